@@ -447,35 +447,56 @@ bool Audit::add_to_filleventqueue(const uint32_t event_id,
     //       in the correct fields.. if not we should add an
     //       event to the audit trail saying it is one in an illegal
     //       format (or missing fields)
-    bool res;
-    Event* new_event = new Event(event_id, payload, length);
-    cb_mutex_enter(&producer_consumer_lock);
-    if (filleventqueue->size() < max_audit_queue) {
-        filleventqueue->push(new_event);
-        cb_cond_broadcast(&events_arrived);
-        res = true;
-    } else {
+    if (++filleventqueue_size > max_audit_queue) {
+        --filleventqueue_size;
         logger->log(EXTENSION_LOG_WARNING, NULL,
-                    "Audit: Dropping audit event %u: %s",
-                    new_event->id, new_event->payload.c_str());
+                    "Audit: Dropping audit event %u: %.*s",
+                    event_id, int(length), payload);
         dropped_events++;
-        delete new_event;
-        res = false;
+        return false;
     }
-    cb_mutex_exit(&producer_consumer_lock);
-    return res;
+
+    push_event(new Event(event_id, payload, length));
+    return true;
 }
 
 
 bool Audit::add_reconfigure_event(const char* configfile, const void *cookie) {
-    ConfigureEvent* new_event = new ConfigureEvent(configfile, cookie);
-    cb_mutex_enter(&producer_consumer_lock);
-    filleventqueue->push(new_event);
-    cb_cond_broadcast(&events_arrived);
-    cb_mutex_exit(&producer_consumer_lock);
+    ++filleventqueue_size;
+    push_event(new ConfigureEvent(configfile, cookie));
     return true;
 }
 
+void Audit::push_event(Event* event) {
+    Event* head = filleventqueue.load();
+    do {
+        event->next = head;
+    } while (!filleventqueue.compare_exchange_weak(head, event));
+
+    if (head == nullptr) {
+        // The consumer may be waiting for the first event
+        cb_mutex_enter(&producer_consumer_lock);
+        cb_cond_broadcast(&events_arrived);
+        cb_mutex_exit(&producer_consumer_lock);
+    }
+}
+
+Event* Audit::take_events(void) {
+    // Reverse the events as they are pushed newest first
+    Event* event = filleventqueue.exchange(nullptr);
+    Event* ret = nullptr;
+    size_t count = 0;
+    while (event != nullptr) {
+        Event* next = event->next;
+        event->next = ret;
+        ret = event;
+        event = next;
+        ++count;
+    }
+    filleventqueue_size -= count;
+    return ret;
+}
+
 
 void Audit::clear_events_map(void) {
     typedef std::map<uint32_t, EventDescriptor*>::iterator it_type;
@@ -487,15 +508,11 @@ void Audit::clear_events_map(void) {
 
 
 void Audit::clear_events_queues(void) {
-    while(!processeventqueue->empty()) {
-        Event *event = processeventqueue->front();
-        processeventqueue->pop();
-        delete event;
-    }
-    while(!filleventqueue->empty()) {
-        Event *event = filleventqueue->front();
-        filleventqueue->pop();
+    Event* event = take_events();
+    while (event != nullptr) {
+        Event* next = event->next;
         delete event;
+        event = next;
     }
 }
 
@@ -20,7 +20,6 @@
 #include <inttypes.h>
 #include <map>
 #include <memory>
-#include <queue>
 #include <atomic>
 
 #include <cJSON.h>
@@ -38,11 +37,13 @@ public:
     AuditConfig config;
     std::map<uint32_t,EventDescriptor*> events;
 
-    // We maintain two Event queues. At any one time one will be used to accept
-    // new events, and the other will be processed. The two queues are swapped
-    // periodically.
-    std::unique_ptr<std::queue<Event*>> processeventqueue;
-    std::unique_ptr<std::queue<Event*>> filleventqueue;
+    // The events not picked up by the consumer thread yet. The producers
+    // push them with a CAS (newest first), and the consumer takes all of
+    // them at once, so that adding an event never blocks. Only the push
+    // onto an empty queue has to wake up the consumer (by broadcasting
+    // events_arrived under the producer_consumer_lock).
+    std::atomic<Event*> filleventqueue;
+    std::atomic<size_t> filleventqueue_size;
 
     bool terminate_audit_daemon;
     std::string configfile;
@@ -59,8 +60,8 @@ public:
     std::atomic<uint32_t> dropped_events;
 
     Audit()
-        : processeventqueue(new std::queue<Event*>()),
-          filleventqueue(new std::queue<Event*>()),
+        : filleventqueue(nullptr),
+          filleventqueue_size(0),
           terminate_audit_daemon(false),
           dropped_events(0),
           max_audit_queue(50000) {
@@ -91,6 +92,19 @@ public:
     }
 
     bool add_reconfigure_event(const char *configfile, const void *cookie);
+
+    /**
+     * Take all the events added to the queue so far
+     *
+     * @return the first event (the others follow by Event::next, in the
+     *         order they were added), or nullptr if there are none
+     */
+    Event* take_events(void);
+
+    bool has_events(void) const {
+        return filleventqueue.load() != nullptr;
+    }
+
     bool create_audit_event(uint32_t event_id, cJSON *payload);
     bool terminate_consumer_thread(void);
     void clear_events_map(void);
@@ -118,6 +132,8 @@ protected:
     } event_state_listener;
 
 private:
+    void push_event(Event* event);
+
     size_t max_audit_queue;
 };
 
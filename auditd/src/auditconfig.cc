@@ -84,6 +84,9 @@ AuditConfig::AuditConfig(const cJSON *json) : AuditConfig() {
     set_rotate_interval(getObject(json, "rotate_interval", cJSON_Number));
     set_auditd_enabled(getObject(json, "auditd_enabled", -1));
     set_buffered(cJSON_GetObjectItem(const_cast<cJSON*>(json), "buffered"));
+    set_fsync_policy(cJSON_GetObjectItem(const_cast<cJSON*>(json), "fsync"));
+    set_log_format(
+            cJSON_GetObjectItem(const_cast<cJSON*>(json), "log_format"));
     set_log_directory(getObject(json, "log_path", cJSON_String));
     set_descriptors_path(getObject(json, "descriptors_path", cJSON_String));
     set_sync(getObject(json, "sync", cJSON_Array));
@@ -95,6 +98,8 @@ AuditConfig::AuditConfig(const cJSON *json) : AuditConfig() {
     tags["rotate_interval"] = 1;
     tags["auditd_enabled"] = 1;
     tags["buffered"] = 1;
+    tags["fsync"] = 1;
+    tags["log_format"] = 1;
     tags["log_path"] = 1;
     tags["descriptors_path"] = 1;
     tags["sync"] = 1;
@@ -159,6 +164,22 @@ bool AuditConfig::is_buffered(void) const {
     return buffered;
 }
 
+void AuditConfig::set_fsync_policy(FsyncPolicy policy) {
+    fsync_policy = policy;
+}
+
+AuditConfig::FsyncPolicy AuditConfig::get_fsync_policy(void) const {
+    return fsync_policy;
+}
+
+void AuditConfig::set_log_format(LogFormat format) {
+    log_format = format;
+}
+
+AuditConfig::LogFormat AuditConfig::get_log_format(void) const {
+    return log_format;
+}
+
 void AuditConfig::set_log_directory(const std::string &directory) {
     std::lock_guard<std::mutex> guard(log_path_mutex);
     /* Sanitize path */
@@ -251,6 +272,50 @@ void AuditConfig::set_buffered(cJSON *obj) {
     }
 }
 
+void AuditConfig::set_fsync_policy(cJSON *obj) {
+    if (obj) {
+        if (obj->type != cJSON_String) {
+            std::stringstream ss;
+            ss << "Incorrect type (" << obj->type
+               << ") for \"fsync\". Should be string";
+            throw ss.str();
+        }
+        const std::string policy(obj->valuestring);
+        if (policy == "none") {
+            set_fsync_policy(FsyncPolicy::None);
+        } else if (policy == "batch") {
+            set_fsync_policy(FsyncPolicy::Batch);
+        } else {
+            std::stringstream ss;
+            ss << "error: \"" << policy << "\" is not a legal value for "
+               << "\"fsync\". Should be \"none\" or \"batch\"";
+            throw ss.str();
+        }
+    }
+}
+
+void AuditConfig::set_log_format(cJSON *obj) {
+    if (obj) {
+        if (obj->type != cJSON_String) {
+            std::stringstream ss;
+            ss << "Incorrect type (" << obj->type
+               << ") for \"log_format\". Should be string";
+            throw ss.str();
+        }
+        const std::string format(obj->valuestring);
+        if (format == "json") {
+            set_log_format(LogFormat::Json);
+        } else if (format == "binary") {
+            set_log_format(LogFormat::Binary);
+        } else {
+            std::stringstream ss;
+            ss << "error: \"" << format << "\" is not a legal value for "
+               << "\"log_format\". Should be \"json\" or \"binary\"";
+            throw ss.str();
+        }
+    }
+}
+
 void AuditConfig::set_log_directory(cJSON *obj) {
     set_log_directory(obj->valuestring);
 }
@@ -295,6 +360,14 @@ unique_cJSON_ptr AuditConfig::to_json() const {
     cJSON_AddNumberToObject(root, "rotate_size", get_rotate_size());
     cJSON_AddNumberToObject(root, "rotate_interval", get_rotate_interval());
     cJSON_AddBoolToObject(root, "buffered", is_buffered());
+    cJSON_AddStringToObject(root, "fsync",
+                            get_fsync_policy() == FsyncPolicy::Batch
+                                    ? "batch"
+                                    : "none");
+    cJSON_AddStringToObject(root, "log_format",
+                            get_log_format() == LogFormat::Binary
+                                    ? "binary"
+                                    : "json");
     cJSON_AddStringToObject(root, "log_path", get_log_directory().c_str());
     cJSON_AddStringToObject(root, "descriptors_path", get_descriptors_path().c_str());
 
@@ -320,6 +393,8 @@ void AuditConfig::initialize_config(const cJSON* json) {
     rotate_interval = other.rotate_interval;
     rotate_size = other.rotate_size;
     buffered = other.buffered;
+    fsync_policy = other.fsync_policy;
+    log_format = other.log_format;
     {
         std::lock_guard<std::mutex> guard(log_path_mutex);
         log_path = other.log_path;
@@ -29,12 +29,31 @@
 
 class AuditConfig {
 public:
+    /**
+     * When the audit trail is synced to the disk (events are always
+     * written out at the end of each batch the daemon processes, this
+     * only controls the fsync which follows):
+     *
+     *   None  - leave it to the operating system
+     *   Batch - fsync after writing each batch
+     */
+    enum class FsyncPolicy { None, Batch };
+
+    /**
+     * The format of the audit trail:
+     *
+     *   Json   - one JSON document per line (audit.log)
+     *   Binary - compact binary records (audit.bin), see auditrecord.h
+     */
+    enum class LogFormat { Json, Binary };
 
     AuditConfig(void) :
         auditd_enabled(false),
         rotate_interval(900),
         rotate_size(20 * 1024 * 1024),
         buffered(true),
+        fsync_policy(FsyncPolicy::None),
+        log_format(LogFormat::Json),
         min_file_rotation_time(900), // 15 minutes
         max_file_rotation_time(604800), // 1 week
         max_rotate_file_size(500 * 1024 * 1024)
@@ -65,6 +84,10 @@ public:
     uint32_t get_rotate_interval(void) const;
     void set_buffered(bool enable);
     bool is_buffered(void) const;
+    void set_fsync_policy(FsyncPolicy policy);
+    FsyncPolicy get_fsync_policy(void) const;
+    void set_log_format(LogFormat format);
+    LogFormat get_log_format(void) const;
     void set_log_directory(const std::string &directory);
     std::string get_log_directory(void) const;
     void set_descriptors_path(const std::string &directory);
@@ -105,6 +128,8 @@ protected:
     void set_rotate_interval(cJSON *obj);
     void set_auditd_enabled(cJSON *obj);
     void set_buffered(cJSON *obj);
+    void set_fsync_policy(cJSON *obj);
+    void set_log_format(cJSON *obj);
     void set_log_directory(cJSON *obj);
     void set_descriptors_path(cJSON *obj);
     void add_array(std::vector<uint32_t> &vec, cJSON *array, const char *name);
@@ -115,6 +140,8 @@ protected:
     Couchbase::RelaxedAtomic<uint32_t> rotate_interval;
     Couchbase::RelaxedAtomic<size_t> rotate_size;
     Couchbase::RelaxedAtomic<bool> buffered;
+    Couchbase::RelaxedAtomic<FsyncPolicy> fsync_policy;
+    Couchbase::RelaxedAtomic<LogFormat> log_format;
 
     mutable std::mutex log_path_mutex;
     std::string log_path;
@@ -45,30 +45,31 @@ static void consume_events(void* arg) {
 
     cb_mutex_enter(&audit.producer_consumer_lock);
     while (!audit.terminate_audit_daemon) {
-        if (audit.filleventqueue->empty()) {
+        if (!audit.has_events()) {
             cb_cond_timedwait(&audit.events_arrived,
                               &audit.producer_consumer_lock,
                               audit.auditfile.get_seconds_to_rotation() * 1000);
-            if (audit.filleventqueue->empty()) {
+            if (!audit.has_events()) {
                 // We timed out, so just rotate the files
                 audit.auditfile.maybe_rotate_files();
             }
         }
-        /* now have producer_consumer lock!
-         * event(s) have arrived or shutdown requested
+        /* event(s) have arrived or shutdown requested. The producers
+         * only need the producer_consumer_lock to wake us up, so it
+         * isn't held while processing the batch
          */
-        swap(audit.processeventqueue, audit.filleventqueue);
         cb_mutex_exit(&audit.producer_consumer_lock);
-        // Now outside of the producer_consumer_lock
 
-        while (!audit.processeventqueue->empty()) {
-            Event* event = audit.processeventqueue->front();
+        Event* event = audit.take_events();
+        while (event != nullptr) {
+            Event* next = event->next;
             if (!event->process(audit)) {
                 audit.dropped_events++;
             }
-            audit.processeventqueue->pop();
             delete event;
+            event = next;
         }
+        // Write the whole batch out
         audit.auditfile.flush();
         cb_mutex_enter(&audit.producer_consumer_lock);
     }
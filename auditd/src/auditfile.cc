@@ -24,9 +24,15 @@
 #include <memcached/isotime.h>
 #include <JSON_checker.h>
 #include <fstream>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "auditd.h"
 #include "audit.h"
 #include "auditfile.h"
+#include "auditrecord.h"
 
 #ifdef UNITTEST_AUDITFILE
 #define log_error(a,b)
@@ -95,7 +101,8 @@ bool AuditFile::open(void) {
     cb_assert(open_time == 0);
 
     std::stringstream ss;
-    ss << log_directory << DIRECTORY_SEPARATOR_CHARACTER << "audit.log";
+    ss << log_directory << DIRECTORY_SEPARATOR_CHARACTER
+       << (is_binary() ? "audit.bin" : "audit.log");
     open_file_name = ss.str();
     file = fopen(open_file_name.c_str(), "wb");
     if (file == NULL) {
@@ -104,12 +111,28 @@ bool AuditFile::open(void) {
     }
     current_size = 0;
     open_time = auditd_time();
+
+    if (is_binary()) {
+        // The header doesn't count in current_size, so that a file
+        // without any events is still removed when closed
+        AuditFileHeader header;
+        memcpy(header.magic, audit_binary_magic, sizeof(header.magic));
+        header.open_time = htonll(uint64_t(open_time));
+        buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
     return true;
 }
 
 
 void AuditFile::close_and_rotate_log(void) {
     cb_assert(file != NULL);
+    if (!buffer.empty()) {
+        if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+            log_error(AuditErrorCode::WRITING_TO_DISK_ERROR,
+                      strerror(errno));
+        }
+        buffer.clear();
+    }
     fclose(file);
     file = NULL;
     if (current_size == 0) {
@@ -136,7 +159,7 @@ void AuditFile::close_and_rotate_log(void) {
             archive_file << "-" << count;
         }
 
-        archive_file << "-audit.log";
+        archive_file << (is_binary() ? "-audit.bin" : "-audit.log");
         fname.assign(archive_file.str());
         ++count;
     } while (file_exists(fname));
@@ -148,7 +171,59 @@ void AuditFile::close_and_rotate_log(void) {
 }
 
 
+void AuditFile::cleanup_old_binary_logfile(const std::string& log_path) {
+    std::stringstream file;
+    file << log_path << DIRECTORY_SEPARATOR_CHARACTER << "audit.bin";
+    std::string filename = file.str();
+
+    if (!file_exists(filename)) {
+        return;
+    }
+
+    // The file may be cut short anywhere by a crash, but a file which
+    // is too short for the header can't contain any events either
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    AuditFileHeader header;
+    bool empty = true;
+    if (in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        if (!header.is_valid()) {
+            std::stringstream ss;
+            ss << "Audit: Incorrect header in audit file \""
+               << filename << "\"";
+            throw ss.str();
+        }
+        empty = in.peek() == std::ifstream::traits_type::eof();
+    }
+    in.close();
+
+    if (empty) {
+        // no events, just remove it.
+        if (remove(filename.c_str()) != 0) {
+            std::stringstream ss;
+            ss << "Audit: Failed to remove \"" << filename << "\": "
+               << strerror(errno);
+            throw ss.str();
+        }
+        return;
+    }
+
+    const time_t opened = time_t(ntohll(header.open_time));
+    std::string ts = ISOTime::generatetimestamp(opened, 0).substr(0, 19);
+    std::replace(ts.begin(), ts.end(), ':', '-');
+    std::stringstream archive_file;
+    archive_file << log_path << DIRECTORY_SEPARATOR_CHARACTER
+                 << my_hostname << "-" << ts << "-audit.bin";
+    if (rename(filename.c_str(), archive_file.str().c_str()) != 0) {
+        std::stringstream ss;
+        ss << "Audit: failed to rename \"" << filename << "\" to \""
+           << archive_file.str() << "\": " << strerror(errno);
+        throw ss.str();
+    }
+}
+
 void AuditFile::cleanup_old_logfile(const std::string& log_path) {
+    cleanup_old_binary_logfile(log_path);
+
     std::stringstream file;
     file << log_path << DIRECTORY_SEPARATOR_CHARACTER << "audit.log";
     std::string filename = file.str();
@@ -249,23 +324,79 @@ void AuditFile::cleanup_old_logfile(const std::string& log_path) {
 
 bool AuditFile::write_event_to_disk(cJSON *output) {
     char *content = cJSON_PrintUnformatted(output);
-    bool ret = true;
-    if (content) {
-        current_size += fprintf(file, "%s\n", content);
-        if (ferror(file)) {
-            log_error(AuditErrorCode::WRITING_TO_DISK_ERROR, strerror(errno));
-            ret = false;
-            close_and_rotate_log();
-        } else if (!buffered) {
-            ret = flush();
-        }
-        cJSON_Free(content);
-    } else {
+    if (content == nullptr) {
         log_error(AuditErrorCode::MEMORY_ALLOCATION_ERROR,
                   "failed to convert audit event");
+        return true;
     }
 
-    return ret;
+    const size_t before = buffer.size();
+    buffer.append(content);
+    buffer.push_back('\n');
+    current_size += buffer.size() - before;
+    cJSON_Free(content);
+
+    return appended_to_buffer();
+}
+
+bool AuditFile::write_binary_event_to_disk(uint32_t id,
+                                           const std::string& payload) {
+    struct timeval tv;
+    cb_get_timeofday(&tv);
+
+    AuditRecordHeader header;
+    header.length = htonl(uint32_t(payload.size()));
+    header.id = htonl(id);
+    header.timestamp =
+            htonll(uint64_t(tv.tv_sec) * 1000000 + uint64_t(tv.tv_usec));
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.append(payload);
+    current_size += sizeof(header) + payload.size();
+
+    return appended_to_buffer();
+}
+
+bool AuditFile::appended_to_buffer(void) {
+    if (!buffered) {
+        return flush();
+    }
+    if (buffer.size() >= max_buffer_size) {
+        return write_buffer();
+    }
+    return true;
+}
+
+bool AuditFile::write_buffer(void) {
+    if (buffer.empty()) {
+        return true;
+    }
+
+    const size_t nw = fwrite(buffer.data(), 1, buffer.size(), file);
+    const bool failed = nw != buffer.size() || ferror(file);
+    buffer.clear();
+    if (failed) {
+        log_error(AuditErrorCode::WRITING_TO_DISK_ERROR, strerror(errno));
+        close_and_rotate_log();
+        return false;
+    }
+    return true;
+}
+
+bool AuditFile::sync(void) {
+#ifdef WIN32
+    const int ret = _commit(_fileno(file));
+#else
+    int ret;
+    while ((ret = fsync(fileno(file))) == -1 && errno == EINTR) {
+        /* Retry */
+    }
+#endif
+    if (ret == -1) {
+        log_error(AuditErrorCode::WRITING_TO_DISK_ERROR, strerror(errno));
+        close_and_rotate_log();
+        return false;
+    }
+    return true;
 }
 
 
@@ -292,20 +423,34 @@ void AuditFile::set_log_directory(const std::string &new_directory) {
 }
 
 void AuditFile::reconfigure(const AuditConfig &config) {
+    if (config.get_log_format() != log_format) {
+        // The open file is in the old format
+        if (file != NULL) {
+            close_and_rotate_log();
+        }
+        log_format = config.get_log_format();
+    }
     rotate_interval = config.get_rotate_interval();
     set_log_directory(config.get_log_directory());
     max_log_size = config.get_rotate_size();
     buffered = config.is_buffered();
+    fsync_policy = config.get_fsync_policy();
 }
 
 bool AuditFile::flush(void) {
     if (is_open()) {
+        if (!write_buffer()) {
+            return false;
+        }
         if (fflush(file) != 0) {
             log_error(AuditErrorCode::WRITING_TO_DISK_ERROR,
                       strerror(errno));
             close_and_rotate_log();
             return false;
         }
+        if (fsync_policy == AuditConfig::FsyncPolicy::Batch && !sync()) {
+            return false;
+        }
     }
 
     return true;
@@ -25,8 +25,16 @@
 #include "auditconfig.h"
 #include "auditd.h"
 
+/**
+ * The audit trail. The events are serialized into an in-memory buffer,
+ * which is written to the file in one go when it is flushed (at the end
+ * of each batch of events, unless buffering is disabled), or when it
+ * grows beyond max_buffer_size.
+ */
 class AuditFile {
 public:
+    /// The pending events are written out once they get this big
+    static const size_t max_buffer_size = 64 * 1024;
 
     AuditFile(void) :
         file(NULL),
@@ -34,7 +42,9 @@ public:
         current_size(0),
         max_log_size(20 * 1024 * 1024),
         rotate_interval(900),
-        buffered(true)
+        buffered(true),
+        fsync_policy(AuditConfig::FsyncPolicy::None),
+        log_format(AuditConfig::LogFormat::Json)
     {
     }
 
@@ -81,22 +91,41 @@ public:
     }
 
     /**
-     * Look in the log directory if a file named "audit.log" exists
-     * and try to move it to the correct name. This method is
-     * used during startup for "crash recovery".
+     * Look in the log directory if a file named "audit.log" (or
+     * "audit.bin") exists and try to move it to the correct name.
+     * This method is used during startup for "crash recovery".
      *
      * @param log_path the directory to search
      */
     void cleanup_old_logfile(const std::string& log_path);
 
     /**
-     * Write a json formatted object to the disk
+     * Serialize a json formatted object to the audit trail. The event is
+     * added to the pending buffer, and only written to the disk when
+     * the buffer is flushed (straight away if buffering is disabled)
      *
      * @param output the data to write
      * @return true if success, false otherwise
      */
     bool write_event_to_disk(cJSON *output);
 
+    /**
+     * Add an event to the binary audit trail (see auditrecord.h). The
+     * payload is stored as is, so it is up to the reader to validate it
+     *
+     * @param id the id of the event
+     * @param payload the payload of the event
+     * @return true if success, false otherwise
+     */
+    bool write_binary_event_to_disk(uint32_t id, const std::string& payload);
+
+    /**
+     * Is the audit trail written in the binary format?
+     */
+    bool is_binary(void) const {
+        return log_format == AuditConfig::LogFormat::Binary;
+    }
+
     /**
      * Check for a file existence
      *
@@ -119,7 +148,8 @@ public:
     void reconfigure(const AuditConfig &config);
 
     /**
-     * Flush the buffers to the disk
+     * Write the pending events to the file and flush the buffers to the
+     * disk (followed by an fsync if the fsync policy says so)
      */
     bool flush(void);
 
@@ -137,10 +167,14 @@ public:
 
 private:
     bool open(void);
+    bool appended_to_buffer(void);
+    bool write_buffer(void);
+    bool sync(void);
     bool time_to_rotate_log(void) const;
     void close_and_rotate_log(void);
     void set_log_directory(const std::string &new_directory);
     bool is_timestamp_format_correct(std::string& str);
+    void cleanup_old_binary_logfile(const std::string& log_path);
 
     static time_t auditd_time();
 
@@ -152,6 +186,11 @@ private:
     size_t max_log_size;
     uint32_t rotate_interval;
     bool buffered;
+    AuditConfig::FsyncPolicy fsync_policy;
+    AuditConfig::LogFormat log_format;
+
+    /// The serialized events not written to the file yet
+    std::string buffer;
 };
 
 #endif
@@ -0,0 +1,64 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#ifndef AUDITRECORD_H
+#define AUDITRECORD_H
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * The layout of the binary audit trail (the "binary" log_format).
+ *
+ * The file starts with an AuditFileHeader, followed by one record per
+ * event: an AuditRecordHeader followed by the payload of the event,
+ * exactly as it was submitted (a JSON document). The fields added to the
+ * JSON audit trail (the id, name and description of the event, and the
+ * timestamp if the payload doesn't have one) are only rendered by
+ * mcauditconv, so that writing an event is little more than a memcpy.
+ *
+ * All the numbers are stored in network byte order.
+ */
+
+/// The magic the file starts with (and the version of the format)
+static const char audit_binary_magic[8] = {'c', 'b', 'a', 'u',
+                                           'd', 'i', 't', 1};
+
+struct AuditFileHeader {
+    char magic[8];
+    /// When the file was opened (seconds since the epoch), for naming it
+    uint64_t open_time;
+
+    bool is_valid() const {
+        return memcmp(magic, audit_binary_magic, sizeof(magic)) == 0;
+    }
+};
+
+struct AuditRecordHeader {
+    /// The number of bytes of the payload following the header
+    uint32_t length;
+    /// The id of the event
+    uint32_t id;
+    /// When the event was written (microseconds since the epoch)
+    uint64_t timestamp;
+};
+
+static_assert(sizeof(AuditFileHeader) == 16,
+              "AuditFileHeader should not have any padding");
+static_assert(sizeof(AuditRecordHeader) == 16,
+              "AuditRecordHeader should not have any padding");
+
+#endif
@@ -28,6 +28,10 @@ bool Event::process(Audit& audit) {
         return true;
     }
 
+    if (audit.auditfile.is_binary()) {
+        return process_binary(audit);
+    }
+
     // convert the event.payload into JSON
     cJSON *json_payload = cJSON_Parse(payload.c_str());
     if (json_payload == NULL) {
@@ -75,3 +79,29 @@ bool Event::process(Audit& audit) {
         return false;
     }
 }
+
+bool Event::process_binary(Audit& audit) {
+    // The payload is stored as is, so the fields added to the JSON audit
+    // trail are rendered when the trail is converted (by mcauditconv)
+    auto evt = audit.events.find(id);
+    if (evt == audit.events.end()) {
+        // it is an unknown event
+        Audit::log_error(AuditErrorCode::UNKNOWN_EVENT_ERROR,
+                         std::to_string(id));
+        return false;
+    }
+    if (!evt->second->isEnabled()) {
+        // the event is not enabled so ignore event
+        return true;
+    }
+    if (!audit.auditfile.ensure_open()) {
+        Audit::log_error(AuditErrorCode::OPEN_AUDITFILE_ERROR);
+        return false;
+    }
+
+    if (!audit.auditfile.write_binary_event_to_disk(id, payload)) {
+        Audit::log_error(AuditErrorCode::WRITE_EVENT_TO_DISK_ERROR);
+        return false;
+    }
+    return true;
+}
@@ -27,6 +27,9 @@ public:
     const uint32_t id;
     const std::string payload;
 
+    /// The next event in the queue of the audit daemon (see Audit)
+    Event* next = nullptr;
+
     // Constructor required for ConfigureEvent
     Event()
         : id(0) {}
@@ -38,6 +41,9 @@ public:
 
     virtual bool process(Audit& audit);
 
+    /// Add the event to the binary audit trail
+    bool process_binary(Audit& audit);
+
     virtual ~Event() {}
 
 };
@@ -256,6 +256,69 @@ TEST_F(AuditConfigTest, TestLegalBuffered) {
     EXPECT_NO_THROW(config.initialize_config(json));
 }
 
+// fsync
+
+TEST_F(AuditConfigTest, TestNoFsync) {
+    // fsync is optional, and left to the OS unless explicitly set
+    EXPECT_NO_THROW(config.initialize_config(json));
+    EXPECT_EQ(AuditConfig::FsyncPolicy::None, config.get_fsync_policy());
+}
+
+TEST_F(AuditConfigTest, TestGetSetFsync) {
+    config.set_fsync_policy(AuditConfig::FsyncPolicy::Batch);
+    EXPECT_EQ(AuditConfig::FsyncPolicy::Batch, config.get_fsync_policy());
+    config.set_fsync_policy(AuditConfig::FsyncPolicy::None);
+    EXPECT_EQ(AuditConfig::FsyncPolicy::None, config.get_fsync_policy());
+}
+
+TEST_F(AuditConfigTest, TestIllegalDatatypeFsync) {
+    cJSON_AddTrueToObject(json, "fsync");
+    EXPECT_THROW(config.initialize_config(json), std::string);
+}
+
+TEST_F(AuditConfigTest, TestIllegalValueFsync) {
+    cJSON_AddStringToObject(json, "fsync", "always");
+    EXPECT_THROW(config.initialize_config(json), std::string);
+}
+
+TEST_F(AuditConfigTest, TestLegalFsync) {
+    cJSON_AddStringToObject(json, "fsync", "batch");
+    EXPECT_NO_THROW(config.initialize_config(json));
+    EXPECT_EQ(AuditConfig::FsyncPolicy::Batch, config.get_fsync_policy());
+
+    cJSON_ReplaceItemInObject(json, "fsync", cJSON_CreateString("none"));
+    EXPECT_NO_THROW(config.initialize_config(json));
+    EXPECT_EQ(AuditConfig::FsyncPolicy::None, config.get_fsync_policy());
+}
+
+// log_format
+
+TEST_F(AuditConfigTest, TestNoLogFormat) {
+    // log_format is optional, and JSON unless explicitly set
+    EXPECT_NO_THROW(config.initialize_config(json));
+    EXPECT_EQ(AuditConfig::LogFormat::Json, config.get_log_format());
+}
+
+TEST_F(AuditConfigTest, TestIllegalDatatypeLogFormat) {
+    cJSON_AddNumberToObject(json, "log_format", 1);
+    EXPECT_THROW(config.initialize_config(json), std::string);
+}
+
+TEST_F(AuditConfigTest, TestIllegalValueLogFormat) {
+    cJSON_AddStringToObject(json, "log_format", "xml");
+    EXPECT_THROW(config.initialize_config(json), std::string);
+}
+
+TEST_F(AuditConfigTest, TestLegalLogFormat) {
+    cJSON_AddStringToObject(json, "log_format", "binary");
+    EXPECT_NO_THROW(config.initialize_config(json));
+    EXPECT_EQ(AuditConfig::LogFormat::Binary, config.get_log_format());
+
+    cJSON_ReplaceItemInObject(json, "log_format", cJSON_CreateString("json"));
+    EXPECT_NO_THROW(config.initialize_config(json));
+    EXPECT_EQ(AuditConfig::LogFormat::Json, config.get_log_format());
+}
+
 // log_path
 TEST_F(AuditConfigTest, TestNoLogPath) {
     cJSON *obj = cJSON_DetachItemFromObject(json, "log_path");
@@ -0,0 +1,133 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmark the audit events per second the worker threads can submit
+ * to a running audit daemon (like memcached does with data-access
+ * auditing enabled), while its consumer thread writes them to the audit
+ * trail. The events dropped because the queue was full are reported
+ * with the "dropped" counter.
+ */
+
+#include "config.h"
+
+#include <benchmark/benchmark.h>
+#include <memcached/audit_interface.h>
+#include <memcached/extension_loggers.h>
+#include <platform/dirutils.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include "audit.h"
+#include "auditconfig.h"
+#include "auditd_audit_events.h"
+
+static std::mutex mutex;
+static std::condition_variable cond;
+static bool ready = false;
+
+static Audit* auditHandle;
+
+extern "C" {
+static void notify_io_complete(const void*, ENGINE_ERROR_CODE) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready = true;
+    cond.notify_one();
+}
+}
+
+static bool configure(const std::string& cfgfile) {
+    switch (configure_auditdaemon(auditHandle, cfgfile.c_str(), &ready)) {
+    case AUDIT_SUCCESS:
+        return true;
+    case AUDIT_EWOULDBLOCK: {
+        std::unique_lock<std::mutex> lk(mutex);
+        cond.wait(lk, [] { return ready; });
+        ready = false;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+void PutAuditEventBenchmark(benchmark::State& state) {
+    const std::string payload =
+            "{\"timestamp\":\"2017-06-06T10:15:01.123456+01:00\","
+            "\"real_userid\":{\"source\":\"memcached\",\"user\":\"bench\"},"
+            "\"peername\":\"127.0.0.1:50000\","
+            "\"sockname\":\"127.0.0.1:11210\","
+            "\"bucket\":\"default\",\"key\":\"key-0000000042\"}";
+    const uint32_t dropped = auditHandle->dropped_events;
+
+    while (state.KeepRunning()) {
+        put_audit_event(auditHandle, AUDITD_AUDIT_CONFIGURED_AUDIT_DAEMON,
+                        payload.data(), payload.size());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index == 0) {
+        state.counters["dropped"] = auditHandle->dropped_events - dropped;
+    }
+}
+
+BENCHMARK(PutAuditEventBenchmark)->ThreadRange(1, 16)->UseRealTime();
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+    // required for gethostname(); normally called by memcached's main()
+    cb_initialize_sockets();
+
+    const std::string testdir =
+            "auditd-benchmark-" + std::to_string(cb_getpid());
+    const std::string cfgfile = testdir + ".json";
+    cb::io::mkdirp(testdir);
+
+    AuditConfig config;
+    config.set_descriptors_path(OBJECT_ROOT "/auditd");
+    config.set_log_directory(testdir);
+    config.set_auditd_enabled(true);
+    FILE* fp = fopen(cfgfile.c_str(), "w");
+    if (fp == nullptr) {
+        std::cerr << "Failed to create " << cfgfile << std::endl;
+        return EXIT_FAILURE;
+    }
+    fprintf(fp, "%s\n", to_string(config.to_json()).c_str());
+    fclose(fp);
+
+    AUDIT_EXTENSION_DATA audit_extension_data;
+    memset(&audit_extension_data, 0, sizeof(audit_extension_data));
+    audit_extension_data.log_extension = get_stderr_logger();
+    audit_extension_data.notify_io_complete = notify_io_complete;
+    if (start_auditdaemon(&audit_extension_data, &auditHandle) !=
+                AUDIT_SUCCESS ||
+        !configure(cfgfile)) {
+        std::cerr << "Failed to start the audit daemon" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ::benchmark::RunSpecifiedBenchmarks();
+
+    shutdown_auditdaemon(auditHandle);
+    cb::io::rmrf(testdir);
+    cb::io::rmrf(cfgfile);
+    return EXIT_SUCCESS;
+}
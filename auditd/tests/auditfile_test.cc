@@ -17,14 +17,17 @@
 #include <platform/dirutils.h>
 
 #include "auditfile.h"
+#include "auditrecord.h"
 #include <iostream>
 #include <map>
 #include <atomic>
 #include <cstring>
+#include <fstream>
 #include <time.h>
 #include <gtest/gtest.h>
 #include <platform/platform.h>
 
+using cb::io::findFilesContaining;
 using cb::io::findFilesWithPrefix;
 
 class AuditFileTest : public ::testing::Test {
@@ -59,6 +62,16 @@ protected:
         cJSON_AddItemToObject(root, "real_userid", source);
         return root;
     }
+
+    int countLines(const std::string& fname) {
+        std::ifstream file(fname);
+        std::string line;
+        int count = 0;
+        while (std::getline(file, line)) {
+            ++count;
+        }
+        return count;
+    }
 };
 
 /**
@@ -163,6 +176,149 @@ TEST_F(AuditFileTest, TestRollover) {
                 secs == (defaultvalue.get_min_file_rotation_time() - 11));
 }
 
+/**
+ * Test that the events are only written to the file when it is
+ * flushed (at the end of each batch) when buffering is enabled
+ */
+TEST_F(AuditFileTest, TestBufferedWrites) {
+    config.set_buffered(true);
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+
+    for (int ii = 0; ii < 10; ++ii) {
+        auditfile.ensure_open();
+        EXPECT_TRUE(auditfile.write_event_to_disk(event));
+    }
+    EXPECT_EQ(0, countLines(testdir + "/audit.log"));
+
+    EXPECT_TRUE(auditfile.flush());
+    EXPECT_EQ(10, countLines(testdir + "/audit.log"));
+}
+
+/**
+ * Test that each event is written straight away when buffering
+ * is disabled (and that we may fsync the file)
+ */
+TEST_F(AuditFileTest, TestUnbufferedWrites) {
+    config.set_buffered(false);
+    config.set_fsync_policy(AuditConfig::FsyncPolicy::Batch);
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+
+    for (int ii = 0; ii < 10; ++ii) {
+        auditfile.ensure_open();
+        EXPECT_TRUE(auditfile.write_event_to_disk(event));
+        EXPECT_EQ(ii + 1, countLines(testdir + "/audit.log"));
+    }
+}
+
+/**
+ * Test that the pending events are written out when the file is
+ * closed
+ */
+TEST_F(AuditFileTest, TestCloseWritesPendingEvents) {
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+
+    for (int ii = 0; ii < 10; ++ii) {
+        auditfile.ensure_open();
+        auditfile.write_event_to_disk(event);
+    }
+    auditfile.close();
+
+    auto files = findFilesWithPrefix(testdir + "/testing");
+    ASSERT_EQ(1, files.size());
+    EXPECT_EQ(10, countLines(files.front()));
+}
+
+/**
+ * Test that the events of the binary audit trail are stored as they
+ * were submitted, following the header of the file
+ */
+TEST_F(AuditFileTest, TestBinaryFormat) {
+    config.set_log_format(AuditConfig::LogFormat::Binary);
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+    EXPECT_TRUE(auditfile.is_binary());
+
+    const std::string payload = to_string(event, false);
+    for (uint32_t ii = 0; ii < 10; ++ii) {
+        auditfile.ensure_open();
+        EXPECT_TRUE(auditfile.write_binary_event_to_disk(4096 + ii, payload));
+    }
+    auditfile.close();
+
+    auto files = findFilesWithPrefix(testdir + "/testing");
+    ASSERT_EQ(1, files.size());
+    EXPECT_NE(std::string::npos, files.front().find("-audit.bin"));
+
+    std::ifstream in(files.front(), std::ios::in | std::ios::binary);
+    AuditFileHeader fileheader;
+    ASSERT_TRUE(in.read(reinterpret_cast<char*>(&fileheader),
+                        sizeof(fileheader)));
+    EXPECT_TRUE(fileheader.is_valid());
+    for (uint32_t ii = 0; ii < 10; ++ii) {
+        AuditRecordHeader header;
+        ASSERT_TRUE(in.read(reinterpret_cast<char*>(&header),
+                            sizeof(header)));
+        EXPECT_EQ(4096 + ii, ntohl(header.id));
+        ASSERT_EQ(payload.size(), ntohl(header.length));
+        std::string data(payload.size(), '\0');
+        ASSERT_TRUE(in.read(&data[0], data.size()));
+        EXPECT_EQ(payload, data);
+    }
+    EXPECT_EQ(std::ifstream::traits_type::eof(), in.peek());
+}
+
+/**
+ * Test that changing the format closes the file in the old format
+ */
+TEST_F(AuditFileTest, TestChangeFormat) {
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+    auditfile.ensure_open();
+    auditfile.write_event_to_disk(event);
+
+    config.set_log_format(AuditConfig::LogFormat::Binary);
+    auditfile.reconfigure(config);
+    EXPECT_FALSE(auditfile.is_open());
+    auditfile.ensure_open();
+    auditfile.write_binary_event_to_disk(4096, to_string(event, false));
+    auditfile.close();
+
+    EXPECT_EQ(1, findFilesContaining(testdir, "-audit.log").size());
+    EXPECT_EQ(1, findFilesContaining(testdir, "-audit.bin").size());
+}
+
+TEST_F(AuditFileTest, TestBinaryCrashRecovery) {
+    FILE *fp = fopen((testdir + "/audit.bin").c_str(), "wb");
+    ASSERT_TRUE(fp != nullptr);
+    AuditFileHeader fileheader;
+    memcpy(fileheader.magic, audit_binary_magic, sizeof(fileheader.magic));
+    // 2015-03-13T09:36:00Z
+    fileheader.open_time = htonll(1426239360);
+    fwrite(&fileheader, sizeof(fileheader), 1, fp);
+    fprintf(fp, "truncated record");
+    fclose(fp);
+
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+    EXPECT_NO_THROW(auditfile.cleanup_old_logfile(testdir));
+    EXPECT_EQ(1, findFilesContaining(testdir, "-audit.bin").size());
+    EXPECT_EQ(0, findFilesWithPrefix(testdir + "/audit").size());
+}
+
+TEST_F(AuditFileTest, TestBinaryCrashRecoveryEmptyFile) {
+    FILE *fp = fopen((testdir + "/audit.bin").c_str(), "wb");
+    ASSERT_TRUE(fp != nullptr);
+    fclose(fp);
+
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+    EXPECT_NO_THROW(auditfile.cleanup_old_logfile(testdir));
+    EXPECT_EQ(0, findFilesContaining(testdir, "").size());
+}
+
 TEST_F(AuditFileTest, TestSuccessfulCrashRecovery) {
     FILE *fp = fopen((testdir + "/audit.log").c_str(), "w");
     EXPECT_TRUE(fp != nullptr);
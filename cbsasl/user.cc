@@ -20,7 +20,9 @@
 #include "cbsasl_internal.h"
 
 #include <atomic>
+#include <chrono>
 #include <iterator>
+#include <mutex>
 #include <platform/base64.h>
 #include <platform/random.h>
 #include <stdexcept>
@@ -88,38 +90,104 @@ cb::sasl::User cb::sasl::UserFactory::create(const std::string& unm,
     return ret;
 }
 
-cb::sasl::User cb::sasl::UserFactory::createDummy(const std::string& unm,
-                                                    const Mechanism& mech) {
-    User ret{unm};
+namespace {
+/**
+ * The secrets handed to the SCRAM authentications of unknown users.
+ *
+ * Deriving them from a random password (like a real user's) cost a full
+ * PBKDF2 run for every attempt, so a client retrying with a bad username
+ * (or a burst of guessed ones) kept the threads running the
+ * authentications busy. Instead each mechanism has a random salted
+ * password, replaced every rotationInterval, and the salt is an HMAC of
+ * the username: the same unknown user always gets the same salt (as a
+ * real user does), different ones get different salts, and it costs an
+ * HMAC instead of the iteration count of them.
+ */
+class DummySecrets {
+public:
+    static const std::chrono::minutes rotationInterval;
+
+    cb::sasl::User::PasswordMetaData get(Mechanism mech,
+                                         const std::string& username) {
+        cb::crypto::Algorithm algorithm = cb::crypto::Algorithm::SHA1;
+        size_t size = 0;
+        switch (mech) {
+        case Mechanism::SCRAM_SHA512:
+            algorithm = cb::crypto::Algorithm::SHA512;
+            size = cb::crypto::SHA512_DIGEST_SIZE;
+            break;
+        case Mechanism::SCRAM_SHA256:
+            algorithm = cb::crypto::Algorithm::SHA256;
+            size = cb::crypto::SHA256_DIGEST_SIZE;
+            break;
+        case Mechanism::SCRAM_SHA1:
+            algorithm = cb::crypto::Algorithm::SHA1;
+            size = cb::crypto::SHA1_DIGEST_SIZE;
+            break;
+        case Mechanism::PLAIN:
+        case Mechanism::UNKNOWN:
+            break;
+        }
 
-    std::vector<uint8_t> salt;
-    std::string passwd;
+        if (size == 0) {
+            throw std::logic_error(
+                    "cb::cbsasl::UserFactory::createDummy invalid algorithm");
+        }
 
-    switch (mech) {
-    case Mechanism::SCRAM_SHA512:
-        salt.resize(cb::crypto::SHA512_DIGEST_SIZE);
-        break;
-    case Mechanism::SCRAM_SHA256:
-        salt.resize(cb::crypto::SHA256_DIGEST_SIZE);
-        break;
-    case Mechanism::SCRAM_SHA1:
-        salt.resize(cb::crypto::SHA1_DIGEST_SIZE);
-        break;
-    case Mechanism::PLAIN:
-    case Mechanism::UNKNOWN:
-        throw std::logic_error("cb::cbsasl::UserFactory::createDummy invalid algorithm");
-    }
+        std::vector<uint8_t> key;
+        std::vector<uint8_t> saltedPassword;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (saltKey.empty()) {
+                std::string encoded;
+                saltKey.resize(cb::crypto::SHA512_DIGEST_SIZE);
+                generateSalt(saltKey, encoded);
+            }
+            auto& secret = secrets[mech];
+            const auto now = std::chrono::steady_clock::now();
+            if (secret.password.empty() ||
+                now - secret.created >= rotationInterval) {
+                std::string encoded;
+                secret.password.resize(size);
+                generateSalt(secret.password, encoded);
+                secret.created = now;
+            }
+            key = saltKey;
+            saltedPassword = secret.password;
+        }
 
-    if (salt.empty()) {
-        throw std::logic_error("cb::cbsasl::UserFactory::createDummy invalid algorithm");
+        const std::vector<uint8_t> name(username.begin(), username.end());
+        // The digest has the size of the salts of the real users
+        const auto salt = cb::crypto::HMAC(algorithm, key, name);
+
+        using Couchbase::Base64::encode;
+        return {std::string((const char*)saltedPassword.data(),
+                            saltedPassword.size()),
+                encode(std::string((const char*)salt.data(), salt.size())),
+                IterationCount};
     }
 
-    // Generate a random password
-    generateSalt(salt, passwd);
+private:
+    struct Secret {
+        std::vector<uint8_t> password;
+        std::chrono::steady_clock::time_point created;
+    };
+
+    std::mutex mutex;
+    // The key of the HMAC of the usernames giving their salts
+    std::vector<uint8_t> saltKey;
+    std::map<Mechanism, Secret> secrets;
+};
 
-    // Generate the secrets by using that random password
-    ret.generateSecrets(mech, passwd);
+const std::chrono::minutes DummySecrets::rotationInterval{60};
+}
 
+cb::sasl::User cb::sasl::UserFactory::createDummy(const std::string& unm,
+                                                    const Mechanism& mech) {
+    static DummySecrets dummySecrets;
+
+    User ret{unm};
+    ret.password[mech] = dummySecrets.get(mech, unm);
     return ret;
 }
 
@@ -80,3 +80,25 @@ int DummyAllocHooks::set_allocator_property(const char* name,
                                             size_t newlen) {
     return 1;
 }
+
+bool DummyAllocHooks::get_allocation_utilization(const void* ptr,
+                                                 allocator_utilization* util) {
+    return false;
+}
+
+bool DummyAllocHooks::create_arena(unsigned* arena) {
+    return false;
+}
+
+bool DummyAllocHooks::set_thread_arena(unsigned arena) {
+    return false;
+}
+
+bool DummyAllocHooks::get_arena_stats(unsigned arena,
+                                      allocator_arena_stats* stats) {
+    return false;
+}
+
+void DummyAllocHooks::purge_arena(unsigned arena) {
+    // empty
+}
@@ -204,3 +204,109 @@ int JemallocHooks::set_allocator_property(const char* name,
                                           size_t newlen) {
     return je_mallctl(name, nullptr, 0, newp, newlen);
 }
+
+bool JemallocHooks::get_allocation_utilization(const void* ptr,
+                                               allocator_utilization* util) {
+    /* The layout of the output of "experimental.utilization.query" (only
+     * in jemalloc 5.2 and later; older versions return ENOENT).
+     */
+    struct {
+        void* slabcur_addr;
+        size_t nfree;
+        size_t nregs;
+        size_t size;
+        size_t bin_nfree;
+        size_t bin_nregs;
+    } out;
+    size_t outlen = sizeof(out);
+    if (je_mallctl("experimental.utilization.query",
+                   &out,
+                   &outlen,
+                   &ptr,
+                   sizeof(ptr)) != 0) {
+        return false;
+    }
+    if (out.nregs == 0 || out.bin_nregs == 0) {
+        /* A large allocation, which has a run of its own */
+        return false;
+    }
+    util->page_used = out.nregs - out.nfree;
+    util->page_regions = out.nregs;
+    util->class_used = out.bin_nregs - out.bin_nfree;
+    util->class_regions = out.bin_nregs;
+    return true;
+}
+
+bool JemallocHooks::create_arena(unsigned* arena) {
+    size_t sz = sizeof(*arena);
+    int err = je_mallctl("arenas.create", arena, &sz, NULL, 0);
+    if (err != 0) {
+        get_stderr_logger()->log(EXTENSION_LOG_WARNING, NULL,
+                                 "jemalloc_create_arena() error %d", err);
+        return false;
+    }
+    return true;
+}
+
+bool JemallocHooks::set_thread_arena(unsigned arena) {
+    /* Called every time a thread enters or leaves a bucket with an arena
+     * of its own, so look up the MIB only once.
+     */
+    static size_t mib[2];
+    static size_t miblen = [] {
+        size_t len = sizeof(mib) / sizeof(mib[0]);
+        return je_mallctlnametomib("thread.arena", mib, &len) == 0 ? len : 0;
+    }();
+    if (miblen == 0) {
+        return false;
+    }
+    return je_mallctlbymib(mib, miblen, NULL, NULL, &arena,
+                           sizeof(arena)) == 0;
+}
+
+bool JemallocHooks::get_arena_stats(unsigned arena,
+                                    allocator_arena_stats* stats) {
+    size_t epoch = 1;
+    size_t sz = sizeof(epoch);
+    /* jemalloc can cache its statistics - force a refresh */
+    je_mallctl("epoch", &epoch, &sz, &epoch, sz);
+
+    size_t page;
+    size_t small;
+    size_t large = 0;
+    size_t pactive = 0;
+    size_t pdirty = 0;
+    char name[64];
+    stats->resident_size = 0;
+    if (jemalloc_get_stats_prop("arenas.page", &page) != 0) {
+        return false;
+    }
+    snprintf(name, sizeof(name), "stats.arenas.%u.small.allocated", arena);
+    if (jemalloc_get_stats_prop(name, &small) != 0) {
+        return false;
+    }
+    snprintf(name, sizeof(name), "stats.arenas.%u.large.allocated", arena);
+    jemalloc_get_stats_prop(name, &large);
+    snprintf(name, sizeof(name), "stats.arenas.%u.pactive", arena);
+    jemalloc_get_stats_prop(name, &pactive);
+    snprintf(name, sizeof(name), "stats.arenas.%u.pdirty", arena);
+    jemalloc_get_stats_prop(name, &pdirty);
+    snprintf(name, sizeof(name), "stats.arenas.%u.resident", arena);
+    jemalloc_get_stats_prop(name, &stats->resident_size);
+
+    stats->allocated_size = small + large;
+    stats->active_size = pactive * page;
+    stats->dirty_size = pdirty * page;
+    return true;
+}
+
+void JemallocHooks::purge_arena(unsigned arena) {
+    char name[32];
+    snprintf(name, sizeof(name), "arena.%u.purge", arena);
+    int err = je_mallctl(name, NULL, 0, NULL, 0);
+    if (err != 0) {
+        get_stderr_logger()->log(EXTENSION_LOG_WARNING, NULL,
+                                 "jemalloc_purge_arena(%u) error %d",
+                                 arena, err);
+    }
+}
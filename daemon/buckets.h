@@ -360,17 +360,25 @@ public:
      *               try to perform a clean shutdown
      * @param connection_ the connection that requested the operation
      * @param task_ the task to notify when deletion is complete
+     * @param detach_ should the connection be notified as soon as the
+     *                bucket is detached (it no longer accepts any new
+     *                connections), instead of when it is gone. The
+     *                connections are then drained and the bucket shut
+     *                down in the background, and the name of the
+     *                bucket can't be used for a new one until then.
      */
     DestroyBucketThread(const std::string& name_,
                         bool force_,
                         McbpConnection* connection_,
-                        Task* task_)
+                        Task* task_,
+                        bool detach_ = false)
         : Couchbase::Thread("mc:bucket_del"),
           name(name_),
           force(force_),
           connection(connection_),
           task(task_),
-          result(ENGINE_DISCONNECT) {
+          result(ENGINE_DISCONNECT),
+          detach(detach_) {
     }
 
     ~DestroyBucketThread() {
@@ -395,9 +403,16 @@ private:
      */
     void destroy();
 
+    /**
+     * Notify the (detaching) connection that requested the deletion of
+     * the status of it, and forget about the connection.
+     */
+    void detach_connection(ENGINE_ERROR_CODE status);
+
     std::string name;
     bool force;
     McbpConnection* connection;
     Task* task;
     ENGINE_ERROR_CODE result;
+    bool detach;
 };
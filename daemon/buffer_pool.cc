@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "buffer_pool.h"
+
+size_t BufferPool::getClass(size_t capacity) {
+    if (capacity < MinClassSize ||
+        capacity > getClassSize(NumClasses - 1)) {
+        return NumClasses;
+    }
+
+    size_t index = 0;
+    while (index + 1 < NumClasses && getClassSize(index + 1) <= capacity) {
+        ++index;
+    }
+    return index;
+}
+
+size_t BufferPool::getAllocationSize(size_t nbytes) {
+    for (size_t ii = 0; ii < NumClasses; ++ii) {
+        if (nbytes <= getClassSize(ii)) {
+            return getClassSize(ii);
+        }
+    }
+    return nbytes;
+}
+
+std::unique_ptr<cb::Pipe> BufferPool::get(size_t nbytes) {
+    // Find the smallest class where all of the buffers are big enough
+    for (size_t ii = 0; ii < NumClasses; ++ii) {
+        if (nbytes <= getClassSize(ii)) {
+            auto& list = classes[ii];
+            if (list.empty()) {
+                break;
+            }
+            auto ret = std::move(list.back().buffer);
+            list.pop_back();
+            size -= ret->capacity();
+            ++hits;
+            return ret;
+        }
+    }
+
+    ++misses;
+    return {};
+}
+
+std::unique_ptr<cb::Pipe> BufferPool::allocate(size_t nbytes) {
+    return std::make_unique<cb::Pipe>(getAllocationSize(nbytes));
+}
+
+void BufferPool::release(std::unique_ptr<cb::Pipe> buffer, uint32_t now) {
+    trim(now);
+
+    if (!buffer || !buffer->empty()) {
+        return;
+    }
+
+    const auto capacity = buffer->capacity();
+    const auto index = getClass(capacity);
+    if (index == NumClasses || (size + capacity) > maxSize) {
+        // Let the buffer go out of scope and release the memory
+        return;
+    }
+
+    buffer->clear();
+    classes[index].push_back(Entry{std::move(buffer), now});
+    size += capacity;
+}
+
+void BufferPool::trim(uint32_t now) {
+    for (auto& list : classes) {
+        while (!list.empty() && (now - list.front().released) > idleTimeout) {
+            size -= list.front().buffer->capacity();
+            list.pop_front();
+        }
+    }
+}
+
+void BufferPool::clear() {
+    for (auto& list : classes) {
+        list.clear();
+    }
+    size = 0;
+}
@@ -0,0 +1,149 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/pipe.h>
+#include <relaxed_atomic.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+/**
+ * The BufferPool keeps a set of idle network buffers (cb::Pipe) for the
+ * connections served by a worker thread.
+ *
+ * The buffers are grouped in size classes (2k, 8k, 32k, 128k, 512k and
+ * 2M). A connection normally borrows a buffer from the smallest class
+ * when it starts processing an event, and hands it back to the pool
+ * when it is done (and the buffer is empty). A connection which needs
+ * to receive (or send) a large packet may borrow a buffer from one of
+ * the bigger classes instead of growing its small buffer.
+ *
+ * Buffers bigger than the largest class are never pooled, and the pool
+ * never holds more than the configured number of bytes. Buffers which
+ * have been sitting unused in the pool for longer than the idle timeout
+ * are released by trim(), so that memory used to serve a burst of large
+ * requests is given back to the system.
+ *
+ * There is one instance of the pool per worker thread, and the pool is
+ * only accessed from the context of that thread. The statistics are
+ * relaxed atomics so they may be read by other threads.
+ */
+class BufferPool {
+public:
+    /**
+     * Create a new pool
+     *
+     * @param max_size the maximum number of bytes to hold in the pool
+     * @param idle_timeout the number of seconds a buffer may stay unused
+     *                     in the pool before trim() releases it
+     */
+    BufferPool(size_t max_size = DefaultMaxSize,
+               uint32_t idle_timeout = DefaultIdleTimeout)
+        : maxSize(max_size), idleTimeout(idle_timeout) {
+    }
+
+    /**
+     * Try to borrow a buffer which may hold at least nbytes bytes.
+     *
+     * @param nbytes the minimum capacity of the buffer
+     * @return a buffer from the pool, or an empty pointer if the pool
+     *         don't have a buffer big enough
+     */
+    std::unique_ptr<cb::Pipe> get(size_t nbytes);
+
+    /**
+     * Allocate a new buffer. The buffer is allocated with the size of
+     * the size class for the requested size so that it may be reused
+     * when it is returned to the pool.
+     *
+     * @throws std::bad_alloc if we fail to allocate memory
+     */
+    static std::unique_ptr<cb::Pipe> allocate(size_t nbytes);
+
+    /**
+     * Return a buffer to the pool. The buffer is released if it isn't
+     * empty, is bigger than the max size class or the pool is full.
+     *
+     * @param buffer the buffer to return
+     * @param now the current time (used to expire idle buffers)
+     */
+    void release(std::unique_ptr<cb::Pipe> buffer, uint32_t now);
+
+    /**
+     * Release all of the buffers which have been idle in the pool for
+     * longer than the idle timeout.
+     */
+    void trim(uint32_t now);
+
+    /// Release all buffers held by the pool
+    void clear();
+
+    /// @return the number of bytes held by the pool
+    size_t getSize() const {
+        return size;
+    }
+
+    uint64_t getHits() const {
+        return hits;
+    }
+
+    uint64_t getMisses() const {
+        return misses;
+    }
+
+    /// @return the capacity used for buffers in the size class for nbytes
+    static size_t getAllocationSize(size_t nbytes);
+
+    static const size_t MinClassSize = 2048;
+    static const size_t NumClasses = 6;
+    static const size_t DefaultMaxSize = 4 * 1024 * 1024;
+    static const uint32_t DefaultIdleTimeout = 10;
+
+protected:
+    /**
+     * Get the index of the size class to use for a buffer with the
+     * given capacity (the biggest class the buffer may serve)
+     *
+     * @return the index or NumClasses if the capacity is outside the
+     *         range of the pool
+     */
+    static size_t getClass(size_t capacity);
+
+    static size_t getClassSize(size_t index) {
+        return MinClassSize << (2 * index);
+    }
+
+    struct Entry {
+        std::unique_ptr<cb::Pipe> buffer;
+        uint32_t released;
+    };
+
+    /**
+     * The idle buffers in each size class. Buffers are returned to (and
+     * borrowed from) the back, so the oldest buffer is at the front.
+     */
+    std::array<std::deque<Entry>, NumClasses> classes;
+
+    const size_t maxSize;
+    const uint32_t idleTimeout;
+    Couchbase::RelaxedAtomic<size_t> size{0};
+    Couchbase::RelaxedAtomic<uint64_t> hits{0};
+    Couchbase::RelaxedAtomic<uint64_t> misses{0};
+};
@@ -57,17 +57,17 @@ public:
         auto& conn = dynamic_cast<McbpConnection&>(connection);
 
         auto& bucket = connection.getBucket();
-        auto payload = bucket.clusterConfiguration.getConfiguration();
-        if (payload.first < conn.getClustermapRevno()) {
+        auto config = bucket.clusterConfiguration.getConfiguration();
+        if (config->revision < conn.getClustermapRevno()) {
             // Ignore.. we've already sent a newer cluster config
             return true;
         }
 
-        conn.setClustermapRevno(payload.first);
+        conn.setClustermapRevno(config->revision);
         LOG_NOTICE(&conn,
                    "%u: Sending Cluster map revision %u",
                    conn.getId(),
-                   payload.first);
+                   config->revision);
 
         std::string name = bucket.name;
 
@@ -75,7 +75,7 @@ public:
         size_t needed = sizeof(Request) + // packet header
                         4 + // rev number in extdata
                         name.size() + // the name of the bucket
-                        payload.second->size(); // The actual payload
+                        config->config.size(); // The actual payload
 
         conn.write->ensureCapacity(needed);
         FrameBuilder<Request> builder(conn.write->wdata());
@@ -84,14 +84,14 @@ public:
         builder.setOpcode(ServerOpcode::ClustermapChangeNotification);
 
         // The extras contains the cluster revision number as an uint32_t
-        const uint32_t rev = htonl(payload.first);
+        const uint32_t rev = htonl(config->revision);
         builder.setExtras(
                 {reinterpret_cast<const uint8_t*>(&rev), sizeof(rev)});
         builder.setKey(
                 {reinterpret_cast<const uint8_t*>(name.data()), name.size()});
         builder.setValue(
-                {reinterpret_cast<const uint8_t*>(payload.second->data()),
-                 payload.second->size()});
+                {reinterpret_cast<const uint8_t*>(config->config.data()),
+                 config->config.size()});
 
         // Inject our packet into the stream!
         conn.addMsgHdr(true);
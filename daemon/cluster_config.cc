@@ -29,9 +29,10 @@ void ClusterConfiguration::setConfiguration(cb::const_char_buffer buffer) {
                 "revision");
     }
 
-    std::lock_guard<std::mutex> guard(mutex);
-    revision = rev;
-    config = std::make_shared<std::string>(buffer.begin(), buffer.end());
+    std::shared_ptr<const Configuration> next =
+            std::make_shared<Configuration>(
+                    rev, std::string(buffer.begin(), buffer.end()));
+    std::atomic_store(&config, std::move(next));
 }
 
 int ClusterConfiguration::getRevisionNumber(cb::const_char_buffer buffer) {
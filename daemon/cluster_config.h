@@ -20,7 +20,6 @@
 
 #include <cstdint>
 #include <memory>
-#include <mutex>
 #include <string>
 
 /**
@@ -32,8 +31,25 @@
  */
 class ClusterConfiguration {
 public:
+    /**
+     * An immutable snapshot of the configuration. The connections hold on
+     * to it (through a shared_ptr) until they've sent it to the client,
+     * so the payload may be referenced straight from the IO vector instead
+     * of being copied into a send buffer for every response.
+     */
+    struct Configuration {
+        Configuration(int rev, std::string cfg)
+            : revision(rev), config(std::move(cfg)) {
+        }
+
+        /// The revision number (or -1 if no configuration is set)
+        const int revision;
+        /// The actual config
+        const std::string config;
+    };
+
     ClusterConfiguration()
-        : config(std::make_shared<std::string>()), revision(-1) {
+        : config(std::make_shared<Configuration>(-1, std::string{})) {
     }
 
     void setConfiguration(cb::const_char_buffer buffer);
@@ -41,12 +57,10 @@ public:
     /**
      * Get the current configuration.
      *
-     * @return a pair where the first element is the revision number, and
-     *         the second element is (a copy) of the configuration.
+     * @return the current snapshot of the configuration (never nullptr)
      */
-    std::pair<int, std::shared_ptr<std::string>> getConfiguration() const {
-        std::lock_guard<std::mutex> guard(mutex);
-        return std::make_pair(revision, config);
+    std::shared_ptr<const Configuration> getConfiguration() const {
+        return std::atomic_load(&config);
     };
 
     /**
@@ -59,21 +73,11 @@ public:
 
 private:
     /**
-     * We use a mutex so that we can get a consistent copy of the revision
-     * number and the configuration. (we cache the revision number to avoid
-     * parsing the JSON every time we have to handle a not my vbucket reply
-     * because we want to be able to avoid sending duplicates of the cluster
-     * configuration map to the clients).
-     */
-    mutable std::mutex mutex;
-
-    /**
-     * The actual config
-     */
-    std::shared_ptr<std::string> config;
-
-    /**
-     * Cached revision so we don't have to parse it every time
+     * The current snapshot. It is replaced (never modified) by
+     * setConfiguration, so the readers don't need to lock (the revision
+     * is cached in the snapshot so we don't have to parse the JSON every
+     * time we have to handle a not my vbucket reply, and it is always
+     * consistent with the config).
      */
-    int revision;
+    std::shared_ptr<const Configuration> config;
 };
@@ -0,0 +1,78 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "command_context_pool.h"
+
+#include "protocol/mcbp/command_context.h"
+
+#include <new>
+
+const size_t CommandContextPool::Granularity;
+const size_t CommandContextPool::MaxSize;
+const size_t CommandContextPool::MaxFree;
+
+CommandContextPool::CommandContextPool() {
+    // Reserve the space up front so that deallocate never allocates
+    for (auto& freelist : freelists) {
+        freelist.reserve(MaxFree);
+    }
+}
+
+CommandContextPool::~CommandContextPool() {
+    for (auto& freelist : freelists) {
+        for (auto* ptr : freelist) {
+            ::operator delete(ptr);
+        }
+    }
+}
+
+void* CommandContextPool::allocate(size_t size) {
+    if (size > MaxSize) {
+        ++heapAllocations;
+        return ::operator new(size);
+    }
+
+    const auto sizeClass = getSizeClass(size);
+    auto& freelist = freelists[sizeClass];
+    if (freelist.empty()) {
+        ++heapAllocations;
+        return ::operator new((sizeClass + 1) * Granularity);
+    }
+
+    auto* ret = freelist.back();
+    freelist.pop_back();
+    return ret;
+}
+
+void CommandContextPool::deallocate(void* ptr, size_t size) {
+    if (size <= MaxSize) {
+        auto& freelist = freelists[getSizeClass(size)];
+        if (freelist.size() < MaxFree) {
+            freelist.push_back(ptr);
+            return;
+        }
+    }
+    ::operator delete(ptr);
+}
+
+void CommandContextDeleter::operator()(CommandContext* context) const {
+    if (pool == nullptr) {
+        delete context;
+    } else {
+        context->~CommandContext();
+        pool->deallocate(memory, size);
+    }
+}
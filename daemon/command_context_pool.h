@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CommandContext;
+
+/**
+ * The CommandContextPool keeps the memory of the command contexts the
+ * connections are done with, so that the next command may reuse it
+ * rather than allocating a new context from the heap. The memory is kept
+ * in a free list per size class (multiples of Granularity up to MaxSize);
+ * contexts bigger than MaxSize are always allocated from the heap.
+ *
+ * There is one instance of the pool per worker thread, and it is only
+ * accessed from the context of that thread so it is not thread safe.
+ */
+class CommandContextPool {
+public:
+    static const size_t Granularity = 64;
+    static const size_t MaxSize = 1024;
+    /// The maximum number of free blocks kept per size class
+    static const size_t MaxFree = 64;
+
+    CommandContextPool();
+
+    CommandContextPool(const CommandContextPool&) = delete;
+
+    ~CommandContextPool();
+
+    /**
+     * Get a block of memory for a command context
+     *
+     * @param size the size of the context
+     * @throws std::bad_alloc if we failed to allocate memory
+     */
+    void* allocate(size_t size);
+
+    /**
+     * Return the memory of a command context to the pool
+     *
+     * @param ptr the memory returned from allocate()
+     * @param size the size passed to allocate()
+     */
+    void deallocate(void* ptr, size_t size);
+
+    /// The number of times allocate() had to go to the heap
+    uint64_t getHeapAllocations() const {
+        return heapAllocations;
+    }
+
+private:
+    static size_t getSizeClass(size_t size) {
+        return (size + Granularity - 1) / Granularity - 1;
+    }
+
+    std::array<std::vector<void*>, MaxSize / Granularity> freelists;
+    uint64_t heapAllocations = 0;
+};
+
+/**
+ * The deleter for the command context of a connection. Contexts created
+ * by McbpConnection::obtainContext() return their memory to the pool of
+ * the worker thread, and contexts without a pool are deleted.
+ */
+struct CommandContextDeleter {
+    CommandContextDeleter() = default;
+
+    CommandContextDeleter(CommandContextPool* pool, void* memory, size_t size)
+        : pool(pool), memory(memory), size(size) {
+    }
+
+    void operator()(CommandContext* context) const;
+
+    CommandContextPool* pool = nullptr;
+    /// The memory from the pool holding the context
+    void* memory = nullptr;
+    size_t size = 0;
+};
@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmark the allocation of command contexts. Each iteration creates
+ * the contexts of a number of outstanding commands (alternating between
+ * the size of a GET and a SET context), and frees them again as the
+ * commands complete.
+ *
+ * Heap allocates the contexts with operator new (what we used to do),
+ * and Pool uses the CommandContextPool of the worker thread. The
+ * "heap_allocations" counter is the number of heap allocations per
+ * context.
+ */
+
+#include "command_context_pool.h"
+#include "protocol/mcbp/get_context.h"
+#include "protocol/mcbp/mutation_context.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <vector>
+
+static const std::array<size_t, 2> sizes = {
+        {sizeof(GetCommandContext), sizeof(MutationCommandContext)}};
+
+struct Heap {
+    void* allocate(size_t size) {
+        ++heapAllocations;
+        return ::operator new(size);
+    }
+
+    void deallocate(void* ptr, size_t) {
+        ::operator delete(ptr);
+    }
+
+    uint64_t getHeapAllocations() const {
+        return heapAllocations;
+    }
+
+    uint64_t heapAllocations = 0;
+};
+
+struct Pool {
+    void* allocate(size_t size) {
+        return pool.allocate(size);
+    }
+
+    void deallocate(void* ptr, size_t size) {
+        pool.deallocate(ptr, size);
+    }
+
+    uint64_t getHeapAllocations() const {
+        return pool.getHeapAllocations();
+    }
+
+    CommandContextPool pool;
+};
+
+template <typename Allocator>
+void CommandContextBenchmark(benchmark::State& state) {
+    Allocator allocator;
+    const auto outstanding = size_t(state.range(0));
+    std::vector<void*> contexts(outstanding);
+
+    while (state.KeepRunning()) {
+        for (size_t ii = 0; ii < outstanding; ++ii) {
+            contexts[ii] = allocator.allocate(sizes[ii & 1]);
+            benchmark::DoNotOptimize(contexts[ii]);
+        }
+        for (size_t ii = 0; ii < outstanding; ++ii) {
+            allocator.deallocate(contexts[ii], sizes[ii & 1]);
+        }
+    }
+
+    const auto total = double(state.iterations() * outstanding);
+    state.SetItemsProcessed(int64_t(total));
+    state.counters["heap_allocations"] =
+            double(allocator.getHeapAllocations()) / total;
+}
+
+// Args: the number of outstanding commands
+BENCHMARK_TEMPLATE(CommandContextBenchmark, Heap)->Arg(1)->Arg(16);
+BENCHMARK_TEMPLATE(CommandContextBenchmark, Pool)->Arg(1)->Arg(16);
+
+BENCHMARK_MAIN()
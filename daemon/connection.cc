@@ -20,6 +20,7 @@
 #include "runtime.h"
 #include "server_event.h"
 #include "statemachine_mcbp.h"
+#include "timings_subscription.h"
 
 #include <exception>
 #include <utilities/protocol2text.h>
@@ -66,6 +67,7 @@ Connection::Connection(SOCKET sfd, event_base* b)
       refcount(0),
       engine_storage(nullptr),
       next(nullptr),
+      pendingIo(false),
       thread(nullptr),
       parent_port(0),
       bucketEngine(nullptr),
@@ -559,3 +561,8 @@ void Connection::addCpuTime(std::chrono::nanoseconds ns) {
 void Connection::enqueueServerEvent(std::unique_ptr<ServerEvent> event) {
     server_events.push(std::move(event));
 }
+
+void Connection::setTimingsSubscription(
+        std::unique_ptr<TimingsSubscription> subscription) {
+    timings_subscription = std::move(subscription);
+}
@@ -24,6 +24,7 @@
 #include <cJSON.h>
 #include <cbsasl/cbsasl.h>
 #include <memcached/rbac.h>
+#include <atomic>
 #include <chrono>
 #include <queue>
 #include <string>
@@ -32,6 +33,7 @@ struct LIBEVENT_THREAD;
 class ListeningPort;
 class Bucket;
 class ServerEvent;
+class TimingsSubscription;
 
 /**
  * The structure representing a connection in memcached.
@@ -230,6 +232,26 @@ public:
         Connection::next = next;
     }
 
+    /**
+     * Mark the connection as scheduled in the pending io lists of its
+     * thread
+     *
+     * @return true if the connection wasn't already scheduled
+     */
+    bool markPendingIo() {
+        return !pendingIo.exchange(true);
+    }
+
+    bool isPendingIo() const {
+        return pendingIo.load();
+    }
+
+    void clearPendingIo() {
+        // Use an exchange to synchronize with a notify_io_complete which
+        // found the connection already scheduled (and didn't add it)
+        pendingIo.exchange(false);
+    }
+
     LIBEVENT_THREAD* getThread() const {
         return thread.load(std::memory_order_relaxed);
     }
@@ -277,6 +299,19 @@ public:
      */
     cb::engine_errc dropPrivilege(cb::rbac::Privilege privilege);
 
+    const cb::rbac::PrivilegeContext& getPrivilegeContext() const {
+        return privilegeContext;
+    }
+
+    /**
+     * Cache the access decision for a command in the current privilege
+     * context (see McbpPrivilegeChains::invoke)
+     */
+    void setCachedCommandAccess(uint8_t opcode,
+                                cb::rbac::PrivilegeAccess access) {
+        privilegeContext.setCachedAccess(opcode, access);
+    }
+
     int getBucketIndex() const {
         return bucketIndex.load(std::memory_order_relaxed);
     }
@@ -309,6 +344,14 @@ public:
         return false;
     }
 
+    /**
+     * Is the connection on its way to another worker thread (see
+     * McbpConnection::prepareMigration())?
+     */
+    virtual bool isMigrating() const {
+        return false;
+    }
+
     virtual void runEventLoop(short which) = 0;
 
 
@@ -374,6 +417,19 @@ public:
         Connection::cccp.store(cccp, std::memory_order_release);
     }
 
+    /// Get the timings the client subscribed to (or nullptr)
+    TimingsSubscription* getTimingsSubscription() const {
+        return timings_subscription.get();
+    }
+
+    /**
+     * Replace the timings the client subscribed to
+     *
+     * @param subscription the new subscription (nullptr to unsubscribe)
+     */
+    void setTimingsSubscription(
+            std::unique_ptr<TimingsSubscription> subscription);
+
     bool allowUnorderedExecution() const {
         return allow_unordered_execution;
     }
@@ -382,6 +438,24 @@ public:
         Connection::allow_unordered_execution = allow_unordered_execution;
     }
 
+    /// Should the responses carry the time the server spent on the request
+    bool isTracingEnabled() const {
+        return tracing_enabled;
+    }
+
+    void setTracingEnabled(bool tracing_enabled) {
+        Connection::tracing_enabled = tracing_enabled;
+    }
+
+    /// May the mutations carry a durability requirement
+    bool isDurabilitySupported() const {
+        return durability_support;
+    }
+
+    void setDurabilitySupported(bool durability_support) {
+        Connection::durability_support = durability_support;
+    }
+
     /**
      * Remap the current error code
      *
@@ -410,6 +484,10 @@ public:
      */
     void addCpuTime(std::chrono::nanoseconds ns);
 
+    std::chrono::nanoseconds getTotalCpuTime() const {
+        return total_cpu_time;
+    }
+
     /**
      * Enqueue a new server event
      *
@@ -481,6 +559,12 @@ protected:
     /* Used for generating a list of Connection structures */
     Connection* next;
 
+    /**
+     * Set while the connection is in the pending io lists of its thread
+     * (so we don't have to search the list to avoid adding it twice)
+     */
+    std::atomic_bool pendingIo;
+
     /** Pointer to the thread object serving this connection */
     std::atomic<LIBEVENT_THREAD*> thread;
 
@@ -544,8 +628,15 @@ protected:
 
     bool allow_unordered_execution{false};
 
+    bool tracing_enabled{false};
+
+    bool durability_support{false};
+
     std::queue<std::unique_ptr<ServerEvent>> server_events;
 
+    /// The timings pushed to the client (see TimingsSubscription)
+    std::unique_ptr<TimingsSubscription> timings_subscription;
+
     /**
      * The total time this connection been on the CPU
      */
@@ -0,0 +1,152 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "connection_balancer.h"
+#include "connections.h"
+#include "executorpool.h"
+#include "memcached.h"
+
+#include <algorithm>
+
+extern std::atomic<bool> memcached_shutdown;
+
+const std::chrono::seconds ConnectionBalancer::Period{1};
+
+bool ConnectionBalancer::findMigration(
+        const std::vector<uint64_t>& threads,
+        const std::vector<std::vector<ConnectionLoad>>& connections,
+        uint64_t period,
+        Migration& migration) {
+    if (threads.size() < 2) {
+        return false;
+    }
+
+    const auto busiest = size_t(
+            std::max_element(threads.begin(), threads.end()) -
+            threads.begin());
+    const auto idlest = size_t(
+            std::min_element(threads.begin(), threads.end()) -
+            threads.begin());
+
+    const auto gap = threads[busiest] - threads[idlest];
+    if (threads[busiest] <= period / 2 || gap <= period / 4) {
+        return false;
+    }
+
+    // Moving a connection with more than half of the gap would just
+    // move the hot spot over to the other thread
+    const ConnectionLoad* candidate = nullptr;
+    for (const auto& c : connections[busiest]) {
+        if (c.load > 0 && c.load <= gap / 2 &&
+            (candidate == nullptr || c.load > candidate->load)) {
+            candidate = &c;
+        }
+    }
+
+    if (candidate == nullptr) {
+        return false;
+    }
+
+    migration.from = busiest;
+    migration.to = idlest;
+    migration.connection = candidate->connection;
+    return true;
+}
+
+Task::Status ConnectionBalancer::periodicExecute() {
+    if (memcached_shutdown) {
+        return Status::Finished;
+    }
+
+    const auto nthreads = size_t(settings.getNumWorkerThreads());
+    threadTime.resize(nthreads);
+
+    std::vector<uint64_t> threads(nthreads);
+    std::vector<std::vector<ConnectionLoad>> connections(nthreads);
+    std::unordered_map<const Connection*, uint64_t> cpuTime;
+    bool pending = false;
+
+    for (size_t ii = 0; ii < nthreads; ++ii) {
+        auto* thread = get_worker_thread(int(ii));
+        LOCK_THREAD(thread);
+        threads[ii] = thread->busy_time - threadTime[ii];
+        threadTime[ii] = thread->busy_time;
+
+        iterate_thread_connections(thread, [&](Connection& c) {
+            auto* mcbp = dynamic_cast<const McbpConnection*>(&c);
+            if (mcbp == nullptr) {
+                return;
+            }
+            if (mcbp->getMigrationTarget() != nullptr) {
+                pending = true;
+            }
+
+            const auto total = uint64_t(c.getTotalCpuTime().count());
+            cpuTime[&c] = total;
+
+            // The connection object may be a new connection reusing the
+            // memory of an old one (which had used more CPU time)
+            auto iter = connectionTime.find(&c);
+            if (iter != connectionTime.end() && iter->second <= total &&
+                !c.isDCP()) {
+                connections[ii].push_back({&c, total - iter->second});
+            }
+        });
+        UNLOCK_THREAD(thread);
+    }
+    connectionTime.swap(cpuTime);
+
+    // Let the previous migration complete before we look at moving
+    // another connection
+    if (!settings.isConnectionMigrationEnabled() || pending) {
+        return Status::Continue;
+    }
+
+    using namespace std::chrono;
+    Migration migration;
+    if (!findMigration(threads,
+                       connections,
+                       uint64_t(duration_cast<nanoseconds>(Period).count()),
+                       migration)) {
+        return Status::Continue;
+    }
+
+    // The connection may be gone by now, so look it up again while we
+    // hold the lock of its thread
+    auto* from = get_worker_thread(int(migration.from));
+    auto* to = get_worker_thread(int(migration.to));
+    LOCK_THREAD(from);
+    iterate_thread_connections(from, [&migration, to](Connection& c) {
+        if (&c == migration.connection) {
+            auto* mcbp = dynamic_cast<McbpConnection*>(&c);
+            if (mcbp != nullptr) {
+                mcbp->requestMigration(to);
+            }
+        }
+    });
+    UNLOCK_THREAD(from);
+
+    return Status::Continue;
+}
+
+static std::shared_ptr<ConnectionBalancer> connection_balancer;
+
+void initializeConnectionBalancer() {
+    connection_balancer = std::make_shared<ConnectionBalancer>();
+    std::shared_ptr<Task> task = connection_balancer;
+    std::lock_guard<std::mutex> lg(task->getMutex());
+    executorPool->schedule(task);
+}
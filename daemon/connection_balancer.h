@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include "task.h"
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Connection;
+
+/**
+ * The ConnectionBalancer is a periodic task which moves connections
+ * between the worker threads. A connection is bound to a worker thread
+ * when it is accepted, so a handful of busy connections (XDCR, analytics)
+ * bound to the same thread may saturate it while other threads are idle.
+ *
+ * Every period the balancer looks at the time each thread spent running
+ * connections, and asks one connection on the busiest thread to move to
+ * the least busy thread (see McbpConnection::prepareMigration). It only
+ * runs if "connection_migration" is enabled in the settings.
+ */
+class ConnectionBalancer : public PeriodicTask {
+public:
+    /// How often we look at the load of the threads
+    static const std::chrono::seconds Period;
+
+    ConnectionBalancer() : PeriodicTask(Period) {
+    }
+
+    Status periodicExecute() override;
+
+    /// The time a connection spent on its thread during the last period
+    struct ConnectionLoad {
+        const Connection* connection;
+        uint64_t load;
+    };
+
+    struct Migration {
+        size_t from;
+        size_t to;
+        const Connection* connection;
+    };
+
+    /**
+     * Pick the connection to move. We only move a connection if the
+     * busiest thread was busy for more than half of the period, and it
+     * was busy for at least a quarter of the period more than the least
+     * busy thread. The connection to move is the busiest connection which
+     * doesn't make the least busy thread busier than the thread it leaves.
+     *
+     * @param threads the time each thread spent running connections
+     * @param connections the connections (which may move) of each thread
+     * @param period the length of the period (in the same unit)
+     * @param migration where to store the connection to move
+     * @return true if we found a connection to move
+     */
+    static bool findMigration(
+            const std::vector<uint64_t>& threads,
+            const std::vector<std::vector<ConnectionLoad>>& connections,
+            uint64_t period,
+            Migration& migration);
+
+private:
+    /// The busy time of each thread the previous time we ran
+    std::vector<uint64_t> threadTime;
+
+    /// The CPU time of each connection the previous time we ran
+    std::unordered_map<const Connection*, uint64_t> connectionTime;
+};
+
+/**
+ * Schedule the ConnectionBalancer on the executor pool
+ */
+void initializeConnectionBalancer();
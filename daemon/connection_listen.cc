@@ -30,7 +30,8 @@ ListenConnection::ListenConnection(SOCKET sfd,
                                    event_base* b,
                                    in_port_t port,
                                    sa_family_t fam,
-                                   const interface& interf)
+                                   const interface& interf,
+                                   LIBEVENT_THREAD* owner)
     : Connection(sfd, b),
       registered_in_libevent(false),
       family(fam),
@@ -38,6 +39,7 @@ ListenConnection::ListenConnection(SOCKET sfd,
       ssl(!interf.ssl.cert.empty()),
       management(interf.management),
       protocol(interf.protocol),
+      owner(owner),
       ev(event_new(b, sfd, EV_READ | EV_PERSIST, listen_event_handler,
                    reinterpret_cast<void*>(this))) {
 
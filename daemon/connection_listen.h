@@ -36,7 +36,8 @@ public:
                      event_base* b,
                      in_port_t port,
                      sa_family_t fam,
-                     const struct interface &interf);
+                     const struct interface &interf,
+                     LIBEVENT_THREAD* owner = nullptr);
 
     virtual ~ListenConnection();
 
@@ -54,6 +55,17 @@ public:
         return management;
     }
 
+    /**
+     * Get the worker thread owning this socket. When running with
+     * SO_REUSEPORT listeners each worker thread has its own listening
+     * socket for every port and accepts the clients directly (without
+     * going through the dispatcher thread). For the "normal" listening
+     * sockets serviced by the dispatcher thread this returns nullptr.
+     */
+    LIBEVENT_THREAD* getOwner() const {
+        return owner;
+    }
+
     /**
      * Get the details for this connection to put in the portnumber
      * file so that the test framework may pick up the port numbers
@@ -67,6 +79,7 @@ protected:
     const bool ssl;
     const bool management;
     const Protocol protocol;
+    LIBEVENT_THREAD* const owner;
 
     struct EventDeleter {
         void operator()(struct event* ev) {
@@ -18,6 +18,7 @@
 #include "connections.h"
 #include "mc_time.h"
 #include "memcached.h"
+#include "protocol/mcbp/engine_wrapper.h"
 #include "runtime.h"
 #include "server_event.h"
 #include "statemachine_mcbp.h"
@@ -29,9 +30,12 @@
 #include <platform/strerror.h>
 #include <platform/timeutils.h>
 #include <utilities/protocol2text.h>
+#include <algorithm>
 #include <cctype>
 #include <exception>
 
+extern std::atomic<bool> memcached_shutdown;
+
 bool McbpConnection::unregisterEvent() {
     if (!registered_in_libevent) {
         LOG_WARNING(NULL,
@@ -177,6 +181,58 @@ bool McbpConnection::initializeEvent() {
     return registerEvent();
 }
 
+bool McbpConnection::prepareMigration() {
+    if (migrationTarget == nullptr) {
+        return false;
+    }
+
+    // DCP connections are notified by the engine at any time, and we
+    // don't want to move while we're shutting down
+    if (migrationTarget == getThread() || isDCP() || memcached_shutdown) {
+        migrationTarget = nullptr;
+        return false;
+    }
+
+    if (isEwouldblock() || isPendingIo() || hasParkedCommands() ||
+        hasBatchedResponses() || (write && !write->empty())) {
+        return false;
+    }
+
+    // The memory of the context belongs to the pool of this thread
+    resetCommandContext();
+
+    if (registered_in_libevent && !unregisterEvent()) {
+        migrationTarget = nullptr;
+        return false;
+    }
+
+    migrating = true;
+    return true;
+}
+
+LIBEVENT_THREAD* McbpConnection::completeMigration() {
+    auto* target = migrationTarget;
+    migrationTarget = nullptr;
+    migrating = false;
+
+    if (event_assign(&event, target->base, socketDescriptor, ev_flags,
+                     event_handler, reinterpret_cast<void*>(this)) == -1) {
+        LOG_WARNING(this,
+                    "%u: Failed to set up event notification for worker "
+                    "thread %u. Shutting down connection %s",
+                    getId(), target->index, getDescription().c_str());
+        // The event still belongs to the old base
+        event_assign(&event, base, socketDescriptor, ev_flags,
+                     event_handler, reinterpret_cast<void*>(this));
+        setState(conn_closing);
+        return getThread();
+    }
+
+    base = target->base;
+    setThread(target);
+    return target;
+}
+
 void McbpConnection::shrinkBuffers() {
     // We share the buffers with the thread, so we don't need to worry
     // about the read and write buffer.
@@ -212,6 +268,39 @@ void McbpConnection::shrinkBuffers() {
     dynamicBuffer.clear();
 }
 
+size_t McbpConnection::getMemoryUsage() const {
+    size_t ret = sizeof(*this);
+    if (read) {
+        ret += read->capacity();
+    }
+    if (write) {
+        ret += write->capacity();
+    }
+    ret += IoVectorPool::getAllocationSize(iov, msglist);
+    ret += batchedResponses.capacity() + unpinnedData.capacity();
+    ret += reservedItems.capacity() * sizeof(void*);
+    ret += temp_alloc.capacity() * sizeof(char*);
+    ret += dynamicBuffer.getSize();
+    ret += ssl.getMemoryUsage();
+    ret += (idleCookies.size() + parkedCookies.size() + (spareCookie ? 1 : 0)) *
+           sizeof(Cookie);
+    return ret;
+}
+
+void McbpConnection::returnIoVectors(IoVectorPool& pool) {
+    if (dcp) {
+        return;
+    }
+
+    const auto state = getState();
+    if (state == conn_read_packet_header || state == conn_waiting ||
+        state == conn_immediate_close || state == conn_destroyed) {
+        iovused = 0;
+        msgcurr = 0;
+        pool.release(iov, msglist);
+    }
+}
+
 bool McbpConnection::tryAuthFromSslCert(const std::string& userName) {
     username.assign(userName);
     domain = cb::sasl::Domain::Local;
@@ -341,21 +430,7 @@ int McbpConnection::recv(char* dest, size_t nbytes) {
 int McbpConnection::sendmsg(struct msghdr* m) {
     int res = 0;
     if (ssl.isEnabled()) {
-        for (int ii = 0; ii < int(m->msg_iovlen); ++ii) {
-            int n = sslWrite(reinterpret_cast<char*>(m->msg_iov[ii].iov_base),
-                             m->msg_iov[ii].iov_len);
-            if (n > 0) {
-                res += n;
-            } else {
-                return res > 0 ? res : -1;
-            }
-        }
-
-        /* @todo figure out how to drain the rest of the data if we
-         * failed to send all of it...
-         */
-        ssl.drainBioSendPipe(socketDescriptor);
-        return res;
+        return sslSendmsg(m);
     } else {
         res = int(::sendmsg(socketDescriptor, m, 0));
         if (res > 0) {
@@ -402,7 +477,200 @@ size_t adjust_msghdr(cb::Pipe& pipe, struct msghdr* m, ssize_t nbytes) {
     return m->msg_iov->iov_len;
 }
 
+bool McbpConnection::tryBatchResponse() {
+    const size_t limit = settings.getPipelineBatchSize();
+
+    // We may only batch the response if we're going to execute the
+    // next command (which must be completely received) right away
+    if (limit > 0 && !ssl.isEnabled() && write_and_go == conn_new_cmd &&
+        hasTimesliceLeft() && msgcurr == 0 && isPacketAvailable()) {
+        size_t total = batchedResponses.size();
+        for (const auto& m : msglist) {
+            for (size_t ii = 0; ii < size_t(m.msg_iovlen); ++ii) {
+                total += m.msg_iov[ii].iov_len;
+            }
+        }
+
+        // Don't read any further ahead of the client if we're already
+        // holding on to too much data
+        if (total <= limit && !isSendQueueFull(total)) {
+            const auto batched = batchedResponses.size();
+            try {
+                batchedResponses.reserve(total);
+                for (const auto& m : msglist) {
+                    for (size_t ii = 0; ii < size_t(m.msg_iovlen); ++ii) {
+                        const auto* ptr = static_cast<const uint8_t*>(
+                                m.msg_iov[ii].iov_base);
+                        batchedResponses.insert(batchedResponses.end(),
+                                                ptr,
+                                                ptr + m.msg_iov[ii].iov_len);
+                    }
+                }
+
+                // All of the data in the write pipe is referenced from
+                // the IO vector, so it is now in the batch buffer
+                write->clear();
+                msglist.clear();
+                iovused = 0;
+                msgcurr = 0;
+                msgbytes = 0;
+                return true;
+            } catch (const std::bad_alloc&) {
+                // Just send it the "normal" way (the batch buffer contains
+                // a number of complete responses)
+                batchedResponses.resize(batched);
+            }
+        }
+    }
+
+    if (!batchedResponses.empty()) {
+        prependBatchedResponses();
+    }
+
+    return false;
+}
+
+void McbpConnection::prependBatchedResponses() {
+    ensureIovSpace();
+    if (iovused > 0) {
+        memmove(&iov[1], &iov[0], iovused * sizeof(iovec));
+    }
+    iov[0].iov_base = batchedResponses.data();
+    iov[0].iov_len = batchedResponses.size();
+    ++iovused;
+
+    if (msglist.empty() || msglist.front().msg_iovlen == IOV_MAX) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msglist.insert(msglist.begin(), msg);
+    }
+    msglist.front().msg_iovlen++;
+
+    // Point all the msghdr structures at their new location in the list
+    size_t iovnum = 0;
+    for (auto& m : msglist) {
+        m.msg_iov = &iov[iovnum];
+        iovnum += m.msg_iovlen;
+    }
+}
+
+void McbpConnection::flushBatchedResponses() {
+    if (batchedResponses.empty() || ssl.isEnabled()) {
+        return;
+    }
+
+    struct iovec vec;
+    vec.iov_base = batchedResponses.data();
+    vec.iov_len = batchedResponses.size();
+
+    struct msghdr m;
+    memset(&m, 0, sizeof(m));
+    m.msg_iov = &vec;
+    m.msg_iovlen = 1;
+
+    auto res = sendmsg(&m);
+    if (res > 0) {
+        get_thread_stats(this)->bytes_written += res;
+        batchedResponses.erase(batchedResponses.begin(),
+                               batchedResponses.begin() + res);
+    }
+    updateSendQueueSize();
+    // Errors are detected (and handled) the next time we try to send data
+}
+
+bool McbpConnection::isSendQueueFull(size_t pending) const {
+    const auto limit = settings.getMaxSendQueueSize();
+    if (limit != 0 && pending > limit) {
+        return true;
+    }
+
+    const auto threadLimit = settings.getMaxThreadSendQueueSize();
+    if (threadLimit == 0 || getThread() == nullptr) {
+        return false;
+    }
+    // Our current send queue is already included in the thread total
+    return getThread()->send_queue_size.load() - sendQueueSize + pending >
+           threadLimit;
+}
+
+void McbpConnection::updateSendQueueSize() {
+    size_t pending = 0;
+    if (sendInProgress) {
+        // The batched responses are at the front of the IO vector
+        for (auto ii = msgcurr; ii < msglist.size(); ++ii) {
+            const auto& m = msglist[ii];
+            for (size_t jj = 0; jj < size_t(m.msg_iovlen); ++jj) {
+                pending += m.msg_iov[jj].iov_len;
+            }
+        }
+    } else {
+        pending = batchedResponses.size();
+    }
+
+    if (pending != sendQueueSize && getThread() != nullptr) {
+        if (pending > sendQueueSize) {
+            getThread()->send_queue_size += pending - sendQueueSize;
+        } else {
+            getThread()->send_queue_size -= sendQueueSize - pending;
+        }
+    }
+    sendQueueSize = pending;
+}
+
+void McbpConnection::unpinSendQueue() {
+    sendQueueLimitHits++;
+    get_thread_stats(this)->send_queue_limit_hits++;
+    if (reservedItems.empty() && reservedConfigurations.empty()) {
+        // Nothing to release (and copying would only use more memory)
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    try {
+        data.reserve(sendQueueSize);
+    } catch (const std::bad_alloc&) {
+        // Keep on waiting for the client with what we've got
+        return;
+    }
+    for (auto ii = msgcurr; ii < msglist.size(); ++ii) {
+        const auto& m = msglist[ii];
+        for (size_t jj = 0; jj < size_t(m.msg_iovlen); ++jj) {
+            const auto& vec = m.msg_iov[jj];
+            const auto* ptr = static_cast<const uint8_t*>(vec.iov_base);
+            data.insert(data.end(), ptr, ptr + vec.iov_len);
+        }
+    }
+
+    // Everything the IO vector referenced is in our copy, and the rest
+    // of the buffers aren't needed anymore
+    unpinnedData = std::move(data);
+    write->clear();
+    batchedResponses.clear();
+    releaseReservedItems();
+
+    addMsgHdr(true);
+    addIov(unpinnedData.data(), unpinnedData.size());
+    sendQueueUnpinnedBytes += unpinnedData.size();
+    get_thread_stats(this)->send_queue_unpinned_bytes += unpinnedData.size();
+}
+
 McbpConnection::TransmitResult McbpConnection::transmit() {
+    const auto ret = transmitData();
+    updateSendQueueSize();
+    if (ret == TransmitResult::SoftError && isSendQueueFull(sendQueueSize)) {
+        unpinSendQueue();
+    }
+    return ret;
+}
+
+McbpConnection::TransmitResult McbpConnection::transmitData() {
+    if (!sendInProgress) {
+        if (tryBatchResponse()) {
+            return TransmitResult::Batched;
+        }
+        sendInProgress = true;
+    }
+
     if (ssl.isEnabled()) {
         // We use OpenSSL to write data into a buffer before we send it
         // over the wire... Lets go ahead and drain that BIO pipe before
@@ -451,6 +719,7 @@ McbpConnection::TransmitResult McbpConnection::transmit() {
                         }
                         return TransmitResult::SoftError;
                     }
+                    sendCompleted();
                     return TransmitResult::Complete;
                 }
             }
@@ -494,6 +763,7 @@ McbpConnection::TransmitResult McbpConnection::transmit() {
         setState(conn_closing);
         return TransmitResult::HardError;
     } else {
+        sendCompleted();
         return TransmitResult::Complete;
     }
 }
@@ -667,6 +937,68 @@ int McbpConnection::sslWrite(const char* src, size_t nbytes) {
     return ret;
 }
 
+int McbpConnection::sslSendmsg(struct msghdr* m) {
+    auto& buffer = getThread()->io_vector_pool->getRecordBuffer(
+            SslContext::MaxRecordSize);
+    int res = 0;
+    size_t ii = 0;
+    size_t offset = 0;
+
+    while (ii < size_t(m->msg_iovlen)) {
+        const char* data;
+        size_t size;
+
+        const auto& first = m->msg_iov[ii];
+        if (first.iov_len - offset >= SslContext::MaxRecordSize) {
+            // Big enough to fill records on its own; don't copy it
+            data = static_cast<const char*>(first.iov_base) + offset;
+            size = first.iov_len - offset;
+            ++ii;
+            offset = 0;
+        } else {
+            buffer.clear();
+            while (ii < size_t(m->msg_iovlen) &&
+                   buffer.size() < SslContext::MaxRecordSize) {
+                const auto& vec = m->msg_iov[ii];
+                const auto* src = static_cast<const char*>(vec.iov_base);
+                const auto chunk =
+                        std::min(vec.iov_len - offset,
+                                 SslContext::MaxRecordSize - buffer.size());
+                buffer.insert(buffer.end(),
+                              src + offset,
+                              src + offset + chunk);
+                offset += chunk;
+                if (offset == vec.iov_len) {
+                    ++ii;
+                    offset = 0;
+                }
+            }
+            data = buffer.data();
+            size = buffer.size();
+            if (size == 0) {
+                // Only empty io vectors left
+                break;
+            }
+        }
+
+        int n = sslWrite(data, size);
+        if (n <= 0) {
+            return res > 0 ? res : -1;
+        }
+        res += n;
+        if (size_t(n) < size) {
+            // The caller calls us again with the rest of the message
+            return res;
+        }
+    }
+
+    /* @todo figure out how to drain the rest of the data if we
+     * failed to send all of it...
+     */
+    ssl.drainBioSendPipe(socketDescriptor);
+    return res;
+}
+
 void McbpConnection::addMsgHdr(bool reset) {
     if (reset) {
         msgcurr = 0;
@@ -720,8 +1052,9 @@ void McbpConnection::ensureIovSpace() {
         return;
     }
 
-    // Try to double the size of the array
-    iov.resize(iov.size() * 2);
+    // Try to double the size of the array (we don't have one unless
+    // we've borrowed one from the pool)
+    iov.resize(std::max(iov.size() * 2, size_t(IOV_LIST_INITIAL)));
 
     /* Point all the msghdr structures at the new list. */
     size_t ii;
@@ -749,12 +1082,14 @@ McbpConnection::McbpConnection(SOCKET sfd,
       ev_flags(0),
       currentEvent(0),
       ev_timeout_enabled(false),
+      migrationTarget(nullptr),
+      migrating(false),
       write_and_go(conn_new_cmd),
-      iov(IOV_LIST_INITIAL),
       iovused(0),
       msglist(),
       msgcurr(0),
       msgbytes(0),
+      sendInProgress(false),
       noreply(false),
       supports_datatype(false),
       supports_mutation_extras(false),
@@ -765,13 +1100,13 @@ McbpConnection::McbpConnection(SOCKET sfd,
       commandContext(nullptr),
       totalRecv(0),
       totalSend(0),
-      cookie(*this) {
+      cookie(*this),
+      currentCookie(&cookie) {
     if (ifc.protocol != Protocol::Memcached) {
         throw std::logic_error("Incorrect object for MCBP");
     }
     memset(&binary_header, 0, sizeof(binary_header));
     memset(&event, 0, sizeof(event));
-    msglist.reserve(MSG_LIST_INITIAL);
 
     if (ifc.ssl.enabled) {
         if (!enableSSL(ifc.ssl.cert, ifc.ssl.key)) {
@@ -786,6 +1121,7 @@ McbpConnection::McbpConnection(SOCKET sfd,
 }
 
 McbpConnection::~McbpConnection() {
+    sendCompleted();
     releaseReservedItems();
     for (auto* ptr : temp_alloc) {
         cb_free(ptr);
@@ -853,6 +1189,7 @@ unique_cJSON_ptr McbpConnection::toJSON() const {
                                 max_reqs_per_event);
         cJSON_AddNumberToObject(obj, "nevents", numEvents);
         cJSON_AddStringToObject(obj, "state", getStateName());
+        cJSON_AddNumberToObject(obj, "parked_commands", parkedCookies.size());
 
         const char* cmd_name = memcached_opcode_2_text(cmd);
         if (cmd_name == nullptr) {
@@ -928,6 +1265,31 @@ unique_cJSON_ptr McbpConnection::toJSON() const {
             cJSON_AddNumberToObject(ilist, "size", reservedItems.size());
             cJSON_AddItemToObject(obj, "itemlist", ilist);
         }
+        {
+            cJSON* sendq = cJSON_CreateObject();
+            cJSON_AddNumberToObject(sendq, "size", sendQueueSize);
+            cJSON_AddNumberToObject(sendq, "limit_hits", sendQueueLimitHits);
+            cJSON_AddNumberToObject(
+                    sendq, "unpinned_bytes", sendQueueUnpinnedBytes);
+            cJSON_AddItemToObject(obj, "send_queue", sendq);
+        }
+        {
+            // The (approximate) number of bytes of memory we're using
+            cJSON* memory = cJSON_CreateObject();
+            cJSON_AddNumberToObject(memory, "total", getMemoryUsage());
+            cJSON_AddNumberToObject(memory, "connection", sizeof(*this));
+            cJSON_AddNumberToObject(
+                    memory,
+                    "buffers",
+                    (read ? read->capacity() : 0) +
+                            (write ? write->capacity() : 0));
+            cJSON_AddNumberToObject(
+                    memory,
+                    "iov",
+                    IoVectorPool::getAllocationSize(iov, msglist));
+            cJSON_AddNumberToObject(memory, "ssl", ssl.getMemoryUsage());
+            cJSON_AddItemToObject(obj, "memory", memory);
+        }
         {
             cJSON* talloc = cJSON_CreateObject();
             cJSON_AddNumberToObject(talloc, "size", temp_alloc.size());
@@ -1001,6 +1363,12 @@ void McbpConnection::maybeLogSlowCommand(
             }
         }
 
+        const auto& tracer = getCookieObject().getTracer();
+        if (!tracer.empty()) {
+            details.append(", trace: ");
+            details.append(tracer.to_string());
+        }
+
         TRACE_INSTANT2("memcached/slow", "Slow cmd", "opcode", cmd, "connection_id", getId());
         LOG_WARNING(NULL,
                     "%u: Slow %s operation on connection: %s (%s)%s"
@@ -1014,6 +1382,18 @@ void McbpConnection::maybeLogSlowCommand(
     }
 }
 
+void McbpConnection::traceResponseSent() {
+    using cb::tracing::TraceCode;
+    auto& tracer = getCookieObject().getTracer();
+    if (!tracer.isActive(TraceCode::SendQueue)) {
+        return;
+    }
+
+    tracer.end(TraceCode::SendQueue);
+    maybeLogSlowCommand(std::chrono::duration_cast<std::chrono::milliseconds>(
+            tracer.getDuration(TraceCode::Request)));
+}
+
 bool McbpConnection::includeErrorStringInResponseBody(
     protocol_binary_response_status err) const {
     // Maintain backwards compatibility - return true for older commands which
@@ -1080,6 +1460,10 @@ void McbpConnection::runEventLoop(short which) {
     conn_loan_buffers(this);
     currentEvent = which;
     numEvents = max_reqs_per_event;
+    if (settings.isEventBudgetEnabled()) {
+        timesliceStart = ProcessClock::now();
+        timesliceBytes = totalRecv + totalSend;
+    }
 
     try {
         runStateMachinery();
@@ -1132,6 +1516,7 @@ void McbpConnection::signalIfIdle(bool logbusy, int workerthread) {
     auto state = getState();
     if (!isEwouldblock() &&
         (state == conn_read_packet_header || state == conn_read_packet_body ||
+         state == conn_read_value ||
          state == conn_waiting || state == conn_new_cmd ||
          state == conn_ship_log || state == conn_send_data)) {
         // Raise a 'fake' write event to ensure the connection has an
@@ -1157,6 +1542,36 @@ void McbpConnection::signalIfIdle(bool logbusy, int workerthread) {
     }
 }
 
+bool McbpConnection::isTimesliceBudgetExceeded() const {
+    const auto time = settings.getEventTimeBudget();
+    if (time.count() != 0 && ProcessClock::now() - timesliceStart >= time) {
+        return true;
+    }
+
+    const auto bytes = settings.getEventByteBudget();
+    return bytes != 0 && totalRecv + totalSend - timesliceBytes >= bytes;
+}
+
+bool McbpConnection::startNextCommand() {
+    --numEvents;
+    if (!settings.isEventBudgetEnabled()) {
+        return numEvents >= 0;
+    }
+
+    if (isTimesliceBudgetExceeded()) {
+        get_thread_stats(this)->conn_budget_yields++;
+        return false;
+    }
+    return true;
+}
+
+bool McbpConnection::hasTimesliceLeft() const {
+    if (settings.isEventBudgetEnabled()) {
+        return !isTimesliceBudgetExceeded();
+    }
+    return numEvents > 0;
+}
+
 void McbpConnection::setPriority(const Connection::Priority& priority) {
     Connection::setPriority(priority);
     switch (priority) {
@@ -1175,7 +1590,203 @@ void McbpConnection::setPriority(const Connection::Priority& priority) {
 }
 
 protocol_binary_response_status McbpConnection::validateCommand(protocol_binary_command command) {
-    return Bucket::validateMcbpCommand(this, command, cookie);
+    return Bucket::validateMcbpCommand(this, command, *currentCookie);
+}
+
+bool McbpConnection::isParkableCommand() const {
+    if (!allowUnorderedExecution() || isDCP() || currentCookie != &cookie ||
+        parkedCookies.size() >= MaxParkedCommands) {
+        return false;
+    }
+
+    switch (cmd) {
+    case PROTOCOL_BINARY_CMD_GET:
+    case PROTOCOL_BINARY_CMD_GETQ:
+    case PROTOCOL_BINARY_CMD_GETK:
+    case PROTOCOL_BINARY_CMD_GETKQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void McbpConnection::useParkableCookie() {
+    if (!spareCookie) {
+        if (idleCookies.empty()) {
+            spareCookie = std::make_unique<Cookie>(*this, true);
+        } else {
+            spareCookie = std::move(idleCookies.back());
+            idleCookies.pop_back();
+        }
+    }
+    currentCookie = spareCookie.get();
+}
+
+bool McbpConnection::startStreamingValue() {
+    const auto& header = binary_header.request;
+    switch (header.opcode) {
+    case PROTOCOL_BINARY_CMD_SET:
+    case PROTOCOL_BINARY_CMD_SETQ:
+    case PROTOCOL_BINARY_CMD_ADD:
+    case PROTOCOL_BINARY_CMD_ADDQ:
+    case PROTOCOL_BINARY_CMD_REPLACE:
+    case PROTOCOL_BINARY_CMD_REPLACEQ:
+        break;
+    default:
+        return false;
+    }
+
+    // Leave anything the validators would reject to the normal path
+    if (header.magic != PROTOCOL_BINARY_REQ || header.extlen != 8 ||
+        header.keylen == 0 || isDCP() || currentCookie != &cookie ||
+        header.bodylen < header.extlen + header.keylen + StreamValueThreshold) {
+        return false;
+    }
+
+    const size_t prefix = sizeof(binary_header) + header.extlen + header.keylen;
+    const size_t size = header.bodylen - header.extlen - header.keylen;
+    auto data = read->rdata();
+    if (data.size() < prefix) {
+        return false;
+    }
+
+    // Allocate the item the same way as MutationCommandContext does
+    const auto* req =
+            reinterpret_cast<const protocol_binary_request_set*>(data.data());
+    const DocKey key(data.data() + sizeof(binary_header) + header.extlen,
+                     header.keylen,
+                     getDocNamespace());
+    try {
+        auto ret = bucket_allocate_ex(*this,
+                                      key,
+                                      size,
+                                      0,
+                                      req->message.body.flags,
+                                      ntohl(req->message.body.expiration),
+                                      header.datatype,
+                                      header.vbucket);
+        if (!ret.first) {
+            return false;
+        }
+        streamedItem = std::move(ret.first);
+        streamedValue = {static_cast<char*>(ret.second.value[0].iov_base),
+                         size};
+    } catch (const cb::engine_error&) {
+        // Let MutationCommandContext deal with (and report) the error
+        return false;
+    }
+
+    try {
+        getCookieObject().setPacket({data.data(), prefix}, binary_header);
+    } catch (const std::bad_alloc&) {
+        releaseStreamedItem();
+        return false;
+    }
+
+    // Move the part of the value we've already received into the item.
+    // We don't have the entire packet, so it is less than the value.
+    streamedBytes = data.size() - prefix;
+    std::copy(data.data() + prefix, data.data() + data.size(),
+              streamedValue.buf);
+    read->consume([](cb::const_byte_buffer buffer) -> ssize_t {
+        return buffer.size();
+    });
+
+    return true;
+}
+
+int McbpConnection::readStreamedValue() {
+    if (isStreamedValueComplete()) {
+        throw std::logic_error(
+                "McbpConnection::readStreamedValue: the value is already "
+                "received");
+    }
+
+    auto res = recv(streamedValue.buf + streamedBytes,
+                    streamedValue.len - streamedBytes);
+    if (res > 0) {
+        streamedBytes += res;
+    }
+    return res;
+}
+
+void McbpConnection::parkCommand() {
+    if (currentCookie != spareCookie.get()) {
+        throw std::logic_error(
+                "McbpConnection::parkCommand: current command isn't "
+                "parkable");
+    }
+
+    if (!currentCookie->hasPacket()) {
+        const size_t size =
+                sizeof(binary_header) + binary_header.request.bodylen;
+        auto data = read->rdata();
+        if (data.size() < size) {
+            throw std::logic_error(
+                    "McbpConnection::parkCommand: Not enough data in input "
+                    "buffer");
+        }
+        currentCookie->setPacket({data.data(), size}, binary_header);
+    }
+
+    parkedCookies.emplace_back(std::move(spareCookie));
+    currentCookie = &cookie;
+    resetCommandContext();
+    setAiostat(ENGINE_SUCCESS);
+    setEwouldblock(false);
+}
+
+bool McbpConnection::replayParkedCommand() {
+    if (parkedCookies.empty()) {
+        return false;
+    }
+
+    auto iter = parkedCookies.end();
+    ENGINE_ERROR_CODE status = ENGINE_SUCCESS;
+    for (auto it = parkedCookies.begin(); it != parkedCookies.end(); ++it) {
+        if ((*it)->isNotified()) {
+            status = (*it)->clearNotified();
+            iter = it;
+            break;
+        }
+    }
+
+    if (iter == parkedCookies.end()) {
+        return false;
+    }
+
+    if (spareCookie) {
+        idleCookies.emplace_back(std::move(spareCookie));
+    }
+    spareCookie = std::move(*iter);
+    parkedCookies.erase(iter);
+    currentCookie = spareCookie.get();
+
+    // Restore the state try_read_mcbp_command would have set up for the
+    // command, and run it again with the status from the engine
+    binary_header = currentCookie->getBinaryHeader();
+    setCmd(binary_header.request.opcode);
+    setCAS(0);
+    setNoReply(false);
+    setStart(gethrtime());
+    setAiostat(status);
+    setState(conn_execute);
+    return true;
+}
+
+CommandContextPool* McbpConnection::getCommandContextPool() const {
+    auto* thr = getThread();
+    return thr == nullptr ? nullptr : thr->command_context_pool;
+}
+
+bool McbpConnection::waitForParkedCommands() {
+    parkedCookies.erase(std::remove_if(parkedCookies.begin(),
+                                       parkedCookies.end(),
+                                       [](const std::unique_ptr<Cookie>& c) {
+                                           return c->isNotified();
+                                       }),
+                        parkedCookies.end());
+    return !parkedCookies.empty();
 }
 
 void McbpConnection::logCommand() const {
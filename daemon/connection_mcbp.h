@@ -20,8 +20,11 @@
 
 #include "config.h"
 
+#include "cluster_config.h"
+#include "command_context_pool.h"
 #include "datatype.h"
 #include "dynamic_buffer.h"
+#include "io_vector_pool.h"
 #include "log_macros.h"
 #include "settings.h"
 #include "sslcert.h"
@@ -30,16 +33,21 @@
 #include <cJSON.h>
 #include <cbsasl/cbsasl.h>
 #include <daemon/protocol/mcbp/command_context.h>
+#include <daemon/protocol/mcbp/stats_context.h>
 #include <daemon/protocol/mcbp/steppable_command_context.h>
 #include <memcached/openssl.h>
 #include <platform/cb_malloc.h>
 #include <platform/make_unique.h>
 #include <platform/pipe.h>
+#include <platform/processclock.h>
 #include <platform/sized_buffer.h>
 
+#include <atomic>
 #include <chrono>
 #include <memory>
+#include <new>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "connection.h"
@@ -155,6 +163,15 @@ public:
      */
     void maybeLogSlowCommand(const std::chrono::milliseconds& elapsed) const;
 
+    /**
+     * The response of the current command has been sent (or the command
+     * didn't send one). Stop timing the send queue and log the command if
+     * it was slow; commands traced from conn_execute are logged here
+     * rather than when the response is queued so that the time spent in
+     * the send queue is part of the trace in the log.
+     */
+    void traceResponseSent();
+
     /**
      * Return the opaque value for the command being processed
      */
@@ -175,7 +192,7 @@ public:
      * @return the buffer to the key.
      */
     cb::const_char_buffer getKey() const {
-        auto *pkt = reinterpret_cast<const char *>(getPacket(cookie));
+        auto *pkt = reinterpret_cast<const char *>(getPacket(*currentCookie));
         cb::const_char_buffer ret;
         ret.len = binary_header.request.keylen;
         ret.buf = pkt + sizeof binary_header.bytes + binary_header.request.extlen;
@@ -202,13 +219,6 @@ public:
     bool includeErrorStringInResponseBody(
         protocol_binary_response_status err) const;
 
-    /**
-     * Decrement the number of events to process and return the new value
-     */
-    int decrementNumEvents() {
-        return --numEvents;
-    }
-
     /**
      * Set the number of events to process per timeslice of the worker
      * thread before yielding.
@@ -225,6 +235,25 @@ public:
         return max_reqs_per_event;
     }
 
+    /**
+     * Account for the next command (or DCP message) in the current
+     * timeslice of the worker thread.
+     *
+     * With Settings::isEventBudgetEnabled() the connection may go on
+     * until it used up the CPU time or the number of bytes it may use
+     * per timeslice, otherwise until it ran max_reqs_per_event commands.
+     *
+     * @return true if the connection may go on, false if it should yield
+     *         to the other connections
+     */
+    bool startNextCommand();
+
+    /**
+     * May the connection run the next command in the current timeslice
+     * (without accounting for it)?
+     */
+    bool hasTimesliceLeft() const;
+
     /**
      * Update the settings in libevent for this connection
      *
@@ -254,6 +283,48 @@ public:
         return registered_in_libevent;
     }
 
+    /**
+     * Ask the connection to move to another worker thread. The connection
+     * moves the next time it is in between two commands (see
+     * prepareMigration()). The caller must hold the lock of the thread
+     * the connection is bound to.
+     *
+     * @param target the thread to move to
+     */
+    void requestMigration(LIBEVENT_THREAD* target) {
+        migrationTarget = target;
+    }
+
+    LIBEVENT_THREAD* getMigrationTarget() const {
+        return migrationTarget;
+    }
+
+    /**
+     * Check if the connection should move to another worker thread. This
+     * is called in between two commands, and if the connection may move
+     * right now it is removed from the event base of its current thread.
+     * The connection keeps the request and tries again after the next
+     * command if it is busy (it has batched responses, parked commands or
+     * is waiting for the engine).
+     *
+     * @return true if the state machine should stop so that
+     *         run_event_loop() may hand the connection over to the new
+     *         thread
+     */
+    bool prepareMigration();
+
+    bool isMigrating() const override {
+        return migrating;
+    }
+
+    /**
+     * Bind the connection to the thread it is migrating to. This must be
+     * the last thing the old thread does with the connection.
+     *
+     * @return the thread the connection is now bound to
+     */
+    LIBEVENT_THREAD* completeMigration();
+
     short getEventFlags() const {
         return ev_flags;
     }
@@ -286,6 +357,27 @@ public:
      */
     void shrinkBuffers();
 
+    /**
+     * Borrow the io vectors used to send the responses from the pool of
+     * the worker thread (unless we've still got the ones we had)
+     */
+    void loanIoVectors(IoVectorPool& pool) {
+        pool.get(iov, msglist);
+    }
+
+    /**
+     * Give the io vectors back to the pool if the connection is idle
+     * (waiting for the next command) or closing. DCP connections keep
+     * theirs, as they're typically busy streaming data.
+     */
+    void returnIoVectors(IoVectorPool& pool);
+
+    /**
+     * Get the number of bytes of memory used by the connection object
+     * and the buffers it holds (excluding any items it references)
+     */
+    size_t getMemoryUsage() const;
+
     /**
      * Receive data from the socket
      *
@@ -307,6 +399,11 @@ public:
     enum class TransmitResult {
         /** All done writing. */
             Complete,
+        /**
+         * The response was batched up with the responses for the following
+         * pipelined commands (and will be sent together with them)
+         */
+            Batched,
         /** More data remaining to write. */
             Incomplete,
         /** Can't write any more right now. */
@@ -318,8 +415,20 @@ public:
     /**
      * Transmit the next chunk of data from our list of msgbuf structures.
      *
+     * If the client already sent us the next command (pipelining) and the
+     * response is small enough the response is copied into a separate
+     * batch buffer instead of being sent immediately, so that we may send
+     * the responses for multiple commands in a single system call. See
+     * Settings::getPipelineBatchSize().
+     *
+     * If the data can't be sent right away and the connection is over
+     * its send queue limit (see isSendQueueFull()) the unsent data is
+     * copied so that the items referenced by the response are released
+     * while we wait for the client.
+     *
      * Returns:
      *   Complete   All done writing.
+     *   Batched    The response is copied into the batch buffer
      *   Incomplete More data remaining to write.
      *   SoftError Can't write any more right now.
      *   HardError Can't write (c->state is set to conn_closing)
@@ -348,6 +457,46 @@ public:
      */
     TryReadResult tryReadNetwork();
 
+    /**
+     * Do we have batched up responses for previous (pipelined) commands
+     * which hasn't been sent to the client yet?
+     */
+    bool hasBatchedResponses() const {
+        return !batchedResponses.empty();
+    }
+
+    /**
+     * Try to send the batched up responses without blocking. Data which
+     * couldn't be sent is kept and sent together with the next response.
+     * This is used when the next command would block so that the client
+     * doesn't have to wait for the responses for the previous commands.
+     */
+    void flushBatchedResponses();
+
+    /**
+     * Get the number of bytes of responses waiting to be sent to the
+     * client (which isn't necessarily queued up in the write pipe)
+     */
+    size_t getSendQueueSize() const {
+        return sendQueueSize;
+    }
+
+    /**
+     * Would the connection (or the worker thread serving it) be over its
+     * send queue limit with the given number of bytes waiting to be sent
+     * (see Settings::getMaxSendQueueSize and
+     * Settings::getMaxThreadSendQueueSize)?
+     */
+    bool isSendQueueFull(size_t pending) const;
+
+    /**
+     * Drop all batched up responses (and reset the transmit state). Used
+     * when the connection is being closed.
+     */
+    void clearBatchedResponses() {
+        sendCompleted();
+    }
+
     const TaskFunction getWriteAndGo() const {
         return write_and_go;
     }
@@ -389,6 +538,7 @@ public:
             bucketEngine->release(handle, this, it);
         }
         reservedItems.clear();
+        reservedConfigurations.clear();
     }
 
     /**
@@ -406,6 +556,77 @@ public:
         }
     }
 
+    /**
+     * Hold on to the cluster configuration until we're done sending the
+     * response (so that it may be referenced from the IO vector). It is
+     * released by releaseReservedItems.
+     *
+     * @return true if success, false otherwise
+     */
+    bool reserveClusterConfiguration(
+            std::shared_ptr<const ClusterConfiguration::Configuration> config) {
+        try {
+            reservedConfigurations.push_back(std::move(config));
+            return true;
+        } catch (std::bad_alloc) {
+            return false;
+        }
+    }
+
+    /// Mutations with a value of at least this size are read straight
+    /// into the item (see startStreamingValue)
+    static constexpr size_t StreamValueThreshold = 1024 * 1024;
+
+    /**
+     * Try to read the value of the mutation in binary_header straight
+     * into an item allocated from the engine, rather than buffering the
+     * entire packet in the input pipe. This is only done for SET, ADD
+     * and REPLACE with a value of at least StreamValueThreshold bytes,
+     * and only once the header, extras and key are in the input pipe.
+     *
+     * On success the header, extras and key are copied into the cookie
+     * (see Cookie::setPacket) and the part of the packet received so far
+     * is moved out of the input pipe. The rest of the value should be
+     * read with readStreamedValue.
+     *
+     * @return true if the value is streamed, false if the packet should
+     *         be buffered in the input pipe as usual
+     */
+    bool startStreamingValue();
+
+    /**
+     * Receive more of the streamed value from the socket
+     *
+     * @return the number of bytes read, 0 for end of stream and -1 for
+     *         an error (see recv)
+     */
+    int readStreamedValue();
+
+    bool hasStreamedItem() const {
+        return streamedItem.get() != nullptr;
+    }
+
+    bool isStreamedValueComplete() const {
+        return streamedBytes == streamedValue.len;
+    }
+
+    /// Get the item the value of the current command was read into
+    item* getStreamedItem() const {
+        return streamedItem.get();
+    }
+
+    /// Get the value of the current command in the streamed item
+    cb::const_char_buffer getStreamedValue() const {
+        return {streamedValue.buf, streamedValue.len};
+    }
+
+    /// Release the streamed item (if it wasn't stored it is dropped)
+    void releaseStreamedItem() {
+        streamedItem.reset();
+        streamedValue = {};
+        streamedBytes = 0;
+    }
+
     void releaseTempAlloc() {
         for (auto* ptr : temp_alloc) {
             cb_free(ptr);
@@ -542,12 +763,21 @@ public:
     }
 
 
-    const ENGINE_ERROR_CODE& getAiostat() const {
-        return aiostat;
+    ENGINE_ERROR_CODE getAiostat() const {
+        return aiostat.load();
     }
 
     void setAiostat(const ENGINE_ERROR_CODE& aiostat) {
-        McbpConnection::aiostat = aiostat;
+        McbpConnection::aiostat.store(aiostat);
+    }
+
+    /**
+     * Grab the status for the async io operation and replace it with
+     * the provided value (the engine may set the status from another
+     * thread through notify_io_complete)
+     */
+    ENGINE_ERROR_CODE exchangeAiostat(ENGINE_ERROR_CODE status) {
+        return aiostat.exchange(status);
     }
 
     bool isEwouldblock() const {
@@ -565,6 +795,14 @@ public:
         return commandContext.get();
     }
 
+    /**
+     * Get the stats last sent to this connection by "stats snapshot",
+     * keyed by the stat group
+     */
+    std::unordered_map<std::string, StatsSnapshot>& getStatsSnapshots() {
+        return statsSnapshots;
+    }
+
     /**
      * Get the command context stored for this command as
      * the given type or make it if it doesn't exist
@@ -577,8 +815,24 @@ public:
     ContextType& obtainContext(Args&&... args) {
         auto* context = commandContext.get();
         if (context == nullptr) {
-            auto* ret = new ContextType(std::forward<Args>(args)...);
-            commandContext.reset(ret);
+            auto* pool = getCommandContextPool();
+            if (pool == nullptr) {
+                auto* ret = new ContextType(std::forward<Args>(args)...);
+                commandContext = CommandContextPtr(ret);
+                return *ret;
+            }
+
+            auto* memory = pool->allocate(sizeof(ContextType));
+            ContextType* ret;
+            try {
+                ret = new (memory) ContextType(std::forward<Args>(args)...);
+            } catch (...) {
+                pool->deallocate(memory, sizeof(ContextType));
+                throw;
+            }
+            commandContext = CommandContextPtr(
+                    ret,
+                    CommandContextDeleter{pool, memory, sizeof(ContextType)});
             return *ret;
         }
         auto* ret = dynamic_cast<ContextType*>(context);
@@ -615,7 +869,7 @@ public:
      *  Set the command context stored for this command
      */
     void setCommandContext(CommandContext* cmd_context) {
-        McbpConnection::commandContext.reset(cmd_context);
+        McbpConnection::commandContext = CommandContextPtr(cmd_context);
     }
 
     /**
@@ -709,18 +963,85 @@ public:
     /** Write buffer */
     std::unique_ptr<cb::Pipe> write;
 
+    /**
+     * Get the cookie for the command currently being executed. This is
+     * normally the connections own cookie, but parkable commands in
+     * unordered execution mode use a cookie of their own (see
+     * parkCommand()).
+     */
     const void* getCookie() const {
-        return &cookie;
+        return currentCookie;
     }
 
     Cookie& getCookieObject() {
-        return cookie;
+        return *currentCookie;
+    }
+
+    const Cookie& getCookieObject() const {
+        return *currentCookie;
+    }
+
+    /**
+     * Switch back to the connections own cookie once the current command
+     * is done.
+     */
+    void resetCurrentCookie() {
+        currentCookie = &cookie;
+    }
+
+    /**
+     * Check if the current command may be parked if the engine blocks.
+     * In unordered execution mode a retrieval command blocking in the
+     * engine (for instance waiting for a background fetch) don't need to
+     * block the rest of the commands in the pipeline; the client matches
+     * the responses by their opaque.
+     */
+    bool isParkableCommand() const;
+
+    /**
+     * Run the current command with a cookie of its own so that it may
+     * wait for the engine without blocking the connection.
+     */
+    void useParkableCookie();
+
+    /**
+     * Park the current command (which returned EWOULDBLOCK) on its own
+     * cookie, and switch back to the connections cookie so that we can
+     * start executing the next command. The command is executed again
+     * (by replayParkedCommand()) once the engine notifies its cookie.
+     */
+    void parkCommand();
+
+    /**
+     * Start executing a parked command if the engine notified its cookie.
+     *
+     * @return true if the state changed to conn_execute for the command
+     */
+    bool replayParkedCommand();
+
+    bool hasParkedCommands() const {
+        return !parkedCookies.empty();
     }
 
+    /**
+     * Drop the parked commands which the engine have notified (used when
+     * we're closing the connection)
+     *
+     * @return true if we're still waiting for the engine to notify some
+     *         parked commands
+     */
+    bool waitForParkedCommands();
+
+    /// The maximum number of commands which may be parked per connection
+    static const size_t MaxParkedCommands = 64;
+
     /**
      * Obtain a pointer to the packet for the Cookie's connection
      */
     static void* getPacket(const Cookie& cookie) {
+        if (cookie.hasPacket()) {
+            return const_cast<uint8_t*>(cookie.getPacket());
+        }
         auto avail = cookie.connection.read->rdata();
         return const_cast<void*>(static_cast<const void*>(avail.data()));
     }
@@ -784,6 +1105,52 @@ protected:
 
     void logResponse(const char* reason) const;
 
+    /**
+     * Try to copy the current response into the batch buffer (see
+     * transmit()). If the response can't be batched (and we've got
+     * batched responses) the batch buffer is inserted in front of the
+     * current response.
+     *
+     * @return true if the response was copied into the batch buffer
+     */
+    bool tryBatchResponse();
+
+    /**
+     * Insert the batched responses as the first entry in the IO vector
+     */
+    void prependBatchedResponses();
+
+    /// transmit() without the send queue accounting
+    TransmitResult transmitData();
+
+    /**
+     * Recalculate the number of bytes waiting to be sent, and update the
+     * total of the worker thread
+     */
+    void updateSendQueueSize();
+
+    /**
+     * The client isn't reading the response fast enough, and we're over
+     * the send queue limit: copy the data still to be sent out of the
+     * items (and other buffers) it references so that they may be
+     * released right away.
+     */
+    void unpinSendQueue();
+
+    /**
+     * The current response (and the batched responses) was completely
+     * sent
+     */
+    void sendCompleted() {
+        sendInProgress = false;
+        batchedResponses.clear();
+        if (!unpinnedData.empty()) {
+            unpinnedData.clear();
+            unpinnedData.shrink_to_fit();
+        }
+        updateSendQueueSize();
+    }
+
     /**
      * The state machine we're currently using
      */
@@ -809,6 +1176,14 @@ protected:
      */
     int numEvents;
 
+    /// When the current timeslice started, and the number of bytes
+    /// read and sent before it (see startNextCommand)
+    ProcessClock::time_point timesliceStart;
+    size_t timesliceBytes = 0;
+
+    /// Did the connection use up its timeslice budget?
+    bool isTimesliceBudgetExceeded() const;
+
     /** current command being processed */
     uint8_t cmd;
 
@@ -829,10 +1204,19 @@ protected:
     /** If ev_timeout_enabled is true, the current timeout in libevent */
     rel_time_t ev_timeout;
 
+    /**
+     * The worker thread we should move to (protected by the lock of the
+     * thread we're bound to)
+     */
+    LIBEVENT_THREAD* migrationTarget;
+    /** Are we removed from our thread and waiting to be handed over? */
+    bool migrating;
+
     /** which state to go into after finishing current write */
     TaskFunction write_and_go;
 
-    /* data for the mwrite state */
+    /* data for the mwrite state (borrowed from the io vector pool of the
+       worker thread while the connection isn't idle) */
     std::vector<iovec> iov;
     /** number of elements used in iov[] */
     size_t iovused;
@@ -844,12 +1228,49 @@ protected:
     /** number of bytes in current msg */
     int msgbytes;
 
+    /** Have we started to transmit the current response */
+    bool sendInProgress;
+
+    /**
+     * Responses for previous (pipelined) commands which we haven't
+     * sent to the client yet
+     */
+    std::vector<uint8_t> batchedResponses;
+
+    /// The number of bytes of responses waiting to be sent
+    size_t sendQueueSize = 0;
+
+    /// The number of times we couldn't send while over the limit
+    uint64_t sendQueueLimitHits = 0;
+
+    /// The number of bytes copied by unpinSendQueue()
+    uint64_t sendQueueUnpinnedBytes = 0;
+
+    /// The copy of the current response made by unpinSendQueue()
+    std::vector<uint8_t> unpinnedData;
+
     /**
      * List of items we've reserved during the command (should call
      * item_release when transmit is complete)
      */
     std::vector<void*> reservedItems;
 
+    /**
+     * The cluster configurations referenced by the responses we're
+     * sending (see reserveClusterConfiguration)
+     */
+    std::vector<std::shared_ptr<const ClusterConfiguration::Configuration>>
+            reservedConfigurations;
+
+    /**
+     * The item the value of the current command is read into (see
+     * startStreamingValue), the value in the item and how much of it
+     * has been received
+     */
+    cb::unique_item_ptr streamedItem;
+    cb::char_buffer streamedValue;
+    size_t streamedBytes = 0;
+
     /**
      * A vector of temporary allocations that should be freed when the
      * the connection is done sending all of the data. Use pushTempAlloc to
@@ -892,13 +1313,22 @@ protected:
     /**
      * The status for the async io operation
      */
-    ENGINE_ERROR_CODE aiostat;
+    std::atomic<ENGINE_ERROR_CODE> aiostat;
 
     /**
      * Is this connection currently in an "ewouldblock" state?
      */
     bool ewouldblock;
 
+    /**
+     * Get the pool to allocate command contexts from (the pool of the
+     * worker thread serving the connection)
+     */
+    CommandContextPool* getCommandContextPool() const;
+
+    using CommandContextPtr =
+            std::unique_ptr<CommandContext, CommandContextDeleter>;
+
     /**
      *  command-specific context - for use by command executors to maintain
      *  additional state while executing a command. For example
@@ -907,7 +1337,13 @@ protected:
      *
      *  Between each command this is deleted and reset to nullptr.
      */
-    std::unique_ptr<CommandContext> commandContext;
+    CommandContextPtr commandContext;
+
+    /**
+     * The stats last sent for each stat group by "stats snapshot" (unlike
+     * the command context they need to outlive the command)
+     */
+    std::unordered_map<std::string, StatsSnapshot> statsSnapshots;
 
     /**
      * The SSL context used by this connection (if enabled)
@@ -940,6 +1376,17 @@ protected:
      */
     int sslWrite(const char* src, size_t nbytes);
 
+    /**
+     * Write the data in the message over the SSL stream. The small io
+     * vectors in the message (response headers, keys, small values) are
+     * coalesced into full size TLS records instead of being sent as one
+     * record each.
+     *
+     * @param m the message to send
+     * @return the number of bytes written
+     */
+    int sslSendmsg(struct msghdr* m);
+
     /**
      * Handle the state for the ssl connection before the ssl connection
      * is fully established
@@ -953,6 +1400,24 @@ protected:
 
     Cookie cookie;
 
+    /// The cookie for the command currently being executed
+    Cookie* currentCookie;
+
+    /**
+     * The cookie used to execute the next (or current) parkable command
+     * in unordered execution mode (allocated the first time we need it)
+     */
+    std::unique_ptr<Cookie> spareCookie;
+
+    /**
+     * The parkable cookies we're done with, kept around to avoid
+     * allocating a new cookie every time a command is parked
+     */
+    std::vector<std::unique_ptr<Cookie>> idleCookies;
+
+    /// The cookies for the commands waiting for the engine to notify them
+    std::vector<std::unique_ptr<Cookie>> parkedCookies;
+
     Datatype datatype;
 
     /**
@@ -16,6 +16,9 @@
  */
 
 #include "connections.h"
+#include "buffer_pool.h"
+#include "io_vector_pool.h"
+#include "mc_time.h"
 #include "runtime.h"
 #include "utilities/protocol2text.h"
 #include "settings.h"
@@ -47,10 +50,10 @@ enum class BufferLoan {
 /** Function prototypes ******************************************************/
 
 static BufferLoan loan_single_buffer(McbpConnection& c,
-                                     std::unique_ptr<cb::Pipe>& thread_buf,
+                                     BufferPool& pool,
                                      std::unique_ptr<cb::Pipe>& conn_buf);
 static void maybe_return_single_buffer(McbpConnection& c,
-                                       std::unique_ptr<cb::Pipe>& thread_buf,
+                                       BufferPool& pool,
                                        std::unique_ptr<cb::Pipe>& conn_buf);
 static void conn_destructor(Connection *c);
 static Connection *allocate_connection(SOCKET sfd,
@@ -61,7 +64,8 @@ static ListenConnection* allocate_listen_connection(SOCKET sfd,
                                                     event_base* base,
                                                     in_port_t port,
                                                     sa_family_t family,
-                                                    const struct interface& interf);
+                                                    const struct interface& interf,
+                                                    LIBEVENT_THREAD* owner);
 
 static void release_connection(Connection *c);
 
@@ -152,6 +156,16 @@ void close_all_connections(void)
             usleep(500);
         }
     } while (!done);
+
+    // Release the command contexts while the pools of the worker
+    // threads they may belong to are still around
+    std::lock_guard<std::mutex> lock(connections.mutex);
+    for (auto* c : connections.conns) {
+        auto* mcbp = dynamic_cast<McbpConnection*>(c);
+        if (mcbp != nullptr) {
+            mcbp->resetCommandContext();
+        }
+    }
 }
 
 void run_event_loop(Connection* c, short which) {
@@ -166,10 +180,15 @@ void run_event_loop(Connection* c, short which) {
     auto* thread = c->getThread();
     if (thread != nullptr) {
         scheduler_info[thread->index].add(ns);
+        thread->busy_time += uint64_t(ns);
     }
 
     if (c->shouldDelete()) {
         release_connection(c);
+    } else if (c->isMigrating()) {
+        // This must be the last thing we do with the connection as the
+        // new thread may start running it right away
+        dispatch_conn_migrate(*static_cast<McbpConnection*>(c));
     }
 }
 
@@ -177,8 +196,10 @@ ListenConnection* conn_new_server(const SOCKET sfd,
                                   in_port_t parent_port,
                                   sa_family_t family,
                                   const struct interface& interf,
-                                  struct event_base* base) {
-    auto* c = allocate_listen_connection(sfd, base, parent_port, family, interf);
+                                  struct event_base* base,
+                                  LIBEVENT_THREAD* owner) {
+    auto* c = allocate_listen_connection(sfd, base, parent_port, family,
+                                         interf, owner);
     if (c == nullptr) {
         return nullptr;
     }
@@ -237,6 +258,7 @@ Connection* conn_new(const SOCKET sfd, in_port_t parent_port,
 
 void conn_cleanup_engine_allocations(McbpConnection * c) {
     c->releaseReservedItems();
+    c->releaseStreamedItem();
 }
 
 static void conn_cleanup(Connection *c) {
@@ -250,6 +272,7 @@ static void conn_cleanup(Connection *c) {
         mcbpc->releaseTempAlloc();
         mcbpc->read->clear();
         mcbpc->write->clear();
+        mcbpc->clearBatchedResponses();
         /* Return any buffers back to the thread; before we disassociate the
          * connection from the thread. Note we clear DCP status first, so
          * conn_return_buffers() will actually free the buffers.
@@ -289,11 +312,11 @@ void conn_close(McbpConnection *c) {
         throw std::logic_error("conn_close: unable to obtain non-NULL thread from connection");
     }
     /* remove from pending-io list */
-    if (settings.getVerbose() > 1 && list_contains(thread->pending_io, c)) {
+    if (settings.getVerbose() > 1 && c->isPendingIo()) {
         LOG_WARNING(c,
                     "Current connection was in the pending-io list.. Nuking it");
     }
-    thread->pending_io = list_remove(thread->pending_io, c);
+    remove_conn_from_pending_io_list(c);
 
     conn_cleanup(c);
 
@@ -356,7 +379,8 @@ void conn_loan_buffers(Connection *connection) {
     }
 
     auto* ts = get_thread_stats(c);
-    switch (loan_single_buffer(*c, c->getThread()->read, c->read)) {
+    auto& pool = *c->getThread()->buffer_pool;
+    switch (loan_single_buffer(*c, pool, c->read)) {
     case BufferLoan::Existing:
         ts->rbufs_existing++;
         break;
@@ -368,7 +392,7 @@ void conn_loan_buffers(Connection *connection) {
         break;
     }
 
-    switch (loan_single_buffer(*c, c->getThread()->write, c->write)) {
+    switch (loan_single_buffer(*c, pool, c->write)) {
     case BufferLoan::Existing:
         ts->wbufs_existing++;
         break;
@@ -379,6 +403,8 @@ void conn_loan_buffers(Connection *connection) {
         ts->wbufs_allocated++;
         break;
     }
+
+    c->loanIoVectors(*c->getThread()->io_vector_pool);
 }
 
 void conn_return_buffers(Connection *connection) {
@@ -394,13 +420,36 @@ void conn_return_buffers(Connection *connection) {
         return;
     }
 
-    if (c->isDCP()) {
-        // DCP work differently - let them keep their buffers once allocated.
+    maybe_return_single_buffer(*c, *thread->buffer_pool, c->read);
+    maybe_return_single_buffer(*c, *thread->buffer_pool, c->write);
+    c->returnIoVectors(*thread->io_vector_pool);
+}
+
+void conn_ensure_read_capacity(McbpConnection& c, size_t nbytes) {
+    auto& read = c.read;
+    const size_t needed = read->rsize() + nbytes;
+    if (read->capacity() >= needed) {
+        read->ensureCapacity(nbytes);
         return;
     }
 
-    maybe_return_single_buffer(*c, thread->read, c->read);
-    maybe_return_single_buffer(*c, thread->write, c->write);
+    // Rather than growing the (small) buffer we've got, borrow a buffer
+    // of the right size class from the pool (so that it may be reused by
+    // the next connection receiving a large packet once we're done)
+    auto& pool = *c.getThread()->buffer_pool;
+    auto buffer = pool.get(needed);
+    if (!buffer) {
+        buffer = BufferPool::allocate(needed);
+    }
+
+    auto data = read->rdata();
+    std::copy(data.begin(), data.end(), buffer->wdata().begin());
+    buffer->produced(data.size());
+    read.swap(buffer);
+
+    // The data is moved to the new buffer; the old one may be reused
+    buffer->clear();
+    pool.release(std::move(buffer), mc_time_get_current_time());
 }
 
 /** Internal functions *******************************************************/
@@ -444,11 +493,12 @@ static ListenConnection* allocate_listen_connection(SOCKET sfd,
                                                     event_base* base,
                                                     in_port_t port,
                                                     sa_family_t family,
-                                                    const struct interface& interf) {
+                                                    const struct interface& interf,
+                                                    LIBEVENT_THREAD* owner) {
     ListenConnection *ret = nullptr;
 
     try {
-        ret = new ListenConnection(sfd, base, port, family, interf);
+        ret = new ListenConnection(sfd, base, port, family, interf, owner);
         std::lock_guard<std::mutex> lock(connections.mutex);
         connections.conns.push_back(ret);
         stats.conn_structs++;
@@ -487,22 +537,22 @@ static void release_connection(Connection *c) {
  * necessary.
  */
 static BufferLoan loan_single_buffer(McbpConnection& c,
-                                     std::unique_ptr<cb::Pipe>& thread_buf,
+                                     BufferPool& pool,
                                      std::unique_ptr<cb::Pipe>& conn_buf) {
     /* Already have a (partial) buffer - nothing to do. */
     if (conn_buf) {
         return BufferLoan::Existing;
     }
 
-    // If the thread has a buffer, let's loan that to the connection
-    if (thread_buf) {
-        thread_buf.swap(conn_buf);
+    // If the pool has a buffer, let's loan that to the connection
+    conn_buf = pool.get(DATA_BUFFER_SIZE);
+    if (conn_buf) {
         return BufferLoan::Loaned;
     }
 
     // Need to allocate a new buffer
     try {
-        conn_buf = std::make_unique<cb::Pipe>(DATA_BUFFER_SIZE);
+        conn_buf = BufferPool::allocate(DATA_BUFFER_SIZE);
     } catch (const std::bad_alloc&) {
         // Unable to alloc a buffer for the thread. Not much we can do here
         // other than terminate the current connection.
@@ -520,17 +570,22 @@ static BufferLoan loan_single_buffer(McbpConnection& c,
 }
 
 static void maybe_return_single_buffer(McbpConnection& c,
-                                       std::unique_ptr<cb::Pipe>& thread_buf,
+                                       BufferPool& pool,
                                        std::unique_ptr<cb::Pipe>& conn_buf) {
-    if (conn_buf && conn_buf->empty()) {
-        // Buffer clean, dispose of it
-        if (thread_buf) {
-            // Already got a thread buffer.. release this one
-            conn_buf.reset();
-        } else {
-            conn_buf.swap(thread_buf);
-        }
+    if (!conn_buf || !conn_buf->empty()) {
+        return;
     }
+
+    // DCP connections keep their buffers once allocated (they're
+    // typically busy streaming data), unless the buffer grew to serve
+    // a large packet.
+    if (c.isDCP() && conn_buf->capacity() <= DATA_BUFFER_SIZE) {
+        return;
+    }
+
+    // Buffer clean, give it back to the pool (which release it if the
+    // pool is full)
+    pool.release(std::move(conn_buf), mc_time_get_current_time());
 }
 
 ENGINE_ERROR_CODE apply_connection_trace_mask(const std::string& connid,
@@ -57,6 +57,16 @@ void conn_loan_buffers(Connection *c);
  */
 void conn_return_buffers(Connection *c);
 
+/**
+ * Make sure that the read buffer of the connection may hold nbytes more
+ * bytes. If the current buffer is too small we borrow a buffer of the
+ * right size class from the thread's buffer pool (and give the small one
+ * back to the pool) rather than growing the small buffer.
+ *
+ * @throws std::bad_alloc if we fail to allocate memory for the buffer
+ */
+void conn_ensure_read_capacity(McbpConnection& c, size_t nbytes);
+
 /**
  * Cerate a new client connection
  *
@@ -79,12 +89,16 @@ Connection* conn_new(const SOCKET sfd,
  * @param family the address family used for the port
  * @param interf the interface description
  * @param base the event base to use for the socket
+ * @param owner the worker thread owning the socket (when running with
+ *              SO_REUSEPORT listeners), or nullptr if the socket is
+ *              serviced by the dispatcher thread
  */
 ListenConnection* conn_new_server(const SOCKET sfd,
                                   in_port_t parent_port,
                                   sa_family_t family,
                                   const struct interface& interf,
-                                  struct event_base* base);
+                                  struct event_base* base,
+                                  LIBEVENT_THREAD* owner = nullptr);
 
 /*
  * Closes a connection. Afterwards the connection is invalid (can no longer
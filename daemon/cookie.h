@@ -16,8 +16,15 @@
  */
 #pragma once
 
+#include "tracer.h"
+
+#include <memcached/engine_error.h>
+#include <memcached/protocol_binary.h>
+#include <platform/sized_buffer.h>
 #include <platform/uuid.h>
+#include <atomic>
 #include <stdexcept>
+#include <vector>
 
 class McbpConnection;
 
@@ -31,7 +38,16 @@ class McbpConnection;
  */
 class Cookie {
 public:
-    Cookie(McbpConnection& conn) : connection(conn) {
+    /**
+     * Create a new cookie
+     *
+     * @param conn the connection the cookie belongs to
+     * @param parkable_ set to true for the cookies used to run commands
+     *                  which may be parked while they wait for the engine
+     *                  (see McbpConnection::parkCommand())
+     */
+    Cookie(McbpConnection& conn, bool parkable_ = false)
+        : connection(conn), parkable(parkable_) {
     }
 
     void validate() const {
@@ -49,6 +65,81 @@ public:
         event_id.clear();
         error_context.clear();
         json_message.clear();
+        packet.clear();
+        tracer.clear();
+    }
+
+    bool isParkable() const {
+        return parkable;
+    }
+
+    /**
+     * Keep a copy of the request so that the command may be executed
+     * again once the engine notifies the cookie.
+     *
+     * @param data the entire request packet (in network byte order)
+     * @param header the header of the request (in host local byte order)
+     */
+    void setPacket(cb::const_byte_buffer data,
+                   const protocol_binary_request_header& header) {
+        packet.assign(data.data(), data.data() + data.size());
+        binary_header = header;
+    }
+
+    /// Does the cookie hold a copy of the request
+    bool hasPacket() const {
+        return !packet.empty();
+    }
+
+    /// Get the copy of the request (in network byte order)
+    const uint8_t* getPacket() const {
+        return packet.data();
+    }
+
+    /// Get the header of the copy of the request (in host local byte order)
+    const protocol_binary_request_header& getBinaryHeader() const {
+        return binary_header;
+    }
+
+    /**
+     * The engine notified the cookie of a parked command (called from
+     * the engine's thread)
+     */
+    void setNotified(ENGINE_ERROR_CODE status) {
+        aiostat = status;
+        notified.store(true, std::memory_order_release);
+    }
+
+    bool isNotified() const {
+        return notified.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Clear the notification
+     *
+     * @return the status provided by the engine
+     */
+    ENGINE_ERROR_CODE clearNotified() {
+        notified.store(false, std::memory_order_relaxed);
+        return aiostat;
+    }
+
+    /**
+     * Count a notification from the engine (called from the engine's
+     * thread through notify_io_complete after the status is stored)
+     */
+    void incrementNotifications() {
+        notifications.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * Get the number of times the engine notified the cookie. Commands
+     * which have multiple operations outstanding in the engine use this
+     * to tell if all of them completed, as the connection may be run
+     * once for multiple notifications.
+     */
+    uint64_t getNotifications() const {
+        return notifications.load(std::memory_order_acquire);
     }
 
     /**
@@ -100,6 +191,15 @@ public:
      */
     const std::string& getErrorJson();
 
+    /// Get the trace of the phases of the command
+    cb::tracing::Tracer& getTracer() {
+        return tracer;
+    }
+
+    const cb::tracing::Tracer& getTracer() const {
+        return tracer;
+    }
+
     McbpConnection& connection;
 
 protected:
@@ -114,6 +214,8 @@ protected:
      */
     const uint64_t magic = 0xdeadcafe;
 
+    const bool parkable;
+
     mutable std::string event_id;
     std::string error_context;
     /**
@@ -121,4 +223,17 @@ protected:
      * transferred to the client.
      */
     std::string json_message;
+
+    /// The copy of the request for a parked command
+    std::vector<uint8_t> packet;
+    protocol_binary_request_header binary_header;
+
+    /// Set when the engine notifies a parked command
+    std::atomic_bool notified{false};
+    ENGINE_ERROR_CODE aiostat = ENGINE_SUCCESS;
+
+    /// The number of times notify_io_complete was called for the cookie
+    std::atomic<uint64_t> notifications{0};
+
+    cb::tracing::Tracer tracer;
 };
@@ -37,6 +37,8 @@ bool Datatype::isSupported(cb::mcbp::Feature feature) {
     case cb::mcbp::Feature::Duplex:
     case cb::mcbp::Feature::ClustermapChangeNotification:
     case cb::mcbp::Feature::UnorderedExecution:
+    case cb::mcbp::Feature::Tracing:
+    case cb::mcbp::Feature::Durability:
         throw std::invalid_argument("Datatype::isSupported invalid feature:" +
                                     std::to_string(int(feature)));
     }
@@ -65,6 +67,8 @@ void Datatype::enable(cb::mcbp::Feature feature) {
     case cb::mcbp::Feature::Invalid:
     case cb::mcbp::Feature::ClustermapChangeNotification:
     case cb::mcbp::Feature::UnorderedExecution:
+    case cb::mcbp::Feature::Tracing:
+    case cb::mcbp::Feature::Durability:
         throw std::invalid_argument("Datatype::enable invalid feature:" +
                                     std::to_string(int(feature)));
     }
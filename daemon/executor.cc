@@ -48,7 +48,8 @@ void Executor::run() {
             break;
         }
 
-        auto task = runq.front();
+        auto task = runq.front().task;
+        const auto runnableTime = runq.front().time;
         runq.pop();
 
         // Release the lock so that others may schedule new events
@@ -57,7 +58,22 @@ void Executor::run() {
         // Lock the task so no one else can touch it and we won't
         // have any races..
         task->getMutex().lock();
-        if (task->execute() == Task::Status::Finished) {
+        const auto start = ProcessClock::now();
+        const auto status = task->execute();
+        const auto end = ProcessClock::now();
+
+        const auto qtime = start - runnableTime;
+        const auto runtime = end - start;
+        lock.lock();
+        auto& typeStats = stats[size_t(task->getType())];
+        ++typeStats.runs;
+        typeStats.qtime += qtime;
+        typeStats.maxQtime = std::max(typeStats.maxQtime, qtime);
+        typeStats.runtime += runtime;
+        typeStats.maxRuntime = std::max(typeStats.maxRuntime, runtime);
+        lock.unlock();
+
+        if (status == Task::Status::Finished) {
             // Unlock the mutex, we're not going to use this anymore
             // By not holding the mutex in notifyExecutionComplete
             // we won't get any warnings from ThreadSanitizer by
@@ -103,7 +119,7 @@ void Executor::schedule(const std::shared_ptr<Task>& task, bool runnable) {
     task->setExecutor(this);
 
     if (runnable) {
-        runq.push(task);
+        runq.push({task, ProcessClock::now()});
         idlecond.notify_all();
     } else {
         waitq[task.get()] = task;
@@ -122,7 +138,7 @@ void Executor::makeRunnable(Task* task) {
     if (iter == waitq.end()) {
         throw std::runtime_error("Internal error object is not in the waitq");
     }
-    runq.push(iter->second);
+    runq.push({iter->second, ProcessClock::now()});
     waitq.erase(iter);
     idlecond.notify_all();
 }
@@ -180,6 +196,20 @@ size_t Executor::futureqSize() const {
     return futureq.size();
 }
 
+Executor::Stats& Executor::Stats::operator+=(const Stats& other) {
+    runs += other.runs;
+    qtime += other.qtime;
+    maxQtime = std::max(maxQtime, other.maxQtime);
+    runtime += other.runtime;
+    maxRuntime = std::max(maxRuntime, other.maxRuntime);
+    return *this;
+}
+
+Executor::Stats Executor::getStats(TaskType type) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return stats[size_t(type)];
+}
+
 std::unique_ptr<Executor> createWorker(cb::ProcessClockSource& clock) {
     auto* executor = new Executor(clock);
     executor->start();
@@ -16,21 +16,19 @@
  */
 #pragma once
 
+#include "task.h"
+
 #include <platform/platform.h>
 #include <platform/processclock.h>
 #include <platform/thread.h>
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <queue>
 #include <unordered_map>
 
-/**
- * Forward decl of the Task to avoid circular dependencies
- */
-class Task;
-
 /**
  * The Executor class represents a single executor thread. It keeps
  * working on items in the runq and whenever a request can't be completed
@@ -84,6 +82,20 @@ public:
 
     size_t futureqSize() const;
 
+    /// How the executor ran the tasks of a type
+    struct Stats {
+        uint64_t runs = 0;
+        // From being made runnable to being executed
+        ProcessClock::duration qtime{0};
+        ProcessClock::duration maxQtime{0};
+        ProcessClock::duration runtime{0};
+        ProcessClock::duration maxRuntime{0};
+
+        Stats& operator+=(const Stats& other);
+    };
+
+    Stats getStats(TaskType type) const;
+
 protected:
     virtual void run() override;
 
@@ -104,10 +116,21 @@ protected:
      */
     mutable std::mutex mutex;
 
+    struct RunnableTask {
+        std::shared_ptr<Task> task;
+        // When it was made runnable
+        ProcessClock::time_point time;
+    };
+
     /**
      * The FIFO queue of commands ready to run
      */
-    std::queue<std::shared_ptr<Task> > runq;
+    std::queue<RunnableTask> runq;
+
+    /**
+     * The stats of the runs, by task type
+     */
+    std::array<Stats, size_t(TaskType::Count)> stats;
 
     /**
      * When a task is being served by a backend thread it is put in
@@ -26,12 +26,33 @@ ExecutorPool::ExecutorPool(size_t sz)
     : ExecutorPool(sz, cb::defaultProcessClockSource()) {
 }
 
-ExecutorPool::ExecutorPool(size_t sz, cb::ProcessClockSource& clock) {
-    roundRobin.store(0);
-    executors.reserve(sz);
+ExecutorPool::ExecutorPool(size_t sz, cb::ProcessClockSource& clock)
+    : ExecutorPool(sz, {}, clock) {
+}
+
+ExecutorPool::ExecutorPool(size_t sz,
+                           const std::map<TaskType, size_t>& dedicated,
+                           cb::ProcessClockSource& clock) {
+    auto& shared = groups[size_t(TaskType::Default)].executors;
     for (size_t ii = 0; ii < sz; ++ii) {
+        shared.push_back(executors.size());
         executors.emplace_back(createWorker(clock));
     }
+
+    for (size_t type = 0; type < groups.size(); ++type) {
+        if (type == size_t(TaskType::Default)) {
+            continue;
+        }
+        auto iter = dedicated.find(TaskType(type));
+        if (iter == dedicated.end() || iter->second == 0) {
+            groups[type].executors = shared;
+            continue;
+        }
+        for (size_t ii = 0; ii < iter->second; ++ii) {
+            groups[type].executors.push_back(executors.size());
+            executors.emplace_back(createWorker(clock));
+        }
+    }
 }
 
 void ExecutorPool::schedule(std::shared_ptr<Task>& task, bool runnable) {
@@ -41,7 +62,10 @@ void ExecutorPool::schedule(std::shared_ptr<Task>& task, bool runnable) {
             "The mutex should be held when trying to schedule a event");
     }
 
-    executors[++roundRobin % executors.size()]->schedule(task, runnable);
+    auto& group = groups[size_t(task->getType())];
+    const auto idx = group.executors[++group.roundRobin %
+                                     group.executors.size()];
+    executors[idx]->schedule(task, runnable);
 }
 
 void ExecutorPool::clockTick() {
@@ -73,3 +97,15 @@ size_t ExecutorPool::futureqSize() const {
     }
     return count;
 }
+
+size_t ExecutorPool::getNumExecutors(TaskType type) const {
+    return groups[size_t(type)].executors.size();
+}
+
+Executor::Stats ExecutorPool::getStats(TaskType type) const {
+    Executor::Stats stats;
+    for (const auto idx : groups[size_t(type)].executors) {
+        stats += executors[idx]->getStats(type);
+    }
+    return stats;
+}
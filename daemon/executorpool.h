@@ -18,6 +18,8 @@
 
 #include "executor.h"
 
+#include <array>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -26,6 +28,12 @@
  * As the name implies the ExecutorPool is pool of executors to execute
  * tasks. A task is pinned to a thread when it is being scheduled
  * (by using round robin) and never switch the thread.
+ *
+ * The task types (see Task::getType()) may be given executors of their
+ * own, so that a burst of one type (e.g. SASL authentications of clients
+ * reconnecting) doesn't queue behind the other (e.g. a bucket deletion
+ * waiting for its connections to go away) or the other way around. The
+ * types without their own executors share the default ones.
  */
 class ExecutorPool {
 public:
@@ -41,6 +49,21 @@ public:
      */
     ExecutorPool(size_t sz, cb::ProcessClockSource& clock);
 
+    /**
+     * Create an executor pool with a given number of shared worker
+     * threads, and for the given task types worker threads of their own
+     *
+     * @param sz the number of executors shared by the task types
+     * @param dedicated the number of executors only running the tasks of a
+     *                  type (the types not listed, or listed with 0, run
+     *                  on the shared ones)
+     * @param clock the clock source of the executors
+     */
+    ExecutorPool(size_t sz,
+                 const std::map<TaskType, size_t>& dedicated,
+                 cb::ProcessClockSource& clock =
+                         cb::defaultProcessClockSource());
+
     ExecutorPool(const ExecutorPool &) = delete;
 
     /**
@@ -59,23 +82,40 @@ public:
      */
     void clockTick();
 
-    // @todo expose these as stats
-
     size_t waitqSize() const;
 
     size_t runqSize() const;
 
     size_t futureqSize() const;
 
+    /// @return the number of executors running the tasks of the type
+    size_t getNumExecutors(TaskType type) const;
+
+    /// @return how the executors ran the tasks of the type
+    Executor::Stats getStats(TaskType type) const;
+
 private:
     /**
      * The actual list of executors
      */
     std::vector< std::unique_ptr<Executor> > executors;
 
+    struct Group {
+        /**
+         * The executors running the tasks of the type (indexes in
+         * executors)
+         */
+        std::vector<size_t> executors;
+
+        /**
+         * We'll be using round robin to distribute the tasks to the
+         * worker threads
+         */
+        std::atomic_int roundRobin{0};
+    };
+
     /**
-     * We'll be using round robin to distribute the tasks to the
-     * worker threads
+     * The executors of each task type
      */
-    std::atomic_int roundRobin;
+    std::array<Group, size_t(TaskType::Count)> groups;
 };
@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/protocol_binary.h>
+#include <cstdint>
+
+/**
+ * The FrameSpec describes the shape of a request frame for the opcodes
+ * which don't need anything but the header to be inspected. Such opcodes
+ * are validated by checking the header against the spec, without calling
+ * through the validator chain (see McbpValidatorChains::invoke).
+ */
+struct FrameSpec {
+    enum class Key : uint8_t {
+        /// The request must not carry a key
+        Forbidden,
+        /// The request must carry a key
+        Required,
+        /// The key is optional
+        Optional
+    };
+
+    enum class Cas : uint8_t {
+        /// Any cas value is accepted
+        Any,
+        /// The cas must be 0
+        Zero,
+        /// The cas must be set
+        Required
+    };
+
+    /// Set if the spec describes the opcode
+    bool defined;
+    /// The size of the extras
+    uint8_t extlen;
+    Key key;
+    /// May the request carry a value
+    bool value;
+    /// The datatype bits accepted (0 means raw bytes only)
+    protocol_binary_datatype_t datatypes;
+    Cas cas;
+
+    /**
+     * Check the (network byte order) request header against the spec
+     */
+    bool validate(const protocol_binary_request_header& header) const {
+        const auto& req = header.request;
+        const uint16_t keylen = ntohs(req.keylen);
+
+        if (req.magic != PROTOCOL_BINARY_REQ || req.extlen != extlen ||
+            (req.datatype & ~datatypes) != 0) {
+            return false;
+        }
+
+        switch (key) {
+        case Key::Forbidden:
+            if (keylen != 0) {
+                return false;
+            }
+            break;
+        case Key::Required:
+            if (keylen == 0) {
+                return false;
+            }
+            break;
+        case Key::Optional:
+            break;
+        }
+
+        if (!value && ntohl(req.bodylen) != uint32_t(extlen) + keylen) {
+            return false;
+        }
+
+        switch (cas) {
+        case Cas::Any:
+            return true;
+        case Cas::Zero:
+            return req.cas == 0;
+        case Cas::Required:
+            return req.cas != 0;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "inflated_value_cache.h"
+
+#include <cstring>
+
+std::string InflatedValueCache::makeKey(int bucket,
+                                        uint16_t vbucket,
+                                        const DocKey& key,
+                                        uint64_t cas) {
+    std::string ret;
+    ret.resize(sizeof(bucket) + sizeof(vbucket) + sizeof(cas) + 1 +
+               key.size());
+    char* ptr = &ret[0];
+    memcpy(ptr, &bucket, sizeof(bucket));
+    ptr += sizeof(bucket);
+    memcpy(ptr, &vbucket, sizeof(vbucket));
+    ptr += sizeof(vbucket);
+    memcpy(ptr, &cas, sizeof(cas));
+    ptr += sizeof(cas);
+    *ptr = char(key.doc_namespace);
+    ++ptr;
+    memcpy(ptr, key.data(), key.size());
+    return ret;
+}
+
+InflatedValueCache::Buffer InflatedValueCache::lookup(int bucket,
+                                                      uint16_t vbucket,
+                                                      const DocKey& key,
+                                                      uint64_t cas) {
+    if (cas == LockedCas) {
+        ++misses;
+        return {};
+    }
+
+    auto iter = index.find(makeKey(bucket, vbucket, key, cas));
+    if (iter == index.end()) {
+        ++misses;
+        return {};
+    }
+
+    // Move the entry to the front of the LRU list
+    entries.splice(entries.begin(), entries, iter->second);
+    ++hits;
+    return iter->second->buffer;
+}
+
+void InflatedValueCache::insert(int bucket,
+                                uint16_t vbucket,
+                                const DocKey& key,
+                                uint64_t cas,
+                                Buffer buffer) {
+    if (!buffer || cas == LockedCas || buffer->len > maxItemSize ||
+        buffer->len > maxSize) {
+        return;
+    }
+
+    auto k = makeKey(bucket, vbucket, key, cas);
+    auto iter = index.find(k);
+    if (iter != index.end()) {
+        size -= iter->second->buffer->len;
+        entries.erase(iter->second);
+        index.erase(iter);
+    }
+
+    size += buffer->len;
+    entries.push_front(Entry{k, std::move(buffer)});
+    index[std::move(k)] = entries.begin();
+    evict();
+}
+
+void InflatedValueCache::clear() {
+    index.clear();
+    entries.clear();
+    size = 0;
+}
+
+void InflatedValueCache::evict() {
+    while (size > maxSize && !entries.empty()) {
+        auto& victim = entries.back();
+        size -= victim.buffer->len;
+        index.erase(victim.key);
+        entries.pop_back();
+    }
+}
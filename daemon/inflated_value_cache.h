@@ -0,0 +1,130 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/dockey.h>
+#include <platform/compress.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/**
+ * The InflatedValueCache is a small LRU cache of inflated (Snappy
+ * decompressed) document values. Clients which don't support Snappy
+ * (and all requests for documents containing xattrs) need the value
+ * to be inflated before we can send it. Without the cache we would
+ * inflate the value into a temporary buffer for every request, which
+ * gets expensive for hot keys.
+ *
+ * An entry is identified by the bucket, vbucket, key and CAS of the
+ * document. The CAS is updated for every modification of the document
+ * so a cached value can't be stale; if the document is modified the
+ * lookup simply misses and the old entry ages out of the cache.
+ *
+ * Documents reported with the "locked" CAS value (-1) are never cached
+ * as the CAS doesn't identify the version of the document.
+ *
+ * The same cache is also used the other way around to hold Snappy
+ * compressed copies of uncompressed values for clients which support
+ * Snappy, so that we don't deflate a hot value for every read.
+ *
+ * The buffers are reference counted, so the caller may keep on using
+ * (and send) the buffer even if the entry gets evicted from the cache.
+ *
+ * There is one instance of the cache per worker thread, and it is only
+ * accessed from the context of that thread so it is not thread safe.
+ */
+class InflatedValueCache {
+public:
+    using Buffer = std::shared_ptr<const cb::compression::Buffer>;
+
+    /**
+     * Create a new cache instance
+     *
+     * @param max_size the maximum number of bytes to keep in the cache
+     * @param max_item_size values bigger than this isn't cached
+     */
+    InflatedValueCache(size_t max_size = DefaultMaxSize,
+                       size_t max_item_size = DefaultMaxItemSize)
+        : maxSize(max_size), maxItemSize(max_item_size) {
+    }
+
+    /**
+     * Look up the inflated value for the given document
+     *
+     * @return the inflated value or an empty pointer if it isn't cached
+     */
+    Buffer lookup(int bucket, uint16_t vbucket, const DocKey& key,
+                  uint64_t cas);
+
+    /**
+     * Insert the inflated value for the given document. The value is
+     * not inserted if it exceeds the maximum item size.
+     */
+    void insert(int bucket, uint16_t vbucket, const DocKey& key,
+                uint64_t cas, Buffer buffer);
+
+    /**
+     * Remove all entries from the cache (used when a bucket is deleted)
+     */
+    void clear();
+
+    /// @return the number of bytes held by the cache
+    size_t getSize() const {
+        return size;
+    }
+
+    uint64_t getHits() const {
+        return hits;
+    }
+
+    uint64_t getMisses() const {
+        return misses;
+    }
+
+    /// The CAS value used by the engines for locked documents
+    static const uint64_t LockedCas = ~uint64_t(0);
+
+    static const size_t DefaultMaxSize = 4 * 1024 * 1024;
+    static const size_t DefaultMaxItemSize = 256 * 1024;
+
+protected:
+    static std::string makeKey(int bucket, uint16_t vbucket,
+                               const DocKey& key, uint64_t cas);
+
+    void evict();
+
+    struct Entry {
+        std::string key;
+        Buffer buffer;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    /// The entries, with the most recently used at the front
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> index;
+
+    const size_t maxSize;
+    const size_t maxItemSize;
+    size_t size = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
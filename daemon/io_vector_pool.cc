@@ -0,0 +1,74 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "io_vector_pool.h"
+#include "memcached.h"
+
+const size_t IoVectorPool::MaxFree;
+
+IoVectorPool::IoVectorPool() {
+    // Reserve the space up front so that release never allocates
+    entries.reserve(MaxFree);
+}
+
+void IoVectorPool::get(std::vector<iovec>& iov,
+                       std::vector<msghdr>& msglist) {
+    if (!iov.empty()) {
+        // The connection kept the ones it had (it is still sending)
+        return;
+    }
+
+    if (entries.empty()) {
+        ++misses;
+        iov.resize(IOV_LIST_INITIAL);
+        msglist.reserve(MSG_LIST_INITIAL);
+        return;
+    }
+
+    ++hits;
+    auto& entry = entries.back();
+    size -= getAllocationSize(entry.iov, entry.msglist);
+    iov.swap(entry.iov);
+    msglist.swap(entry.msglist);
+    entries.pop_back();
+}
+
+void IoVectorPool::release(std::vector<iovec>& iov,
+                           std::vector<msghdr>& msglist) {
+    if (iov.empty()) {
+        return;
+    }
+
+    msglist.clear();
+    Entry entry;
+    entry.iov.swap(iov);
+    entry.msglist.swap(msglist);
+
+    if (entries.size() < MaxFree && entry.iov.size() <= IOV_LIST_HIGHWAT &&
+        entry.msglist.capacity() <= MSG_LIST_HIGHWAT) {
+        size += getAllocationSize(entry.iov, entry.msglist);
+        entries.emplace_back(std::move(entry));
+    }
+}
+
+std::vector<char>& IoVectorPool::getRecordBuffer(size_t nbytes) {
+    if (recordBuffer.capacity() < nbytes) {
+        size -= recordBuffer.capacity();
+        recordBuffer.reserve(nbytes);
+        size += recordBuffer.capacity();
+    }
+    return recordBuffer;
+}
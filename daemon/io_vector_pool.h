@@ -0,0 +1,113 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/platform.h>
+#include <relaxed_atomic.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The IoVectorPool keeps the io vectors (the iovec and msghdr lists used
+ * to send the responses) of the connections served by a worker thread.
+ *
+ * An idle connection doesn't need them, so rather than having every
+ * connection carry its own lists they are handed to the connection when
+ * it starts processing an event (just like the network buffers in the
+ * BufferPool), and taken back when the connection goes back to wait for
+ * the next command. With a large number of mostly idle connections
+ * only the connections actually serving a command hold any.
+ *
+ * The pool also owns the buffer used to coalesce the small io vectors
+ * into full size TLS records, as it is only used while the connection is
+ * sending data.
+ *
+ * There is one instance of the pool per worker thread, and the pool is
+ * only accessed from the context of that thread. The statistics are
+ * relaxed atomics so they may be read by other threads.
+ */
+class IoVectorPool {
+public:
+    /// The maximum number of idle lists kept in the pool
+    static const size_t MaxFree = 64;
+
+    IoVectorPool();
+
+    IoVectorPool(const IoVectorPool&) = delete;
+
+    /**
+     * Give the connection a set of io vectors unless it already has one
+     * (taken from the pool, or allocated if the pool is empty)
+     *
+     * @param iov the iovec list of the connection
+     * @param msglist the msghdr list of the connection
+     * @throws std::bad_alloc if we fail to allocate memory
+     */
+    void get(std::vector<iovec>& iov, std::vector<msghdr>& msglist);
+
+    /**
+     * Take back the io vectors of a connection. The lists are kept in the
+     * pool unless they grew above the high watermarks or the pool is full,
+     * in which case they are released. The connection is left with empty
+     * lists (which don't hold any memory).
+     */
+    void release(std::vector<iovec>& iov, std::vector<msghdr>& msglist);
+
+    /**
+     * Get the buffer used to coalesce small writes into a full TLS record
+     * (see McbpConnection::sslSendmsg()). Its content isn't preserved
+     * between the calls.
+     *
+     * @param nbytes the capacity needed
+     */
+    std::vector<char>& getRecordBuffer(size_t nbytes);
+
+    /// @return the number of bytes held by the pool
+    size_t getSize() const {
+        return size;
+    }
+
+    uint64_t getHits() const {
+        return hits;
+    }
+
+    uint64_t getMisses() const {
+        return misses;
+    }
+
+    /// @return the number of bytes used by the given io vectors
+    static size_t getAllocationSize(const std::vector<iovec>& iov,
+                                    const std::vector<msghdr>& msglist) {
+        return iov.capacity() * sizeof(iovec) +
+               msglist.capacity() * sizeof(msghdr);
+    }
+
+protected:
+    struct Entry {
+        std::vector<iovec> iov;
+        std::vector<msghdr> msglist;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<char> recordBuffer;
+
+    Couchbase::RelaxedAtomic<size_t> size{0};
+    Couchbase::RelaxedAtomic<uint64_t> hits{0};
+    Couchbase::RelaxedAtomic<uint64_t> misses{0};
+};
@@ -21,9 +21,11 @@
 #include "alloc_hooks.h"
 #include "connections.h"
 #include "utilities/string_utilities.h"
+#include "timings_subscription.h"
 #include "tracing.h"
 
 #include <mcbp/mcbp.h>
+#include <memcached/util.h>
 
 /*
  * Implement ioctl-style memcached commands (ioctl_get / ioctl_set).
@@ -106,6 +108,55 @@ static ENGINE_ERROR_CODE setTraceConnection(Connection* c,
     return apply_connection_trace_mask(id->second, value);
 }
 
+/**
+ * Callback for subscribing to the timings of the buckets and opcodes
+ * specified by the arguments, to be pushed to the client every value
+ * seconds (see TimingsSubscription)
+ */
+static ENGINE_ERROR_CODE setTimingsSubscribe(Connection* c,
+                                             const StrToStrMap& arguments,
+                                             const std::string& value) {
+    if (!c->isDuplexSupported()) {
+        return ENGINE_ENOTSUP;
+    }
+
+    auto buckets = arguments.find("buckets");
+    auto opcodes = arguments.find("opcodes");
+    uint32_t interval;
+    if (buckets == arguments.end() || opcodes == arguments.end() ||
+        !safe_strtoul(value.c_str(), &interval)) {
+        return ENGINE_EINVAL;
+    }
+
+    try {
+        std::vector<uint8_t> ops;
+        for (const auto& op : split_string(opcodes->second, ",")) {
+            ops.push_back(uint8_t(cb::mcbp::to_opcode(op)));
+        }
+        c->setTimingsSubscription(std::make_unique<TimingsSubscription>(
+                interval, split_string(buckets->second, ","), std::move(ops)));
+    } catch (const std::invalid_argument&) {
+        return ENGINE_EINVAL;
+    }
+
+    LOG_NOTICE(c,
+               "%u: %s IOCTL_SET: subscribed to the timings of buckets:[%s] "
+               "opcodes:[%s] every %u seconds",
+               c->getId(),
+               c->getDescription().c_str(),
+               buckets->second.c_str(),
+               opcodes->second.c_str(),
+               interval);
+    return ENGINE_SUCCESS;
+}
+
+static ENGINE_ERROR_CODE setTimingsUnsubscribe(Connection* c,
+                                               const StrToStrMap&,
+                                               const std::string&) {
+    c->setTimingsSubscription({});
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE ioctlGetMcbpSla(Connection* c,
                                   const StrToStrMap& arguments,
                                   std::string& value) {
@@ -176,6 +227,8 @@ static const std::unordered_map<std::string, SetCallbackFunc> ioctl_set_map{
         {"trace.start", ioctlSetTracingStart},
         {"trace.stop", ioctlSetTracingStop},
         {"trace.dump.clear", ioctlSetTracingClearDump},
+        {"timings.subscribe", setTimingsSubscribe},
+        {"timings.unsubscribe", setTimingsUnsubscribe},
         {"sla", ioctlSetMcbpSla}};
 
 ENGINE_ERROR_CODE ioctl_set_property(Connection* c,
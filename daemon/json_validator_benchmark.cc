@@ -0,0 +1,120 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmark the JSON detection performed on the mutation path for
+ * documents of 20 and 200 kB. The documents are an array of user
+ * profiles (short strings, numbers, a nested object and a long free
+ * text field), either compact or pretty printed.
+ *
+ * JsonChecker is the validator from JSON_checker we used to use,
+ * Scalar and Vectorized are cb::json::isValidJson with and without the
+ * SIMD string scanner.
+ */
+
+#include <JSON_checker.h>
+#include <memcached/json_validator.h>
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+static std::string makeDocument(size_t size, bool pretty) {
+    const std::string nl = pretty ? "\n" : "";
+    const std::string indent = pretty ? "    " : "";
+    const std::string space = pretty ? " " : "";
+
+    std::string doc = "[" + nl;
+    for (int ii = 0; doc.size() < size; ++ii) {
+        if (ii != 0) {
+            doc += "," + nl;
+        }
+        const auto id = std::to_string(ii);
+        doc += indent + "{" + nl;
+        doc += indent + indent + "\"id\":" + space + id + "," + nl;
+        doc += indent + indent + "\"name\":" + space + "\"user" + id + "\"," +
+               nl;
+        doc += indent + indent + "\"email\":" + space + "\"user" + id +
+               "@example.com\"," + nl;
+        doc += indent + indent + "\"active\":" + space +
+               (ii % 2 ? "true" : "false") + "," + nl;
+        doc += indent + indent + "\"balance\":" + space + id + ".25," + nl;
+        doc += indent + indent + "\"address\":" + space + "{\"street\":" +
+               space + "\"" + id + " Main Street\",\"zip\":" + space +
+               "\"94040\"}," + nl;
+        doc += indent + indent + "\"bio\":" + space +
+               "\"Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+               "sed do eiusmod tempor incididunt ut labore et dolore magna "
+               "aliqua. \\\"Quoted\\\" caf\xc3\xa9.\"" +
+               nl;
+        doc += indent + "}";
+    }
+    doc += nl + "]";
+    return doc;
+}
+
+struct JsonChecker {
+    bool validate(const std::string& doc) {
+        return validator.validate(
+                reinterpret_cast<const uint8_t*>(doc.data()), doc.size());
+    }
+
+    JSON_checker::Validator validator;
+};
+
+struct Scalar {
+    bool validate(const std::string& doc) {
+        return cb::json::isValidJsonScalar(
+                reinterpret_cast<const uint8_t*>(doc.data()), doc.size());
+    }
+};
+
+struct Vectorized {
+    bool validate(const std::string& doc) {
+        return cb::json::isValidJson(
+                reinterpret_cast<const uint8_t*>(doc.data()), doc.size());
+    }
+};
+
+template <typename Validator>
+void JsonValidatorBenchmark(benchmark::State& state) {
+    const auto doc = makeDocument(size_t(state.range(0)) * 1024,
+                                  state.range(1) != 0);
+    Validator validator;
+    if (!validator.validate(doc)) {
+        state.SkipWithError("The document isn't valid JSON");
+    }
+
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(validator.validate(doc));
+    }
+    state.SetBytesProcessed(state.iterations() * doc.size());
+}
+
+// Args: the document size in kB and if it is pretty printed
+#define JSON_VALIDATOR_BENCHMARK(validator)                  \
+    BENCHMARK_TEMPLATE(JsonValidatorBenchmark, validator)    \
+            ->Args({20, 0})                                  \
+            ->Args({20, 1})                                  \
+            ->Args({200, 0})                                 \
+            ->Args({200, 1})
+
+JSON_VALIDATOR_BENCHMARK(JsonChecker);
+JSON_VALIDATOR_BENCHMARK(Scalar);
+JSON_VALIDATOR_BENCHMARK(Vectorized);
+
+BENCHMARK_MAIN()
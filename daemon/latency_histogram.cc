@@ -0,0 +1,169 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "latency_histogram.h"
+#include "timing_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <utility>
+
+const int LatencyHistogram::SubBucketBits;
+const size_t LatencyHistogram::SubBuckets;
+const int LatencyHistogram::MaxValueBits;
+const size_t LatencyHistogram::NumBuckets;
+
+/// Get the position of the most significant bit set in a non-zero value
+static int msb(uint64_t value) {
+    int ret = 0;
+    for (int shift = 32; shift > 0; shift /= 2) {
+        if (value >> shift) {
+            value >>= shift;
+            ret += shift;
+        }
+    }
+    return ret;
+}
+
+size_t LatencyHistogram::getIndex(hrtime_t nsec) {
+    if (nsec < SubBuckets) {
+        return size_t(nsec);
+    }
+
+    if (nsec >> MaxValueBits) {
+        return NumBuckets - 1;
+    }
+
+    // The value is in [2^msb, 2^(msb + 1)), which is split into
+    // SubBuckets buckets of 2^shift each
+    const int shift = msb(nsec) - SubBucketBits;
+    return (shift + 1) * SubBuckets + size_t(nsec >> shift) - SubBuckets;
+}
+
+hrtime_t LatencyHistogram::getLowerBound(size_t index) {
+    if (index < SubBuckets) {
+        return hrtime_t(index);
+    }
+
+    const int shift = int(index / SubBuckets) - 1;
+    return hrtime_t(SubBuckets + index % SubBuckets) << shift;
+}
+
+hrtime_t LatencyHistogram::getUpperBound(size_t index) {
+    if (index < SubBuckets) {
+        return hrtime_t(index);
+    }
+
+    const int shift = int(index / SubBuckets) - 1;
+    return getLowerBound(index) + (hrtime_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * As with the TimingHistogram this isn't an atomic snapshot of the
+ * other histogram, but it's only used when we're grabbing the stats.
+ */
+LatencyHistogram& LatencyHistogram::operator+=(const LatencyHistogram& other) {
+    uint64_t total = 0;
+    for (size_t ii = 0; ii < NumBuckets; ++ii) {
+        const auto value = other.getBucket(ii);
+        if (value != 0) {
+            buckets[ii].fetch_add(value, std::memory_order_relaxed);
+            total += value;
+        }
+    }
+    // Use the sum of the buckets so that the count is consistent with
+    // the buckets we copied
+    count.fetch_add(total, std::memory_order_relaxed);
+    return *this;
+}
+
+LatencyHistogram& LatencyHistogram::operator-=(const LatencyHistogram& other) {
+    uint64_t total = 0;
+    for (size_t ii = 0; ii < NumBuckets; ++ii) {
+        const auto value = other.getBucket(ii);
+        if (value != 0 && value <= getBucket(ii)) {
+            buckets[ii].fetch_sub(value, std::memory_order_relaxed);
+            total += value;
+        }
+    }
+    count.fetch_sub(std::min(total, getCount()), std::memory_order_relaxed);
+    return *this;
+}
+
+hrtime_t LatencyHistogram::getPercentile(double percentile) const {
+    const auto total = getCount();
+    if (total == 0) {
+        return 0;
+    }
+
+    auto wanted = uint64_t(std::ceil(total * percentile / 100.0));
+    if (wanted == 0) {
+        wanted = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t ii = 0; ii < NumBuckets; ++ii) {
+        seen += getBucket(ii);
+        if (seen >= wanted) {
+            return getUpperBound(ii);
+        }
+    }
+
+    // The count may be ahead of the buckets if someone is updating
+    // the histogram
+    return getUpperBound(NumBuckets - 1);
+}
+
+void LatencyHistogram::addTo(TimingHistogram& histogram) const {
+    for (size_t ii = 0; ii < NumBuckets; ++ii) {
+        const auto value = getBucket(ii);
+        if (value != 0) {
+            histogram.add(getLowerBound(ii), value);
+        }
+    }
+}
+
+unique_cJSON_ptr LatencyHistogram::to_json() const {
+    // Keep the old layout for backwards compatibility, and add the
+    // percentiles we're able to provide with the finer resolution
+    TimingHistogram legacy;
+    addTo(legacy);
+    auto json = legacy.to_json();
+
+    cJSON* percentiles = cJSON_CreateObject();
+    if (percentiles == nullptr) {
+        throw std::bad_alloc();
+    }
+    const std::pair<const char*, double> wanted[] = {{"50", 50.0},
+                                                     {"90", 90.0},
+                                                     {"99", 99.0},
+                                                     {"99.9", 99.9},
+                                                     {"99.99", 99.99}};
+    for (const auto& p : wanted) {
+        cJSON_AddNumberToObject(percentiles, p.first,
+                                double(getPercentile(p.second)));
+    }
+    cJSON_AddItemToObject(json.get(), "percentiles", percentiles);
+    return json;
+}
@@ -0,0 +1,121 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <cJSON_utils.h>
+#include <platform/platform.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class TimingHistogram;
+
+/**
+ * The LatencyHistogram records durations (in nanoseconds) in a log-linear
+ * (HDR style) bucket layout: every power of two is split into SubBuckets
+ * linear buckets, so the value of a bucket is within ~3% of the samples
+ * recorded in it no matter how big the value is. This gives us enough
+ * resolution to report the tail latency (p99.9, p99.99) of fast
+ * operations while still covering slow ones.
+ *
+ * Values below SubBuckets ns are recorded exactly, and values of
+ * 2^MaxValueBits ns (~18 minutes) and above are recorded in the last
+ * bucket.
+ *
+ * The counters are relaxed atomics so that the histogram may be read
+ * (and merged) by other threads while it is being updated. It is
+ * intended to be updated by a single thread (see Timings), so the
+ * counters don't suffer from cache line contention.
+ */
+class LatencyHistogram {
+public:
+    static const int SubBucketBits = 5;
+    static const size_t SubBuckets = size_t(1) << SubBucketBits;
+    static const int MaxValueBits = 40;
+    static const size_t NumBuckets =
+            (MaxValueBits - SubBucketBits + 1) * SubBuckets;
+
+    LatencyHistogram() {
+        reset();
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+
+    void add(hrtime_t nsec) {
+        buckets[getIndex(nsec)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void reset();
+
+    /// Add the samples of the other histogram to this histogram
+    LatencyHistogram& operator+=(const LatencyHistogram& other);
+
+    /**
+     * Remove the samples of the other (earlier) histogram from this
+     * histogram, leaving the samples recorded since. A bucket with fewer
+     * samples than in the other histogram (it was reset in between) is
+     * left as it is.
+     */
+    LatencyHistogram& operator-=(const LatencyHistogram& other);
+
+    uint64_t getCount() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getBucket(size_t index) const {
+        return buckets[index].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the value (in ns) for the given percentile; no more than
+     * the given percentage of the samples are bigger than the value.
+     *
+     * @param percentile the percentile (0-100)
+     * @return the upper bound of the bucket containing the percentile
+     *         (or 0 if there are no samples)
+     */
+    hrtime_t getPercentile(double percentile) const;
+
+    /**
+     * Add the samples to a TimingHistogram (which is used by the
+     * JSON representation of the timings). The samples in a bucket are
+     * added as the lower bound of the bucket.
+     */
+    void addTo(TimingHistogram& histogram) const;
+
+    /**
+     * Get the JSON representation of the histogram: the layout of the
+     * TimingHistogram (understood by mctimings) with a "percentiles"
+     * object of p50 to p99.99 (in ns) added.
+     */
+    unique_cJSON_ptr to_json() const;
+
+    /// Get the index of the bucket used for the given value
+    static size_t getIndex(hrtime_t nsec);
+
+    /// Get the smallest value recorded in the given bucket
+    static hrtime_t getLowerBound(size_t index);
+
+    /// Get the biggest value recorded in the given bucket
+    static hrtime_t getUpperBound(size_t index);
+
+private:
+    std::array<std::atomic<uint32_t>, NumBuckets> buckets;
+    std::atomic<uint64_t> count;
+};
@@ -27,6 +27,7 @@
 #include "config.h"
 #include "memcached.h"
 #include "mc_time.h"
+#include "timings_subscription.h"
 
 #include <atomic>
 
@@ -219,4 +220,6 @@ static void mc_gather_timing_samples(void) {
         bucket.timings.sample(std::chrono::seconds(1));
         return true;
     }, nullptr);
+
+    TimingsSubscription::notifySubscribers();
 }
@@ -23,8 +23,44 @@
 #include "xattr/utils.h"
 
 #include <include/memcached/protocol_binary.h>
+#include <mcbp/protocol/server_duration.h>
 #include <platform/compress.h>
 
+/**
+ * Should the response carry the time the server spent on the request.
+ * The client asks for it with Feature::Tracing, and the alternative
+ * response magic only got room for an 8 bit key length so responses with
+ * longer keys are sent without it.
+ */
+static bool send_server_duration(const McbpConnection& c, uint16_t keylen) {
+    return c.isTracingEnabled() && keylen <= 0xff;
+}
+
+/**
+ * Turn a response header into an alternative response header carrying
+ * the time spent on the request in the framing extras. The bodylen in the
+ * header must already include the framing extras.
+ *
+ * @param c the connection sending the response
+ * @param header the response header (in network byte order)
+ * @param framing where to write the framing extras (right after the header)
+ */
+static void add_server_duration(McbpConnection& c,
+                                uint8_t* header,
+                                uint8_t* framing) {
+    auto* res = reinterpret_cast<protocol_binary_response_header*>(header);
+    const auto keylen = uint8_t(ntohs(res->response.keylen));
+    res->response.magic = uint8_t(cb::mcbp::Magic::AltClientResponse);
+    header[2] = uint8_t(cb::mcbp::ServerDurationFrameSize);
+    header[3] = keylen;
+
+    const auto duration = c.getCookieObject().getTracer().getDuration(
+            cb::tracing::TraceCode::Request);
+    cb::mcbp::writeServerDurationFrame(
+            framing,
+            std::chrono::duration_cast<std::chrono::microseconds>(duration));
+}
+
 /**
  * Send a not my vbucket response to the client. It should piggyback the
  * current vbucket map unless the client knows it already (and is configured
@@ -34,11 +70,12 @@
  * @return true if success, false if memory allocation fails.
  */
 static bool send_not_my_vbucket(McbpConnection& c) {
-    auto pair = c.getBucket().clusterConfiguration.getConfiguration();
-    if (pair.first == -1 ||
-        (pair.first == c.getClustermapRevno() && settings.isDedupeNmvbMaps())) {
-        // We don't have a vbucket map, or we've already sent it to the
-        // client
+    auto config = c.getBucket().clusterConfiguration.getConfiguration();
+    if (config->revision == -1 ||
+        (config->revision <= c.getClustermapRevno() &&
+         settings.isDedupeNmvbMaps())) {
+        // We don't have a vbucket map, or we've already sent it (or a
+        // newer one) to the client
         mcbp_add_header(&c,
                         PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET,
                         0,
@@ -50,33 +87,25 @@ static bool send_not_my_vbucket(McbpConnection& c) {
         return true;
     }
 
-    protocol_binary_response_header* header;
-    const size_t needed = sizeof(*header) + pair.second->size();
-
-    if (!c.growDynamicBuffer(needed)) {
+    // Send the map straight from the (shared) configuration rather than
+    // copying it into the send buffer
+    if (!c.reserveClusterConfiguration(config)) {
         LOG_WARNING(&c,
                     "<%d ERROR: Failed to allocate memory for response",
                     c.getId());
         return false;
     }
 
-    auto& buffer = c.getDynamicBuffer();
-    auto* buf = buffer.getCurrent();
-    header = reinterpret_cast<protocol_binary_response_header*>(buf);
-    memset(header, 0, sizeof(*header));
-
-    header->response.magic = (uint8_t)PROTOCOL_BINARY_RES;
-    header->response.opcode = c.binary_header.request.opcode;
-    header->response.status =
-            (uint16_t)htons(PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET);
-    header->response.bodylen = htonl((uint32_t)pair.second->size());
-    header->response.opaque = c.getOpaque();
-    buf += sizeof(*header);
-    std::copy(pair.second->begin(), pair.second->end(), buf);
-    buffer.moveOffset(needed);
-
-    mcbp_write_and_free(&c, &c.getDynamicBuffer());
-    c.setClustermapRevno(pair.first);
+    mcbp_add_header(&c,
+                    PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET,
+                    0,
+                    0,
+                    uint32_t(config->config.size()),
+                    PROTOCOL_BINARY_RAW_BYTES);
+    c.addIov(config->config.data(), config->config.size());
+    c.setState(conn_send_data);
+    c.setWriteAndGo(conn_new_cmd);
+    c.setClustermapRevno(config->revision);
     return true;
 }
 
@@ -98,9 +127,10 @@ void mcbp_write_response(McbpConnection* c,
         c->setWriteAndGo(conn_new_cmd);
     } else {
         if (c->getStart() != 0) {
-            mcbp_collect_timings(reinterpret_cast<McbpConnection*>(c));
+            mcbp_collect_timings(c);
             c->setStart(0);
         }
+        c->traceResponseSent();
         // The responseCounter is updated here as this is non-responding code
         // hence mcbp_add_header will not be called (which is what normally
         // updates the responseCounters).
@@ -195,15 +225,25 @@ void mcbp_add_header(McbpConnection* c,
     }
 
     c->addMsgHdr(true);
-    const auto wbuf = mcbp_add_header(*c->write,
-                                      c->binary_header.request.opcode,
-                                      err,
-                                      ext_len,
-                                      key_len,
-                                      body_len,
-                                      datatype,
-                                      c->getOpaque(),
-                                      c->getCAS());
+    const bool duration = send_server_duration(*c, key_len);
+    auto* header = c->write->wdata().data();
+    auto wbuf = mcbp_add_header(
+            *c->write,
+            c->binary_header.request.opcode,
+            err,
+            ext_len,
+            key_len,
+            duration ? body_len + cb::mcbp::ServerDurationFrameSize
+                     : body_len,
+            datatype,
+            c->getOpaque(),
+            c->getCAS());
+
+    if (duration) {
+        add_server_duration(*c, header, c->write->wdata().data());
+        c->write->produced(cb::mcbp::ServerDurationFrameSize);
+        wbuf = {header, wbuf.size() + cb::mcbp::ServerDurationFrameSize};
+    }
 
     if (settings.getVerbose() > 1) {
         char buffer[1024];
@@ -281,7 +321,9 @@ bool mcbp_response_handler(const void* key, uint16_t keylen,
                                    : PROTOCOL_BINARY_DATATYPE_JSON;
     }
 
-    const size_t needed = payload.len + keylen + extlen +
+    const bool duration = send_server_duration(*c, keylen);
+    const size_t framing = duration ? cb::mcbp::ServerDurationFrameSize : 0;
+    const size_t needed = framing + payload.len + keylen + extlen +
                           sizeof(protocol_binary_response_header);
 
     auto &dbuf = c->getDynamicBuffer();
@@ -308,6 +350,13 @@ bool mcbp_response_handler(const void* key, uint16_t keylen,
     memcpy(buf, header.bytes, sizeof(header.response));
     buf += sizeof(header.response);
 
+    if (duration) {
+        add_server_duration(*c,
+                            reinterpret_cast<uint8_t*>(dbuf.getCurrent()),
+                            reinterpret_cast<uint8_t*>(buf));
+        buf += framing;
+    }
+
     if (extlen > 0) {
         memcpy(buf, ext, extlen);
         buf += extlen;
@@ -326,11 +375,12 @@ bool mcbp_response_handler(const void* key, uint16_t keylen,
     return true;
 }
 
-void mcbp_collect_timings(const McbpConnection* c) {
+void mcbp_collect_timings(McbpConnection* c) {
     hrtime_t now = gethrtime();
     const hrtime_t elapsed_ns = now - c->getStart();
+    const size_t thread = size_t(c->getThread()->index);
     // aggregated timing for all buckets
-    all_buckets[0].timings.collect(c->getCmd(), elapsed_ns);
+    all_buckets[0].timings.collect(thread, c->getCmd(), elapsed_ns);
 
     // timing for current bucket
     bucket_id_t bucketid = get_bucket_id(c->getCookie());
@@ -339,7 +389,16 @@ void mcbp_collect_timings(const McbpConnection* c) {
      * to delete the bucket you're associated with and your're idle.
      */
     if (bucketid != 0) {
-        all_buckets[bucketid].timings.collect(c->getCmd(), elapsed_ns);
+        all_buckets[bucketid].timings.collect(thread, c->getCmd(), elapsed_ns);
+    }
+
+    auto& tracer = c->getCookieObject().getTracer();
+    if (tracer.isActive(cb::tracing::TraceCode::Request)) {
+        // The command is checked for being slow once the response is
+        // sent (see McbpConnection::traceResponseSent)
+        tracer.end(cb::tracing::TraceCode::Request);
+        tracer.begin(cb::tracing::TraceCode::SendQueue);
+        return;
     }
 
     // Log operations taking longer than 0.5s
@@ -45,6 +45,7 @@
 #include "protocol/mcbp/gat_context.h"
 #include "protocol/mcbp/get_context.h"
 #include "protocol/mcbp/get_locked_context.h"
+#include "protocol/mcbp/get_multi_context.h"
 #include "protocol/mcbp/get_meta_context.h"
 #include "protocol/mcbp/mutation_context.h"
 #include "protocol/mcbp/rbac_reload_command_context.h"
@@ -80,9 +81,11 @@ void update_topkeys(const DocKey& key, McbpConnection* c) {
 
     if (topkey_commands[c->binary_header.request.opcode]) {
         if (all_buckets[c->getBucketIndex()].topkeys != nullptr) {
-            all_buckets[c->getBucketIndex()].topkeys->updateKey(key.data(),
-                                                                key.size(),
-                                                                mc_time_get_current_time());
+            all_buckets[c->getBucketIndex()].topkeys->updateKey(
+                    key.data(),
+                    key.size(),
+                    mc_time_get_current_time(),
+                    size_t(c->getThread()->index));
         }
     }
 }
@@ -613,6 +616,11 @@ static void get_executor(McbpConnection* c, void* packet) {
     process_bin_get(c, packet);
 }
 
+static void get_multi_executor(McbpConnection* c, void* packet) {
+    auto* req = reinterpret_cast<protocol_binary_request_get_multi*>(packet);
+    c->obtainContext<GetMultiCommandContext>(*c, req).drive();
+}
+
 static void get_meta_executor(McbpConnection* c, void* packet) {
     switch (c->getCmd()) {
     case PROTOCOL_BINARY_CMD_GET_META:
@@ -635,6 +643,12 @@ static void get_meta_executor(McbpConnection* c, void* packet) {
     process_bin_get_meta(c, packet);
 }
 
+static void get_meta_multi_executor(McbpConnection* c, void* packet) {
+    auto* req =
+            reinterpret_cast<protocol_binary_request_get_meta_multi*>(packet);
+    c->obtainContext<GetMetaMultiCommandContext>(*c, req).drive();
+}
+
 static void stat_executor(McbpConnection* c, void* packet) {
     auto* req = reinterpret_cast<protocol_binary_request_stats*>(packet);
     c->obtainContext<StatsCommandContext>(*c, *req).drive();
@@ -1031,8 +1045,10 @@ std::array<mcbp_package_execute, 0x100>& get_mcbp_executors(void) {
     executors[PROTOCOL_BINARY_CMD_GETQ] = get_executor;
     executors[PROTOCOL_BINARY_CMD_GETK] = get_executor;
     executors[PROTOCOL_BINARY_CMD_GETKQ] = get_executor;
+    executors[PROTOCOL_BINARY_CMD_GET_MULTI] = get_multi_executor;
     executors[PROTOCOL_BINARY_CMD_GET_META] = get_meta_executor;
     executors[PROTOCOL_BINARY_CMD_GETQ_META] = get_meta_executor;
+    executors[PROTOCOL_BINARY_CMD_GET_META_MULTI] = get_meta_multi_executor;
     executors[PROTOCOL_BINARY_CMD_GAT] = gat_executor;
     executors[PROTOCOL_BINARY_CMD_GATQ] = gat_executor;
     executors[PROTOCOL_BINARY_CMD_TOUCH] = gat_executor;
@@ -1182,7 +1198,10 @@ static void execute_request_packet(McbpConnection* c) {
     auto opcode = static_cast<protocol_binary_command>(c->binary_header.request.opcode);
     auto executor = executors[opcode];
 
+    auto& tracer = c->getCookieObject().getTracer();
+    tracer.begin(cb::tracing::TraceCode::Rbac);
     const auto res = privilegeChains.invoke(opcode, c->getCookieObject());
+    tracer.end(cb::tracing::TraceCode::Rbac);
     switch (res) {
     case cb::rbac::PrivilegeAccess::Fail:
         LOG_WARNING(c,
@@ -1200,10 +1219,12 @@ static void execute_request_packet(McbpConnection* c) {
 
         return;
     case cb::rbac::PrivilegeAccess::Ok:
+        tracer.begin(cb::tracing::TraceCode::Validate);
         result = validate_bin_header(c);
         if (result == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
             result = c->validateCommand(opcode);
         }
+        tracer.end(cb::tracing::TraceCode::Validate);
 
         if (result != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
             LOG_NOTICE(c,
@@ -1414,12 +1435,16 @@ void try_read_mcbp_command(McbpConnection* c) {
     if (c->isPacketAvailable()) {
         // we've got the entire packet spooled up, just go execute
         c->setState(conn_execute);
+    } else if (c->startStreamingValue()) {
+        // read the (large) value straight into the item rather than
+        // growing the input buffer to hold the entire packet
+        c->setState(conn_read_value);
     } else {
         // we need to allocate more memory!!
         try {
             size_t needed = sizeof(cb::mcbp::Request) +
                             c->binary_header.request.bodylen;
-            c->read->ensureCapacity(needed - c->read->rsize());
+            conn_ensure_read_capacity(*c, needed - c->read->rsize());
         } catch (const std::bad_alloc&) {
             LOG_WARNING(c,
                         "%u: Failed to grow buffer.. closing connection",
@@ -39,12 +39,38 @@ static PrivilegeAccess empty(Cookie& cookie) {
     return PrivilegeAccess::Ok;
 }
 
+PrivilegeAccess McbpPrivilegeChains::invoke(protocol_binary_command command,
+                                            Cookie& cookie) {
+    auto& connection = cookie.connection;
+    const auto& context = connection.getPrivilegeContext();
+    auto ret = context.getCachedAccess(uint8_t(command));
+    if (ret != PrivilegeAccess::Stale) {
+        return ret;
+    }
+
+    auto& chain = commandChains[command];
+    if (chain.empty()) {
+        return PrivilegeAccess::Fail;
+    }
+
+    // The chain refreshes the context if it is stale, so only cache the
+    // outcome if all of the chain used the one context
+    const bool stale = context.isStale();
+    const auto generation = context.getGeneration();
+    ret = chain.invoke(cookie);
+    if (!stale && !context.isStale() && context.getGeneration() == generation) {
+        connection.setCachedCommandAccess(uint8_t(command), ret);
+    }
+    return ret;
+}
+
 McbpPrivilegeChains::McbpPrivilegeChains() {
 
     setup(PROTOCOL_BINARY_CMD_GET, require<Privilege::Read>);
     setup(PROTOCOL_BINARY_CMD_GETQ, require<Privilege::Read>);
     setup(PROTOCOL_BINARY_CMD_GETK, require<Privilege::Read>);
     setup(PROTOCOL_BINARY_CMD_GETKQ, require<Privilege::Read>);
+    setup(PROTOCOL_BINARY_CMD_GET_MULTI, require<Privilege::Read>);
     setup(PROTOCOL_BINARY_CMD_SET, require<Privilege::Upsert>);
     setup(PROTOCOL_BINARY_CMD_SETQ, require<Privilege::Upsert>);
     setup(PROTOCOL_BINARY_CMD_ADD, requireInsertOrUpsert);
@@ -174,6 +200,7 @@ McbpPrivilegeChains::McbpPrivilegeChains() {
      */
     setup(PROTOCOL_BINARY_CMD_GET_META, require<Privilege::MetaRead>);
     setup(PROTOCOL_BINARY_CMD_GETQ_META, require<Privilege::MetaRead>);
+    setup(PROTOCOL_BINARY_CMD_GET_META_MULTI, require<Privilege::MetaRead>);
     setup(PROTOCOL_BINARY_CMD_SET_WITH_META, require<Privilege::MetaWrite>);
     setup(PROTOCOL_BINARY_CMD_SETQ_WITH_META, require<Privilege::MetaWrite>);
     setup(PROTOCOL_BINARY_CMD_ADD_WITH_META, require<Privilege::MetaWrite>);
@@ -229,6 +256,14 @@ McbpPrivilegeChains::McbpPrivilegeChains() {
      * Command to get all keys
      */
     setup(PROTOCOL_BINARY_CMD_GET_KEYS, require<Privilege::Read>);
+    /**
+     * Command to get the documents of a range of keys
+     */
+    setup(PROTOCOL_BINARY_CMD_RANGE_SCAN, require<Privilege::Read>);
+    /**
+     * Command to apply a batch of documents with their metadata
+     */
+    setup(PROTOCOL_BINARY_CMD_WITH_META_BATCH, require<Privilege::MetaWrite>);
     /**
      * Commands for GO-XDCR
      */
@@ -41,6 +41,12 @@ public:
      * we should fail the request (That would most likely help us not forget
      * to add new rules when people add new commands ;-))
      *
+     * The outcome of the chain is cached in the privilege context of the
+     * connection, so that the chain is only run the first time the
+     * connection uses the command in a given privilege context (a new
+     * context is created when the connection selects a bucket or the
+     * RBAC database is reloaded).
+     *
      * @param command the opcode of the command to check access for
      * @param cookie the cookie representing the connection / command
      * @return Ok - the connection holds the appropriate privilege
@@ -48,14 +54,7 @@ public:
      *         Stale - the authentication context is out of date
      */
     cb::rbac::PrivilegeAccess invoke(protocol_binary_command command,
-                                     Cookie& cookie) {
-        auto& chain = commandChains[command];
-        if (chain.empty()) {
-            return cb::rbac::PrivilegeAccess::Fail;
-        } else {
-            return chain.invoke(cookie);
-        }
-    }
+                                     Cookie& cookie);
 
 protected:
     /*
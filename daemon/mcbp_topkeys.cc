@@ -41,6 +41,7 @@ std::array<bool, 0x100>& get_mcbp_topkeys() {
     commands[PROTOCOL_BINARY_CMD_GETQ] = true;
     commands[PROTOCOL_BINARY_CMD_GETK] = true;
     commands[PROTOCOL_BINARY_CMD_GETKQ] = true;
+    commands[PROTOCOL_BINARY_CMD_GET_MULTI] = true;
     commands[PROTOCOL_BINARY_CMD_DELETE] = true;
     commands[PROTOCOL_BINARY_CMD_DELETEQ] = true;
     commands[PROTOCOL_BINARY_CMD_INCREMENT] = true;
@@ -63,6 +64,7 @@ std::array<bool, 0x100>& get_mcbp_topkeys() {
     commands[PROTOCOL_BINARY_CMD_UNLOCK_KEY] = true;
     commands[PROTOCOL_BINARY_CMD_GET_META] = true;
     commands[PROTOCOL_BINARY_CMD_GETQ_META] = true;
+    commands[PROTOCOL_BINARY_CMD_GET_META_MULTI] = true;
     commands[PROTOCOL_BINARY_CMD_SET_WITH_META] = true;
     commands[PROTOCOL_BINARY_CMD_SETQ_WITH_META] = true;
     commands[PROTOCOL_BINARY_CMD_DEL_WITH_META] = true;
@@ -447,28 +447,6 @@ static protocol_binary_response_status dcp_set_vbucket_state_validator(const Coo
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status dcp_noop_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_dcp_noop*>(McbpConnection::getPacket(cookie));
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    // We could do these tests before checking the packet, but
-    // it feels cleaner to validate the packet first.
-    if (cookie.connection.getBucketEngine() == nullptr ||
-        cookie.connection.getBucketEngine()->dcp.noop == nullptr) {
-        // The attached bucket does not support DCP
-        return PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
 static protocol_binary_response_status dcp_buffer_acknowledgement_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_dcp_buffer_acknowledgement*>(McbpConnection::getPacket(cookie));
@@ -515,36 +493,6 @@ static protocol_binary_response_status dcp_control_validator(const Cookie& cooki
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status configuration_refresh_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status verbosity_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 4 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.cas != 0 ||
-        ntohl(req->message.header.request.bodylen) != 4 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
 static protocol_binary_response_status hello_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
@@ -561,85 +509,6 @@ static protocol_binary_response_status hello_validator(const Cookie& cookie)
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status version_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status quit_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES ||
-        req->message.header.request.cas != 0) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status sasl_list_mech_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status sasl_auth_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen == 0 ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status noop_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES ||
-        req->message.header.request.cas != 0) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
 static protocol_binary_response_status flush_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
@@ -672,150 +541,38 @@ static protocol_binary_response_status flush_validator(const Cookie& cookie)
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status add_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    /* Must have extras and key, may have value */
-    auto datatype = req->message.header.request.datatype;
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 8 ||
-        req->message.header.request.keylen == 0 ||
-        req->message.header.request.cas != 0 ||
-        mcbp::datatype::is_xattr(datatype) ||
-        !mcbp::datatype::is_valid(datatype)) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status set_replace_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    /* Must have extras and key, may have value */
-    auto datatype = req->message.header.request.datatype;
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 8 ||
-        req->message.header.request.keylen == 0 ||
-        mcbp::datatype::is_xattr(datatype) ||
-        !mcbp::datatype::is_valid(datatype)) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status append_prepend_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    /* Must not have extras, must have key, may have value */
-    auto datatype = req->message.header.request.datatype;
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen == 0 ||
-        mcbp::datatype::is_xattr(datatype) ||
-        !mcbp::datatype::is_valid(datatype)) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status get_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    uint16_t klen = ntohs(req->message.header.request.keylen);
-    uint32_t blen = ntohl(req->message.header.request.bodylen);
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        klen == 0 || klen != blen ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES ||
-        req->message.header.request.cas != 0) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status gat_validator(const Cookie& cookie) {
-    auto req = static_cast<protocol_binary_request_no_extras*>(
+static protocol_binary_response_status get_multi_validator(
+        const Cookie& cookie) {
+    auto req = static_cast<protocol_binary_request_get_multi*>(
             McbpConnection::getPacket(cookie));
-    uint32_t klen = ntohs(req->message.header.request.keylen);
     uint32_t blen = ntohl(req->message.header.request.bodylen);
 
     if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 4 || klen == 0 ||
-        (klen + 4) != blen ||
+        req->message.header.request.extlen != 0 ||
+        req->message.header.request.keylen != 0 || blen == 0 ||
         req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES ||
         req->message.header.request.cas != 0) {
         return PROTOCOL_BINARY_RESPONSE_EINVAL;
     }
 
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status delete_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    uint16_t klen = ntohs(req->message.header.request.keylen);
-    uint32_t blen = ntohl(req->message.header.request.bodylen);
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        klen == 0 || klen != blen ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status stat_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    uint16_t klen = ntohs(req->message.header.request.keylen);
-    uint32_t blen = ntohl(req->message.header.request.bodylen);
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 || klen != blen ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status arithmetic_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    uint16_t klen = ntohs(req->message.header.request.keylen);
-    uint32_t blen = ntohl(req->message.header.request.bodylen);
-    uint8_t extlen = req->message.header.request.extlen;
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        extlen != 20 || klen == 0 || (klen + extlen) != blen ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status get_cmd_timer_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    uint16_t klen = ntohs(req->message.header.request.keylen);
-    uint32_t blen = ntohl(req->message.header.request.bodylen);
-    uint8_t extlen = req->message.header.request.extlen;
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        extlen != 1 || (klen + extlen) != blen ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    // The body must consist of complete (non-empty) keys
+    using mcbp::getmulti::KeyHeader;
+    const uint8_t* ptr = req->bytes + sizeof(req->bytes);
+    const uint8_t* end = ptr + blen;
+    size_t nkeys = 0;
+    while (ptr < end) {
+        if (size_t(end - ptr) < sizeof(KeyHeader) ||
+            ++nkeys > mcbp::getmulti::MaxKeys) {
+            return PROTOCOL_BINARY_RESPONSE_EINVAL;
+        }
+        KeyHeader kh;
+        memcpy(&kh, ptr, sizeof(kh));
+        const size_t klen = ntohs(kh.keylen);
+        ptr += sizeof(kh);
+        if (klen == 0 || size_t(end - ptr) < klen) {
+            return PROTOCOL_BINARY_RESPONSE_EINVAL;
+        }
+        ptr += klen;
     }
 
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
@@ -837,35 +594,6 @@ static protocol_binary_response_status set_ctrl_token_validator(const Cookie& co
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status get_ctrl_token_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
-static protocol_binary_response_status init_complete_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
 static protocol_binary_response_status ioctl_get_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_ioctl_get*>(McbpConnection::getPacket(cookie));
@@ -946,21 +674,6 @@ static protocol_binary_response_status observe_seqno_validator(const Cookie& coo
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status get_adjusted_time_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_get_adjusted_time*>(McbpConnection::getPacket(cookie));
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.cas != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
 static protocol_binary_response_status set_drift_counter_state_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_set_drift_counter_state*>(McbpConnection::getPacket(cookie));
@@ -1001,21 +714,6 @@ static protocol_binary_response_status create_bucket_validator(const Cookie& coo
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status list_bucket_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.keylen != 0 ||
-        req->message.header.request.extlen != 0 ||
-        req->message.header.request.bodylen != 0 ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
 static protocol_binary_response_status delete_bucket_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
@@ -1094,8 +792,6 @@ static protocol_binary_response_status shutdown_validator(const Cookie& cookie)
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-
-
 static protocol_binary_response_status get_meta_validator(const Cookie& cookie)
 {
     auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
@@ -1194,24 +890,6 @@ static protocol_binary_response_status get_locked_validator(const Cookie& cookie
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
-static protocol_binary_response_status unlock_validator(const Cookie& cookie)
-{
-    auto req = static_cast<protocol_binary_request_no_extras*>(McbpConnection::getPacket(cookie));
-    uint32_t extlen = req->message.header.request.extlen;
-    uint32_t klen = ntohs(req->message.header.request.keylen);
-    uint32_t blen = ntohl(req->message.header.request.bodylen);
-
-    if (req->message.header.request.magic != PROTOCOL_BINARY_REQ ||
-        req->message.header.request.extlen != 0 ||
-        klen == 0 || extlen != 0 || klen != blen ||
-        req->message.header.request.datatype != PROTOCOL_BINARY_RAW_BYTES ||
-        req->message.header.request.cas == 0) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
-}
-
 static protocol_binary_response_status collections_set_manifest_validator(
         const Cookie& cookie) {
     auto packet = static_cast<protocol_binary_collections_set_manifest*>(
@@ -1236,7 +914,147 @@ static protocol_binary_response_status collections_set_manifest_validator(
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
+/******************************************************************************
+ *                         Frame specs                                        *
+ *****************************************************************************/
+namespace {
+struct OpcodeFrameSpec {
+    protocol_binary_command opcode;
+    FrameSpec spec;
+};
+
+using Key = FrameSpec::Key;
+using Cas = FrameSpec::Cas;
+
+const protocol_binary_datatype_t Document =
+        PROTOCOL_BINARY_DATATYPE_JSON | PROTOCOL_BINARY_DATATYPE_SNAPPY;
+
+/**
+ * The opcodes which are validated by the header alone. The opcodes
+ * which need to look at the extras or the value (or at the state of
+ * the connection) use the validator functions above.
+ */
+const OpcodeFrameSpec headerOnlyOpcodes[] = {
+    // opcode, {defined, extlen, key, value, datatypes, cas}
+    {PROTOCOL_BINARY_CMD_GET, {true, 0, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GETQ, {true, 0, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GETK, {true, 0, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GETKQ, {true, 0, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GAT, {true, 4, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GATQ, {true, 4, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_TOUCH, {true, 4, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_APPEND, {true, 0, Key::Required, true, Document, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_APPENDQ, {true, 0, Key::Required, true, Document, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_PREPEND, {true, 0, Key::Required, true, Document, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_PREPENDQ, {true, 0, Key::Required, true, Document, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_DELETE, {true, 0, Key::Required, false, 0, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_DELETEQ, {true, 0, Key::Required, false, 0, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_INCREMENT, {true, 20, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_INCREMENTQ, {true, 20, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_DECREMENT, {true, 20, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_DECREMENTQ, {true, 20, Key::Required, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_UNLOCK_KEY, {true, 0, Key::Required, false, 0, Cas::Required}},
+    {PROTOCOL_BINARY_CMD_STAT, {true, 0, Key::Optional, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GET_CMD_TIMER, {true, 1, Key::Optional, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_VERBOSITY, {true, 4, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_SASL_AUTH, {true, 0, Key::Required, true, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_SASL_STEP, {true, 0, Key::Required, true, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_SASL_LIST_MECHS, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_NOOP, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_VERSION, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_QUIT, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_QUITQ, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GET_CTRL_TOKEN, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_GET_ADJUSTED_TIME, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_ISASL_REFRESH, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_SSL_CERTS_REFRESH, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_RBAC_REFRESH, {true, 0, Key::Forbidden, false, 0, Cas::Zero}},
+    {PROTOCOL_BINARY_CMD_INIT_COMPLETE, {true, 0, Key::Forbidden, false, 0, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_LIST_BUCKETS, {true, 0, Key::Forbidden, false, 0, Cas::Any}},
+    {PROTOCOL_BINARY_CMD_DCP_NOOP, {true, 0, Key::Forbidden, false, 0, Cas::Any}},
+};
+} // anonymous namespace
+
+/**
+ * SET, ADD and REPLACE carry the flags and the expiry time in the extras,
+ * followed by a cb::mcbp::DurabilityLevel if the client enabled
+ * Feature::Durability (and wants to wait for the mutation to be durable).
+ */
+static protocol_binary_response_status mutation_validator(const Cookie& cookie,
+                                                          Cas cas) {
+    auto* header = static_cast<const protocol_binary_request_header*>(
+            McbpConnection::getPacket(cookie));
+    const bool durable = header->request.extlen == 9;
+    if (durable && !cookie.connection.isDurabilitySupported()) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    const FrameSpec spec{
+            true, uint8_t(durable ? 9 : 8), Key::Required, true, Document, cas};
+    if (!spec.validate(*header)) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    if (durable) {
+        using cb::mcbp::DurabilityLevel;
+        const auto* extras = header->bytes + sizeof(header->bytes);
+        switch (DurabilityLevel(extras[8])) {
+        case DurabilityLevel::None:
+            break;
+        case DurabilityLevel::PersistToActive:
+            if (cookie.connection.getBucketEngine() == nullptr ||
+                cookie.connection.getBucketEngine()->wait_for_persistence ==
+                        nullptr) {
+                // The attached bucket doesn't persist anything
+                return PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED;
+            }
+            break;
+        default:
+            return PROTOCOL_BINARY_RESPONSE_EINVAL;
+        }
+    }
+
+    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
+static protocol_binary_response_status set_replace_validator(
+        const Cookie& cookie) {
+    return mutation_validator(cookie, Cas::Any);
+}
+
+static protocol_binary_response_status add_validator(const Cookie& cookie) {
+    return mutation_validator(cookie, Cas::Zero);
+}
+
+protocol_binary_response_status McbpValidatorChains::invoke(
+        protocol_binary_command command, const Cookie& cookie) {
+    const auto& spec = frameSpecs[command];
+    if (spec.defined) {
+        auto* header = static_cast<const protocol_binary_request_header*>(
+                McbpConnection::getPacket(cookie));
+        if (!spec.validate(*header)) {
+            return PROTOCOL_BINARY_RESPONSE_EINVAL;
+        }
+    }
+
+    const auto& chain = commandChains[command];
+    if (chain.empty()) {
+        return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    }
+    return chain.invoke(cookie);
+}
+
 void McbpValidatorChains::initializeMcbpValidatorChains(McbpValidatorChains& chains) {
+    for (const auto& entry : headerOnlyOpcodes) {
+        chains.setFrameSpec(entry.opcode, entry.spec);
+    }
+
+    chains.push_unique(PROTOCOL_BINARY_CMD_SET, set_replace_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_SETQ, set_replace_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_REPLACE, set_replace_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_REPLACEQ, set_replace_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_ADD, add_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_ADDQ, add_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_OPEN, dcp_open_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_ADD_STREAM, dcp_add_stream_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_CLOSE_STREAM, dcp_close_stream_validator);
@@ -1247,50 +1065,22 @@ void McbpValidatorChains::initializeMcbpValidatorChains(McbpValidatorChains& cha
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_GET_FAILOVER_LOG, dcp_get_failover_log_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_MUTATION, dcp_mutation_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_SET_VBUCKET_STATE, dcp_set_vbucket_state_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_DCP_NOOP, dcp_noop_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_BUFFER_ACKNOWLEDGEMENT, dcp_buffer_acknowledgement_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_CONTROL, dcp_control_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_STREAM_END, dcp_stream_end_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_STREAM_REQ, dcp_stream_req_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DCP_SYSTEM_EVENT, dcp_system_event_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_ISASL_REFRESH, configuration_refresh_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_SSL_CERTS_REFRESH, configuration_refresh_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_VERBOSITY, verbosity_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_HELLO, hello_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_VERSION, version_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_QUIT, quit_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_QUITQ, quit_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_SASL_LIST_MECHS, sasl_list_mech_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_SASL_AUTH, sasl_auth_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_SASL_STEP, sasl_auth_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_NOOP, noop_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_FLUSH, flush_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_FLUSHQ, flush_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GET, get_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GETQ, get_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GETK, get_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GETKQ, get_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GAT, gat_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GATQ, gat_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_TOUCH, gat_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_DELETE, delete_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_DELETEQ, delete_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_STAT, stat_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_INCREMENT, arithmetic_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_INCREMENTQ, arithmetic_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_DECREMENT, arithmetic_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_DECREMENTQ, arithmetic_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GET_CMD_TIMER, get_cmd_timer_validator);
+    chains.push_unique(PROTOCOL_BINARY_CMD_GET_MULTI, get_multi_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_SET_CTRL_TOKEN, set_ctrl_token_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GET_CTRL_TOKEN, get_ctrl_token_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_INIT_COMPLETE, init_complete_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_IOCTL_GET, ioctl_get_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_IOCTL_SET, ioctl_set_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_AUDIT_PUT, audit_put_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_AUDIT_CONFIG_RELOAD, audit_config_reload_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_SHUTDOWN, shutdown_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_OBSERVE_SEQNO, observe_seqno_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_GET_ADJUSTED_TIME, get_adjusted_time_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_SET_DRIFT_COUNTER_STATE, set_drift_counter_state_validator);
 
     chains.push_unique(PROTOCOL_BINARY_CMD_SUBDOC_GET, subdoc_get_validator);
@@ -1308,24 +1098,15 @@ void McbpValidatorChains::initializeMcbpValidatorChains(McbpValidatorChains& cha
     chains.push_unique(PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION, subdoc_multi_mutation_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT, subdoc_get_count_validator);
 
-    chains.push_unique(PROTOCOL_BINARY_CMD_SETQ, set_replace_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_SET, set_replace_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_ADDQ, add_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_ADD, add_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_REPLACEQ, set_replace_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_REPLACE, set_replace_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_APPENDQ, append_prepend_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_APPEND, append_prepend_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_PREPENDQ, append_prepend_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_PREPEND, append_prepend_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_CREATE_BUCKET, create_bucket_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_LIST_BUCKETS, list_bucket_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_DELETE_BUCKET, delete_bucket_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_SELECT_BUCKET, select_bucket_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_GET_ALL_VB_SEQNOS, get_all_vb_seqnos_validator);
 
     chains.push_unique(PROTOCOL_BINARY_CMD_GET_META, get_meta_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_GETQ_META, get_meta_validator);
+    // GET_META_MULTI has the same layout as GET_MULTI
+    chains.push_unique(PROTOCOL_BINARY_CMD_GET_META_MULTI, get_multi_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_SET_WITH_META, mutate_with_meta_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_SETQ_WITH_META, mutate_with_meta_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_ADD_WITH_META, mutate_with_meta_validator);
@@ -1334,8 +1115,6 @@ void McbpValidatorChains::initializeMcbpValidatorChains(McbpValidatorChains& cha
     chains.push_unique(PROTOCOL_BINARY_CMD_DELQ_WITH_META, mutate_with_meta_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_GET_ERROR_MAP, get_errmap_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_GET_LOCKED, get_locked_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_UNLOCK_KEY, unlock_validator);
-    chains.push_unique(PROTOCOL_BINARY_CMD_RBAC_REFRESH, configuration_refresh_validator);
     chains.push_unique(PROTOCOL_BINARY_CMD_COLLECTIONS_SET_MANIFEST,
                        collections_set_manifest_validator);
 }
@@ -23,6 +23,7 @@
 #include <array>
 #include <memcached/protocol_binary.h>
 #include "cookie.h"
+#include "frame_spec.h"
 #include "function_chain.h"
 
 /*
@@ -31,6 +32,8 @@
  * Class stores a chain per opcode allowing a sequence of command validators to be
  * configured, stored and invoked.
  *
+ * The opcodes with a FrameSpec are validated by the spec before the chain
+ * is invoked (and most of them don't have a chain at all).
  */
 class McbpValidatorChains {
 public:
@@ -39,9 +42,7 @@ public:
      * Invoke the chain for the command
      */
     protocol_binary_response_status invoke(protocol_binary_command command,
-                                           const Cookie& cookie) {
-        return commandChains[command].invoke(cookie);
-    }
+                                           const Cookie& cookie);
 
     /*
      * Silently ignores any attempt to push the same function onto the chain.
@@ -53,6 +54,13 @@ public:
                                            const Cookie&>(f));
     }
 
+    /*
+     * Set the frame spec used to validate the command
+     */
+    void setFrameSpec(protocol_binary_command command, const FrameSpec& spec) {
+        frameSpecs[command] = spec;
+    }
+
     /*
      * Initialize the memcached binary protocol validators
      */
@@ -63,4 +71,6 @@ private:
     std::array<FunctionChain<protocol_binary_response_status,
                              PROTOCOL_BINARY_RESPONSE_SUCCESS,
                              const Cookie&>, 0x100> commandChains;
-};
\ No newline at end of file
+
+    std::array<FrameSpec, 0x100> frameSpecs{};
+};
@@ -30,8 +30,9 @@ class McbpDestroyBucketTask : public Task {
 public:
     McbpDestroyBucketTask(const std::string& name_,
                           bool force_,
-                          McbpConnection* connection_)
-        : thread(name_, force_, connection_, this) {
+                          McbpConnection* connection_,
+                          bool detach_ = false)
+        : thread(name_, force_, connection_, this, detach_) {
     }
 
     // start the bucket deletion
@@ -51,5 +52,9 @@ public:
         }
     }
 
+    TaskType getType() const override {
+        return TaskType::Admin;
+    }
+
     DestroyBucketThread thread;
 };
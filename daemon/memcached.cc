@@ -20,6 +20,7 @@
 #include "buckets.h"
 #include "cmdline.h"
 #include "config_parse.h"
+#include "connection_balancer.h"
 #include "connections.h"
 #include "debug_helpers.h"
 #include "doc_pre_expiry.h"
@@ -41,6 +42,7 @@
 #include "runtime.h"
 #include "session_cas.h"
 #include "settings.h"
+#include "ssl_session_cache.h"
 #include "stats.h"
 #include "subdocument.h"
 #include "timings.h"
@@ -404,6 +406,7 @@ static void stats_init(void) {
     stats.total_conns.reset();
     stats.daemon_conns.reset();
     stats.rejected_conns.reset();
+    stats.migrated_conns.reset();
     stats.curr_conns.store(0, std::memory_order_relaxed);
 }
 
@@ -424,6 +427,7 @@ void stats_reset(const void *void_cookie) {
     }
     stats.total_conns.reset();
     stats.rejected_conns.reset();
+    stats.migrated_conns.reset();
     threadlocal_stats_reset(all_buckets[conn.getBucketIndex()].stats);
     bucket_reset_stats(&conn);
 }
@@ -462,6 +466,17 @@ static void ssl_cipher_list_changed_listener(const std::string&, Settings &s) {
     set_ssl_cipher_list(s.getSslCipherList());
 }
 
+static void ssl_session_cache_size_changed_listener(const std::string&,
+                                                   Settings& s) {
+    SslSessionCache::getInstance().setMaxSize(s.getSslSessionCacheSize());
+}
+
+static void ssl_session_lifetime_changed_listener(const std::string&,
+                                                 Settings& s) {
+    SslSessionCache::getInstance().setLifetime(
+            std::chrono::seconds(s.getSslSessionLifetime()));
+}
+
 static void verbosity_changed_listener(const std::string&, Settings &s) {
     perform_callbacks(ON_LOG_LEVEL, NULL, NULL);
 }
@@ -539,6 +554,10 @@ static void settings_init(void) {
                                ssl_minimum_protocol_changed_listener);
     settings.addChangeListener("ssl_cipher_list",
                                ssl_cipher_list_changed_listener);
+    settings.addChangeListener("ssl_session_cache_size",
+                               ssl_session_cache_size_changed_listener);
+    settings.addChangeListener("ssl_session_lifetime",
+                               ssl_session_lifetime_changed_listener);
     settings.addChangeListener("verbosity", verbosity_changed_listener);
     settings.addChangeListener("interfaces", interfaces_changed_listener);
     settings.addChangeListener("saslauthd_socketpath",
@@ -547,6 +566,8 @@ static void settings_init(void) {
     settings.addInterface(default_interface);
 
     settings.setBioDrainBufferSize(8192);
+    settings.setSslSessionCacheSize(10240);
+    settings.setSslSessionLifetime(3600);
 
     settings.setVerbose(0);
     settings.setConnectionIdleTime(0); // Connection idle time disabled
@@ -963,7 +984,14 @@ bool conn_listening(ListenConnection *c)
         return false;
     }
 
-    dispatch_conn_new(sfd, c->getParentPort());
+    auto* owner = c->getOwner();
+    if (owner == nullptr) {
+        dispatch_conn_new(sfd, c->getParentPort());
+    } else {
+        // We're running in the context of the worker thread owning the
+        // listening socket; skip the handoff through the notification pipe
+        dispatch_conn_local(owner, sfd, c->getParentPort());
+    }
 
     return false;
 }
@@ -1019,11 +1047,11 @@ void event_handler(evutil_socket_t fd, short which, void *arg) {
     }
 
     /*
-     * Remove the list from the list of pending io's (in case the
-     * object was scheduled to run in the dispatcher before the
-     * callback for the worker thread is executed.
+     * Note that the connection may still be in the pending io queue (if
+     * it was notified before the callback for the worker thread is
+     * executed). That's harmless; it'll just run one more time from
+     * the pending io list.
      */
-    thr->pending_io = list_remove(thr->pending_io, c);
 
     /* sanity */
     cb_assert(fd == c->getSocketDescriptor());
@@ -1083,6 +1111,13 @@ void listen_event_handler(evutil_socket_t, short which, void *arg) {
     }
 
     if (memcached_shutdown) {
+        if (c->getOwner() != nullptr) {
+            // The socket is owned by a worker thread which needs to keep
+            // on running until all of its clients are disconnected. Just
+            // stop accepting new clients.
+            c->disable();
+            return;
+        }
         // Someone requested memcached to shut down. The listen thread should
         // be stopped immediately.
         LOG_NOTICE(NULL, "Stopping listen thread");
@@ -1173,7 +1208,8 @@ static void maximize_sndbuf(const SOCKET sfd) {
     }
 }
 
-static SOCKET new_server_socket(struct addrinfo *ai, bool tcp_nodelay) {
+static SOCKET new_server_socket(struct addrinfo *ai, bool tcp_nodelay,
+                                bool reuseport) {
     SOCKET sfd;
 
     sfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
@@ -1214,6 +1250,20 @@ static SOCKET new_server_socket(struct addrinfo *ai, bool tcp_nodelay) {
 #endif
 
     setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, flags_ptr, sizeof(flags));
+#ifdef SO_REUSEPORT
+    if (reuseport) {
+        error = setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, flags_ptr,
+                           sizeof(flags));
+        if (error != 0) {
+            LOG_WARNING(NULL, "setsockopt(SO_REUSEPORT): %s",
+                        strerror(errno));
+            safe_close(sfd);
+            return INVALID_SOCKET;
+        }
+    }
+#else
+    (void)reuseport;
+#endif
     error = setsockopt(sfd, SOL_SOCKET, SO_KEEPALIVE, flags_ptr,
                        sizeof(flags));
     if (error != 0) {
@@ -1290,6 +1340,90 @@ static void add_listening_port(const struct interface *interf, in_port_t port, s
     }
 }
 
+/**
+ * Should each worker thread own its own set of listening sockets (bound
+ * with SO_REUSEPORT so that the kernel distributes the incoming
+ * connections between them) instead of having the dispatcher thread
+ * accept all clients and hand them over to the worker threads.
+ */
+static bool use_reuseport_listeners() {
+#ifdef SO_REUSEPORT
+    return settings.isReuseportListeners();
+#else
+    if (settings.isReuseportListeners()) {
+        LOG_WARNING(NULL,
+                    "SO_REUSEPORT is not supported on this platform. "
+                    "Accepting clients from the dispatcher thread");
+    }
+    return false;
+#endif
+}
+
+/**
+ * Insert a newly created listening connection into the list of listening
+ * connections and account for it in the stats.
+ */
+static void add_listen_connection(ListenConnection* lconn) {
+    if (lconn == nullptr) {
+        FATAL_ERROR(EXIT_FAILURE, "Failed to create listening connection");
+    }
+
+    lconn->setNext(listen_conn);
+    listen_conn = lconn;
+
+    stats.daemon_conns++;
+    stats.curr_conns.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Create a listening socket for each of the worker threads bound to the
+ * same address as the (already bound) socket sfd. The socket sfd itself
+ * is handed to the first worker thread.
+ *
+ * @param sfd the first socket bound to the address (with SO_REUSEPORT)
+ * @param ai the address information used to create sfd
+ * @param port the port number sfd is bound to (it may differ from the one
+ *             in ai if the interface specified port 0)
+ * @param interf the interface description
+ */
+static void create_reuseport_listeners(SOCKET sfd,
+                                       struct addrinfo* ai,
+                                       in_port_t port,
+                                       const struct interface* interf) {
+    struct sockaddr_storage addr;
+    memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+    if (ai->ai_addr->sa_family == AF_INET) {
+        reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port = htons(port);
+    } else if (ai->ai_addr->sa_family == AF_INET6) {
+        reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port = htons(port);
+    }
+
+    for (int ii = 0; ii < settings.getNumWorkerThreads(); ++ii) {
+        if (ii > 0) {
+            sfd = new_server_socket(ai, interf->tcp_nodelay, true);
+            if (sfd == INVALID_SOCKET) {
+                LOG_WARNING(NULL,
+                            "Failed to create SO_REUSEPORT socket for port "
+                            "%u on worker thread %d", port, ii);
+                continue;
+            }
+
+            if (bind(sfd, reinterpret_cast<struct sockaddr*>(&addr),
+                     (socklen_t)ai->ai_addrlen) == SOCKET_ERROR) {
+                log_socket_error(EXTENSION_LOG_WARNING, nullptr,
+                                 "Failed to bind SO_REUSEPORT socket: %s");
+                safe_close(sfd);
+                continue;
+            }
+        }
+
+        auto* thread = get_worker_thread(ii);
+        add_listen_connection(conn_new_server(sfd, port,
+                                              ai->ai_addr->sa_family,
+                                              *interf, thread->base, thread));
+    }
+}
+
 /**
  * Create a socket and bind it to a specific port number
  * @param interface the interface to bind to
@@ -1336,8 +1470,10 @@ static int server_socket(const struct interface *interf) {
         return 1;
     }
 
+    const bool reuseport = use_reuseport_listeners();
     for (struct addrinfo* next = ai; next; next = next->ai_next) {
-        if ((sfd = new_server_socket(next, interf->tcp_nodelay)) == INVALID_SOCKET) {
+        if ((sfd = new_server_socket(next, interf->tcp_nodelay,
+                                     reuseport)) == INVALID_SOCKET) {
             /* getaddrinfo can return "junk" addresses,
              * we make sure at least one works before erroring.
              */
@@ -1375,18 +1511,16 @@ static int server_socket(const struct interface *interf) {
             }
         }
 
-        auto* lconn = conn_new_server(sfd, listenport, next->ai_addr->sa_family,
-                                      *interf, main_base);
-        if (lconn == nullptr) {
-            FATAL_ERROR(EXIT_FAILURE, "Failed to create listening connection");
-        }
-
-        lconn->setNext(listen_conn);
-        listen_conn = lconn;
-
-        stats.daemon_conns++;
-        stats.curr_conns.fetch_add(1, std::memory_order_relaxed);
+        // The listening port must be registered before we start
+        // accepting clients on the worker threads
         add_listening_port(interf, listenport, next->ai_addr->sa_family);
+        if (reuseport) {
+            create_reuseport_listeners(sfd, next, listenport, interf);
+        } else {
+            add_listen_connection(conn_new_server(sfd, listenport,
+                                                  next->ai_addr->sa_family,
+                                                  *interf, main_base));
+        }
     }
 
     freeaddrinfo(ai);
@@ -1450,6 +1584,11 @@ static void create_listen_sockets(bool management) {
                                            " illegal objects: " +
                                        to_string(c->toJSON(), false));
             }
+            auto* owner = lc->getOwner();
+            if (owner != nullptr && owner->index != 0) {
+                // Only report one of the SO_REUSEPORT sockets for the port
+                continue;
+            }
             cJSON_AddItemToArray(array.get(), lc->getDetails().release());
         }
 
@@ -1633,6 +1772,7 @@ static ENGINE_ERROR_CODE release_cookie(const void *void_cookie) {
     cb_assert(thr);
     LOCK_THREAD(thr);
     c->decrementRefcount();
+    UNLOCK_THREAD(thr);
 
     /* Releasing the refererence to the object may cause it to change
      * state. (NOTE: the release call shall never be called from the
@@ -1641,7 +1781,6 @@ static ENGINE_ERROR_CODE release_cookie(const void *void_cookie) {
      * connection
      */
     notify = add_conn_to_pending_io_list(c);
-    UNLOCK_THREAD(thr);
 
     /* kick the thread in the butt */
     if (notify) {
@@ -1973,6 +2112,12 @@ static SERVER_HANDLE_V1 *get_server_api(void)
         hooks_api.release_free_memory = AllocHooks::release_free_memory;
         hooks_api.enable_thread_cache = AllocHooks::enable_thread_cache;
         hooks_api.get_allocator_property = AllocHooks::get_allocator_property;
+        hooks_api.get_allocation_utilization =
+                AllocHooks::get_allocation_utilization;
+        hooks_api.create_arena = AllocHooks::create_arena;
+        hooks_api.set_thread_arena = AllocHooks::set_thread_arena;
+        hooks_api.get_arena_stats = AllocHooks::get_arena_stats;
+        hooks_api.purge_arena = AllocHooks::purge_arena;
 
         document_api.pre_link = pre_link_document;
         document_api.pre_expiry = document_pre_expiry;
@@ -2052,7 +2197,9 @@ void CreateBucketThread::create() {
         all_buckets[ii].type = type;
         strcpy(all_buckets[ii].name, name.c_str());
         try {
-            all_buckets[ii].topkeys = new TopKeys(settings.getTopkeysSize());
+            all_buckets[ii].topkeys =
+                    new TopKeys(settings.getTopkeysSize(),
+                                size_t(settings.getNumWorkerThreads()) + 1);
         } catch (const std::bad_alloc &) {
             result = ENGINE_ENOMEM;
             LOG_WARNING(&connection,
@@ -2199,9 +2346,27 @@ void DestroyBucketThread::destroy() {
                    connection_id.c_str(), name.c_str(),
                    memcached_status_2_text(code));
         result = ret;
+        if (detach && connection != nullptr) {
+            detach_connection(ret);
+        }
         return;
     }
 
+    if (detach && connection != nullptr) {
+        // The bucket is no longer Ready, so no new connection may select
+        // it. Let the requester carry on while we drain the connections
+        // and shut it down.
+        if (idx == size_t(connection->getBucketIndex())) {
+            disassociate_bucket(connection);
+        }
+        LOG_NOTICE(connection,
+                   "%s Delete bucket [%s]. Detached, the deletion continues "
+                   "in the background",
+                   connection_id.c_str(),
+                   name.c_str());
+        detach_connection(ENGINE_SUCCESS);
+    }
+
     LOG_NOTICE(connection, "%s Delete bucket [%s]. Notifying all registered "
             "ON_DELETE_BUCKET callbacks", connection_id.c_str(), name.c_str());
 
@@ -2292,6 +2457,14 @@ void DestroyBucketThread::destroy() {
     result = ENGINE_SUCCESS;
 }
 
+void DestroyBucketThread::detach_connection(ENGINE_ERROR_CODE status) {
+    // The connection may go away once notified, and is not to be notified
+    // again when the task completes
+    auto* cookie = &connection->getCookieObject();
+    connection = nullptr;
+    notify_io_complete(cookie, status);
+}
+
 void DestroyBucketThread::run() {
     setRunning();
     destroy();
@@ -2383,6 +2556,10 @@ void delete_all_buckets() {
             return Status::Finished;
         }
 
+        TaskType getType() const override {
+            return TaskType::Admin;
+        }
+
         DestroyBucketThread thread;
     };
 
@@ -2779,9 +2956,17 @@ extern "C" int memcached_main(int argc, char **argv) {
     /* start up worker threads if MT mode */
     thread_init(settings.getNumWorkerThreads(), main_base, dispatch_event_handler);
 
-    executorPool.reset(new ExecutorPool(size_t(settings.getNumWorkerThreads())));
+    // The authentications (which may be many when the clients reconnect)
+    // and the bucket management (which may block for long) each get their
+    // own executors, so that neither holds up the other
+    const auto numWorkers = size_t(settings.getNumWorkerThreads());
+    executorPool.reset(new ExecutorPool(
+            numWorkers,
+            {{TaskType::Auth, std::max(size_t(1), numWorkers / 2)},
+             {TaskType::Admin, 1}}));
 
     initializeTracing();
+    initializeConnectionBalancer();
     TRACE_GLOBAL0("memcached", "Started");
 
     /*
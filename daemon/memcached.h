@@ -2,6 +2,7 @@
 #ifndef MEMCACHED_H
 #define MEMCACHED_H
 
+#include <atomic>
 #include <functional>
 #include <mutex>
 #include <vector>
@@ -22,11 +23,11 @@
 #include <memcached/engine.h>
 #include <memcached/engine_error.h>
 #include <memcached/extension.h>
-#include <JSON_checker.h>
 
 #include "dynamic_buffer.h"
 #include "executorpool.h"
 #include "log_macros.h"
+#include "pending_io_queue.h"
 #include "settings.h"
 #include "timing_histogram.h"
 
@@ -71,6 +72,10 @@ enum class ThreadType {
 
 class Connection;
 class ConnectionQueue;
+class BufferPool;
+class InflatedValueCache;
+class CommandContextPool;
+class IoVectorPool;
 
 struct LIBEVENT_THREAD {
     cb_thread_t thread_id;      /* unique ID of this thread */
@@ -78,17 +83,35 @@ struct LIBEVENT_THREAD {
     struct event notify_event;  /* listen event for notify pipe */
     SOCKET notify[2];           /* notification pipes */
     ConnectionQueue *new_conn_queue; /* queue of new connections to handle */
-    cb_mutex_t mutex;      /* Mutex to lock protect access to the pending_io */
+    cb_mutex_t mutex;      /* Mutex to lock protect access to the thread */
     bool is_locked;
-    Connection *pending_io;    /* List of connection with pending async io ops */
+
+    /**
+     * Connections scheduled with pending async io ops by other threads
+     * (see notify_io_complete). The queue is lock free, and only wakes
+     * up the thread when it isn't already running the pending io.
+     */
+    PendingIoQueue<Connection> pending_io_queue;
+
+    /**
+     * The connections moved off pending_io_queue which are about to be
+     * run by the worker thread (protected by the mutex)
+     */
+    Connection *pending_io;
     int index;                  /* index of this thread in the threads array */
     ThreadType type;      /* Type of IO this thread processes */
 
-    /** Shared read buffer for all connections serviced by this thread. */
-    std::unique_ptr<cb::Pipe> read;
+    /**
+     * Pool of idle read and write buffers shared by all connections
+     * serviced by this thread.
+     */
+    BufferPool* buffer_pool;
 
-    /** Shared write buffer for all connections serviced by this thread. */
-    std::unique_ptr<cb::Pipe> write;
+    /**
+     * Pool of idle io vectors shared by all connections serviced by
+     * this thread.
+     */
+    IoVectorPool* io_vector_pool;
 
     subdoc_OPERATION* subdoc_op; /** Shared sub-document operation for all
                                      connections serviced by this thread. */
@@ -104,7 +127,37 @@ struct LIBEVENT_THREAD {
      */
     int deleting_buckets;
 
-    JSON_checker::Validator *validator;
+    /**
+     * Cache of inflated document values for the connections serviced
+     * by this thread.
+     */
+    InflatedValueCache* inflated_value_cache;
+
+    /**
+     * Cache of Snappy compressed copies of uncompressed document values
+     * sent to the Snappy enabled connections serviced by this thread
+     * (see Settings::getSnappyResponseMinSize).
+     */
+    InflatedValueCache* compressed_value_cache;
+
+    /**
+     * Free lists of command context memory for the connections serviced
+     * by this thread.
+     */
+    CommandContextPool* command_context_pool;
+
+    /**
+     * The time (in ns) this thread spent running connections (protected
+     * by the mutex). The ConnectionBalancer uses it to find the busy
+     * threads.
+     */
+    uint64_t busy_time;
+
+    /**
+     * The number of bytes the connections serviced by this thread have
+     * waiting to be sent (see Settings::getMaxThreadSendQueueSize)
+     */
+    std::atomic<size_t> send_queue_size;
 };
 
 #define LOCK_THREAD(t) \
@@ -158,6 +211,29 @@ void threads_cleanup(void);
 
 void dispatch_conn_new(SOCKET sfd, int parent_port);
 
+/**
+ * Create a connection object for a client accepted on a listening socket
+ * owned by the worker thread itself (SO_REUSEPORT mode). This must only
+ * be called from the context of the provided thread, and bypass the
+ * connection queue and notification pipe used by dispatch_conn_new.
+ */
+void dispatch_conn_local(LIBEVENT_THREAD* thread, SOCKET sfd, int parent_port);
+
+/**
+ * Hand a connection over to the worker thread it is migrating to. This
+ * must be called from the context of the thread the connection is
+ * bound to, once McbpConnection::prepareMigration() removed it from
+ * the thread.
+ */
+void dispatch_conn_migrate(McbpConnection& c);
+
+/**
+ * Get the worker thread with the given index
+ *
+ * @throws std::out_of_range if index isn't a valid worker thread index
+ */
+LIBEVENT_THREAD* get_worker_thread(int index);
+
 /* Lock wrappers for cache functions that are called from main loop. */
 int is_listen_thread(void);
 
@@ -175,15 +251,27 @@ Connection *list_remove(Connection *h, Connection *n);
 
 bool load_extension(const char *soname, const char *config);
 
+/**
+ * Schedule the connection to be run by its worker thread. May be called
+ * from any thread without holding the thread lock.
+ *
+ * @return nonzero if the caller should notify the thread
+ */
 int add_conn_to_pending_io_list(Connection *c);
 
+/**
+ * Remove the connection from the pending io lists of its thread (the
+ * caller must be the worker thread and hold the thread lock)
+ */
+void remove_conn_from_pending_io_list(Connection *c);
+
 /* connection state machine */
 bool conn_listening(ListenConnection *c);
 
 void event_handler(evutil_socket_t fd, short which, void *arg);
 void listen_event_handler(evutil_socket_t, short, void *);
 
-void mcbp_collect_timings(const McbpConnection* c);
+void mcbp_collect_timings(McbpConnection* c);
 
 void log_socket_error(EXTENSION_LOG_LEVEL severity,
                       const void* client_cookie,
@@ -0,0 +1,268 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmark the cost of notify_io_complete for multiple engine threads
+ * notifying connections served by a single worker thread. The worker
+ * thread is woken up through a "notification pipe", and we count the
+ * number of signals sent and wakeups performed.
+ *
+ * MutexPendingList is the old scheme: a mutex protected list which the
+ * worker holds the lock for while it runs the connections.
+ * LockFreePendingQueue is the PendingIoQueue used by the daemon.
+ */
+
+#include "pending_io_queue.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// The number of notifications each producer sends per iteration
+static const int NotificationsPerProducer = 1000;
+
+/// The number of connections each producer notifies
+static const int ConnectionsPerProducer = 50;
+
+/// The stand-in for a connection
+struct Item {
+    Item* getNext() const {
+        return next;
+    }
+
+    void setNext(Item* n) {
+        next = n;
+    }
+
+    Item* next = nullptr;
+    std::atomic_bool pending{false};
+    bool sentinel = false;
+};
+
+/// The stand-in for the notification pipe of the worker thread
+class WakeupChannel {
+public:
+    void signal() {
+        std::lock_guard<std::mutex> guard(mutex);
+        ++signals;
+        ++outstanding;
+        cond.notify_one();
+    }
+
+    /// Wait for (and drain) the signals, returns false when stopped
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return outstanding > 0 || stopped; });
+        if (outstanding == 0) {
+            return false;
+        }
+        outstanding = 0;
+        ++wakeups;
+        return true;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopped = true;
+        cond.notify_one();
+    }
+
+    uint64_t getSignals() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return signals;
+    }
+
+    uint64_t getWakeups() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return wakeups;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    int outstanding = 0;
+    bool stopped = false;
+    uint64_t signals = 0;
+    uint64_t wakeups = 0;
+};
+
+/// Simulate the work of running the connection
+static void runItem(Item* item, bool& sentinel) {
+    for (int ii = 0; ii < 100; ++ii) {
+        benchmark::DoNotOptimize(item);
+    }
+    if (item->sentinel) {
+        sentinel = true;
+    }
+}
+
+class MutexPendingList {
+public:
+    void notify(Item* item) {
+        bool signal = false;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            Item* ptr = list;
+            while (ptr != nullptr && ptr != item) {
+                ptr = ptr->getNext();
+            }
+            if (ptr == nullptr) {
+                signal = (list == nullptr);
+                item->setNext(list);
+                list = item;
+            }
+        }
+        if (signal) {
+            channel.signal();
+        }
+    }
+
+    void run(std::atomic_bool& done) {
+        while (channel.wait()) {
+            bool sentinel = false;
+            std::lock_guard<std::mutex> guard(mutex);
+            Item* pending = list;
+            list = nullptr;
+            while (pending != nullptr) {
+                auto* item = pending;
+                pending = item->getNext();
+                item->setNext(nullptr);
+                runItem(item, sentinel);
+            }
+            if (sentinel) {
+                done = true;
+            }
+        }
+    }
+
+    WakeupChannel channel;
+
+private:
+    std::mutex mutex;
+    Item* list = nullptr;
+};
+
+class LockFreePendingQueue {
+public:
+    void notify(Item* item) {
+        if (!item->pending.exchange(true)) {
+            if (queue.push(item)) {
+                channel.signal();
+            }
+        }
+    }
+
+    void run(std::atomic_bool& done) {
+        while (channel.wait()) {
+            // Mirrors process_pending_io() in thread.cc
+            bool sentinel = false;
+            int round;
+            for (round = 0; round < 4; ++round) {
+                auto* pending = queue.popAll();
+                if (pending == nullptr) {
+                    pending = queue.prepareToSleep();
+                    if (pending == nullptr) {
+                        break;
+                    }
+                }
+                runList(pending, sentinel);
+            }
+            if (round == 4) {
+                auto* pending = queue.prepareToSleep();
+                if (pending != nullptr) {
+                    runList(pending, sentinel);
+                }
+            }
+            if (sentinel) {
+                done = true;
+            }
+        }
+    }
+
+    WakeupChannel channel;
+
+private:
+    void runList(Item* pending, bool& sentinel) {
+        while (pending != nullptr) {
+            auto* item = pending;
+            pending = item->getNext();
+            item->setNext(nullptr);
+            item->pending.exchange(false);
+            runItem(item, sentinel);
+        }
+    }
+
+    PendingIoQueue<Item> queue;
+};
+
+template <typename Scheme>
+void PendingIoBenchmark(benchmark::State& state) {
+    const int producers = int(state.range(0));
+    Scheme scheme;
+    std::vector<Item> items(producers * ConnectionsPerProducer);
+    std::atomic_bool done{false};
+    std::thread consumer([&scheme, &done]() { scheme.run(done); });
+
+    while (state.KeepRunning()) {
+        std::vector<std::thread> threads;
+        for (int ii = 0; ii < producers; ++ii) {
+            threads.emplace_back([&scheme, &items, ii]() {
+                auto* base = items.data() + ii * ConnectionsPerProducer;
+                for (int jj = 0; jj < NotificationsPerProducer; ++jj) {
+                    scheme.notify(base + (jj % ConnectionsPerProducer));
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        // Wait for the worker to catch up before the next iteration
+        Item sentinel;
+        sentinel.sentinel = true;
+        done = false;
+        scheme.notify(&sentinel);
+        while (!done) {
+            std::this_thread::yield();
+        }
+    }
+
+    const auto signals = scheme.channel.getSignals();
+    const auto wakeups = scheme.channel.getWakeups();
+    scheme.channel.stop();
+    consumer.join();
+
+    state.SetItemsProcessed(state.iterations() * producers *
+                            NotificationsPerProducer);
+    state.counters["signals"] = double(signals) / state.iterations();
+    state.counters["wakeups"] = double(wakeups) / state.iterations();
+}
+
+BENCHMARK_TEMPLATE(PendingIoBenchmark, MutexPendingList)
+        ->RangeMultiplier(2)
+        ->Range(1, 8)
+        ->UseRealTime();
+BENCHMARK_TEMPLATE(PendingIoBenchmark, LockFreePendingQueue)
+        ->RangeMultiplier(2)
+        ->Range(1, 8)
+        ->UseRealTime();
+
+BENCHMARK_MAIN()
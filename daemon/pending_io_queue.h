@@ -0,0 +1,80 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+
+/**
+ * The PendingIoQueue is the queue the engines (and other threads) use
+ * to schedule connections to be run by the worker thread serving them
+ * (through notify_io_complete). Multiple threads may push objects
+ * onto the queue without locking, and the worker thread grabs all of
+ * them in one go.
+ *
+ * The queue also keeps track of if the worker thread needs a wakeup
+ * signal. Only the first push after the worker thread went to sleep
+ * requests a wakeup; objects pushed while the worker is busy (or
+ * already signalled) are picked up without an extra wakeup.
+ *
+ * The objects are linked through their own next pointer (like the
+ * rest of the connection lists), and must provide getNext() and
+ * setNext(). The caller must ensure an object isn't pushed while it
+ * is already in the queue.
+ */
+template <typename T>
+class PendingIoQueue {
+public:
+    /**
+     * Push an object to the queue
+     *
+     * @return true if the caller should wake up the consumer
+     */
+    bool push(T* obj) {
+        auto* head = list.load(std::memory_order_relaxed);
+        do {
+            obj->setNext(head);
+        } while (!list.compare_exchange_weak(head, obj));
+
+        return !wakeupPending.exchange(true);
+    }
+
+    /**
+     * Grab all of the objects in the queue (most recently pushed first)
+     */
+    T* popAll() {
+        return list.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    /**
+     * The consumer found the queue empty and is about to go back to
+     * sleep. Let the next push request a wakeup, and return the objects
+     * pushed in the meantime (which the consumer must process as their
+     * producers won't signal).
+     */
+    T* prepareToSleep() {
+        wakeupPending.store(false);
+        return list.exchange(nullptr);
+    }
+
+    bool empty() const {
+        return list.load(std::memory_order_relaxed) == nullptr;
+    }
+
+private:
+    std::atomic<T*> list{nullptr};
+    std::atomic<bool> wakeupPending{false};
+};
@@ -27,6 +27,9 @@ ENGINE_ERROR_CODE AppendPrependCommandContext::step() {
         case State::InflateInputData:
             ret = inflateInputData();
             break;
+        case State::UpdateInEngine:
+            ret = updateInEngine();
+            break;
         case State::GetItem:
             ret = getItem();
             break;
@@ -65,7 +68,7 @@ ENGINE_ERROR_CODE AppendPrependCommandContext::inflateInputData() {
         }
         value.buf = inputbuffer.data.get();
         value.len = inputbuffer.len;
-        state = State::GetItem;
+        state = State::UpdateInEngine;
     } catch (const std::bad_alloc&) {
         return ENGINE_ENOMEM;
     }
@@ -73,6 +76,33 @@ ENGINE_ERROR_CODE AppendPrependCommandContext::inflateInputData() {
     return ENGINE_SUCCESS;
 }
 
+ENGINE_ERROR_CODE AppendPrependCommandContext::updateInEngine() {
+    uint64_t ncas = 0;
+    mutation_descr_t info = {};
+    auto ret = bucket_append_prepend(connection,
+                                     key,
+                                     vbucket,
+                                     mode == Mode::Append,
+                                     value,
+                                     cas,
+                                     ncas,
+                                     info);
+    if (ret == ENGINE_SUCCESS) {
+        update_topkeys(key, &connection);
+        connection.setCAS(ncas);
+        extras.vbucket_uuid = htonll(info.vbucket_uuid);
+        extras.seqno = htonll(info.seqno);
+        sendResponse();
+        state = State::Done;
+    } else if (ret == ENGINE_ENOTSUP) {
+        // The engine can't do this one (or at all), so get and store it
+        state = State::GetItem;
+        ret = ENGINE_SUCCESS;
+    }
+
+    return ret;
+}
+
 ENGINE_ERROR_CODE AppendPrependCommandContext::getItem() {
     auto ret = bucket_get(&connection, key, vbucket);
     if (ret.first == cb::engine_errc::success) {
@@ -186,12 +216,8 @@ ENGINE_ERROR_CODE AppendPrependCommandContext::storeItem() {
             }
             extras.vbucket_uuid = htonll(newItemInfo.vbucket_uuid);
             extras.seqno = htonll(newItemInfo.seqno);
-            mcbp_write_response(&connection, &extras, sizeof(extras), 0,
-                                sizeof(extras));
-        } else {
-            mcbp_write_packet(&connection,
-                              PROTOCOL_BINARY_RESPONSE_SUCCESS);
         }
+        sendResponse();
         state = State::Done;
     } else if (ret == ENGINE_KEY_EEXISTS && cas == 0) {
         state = State::Reset;
@@ -200,6 +226,15 @@ ENGINE_ERROR_CODE AppendPrependCommandContext::storeItem() {
     return ret;
 }
 
+void AppendPrependCommandContext::sendResponse() {
+    if (connection.isSupportsMutationExtras()) {
+        mcbp_write_response(&connection, &extras, sizeof(extras), 0,
+                            sizeof(extras));
+    } else {
+        mcbp_write_packet(&connection, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    }
+}
+
 ENGINE_ERROR_CODE AppendPrependCommandContext::reset() {
     olditem.reset();
     newitem.reset();
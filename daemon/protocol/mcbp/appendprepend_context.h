@@ -27,6 +27,10 @@
  * the document in the underlying engine. Multiple clients operating on the
  * same document will be detected by the CAS store operation returning EEXISTS,
  * and we just retry the operation.
+ *
+ * Engines which provide ENGINE_HANDLE_V1::append_prepend are asked to do
+ * the whole operation first, and the state machine only falls back to the
+ * above if they can't.
  */
 class AppendPrependCommandContext : public SteppableCommandContext {
 public:
@@ -39,6 +43,9 @@ public:
         // If the client sends compressed data we need to inflate the
         // input data before we can do anything
             InflateInputData,
+        // Let the engine do the whole operation if it can (and move on to
+        // GetItem if it can't)
+            UpdateInEngine,
         // Look up the item to operate on
             GetItem,
         // Allocate the destination object
@@ -73,7 +80,7 @@ public:
           cas(ntohll(req->message.header.request.cas)),
           olditem(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
           newitem(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
-          state(State::GetItem) {
+          state(State::UpdateInEngine) {
 
         auto datatype = req->message.header.request.datatype;
         if (mcbp::datatype::is_snappy(datatype)) {
@@ -86,6 +93,8 @@ protected:
 
     ENGINE_ERROR_CODE inflateInputData();
 
+    ENGINE_ERROR_CODE updateInEngine();
+
     ENGINE_ERROR_CODE getItem();
 
     ENGINE_ERROR_CODE allocateNewItem();
@@ -94,6 +103,10 @@ protected:
 
     ENGINE_ERROR_CODE reset();
 
+    /// Send the response for the stored document (with the mutation
+    /// extras if the client asked for them)
+    void sendResponse();
+
 private:
     const Mode mode;
     const DocKey key;
@@ -21,6 +21,34 @@
 #include "../../mcbp.h"
 #include "engine_wrapper.h"
 
+bool ArithmeticCommandContext::isIncrement() const {
+    return connection.getCmd() == PROTOCOL_BINARY_CMD_INCREMENT ||
+           connection.getCmd() == PROTOCOL_BINARY_CMD_INCREMENTQ;
+}
+
+ENGINE_ERROR_CODE ArithmeticCommandContext::updateInEngine() {
+    uint64_t ncas = 0;
+    auto ret = bucket_arithmetic(connection,
+                                 key,
+                                 vbucket,
+                                 isIncrement(),
+                                 ntohll(request.message.body.delta),
+                                 cas,
+                                 result,
+                                 ncas,
+                                 mutationDescr);
+    if (ret == ENGINE_SUCCESS) {
+        connection.setCAS(ncas);
+        state = State::SendResult;
+    } else if (ret == ENGINE_ENOTSUP) {
+        // The engine can't do this one (or at all), so get and store it
+        state = State::GetItem;
+        ret = ENGINE_SUCCESS;
+    }
+
+    return ret;
+}
+
 ENGINE_ERROR_CODE ArithmeticCommandContext::getItem() {
     auto ret = bucket_get(&connection, key, vbucket);
     if (ret.first == cb::engine_errc::success) {
@@ -57,8 +85,7 @@ ENGINE_ERROR_CODE ArithmeticCommandContext::getItem() {
             state = State::CreateNewItem;
             ret.first = cb::engine_errc::success;
         } else {
-            if ((connection.getCmd() == PROTOCOL_BINARY_CMD_INCREMENT) ||
-                (connection.getCmd() == PROTOCOL_BINARY_CMD_INCREMENTQ)) {
+            if (isIncrement()) {
                 STATS_INCR(&connection, incr_misses);
             } else {
                 STATS_INCR(&connection, decr_misses);
@@ -133,8 +160,7 @@ ENGINE_ERROR_CODE ArithmeticCommandContext::allocateNewItem() {
     uint64_t delta = ntohll(request.message.body.delta);
 
     // perform the op ;)
-    if (request.message.header.request.opcode == PROTOCOL_BINARY_CMD_INCREMENT ||
-        request.message.header.request.opcode == PROTOCOL_BINARY_CMD_INCREMENTQ) {
+    if (isIncrement()) {
         // increment
         oldval += delta;
     } else {
@@ -201,8 +227,7 @@ ENGINE_ERROR_CODE ArithmeticCommandContext::sendResult() {
     update_topkeys(key, &connection);
     state = State::Done;
 
-    if ((connection.getCmd() == PROTOCOL_BINARY_CMD_INCREMENT) ||
-        (connection.getCmd() == PROTOCOL_BINARY_CMD_INCREMENTQ)) {
+    if (isIncrement()) {
         STATS_INCR(&connection, incr_hits);
     } else {
         STATS_INCR(&connection, decr_hits);
@@ -216,17 +241,22 @@ ENGINE_ERROR_CODE ArithmeticCommandContext::sendResult() {
     }
 
     if (connection.isSupportsMutationExtras()) {
-        item_info newItemInfo;
-        if (!bucket_get_item_info(&connection, newitem.get(),
-                                  &newItemInfo)) {
-            return ENGINE_FAILED;
-        }
-
         // Response includes vbucket UUID and sequence number
         // (in addition to value)
         mutation_descr_t extras;
-        extras.vbucket_uuid = htonll(newItemInfo.vbucket_uuid);
-        extras.seqno = htonll(newItemInfo.seqno);
+        if (newitem) {
+            item_info newItemInfo;
+            if (!bucket_get_item_info(&connection, newitem.get(),
+                                      &newItemInfo)) {
+                return ENGINE_FAILED;
+            }
+            extras.vbucket_uuid = htonll(newItemInfo.vbucket_uuid);
+            extras.seqno = htonll(newItemInfo.seqno);
+        } else {
+            // The engine updated the counter itself
+            extras.vbucket_uuid = htonll(mutationDescr.vbucket_uuid);
+            extras.seqno = htonll(mutationDescr.seqno);
+        }
         result = ntohll(result);
 
         if (!mcbp_response_handler(nullptr, 0,
@@ -37,7 +37,12 @@ public:
      * We've got two different paths through the state diagram depending
      * if the counter exists or not:
      *
-     * If the document exists:
+     * If the engine can update the counter itself:
+     *
+     *    UpdateInEngine -> SendResult -> Done
+     *
+     * Otherwise (UpdateInEngine moves on to GetItem when the engine
+     * returns ENGINE_ENOTSUP), if the document exists:
      *
      *    GetItem -> AllocateNewItem -> StoreItem -> SendResult -> Done
      *
@@ -55,6 +60,7 @@ public:
      * forever we give up after a 10 times.
      */
     enum class State {
+        UpdateInEngine,
         GetItem,
         CreateNewItem,
         StoreNewItem,
@@ -76,7 +82,7 @@ public:
           olditem(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
           newitem(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
           vbucket(ntohs(req.message.header.request.vbucket)),
-          state(State::GetItem) {
+          state(State::UpdateInEngine) {
     }
 
     ~ArithmeticCommandContext() {
@@ -88,6 +94,9 @@ protected:
         ENGINE_ERROR_CODE ret;
         do {
             switch (state) {
+            case State::UpdateInEngine:
+                ret = updateInEngine();
+                break;
             case State::GetItem:
                 ret = getItem();
                 break;
@@ -117,6 +126,8 @@ protected:
         return ret;
     }
 
+    ENGINE_ERROR_CODE updateInEngine();
+
     ENGINE_ERROR_CODE getItem();
 
     ENGINE_ERROR_CODE createNewItem();
@@ -132,6 +143,9 @@ protected:
     ENGINE_ERROR_CODE reset();
 
 private:
+    /// Is this an increment (rather than a decrement)?
+    bool isIncrement() const;
+
 
     const DocKey key;
     const protocol_binary_request_incr& request;
@@ -141,6 +155,9 @@ private:
     cb::unique_item_ptr newitem;
     cb::compression::Buffer buffer;
     uint64_t result;
+    /// The vbucket uuid and seqno of the mutation when the engine
+    /// updated the counter itself (in UpdateInEngine)
+    mutation_descr_t mutationDescr{};
     const uint16_t vbucket;
     State state;
 };
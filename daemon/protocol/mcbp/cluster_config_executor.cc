@@ -40,22 +40,23 @@ void get_cluster_config_executor(McbpConnection* c, void*) {
         return;
     }
 
-    auto pair = c->getBucket().clusterConfiguration.getConfiguration();
-    if (pair.first == -1) {
+    auto config = c->getBucket().clusterConfiguration.getConfiguration();
+    if (config->revision == -1) {
         mcbp_write_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+    } else if (!c->reserveClusterConfiguration(config)) {
+        c->setState(conn_closing);
     } else {
-        mcbp_response_handler(nullptr,
-                              0,
-                              nullptr,
-                              0,
-                              pair.second->data(),
-                              uint32_t(pair.second->size()),
-                              PROTOCOL_BINARY_RAW_BYTES,
-                              PROTOCOL_BINARY_RESPONSE_SUCCESS,
-                              0,
-                              c->getCookie());
-        mcbp_write_and_free(c, &c->getDynamicBuffer());
-        c->setClustermapRevno(pair.first);
+        // Send the configuration straight from the (shared) snapshot
+        mcbp_add_header(c,
+                        PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                        0,
+                        0,
+                        uint32_t(config->config.size()),
+                        PROTOCOL_BINARY_RAW_BYTES);
+        c->addIov(config->config.data(), config->config.size());
+        c->setState(conn_send_data);
+        c->setWriteAndGo(conn_new_cmd);
+        c->setClustermapRevno(config->revision);
     }
 }
 
@@ -95,7 +96,7 @@ void set_cluster_config_executor(McbpConnection* c, void* packet) {
         mcbp_write_packet(c, cb::mcbp::Status::Success);
 
         const long revision =
-                bucket.clusterConfiguration.getConfiguration().first;
+                bucket.clusterConfiguration.getConfiguration()->revision;
 
         LOG_NOTICE(c,
                    "%u: %s Updated cluster configuration for bucket [%s]. New "
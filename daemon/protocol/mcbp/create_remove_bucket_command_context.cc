@@ -47,6 +47,10 @@ public:
         notify_io_complete(mcbpconnection.getCookie(), thread.getResult());
     }
 
+    TaskType getType() const override {
+        return TaskType::Admin;
+    }
+
     CreateBucketThread thread;
     McbpConnection& mcbpconnection;
 };
@@ -94,18 +98,28 @@ ENGINE_ERROR_CODE CreateRemoveBucketCommandContext::remove() {
     std::string name(reinterpret_cast<const char*>(k.data()), k.size());
     std::string config(reinterpret_cast<const char*>(v.data()), v.size());
     bool force = false;
+    // Reply as soon as the bucket is detached, and finish the deletion in
+    // the background
+    bool async = false;
 
-    std::vector<struct config_item> items(2);
+    std::vector<struct config_item> items(3);
     items[0].key = "force";
     items[0].datatype = DT_BOOL;
     items[0].value.dt_bool = &force;
-    items[1].key = NULL;
+    items[1].key = "async";
+    items[1].datatype = DT_BOOL;
+    items[1].value.dt_bool = &async;
+    items[2].key = NULL;
 
     if (parse_config(config.c_str(), items.data(), stderr) != 0) {
         return ENGINE_EINVAL;
     }
 
-    task = std::make_shared<McbpDestroyBucketTask>(name, force, &connection);
+    // The executor keeps the task (and hence the deletion thread) alive
+    // until the deletion completes, so dropping our reference to it when
+    // the command completes after an async deletion detached won't block
+    task = std::make_shared<McbpDestroyBucketTask>(
+            name, force, &connection, async);
     std::lock_guard<std::mutex> guard(task->getMutex());
     reinterpret_cast<McbpDestroyBucketTask*>(task.get())->start();
     executorPool->schedule(task, false);
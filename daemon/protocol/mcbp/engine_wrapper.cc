@@ -18,9 +18,22 @@
 #include <utilities/protocol2text.h>
 #include <daemon/mcaudit.h>
 
+/**
+ * Time the engine call in the current scope as part of the trace of the
+ * command (see cb::tracing::TraceCode::Engine)
+ */
+class EngineSpan : public cb::tracing::ScopedSpan {
+public:
+    explicit EngineSpan(McbpConnection& c)
+        : ScopedSpan(c.getCookieObject().getTracer(),
+                     cb::tracing::TraceCode::Engine) {
+    }
+};
+
 ENGINE_ERROR_CODE bucket_unknown_command(McbpConnection* c,
                                          protocol_binary_request_header* request,
                                          ADD_RESPONSE response) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->unknown_command(c->getBucketEngineAsV0(),
                                                      c->getCookie(),
                                                      request,
@@ -62,6 +75,7 @@ bool bucket_get_item_info(McbpConnection* c, const item* item_,
 cb::EngineErrorMetadataPair bucket_get_meta(McbpConnection* c,
                                             const DocKey& key,
                                             uint16_t vbucket) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->get_meta(
             c->getBucketEngineAsV0(), c->getCookie(), key, vbucket);
     if (ret.first == cb::engine_errc::disconnect) {
@@ -74,6 +88,34 @@ cb::EngineErrorMetadataPair bucket_get_meta(McbpConnection* c,
     return ret;
 }
 
+void bucket_get_meta_multi(McbpConnection* c,
+                           const std::vector<cb::MultiGetKey>& keys,
+                           std::vector<cb::EngineErrorMetadataPair>& results) {
+    EngineSpan span(*c);
+    auto* engine = c->getBucketEngine();
+    if (engine->get_meta_multi != nullptr) {
+        engine->get_meta_multi(
+                c->getBucketEngineAsV0(), c->getCookie(), keys, results);
+    } else {
+        for (size_t ii = 0; ii < keys.size(); ++ii) {
+            results[ii] = engine->get_meta(c->getBucketEngineAsV0(),
+                                           c->getCookie(),
+                                           keys[ii].key,
+                                           keys[ii].vbucket);
+        }
+    }
+
+    for (const auto& ret : results) {
+        if (ret.first == cb::engine_errc::disconnect) {
+            LOG_INFO(c,
+                     "%u: %s bucket_get_meta_multi return ENGINE_DISCONNECT",
+                     c->getId(),
+                     c->getDescription().c_str());
+            break;
+        }
+    }
+}
+
 bool bucket_set_item_info(McbpConnection* c, item* item_,
                           const item_info* item_info_) {
     auto ret = c->getBucketEngine()->set_item_info(
@@ -94,6 +136,7 @@ ENGINE_ERROR_CODE bucket_store(McbpConnection* c,
                                uint64_t* cas,
                                ENGINE_STORE_OPERATION operation,
                                DocumentState document_state) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->store(c->getBucketEngineAsV0(),
                                            c->getCookie(),
                                            item_,
@@ -120,6 +163,7 @@ cb::EngineErrorCasPair bucket_store_if(McbpConnection* c,
                                        ENGINE_STORE_OPERATION operation,
                                        cb::StoreIfPredicate predicate,
                                        DocumentState document_state) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->store_if(c->getBucketEngineAsV0(),
                                               c->getCookie(),
                                               item_,
@@ -147,6 +191,7 @@ ENGINE_ERROR_CODE bucket_remove(McbpConnection* c,
                                 uint64_t* cas,
                                 uint16_t vbucket,
                                 mutation_descr_t* mut_info) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->remove(c->getBucketEngineAsV0(),
                                             c->getCookie(),
                                             key,
@@ -168,6 +213,7 @@ cb::EngineErrorItemPair bucket_get(McbpConnection* c,
                              const DocKey& key,
                              uint16_t vbucket,
                              DocStateFilter documentStateFilter) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->get(c->getBucketEngineAsV0(),
                                          c->getCookie(),
                                          key,
@@ -182,11 +228,41 @@ cb::EngineErrorItemPair bucket_get(McbpConnection* c,
     return ret;
 }
 
+void bucket_get_multi(McbpConnection* c,
+                      const std::vector<cb::MultiGetKey>& keys,
+                      std::vector<cb::EngineErrorItemPair>& results) {
+    EngineSpan span(*c);
+    auto* engine = c->getBucketEngine();
+    if (engine->get_multi != nullptr) {
+        engine->get_multi(
+                c->getBucketEngineAsV0(), c->getCookie(), keys, results);
+    } else {
+        for (size_t ii = 0; ii < keys.size(); ++ii) {
+            results[ii] = engine->get(c->getBucketEngineAsV0(),
+                                      c->getCookie(),
+                                      keys[ii].key,
+                                      keys[ii].vbucket,
+                                      DocStateFilter::Alive);
+        }
+    }
+
+    for (const auto& ret : results) {
+        if (ret.first == cb::engine_errc::disconnect) {
+            LOG_INFO(c,
+                     "%u: %s bucket_get_multi return ENGINE_DISCONNECT",
+                     c->getId(),
+                     c->getDescription().c_str());
+            break;
+        }
+    }
+}
+
 cb::EngineErrorItemPair bucket_get_if(McbpConnection* c,
                                       const DocKey& key,
                                       uint16_t vbucket,
                                       std::function<bool(
                                           const item_info&)> filter) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->get_if(
             c->getBucketEngineAsV0(), c->getCookie(), key, vbucket, filter);
 
@@ -203,6 +279,7 @@ cb::EngineErrorItemPair bucket_get_and_touch(McbpConnection* c,
                                              const DocKey& key,
                                              uint16_t vbucket,
                                              uint32_t expiration) {
+    EngineSpan span(*c);
     auto ret = c->getBucketEngine()->get_and_touch(
         c->getBucketEngineAsV0(), c->getCookie(), key, vbucket, expiration);
 
@@ -219,6 +296,7 @@ cb::EngineErrorItemPair bucket_get_locked(McbpConnection& c,
                                     const DocKey& key,
                                     uint16_t vbucket,
                                     uint32_t lock_timeout) {
+    EngineSpan span(c);
     auto ret = c.getBucketEngine()->get_locked(c.getBucketEngineAsV0(),
                                                c.getCookie(),
                                                key,
@@ -240,6 +318,7 @@ ENGINE_ERROR_CODE bucket_unlock(McbpConnection& c,
                                 const DocKey& key,
                                 uint16_t vbucket,
                                 uint64_t cas) {
+    EngineSpan span(c);
     auto ret = c.getBucketEngine()->unlock(
             c.getBucketEngineAsV0(), c.getCookie(), key, vbucket, cas);
     if (ret == ENGINE_DISCONNECT) {
@@ -251,6 +330,90 @@ ENGINE_ERROR_CODE bucket_unlock(McbpConnection& c,
     return ret;
 }
 
+ENGINE_ERROR_CODE bucket_wait_for_persistence(McbpConnection& c,
+                                             uint16_t vbucket,
+                                             uint64_t seqno) {
+    auto* engine = c.getBucketEngine();
+    if (engine->wait_for_persistence == nullptr) {
+        return ENGINE_ENOTSUP;
+    }
+    EngineSpan span(c);
+    auto ret = engine->wait_for_persistence(
+            c.getBucketEngineAsV0(), c.getCookie(), vbucket, seqno);
+    if (ret == ENGINE_DISCONNECT) {
+        LOG_INFO(&c,
+                 "%u: %s bucket_wait_for_persistence return "
+                 "ENGINE_DISCONNECT",
+                 c.getId(),
+                 c.getDescription().c_str());
+    }
+    return ret;
+}
+
+ENGINE_ERROR_CODE bucket_arithmetic(McbpConnection& c,
+                                    const DocKey& key,
+                                    uint16_t vbucket,
+                                    bool increment,
+                                    uint64_t delta,
+                                    uint64_t cas,
+                                    uint64_t& result,
+                                    uint64_t& new_cas,
+                                    mutation_descr_t& mut_info) {
+    auto* engine = c.getBucketEngine();
+    if (engine->arithmetic == nullptr) {
+        return ENGINE_ENOTSUP;
+    }
+    EngineSpan span(c);
+    auto ret = engine->arithmetic(c.getBucketEngineAsV0(),
+                                  c.getCookie(),
+                                  key,
+                                  vbucket,
+                                  increment,
+                                  delta,
+                                  cas,
+                                  &result,
+                                  &new_cas,
+                                  &mut_info);
+    if (ret == ENGINE_DISCONNECT) {
+        LOG_INFO(&c,
+                 "%u: %s bucket_arithmetic return ENGINE_DISCONNECT",
+                 c.getId(),
+                 c.getDescription().c_str());
+    }
+    return ret;
+}
+
+ENGINE_ERROR_CODE bucket_append_prepend(McbpConnection& c,
+                                        const DocKey& key,
+                                        uint16_t vbucket,
+                                        bool append,
+                                        cb::const_char_buffer value,
+                                        uint64_t cas,
+                                        uint64_t& new_cas,
+                                        mutation_descr_t& mut_info) {
+    auto* engine = c.getBucketEngine();
+    if (engine->append_prepend == nullptr) {
+        return ENGINE_ENOTSUP;
+    }
+    EngineSpan span(c);
+    auto ret = engine->append_prepend(c.getBucketEngineAsV0(),
+                                      c.getCookie(),
+                                      key,
+                                      vbucket,
+                                      append,
+                                      value,
+                                      cas,
+                                      &new_cas,
+                                      &mut_info);
+    if (ret == ENGINE_DISCONNECT) {
+        LOG_INFO(&c,
+                 "%u: %s bucket_append_prepend return ENGINE_DISCONNECT",
+                 c.getId(),
+                 c.getDescription().c_str());
+    }
+    return ret;
+}
+
 void bucket_release_item(McbpConnection* c, item* it) {
     c->getBucketEngine()->release(c->getBucketEngineAsV0(),
                                   c->getCookie(), it);
@@ -264,6 +427,7 @@ std::pair<cb::unique_item_ptr, item_info> bucket_allocate_ex(McbpConnection& c,
                                                              const rel_time_t exptime,
                                                              uint8_t datatype,
                                                              uint16_t vbucket) {
+    EngineSpan span(c);
     // MB-25650 - We've got a document of 0 byte value and claims to contain
     //            xattrs.. that's not possible.
     if (nbytes == 0 && !mcbp::datatype::is_raw(datatype)) {
@@ -48,6 +48,18 @@ cb::EngineErrorMetadataPair bucket_get_meta(McbpConnection* c,
                                             const DocKey& key,
                                             uint16_t vbucket);
 
+/**
+ * Get the metadata of multiple documents in one call to the engine.
+ * Engines which don't implement get_meta_multi get one call to get_meta()
+ * per key.
+ *
+ * @param keys the keys (and their vbuckets) to look up
+ * @param results one entry per key (the caller must size the vector)
+ */
+void bucket_get_meta_multi(McbpConnection* c,
+                           const std::vector<cb::MultiGetKey>& keys,
+                           std::vector<cb::EngineErrorMetadataPair>& results);
+
 bool bucket_set_item_info(McbpConnection* c, item* item_,
                           const item_info* item_info_);
 
@@ -65,6 +77,29 @@ cb::EngineErrorCasPair bucket_store_if(
         cb::StoreIfPredicate predicate,
         DocumentState document_state = DocumentState::Alive);
 
+ENGINE_ERROR_CODE bucket_wait_for_persistence(McbpConnection& c,
+                                             uint16_t vbucket,
+                                             uint64_t seqno);
+
+ENGINE_ERROR_CODE bucket_arithmetic(McbpConnection& c,
+                                    const DocKey& key,
+                                    uint16_t vbucket,
+                                    bool increment,
+                                    uint64_t delta,
+                                    uint64_t cas,
+                                    uint64_t& result,
+                                    uint64_t& new_cas,
+                                    mutation_descr_t& mut_info);
+
+ENGINE_ERROR_CODE bucket_append_prepend(McbpConnection& c,
+                                        const DocKey& key,
+                                        uint16_t vbucket,
+                                        bool append,
+                                        cb::const_char_buffer value,
+                                        uint64_t cas,
+                                        uint64_t& new_cas,
+                                        mutation_descr_t& mut_info);
+
 ENGINE_ERROR_CODE bucket_remove(McbpConnection* c,
                                 const DocKey& key,
                                 uint64_t* cas,
@@ -77,6 +112,17 @@ cb::EngineErrorItemPair bucket_get(
         uint16_t vbucket,
         DocStateFilter documentStateFilter = DocStateFilter::Alive);
 
+/**
+ * Get multiple documents in one call to the engine. Engines which don't
+ * implement get_multi get one call to get() per key.
+ *
+ * @param keys the keys (and their vbuckets) to get
+ * @param results one entry per key (the caller must size the vector)
+ */
+void bucket_get_multi(McbpConnection* c,
+                      const std::vector<cb::MultiGetKey>& keys,
+                      std::vector<cb::EngineErrorItemPair>& results);
+
 cb::EngineErrorItemPair bucket_get_if(McbpConnection* c,
                                       const DocKey& key,
                                       uint16_t vbucket,
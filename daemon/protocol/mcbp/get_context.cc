@@ -36,13 +36,20 @@ ENGINE_ERROR_CODE GetCommandContext::getItem() {
         payload.len = info.value[0].iov_len;
 
         bool need_inflate = false;
+        bool need_compress = false;
         if (mcbp::datatype::is_snappy(info.datatype)) {
             need_inflate = mcbp::datatype::is_xattr(info.datatype) ||
                            !connection.isSnappyEnabled();
+        } else if (connection.isSnappyEnabled() &&
+                   !mcbp::datatype::is_xattr(info.datatype)) {
+            const auto min = settings.getSnappyResponseMinSize();
+            need_compress = min != 0 && payload.len >= min;
         }
 
         if (need_inflate) {
             state = State::InflateItem;
+        } else if (need_compress) {
+            state = State::CompressItem;
         } else {
             state = State::SendResponse;
         }
@@ -55,19 +62,64 @@ ENGINE_ERROR_CODE GetCommandContext::getItem() {
 }
 
 ENGINE_ERROR_CODE GetCommandContext::inflateItem() {
+    auto& cache = *connection.getThread()->inflated_value_cache;
+    const auto bucket = connection.getBucketIndex();
+
     try {
-        if (!cb::compression::inflate(cb::compression::Algorithm::Snappy,
-                                      payload.buf, payload.len, buffer)) {
-            LOG_WARNING(&connection, "%u: Failed to inflate item",
-                        connection.getId());
-            return ENGINE_FAILED;
+        inflated = cache.lookup(bucket, vbucket, key, info.cas);
+        if (!inflated) {
+            auto buffer = std::make_shared<cb::compression::Buffer>();
+            if (!cb::compression::inflate(cb::compression::Algorithm::Snappy,
+                                          payload.buf, payload.len, *buffer)) {
+                LOG_WARNING(&connection, "%u: Failed to inflate item",
+                            connection.getId());
+                return ENGINE_FAILED;
+            }
+            inflated = buffer;
+            cache.insert(bucket, vbucket, key, info.cas, inflated);
+        }
+        payload.buf = inflated->data.get();
+        payload.len = inflated->len;
+    } catch (const std::bad_alloc&) {
+        return ENGINE_ENOMEM;
+    }
+
+    state = State::SendResponse;
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE GetCommandContext::compressItem() {
+    auto& cache = *connection.getThread()->compressed_value_cache;
+    const auto bucket = connection.getBucketIndex();
+
+    try {
+        compressed = cache.lookup(bucket, vbucket, key, info.cas);
+        if (!compressed) {
+            auto buffer = std::make_shared<cb::compression::Buffer>();
+            if (!cb::compression::deflate(cb::compression::Algorithm::Snappy,
+                                          payload.buf, payload.len, *buffer)) {
+                // We can always send the value uncompressed
+                LOG_WARNING(&connection, "%u: Failed to compress item",
+                            connection.getId());
+                state = State::SendResponse;
+                return ENGINE_SUCCESS;
+            }
+            compressed = buffer;
+            // Insert it even if it didn't get smaller, so that we don't
+            // try to compress it again for the next read
+            cache.insert(bucket, vbucket, key, info.cas, compressed);
         }
-        payload.buf = buffer.data.get();
-        payload.len = buffer.len;
     } catch (const std::bad_alloc&) {
         return ENGINE_ENOMEM;
     }
 
+    if (compressed->len < payload.len) {
+        payload.buf = compressed->data.get();
+        payload.len = compressed->len;
+    } else {
+        compressed.reset();
+    }
+
     state = State::SendResponse;
     return ENGINE_SUCCESS;
 }
@@ -75,6 +127,10 @@ ENGINE_ERROR_CODE GetCommandContext::inflateItem() {
 ENGINE_ERROR_CODE GetCommandContext::sendResponse() {
     protocol_binary_datatype_t datatype = info.datatype;
 
+    if (compressed) {
+        datatype |= PROTOCOL_BINARY_DATATYPE_SNAPPY;
+    }
+
     if (mcbp::datatype::is_xattr(datatype)) {
         payload = cb::xattr::get_body(payload);
         datatype &= ~PROTOCOL_BINARY_DATATYPE_XATTR;
@@ -158,6 +214,9 @@ ENGINE_ERROR_CODE GetCommandContext::step() {
         case State::InflateItem:
             ret = inflateItem();
             break;
+        case State::CompressItem:
+            ret = compressItem();
+            break;
         case State::SendResponse:
             ret = sendResponse();
             break;
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <platform/compress.h>
+#include "../../inflated_value_cache.h"
 #include "../../memcached.h"
 #include "steppable_command_context.h"
 
@@ -33,6 +34,7 @@ public:
         GetItem,
         NoSuchItem,
         InflateItem,
+        CompressItem,
         SendResponse,
         Done
     };
@@ -79,6 +81,10 @@ protected:
      * would happen if the document is compressed and the client can't handle
      * that (or it contains xattrs which we need to strip off).
      *
+     * If the object isn't compressed but it is big enough to be worth
+     * compressing for a client which enabled Snappy, we'll move to the
+     * State::CompressItem.
+     *
      * If the object isn't compressed (or it doesn't contain any xattrs and
      * the client won't freak out if we send compressed data) we'll progress
      * into the State::SendResponse state.
@@ -102,7 +108,10 @@ protected:
     ENGINE_ERROR_CODE noSuchItem();
 
     /**
-     * Inflate the document before progressing to State::SendResponse
+     * Inflate the document before progressing to State::SendResponse.
+     * The inflated value is looked up in (and inserted into) the
+     * InflatedValueCache for the thread so that repeated reads of the
+     * same version of a document don't need to inflate it every time.
      *
      * @return ENGINE_FAILED if inflate failed
      *         ENGINE_ENOMEM if we're out of memory
@@ -110,6 +119,18 @@ protected:
      */
     ENGINE_ERROR_CODE inflateItem();
 
+    /**
+     * Send a Snappy compressed copy of the document before progressing to
+     * State::SendResponse. The compressed value is looked up in (and
+     * inserted into) the compressed value cache for the thread so that
+     * a hot document is only compressed once. If the value doesn't get
+     * smaller we'll send the uncompressed value.
+     *
+     * @return ENGINE_ENOMEM if we're out of memory
+     *         ENGINE_SUCCESS to go to the next state
+     */
+    ENGINE_ERROR_CODE compressItem();
+
     /**
      * Craft up the response message and send it to the client. Given that
      * the command context object lives until we start the next command
@@ -129,6 +150,7 @@ private:
     item_info info;
 
     cb::const_char_buffer payload;
-    cb::compression::Buffer buffer;
+    InflatedValueCache::Buffer inflated;
+    InflatedValueCache::Buffer compressed;
     State state;
 };
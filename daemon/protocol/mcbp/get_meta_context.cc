@@ -15,6 +15,7 @@
  *   limitations under the License.
  */
 #include "get_meta_context.h"
+#include "engine_errc_2_mcbp.h"
 #include "engine_wrapper.h"
 
 #include <daemon/debug_helpers.h>
@@ -22,6 +23,8 @@
 #include <daemon/mcbp.h>
 #include <xattr/utils.h>
 
+#include <algorithm>
+
 GetMetaCommandContext::GetMetaCommandContext(
         McbpConnection& c, protocol_binary_request_get_meta* req)
     : SteppableCommandContext(c),
@@ -128,3 +131,174 @@ ENGINE_ERROR_CODE GetMetaCommandContext::step() {
 
     return ret;
 }
+
+GetMetaMultiCommandContext::GetMetaMultiCommandContext(
+        McbpConnection& c, protocol_binary_request_get_meta_multi* req)
+    : SteppableCommandContext(c) {
+    // The validator verified that the body consists of complete keys
+    using mcbp::getmulti::KeyHeader;
+    const uint8_t* ptr = req->bytes + sizeof(req->bytes);
+    const uint8_t* end = ptr + ntohl(req->message.header.request.bodylen);
+    while (ptr < end) {
+        KeyHeader kh;
+        memcpy(&kh, ptr, sizeof(kh));
+        ptr += sizeof(kh);
+        const uint16_t klen = ntohs(kh.keylen);
+        entries.emplace_back(DocKey(ptr, klen, c.getDocNamespace()),
+                             ntohs(kh.vbucket));
+        ptr += klen;
+    }
+
+    pending.reserve(entries.size());
+    for (size_t ii = 0; ii < entries.size(); ++ii) {
+        pending.push_back(ii);
+    }
+}
+
+ENGINE_ERROR_CODE GetMetaMultiCommandContext::getItemMeta() {
+    auto& cookie = connection.getCookieObject();
+    if (cookie.getNotifications() < notificationsNeeded) {
+        // The engine hasn't notified us for all of the keys yet
+        return ENGINE_EWOULDBLOCK;
+    }
+
+    std::vector<cb::MultiGetKey> keys;
+    keys.reserve(pending.size());
+    for (auto index : pending) {
+        keys.push_back({entries[index].key, entries[index].vbucket});
+    }
+
+    // Read the counter before calling the engine as it may notify us
+    // before it returns
+    const auto notifications = cookie.getNotifications();
+    std::vector<cb::EngineErrorMetadataPair> results(keys.size());
+    bucket_get_meta_multi(&connection, keys, results);
+
+    std::vector<size_t> blocked;
+    for (size_t ii = 0; ii < results.size(); ++ii) {
+        auto& entry = entries[pending[ii]];
+        auto& ret = results[ii];
+
+        if (ret.first == cb::engine_errc::would_block) {
+            blocked.push_back(pending[ii]);
+            continue;
+        }
+        if (ret.first == cb::engine_errc::disconnect) {
+            return ENGINE_DISCONNECT;
+        }
+        entry.status = ret.first;
+        entry.info = ret.second;
+    }
+
+    pending.swap(blocked);
+    if (!pending.empty()) {
+        // The engine calls notify_io_complete once for every key it
+        // blocked on
+        notificationsNeeded = notifications + pending.size();
+        return ENGINE_EWOULDBLOCK;
+    }
+
+    state = State::SendResponse;
+    return ENGINE_SUCCESS;
+}
+
+void GetMetaMultiCommandContext::addResponse(uint16_t status,
+                                             const void* extras,
+                                             uint8_t extlen,
+                                             const DocKey& key,
+                                             uint64_t cas) {
+    auto* header = reinterpret_cast<protocol_binary_response_header*>(
+            response.data() + responseUsed);
+    const auto keylen = uint16_t(key.size());
+    header->response.magic = uint8_t(PROTOCOL_BINARY_RES);
+    header->response.opcode = PROTOCOL_BINARY_CMD_GET_META_MULTI;
+    header->response.keylen = htons(keylen);
+    header->response.extlen = extlen;
+    header->response.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    header->response.status = htons(status);
+    header->response.bodylen = htonl(uint32_t(extlen) + keylen);
+    header->response.opaque = connection.getOpaque();
+    header->response.cas = htonll(cas);
+    responseUsed += sizeof(header->bytes);
+
+    auto* ptr = response.data() + responseUsed;
+    if (extlen > 0) {
+        memcpy(ptr, extras, extlen);
+    }
+    std::copy(key.data(), key.data() + keylen, ptr + extlen);
+    responseUsed += extlen + keylen;
+
+    ++connection.getBucket().responseCounters[status];
+}
+
+ENGINE_ERROR_CODE GetMetaMultiCommandContext::sendResponse() {
+    size_t needed = sizeof(protocol_binary_response_header);
+    for (const auto& entry : entries) {
+        needed += sizeof(protocol_binary_response_header) + entry.key.size();
+        if (entry.status == cb::engine_errc::success) {
+            needed += sizeof(GetMetaResponse);
+        }
+    }
+    response.resize(needed);
+    responseUsed = 0;
+
+    for (const auto& entry : entries) {
+        if (entry.status == cb::engine_errc::success) {
+            const auto& info = entry.info;
+            GetMetaResponse meta(
+                    htonl(info.document_state == DocumentState::Deleted ? 1
+                                                                        : 0),
+                    info.flags,
+                    htonl(info.exptime),
+                    htonll(info.seqno),
+                    info.datatype);
+            addResponse(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                        &meta,
+                        sizeof(meta),
+                        entry.key,
+                        info.cas);
+            STATS_HIT(&connection, get);
+            update_topkeys(entry.key, &connection);
+        } else {
+            if (entry.status == cb::engine_errc::no_such_key) {
+                STATS_MISS(&connection, get);
+            }
+            const auto status = uint16_t(engine_error_2_mcbp_protocol_error(
+                    connection.remapErrorCode(
+                            ENGINE_ERROR_CODE(entry.status))));
+            addResponse(status, nullptr, 0, entry.key, 0);
+        }
+    }
+
+    // Terminate the sequence of responses
+    addResponse(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                nullptr,
+                0,
+                DocKey(nullptr, 0, DocNamespace::DefaultCollection),
+                0);
+
+    connection.addMsgHdr(true);
+    connection.addIov(response.data(), responseUsed);
+    connection.setState(conn_send_data);
+
+    state = State::Done;
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE GetMetaMultiCommandContext::step() {
+    ENGINE_ERROR_CODE ret;
+    do {
+        switch (state) {
+        case State::GetItemMeta:
+            ret = getItemMeta();
+            break;
+        case State::SendResponse:
+            ret = sendResponse();
+            break;
+        case State::Done:
+            return ENGINE_SUCCESS;
+        }
+    } while (ret == ENGINE_SUCCESS);
+
+    return ret;
+}
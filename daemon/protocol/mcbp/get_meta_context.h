@@ -19,6 +19,8 @@
 #include "../../memcached.h"
 #include "steppable_command_context.h"
 
+#include <vector>
+
 /**
  * The GetMetaCommandContext is a state machine used by the memcached
  * core to implement the Get_Meta operation
@@ -87,3 +89,76 @@ private:
     protocol_binary_request_get_meta* const request;
     bool fetchDatatype;
 };
+
+/**
+ * The GetMetaMultiCommandContext is a state machine used by the memcached
+ * core to implement the GET_META_MULTI operation. It works like the
+ * GetMultiCommandContext; all of the keys are passed to the engine in one
+ * call (see get_meta_multi in engine.h), and all of the responses are
+ * sent in one go.
+ */
+class GetMetaMultiCommandContext : public SteppableCommandContext {
+public:
+    enum class State : uint8_t { GetItemMeta, SendResponse, Done };
+
+    GetMetaMultiCommandContext(McbpConnection& c,
+                               protocol_binary_request_get_meta_multi* req);
+
+protected:
+    ENGINE_ERROR_CODE step() override;
+
+    /**
+     * Look up the metadata of the keys we don't have a result for. The
+     * engine may block for some of the keys, in which case we return
+     * ENGINE_EWOULDBLOCK and try those keys again once the engine
+     * notified us for all of them.
+     *
+     * @return ENGINE_EWOULDBLOCK if the underlying engine needs to block
+     *         ENGINE_SUCCESS to go to State::SendResponse
+     *         a standard engine error code if something goes wrong
+     */
+    ENGINE_ERROR_CODE getItemMeta();
+
+    /**
+     * Craft up a response for every key (and the terminating response)
+     * in a buffer owned by the context, and send it to the client.
+     *
+     * @return ENGINE_SUCCESS
+     */
+    ENGINE_ERROR_CODE sendResponse();
+
+    /**
+     * Add a response to the response buffer
+     */
+    void addResponse(uint16_t status,
+                     const void* extras,
+                     uint8_t extlen,
+                     const DocKey& key,
+                     uint64_t cas);
+
+private:
+    struct Entry {
+        Entry(const DocKey& k, uint16_t vb) : key(k), vbucket(vb) {
+        }
+
+        const DocKey key;
+        const uint16_t vbucket;
+
+        cb::engine_errc status = cb::engine_errc::would_block;
+        item_info info;
+    };
+
+    std::vector<Entry> entries;
+
+    /// The index of the entries we still need to look up
+    std::vector<size_t> pending;
+
+    /// The number of notifications the cookie must have received before
+    /// we can retry the pending entries
+    uint64_t notificationsNeeded = 0;
+
+    std::vector<uint8_t> response;
+    size_t responseUsed = 0;
+
+    State state = State::GetItemMeta;
+};
@@ -0,0 +1,261 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "engine_wrapper.h"
+#include "engine_errc_2_mcbp.h"
+#include "get_multi_context.h"
+
+#include <daemon/mcaudit.h>
+#include <daemon/mcbp.h>
+#include <xattr/utils.h>
+
+#include <algorithm>
+
+GetMultiCommandContext::GetMultiCommandContext(
+        McbpConnection& c, protocol_binary_request_get_multi* req)
+    : SteppableCommandContext(c) {
+    // The validator verified that the body consists of complete keys
+    using mcbp::getmulti::KeyHeader;
+    const uint8_t* ptr = req->bytes + sizeof(req->bytes);
+    const uint8_t* end = ptr + ntohl(req->message.header.request.bodylen);
+    while (ptr < end) {
+        KeyHeader kh;
+        memcpy(&kh, ptr, sizeof(kh));
+        ptr += sizeof(kh);
+        const uint16_t klen = ntohs(kh.keylen);
+        entries.emplace_back(
+                c, DocKey(ptr, klen, c.getDocNamespace()), ntohs(kh.vbucket));
+        ptr += klen;
+    }
+
+    pending.reserve(entries.size());
+    for (size_t ii = 0; ii < entries.size(); ++ii) {
+        pending.push_back(ii);
+    }
+}
+
+ENGINE_ERROR_CODE GetMultiCommandContext::getItems() {
+    auto& cookie = connection.getCookieObject();
+    if (cookie.getNotifications() < notificationsNeeded) {
+        // The engine hasn't notified us for all of the keys yet
+        return ENGINE_EWOULDBLOCK;
+    }
+
+    std::vector<cb::MultiGetKey> keys;
+    keys.reserve(pending.size());
+    for (auto index : pending) {
+        keys.push_back({entries[index].key, entries[index].vbucket});
+    }
+
+    // Read the counter before calling the engine as it may notify us
+    // before it returns
+    const auto notifications = cookie.getNotifications();
+    std::vector<cb::EngineErrorItemPair> results(keys.size());
+    bucket_get_multi(&connection, keys, results);
+
+    std::vector<size_t> blocked;
+    for (size_t ii = 0; ii < results.size(); ++ii) {
+        auto& entry = entries[pending[ii]];
+        auto& ret = results[ii];
+
+        switch (ret.first) {
+        case cb::engine_errc::would_block:
+            blocked.push_back(pending[ii]);
+            continue;
+        case cb::engine_errc::disconnect:
+            return ENGINE_DISCONNECT;
+        case cb::engine_errc::success:
+            entry.it = std::move(ret.second);
+            if (!bucket_get_item_info(&connection, entry.it.get(),
+                                      &entry.info)) {
+                LOG_WARNING(&connection, "%u: Failed to get item info",
+                            connection.getId());
+                return ENGINE_FAILED;
+            }
+            entry.payload.buf =
+                    static_cast<const char*>(entry.info.value[0].iov_base);
+            entry.payload.len = entry.info.value[0].iov_len;
+            break;
+        default:
+            break;
+        }
+        entry.status = ret.first;
+    }
+
+    pending.swap(blocked);
+    if (!pending.empty()) {
+        // The engine calls notify_io_complete once for every key it
+        // blocked on
+        notificationsNeeded = notifications + pending.size();
+        return ENGINE_EWOULDBLOCK;
+    }
+
+    state = State::InflateItems;
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE GetMultiCommandContext::inflateItems() {
+    auto& cache = *connection.getThread()->inflated_value_cache;
+    const auto bucket = connection.getBucketIndex();
+
+    for (auto& entry : entries) {
+        if (entry.status != cb::engine_errc::success ||
+            !mcbp::datatype::is_snappy(entry.info.datatype) ||
+            (!mcbp::datatype::is_xattr(entry.info.datatype) &&
+             connection.isSnappyEnabled())) {
+            continue;
+        }
+
+        try {
+            entry.inflated = cache.lookup(
+                    bucket, entry.vbucket, entry.key, entry.info.cas);
+            if (!entry.inflated) {
+                auto buffer = std::make_shared<cb::compression::Buffer>();
+                if (!cb::compression::inflate(
+                            cb::compression::Algorithm::Snappy,
+                            entry.payload.buf,
+                            entry.payload.len,
+                            *buffer)) {
+                    LOG_WARNING(&connection, "%u: Failed to inflate item",
+                                connection.getId());
+                    return ENGINE_FAILED;
+                }
+                entry.inflated = buffer;
+                cache.insert(bucket, entry.vbucket, entry.key,
+                             entry.info.cas, entry.inflated);
+            }
+            entry.payload.buf = entry.inflated->data.get();
+            entry.payload.len = entry.inflated->len;
+        } catch (const std::bad_alloc&) {
+            return ENGINE_ENOMEM;
+        }
+    }
+
+    state = State::SendResponse;
+    return ENGINE_SUCCESS;
+}
+
+void GetMultiCommandContext::addHeader(uint16_t status,
+                                       uint8_t extlen,
+                                       uint16_t keylen,
+                                       uint32_t bodylen,
+                                       protocol_binary_datatype_t datatype,
+                                       uint64_t cas) {
+    auto* header = reinterpret_cast<protocol_binary_response_header*>(
+            response.data() + responseUsed);
+    header->response.magic = uint8_t(PROTOCOL_BINARY_RES);
+    header->response.opcode = PROTOCOL_BINARY_CMD_GET_MULTI;
+    header->response.keylen = htons(keylen);
+    header->response.extlen = extlen;
+    header->response.datatype = datatype;
+    header->response.status = htons(status);
+    header->response.bodylen = htonl(bodylen);
+    header->response.opaque = connection.getOpaque();
+    header->response.cas = htonll(cas);
+    responseUsed += sizeof(header->bytes);
+
+    ++connection.getBucket().responseCounters[status];
+    connection.addIov(header, sizeof(header->bytes));
+}
+
+ENGINE_ERROR_CODE GetMultiCommandContext::sendResponse() {
+    // Size the buffer up front; the IO vector points into it
+    size_t needed = sizeof(protocol_binary_response_header);
+    for (const auto& entry : entries) {
+        if (entry.status == cb::engine_errc::success) {
+            needed += sizeof(protocol_binary_response_header);
+        } else if (entry.status != cb::engine_errc::no_such_key) {
+            needed += sizeof(protocol_binary_response_header) +
+                      entry.key.size();
+        }
+    }
+    response.resize(needed);
+    responseUsed = 0;
+
+    connection.addMsgHdr(true);
+    for (auto& entry : entries) {
+        if (entry.status == cb::engine_errc::success) {
+            protocol_binary_datatype_t datatype = entry.info.datatype;
+            if (entry.inflated) {
+                datatype &= ~PROTOCOL_BINARY_DATATYPE_SNAPPY;
+            }
+            if (mcbp::datatype::is_xattr(datatype)) {
+                entry.payload = cb::xattr::get_body(entry.payload);
+                datatype &= ~PROTOCOL_BINARY_DATATYPE_XATTR;
+            }
+            datatype = connection.getEnabledDatatypes(datatype);
+
+            const auto keylen = uint16_t(entry.info.nkey);
+            addHeader(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                      sizeof(entry.info.flags),
+                      keylen,
+                      sizeof(entry.info.flags) + keylen + entry.payload.len,
+                      datatype,
+                      entry.info.cas);
+            connection.addIov(&entry.info.flags, sizeof(entry.info.flags));
+            connection.addIov(entry.info.key, entry.info.nkey);
+            connection.addIov(entry.payload.buf, entry.payload.len);
+            cb::audit::document::add(connection,
+                                     cb::audit::document::Operation::Read);
+            STATS_HIT(&connection, get);
+            update_topkeys(entry.key, &connection);
+        } else if (entry.status == cb::engine_errc::no_such_key) {
+            STATS_MISS(&connection, get);
+            ++connection.getBucket()
+                      .responseCounters[PROTOCOL_BINARY_RESPONSE_KEY_ENOENT];
+        } else {
+            const auto status = uint16_t(
+                    engine_error_2_mcbp_protocol_error(
+                            connection.remapErrorCode(
+                                    ENGINE_ERROR_CODE(entry.status))));
+            const auto keylen = uint16_t(entry.key.size());
+            addHeader(status, 0, keylen, keylen, PROTOCOL_BINARY_RAW_BYTES, 0);
+            auto* key = response.data() + responseUsed;
+            std::copy(entry.key.data(), entry.key.data() + keylen, key);
+            responseUsed += keylen;
+            connection.addIov(key, keylen);
+        }
+    }
+
+    // Terminate the sequence of responses
+    addHeader(PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, 0, 0,
+              PROTOCOL_BINARY_RAW_BYTES, 0);
+    connection.setState(conn_send_data);
+
+    state = State::Done;
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE GetMultiCommandContext::step() {
+    ENGINE_ERROR_CODE ret;
+    do {
+        switch (state) {
+        case State::GetItems:
+            ret = getItems();
+            break;
+        case State::InflateItems:
+            ret = inflateItems();
+            break;
+        case State::SendResponse:
+            ret = sendResponse();
+            break;
+        case State::Done:
+            return ENGINE_SUCCESS;
+        }
+    } while (ret == ENGINE_SUCCESS);
+
+    return ret;
+}
@@ -0,0 +1,129 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/compress.h>
+#include "../../inflated_value_cache.h"
+#include "../../memcached.h"
+#include "steppable_command_context.h"
+
+#include <vector>
+
+/**
+ * The GetMultiCommandContext is a state machine used by the memcached
+ * core to implement the GET_MULTI operation. All of the keys in the
+ * request are passed to the engine in one call (see get_multi in
+ * engine.h) so that the engine may batch the lookups (and the disk
+ * fetches), and all of the responses are sent in one go.
+ */
+class GetMultiCommandContext : public SteppableCommandContext {
+public:
+    // The internal states. Look at the function headers below to
+    // for the functions with the same name to figure out what each
+    // state does
+    enum class State : uint8_t { GetItems, InflateItems, SendResponse, Done };
+
+    GetMultiCommandContext(McbpConnection& c,
+                           protocol_binary_request_get_multi* req);
+
+protected:
+    /**
+     * Keep running the state machine.
+     *
+     * @return A standard engine error code (if SUCCESS we've changed the
+     *         the connections state to one of the appropriate states (send
+     *         data, or start processing the next command)
+     */
+    ENGINE_ERROR_CODE step() override;
+
+    /**
+     * Look up the keys we don't have a result for in the underlying
+     * engine. The engine may block for some of the keys, in which case
+     * we return ENGINE_EWOULDBLOCK and try those keys again once the
+     * engine notified us for all of them (the connection may be run
+     * once for multiple notifications).
+     *
+     * @return ENGINE_EWOULDBLOCK if the underlying engine needs to block
+     *         ENGINE_SUCCESS to go to State::InflateItems
+     *         a standard engine error code if something goes wrong
+     */
+    ENGINE_ERROR_CODE getItems();
+
+    /**
+     * Inflate the documents we can't send compressed to the client
+     * (see GetCommandContext::inflateItem())
+     *
+     * @return ENGINE_FAILED if inflate failed
+     *         ENGINE_ENOMEM if we're out of memory
+     *         ENGINE_SUCCESS to go to the next state
+     */
+    ENGINE_ERROR_CODE inflateItems();
+
+    /**
+     * Craft up the response messages and send them to the client. The
+     * headers (and the keys for the failed lookups) are written to a
+     * buffer owned by the context, and the values are sent directly
+     * from the items (or the inflated buffers).
+     *
+     * @return ENGINE_SUCCESS
+     */
+    ENGINE_ERROR_CODE sendResponse();
+
+    /**
+     * Add a response header to the response buffer and the IO vector
+     */
+    void addHeader(uint16_t status,
+                   uint8_t extlen,
+                   uint16_t keylen,
+                   uint32_t bodylen,
+                   protocol_binary_datatype_t datatype,
+                   uint64_t cas);
+
+private:
+    struct Entry {
+        Entry(McbpConnection& c, const DocKey& k, uint16_t vb)
+            : key(k),
+              vbucket(vb),
+              it(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}) {
+        }
+
+        const DocKey key;
+        const uint16_t vbucket;
+
+        cb::engine_errc status = cb::engine_errc::would_block;
+        cb::unique_item_ptr it;
+        item_info info;
+
+        cb::const_char_buffer payload;
+        InflatedValueCache::Buffer inflated;
+    };
+
+    std::vector<Entry> entries;
+
+    /// The index of the entries we still need to look up
+    std::vector<size_t> pending;
+
+    /// The number of notifications the cookie must have received before
+    /// we can retry the pending entries
+    uint64_t notificationsNeeded = 0;
+
+    /// The response headers and the keys of the failed lookups
+    std::vector<uint8_t> response;
+    size_t responseUsed = 0;
+
+    State state = State::GetItems;
+};
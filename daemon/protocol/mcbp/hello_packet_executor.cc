@@ -45,6 +45,9 @@ void process_hello_packet_executor(McbpConnection* c, void* packet) {
     c->setCollectionsSupported(false);
     c->setDuplexSupported(false);
     c->setClustermapChangeNotificationSupported(false);
+    c->setAllowUnorderedExecution(false);
+    c->setTracingEnabled(false);
+    c->setDurabilitySupported(false);
 
     if (!key.empty()) {
         log_buffer.append("[");
@@ -139,10 +142,23 @@ void process_hello_packet_executor(McbpConnection* c, void* packet) {
             }
             break;
         case cb::mcbp::Feature::UnorderedExecution:
-            if (!c->allowUnorderedExecution()) {
+            if (!c->allowUnorderedExecution() && !c->isDCP()) {
                 c->setAllowUnorderedExecution(true);
                 added = true;
             }
+            break;
+        case cb::mcbp::Feature::Tracing:
+            if (!c->isTracingEnabled()) {
+                c->setTracingEnabled(true);
+                added = true;
+            }
+            break;
+        case cb::mcbp::Feature::Durability:
+            if (!c->isDurabilitySupported()) {
+                c->setDurabilitySupported(true);
+                added = true;
+            }
+            break;
         }
 
         if (added) {
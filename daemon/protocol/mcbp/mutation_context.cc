@@ -19,28 +19,46 @@
 #include "engine_wrapper.h"
 #include "mutation_context.h"
 
+#include <memcached/json_validator.h>
 #include <memcached/protocol_binary.h>
 #include <memcached/types.h>
 #include <xattr/utils.h>
 
+/// The durability level follows the flags and the expiry time (if present)
+static cb::mcbp::DurabilityLevel getDurabilityLevel(
+        const protocol_binary_request_set& req) {
+    if (req.message.header.request.extlen == sizeof(req.message.body)) {
+        return cb::mcbp::DurabilityLevel::None;
+    }
+    return cb::mcbp::DurabilityLevel(*(req.bytes + sizeof(req.bytes)));
+}
+
 MutationCommandContext::MutationCommandContext(McbpConnection& c,
                                                protocol_binary_request_set* req,
                                                const ENGINE_STORE_OPERATION op_)
     : SteppableCommandContext(c),
       operation(req->message.header.request.cas == 0 ? op_ : OPERATION_CAS),
-      key(req->bytes + sizeof(req->bytes),
+      key(req->message.header.bytes + sizeof(req->message.header.bytes) +
+                  req->message.header.request.extlen,
           ntohs(req->message.header.request.keylen),
           c.getDocNamespace()),
-      value(reinterpret_cast<const char*>(key.data() + key.size()),
-            ntohl(req->message.header.request.bodylen) - key.size() -
-                    req->message.header.request.extlen),
+      value(c.hasStreamedItem()
+                    ? c.getStreamedValue()
+                    : cb::const_char_buffer{
+                              reinterpret_cast<const char*>(key.data() +
+                                                            key.size()),
+                              ntohl(req->message.header.request.bodylen) -
+                                      key.size() -
+                                      req->message.header.request.extlen}),
       vbucket(ntohs(req->message.header.request.vbucket)),
       input_cas(ntohll(req->message.header.request.cas)),
       expiration(ntohl(req->message.body.expiration)),
       flags(req->message.body.flags),
+      durability(getDurabilityLevel(*req)),
       datatype(req->message.header.request.datatype),
       state(State::ValidateInput),
       newitem(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
+      streamed(c.getStreamedItem()),
       existing(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
       store_if_predicate(c.selectedBucketIsXattrEnabled() ? storeIfPredicate
                                                           : nullptr) {
@@ -62,6 +80,9 @@ ENGINE_ERROR_CODE MutationCommandContext::step() {
         case State::StoreItem:
             ret = storeItem();
             break;
+        case State::WaitForDurability:
+            ret = waitForDurability();
+            break;
         case State::SendResponse:
             ret = sendResponse();
             break;
@@ -103,10 +124,9 @@ ENGINE_ERROR_CODE MutationCommandContext::validateInput() {
     }
 
     if (!connection.isJsonEnabled()) {
-        auto* validator = connection.getThread()->validator;
         try {
             auto* ptr = reinterpret_cast<const uint8_t*>(value.buf);
-            if (validator->validate(ptr, value.len)) {
+            if (cb::json::isValidJson(ptr, value.len)) {
                 datatype = PROTOCOL_BINARY_DATATYPE_JSON;
             }
         } catch (const std::bad_alloc&) {
@@ -114,6 +134,15 @@ ENGINE_ERROR_CODE MutationCommandContext::validateInput() {
         }
     }
 
+    if (streamed != nullptr) {
+        // The item was allocated with the datatype from the client
+        item_info info;
+        info.datatype = datatype;
+        if (!bucket_set_item_info(&connection, streamed, &info)) {
+            return ENGINE_FAILED;
+        }
+    }
+
     state = State::AllocateNewItem;
     return ENGINE_SUCCESS;
 }
@@ -170,6 +199,13 @@ ENGINE_ERROR_CODE MutationCommandContext::getExistingItemToPreserveXattr() {
 }
 
 ENGINE_ERROR_CODE MutationCommandContext::allocateNewItem() {
+    if (streamed != nullptr && xattr_size == 0) {
+        // Store the item the value was read into as is
+        setItemCas(streamed);
+        state = State::StoreItem;
+        return ENGINE_SUCCESS;
+    }
+
     auto dtype = datatype;
     if (xattr_size > 0) {
         dtype |= PROTOCOL_BINARY_DATATYPE_XATTR;
@@ -195,15 +231,7 @@ ENGINE_ERROR_CODE MutationCommandContext::allocateNewItem() {
         return ENGINE_ERROR_CODE(e.code().value());
     }
 
-    if (operation == OPERATION_ADD || input_cas != 0) {
-        bucket_item_set_cas(&connection, newitem.get(), input_cas);
-    } else {
-        if (existing) {
-            bucket_item_set_cas(&connection, newitem.get(), existing_info.cas);
-        } else {
-            bucket_item_set_cas(&connection, newitem.get(), input_cas);
-        }
-    }
+    setItemCas(newitem.get());
 
     auto* root = reinterpret_cast<uint8_t*>(newitem_info.value[0].iov_base);
     if (xattr_size > 0) {
@@ -220,15 +248,33 @@ ENGINE_ERROR_CODE MutationCommandContext::allocateNewItem() {
     return ENGINE_SUCCESS;
 }
 
+void MutationCommandContext::setItemCas(item* it) {
+    if (operation == OPERATION_ADD || input_cas != 0) {
+        bucket_item_set_cas(&connection, it, input_cas);
+    } else {
+        if (existing) {
+            bucket_item_set_cas(&connection, it, existing_info.cas);
+        } else {
+            bucket_item_set_cas(&connection, it, input_cas);
+        }
+    }
+}
+
+item* MutationCommandContext::getNewItem() const {
+    return newitem ? newitem.get() : streamed;
+}
+
 ENGINE_ERROR_CODE MutationCommandContext::storeItem() {
     auto ret = bucket_store_if(&connection,
-                               newitem.get(),
+                               getNewItem(),
                                input_cas,
                                operation,
                                store_if_predicate);
     if (ret.status == cb::engine_errc::success) {
         connection.setCAS(ret.cas);
-        state = State::SendResponse;
+        state = durability == cb::mcbp::DurabilityLevel::None
+                        ? State::SendResponse
+                        : State::WaitForDurability;
     } else if (ret.status == cb::engine_errc::predicate_failed) {
         // predicate failed because xattrs are present
         state = State::GetExistingItemToPreserveXattr;
@@ -256,6 +302,17 @@ ENGINE_ERROR_CODE MutationCommandContext::storeItem() {
     return ENGINE_ERROR_CODE(ret.status);
 }
 
+ENGINE_ERROR_CODE MutationCommandContext::waitForDurability() {
+    item_info info;
+    if (!bucket_get_item_info(&connection, getNewItem(), &info)) {
+        return ENGINE_FAILED;
+    }
+
+    // The engine notifies us (with ENGINE_SUCCESS) once it is persisted
+    state = State::SendResponse;
+    return bucket_wait_for_persistence(connection, vbucket, info.seqno);
+}
+
 ENGINE_ERROR_CODE MutationCommandContext::sendResponse() {
     update_topkeys(key, &connection);
     state = State::Done;
@@ -269,7 +326,7 @@ ENGINE_ERROR_CODE MutationCommandContext::sendResponse() {
 
     if (connection.isSupportsMutationExtras()) {
         item_info newitem_info;
-        if (!bucket_get_item_info(&connection, newitem.get(), &newitem_info)) {
+        if (!bucket_get_item_info(&connection, getNewItem(), &newitem_info)) {
             return ENGINE_FAILED;
         }
 
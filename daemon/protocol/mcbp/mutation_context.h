@@ -40,6 +40,8 @@ public:
         AllocateNewItem,
         // Store the new document
         StoreItem,
+        // Wait for the document to meet the durability requirement
+        WaitForDurability,
         // Send the response back to the client
         SendResponse,
         // Release all data and start all over again (used by cas collision);-)
@@ -90,6 +92,16 @@ protected:
      */
     ENGINE_ERROR_CODE storeItem();
 
+    /**
+     * Hold back the response until the stored document is persisted (if
+     * the client asked for it). If the engine gives up waiting for it
+     * the client gets the error (typically ENGINE_TMPFAIL) even though
+     * the document is stored.
+     *
+     * @return ENGINE_SUCCESS if we want to proceed to the next state
+     */
+    ENGINE_ERROR_CODE waitForDurability();
+
     /**
      * Send the response back to the client (or progress to the next
      * phase for quiet ops).
@@ -105,6 +117,11 @@ protected:
      */
     ENGINE_ERROR_CODE reset();
 
+    /// Set the CAS the item should be stored with
+    void setItemCas(item* it);
+
+    /// Get the item to store (the streamed item unless we copied it)
+    item* getNewItem() const;
 
 private:
     const ENGINE_STORE_OPERATION operation;
@@ -114,6 +131,7 @@ private:
     const uint64_t input_cas;
     const rel_time_t expiration;
     const uint32_t flags;
+    const cb::mcbp::DurabilityLevel durability;
 
     // The datatype for the document to be created. We trust datatype aware
     // clients to correctly initialize this.
@@ -125,6 +143,10 @@ private:
     // The newly created document
     cb::unique_item_ptr newitem;
 
+    // The item the connection read the value into (owned by the
+    // connection, see McbpConnection::startStreamingValue), if any
+    item* const streamed;
+
     // Pointer to the current value stored in the engine
     cb::unique_item_ptr existing;
 
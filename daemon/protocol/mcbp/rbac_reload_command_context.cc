@@ -58,6 +58,10 @@ public:
         notify_io_complete(connection.getCookie(), status);
     }
 
+    TaskType getType() const override {
+        return TaskType::Admin;
+    }
+
 private:
     McbpConnection& connection;
     ENGINE_ERROR_CODE status;
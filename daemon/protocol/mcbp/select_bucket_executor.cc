@@ -24,6 +24,14 @@ ENGINE_ERROR_CODE select_bucket(McbpConnection& connection) {
     if (!connection.isAuthenticated()) {
         return ENGINE_EACCESS;
     }
+
+    if (connection.allowUnorderedExecution()) {
+        // Parked commands would be executed in the wrong bucket
+        connection.getCookieObject().setErrorContext(
+                "Can't change bucket with unordered execution enabled");
+        return ENGINE_ENOTSUP;
+    }
+
     const auto key = connection.getKey();
     // Unfortunately we need to copy it over to a std::string as the
     // internal methods expects the string to be terminated with '\0'
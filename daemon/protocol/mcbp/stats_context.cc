@@ -20,11 +20,15 @@
 #include "stats_context.h"
 #include "utilities.h"
 
+#include <daemon/buffer_pool.h>
+#include <daemon/io_vector_pool.h>
 #include <daemon/connections.h>
 #include <daemon/debug_helpers.h>
+#include <daemon/executorpool.h>
 #include <daemon/mc_time.h>
 #include <daemon/mcbp.h>
 #include <daemon/runtime.h>
+#include <daemon/ssl_session_cache.h>
 #include <memcached/audit_interface.h>
 #include <phosphor/stats_callback.h>
 #include <phosphor/trace_log.h>
@@ -32,7 +36,9 @@
 #include <platform/sized_buffer.h>
 #include <utilities/protocol2text.h>
 
+#include <algorithm>
 #include <numeric>
+#include <unordered_set>
 
 // Generic add_stat<T>. Uses std::to_string which requires heap allocation.
 template<typename T>
@@ -200,8 +206,28 @@ static ENGINE_ERROR_CODE server_stats(ADD_STAT add_stat_callback,
         add_stat(cookie, add_stat_callback, "listen_disabled_num",
                  get_listen_disabled_num());
         add_stat(cookie, add_stat_callback, "rejected_conns", stats.rejected_conns);
+        add_stat(cookie, add_stat_callback, "migrated_conns",
+                 stats.migrated_conns);
+
+        auto& sslSessions = SslSessionCache::getInstance();
+        add_stat(cookie, add_stat_callback, "ssl_session_cache_curr_items",
+                 sslSessions.getNumEntries());
+        add_stat(cookie, add_stat_callback, "ssl_session_cache_hits",
+                 sslSessions.getHits());
+        add_stat(cookie, add_stat_callback, "ssl_session_cache_misses",
+                 sslSessions.getMisses());
+        add_stat(cookie, add_stat_callback, "ssl_handshakes_full",
+                 sslSessions.getFullHandshakes());
+        add_stat(cookie, add_stat_callback, "ssl_handshakes_resumed",
+                 sslSessions.getResumedHandshakes());
+        add_stat(cookie, add_stat_callback, "ssl_handshake_full_usec",
+                 sslSessions.getFullHandshakeTime());
+        add_stat(cookie, add_stat_callback, "ssl_handshake_resumed_usec",
+                 sslSessions.getResumedHandshakeTime());
         add_stat(cookie, add_stat_callback, "threads", settings.getNumWorkerThreads());
         add_stat(cookie, add_stat_callback, "conn_yields", thread_stats.conn_yields);
+        add_stat(cookie, add_stat_callback, "conn_budget_yields",
+                 thread_stats.conn_budget_yields);
         add_stat(cookie, add_stat_callback, "rbufs_allocated",
                  thread_stats.rbufs_allocated);
         add_stat(cookie, add_stat_callback, "rbufs_loaned",
@@ -216,6 +242,43 @@ static ENGINE_ERROR_CODE server_stats(ADD_STAT add_stat_callback,
                  add_stat_callback,
                  "wbufs_existing",
                  thread_stats.wbufs_existing);
+
+        uint64_t bufpool_hits = 0;
+        uint64_t bufpool_misses = 0;
+        uint64_t bufpool_bytes = 0;
+        for (int ii = 0; ii < settings.getNumWorkerThreads(); ++ii) {
+            const auto& pool = *get_worker_thread(ii)->buffer_pool;
+            bufpool_hits += pool.getHits();
+            bufpool_misses += pool.getMisses();
+            bufpool_bytes += pool.getSize();
+        }
+        uint64_t iovpool_hits = 0;
+        uint64_t iovpool_misses = 0;
+        uint64_t iovpool_bytes = 0;
+        for (int ii = 0; ii < settings.getNumWorkerThreads(); ++ii) {
+            const auto& pool = *get_worker_thread(ii)->io_vector_pool;
+            iovpool_hits += pool.getHits();
+            iovpool_misses += pool.getMisses();
+            iovpool_bytes += pool.getSize();
+        }
+        size_t send_queue_bytes = 0;
+        for (int ii = 0; ii < settings.getNumWorkerThreads(); ++ii) {
+            send_queue_bytes += get_worker_thread(ii)->send_queue_size;
+        }
+        add_stat(cookie, add_stat_callback, "send_queue_bytes",
+                 send_queue_bytes);
+        add_stat(cookie, add_stat_callback, "send_queue_limit_hits",
+                 thread_stats.send_queue_limit_hits);
+        add_stat(cookie, add_stat_callback, "send_queue_unpinned_bytes",
+                 thread_stats.send_queue_unpinned_bytes);
+        add_stat(cookie, add_stat_callback, "bufpool_hits", bufpool_hits);
+        add_stat(cookie, add_stat_callback, "bufpool_misses", bufpool_misses);
+        add_stat(cookie, add_stat_callback, "bufpool_bytes_held",
+                 bufpool_bytes);
+        add_stat(cookie, add_stat_callback, "iovpool_hits", iovpool_hits);
+        add_stat(cookie, add_stat_callback, "iovpool_misses", iovpool_misses);
+        add_stat(cookie, add_stat_callback, "iovpool_bytes_held",
+                 iovpool_bytes);
         add_stat(cookie, add_stat_callback, "iovused_high_watermark",
                  thread_stats.iovused_high_watermark);
         add_stat(cookie, add_stat_callback, "msgused_high_watermark",
@@ -369,6 +432,22 @@ static void process_stat_settings(ADD_STAT add_stat_callback,
              settings.isDatatypeSnappyEnabled() ? "true" : "false");
     add_stat(cookie, add_stat_callback, "dedupe_nmvb_maps",
              settings.isDedupeNmvbMaps() ? "true" : "false");
+    add_stat(cookie, add_stat_callback, "reuseport_listeners",
+             settings.isReuseportListeners() ? "true" : "false");
+    add_stat(cookie, add_stat_callback, "numa_affinity",
+             settings.isNumaAffinity() ? "true" : "false");
+    add_stat(cookie, add_stat_callback, "topkeys_sample_rate",
+             std::to_string(settings.getTopkeysSampleRate()).c_str());
+    add_stat(cookie, add_stat_callback, "pipeline_batch_size",
+             std::to_string(settings.getPipelineBatchSize()).c_str());
+    add_stat(cookie, add_stat_callback, "event_time_budget",
+             std::to_string(settings.getEventTimeBudget().count()).c_str());
+    add_stat(cookie, add_stat_callback, "event_byte_budget",
+             std::to_string(settings.getEventByteBudget()).c_str());
+    add_stat(cookie, add_stat_callback, "max_send_queue_size",
+             std::to_string(settings.getMaxSendQueueSize()).c_str());
+    add_stat(cookie, add_stat_callback, "max_thread_send_queue_size",
+             std::to_string(settings.getMaxThreadSendQueueSize()).c_str());
     add_stat(cookie, add_stat_callback, "max_packet_size",
              std::to_string(settings.getMaxPacketSize()).c_str());
     add_stat(cookie, add_stat_callback, "xattr_enabled",
@@ -387,8 +466,7 @@ static void process_stat_settings(ADD_STAT add_stat_callback,
 
 static void append_bin_stats(const char* key, const uint16_t klen,
                              const char* val, const uint32_t vlen,
-                             McbpConnection* c) {
-    auto& dbuf = c->getDynamicBuffer();
+                             DynamicBuffer& dbuf, uint32_t opaque) {
     // We've ensured that there is enough room in the buffer before calling
     // this method
     char* buf = dbuf.getCurrent();
@@ -402,7 +480,7 @@ static void append_bin_stats(const char* key, const uint16_t klen,
     header.response.keylen = (uint16_t)htons(klen);
     header.response.datatype = (uint8_t)PROTOCOL_BINARY_RAW_BYTES;
     header.response.bodylen = htonl(bodylen);
-    header.response.opaque = c->getOpaque();
+    header.response.opaque = opaque;
 
     memcpy(buf, header.bytes, sizeof(header.response));
     buf += sizeof(header.response);
@@ -431,9 +509,150 @@ static void append_stats(const char* key, const uint16_t klen,
     if (!cookie->connection.growDynamicBuffer(needed)) {
         return;
     }
-    append_bin_stats(key, klen, val, vlen, &cookie->connection);
+    append_bin_stats(key, klen, val, vlen,
+                     cookie->connection.getDynamicBuffer(),
+                     cookie->connection.getOpaque());
+}
+
+static ENGINE_ERROR_CODE engine_get_stats(McbpConnection& conn,
+                                          const cb::const_char_buffer& k,
+                                          ADD_STAT add_stat_callback) {
+    if (k.empty()) {
+        // Some backeds rely on key being nullptr if klen = 0
+        return conn.getBucketEngine()->get_stats(conn.getBucketEngineAsV0(),
+                                                 conn.getCookie(),
+                                                 nullptr, 0,
+                                                 add_stat_callback);
+    } else {
+        return conn.getBucketEngine()->get_stats(conn.getBucketEngineAsV0(),
+                                                 conn.getCookie(),
+                                                 k.data(),
+                                                 int(k.size()),
+                                                 add_stat_callback);
+    }
 }
 
+/**
+ * The stat groups generated by a StatsTask rather than on the worker
+ * thread. These are the engine stat groups whose size grows with the
+ * number of vbuckets, checkpoints or DCP streams in the bucket.
+ */
+static bool isBackgroundStatGroup(const std::string& group) {
+    static const std::unordered_set<std::string> groups = {
+            "checkpoint",
+            "dcp",
+            "dcpagg",
+            "failovers",
+            "vbucket-details",
+            "vbucket-seqno"};
+    return groups.find(group) != groups.end();
+}
+
+/**
+ * A task used to generate a stat group on the executor pool. The engine
+ * calls the ADD_STAT callback (append_stats_to_task) with the cookie of
+ * the connection, and the stats are formatted into a list of chunks so
+ * that we don't need to copy the response around by growing a single
+ * buffer.
+ */
+class StatsTask : public Task {
+public:
+    /**
+     * @param collect if the stats should be collected (for a snapshot)
+     *                rather than formatted
+     */
+    StatsTask(McbpConnection& connection_, std::string key_, bool collect_)
+        : connection(connection_),
+          key(std::move(key_)),
+          opaque(connection_.getOpaque()),
+          collect(collect_),
+          status(ENGINE_SUCCESS) {
+        // Empty
+    }
+
+    Status execute() override {
+        try {
+            status = engine_get_stats(
+                    connection, {key.data(), key.size()}, append_stats_to_task);
+        } catch (const std::bad_alloc&) {
+            status = ENGINE_ENOMEM;
+        }
+        return Status::Finished;
+    }
+
+    void notifyExecutionComplete() override {
+        // If the engine blocked it notifies the cookie once it is ready
+        // for us to try again
+        if (status != ENGINE_EWOULDBLOCK) {
+            notify_io_complete(connection.getCookie(), ENGINE_SUCCESS);
+        }
+    }
+
+    /**
+     * Add a stat to the response (the same as append_stats, except that
+     * it writes to the chunks owned by the task)
+     */
+    void addStat(const char* k, const uint16_t klen,
+                 const char* val, const uint32_t vlen) {
+        if (collect) {
+            if (k != nullptr) {
+                collected.emplace_back(std::string{k, klen},
+                                       std::string{val, vlen});
+            }
+            return;
+        }
+        const size_t needed =
+                vlen + klen + sizeof(protocol_binary_response_header);
+        if (chunks.empty() ||
+            chunks.back()->getSize() - chunks.back()->getOffset() < needed) {
+            std::unique_ptr<DynamicBuffer> chunk(new DynamicBuffer);
+            if (!chunk->grow(std::max(ChunkSize, needed))) {
+                return;
+            }
+            chunks.push_back(std::move(chunk));
+        }
+        append_bin_stats(k, klen, val, vlen, *chunks.back(), opaque);
+    }
+
+    ENGINE_ERROR_CODE getStatus() const {
+        return status;
+    }
+
+    std::vector<std::unique_ptr<DynamicBuffer>>& getChunks() {
+        return chunks;
+    }
+
+    bool isCollecting() const {
+        return collect;
+    }
+
+    StatsSnapshot::List& getCollected() {
+        return collected;
+    }
+
+private:
+    static void append_stats_to_task(const char* k, const uint16_t klen,
+                                     const char* val, const uint32_t vlen,
+                                     const void* void_cookie) {
+        auto* cookie = reinterpret_cast<const Cookie*>(void_cookie);
+        auto* context = static_cast<StatsCommandContext*>(
+                cookie->connection.getCommandContext());
+        context->getTask()->addStat(k, klen, val, vlen);
+    }
+
+    /// The size of the chunks we format the stats into
+    static const size_t ChunkSize = 64 * 1024;
+
+    McbpConnection& connection;
+    const std::string key;
+    const uint32_t opaque;
+    const bool collect;
+    ENGINE_ERROR_CODE status;
+    std::vector<std::unique_ptr<DynamicBuffer>> chunks;
+    StatsSnapshot::List collected;
+};
+
+const size_t StatsTask::ChunkSize;
 
 /**
  * This is a very slow thing that you shouldn't use in production ;-)
@@ -813,6 +1032,52 @@ static ENGINE_ERROR_CODE stat_tracing_executor(const std::string& arg,
     }
 }
 
+/**
+ * Handler for the <code>stats executor</code> used to get how the
+ * executors ran the tasks of each type (the times are in microseconds).
+ *
+ * @param arg - should be empty
+ * @param connection the connection that requested the operation
+ */
+static ENGINE_ERROR_CODE stat_executor_executor(const std::string& arg,
+                                                McbpConnection& connection) {
+    if (!arg.empty()) {
+        return ENGINE_EINVAL;
+    }
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    const auto* cookie = connection.getCookie();
+    add_stat(cookie, append_stats, "runq_size",
+             uint64_t(executorPool->runqSize()));
+    add_stat(cookie, append_stats, "waitq_size",
+             uint64_t(executorPool->waitqSize()));
+    add_stat(cookie, append_stats, "futureq_size",
+             uint64_t(executorPool->futureqSize()));
+    for (size_t ii = 0; ii < size_t(TaskType::Count); ++ii) {
+        const auto type = TaskType(ii);
+        const auto prefix = to_string(type) + ":";
+        const auto typeStats = executorPool->getStats(type);
+        add_stat(cookie, append_stats, (prefix + "threads").c_str(),
+                 uint64_t(executorPool->getNumExecutors(type)));
+        add_stat(cookie, append_stats, (prefix + "runs").c_str(),
+                 typeStats.runs);
+        add_stat(cookie, append_stats, (prefix + "qtime").c_str(),
+                 uint64_t(duration_cast<microseconds>(typeStats.qtime)
+                                  .count()));
+        add_stat(cookie, append_stats, (prefix + "max_qtime").c_str(),
+                 uint64_t(duration_cast<microseconds>(typeStats.maxQtime)
+                                  .count()));
+        add_stat(cookie, append_stats, (prefix + "runtime").c_str(),
+                 uint64_t(duration_cast<microseconds>(typeStats.runtime)
+                                  .count()));
+        add_stat(cookie, append_stats, (prefix + "max_runtime").c_str(),
+                 uint64_t(duration_cast<microseconds>(typeStats.maxRuntime)
+                                  .count()));
+    }
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE StatsCommandContext::step() {
     struct stat_handler {
         /**
@@ -842,7 +1107,12 @@ ENGINE_ERROR_CODE StatsCommandContext::step() {
             {"topkeys_json", {false, stat_topkeys_json_executor}},
             {"subdoc_execute", {false, stat_subdoc_execute_executor}},
             {"responses", {false, stat_responses_json_executor}},
-            {"tracing", {true, stat_tracing_executor}}};
+            {"tracing", {true, stat_tracing_executor}},
+            {"executor", {true, stat_executor_executor}}};
+
+    if (task) {
+        return sendTaskResult();
+    }
 
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
 
@@ -870,7 +1140,26 @@ ENGINE_ERROR_CODE StatsCommandContext::step() {
         }
 
         auto iter = handlers.find(command);
-        if (iter == handlers.end()) {
+        if (command == "snapshot") {
+            // <generation> [<group>]
+            index = argument.find(' ');
+            const std::string group = (index == std::string::npos)
+                                              ? ""
+                                              : argument.substr(index + 1);
+            // The stat groups implemented here write the response
+            // directly, so only the engine stats may be collected
+            if (handlers.find(group.substr(0, group.find(' '))) !=
+                handlers.end()) {
+                ret = ENGINE_EINVAL;
+            } else {
+                ret = snapshot(argument.substr(0, index), group);
+            }
+        } else if (iter == handlers.end()) {
+            if (!foreground && isBackgroundStatGroup(command)) {
+                return scheduleTask({reinterpret_cast<const char*>(key.data()),
+                                     key.size()},
+                                    false);
+            }
             // This may be specific to the underlying engine
             ret = get_stats({reinterpret_cast<const char*>(key.data()),
                              key.size()});
@@ -913,20 +1202,168 @@ ENGINE_ERROR_CODE StatsCommandContext::step() {
     return ret;
 }
 
-ENGINE_ERROR_CODE StatsCommandContext::get_stats(const cb::const_char_buffer& k) {
-    // Use a shorter name to avoid line wrapping..
-    auto& conn = connection;
-    if (k.empty()) {
-        // Some backeds rely on key being nullptr if klen = 0
-        return conn.getBucketEngine()->get_stats(conn.getBucketEngineAsV0(),
-                                                 conn.getCookie(),
-                                                 nullptr, 0, append_stats);
-    } else {
-        return conn.getBucketEngine()->get_stats(conn.getBucketEngineAsV0(),
-                                                 conn.getCookie(),
-                                                 k.data(),
-                                                 int(k.size()),
-                                                 append_stats);
+ENGINE_ERROR_CODE StatsCommandContext::scheduleTask(std::string statKey,
+                                                    bool collect) {
+    task = std::make_shared<StatsTask>(connection, std::move(statKey), collect);
+    std::shared_ptr<Task> scheduled = task;
+    std::lock_guard<std::mutex> guard(task->getMutex());
+    executorPool->schedule(scheduled);
+    return ENGINE_EWOULDBLOCK;
+}
 
+ENGINE_ERROR_CODE StatsCommandContext::sendTaskResult() {
+    std::shared_ptr<StatsTask> result;
+    result.swap(task);
+
+    // The executor holds the mutex while it runs the task (the engine
+    // may notify us before the task returned)
+    std::lock_guard<std::mutex> guard(result->getMutex());
+    const auto ret = result->getStatus();
+    if (ret == ENGINE_EWOULDBLOCK) {
+        foreground = true;
+        return step();
+    }
+
+    if (ret != ENGINE_SUCCESS) {
+        if (ret != ENGINE_DISCONNECT) {
+            ++connection.getBucket()
+                      .responseCounters[engine_error_2_mcbp_protocol_error(
+                              ret)];
+        }
+        return ret;
+    }
+
+    if (result->isCollecting()) {
+        // Send the snapshot the usual way now that we have its stats
+        collected = std::make_unique<StatsSnapshot::List>(
+                std::move(result->getCollected()));
+        return step();
+    }
+
+    // Terminate the stats and hand the chunks over to the connection;
+    // they're released once they're sent
+    result->addStat(nullptr, 0, nullptr, 0);
+    if (result->getChunks().empty()) {
+        connection.setState(conn_closing);
+        return ENGINE_SUCCESS;
+    }
+
+    ++connection.getBucket()
+              .responseCounters[PROTOCOL_BINARY_RESPONSE_SUCCESS];
+    for (auto& chunk : result->getChunks()) {
+        if (!connection.pushTempAlloc(chunk->getRoot())) {
+            connection.setState(conn_closing);
+            return ENGINE_SUCCESS;
+        }
+        connection.addIov(chunk->getRoot(), chunk->getOffset());
+        chunk->takeOwnership();
     }
+    connection.setState(conn_send_data);
+    connection.setWriteAndGo(conn_new_cmd);
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE StatsCommandContext::snapshot(const std::string& gen,
+                                                const std::string& group) {
+    uint64_t generation;
+    if (!safe_strtoull(gen.c_str(), &generation)) {
+        return ENGINE_EINVAL;
+    }
+
+    if (!collected) {
+        if (!foreground &&
+            isBackgroundStatGroup(group.substr(0, group.find(' ')))) {
+            return scheduleTask(group, true);
+        }
+
+        collected = std::make_unique<StatsSnapshot::List>();
+        auto ret = engine_get_stats(
+                connection, {group.data(), group.size()},
+                append_stats_to_snapshot);
+        if (ret == ENGINE_SUCCESS && group.empty()) {
+            ret = server_stats(append_stats_to_snapshot, &connection);
+        }
+        if (ret != ENGINE_SUCCESS) {
+            // Start over if the engine blocked
+            collected.reset();
+            return ret;
+        }
+    }
+
+    return sendSnapshot(group, generation);
+}
+
+ENGINE_ERROR_CODE StatsCommandContext::sendSnapshot(const std::string& group,
+                                                    uint64_t generation) {
+    auto& previous = connection.getStatsSnapshots()[group];
+    const bool delta =
+            generation != 0 && generation == previous.generation;
+
+    unique_cJSON_ptr root(cJSON_CreateObject());
+    cJSON* stats = cJSON_CreateObject();
+    std::unordered_map<std::string, std::string> values;
+    values.reserve(collected->size());
+    for (auto& stat : *collected) {
+        if (!delta) {
+            cJSON_AddStringToObject(
+                    stats, stat.first.c_str(), stat.second.c_str());
+        } else {
+            auto iter = previous.values.find(stat.first);
+            if (iter == previous.values.end() || iter->second != stat.second) {
+                cJSON_AddStringToObject(
+                        stats, stat.first.c_str(), stat.second.c_str());
+            }
+        }
+        values[std::move(stat.first)] = std::move(stat.second);
+    }
+    collected.reset();
+
+    previous.generation++;
+    cJSON_AddNumberToObject(
+            root.get(), "generation", double(previous.generation));
+    cJSON_AddBoolToObject(root.get(), "delta", delta);
+    cJSON_AddItemToObject(root.get(), "stats", stats);
+    if (delta) {
+        cJSON* removed = cJSON_CreateArray();
+        for (const auto& stat : previous.values) {
+            if (values.find(stat.first) == values.end()) {
+                cJSON_AddItemToArray(removed,
+                                     cJSON_CreateString(stat.first.c_str()));
+            }
+        }
+        cJSON_AddItemToObject(root.get(), "removed", removed);
+    }
+    previous.values = std::move(values);
+
+    char* ptr = cJSON_PrintUnformatted(root.get());
+    if (ptr == nullptr) {
+        return ENGINE_ENOMEM;
+    }
+    static const std::string name = "snapshot";
+    append_stats(name.data(),
+                 uint16_t(name.size()),
+                 ptr,
+                 uint32_t(strlen(ptr)),
+                 connection.getCookie());
+    cJSON_Free(ptr);
+    return ENGINE_SUCCESS;
+}
+
+void StatsCommandContext::append_stats_to_snapshot(const char* k,
+                                                   const uint16_t klen,
+                                                   const char* val,
+                                                   const uint32_t vlen,
+                                                   const void* void_cookie) {
+    if (k == nullptr) {
+        return;
+    }
+    auto* cookie = reinterpret_cast<const Cookie*>(void_cookie);
+    auto* context = static_cast<StatsCommandContext*>(
+            cookie->connection.getCommandContext());
+    context->collected->emplace_back(std::string{k, klen},
+                                     std::string{val, vlen});
+}
+
+ENGINE_ERROR_CODE StatsCommandContext::get_stats(const cb::const_char_buffer& k) {
+    return engine_get_stats(connection, k, append_stats);
 }
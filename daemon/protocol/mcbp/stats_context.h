@@ -21,9 +21,49 @@
 
 #include "steppable_command_context.h"
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class StatsTask;
+
+/**
+ * The stats of a stat group last sent to a connection with
+ * "stats snapshot" (see StatsCommandContext::snapshot()), which the
+ * next snapshot of the group is compared with
+ */
+struct StatsSnapshot {
+    /// The stats as they are collected from the engine (key, value)
+    using List = std::vector<std::pair<std::string, std::string>>;
+
+    /// The generation last sent (0 if none)
+    uint64_t generation = 0;
+    std::unordered_map<std::string, std::string> values;
+};
+
 /**
  * The StatsCommandContext is responsible for implementing all of the
  * various stats commands (including the sub commands).
+ *
+ * The stat groups which may be expensive to generate for a large bucket
+ * (see isBackgroundStatGroup() in stats_context.cc) are generated by a
+ * StatsTask on the executor pool so that we don't stall the other
+ * connections bound to the worker thread. The task writes the response
+ * into a list of chunks which is handed over to the connection once the
+ * task completes.
+ *
+ * "stats snapshot <generation> [<group>]" returns the engine stat group
+ * (the default stats if no group is given) as a single JSON document
+ * instead of a response per stat:
+ *
+ *     {"generation": 7, "delta": true,
+ *      "stats": {"key": "value", ...}, "removed": ["key", ...]}
+ *
+ * If the generation is the one last returned for the group on this
+ * connection, only the stats which changed since then (and the keys of
+ * the ones no longer there) are returned, otherwise all of them are.
  */
 class StatsCommandContext : public SteppableCommandContext {
 public:
@@ -35,6 +75,13 @@ public:
               ntohs(req.message.header.request.keylen)} {
     }
 
+    /**
+     * Get the task generating the stats for this command (if any)
+     */
+    StatsTask* getTask() const {
+        return task.get();
+    }
+
 protected:
     /**
      * In most cases we won't be returning EWOULDBLOCK, and there isn't any
@@ -49,6 +96,46 @@ protected:
     ENGINE_ERROR_CODE step() override;
 
 private:
+    /**
+     * Schedule a StatsTask to generate the stat group in the background
+     *
+     * @return ENGINE_EWOULDBLOCK (the task notifies the cookie when done)
+     */
+    ENGINE_ERROR_CODE scheduleTask(std::string statKey, bool collect);
+
+    /**
+     * Implement "stats snapshot <generation> [<group>]" (see above)
+     *
+     * @param gen the generation the client has of the group
+     * @param group the engine stat group (empty for the default stats)
+     * @return the status from the engine
+     */
+    ENGINE_ERROR_CODE snapshot(const std::string& gen,
+                               const std::string& group);
+
+    /**
+     * Send the snapshot of the stats collected, and remember it for the
+     * next snapshot of the group
+     */
+    ENGINE_ERROR_CODE sendSnapshot(const std::string& group,
+                                   uint64_t generation);
+
+    /// The ADD_STAT callback collecting the stats of a snapshot
+    static void append_stats_to_snapshot(const char* k,
+                                         const uint16_t klen,
+                                         const char* val,
+                                         const uint32_t vlen,
+                                         const void* void_cookie);
+
+    /**
+     * Collect the result from the StatsTask and send it to the client,
+     * or fall back to generating the stats on the worker thread if the
+     * engine blocked.
+     *
+     * @return the status from the engine
+     */
+    ENGINE_ERROR_CODE sendTaskResult();
+
     /**
      * Helper method to call into the engine API with the appropriate
      * parameters.
@@ -62,4 +149,22 @@ private:
      * The key as specified in the input buffer (it may contain a sub command)
      */
     const cb::const_byte_buffer key;
+
+    /**
+     * The task generating the stats in the background
+     */
+    std::shared_ptr<StatsTask> task;
+
+    /**
+     * Set if the engine blocked in the background task, in which case the
+     * stats are generated on the worker thread once the engine notifies
+     * us (like any other engine call which blocks)
+     */
+    bool foreground = false;
+
+    /**
+     * The stats collected for "stats snapshot" (once they are complete if
+     * collected by the task)
+     */
+    std::unique_ptr<StatsSnapshot::List> collected;
 };
@@ -24,8 +24,12 @@ SteppableCommandContext::SteppableCommandContext(McbpConnection& c)
 }
 
 void SteppableCommandContext::drive() {
-    ENGINE_ERROR_CODE ret = connection.getAiostat();
-    connection.setAiostat(ENGINE_SUCCESS);
+    // Grab the status and leave EWOULDBLOCK in its place while we run
+    // the step. The engine may notify us from its own thread before we
+    // get around to block the connection (notify_io_complete doesn't
+    // hold the thread lock), and we must not overwrite the status it
+    // provided.
+    ENGINE_ERROR_CODE ret = connection.exchangeAiostat(ENGINE_EWOULDBLOCK);
     connection.setEwouldblock(false);
 
     if (ret == ENGINE_SUCCESS) {
@@ -48,11 +52,14 @@ void SteppableCommandContext::drive() {
 
     connection.logResponse(ret);
     ret = connection.remapErrorCode(ret);
+    if (ret != ENGINE_EWOULDBLOCK) {
+        connection.setAiostat(ENGINE_SUCCESS);
+    }
+
     switch (ret) {
     case ENGINE_SUCCESS:
         break;
     case ENGINE_EWOULDBLOCK:
-        connection.setAiostat(ENGINE_EWOULDBLOCK);
         connection.setEwouldblock(true);
         return;
     case ENGINE_DISCONNECT:
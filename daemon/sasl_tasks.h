@@ -42,6 +42,9 @@ public:
 
     virtual void notifyExecutionComplete() override;
 
+    TaskType getType() const override {
+        return TaskType::Auth;
+    }
 
     cbsasl_error_t getError() const {
         return error;
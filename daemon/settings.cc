@@ -21,6 +21,7 @@
 #include <platform/strerror.h>
 
 #include <algorithm>
+#include <cinttypes>
 #include <cstring>
 #include <fstream>
 #include <system_error>
@@ -50,6 +51,8 @@ Settings::Settings()
       default_reqs_per_event(00),
       max_packet_size(0),
       require_init(false),
+      reuseport_listeners(false),
+      numa_affinity(false),
       topkeys_size(0),
       maxconns(0) {
 
@@ -59,6 +62,15 @@ Settings::Settings()
     xattr_enabled.store(false);
     privilege_debug.store(false);
     collections_prototype.store(false);
+    topkeys_sample_rate.store(1);
+    pipeline_batch_size.store(0);
+    snappy_response_min_size.store(0);
+    event_time_budget.store(0);
+    event_byte_budget.store(0);
+    max_send_queue_size.store(0);
+    max_thread_send_queue_size.store(0);
+    ssl_session_cache_size.store(0);
+    ssl_session_lifetime.store(0);
 
     memset(&has, 0, sizeof(has));
     memset(&extensions, 0, sizeof(extensions));
@@ -217,6 +229,44 @@ static void handle_require_init(Settings& s, cJSON* obj) {
     }
 }
 
+/**
+ * Handle the "reuseport_listeners" tag in the settings
+ *
+ *  The value must be a boolean value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_reuseport_listeners(Settings& s, cJSON* obj) {
+    if (obj->type == cJSON_True) {
+        s.setReuseportListeners(true);
+    } else if (obj->type == cJSON_False) {
+        s.setReuseportListeners(false);
+    } else {
+        throw std::invalid_argument(
+            "\"reuseport_listeners\" must be a boolean value");
+    }
+}
+
+/**
+ * Handle the "numa_affinity" tag in the settings
+ *
+ *  The value must be a boolean value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_numa_affinity(Settings& s, cJSON* obj) {
+    if (obj->type == cJSON_True) {
+        s.setNumaAffinity(true);
+    } else if (obj->type == cJSON_False) {
+        s.setNumaAffinity(false);
+    } else {
+        throw std::invalid_argument(
+            "\"numa_affinity\" must be a boolean value");
+    }
+}
+
 /**
  * Handle the "topkeys_enabled" tag in the settings
  *
@@ -236,6 +286,22 @@ static void handle_topkeys_enabled(Settings& s, cJSON* obj) {
     }
 }
 
+/**
+ * Handle the "topkeys_sample_rate" tag in the settings
+ *
+ *  The value must be a positive integer value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_topkeys_sample_rate(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number || obj->valueint < 1) {
+        throw std::invalid_argument(
+                "\"topkeys_sample_rate\" must be a positive integer");
+    }
+    s.setTopkeysSampleRate(uint32_t(obj->valueint));
+}
+
 /**
  * Handle "default_reqs_per_event", "reqs_per_event_high_priority",
  * "reqs_per_event_med_priority" and "reqs_per_event_low_priority" tag in
@@ -623,6 +689,153 @@ static void handle_breakpad(Settings& s, cJSON* obj) {
     s.setBreakpadSettings(breakpad);
 }
 
+/**
+ * Handle the "pipeline_batch_size" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_pipeline_batch_size(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"pipeline_batch_size\" must be an integer");
+    }
+    s.setPipelineBatchSize(size_t(obj->valueint));
+}
+
+/**
+ * Handle the "connection_migration" tag in the settings
+ *
+ *  The value must be a boolean value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_connection_migration(Settings& s, cJSON* obj) {
+    if (obj->type == cJSON_True) {
+        s.setConnectionMigrationEnabled(true);
+    } else if (obj->type == cJSON_False) {
+        s.setConnectionMigrationEnabled(false);
+    } else {
+        throw std::invalid_argument(
+                "\"connection_migration\" must be a boolean value");
+    }
+}
+
+/**
+ * Handle the "snappy_response_min_size" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_snappy_response_min_size(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"snappy_response_min_size\" must be an integer");
+    }
+    s.setSnappyResponseMinSize(size_t(obj->valueint));
+}
+
+/**
+ * Handle the "event_time_budget" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_event_time_budget(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"event_time_budget\" must be an integer");
+    }
+    s.setEventTimeBudget(size_t(obj->valueint));
+}
+
+/**
+ * Handle the "event_byte_budget" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_event_byte_budget(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"event_byte_budget\" must be an integer");
+    }
+    s.setEventByteBudget(size_t(obj->valueint));
+}
+
+/**
+ * Handle the "max_send_queue_size" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_max_send_queue_size(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"max_send_queue_size\" must be an integer");
+    }
+    s.setMaxSendQueueSize(size_t(obj->valueint));
+}
+
+/**
+ * Handle the "max_thread_send_queue_size" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_max_thread_send_queue_size(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"max_thread_send_queue_size\" must be an integer");
+    }
+    s.setMaxThreadSendQueueSize(size_t(obj->valueint));
+}
+
+/**
+ * Handle the "ssl_session_cache_size" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_ssl_session_cache_size(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"ssl_session_cache_size\" must be an integer");
+    }
+    s.setSslSessionCacheSize(size_t(obj->valueint));
+}
+
+/**
+ * Handle the "ssl_session_lifetime" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_ssl_session_lifetime(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"ssl_session_lifetime\" must be an integer");
+    }
+    s.setSslSessionLifetime(size_t(obj->valueint));
+}
+
 void Settings::reconfigure(const unique_cJSON_ptr& json) {
     // Nuke the default interface added to the system in settings_init and
     // use the ones in the configuration file.. (this is a bit messy)
@@ -656,6 +869,8 @@ void Settings::reconfigure(const unique_cJSON_ptr& json) {
             {"interfaces", handle_interfaces},
             {"extensions", handle_extensions},
             {"require_init", handle_require_init},
+            {"reuseport_listeners", handle_reuseport_listeners},
+            {"numa_affinity", handle_numa_affinity},
             {"default_reqs_per_event", handle_reqs_event},
             {"reqs_per_event_high_priority", handle_reqs_event},
             {"reqs_per_event_med_priority", handle_reqs_event},
@@ -678,7 +893,17 @@ void Settings::reconfigure(const unique_cJSON_ptr& json) {
             {"client_cert_auth", handle_client_cert_auth},
             {"collections_prototype", handle_collections_prototype},
             {"opcode_attributes_override", handle_opcode_attributes_override},
-            {"topkeys_enabled", handle_topkeys_enabled}};
+            {"topkeys_enabled", handle_topkeys_enabled},
+            {"topkeys_sample_rate", handle_topkeys_sample_rate},
+            {"pipeline_batch_size", handle_pipeline_batch_size},
+            {"connection_migration", handle_connection_migration},
+            {"snappy_response_min_size", handle_snappy_response_min_size},
+            {"event_time_budget", handle_event_time_budget},
+            {"event_byte_budget", handle_event_byte_budget},
+            {"max_send_queue_size", handle_max_send_queue_size},
+            {"max_thread_send_queue_size", handle_max_thread_send_queue_size},
+            {"ssl_session_cache_size", handle_ssl_session_cache_size},
+            {"ssl_session_lifetime", handle_ssl_session_lifetime}};
 
     cJSON* obj = json->child;
     while (obj != nullptr) {
@@ -945,6 +1170,18 @@ void Settings::updateSettings(const Settings& other, bool apply) {
                 "require_init can't be changed dynamically");
         }
     }
+    if (other.has.reuseport_listeners) {
+        if (other.reuseport_listeners != reuseport_listeners) {
+            throw std::invalid_argument(
+                "reuseport_listeners can't be changed dynamically");
+        }
+    }
+    if (other.has.numa_affinity) {
+        if (other.numa_affinity != numa_affinity) {
+            throw std::invalid_argument(
+                "numa_affinity can't be changed dynamically");
+        }
+    }
     if (other.has.topkeys_size) {
         if (other.topkeys_size != topkeys_size) {
             throw std::invalid_argument(
@@ -1142,6 +1379,16 @@ void Settings::updateSettings(const Settings& other, bool apply) {
         }
     }
 
+    if (other.has.pipeline_batch_size) {
+        if (other.pipeline_batch_size != pipeline_batch_size) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change pipeline_batch_size from %" PRIu64 " to %" PRIu64,
+                  uint64_t(pipeline_batch_size.load()),
+                  uint64_t(other.pipeline_batch_size.load()));
+            setPipelineBatchSize(other.pipeline_batch_size.load());
+        }
+    }
+
     if (other.has.interfaces) {
         // validate that we haven't changed stuff in the entries
         auto total = interfaces.size();
@@ -1286,6 +1533,100 @@ void Settings::updateSettings(const Settings& other, bool apply) {
         }
         setTopkeysEnabled(other.isTopkeysEnabled());
     }
+
+    if (other.has.topkeys_sample_rate) {
+        if (other.topkeys_sample_rate != topkeys_sample_rate) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change topkeys_sample_rate from %" PRIu32 " to %" PRIu32,
+                  topkeys_sample_rate.load(),
+                  other.topkeys_sample_rate.load());
+        }
+        setTopkeysSampleRate(other.topkeys_sample_rate.load());
+    }
+
+    if (other.has.connection_migration) {
+        if (other.isConnectionMigrationEnabled() !=
+            isConnectionMigrationEnabled()) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "%s connection migration",
+                  other.isConnectionMigrationEnabled() ? "Enable"
+                                                       : "Disable");
+        }
+        setConnectionMigrationEnabled(other.isConnectionMigrationEnabled());
+    }
+
+    if (other.has.snappy_response_min_size) {
+        if (other.snappy_response_min_size != snappy_response_min_size) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change snappy_response_min_size from %" PRIu64
+                  " to %" PRIu64,
+                  uint64_t(snappy_response_min_size.load()),
+                  uint64_t(other.snappy_response_min_size.load()));
+            setSnappyResponseMinSize(other.snappy_response_min_size.load());
+        }
+    }
+
+    if (other.has.event_time_budget) {
+        if (other.event_time_budget != event_time_budget) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change event_time_budget from %" PRIu64 " to %" PRIu64,
+                  uint64_t(event_time_budget.load()),
+                  uint64_t(other.event_time_budget.load()));
+            setEventTimeBudget(other.event_time_budget.load());
+        }
+    }
+
+    if (other.has.event_byte_budget) {
+        if (other.event_byte_budget != event_byte_budget) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change event_byte_budget from %" PRIu64 " to %" PRIu64,
+                  uint64_t(event_byte_budget.load()),
+                  uint64_t(other.event_byte_budget.load()));
+            setEventByteBudget(other.event_byte_budget.load());
+        }
+    }
+
+    if (other.has.max_send_queue_size) {
+        if (other.max_send_queue_size != max_send_queue_size) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change max_send_queue_size from %" PRIu64 " to %" PRIu64,
+                  uint64_t(max_send_queue_size.load()),
+                  uint64_t(other.max_send_queue_size.load()));
+            setMaxSendQueueSize(other.max_send_queue_size.load());
+        }
+    }
+
+    if (other.has.max_thread_send_queue_size) {
+        if (other.max_thread_send_queue_size != max_thread_send_queue_size) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change max_thread_send_queue_size from %" PRIu64
+                  " to %" PRIu64,
+                  uint64_t(max_thread_send_queue_size.load()),
+                  uint64_t(other.max_thread_send_queue_size.load()));
+            setMaxThreadSendQueueSize(
+                    other.max_thread_send_queue_size.load());
+        }
+    }
+
+    if (other.has.ssl_session_cache_size) {
+        if (other.ssl_session_cache_size != ssl_session_cache_size) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change ssl_session_cache_size from %" PRIu64 " to %" PRIu64,
+                  uint64_t(ssl_session_cache_size.load()),
+                  uint64_t(other.ssl_session_cache_size.load()));
+            setSslSessionCacheSize(other.ssl_session_cache_size.load());
+        }
+    }
+
+    if (other.has.ssl_session_lifetime) {
+        if (other.ssl_session_lifetime != ssl_session_lifetime) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change ssl_session_lifetime from %" PRIu64 " to %" PRIu64,
+                  uint64_t(ssl_session_lifetime.load()),
+                  uint64_t(other.ssl_session_lifetime.load()));
+            setSslSessionLifetime(other.ssl_session_lifetime.load());
+        }
+    }
 }
 
 void Settings::logit(EXTENSION_LOG_LEVEL level, const char* fmt, ...) {
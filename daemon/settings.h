@@ -25,6 +25,7 @@
 #include <platform/dynamic.h>
 #include <relaxed_atomic.h>
 #include <atomic>
+#include <chrono>
 #include <cstdarg>
 #include <deque>
 #include <map>
@@ -676,6 +677,52 @@ public:
         notify_changed("require_init");
     }
 
+    /**
+     * Should each worker thread own a SO_REUSEPORT listening socket for
+     * every port (and accept clients directly) instead of having the
+     * dispatcher thread accept all clients and hand them over to the
+     * worker threads through the notification pipe?
+     *
+     * @return true if the worker threads should accept the clients
+     */
+    bool isReuseportListeners() const {
+        return reuseport_listeners;
+    }
+
+    /**
+     * Set if each worker thread should own its own SO_REUSEPORT listening
+     * sockets
+     *
+     * @param reuseport_listeners true if the worker threads should accept
+     *                            the clients
+     */
+    void setReuseportListeners(bool reuseport_listeners) {
+        Settings::reuseport_listeners = reuseport_listeners;
+        has.reuseport_listeners = true;
+        notify_changed("reuseport_listeners");
+    }
+
+    /**
+     * Should the worker threads be bound to the CPUs of a NUMA node
+     * (spread round robin over the nodes)?
+     *
+     * @return true if the worker threads should be bound to a node
+     */
+    bool isNumaAffinity() const {
+        return numa_affinity;
+    }
+
+    /**
+     * Set if the worker threads should be bound to a NUMA node
+     *
+     * @param numa_affinity true if the worker threads should be bound
+     */
+    void setNumaAffinity(bool numa_affinity) {
+        Settings::numa_affinity = numa_affinity;
+        has.numa_affinity = true;
+        notify_changed("numa_affinity");
+    }
+
     /**
      * Get the configured socket path for Saslauthd
      */
@@ -961,6 +1008,236 @@ public:
         notify_changed("topkeys_enabled");
     }
 
+    /**
+     * Get the topkeys sample rate. Only one in (on average) this many key
+     * accesses are recorded by topkeys (and each of them is counted as
+     * this many accesses). A value of 1 records every access.
+     *
+     * @return the sample rate
+     */
+    uint32_t getTopkeysSampleRate() const {
+        return topkeys_sample_rate;
+    }
+
+    /**
+     * Set the topkeys sample rate
+     *
+     * @param value the new value (must be at least 1)
+     */
+    void setTopkeysSampleRate(uint32_t value) {
+        Settings::topkeys_sample_rate = value;
+        has.topkeys_sample_rate = true;
+        notify_changed("topkeys_sample_rate");
+    }
+
+    /**
+     * Get the maximum number of bytes of responses for pipelined commands
+     * to batch up before sending them to the client. Batching the responses
+     * lets us send the responses for multiple commands with a single system
+     * call. A value of 0 disables batching.
+     *
+     * @return the maximum number of bytes to batch up
+     */
+    size_t getPipelineBatchSize() const {
+        return pipeline_batch_size;
+    }
+
+    /**
+     * Set the pipeline batch size
+     *
+     * @param value the new value
+     */
+    void setPipelineBatchSize(size_t value) {
+        Settings::pipeline_batch_size = value;
+        has.pipeline_batch_size = true;
+        notify_changed("pipeline_batch_size");
+    }
+
+    /**
+     * Are we allowed to move connections from a busy worker thread over
+     * to an idle worker thread (see ConnectionBalancer)?
+     */
+    bool isConnectionMigrationEnabled() const {
+        return connection_migration.load(std::memory_order_acquire);
+    }
+
+    void setConnectionMigrationEnabled(bool enabled) {
+        Settings::connection_migration.store(enabled,
+                                             std::memory_order_release);
+        has.connection_migration = true;
+        notify_changed("connection_migration");
+    }
+
+    /**
+     * Get the minimum size of an uncompressed document value we'll send
+     * Snappy compressed to clients which enabled Snappy. The compressed
+     * copy of the value is cached per worker thread, so a hot value is
+     * only compressed once. A value of 0 disables compression of
+     * responses.
+     *
+     * @return the minimum size (in bytes) of values to compress
+     */
+    size_t getSnappyResponseMinSize() const {
+        return snappy_response_min_size;
+    }
+
+    /**
+     * Set the minimum size of values to compress in responses
+     *
+     * @param value the new value
+     */
+    void setSnappyResponseMinSize(size_t value) {
+        Settings::snappy_response_min_size = value;
+        has.snappy_response_min_size = true;
+        notify_changed("snappy_response_min_size");
+    }
+
+    /**
+     * Get the CPU time (in microseconds) a connection may use before it
+     * yields the worker thread to the other connections. When set (or
+     * when the byte budget is set) the cost of the commands decides when
+     * the connection yields instead of the number of commands
+     * (reqs_per_event). A value of 0 disables the time budget.
+     *
+     * @return the time budget per event notification
+     */
+    std::chrono::microseconds getEventTimeBudget() const {
+        return std::chrono::microseconds(event_time_budget.load());
+    }
+
+    /**
+     * Set the time budget for a connection per event notification
+     *
+     * @param value the new value (in microseconds)
+     */
+    void setEventTimeBudget(size_t value) {
+        Settings::event_time_budget = value;
+        has.event_time_budget = true;
+        notify_changed("event_time_budget");
+    }
+
+    /**
+     * Get the number of bytes a connection may read and send before it
+     * yields the worker thread to the other connections (see
+     * getEventTimeBudget). A value of 0 disables the byte budget.
+     *
+     * @return the byte budget per event notification
+     */
+    size_t getEventByteBudget() const {
+        return event_byte_budget;
+    }
+
+    /**
+     * Set the byte budget for a connection per event notification
+     *
+     * @param value the new value
+     */
+    void setEventByteBudget(size_t value) {
+        Settings::event_byte_budget = value;
+        has.event_byte_budget = true;
+        notify_changed("event_byte_budget");
+    }
+
+    /**
+     * Should connections yield based on the cost of their commands rather
+     * than the number of commands?
+     */
+    bool isEventBudgetEnabled() const {
+        return event_time_budget != 0 || event_byte_budget != 0;
+    }
+
+    /**
+     * Get the maximum number of bytes of responses a connection may have
+     * waiting to be sent to the client. A connection over the limit stops
+     * reading (pipelined) commands ahead of the client, and if the client
+     * doesn't keep up it copies the data it can't send and releases the
+     * items it holds on to. A value of 0 disables the limit.
+     *
+     * @return the maximum number of bytes queued up per connection
+     */
+    size_t getMaxSendQueueSize() const {
+        return max_send_queue_size;
+    }
+
+    /**
+     * Set the maximum size of the send queue of a connection
+     *
+     * @param value the new value
+     */
+    void setMaxSendQueueSize(size_t value) {
+        Settings::max_send_queue_size = value;
+        has.max_send_queue_size = true;
+        notify_changed("max_send_queue_size");
+    }
+
+    /**
+     * Get the maximum number of bytes of responses all of the connections
+     * served by a worker thread may have waiting to be sent. When the
+     * thread is over the limit its connections behave as if they were
+     * over max_send_queue_size. A value of 0 disables the limit.
+     *
+     * @return the maximum number of bytes queued up per worker thread
+     */
+    size_t getMaxThreadSendQueueSize() const {
+        return max_thread_send_queue_size;
+    }
+
+    /**
+     * Set the maximum size of the send queues of a worker thread
+     *
+     * @param value the new value
+     */
+    void setMaxThreadSendQueueSize(size_t value) {
+        Settings::max_thread_send_queue_size = value;
+        has.max_thread_send_queue_size = true;
+        notify_changed("max_thread_send_queue_size");
+    }
+
+    /**
+     * Get the maximum number of TLS sessions kept in the (process wide)
+     * session cache for clients resuming their session by session id.
+     * A value of 0 disables the cache (clients may still resume their
+     * session with a session ticket).
+     *
+     * @return the maximum number of sessions in the cache
+     */
+    size_t getSslSessionCacheSize() const {
+        return ssl_session_cache_size;
+    }
+
+    /**
+     * Set the maximum number of sessions in the TLS session cache
+     *
+     * @param value the new value
+     */
+    void setSslSessionCacheSize(size_t value) {
+        Settings::ssl_session_cache_size = value;
+        has.ssl_session_cache_size = true;
+        notify_changed("ssl_session_cache_size");
+    }
+
+    /**
+     * Get the number of seconds a TLS session may be resumed for. It is
+     * also the interval the session ticket keys are rotated at. A value
+     * of 0 disables session resumption.
+     *
+     * @return the lifetime of a session in seconds
+     */
+    size_t getSslSessionLifetime() const {
+        return ssl_session_lifetime;
+    }
+
+    /**
+     * Set the lifetime of the TLS sessions
+     *
+     * @param value the new value (in seconds)
+     */
+    void setSslSessionLifetime(size_t value) {
+        Settings::ssl_session_lifetime = value;
+        has.ssl_session_lifetime = true;
+        notify_changed("ssl_session_lifetime");
+    }
+
 protected:
 
     /**
@@ -1051,6 +1328,16 @@ protected:
      */
     bool require_init;
 
+    /**
+     * Should the worker threads own SO_REUSEPORT listening sockets
+     */
+    bool reuseport_listeners;
+
+    /**
+     * Should the worker threads be bound to NUMA nodes
+     */
+    bool numa_affinity;
+
     /**
      * The SSL cipher list to use
      */
@@ -1122,6 +1409,54 @@ protected:
      */
     std::atomic_bool topkeys_enabled{false};
 
+    /**
+     * Record one in this many key accesses in topkeys
+     */
+    Couchbase::RelaxedAtomic<uint32_t> topkeys_sample_rate;
+
+    /**
+     * The maximum number of bytes of responses to pipelined commands to
+     * batch up before sending them to the client
+     */
+    Couchbase::RelaxedAtomic<size_t> pipeline_batch_size;
+
+    /**
+     * Should connections be moved between the worker threads to balance
+     * the load?
+     */
+    std::atomic_bool connection_migration{false};
+
+    /**
+     * The minimum size of uncompressed values to send Snappy compressed
+     * to clients supporting Snappy (0 = disabled)
+     */
+    Couchbase::RelaxedAtomic<size_t> snappy_response_min_size;
+
+    /**
+     * The CPU time (in usec) and the number of bytes read and sent a
+     * connection may use per event notification (0 = disabled)
+     */
+    Couchbase::RelaxedAtomic<size_t> event_time_budget;
+    Couchbase::RelaxedAtomic<size_t> event_byte_budget;
+
+    /**
+     * The maximum number of bytes waiting to be sent per connection, and
+     * per worker thread (0 = unlimited)
+     */
+    Couchbase::RelaxedAtomic<size_t> max_send_queue_size;
+    Couchbase::RelaxedAtomic<size_t> max_thread_send_queue_size;
+
+    /**
+     * The maximum number of sessions in the TLS session cache
+     */
+    Couchbase::RelaxedAtomic<size_t> ssl_session_cache_size;
+
+    /**
+     * The number of seconds a TLS session may be resumed for (0 =
+     * disabled)
+     */
+    Couchbase::RelaxedAtomic<size_t> ssl_session_lifetime;
+
 public:
     /**
      * Flags for each of the above config options, indicating if they were
@@ -1150,6 +1485,8 @@ public:
         bool breakpad;
         bool max_packet_size;
         bool require_init;
+        bool reuseport_listeners;
+        bool numa_affinity;
         bool ssl_cipher_list;
         bool ssl_minimum_protocol;
         bool client_cert_auth;
@@ -1162,6 +1499,16 @@ public:
         bool collections_prototype;
         bool opcode_attributes_override;
         bool topkeys_enabled;
+        bool topkeys_sample_rate;
+        bool pipeline_batch_size;
+        bool connection_migration;
+        bool snappy_response_min_size;
+        bool event_time_budget;
+        bool event_byte_budget;
+        bool max_send_queue_size;
+        bool max_thread_send_queue_size;
+        bool ssl_session_cache_size;
+        bool ssl_session_lifetime;
     } has;
 
 protected:
@@ -23,6 +23,7 @@
 #include <cJSON.h>
 #include <memcached/openssl.h>
 #include <platform/pipe.h>
+#include <platform/processclock.h>
 #include <cstdint>
 #include <vector>
 
@@ -145,11 +146,19 @@ public:
     bool havePendingInputData();
 
     std::pair<ClientCertUser::Status, std::string> getCertUserName();
+
+    /// The largest amount of data OpenSSL puts in a single TLS record
+    static const size_t MaxRecordSize = SSL3_RT_MAX_PLAIN_LENGTH;
+
     /**
      * Get a JSON description of this object.. caller must call cJSON_Delete()
      */
     cJSON* toJSON() const;
 
+    /// Get the number of bytes used by the buffers between the socket and
+    /// the SSL library
+    size_t getMemoryUsage() const;
+
 protected:
     bool drainInputSocketBuf();
 
@@ -172,4 +181,8 @@ protected:
     size_t totalRecv = 0;
     // Total number of bytes sent to the network
     size_t totalSend = 0;
+
+    // The time spent in SSL_accept so far (the handshake may need a
+    // number of calls)
+    ProcessClock::duration handshakeTime{0};
 };
@@ -18,6 +18,9 @@
 
 #include "memcached.h"
 #include "runtime.h"
+#include "ssl_session_cache.h"
+
+const size_t SslContext::MaxRecordSize;
 
 SslContext::~SslContext() {
     if (enabled) {
@@ -26,7 +29,14 @@ SslContext::~SslContext() {
 }
 
 int SslContext::accept() {
-    return SSL_accept(client);
+    const auto start = ProcessClock::now();
+    const int ret = SSL_accept(client);
+    handshakeTime += ProcessClock::now() - start;
+    if (ret == 1) {
+        SslSessionCache::getInstance().recordHandshake(
+                SSL_session_reused(client) != 0, handshakeTime);
+    }
+    return ret;
 }
 
 int SslContext::getError(int errormask) const {
@@ -65,6 +75,7 @@ bool SslContext::enable(const std::string& cert, const std::string& pkey) {
     }
 
     set_ssl_ctx_cipher_list(ctx);
+    SslSessionCache::getInstance().install(ctx);
     int ssl_flags = 0;
     switch (settings.getClientCertAuth()) {
     case ClientCertAuth::Mode::Mandatory:
@@ -104,6 +115,9 @@ bool SslContext::enable(const std::string& cert, const std::string& pkey) {
 
     client = SSL_new(ctx);
     SSL_set_bio(client, application, application);
+    // A write retried after SSL_ERROR_WANT_WRITE may come from the
+    // coalescing buffer or straight from the io vector
+    SSL_set_mode(client, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
     return true;
 }
@@ -276,3 +290,12 @@ cJSON* SslContext::toJSON() const {
 
     return obj;
 }
+
+size_t SslContext::getMemoryUsage() const {
+    if (!enabled) {
+        return 0;
+    }
+    // Both ends of the BIO pair have a buffer of the drain size
+    return inputPipe.capacity() + outputPipe.capacity() +
+           2 * settings.getBioDrainBufferSize();
+}
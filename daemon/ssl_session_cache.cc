@@ -0,0 +1,277 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include "ssl_session_cache.h"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include <cstring>
+
+SslSessionCache& SslSessionCache::getInstance() {
+    static SslSessionCache instance;
+    return instance;
+}
+
+void SslSessionCache::install(SSL_CTX* ctx) {
+    // Sessions may only be resumed in the context they were created in
+    // (and OpenSSL refuses to resume a session with a verified client
+    // certificate without one)
+    static const unsigned char sidContext[] = "memcached";
+    SSL_CTX_set_session_id_context(ctx, sidContext, sizeof(sidContext) - 1);
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (lifetime.count() == 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        return;
+    }
+
+    SSL_CTX_set_timeout(ctx, long(lifetime.count()));
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketKeyCallback);
+
+    if (maxSize == 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    } else {
+        // The internal cache belongs to the SSL_CTX of this connection,
+        // which is gone by the time the client reconnects
+        SSL_CTX_set_session_cache_mode(
+                ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(ctx, newSessionCallback);
+        SSL_CTX_sess_set_get_cb(ctx, getSessionCallback);
+        SSL_CTX_sess_set_remove_cb(ctx, removeSessionCallback);
+    }
+}
+
+void SslSessionCache::setMaxSize(size_t value) {
+    std::lock_guard<std::mutex> guard(mutex);
+    maxSize = value;
+    evict_UNLOCKED();
+}
+
+void SslSessionCache::setLifetime(std::chrono::seconds value) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (lifetime.count() == 0 && value.count() != 0) {
+        // Make sure that we start off with a fresh pair of keys
+        rotate_UNLOCKED();
+        rotate_UNLOCKED();
+    }
+    lifetime = value;
+}
+
+void SslSessionCache::recordHandshake(bool resumed,
+                                      ProcessClock::duration duration) {
+    const auto usec =
+            std::chrono::duration_cast<std::chrono::microseconds>(duration)
+                    .count();
+    if (resumed) {
+        resumedHandshakes++;
+        resumedHandshakeTime.fetch_add(uint64_t(usec));
+    } else {
+        fullHandshakes++;
+        fullHandshakeTime.fetch_add(uint64_t(usec));
+    }
+}
+
+size_t SslSessionCache::getNumEntries() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return lru.size();
+}
+
+int SslSessionCache::newSessionCallback(SSL*, SSL_SESSION* session) {
+    getInstance().insert(session);
+    // We keep a serialized copy, not the reference
+    return 0;
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+SSL_SESSION* SslSessionCache::getSessionCallback(SSL*,
+                                                 unsigned char* id,
+                                                 int length,
+                                                 int* copy) {
+#else
+SSL_SESSION* SslSessionCache::getSessionCallback(SSL*,
+                                                 const unsigned char* id,
+                                                 int length,
+                                                 int* copy) {
+#endif
+    // The session returned is a new object, so OpenSSL should take over
+    // our reference instead of adding one
+    *copy = 0;
+    return getInstance().lookup(id, length);
+}
+
+void SslSessionCache::removeSessionCallback(SSL_CTX*, SSL_SESSION* session) {
+    getInstance().remove(session);
+}
+
+int SslSessionCache::ticketKeyCallback(SSL*,
+                                       unsigned char* name,
+                                       unsigned char* iv,
+                                       EVP_CIPHER_CTX* ectx,
+                                       HMAC_CTX* hctx,
+                                       int enc) {
+    return getInstance().ticketKey(name, iv, ectx, hctx, enc);
+}
+
+void SslSessionCache::insert(SSL_SESSION* session) {
+    const int length = i2d_SSL_SESSION(session, nullptr);
+    if (length <= 0) {
+        return;
+    }
+
+    unsigned int idLength;
+    const unsigned char* id = SSL_SESSION_get_id(session, &idLength);
+    Entry entry;
+    entry.id.assign(reinterpret_cast<const char*>(id), idLength);
+    entry.session.resize(length);
+    unsigned char* ptr = entry.session.data();
+    i2d_SSL_SESSION(session, &ptr);
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (maxSize == 0) {
+        return;
+    }
+    entry.expiry = ProcessClock::now() + lifetime;
+
+    auto iter = index.find(entry.id);
+    if (iter != index.end()) {
+        lru.erase(iter->second);
+        index.erase(iter);
+    }
+    lru.push_front(std::move(entry));
+    index[lru.front().id] = lru.begin();
+    evict_UNLOCKED();
+}
+
+SSL_SESSION* SslSessionCache::lookup(const unsigned char* id, int length) {
+    std::vector<uint8_t> serialized;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto iter = index.find(
+                std::string(reinterpret_cast<const char*>(id), length));
+        if (iter == index.end()) {
+            misses++;
+            return nullptr;
+        }
+        if (iter->second->expiry < ProcessClock::now()) {
+            lru.erase(iter->second);
+            index.erase(iter);
+            misses++;
+            return nullptr;
+        }
+        lru.splice(lru.begin(), lru, iter->second);
+        serialized = lru.front().session;
+    }
+
+    const unsigned char* ptr = serialized.data();
+    auto* session = d2i_SSL_SESSION(nullptr, &ptr, long(serialized.size()));
+    if (session == nullptr) {
+        misses++;
+    } else {
+        hits++;
+    }
+    return session;
+}
+
+void SslSessionCache::remove(SSL_SESSION* session) {
+    unsigned int idLength;
+    const unsigned char* id = SSL_SESSION_get_id(session, &idLength);
+
+    std::lock_guard<std::mutex> guard(mutex);
+    auto iter = index.find(
+            std::string(reinterpret_cast<const char*>(id), idLength));
+    if (iter != index.end()) {
+        lru.erase(iter->second);
+        index.erase(iter);
+    }
+}
+
+int SslSessionCache::ticketKey(unsigned char* name,
+                               unsigned char* iv,
+                               EVP_CIPHER_CTX* ectx,
+                               HMAC_CTX* hctx,
+                               int enc) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (lifetime.count() != 0 && ProcessClock::now() - rotated >= lifetime) {
+        rotate_UNLOCKED();
+    }
+
+    if (enc) {
+        const auto ivLength = EVP_CIPHER_iv_length(EVP_aes_256_cbc());
+        if (RAND_bytes(iv, ivLength) != 1) {
+            return -1;
+        }
+        memcpy(name, currentKey.name.data(), currentKey.name.size());
+        EVP_EncryptInit_ex(ectx,
+                           EVP_aes_256_cbc(),
+                           nullptr,
+                           currentKey.aesKey.data(),
+                           iv);
+        HMAC_Init_ex(hctx,
+                     currentKey.hmacKey.data(),
+                     int(currentKey.hmacKey.size()),
+                     EVP_sha256(),
+                     nullptr);
+        return 1;
+    }
+
+    const TicketKey* key;
+    int ret;
+    if (memcmp(name, currentKey.name.data(), currentKey.name.size()) == 0) {
+        key = &currentKey;
+        ret = 1;
+    } else if (memcmp(name, previousKey.name.data(),
+                      previousKey.name.size()) == 0) {
+        // Still valid, but ask OpenSSL to hand out a new ticket
+        key = &previousKey;
+        ret = 2;
+    } else {
+        // An unknown (or too old) key, fall back to a full handshake
+        return 0;
+    }
+
+    HMAC_Init_ex(hctx,
+                 key->hmacKey.data(),
+                 int(key->hmacKey.size()),
+                 EVP_sha256(),
+                 nullptr);
+    EVP_DecryptInit_ex(
+            ectx, EVP_aes_256_cbc(), nullptr, key->aesKey.data(), iv);
+    return ret;
+}
+
+void SslSessionCache::evict_UNLOCKED() {
+    while (lru.size() > maxSize) {
+        index.erase(lru.back().id);
+        lru.pop_back();
+    }
+}
+
+void SslSessionCache::rotate_UNLOCKED() {
+    TicketKey key;
+    if (RAND_bytes(key.name.data(), int(key.name.size())) != 1 ||
+        RAND_bytes(key.aesKey.data(), int(key.aesKey.size())) != 1 ||
+        RAND_bytes(key.hmacKey.data(), int(key.hmacKey.size())) != 1) {
+        // Keep on using the current key, and try again next time
+        return;
+    }
+    previousKey = currentKey;
+    currentKey = key;
+    rotated = ProcessClock::now();
+}
@@ -0,0 +1,173 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/openssl.h>
+#include <platform/processclock.h>
+#include <relaxed_atomic.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The SslSessionCache lets TLS clients resume their session when they
+ * reconnect, instead of paying for a full handshake (and the RSA / ECDHE
+ * operations on the worker thread) every time.
+ *
+ * Every connection has its own SSL_CTX (see SslContext::enable), so the
+ * session cache built into OpenSSL (which lives in the SSL_CTX) would be
+ * thrown away with the connection. Instead the SSL_CTX of every
+ * connection is set up to use this process wide object for:
+ *
+ *   * Session ids: a bounded LRU cache of the (serialized) sessions,
+ *     shared by all the worker threads.
+ *   * Session tickets: the keys used to encrypt the tickets handed to
+ *     the clients. A new key is generated every session lifetime, and
+ *     tickets encrypted with the previous key are still accepted (and
+ *     replaced with a new ticket) for one more lifetime.
+ *
+ * Both are configured through the "ssl_session_cache_size" and
+ * "ssl_session_lifetime" settings, and may be changed at runtime.
+ */
+class SslSessionCache {
+public:
+    static SslSessionCache& getInstance();
+
+    /**
+     * Set up the SSL_CTX to use the shared session cache and ticket keys
+     */
+    void install(SSL_CTX* ctx);
+
+    /**
+     * Set the maximum number of sessions to keep in the cache (0 disables
+     * the cache). Sessions are evicted if the cache is too big.
+     */
+    void setMaxSize(size_t value);
+
+    /**
+     * Set the lifetime of the sessions, which is also the interval the
+     * ticket key is rotated at. 0 disables session resumption.
+     */
+    void setLifetime(std::chrono::seconds value);
+
+    /**
+     * Record a completed handshake
+     *
+     * @param resumed true if the session was resumed
+     * @param duration the time spent in SSL_accept for it
+     */
+    void recordHandshake(bool resumed, ProcessClock::duration duration);
+
+    size_t getNumEntries();
+
+    uint64_t getHits() const {
+        return hits;
+    }
+
+    uint64_t getMisses() const {
+        return misses;
+    }
+
+    uint64_t getFullHandshakes() const {
+        return fullHandshakes;
+    }
+
+    uint64_t getResumedHandshakes() const {
+        return resumedHandshakes;
+    }
+
+    /// The total time spent on full handshakes (in microseconds)
+    uint64_t getFullHandshakeTime() const {
+        return fullHandshakeTime;
+    }
+
+    /// The total time spent on resumed handshakes (in microseconds)
+    uint64_t getResumedHandshakeTime() const {
+        return resumedHandshakeTime;
+    }
+
+protected:
+    struct Entry {
+        std::string id;
+        std::vector<uint8_t> session;
+        ProcessClock::time_point expiry;
+    };
+
+    struct TicketKey {
+        std::array<uint8_t, 16> name{};
+        std::array<uint8_t, 32> aesKey{};
+        std::array<uint8_t, 32> hmacKey{};
+    };
+
+    static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    static SSL_SESSION* getSessionCallback(SSL* ssl,
+                                           unsigned char* id,
+                                           int length,
+                                           int* copy);
+#else
+    static SSL_SESSION* getSessionCallback(SSL* ssl,
+                                           const unsigned char* id,
+                                           int length,
+                                           int* copy);
+#endif
+    static void removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session);
+    static int ticketKeyCallback(SSL* ssl,
+                                 unsigned char* name,
+                                 unsigned char* iv,
+                                 EVP_CIPHER_CTX* ectx,
+                                 HMAC_CTX* hctx,
+                                 int enc);
+
+    void insert(SSL_SESSION* session);
+    SSL_SESSION* lookup(const unsigned char* id, int length);
+    void remove(SSL_SESSION* session);
+    int ticketKey(unsigned char* name,
+                  unsigned char* iv,
+                  EVP_CIPHER_CTX* ectx,
+                  HMAC_CTX* hctx,
+                  int enc);
+
+    void evict_UNLOCKED();
+    void rotate_UNLOCKED();
+
+    std::mutex mutex;
+
+    /// The sessions, the most recently used first
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t maxSize = 0;
+    std::chrono::seconds lifetime{0};
+
+    /// The key new tickets are encrypted with, and the one before it
+    TicketKey currentKey;
+    TicketKey previousKey;
+    ProcessClock::time_point rotated;
+
+    Couchbase::RelaxedAtomic<uint64_t> hits{0};
+    Couchbase::RelaxedAtomic<uint64_t> misses{0};
+    Couchbase::RelaxedAtomic<uint64_t> fullHandshakes{0};
+    Couchbase::RelaxedAtomic<uint64_t> resumedHandshakes{0};
+    Couchbase::RelaxedAtomic<uint64_t> fullHandshakeTime{0};
+    Couchbase::RelaxedAtomic<uint64_t> resumedHandshakeTime{0};
+};
@@ -82,6 +82,8 @@ const char* McbpStateMachine::getTaskName(TaskFunction task) const {
         return "conn_parse_cmd";
     } else if (task == conn_read_packet_body) {
         return "conn_read_packet_body";
+    } else if (task == conn_read_value) {
+        return "conn_read_value";
     } else if (task == conn_execute) {
         return "conn_execute";
     } else if (task == conn_closing) {
@@ -107,9 +109,20 @@ static void reset_cmd_handler(McbpConnection *c) {
 
     c->getCookieObject().reset();
     c->resetCommandContext();
+    c->releaseStreamedItem();
+    c->resetCurrentCookie();
 
     c->shrinkBuffers();
-    if (c->read->rsize() >= sizeof(c->binary_header)) {
+    if (c->replayParkedCommand()) {
+        // The engine completed a command parked while we kept on
+        // executing the following commands.
+    } else if (c->hasBatchedResponses() && !c->isPacketAvailable()) {
+        // We're about to wait for more data from the client. Send the
+        // responses we've batched up for the previous commands first.
+        c->addMsgHdr(true);
+        c->setWriteAndGo(conn_new_cmd);
+        c->setState(conn_send_data);
+    } else if (c->read->rsize() >= sizeof(c->binary_header)) {
         c->setState(conn_parse_cmd);
     } else if (c->isSslEnabled()) {
         c->setState(conn_read_packet_header);
@@ -161,7 +174,7 @@ bool conn_ship_log(McbpConnection *c) {
         /* and it will slowly grow.. */
         c->setNumEvents(c->getMaxReqsPerEvent());
     } else if (c->isWriteEvent()) {
-        if (c->decrementNumEvents() >= 0) {
+        if (c->startNextCommand()) {
             c->setEwouldblock(false);
             ship_mcbp_dcp_log(c);
             if (c->isEwouldblock()) {
@@ -183,7 +196,8 @@ bool conn_ship_log(McbpConnection *c) {
 }
 
 bool conn_waiting(McbpConnection *c) {
-    if (is_bucket_dying(c) || c->processServerEvents()) {
+    if (is_bucket_dying(c) || c->processServerEvents() ||
+        c->replayParkedCommand()) {
         return true;
     }
 
@@ -200,7 +214,8 @@ bool conn_waiting(McbpConnection *c) {
 }
 
 bool conn_read_packet_header(McbpConnection* c) {
-    if (is_bucket_dying(c) || c->processServerEvents()) {
+    if (is_bucket_dying(c) || c->processServerEvents() ||
+        c->replayParkedCommand()) {
         return true;
     }
 
@@ -237,6 +252,12 @@ bool conn_new_cmd(McbpConnection *c) {
         return true;
     }
 
+    if (c->prepareMigration()) {
+        // run_event_loop() hands us over to the new worker thread, which
+        // picks up from this state
+        return false;
+    }
+
     c->setStart(0);
 
     if (!c->write->empty()) {
@@ -251,9 +272,10 @@ bool conn_new_cmd(McbpConnection *c) {
     /*
      * In order to ensure that all clients will be served each
      * connection will only process a certain number of operations
-     * before they will back off.
+     * (or use a certain amount of CPU time or bytes) before they will
+     * back off.
      */
-    if (c->decrementNumEvents() >= 0) {
+    if (c->startNextCommand()) {
         reset_cmd_handler(c);
     } else {
         get_thread_stats(c)->conn_yields++;
@@ -270,7 +292,8 @@ bool conn_new_cmd(McbpConnection *c) {
          * connections in the way that they may not even get data from
          * the other end so that they'll _have_ to wait for a write event.
          */
-        if (c->havePendingInputData() || c->isDCP()) {
+        if (c->havePendingInputData() || c->isDCP() ||
+            c->hasBatchedResponses() || c->hasParkedCommands()) {
             short flags = EV_WRITE | EV_PERSIST;
             if (!c->updateEvent(flags)) {
                 LOG_WARNING(c, "%u: conn_new_cmd - Unable to update "
@@ -292,17 +315,45 @@ bool conn_execute(McbpConnection *c) {
         return true;
     }
 
-    if (!c->isPacketAvailable()) {
+    // A replay of a parked command use the copy of the packet kept in
+    // the cookie, rather than the packet in the input buffer. So does a
+    // mutation with its value streamed into the item.
+    const bool streamed = c->hasStreamedItem();
+    const bool replay = !streamed && c->getCookieObject().hasPacket();
+    if (!replay && !streamed && !c->isPacketAvailable()) {
         throw std::logic_error(
                 "conn_execute: Internal error.. the input packet is not "
                 "completely in memory");
     }
 
+    if (!replay && !c->isEwouldblock() && c->isParkableCommand()) {
+        c->useParkableCookie();
+    }
+
+    auto& tracer = c->getCookieObject().getTracer();
+    if (replay || c->isEwouldblock()) {
+        tracer.end(cb::tracing::TraceCode::Ewouldblock);
+    } else {
+        tracer.begin(cb::tracing::TraceCode::Request);
+    }
+
     c->setEwouldblock(false);
 
     mcbp_execute_packet(c);
 
     if (c->isEwouldblock()) {
+        tracer.begin(cb::tracing::TraceCode::Ewouldblock);
+    }
+
+    if (c->isEwouldblock() && c->getCookieObject().isParkable()) {
+        // Let the command wait for the engine on its own cookie and
+        // move on to the next command in the pipeline
+        c->parkCommand();
+        c->setState(conn_new_cmd);
+    } else if (c->isEwouldblock()) {
+        // Don't let the responses for the previous commands wait for
+        // this command to complete
+        c->flushBatchedResponses();
         c->unregisterEvent();
         return false;
     }
@@ -315,6 +366,10 @@ bool conn_execute(McbpConnection *c) {
                 "conn_execute: Should leave conn_execute for !EWOULDBLOCK");
     }
 
+    if (replay || streamed) {
+        return true;
+    }
+
     // Consume the packet we just executed from the input buffer
     c->read->consume([c](cb::const_byte_buffer buffer) -> ssize_t {
         size_t size =
@@ -392,14 +447,65 @@ bool conn_read_packet_body(McbpConnection* c) {
     return true;
 }
 
+bool conn_read_value(McbpConnection* c) {
+    if (is_bucket_dying(c)) {
+        return true;
+    }
+
+    auto res = c->readStreamedValue();
+    if (res > 0) {
+        get_thread_stats(c)->bytes_read += res;
+
+        if (c->isStreamedValueComplete()) {
+            c->setState(conn_execute);
+        }
+
+        return true;
+    }
+
+    if (res == 0) { /* end of stream */
+        c->setState(conn_closing);
+        return true;
+    }
+
+    auto error = GetLastNetworkError();
+    if (is_blocking(error)) {
+        if (!c->updateEvent(EV_READ | EV_PERSIST)) {
+            LOG_WARNING(c,
+                        "%u: conn_read_value - Unable to update libevent "
+                        "settings with (EV_READ | EV_PERSIST), closing "
+                        "connection (%p) %s",
+                        c->getId(),
+                        c->getCookie(),
+                        c->getDescription().c_str());
+            c->setState(conn_closing);
+            return true;
+        }
+        return false;
+    }
+
+    std::string errormsg = cb_strerror(error);
+    LOG_WARNING(c,
+                "%u Closing connection (%p) %s due to read error: %s",
+                c->getId(),
+                c->getCookie(),
+                c->getDescription().c_str(),
+                errormsg.c_str());
+
+    c->setState(conn_closing);
+    return true;
+}
+
 bool conn_send_data(McbpConnection* c) {
     bool ret = true;
 
     switch (c->transmit()) {
     case McbpConnection::TransmitResult::Complete:
+    case McbpConnection::TransmitResult::Batched:
         // Release all allocated resources
         c->releaseTempAlloc();
         c->releaseReservedItems();
+        c->traceResponseSent();
 
         // We're done sending the response to the client. Enter the next
         // state in the state machine
@@ -439,7 +545,7 @@ bool conn_pending_close(McbpConnection *c) {
      */
     perform_callbacks(ON_DISCONNECT, NULL, c->getCookie());
 
-    if (c->getRefcount() > 1) {
+    if (c->getRefcount() > 1 || c->waitForParkedCommands()) {
         return false;
     }
 
@@ -483,7 +589,8 @@ bool conn_closing(McbpConnection *c) {
     /* engine::release any allocated state */
     conn_cleanup_engine_allocations(c);
 
-    if (c->getRefcount() > 1 || c->isEwouldblock()) {
+    if (c->getRefcount() > 1 || c->isEwouldblock() ||
+        c->hasParkedCommands()) {
         c->setState(conn_pending_close);
     } else {
         c->setState(conn_immediate_close);
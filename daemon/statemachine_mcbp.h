@@ -134,6 +134,7 @@ bool conn_read_packet_header(McbpConnection* c);
  *   * conn_closing - if the bucket is currently being deleted (or protocol
  *                    error)
  *   * conn_read_packet_body - to fetch the rest of the data in the packet
+ *   * conn_read_value - to read the rest of a large value into the item
  *   * conn_send_data - if an error occurs and we want to tell the user
  *                      about the error before disconnecting.
  *
@@ -157,6 +158,21 @@ bool conn_parse_cmd(McbpConnection* c);
  */
 bool conn_read_packet_body(McbpConnection* c);
 
+/**
+ * Read the rest of the value of a mutation straight into the item
+ * allocated for it (see McbpConnection::startStreamingValue)
+ *
+ * possible next state:
+ *   * conn_closing - if the bucket is currently being deleted (or
+ *                    network error)
+ *   * conn_execute - the entire value is read into the item
+ *
+ * @param c the connection object
+ * @return true if the state machinery should continue to process events
+ *              for this connection, false if we're done
+ */
+bool conn_read_value(McbpConnection* c);
+
 /**
  * start closing a connection
  *
@@ -16,6 +16,7 @@
  */
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <relaxed_atomic.h>
 #include <mutex>
@@ -23,7 +24,80 @@
 #include "timing_histogram.h"
 
 /**
- * Stats stored per-thread.
+ * A counter which is only updated by a single thread (the worker thread
+ * the thread_stats belongs to), but may be read by any thread. Unlike
+ * Couchbase::RelaxedAtomic an update is a plain (relaxed) load and store
+ * rather than a read-modify-write, so it doesn't need a locked
+ * instruction.
+ *
+ * The only writes from another thread are the resets, and an update
+ * racing with a reset may bring back the value from before the reset.
+ */
+template <typename T>
+class ThreadOwnedCounter {
+public:
+    ThreadOwnedCounter(T initial = 0) : value(initial) {
+    }
+
+    ThreadOwnedCounter(const ThreadOwnedCounter& other) : value(other.load()) {
+    }
+
+    ThreadOwnedCounter& operator=(const ThreadOwnedCounter& other) {
+        store(other.load());
+        return *this;
+    }
+
+    ThreadOwnedCounter& operator=(T newValue) {
+        store(newValue);
+        return *this;
+    }
+
+    operator T() const {
+        return load();
+    }
+
+    T load() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    ThreadOwnedCounter& operator+=(T delta) {
+        store(load() + delta);
+        return *this;
+    }
+
+    T operator++() {
+        const T next = load() + 1;
+        store(next);
+        return next;
+    }
+
+    T operator++(int) {
+        const T current = load();
+        store(current + 1);
+        return current;
+    }
+
+    void setIfGreater(T candidate) {
+        if (candidate > load()) {
+            store(candidate);
+        }
+    }
+
+    void reset() {
+        store(0);
+    }
+
+private:
+    void store(T newValue) {
+        value.store(newValue, std::memory_order_relaxed);
+    }
+
+    std::atomic<T> value;
+};
+
+/**
+ * Stats stored per-thread (each bucket has one for every worker thread,
+ * which only that thread updates).
  */
 struct thread_stats {
     thread_stats() {
@@ -48,6 +122,7 @@ struct thread_stats {
         bytes_read = 0;
         cmd_flush = 0;
         conn_yields = 0;
+        conn_budget_yields = 0;
         auth_cmds = 0;
         auth_errors = 0;
         cmd_subdoc_lookup = 0;
@@ -69,6 +144,9 @@ struct thread_stats {
 
         iovused_high_watermark = 0;
         msgused_high_watermark = 0;
+
+        send_queue_limit_hits = 0;
+        send_queue_unpinned_bytes = 0;
     }
 
     thread_stats & operator += (const thread_stats &other) {
@@ -89,6 +167,7 @@ struct thread_stats {
         bytes_written += other.bytes_written;
         cmd_flush += other.cmd_flush;
         conn_yields += other.conn_yields;
+        conn_budget_yields += other.conn_budget_yields;
         auth_cmds += other.auth_cmds;
         auth_errors += other.auth_errors;
         cmd_subdoc_lookup += other.cmd_subdoc_lookup;
@@ -112,6 +191,9 @@ struct thread_stats {
         iovused_high_watermark.setIfGreater(other.iovused_high_watermark);
         msgused_high_watermark.setIfGreater(other.msgused_high_watermark);
 
+        send_queue_limit_hits += other.send_queue_limit_hits;
+        send_queue_unpinned_bytes += other.send_queue_unpinned_bytes;
+
         return *this;
     }
 
@@ -121,69 +203,84 @@ struct thread_stats {
         }
     }
 
-    Couchbase::RelaxedAtomic<uint64_t> cmd_get;
-    Couchbase::RelaxedAtomic<uint64_t> get_hits;
-    Couchbase::RelaxedAtomic<uint64_t> get_misses;
-    Couchbase::RelaxedAtomic<uint64_t> cmd_set;
-    Couchbase::RelaxedAtomic<uint64_t> delete_hits;
-    Couchbase::RelaxedAtomic<uint64_t> cas_hits;
-    Couchbase::RelaxedAtomic<uint64_t> cas_badval;
-    Couchbase::RelaxedAtomic<uint64_t> delete_misses;
-    Couchbase::RelaxedAtomic<uint64_t> incr_misses;
-    Couchbase::RelaxedAtomic<uint64_t> decr_misses;
-    Couchbase::RelaxedAtomic<uint64_t> incr_hits;
-    Couchbase::RelaxedAtomic<uint64_t> decr_hits;
-    Couchbase::RelaxedAtomic<uint64_t> cas_misses;
-    Couchbase::RelaxedAtomic<uint64_t> bytes_read;
-    Couchbase::RelaxedAtomic<uint64_t> bytes_written;
-    Couchbase::RelaxedAtomic<uint64_t> cmd_flush;
-    Couchbase::RelaxedAtomic<uint64_t> conn_yields; /* # of yields for connections (-R option)*/
-    Couchbase::RelaxedAtomic<uint64_t> auth_cmds;
-    Couchbase::RelaxedAtomic<uint64_t> auth_errors;
+    ThreadOwnedCounter<uint64_t> cmd_get;
+    ThreadOwnedCounter<uint64_t> get_hits;
+    ThreadOwnedCounter<uint64_t> get_misses;
+    ThreadOwnedCounter<uint64_t> cmd_set;
+    ThreadOwnedCounter<uint64_t> delete_hits;
+    ThreadOwnedCounter<uint64_t> cas_hits;
+    ThreadOwnedCounter<uint64_t> cas_badval;
+    ThreadOwnedCounter<uint64_t> delete_misses;
+    ThreadOwnedCounter<uint64_t> incr_misses;
+    ThreadOwnedCounter<uint64_t> decr_misses;
+    ThreadOwnedCounter<uint64_t> incr_hits;
+    ThreadOwnedCounter<uint64_t> decr_hits;
+    ThreadOwnedCounter<uint64_t> cas_misses;
+    ThreadOwnedCounter<uint64_t> bytes_read;
+    ThreadOwnedCounter<uint64_t> bytes_written;
+    ThreadOwnedCounter<uint64_t> cmd_flush;
+    /* # of yields for connections (-R option)*/
+    ThreadOwnedCounter<uint64_t> conn_yields;
+    /* # of the yields caused by the timeslice budget (event_time_budget
+       and event_byte_budget) */
+    ThreadOwnedCounter<uint64_t> conn_budget_yields;
+    ThreadOwnedCounter<uint64_t> auth_cmds;
+    ThreadOwnedCounter<uint64_t> auth_errors;
     /* # of subdoc lookup commands (GET/EXISTS/MULTI_LOOKUP) */
-    Couchbase::RelaxedAtomic<uint64_t> cmd_subdoc_lookup;
+    ThreadOwnedCounter<uint64_t> cmd_subdoc_lookup;
     /* # of subdoc mutation commands */
-    Couchbase::RelaxedAtomic<uint64_t> cmd_subdoc_mutation;
+    ThreadOwnedCounter<uint64_t> cmd_subdoc_mutation;
 
     /** # of lock commands */
-    Couchbase::RelaxedAtomic<uint64_t> cmd_lock;
+    ThreadOwnedCounter<uint64_t> cmd_lock;
 
     /** # of times an operation failed due to accessing a locked item */
-    Couchbase::RelaxedAtomic<uint64_t> lock_errors;
+    ThreadOwnedCounter<uint64_t> lock_errors;
 
     /* # of bytes in the complete document which subdoc lookups searched
        within. Compare with 'bytes_subdoc_lookup_extracted' */
-    Couchbase::RelaxedAtomic<uint64_t> bytes_subdoc_lookup_total;
+    ThreadOwnedCounter<uint64_t> bytes_subdoc_lookup_total;
     /* # of bytes extracted during a subdoc lookup operation and sent back to
       the client. */
-    Couchbase::RelaxedAtomic<uint64_t> bytes_subdoc_lookup_extracted;
+    ThreadOwnedCounter<uint64_t> bytes_subdoc_lookup_extracted;
 
     /* # of bytes in the complete document which subdoc mutations updated.
        Compare with 'bytes_subdoc_mutation_inserted' */
-    Couchbase::RelaxedAtomic<uint64_t> bytes_subdoc_mutation_total;
+    ThreadOwnedCounter<uint64_t> bytes_subdoc_mutation_total;
     /* # of bytes inserted during a subdoc mutation operation (which were
        received from the client). */
-    Couchbase::RelaxedAtomic<uint64_t> bytes_subdoc_mutation_inserted;
+    ThreadOwnedCounter<uint64_t> bytes_subdoc_mutation_inserted;
 
     /* # of read buffers allocated. */
-    Couchbase::RelaxedAtomic<uint64_t> rbufs_allocated;
+    ThreadOwnedCounter<uint64_t> rbufs_allocated;
     /* # of read buffers which could be loaned (and hence didn't need to be allocated). */
-    Couchbase::RelaxedAtomic<uint64_t> rbufs_loaned;
+    ThreadOwnedCounter<uint64_t> rbufs_loaned;
     /* # of read buffers which already existed (with partial data) on the connection
        (and hence didn't need to be allocated). */
-    Couchbase::RelaxedAtomic<uint64_t> rbufs_existing;
+    ThreadOwnedCounter<uint64_t> rbufs_existing;
     /* # of write buffers allocated. */
-    Couchbase::RelaxedAtomic<uint64_t> wbufs_allocated;
+    ThreadOwnedCounter<uint64_t> wbufs_allocated;
     /* # of write buffers which could be loaned (and hence didn't need to be allocated). */
-    Couchbase::RelaxedAtomic<uint64_t> wbufs_loaned;
+    ThreadOwnedCounter<uint64_t> wbufs_loaned;
     /* # of write buffers which already existed (with partial data) on the
         connection (and hence didn't need to be allocated). */
-    Couchbase::RelaxedAtomic<uint64_t> wbufs_existing;
+    ThreadOwnedCounter<uint64_t> wbufs_existing;
 
     /* Highest value iovsize has got to */
-    Couchbase::RelaxedAtomic<int> iovused_high_watermark;
+    ThreadOwnedCounter<int> iovused_high_watermark;
     /* High value Connection->msgused has got to */
-    Couchbase::RelaxedAtomic<int> msgused_high_watermark;
+    ThreadOwnedCounter<int> msgused_high_watermark;
+
+    /* # of times a connection couldn't send its responses while it was
+       over the send queue limit */
+    ThreadOwnedCounter<uint64_t> send_queue_limit_hits;
+    /* # of bytes copied out of the items the connections released when
+       they hit the send queue limit */
+    ThreadOwnedCounter<uint64_t> send_queue_unpinned_bytes;
+
+    // Keep the counters of the worker threads (which are stored next to
+    // each other) off each other's cache lines
+    char padding[64];
 };
 
 /**
@@ -282,6 +379,9 @@ struct stats {
     /** The number of times I reject a client */
     Couchbase::RelaxedAtomic<uint64_t> rejected_conns;
 
+    /** The number of times a connection moved to another worker thread */
+    Couchbase::RelaxedAtomic<uint64_t> migrated_conns;
+
     std::vector<ListeningPort> listening_ports;
 };
 
@@ -32,6 +32,7 @@
 #include "xattr/key_validator.h"
 #include "xattr/utils.h"
 
+#include <memcached/json_validator.h>
 #include <memcached/protocol_binary.h>
 #include <memcached/types.h>
 #include <platform/histogram.h>
@@ -562,6 +563,35 @@ static protocol_binary_response_status
 subdoc_operate_one_path(SubdocCmdContext& context, SubdocCmdContext::OperationSpec& spec,
                         const cb::const_char_buffer& in_doc) {
 
+    // Multi-path lookups look up all of the paths in the same document,
+    // so let them share the index of the document rather than having
+    // subjson parse it for every path. Anything the index can't answer
+    // exactly like subjson is left to subjson.
+    if (!context.traits.is_mutator &&
+        context.traits.path == SubdocPath::MULTI &&
+        context.getOperations().size() > 1 &&
+        (spec.traits.subdocCommand == Subdoc::Command::GET ||
+         spec.traits.subdocCommand == Subdoc::Command::EXISTS) &&
+        spec.path.len > 0 &&
+        !(context.getCurrentPhase() == SubdocCmdContext::Phase::XATTR &&
+          spec.path.buf[0] == '$')) {
+        const auto* index = context.getDocumentIndex(in_doc);
+        if (index != nullptr) {
+            cb::const_char_buffer value;
+            switch (index->lookup(spec.path, value)) {
+            case SubdocumentIndex::Status::Found:
+                spec.result.set_matchloc({value.buf, value.len});
+                return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+            case SubdocumentIndex::Status::NotFound:
+                return PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT;
+            case SubdocumentIndex::Status::Mismatch:
+                return PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_MISMATCH;
+            case SubdocumentIndex::Status::Unsupported:
+                break;
+            }
+        }
+    }
+
     // Prepare the specified sub-document command.
     Subdoc::Operation* op = context.connection.getThread()->subdoc_op;
     op->clear();
@@ -660,6 +690,15 @@ static protocol_binary_response_status subdoc_operate_wholedoc(
 
     case PROTOCOL_BINARY_CMD_SET:
         spec.result.push_newdoc({spec.value.buf, spec.value.len});
+        // The value replaces the body, so it decides if the document
+        // is JSON
+        if (cb::json::isValidJson(
+                    reinterpret_cast<const uint8_t*>(spec.value.buf),
+                    spec.value.len)) {
+            context.in_datatype |= PROTOCOL_BINARY_DATATYPE_JSON;
+        } else {
+            context.in_datatype &= ~PROTOCOL_BINARY_DATATYPE_JSON;
+        }
         return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 
     case PROTOCOL_BINARY_CMD_DELETE:
@@ -681,6 +720,10 @@ static protocol_binary_response_status subdoc_operate_wholedoc(
  * @param doc_datatype The datatype of the document.
  * @param temp_buffer where to store the data for our temporary buffer
  *                    allocations if we need to change the doc.
+ * @param prefix copied in front of the document in temp_buffer (with doc
+ *               pointing just after it), so that a caller which has to
+ *               put it back in front of the modified document doesn't
+ *               need to copy the whole document once more to do so.
  * @param modified set to true upon return if any modifications happened
  *                 to the input document.
  * @return true if we should continue processing this request,
@@ -693,6 +736,7 @@ static bool operate_single_doc(SubdocCmdContext& context,
                                 cb::const_char_buffer& doc,
                                 protocol_binary_datatype_t doc_datatype,
                                 std::unique_ptr<char[]>& temp_buffer,
+                                cb::const_char_buffer prefix,
                                 bool& modified) {
     modified = false;
     auto& operations = context.getOperations();
@@ -736,10 +780,12 @@ static bool operate_single_doc(SubdocCmdContext& context,
 
                 // Allocate an extra byte to make sure we can zero term it
                 // (in case we want to use cJSON_Parse() ;-)
-                std::unique_ptr<char[]> temp(new char[new_doc_len + 1]);
-                temp[new_doc_len] = '\0';
+                std::unique_ptr<char[]> temp(
+                        new char[prefix.len + new_doc_len + 1]);
+                temp[prefix.len + new_doc_len] = '\0';
+                std::copy(prefix.buf, prefix.buf + prefix.len, temp.get());
 
-                size_t offset = 0;
+                size_t offset = prefix.len;
                 for (auto& loc : op->result.newdoc()) {
                     std::memcpy(temp.get() + offset, loc.at, loc.length);
                     offset += loc.length;
@@ -749,7 +795,7 @@ static bool operate_single_doc(SubdocCmdContext& context,
                 // (even if it was the source of some of the newdoc
                 // iovecs).
                 temp_buffer.swap(temp);
-                doc.buf = temp_buffer.get();
+                doc.buf = temp_buffer.get() + prefix.len;
                 doc.len = new_doc_len;
             } else { // lookup
                 // nothing to do.
@@ -1005,7 +1051,8 @@ static bool do_xattr_phase(SubdocCmdContext& context) {
 
     const cb::xattr::Blob xattr_blob(blob_buffer);
     auto key = context.get_xattr_key();
-    auto value_buf = xattr_blob.get(key);
+    auto value_buf = context.getXattrIndex({blob_buffer.buf, blob_buffer.len})
+                             .get(key);
 
     if (value_buf.len == 0) {
         context.xattr_buffer.reset(new uint8_t[2]);
@@ -1041,6 +1088,7 @@ static bool do_xattr_phase(SubdocCmdContext& context) {
                             document,
                             PROTOCOL_BINARY_DATATYPE_JSON,
                             temp_doc,
+                            /*prefix*/ {},
                             modified)) {
         // Something failed..
         return false;
@@ -1104,8 +1152,14 @@ static bool do_body_phase(SubdocCmdContext& context) {
     std::unique_ptr<char[]> temp_doc;
     bool modified;
 
-    if (!operate_single_doc(
-                context, document, context.in_datatype, temp_doc, modified)) {
+    // The xattrs are copied in front of the modified body as it is built,
+    // so the temporary buffer already holds the full document
+    if (!operate_single_doc(context,
+                            document,
+                            context.in_datatype,
+                            temp_doc,
+                            {context.in_doc.buf, xattrsize},
+                            modified)) {
         return false;
     }
 
@@ -1114,25 +1168,8 @@ static bool do_body_phase(SubdocCmdContext& context) {
         return true;
     }
 
-    // There isn't any xattrs associated with the document. We shouldn't
-    // reallocate and move things around but just reuse the temporary
-    // buffer we've already created.
-    if (xattrsize == 0) {
-        context.temp_doc.swap(temp_doc);
-        context.in_doc = { context.temp_doc.get(), document.len };
-        return true;
-    }
-
-    // Time to rebuild the full document.
-    auto total = xattrsize + document.len;
-    std::unique_ptr<char[]> full_document(new char[total]);;
-
-    memcpy(full_document.get(), context.in_doc.buf, xattrsize);
-    memcpy(full_document.get() + xattrsize, document.buf, document.len);
-
-    context.temp_doc.swap(full_document);
-    context.in_doc = { context.temp_doc.get(), total };
-
+    context.temp_doc.swap(temp_doc);
+    context.in_doc = {context.temp_doc.get(), xattrsize + document.len};
     return true;
 }
 
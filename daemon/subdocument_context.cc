@@ -67,6 +67,22 @@ uint64_t SubdocCmdContext::getOperationValueBytesTotal() const {
     return result;
 }
 
+const SubdocumentIndex* SubdocCmdContext::getDocumentIndex(
+        cb::const_char_buffer doc) {
+    if (!documentIndex.isIndexOf(doc)) {
+        documentIndex.build(doc);
+    }
+    return documentIndex.isIndexed() ? &documentIndex : nullptr;
+}
+
+const cb::xattr::BlobIndex& SubdocCmdContext::getXattrIndex(
+        cb::const_byte_buffer blob) {
+    if (!xattrIndex.is_index_of(blob)) {
+        xattrIndex.build(blob);
+    }
+    return xattrIndex;
+}
+
 template <typename T>
 std::string SubdocCmdContext::macroToString(T macroValue) {
     std::stringstream ss;
@@ -340,6 +356,11 @@ protocol_binary_response_status SubdocCmdContext::get_document_for_searching(
     in_datatype = info.datatype;
     in_document_state = info.document_state;
 
+    // A (retried) fetch may return a different document at the same
+    // address, so drop the indexes of the previous one
+    documentIndex = SubdocumentIndex{};
+    xattrIndex = cb::xattr::BlobIndex{};
+
     if (mcbp::datatype::is_snappy(info.datatype)) {
         // Need to expand before attempting to extract from it.
         try {
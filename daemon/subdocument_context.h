@@ -19,7 +19,9 @@
 
 #include "memcached.h"
 
+#include "subdocument_index.h"
 #include "subdocument_traits.h"
+#include "xattr/blob_index.h"
 #include "xattr/utils.h"
 
 #include <cstddef>
@@ -161,6 +163,27 @@ public:
     // Returns the total size of all Operation values (bytes).
     uint64_t getOperationValueBytesTotal() const;
 
+    /**
+     * Get the structural index of the given document, so that the paths
+     * of a multi-path lookup don't need to parse the document over and
+     * over again. The index is built by the first call for a document.
+     *
+     * @param doc the document the operations are run against
+     * @return the index, or nullptr if the document couldn't be indexed
+     *         (and the operations should be run through subjson)
+     */
+    const SubdocumentIndex* getDocumentIndex(cb::const_char_buffer doc);
+
+    /**
+     * Get the index of the given xattr blob, so that all of the lookups
+     * into the xattrs of the document during the operation share a
+     * single walk through the blob. The index is built by the first call
+     * for a blob.
+     *
+     * @param blob the xattr blob of the document
+     */
+    const cb::xattr::BlobIndex& getXattrIndex(cb::const_byte_buffer blob);
+
     // Cookie this command is associated with. Needed for the destructor
     // to release items.
     McbpConnection& connection;
@@ -386,4 +409,10 @@ private:
 
     std::string document_vattr;
     std::string xtoc_vattr;
+
+    // The index of the document used by the last getDocumentIndex() call
+    SubdocumentIndex documentIndex;
+
+    // The index of the xattrs used by the last getXattrIndex() call
+    cb::xattr::BlobIndex xattrIndex;
 }; // class SubdocCmdContext
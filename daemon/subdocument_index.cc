@@ -0,0 +1,301 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include "subdocument_index.h"
+
+#include <memcached/json_validator.h>
+
+#include <cstring>
+#include <limits>
+
+const size_t SubdocumentIndex::MaxDepth;
+
+static const uint32_t NoNode = std::numeric_limits<uint32_t>::max();
+
+static bool isWhitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/**
+ * Get the position following the string starting at pos (the document is
+ * known to be valid JSON)
+ */
+static size_t skipString(const char* doc, size_t size, size_t pos) {
+    ++pos;
+    for (;;) {
+        auto* quote = static_cast<const char*>(
+                std::memchr(doc + pos, '"', size - pos));
+        pos = size_t(quote - doc);
+        // The quote is escaped if it follows an odd number of backslashes
+        size_t backslashes = 0;
+        while (doc[pos - 1 - backslashes] == '\\') {
+            ++backslashes;
+        }
+        ++pos;
+        if ((backslashes % 2) == 0) {
+            return pos;
+        }
+    }
+}
+
+bool SubdocumentIndex::build(cb::const_char_buffer document) {
+    doc = document;
+    indexed = false;
+    nodes.clear();
+
+    if (document.len > std::numeric_limits<uint32_t>::max() ||
+        !cb::json::isValidJson(
+                reinterpret_cast<const uint8_t*>(document.buf),
+                document.len)) {
+        return false;
+    }
+
+    const char* base = document.buf;
+    const size_t size = document.len;
+    size_t pos = 0;
+
+    // The containers we're in, and the last child seen in each of them
+    std::vector<uint32_t> open;
+    std::vector<uint32_t> last;
+
+    bool expectKey = false;
+    uint32_t keyBegin = 0;
+    uint32_t keyLen = 0;
+    bool escapedKey = false;
+
+    for (;;) {
+        while (isWhitespace(base[pos])) {
+            ++pos;
+        }
+
+        const char c = base[pos];
+        if (c == ',') {
+            ++pos;
+            expectKey = nodes[open.back()].type == Type::Object;
+            continue;
+        }
+
+        if (c == '}' || c == ']') {
+            nodes[open.back()].end = uint32_t(pos + 1);
+            ++pos;
+            open.pop_back();
+            last.pop_back();
+            if (open.empty()) {
+                break;
+            }
+            continue;
+        }
+
+        if (expectKey) {
+            const auto end = skipString(base, size, pos);
+            keyBegin = uint32_t(pos + 1);
+            keyLen = uint32_t(end - pos - 2);
+            escapedKey = std::memchr(base + keyBegin, '\\', keyLen) != nullptr;
+            pos = end;
+            while (base[pos] != ':') {
+                ++pos;
+            }
+            ++pos;
+            expectKey = false;
+            continue;
+        }
+
+        // A value
+        const auto idx = uint32_t(nodes.size());
+        Node node{};
+        node.begin = uint32_t(pos);
+        node.next = 0;
+        if (!open.empty()) {
+            auto& parent = nodes[open.back()];
+            ++parent.children;
+            if (parent.type == Type::Object) {
+                node.keyBegin = keyBegin;
+                node.keyLen = keyLen;
+                node.escapedKey = escapedKey;
+            }
+            if (last.back() != NoNode) {
+                nodes[last.back()].next = idx;
+            }
+            last.back() = idx;
+        }
+
+        if (c == '{' || c == '[') {
+            node.type = (c == '{') ? Type::Object : Type::Array;
+            nodes.push_back(node);
+            open.push_back(idx);
+            last.push_back(NoNode);
+            if (open.size() > MaxDepth) {
+                nodes.clear();
+                return false;
+            }
+            ++pos;
+            expectKey = (c == '{');
+            continue;
+        }
+
+        node.type = Type::Scalar;
+        if (c == '"') {
+            pos = skipString(base, size, pos);
+        } else {
+            while (pos < size && !isWhitespace(base[pos]) && base[pos] != ',' &&
+                   base[pos] != ']' && base[pos] != '}') {
+                ++pos;
+            }
+        }
+        node.end = uint32_t(pos);
+        nodes.push_back(node);
+        if (open.empty()) {
+            break;
+        }
+    }
+
+    indexed = true;
+    return true;
+}
+
+const SubdocumentIndex::Node* SubdocumentIndex::findMember(
+        const Node& object, cb::const_char_buffer key, bool& escaped) const {
+    if (object.children == 0) {
+        return nullptr;
+    }
+
+    auto idx = uint32_t(&object - nodes.data()) + 1;
+    for (;;) {
+        const auto& child = nodes[idx];
+        if (child.escapedKey) {
+            // We can't tell if the name matches without decoding it
+            escaped = true;
+            return nullptr;
+        } else if (child.keyLen == key.len &&
+                   std::memcmp(doc.buf + child.keyBegin, key.buf, key.len) ==
+                           0) {
+            return &child;
+        }
+        if (child.next == 0) {
+            return nullptr;
+        }
+        idx = child.next;
+    }
+}
+
+const SubdocumentIndex::Node* SubdocumentIndex::findElement(
+        const Node& array, uint32_t index, bool last) const {
+    if (last) {
+        if (array.children == 0) {
+            return nullptr;
+        }
+        index = array.children - 1;
+    }
+    if (index >= array.children) {
+        return nullptr;
+    }
+
+    auto idx = uint32_t(&array - nodes.data()) + 1;
+    for (uint32_t ii = 0; ii < index; ++ii) {
+        idx = nodes[idx].next;
+    }
+    return &nodes[idx];
+}
+
+SubdocumentIndex::Status SubdocumentIndex::lookup(
+        cb::const_char_buffer path, cb::const_char_buffer& value) const {
+    if (!indexed || path.len == 0) {
+        return Status::Unsupported;
+    }
+
+    const Node* node = &nodes[0];
+    size_t pos = 0;
+    size_t components = 0;
+
+    while (pos < path.len) {
+        if (++components > MaxDepth) {
+            return Status::Unsupported;
+        }
+
+        if (path.buf[pos] == '[') {
+            // An array index: [n] or [-1] for the last element
+            ++pos;
+            uint64_t index = 0;
+            bool lastElement = false;
+            if (pos < path.len && path.buf[pos] == '-') {
+                if (pos + 1 >= path.len || path.buf[pos + 1] != '1') {
+                    return Status::Unsupported;
+                }
+                lastElement = true;
+                pos += 2;
+            } else {
+                const auto start = pos;
+                while (pos < path.len && path.buf[pos] >= '0' &&
+                       path.buf[pos] <= '9') {
+                    index = index * 10 + uint64_t(path.buf[pos] - '0');
+                    if (index > std::numeric_limits<uint32_t>::max()) {
+                        return Status::Unsupported;
+                    }
+                    ++pos;
+                }
+                if (pos == start || (path.buf[start] == '0' && pos - start > 1)) {
+                    return Status::Unsupported;
+                }
+            }
+            if (pos >= path.len || path.buf[pos] != ']') {
+                return Status::Unsupported;
+            }
+            ++pos;
+
+            if (node->type != Type::Array) {
+                return Status::Mismatch;
+            }
+            node = findElement(*node, uint32_t(index), lastElement);
+            if (node == nullptr) {
+                return Status::NotFound;
+            }
+        } else {
+            // A member name, separated from the previous component by a dot
+            if (components > 1) {
+                if (path.buf[pos] != '.') {
+                    return Status::Unsupported;
+                }
+                ++pos;
+            }
+            const auto start = pos;
+            while (pos < path.len && path.buf[pos] != '.' &&
+                   path.buf[pos] != '[') {
+                const char c = path.buf[pos];
+                if (c == '`' || c == ']' || c == '\\' || c == '"') {
+                    // Escaped names are left to subjson
+                    return Status::Unsupported;
+                }
+                ++pos;
+            }
+            if (pos == start) {
+                return Status::Unsupported;
+            }
+
+            if (node->type != Type::Object) {
+                return Status::Mismatch;
+            }
+            bool escaped = false;
+            node = findMember(*node, {path.buf + start, pos - start}, escaped);
+            if (node == nullptr) {
+                return escaped ? Status::Unsupported : Status::NotFound;
+            }
+        }
+    }
+
+    value = {doc.buf + node->begin, node->end - node->begin};
+    return Status::Found;
+}
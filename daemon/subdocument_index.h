@@ -0,0 +1,121 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/sized_buffer.h>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * The SubdocumentIndex is a structural index of a JSON document: the
+ * location of every value in the document, and how the values nest.
+ * The document is parsed once to build the index, and a path is then
+ * resolved by walking the index rather than by parsing the document
+ * again (which is what subjson does for every path).
+ *
+ * It is used by the multi-path lookups so that looking up N paths in a
+ * document costs O(document) + O(N * depth) rather than O(N * document).
+ *
+ * The index only resolves the simple paths (dotted member names and
+ * array indexes); lookups it can't answer exactly the way subjson
+ * would return Status::Unsupported so that the caller may fall back to
+ * subjson. For the same reason it refuses to index documents which
+ * aren't valid JSON or are nested deeper than subjson allows.
+ */
+class SubdocumentIndex {
+public:
+    enum class Status : uint8_t {
+        /// The path was found in the document
+        Found,
+        /// The path doesn't exist (PATH_ENOENT)
+        NotFound,
+        /// A component of the path doesn't match the type of the value
+        /// (PATH_MISMATCH)
+        Mismatch,
+        /// The index can't resolve the path; use subjson
+        Unsupported
+    };
+
+    /// The maximum nesting we index (and path components we resolve)
+    static const size_t MaxDepth = 32;
+
+    /**
+     * Build the index for a document. The document must outlive the
+     * index (the values returned by lookup() point into it).
+     *
+     * @return true if the document was indexed, false if it can't be
+     *         indexed (and lookups must be done by subjson)
+     */
+    bool build(cb::const_char_buffer document);
+
+    /// Was build() last called for the given document
+    bool isIndexOf(cb::const_char_buffer document) const {
+        return document.buf == doc.buf && document.len == doc.len;
+    }
+
+    /// Did the last build() succeed
+    bool isIndexed() const {
+        return indexed;
+    }
+
+    /**
+     * Look up a path in the document
+     *
+     * @param path the path to look up
+     * @param value set to the location of the value if found
+     */
+    Status lookup(cb::const_char_buffer path,
+                  cb::const_char_buffer& value) const;
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+private:
+    enum class Type : uint8_t { Object, Array, Scalar };
+
+    /**
+     * The nodes are stored in document order, so the first child of
+     * a container (if any) is the next node
+     */
+    struct Node {
+        /// The location of the value in the document [begin, end)
+        uint32_t begin;
+        uint32_t end;
+        /// The member name (without the quotes) if the parent is an object
+        uint32_t keyBegin;
+        uint32_t keyLen;
+        /// The index of the next sibling (0 if this is the last child)
+        uint32_t next;
+        /// The number of children of a container
+        uint32_t children;
+        Type type;
+        /// Set if the member name contains escape sequences
+        bool escapedKey;
+    };
+
+    const Node* findMember(const Node& object,
+                           cb::const_char_buffer key,
+                           bool& escaped) const;
+
+    const Node* findElement(const Node& array, uint32_t index, bool last) const;
+
+    cb::const_char_buffer doc;
+    bool indexed = false;
+    std::vector<Node> nodes;
+};
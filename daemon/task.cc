@@ -18,6 +18,21 @@
 #include "task.h"
 #include "executor.h"
 
+std::string to_string(TaskType type) {
+    switch (type) {
+    case TaskType::Default:
+        return "default";
+    case TaskType::Auth:
+        return "auth";
+    case TaskType::Admin:
+        return "admin";
+    case TaskType::Count:
+        break;
+    }
+    throw std::invalid_argument("to_string(TaskType): invalid type " +
+                                std::to_string(int(type)));
+}
+
 void Task::makeRunnable() {
     if (executor == nullptr) {
         throw std::logic_error("task need to be scheduled");
@@ -24,6 +24,26 @@ class Executor;
 
 #include <mutex>
 #include <stdexcept>
+#include <string>
+
+/**
+ * What a task does. The ExecutorPool may run each type on executors of its
+ * own, so that a burst of one type (e.g. authentications during a
+ * reconnect storm) doesn't queue up the tasks of the others, and keeps the
+ * stats of the runs by type.
+ */
+enum class TaskType : uint8_t {
+    /// Anything not listed below (stats, tracing, CCCP notifications...)
+    Default,
+    /// SASL authentication (SCRAM hashes the password, which is CPU heavy)
+    Auth,
+    /// Bucket creation and deletion, RBAC reloads
+    Admin,
+    /// The number of types (keep last)
+    Count
+};
+
+std::string to_string(TaskType type);
 
 /**
  * The Task class represents a Task that needs to be performed by the
@@ -60,6 +80,14 @@ public:
     virtual void notifyExecutionComplete() {
     }
 
+    /**
+     * The type of the task, which decides the executors running it (it must
+     * not change once the task is scheduled)
+     */
+    virtual TaskType getType() const {
+        return TaskType::Default;
+    }
+
     /**
      * Get the mutex used to protect the task and to ensure that we don't
      * have any race conditions. It should be held when:
@@ -4,8 +4,13 @@
  */
 #include "config.h"
 #include "memcached.h"
+#include "buffer_pool.h"
+#include "command_context_pool.h"
+#include "io_vector_pool.h"
 #include "connections.h"
+#include "inflated_value_cache.h"
 
+#include <memcached/numa.h>
 #include <atomic>
 #include <stdio.h>
 #include <errno.h>
@@ -20,6 +25,8 @@
 #include <platform/strerror.h>
 #include <queue>
 #include <memory>
+#include <stdexcept>
+#include <string>
 
 #define ITEMS_PER_ALLOC 64
 
@@ -81,6 +88,12 @@ static LIBEVENT_THREAD *threads;
 static cb_thread_t *thread_ids;
 std::vector<TimingHistogram> scheduler_info;
 
+/*
+ * The number of times the worker thread looks for new connections in
+ * the pending io queue before it gives the other events a chance to run.
+ */
+static const int max_pending_io_rounds = 4;
+
 /*
  * Number of worker threads that have finished setting themselves up.
  */
@@ -208,9 +221,37 @@ static void setup_thread(LIBEVENT_THREAD *me) {
     me->subdoc_op = subdoc_op_alloc();
 
     try {
-        me->validator = new JSON_checker::Validator();
+        me->inflated_value_cache = new InflatedValueCache();
+    } catch (const std::bad_alloc&) {
+        FATAL_ERROR(EXIT_FAILURE,
+                    "Failed to allocate memory for inflated value cache");
+    }
+
+    try {
+        me->compressed_value_cache = new InflatedValueCache();
+    } catch (const std::bad_alloc&) {
+        FATAL_ERROR(EXIT_FAILURE,
+                    "Failed to allocate memory for compressed value cache");
+    }
+
+    try {
+        me->command_context_pool = new CommandContextPool();
     } catch (const std::bad_alloc&) {
-        FATAL_ERROR(EXIT_FAILURE, "Failed to allocate memory for JSON validator");
+        FATAL_ERROR(EXIT_FAILURE,
+                    "Failed to allocate memory for command context pool");
+    }
+
+    try {
+        me->buffer_pool = new BufferPool();
+    } catch (const std::bad_alloc&) {
+        FATAL_ERROR(EXIT_FAILURE, "Failed to allocate memory for buffer pool");
+    }
+
+    try {
+        me->io_vector_pool = new IoVectorPool();
+    } catch (const std::bad_alloc&) {
+        FATAL_ERROR(EXIT_FAILURE,
+                    "Failed to allocate memory for io vector pool");
     }
 }
 
@@ -224,6 +265,22 @@ static void worker_libevent(void *arg) {
      * all threads have finished initializing.
      */
 
+    if (settings.isNumaAffinity()) {
+        // Spread the worker threads round robin over the NUMA nodes so
+        // that the connections they serve (and the memory they allocate)
+        // stay local to a node
+        if (cb::numa::bindCurrentThreadToNode(me->index)) {
+            LOG_INFO(nullptr,
+                     "Bound worker thread %d to NUMA node %u",
+                     me->index,
+                     unsigned(me->index % cb::numa::getNumNodes()));
+        } else {
+            LOG_WARNING(nullptr,
+                        "Failed to bind worker thread %d to a NUMA node",
+                        me->index);
+        }
+    }
+
     cb_mutex_enter(&init_lock);
     init_count++;
     cb_cond_signal(&init_cond);
@@ -235,16 +292,6 @@ static void worker_libevent(void *arg) {
     ERR_remove_state(0);
 }
 
-static int number_of_pending(Connection *c, Connection *list) {
-    int rv = 0;
-    for (; list; list = list->getNext()) {
-        if (list == c) {
-            rv ++;
-        }
-    }
-    return rv;
-}
-
 static void drain_notification_channel(evutil_socket_t fd)
 {
     /* Every time we want to notify a thread, we send 1 byte to its
@@ -280,6 +327,74 @@ void dispatch_new_connections(LIBEVENT_THREAD* me) {
     }
 }
 
+/**
+ * Move the connections in the chain over to the list of connections
+ * to run (the caller must hold the thread lock)
+ */
+static void splice_pending_io(LIBEVENT_THREAD* me, Connection* chain) {
+    if (chain == nullptr) {
+        return;
+    }
+
+    auto* tail = chain;
+    while (tail->getNext() != nullptr) {
+        tail = tail->getNext();
+    }
+    tail->setNext(me->pending_io);
+    me->pending_io = chain;
+}
+
+/**
+ * Run all of the connections scheduled through notify_io_complete. We
+ * keep on looking at the queue as long as it keeps getting new
+ * connections (the producers don't signal us while we're running),
+ * but give up after a few rounds to let the other events run.
+ */
+static void process_pending_io(LIBEVENT_THREAD* me) {
+    for (int round = 0; round < max_pending_io_rounds; ++round) {
+        splice_pending_io(me, me->pending_io_queue.popAll());
+        if (me->pending_io == nullptr) {
+            splice_pending_io(me, me->pending_io_queue.prepareToSleep());
+            if (me->pending_io == nullptr) {
+                return;
+            }
+        }
+
+        Connection* c;
+        while ((c = me->pending_io) != nullptr) {
+            cb_assert(me == c->getThread());
+            me->pending_io = c->getNext();
+            c->setNext(nullptr);
+            c->clearPendingIo();
+
+            auto *mcbp = dynamic_cast<McbpConnection*>(c);
+            if (mcbp != nullptr) {
+                if (c->getSocketDescriptor() != INVALID_SOCKET &&
+                    !mcbp->isRegisteredInLibevent()) {
+                    /* The socket may have been shut down while we're looping */
+                    /* in delayed shutdown */
+                    mcbp->registerEvent();
+                }
+
+                /*
+                 * We don't want the thread to keep on serving all of the data
+                 * from the context of the notification pipe, so just let it
+                 * run one time to set up the correct mask in libevent
+                 */
+                mcbp->setNumEvents(1);
+            }
+            run_event_loop(c, EV_READ|EV_WRITE);
+        }
+    }
+
+    // We're still being notified; let the other events run and pick up
+    // the rest the next time around
+    splice_pending_io(me, me->pending_io_queue.prepareToSleep());
+    if (me->pending_io != nullptr) {
+        notify_thread(me);
+    }
+}
+
 /*
  * Processes an incoming "handle a new connection" item. This is called when
  * input arrives on the libevent wakeup pipe.
@@ -314,37 +429,15 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
     dispatch_new_connections(me);
 
     LOCK_THREAD(me);
-    Connection* pending = me->pending_io;
-    me->pending_io = NULL;
-    while (pending != NULL) {
-        Connection *c = pending;
-        cb_assert(me == c->getThread());
-        pending = pending->getNext();
-        c->setNext(nullptr);
-
-        auto *mcbp = dynamic_cast<McbpConnection*>(c);
-        if (mcbp != nullptr) {
-            if (c->getSocketDescriptor() != INVALID_SOCKET &&
-                !mcbp->isRegisteredInLibevent()) {
-                /* The socket may have been shut down while we're looping */
-                /* in delayed shutdown */
-                mcbp->registerEvent();
-            }
-
-            /*
-             * We don't want the thread to keep on serving all of the data
-             * from the context of the notification pipe, so just let it
-             * run one time to set up the correct mask in libevent
-             */
-            mcbp->setNumEvents(1);
-        }
-        run_event_loop(c, EV_READ|EV_WRITE);
-    }
+    process_pending_io(me);
 
     /*
      * I could look at all of the connection objects bound to dying buckets
      */
     if (me->deleting_buckets) {
+        // The bucket index may be reused by a new bucket
+        me->inflated_value_cache->clear();
+        me->compressed_value_cache->clear();
         notify_thread_bucket_deletion(me);
     }
 
@@ -368,23 +461,6 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
 
 extern volatile rel_time_t current_time;
 
-static bool has_cycle(Connection *c) {
-    Connection *slowNode, *fastNode1, *fastNode2;
-
-    if (!c) {
-        return false;
-    }
-
-    slowNode = fastNode1 = fastNode2 = c;
-    while (slowNode && (fastNode1 = fastNode2->getNext()) && (fastNode2 = fastNode1->getNext())) {
-        if (slowNode == fastNode1 || slowNode == fastNode2) {
-            return true;
-        }
-        slowNode = slowNode->getNext();
-    }
-    return false;
-}
-
 bool list_contains(Connection *haystack, Connection *needle) {
     for (; haystack; haystack = haystack->getNext()) {
         if (needle == haystack) {
@@ -410,17 +486,6 @@ Connection * list_remove(Connection *haystack, Connection *needle) {
     return haystack;
 }
 
-static void enlist_conn(Connection *c, Connection **list) {
-    LIBEVENT_THREAD *thr = c->getThread();
-    cb_assert(list == &thr->pending_io);
-    cb_assert(!list_contains(thr->pending_io, c));
-    cb_assert(c->getNext() == nullptr);
-    c->setNext(*list);
-    *list = c;
-    cb_assert(list_contains(*list, c));
-    cb_assert(!has_cycle(*list));
-}
-
 void notify_io_complete(const void *void_cookie, ENGINE_ERROR_CODE status)
 {
     if (void_cookie == nullptr) {
@@ -437,20 +502,24 @@ void notify_io_complete(const void *void_cookie, ENGINE_ERROR_CODE status)
             "notify_io_complete: connection should be bound to a thread");
     }
 
-    int notify;
-
     LOG_DEBUG(NULL,
               "Got notify from %u, status 0x%x",
               cookie->connection.getId(),
               status);
 
-    LOCK_THREAD(thr);
-    cookie->connection.setAiostat(status);
-    notify = add_conn_to_pending_io_list(&cookie->connection);
-    UNLOCK_THREAD(thr);
+    // We don't need the thread lock; the status is published to the
+    // worker thread when the connection is put in the pending io queue
+    if (cookie->isParkable()) {
+        // The command runs on a cookie of its own (and may have been
+        // parked), McbpConnection::replayParkedCommand() picks it up
+        const_cast<Cookie*>(cookie)->setNotified(status);
+    } else {
+        cookie->connection.setAiostat(status);
+    }
+    const_cast<Cookie*>(cookie)->incrementNotifications();
 
     /* kick the thread in the butt */
-    if (notify) {
+    if (add_conn_to_pending_io_list(&cookie->connection)) {
         notify_thread(thr);
     }
 }
@@ -483,6 +552,39 @@ void dispatch_conn_new(SOCKET sfd, int parent_port) {
     notify_thread(thread);
 }
 
+void dispatch_conn_local(LIBEVENT_THREAD* thread, SOCKET sfd, int parent_port) {
+    MEMCACHED_CONN_DISPATCH(sfd, (uintptr_t)thread->thread_id);
+    if (conn_new(sfd, parent_port, thread->base, thread) == nullptr) {
+        LOG_WARNING(nullptr, "Failed to dispatch event for socket %ld",
+                    long(sfd));
+        safe_close(sfd);
+    }
+}
+
+void dispatch_conn_migrate(McbpConnection& c) {
+    auto* from = c.getThread();
+    auto* to = c.completeMigration();
+    if (to != from) {
+        stats.migrated_conns++;
+        LOG_INFO(&c, "%u: Moved from worker thread %u to %u", c.getId(),
+                 from->index, to->index);
+    }
+
+    // Let the new thread register the connection in its event base and
+    // run it (see process_pending_io)
+    if (add_conn_to_pending_io_list(&c)) {
+        notify_thread(to);
+    }
+}
+
+LIBEVENT_THREAD* get_worker_thread(int index) {
+    if (index < 0 || index >= nthreads) {
+        throw std::out_of_range("get_worker_thread: invalid index " +
+                                std::to_string(index));
+    }
+    return threads + index;
+}
+
 /*
  * Returns true if this is the thread that listens for new TCP connections.
  */
@@ -571,10 +673,12 @@ void threads_cleanup(void)
         safe_close(threads[ii].notify[0]);
         safe_close(threads[ii].notify[1]);
         event_base_free(threads[ii].base);
-        threads[ii].read.reset();
-        threads[ii].write.reset();
+        delete threads[ii].buffer_pool;
+        delete threads[ii].io_vector_pool;
         subdoc_op_free(threads[ii].subdoc_op);
-        delete threads[ii].validator;
+        delete threads[ii].inflated_value_cache;
+        delete threads[ii].compressed_value_cache;
+        delete threads[ii].command_context_pool;
         delete threads[ii].new_conn_queue;
     }
 
@@ -619,14 +723,26 @@ void notify_thread(LIBEVENT_THREAD *thread) {
 }
 
 int add_conn_to_pending_io_list(Connection *c) {
-    int notify = 0;
-    auto thread = c->getThread();
-    if (number_of_pending(c, thread->pending_io) == 0) {
-        if (thread->pending_io == NULL) {
-            notify = 1;
-        }
-        enlist_conn(c, &thread->pending_io);
+    if (!c->markPendingIo()) {
+        // Already scheduled
+        return 0;
+    }
+
+    return c->getThread()->pending_io_queue.push(c) ? 1 : 0;
+}
+
+void remove_conn_from_pending_io_list(Connection *c) {
+    if (!c->isPendingIo()) {
+        return;
     }
 
-    return notify;
+    // The connection may still be in the queue; grab all of them so
+    // that we can unlink it, and make sure the rest gets run
+    auto* thr = c->getThread();
+    splice_pending_io(thr, thr->pending_io_queue.popAll());
+    thr->pending_io = list_remove(thr->pending_io, c);
+    c->clearPendingIo();
+    if (thr->pending_io != nullptr) {
+        notify_thread(thr);
+    }
 }
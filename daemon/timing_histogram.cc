@@ -104,38 +104,47 @@ void TimingHistogram::reset(void) {
     total.reset();
 }
 
-void TimingHistogram::add(const hrtime_t nsec) {
+void TimingHistogram::add(const hrtime_t nsec, const uint32_t count) {
     hrtime_t us = nsec / 1000;
     hrtime_t ms = us / 1000;
     hrtime_t hs = ms / 500;
 
     if (us == 0) {
-        ns++;
+        ns += count;
     } else if (us < 1000) {
-        usec[us / 10]++;
+        usec[us / 10] += count;
     } else if (ms < 50) {
-        msec[ms]++;
+        msec[ms] += count;
     } else if (hs < 10) {
-        halfsec[hs]++;
+        halfsec[hs] += count;
     } else {
         // [5-9], [10-19], [20-39], [40-79], [80-inf].
         hrtime_t sec = hs / 2;
         if (sec < 10) {
-            wayout[0]++;
+            wayout[0] += count;
         } else if (sec < 20) {
-            wayout[1]++;
+            wayout[1] += count;
         } else if (sec < 40) {
-            wayout[2]++;
+            wayout[2] += count;
         } else if (sec < 80) {
-            wayout[3]++;
+            wayout[3] += count;
         } else {
-            wayout[4]++;
+            wayout[4] += count;
         }
     }
-    total++;
+    total += count;
 }
 
 std::string TimingHistogram::to_string(void) {
+    auto json = to_json();
+    char *ptr = cJSON_PrintUnformatted(json.get());
+    std::string ret(ptr);
+    cJSON_Free(ptr);
+
+    return ret;
+}
+
+unique_cJSON_ptr TimingHistogram::to_json(void) {
     unique_cJSON_ptr json(cJSON_CreateObject());
     cJSON* root = json.get();
 
@@ -176,11 +185,8 @@ std::string TimingHistogram::to_string(void) {
 
     // for backwards compatibility, add the old wayouts
     cJSON_AddNumberToObject(root, "wayout", aggregate_wayout());
-    char *ptr = cJSON_PrintUnformatted(root);
-    std::string ret(ptr);
-    cJSON_Free(ptr);
 
-    return ret;
+    return json;
 }
 
 /* get functions of Timings class */
@@ -16,6 +16,7 @@
  */
 #pragma once
 
+#include <cJSON_utils.h>
 #include <platform/platform.h>
 #include <array>
 #include <relaxed_atomic.h>
@@ -40,8 +41,9 @@ public:
     TimingHistogram& operator+=(const TimingHistogram& other);
 
     void reset(void);
-    void add(const hrtime_t nsec);
+    void add(const hrtime_t nsec, const uint32_t count = 1);
     std::string to_string(void);
+    unique_cJSON_ptr to_json(void);
     uint32_t get_ns();
     uint32_t get_usec(const uint8_t index);
     uint32_t get_msec(const uint8_t index);
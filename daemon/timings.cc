@@ -15,24 +15,99 @@
  *   limitations under the License.
  */
 #include "timings.h"
+#include <cJSON.h>
 #include <memcached/protocol_binary.h>
 #include <platform/platform.h>
 #include "timing_histogram.h"
 
+#include <new>
+#include <utility>
+
+Timings::Shard::Shard() {
+    for (auto& histogram : histograms) {
+        histogram.store(nullptr);
+    }
+}
+
+Timings::Shard::~Shard() {
+    for (auto& histogram : histograms) {
+        delete histogram.load();
+    }
+}
+
+LatencyHistogram& Timings::Shard::getHistogram(uint8_t opcode) {
+    auto& slot = histograms[opcode];
+    auto* histogram = slot.load(std::memory_order_acquire);
+    if (histogram == nullptr) {
+        std::unique_ptr<LatencyHistogram> created(new LatencyHistogram);
+        if (slot.compare_exchange_strong(histogram, created.get())) {
+            histogram = created.release();
+        }
+        // Otherwise someone else beat us to it, and histogram holds theirs
+    }
+    return *histogram;
+}
+
 Timings::Timings() {
+    for (auto& shard : shards) {
+        shard.store(nullptr);
+    }
     reset();
 }
 
+Timings::~Timings() {
+    for (auto& shard : shards) {
+        delete shard.load();
+    }
+}
+
 Timings& Timings::operator=(const Timings& other) {
-    timings = other.timings;
+    reset();
+    for (size_t ii = 0; ii < MaxShards; ++ii) {
+        auto* shard = other.shards[ii].load(std::memory_order_acquire);
+        if (shard == nullptr) {
+            continue;
+        }
+        for (int op = 0; op < MAX_NUM_OPCODES; ++op) {
+            auto* histogram =
+                    shard->histograms[op].load(std::memory_order_acquire);
+            if (histogram != nullptr) {
+                getShard(ii).getHistogram(uint8_t(op)) += *histogram;
+            }
+        }
+    }
     interval_latency_lookups = other.interval_latency_lookups;
     interval_latency_mutations = other.interval_latency_mutations;
     return *this;
 }
 
+Timings::Shard& Timings::getShard(size_t thread) {
+    auto& slot = shards[thread % MaxShards];
+    auto* shard = slot.load(std::memory_order_acquire);
+    if (shard == nullptr) {
+        std::unique_ptr<Shard> created(new Shard);
+        if (slot.compare_exchange_strong(shard, created.get())) {
+            shard = created.release();
+        }
+        // Otherwise someone else beat us to it, and shard holds theirs
+    }
+    return *shard;
+}
+
 void Timings::reset(void) {
-    for (int ii = 0; ii < MAX_NUM_OPCODES; ++ii) {
-        timings[ii].reset();
+    // We don't release the histograms as the worker threads may be
+    // using them
+    for (auto& slot : shards) {
+        auto* shard = slot.load(std::memory_order_acquire);
+        if (shard == nullptr) {
+            continue;
+        }
+        for (auto& histogram : shard->histograms) {
+            auto* ptr = histogram.load(std::memory_order_acquire);
+            if (ptr != nullptr) {
+                ptr->reset();
+            }
+        }
     }
 
     {
@@ -42,15 +117,38 @@ void Timings::reset(void) {
     }
 }
 
-void Timings::collect(const uint8_t opcode, const hrtime_t nsec) {
-    timings[opcode].add(nsec);
-    auto& interval = interval_counters[opcode];
+void Timings::collect(const size_t thread,
+                      const uint8_t opcode,
+                      const hrtime_t nsec) {
+    auto& shard = getShard(thread);
+    shard.getHistogram(opcode).add(nsec);
+    auto& interval = shard.interval_counters[opcode];
     interval.count++;
     interval.duration_ns += nsec;
 }
 
+void Timings::merge(const uint8_t opcode, LatencyHistogram& histogram) const {
+    for (const auto& slot : shards) {
+        auto* shard = slot.load(std::memory_order_acquire);
+        if (shard == nullptr) {
+            continue;
+        }
+        auto* ptr = shard->histograms[opcode].load(std::memory_order_acquire);
+        if (ptr != nullptr) {
+            histogram += *ptr;
+        }
+    }
+}
+
 std::string Timings::generate(const uint8_t opcode) {
-    return timings[opcode].to_string();
+    LatencyHistogram histogram;
+    merge(opcode, histogram);
+    auto json = histogram.to_json();
+
+    char* ptr = cJSON_PrintUnformatted(json.get());
+    std::string ret(ptr);
+    cJSON_Free(ptr);
+    return ret;
 }
 
 static const uint8_t timings_mutations[] = {
@@ -93,6 +191,7 @@ static const uint8_t timings_retrievals[] = {
     PROTOCOL_BINARY_CMD_GETKQ,
     PROTOCOL_BINARY_CMD_GETQ,
     PROTOCOL_BINARY_CMD_GET_LOCKED,
+    PROTOCOL_BINARY_CMD_GET_MULTI,
     PROTOCOL_BINARY_CMD_GET_RANDOM_KEY,
     PROTOCOL_BINARY_CMD_GET_REPLICA,
     PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP,
@@ -100,22 +199,32 @@ static const uint8_t timings_retrievals[] = {
     PROTOCOL_BINARY_CMD_SUBDOC_EXISTS};
 
 
-uint64_t Timings::get_aggregated_mutation_stats() {
-
+uint64_t Timings::get_aggregated_total(const uint8_t* opcodes, size_t num) {
     uint64_t ret = 0;
-    for (auto cmd : timings_mutations) {
-        ret += timings[cmd].get_total();
+    for (const auto& slot : shards) {
+        auto* shard = slot.load(std::memory_order_acquire);
+        if (shard == nullptr) {
+            continue;
+        }
+        for (size_t ii = 0; ii < num; ++ii) {
+            auto* ptr = shard->histograms[opcodes[ii]].load(
+                    std::memory_order_acquire);
+            if (ptr != nullptr) {
+                ret += ptr->getCount();
+            }
+        }
     }
     return ret;
 }
 
-uint64_t Timings::get_aggregated_retrival_stats() {
+uint64_t Timings::get_aggregated_mutation_stats() {
+    return get_aggregated_total(timings_mutations,
+                                sizeof(timings_mutations));
+}
 
-    uint64_t ret = 0;
-    for (auto cmd : timings_retrievals) {
-        ret += timings[cmd].get_total();
-    }
-    return ret;
+uint64_t Timings::get_aggregated_retrival_stats() {
+    return get_aggregated_total(timings_retrievals,
+                                sizeof(timings_retrievals));
 }
 
 cb::sampling::Interval Timings::get_interval_mutation_latency() {
@@ -131,14 +240,22 @@ cb::sampling::Interval Timings::get_interval_lookup_latency() {
 void Timings::sample(std::chrono::seconds sample_interval) {
     cb::sampling::Interval interval_lookup, interval_mutation;
 
-    for (auto op : timings_mutations) {
-        interval_mutation += interval_counters[op];
-        interval_counters[op].reset();
-    }
+    for (const auto& slot : shards) {
+        auto* shard = slot.load(std::memory_order_acquire);
+        if (shard == nullptr) {
+            continue;
+        }
+        auto& interval_counters = shard->interval_counters;
+
+        for (auto op : timings_mutations) {
+            interval_mutation += interval_counters[op];
+            interval_counters[op].reset();
+        }
 
-    for (auto op : timings_retrievals) {
-        interval_lookup += interval_counters[op];
-        interval_counters[op].reset();
+        for (auto op : timings_retrievals) {
+            interval_lookup += interval_counters[op];
+            interval_counters[op].reset();
+        }
     }
 
     {
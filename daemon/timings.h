@@ -18,10 +18,13 @@
 
 #include <platform/platform.h>
 #include <array>
+#include <atomic>
 #include <string>
+#include <memory>
 #include <mutex>
 #include <cstdint>
 
+#include "latency_histogram.h"
 #include "timing_histogram.h"
 #include "timing_interval.h"
 
@@ -29,15 +32,30 @@
 
 /** Records timings for each memcached opcode. Each opcode has a histogram of
  * times.
+ *
+ * To avoid having all of the worker threads updating the same counters
+ * every thread records the timings in a shard of its own (allocated the
+ * first time the thread records a timing). The shards are merged when
+ * the timings are requested.
  */
 class Timings {
 public:
     Timings(void);
+    ~Timings();
     Timings& operator=(const Timings& other);
     Timings(const Timings&) = delete;
 
     void reset(void);
-    void collect(const uint8_t opcode, const hrtime_t nsec);
+
+    /**
+     * Record the timing for a command
+     *
+     * @param thread the index of the worker thread executing the command
+     * @param opcode the command
+     * @param nsec the duration of the command
+     */
+    void collect(const size_t thread, const uint8_t opcode,
+                 const hrtime_t nsec);
     void sample(std::chrono::seconds sample_interval);
     std::string generate(const uint8_t opcode);
     uint64_t get_aggregated_mutation_stats();
@@ -46,7 +64,35 @@ public:
     cb::sampling::Interval get_interval_mutation_latency();
     cb::sampling::Interval get_interval_lookup_latency();
 
+    /**
+     * Merge the histograms from all of the threads for the given opcode
+     *
+     * @param opcode the command to get the histogram for
+     * @param histogram where to add the samples
+     */
+    void merge(const uint8_t opcode, LatencyHistogram& histogram) const;
+
+    /// The maximum number of shards (threads with a higher index share
+    /// the shard with the threads with index % MaxShards)
+    static const size_t MaxShards = 64;
+
 private:
+    struct Shard {
+        Shard();
+        ~Shard();
+
+        /// Get the histogram for the opcode (allocating it if needed)
+        LatencyHistogram& getHistogram(uint8_t opcode);
+
+        std::array<std::atomic<LatencyHistogram*>, MAX_NUM_OPCODES> histograms;
+        std::array<cb::sampling::Interval, MAX_NUM_OPCODES> interval_counters;
+    };
+
+    /// Get the shard for the thread (allocating it if needed)
+    Shard& getShard(size_t thread);
+
+    uint64_t get_aggregated_total(const uint8_t* opcodes, size_t num);
+
     // This lock is only held by sample() and some blocks within generate().
     // It guards the various IntervalSeries variables which internally
     // contain cb::RingBuffer objects which are not thread safe.
@@ -54,6 +100,5 @@ private:
 
     cb::sampling::IntervalSeries interval_latency_lookups;
     cb::sampling::IntervalSeries interval_latency_mutations;
-    std::array<TimingHistogram, MAX_NUM_OPCODES> timings;
-    std::array<cb::sampling::Interval, MAX_NUM_OPCODES> interval_counters;
+    std::array<std::atomic<Shard*>, MaxShards> shards;
 };
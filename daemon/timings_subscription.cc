@@ -0,0 +1,218 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "timings_subscription.h"
+#include "buckets.h"
+#include "executorpool.h"
+#include "log_macros.h"
+#include "mc_time.h"
+#include "memcached.h"
+#include "server_event.h"
+
+#include <mcbp/protocol/framebuilder.h>
+#include <mcbp/protocol/opcode.h>
+#include <stdexcept>
+
+std::atomic<size_t> TimingsSubscription::numSubscriptions{0};
+std::atomic<bool> TimingsNotificationTask::scheduled{false};
+
+TimingsSubscription::TimingsSubscription(rel_time_t interval_,
+                                         std::vector<std::string> buckets_,
+                                         std::vector<uint8_t> opcodes_)
+    : interval(interval_),
+      next(mc_time_get_current_time() + interval_),
+      buckets(std::move(buckets_)),
+      opcodes(std::move(opcodes_)) {
+    if (interval == 0 || buckets.empty() || opcodes.empty()) {
+        throw std::invalid_argument(
+                "TimingsSubscription: interval, buckets and opcodes must be "
+                "specified");
+    }
+
+    // Use what we've got so far as the starting point, so that the first
+    // notification only contains the samples from the first interval
+    sample();
+    numSubscriptions++;
+}
+
+TimingsSubscription::~TimingsSubscription() {
+    numSubscriptions--;
+}
+
+bool TimingsSubscription::schedule(rel_time_t now) {
+    if (now < next) {
+        return false;
+    }
+    next = now + interval;
+    return true;
+}
+
+bool TimingsSubscription::sample(const std::string& bucket,
+                                 uint8_t opcode,
+                                 LatencyHistogram& histogram) {
+    LatencyHistogram current;
+    bool found = false;
+    // The aggregated timings is stored in index 0 (no bucket)
+    if (bucket == "/all/") {
+        all_buckets[0].timings.merge(opcode, current);
+        found = true;
+    } else {
+        for (size_t ii = 1; ii < all_buckets.size() && !found; ++ii) {
+            // Need the lock to get the bucket state and name
+            std::lock_guard<std::mutex> guard(all_buckets[ii].mutex);
+            if ((all_buckets[ii].state == BucketState::Ready) &&
+                (bucket == all_buckets[ii].name)) {
+                all_buckets[ii].timings.merge(opcode, current);
+                found = true;
+            }
+        }
+    }
+
+    auto& prev = previous[{bucket, opcode}];
+    if (!found) {
+        // Start over if the bucket is created again
+        prev.reset();
+        return false;
+    }
+
+    if (!prev) {
+        prev = std::make_unique<LatencyHistogram>();
+    }
+    histogram += current;
+    histogram -= *prev;
+    prev->reset();
+    *prev += current;
+    return true;
+}
+
+std::vector<std::pair<std::string, std::string>>
+TimingsSubscription::sample() {
+    std::vector<std::pair<std::string, std::string>> ret;
+    for (const auto& bucket : buckets) {
+        unique_cJSON_ptr timings(cJSON_CreateObject());
+        bool found = true;
+        for (const auto opcode : opcodes) {
+            LatencyHistogram histogram;
+            if (!sample(bucket, opcode, histogram)) {
+                found = false;
+                break;
+            }
+            cJSON_AddItemToObject(
+                    timings.get(),
+                    to_string(cb::mcbp::ClientOpcode(opcode)).c_str(),
+                    histogram.to_json().release());
+        }
+
+        if (found) {
+            unique_cJSON_ptr json(cJSON_CreateObject());
+            cJSON_AddNumberToObject(json.get(), "interval", interval);
+            cJSON_AddItemToObject(json.get(), "timings", timings.release());
+            ret.emplace_back(bucket, to_string(json, false));
+        }
+    }
+    return ret;
+}
+
+void TimingsSubscription::notifySubscribers() {
+    if (numSubscriptions == 0) {
+        return;
+    }
+    if (TimingsNotificationTask::scheduled.exchange(true)) {
+        // The previous run isn't done yet
+        return;
+    }
+
+    std::shared_ptr<Task> task = std::make_shared<TimingsNotificationTask>();
+    std::lock_guard<std::mutex> guard(task->getMutex());
+    executorPool->schedule(task, true);
+}
+
+class TimingsNotificationServerEvent : public ServerEvent {
+public:
+    std::string getDescription() const override {
+        return "TimingsNotificationServerEvent";
+    }
+
+    bool execute(Connection& connection) override {
+        auto* subscription = connection.getTimingsSubscription();
+        if (subscription == nullptr) {
+            // The client unsubscribed after we scheduled the event
+            return true;
+        }
+
+        auto& conn = dynamic_cast<McbpConnection&>(connection);
+        const auto notifications = subscription->sample();
+        if (notifications.empty()) {
+            return true;
+        }
+
+        using namespace cb::mcbp;
+        size_t total = 0;
+        for (const auto& n : notifications) {
+            total += sizeof(Request) + n.first.size() + n.second.size();
+        }
+        conn.write->ensureCapacity(total);
+        conn.addMsgHdr(true);
+
+        // The key is the name of the bucket and the value the timings
+        for (const auto& n : notifications) {
+            const size_t needed =
+                    sizeof(Request) + n.first.size() + n.second.size();
+            FrameBuilder<Request> builder(conn.write->wdata());
+            builder.setMagic(Magic::ServerRequest);
+            builder.setDatatype(cb::mcbp::Datatype::JSON);
+            builder.setOpcode(ServerOpcode::TimingsNotification);
+            builder.setKey({reinterpret_cast<const uint8_t*>(n.first.data()),
+                            n.first.size()});
+            builder.setValue(
+                    {reinterpret_cast<const uint8_t*>(n.second.data()),
+                     n.second.size()});
+            conn.addIov(conn.write->wdata().data(), needed);
+            conn.write->produced(needed);
+        }
+
+        conn.setState(conn_send_data);
+        conn.setWriteAndGo(conn_new_cmd);
+        return true;
+    }
+};
+
+Task::Status TimingsNotificationTask::execute() {
+    const auto now = mc_time_get_current_time();
+
+    // See CccpNotificationTask::execute; no one else is using the task
+    getMutex().unlock();
+    try {
+        iterate_all_connections([now](Connection& c) -> void {
+            auto* subscription = c.getTimingsSubscription();
+            if (subscription == nullptr || !subscription->schedule(now)) {
+                return;
+            }
+
+            c.enqueueServerEvent(
+                    std::make_unique<TimingsNotificationServerEvent>());
+            c.signalIfIdle(false, 0);
+        });
+    } catch (const std::exception& e) {
+        LOG_WARNING(nullptr,
+                    "TimingsNotificationTask::execute: received exception: %s",
+                    e.what());
+    }
+    getMutex().lock();
+
+    scheduled = false;
+    return Status::Finished;
+}
@@ -0,0 +1,128 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include "latency_histogram.h"
+#include "task.h"
+
+#include <memcached/types.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A TimingsSubscription lets a (duplex) connection have the server push
+ * the command timings to it, instead of fetching (and diffing) the
+ * cumulative histograms with GET_CMD_TIMER over and over again.
+ *
+ * Every interval the connection is sent a TimingsNotification message
+ * per bucket, with the histograms of the samples recorded since the
+ * previous message (or since the subscription was made) for each of the
+ * opcodes subscribed to.
+ *
+ * The subscription is made with ioctl_set of
+ *
+ *     timings.subscribe?buckets=<bucket>[,<bucket>]&opcodes=<op>[,<op>]
+ *
+ * with the interval (in seconds) as the value ("/all/" being the
+ * aggregated timings of all of the buckets), and removed with
+ * timings.unsubscribe.
+ */
+class TimingsSubscription {
+public:
+    /**
+     * Create a new subscription, with the timings recorded up until now
+     * as the starting point
+     *
+     * @throws std::invalid_argument if no interval, bucket or opcode is
+     *         specified
+     */
+    TimingsSubscription(rel_time_t interval_,
+                        std::vector<std::string> buckets_,
+                        std::vector<uint8_t> opcodes_);
+
+    TimingsSubscription(const TimingsSubscription&) = delete;
+
+    ~TimingsSubscription();
+
+    /**
+     * Check if it is time to send the next notifications, and if so
+     * move on to the next interval (so that the notifications are only
+     * scheduled once).
+     */
+    bool schedule(rel_time_t now);
+
+    /**
+     * Get the samples recorded since the previous call.
+     *
+     * @return the name of the bucket and the JSON document to send for
+     *         each of the buckets (which still exist)
+     */
+    std::vector<std::pair<std::string, std::string>> sample();
+
+    /**
+     * Schedule the task telling the connections with a subscription which
+     * is due to send their notifications (called by the clock once a
+     * second, after the timings are sampled). It is a noop unless there
+     * are any subscriptions.
+     */
+    static void notifySubscribers();
+
+protected:
+    /**
+     * Find the (ready) bucket with the given name and get the samples of
+     * the opcode recorded since the previous call.
+     *
+     * @return false if the bucket doesn't exist (anymore)
+     */
+    bool sample(const std::string& bucket,
+                uint8_t opcode,
+                LatencyHistogram& histogram);
+
+    const rel_time_t interval;
+    rel_time_t next;
+    const std::vector<std::string> buckets;
+    const std::vector<uint8_t> opcodes;
+
+    /// The histograms at the time of the previous sample, per bucket and
+    /// opcode
+    std::map<std::pair<std::string, uint8_t>,
+             std::unique_ptr<LatencyHistogram>>
+            previous;
+
+    /// The number of subscriptions (so that the clock doesn't schedule
+    /// the task for nothing)
+    static std::atomic<size_t> numSubscriptions;
+};
+
+/**
+ * The TimingsNotificationTask walks all of the connections and notifies
+ * the ones with a subscription which is due to push their timings (when
+ * they go back to idle).
+ */
+class TimingsNotificationTask : public Task {
+public:
+    Status execute() override;
+
+    /// Set while the task is scheduled (so that a slow run doesn't make
+    /// the clock pile up tasks)
+    static std::atomic<bool> scheduled;
+};
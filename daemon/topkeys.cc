@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <platform/platform.h>
+#include <unordered_map>
 
 #include "topkeys.h"
 
@@ -31,12 +32,21 @@
  *
  * === TopKeys ===
  *
- * The TopKeys class is split into NUM_SHARDS shards, each which owns
- * 1/NUM_SHARDS of the keyspace. This is to allow some level of
- * concurrent access - each shard has a mutex guarding all access.
- * Other than that the TopKeys class is pretty uninteresting - it
- * simply passes on requests to the correct Shard, and when statistics
- * are requested it aggregates information from each shard.
+ * The TopKeys class has one Collector per worker thread, so that the
+ * threads don't contend with each other when updating the keys. Each
+ * Collector is split into NUM_SHARDS shards, each which owns
+ * 1/NUM_SHARDS of the keyspace - each shard has a mutex guarding all
+ * access, which is only contended by a stats call. Other than that the
+ * TopKeys class is pretty uninteresting - it simply passes on requests
+ * to the correct Shard of the calling thread's Collector, and when
+ * statistics are requested it merges the same shard of each Collector
+ * (summing the access counts of a key seen by multiple threads and
+ * keeping the most used keys) before aggregating information from each
+ * shard.
+ *
+ * With a sample rate of N the Collector only passes on one in N
+ * accesses (on average) to the shards, with a weight of N. The
+ * accesses skipped just decrement a thread-local countdown.
  *
  * === TopKeys::Shard ===
  *
@@ -88,16 +98,31 @@
  */
 
 
-TopKeys::TopKeys(int mkeys) {
-    for (auto& shard : shards) {
-        shard.setMaxKeys(mkeys);
+TopKeys::TopKeys(int mkeys, size_t nthreads)
+    : max_keys(size_t(mkeys)) {
+    if (nthreads == 0) {
+        nthreads = 1;
+    }
+    for (size_t ii = 0; ii < nthreads; ++ii) {
+        collectors.emplace_back(new Collector);
+        for (auto& shard : collectors.back()->shards) {
+            shard.setMaxKeys(mkeys);
+        }
     }
 }
 
 TopKeys::~TopKeys() {
 }
 
-TopKeys::Shard& TopKeys::getShard(size_t key_hash) {
+uint32_t TopKeys::Collector::nextInterval(uint32_t rate) {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    // Uniform in [1, 2 * rate - 1]
+    return 1 + random % (2 * rate - 1);
+}
+
+TopKeys::Shard& TopKeys::Collector::getShard(size_t key_hash) {
     /* This is special-cased for 8 */
     static_assert(NUM_SHARDS == 8,
                   "Topkeys::getShard() special-cased for SHARDS==8");
@@ -123,7 +148,8 @@ TopKeys::Shard::searchForKey(size_t key_hash,
 
 bool TopKeys::Shard::updateKey(const cb::const_char_buffer& key,
                                size_t key_hash,
-                               const rel_time_t ct) {
+                               const rel_time_t ct,
+                               uint32_t weight) {
     try {
         std::lock_guard<std::mutex> lock(mutex);
 
@@ -162,7 +188,7 @@ bool TopKeys::Shard::updateKey(const cb::const_char_buffer& key,
         }
 
         // Increment access count.
-        found_key->second.ti_access_count++;
+        found_key->second.ti_access_count += weight;
         return true;
 
     } catch (const std::bad_alloc&) {
@@ -171,9 +197,11 @@ bool TopKeys::Shard::updateKey(const cb::const_char_buffer& key,
     }
 }
 
-void TopKeys::doUpdateKey(const void* key,
+void TopKeys::doUpdateKey(Collector& collector,
+                          const void* key,
                           size_t nkey,
-                          rel_time_t operation_time) {
+                          rel_time_t operation_time,
+                          uint32_t weight) {
     cb_assert(key);
     cb_assert(nkey > 0);
 
@@ -182,7 +210,8 @@ void TopKeys::doUpdateKey(const void* key,
         std::hash<cb::const_char_buffer > hash_fn;
         const size_t key_hash = hash_fn(key_buf);
 
-        getShard(key_hash).updateKey(key_buf, key_hash, operation_time);
+        collector.getShard(key_hash).updateKey(
+                key_buf, key_hash, operation_time, weight);
     } catch (const std::bad_alloc&) {
         // Failed to increment topkeys, continue...
     }
@@ -251,8 +280,8 @@ ENGINE_ERROR_CODE TopKeys::doStats(const void* cookie,
                                    ADD_STAT add_stat) {
     struct tk_context context(cookie, add_stat, current_time, nullptr);
 
-    for (auto& shard : shards) {
-        shard.accept_visitor(tk_iterfunc, &context);
+    for (size_t ii = 0; ii < size_t(NUM_SHARDS); ++ii) {
+        accept_visitor(ii, tk_iterfunc, &context);
     }
 
     return ENGINE_SUCCESS;
@@ -274,8 +303,8 @@ ENGINE_ERROR_CODE TopKeys::do_json_stats(cJSON* object,
     struct tk_context context(nullptr, nullptr, current_time, topkeys);
 
     /* Collate the topkeys JSON object */
-    for (auto& shard : shards) {
-        shard.accept_visitor(tk_jsonfunc, &context);
+    for (size_t ii = 0; ii < size_t(NUM_SHARDS); ++ii) {
+        accept_visitor(ii, tk_jsonfunc, &context);
     }
 
     cJSON_AddItemToObject(object, "topkeys", topkeys);
@@ -289,3 +318,51 @@ void TopKeys::Shard::accept_visitor(iterfunc_t visitor_func,
         visitor_func(key->first.key, key->second, visitor_ctx);
     }
 }
+
+/*
+ * The keys of one shard merged from all of the collectors, in the order
+ * we first saw them.
+ */
+struct tk_merged {
+    std::vector<std::pair<std::string, topkey_item_t>> keys;
+    std::unordered_map<std::string, size_t> index;
+};
+
+static void tk_mergefunc(const std::string& key, const topkey_item_t& it,
+                         void* arg) {
+    auto* merged = static_cast<tk_merged*>(arg);
+    auto iter = merged->index.find(key);
+    if (iter == merged->index.end()) {
+        merged->index.emplace(key, merged->keys.size());
+        merged->keys.emplace_back(key, it);
+    } else {
+        auto& item = merged->keys[iter->second].second;
+        item.ti_access_count += it.ti_access_count;
+        item.ti_ctime = std::min(item.ti_ctime, it.ti_ctime);
+    }
+}
+
+void TopKeys::accept_visitor(size_t shard,
+                             Shard::iterfunc_t visitor_func,
+                             void* visitor_ctx) {
+    tk_merged merged;
+    for (auto& collector : collectors) {
+        collector->shards[shard].accept_visitor(tk_mergefunc, &merged);
+    }
+
+    auto& keys = merged.keys;
+    if (keys.size() > max_keys) {
+        std::stable_sort(keys.begin(),
+                         keys.end(),
+                         [](const std::pair<std::string, topkey_item_t>& a,
+                            const std::pair<std::string, topkey_item_t>& b) {
+                             return a.second.ti_access_count >
+                                    b.second.ti_access_count;
+                         });
+        keys.erase(keys.begin() + max_keys, keys.end());
+    }
+
+    for (const auto& key : keys) {
+        visitor_func(key.first, key.second, visitor_ctx);
+    }
+}
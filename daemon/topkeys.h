@@ -24,6 +24,8 @@
 #include <memcached/engine.h>
 #include <cJSON.h>
 
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <list>
 #include <string>
@@ -35,6 +37,11 @@
  * Tracks the top N most recently accessed keys. The details are
  * accessible by a stats call, which is used by ns_server to print the
  * top keys list in the GUI.
+ *
+ * Each worker thread records the keys it accesses in its own set of
+ * shards, and the sets are merged when the stats are requested. With a
+ * "topkeys_sample_rate" of N only one in (on average) N accesses is
+ * recorded, and it is counted as N accesses.
  */
 
 struct topkey_item_t {
@@ -53,13 +60,31 @@ public:
     /* Constructor.
      * @param mkeys Number of keys stored in each shard (i.e. up to
      * mkeys * SHARDS will be tracked).
+     * @param nthreads Number of threads updating the keys (each thread
+     * records its accesses separately)
      */
-    explicit TopKeys(int mkeys);
+    explicit TopKeys(int mkeys, size_t nthreads = 1);
     ~TopKeys();
 
-    void updateKey(const void* key, size_t nkey, rel_time_t operation_time) {
+    /**
+     * Record an access to a key
+     *
+     * @param key the key accessed
+     * @param nkey the length of the key
+     * @param operation_time the time of the access
+     * @param thread the index of the thread accessing the key
+     */
+    void updateKey(const void* key,
+                   size_t nkey,
+                   rel_time_t operation_time,
+                   size_t thread = 0) {
         if (settings.isTopkeysEnabled()) {
-            doUpdateKey(key, nkey, operation_time);
+            auto& collector = *collectors[thread % collectors.size()];
+            const auto weight =
+                    collector.sample(settings.getTopkeysSampleRate());
+            if (weight != 0) {
+                doUpdateKey(collector, key, nkey, operation_time, weight);
+            }
         }
     }
 
@@ -96,7 +121,13 @@ public:
     }
 
 protected:
-    void doUpdateKey(const void* key, size_t nkey, rel_time_t operation_time);
+    class Collector;
+
+    void doUpdateKey(Collector& collector,
+                     const void* key,
+                     size_t nkey,
+                     rel_time_t operation_time,
+                     uint32_t weight);
 
     ENGINE_ERROR_CODE doStats(const void* cookie,
                               rel_time_t current_time,
@@ -111,7 +142,8 @@ private:
 
     class Shard;
 
-    Shard& getShard(size_t key_hash);
+    // Number of keys to report for each shard
+    const size_t max_keys;
 
     // One of N Shards which the keyspace has been broken
     // into.
@@ -126,7 +158,8 @@ private:
             list.clear();
         }
 
-        // Updates the topkey 'ranking' for the specified key.
+        // Updates the topkey 'ranking' for the specified key, adding
+        // weight to its access count.
         // If the item does not exist it will be created (with it's creation
         // time set to operation_time), otherwise the existing item will be
         // updated.
@@ -134,7 +167,8 @@ private:
         // new item, returns false.
         bool updateKey(const cb::const_char_buffer& key,
                        size_t key_hash,
-                       rel_time_t operation_time);
+                       rel_time_t operation_time,
+                       uint32_t weight);
 
         typedef void (*iterfunc_t)(const std::string& key,
                                    const topkey_item_t& it,
@@ -178,6 +212,58 @@ private:
         key_storage_t storage;
     };
 
-    // array of topkey shards.
-    std::array<Shard, NUM_SHARDS> shards;
+protected:
+    // The keys recorded by one thread. Only the owning thread updates
+    // the collector, so its shard mutexes are only contended when the
+    // stats are requested.
+    class Collector {
+    public:
+        /**
+         * Decide if we should record the current access
+         *
+         * @param rate the sample rate
+         * @return 0 if the access should be skipped, otherwise the number
+         *         of accesses it represents
+         */
+        uint32_t sample(uint32_t rate) {
+            if (rate <= 1) {
+                return 1;
+            }
+            // Only the owning thread writes the countdown
+            const auto left = countdown.load(std::memory_order_relaxed);
+            if (left > 1) {
+                countdown.store(left - 1, std::memory_order_relaxed);
+                return 0;
+            }
+            countdown.store(nextInterval(rate), std::memory_order_relaxed);
+            return rate;
+        }
+
+        Shard& getShard(size_t key_hash);
+
+        // array of topkey shards.
+        std::array<Shard, NUM_SHARDS> shards;
+
+    private:
+        // Pick the number of accesses until the next sample. The interval
+        // is random (with a mean of rate) so that we don't keep missing
+        // the keys of a regular access pattern.
+        uint32_t nextInterval(uint32_t rate);
+
+        // Number of accesses left until the next sample
+        std::atomic<uint32_t> countdown{0};
+
+        // xorshift state used to pick the sample intervals
+        uint32_t random = 2463534242u;
+    };
+
+private:
+    // Merge the shard with the given index from each of the collectors,
+    // and invoke the visitor for the (at most) max_keys most used keys.
+    void accept_visitor(size_t shard,
+                        Shard::iterfunc_t visitor_func,
+                        void* visitor_ctx);
+
+    // The collector of each thread
+    std::vector<std::unique_ptr<Collector>> collectors;
 };
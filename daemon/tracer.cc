@@ -0,0 +1,80 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "tracer.h"
+
+#include <platform/timeutils.h>
+
+#include <stdexcept>
+
+std::string cb::tracing::to_string(TraceCode code) {
+    switch (code) {
+    case TraceCode::Request:
+        return "request";
+    case TraceCode::Validate:
+        return "validate";
+    case TraceCode::Rbac:
+        return "rbac";
+    case TraceCode::Engine:
+        return "engine";
+    case TraceCode::Ewouldblock:
+        return "ewouldblock";
+    case TraceCode::SendQueue:
+        return "send_queue";
+    case TraceCode::Count:
+        break;
+    }
+    throw std::invalid_argument("cb::tracing::to_string: invalid code: " +
+                                std::to_string(int(code)));
+}
+
+ProcessClock::duration cb::tracing::Tracer::getDuration(TraceCode code) const {
+    auto ret = durations[index(code)];
+    if (isActive(code)) {
+        ret += ProcessClock::now() - start[index(code)];
+    }
+    return ret;
+}
+
+bool cb::tracing::Tracer::empty() const {
+    for (size_t ii = 0; ii < Size; ++ii) {
+        if (start[ii] != ProcessClock::time_point() ||
+            durations[ii] != ProcessClock::duration::zero()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string cb::tracing::Tracer::to_string() const {
+    std::string ret;
+    for (size_t ii = 0; ii < Size; ++ii) {
+        const auto code = TraceCode(ii);
+        const auto duration = getDuration(code);
+        if (duration == ProcessClock::duration::zero()) {
+            continue;
+        }
+        if (!ret.empty()) {
+            ret.push_back(' ');
+        }
+        ret.append(cb::tracing::to_string(code));
+        ret.push_back('=');
+        ret.append(cb::time2text(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        duration)));
+    }
+    return ret;
+}
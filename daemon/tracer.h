@@ -0,0 +1,133 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/processclock.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace cb {
+namespace tracing {
+
+/**
+ * The phases of a request we keep track of. The time spent waiting for
+ * the engine to complete a background fetch is part of Ewouldblock as
+ * the core can't tell why the engine blocked.
+ */
+enum class TraceCode : uint8_t {
+    /// From the request is picked up until the response is queued
+    Request,
+    /// Validating the packet
+    Validate,
+    /// Checking the privileges of the connection
+    Rbac,
+    /// Calls into the engine
+    Engine,
+    /// Waiting for the engine to notify an EWOULDBLOCK
+    Ewouldblock,
+    /// Until the response is handed to the socket
+    SendQueue,
+    /// The number of trace codes (not a legal code)
+    Count
+};
+
+std::string to_string(TraceCode code);
+
+/**
+ * The Tracer records the time spent in each phase of a request. A phase
+ * may be entered multiple times (a command blocking twice or calling
+ * the engine multiple times) in which case the total is recorded.
+ *
+ * The Tracer lives in the Cookie and is only accessed from the worker
+ * thread running the connection, so it doesn't need any locking.
+ */
+class Tracer {
+public:
+    /// Start timing a phase (restarting it if it is running)
+    void begin(TraceCode code) {
+        start[index(code)] = ProcessClock::now();
+    }
+
+    /// Stop timing a phase and add the time to its total
+    void end(TraceCode code) {
+        auto& begin = start[index(code)];
+        if (begin != ProcessClock::time_point()) {
+            durations[index(code)] += ProcessClock::now() - begin;
+            begin = ProcessClock::time_point();
+        }
+    }
+
+    /// Is the phase currently being timed
+    bool isActive(TraceCode code) const {
+        return start[index(code)] != ProcessClock::time_point();
+    }
+
+    /// Get the total time recorded for a phase (including the time it
+    /// has been running if it is active)
+    ProcessClock::duration getDuration(TraceCode code) const;
+
+    /// Has anything been recorded (or is anything being recorded)
+    bool empty() const;
+
+    void clear() {
+        start.fill(ProcessClock::time_point());
+        durations.fill(ProcessClock::duration::zero());
+    }
+
+    /**
+     * Get a textual representation of the phases with time recorded
+     * (for instance for the slow command log):
+     *
+     *     request=2 ms validate=250 ns engine=1200 us
+     */
+    std::string to_string() const;
+
+private:
+    static size_t index(TraceCode code) {
+        return size_t(code);
+    }
+
+    static const size_t Size = size_t(TraceCode::Count);
+    std::array<ProcessClock::time_point, Size> start{};
+    std::array<ProcessClock::duration, Size> durations{};
+};
+
+/**
+ * Time the current scope as the given phase
+ */
+class ScopedSpan {
+public:
+    ScopedSpan(Tracer& tracer_, TraceCode code_)
+        : tracer(tracer_), code(code_) {
+        tracer.begin(code);
+    }
+
+    ~ScopedSpan() {
+        tracer.end(code);
+    }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+
+private:
+    Tracer& tracer;
+    const TraceCode code;
+};
+
+} // namespace tracing
+} // namespace cb
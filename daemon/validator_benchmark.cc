@@ -0,0 +1,159 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmark the cost of validating the header of a request.
+ *
+ * FunctionChainValidator is the old scheme: each opcode has a chain of
+ * validator functions (stored as std::function) inspecting the packet.
+ * FrameSpecValidator checks the header against the FrameSpec of the
+ * opcode, which is what McbpValidatorChains does for the opcodes which
+ * may be validated by the header alone.
+ */
+
+#include "frame_spec.h"
+#include "function_chain.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstring>
+
+using Header = protocol_binary_request_header;
+
+/// The validators as they looked before the frame specs
+static protocol_binary_response_status get_validator(const Header& header) {
+    const auto& req = header.request;
+    uint16_t klen = ntohs(req.keylen);
+    uint32_t blen = ntohl(req.bodylen);
+
+    if (req.magic != PROTOCOL_BINARY_REQ || req.extlen != 0 || klen == 0 ||
+        klen != blen || req.datatype != PROTOCOL_BINARY_RAW_BYTES ||
+        req.cas != 0) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
+static protocol_binary_response_status set_validator(const Header& header) {
+    const auto& req = header.request;
+    auto datatype = req.datatype;
+
+    if (req.magic != PROTOCOL_BINARY_REQ || req.extlen != 8 ||
+        req.keylen == 0 || mcbp::datatype::is_xattr(datatype) ||
+        !mcbp::datatype::is_valid(datatype)) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
+class FunctionChainValidator {
+public:
+    FunctionChainValidator() {
+        push(PROTOCOL_BINARY_CMD_GET, get_validator);
+        push(PROTOCOL_BINARY_CMD_SET, set_validator);
+    }
+
+    protocol_binary_response_status validate(const Header& header) const {
+        return chains[header.request.opcode].invoke(header);
+    }
+
+private:
+    void push(protocol_binary_command command,
+              protocol_binary_response_status (*f)(const Header&)) {
+        chains[command].push_unique(
+                makeFunction<protocol_binary_response_status,
+                             PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                             const Header&>(f));
+    }
+
+    std::array<FunctionChain<protocol_binary_response_status,
+                             PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                             const Header&>,
+               0x100>
+            chains;
+};
+
+class FrameSpecValidator {
+public:
+    FrameSpecValidator() : specs() {
+        using Key = FrameSpec::Key;
+        using Cas = FrameSpec::Cas;
+        specs[PROTOCOL_BINARY_CMD_GET] = {
+                true, 0, Key::Required, false, 0, Cas::Zero};
+        specs[PROTOCOL_BINARY_CMD_SET] = {
+                true,
+                8,
+                Key::Required,
+                true,
+                PROTOCOL_BINARY_DATATYPE_JSON | PROTOCOL_BINARY_DATATYPE_SNAPPY,
+                Cas::Any};
+    }
+
+    protocol_binary_response_status validate(const Header& header) const {
+        if (!specs[header.request.opcode].validate(header)) {
+            return PROTOCOL_BINARY_RESPONSE_EINVAL;
+        }
+        return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    }
+
+private:
+    std::array<FrameSpec, 0x100> specs;
+};
+
+/// Alternate between a GET and a SET request to avoid a perfectly
+/// predicted single opcode
+static std::array<Header, 2> makeRequests() {
+    std::array<Header, 2> requests;
+    std::memset(requests.data(), 0, sizeof(Header) * requests.size());
+
+    auto& get = requests[0].request;
+    get.magic = PROTOCOL_BINARY_REQ;
+    get.opcode = PROTOCOL_BINARY_CMD_GET;
+    get.keylen = htons(10);
+    get.bodylen = htonl(10);
+
+    auto& set = requests[1].request;
+    set.magic = PROTOCOL_BINARY_REQ;
+    set.opcode = PROTOCOL_BINARY_CMD_SET;
+    set.extlen = 8;
+    set.keylen = htons(10);
+    set.bodylen = htonl(118);
+    set.datatype = PROTOCOL_BINARY_DATATYPE_JSON;
+    return requests;
+}
+
+template <typename Validator>
+void ValidatorBenchmark(benchmark::State& state) {
+    const Validator validator;
+    const auto requests = makeRequests();
+    size_t ii = 0;
+
+    while (state.KeepRunning()) {
+        const auto& header = requests[ii++ & 1];
+        benchmark::DoNotOptimize(&header);
+        auto status = validator.validate(header);
+        benchmark::DoNotOptimize(status);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(ValidatorBenchmark, FunctionChainValidator);
+BENCHMARK_TEMPLATE(ValidatorBenchmark, FrameSpecValidator);
+
+BENCHMARK_MAIN()
@@ -287,6 +287,8 @@ ENGINE_ERROR_CODE create_instance(uint64_t interface,
     engine->engine.remove = item_delete;
     engine->engine.release = item_release;
     engine->engine.get = get;
+    engine->engine.get_multi = nullptr;
+    engine->engine.get_meta_multi = nullptr;
     engine->engine.get_if = get_if;
     engine->engine.get_and_touch = get_and_touch;
     engine->engine.get_locked = get_locked;
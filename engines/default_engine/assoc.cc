@@ -4,12 +4,15 @@
  *
  */
 #include "config.h"
+#include <array>
+#include <atomic>
 #include <fcntl.h>
 #include <errno.h>
 #include <mutex>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <platform/cacheline_padded.h>
 #include <platform/platform.h>
 #include <platform/crc32c.h>
 #include <platform/strerror.h>
@@ -20,13 +23,26 @@
 #define hashsize(n) ((size_t)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 
+/*
+ * The hashtable is shared by all the buckets, so rather than one mutex, a
+ * bucket of the table is guarded by the stripe of its low bits. As the table
+ * never has fewer than hashsize(stripe_power + 1) buckets, the stripe of a
+ * key is the same in the old and the primary table, and an old bucket is
+ * moved to primary buckets of its own stripe.
+ */
+static const unsigned int stripe_power = 10;
+#define stripe_of(hash) ((hash) & hashmask(stripe_power))
+
 struct Assoc {
     Assoc(unsigned int hp) : hashpower(hp) {
         primary_hashtable.resize(hashsize(hashpower));
     }
 
-    /* how many powers of 2's worth of buckets we use */
-    unsigned int hashpower;
+    /*
+     * how many powers of 2's worth of buckets we use. Changed with all the
+     * stripes locked.
+     */
+    std::atomic<unsigned int> hashpower;
 
 
     /* Main hash table. This is where we look except during expansion. */
@@ -39,21 +55,59 @@ struct Assoc {
     std::vector<hash_item*> old_hashtable;
 
     /* Number of items in the hash table. */
-    unsigned int hash_items{0};
+    std::atomic<unsigned int> hash_items{0};
 
-    /* Flag: Are we in the middle of expanding now? */
-    bool expanding{false};
+    /*
+     * Flag: Are we in the middle of expanding now? Set and cleared with all
+     * the stripes locked.
+     */
+    std::atomic<bool> expanding{false};
 
     /*
      * During expansion we migrate values with bucket granularity; this is how
      * far we've gotten so far. Ranges from 0 .. hashsize(hashpower - 1) - 1.
+     * Moved on by one with the stripe of the bucket migrated locked, which
+     * doesn't change whether the buckets of the other stripes are migrated.
      */
-    unsigned int expand_bucket{0};
+    std::atomic<unsigned int> expand_bucket{0};
 
     /*
-     * serialise access to the hashtable
+     * serialise access to the buckets of each stripe. Locking them all (in
+     * order) gives access to the whole table.
      */
-    std::mutex mutex;
+    std::array<cb::CachelinePadded<std::mutex>, hashsize(stripe_power)>
+            stripes;
+
+    std::mutex& stripe(uint32_t hash) {
+        return *stripes[stripe_of(hash)];
+    }
+
+    void lock_all() {
+        for (auto& s : stripes) {
+            s->lock();
+        }
+    }
+
+    void unlock_all() {
+        for (auto& s : stripes) {
+            s->unlock();
+        }
+    }
+};
+
+/* Holds all the stripes of the table for its scope */
+class AllStripesGuard {
+public:
+    explicit AllStripesGuard(Assoc& a) : assoc(a) {
+        assoc.lock_all();
+    }
+
+    ~AllStripesGuard() {
+        assoc.unlock_all();
+    }
+
+private:
+    Assoc& assoc;
 };
 
 /* One hashtable for all */
@@ -98,7 +152,7 @@ hash_item *assoc_find(uint32_t hash, const hash_key *key) {
     unsigned int oldbucket;
     hash_item *ret = NULL;
     int depth = 0;
-    std::lock_guard<std::mutex> guard(global_assoc->mutex);
+    std::lock_guard<std::mutex> guard(global_assoc->stripe(hash));
     if (global_assoc->expanding &&
         (oldbucket = (hash & hashmask(global_assoc->hashpower - 1))) >= global_assoc->expand_bucket)
     {
@@ -126,7 +180,7 @@ hash_item *assoc_find(uint32_t hash, const hash_key *key) {
 /*
     returns the address of the item pointer before the key.  if *item == 0,
     the item wasn't found
-    assoc->lock is assumed to be held by the caller.
+    the stripe of the hash is assumed to be held by the caller.
 */
 static hash_item** _hashitem_before(uint32_t hash, const hash_key* key) {
     hash_item **pos;
@@ -159,7 +213,7 @@ static void assoc_maintenance_thread(void *arg);
 
 /*
     grows the hashtable to the next power of 2.
-    assoc->lock is assumed to be held by the caller.
+    all the stripes are assumed to be held by the caller.
 */
 static void assoc_expand() {
     global_assoc->old_hashtable.swap(global_assoc->primary_hashtable);
@@ -201,7 +255,7 @@ int assoc_insert(uint32_t hash, hash_item *it) {
 
     cb_assert(assoc_find(hash, item_get_key(it)) == 0);  /* shouldn't have duplicately named things defined */
 
-    std::lock_guard<std::mutex> guard(global_assoc->mutex);
+    std::unique_lock<std::mutex> guard(global_assoc->stripe(hash));
     if (global_assoc->expanding &&
         (oldbucket = (hash & hashmask(global_assoc->hashpower - 1))) >= global_assoc->expand_bucket)
     {
@@ -212,27 +266,36 @@ int assoc_insert(uint32_t hash, hash_item *it) {
         global_assoc->primary_hashtable[hash & hashmask(global_assoc->hashpower)] = it;
     }
 
-    global_assoc->hash_items++;
-    if (! global_assoc->expanding && global_assoc->hash_items > (hashsize(global_assoc->hashpower) * 3) / 2) {
-        assoc_expand();
+    unsigned int items = ++global_assoc->hash_items;
+    MEMCACHED_ASSOC_INSERT(hash_key_get_key(item_get_key(it)), hash_key_get_key_len(item_get_key(it)), items);
+    guard.unlock();
+
+    if (!global_assoc->expanding &&
+        items > (hashsize(global_assoc->hashpower) * 3) / 2) {
+        /* Check again once the whole table is ours */
+        AllStripesGuard all(*global_assoc);
+        if (!global_assoc->expanding &&
+            global_assoc->hash_items >
+                    (hashsize(global_assoc->hashpower) * 3) / 2) {
+            assoc_expand();
+        }
     }
-    MEMCACHED_ASSOC_INSERT(hash_key_get_key(item_get_key(it)), hash_key_get_key_len(item_get_key(it)), global_assoc->hash_items);
     return 1;
 }
 
 void assoc_delete(uint32_t hash, const hash_key *key) {
-    std::lock_guard<std::mutex> guard(global_assoc->mutex);
+    std::lock_guard<std::mutex> guard(global_assoc->stripe(hash));
     hash_item **before = _hashitem_before(hash, key);
 
     if (*before) {
         hash_item *nxt;
-        global_assoc->hash_items--;
+        unsigned int items = --global_assoc->hash_items;
         /* The DTrace probe cannot be triggered as the last instruction
          * due to possible tail-optimization by the compiler
          */
         MEMCACHED_ASSOC_DELETE(hash_key_get_key(key),
                                hash_key_get_key_len(key),
-                               global_assoc->hash_items);
+                               items);
         nxt = (*before)->h_next;
         (*before)->h_next = 0;   /* probably pointless, but whatever. */
         *before = nxt;
@@ -252,13 +315,15 @@ static void assoc_maintenance_thread(void *arg) {
     bool done = false;
     do {
         int ii;
-        std::lock_guard<std::mutex> guard(global_assoc->mutex);
 
-        for (ii = 0; ii < hash_bulk_move && global_assoc->expanding; ++ii) {
+        for (ii = 0; ii < hash_bulk_move && !done; ++ii) {
             hash_item *it, *next;
             int bucket;
+            const unsigned int old_bucket = global_assoc->expand_bucket;
+            std::lock_guard<std::mutex> guard(
+                    global_assoc->stripe(old_bucket));
 
-            for (it = global_assoc->old_hashtable[global_assoc->expand_bucket];
+            for (it = global_assoc->old_hashtable[old_bucket];
                  NULL != it; it = next) {
                 next = it->h_next;
                 const hash_key* key = item_get_key(it);
@@ -269,25 +334,25 @@ static void assoc_maintenance_thread(void *arg) {
                 global_assoc->primary_hashtable[bucket] = it;
             }
 
-            global_assoc->old_hashtable[global_assoc->expand_bucket] = NULL;
+            global_assoc->old_hashtable[old_bucket] = NULL;
             global_assoc->expand_bucket++;
             if (global_assoc->expand_bucket == hashsize(global_assoc->hashpower - 1)) {
-                global_assoc->expanding = false;
-                global_assoc->old_hashtable.resize(0);
-                global_assoc->old_hashtable.shrink_to_fit();
-                if (logger != nullptr) {
-                    logger->log(EXTENSION_LOG_INFO, NULL,
-                                "Hash table expansion done");
-                }
+                done = true;
             }
         }
-        if (!global_assoc->expanding) {
-            done = true;
-        }
     } while (!done);
+
+    /* No one may look at the old table while it goes */
+    AllStripesGuard all(*global_assoc);
+    global_assoc->expanding = false;
+    global_assoc->old_hashtable.resize(0);
+    global_assoc->old_hashtable.shrink_to_fit();
+    if (logger != nullptr) {
+        logger->log(EXTENSION_LOG_INFO, NULL,
+                    "Hash table expansion done");
+    }
 }
 
 bool assoc_expanding() {
-    std::lock_guard<std::mutex> guard(global_assoc->mutex);
     return global_assoc->expanding;
 }
@@ -106,8 +106,36 @@ void AccessRandomItems(benchmark::State& state) {
     }
 }
 
-BENCHMARK(AccessSingleItem)->ThreadRange(1, 16);
-BENCHMARK(AccessRandomItems)->ThreadRange(1, 16);
+/*
+ * Each thread unlinks and links back random items of its own (in the engine
+ * the items lock keeps two threads off the same key), so that the count of
+ * items doesn't change (and the table doesn't grow)
+ */
+void RelinkRandomItems(benchmark::State& state) {
+    std::random_device rd;
+    std::minstd_rand0 gen(rd());
+    std::uniform_int_distribution<uint32_t> dis;
+    const uint32_t threads = state.threads;
+    const uint32_t mine = max_items / threads;
+
+    while (state.KeepRunning()) {
+        uint32_t id = (dis(gen) % mine) * threads + state.thread_index;
+        hash_key hkey;
+        hash_key_create(&hkey, id);
+        auto hash = crc32c(hash_key_get_key(&hkey),
+                           hash_key_get_key_len(&hkey), 0);
+        auto* it = assoc_find(hash, &hkey);
+        if (it == nullptr) {
+            throw std::logic_error("RelinkRandomItems: Expected to find key");
+        }
+        assoc_delete(hash, &hkey);
+        assoc_insert(hash, it);
+    }
+}
+
+BENCHMARK(AccessSingleItem)->ThreadRange(1, 32);
+BENCHMARK(AccessRandomItems)->ThreadRange(1, 32);
+BENCHMARK(RelinkRandomItems)->ThreadRange(1, 32);
 
 int main(int argc, char** argv) {
     ::benchmark::Initialize(&argc, argv);
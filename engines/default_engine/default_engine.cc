@@ -16,6 +16,9 @@
 #include <platform/cb_malloc.h>
 #include "engines/default_engine.h"
 #include "engine_manager.h"
+#include "expiry_scrubber.h"
+#include "lru_maintainer.h"
+#include "slab_mover.h"
 
 // The default engine don't really use vbucket uuids, but in order
 // to run the unit tests and verify that we correctly convert the
@@ -187,9 +190,11 @@ void default_engine_constructor(struct default_engine* engine, bucket_id_t id)
     engine->engine.remove = default_item_delete;
     engine->engine.release = default_item_release;
     engine->engine.get = default_get;
+    engine->engine.get_multi = nullptr;
     engine->engine.get_if = default_get_if;
     engine->engine.get_locked = default_get_locked;
     engine->engine.get_meta = default_get_meta;
+    engine->engine.get_meta_multi = nullptr;
     engine->engine.get_and_touch = default_get_and_touch;
     engine->engine.unlock = default_unlock;
     engine->engine.get_stats = default_get_stats;
@@ -211,6 +216,10 @@ void default_engine_constructor(struct default_engine* engine, bucket_id_t id)
     engine->config.chunk_size = 48;
     engine->config.item_size_max= 1024 * 1024;
     engine->config.xattr_enabled = true;
+    engine->config.slab_automove = false;
+    engine->config.scrub_interval = 0;
+    engine->config.scrub_budget = 10000;
+    engine->config.hugepages = false;
     engine->info.engine.description = "Default engine v0.1";
     engine->info.engine.num_features = 1;
     engine->info.engine.features[0].feature = ENGINE_FEATURE_LRU;
@@ -276,9 +285,30 @@ static ENGINE_ERROR_CODE default_initialize(ENGINE_HANDLE* handle,
       return ret;
    }
 
+   try {
+      se->lru_maintainer = new LruMaintainer(*se);
+      if (se->config.slab_automove) {
+         se->slab_mover = new SlabMover(*se);
+      }
+      if (se->config.scrub_interval != 0) {
+         se->expiry_scrubber = new ExpiryScrubber(*se);
+      }
+   } catch (const std::exception&) {
+      return ENGINE_FAILED;
+   }
+
    return ENGINE_SUCCESS;
 }
 
+void stop_engine_tasks(struct default_engine* engine) {
+    delete engine->slab_mover;
+    engine->slab_mover = nullptr;
+    delete engine->lru_maintainer;
+    engine->lru_maintainer = nullptr;
+    delete engine->expiry_scrubber;
+    engine->expiry_scrubber = nullptr;
+}
+
 static void default_destroy(ENGINE_HANDLE* handle, const bool force) {
     (void)force;
     engine_manager_delete_engine(get_handle(handle));
@@ -286,6 +316,8 @@ static void default_destroy(ENGINE_HANDLE* handle, const bool force) {
 
 void destroy_engine_instance(struct default_engine* engine) {
     if (engine->initialized) {
+        stop_engine_tasks(engine);
+
         /* Destory the slabs cache */
         slabs_destroy(engine);
 
@@ -658,6 +690,15 @@ static ENGINE_ERROR_CODE default_get_stats(ENGINE_HANDLE* handle,
          len = sprintf(val, "%" PRIu64, engine->scrubber.cleaned);
          add_stat("scrubber:cleaned", 16, val, len, cookie);
       }
+
+      if (engine->config.scrub_interval != 0) {
+         len = sprintf(val, "%" PRIu64, engine->scrubber.expiry_visited);
+         add_stat("scrubber:expiry_visited", 23, val, len, cookie);
+         len = sprintf(val, "%" PRIu64, engine->scrubber.expiry_cleaned);
+         add_stat("scrubber:expiry_cleaned", 23, val, len, cookie);
+         len = sprintf(val, "%" PRIu64, engine->scrubber.expiry_passes);
+         add_stat("scrubber:expiry_passes", 22, val, len, cookie);
+      }
       cb_mutex_exit(&engine->scrubber.lock);
    } else {
       ret = ENGINE_KEY_ENOENT;
@@ -760,7 +801,7 @@ static ENGINE_ERROR_CODE initalize_configuration(struct default_engine *se,
    se->config.vb0 = true;
 
    if (cfg_str != NULL) {
-       struct config_item items[13];
+       struct config_item items[17];
        int ii = 0;
 
        memset(&items, 0, sizeof(items));
@@ -823,9 +864,29 @@ static ENGINE_ERROR_CODE initalize_configuration(struct default_engine *se,
        items[ii].value.dt_bool = &se->config.keep_deleted;
        ++ii;
 
+       items[ii].key = "slab_automove";
+       items[ii].datatype = DT_BOOL;
+       items[ii].value.dt_bool = &se->config.slab_automove;
+       ++ii;
+
+       items[ii].key = "scrub_interval";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.scrub_interval;
+       ++ii;
+
+       items[ii].key = "scrub_budget";
+       items[ii].datatype = DT_SIZE;
+       items[ii].value.dt_size = &se->config.scrub_budget;
+       ++ii;
+
+       items[ii].key = "hugepages";
+       items[ii].datatype = DT_BOOL;
+       items[ii].value.dt_bool = &se->config.hugepages;
+       ++ii;
+
        items[ii].key = NULL;
        ++ii;
-       cb_assert(ii == 13);
+       cb_assert(ii == 17);
        ret = ENGINE_ERROR_CODE(se->server.core->parse_config(cfg_str,
                                                              items,
                                                              stderr));
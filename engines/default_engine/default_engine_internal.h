@@ -32,6 +32,9 @@
 
 /* Forward decl */
 struct default_engine;
+class SlabMover;
+class LruMaintainer;
+class ExpiryScrubber;
 
 #include "trace.h"
 #include "items.h"
@@ -47,6 +50,9 @@ struct default_engine;
 /** The item is deleted (may only be accessed if explicitly asked for) */
 #define ITEM_ZOMBIE (4)
 
+/** The item was hit since the LRU maintainer last moved it */
+#define ITEM_ACTIVE (8)
+
 struct config {
    size_t verbose;
    rel_time_t oldest_live;
@@ -61,6 +67,13 @@ struct config {
    char *uuid;
    bool keep_deleted;
    std::atomic<bool> xattr_enabled;
+   bool slab_automove;
+   /* Seconds between the runs of the expiry scrubber (0 disables it) */
+   size_t scrub_interval;
+   /* The number of items the expiry scrubber visits in each run */
+   size_t scrub_budget;
+   /* Allocate the slab pages from huge pages (where available) */
+   bool hugepages;
 };
 
 /**
@@ -83,6 +96,10 @@ struct engine_scrubber {
    time_t stopped;
    bool running;
    bool force_delete;
+   /* Totals of the runs of the expiry scrubber */
+   uint64_t expiry_visited;
+   uint64_t expiry_cleaned;
+   uint64_t expiry_passes;
 };
 
 struct vbucket_info {
@@ -113,6 +130,21 @@ struct default_engine {
    struct engine_stats stats;
    struct engine_scrubber scrubber;
 
+   /**
+    * Moves slab pages between the slab classes (if slab_automove is set)
+    */
+   SlabMover* slab_mover;
+
+   /**
+    * Moves the items between the segments of the LRU
+    */
+   LruMaintainer* lru_maintainer;
+
+   /**
+    * Unlinks the expired items a few at a time (if scrub_interval is set)
+    */
+   ExpiryScrubber* expiry_scrubber;
+
    union {
        engine_info engine;
        char buffer[sizeof(engine_info) +
@@ -139,6 +171,13 @@ void destroy_engine(void);
 void default_engine_constructor(struct default_engine* engine, bucket_id_t id);
 void destroy_engine_instance(struct default_engine* engine);
 
+/*
+ * Stop the background tasks of the engine (the LRU maintainer, the slab
+ * mover and the expiry scrubber), which must not run while the scrubber
+ * deletes its items.
+ */
+void stop_engine_tasks(struct default_engine* engine);
+
 #ifdef __cplusplus
 }
 #endif
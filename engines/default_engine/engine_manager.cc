@@ -67,6 +67,7 @@ struct default_engine* EngineManager::createEngine() {
 void EngineManager::requestDestroyEngine(struct default_engine* engine) {
     std::lock_guard<std::mutex> lck(lock);
     if (!shuttingdown) {
+        stop_engine_tasks(engine);
         scrubberTask.placeOnWorkQueue(engine, true);
     }
 }
@@ -117,6 +118,7 @@ void EngineManager::shutdown() {
         if (!engines.empty()) {
             // Tell it to go ahead and scrub all engines
             for (auto engine : engines) {
+                stop_engine_tasks(engine);
                 scrubberTask.placeOnWorkQueue(engine, true);
             }
 
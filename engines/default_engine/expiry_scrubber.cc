@@ -0,0 +1,71 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "expiry_scrubber.h"
+
+#include <stdexcept>
+
+static void expiry_scrubber_main(void* arg) {
+    ExpiryScrubber* scrubber = reinterpret_cast<ExpiryScrubber*>(arg);
+    scrubber->run();
+}
+
+ExpiryScrubber::ExpiryScrubber(struct default_engine& engine)
+    : engine(engine) {
+    item_scrub_cursor_init(&cursor);
+    if (cb_create_named_thread(&thread, &expiry_scrubber_main, this, 0,
+                               "mc:expiry scrub") != 0) {
+        throw std::runtime_error("Error creating 'mc:expiry scrub' thread");
+    }
+}
+
+ExpiryScrubber::~ExpiryScrubber() {
+    {
+        std::lock_guard<std::mutex> lck(lock);
+        shuttingdown = true;
+        cvar.notify_one();
+    }
+    cb_join_thread(thread);
+    item_scrub_cursor_release(&engine, &cursor);
+}
+
+void ExpiryScrubber::run() {
+    const std::chrono::seconds interval(engine.config.scrub_interval);
+    const auto budget = unsigned(engine.config.scrub_budget);
+    std::unique_lock<std::mutex> lck(lock);
+    while (!shuttingdown) {
+        cvar.wait_for(lck, interval, [this] { return shuttingdown; });
+        if (shuttingdown) {
+            break;
+        }
+
+        // Run the task without holding the lock
+        lck.unlock();
+        uint64_t visited;
+        uint64_t cleaned;
+        const bool completed = item_scrub_expired(
+                &engine, &cursor, budget, &visited, &cleaned);
+
+        cb_mutex_enter(&engine.scrubber.lock);
+        engine.scrubber.expiry_visited += visited;
+        engine.scrubber.expiry_cleaned += cleaned;
+        if (completed) {
+            engine.scrubber.expiry_passes++;
+        }
+        cb_mutex_exit(&engine.scrubber.lock);
+        lck.lock();
+    }
+}
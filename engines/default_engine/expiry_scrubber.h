@@ -0,0 +1,68 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <platform/platform.h>
+
+#include "default_engine_internal.h"
+
+/**
+ * The expiry scrubber unlinks the expired items of an engine in the
+ * background, so that their memory is given back without waiting for
+ * them to be read, to reach the tail of their LRU or for a scrub to be
+ * requested.
+ *
+ * Every scrub_interval seconds it visits the next scrub_budget items (see
+ * item_scrub_expired), so that a pass over all of the items takes a number
+ * of runs and the front-end threads never wait for the items lock for
+ * longer than it takes to visit a few hundred items.
+ *
+ * Only runs for engines configured with a non-zero scrub_interval.
+ */
+class ExpiryScrubber {
+public:
+    ExpiryScrubber(struct default_engine& engine);
+
+    /// Stop and join the thread
+    ~ExpiryScrubber();
+
+    /**
+     * Task's run loop method. This is not a public function and should only
+     * be called from the tasks constructor.
+     */
+    void run();
+
+private:
+    struct default_engine& engine;
+
+    /// Where the previous run stopped
+    struct item_scrub_cursor cursor;
+
+    /** Is the task being requested to shut down? */
+    bool shuttingdown = false;
+
+    /** Protects shuttingdown */
+    std::mutex lock;
+
+    /** Used to wake the task up when shutting down */
+    std::condition_variable cvar;
+
+    cb_thread_t thread;
+};
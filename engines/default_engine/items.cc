@@ -49,12 +49,6 @@ static bool hash_key_create(hash_key* hkey,
 static void hash_key_destroy(hash_key* hkey);
 static void hash_key_copy_to_item(hash_item* dst, const hash_key* src);
 
-/*
- * We only reposition items in the LRU queue if they haven't been repositioned
- * in this many seconds. That saves us from churning on frequently-accessed
- * items.
- */
-#define ITEM_UPDATE_INTERVAL 60
 /*
  * To avoid scanning through the complete cache in some circumstances we'll
  * just give up and return an error after inspecting a fixed number of objects.
@@ -68,6 +62,34 @@ void item_stats_reset(struct default_engine *engine) {
 }
 
 
+/* The scrubber walks the LRU with cursors (items without key or value) */
+static bool item_is_cursor(const hash_item *it) {
+    return item_get_key(it)->header.len == 0 && it->nbytes == 0;
+}
+
+/*
+ * Search up from the tail of the segments of the LRU of the slab class
+ * (COLD first, as it holds the least recently used items) for an item
+ * accepted by pred, and give up after search_items tries per segment
+ */
+template <typename Pred>
+static hash_item *do_item_search_tails(struct default_engine *engine,
+                                       unsigned int id, Pred pred) {
+    static const lru_segment_t order[] = {COLD_LRU, WARM_LRU, HOT_LRU};
+    for (const auto lru : order) {
+        hash_item *search;
+        int tries = search_items;
+        for (search = engine->items.tails[lru_id(id, lru)];
+             tries > 0 && search != NULL;
+             tries--, search = search->prev) {
+            if (pred(search)) {
+                return search;
+            }
+        }
+    }
+    return NULL;
+}
+
 /* warning: don't use these macros with a function, as it evals its arg twice */
 static size_t ITEM_ntotal(struct default_engine *engine,
                           const hash_item *item) {
@@ -118,7 +140,7 @@ hash_item *do_item_alloc(struct default_engine *engine,
     oldest_live = engine->config.oldest_live;
     current_time = engine->server.core->get_current_time();
 
-    for (search = engine->items.tails[id];
+    for (search = engine->items.tails[lru_id(id, COLD_LRU)];
          tries > 0 && search != NULL;
          tries--, search=search->prev) {
         if (search->refcount == 0 &&
@@ -161,41 +183,41 @@ hash_item *do_item_alloc(struct default_engine *engine,
         }
 
         /*
-         * try to get one off the right LRU
+         * try to get one off the right LRU (starting with COLD)
          * don't necessariuly unlink the tail because it may be locked: refcount>0
          * search up from tail an item with refcount==0 and unlink it; give up after search_items
          * tries
          */
-
-        if (engine->items.tails[id] == 0) {
-            engine->items.itemstats[id].outofmemory++;
-            return NULL;
-        }
-
-        for (search = engine->items.tails[id]; tries > 0 && search != NULL; tries--, search=search->prev) {
-            if (search->refcount == 0 && search->locktime <= current_time) {
-                if (search->exptime == 0 || search->exptime > current_time) {
-                    engine->items.itemstats[id].evicted++;
-                    engine->items.itemstats[id].evicted_time = current_time - search->time;
-                    if (search->exptime != 0) {
-                        engine->items.itemstats[id].evicted_nonzero++;
-                    }
-                    cb_mutex_enter(&engine->stats.lock);
-                    engine->stats.evictions++;
-                    cb_mutex_exit(&engine->stats.lock);
-                    const hash_key* search_key = item_get_key(search);
-                    engine->server.stat->evicting(cookie,
-                                                  hash_key_get_client_key(search_key),
-                                                  hash_key_get_client_key_len(search_key));
-                } else {
-                    engine->items.itemstats[id].reclaimed++;
-                    cb_mutex_enter(&engine->stats.lock);
-                    engine->stats.reclaimed++;
-                    cb_mutex_exit(&engine->stats.lock);
+        search = do_item_search_tails(engine, id,
+                                      [current_time](hash_item* item) {
+            return item->refcount == 0 && item->locktime <= current_time;
+        });
+        if (search != NULL) {
+            if (search->exptime == 0 || search->exptime > current_time) {
+                engine->items.itemstats[id].evicted++;
+                engine->items.itemstats[id].evicted_time = current_time - search->time;
+                if (search->exptime != 0) {
+                    engine->items.itemstats[id].evicted_nonzero++;
                 }
-                do_item_unlink(engine, search);
-                break;
+                cb_mutex_enter(&engine->stats.lock);
+                engine->stats.evictions++;
+                cb_mutex_exit(&engine->stats.lock);
+                const hash_key* search_key = item_get_key(search);
+                engine->server.stat->evicting(cookie,
+                                              hash_key_get_client_key(search_key),
+                                              hash_key_get_client_key_len(search_key));
+            } else {
+                engine->items.itemstats[id].reclaimed++;
+                cb_mutex_enter(&engine->stats.lock);
+                engine->stats.reclaimed++;
+                cb_mutex_exit(&engine->stats.lock);
             }
+            do_item_unlink(engine, search);
+        } else if (engine->items.tails[lru_id(id, HOT_LRU)] == 0 &&
+                   engine->items.tails[lru_id(id, WARM_LRU)] == 0 &&
+                   engine->items.tails[lru_id(id, COLD_LRU)] == 0) {
+            engine->items.itemstats[id].outofmemory++;
+            return NULL;
         }
         it = static_cast<hash_item*>(slabs_alloc(engine, ntotal, id));
         if (it == 0) {
@@ -207,14 +229,15 @@ hash_item *do_item_alloc(struct default_engine *engine,
              * three hours, so if we find one in the tail which is that old,
              * free it anyway.
              */
-            tries = search_items;
-            for (search = engine->items.tails[id]; tries > 0 && search != NULL; tries--, search=search->prev) {
-                if (search->refcount != 0 && search->time + TAIL_REPAIR_TIME < current_time) {
-                    engine->items.itemstats[id].tailrepairs++;
-                    search->refcount = 0;
-                    do_item_unlink(engine, search);
-                    break;
-                }
+            search = do_item_search_tails(engine, id,
+                                          [current_time](hash_item* item) {
+                return item->refcount != 0 &&
+                       item->time + TAIL_REPAIR_TIME < current_time;
+            });
+            if (search != NULL) {
+                engine->items.itemstats[id].tailrepairs++;
+                search->refcount = 0;
+                do_item_unlink(engine, search);
             }
             it = static_cast<hash_item*>(slabs_alloc(engine, ntotal, id));
             if (it == 0) {
@@ -227,12 +250,13 @@ hash_item *do_item_alloc(struct default_engine *engine,
 
     it->slabs_clsid = id;
 
-    cb_assert(it != engine->items.heads[it->slabs_clsid]);
+    cb_assert(it != engine->items.heads[lru_id(it->slabs_clsid, HOT_LRU)]);
 
     it->next = it->prev = it->h_next = 0;
     it->refcount = 1;     /* the caller will have a reference */
     DEBUG_REFCNT(it, '*');
     it->iflag = 0;
+    it->lru = HOT_LRU;
     it->nbytes = nbytes;
     it->flags = flags;
     it->datatype = datatype;
@@ -246,8 +270,8 @@ static void item_free(struct default_engine *engine, hash_item *it) {
     size_t ntotal = ITEM_ntotal(engine, it);
     unsigned int clsid;
     cb_assert((it->iflag & ITEM_LINKED) == 0);
-    cb_assert(it != engine->items.heads[it->slabs_clsid]);
-    cb_assert(it != engine->items.tails[it->slabs_clsid]);
+    cb_assert(it != engine->items.heads[lru_id(it->slabs_clsid, it->lru)]);
+    cb_assert(it != engine->items.tails[lru_id(it->slabs_clsid, it->lru)]);
     cb_assert(it->refcount == 0 || engine->scrubber.force_delete);
 
     /* so slab size changer can tell later if item is already free or not */
@@ -261,10 +285,12 @@ static void item_free(struct default_engine *engine, hash_item *it) {
 static void item_link_q(struct default_engine *engine, hash_item *it) { /* item is the new head */
     hash_item **head, **tail;
     cb_assert(it->slabs_clsid < POWER_LARGEST);
+    cb_assert(it->lru < NUM_LRUS);
     cb_assert((it->iflag & ITEM_SLABBED) == 0);
 
-    head = &engine->items.heads[it->slabs_clsid];
-    tail = &engine->items.tails[it->slabs_clsid];
+    const unsigned int id = lru_id(it->slabs_clsid, it->lru);
+    head = &engine->items.heads[id];
+    tail = &engine->items.tails[id];
     cb_assert(it != *head);
     cb_assert((*head && *tail) || (*head == 0 && *tail == 0));
     it->prev = 0;
@@ -272,15 +298,17 @@ static void item_link_q(struct default_engine *engine, hash_item *it) { /* item
     if (it->next) it->next->prev = it;
     *head = it;
     if (*tail == 0) *tail = it;
-    engine->items.sizes[it->slabs_clsid]++;
+    engine->items.sizes[id]++;
     return;
 }
 
 static void item_unlink_q(struct default_engine *engine, hash_item *it) {
     hash_item **head, **tail;
     cb_assert(it->slabs_clsid < POWER_LARGEST);
-    head = &engine->items.heads[it->slabs_clsid];
-    tail = &engine->items.tails[it->slabs_clsid];
+    cb_assert(it->lru < NUM_LRUS);
+    const unsigned int id = lru_id(it->slabs_clsid, it->lru);
+    head = &engine->items.heads[id];
+    tail = &engine->items.tails[id];
 
     if (*head == it) {
         cb_assert(it->prev == 0);
@@ -295,10 +323,18 @@ static void item_unlink_q(struct default_engine *engine, hash_item *it) {
 
     if (it->next) it->next->prev = it->prev;
     if (it->prev) it->prev->next = it->next;
-    engine->items.sizes[it->slabs_clsid]--;
+    engine->items.sizes[id]--;
     return;
 }
 
+/* Move the item to the head of the segment lru of its LRU */
+static void do_item_lru_move(struct default_engine *engine, hash_item *it,
+                             lru_segment_t lru) {
+    item_unlink_q(engine, it);
+    it->lru = lru;
+    item_link_q(engine, it);
+}
+
 int do_item_link(struct default_engine *engine,
                  const void* cookie,
                  hash_item *it) {
@@ -337,6 +373,7 @@ int do_item_link(struct default_engine *engine,
         return 0;
     }
 
+    it->lru = HOT_LRU;
     item_link_q(engine, it);
 
     return 1;
@@ -414,18 +451,17 @@ void do_item_release(struct default_engine *engine, hash_item *it) {
 }
 
 void do_item_update(struct default_engine *engine, hash_item *it) {
-    rel_time_t current_time = engine->server.core->get_current_time();
     MEMCACHED_ITEM_UPDATE(hash_key_get_client_key(item_get_key(it)),
                           hash_key_get_client_key_len(item_get_key(it)),
                           it->nbytes);
-    if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
-        cb_assert((it->iflag & ITEM_SLABBED) == 0);
+    cb_assert((it->iflag & ITEM_SLABBED) == 0);
 
-        if ((it->iflag & ITEM_LINKED) != 0) {
-            item_unlink_q(engine, it);
-            it->time = current_time;
-            item_link_q(engine, it);
-        }
+    /*
+     * Leave the LRU alone, the LRU maintainer moves the item when it gets
+     * to it (and we don't write to the item if it is already flagged)
+     */
+    if ((it->iflag & ITEM_ACTIVE) == 0) {
+        it->iflag |= ITEM_ACTIVE;
     }
 }
 
@@ -450,45 +486,68 @@ static void do_item_stats(struct default_engine *engine,
     int i;
     rel_time_t current_time = engine->server.core->get_current_time();
     for (i = 0; i < POWER_LARGEST; i++) {
-        if (engine->items.tails[i] != NULL) {
-            const char *prefix = "items";
+        const char *prefix = "items";
+        unsigned int number = 0;
+        /* The next item to evict (the oldest in COLD, if any) */
+        hash_item *oldest = NULL;
+        int lru;
+
+        for (lru = COLD_LRU; lru >= HOT_LRU; lru--) {
+            const unsigned int id = lru_id(i, lru);
             int search = search_items;
             while (search > 0 &&
-                   engine->items.tails[i] != NULL &&
+                   engine->items.tails[id] != NULL &&
                    ((engine->config.oldest_live != 0 && /* Item flushd */
                      engine->config.oldest_live <= current_time &&
-                     engine->items.tails[i]->time <= engine->config.oldest_live) ||
-                    (engine->items.tails[i]->exptime != 0 && /* and not expired */
-                     engine->items.tails[i]->exptime < current_time))) {
+                     engine->items.tails[id]->time <= engine->config.oldest_live) ||
+                    (engine->items.tails[id]->exptime != 0 && /* and not expired */
+                     engine->items.tails[id]->exptime < current_time))) {
                 --search;
-                if (engine->items.tails[i]->refcount == 0) {
-                    do_item_unlink(engine, engine->items.tails[i]);
+                if (engine->items.tails[id]->refcount == 0) {
+                    do_item_unlink(engine, engine->items.tails[id]);
                 } else {
                     break;
                 }
             }
-            if (engine->items.tails[i] == NULL) {
-                /* We removed all of the items in this slab class */
-                continue;
+            number += engine->items.sizes[id];
+            if (oldest == NULL) {
+                oldest = engine->items.tails[id];
             }
-
-            add_statistics(c, add_stats, prefix, i, "number", "%u",
-                           engine->items.sizes[i]);
-            add_statistics(c, add_stats, prefix, i, "age", "%u",
-                           engine->items.tails[i]->time);
-            add_statistics(c, add_stats, prefix, i, "evicted",
-                           "%u", engine->items.itemstats[i].evicted);
-            add_statistics(c, add_stats, prefix, i, "evicted_nonzero",
-                           "%u", engine->items.itemstats[i].evicted_nonzero);
-            add_statistics(c, add_stats, prefix, i, "evicted_time",
-                           "%u", engine->items.itemstats[i].evicted_time);
-            add_statistics(c, add_stats, prefix, i, "outofmemory",
-                           "%u", engine->items.itemstats[i].outofmemory);
-            add_statistics(c, add_stats, prefix, i, "tailrepairs",
-                           "%u", engine->items.itemstats[i].tailrepairs);;
-            add_statistics(c, add_stats, prefix, i, "reclaimed",
-                           "%u", engine->items.itemstats[i].reclaimed);;
         }
+        if (oldest == NULL) {
+            /* We removed all of the items in this slab class */
+            continue;
+        }
+
+        add_statistics(c, add_stats, prefix, i, "number", "%u", number);
+        add_statistics(c, add_stats, prefix, i, "number_hot", "%u",
+                       engine->items.sizes[lru_id(i, HOT_LRU)]);
+        add_statistics(c, add_stats, prefix, i, "number_warm", "%u",
+                       engine->items.sizes[lru_id(i, WARM_LRU)]);
+        add_statistics(c, add_stats, prefix, i, "number_cold", "%u",
+                       engine->items.sizes[lru_id(i, COLD_LRU)]);
+        add_statistics(c, add_stats, prefix, i, "age", "%u", oldest->time);
+        add_statistics(c, add_stats, prefix, i, "evicted",
+                       "%u", engine->items.itemstats[i].evicted);
+        add_statistics(c, add_stats, prefix, i, "evicted_nonzero",
+                       "%u", engine->items.itemstats[i].evicted_nonzero);
+        add_statistics(c, add_stats, prefix, i, "evicted_time",
+                       "%u", engine->items.itemstats[i].evicted_time);
+        add_statistics(c, add_stats, prefix, i, "outofmemory",
+                       "%u", engine->items.itemstats[i].outofmemory);
+        add_statistics(c, add_stats, prefix, i, "tailrepairs",
+                       "%u", engine->items.itemstats[i].tailrepairs);;
+        add_statistics(c, add_stats, prefix, i, "reclaimed",
+                       "%u", engine->items.itemstats[i].reclaimed);;
+        add_statistics(c, add_stats, prefix, i, "get_hits",
+                       "%" PRIu64, engine->items.itemstats[i].get_hits);
+        add_statistics(c, add_stats, prefix, i, "moves_to_cold",
+                       "%" PRIu64, engine->items.itemstats[i].moves_to_cold);
+        add_statistics(c, add_stats, prefix, i, "moves_to_warm",
+                       "%" PRIu64, engine->items.itemstats[i].moves_to_warm);
+        add_statistics(c, add_stats, prefix, i, "moves_within_lru",
+                       "%" PRIu64,
+                       engine->items.itemstats[i].moves_within_lru);
     }
 }
 
@@ -506,7 +565,7 @@ static void do_item_stats_sizes(struct default_engine *engine,
         int i;
 
         /* build the histogram */
-        for (i = 0; i < POWER_LARGEST; i++) {
+        for (i = 0; i < POWER_LARGEST * NUM_LRUS; i++) {
             hash_item *iter = engine->items.heads[i];
             while (iter) {
                 size_t ntotal = ITEM_ntotal(engine, iter);
@@ -748,6 +807,9 @@ hash_item* item_get(struct default_engine* engine,
                     const DocStateFilter state) {
     cb_mutex_enter(&engine->items.lock);
     auto* it = do_item_get(engine, &key, state);
+    if (it != nullptr) {
+        engine->items.itemstats[it->slabs_clsid].get_hits++;
+    }
     cb_mutex_exit(&engine->items.lock);
     return it;
 }
@@ -1075,24 +1137,19 @@ void item_flush_expired(struct default_engine *engine) {
         engine->config.oldest_live = now - 1;
     }
 
-    for (int ii = 0; ii < POWER_LARGEST; ii++) {
+    for (int ii = 0; ii < POWER_LARGEST * NUM_LRUS; ii++) {
         hash_item *iter, *next;
         /*
-         * The LRU is sorted in decreasing time order, and an item's
-         * timestamp is never newer than its last access time, so we
-         * only need to walk back until we hit an item older than the
-         * oldest_live time.
-         * The oldest_live checking will auto-expire the remaining items.
+         * The oldest_live checking will auto-expire the items older than
+         * the oldest_live time, so we only unlink the newer ones. The
+         * segments aren't sorted in time order (the LRU maintainer moves
+         * the items between them), so we have to walk all of them.
          */
         for (iter = engine->items.heads[ii]; iter != NULL; iter = next) {
-            if (iter->time >= engine->config.oldest_live) {
-                next = iter->next;
-                if ((iter->iflag & ITEM_SLABBED) == 0) {
-                    do_item_unlink(engine, iter);
-                }
-            } else {
-                /* We've hit the first old item. Continue to the next queue. */
-                break;
+            next = iter->next;
+            if (iter->time >= engine->config.oldest_live &&
+                (iter->iflag & ITEM_SLABBED) == 0 && !item_is_cursor(iter)) {
+                do_item_unlink(engine, iter);
             }
         }
     }
@@ -1116,10 +1173,174 @@ void item_stats_sizes(struct default_engine *engine,
     cb_mutex_exit(&engine->items.lock);
 }
 
+void item_stats_evictions(struct default_engine *engine,
+                          uint64_t evictions[POWER_LARGEST]) {
+    int i;
+    cb_mutex_enter(&engine->items.lock);
+    for (i = 0; i < POWER_LARGEST; i++) {
+        evictions[i] = (uint64_t)engine->items.itemstats[i].evicted +
+                       engine->items.itemstats[i].outofmemory;
+    }
+    cb_mutex_exit(&engine->items.lock);
+}
+
+/*
+ * The slab mover gives up after looking at this many pages of the source
+ * class being busy, and tries again at its next run
+ */
+static const unsigned int reassign_page_tries = 8;
+
+static bool do_item_slab_reassign(struct default_engine *engine,
+                                  unsigned int src, unsigned int dst) {
+    const rel_time_t current_time = engine->server.core->get_current_time();
+    const unsigned int size = engine->slabs.slabclass[src].size;
+    const unsigned int perslab = engine->slabs.slabclass[src].perslab;
+    unsigned int skip;
+
+    /*
+     * We hold the items lock, so no one else may allocate (or free) items
+     * in the page while we look at it. A chunk is either free (slabbed),
+     * or an item which is busy unless it is linked without anyone holding
+     * a reference to it (or a lock on it).
+     */
+    for (skip = 0; skip < reassign_page_tries; skip++) {
+        char *page = static_cast<char*>(slabs_reassign_pick(engine, src, skip));
+        unsigned int ii, evicted = 0;
+        bool busy = false;
+
+        if (page == NULL) {
+            return false;
+        }
+
+        for (ii = 0; ii < perslab && !busy; ii++) {
+            hash_item *it = (hash_item*)(page + (size_t)ii * size);
+            if ((it->iflag & ITEM_SLABBED) == 0 &&
+                ((it->iflag & ITEM_LINKED) == 0 || it->refcount != 0 ||
+                 it->locktime > current_time)) {
+                busy = true;
+            }
+        }
+        if (busy) {
+            slabs_reassign_busy(engine);
+            continue;
+        }
+
+        for (ii = 0; ii < perslab; ii++) {
+            hash_item *it = (hash_item*)(page + (size_t)ii * size);
+            if ((it->iflag & ITEM_LINKED) != 0) {
+                do_item_unlink(engine, it);
+                evicted++;
+            }
+        }
+        return slabs_reassign(engine, page, src, dst, evicted);
+    }
+    return false;
+}
+
+bool item_slab_reassign(struct default_engine *engine,
+                        unsigned int src, unsigned int dst) {
+    bool ret;
+    cb_mutex_enter(&engine->items.lock);
+    ret = do_item_slab_reassign(engine, src, dst);
+    cb_mutex_exit(&engine->items.lock);
+    return ret;
+}
+
+/*
+ * The LRU maintainer looks at no more than this many items of each
+ * segment per run, so that it holds the items lock for a short time
+ */
+static const unsigned int lru_juggle_items = 500;
+
+static unsigned int do_item_lru_juggle(struct default_engine *engine,
+                                       unsigned int clsid) {
+    const rel_time_t current_time = engine->server.core->get_current_time();
+    const rel_time_t oldest_live = engine->config.oldest_live;
+    itemstats_t *stats = &engine->items.itemstats[clsid];
+    unsigned int total = 0;
+    unsigned int done = 0;
+    unsigned int lru;
+
+    for (lru = 0; lru < NUM_LRUS; lru++) {
+        total += engine->items.sizes[lru_id(clsid, lru)];
+    }
+    /* COLD takes whatever overflows from HOT and WARM */
+    const unsigned int limits[NUM_LRUS] = {total * HOT_LRU_PCT / 100,
+                                           total * WARM_LRU_PCT / 100,
+                                           total};
+
+    for (lru = 0; lru < NUM_LRUS; lru++) {
+        const unsigned int id = lru_id(clsid, lru);
+        hash_item *search, *prev;
+        unsigned int tries = lru_juggle_items;
+
+        for (search = engine->items.tails[id];
+             search != NULL && tries > 0;
+             search = prev, tries--) {
+            prev = search->prev;
+            if (item_is_cursor(search)) {
+                continue;
+            }
+
+            if (search->refcount == 0 && search->locktime <= current_time &&
+                ((search->time < oldest_live) || /* dead by flush */
+                 (search->exptime != 0 && search->exptime < current_time))) {
+                stats->reclaimed++;
+                cb_mutex_enter(&engine->stats.lock);
+                engine->stats.reclaimed++;
+                cb_mutex_exit(&engine->stats.lock);
+                do_item_unlink(engine, search);
+                done++;
+                continue;
+            }
+
+            const bool active = (search->iflag & ITEM_ACTIVE) != 0;
+            lru_segment_t target;
+            if (lru == COLD_LRU) {
+                /* Look for the items hit since they got to COLD */
+                if (!active) {
+                    continue;
+                }
+                target = WARM_LRU;
+                stats->moves_to_warm++;
+            } else if (engine->items.sizes[id] <= limits[lru]) {
+                break;
+            } else if (!active) {
+                target = COLD_LRU;
+                stats->moves_to_cold++;
+            } else if (lru == HOT_LRU) {
+                target = WARM_LRU;
+                stats->moves_to_warm++;
+            } else {
+                target = WARM_LRU;
+                stats->moves_within_lru++;
+            }
+
+            if (active) {
+                search->iflag &= ~ITEM_ACTIVE;
+                search->time = current_time;
+            }
+            do_item_lru_move(engine, search, target);
+            done++;
+        }
+    }
+    return done;
+}
+
+unsigned int item_lru_juggle(struct default_engine *engine,
+                             unsigned int clsid) {
+    unsigned int ret;
+    cb_mutex_enter(&engine->items.lock);
+    ret = do_item_lru_juggle(engine, clsid);
+    cb_mutex_exit(&engine->items.lock);
+    return ret;
+}
+
 static void do_item_link_cursor(struct default_engine *engine,
                                 hash_item *cursor, int ii)
 {
-    cursor->slabs_clsid = (uint8_t)ii;
+    cursor->slabs_clsid = (uint8_t)(ii / NUM_LRUS);
+    cursor->lru = (uint8_t)(ii % NUM_LRUS);
     cursor->next = NULL;
     cursor->prev = engine->items.tails[ii];
     engine->items.tails[ii]->next = cursor;
@@ -1148,7 +1369,8 @@ static bool do_item_walk_cursor(struct default_engine *engine,
         ++ii;
         item_unlink_q(engine, cursor);
 
-        if (ptr == engine->items.heads[cursor->slabs_clsid]) {
+        if (ptr == engine->items.heads[lru_id(cursor->slabs_clsid,
+                                              cursor->lru)]) {
             done = true;
             cursor->prev = NULL;
         } else {
@@ -1159,7 +1381,7 @@ static bool do_item_walk_cursor(struct default_engine *engine,
         }
 
         /* Ignore cursors */
-        if (item_get_key(ptr)->header.len == 0 && ptr->nbytes == 0) {
+        if (item_is_cursor(ptr)) {
             --ii;
         } else {
             *error = itemfunc(engine, ptr, itemdata);
@@ -1176,6 +1398,9 @@ static bool do_item_walk_cursor(struct default_engine *engine,
     return (cursor->prev != NULL);
 }
 
+/* The most items a scrub visits in a single hold of the items lock */
+static const int scrub_step_items = 200;
+
 static ENGINE_ERROR_CODE item_scrub(struct default_engine *engine,
                                     hash_item *item,
                                     void *cookie) {
@@ -1212,7 +1437,8 @@ static void item_scrub_class(struct default_engine *engine,
     bool more;
     do {
         cb_mutex_enter(&engine->items.lock);
-        more = do_item_walk_cursor(engine, cursor, 200, item_scrub, NULL, &ret);
+        more = do_item_walk_cursor(engine, cursor, scrub_step_items,
+                                   item_scrub, NULL, &ret);
         cb_mutex_exit(&engine->items.lock);
         if (ret != ENGINE_SUCCESS) {
             break;
@@ -1227,7 +1453,7 @@ void item_scrubber_main(struct default_engine *engine)
 
     memset(&cursor, 0, sizeof(cursor));
     cursor.refcount = 1;
-    for (ii = 0; ii < POWER_LARGEST; ++ii) {
+    for (ii = 0; ii < POWER_LARGEST * NUM_LRUS; ++ii) {
         bool skip = false;
         cb_mutex_enter(&engine->items.lock);
         if (engine->items.heads[ii] == NULL) {
@@ -1273,6 +1499,100 @@ bool item_start_scrub(struct default_engine *engine)
     return ret;
 }
 
+struct expiry_scrub_counts {
+    unsigned int visited;
+    unsigned int cleaned;
+};
+
+static ENGINE_ERROR_CODE item_scrub_expired_item(struct default_engine *engine,
+                                                 hash_item *item,
+                                                 void *cookie) {
+    struct expiry_scrub_counts *counts =
+        static_cast<struct expiry_scrub_counts*>(cookie);
+    rel_time_t current_time = engine->server.core->get_current_time();
+
+    counts->visited++;
+    if (item->refcount == 0 &&
+        item->exptime != 0 && item->exptime < current_time) {
+        do_item_unlink(engine, item);
+        counts->cleaned++;
+    }
+    return ENGINE_SUCCESS;
+}
+
+void item_scrub_cursor_init(struct item_scrub_cursor *cursor) {
+    memset(cursor, 0, sizeof(*cursor));
+    /* Keep the cursor out of the way of the eviction of the tails */
+    cursor->item.refcount = 1;
+}
+
+/*
+ * Take the cursor out of its LRU. do_item_walk_cursor() unlinks it when
+ * it steps past the head, but it is left at the head if the items in
+ * front of it have been unlinked by someone else since.
+ */
+static void do_item_scrub_cursor_unlink(struct default_engine *engine,
+                                        struct item_scrub_cursor *cursor) {
+    if (cursor->linked &&
+        (cursor->item.prev != NULL ||
+         engine->items.heads[cursor->lru] == &cursor->item)) {
+        item_unlink_q(engine, &cursor->item);
+    }
+    cursor->item.prev = cursor->item.next = NULL;
+    cursor->linked = false;
+}
+
+void item_scrub_cursor_release(struct default_engine *engine,
+                               struct item_scrub_cursor *cursor) {
+    cb_mutex_enter(&engine->items.lock);
+    do_item_scrub_cursor_unlink(engine, cursor);
+    cb_mutex_exit(&engine->items.lock);
+}
+
+bool item_scrub_expired(struct default_engine *engine,
+                        struct item_scrub_cursor *cursor,
+                        unsigned int budget,
+                        uint64_t *visited,
+                        uint64_t *cleaned) {
+    struct expiry_scrub_counts counts = {0, 0};
+    bool done = false;
+
+    while (!done && counts.visited < budget) {
+        ENGINE_ERROR_CODE ret;
+        int step = scrub_step_items;
+        if (budget - counts.visited < unsigned(step)) {
+            step = int(budget - counts.visited);
+        }
+
+        cb_mutex_enter(&engine->items.lock);
+        if (!cursor->linked) {
+            /* Start on the tail of the next LRU with any items in it */
+            while (cursor->lru < POWER_LARGEST * NUM_LRUS &&
+                   engine->items.heads[cursor->lru] == NULL) {
+                cursor->lru++;
+            }
+            if (cursor->lru == POWER_LARGEST * NUM_LRUS) {
+                cursor->lru = 0;
+                done = true;
+            } else {
+                do_item_link_cursor(engine, &cursor->item, cursor->lru);
+                cursor->linked = true;
+            }
+        }
+        if (cursor->linked &&
+            !do_item_walk_cursor(engine, &cursor->item, step,
+                                 item_scrub_expired_item, &counts, &ret)) {
+            do_item_scrub_cursor_unlink(engine, cursor);
+            cursor->lru++;
+        }
+        cb_mutex_exit(&engine->items.lock);
+    }
+
+    *visited = counts.visited;
+    *cleaned = counts.cleaned;
+    return done;
+}
+
 static bool hash_key_create(hash_key* hkey,
                             const void* key,
                             const size_t nkey,
@@ -61,9 +61,35 @@ typedef struct _hash_item {
     /** to identify the type of the data */
     uint8_t datatype;
 
-    // There is 3 spare bytes due to alignment
+    /** which segment (lru_segment_t) of the LRU of the slab class we're in */
+    uint8_t lru;
+
+    // There is 2 spare bytes due to alignment
 } hash_item;
 
+/*
+ * The LRU of each slab class is split in segments. New items are linked
+ * in HOT. A hit only flags the item as active, and the LRU maintainer
+ * moves the items which fall off the tail of HOT (or WARM) to WARM if they
+ * were active and to COLD otherwise. Active items in COLD get back to WARM.
+ * We evict from the tail of COLD.
+ */
+typedef enum {
+    HOT_LRU = 0,
+    WARM_LRU = 1,
+    COLD_LRU = 2,
+    NUM_LRUS = 3
+} lru_segment_t;
+
+/* The share of the items of a slab class which may stay in HOT and WARM */
+#define HOT_LRU_PCT 20
+#define WARM_LRU_PCT 40
+
+/* The index of the list of the segment lru of the slab class clsid */
+static inline unsigned int lru_id(unsigned int clsid, unsigned int lru) {
+    return clsid * NUM_LRUS + lru;
+}
+
 /*
     The structure of the key we hash with.
 
@@ -146,13 +172,18 @@ typedef struct {
     unsigned int outofmemory;
     unsigned int tailrepairs;
     unsigned int reclaimed;
+    uint64_t get_hits;
+    uint64_t moves_to_cold;
+    uint64_t moves_to_warm;
+    uint64_t moves_within_lru;
 } itemstats_t;
 
 struct items {
-   hash_item *heads[POWER_LARGEST];
-   hash_item *tails[POWER_LARGEST];
+   /* The lists are indexed by lru_id() */
+   hash_item *heads[POWER_LARGEST * NUM_LRUS];
+   hash_item *tails[POWER_LARGEST * NUM_LRUS];
+   unsigned int sizes[POWER_LARGEST * NUM_LRUS];
    itemstats_t itemstats[POWER_LARGEST];
-   unsigned int sizes[POWER_LARGEST];
    /*
     * serialise access to the items data
    */
@@ -339,6 +370,36 @@ ENGINE_ERROR_CODE store_item(struct default_engine *engine,
                              const void *cookie,
                              const DocumentState document_state);
 
+/**
+ * Get the number of items each slab class failed to store in its own
+ * memory (evicted to make room for them, or failed with out of memory)
+ * @param engine handle to the storage engine
+ * @param evictions where to store the counts (indexed by the class id)
+ */
+void item_stats_evictions(struct default_engine *engine,
+                          uint64_t evictions[POWER_LARGEST]);
+
+/**
+ * Move a page from the slab class src to the class dst, evicting the
+ * items still stored in it. Pages where one of the items is in use are
+ * skipped.
+ * @param engine handle to the storage engine
+ * @param src the slab class to take the page from
+ * @param dst the slab class to give the page to
+ * @return true if a page was moved
+ */
+bool item_slab_reassign(struct default_engine *engine,
+                        unsigned int src, unsigned int dst);
+
+/**
+ * Move the items of the slab class between the segments of its LRU, and
+ * reclaim the expired ones found on the way.
+ * @param engine handle to the storage engine
+ * @param clsid the slab class
+ * @return the number of items moved or reclaimed
+ */
+unsigned int item_lru_juggle(struct default_engine *engine, unsigned int clsid);
+
 /**
  * Run a single scrub loop for the engine.
  * @param engine handle to the storage engine
@@ -352,4 +413,50 @@ void item_scrubber_main(struct default_engine *engine);
  */
 bool item_start_scrub(struct default_engine *engine);
 
+/**
+ * Where an incremental expiry scrub (see item_scrub_expired) got to in the
+ * LRUs of the engine. The cursor item is linked into the LRU lru while
+ * linked is set.
+ */
+struct item_scrub_cursor {
+    hash_item item;
+    int lru;
+    bool linked;
+};
+
+/**
+ * Initialize the cursor to start at the first LRU
+ * @param cursor the cursor to initialize
+ */
+void item_scrub_cursor_init(struct item_scrub_cursor *cursor);
+
+/**
+ * Unlink the cursor from the LRU it is in (if any). Must be called before
+ * the cursor goes away.
+ * @param engine handle to the storage engine
+ * @param cursor the cursor to release
+ */
+void item_scrub_cursor_release(struct default_engine *engine,
+                               struct item_scrub_cursor *cursor);
+
+/**
+ * Unlink the expired items (not in use) found in the next budget items
+ * from where the cursor is, walking each LRU from its tail and moving on
+ * to the next one. Unlike the full scrub the items lock is only held for
+ * a few hundred items at a time, and the cursor is kept between the calls
+ * so that a pass over all of the items is spread over many of them.
+ * @param engine handle to the storage engine
+ * @param cursor where the previous call stopped
+ * @param budget the maximum number of items to visit
+ * @param visited where to store the number of items visited
+ * @param cleaned where to store the number of items unlinked
+ * @return true if the pass over all of the LRUs completed (the next call
+ *         starts over from the first one)
+ */
+bool item_scrub_expired(struct default_engine *engine,
+                        struct item_scrub_cursor *cursor,
+                        unsigned int budget,
+                        uint64_t *visited,
+                        uint64_t *cleaned);
+
 #endif
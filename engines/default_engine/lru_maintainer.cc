@@ -0,0 +1,72 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "lru_maintainer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+constexpr std::chrono::milliseconds LruMaintainer::minSleep;
+constexpr std::chrono::milliseconds LruMaintainer::maxSleep;
+
+static void lru_maintainer_main(void* arg) {
+    LruMaintainer* maintainer = reinterpret_cast<LruMaintainer*>(arg);
+    maintainer->run();
+}
+
+LruMaintainer::LruMaintainer(struct default_engine& engine) : engine(engine) {
+    if (cb_create_named_thread(&thread, &lru_maintainer_main, this, 0,
+                               "mc:lru maint") != 0) {
+        throw std::runtime_error("Error creating 'mc:lru maint' thread");
+    }
+}
+
+LruMaintainer::~LruMaintainer() {
+    {
+        std::lock_guard<std::mutex> lck(lock);
+        shuttingdown = true;
+        cvar.notify_one();
+    }
+    cb_join_thread(thread);
+}
+
+void LruMaintainer::run() {
+    auto sleep = maxSleep;
+    std::unique_lock<std::mutex> lck(lock);
+    while (!shuttingdown) {
+        cvar.wait_for(lck, sleep, [this] { return shuttingdown; });
+        if (shuttingdown) {
+            break;
+        }
+
+        // Run the task without holding the lock (each class is juggled
+        // under its own hold of the items lock)
+        lck.unlock();
+        unsigned int done = 0;
+        for (unsigned int id = POWER_SMALLEST;
+             id <= engine.slabs.power_largest;
+             ++id) {
+            done += item_lru_juggle(&engine, id);
+        }
+        lck.lock();
+
+        if (done > 0) {
+            sleep = std::max(minSleep, sleep / 2);
+        } else {
+            sleep = std::min(maxSleep, sleep * 2);
+        }
+    }
+}
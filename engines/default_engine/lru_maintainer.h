@@ -0,0 +1,63 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <platform/platform.h>
+
+#include "default_engine_internal.h"
+
+/**
+ * The LRU maintainer of an engine moves the items between the segments
+ * (HOT, WARM and COLD) of the LRU of each slab class, so that a hit only
+ * has to flag the item as active (see item_lru_juggle).
+ *
+ * It runs more often while it finds work to do, and backs off (up to
+ * maxSleep) while it doesn't.
+ */
+class LruMaintainer {
+public:
+    static constexpr std::chrono::milliseconds minSleep{1};
+    static constexpr std::chrono::milliseconds maxSleep{1000};
+
+    LruMaintainer(struct default_engine& engine);
+
+    /// Stop and join the thread
+    ~LruMaintainer();
+
+    /**
+     * Task's run loop method. This is not a public function and should only
+     * be called from the tasks constructor.
+     */
+    void run();
+
+private:
+    struct default_engine& engine;
+
+    /** Is the task being requested to shut down? */
+    bool shuttingdown = false;
+
+    /** Protects shuttingdown */
+    std::mutex lock;
+
+    /** Used to wake the task up when shutting down */
+    std::condition_variable cvar;
+
+    cb_thread_t thread;
+};
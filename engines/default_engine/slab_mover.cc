@@ -0,0 +1,122 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "slab_mover.h"
+
+#include <stdexcept>
+
+constexpr std::chrono::seconds SlabMover::interval;
+
+static void slab_mover_main(void* arg) {
+    SlabMover* mover = reinterpret_cast<SlabMover*>(arg);
+    mover->run();
+}
+
+SlabMover::SlabMover(struct default_engine& engine) : engine(engine) {
+    if (cb_create_named_thread(&thread, &slab_mover_main, this, 0,
+                               "mc:slab mover") != 0) {
+        throw std::runtime_error("Error creating 'mc:slab mover' thread");
+    }
+}
+
+SlabMover::~SlabMover() {
+    {
+        std::lock_guard<std::mutex> lck(lock);
+        shuttingdown = true;
+        cvar.notify_one();
+    }
+    cb_join_thread(thread);
+}
+
+void SlabMover::run() {
+    std::unique_lock<std::mutex> lck(lock);
+    while (!shuttingdown) {
+        cvar.wait_for(lck, interval, [this] { return shuttingdown; });
+        if (!shuttingdown) {
+            // Run the task without holding the lock
+            lck.unlock();
+            rebalance();
+            lck.lock();
+        }
+    }
+}
+
+void SlabMover::rebalance() {
+    std::array<uint64_t, POWER_LARGEST> current;
+    unsigned int pages[MAX_NUMBER_OF_SLAB_CLASSES];
+    item_stats_evictions(&engine, current.data());
+    slabs_pages(&engine, pages);
+
+    unsigned int dst = 0;
+    uint64_t most = 0;
+    for (unsigned int id = POWER_SMALLEST; id <= engine.slabs.power_largest;
+         ++id) {
+        // The counts start over from zero when the stats are reset
+        const uint64_t delta = current[id] >= evictions[id]
+                                       ? current[id] - evictions[id]
+                                       : current[id];
+        evictions[id] = current[id];
+        if (delta == 0) {
+            ++idleRuns[id];
+        } else {
+            idleRuns[id] = 0;
+            if (delta > most) {
+                most = delta;
+                dst = id;
+            }
+        }
+    }
+
+    if (dst == 0) {
+        hottest = 0;
+        hottestRuns = 0;
+        return;
+    }
+    if (dst == hottest) {
+        ++hottestRuns;
+    } else {
+        hottest = dst;
+        hottestRuns = 1;
+    }
+    if (hottestRuns < windows) {
+        return;
+    }
+
+    // Take the page from the idle class with the most pages
+    unsigned int src = 0;
+    for (unsigned int id = POWER_SMALLEST; id <= engine.slabs.power_largest;
+         ++id) {
+        if (id != dst && idleRuns[id] >= windows && pages[id] > minPages &&
+            (src == 0 || pages[id] > pages[src])) {
+            src = id;
+        }
+    }
+    if (src == 0 || !item_slab_reassign(&engine, src, dst)) {
+        return;
+    }
+
+    if (engine.config.verbose > 0) {
+        auto* logger = static_cast<EXTENSION_LOGGER_DESCRIPTOR*>(
+                engine.server.extension->get_extension(EXTENSION_LOGGER));
+        logger->log(EXTENSION_LOG_INFO, NULL,
+                    "Slab mover: moved a page from slab class %u to %u",
+                    src, dst);
+    }
+
+    // Let the classes settle before moving another page between them
+    hottestRuns = 0;
+    idleRuns[src] = 0;
+}
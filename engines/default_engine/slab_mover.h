@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <platform/platform.h>
+
+#include "default_engine_internal.h"
+
+/**
+ * The slab mover moves pages between the slab classes of an engine, so
+ * that the memory follows the sizes of the items when they change (pages
+ * are otherwise given to a class for good the first time it needs one).
+ *
+ * Every interval it counts the items each class evicted since the last
+ * run. Once the same class evicted the most for windows runs in a row,
+ * while another class (with a few pages) didn't evict anything in as
+ * many runs, a page is taken from the latter (evicting the items left in
+ * it) and given to the former.
+ *
+ * Only runs for engines configured with slab_automove.
+ */
+class SlabMover {
+public:
+    /// How often the mover looks at the evictions
+    static constexpr std::chrono::seconds interval{10};
+
+    /// The runs in a row a class must evict the most (or nothing) to get
+    /// (give away) a page
+    static const int windows = 3;
+
+    /// A class must keep at least this many pages to give one away
+    static const unsigned int minPages = 2;
+
+    SlabMover(struct default_engine& engine);
+
+    /// Stop and join the thread
+    ~SlabMover();
+
+    /**
+     * Task's run loop method. This is not a public function and should only
+     * be called from the tasks constructor.
+     */
+    void run();
+
+private:
+    /// Look at the evictions since the last run and move a page if needed
+    void rebalance();
+
+    struct default_engine& engine;
+
+    /// The evictions of each class at the last run
+    std::array<uint64_t, POWER_LARGEST> evictions{};
+
+    /// The runs in a row in which each class didn't evict anything
+    std::array<int, POWER_LARGEST> idleRuns{};
+
+    /// The class which evicted the most at the last run, and for how many
+    /// runs in a row
+    unsigned int hottest = 0;
+    int hottestRuns = 0;
+
+    /** Is the task being requested to shut down? */
+    bool shuttingdown = false;
+
+    /** Protects shuttingdown */
+    std::mutex lock;
+
+    /** Used to wake the task up when shutting down */
+    std::condition_variable cvar;
+
+    cb_thread_t thread;
+};
@@ -11,6 +11,7 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <memcached/hugepages.h>
 #include <platform/cb_malloc.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -60,8 +61,63 @@ unsigned int slabs_clsid(struct default_engine *engine, const size_t size) {
     return res;
 }
 
+/*
+ * Carve size bytes out of the last region mapped from huge pages, or map
+ * a new one (of whole huge pages, so a region holds a number of slab
+ * pages) if there isn't enough room left in it
+ */
+static void *hugepage_allocate(struct default_engine *e, size_t size) {
+    void *ptr;
+    if (size > e->slabs.hugepages.avail) {
+        cb::hugepages::Backing backing;
+        const size_t len = cb::hugepages::roundUp(size);
+        if (e->slabs.hugepages.next == e->slabs.hugepages.size) {
+            size_t n = e->slabs.hugepages.size + 64;
+            void *p = cb_realloc(e->slabs.hugepages.regions,
+                                 n * sizeof(*e->slabs.hugepages.regions));
+            if (p == NULL) {
+                return NULL;
+            }
+            e->slabs.hugepages.regions =
+                static_cast<decltype(e->slabs.hugepages.regions)>(p);
+            e->slabs.hugepages.size = n;
+        }
+
+        ptr = cb::hugepages::map(len, backing);
+        if (ptr == NULL) {
+            return NULL;
+        }
+        e->slabs.hugepages.regions[e->slabs.hugepages.next].ptr = ptr;
+        e->slabs.hugepages.regions[e->slabs.hugepages.next].size = len;
+        e->slabs.hugepages.next++;
+        if (backing == cb::hugepages::Backing::Explicit) {
+            e->slabs.hugepages.explicit_bytes += len;
+        } else if (backing == cb::hugepages::Backing::Transparent) {
+            e->slabs.hugepages.transparent_bytes += len;
+        }
+
+        /* The rest of the previous region (if any) is left unused */
+        e->slabs.hugepages.current = static_cast<char*>(ptr);
+        e->slabs.hugepages.avail = len;
+    }
+
+    ptr = e->slabs.hugepages.current;
+    e->slabs.hugepages.current += size;
+    e->slabs.hugepages.avail -= size;
+    return ptr;
+}
+
 static void *my_allocate(struct default_engine *e, size_t size) {
     void *ptr;
+
+    if (e->config.hugepages) {
+        ptr = hugepage_allocate(e, size);
+        if (ptr != NULL) {
+            return ptr;
+        }
+        e->slabs.hugepages.fallbacks++;
+    }
+
     /* Is threre room? */
     if (e->slabs.allocs.next == e->slabs.allocs.size) {
         size_t n = e->slabs.allocs.size + 1024;
@@ -195,9 +251,47 @@ static int grow_slab_list (struct default_engine *engine, const unsigned int id)
     return 1;
 }
 
+static int grow_slab_slots(struct default_engine *engine,
+                           const unsigned int id,
+                           const unsigned int needed) {
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    if (needed > p->sl_total) {
+        unsigned int new_size = (p->sl_total != 0) ? p->sl_total * 2 : 16;  /* 16 is arbitrary */
+        while (new_size < needed) {
+            new_size *= 2;
+        }
+        void **new_slots = static_cast<void**>(cb_realloc(p->slots,
+                                               new_size * sizeof(void *)));
+        if (new_slots == 0) return 0;
+        p->slots = new_slots;
+        p->sl_total = new_size;
+    }
+    return 1;
+}
+
+/*
+ * The slab mover may move a page to any class, so with slab_automove
+ * all of the pages are item_size_max (the largest page of any class)
+ */
+static int slab_page_size(struct default_engine *engine,
+                          const unsigned int id) {
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    if (engine->config.slab_automove) {
+        return (int)engine->config.item_size_max;
+    }
+    return p->size * p->perslab;
+}
+
+static bool slab_page_contains(struct default_engine *engine,
+                               const void *page, const void *ptr) {
+    const char *begin = static_cast<const char*>(page);
+    const char *p = static_cast<const char*>(ptr);
+    return p >= begin && p < begin + engine->config.item_size_max;
+}
+
 static int do_slabs_newslab(struct default_engine *engine, const unsigned int id) {
     slabclass_t *p = &engine->slabs.slabclass[id];
-    int len = p->size * p->perslab;
+    int len = slab_page_size(engine, id);
     char *ptr;
 
     if ((engine->slabs.mem_limit && engine->slabs.mem_malloced + len > engine->slabs.mem_limit && p->slabs > 0) ||
@@ -287,15 +381,9 @@ static void do_slabs_free(struct default_engine *engine, void *ptr, const size_t
     return;
 #endif
 
-    if (p->sl_curr == p->sl_total) { /* need more space on the free list */
-        int new_size = (p->sl_total != 0) ? p->sl_total * 2 : 16;  /* 16 is arbitrary */
-        void **new_slots = static_cast<void**>(cb_realloc(p->slots,
-                                               new_size * sizeof(void *)));
-        if (new_slots == 0)
-            return;
-        p->slots = new_slots;
-        p->sl_total = new_size;
-    }
+    /* need more space on the free list? */
+    if (grow_slab_slots(engine, id, p->sl_curr + 1) == 0)
+        return;
     p->slots[p->sl_curr++] = ptr;
     p->requested -= size;
     return;
@@ -377,6 +465,10 @@ static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, co
             add_statistics(cookie, add_stats, NULL, i, "mem_requested",
                            "%" PRIu64,
                            (uint64_t)p->requested);
+            add_statistics(cookie, add_stats, NULL, i, "pages_moved_in", "%u",
+                           p->pages_moved_in);
+            add_statistics(cookie, add_stats, NULL, i, "pages_moved_out", "%u",
+                           p->pages_moved_out);
             total++;
         }
     }
@@ -386,6 +478,102 @@ static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, co
     add_statistics(cookie, add_stats, NULL, -1, "active_slabs", "%d", total);
     add_statistics(cookie, add_stats, NULL, -1, "total_malloced", "%" PRIu64,
                    (uint64_t)engine->slabs.mem_malloced);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_automove", "%d",
+                   engine->config.slab_automove ? 1 : 0);
+    add_statistics(cookie, add_stats, NULL, -1, "hugepages", "%d",
+                   engine->config.hugepages ? 1 : 0);
+    add_statistics(cookie, add_stats, NULL, -1, "hugepages_explicit_bytes",
+                   "%" PRIu64, engine->slabs.hugepages.explicit_bytes);
+    add_statistics(cookie, add_stats, NULL, -1,
+                   "hugepages_transparent_bytes",
+                   "%" PRIu64, engine->slabs.hugepages.transparent_bytes);
+    add_statistics(cookie, add_stats, NULL, -1, "hugepages_fallbacks",
+                   "%" PRIu64, engine->slabs.hugepages.fallbacks);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_moves",
+                   "%" PRIu64, engine->slabs.reassign.moves);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_busy",
+                   "%" PRIu64, engine->slabs.reassign.busy);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_evicted",
+                   "%" PRIu64, engine->slabs.reassign.evicted);
+}
+
+static void *do_slabs_reassign_pick(struct default_engine *engine,
+                                    unsigned int id, unsigned int skip) {
+    slabclass_t *p;
+    unsigned int ii;
+
+    if (!engine->config.slab_automove ||
+        id < POWER_SMALLEST || id > engine->slabs.power_largest) {
+        return NULL;
+    }
+
+#ifdef USE_SYSTEM_MALLOC
+    /* The items aren't stored in pages */
+    return NULL;
+#endif
+
+    p = &engine->slabs.slabclass[id];
+    if (p->slabs < 2) {
+        return NULL;
+    }
+
+    for (ii = p->slabs; ii > 0; --ii) {
+        void *page = p->slab_list[ii - 1];
+        if (p->end_page_ptr != 0 &&
+            slab_page_contains(engine, page, p->end_page_ptr)) {
+            continue;
+        }
+        if (skip == 0) {
+            return page;
+        }
+        --skip;
+    }
+    return NULL;
+}
+
+static bool do_slabs_reassign(struct default_engine *engine, void *page,
+                              unsigned int src, unsigned int dst,
+                              unsigned int evicted) {
+    slabclass_t *s = &engine->slabs.slabclass[src];
+    slabclass_t *d = &engine->slabs.slabclass[dst];
+    unsigned int ii, kept;
+
+    /* Make room in dst up front so that we can't fail half way */
+    if (grow_slab_list(engine, dst) == 0 ||
+        grow_slab_slots(engine, dst, d->sl_curr + d->perslab) == 0) {
+        return false;
+    }
+
+    /* Drop the chunks of the page from the freelist of src */
+    for (ii = kept = 0; ii < s->sl_curr; ii++) {
+        if (!slab_page_contains(engine, page, s->slots[ii])) {
+            s->slots[kept++] = s->slots[ii];
+        }
+    }
+    s->sl_curr = kept;
+
+    for (ii = 0; ii < s->slabs; ii++) {
+        if (s->slab_list[ii] == page) {
+            s->slab_list[ii] = s->slab_list[--s->slabs];
+            break;
+        }
+    }
+
+    /* Carve the page up in chunks of dst, and put them on its freelist */
+    memset(page, 0, engine->config.item_size_max);
+    for (ii = 0; ii < d->perslab; ii++) {
+        hash_item *it = (hash_item*)((char*)page + (size_t)ii * d->size);
+        /* so that a later move can tell that the chunk is free */
+        it->iflag = ITEM_SLABBED;
+        d->slots[d->sl_curr++] = it;
+    }
+    d->slab_list[d->slabs++] = page;
+
+    s->pages_moved_out++;
+    d->pages_moved_in++;
+    engine->slabs.reassign.moves++;
+    engine->slabs.reassign.evicted += evicted;
+    return true;
 }
 
 static void *memory_allocate(struct default_engine *engine, size_t size) {
@@ -438,6 +626,44 @@ void slabs_stats(struct default_engine *engine, ADD_STAT add_stats, const void *
     cb_mutex_exit(&engine->slabs.lock);
 }
 
+void *slabs_reassign_pick(struct default_engine *engine, unsigned int id,
+                          unsigned int skip) {
+    void *ret;
+
+    cb_mutex_enter(&engine->slabs.lock);
+    ret = do_slabs_reassign_pick(engine, id, skip);
+    cb_mutex_exit(&engine->slabs.lock);
+    return ret;
+}
+
+bool slabs_reassign(struct default_engine *engine, void *page,
+                    unsigned int src, unsigned int dst,
+                    unsigned int evicted) {
+    bool ret;
+
+    cb_mutex_enter(&engine->slabs.lock);
+    ret = do_slabs_reassign(engine, page, src, dst, evicted);
+    cb_mutex_exit(&engine->slabs.lock);
+    return ret;
+}
+
+void slabs_reassign_busy(struct default_engine *engine) {
+    cb_mutex_enter(&engine->slabs.lock);
+    engine->slabs.reassign.busy++;
+    cb_mutex_exit(&engine->slabs.lock);
+}
+
+void slabs_pages(struct default_engine *engine,
+                 unsigned int pages[MAX_NUMBER_OF_SLAB_CLASSES]) {
+    unsigned int ii;
+
+    cb_mutex_enter(&engine->slabs.lock);
+    for (ii = 0; ii < MAX_NUMBER_OF_SLAB_CLASSES; ii++) {
+        pages[ii] = engine->slabs.slabclass[ii].slabs;
+    }
+    cb_mutex_exit(&engine->slabs.lock);
+}
+
 void slabs_adjust_mem_requested(struct default_engine *engine, unsigned int id, size_t old, size_t ntotal)
 {
     slabclass_t *p;
@@ -467,6 +693,12 @@ void slabs_destroy(struct default_engine *e)
     }
     cb_free(e->slabs.allocs.ptrs);
 
+    for (ii = 0; ii < e->slabs.hugepages.next; ++ii) {
+        cb::hugepages::unmap(e->slabs.hugepages.regions[ii].ptr,
+                             e->slabs.hugepages.regions[ii].size);
+    }
+    cb_free(e->slabs.hugepages.regions);
+
     /* Release the freelists */
     for (jj = POWER_SMALLEST; jj <= e->slabs.power_largest; jj++) {
         slabclass_t *p = &e->slabs.slabclass[jj];
@@ -24,6 +24,9 @@ typedef struct {
 
     unsigned int killing;  /* index+1 of dying slab, or zero if none */
     size_t requested; /* The number of requested bytes */
+
+    unsigned int pages_moved_in;  /* pages given to us by the slab mover */
+    unsigned int pages_moved_out; /* pages taken from us by the slab mover */
 } slabclass_t;
 
 struct slabs {
@@ -42,6 +45,33 @@ struct slabs {
       size_t size;
    } allocs;
 
+   /**
+    * The regions mapped from huge pages (if the engine is configured with
+    * hugepages), which the slab pages are carved out of
+    */
+   struct {
+      struct hugepage_region {
+         void *ptr;
+         size_t size;
+      } *regions;
+      size_t next;
+      size_t size;
+      char *current;  /* the end of the pages carved out of the last one */
+      size_t avail;   /* the bytes left after current */
+      uint64_t explicit_bytes;    /* mapped from reserved huge pages */
+      uint64_t transparent_bytes; /* advised to use transparent ones */
+      uint64_t fallbacks; /* pages allocated with malloc instead */
+   } hugepages;
+
+   /**
+    * Statistics on the pages moved between the slab classes
+    */
+   struct {
+      uint64_t moves;   /* pages moved */
+      uint64_t busy;    /* pages skipped as some of their items were in use */
+      uint64_t evicted; /* items evicted from the moved pages */
+   } reassign;
+
    /**
     * Access to the slab allocator is protected by this lock
     */
@@ -80,6 +110,39 @@ void slabs_free(struct default_engine *engine, void *ptr, size_t size, unsigned
 /** Adjust the stats for memory requested */
 void slabs_adjust_mem_requested(struct default_engine *engine, unsigned int id, size_t old, size_t ntotal);
 
+/**
+ * Pick a page of the slab class id to move to another class. Only used
+ * with slab_automove (which makes all of the pages item_size_max bytes so
+ * that any class may reuse them). The page at the end of the class (being
+ * carved up) isn't picked, nor the last page of the class.
+ *
+ * @param skip the number of candidate pages to skip (so that the caller
+ *             may retry with another page if this one is busy)
+ * @return the page or NULL if the class don't have one to give away
+ */
+void *slabs_reassign_pick(struct default_engine *engine, unsigned int id,
+                          unsigned int skip);
+
+/**
+ * Move a page from the slab class src to the class dst. All of the chunks
+ * of the page must be free (on the freelist of src); they are replaced
+ * with the chunks of dst.
+ *
+ * @param evicted the number of items evicted to free the page
+ * @return true on success, false if we failed to allocate the lists
+ *         needed by dst (the page is left in src)
+ */
+bool slabs_reassign(struct default_engine *engine, void *page,
+                    unsigned int src, unsigned int dst,
+                    unsigned int evicted);
+
+/** Count a page skipped by the slab mover as some of its items were busy */
+void slabs_reassign_busy(struct default_engine *engine);
+
+/** Fill pages with the number of pages of each slab class */
+void slabs_pages(struct default_engine *engine,
+                 unsigned int pages[MAX_NUMBER_OF_SLAB_CLASSES]);
+
 /** Fill buffer with stats */ /*@null@*/
 void slabs_stats(struct default_engine *engine, ADD_STAT add_stats, const void *c);
 
@@ -22,77 +22,33 @@
 #include <programs/engine_testapp/mock_server.h>
 
 #include "benchmark_memory_tracker.h"
-#include "dcp/dcpconnmap.h"
+#include "engine_fixture.h"
 #include "ep_time.h"
 #include "item.h"
 
-class EngineFixture : public benchmark::Fixture {
+class AccessLogBenchEngine : public EngineFixture {
 protected:
     void SetUp(const benchmark::State& state) override {
-        SingleThreadedExecutorPool::replaceExecutorPoolWithFake();
-        executorPool = reinterpret_cast<SingleThreadedExecutorPool*>(
-                ExecutorPool::get());
-        memoryTracker = BenchmarkMemoryTracker::getInstance(
-                *get_mock_server_api()->alloc_hooks);
-        memoryTracker->reset();
-        std::string config = "dbname=benchmarks-test;ht_locks=47;" + varConfig;
-
-        engine.reset(new SynchronousEPEngine(config));
-        ObjectRegistry::onSwitchThread(engine.get());
-
-        engine->setKVBucket(
-                engine->public_makeBucket(engine->getConfiguration()));
-
-        engine->public_initializeEngineCallbacks();
-        initialize_time_functions(get_mock_server_api()->core);
-        cookie = create_mock_cookie();
-    }
-
-    void TearDown(const benchmark::State& state) override {
-        executorPool->cancelAndClearAll();
-        destroy_mock_cookie(cookie);
-        destroy_mock_event_callbacks();
-        engine->getDcpConnMap().manageConnections();
-        engine.reset();
-        ObjectRegistry::onSwitchThread(nullptr);
-        ExecutorPool::shutdown();
-        memoryTracker->destroyInstance();
-    }
-
-    Item make_item(uint16_t vbid,
-                   const std::string& key,
-                   const std::string& value) {
-        Item item({key, DocNamespace::DefaultCollection},
-                  /*flags*/ 0,
-                  /*exp*/ 0,
-                  value.c_str(),
-                  value.size(),
-                  PROTOCOL_BINARY_DATATYPE_JSON);
-        item.setVBucketId(vbid);
-        return item;
+        // If the access scanner is running then it will always scan
+        varConfig = "alog_resident_ratio_threshold=100;";
+        varConfig += "alog_max_stored_items=" +
+                     std::to_string(alog_max_stored_items);
+        EngineFixture::SetUp(state);
     }
 
-    std::unique_ptr<SynchronousEPEngine> engine;
-    const void* cookie = nullptr;
-    const int vbid = 0;
-
-    // Allows subclasses to add stuff to the config
-    std::string varConfig;
-    BenchmarkMemoryTracker* memoryTracker;
-    SingleThreadedExecutorPool* executorPool;
+    const size_t alog_max_stored_items = 2048;
 };
 
-class AccessLogBenchEngine : public EngineFixture {
+class IncrementalAccessLogBenchEngine : public AccessLogBenchEngine {
 protected:
     void SetUp(const benchmark::State& state) override {
-        // If the access scanner is running then it will always scan
         varConfig = "alog_resident_ratio_threshold=100;";
         varConfig += "alog_max_stored_items=" +
-                     std::to_string(alog_max_stored_items);
+                     std::to_string(alog_max_stored_items) + ";";
+        varConfig += std::string("alog_incremental=") +
+                     (state.range(0) == 1 ? "true" : "false");
         EngineFixture::SetUp(state);
     }
-
-    const size_t alog_max_stored_items = 2048;
 };
 
 ProcessClock::time_point runNextTask(SingleThreadedExecutorPool* pool,
@@ -155,6 +111,49 @@ BENCHMARK_DEFINE_F(AccessLogBenchEngine, MemoryOverhead)
             (memoryTracker->getMaxAlloc() - baseMemory) / alog_max_stored_items;
 }
 
+/*
+ * Measures the runs of the access scanner over a vbucket whose resident set
+ * doesn't change between them, with and without alog_incremental (which
+ * copies the keys from the previous access log instead of visiting the hash
+ * table).
+ * Variables:
+ *  - range(0) : Whether alog_incremental is set (0: no, 1: yes)
+ *  - range(1) : The number of items to fill the vbucket with
+ */
+BENCHMARK_DEFINE_F(IncrementalAccessLogBenchEngine, UnchangedRuns)
+(benchmark::State& state) {
+    engine->getKVBucket()->setVBucketState(0, vbucket_state_active, false);
+    state.SetLabel(state.range(0) == 1 ? "Incremental" : "Full");
+    ExTask task = std::make_shared<AccessScanner>(*(engine->getKVBucket()),
+                                                  engine->getConfiguration(),
+                                                  engine->getEpStats(),
+                                                  1000);
+    ExecutorPool::get()->schedule(task);
+
+    std::string value(200, 'x');
+    std::string keyPrefixPre(20, 'a');
+    for (int i = 0; i < state.range(1); ++i) {
+        auto item = make_item(vbid, keyPrefixPre + std::to_string(i), value);
+        engine->getKVBucket()->set(item, cookie);
+    }
+
+    auto runScanner = [this, &task]() {
+        executorPool->wake(task->getId());
+        runNextTask(executorPool, AUXIO_TASK_IDX, "Generating access log");
+        runNextTask(executorPool,
+                    AUXIO_TASK_IDX,
+                    "Item Access Scanner on vb 0");
+    };
+
+    // The first run always visits the hash table
+    runScanner();
+    while (state.KeepRunning()) {
+        runScanner();
+    }
+    state.counters["ReusedVBuckets"] =
+            engine->getEpStats().alogReusedVBuckets.load();
+}
+
 static void AccessScannerArguments(benchmark::internal::Benchmark* b) {
     std::array<int, 2> numItems{{32768, 65536}};
     for (int j : numItems) {
@@ -167,6 +166,9 @@ BENCHMARK_REGISTER_F(AccessLogBenchEngine, MemoryOverhead)
         ->Apply(AccessScannerArguments)
         ->MinTime(0.000001);
 
+BENCHMARK_REGISTER_F(IncrementalAccessLogBenchEngine, UnchangedRuns)
+        ->Apply(AccessScannerArguments);
+
 static char allow_no_stats_env[] = "ALLOW_NO_STATS_UPDATE=yeah";
 int main(int argc, char** argv) {
     putenv(allow_no_stats_env);
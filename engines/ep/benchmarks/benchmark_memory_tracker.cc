@@ -25,6 +25,7 @@ std::atomic<BenchmarkMemoryTracker*> BenchmarkMemoryTracker::instance;
 std::mutex BenchmarkMemoryTracker::instanceMutex;
 std::atomic<size_t> BenchmarkMemoryTracker::maxTotalAllocation;
 std::atomic<size_t> BenchmarkMemoryTracker::currentAlloc;
+std::atomic<size_t> BenchmarkMemoryTracker::numAllocs;
 
 BenchmarkMemoryTracker::~BenchmarkMemoryTracker() {
     hooks_api.remove_new_hook(&NewHook);
@@ -64,6 +65,10 @@ size_t BenchmarkMemoryTracker::getCurrentAlloc() {
     return currentAlloc;
 }
 
+size_t BenchmarkMemoryTracker::getNumAllocs() {
+    return numAllocs;
+}
+
 BenchmarkMemoryTracker::BenchmarkMemoryTracker(
         const ALLOCATOR_HOOKS_API& hooks_api)
     : hooks_api(hooks_api) {
@@ -85,6 +90,7 @@ void BenchmarkMemoryTracker::NewHook(const void* ptr, size_t) {
         void* p = const_cast<void*>(ptr);
         size_t alloc = tracker->hooks_api.get_allocation_size(p);
         currentAlloc += alloc;
+        ++numAllocs;
         maxTotalAllocation.store(
                 std::max(currentAlloc.load(), maxTotalAllocation.load()));
         ObjectRegistry::memoryAllocated(alloc);
@@ -103,4 +109,5 @@ void BenchmarkMemoryTracker::DeleteHook(const void* ptr) {
 void BenchmarkMemoryTracker::reset() {
     currentAlloc.store(0);
     maxTotalAllocation.store(0);
+    numAllocs.store(0);
 }
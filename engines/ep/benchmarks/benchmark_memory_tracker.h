@@ -43,6 +43,8 @@ public:
 
     size_t getMaxAlloc();
     size_t getCurrentAlloc();
+    /// @return the number of allocations made since the last reset
+    size_t getNumAllocs();
 
 private:
     BenchmarkMemoryTracker(const ALLOCATOR_HOOKS_API& hooks_api);
@@ -55,4 +57,5 @@ private:
     ALLOCATOR_HOOKS_API hooks_api;
     static std::atomic<size_t> maxTotalAllocation;
     static std::atomic<size_t> currentAlloc;
+    static std::atomic<size_t> numAllocs;
 };
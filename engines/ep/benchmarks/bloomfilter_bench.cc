@@ -0,0 +1,112 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "bloomfilter.h"
+#include "tests/module_tests/test_helpers.h"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <platform/make_unique.h>
+#include <valgrind/valgrind.h>
+
+/**
+ * Compare the lookup rate of the standard and the blocked bloom filter
+ * layouts.
+ *
+ * The parameter specifies the layout. Most lookups made by a full eviction
+ * bucket are for keys which don't exist, which is where the blocked layout
+ * takes a single cache miss instead of one per hash.
+ */
+class BloomFilterBench : public benchmark::Fixture {
+public:
+    void SetUp(::benchmark::State& state) {
+        BloomFilter::Layout layout;
+        switch (state.range(0)) {
+        case 0:
+            state.SetLabel("Standard");
+            layout = BloomFilter::Layout::Standard;
+            break;
+        case 1:
+            state.SetLabel("Blocked");
+            layout = BloomFilter::Layout::Blocked;
+            break;
+        default:
+            FAIL() << "Invalid input param(0) value:" << state.range(0);
+        }
+
+        // Use a filter which exceeds the D$ (as a vbucket with many keys
+        // would), but only a few keys when running under Valgrind.
+        const size_t nkeys = RUNNING_ON_VALGRIND ? 10 : 1000000;
+        filter = std::make_unique<BloomFilter>(
+                nkeys, 0.01, BFILTER_ENABLED, layout);
+        for (size_t i = 0; i < nkeys; i++) {
+            keys.push_back(makeStoredDocKey("key" + std::to_string(i)));
+            filter->addKey(keys.back());
+            missing.push_back(makeStoredDocKey("missing" + std::to_string(i)));
+        }
+    }
+
+    void TearDown(const ::benchmark::State& state) {
+        filter.reset();
+        keys.clear();
+        missing.clear();
+    }
+
+protected:
+    std::unique_ptr<BloomFilter> filter;
+    std::vector<StoredDocKey> keys;
+    std::vector<StoredDocKey> missing;
+};
+
+BENCHMARK_DEFINE_F(BloomFilterBench, MaybeKeyExistsHit)
+(benchmark::State& state) {
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(filter->maybeKeyExists(keys[ii]));
+        if (++ii == keys.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_DEFINE_F(BloomFilterBench, MaybeKeyExistsMiss)
+(benchmark::State& state) {
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(filter->maybeKeyExists(missing[ii]));
+        if (++ii == missing.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_DEFINE_F(BloomFilterBench, AddKey)(benchmark::State& state) {
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        filter->addKey(missing[ii]);
+        if (++ii == missing.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(BloomFilterBench, MaybeKeyExistsHit)->Arg(0)->Arg(1);
+BENCHMARK_REGISTER_F(BloomFilterBench, MaybeKeyExistsMiss)->Arg(0)->Arg(1);
+BENCHMARK_REGISTER_F(BloomFilterBench, AddKey)->Arg(0)->Arg(1);
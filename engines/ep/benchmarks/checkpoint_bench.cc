@@ -0,0 +1,307 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "checkpoint.h"
+#include "checkpoint_config.h"
+#include "configuration.h"
+#include "engine_fixture.h"
+#include "ep_vb.h"
+#include "failover-table.h"
+#include "kv_bucket.h"
+#include "stats.h"
+#include "tests/module_tests/test_helpers.h"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <valgrind/valgrind.h>
+
+/**
+ * Fixture of the benchmarks of a CheckpointManager on its own (i.e. the
+ * one of an active vbucket which isn't part of a bucket), shared by all of
+ * the benchmark threads.
+ *
+ * The first parameter of all of them is the number of cursors registered
+ * in addition to the persistence cursor (as DCP streams would), all of
+ * them at the beginning of the checkpoints.
+ */
+class CheckpointBench : public benchmark::Fixture {
+public:
+    void SetUp(::benchmark::State& state) {
+        // The benchmark threads wait for each other before they start
+        // running, so the first thread sets up the vbucket for all of them
+        if (state.thread_index != 0) {
+            return;
+        }
+
+        memoryTracker = BenchmarkMemoryTracker::getInstance(
+                *get_mock_server_api()->alloc_hooks);
+        vbucket = std::make_unique<EPVBucket>(
+                0,
+                vbucket_state_active,
+                stats,
+                checkpointConfig,
+                /*kvshard*/ nullptr,
+                /*lastSeqno*/ 0,
+                /*lastSnapStart*/ 0,
+                /*lastSnapEnd*/ 0,
+                /*table*/ nullptr,
+                std::make_shared<NoopFlusherCallback>(),
+                /*newSeqnoCb*/ nullptr,
+                config,
+                item_eviction_policy_t::VALUE_ONLY);
+        manager = vbucket->checkpointManager.get();
+
+        for (int ii = 0; ii < state.range(0); ++ii) {
+            manager->registerCursorBySeqno(
+                    cursorName(ii), 0, MustSendCheckpointEnd::NO);
+        }
+    }
+
+    void TearDown(const ::benchmark::State& state) {
+        if (state.thread_index == 0) {
+            manager = nullptr;
+            vbucket.reset();
+            memoryTracker->destroyInstance();
+        }
+    }
+
+protected:
+    class NoopFlusherCallback : public Callback<uint16_t> {
+    public:
+        void callback(uint16_t&) override {
+        }
+    };
+
+    static std::string cursorName(int index) {
+        return "cursor-" + std::to_string(index);
+    }
+
+    /// Queue the given number of items (with distinct keys)
+    void queueItems(size_t count) {
+        for (size_t ii = 0; ii < count; ++ii) {
+            const auto key = makeStoredDocKey("key" + std::to_string(ii));
+            queued_item qi(new Item(key,
+                                    vbucket->getId(),
+                                    queue_op::set,
+                                    /*revSeq*/ 0,
+                                    /*bySeq*/ 0));
+            manager->queueDirty(*vbucket,
+                                qi,
+                                GenerateBySeqno::Yes,
+                                GenerateCas::Yes,
+                                /*preLinkDocCtx*/ nullptr);
+        }
+    }
+
+    /// Move all of the cursors to the end of the checkpoints
+    void drainCursors(const ::benchmark::State& state) {
+        std::vector<queued_item> items;
+        manager->getAllItemsForCursor(CheckpointManager::pCursorName, items);
+        manager->itemsPersisted();
+        for (int ii = 0; ii < state.range(0); ++ii) {
+            items.clear();
+            manager->getAllItemsForCursor(cursorName(ii), items);
+        }
+    }
+
+    /// The number of items the single threaded benchmarks queue: enough
+    /// to fill a number of checkpoints (of the default 500 items)
+    const size_t numItems = RUNNING_ON_VALGRIND ? 10 : 100000;
+
+    EPStats stats;
+    // Only close the checkpoints when they are full, and never during a
+    // run because of how long it takes
+    CheckpointConfig checkpointConfig{/*period*/ 3600,
+                                      DEFAULT_CHECKPOINT_ITEMS,
+                                      DEFAULT_MAX_CHECKPOINTS,
+                                      /*item_based_new_ckpt*/ true,
+                                      /*keep_closed_ckpts*/ false,
+                                      /*enable_ckpt_merge*/ false,
+                                      /*persistence_enabled*/ true};
+    Configuration config;
+    std::unique_ptr<EPVBucket> vbucket;
+    CheckpointManager* manager = nullptr;
+    BenchmarkMemoryTracker* memoryTracker = nullptr;
+};
+
+/*
+ * Measures the contention of the front-end threads on the queueLock, with
+ * the threads queueing items into the same vbucket. Each thread updates
+ * its own few keys over and over, so that the items are de-duplicated in
+ * the open checkpoint (which is never full) and the memory used stays the
+ * same however long the benchmark runs.
+ */
+BENCHMARK_DEFINE_F(CheckpointBench, QueueDirty)(benchmark::State& state) {
+    const size_t numKeys = DEFAULT_CHECKPOINT_ITEMS / 32;
+    std::vector<StoredDocKey> keys;
+    for (size_t ii = 0; ii < numKeys; ++ii) {
+        keys.push_back(makeStoredDocKey("writer" +
+                                        std::to_string(state.thread_index) +
+                                        "-key" + std::to_string(ii)));
+    }
+
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        queued_item qi(new Item(keys[ii],
+                                vbucket->getId(),
+                                queue_op::set,
+                                /*revSeq*/ 0,
+                                /*bySeq*/ 0));
+        manager->queueDirty(*vbucket,
+                            qi,
+                            GenerateBySeqno::Yes,
+                            GenerateCas::Yes,
+                            /*preLinkDocCtx*/ nullptr);
+        if (++ii == numKeys) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index == 0) {
+        state.counters["CheckpointBytes"] = manager->getMemoryUsage();
+    }
+}
+
+/*
+ * Measures the rate the items of the checkpoints are copied out for all of
+ * the cursors (as the flusher, and the checkpoint processor task of the DCP
+ * streams, do).
+ */
+BENCHMARK_DEFINE_F(CheckpointBench, GetAllItemsForCursor)
+(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        queueItems(numItems);
+        state.ResumeTiming();
+
+        drainCursors(state);
+
+        state.PauseTiming();
+        bool newCheckpointCreated;
+        manager->removeClosedUnrefCheckpoints(*vbucket, newCheckpointCreated);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * numItems *
+                            (state.range(0) + 1));
+}
+
+/*
+ * As GetAllItemsForCursor, but visiting the items in place with
+ * visitItemsForCursor() instead of copying them into a vector.
+ */
+BENCHMARK_DEFINE_F(CheckpointBench, VisitItemsForCursor)
+(benchmark::State& state) {
+    size_t visited = 0;
+    const auto visitor = [&visited](const queued_item&, bool) { ++visited; };
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        queueItems(numItems);
+        state.ResumeTiming();
+
+        manager->visitItemsForCursor(CheckpointManager::pCursorName, visitor);
+        manager->itemsPersisted();
+        for (int ii = 0; ii < state.range(0); ++ii) {
+            manager->visitItemsForCursor(cursorName(ii), visitor);
+        }
+
+        state.PauseTiming();
+        bool newCheckpointCreated;
+        manager->removeClosedUnrefCheckpoints(*vbucket, newCheckpointCreated);
+        state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(visited);
+    state.SetItemsProcessed(state.iterations() * numItems *
+                            (state.range(0) + 1));
+}
+
+/*
+ * Measures the removal of the checkpoints all of the cursors have moved
+ * past (the work the visitor of the ClosedUnrefCheckpointRemoverTask does
+ * for each vbucket), and how much memory it gives back.
+ */
+BENCHMARK_DEFINE_F(CheckpointBench, RemoveClosedUnrefCheckpoints)
+(benchmark::State& state) {
+    size_t released = 0;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        queueItems(numItems);
+        drainCursors(state);
+        const auto before = memoryTracker->getCurrentAlloc();
+        state.ResumeTiming();
+
+        bool newCheckpointCreated;
+        manager->removeClosedUnrefCheckpoints(*vbucket, newCheckpointCreated);
+
+        state.PauseTiming();
+        released += before - memoryTracker->getCurrentAlloc();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * numItems);
+    state.counters["BytesReleasedPerItem"] =
+            released / (state.iterations() * numItems);
+}
+
+BENCHMARK_REGISTER_F(CheckpointBench, QueueDirty)
+        ->Arg(0)->Arg(4)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_REGISTER_F(CheckpointBench, GetAllItemsForCursor)->Arg(0)->Arg(4);
+BENCHMARK_REGISTER_F(CheckpointBench, VisitItemsForCursor)->Arg(0)->Arg(4);
+BENCHMARK_REGISTER_F(CheckpointBench, RemoveClosedUnrefCheckpoints)
+        ->Arg(0)->Arg(4);
+
+/**
+ * Measures the rate KVBucket::flushVBucket() persists the items of the
+ * checkpoints of a vbucket (to couchstore) at, for a number of items
+ * queued between the flushes.
+ *
+ * Variables:
+ *  - range(0) : The number of items flushed in each batch
+ */
+class FlushBench : public EngineFixture {};
+
+BENCHMARK_DEFINE_F(FlushBench, FlushVBucket)(benchmark::State& state) {
+    ASSERT_EQ(ENGINE_SUCCESS,
+              engine->getKVBucket()->setVBucketState(
+                      vbid, vbucket_state_active, false));
+    const size_t batchSize = state.range(0);
+    const std::string value(256, 'x');
+    const auto baseMemory = memoryTracker->getCurrentAlloc();
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        for (size_t ii = 0; ii < batchSize; ++ii) {
+            auto item = make_item(vbid, "key" + std::to_string(ii), value);
+            ASSERT_EQ(ENGINE_SUCCESS,
+                      engine->getKVBucket()->set(item, cookie));
+        }
+        state.ResumeTiming();
+
+        size_t flushed = 0;
+        while (flushed < batchSize) {
+            const auto count = engine->getKVBucket()->flushVBucket(vbid);
+            ASSERT_GT(count, 0) << "Flusher stalled";
+            flushed += count;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batchSize);
+    state.SetBytesProcessed(state.iterations() * batchSize * value.size());
+    // Includes the items stored in the hash table
+    state.counters["MaxBytesAllocatedPerItem"] =
+            (memoryTracker->getMaxAlloc() - baseMemory) / batchSize;
+}
+
+BENCHMARK_REGISTER_F(FlushBench, FlushVBucket)
+        ->Arg(1)->Arg(100)->Arg(10000);
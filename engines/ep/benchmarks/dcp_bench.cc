@@ -0,0 +1,350 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "checkpoint.h"
+#include "dcp/backfill_memory.h"
+#include "engine_fixture.h"
+#include "ephemeral_vb.h"
+#include "kv_bucket.h"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <mock/mock_dcp.h>
+#include <mock/mock_dcp_consumer.h>
+#include <mock/mock_dcp_producer.h>
+#include <mock/mock_stream.h>
+#include <valgrind/valgrind.h>
+
+/**
+ * Fixture of the DCP benchmarks, all of which take:
+ *  - range(0) : the size of the values
+ *  - range(1) : the number of streams (each on its own vbucket)
+ *
+ * The items are spread evenly over the vbuckets of the streams; how many
+ * of them is bound so that they take about the same memory whatever the
+ * value size.
+ */
+class DcpBench : public EngineFixture {
+protected:
+    void SetUp(const benchmark::State& state) override {
+        varConfig += "max_size=1073741824;";
+        EngineFixture::SetUp(state);
+
+        valueSize = state.range(0);
+        numStreams = state.range(1);
+        const size_t totalItems =
+                RUNNING_ON_VALGRIND
+                        ? 10
+                        : std::min(size_t(100000), (64 << 20) / valueSize);
+        itemsPerStream = std::max(size_t(1), totalItems / numStreams);
+        value.assign(valueSize, 'x');
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        clear_dcp_data();
+        EngineFixture::TearDown(state);
+    }
+
+    /// Set the vbuckets of the streams to the given state
+    void setVBuckets(vbucket_state_t state) {
+        for (uint16_t vb = 0; vb < numStreams; ++vb) {
+            ASSERT_EQ(ENGINE_SUCCESS,
+                      engine->getKVBucket()->setVBucketState(
+                              vb, state, false));
+        }
+    }
+
+    /// Store itemsPerStream items into each of the vbuckets of the streams
+    void storeItems() {
+        for (uint16_t vb = 0; vb < numStreams; ++vb) {
+            for (size_t ii = 0; ii < itemsPerStream; ++ii) {
+                auto item = make_item(vb, "key" + std::to_string(ii), value);
+                ASSERT_EQ(ENGINE_SUCCESS,
+                          engine->getKVBucket()->set(item, cookie));
+            }
+        }
+    }
+
+    /// Remove the checkpoints of the vbuckets no cursor needs anymore
+    void removeCheckpoints() {
+        for (uint16_t vb = 0; vb < numStreams; ++vb) {
+            auto vbucket = engine->getVBucket(vb);
+            bool newCheckpointCreated;
+            vbucket->checkpointManager->removeClosedUnrefCheckpoints(
+                    *vbucket, newCheckpointCreated);
+        }
+    }
+
+    void setProcessed(benchmark::State& state) {
+        const size_t items = state.iterations() * numStreams * itemsPerStream;
+        state.SetItemsProcessed(items);
+        state.SetBytesProcessed(items * valueSize);
+    }
+
+    static ENGINE_ERROR_CODE addFailoverLog(vbucket_failover_t*,
+                                            size_t,
+                                            const void*) {
+        return ENGINE_SUCCESS;
+    }
+
+    size_t valueSize;
+    uint16_t numStreams;
+    size_t itemsPerStream;
+    std::string value;
+};
+
+class EphemeralDcpBench : public DcpBench {
+protected:
+    void SetUp(const benchmark::State& state) override {
+        varConfig = "bucket_type=ephemeral;";
+        DcpBench::SetUp(state);
+    }
+};
+
+/*
+ * Measures the rate DcpProducer::step() streams the items of the checkpoints
+ * of the vbuckets to a connection at, from the stream requests to the last
+ * mutation sent (including the checkpoint processor task moving the items to
+ * the ready queues of the streams).
+ */
+BENCHMARK_DEFINE_F(DcpBench, ProducerStep)(benchmark::State& state) {
+    setVBuckets(vbucket_state_active);
+    storeItems();
+    auto producers = get_dcp_producers(
+            reinterpret_cast<ENGINE_HANDLE*>(engine.get()),
+            reinterpret_cast<ENGINE_HANDLE_V1*>(engine.get()));
+    const size_t total = numStreams * itemsPerStream;
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        mock_dcp_producer_t producer = new MockDcpProducer(
+                *engine, cookie, "bench_producer", /*flags*/ 0, {});
+        state.ResumeTiming();
+
+        for (uint16_t vb = 0; vb < numStreams; ++vb) {
+            uint64_t rollbackSeqno;
+            ASSERT_EQ(ENGINE_SUCCESS,
+                      producer->streamRequest(/*flags*/ 0,
+                                              /*opaque*/ vb,
+                                              vb,
+                                              /*start_seqno*/ 0,
+                                              /*end_seqno*/ ~0,
+                                              /*vb_uuid*/ 0,
+                                              /*snap_start*/ 0,
+                                              /*snap_end*/ ~0,
+                                              &rollbackSeqno,
+                                              addFailoverLog));
+        }
+
+        // Step until all the items are sent, running the checkpoint
+        // processor task whenever the ready queues are empty
+        size_t idleSteps = 0;
+        while (producer->getItemsSent() < total) {
+            if (producer->step(producers.get()) == ENGINE_WANT_MORE) {
+                idleSteps = 0;
+            } else {
+                ASSERT_LT(++idleSteps, 1000u) << "Producer stalled";
+                producer->getCheckpointSnapshotTask().run();
+            }
+        }
+
+        state.PauseTiming();
+        producer->closeAllStreams();
+        producer.reset();
+        state.ResumeTiming();
+    }
+    setProcessed(state);
+}
+
+/*
+ * Measures the rate ActiveStream moves the items of the checkpoints of its
+ * vbucket to its ready queue at (as the checkpoint processor task does),
+ * making the snapshot markers and the mutation responses.
+ */
+BENCHMARK_DEFINE_F(DcpBench, CheckpointToReadyQ)(benchmark::State& state) {
+    setVBuckets(vbucket_state_active);
+    mock_dcp_producer_t producer =
+            new MockDcpProducer(*engine,
+                                cookie,
+                                "bench_producer",
+                                /*flags*/ 0,
+                                {},
+                                /*startTask*/ true);
+    std::vector<SingleThreadedRCPtr<MockActiveStream>> streams;
+    for (uint16_t vb = 0; vb < numStreams; ++vb) {
+        auto vbucket = engine->getVBucket(vb);
+        streams.emplace_back(new MockActiveStream(engine.get(),
+                                                  producer,
+                                                  /*flags*/ 0,
+                                                  /*opaque*/ vb,
+                                                  *vbucket,
+                                                  /*st_seqno*/ 0,
+                                                  /*en_seqno*/ ~0,
+                                                  /*vb_uuid*/ 0,
+                                                  /*snap_start_seqno*/ 0,
+                                                  /*snap_end_seqno*/ ~0));
+        vbucket->checkpointManager->registerCursor(
+                producer->getName(), 1, false, MustSendCheckpointEnd::NO);
+        streams.back()->transitionStateToBackfilling();
+        streams.back()->transitionStateToInMemory();
+    }
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        storeItems();
+        state.ResumeTiming();
+
+        for (auto& stream : streams) {
+            stream->nextCheckpointItemTask();
+        }
+
+        state.PauseTiming();
+        for (auto& stream : streams) {
+            while (stream->public_nextQueuedItem()) {
+            }
+        }
+        removeCheckpoints();
+        state.ResumeTiming();
+    }
+    setProcessed(state);
+
+    for (auto& stream : streams) {
+        stream->setDead(END_STREAM_OK);
+    }
+    producer->closeAllStreams();
+}
+
+/*
+ * Measures the rate DCPBackfillMemory scans the sequence lists of ephemeral
+ * vbuckets at, into the ready queues of their streams.
+ */
+BENCHMARK_DEFINE_F(EphemeralDcpBench, BackfillMemoryScan)
+(benchmark::State& state) {
+    setVBuckets(vbucket_state_active);
+    storeItems();
+    mock_dcp_producer_t producer =
+            new MockDcpProducer(*engine,
+                                cookie,
+                                "bench_producer",
+                                /*flags*/ 0,
+                                {},
+                                /*startTask*/ false);
+
+    while (state.KeepRunning()) {
+        for (uint16_t vb = 0; vb < numStreams; ++vb) {
+            state.PauseTiming();
+            auto evb = std::dynamic_pointer_cast<EphemeralVBucket>(
+                    engine->getVBucket(vb));
+            active_stream_t stream =
+                    new MockActiveStream(engine.get(),
+                                         producer,
+                                         /*flags*/ 0,
+                                         /*opaque*/ vb,
+                                         *evb,
+                                         /*st_seqno*/ 0,
+                                         /*en_seqno*/ ~0,
+                                         /*vb_uuid*/ 0,
+                                         /*snap_start_seqno*/ 0,
+                                         /*snap_end_seqno*/ ~0);
+            static_cast<MockActiveStream*>(stream.get())
+                    ->transitionStateToBackfilling();
+            state.ResumeTiming();
+
+            DCPBackfillMemory backfill(evb, stream, 1, evb->getHighSeqno());
+            backfill.run();
+
+            state.PauseTiming();
+            stream->setDead(END_STREAM_OK);
+            state.ResumeTiming();
+        }
+    }
+    setProcessed(state);
+}
+
+/*
+ * Measures the rate DcpConsumer applies the mutations of in-memory snapshots
+ * to replica vbuckets at, each snapshot updating all the keys of its
+ * vbucket.
+ */
+BENCHMARK_DEFINE_F(DcpBench, ConsumerApply)(benchmark::State& state) {
+    setVBuckets(vbucket_state_replica);
+    connection_t conn =
+            new MockDcpConsumer(*engine, cookie, "bench_consumer");
+    auto* consumer = dynamic_cast<MockDcpConsumer*>(conn.get());
+    std::vector<uint32_t> opaques;
+    for (uint16_t vb = 0; vb < numStreams; ++vb) {
+        ASSERT_EQ(ENGINE_SUCCESS,
+                  consumer->addStream(/*opaque*/ 0, vb, /*flags*/ 0));
+        opaques.push_back(consumer->getVbucketStream(vb)->getOpaque());
+    }
+    std::vector<std::string> keys;
+    for (size_t ii = 0; ii < itemsPerStream; ++ii) {
+        keys.push_back("key" + std::to_string(ii));
+    }
+    const cb::const_byte_buffer valueBuf{
+            reinterpret_cast<const uint8_t*>(value.data()), value.size()};
+
+    uint64_t seqno = 0;
+    while (state.KeepRunning()) {
+        for (uint16_t vb = 0; vb < numStreams; ++vb) {
+            ASSERT_EQ(ENGINE_SUCCESS,
+                      consumer->snapshotMarker(opaques[vb],
+                                               vb,
+                                               seqno + 1,
+                                               seqno + itemsPerStream,
+                                               MARKER_FLAG_MEMORY));
+            for (size_t ii = 0; ii < itemsPerStream; ++ii) {
+                const DocKey key{keys[ii], DocNamespace::DefaultCollection};
+                ASSERT_EQ(ENGINE_SUCCESS,
+                          consumer->mutation(opaques[vb],
+                                             key,
+                                             valueBuf,
+                                             /*priv_bytes*/ 0,
+                                             PROTOCOL_BINARY_DATATYPE_JSON,
+                                             /*cas*/ 0,
+                                             vb,
+                                             /*flags*/ 0,
+                                             seqno + ii + 1,
+                                             /*rev_seqno*/ 0,
+                                             /*exptime*/ 0,
+                                             /*locktime*/ 0,
+                                             /*meta*/ {},
+                                             /*nru*/ 0));
+            }
+        }
+        seqno += itemsPerStream;
+    }
+    setProcessed(state);
+
+    for (uint16_t vb = 0; vb < numStreams; ++vb) {
+        consumer->closeStream(opaques[vb], vb);
+    }
+}
+
+static void DcpArguments(benchmark::internal::Benchmark* b) {
+    for (int valueSize : {64, 1024, 8192}) {
+        for (int streams : {1, 16, 128}) {
+            b->ArgPair(valueSize, streams);
+        }
+    }
+}
+
+BENCHMARK_REGISTER_F(DcpBench, ProducerStep)->Apply(DcpArguments);
+BENCHMARK_REGISTER_F(DcpBench, CheckpointToReadyQ)->Apply(DcpArguments);
+BENCHMARK_REGISTER_F(EphemeralDcpBench, BackfillMemoryScan)
+        ->Apply(DcpArguments);
+BENCHMARK_REGISTER_F(DcpBench, ConsumerApply)->Apply(DcpArguments);
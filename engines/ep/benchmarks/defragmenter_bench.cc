@@ -108,6 +108,7 @@ protected:
         // least once (given the age_threshold may be up to 10).
         const size_t passes = 10;
 
+        VisitorBudget budget;
         auto start = ProcessClock::now();
         for (size_t i = 0; i < passes; i++) {
             // Loop until we get to the end; this may take multiple chunks
@@ -115,8 +116,8 @@ protected:
             // on the chunk_duration.
             HashTable::Position pos;
             while (pos != vbucket->ht.endPosition()) {
-                visitor.setDeadline(ProcessClock::now() + chunk_duration);
-                pos = vbucket->ht.pauseResumeVisit(visitor, pos);
+                budget.startRun(chunk_duration);
+                pos = visitWithinBudget(vbucket->ht, visitor, budget, pos);
             }
         }
         auto end = ProcessClock::now();
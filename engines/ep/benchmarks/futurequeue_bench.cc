@@ -0,0 +1,110 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "futurequeue.h"
+#include "tests/module_tests/test_task.h"
+#include "timer_wheel.h"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <valgrind/valgrind.h>
+
+#include <random>
+
+/**
+ * Compare the FutureQueue (heap) and the TimerWheel a TaskQueue can keep its
+ * waiting tasks in.
+ *
+ * range(0) selects the queue, range(1) is how many tasks are queued: every
+ * benchmark runs with a queue of that many tasks due over the next minute,
+ * as the periodic and snoozed tasks of a bucket are.
+ */
+class FutureQueueBench : public benchmark::Fixture {
+public:
+    void SetUp(::benchmark::State& state) {
+        switch (state.range(0)) {
+        case 0:
+            state.SetLabel("FutureQueue");
+            queue.reset(new FutureQueue<>());
+            break;
+        case 1:
+            state.SetLabel("TimerWheel");
+            queue.reset(new TimerWheel());
+            break;
+        default:
+            FAIL() << "Invalid input param(0) value:" << state.range(0);
+        }
+
+        const size_t numTasks = RUNNING_ON_VALGRIND ? 10 : state.range(1);
+        for (size_t i = 0; i < numTasks; ++i) {
+            tasks.push_back(std::make_shared<TestTask>(
+                    nullptr, TaskId::PendingOpsNotification));
+            tasks.back()->updateWaketime(randomWaketime());
+            queue->push(tasks.back());
+        }
+    }
+
+    void TearDown(const ::benchmark::State& state) {
+        queue.reset();
+        tasks.clear();
+    }
+
+protected:
+    ProcessClock::time_point randomWaketime() {
+        std::uniform_int_distribution<int64_t> dist(0, 60000);
+        return ProcessClock::now() + std::chrono::milliseconds(dist(gen));
+    }
+
+    std::mt19937 gen{42};
+    std::unique_ptr<FutureQueueBase> queue;
+    std::vector<ExTask> tasks;
+};
+
+/*
+ * Snooze queued tasks (as ExecutorPool::snooze and wake do).
+ */
+BENCHMARK_DEFINE_F(FutureQueueBench, Snooze)(benchmark::State& state) {
+    std::uniform_int_distribution<size_t> pick(0, tasks.size() - 1);
+    std::uniform_real_distribution<double> secs(0, 60);
+    while (state.KeepRunning()) {
+        queue->snooze(tasks[pick(gen)], secs(gen));
+    }
+}
+
+/*
+ * Pop the earliest task and push it back to run again later (as a thread
+ * running a periodic task does).
+ */
+BENCHMARK_DEFINE_F(FutureQueueBench, PopPush)(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        ExTask task = queue->top();
+        queue->pop();
+        task->updateWaketime(randomWaketime());
+        queue->push(task);
+    }
+}
+
+static void FutureQueueArguments(benchmark::internal::Benchmark* b) {
+    for (int queue : {0, 1}) {
+        for (int numTasks : {100, 1000, 10000}) {
+            b->ArgPair(queue, numTasks);
+        }
+    }
+}
+
+BENCHMARK_REGISTER_F(FutureQueueBench, Snooze)->Apply(FutureQueueArguments);
+BENCHMARK_REGISTER_F(FutureQueueBench, PopPush)->Apply(FutureQueueArguments);
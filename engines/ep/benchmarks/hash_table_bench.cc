@@ -0,0 +1,465 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "benchmark_memory_tracker.h"
+#include "hash_table.h"
+#include "item.h"
+#include "stats.h"
+#include "stored_value_factories.h"
+#include "tests/module_tests/test_helpers.h"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <platform/make_unique.h>
+#include <programs/engine_testapp/mock_server.h>
+#include <valgrind/valgrind.h>
+
+#include <algorithm>
+#include <random>
+
+/**
+ * Compare the lookup rate of the chained and the tagged hash bucket layouts.
+ *
+ * The first parameter specifies the layout, and the second the number of
+ * items per hash bucket (the load factor) - the tagged layout is most
+ * useful when the chains are longer than one element.
+ */
+class HashTableBench : public benchmark::Fixture {
+public:
+    void SetUp(::benchmark::State& state) {
+        HashTable::BucketLayout layout;
+        switch (state.range(0)) {
+        case 0:
+            state.SetLabel("Chained");
+            layout = HashTable::BucketLayout::Chained;
+            break;
+        case 1:
+            state.SetLabel("Tagged");
+            layout = HashTable::BucketLayout::Tagged;
+            break;
+        default:
+            FAIL() << "Invalid input param(0) value:" << state.range(0);
+        }
+
+        // Use enough items to exceed the D$ (as we would in production),
+        // but only a few when running under Valgrind.
+        const size_t ndocs = RUNNING_ON_VALGRIND ? 10 : 1000000;
+        ht = std::make_unique<HashTable>(
+                stats,
+                std::make_unique<StoredValueFactory>(stats),
+                std::max(size_t(1), ndocs / size_t(state.range(1))),
+                /*locks*/ 47,
+                layout);
+
+        char value[16] = {};
+        for (size_t i = 0; i < ndocs; i++) {
+            keys.push_back(makeStoredDocKey("key" + std::to_string(i)));
+            Item item(keys.back(), 0, 0, value, sizeof(value));
+            ASSERT_EQ(MutationStatus::WasClean, ht->set(item));
+        }
+
+        // Look up the keys in a random order so that we miss the caches
+        std::shuffle(keys.begin(), keys.end(), std::mt19937(0));
+    }
+
+    void TearDown(const ::benchmark::State& state) {
+        ht.reset();
+        keys.clear();
+    }
+
+protected:
+    EPStats stats;
+    std::unique_ptr<HashTable> ht;
+    std::vector<StoredDocKey> keys;
+};
+
+BENCHMARK_DEFINE_F(HashTableBench, FindHit)(benchmark::State& state) {
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(ht->find(keys[ii], TrackReference::No,
+                                          WantsDeleted::No));
+        if (++ii == keys.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_DEFINE_F(HashTableBench, FindMiss)(benchmark::State& state) {
+    std::vector<StoredDocKey> missing;
+    for (size_t i = 0; i < keys.size(); i++) {
+        missing.push_back(makeStoredDocKey("missing" + std::to_string(i)));
+    }
+
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(ht->find(missing[ii], TrackReference::No,
+                                          WantsDeleted::No));
+        if (++ii == missing.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(HashTableBench, FindHit)
+        ->Args({0, 1})->Args({1, 1})->Args({0, 4})->Args({1, 4});
+BENCHMARK_REGISTER_F(HashTableBench, FindMiss)
+        ->Args({0, 1})->Args({1, 1})->Args({0, 4})->Args({1, 4});
+
+static DocKeyHashVersion getHashVersion(benchmark::State& state) {
+    if (state.range(0) == int(DocKeyHashVersion::Djb2)) {
+        state.SetLabel("Djb2");
+        return DocKeyHashVersion::Djb2;
+    }
+    state.SetLabel("WordAtATime");
+    return DocKeyHashVersion::WordAtATime;
+}
+
+/**
+ * Keys of the given length which (as the keys of most applications) only
+ * differ by a counter at their end, e.g. "user::profile::0000000042".
+ */
+static std::vector<StoredDocKey> makeClusteredKeys(size_t count,
+                                                   size_t length) {
+    std::vector<StoredDocKey> keys;
+    for (size_t i = 0; i < count; i++) {
+        const auto counter = std::to_string(i);
+        std::string key(length, 'k');
+        key.replace(0, std::min(length, size_t(6)), "user::");
+        key.replace(length - std::min(length, counter.size()),
+                    std::string::npos,
+                    counter);
+        keys.push_back(makeStoredDocKey(key));
+    }
+    return keys;
+}
+
+/*
+ * Measures the rate of the versions of DocKey::hash().
+ * Variables:
+ *  - range(0) : The DocKeyHashVersion
+ *  - range(1) : The length of the keys
+ */
+static void DocKeyHash(benchmark::State& state) {
+    const auto version = getHashVersion(state);
+    const auto keys = makeClusteredKeys(1024, state.range(1));
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(keys[ii].hash(version));
+        ii = (ii + 1) % keys.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(1));
+}
+
+/*
+ * Measures the rate the keys are mapped to the buckets of a HashTable
+ * (sized as one holding them would be) with the versions of the hash, and
+ * reports the distribution of the lengths of the chains they make.
+ * Variables:
+ *  - range(0) : The DocKeyHashVersion
+ *  - range(1) : The length of the keys
+ */
+static void DocKeyHashChains(benchmark::State& state) {
+    const auto version = getHashVersion(state);
+    const size_t ndocs = RUNNING_ON_VALGRIND ? 10 : 1000000;
+    const auto keys = makeClusteredKeys(ndocs, state.range(1));
+    // The size HashTable::resize() picks for that many items
+    const int size = RUNNING_ON_VALGRIND ? 13 : 1572869;
+
+    std::vector<uint32_t> chains(size);
+    while (state.KeepRunning()) {
+        std::fill(chains.begin(), chains.end(), 0);
+        for (const auto& key : keys) {
+            // As HashTable::getBucketForHash()
+            ++chains[std::abs(int(key.hash(version)) % size)];
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * ndocs);
+
+    const double mean = double(ndocs) / size;
+    double variance = 0;
+    for (const auto chain : chains) {
+        variance += (chain - mean) * (chain - mean);
+    }
+    state.counters["EmptyBucketsPct"] =
+            100.0 * std::count(chains.begin(), chains.end(), 0) / size;
+    state.counters["MaxChain"] =
+            *std::max_element(chains.begin(), chains.end());
+    // 1 for a uniformly random hash (the chains are Poisson distributed)
+    state.counters["VarianceToMean"] = variance / size / mean;
+}
+
+static void DocKeyHashArguments(benchmark::internal::Benchmark* b) {
+    for (auto version :
+         {DocKeyHashVersion::Djb2, DocKeyHashVersion::WordAtATime}) {
+        for (int length : {16, 64, 200}) {
+            b->Args({int(version), length});
+        }
+    }
+}
+
+BENCHMARK(DocKeyHash)->Apply(DocKeyHashArguments);
+BENCHMARK(DocKeyHashChains)->Apply(DocKeyHashArguments);
+
+/**
+ * Concurrent operations on a HashTable shared by all of the benchmark
+ * threads, to measure the effects of the lock striping (and of any change
+ * to the layout or the locking of the HashTable).
+ *
+ * The first parameter specifies the distribution of the keys the threads
+ * operate on: 0 picks them uniformly, and 1 sends 90% of the operations
+ * to 10% of the keys (a hot set).
+ */
+class HashTableConcurrentBench : public benchmark::Fixture {
+public:
+    void SetUp(::benchmark::State& state) {
+        // The benchmark threads wait for each other before they start
+        // running, so the first thread sets up the table for all of them
+        if (state.thread_index != 0) {
+            return;
+        }
+
+        ht = std::make_unique<HashTable>(
+                stats,
+                std::make_unique<StoredValueFactory>(stats),
+                ndocs,
+                /*locks*/ 47);
+
+        for (size_t i = 0; i < ndocs; i++) {
+            keys.push_back(makeStoredDocKey("key" + std::to_string(i)));
+            Item item(keys.back(), 0, 0, value, sizeof(value));
+            ASSERT_EQ(MutationStatus::WasClean, ht->set(item));
+        }
+    }
+
+    void TearDown(const ::benchmark::State& state) {
+        if (state.thread_index == 0) {
+            ht.reset();
+            keys.clear();
+        }
+    }
+
+protected:
+    /**
+     * Get the (indexes of the) keys the calling thread operates on, in
+     * the distribution of the benchmark. They are generated up front to
+     * keep the random number generation out of the timed loop.
+     */
+    std::vector<uint32_t> makeSequence(const benchmark::State& state) const {
+        std::mt19937 gen(state.thread_index);
+        std::uniform_int_distribution<uint32_t> all(0, ndocs - 1);
+        std::uniform_int_distribution<uint32_t> hot(
+                0, std::max(size_t(1), ndocs / 10) - 1);
+        std::bernoulli_distribution isHot(0.9);
+
+        std::vector<uint32_t> sequence(1 << 20);
+        for (auto& index : sequence) {
+            index = (state.range(0) == 1 && isHot(gen)) ? hot(gen) : all(gen);
+        }
+        return sequence;
+    }
+
+    void setLabel(benchmark::State& state) const {
+        state.SetLabel(state.range(0) == 1 ? "Hot" : "Uniform");
+    }
+
+    void del(const DocKey& key) {
+        auto hbl = ht->getLockedBucket(key);
+        ht->unlocked_del(hbl, key);
+    }
+
+    // Use enough items to exceed the D$ (as we would in production),
+    // but only a few when running under Valgrind.
+    const size_t ndocs = RUNNING_ON_VALGRIND ? 10 : 1000000;
+    const char value[16] = {};
+
+    EPStats stats;
+    std::unique_ptr<HashTable> ht;
+    std::vector<StoredDocKey> keys;
+};
+
+BENCHMARK_DEFINE_F(HashTableConcurrentBench, Find)(benchmark::State& state) {
+    setLabel(state);
+    const auto sequence = makeSequence(state);
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(ht->find(keys[sequence[ii]],
+                                          TrackReference::No,
+                                          WantsDeleted::No));
+        if (++ii == sequence.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_DEFINE_F(HashTableConcurrentBench, Set)(benchmark::State& state) {
+    setLabel(state);
+    const auto sequence = makeSequence(state);
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        Item item(keys[sequence[ii]], 0, 0, value, sizeof(value));
+        benchmark::DoNotOptimize(ht->set(item));
+        if (++ii == sequence.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/*
+ * A mix of 80% finds, 15% sets and 5% deletes (the keys deleted come back
+ * with the sets of the other operations).
+ */
+BENCHMARK_DEFINE_F(HashTableConcurrentBench, FindSetDelete)
+(benchmark::State& state) {
+    setLabel(state);
+    const auto sequence = makeSequence(state);
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        const auto& key = keys[sequence[ii]];
+        const auto op = ii % 20;
+        if (op < 16) {
+            benchmark::DoNotOptimize(
+                    ht->find(key, TrackReference::No, WantsDeleted::No));
+        } else if (op < 19) {
+            Item item(key, 0, 0, value, sizeof(value));
+            benchmark::DoNotOptimize(ht->set(item));
+        } else {
+            del(key);
+        }
+        if (++ii == sequence.size()) {
+            ii = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/*
+ * The first thread keeps on growing and shrinking the table while the
+ * other threads look up keys; the rate of the finds shows how much the
+ * resizing gets in the way of the front end.
+ */
+BENCHMARK_DEFINE_F(HashTableConcurrentBench, FindDuringResize)
+(benchmark::State& state) {
+    const auto sequence = makeSequence(state);
+    size_t ii = 0;
+    if (state.thread_index == 0) {
+        state.SetLabel("Resize");
+        while (state.KeepRunning()) {
+            ht->resize((ii++ % 2) ? ndocs : ndocs * 4);
+        }
+    } else {
+        setLabel(state);
+        while (state.KeepRunning()) {
+            benchmark::DoNotOptimize(ht->find(keys[sequence[ii]],
+                                              TrackReference::No,
+                                              WantsDeleted::No));
+            if (++ii == sequence.size()) {
+                ii = 0;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/*
+ * The first thread visits the whole table (as the item pager, expiry
+ * pager and access scanner do), while the other threads update keys.
+ * The items processed are the items visited by the first thread, and the
+ * sets of the others.
+ */
+BENCHMARK_DEFINE_F(HashTableConcurrentBench, VisitDuringSet)
+(benchmark::State& state) {
+    class CountingVisitor : public HashTableVisitor {
+    public:
+        bool visit(const HashTable::HashBucketLock& lh,
+                   StoredValue& v) override {
+            ++count;
+            return true;
+        }
+        size_t count = 0;
+    };
+
+    const auto sequence = makeSequence(state);
+    if (state.thread_index == 0) {
+        state.SetLabel("Visit");
+        CountingVisitor visitor;
+        while (state.KeepRunning()) {
+            ht->visit(visitor);
+        }
+        state.SetItemsProcessed(visitor.count);
+    } else {
+        setLabel(state);
+        size_t ii = 0;
+        while (state.KeepRunning()) {
+            Item item(keys[sequence[ii]], 0, 0, value, sizeof(value));
+            benchmark::DoNotOptimize(ht->set(item));
+            if (++ii == sequence.size()) {
+                ii = 0;
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+}
+
+BENCHMARK_REGISTER_F(HashTableConcurrentBench, Find)
+        ->Arg(0)->Arg(1)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableConcurrentBench, Set)
+        ->Arg(0)->Arg(1)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableConcurrentBench, FindSetDelete)
+        ->Arg(0)->Arg(1)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableConcurrentBench, FindDuringResize)
+        ->Arg(0)->ThreadRange(2, 16)->UseRealTime();
+BENCHMARK_REGISTER_F(HashTableConcurrentBench, VisitDuringSet)
+        ->Arg(0)->ThreadRange(1, 16)->UseRealTime();
+
+/*
+ * The memory used per item by the HashTable (the StoredValue, the value
+ * and the share of the hash buckets) of the given value size, as seen by
+ * the allocator.
+ */
+static void HashTableMemoryPerItem(benchmark::State& state) {
+    const size_t ndocs = RUNNING_ON_VALGRIND ? 10 : 100000;
+    std::vector<StoredDocKey> keys;
+    for (size_t i = 0; i < ndocs; i++) {
+        keys.push_back(makeStoredDocKey("key" + std::to_string(i)));
+    }
+    const std::string value(state.range(0), 'x');
+
+    auto* memoryTracker = BenchmarkMemoryTracker::getInstance(
+            *get_mock_server_api()->alloc_hooks);
+    size_t bytes = 0;
+    while (state.KeepRunning()) {
+        EPStats stats;
+        memoryTracker->reset();
+        const auto baseMemory = memoryTracker->getCurrentAlloc();
+        auto ht = std::make_unique<HashTable>(
+                stats, std::make_unique<StoredValueFactory>(stats), ndocs, 47);
+        for (const auto& key : keys) {
+            Item item(key, 0, 0, value.data(), value.size());
+            ht->set(item);
+        }
+        bytes = memoryTracker->getCurrentAlloc() - baseMemory;
+    }
+    state.counters["BytesPerItem"] = bytes / ndocs;
+    memoryTracker->destroyInstance();
+}
+
+BENCHMARK(HashTableMemoryPerItem)->Arg(0)->Arg(16)->Arg(256)->Arg(4096);
@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "engine_fixture.h"
+#include "item.h"
+#include "kv_bucket.h"
+
+#include <cstring>
+#include <vector>
+
+class ItemAllocateBench : public EngineFixture {
+protected:
+    void SetUp(const benchmark::State& state) override {
+        EngineFixture::SetUp(state);
+        engine->getKVBucket()->setVBucketState(
+                vbid, vbucket_state_active, false);
+        for (size_t ii = 0; ii < numKeys; ++ii) {
+            keys.emplace_back("key" + std::to_string(ii),
+                              DocNamespace::DefaultCollection);
+        }
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        keys.clear();
+        EngineFixture::TearDown(state);
+    }
+
+    /// A SET the way the front end does it: allocate, fill in, store
+    void set(const StoredDocKey& key, const std::string& value) {
+        item* itm = nullptr;
+        engine->itemAllocate(&itm,
+                             key,
+                             value.size(),
+                             0 /*priv_nbytes*/,
+                             0 /*flags*/,
+                             0 /*exptime*/,
+                             PROTOCOL_BINARY_RAW_BYTES,
+                             vbid);
+        std::memcpy(const_cast<char*>(static_cast<Item*>(itm)->getData()),
+                    value.data(),
+                    value.size());
+        uint64_t cas = 0;
+        engine->store(cookie, itm, &cas, OPERATION_SET);
+        engine->itemRelease(cookie, itm);
+    }
+
+    const size_t numKeys = 1000;
+    std::vector<StoredDocKey> keys;
+};
+
+/*
+ * Counts the allocations a SET (of an existing key) makes, through the
+ * calls the front end makes to the engine.
+ * Variables:
+ *  - range(0) : The size of the value
+ */
+BENCHMARK_DEFINE_F(ItemAllocateBench, SetAllocations)
+(benchmark::State& state) {
+    const std::string value(state.range(0), 'x');
+    // Create the keys first, so that only updates are measured
+    for (const auto& key : keys) {
+        set(key, value);
+    }
+
+    memoryTracker->reset();
+    size_t sets = 0;
+    while (state.KeepRunning()) {
+        set(keys[sets++ % numKeys], value);
+    }
+    state.counters["AllocationsPerSet"] =
+            double(memoryTracker->getNumAllocs()) / sets;
+}
+
+BENCHMARK_REGISTER_F(ItemAllocateBench, SetAllocations)
+        ->Arg(32)
+        ->Arg(1024)
+        ->Arg(16384);
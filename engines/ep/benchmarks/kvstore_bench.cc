@@ -0,0 +1,133 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "callbacks.h"
+#include "kvstore.h"
+#include "kvstore_config.h"
+#include "tests/module_tests/test_helpers.h"
+#include "vbucket_bgfetch_item.h"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <platform/dirutils.h>
+#include <platform/make_unique.h>
+#include <valgrind/valgrind.h>
+
+/**
+ * Measure the rate at which KVStore::getMulti() background fetches a batch
+ * of documents.
+ *
+ * The parameter specifies the backend: couchstore (whose getMulti reads the
+ * batch with couchstore_docinfos_by_id) or RocksDB (which uses MultiGet).
+ */
+class KVStoreBench : public benchmark::Fixture {
+public:
+    void SetUp(::benchmark::State& state) {
+        std::string backend;
+        switch (state.range(0)) {
+        case 0:
+            backend = "couchdb";
+            break;
+        case 1:
+            backend = "rocksdb";
+            break;
+        default:
+            FAIL() << "Invalid input param(0) value:" << state.range(0);
+        }
+        state.SetLabel(backend.c_str());
+
+        cb::io::rmrf(dataDir);
+        config = std::make_unique<KVStoreConfig>(
+                1024, 4, dataDir, backend, 0, false /*persistnamespace*/);
+        kvstore = std::move(KVStoreFactory::create(*config).rw);
+
+        vbucket_state vbstate(
+                vbucket_state_active, 0, 0, 0, 0, 0, 0, 0, 0, false, "");
+        kvstore->incrementRevision(0);
+        kvstore->snapshotVBucket(
+                0, vbstate, VBStatePersist::VBSTATE_PERSIST_WITHOUT_COMMIT);
+
+        const size_t nkeys = RUNNING_ON_VALGRIND ? 10 : 100000;
+        const std::string value(256, 'x');
+        kvstore->begin();
+        for (size_t i = 0; i < nkeys; i++) {
+            keys.push_back(makeStoredDocKey("key" + std::to_string(i)));
+            Item item(keys.back(), 0, 0, value.data(), value.size());
+            item.setBySeqno(i + 1);
+            kvstore->set(item, wc);
+        }
+        kvstore->commit(nullptr /*no collections manifest*/);
+    }
+
+    void TearDown(const ::benchmark::State& state) {
+        kvstore.reset();
+        config.reset();
+        keys.clear();
+        cb::io::rmrf(dataDir);
+    }
+
+protected:
+    class WriteCallback : public Callback<mutation_result> {
+    public:
+        void callback(mutation_result& result) {
+        }
+    };
+
+    const std::string dataDir = "kvstore_bench";
+    std::unique_ptr<KVStoreConfig> config;
+    std::unique_ptr<KVStore> kvstore;
+    std::vector<StoredDocKey> keys;
+    WriteCallback wc;
+};
+
+/*
+ * getMulti() of a batch of state.range(1) keys, spread over the whole
+ * vbucket (as the keys of a full eviction bgfetch batch are).
+ */
+BENCHMARK_DEFINE_F(KVStoreBench, GetMulti)(benchmark::State& state) {
+    const size_t batchSize = state.range(1);
+    const size_t stride = keys.size() / batchSize + 1;
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        vb_bgfetch_queue_t itms;
+        for (size_t jj = 0; jj < batchSize; jj++) {
+            vb_bgfetch_item_ctx_t ctx;
+            ctx.isMetaOnly = GetMetaOnly::No;
+            ctx.bgfetched_list.push_back(
+                    std::make_unique<VBucketBGFetchItem>(nullptr, false));
+            itms[keys[(ii + jj * stride) % keys.size()]] = std::move(ctx);
+        }
+        ii++;
+        state.ResumeTiming();
+
+        kvstore->getMulti(0, itms);
+    }
+    state.SetItemsProcessed(state.iterations() * batchSize);
+}
+
+#ifdef EP_USE_ROCKSDB
+BENCHMARK_REGISTER_F(KVStoreBench, GetMulti)
+        ->ArgPair(0, 1)
+        ->ArgPair(0, 64)
+        ->ArgPair(1, 1)
+        ->ArgPair(1, 64);
+#else
+BENCHMARK_REGISTER_F(KVStoreBench, GetMulti)->ArgPair(0, 1)->ArgPair(0, 64);
+#endif
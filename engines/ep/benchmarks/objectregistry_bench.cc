@@ -0,0 +1,71 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "blob.h"
+#include "engine_fixture.h"
+#include "objectregistry.h"
+#include "threadlocal.h"
+
+#include <benchmark/benchmark.h>
+
+/*
+ * Benchmarks of the memory tracking done on every allocation and free
+ * (ObjectRegistry), which reads the engine of the calling thread.
+ */
+
+class ObjectRegistryBench : public EngineFixture {};
+
+/*
+ * Creates and frees a value (a Blob), which updates the memory stats of
+ * the engine twice.
+ * Variables:
+ *  - range(0) : The size of the value
+ */
+BENCHMARK_DEFINE_F(ObjectRegistryBench, BlobCreateDelete)
+(benchmark::State& state) {
+    const std::string data(state.range(0), 'x');
+    while (state.KeepRunning()) {
+        value_t value(Blob::New(data.data(), data.size()));
+        benchmark::DoNotOptimize(value.get());
+    }
+}
+
+BENCHMARK_REGISTER_F(ObjectRegistryBench, BlobCreateDelete)
+        ->Arg(32)
+        ->Arg(4096);
+
+/*
+ * The cost of reading a thread-local pointer, through a ThreadLocal (as
+ * the ObjectRegistry used to) and through a thread_local.
+ */
+static void BM_ThreadLocalGet(benchmark::State& state) {
+    static ThreadLocal<EventuallyPersistentEngine*> engine;
+    engine.set(nullptr);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(engine.get());
+    }
+}
+BENCHMARK(BM_ThreadLocalGet);
+
+static void BM_NativeThreadLocalGet(benchmark::State& state) {
+    static thread_local EventuallyPersistentEngine* engine = nullptr;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(engine);
+    }
+}
+BENCHMARK(BM_NativeThreadLocalGet);
+
@@ -17,6 +17,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include <phosphor/phosphor.h>
@@ -68,6 +69,9 @@ public:
         } else {
             LOG(EXTENSION_LOG_NOTICE, "Attempting to generate new access file "
                 "'%s'", next.c_str());
+            if (as.incremental) {
+                openPreviousLog();
+            }
         }
     }
 
@@ -87,6 +91,9 @@ public:
 
     void update() {
         if (log != nullptr) {
+            // Log the keys in key order, which is the order of the by-key
+            // index on disk the warmup loads them from
+            std::sort(accessed.begin(), accessed.end());
             for (auto it = accessed.begin(); it != accessed.end(); ++it) {
                 log->newItem(currentBucket->getId(), *it);
             }
@@ -98,22 +105,44 @@ public:
         currentBucket = vb;
         update();
 
-        if (log == nullptr) {
+        if (log == nullptr || !vBucketFilter(vb->getId())) {
             return;
         }
-        HashTable::Position ht_start;
-        if (vBucketFilter(vb->getId())) {
-            while (ht_start != vb->ht.endPosition()) {
-                ht_start = vb->ht.pauseResumeVisit(*this, ht_start);
-                update();
-                log->commit1();
-                log->commit2();
-                items_scanned = 0;
+        // When resuming the visit of a vbucket which ran out of the budget
+        // of the previous run, current was read when it started
+        if (!isBucketPaused(vb->getId())) {
+            // Read before the keys are, so that a change made meanwhile is
+            // noticed by the next run
+            current.valid = true;
+            current.uuid = vb->failovers->getLatestUUID();
+            current.residentSetChanges = vb->ht.getNumResidentSetChanges();
+
+            if (prevLog && current == as.loggedVBuckets[vb->getId()] &&
+                copyFromPreviousLog(vb->getId())) {
+                ++reusedVBuckets;
+                logged.emplace_back(vb->getId(), current);
+                return;
             }
         }
+
+        bool done;
+        do {
+            done = visitHashTable(*vb, *this);
+            update();
+            log->commit1();
+            log->commit2();
+            items_scanned = 0;
+        } while (!done && !isBucketPaused(vb->getId()));
+
+        if (done) {
+            logged.emplace_back(vb->getId(), current);
+        }
     }
 
     void complete() override {
+        // Done with the current access log before it's renamed
+        prevIt.reset();
+        prevLog.reset();
 
         if (log == nullptr) {
             updateStateFinalizer(false);
@@ -163,13 +192,84 @@ public:
                 return;
             }
             LOG(EXTENSION_LOG_NOTICE, "New access log file '%s' created with "
-                "%" PRIu64 " keys", name.c_str(),
-                static_cast<uint64_t>(num_items));
+                "%" PRIu64 " keys (%" PRIu64 " vbuckets copied from the "
+                "previous one)", name.c_str(),
+                static_cast<uint64_t>(num_items),
+                static_cast<uint64_t>(reusedVBuckets));
+            for (const auto& entry : logged) {
+                as.loggedVBuckets[entry.first] = entry.second;
+            }
+            stats.alogReusedVBuckets.fetch_add(reusedVBuckets);
             updateStateFinalizer(true);
         }
     }
 
 private:
+    /**
+     * Open the current access log of the shard to copy the keys of the
+     * unchanged vbuckets from. Both logs have the vbuckets in the same
+     * (ascending) order, so it is read once from start to end.
+     */
+    void openPreviousLog() {
+        if (access(name.c_str(), F_OK) != 0) {
+            return;
+        }
+        try {
+            prevLog = std::make_unique<MutationLog>(name, log->getBlockSize());
+            prevLog->open(true);
+            prevIt = std::make_unique<MutationLog::iterator>(prevLog->begin());
+        } catch (const MutationLog::ReadException& e) {
+            LOG(EXTENSION_LOG_WARNING,
+                "Not reusing access log '%s': %s",
+                name.c_str(),
+                e.what());
+            prevIt.reset();
+            prevLog.reset();
+        }
+    }
+
+    /**
+     * Log the keys of the given vbucket from the previous access log.
+     *
+     * @return false if the previous log couldn't be read, in which case the
+     *         vbucket must be visited (any keys already copied are then
+     *         logged twice, which the warmup doesn't mind).
+     */
+    bool copyFromPreviousLog(uint16_t vbid) {
+        try {
+            for (; *prevIt != prevLog->end(); ++*prevIt) {
+                const auto le = **prevIt;
+                if (le->type() != MutationLogType::New) {
+                    continue;
+                }
+                if (le->vbucket() > vbid) {
+                    break;
+                }
+                if (le->vbucket() == vbid) {
+                    accessed.push_back(StoredDocKey(le->key()));
+                    if (accessed.size() >= items_to_scan) {
+                        update();
+                        log->commit1();
+                        log->commit2();
+                    }
+                }
+            }
+        } catch (const MutationLog::ReadException& e) {
+            LOG(EXTENSION_LOG_WARNING,
+                "Failed to read access log '%s', no longer reusing it: %s",
+                name.c_str(),
+                e.what());
+            accessed.clear();
+            prevIt.reset();
+            prevLog.reset();
+            return false;
+        }
+        update();
+        log->commit1();
+        log->commit2();
+        return true;
+    }
+
     /**
      * Finalizer method called at the end of completing a visit.
      * @param created_log: Did we successfully create a MutationLog object on
@@ -203,6 +303,18 @@ private:
     std::vector<StoredDocKey> accessed;
 
     std::unique_ptr<MutationLog> log;
+
+    // The current access log of the shard and where we are in it
+    // (alog_incremental)
+    std::unique_ptr<MutationLog> prevLog;
+    std::unique_ptr<MutationLog::iterator> prevIt;
+    // What the segments of the visited vbuckets were generated from, and
+    // what the vbucket being visited is
+    std::vector<std::pair<uint16_t, AccessScanner::LoggedVBucket>> logged;
+    AccessScanner::LoggedVBucket current;
+    // The number of vbuckets copied from prevLog
+    size_t reusedVBuckets = 0;
+
     std::atomic<bool> &stateFinalizer;
     AccessScanner &as;
 
@@ -229,7 +341,9 @@ AccessScanner::AccessScanner(KVBucket& _store,
       conf(conf),
       stats(st),
       sleepTime(sleeptime),
-      available(true) {
+      available(true),
+      incremental(conf.isAlogIncremental()),
+      loggedVBuckets(_store.getVBuckets().getSize()) {
     residentRatioThreshold = conf.getAlogResidentRatioThreshold();
     alogPath = conf.getAlogPath();
     maxStoredItems = conf.getAlogMaxStoredItems();
@@ -294,6 +408,11 @@ bool AccessScanner::run() {
             (replicaCountVisitor.getMemResidentPer() > residentRatioThreshold))
         {
             deleteAccessLogFiles = true;
+            std::fill(loggedVBuckets.begin(),
+                      loggedVBuckets.end(),
+                      LoggedVBucket());
+        } else {
+            stats.alogReusedVBuckets.store(0);
         }
         for (size_t i = 0; i < store.getVBuckets().getNumShards(); i++) {
             if (deleteAccessLogFiles) {
@@ -317,6 +436,8 @@ bool AccessScanner::run() {
                                                               available,
                                                               *this,
                                                               maxStoredItems);
+                pv->setRunBudget(std::chrono::milliseconds(
+                        conf.getVisitorChunkDuration()));
                 auto task = std::make_shared<VBCBAdaptor>(
                         &store,
                         TaskId::AccessScannerVisitor,
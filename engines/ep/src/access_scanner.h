@@ -23,15 +23,18 @@
 #include "globaltask.h"
 
 #include <string>
+#include <vector>
 
 // Forward declaration.
 class Configuration;
 class EPStats;
 class KVBucket;
 class AccessScannerValueChangeListener;
+class ItemAccessVisitor;
 
 class AccessScanner : public GlobalTask {
     friend class AccessScannerValueChangeListener;
+    friend class ItemAccessVisitor;
 public:
     AccessScanner(KVBucket& _store,
                   Configuration& conf,
@@ -47,6 +50,23 @@ public:
     std::atomic<size_t> completedCount;
 
 private:
+    /**
+     * What a vbucket's segment of the current access log was generated from:
+     * the incarnation of the vbucket and the number of changes to its
+     * resident set at the time. If both still match a vbucket's, the keys of
+     * the segment are still the resident ones (alog_incremental).
+     */
+    struct LoggedVBucket {
+        bool valid = false;
+        uint64_t uuid = 0;
+        size_t residentSetChanges = 0;
+
+        bool operator==(const LoggedVBucket& other) const {
+            return valid && other.valid && uuid == other.uuid &&
+                   residentSetChanges == other.residentSetChanges;
+        }
+    };
+
     void updateAlogTime(double sleepSecs);
     void deleteAlogFile(const std::string& fileName);
 
@@ -58,6 +78,14 @@ private:
     std::atomic<bool> available;
     uint8_t residentRatioThreshold;
     uint64_t maxStoredItems;
+    const bool incremental;
+
+    /**
+     * Indexed by vbucket id. The entries of the vbuckets of a shard are only
+     * accessed by the visitor of that shard, and only updated once the
+     * visitor replaced the shard's access log.
+     */
+    std::vector<LoggedVBucket> loggedVBuckets;
 };
 
 #endif  // SRC_ACCESS_SCANNER_H_
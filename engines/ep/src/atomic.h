@@ -125,7 +125,7 @@ public:
     RCValue() : _rc_refcount(0) {}
     RCValue(const RCValue &) : _rc_refcount(0) {}
     ~RCValue() {}
-private:
+protected:
     template <class MyTT> friend class RCPtr;
     template <class MySS> friend class SingleThreadedRCPtr;
     int _rc_incref() const {
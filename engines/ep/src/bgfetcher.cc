@@ -23,6 +23,7 @@
 #include "kv_bucket.h"
 #include "kvshard.h"
 #include "tasks.h"
+#include "trace.h"
 #include "vbucket_bgfetch_item.h"
 
 #include <phosphor/phosphor.h>
@@ -57,6 +58,7 @@ void BgFetcher::notifyBGEvent(void) {
 void BgFetcher::wakeUpTaskIfSnoozed() {
     bool expected = false;
     if (pendingFetch.compare_exchange_strong(expected, true)) {
+        pendingSince.store(to_ns_since_epoch(ProcessClock::now()).count());
         ExecutorPool::get()->wake(taskId);
     }
 }
@@ -69,6 +71,7 @@ size_t BgFetcher::doFetch(VBucket::id_type vbId,
                  vbId,
                  "#itemsToFetch",
                  itemsToFetch.size());
+    MEMCACHED_EP_BGFETCH_START(vbId, int(itemsToFetch.size()));
     ProcessClock::time_point startTime(ProcessClock::now());
     LOG(EXTENSION_LOG_DEBUG,
         "BgFetcher is fetching data, vb:%" PRIu16 " numDocs:%" PRIu64 " "
@@ -102,11 +105,36 @@ size_t BgFetcher::doFetch(VBucket::id_type vbId,
                 fetchedItems.size());
        stats.getMultiBatchSizeHisto.add(fetchedItems.size());
     }
+    if (MEMCACHED_EP_BGFETCH_DONE_ENABLED()) {
+        MEMCACHED_EP_BGFETCH_DONE(
+                vbId,
+                int(fetchedItems.size()),
+                uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                 ProcessClock::now() - startTime)
+                                 .count()));
+    }
 
     return fetchedItems.size();
 }
 
 bool BgFetcher::run(GlobalTask *task) {
+    const bool notified = pendingFetch.load();
+    const ProcessClock::time_point since(
+            std::chrono::nanoseconds(pendingSince.load()));
+
+    // Give the misses of the other vbuckets of the shard the chance to be
+    // queued, so that a single pass fetches them all: leave pendingFetch
+    // set (the misses queued meanwhile needn't wake us) and run again at
+    // the end of the coalescing window of the first miss.
+    const auto window = store->getBgFetcherCoalesceWindow();
+    if (notified && window.count() > 0) {
+        const auto due = since + window;
+        if (ProcessClock::now() < due) {
+            task->updateWaketime(due);
+            return true;
+        }
+    }
+
     // Setup to snooze forever, and *then* clear the pending flag.
     // The ordering of these two statements is important - if we were
     // to clear the flag *before* snoozing, then we could have a Lost
@@ -132,6 +160,7 @@ bool BgFetcher::run(GlobalTask *task) {
         pendingVbs.clear();
     }
 
+    const auto passStart = ProcessClock::now();
     size_t num_fetched_items = 0;
     for (const uint16_t vbId : bg_vbs) {
         VBucketPtr vb = shard->getBucket(vbId);
@@ -154,6 +183,15 @@ bool BgFetcher::run(GlobalTask *task) {
     }
 
     stats.numRemainingBgItems.fetch_sub(num_fetched_items);
+    if (num_fetched_items > 0) {
+        stats.bgFetchPassSizeHisto.add(num_fetched_items);
+        if (notified) {
+            stats.bgFetchCoalesceHisto.add(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                            passStart - since)
+                            .count());
+        }
+    }
 
     return true;
 }
@@ -47,7 +47,8 @@ public:
      * @param st reference to statistics
      */
     BgFetcher(KVBucket* s, KVShard* k, EPStats &st) :
-        store(s), shard(k), taskId(0), stats(st), pendingFetch(false) {}
+        store(s), shard(k), taskId(0), stats(st), pendingFetch(false),
+        pendingSince(0) {}
 
     /**
      * Construct a BgFetcher
@@ -96,6 +97,9 @@ private:
     EPStats &stats;
 
     std::atomic<bool> pendingFetch;
+    /// When pendingFetch was last set (ns since the ProcessClock epoch); the
+    /// coalescing window of a pass starts then.
+    std::atomic<int64_t> pendingSince;
     std::set<VBucket::id_type> pendingVbs;
 };
 
@@ -39,6 +39,24 @@ Blob* Blob::Copy(const Blob& other) {
     return t;
 }
 
+Blob* Blob::NewEmbedded(void* storage, const char* start, size_t len) {
+    Blob* t = new (storage) Blob(start, len, Embedded());
+    t->_rc_incref();
+    return t;
+}
+
+Blob* Blob::NewHolding(void* allocation, size_t len) {
+    Blob* t = new (allocation) Blob(len);
+    t->_rc_incref();
+    return t;
+}
+
+void Blob::releaseHolder(Blob* blob) {
+    if (blob->_rc_decref() == 0) {
+        delete blob;
+    }
+}
+
 Blob::Blob(const char* start, const size_t len)
     : size(static_cast<uint32_t>(len)), age(0) {
     if (start != NULL) {
@@ -54,6 +72,13 @@ Blob::Blob(const char* start, const size_t len)
 Blob::Blob(const size_t len) : Blob(nullptr, len) {
 }
 
+Blob::Blob(const char* start, const size_t len, Embedded)
+    : size(static_cast<uint32_t>(len)), age(0) {
+    if (start != nullptr) {
+        std::memcpy(data, start, len);
+    }
+}
+
 Blob::Blob(const Blob& other)
     : size(other.size),
       // While this is a copy, it is a new allocation therefore reset age.
@@ -53,6 +53,56 @@ public:
      */
     static Blob* Copy(const Blob& other);
 
+    /**
+     * Create a new Blob holding the given data in the given storage (of at
+     * least getAllocationSize(len) bytes), to embed the Blob in the object
+     * owning the storage (see StoredValue).
+     *
+     * An embedded Blob isn't tracked by the ObjectRegistry (its memory is
+     * part of its owner), and it holds a reference to itself so it's never
+     * deleted when the last value_t referring to it goes away. Its owner
+     * must make sure no value_t refers to it when the storage is freed or
+     * reused (see isUnreferencedEmbedded).
+     *
+     * @param storage where to create the Blob
+     * @param start the beginning of the data to copy into this blob
+     * @param len the amount of data to copy in
+     *
+     * @return the new Blob instance
+     */
+    static Blob* NewEmbedded(void* storage, const char* start, size_t len);
+
+    /**
+     * Create a new Blob of the given size at the start of the given
+     * allocation (of at least getAllocationSize(len) bytes, made with
+     * ::operator new), which also holds the object the value is allocated
+     * for (see Item::makeWithValue). The Blob is tracked and freed (with the
+     * whole allocation) as any other Blob.
+     *
+     * The Blob holds a reference for the other object, so the allocation
+     * isn't freed while it lives even if the value is replaced or shared;
+     * the object drops it with releaseHolder() once destroyed.
+     *
+     * @param allocation where to create the Blob
+     * @param len the size of the blob
+     *
+     * @return the new Blob instance
+     */
+    static Blob* NewHolding(void* allocation, size_t len);
+
+    /**
+     * Drop the reference NewHolding() took, deleting the Blob (and freeing
+     * its allocation) if it was the last one.
+     */
+    static void releaseHolder(Blob* blob);
+
+    /**
+     * Get the number of bytes to allocate for a Blob of the given size.
+     */
+    static size_t getAllocationSize(size_t len) {
+        return sizeof(Blob) + len - sizeof(Blob(0, 0).data);
+    }
+
     // Actual accessorish things.
 
     /**
@@ -96,6 +146,14 @@ public:
         }
     }
 
+    /**
+     * True if this embedded Blob (see NewEmbedded) is only referenced by
+     * itself.
+     */
+    bool isUnreferencedEmbedded() const {
+        return _rc_refcount == 1;
+    }
+
     /**
      * Get a std::string representation of this blob.
      */
@@ -127,9 +185,8 @@ protected:
 
     explicit Blob(const Blob& other);
 
-    static size_t getAllocationSize(size_t len) {
-        return sizeof(Blob) + len - sizeof(Blob(0, 0).data);
-    }
+    struct Embedded {};
+    Blob(const char* start, const size_t len, Embedded);
 
     const uint32_t size;
 
@@ -21,7 +21,11 @@
 
 #include "murmurhash3.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 
 #if __x86_64__ || __ppc64__
 #define MURMURHASH_3 MurmurHash3_x64_128
@@ -30,18 +34,74 @@
 #endif
 
 BloomFilter::BloomFilter(size_t key_count, double false_positive_prob,
-                         bfilter_status_t new_status) {
+                         bfilter_status_t new_status, Layout layout_)
+    : layout(layout_), numBlocks(0), blocks(nullptr) {
 
     status = new_status;
     filterSize = estimateFilterSize(key_count, false_positive_prob);
     noOfHashes = estimateNoOfHashes(key_count);
     keyCounter = 0;
-    bitArray.assign(filterSize, false);
+    if (layout == Layout::Blocked) {
+        // Round up to whole blocks
+        const size_t blockBits = BlockWords * 64;
+        numBlocks = std::max(size_t(1), (filterSize + blockBits - 1) / blockBits);
+        filterSize = numBlocks * blockBits;
+        noOfHashes = BlockWords;
+    }
+    allocateFilter();
+}
+
+BloomFilter::BloomFilter(const BloomFilter& other)
+    : filterSize(other.filterSize),
+      noOfHashes(other.noOfHashes),
+      keyCounter(other.keyCounter),
+      status(other.status),
+      layout(other.layout),
+      bitArray(other.bitArray),
+      numBlocks(other.numBlocks),
+      blocks(nullptr) {
+    if (other.blocks != nullptr) {
+        allocateFilter();
+        std::copy(other.blocks, other.blocks + numBlocks * BlockWords, blocks);
+    }
+}
+
+void BloomFilter::allocateFilter() {
+    if (layout == Layout::Standard) {
+        bitArray.assign(filterSize, false);
+    } else {
+        // Allocate an extra block's worth of words so we can align them on
+        // a cache line
+        blockWords.assign((numBlocks + 1) * BlockWords, 0);
+        const auto address = reinterpret_cast<uintptr_t>(blockWords.data());
+        const uintptr_t alignment = BlockWords * sizeof(uint64_t);
+        blocks = blockWords.data() +
+                 ((alignment - (address % alignment)) % alignment) /
+                         sizeof(uint64_t);
+    }
 }
 
 BloomFilter::~BloomFilter() {
     status = BFILTER_DISABLED;
+    clearFilter();
+}
+
+BloomFilter::Layout BloomFilter::parseLayout(const std::string& name) {
+    if (name == "standard") {
+        return Layout::Standard;
+    }
+    if (name == "blocked") {
+        return Layout::Blocked;
+    }
+    throw std::invalid_argument("BloomFilter::parseLayout: unknown layout: " +
+                                name);
+}
+
+void BloomFilter::clearFilter() {
     bitArray.clear();
+    blockWords.clear();
+    blocks = nullptr;
+    numBlocks = 0;
 }
 
 size_t BloomFilter::estimateFilterSize(size_t key_count,
@@ -55,10 +115,35 @@ size_t BloomFilter::estimateNoOfHashes(size_t key_count) {
 }
 
 uint64_t BloomFilter::hashDocKey(const DocKey& key, uint32_t iteration) {
-    uint64_t result = 0;
+    // MurmurHash3 produces 128 bits; we use the first 64
+    uint64_t result[2] = {0, 0};
     uint32_t seed = iteration + (uint32_t(key.getDocNamespace()) * noOfHashes);
-    MURMURHASH_3(key.data(), key.size(), seed, &result);
-    return result;
+    MURMURHASH_3(key.data(), key.size(), seed, result);
+    return result[0];
+}
+
+uint64_t* BloomFilter::getBlock(uint64_t hash) {
+    // Map the top 32 bits of the hash onto the blocks (without a division)
+    const uint64_t index = ((hash >> 32) * numBlocks) >> 32;
+    return blocks + index * BlockWords;
+}
+
+void BloomFilter::getBlockMasks(uint64_t hash,
+                                uint64_t (&masks)[BlockWords]) {
+    // Multiplying the bottom 32 bits of the hash by a different odd
+    // constant for each word gives us the (top 6 bits) bit numbers
+    static const uint32_t salts[BlockWords] = {0x47b6137bU,
+                                               0x44974d91U,
+                                               0x8824ad5bU,
+                                               0xa2b7289dU,
+                                               0x705495c7U,
+                                               0x2df1424bU,
+                                               0x9efc4947U,
+                                               0x5c6bfb31U};
+    const uint32_t h = uint32_t(hash);
+    for (int i = 0; i < BlockWords; i++) {
+        masks[i] = uint64_t(1) << ((h * salts[i]) >> 26);
+    }
 }
 
 void BloomFilter::setStatus(bfilter_status_t to) {
@@ -71,7 +156,7 @@ void BloomFilter::setStatus(bfilter_status_t to) {
         case BFILTER_PENDING:
             if (to == BFILTER_DISABLED) {
                 status = to;
-                bitArray.clear();
+                clearFilter();
             } else if (to == BFILTER_COMPACTING) {
                 status = to;
             }
@@ -79,7 +164,7 @@ void BloomFilter::setStatus(bfilter_status_t to) {
         case BFILTER_COMPACTING:
             if (to == BFILTER_DISABLED) {
                 status = to;
-                bitArray.clear();
+                clearFilter();
             } else if (to == BFILTER_ENABLED) {
                 status = to;
             }
@@ -87,7 +172,7 @@ void BloomFilter::setStatus(bfilter_status_t to) {
         case BFILTER_ENABLED:
             if (to == BFILTER_DISABLED) {
                 status = to;
-                bitArray.clear();
+                clearFilter();
             } else if (to == BFILTER_COMPACTING) {
                 status = to;
             }
@@ -114,7 +199,21 @@ std::string BloomFilter::getStatusString() {
 }
 
 void BloomFilter::addKey(const DocKey& key) {
-    if (status == BFILTER_COMPACTING || status == BFILTER_ENABLED) {
+    if (layout == Layout::Blocked &&
+        (status == BFILTER_COMPACTING || status == BFILTER_ENABLED)) {
+        const uint64_t hash = hashDocKey(key, 0);
+        uint64_t* block = getBlock(hash);
+        uint64_t masks[BlockWords];
+        getBlockMasks(hash, masks);
+        uint64_t missing = 0;
+        for (int i = 0; i < BlockWords; i++) {
+            missing |= masks[i] & ~block[i];
+            block[i] |= masks[i];
+        }
+        if (missing != 0) {
+            keyCounter++;
+        }
+    } else if (status == BFILTER_COMPACTING || status == BFILTER_ENABLED) {
         bool overlap = true;
         for (uint32_t i = 0; i < noOfHashes; i++) {
             uint64_t result = hashDocKey(key, i);
@@ -130,7 +229,19 @@ void BloomFilter::addKey(const DocKey& key) {
 }
 
 bool BloomFilter::maybeKeyExists(const DocKey& key) {
-    if (status == BFILTER_COMPACTING || status == BFILTER_ENABLED) {
+    if (layout == Layout::Blocked &&
+        (status == BFILTER_COMPACTING || status == BFILTER_ENABLED)) {
+        const uint64_t hash = hashDocKey(key, 0);
+        const uint64_t* block = getBlock(hash);
+        uint64_t masks[BlockWords];
+        getBlockMasks(hash, masks);
+        uint64_t missing = 0;
+        for (int i = 0; i < BlockWords; i++) {
+            missing |= masks[i] & ~block[i];
+        }
+        // The key does NOT exist if any of its bits isn't set.
+        return missing == 0;
+    } else if (status == BFILTER_COMPACTING || status == BFILTER_ENABLED) {
         for (uint32_t i = 0; i < noOfHashes; i++) {
             uint64_t result = hashDocKey(key, i);
             if (bitArray[result % filterSize] == 0) {
@@ -158,3 +269,143 @@ size_t BloomFilter::getFilterSize() {
         return 0;
     }
 }
+
+namespace {
+/// The header of a serialized filter (in host byte order)
+struct SerializedHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t layout;
+    uint8_t padding[2];
+    uint64_t filterSize;
+    uint64_t noOfHashes;
+    uint64_t keyCounter;
+};
+
+const uint32_t SerializedMagic = 0x62666c74; // "bflt"
+const uint8_t SerializedVersion = 1;
+} // anonymous namespace
+
+std::string BloomFilter::serialize() const {
+    SerializedHeader header = {};
+    header.magic = SerializedMagic;
+    header.version = SerializedVersion;
+    header.layout = uint8_t(layout);
+    header.filterSize = filterSize;
+    header.noOfHashes = noOfHashes;
+    header.keyCounter = keyCounter;
+
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (layout == Layout::Blocked) {
+        if (blocks != nullptr) {
+            data.append(reinterpret_cast<const char*>(blocks),
+                        numBlocks * BlockWords * sizeof(uint64_t));
+        }
+    } else if (!bitArray.empty()) {
+        // Pack the bits 8 to a byte
+        const size_t offset = data.size();
+        data.resize(offset + (filterSize + 7) / 8, 0);
+        for (size_t i = 0; i < filterSize; i++) {
+            if (bitArray[i]) {
+                data[offset + i / 8] |= char(1 << (i % 8));
+            }
+        }
+    }
+    return data;
+}
+
+std::unique_ptr<BloomFilter> BloomFilter::deserialize(
+        const std::string& data, bfilter_status_t newStatus) {
+    SerializedHeader header;
+    if (data.size() < sizeof(header)) {
+        throw std::invalid_argument(
+                "BloomFilter::deserialize: data too short for the header");
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != SerializedMagic ||
+        header.version != SerializedVersion) {
+        throw std::invalid_argument(
+                "BloomFilter::deserialize: unknown magic or version");
+    }
+    if (header.layout > uint8_t(Layout::Blocked) || header.filterSize == 0) {
+        throw std::invalid_argument(
+                "BloomFilter::deserialize: invalid layout or size");
+    }
+
+    const auto filterLayout = Layout(header.layout);
+    const size_t blockBits = BlockWords * 64;
+    size_t expected;
+    if (filterLayout == Layout::Blocked) {
+        if (header.filterSize % blockBits != 0) {
+            throw std::invalid_argument(
+                    "BloomFilter::deserialize: size isn't whole blocks");
+        }
+        expected = header.filterSize / 8;
+    } else {
+        expected = (header.filterSize + 7) / 8;
+    }
+    if (data.size() != sizeof(header) + expected) {
+        throw std::invalid_argument(
+                "BloomFilter::deserialize: size mismatch; expected " +
+                std::to_string(sizeof(header) + expected) + " bytes, got " +
+                std::to_string(data.size()));
+    }
+
+    std::unique_ptr<BloomFilter> filter(new BloomFilter(filterLayout,
+                                                        header.filterSize,
+                                                        header.noOfHashes,
+                                                        newStatus));
+    filter->keyCounter = header.keyCounter;
+    const char* bits = data.data() + sizeof(header);
+    if (filterLayout == Layout::Blocked) {
+        std::memcpy(filter->blocks, bits, expected);
+    } else {
+        for (size_t i = 0; i < filter->filterSize; i++) {
+            filter->bitArray[i] = (bits[i / 8] >> (i % 8)) & 1;
+        }
+    }
+    return filter;
+}
+
+BloomFilter::BloomFilter(Layout layout_,
+                         size_t filterSize_,
+                         size_t noOfHashes_,
+                         bfilter_status_t newStatus)
+    : filterSize(filterSize_),
+      noOfHashes(noOfHashes_),
+      keyCounter(0),
+      status(newStatus),
+      layout(layout_),
+      numBlocks(layout_ == Layout::Blocked ? filterSize_ / (BlockWords * 64)
+                                           : 0),
+      blocks(nullptr) {
+    allocateFilter();
+}
+
+bool BloomFilter::merge(const BloomFilter& other) {
+    if (layout != other.layout || filterSize != other.filterSize ||
+        noOfHashes != other.noOfHashes) {
+        return false;
+    }
+
+    if (layout == Layout::Blocked) {
+        if (blocks == nullptr || other.blocks == nullptr) {
+            return false;
+        }
+        for (size_t i = 0; i < numBlocks * BlockWords; i++) {
+            blocks[i] |= other.blocks[i];
+        }
+    } else {
+        if (bitArray.size() != other.bitArray.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < filterSize; i++) {
+            if (other.bitArray[i]) {
+                bitArray[i] = true;
+            }
+        }
+    }
+    // We can't tell how many of the keys the filters have in common
+    keyCounter = std::max(keyCounter, other.keyCounter);
+    return true;
+}
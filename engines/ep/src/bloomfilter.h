@@ -20,6 +20,7 @@
 
 #include "config.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -37,13 +38,38 @@ enum bfilter_status_t {
  * We are to maintain the vbucket-number of these instances.
  *
  * Each vbucket will hold one such object.
+ *
+ * With the Standard layout each of the noOfHashes bits of a key is
+ * anywhere in the filter, so a lookup may take noOfHashes cache misses.
+ * The Blocked layout (a "split block" bloom filter) derives all of the bits
+ * of a key from a single hash: the hash picks one 64 byte (cache line)
+ * block, and one bit in each of the 8 words of the block. A lookup then
+ * costs a single cache miss, and the 8 words are checked at once (the loop
+ * is written for the compiler to vectorize). For the same size the false
+ * positive rate is slightly higher than with the Standard layout.
  */
 class BloomFilter {
 public:
+    enum class Layout { Standard, Blocked };
+
     BloomFilter(size_t key_count, double false_positive_prob,
-                bfilter_status_t newStatus = BFILTER_DISABLED);
+                bfilter_status_t newStatus = BFILTER_DISABLED,
+                Layout layout = Layout::Standard);
+    BloomFilter(const BloomFilter& other);
+    BloomFilter& operator=(const BloomFilter& other) = delete;
     ~BloomFilter();
 
+    /**
+     * Get the layout with the given name ("standard" or "blocked")
+     *
+     * @throws std::invalid_argument for unknown layouts
+     */
+    static Layout parseLayout(const std::string& name);
+
+    Layout getLayout() const {
+        return layout;
+    }
+
     void setStatus(bfilter_status_t to);
     bfilter_status_t getStatus();
     std::string getStatusString();
@@ -54,19 +80,72 @@ public:
     size_t getNumOfKeysInFilter();
     size_t getFilterSize();
 
+    /**
+     * Get the filter (its geometry, and the bits) as a string of bytes, to
+     * be restored with deserialize(). The status isn't included.
+     */
+    std::string serialize() const;
+
+    /**
+     * Create a filter from the output of serialize()
+     *
+     * @param data the serialized filter
+     * @param newStatus the status of the new filter
+     * @throws std::invalid_argument if the data isn't a serialized filter
+     */
+    static std::unique_ptr<BloomFilter> deserialize(
+            const std::string& data, bfilter_status_t newStatus);
+
+    /**
+     * Add all of the keys of the other filter to this filter. The filters
+     * must have the same layout, size and number of hashes.
+     *
+     * @return false (leaving this filter as it was) if the filters differ
+     */
+    bool merge(const BloomFilter& other);
+
 protected:
+    /// Create an empty filter with the given geometry (see deserialize())
+    BloomFilter(Layout layout,
+                size_t filterSize,
+                size_t noOfHashes,
+                bfilter_status_t newStatus);
+
+
     size_t estimateFilterSize(size_t key_count, double false_positive_prob);
     size_t estimateNoOfHashes(size_t key_count);
 
     uint64_t hashDocKey(const DocKey& key, uint32_t iteration);
 
+    /// The number of 64-bit words in a block of the Blocked layout
+    static const int BlockWords = 8;
+
+    /// Get the block of the Blocked layout for the given hash
+    uint64_t* getBlock(uint64_t hash);
+
+    /// Get the bit of each word of a block which is set for the given hash
+    static void getBlockMasks(uint64_t hash, uint64_t (&masks)[BlockWords]);
+
+    /// Allocate the (cleared) bits of the filter for its size
+    void allocateFilter();
+
+    /// Release the bits of the filter
+    void clearFilter();
+
     size_t filterSize;
     size_t noOfHashes;
 
     size_t keyCounter;
 
     bfilter_status_t status;
+    const Layout layout;
     std::vector<bool> bitArray;
+
+    // The blocks of the Blocked layout; blocks points at the first 64 byte
+    // aligned word of blockWords.
+    size_t numBlocks;
+    std::vector<uint64_t> blockWords;
+    uint64_t* blocks;
 };
 
 #endif // SRC_BLOOMFILTER_H_
@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <platform/checked_snprintf.h>
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -27,7 +28,9 @@
 #include "ep_time.h"
 #include "pre_link_document_context.h"
 #include "statwriter.h"
+#include "trace.h"
 #include "vbucket.h"
+#include "vbucketmap.h"
 
 const std::string CheckpointManager::pCursorName("persistence");
 
@@ -90,8 +93,10 @@ Checkpoint::Checkpoint(EPStats& st,
       numItems(0),
       numMetaItems(0),
       memOverhead(0),
+      highestExpelledSeqno(0),
       effectiveMemUsage(0) {
     stats.memOverhead->fetch_add(memorySize());
+    stats.checkpointMemory.fetch_add(memorySize());
     if (stats.memOverhead->load() >= GIGANTOR) {
         LOG(EXTENSION_LOG_WARNING,
             "Checkpoint::Checkpoint: stats.memOverhead (which is %" PRId64
@@ -106,6 +111,7 @@ Checkpoint::~Checkpoint() {
         "Checkpoint %" PRIu64 " for vbucket %d is purged from memory",
         checkpointId, vbucketId);
     stats.memOverhead->fetch_sub(memorySize());
+    stats.checkpointMemory.fetch_sub(memorySize() + effectiveMemUsage);
     if (stats.memOverhead->load() >= GIGANTOR) {
         LOG(EXTENSION_LOG_WARNING,
             "Checkpoint::~Checkpoint: stats.memOverhead (which is %" PRId64
@@ -131,7 +137,7 @@ void Checkpoint::popBackCheckpointEndItem() {
 }
 
 bool Checkpoint::keyExists(const DocKey& key) {
-    return keyIndex.find(key) != keyIndex.end();
+    return keyIndex.find(key) != nullptr;
 }
 
 queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
@@ -142,7 +148,10 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                         ") is not OPEN");
     }
     queue_dirty_t rv;
-    checkpoint_index::iterator it = keyIndex.find(qi->getKey());
+    // The index refers to the key of the queued item, so keep an existing
+    // item for the key alive until the index refers to the new one.
+    queued_item existing;
+    const index_entry* it = keyIndex.find(qi->getKey());
     // Check if the item is a meta item
     if (qi->isCheckPointMetaItem()) {
         // empty items act only as a dummy element for the start of the
@@ -155,10 +164,10 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
         toWrite.push_back(qi);
     } else {
         // Check if this checkpoint already had an item for the same key
-        if (it != keyIndex.end()) {
+        if (it != nullptr) {
             rv = EXISTING_ITEM;
-            CheckpointQueue::iterator currPos = it->second.position;
-            const int64_t currMutationId{it->second.mutation_id};
+            const CheckpointQueue::Position currPos = it->position;
+            const int64_t currMutationId{it->mutation_id};
 
             // Given the key already exists, need to check all cursors in this
             // Checkpoint and see if the existing item for this key is to
@@ -177,7 +186,7 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                                                                 : keyIndex;
 
                     auto cursor_item_idx = index.find(cursor_item->getKey());
-                    if (cursor_item_idx == keyIndex.end()) {
+                    if (cursor_item_idx == nullptr) {
                         throw std::logic_error("Checkpoint::queueDirty: Unable "
                                 "to find key with"
                                 " op:" + to_string(cursor_item->getOperation()) +
@@ -192,7 +201,7 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                     // decrement if the the existing item is strictly less than
                     // the cursor, as meta-items can share a seqno with
                     // a non-meta item but are logically before them.
-                    int64_t cursor_mutation_id{cursor_item_idx->second.mutation_id};
+                    int64_t cursor_mutation_id{cursor_item_idx->mutation_id};
                     if (cursor_item->isCheckPointMetaItem()) {
                         --cursor_mutation_id;
                     }
@@ -208,15 +217,17 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                     }
                     /* If an TAP cursor points to the existing item for the same
                        key, shift it left by 1 */
-                    if (cursor.second.currentPos == currPos) {
+                    if (cursor.second.currentPos.getPosition() == currPos) {
                         cursor.second.decrPos();
                     }
                 }
             }
 
             toWrite.push_back(qi);
-            // Remove the existing item for the same key from the list.
+            // Remove the existing item for the same key from the queue.
+            existing = *toWrite.iteratorAt(currPos);
             toWrite.erase(currPos);
+            decrementMemConsumption(existing->size());
         } else {
             ++numItems;
             rv = NEW_ITEM;
@@ -226,22 +237,20 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
     }
 
     if (qi->getKey().size() > 0) {
-        CheckpointQueue::iterator last = toWrite.end();
-        // --last is okay as the list is not empty now.
-        index_entry entry = {--last, qi->getBySeqno()};
+        index_entry entry = {toWrite.backPosition(), qi->getBySeqno()};
         // Set the index of the key to the new item that is pushed back into
         // the list.
         if (qi->isCheckPointMetaItem()) {
             // We add a meta item only once to a checkpoint
-            metaKeyIndex[qi->getKey()] = entry;
+            metaKeyIndex.insert(qi->getKey(), entry);
         } else {
-            keyIndex[qi->getKey()] = entry;
+            keyIndex.insert(qi->getKey(), entry);
         }
         if (rv == NEW_ITEM) {
-            size_t newEntrySize = qi->getKey().size() +
-                                  sizeof(index_entry) + sizeof(queued_item);
+            size_t newEntrySize = sizeof(index_entry) + sizeof(queued_item);
             memOverhead += newEntrySize;
             stats.memOverhead->fetch_add(newEntrySize);
+            stats.checkpointMemory.fetch_add(newEntrySize);
             if (stats.memOverhead->load() >= GIGANTOR) {
                 LOG(EXTENSION_LOG_WARNING,
                     "Checkpoint::queueDirty: stats.memOverhead (which is %" PRId64
@@ -251,6 +260,12 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
         }
     }
 
+    incrementMemConsumption(qi->size());
+
+    if (toWrite.needsCompaction()) {
+        compactQueue(*checkpointManager);
+    }
+
     // Notify flusher if in case queued item is a checkpoint meta item or
     // vbpersist state.
     if (qi->getOperation() == queue_op::checkpoint_start ||
@@ -262,6 +277,43 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
     return rv;
 }
 
+void Checkpoint::compactQueue(CheckpointManager& checkpointManager) {
+    std::vector<CheckpointCursor*> cursorsHere;
+    for (auto& cursor : checkpointManager.connCursors) {
+        if ((*(cursor.second.currentCheckpoint)).get() == this) {
+            cursorsHere.push_back(&cursor.second);
+        }
+    }
+    std::sort(cursorsHere.begin(),
+              cursorsHere.end(),
+              [](const CheckpointCursor* a, const CheckpointCursor* b) {
+                  return a->currentPos.getPosition() <
+                         b->currentPos.getPosition();
+              });
+
+    auto nextCursor = cursorsHere.begin();
+    toWrite.compact([this, &cursorsHere, &nextCursor](
+            CheckpointQueue::Position from,
+            CheckpointQueue::Position to,
+            const queued_item& qi) {
+        auto& index = qi->isCheckPointMetaItem() ? metaKeyIndex : keyIndex;
+        auto entry = index.find(qi->getKey());
+        if (entry != nullptr && entry->position == from) {
+            entry->position = to;
+        }
+
+        // Cursors are always positioned on an item, so every cursor is
+        // found here in turn
+        while (nextCursor != cursorsHere.end() &&
+               (*nextCursor)->currentPos.getPosition() <= from) {
+            if ((*nextCursor)->currentPos.getPosition() == from) {
+                (*nextCursor)->currentPos = toWrite.iteratorAt(to);
+            }
+            ++nextCursor;
+        }
+    });
+}
+
 const StoredDocKey Checkpoint::DummyKey("dummy_key", DocNamespace::System);
 const StoredDocKey Checkpoint::CheckpointStartKey("checkpoint_start", DocNamespace::System);
 const StoredDocKey Checkpoint::CheckpointEndKey("checkpoint_end", DocNamespace::System);
@@ -276,15 +328,21 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
         " for vbucket %d",
         pPrevCheckpoint->getId(), checkpointId, vbucketId);
 
-    CheckpointQueue::iterator itr = toWrite.begin();
+    // The items of the previous checkpoint go after the first two meta
+    // items (empty & checkpoint start). Take those off the queue while we
+    // push the items to its front, and put them back in front at the end.
+    queued_item dummy = toWrite.front();
+    toWrite.pop_front();
+    queued_item checkpointStart = toWrite.front();
+    toWrite.pop_front();
+
     uint64_t seqno = pPrevCheckpoint->getMutationIdForKey(Checkpoint::DummyKey, true);
-    metaKeyIndex[Checkpoint::DummyKey].mutation_id = seqno;
-    (*itr)->setBySeqno(seqno);
+    metaKeyIndex.find(Checkpoint::DummyKey)->mutation_id = seqno;
+    dummy->setBySeqno(seqno);
 
     seqno = pPrevCheckpoint->getMutationIdForKey(Checkpoint::CheckpointStartKey, true);
-    metaKeyIndex[Checkpoint::CheckpointStartKey].mutation_id = seqno;
-    ++itr;
-    (*itr)->setBySeqno(seqno);
+    metaKeyIndex.find(Checkpoint::CheckpointStartKey)->mutation_id = seqno;
+    checkpointStart->setBySeqno(seqno);
 
     // Iterate in reverse over the previous checkpoints' items, inserting them
     // into the current checkpoint as necessary.
@@ -298,14 +356,12 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
                 // checkpoint if the key isn't already present (if it is already
                 // present then it must be an older revision and hence we can
                 // safely discard it).
-                if (keyIndex.find(key) == keyIndex.end()) {
-                    // Skip the first two meta items (empty & checkpoint start).
-                    auto pos = std::next(toWrite.begin(), 2);
-                    toWrite.insert(pos, *rit);
-                    index_entry entry = {--pos, static_cast<int64_t>(pPrevCheckpoint->
+                if (keyIndex.find(key) == nullptr) {
+                    const auto pos = toWrite.push_front(*rit);
+                    index_entry entry = {pos, static_cast<int64_t>(pPrevCheckpoint->
                                                     getMutationIdForKey(key, false))};
-                    keyIndex[key] = entry;
-                    newEntryMemOverhead += key.size() + sizeof(index_entry);
+                    keyIndex.insert((*rit)->getKey(), entry);
+                    newEntryMemOverhead += sizeof(index_entry);
                     ++numItems;
                     ++numNewItems;
 
@@ -336,14 +392,12 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
             case queue_op::set_vbucket_state:
             case queue_op::system_event:
                 // Need to re-insert these into the correct place in the index.
-                if (metaKeyIndex.find(key) == metaKeyIndex.end()) {
-                    // Skip the first two meta items (empty & checkpoint start).
-                    auto pos = std::next(toWrite.begin(), 2);
-                    toWrite.insert(pos, *rit);
+                if (metaKeyIndex.find(key) == nullptr) {
+                    const auto pos = toWrite.push_front(*rit);
                     auto mutationId = static_cast<int64_t>(
                             pPrevCheckpoint->getMutationIdForKey(key, true));
-                    metaKeyIndex[key] = {--pos, mutationId};
-                    newEntryMemOverhead += key.size() + sizeof(index_entry);
+                    metaKeyIndex.insert((*rit)->getKey(), {pos, mutationId});
+                    newEntryMemOverhead += sizeof(index_entry);
                     ++numMetaItems;
                     ++numNewItems;
 
@@ -354,6 +408,11 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
         }
     }
 
+    metaKeyIndex.find(Checkpoint::CheckpointStartKey)->position =
+            toWrite.push_front(checkpointStart);
+    metaKeyIndex.find(Checkpoint::DummyKey)->position =
+            toWrite.push_front(dummy);
+
     /**
      * Update snapshot start of current checkpoint to the first
      * item's sequence number, after merge completed, as items
@@ -361,9 +420,13 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
      * checkpoint.
      */
     setSnapshotStartSeqno(getLowSeqno());
+    // The items expelled from the previous checkpoint are missing here too
+    highestExpelledSeqno = std::max(highestExpelledSeqno,
+                                    pPrevCheckpoint->highestExpelledSeqno);
 
     memOverhead += newEntryMemOverhead;
     stats.memOverhead->fetch_add(newEntryMemOverhead);
+    stats.checkpointMemory.fetch_add(newEntryMemOverhead);
     LOG(EXTENSION_LOG_WARNING,
         "Checkpoint::mergePrevCheckpoint: stats.memOverhead (which is %" PRId64
         ") is greater than %" PRId64, uint64_t(stats.memOverhead->load()),
@@ -371,13 +434,50 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
     return numNewItems;
 }
 
+size_t Checkpoint::expelItems(CheckpointQueue::Position until,
+                              CheckpointManager& checkpointManager) {
+    size_t numExpelled = 0;
+    size_t expelledMemOverhead = 0;
+    auto it = toWrite.begin();
+    while (it != toWrite.end() && it.getPosition() < until) {
+        const CheckpointQueue::Position pos = it.getPosition();
+        // The index refers to the key of the item, keep it alive until the
+        // entry is gone.
+        const queued_item qi = *it;
+        ++it;
+        // Keep the meta items, the cursors and the checkpoint collapse
+        // rely on them.
+        if (qi->isCheckPointMetaItem()) {
+            continue;
+        }
+        keyIndex.erase(qi->getKey());
+        toWrite.erase(pos);
+
+        --numItems;
+        ++numExpelled;
+        decrementMemConsumption(qi->size());
+        expelledMemOverhead += sizeof(index_entry) + sizeof(queued_item);
+        highestExpelledSeqno = std::max(highestExpelledSeqno,
+                                        uint64_t(qi->getBySeqno()));
+    }
+
+    memOverhead -= expelledMemOverhead;
+    stats.memOverhead->fetch_sub(expelledMemOverhead);
+    stats.checkpointMemory.fetch_sub(expelledMemOverhead);
+
+    if (toWrite.needsCompaction()) {
+        compactQueue(checkpointManager);
+    }
+    return numExpelled;
+}
+
 uint64_t Checkpoint::getMutationIdForKey(const DocKey& key, bool isMeta) {
     uint64_t mid = 0;
-    checkpoint_index& chkIdx = isMeta ? metaKeyIndex : keyIndex;
+    const CheckpointIndex& chkIdx = isMeta ? metaKeyIndex : keyIndex;
 
-    checkpoint_index::iterator it = chkIdx.find(key);
-    if (it != chkIdx.end()) {
-        mid = it->second.mutation_id;
+    const index_entry* it = chkIdx.find(key);
+    if (it != nullptr) {
+        mid = it->mutation_id;
     } else {
         throw std::invalid_argument("key{" +
                                     std::string(reinterpret_cast<const char*>(key.data())) +
@@ -423,13 +523,15 @@ CheckpointManager::CheckpointManager(EPStats& st,
                                      FlusherCallback cb)
     : stats(st),
       checkpointConfig(config),
+      queueLock(LockStats::checkpointQueue),
       vbucketId(vbucket),
       numItems(0),
       lastBySeqno(lastSeqno),
       isCollapsedCheckpoint(false),
       pCursorPreCheckpointId(0),
-      flusherCB(cb) {
-    LockHolder lh(queueLock);
+      flusherCB(cb),
+      seqnoSlot(nullptr) {
+    QueueWriterLockHolder lh(queueLock);
     addNewCheckpoint_UNLOCKED(1, lastSnapStart, lastSnapEnd);
     if (checkpointConfig.isPersistenceEnabled()) {
         registerCursor_UNLOCKED(
@@ -447,7 +549,7 @@ uint64_t CheckpointManager::getOpenCheckpointId_UNLOCKED() {
 }
 
 uint64_t CheckpointManager::getOpenCheckpointId() {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
     return getOpenCheckpointId_UNLOCKED();
 }
 
@@ -460,7 +562,7 @@ uint64_t CheckpointManager::getLastClosedCheckpointId_UNLOCKED() {
 }
 
 uint64_t CheckpointManager::getLastClosedCheckpointId() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     return getLastClosedCheckpointId_UNLOCKED();
 }
 
@@ -514,6 +616,7 @@ bool CheckpointManager::addNewCheckpoint_UNLOCKED(uint64_t id,
     LOG(EXTENSION_LOG_INFO, "Create a new open checkpoint %" PRIu64
         " for vbucket %" PRIu16 " at seqno:%" PRIu64,
         id, vbucketId, snapStartSeqno);
+    MEMCACHED_EP_CHECKPOINT_CREATE(vbucketId, id, snapStartSeqno, snapEndSeqno);
 
     bool was_empty = checkpointList.empty() ? true : false;
     auto checkpoint = std::make_unique<Checkpoint>(stats, id, snapStartSeqno,
@@ -532,6 +635,7 @@ bool CheckpointManager::addNewCheckpoint_UNLOCKED(uint64_t id,
     checkpoint->queueDirty(qi, this);
     ++numItems;
     checkpointList.push_back(std::move(checkpoint));
+    publishSeqnos_UNLOCKED();
 
     if (was_empty) {
         return true;
@@ -600,7 +704,7 @@ bool CheckpointManager::closeOpenCheckpoint_UNLOCKED() {
 }
 
 bool CheckpointManager::closeOpenCheckpoint() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     return closeOpenCheckpoint_UNLOCKED();
 }
 
@@ -609,7 +713,7 @@ bool CheckpointManager::registerCursor(
                             uint64_t checkpointId,
                             bool alwaysFromBeginning,
                             MustSendCheckpointEnd needsCheckpointEndMetaItem) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     return registerCursor_UNLOCKED(name, checkpointId, alwaysFromBeginning,
                                    needsCheckpointEndMetaItem);
 }
@@ -618,7 +722,7 @@ CursorRegResult CheckpointManager::registerCursorBySeqno(
                             const std::string &name,
                             uint64_t startBySeqno,
                             MustSendCheckpointEnd needsCheckPointEndMetaItem) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     if (checkpointList.empty()) {
         throw std::logic_error("CheckpointManager::registerCursorBySeqno: "
                         "checkpointList is empty");
@@ -643,6 +747,12 @@ CursorRegResult CheckpointManager::registerCursorBySeqno(
     for (; itr != checkpointList.end(); ++itr) {
         uint64_t en = (*itr)->getHighSeqno();
         uint64_t st = (*itr)->getLowSeqno();
+        // The cursor can only start after the items expelled from the
+        // checkpoint; the stream backfills them.
+        const uint64_t expelled = (*itr)->getHighestExpelledSeqno();
+        if (expelled > 0) {
+            st = std::max(st, expelled + 1);
+        }
 
         if (startBySeqno < st) {
             // Requested sequence number is before the start of this
@@ -652,7 +762,7 @@ CursorRegResult CheckpointManager::registerCursorBySeqno(
                                                  false,
                                                  needsCheckPointEndMetaItem);
             (*itr)->registerCursorName(name);
-            result.first = (*itr)->getLowSeqno();
+            result.first = st;
             break;
         } else if (startBySeqno <= en) {
             // Requested sequence number lies within this checkpoint.
@@ -814,7 +924,7 @@ bool CheckpointManager::registerCursor_UNLOCKED(
 }
 
 bool CheckpointManager::removeCursor(const std::string &name) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     return removeCursor_UNLOCKED(name);
 }
 
@@ -845,7 +955,7 @@ bool CheckpointManager::removeCursor_UNLOCKED(const std::string &name) {
 }
 
 uint64_t CheckpointManager::getCheckpointIdForCursor(const std::string &name) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     cursor_index::iterator it = connCursors.find(name);
     if (it == connCursors.end()) {
         return 0;
@@ -855,17 +965,17 @@ uint64_t CheckpointManager::getCheckpointIdForCursor(const std::string &name) {
 }
 
 size_t CheckpointManager::getNumOfCursors() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     return connCursors.size();
 }
 
 size_t CheckpointManager::getNumCheckpoints() const {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
     return checkpointList.size();
 }
 
 checkpointCursorInfoList CheckpointManager::getAllCursors() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     checkpointCursorInfoList cursorInfo;
     for (auto& cur_it : connCursors) {
         cursorInfo.push_back(std::make_pair(
@@ -883,7 +993,8 @@ bool CheckpointManager::isCheckpointCreationForHighMemUsage(
     bool allCursorsInOpenCheckpoint =
         (connCursors.size() + 1) == checkpointList.back()->getNumberOfCursors();
 
-    if (memoryUsed > stats.mem_high_wat && allCursorsInOpenCheckpoint &&
+    if ((memoryUsed > stats.mem_high_wat || isCheckpointMemoryOverQuota()) &&
+        allCursorsInOpenCheckpoint &&
         (checkpointList.back()->getNumItems() >= MIN_CHECKPOINT_ITEMS ||
          checkpointList.back()->getNumItems() ==
                  vbucket.ht.getNumInMemoryItems())) {
@@ -892,10 +1003,15 @@ bool CheckpointManager::isCheckpointCreationForHighMemUsage(
     return forceCreation;
 }
 
+bool CheckpointManager::isCheckpointMemoryOverQuota() const {
+    return stats.checkpointMemory >
+           stats.getMaxDataSize() * checkpointConfig.getCheckpointMemoryRatio();
+}
+
 size_t CheckpointManager::removeClosedUnrefCheckpoints(
         VBucket& vbucket, bool& newOpenCheckpointCreated) {
     // This function is executed periodically by the non-IO dispatcher.
-    std::unique_lock<std::mutex> lh(queueLock);
+    std::unique_lock<QueueLock> lh(queueLock);
     uint64_t oldCheckpointId = 0;
     bool canCreateNewCheckpoint = false;
     if (checkpointList.size() < checkpointConfig.getMaxCheckpoints() ||
@@ -913,7 +1029,7 @@ size_t CheckpointManager::removeClosedUnrefCheckpoints(
 
     if (checkpointConfig.canKeepClosedCheckpoints()) {
         double memoryUsed = static_cast<double>(stats.getTotalMemoryUsed());
-        if (memoryUsed < stats.mem_high_wat &&
+        if (memoryUsed < stats.mem_high_wat && !isCheckpointMemoryOverQuota() &&
             checkpointList.size() <= checkpointConfig.getMaxCheckpoints()) {
             return 0;
         }
@@ -1084,8 +1200,58 @@ void CheckpointManager::collapseClosedCheckpoints(
     }
 }
 
+size_t CheckpointManager::expelUnreferencedCheckpointItems() {
+    QueueWriterLockHolder lh(queueLock);
+
+    // Only the oldest checkpoint, so that no cursor is behind the expelled
+    // items. It must be closed and, if persistence is enabled, flushed (as
+    // for removing the checkpoint), as a stream registered later will have
+    // to backfill the expelled items.
+    auto& oldest = checkpointList.front();
+    if (oldest->getState() != CHECKPOINT_CLOSED ||
+        (checkpointConfig.isPersistenceEnabled() &&
+         oldest->getId() > pCursorPreCheckpointId)) {
+        return 0;
+    }
+
+    // The items before the slowest cursor in the checkpoint were processed
+    // by all of the cursors; the item a cursor is on must stay.
+    bool hasCursors = false;
+    CheckpointQueue::Position until = 0;
+    for (const auto& cursor : connCursors) {
+        if ((*(cursor.second.currentCheckpoint)).get() == oldest.get()) {
+            const auto pos = cursor.second.currentPos.getPosition();
+            until = hasCursors ? std::min(until, pos) : pos;
+            hasCursors = true;
+        }
+    }
+    if (!hasCursors) {
+        // Unreferenced, the whole checkpoint is removed instead
+        return 0;
+    }
+
+    const size_t memBefore = oldest->getMemConsumption() + oldest->memorySize();
+    const size_t numExpelled = oldest->expelItems(until, *this);
+    if (numExpelled == 0) {
+        return 0;
+    }
+
+    numItems.fetch_sub(numExpelled);
+    for (auto& cursor : connCursors) {
+        cursor.second.decrOffset(numExpelled);
+    }
+    stats.itemsExpelledFromCheckpoints.fetch_add(numExpelled);
+
+    LOG(EXTENSION_LOG_INFO,
+        "Expelled %" PRIu64 " items from checkpoint %" PRIu64
+        " for vbucket %d",
+        uint64_t(numExpelled), oldest->getId(), vbucketId);
+
+    return memBefore - (oldest->getMemConsumption() + oldest->memorySize());
+}
+
 std::vector<std::string> CheckpointManager::getListOfCursorsToDrop() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
 
     // List of cursor names whose streams will be closed
     std::vector<std::string> cursorsToDrop;
@@ -1114,26 +1280,19 @@ std::vector<std::string> CheckpointManager::getListOfCursorsToDrop() {
     return cursorsToDrop;
 }
 
-void CheckpointManager::updateStatsForNewQueuedItem_UNLOCKED(const LockHolder&,
-                                                             VBucket& vb,
-                                                             const queued_item& qi) {
+void CheckpointManager::updateStatsForNewQueuedItem_UNLOCKED(
+        const QueueWriterLockHolder&, VBucket& vb, const queued_item& qi) {
     ++stats.totalEnqueued;
     if (checkpointConfig.isPersistenceEnabled()) {
         ++stats.diskQueueSize;
         vb.doStatsForQueueing(*qi, qi->size());
     }
-    // Update the checkpoint's memory usage
-    checkpointList.back()->incrementMemConsumption(qi->size());
 }
 
-bool CheckpointManager::queueDirty(
+void CheckpointManager::prepareOpenCheckpoint_UNLOCKED(
+        const QueueWriterLockHolder&,
         VBucket& vb,
-        queued_item& qi,
-        const GenerateBySeqno generateBySeqno,
-        const GenerateCas generateCas,
-        PreLinkDocumentContext* preLinkDocumentContext) {
-    LockHolder lh(queueLock);
-
+        const GenerateBySeqno generateBySeqno) {
     bool canCreateNewCheckpoint = false;
     if (checkpointList.size() < checkpointConfig.getMaxCheckpoints() ||
         (checkpointList.size() == checkpointConfig.getMaxCheckpoints() &&
@@ -1166,6 +1325,37 @@ bool CheckpointManager::queueDirty(
                 std::to_string(checkpointList.back()->getState()) +
                 ") is not OPEN");
     }
+}
+
+void CheckpointManager::checkSnapshotRange_UNLOCKED(
+        const QueueWriterLockHolder&,
+        const VBucket& vb,
+        const int64_t seqno,
+        const GenerateBySeqno generateBySeqno) const {
+    uint64_t st = checkpointList.back()->getSnapshotStartSeqno();
+    uint64_t en = checkpointList.back()->getSnapshotEndSeqno();
+    if (!(st <= static_cast<uint64_t>(seqno) &&
+          static_cast<uint64_t>(seqno) <= en)) {
+        throw std::logic_error("CheckpointManager::queueDirty: lastBySeqno "
+                "not in snapshot range. vb:" + std::to_string(vb.getId()) +
+                " state:" + std::string(VBucket::toString(vb.getState())) +
+                " snapshotStart:" + std::to_string(st) +
+                " lastBySeqno:" + std::to_string(seqno) +
+                " snapshotEnd:" + std::to_string(en) +
+                " genSeqno:" + to_string(generateBySeqno));
+    }
+}
+
+bool CheckpointManager::queueDirty(
+        VBucket& vb,
+        queued_item& qi,
+        const GenerateBySeqno generateBySeqno,
+        const GenerateCas generateCas,
+        PreLinkDocumentContext* preLinkDocumentContext) {
+    qi->setEnqueueTime(gethrtime());
+
+    QueueWriterLockHolder lh(queueLock);
+    prepareOpenCheckpoint_UNLOCKED(lh, vb, generateBySeqno);
 
     if (GenerateBySeqno::Yes == generateBySeqno) {
         qi->setBySeqno(++lastBySeqno);
@@ -1184,18 +1374,7 @@ bool CheckpointManager::queueDirty(
         }
     }
 
-    uint64_t st = checkpointList.back()->getSnapshotStartSeqno();
-    uint64_t en = checkpointList.back()->getSnapshotEndSeqno();
-    if (!(st <= static_cast<uint64_t>(lastBySeqno) &&
-          static_cast<uint64_t>(lastBySeqno) <= en)) {
-        throw std::logic_error("CheckpointManager::queueDirty: lastBySeqno "
-                "not in snapshot range. vb:" + std::to_string(vb.getId()) +
-                " state:" + std::string(VBucket::toString(vb.getState())) +
-                " snapshotStart:" + std::to_string(st) +
-                " lastBySeqno:" + std::to_string(lastBySeqno) +
-                " snapshotEnd:" + std::to_string(en) +
-                " genSeqno:" + to_string(generateBySeqno));
-    }
+    checkSnapshotRange_UNLOCKED(lh, vb, lastBySeqno, generateBySeqno);
 
     queue_dirty_t result = checkpointList.back()->queueDirty(qi, this);
 
@@ -1206,13 +1385,69 @@ bool CheckpointManager::queueDirty(
     if (result != EXISTING_ITEM) {
         updateStatsForNewQueuedItem_UNLOCKED(lh, vb, qi);
     }
+    publishSeqnos_UNLOCKED();
 
     return result != EXISTING_ITEM;
 }
 
+size_t CheckpointManager::queueDirty(VBucket& vb,
+                                     std::vector<queued_item>& items,
+                                     const GenerateBySeqno generateBySeqno,
+                                     const GenerateCas generateCas) {
+    if (items.empty()) {
+        return 0;
+    }
+
+    const hrtime_t now = gethrtime();
+    for (auto& qi : items) {
+        qi->setEnqueueTime(now);
+    }
+
+    QueueWriterLockHolder lh(queueLock);
+    prepareOpenCheckpoint_UNLOCKED(lh, vb, generateBySeqno);
+    auto& openCheckpoint = checkpointList.back();
+
+    if (GenerateBySeqno::Yes == generateBySeqno) {
+        // Reserve the seqnos of the whole batch at once
+        int64_t seqno = lastBySeqno;
+        lastBySeqno = seqno + static_cast<int64_t>(items.size());
+        for (auto& qi : items) {
+            qi->setBySeqno(++seqno);
+        }
+        openCheckpoint->setSnapshotEndSeqno(lastBySeqno);
+    } else {
+        // The seqnos must be increasing, so checking the range of the first
+        // and the last covers them all.
+        checkSnapshotRange_UNLOCKED(
+                lh, vb, items.front()->getBySeqno(), generateBySeqno);
+        for (const auto& qi : items) {
+            lastBySeqno = qi->getBySeqno();
+        }
+    }
+    checkSnapshotRange_UNLOCKED(lh, vb, lastBySeqno, generateBySeqno);
+
+    size_t numQueued = 0;
+    for (auto& qi : items) {
+        if (GenerateCas::Yes == generateCas) {
+            qi->setCas(vb.nextHLCCas());
+        }
+
+        queue_dirty_t result = openCheckpoint->queueDirty(qi, this);
+        if (result == NEW_ITEM) {
+            ++numItems;
+        }
+        if (result != EXISTING_ITEM) {
+            updateStatsForNewQueuedItem_UNLOCKED(lh, vb, qi);
+            ++numQueued;
+        }
+    }
+    publishSeqnos_UNLOCKED();
+    return numQueued;
+}
+
 void CheckpointManager::queueSetVBState(VBucket& vb) {
     // Take lock to serialize use of {lastBySeqno} and to queue op.
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
 
     // Create the setVBState operation, and enqueue it.
     queued_item item = createCheckpointItem(/*id*/0, vbucketId,
@@ -1223,6 +1458,7 @@ void CheckpointManager::queueSetVBState(VBucket& vb) {
     if (result == NEW_ITEM) {
         ++numItems;
         updateStatsForNewQueuedItem_UNLOCKED(lh, vb, item);
+        publishSeqnos_UNLOCKED();
     } else {
         throw std::logic_error("CheckpointManager::queueSetVBState: "
                 "expected: NEW_ITEM, got:" + std::to_string(result) +
@@ -1233,7 +1469,7 @@ void CheckpointManager::queueSetVBState(VBucket& vb) {
 snapshot_range_t CheckpointManager::getAllItemsForCursor(
                                              const std::string& name,
                                              std::vector<queued_item> &items) {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
     snapshot_range_t range;
     cursor_index::iterator it = connCursors.find(name);
     if (it == connCursors.end()) {
@@ -1242,6 +1478,7 @@ snapshot_range_t CheckpointManager::getAllItemsForCursor(
         return range;
     }
 
+    std::lock_guard<std::mutex> cursorLock(it->second.lock);
     bool moreItems;
     range.start = (*it->second.currentCheckpoint)->getSnapshotStartSeqno();
     range.end = (*it->second.currentCheckpoint)->getSnapshotEndSeqno();
@@ -1268,9 +1505,54 @@ snapshot_range_t CheckpointManager::getAllItemsForCursor(
     return range;
 }
 
+snapshot_range_t CheckpointManager::visitItemsForCursor(
+        const std::string& name, const ItemVisitor& visitor) {
+    QueueReaderLockHolder lh(queueLock);
+    snapshot_range_t range;
+    cursor_index::iterator it = connCursors.find(name);
+    if (it == connCursors.end()) {
+        range.start = 0;
+        range.end = 0;
+        return range;
+    }
+
+    CheckpointCursor& cursor = it->second;
+    std::lock_guard<std::mutex> cursorLock(cursor.lock);
+    range.start = (*cursor.currentCheckpoint)->getSnapshotStartSeqno();
+    range.end = (*cursor.currentCheckpoint)->getSnapshotEndSeqno();
+    while (incrCursor(cursor)) {
+        const queued_item& qi = *(cursor.currentPos);
+
+        // A key is indexed at most once per checkpoint, so an item is only
+        // superseded by an item of one of the checkpoints after its own.
+        bool superseded = false;
+        if (!qi->isCheckPointMetaItem()) {
+            auto later = cursor.currentCheckpoint;
+            while (!superseded && ++later != checkpointList.end()) {
+                superseded = (*later)->keyExists(qi->getKey());
+            }
+        }
+        visitor(qi, superseded);
+
+        if (qi->getOperation() == queue_op::checkpoint_end) {
+            range.end = (*cursor.currentCheckpoint)->getSnapshotEndSeqno();
+            moveCursorToNextCheckpoint(cursor);
+        }
+    }
+    range.end = (*cursor.currentCheckpoint)->getSnapshotEndSeqno();
+
+    LOG(EXTENSION_LOG_DEBUG, "CheckpointManager::visitItemsForCursor() "
+            "cursor:%s range:{%" PRIu64 ", %" PRIu64 "}",
+            name.c_str(), range.start, range.end);
+
+    cursor.numVisits++;
+
+    return range;
+}
+
 queued_item CheckpointManager::nextItem(const std::string &name,
                                         bool &isLastMutationItem) {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
     cursor_index::iterator it = connCursors.find(name);
     if (it == connCursors.end()) {
         LOG(EXTENSION_LOG_WARNING,
@@ -1291,6 +1573,7 @@ queued_item CheckpointManager::nextItem(const std::string &name,
     }
 
     CheckpointCursor &cursor = it->second;
+    std::lock_guard<std::mutex> cursorLock(cursor.lock);
     if (incrCursor(cursor)) {
         isLastMutationItem = isLastMutationItemInCheckpoint(cursor);
         return *(cursor.currentPos);
@@ -1321,7 +1604,7 @@ void CheckpointManager::dump() const {
 }
 
 void CheckpointManager::clear(VBucket& vb, uint64_t seqno) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     clear_UNLOCKED(vb.getState(), seqno);
 
     // Reset the disk write queue size stat for the vbucket
@@ -1363,7 +1646,7 @@ void CheckpointManager::resetCursors(bool resetPersistenceCursor) {
 }
 
 void CheckpointManager::resetCursors(checkpointCursorInfoList &cursors) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
 
     for (auto& it : cursors) {
         registerCursor_UNLOCKED(it.first, getOpenCheckpointId_UNLOCKED(), true,
@@ -1396,7 +1679,7 @@ bool CheckpointManager::moveCursorToNextCheckpoint(CheckpointCursor &cursor) {
 }
 
 size_t CheckpointManager::getNumOpenChkItems() const {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
     if (checkpointList.empty()) {
         return 0;
     }
@@ -1416,11 +1699,15 @@ uint64_t CheckpointManager::checkOpenCheckpoint_UNLOCKED(bool forceCreation,
     // (2) current checkpoint is reached to the max number of items allowed.
     // (3) time elapsed since the creation of the current checkpoint is greater
     //     than the threshold
+    // (4) the items of the current checkpoint use the max memory allowed.
+    const size_t maxSize = checkpointConfig.getCheckpointMaxSize();
     if (forceCreation ||
         (checkpointConfig.isItemNumBasedNewCheckpoint() &&
          checkpointList.back()->getNumItems() >=
          checkpointConfig.getCheckpointMaxItems()) ||
-        (checkpointList.back()->getNumItems() > 0 && timeBound)) {
+        (checkpointList.back()->getNumItems() > 0 && timeBound) ||
+        (maxSize > 0 && checkpointList.back()->getNumItems() > 0 &&
+         checkpointList.back()->getMemConsumption() >= maxSize)) {
 
         checkpoint_id = checkpointList.back()->getId();
         addNewCheckpoint_UNLOCKED(checkpoint_id + 1);
@@ -1429,7 +1716,12 @@ uint64_t CheckpointManager::checkOpenCheckpoint_UNLOCKED(bool forceCreation,
 }
 
 size_t CheckpointManager::getNumItemsForCursor(const std::string &name) const {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
+    cursor_index::const_iterator it = connCursors.find(name);
+    if (it == connCursors.end()) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> cursorLock(it->second.lock);
     return getNumItemsForCursor_UNLOCKED(name);
 }
 
@@ -1471,7 +1763,7 @@ size_t CheckpointManager::getNumOfMetaItemsFromCursor(const CheckpointCursor &cu
 }
 
 void CheckpointManager::decrCursorFromCheckpointEnd(const std::string &name) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     cursor_index::iterator it = connCursors.find(name);
     if (it != connCursors.end() &&
         (*(it->second.currentPos))->getOperation() ==
@@ -1492,15 +1784,16 @@ bool CheckpointManager::isLastMutationItemInCheckpoint(
 }
 
 void CheckpointManager::setBackfillPhase(uint64_t start, uint64_t end) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     setOpenCheckpointId_UNLOCKED(0);
     checkpointList.back()->setSnapshotStartSeqno(start);
     checkpointList.back()->setSnapshotEndSeqno(end);
+    publishSeqnos_UNLOCKED();
 }
 
 void CheckpointManager::createSnapshot(uint64_t snapStartSeqno,
                                        uint64_t snapEndSeqno) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     if (checkpointList.empty()) {
         throw std::logic_error("CheckpointManager::createSnapshot: "
                         "checkpointList is empty");
@@ -1516,6 +1809,7 @@ void CheckpointManager::createSnapshot(uint64_t snapStartSeqno,
         }
         checkpointList.back()->setSnapshotStartSeqno(snapStartSeqno);
         checkpointList.back()->setSnapshotEndSeqno(snapEndSeqno);
+        publishSeqnos_UNLOCKED();
         return;
     }
 
@@ -1523,7 +1817,7 @@ void CheckpointManager::createSnapshot(uint64_t snapStartSeqno,
 }
 
 void CheckpointManager::resetSnapshotRange() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     if (checkpointList.empty()) {
         throw std::logic_error("CheckpointManager::resetSnapshotRange: "
                         "checkpointList is empty");
@@ -1543,10 +1837,28 @@ void CheckpointManager::resetSnapshotRange() {
         checkpointList.back()->setSnapshotEndSeqno(
                                         static_cast<uint64_t>(lastBySeqno));
     }
+    publishSeqnos_UNLOCKED();
 }
 
 snapshot_info_t CheckpointManager::getSnapshotInfo() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
+    return getSnapshotInfo_UNLOCKED();
+}
+
+void CheckpointManager::setSeqnoSlot(VBucketSeqnoSlot* slot) {
+    QueueWriterLockHolder lh(queueLock);
+    seqnoSlot = slot;
+    publishSeqnos_UNLOCKED();
+}
+
+void CheckpointManager::publishSeqnos_UNLOCKED() {
+    if (seqnoSlot) {
+        seqnoSlot->highSeqno.store(lastBySeqno);
+        seqnoSlot->snapshotEnd.store(getSnapshotInfo_UNLOCKED().range.end);
+    }
+}
+
+snapshot_info_t CheckpointManager::getSnapshotInfo_UNLOCKED() {
     if (checkpointList.empty()) {
         throw std::logic_error("CheckpointManager::getSnapshotInfo: "
                         "checkpointList is empty");
@@ -1595,7 +1907,7 @@ void CheckpointManager::updateDiskQueueStats(VBucket& vbucket,
 
 void CheckpointManager::checkAndAddNewCheckpoint(uint64_t id,
                                                  VBucket& vbucket) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
 
     // Ignore CHECKPOINT_START message with ID 0 as 0 is reserved for
     // representing backfill.
@@ -1654,6 +1966,7 @@ void CheckpointManager::checkAndAddNewCheckpoint(uint64_t id,
         collapseCheckpoints(id);
         size_t new_remains = getNumItemsForCursor_UNLOCKED(pCursorName);
         updateDiskQueueStats(vbucket, curr_remains, new_remains);
+        publishSeqnos_UNLOCKED();
     }
 }
 
@@ -1782,12 +2095,13 @@ void CheckpointManager::putCursorsInCollapsedChk(
 }
 
 bool CheckpointManager::hasNext(const std::string &name) {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
     cursor_index::iterator it = connCursors.find(name);
     if (it == connCursors.end() || getOpenCheckpointId_UNLOCKED() == 0) {
         return false;
     }
 
+    std::lock_guard<std::mutex> cursorLock(it->second.lock);
     bool hasMore = true;
     CheckpointQueue::iterator curr = it->second.currentPos;
     ++curr;
@@ -1834,7 +2148,7 @@ queued_item CheckpointManager::createCheckpointItem(uint64_t id, uint16_t vbid,
 }
 
 uint64_t CheckpointManager::createNewCheckpoint() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     if (checkpointList.back()->getNumItems() > 0) {
         uint64_t chk_id = checkpointList.back()->getId();
         addNewCheckpoint_UNLOCKED(chk_id + 1);
@@ -1843,12 +2157,12 @@ uint64_t CheckpointManager::createNewCheckpoint() {
 }
 
 uint64_t CheckpointManager::getPersistenceCursorPreChkId() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     return pCursorPreCheckpointId;
 }
 
 void CheckpointManager::itemsPersisted() {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     auto persistenceCursor = connCursors.find(pCursorName);
     if (persistenceCursor != connCursors.end()) {
         auto itr = persistenceCursor->second.currentCheckpoint;
@@ -1869,12 +2183,12 @@ size_t CheckpointManager::getMemoryUsage_UNLOCKED() const {
 }
 
 size_t CheckpointManager::getMemoryUsage() const {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
     return getMemoryUsage_UNLOCKED();
 }
 
 size_t CheckpointManager::getMemoryUsageOfUnrefCheckpoints() const {
-    LockHolder lh(queueLock);
+    QueueReaderLockHolder lh(queueLock);
 
     if (checkpointList.empty()) {
         return 0;
@@ -1892,7 +2206,7 @@ size_t CheckpointManager::getMemoryUsageOfUnrefCheckpoints() const {
 }
 
 void CheckpointManager::addStats(ADD_STAT add_stat, const void *cookie) {
-    LockHolder lh(queueLock);
+    QueueWriterLockHolder lh(queueLock);
     char buf[256];
 
     try {
@@ -1921,6 +2235,12 @@ void CheckpointManager::addStats(ADD_STAT add_stat, const void *cookie) {
                         add_stat, cookie);
         checked_snprintf(buf, sizeof(buf), "vb_%d:mem_usage", vbucketId);
         add_casted_stat(buf, getMemoryUsage_UNLOCKED(), add_stat, cookie);
+        size_t memOverhead = 0;
+        for (const auto& checkpoint : checkpointList) {
+            memOverhead += checkpoint->memorySize();
+        }
+        checked_snprintf(buf, sizeof(buf), "vb_%d:mem_overhead", vbucketId);
+        add_casted_stat(buf, memOverhead, add_stat, cookie);
 
         cursor_index::iterator cur_it = connCursors.begin();
         for (; cur_it != connCursors.end(); ++cur_it) {
@@ -21,16 +21,22 @@
 #include "config.h"
 
 #include "callbacks.h"
+#include "checkpoint_index.h"
+#include "checkpoint_queue.h"
 #include "ep_types.h"
+#include "instrumented_mutex.h"
 #include "item.h"
 #include "monotonic.h"
 #include "locks.h"
 #include "stats.h"
 
+#include <algorithm>
 #include <atomic>
+#include <functional>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -59,18 +65,6 @@ enum checkpoint_state {
 
 const char* to_string(enum checkpoint_state);
 
-// List is used for queueing mutations as vector incurs shift operations for
-// deduplication.
-typedef std::list<queued_item> CheckpointQueue;
-
-/**
- * A checkpoint index entry.
- */
-struct index_entry {
-    CheckpointQueue::iterator position;
-    int64_t mutation_id;
-};
-
 /**
  * Flag indicating that we must send checkpoint end meta item for the cursor
  */
@@ -79,11 +73,6 @@ enum class MustSendCheckpointEnd {
     YES
 };
 
-/**
- * The checkpoint index maps a key to a checkpoint index_entry.
- */
-typedef std::unordered_map<StoredDocKey, index_entry> checkpoint_index;
-
 /**
  * List of pairs containing checkpoint cursor name and corresponding flag
  * indicating whether we must send checkpoint end meta item for the cursor
@@ -96,6 +85,7 @@ class CheckpointManager;
 class CheckpointConfig;
 class PreLinkDocumentContext;
 class VBucket;
+struct VBucketSeqnoSlot;
 
 // List of Checkpoints used by class CheckpointManager to store Checkpoints for
 // a given vBucket.
@@ -237,6 +227,12 @@ private:
     bool                             fromBeginningOnChkCollapse;
     MustSendCheckpointEnd            sendCheckpointEndMetaItem;
 
+    // Readers of the checkpoints only take queueLock in shared mode, so the
+    // cursor has its own lock for them to move it (or read its position).
+    // When queueLock is held exclusively the cursor may be used without it.
+    // Not copied along with the cursor.
+    mutable std::mutex lock;
+
     friend std::ostream& operator<<(std::ostream& os, const CheckpointCursor& c);
 };
 
@@ -406,6 +402,7 @@ public:
      * Return the number of cursors that are currently walking through this checkpoint.
      */
     size_t getNumberOfCursors() const {
+        std::lock_guard<std::mutex> lh(cursorsLock);
         return cursors.size();
     }
 
@@ -413,6 +410,7 @@ public:
      * Register a cursor's name to this checkpoint
      */
     void registerCursorName(const std::string &name) {
+        std::lock_guard<std::mutex> lh(cursorsLock);
         cursors.insert(name);
     }
 
@@ -420,6 +418,7 @@ public:
      * Remove a cursor's name from this checkpoint
      */
     void removeCursorName(const std::string &name) {
+        std::lock_guard<std::mutex> lh(cursorsLock);
         cursors.erase(name);
     }
 
@@ -427,11 +426,14 @@ public:
      * Return true if the cursor with a given name exists in this checkpoint
      */
     bool hasCursorName(const std::string &name) const {
+        std::lock_guard<std::mutex> lh(cursorsLock);
         return cursors.find(name) != cursors.end();
     }
 
     /**
-     * Return the list of all cursor names in this checkpoint
+     * Return the list of all cursor names in this checkpoint. Cursors move
+     * between checkpoints while queueLock is only held in shared mode, so
+     * the caller must hold the CheckpointManager's queueLock exclusively.
      */
     const std::set<std::string> &getCursorNameList() const {
         return cursors;
@@ -518,6 +520,27 @@ public:
      */
     size_t mergePrevCheckpoint(Checkpoint *pPrevCheckpoint);
 
+    /**
+     * Expel the (non-meta) items queued before the given position from this
+     * checkpoint, to free their memory while the cursors which have already
+     * processed them stay where they are. The caller must ensure that every
+     * cursor has moved past the items.
+     * @param until the position of the first item to keep
+     * @param checkpointManager the checkpoint manager to which this
+     *        checkpoint belongs
+     * @return the number of items expelled
+     */
+    size_t expelItems(CheckpointQueue::Position until,
+                      CheckpointManager& checkpointManager);
+
+    /**
+     * Return the highest seqno of the items expelled from this checkpoint,
+     * or 0 if none were. A cursor can't be registered at (or before) it.
+     */
+    uint64_t getHighestExpelledSeqno() const {
+        return highestExpelledSeqno;
+    }
+
     /**
      * Get the mutation id for a given key in this checkpoint
      * @param key a key to retrieve its mutation id
@@ -534,12 +557,23 @@ public:
     bool isEligibleToBeUnreferenced();
 
     /**
-     * Invoked by the checkpoint manager whenever an item is queued
-     * into the given checkpoint.
+     * Invoked whenever an item is queued into the given checkpoint.
      * @param Amount of memory being added to current usage
      */
     void incrementMemConsumption(size_t by) {
         effectiveMemUsage += by;
+        stats.checkpointMemory.fetch_add(by);
+    }
+
+    /**
+     * Invoked whenever an item is removed from the given checkpoint
+     * (de-duplicated or expelled).
+     * @param Amount of memory being removed from current usage
+     */
+    void decrementMemConsumption(size_t by) {
+        by = std::min(by, effectiveMemUsage);
+        effectiveMemUsage -= by;
+        stats.checkpointMemory.fetch_sub(by);
     }
 
     /**
@@ -556,6 +590,12 @@ public:
     static const StoredDocKey SetVBucketStateKey;
 
 private:
+    /**
+     * Compact toWrite, updating the index entries and the positions of the
+     * cursors in this checkpoint to follow the items that moved.
+     */
+    void compactQueue(CheckpointManager& checkpointManager);
+
     EPStats                       &stats;
     uint64_t                       checkpointId;
     uint64_t                       snapStartSeqno;
@@ -568,11 +608,14 @@ private:
     /// Number of meta items (see Item::isCheckPointMetaItem).
     size_t numMetaItems;
     std::set<std::string>          cursors; // List of cursors with their unique names.
+    // Protects cursors against the readers of the CheckpointManager
+    mutable std::mutex             cursorsLock;
     CheckpointQueue                toWrite;
-    checkpoint_index               keyIndex;
+    CheckpointIndex                keyIndex;
     /* Index for meta keys like "dummy_key" */
-    checkpoint_index               metaKeyIndex;
+    CheckpointIndex                metaKeyIndex;
     size_t                         memOverhead;
+    uint64_t                       highestExpelledSeqno;
 
     // The following stat is to contain the memory consumption of all
     // the queued items in the given checkpoint.
@@ -595,6 +638,11 @@ public:
 
     typedef std::shared_ptr<Callback<uint16_t> > FlusherCallback;
 
+    /// The queueLock, and how it is held exclusively and shared
+    using QueueLock = InstrumentedMutex<cb::RWLock>;
+    using QueueWriterLockHolder = std::lock_guard<QueueLock>;
+    using QueueReaderLockHolder = SharedLockHolder<QueueLock>;
+
     CheckpointManager(EPStats& st,
                       uint16_t vbucket,
                       CheckpointConfig& config,
@@ -612,7 +660,7 @@ public:
     void setOpenCheckpointId_UNLOCKED(uint64_t id);
 
     void setOpenCheckpointId(uint64_t id) {
-        LockHolder lh(queueLock);
+        QueueWriterLockHolder lh(queueLock);
         setOpenCheckpointId_UNLOCKED(id);
     }
 
@@ -703,6 +751,24 @@ public:
                     const GenerateCas generateCas,
                     PreLinkDocumentContext* preLinkDocumentContext);
 
+    /**
+     * Queue a batch of items to be written to persistent layer, taking
+     * queueLock and reserving the seqnos only once for the whole batch.
+     * The items are queued in order into the open checkpoint (which is
+     * closed, if needed, before the batch but not in the middle of it).
+     * @param vb the vbucket that the items are pushed into.
+     * @param items the items to be persisted; their seqnos must be
+     *        increasing if they aren't generated.
+     * @param generateBySeqno yes/no generate the seqnos for the items
+     * @param generateCas yes/no generate the CAS for the items
+     * @return the number of items which increased the size of the
+     *         persistence queue.
+     */
+    size_t queueDirty(VBucket& vb,
+                      std::vector<queued_item>& items,
+                      const GenerateBySeqno generateBySeqno,
+                      const GenerateCas generateCas);
+
     /*
      * Queue writing of the VBucket's state to persistent layer.
      * @param vb the vbucket that a new item is pushed into.
@@ -721,6 +787,31 @@ public:
     snapshot_range_t getAllItemsForCursor(const std::string& name,
                                           std::vector<queued_item> &items);
 
+    /**
+     * Visitor of the items outstanding for a cursor. It is passed each item
+     * by reference, and whether the item is superseded, i.e. its key is
+     * queued again in a later checkpoint (so the visit also reaches a newer
+     * item for the same key).
+     */
+    using ItemVisitor =
+            std::function<void(const queued_item& qi, bool superseded)>;
+
+    /**
+     * Visit all the items outstanding for a given cursor, in seqno order,
+     * and move the cursor past them; like getAllItemsForCursor(), but the
+     * items are visited in place instead of being copied into a vector.
+     *
+     * The visitor is invoked under the (shared) queueLock, so it must not
+     * call back into this CheckpointManager, and it holds up the front-end
+     * threads queueing into this vbucket while it runs.
+     *
+     * @param name the name of the cursor
+     * @param visitor invoked for each item (meta items included)
+     * @return the snapshot range of the items visited
+     */
+    snapshot_range_t visitItemsForCursor(const std::string& name,
+                                         const ItemVisitor& visitor);
+
     /**
      * Return the total number of items (including meta items) that belong to
      * this checkpoint manager.
@@ -743,7 +834,7 @@ public:
     size_t getNumItemsForCursor(const std::string &name) const;
 
     void clear(vbucket_state_t vbState) {
-        LockHolder lh(queueLock);
+        QueueWriterLockHolder lh(queueLock);
         clear_UNLOCKED(vbState, lastBySeqno);
     }
 
@@ -799,6 +890,14 @@ public:
      */
     size_t getMemoryUsageOfUnrefCheckpoints() const;
 
+    /**
+     * Expel the items of the oldest (closed) checkpoint which all of its
+     * cursors have already processed, invoked by the cursor-dropper before
+     * it resorts to dropping cursors. The cursors keep their positions.
+     * @return the amount of memory freed
+     */
+    size_t expelUnreferencedCheckpointItems();
+
     /**
      * Function returns a list of cursors to drop so as to unreference
      * certain checkpoints within the manager, invoked by the cursor-dropper.
@@ -825,12 +924,19 @@ public:
     void resetSnapshotRange();
 
     void updateCurrentSnapshotEnd(uint64_t snapEnd) {
-        LockHolder lh(queueLock);
+        QueueWriterLockHolder lh(queueLock);
         checkpointList.back()->setSnapshotEndSeqno(snapEnd);
+        publishSeqnos_UNLOCKED();
     }
 
     snapshot_info_t getSnapshotInfo();
 
+    /**
+     * Publish the high seqno and the snapshot end of the vbucket to the
+     * given slot from now on, as they change, or stop if it is null.
+     */
+    void setSeqnoSlot(VBucketSeqnoSlot* slot);
+
     bool incrCursor(CheckpointCursor &cursor);
 
     void notifyFlusher() {
@@ -841,18 +947,21 @@ public:
     }
 
     void setBySeqno(int64_t seqno) {
-        LockHolder lh(queueLock);
+        QueueWriterLockHolder lh(queueLock);
         lastBySeqno = seqno;
+        publishSeqnos_UNLOCKED();
     }
 
     int64_t getHighSeqno() const {
-        LockHolder lh(queueLock);
+        QueueReaderLockHolder lh(queueLock);
         return lastBySeqno;
     }
 
     int64_t nextBySeqno() {
-        LockHolder lh(queueLock);
-        return ++lastBySeqno;
+        QueueWriterLockHolder lh(queueLock);
+        ++lastBySeqno;
+        publishSeqnos_UNLOCKED();
+        return lastBySeqno;
     }
 
     void dump() const;
@@ -863,11 +972,23 @@ protected:
 
     // Helper method for queueing methods - update the global and per-VBucket
     // stats after queueing a new item to a checkpoint.
-    // Must be called with queueLock held (LockHolder passed in as argument to
-    // 'prove' this).
-    void updateStatsForNewQueuedItem_UNLOCKED(const LockHolder&,
+    // Must be called with queueLock held (QueueWriterLockHolder passed in as
+    // argument to 'prove' this).
+    void updateStatsForNewQueuedItem_UNLOCKED(const QueueWriterLockHolder&,
                                      VBucket& vb, const queued_item& qi);
 
+    // Helper methods for queueing methods - create a new open checkpoint
+    // if the current one is full (or closed), and check that a seqno lies
+    // in the snapshot range of the open checkpoint.
+    void prepareOpenCheckpoint_UNLOCKED(const QueueWriterLockHolder&,
+                                        VBucket& vb,
+                                        const GenerateBySeqno generateBySeqno);
+
+    void checkSnapshotRange_UNLOCKED(const QueueWriterLockHolder&,
+                                     const VBucket& vb,
+                                     const int64_t seqno,
+                                     const GenerateBySeqno generateBySeqno) const;
+
     /**
      * Helper method to update disk queue stats after (maybe) changing the
      * number of items remaining for the persistence cursor (for example after
@@ -933,7 +1054,7 @@ private:
     uint64_t checkOpenCheckpoint_UNLOCKED(bool forceCreation, bool timeBound);
 
     uint64_t checkOpenCheckpoint(bool forceCreation, bool timeBound) {
-        LockHolder lh(queueLock);
+        QueueWriterLockHolder lh(queueLock);
         return checkOpenCheckpoint_UNLOCKED(forceCreation, timeBound);
     }
 
@@ -943,6 +1064,12 @@ private:
 
     bool isCheckpointCreationForHighMemUsage(const VBucket& vbucket);
 
+    /**
+     * Return true if the checkpoints of the bucket use more memory than
+     * their share of the bucket quota (see checkpoint_memory_ratio).
+     */
+    bool isCheckpointMemoryOverQuota() const;
+
     void collapseClosedCheckpoints(CheckpointList& collapsedChks);
 
     void collapseCheckpoints(uint64_t id);
@@ -960,9 +1087,22 @@ private:
      */
     size_t getNumOfMetaItemsFromCursor(const CheckpointCursor &cursor) const;
 
+    snapshot_info_t getSnapshotInfo_UNLOCKED();
+
+    /// Update the seqno slot (if any) after the high seqno or the open
+    /// checkpoint changed
+    void publishSeqnos_UNLOCKED();
+
     EPStats                 &stats;
     CheckpointConfig        &checkpointConfig;
-    mutable std::mutex       queueLock;
+    /**
+     * Writers (queueing items, adding, closing, collapsing or removing
+     * checkpoints, and (un)registering cursors) hold queueLock exclusively.
+     * Readers which only move or inspect a cursor hold it in shared mode
+     * along with the cursor's lock, so the cursors of different consumers
+     * don't serialise on each other.
+     */
+    mutable QueueLock        queueLock;
     const uint16_t           vbucketId;
 
     // Total number of items (including meta items) in /all/ checkpoints managed
@@ -977,6 +1117,9 @@ private:
 
     FlusherCallback          flusherCB;
 
+    // Where the seqnos are published to, guarded by the queueLock
+    VBucketSeqnoSlot*        seqnoSlot;
+
     friend std::ostream& operator<<(std::ostream& os, const CheckpointManager& m);
 };
 
@@ -37,6 +37,14 @@ public:
             config.setCheckpointMaxItems(value);
         } else if (key.compare("max_checkpoints") == 0) {
             config.setMaxCheckpoints(value);
+        } else if (key.compare("chk_max_size") == 0) {
+            config.setCheckpointMaxSize(value);
+        }
+    }
+
+    virtual void floatValueChanged(const std::string& key, float value) {
+        if (key.compare("checkpoint_memory_ratio") == 0) {
+            config.setCheckpointMemoryRatio(value);
         }
     }
 
@@ -58,6 +66,8 @@ CheckpointConfig::CheckpointConfig()
     : checkpointPeriod(DEFAULT_CHECKPOINT_PERIOD),
       checkpointMaxItems(DEFAULT_CHECKPOINT_ITEMS),
       maxCheckpoints(DEFAULT_MAX_CHECKPOINTS),
+      checkpointMaxSize(0),
+      checkpointMemoryRatio(DEFAULT_CHECKPOINT_MEMORY_RATIO),
       itemNumBasedNewCheckpoint(true),
       keepClosedCheckpoints(false),
       enableChkMerge(false),
@@ -70,10 +80,14 @@ CheckpointConfig::CheckpointConfig(rel_time_t period,
                                    bool item_based_new_ckpt,
                                    bool keep_closed_ckpts,
                                    bool enable_ckpt_merge,
-                                   bool persistence_enabled)
+                                   bool persistence_enabled,
+                                   size_t max_size,
+                                   float memory_ratio)
     : checkpointPeriod(period),
       checkpointMaxItems(max_items),
       maxCheckpoints(max_ckpts),
+      checkpointMaxSize(max_size),
+      checkpointMemoryRatio(memory_ratio),
       itemNumBasedNewCheckpoint(item_based_new_ckpt),
       keepClosedCheckpoints(keep_closed_ckpts),
       enableChkMerge(enable_ckpt_merge),
@@ -85,6 +99,8 @@ CheckpointConfig::CheckpointConfig(EventuallyPersistentEngine& e) {
     checkpointPeriod = config.getChkPeriod();
     checkpointMaxItems = config.getChkMaxItems();
     maxCheckpoints = config.getMaxCheckpoints();
+    checkpointMaxSize = config.getChkMaxSize();
+    checkpointMemoryRatio = config.getCheckpointMemoryRatio();
     itemNumBasedNewCheckpoint = config.isItemNumBasedNewChk();
     keepClosedCheckpoints = config.isKeepClosedChks();
     enableChkMerge = config.isEnableChkMerge();
@@ -110,6 +126,11 @@ void CheckpointConfig::addConfigChangeListener(
     configuration.addValueChangedListener(
             "enable_chk_merge",
             new ChangeListener(engine.getCheckpointConfig()));
+    configuration.addValueChangedListener(
+            "chk_max_size", new ChangeListener(engine.getCheckpointConfig()));
+    configuration.addValueChangedListener(
+            "checkpoint_memory_ratio",
+            new ChangeListener(engine.getCheckpointConfig()));
 }
 
 bool CheckpointConfig::validateCheckpointMaxItemsParam(
@@ -23,6 +23,8 @@
 
 class EventuallyPersistentEngine;
 
+#define DEFAULT_CHECKPOINT_MEMORY_RATIO 0.5f
+
 /**
  * A class containing the config parameters for checkpoint.
  */
@@ -37,7 +39,9 @@ public:
                      bool item_based_new_ckpt,
                      bool keep_closed_ckpts,
                      bool enable_ckpt_merge,
-                     bool persistence_enabled);
+                     bool persistence_enabled,
+                     size_t max_size = 0,
+                     float memory_ratio = DEFAULT_CHECKPOINT_MEMORY_RATIO);
 
     CheckpointConfig(EventuallyPersistentEngine& e);
 
@@ -53,6 +57,14 @@ public:
         return maxCheckpoints;
     }
 
+    size_t getCheckpointMaxSize() const {
+        return checkpointMaxSize;
+    }
+
+    float getCheckpointMemoryRatio() const {
+        return checkpointMemoryRatio;
+    }
+
     bool isItemNumBasedNewCheckpoint() const {
         return itemNumBasedNewCheckpoint;
     }
@@ -93,6 +105,14 @@ protected:
         enableChkMerge = value;
     }
 
+    void setCheckpointMaxSize(size_t value) {
+        checkpointMaxSize = value;
+    }
+
+    void setCheckpointMemoryRatio(float value) {
+        checkpointMemoryRatio = value;
+    }
+
     static void addConfigChangeListener(EventuallyPersistentEngine& engine);
 
 private:
@@ -104,6 +124,11 @@ private:
     size_t checkpointMaxItems;
     // Number of max checkpoints allowed
     size_t maxCheckpoints;
+    // Max memory (in bytes) used by the items of a checkpoint before a new
+    // checkpoint is created, 0 if unbounded
+    size_t checkpointMaxSize;
+    // Fraction of the bucket quota the checkpoints of all vbuckets may use
+    float checkpointMemoryRatio;
     // Flag indicating if a new checkpoint is created once the number of items
     // in the current
     // checkpoint is greater than the max number allowed.
@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "checkpoint_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+const size_t CheckpointIndex::minCapacity;
+
+static bool keyEquals(const StoredDocKey& stored, const DocKey& key) {
+    return stored.size() == key.size() &&
+           stored.getDocNamespace() == key.getDocNamespace() &&
+           std::memcmp(stored.data(), key.data(), key.size()) == 0;
+}
+
+size_t CheckpointIndex::findSlot(const DocKey& key, uint32_t hash) const {
+    const size_t mask = slots.size() - 1;
+    size_t ii = home(hash);
+    while (slots[ii].key != nullptr) {
+        if (slots[ii].hash == hash && keyEquals(*slots[ii].key, key)) {
+            break;
+        }
+        ii = (ii + 1) & mask;
+    }
+    return ii;
+}
+
+index_entry* CheckpointIndex::find(const DocKey& key) {
+    return const_cast<index_entry*>(
+            static_cast<const CheckpointIndex*>(this)->find(key));
+}
+
+const index_entry* CheckpointIndex::find(const DocKey& key) const {
+    if (numEntries == 0) {
+        return nullptr;
+    }
+    const auto& slot = slots[findSlot(key, key.hash())];
+    return slot.key == nullptr ? nullptr : &slot.entry;
+}
+
+void CheckpointIndex::insert(const StoredDocKey& key,
+                             const index_entry& entry) {
+    if ((numEntries + 1) * 4 > slots.size() * 3) {
+        grow();
+    }
+    const auto hash = key.hash();
+    auto& slot = slots[findSlot(key, hash)];
+    if (slot.key == nullptr) {
+        ++numEntries;
+    }
+    slot.key = &key;
+    slot.hash = hash;
+    slot.entry = entry;
+}
+
+bool CheckpointIndex::erase(const DocKey& key) {
+    if (numEntries == 0) {
+        return false;
+    }
+    const size_t mask = slots.size() - 1;
+    size_t hole = findSlot(key, key.hash());
+    if (slots[hole].key == nullptr) {
+        return false;
+    }
+
+    // Shift back the entries which follow the removed one (in its probe
+    // sequence), so that a lookup never stops at the hole too early.
+    size_t ii = hole;
+    while (true) {
+        ii = (ii + 1) & mask;
+        if (slots[ii].key == nullptr) {
+            break;
+        }
+        const size_t want = home(slots[ii].hash);
+        // Move the entry if its home isn't cyclically in (hole, ii]
+        if (((ii - want) & mask) >= ((ii - hole) & mask)) {
+            slots[hole] = slots[ii];
+            hole = ii;
+        }
+    }
+    slots[hole].key = nullptr;
+    --numEntries;
+    return true;
+}
+
+void CheckpointIndex::grow() {
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.assign(std::max(minCapacity, old.size() * 2), Slot{nullptr, 0, {}});
+    for (const auto& slot : old) {
+        if (slot.key != nullptr) {
+            auto& dest = slots[findSlot(*slot.key, slot.hash)];
+            dest = slot;
+        }
+    }
+}
@@ -0,0 +1,110 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "checkpoint_queue.h"
+#include "storeddockey.h"
+
+#include <memcached/dockey.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A checkpoint index entry.
+ */
+struct index_entry {
+    CheckpointQueue::Position position;
+    int64_t mutation_id;
+};
+
+/**
+ * The checkpoint index maps a key to a checkpoint index_entry.
+ *
+ * It is a flat open addressing (linear probing) hash table, so all of the
+ * entries of a checkpoint live in a single allocation which is freed with
+ * the checkpoint. The index doesn't copy the keys: each entry refers to the
+ * key of the item it indexes, which the checkpoint keeps alive in its
+ * queue. Hence the key given to insert() must be the key of the queued item,
+ * and it must outlive the entry (until the entry is replaced by insert() or
+ * removed by erase()).
+ */
+class CheckpointIndex {
+public:
+    /// @return the entry for the key, or nullptr if it isn't in the index
+    index_entry* find(const DocKey& key);
+
+    const index_entry* find(const DocKey& key) const;
+
+    /**
+     * Add the entry for a key, or replace the existing one (and the key it
+     * refers to).
+     */
+    void insert(const StoredDocKey& key, const index_entry& entry);
+
+    /**
+     * Remove the entry for a key
+     * @return true if the key was in the index
+     */
+    bool erase(const DocKey& key);
+
+    size_t size() const {
+        return numEntries;
+    }
+
+    bool empty() const {
+        return numEntries == 0;
+    }
+
+    /// @return the number of bytes allocated for the table
+    size_t getMemorySize() const {
+        return slots.capacity() * sizeof(Slot);
+    }
+
+private:
+    struct Slot {
+        /// The key of the entry, nullptr if the slot is free
+        const StoredDocKey* key;
+        uint32_t hash;
+        index_entry entry;
+    };
+
+    /// The number of slots allocated by the first insert
+    static const size_t minCapacity = 16;
+
+    size_t findSlot(const DocKey& key, uint32_t hash) const;
+
+    /// The slot where the probe sequence of a hash starts
+    size_t home(uint32_t hash) const {
+        // Mix the high bits of the key hash into the low ones we use (the
+        // MurmurHash3 finaliser), as not every DocKeyHashVersion does
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6b;
+        hash ^= hash >> 13;
+        hash *= 0xc2b2ae35;
+        hash ^= hash >> 16;
+        return size_t(hash) & (slots.size() - 1);
+    }
+
+    /// Double the number of slots; called when the table is 3/4 full
+    void grow();
+
+    std::vector<Slot> slots;
+    size_t numEntries = 0;
+};
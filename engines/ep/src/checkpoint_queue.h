@@ -0,0 +1,315 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "item.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+/**
+ * The queue of items of a Checkpoint.
+ *
+ * Items are stored in a std::deque, i.e. in contiguous chunks, instead of
+ * one heap allocated node per item. Each item is given a Position when it
+ * is queued, and it keeps that Position until it is removed from the queue
+ * (or the queue is compacted), so the checkpoint index and the cursors can
+ * refer to an item by its Position instead of holding a list iterator.
+ *
+ * Removing an item from the middle of the queue (de-duplication) doesn't
+ * shift the items after it; its slot is cleared and skipped by the
+ * iterators. The front and the back of the queue are always valid items.
+ * Once enough slots are cleared the owner should compact() the queue, which
+ * moves the items down over the cleared slots and reports the new Position
+ * of every item moved.
+ */
+class CheckpointQueue {
+public:
+    /// The position of an item in the queue
+    using Position = int64_t;
+
+    /**
+     * Bidirectional iterator over the (non-removed) items of the queue.
+     * It is just a Position; it stays valid as long as the item it refers
+     * to is in the queue (and the queue isn't compacted).
+     */
+    template <class Queue, class Value>
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = queued_item;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        Iterator() = default;
+
+        Iterator(Queue* q, Position p) : queue(q), pos(p) {
+        }
+
+        reference operator*() const {
+            return queue->slot(pos);
+        }
+
+        pointer operator->() const {
+            return &queue->slot(pos);
+        }
+
+        Iterator& operator++() {
+            do {
+                ++pos;
+            } while (pos < queue->endPosition() && !queue->slot(pos));
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator tmp(*this);
+            ++(*this);
+            return tmp;
+        }
+
+        Iterator& operator--() {
+            do {
+                --pos;
+            } while (pos > queue->frontPos && !queue->slot(pos));
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            Iterator tmp(*this);
+            --(*this);
+            return tmp;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return pos == other.pos && queue == other.queue;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+        Position getPosition() const {
+            return pos;
+        }
+
+    private:
+        Queue* queue = nullptr;
+        Position pos = 0;
+    };
+
+    using iterator = Iterator<CheckpointQueue, queued_item>;
+    using const_iterator = Iterator<const CheckpointQueue, const queued_item>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    bool empty() const {
+        return items.empty();
+    }
+
+    /// The number of items in the queue (excluding the removed ones)
+    size_t size() const {
+        return items.size() - numRemoved;
+    }
+
+    /// The number of slots cleared by erase() since the last compaction
+    size_t getNumRemoved() const {
+        return numRemoved;
+    }
+
+    queued_item& front() {
+        return items.front();
+    }
+
+    const queued_item& front() const {
+        return items.front();
+    }
+
+    queued_item& back() {
+        return items.back();
+    }
+
+    const queued_item& back() const {
+        return items.back();
+    }
+
+    /// @return the position of the back item
+    Position backPosition() const {
+        return endPosition() - 1;
+    }
+
+    /**
+     * Append an item to the queue
+     * @return the position of the item
+     */
+    Position push_back(const queued_item& qi) {
+        items.push_back(qi);
+        return endPosition() - 1;
+    }
+
+    /**
+     * Prepend an item to the queue. The items already queued keep their
+     * positions.
+     * @return the position of the item
+     */
+    Position push_front(const queued_item& qi) {
+        items.push_front(qi);
+        return --frontPos;
+    }
+
+    void pop_back() {
+        items.pop_back();
+        trim();
+    }
+
+    void pop_front() {
+        items.pop_front();
+        ++frontPos;
+        trim();
+    }
+
+    /**
+     * Remove the item at the given position from the queue. The other
+     * items keep their positions.
+     */
+    void erase(Position pos) {
+        if (!slot(pos)) {
+            throw std::invalid_argument(
+                    "CheckpointQueue::erase: no item at position " +
+                    std::to_string(pos));
+        }
+        slot(pos).reset();
+        ++numRemoved;
+        trim();
+    }
+
+    /// @return an iterator to the item at the given position
+    iterator iteratorAt(Position pos) {
+        return iterator(this, pos);
+    }
+
+    iterator begin() {
+        return iterator(this, frontPos);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, frontPos);
+    }
+
+    iterator end() {
+        return iterator(this, endPosition());
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, endPosition());
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    /**
+     * A compaction is worthwhile once more than half of the slots were
+     * cleared, and there are at least a few chunks worth of them; this
+     * keeps the cost of the compactions linear in the number of erase()
+     * calls.
+     */
+    bool needsCompaction() const {
+        return numRemoved >= minRemovedForCompaction &&
+               numRemoved > items.size() / 2;
+    }
+
+    /**
+     * Move the items down over the cleared slots. The front item keeps its
+     * position; the positions of the other items change.
+     *
+     * @param moved invoked as moved(from, to, item) for each item whose
+     *              position changes, in increasing order of position
+     */
+    template <class Callback>
+    void compact(Callback moved) {
+        Position to = frontPos;
+        for (Position from = frontPos; from < endPosition(); ++from) {
+            auto& qi = slot(from);
+            if (!qi) {
+                continue;
+            }
+            if (from != to) {
+                slot(to) = qi;
+                qi.reset();
+                moved(from, to, slot(to));
+            }
+            ++to;
+        }
+        items.resize(size_t(to - frontPos));
+        numRemoved = 0;
+    }
+
+private:
+    /// Cleared slots don't take part in compaction until there are this many
+    static const size_t minRemovedForCompaction = 1024;
+
+    Position endPosition() const {
+        return frontPos + Position(items.size());
+    }
+
+    queued_item& slot(Position pos) {
+        return items[size_t(pos - frontPos)];
+    }
+
+    const queued_item& slot(Position pos) const {
+        return items[size_t(pos - frontPos)];
+    }
+
+    /// Drop the cleared slots at either end of the queue
+    void trim() {
+        while (!items.empty() && !items.back()) {
+            items.pop_back();
+            --numRemoved;
+        }
+        while (!items.empty() && !items.front()) {
+            items.pop_front();
+            ++frontPos;
+            --numRemoved;
+        }
+    }
+
+    std::deque<queued_item> items;
+
+    /// The position of the front item
+    Position frontPos = 0;
+
+    /// The number of cleared slots in items
+    size_t numRemoved = 0;
+};
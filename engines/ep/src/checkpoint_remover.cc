@@ -28,6 +28,8 @@
 #include <phosphor/phosphor.h>
 #include <platform/make_unique.h>
 
+#include <algorithm>
+
 /**
  * Remove all the closed unreferenced checkpoints for each vbucket.
  */
@@ -92,10 +94,24 @@ void ClosedUnrefCheckpointRemoverTask::cursorDroppingIfNeeded(void) {
      * dropping starts, it will continue until memory usage is projected
      * to go under the lower threshold which is a percentage of the quota,
      * specified by cursor_dropping_lower_mark.
+     * It also commences when the checkpoints use more than their share of
+     * the quota, specified by checkpoint_memory_ratio, and continues until
+     * they are projected to go back under it.
      */
+    size_t amountOfMemoryToClear = 0;
     if (stats.getTotalMemoryUsed() > stats.cursorDroppingUThreshold.load()) {
-        size_t amountOfMemoryToClear = stats.getTotalMemoryUsed() -
-                                          stats.cursorDroppingLThreshold.load();
+        amountOfMemoryToClear = stats.getTotalMemoryUsed() -
+                                stats.cursorDroppingLThreshold.load();
+    }
+    const size_t checkpointQuota = static_cast<size_t>(
+            stats.getMaxDataSize() *
+            engine->getCheckpointConfig().getCheckpointMemoryRatio());
+    if (stats.checkpointMemory > checkpointQuota) {
+        amountOfMemoryToClear = std::max(amountOfMemoryToClear,
+                                         stats.checkpointMemory -
+                                                 checkpointQuota);
+    }
+    if (amountOfMemoryToClear > 0) {
         size_t memoryCleared = 0;
         KVBucketIface* kvBucket = engine->getKVBucket();
         // Get a list of active vbuckets sorted by memory usage
@@ -107,6 +123,13 @@ void ClosedUnrefCheckpointRemoverTask::cursorDroppingIfNeeded(void) {
                 uint16_t vbid = it.first;
                 VBucketPtr vb = kvBucket->getVBucket(vbid);
                 if (vb) {
+                    // First expel the items all the cursors have already
+                    // processed, which frees memory without closing any
+                    // stream.
+                    if (engine->getConfiguration().isChkExpelEnabled()) {
+                        memoryCleared += vb->checkpointManager->
+                                expelUnreferencedCheckpointItems();
+                    }
                     // Get a list of cursors that can be dropped from the
                     // vbucket's checkpoint manager, so as to unreference
                     // an estimated number of checkpoints.
@@ -0,0 +1,45 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "checksum.h"
+
+#include <platform/crc32c.h>
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#include <cstring>
+#endif
+
+uint32_t computeChecksum(const uint8_t* buf, size_t len, uint32_t crc) {
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    crc = ~crc;
+    for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, buf, sizeof(word));
+        crc = __crc32cd(crc, word);
+        buf += sizeof(uint64_t);
+    }
+    for (; len > 0; --len) {
+        crc = __crc32cb(crc, *buf++);
+    }
+    return ~crc;
+#else
+    return crc32c(buf, len, crc);
+#endif
+}
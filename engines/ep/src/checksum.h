@@ -0,0 +1,39 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The checksum of the files written by ep-engine (the blocks of the access
+ * log, the saved bloom filters...): a CRC32C.
+ *
+ * On x86-64 it is computed by the platform crc32c(), which uses the SSE4.2
+ * CRC32 instruction if the CPU has it (checked at runtime). On ARMv8 builds
+ * with the CRC extension it uses the CRC32C instructions. Elsewhere it is a
+ * table-driven software CRC.
+ *
+ * @param buf the data
+ * @param len the number of bytes of data
+ * @param crc the checksum of the data preceding buf, to checksum a buffer in
+ *            pieces (0 for none)
+ */
+uint32_t computeChecksum(const uint8_t* buf, size_t len, uint32_t crc = 0);
@@ -19,8 +19,11 @@
 #include "collections/manager.h"
 #include "collections/manifest.h"
 #include "kv_bucket.h"
+#include "statwriter.h"
 #include "vbucket.h"
 
+#include <unordered_map>
+
 Collections::Manager::Manager() : current(std::make_unique<Manifest>()) {
 }
 
@@ -78,6 +81,33 @@ std::unique_ptr<Collections::Filter> Collections::Manager::makeFilter(
     return std::make_unique<Collections::Filter>(jsonFilter, *current);
 }
 
+void Collections::Manager::addStats(KVBucket& bucket,
+                                    const void* cookie,
+                                    ADD_STAT add_stat) const {
+    std::unordered_map<std::string, VB::ManifestEntry::Stats::Totals> totals;
+    for (int i = 0; i < bucket.getVBuckets().getSize(); i++) {
+        auto vb = bucket.getVBuckets().getBucket(i);
+        if (vb) {
+            vb->lockCollections().addStatsTotals(totals);
+        }
+    }
+
+    for (const auto& collection : totals) {
+        const auto prefix = collection.first + ":";
+        const auto& t = collection.second;
+        add_casted_stat((prefix + "gets").c_str(), t.gets, add_stat, cookie);
+        add_casted_stat((prefix + "sets").c_str(), t.sets, add_stat, cookie);
+        add_casted_stat(
+                (prefix + "deletes").c_str(), t.deletes, add_stat, cookie);
+        add_casted_stat(
+                (prefix + "disk_items").c_str(), t.diskItems, add_stat, cookie);
+        add_casted_stat((prefix + "flushed_bytes").c_str(),
+                        t.flushedBytes,
+                        add_stat,
+                        cookie);
+    }
+}
+
 // This method is really to aid development and allow the dumping of the VB
 // collection data to the logs.
 void Collections::Manager::logAll(KVBucket& bucket) const {
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <memcached/engine_common.h>
 #include <memcached/engine_error.h>
 
 #include <memory>
@@ -64,6 +65,14 @@ public:
     std::unique_ptr<Filter> makeFilter(bool collectionsEnabled,
                                        const std::string& json) const;
 
+    /**
+     * Add the stats of each collection, summed over the bucket's vbuckets,
+     * (the "collections" stats group).
+     */
+    void addStats(KVBucket& bucket,
+                  const void* cookie,
+                  ADD_STAT add_stat) const;
+
     /**
      * For development, log as much collections stuff as we can
      */
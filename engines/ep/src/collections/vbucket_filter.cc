@@ -70,6 +70,18 @@ Collections::VB::Filter::Filter(const Collections::Filter& filter,
     }
 }
 
+Collections::VB::Filter::Filter(const Filter& other)
+    : defaultAllowed(other.defaultAllowed),
+      passthrough(other.passthrough),
+      systemEventsAllowed(other.systemEventsAllowed),
+      separator(other.separator) {
+    for (const auto& c : other.filter) {
+        auto m = std::make_unique<std::string>(*c.second);
+        cb::const_char_buffer b{m->data(), m->size()};
+        filter.emplace(b, std::move(m));
+    }
+}
+
 bool Collections::VB::Filter::allow(::DocKey key) const {
     // passthrough, everything is allowed.
     if (passthrough) {
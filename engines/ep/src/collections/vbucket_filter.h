@@ -68,6 +68,19 @@ public:
     Filter(const ::Collections::Filter& filter,
            const ::Collections::VB::Manifest& manifest);
 
+    /**
+     * Copy a filter, e.g. for another thread to use as it is now (the
+     * stream may remove collections from its own later on).
+     */
+    Filter(const Filter& other);
+
+    /**
+     * @returns true if the filter allows everything
+     */
+    bool isPassthrough() const {
+        return passthrough;
+    }
+
     /**
      * @returns if the filter allows key based on the filter contents
      */
@@ -323,6 +323,32 @@ bool Manifest::doesKeyContainDeletingCollection(const ::DocKey& key,
     return false;
 }
 
+ManifestEntry::Stats* Manifest::getStatsForKey(const ::DocKey& key) const {
+    container::const_iterator itr = map.end();
+    if (key.getDocNamespace() == DocNamespace::DefaultCollection) {
+        if (defaultCollectionExists) {
+            itr = map.find(DefaultCollectionIdentifier);
+        }
+    } else if (key.getDocNamespace() == DocNamespace::Collections) {
+        const auto cKey = Collections::DocKey::make(key, separator);
+        itr = map.find({reinterpret_cast<const char*>(cKey.data()),
+                        cKey.getCollectionLen()});
+    }
+    if (itr != map.end()) {
+        return &itr->second->getStats();
+    }
+    return nullptr;
+}
+
+void Manifest::addStatsTotals(
+        std::unordered_map<std::string, ManifestEntry::Stats::Totals>& totals)
+        const {
+    for (const auto& entry : map) {
+        totals[entry.second->getCollectionName()] +=
+                entry.second->getStats().getTotals();
+    }
+}
+
 std::unique_ptr<Item> Manifest::createSystemEvent(SystemEvent se,
                                                   Identifier identifier,
                                                   OptionalSeqno seqno) const {
@@ -21,10 +21,10 @@
 #include "collections/collections_types.h"
 #include "collections/manifest.h"
 #include "collections/vbucket_manifest_entry.h"
+#include "locks.h"
 #include "systemevent.h"
 
 #include <platform/sized_buffer.h>
-#include <platform/rwlock.h>
 
 #include <mutex>
 #include <unordered_map>
@@ -61,6 +61,10 @@ namespace VB {
  * for the entire scope of the set path to ensure no other thread can interleave
  * collection create/delete and cause an inconsistency in the checkpoint
  * ordering.
+ *
+ * Every collection-aware operation takes the read handle, from any front end
+ * thread, while updates are rare; the lock is a ShardedSharedMutex so the
+ * readers don't all write the same cache line.
  */
 class Manifest {
 public:
@@ -69,7 +73,7 @@ public:
      */
     class ReadHandle {
     public:
-        ReadHandle(const Manifest& m, cb::RWLock& lock)
+        ReadHandle(const Manifest& m, ShardedSharedMutex& lock)
             : readLock(lock), manifest(m) {
         }
 
@@ -122,6 +126,40 @@ public:
             return manifest.isCollectionOpen(collection);
         }
 
+        /**
+         * Count a successful front end read, write or delete of the key in
+         * the counters of its collection (if the manifest knows it).
+         */
+        void countGet(::DocKey key) const {
+            countOp(key, &ManifestEntry::Stats::gets);
+        }
+
+        void countSet(::DocKey key) const {
+            countOp(key, &ManifestEntry::Stats::sets);
+        }
+
+        void countDelete(::DocKey key) const {
+            countOp(key, &ManifestEntry::Stats::deletes);
+        }
+
+        /**
+         * @return the counters of the key's collection, or nullptr if the
+         *         manifest doesn't know the collection
+         */
+        ManifestEntry::Stats* getStatsForKey(::DocKey key) const {
+            return manifest.getStatsForKey(key);
+        }
+
+        /**
+         * Add the counters of each collection to the totals of the
+         * collection's name.
+         */
+        void addStatsTotals(
+                std::unordered_map<std::string, ManifestEntry::Stats::Totals>&
+                        totals) const {
+            manifest.addStatsTotals(totals);
+        }
+
         /**
          * Dump the manifest to std::cerr
          */
@@ -132,7 +170,15 @@ public:
     private:
         friend std::ostream& operator<<(std::ostream& os,
                                         const Manifest::ReadHandle& readHandle);
-        std::unique_lock<cb::ReaderLock> readLock;
+        void countOp(::DocKey key,
+                     std::atomic<uint64_t> ManifestEntry::Stats::*op) const {
+            auto* stats = manifest.getStatsForKey(key);
+            if (stats) {
+                (stats->*op).fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        ShardedSharedMutex::ReaderHolder readLock;
         const Manifest& manifest;
     };
 
@@ -141,7 +187,7 @@ public:
      */
     class WriteHandle {
     public:
-        WriteHandle(Manifest& m, cb::RWLock& lock)
+        WriteHandle(Manifest& m, ShardedSharedMutex& lock)
             : writeLock(lock), manifest(m) {
         }
 
@@ -236,7 +282,7 @@ public:
         }
 
     private:
-        std::unique_lock<cb::WriterLock> writeLock;
+        std::unique_lock<ShardedSharedMutex> writeLock;
         Manifest& manifest;
     };
 
@@ -446,6 +492,19 @@ private:
         return false;
     }
 
+    /**
+     * @returns the counters of the key's collection, or nullptr if the key's
+     *          namespace has no collection or the collection is unknown
+     */
+    ManifestEntry::Stats* getStatsForKey(const ::DocKey& key) const;
+
+    /**
+     * Add the counters of each collection to the totals of its name
+     */
+    void addStatsTotals(
+            std::unordered_map<std::string, ManifestEntry::Stats::Totals>&
+                    totals) const;
+
 protected:
     /**
      * Add a collection entry to the manifest specifing the revision that it was
@@ -647,7 +706,7 @@ protected:
     /**
      * shared lock to allow concurrent readers and safe updates
      */
-    mutable cb::RWLock rwlock;
+    mutable ShardedSharedMutex rwlock;
 
     friend std::ostream& operator<<(std::ostream& os, const Manifest& manifest);
 };
@@ -21,9 +21,11 @@
 #include "stored-value.h"
 #include "systemevent.h"
 
+#include <platform/cacheline_padded.h>
 #include <platform/make_unique.h>
 #include <platform/sized_buffer.h>
 
+#include <atomic>
 #include <memory>
 
 namespace Collections {
@@ -34,6 +36,7 @@ namespace VB {
  * needs from a vbucket's perspective.
  * - The Collections::Manifest revision
  * - The seqno lifespace of the collection
+ * - The counters of the collection's operations and persisted items
  *
  * Additionally this object is designed for use by Collections::VB::Manifest,
  * this is why the object stores a pointer to a std::string collection name,
@@ -43,6 +46,54 @@ namespace VB {
  */
 class ManifestEntry {
 public:
+    /**
+     * What happened to the collection in the vbucket. The counters are
+     * relaxed atomics bumped by the threads which already hold the
+     * manifest's read lock for the operation, and are on their own cache
+     * line so the updates don't slow the readers of the entry's seqnos.
+     * Every vbucket has its own entry, so the updates of the front end
+     * threads are spread over the vbuckets (the stats group sums them).
+     * A copy of an entry starts with zeroed counters.
+     */
+    struct Stats {
+        /// A summable snapshot of the counters
+        struct Totals {
+            Totals& operator+=(const Totals& other) {
+                gets += other.gets;
+                sets += other.sets;
+                deletes += other.deletes;
+                diskItems += other.diskItems;
+                flushedBytes += other.flushedBytes;
+                return *this;
+            }
+
+            uint64_t gets = 0;
+            uint64_t sets = 0;
+            uint64_t deletes = 0;
+            int64_t diskItems = 0;
+            uint64_t flushedBytes = 0;
+        };
+
+        Totals getTotals() const {
+            Totals totals;
+            totals.gets = gets.load(std::memory_order_relaxed);
+            totals.sets = sets.load(std::memory_order_relaxed);
+            totals.deletes = deletes.load(std::memory_order_relaxed);
+            totals.diskItems = diskItems.load(std::memory_order_relaxed);
+            totals.flushedBytes = flushedBytes.load(std::memory_order_relaxed);
+            return totals;
+        }
+
+        // Successful front end reads, writes and deletes of documents
+        std::atomic<uint64_t> gets{0};
+        std::atomic<uint64_t> sets{0};
+        std::atomic<uint64_t> deletes{0};
+        // The documents the flusher inserted into (less those it deleted
+        // from) the vbucket's file, and the bytes of the items it wrote
+        std::atomic<int64_t> diskItems{0};
+        std::atomic<uint64_t> flushedBytes{0};
+    };
+
     ManifestEntry(Identifier identifier, int64_t _startSeqno, int64_t _endSeqno)
         : collectionName(std::make_unique<std::string>(
                   identifier.getName().data(), identifier.getName().size())),
@@ -147,6 +198,14 @@ public:
         this->uid = uid;
     }
 
+    /**
+     * @return the counters of the collection, which may be updated by
+     *         anyone holding the manifest's read lock
+     */
+    Stats& getStats() const {
+        return *stats;
+    }
+
     /**
      * A collection is open when the start is greater than the end.
      * An open collection is one that is readable and writable by the data
@@ -247,6 +306,8 @@ private:
      */
     int64_t startSeqno;
     int64_t endSeqno;
+
+    mutable cb::CachelinePadded<Stats> stats;
 };
 
 std::ostream& operator<<(std::ostream& os, const ManifestEntry& manifestEntry);
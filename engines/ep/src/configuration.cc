@@ -48,8 +48,49 @@ Configuration::Configuration() {
     initialize();
 }
 
+/**
+ * Stores the new values of a parameter in the lock-free copy the getter
+ * reads. Unlike the other listeners it is called with the mutex held, so
+ * that the copy is updated in the same order as the parameter.
+ */
+template <class T>
+class CachedValue : public ValueChangedListener {
+public:
+    explicit CachedValue(std::atomic<T>& cached) : cached(cached) {
+    }
+
+    void booleanValueChanged(const std::string&, bool value) override {
+        store(value);
+    }
+
+    void sizeValueChanged(const std::string&, size_t value) override {
+        store(value);
+    }
+
+    void ssizeValueChanged(const std::string&, ssize_t value) override {
+        store(value);
+    }
+
+    void floatValueChanged(const std::string&, float value) override {
+        store(value);
+    }
+
+private:
+    void store(T value) {
+        cached.store(value);
+    }
+
+    // Ignore values of another type (getParameter would throw for them)
+    template <class V>
+    void store(V) {
+    }
+
+    std::atomic<T>& cached;
+};
+
 struct Configuration::value_t {
     std::vector<std::unique_ptr<ValueChangedListener>> changeListener;
+    std::unique_ptr<ValueChangedListener> cache;
     std::unique_ptr<ValueChangedValidator> validator;
     std::unique_ptr<Requirement> requirement;
 
@@ -84,8 +125,12 @@ void Configuration::setParameter(const std::string& key, T value) {
         } else {
             attributes[key] = std::make_shared<value_t>();
         }
-        attributes[key]->value = value;
-        copy = attributes[key]->copyListeners();
+        auto& attribute = *attributes[key];
+        attribute.value = value;
+        if (attribute.cache) {
+            attribute.cache->valueChanged(key, value);
+        }
+        copy = attribute.copyListeners();
     }
 
     for (auto* listener : copy) {
@@ -141,6 +186,30 @@ std::ostream& operator<<(std::ostream& out, const Configuration& config) {
     return out;
 }
 
+template <class T>
+void Configuration::addCachedValue(const std::string& key,
+                                   std::atomic<T>& cached) {
+    LockHolder lh(mutex);
+    auto iter = attributes.find(key);
+    if (iter == attributes.end()) {
+        return;
+    }
+    iter->second->cache = std::make_unique<CachedValue<T>>(cached);
+    const T* value = boost::get<T>(&iter->second->value);
+    if (value != nullptr) {
+        cached.store(*value);
+    }
+}
+
+template void Configuration::addCachedValue<bool>(const std::string& key,
+                                                  std::atomic<bool>& cached);
+template void Configuration::addCachedValue<size_t>(
+        const std::string& key, std::atomic<size_t>& cached);
+template void Configuration::addCachedValue<ssize_t>(
+        const std::string& key, std::atomic<ssize_t>& cached);
+template void Configuration::addCachedValue<float>(const std::string& key,
+                                                   std::atomic<float>& cached);
+
 void Configuration::addAlias(const std::string& key, const std::string& alias) {
     attributes[alias] = attributes[key];
 }
@@ -21,6 +21,7 @@
 
 #include <memcached/engine.h>
 
+#include <atomic>
 #include <iostream>
 #include <map>
 #include <mutex>
@@ -318,6 +319,14 @@ protected:
 private:
     void initialize();
 
+    /**
+     * Keep the given member (the lock-free copy of a parameter the getter
+     * generated from configuration.json reads) in sync with the value of
+     * the parameter
+     */
+    template <class T>
+    void addCachedValue(const std::string& key, std::atomic<T>& cached);
+
     // Access to the configuration variables is protected by the mutex
     mutable std::mutex mutex;
     std::map<std::string, std::shared_ptr<value_t>> attributes;
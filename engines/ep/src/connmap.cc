@@ -165,7 +165,7 @@ ConnMap::ConnMap(EventuallyPersistentEngine &theEngine)
     Configuration &config = engine.getConfiguration();
     size_t max_vbs = config.getMaxVbuckets();
     for (size_t i = 0; i < max_vbs; ++i) {
-        vbConns.push_back(std::list<connection_t>());
+        vbConns.push_back(std::make_shared<const VBConnList>());
     }
 }
 
@@ -226,27 +226,33 @@ void ConnMap::addVBConnByVBId(connection_t &conn, int16_t vbid) {
 
     size_t lock_num = vbid % vbConnLockNum;
     std::lock_guard<SpinLock> lh(vbConnLocks[lock_num]);
-    std::list<connection_t> &vb_conns = vbConns[vbid];
-    vb_conns.push_back(conn);
+    auto vb_conns = std::make_shared<VBConnList>(*getVBConns(vbid));
+    vb_conns->push_back(conn);
+    std::atomic_store(&vbConns[vbid],
+                      std::shared_ptr<const VBConnList>(std::move(vb_conns)));
 }
 
-void ConnMap::removeVBConnByVBId_UNLOCKED(connection_t &conn, int16_t vbid) {
+void ConnMap::removeVBConnByVBId(connection_t &conn, int16_t vbid) {
     if (!conn.get()) {
         return;
     }
 
-    std::list<connection_t> &vb_conns = vbConns[vbid];
-    std::list<connection_t>::iterator itr = vb_conns.begin();
-    for (; itr != vb_conns.end(); ++itr) {
-        if (conn->getCookie() == (*itr)->getCookie()) {
-            vb_conns.erase(itr);
-            break;
-        }
-    }
-}
-
-void ConnMap::removeVBConnByVBId(connection_t &conn, int16_t vbid) {
     size_t lock_num = vbid % vbConnLockNum;
     std::lock_guard<SpinLock> lh(vbConnLocks[lock_num]);
-    removeVBConnByVBId_UNLOCKED(conn, vbid);
+    const auto current = getVBConns(vbid);
+    auto itr = std::find_if(current->begin(),
+                            current->end(),
+                            [&conn](const connection_t& c) {
+                                return conn->getCookie() == c->getCookie();
+                            });
+    if (itr == current->end()) {
+        return;
+    }
+
+    auto vb_conns = std::make_shared<VBConnList>();
+    vb_conns->reserve(current->size() - 1);
+    vb_conns->insert(vb_conns->end(), current->begin(), itr);
+    vb_conns->insert(vb_conns->end(), std::next(itr), current->end());
+    std::atomic_store(&vbConns[vbid],
+                      std::shared_ptr<const VBConnList>(std::move(vb_conns)));
 }
@@ -22,11 +22,13 @@
 #include "atomic.h"
 #include "atomicqueue.h"
 #include "dcp/dcp-types.h"
+#include "instrumented_mutex.h"
 
 #include <climits>
 #include <iterator>
 #include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -66,8 +68,6 @@ public:
 
     void addVBConnByVBId(connection_t &conn, int16_t vbid);
 
-    void removeVBConnByVBId_UNLOCKED(connection_t &conn, int16_t vbid);
-
     void removeVBConnByVBId(connection_t &conn, int16_t vbid);
 
     /**
@@ -96,13 +96,28 @@ protected:
     // removing connections.
     // Actual modification of the underlying
     // ConnHandler objects is guarded by {releaseLock}.
-    std::mutex                                    connsLock;
+    InstrumentedMutex<std::mutex> connsLock{LockStats::dcpConns};
+    using ConnsLockHolder = std::lock_guard<InstrumentedMutex<std::mutex>>;
 
     using CookieToConnectionMap = std::map<const void*, connection_t>;
     CookieToConnectionMap map_;
 
+    using VBConnList = std::vector<connection_t>;
+
+    /**
+     * Get the connections with a stream for the given vbucket. The list is
+     * immutable, and may be used without holding any lock.
+     */
+    std::shared_ptr<const VBConnList> getVBConns(uint16_t vbid) const {
+        return std::atomic_load(&vbConns[vbid]);
+    }
+
+    // Serialise the modifications of the {vbConns} of the vbuckets
+    // mapping to each lock. A modification copies the list of the
+    // vbucket and swaps the copy in, so that the readers (such as the
+    // notification of every mutation) never have to lock.
     std::vector<SpinLock> vbConnLocks;
-    std::vector<std::list<connection_t> > vbConns;
+    std::vector<std::shared_ptr<const VBConnList>> vbConns;
 
     /* Handle to the engine who owns us */
     EventuallyPersistentEngine &engine;
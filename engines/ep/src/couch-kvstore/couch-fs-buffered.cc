@@ -0,0 +1,177 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "couch-kvstore/couch-fs-buffered.h"
+
+#include <algorithm>
+
+couch_file_handle BufferedWriteOps::constructor(
+        couchstore_error_info_t* errinfo) {
+    BufferedFile* bf =
+            new BufferedFile{wrapped_ops.constructor(errinfo), {}, 0};
+    return reinterpret_cast<couch_file_handle>(bf);
+}
+
+couchstore_error_t BufferedWriteOps::open(couchstore_error_info_t* errinfo,
+                                          couch_file_handle* h,
+                                          const char* path,
+                                          int flags) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(*h);
+    return wrapped_ops.open(errinfo, &bf->handle, path, flags);
+}
+
+couchstore_error_t BufferedWriteOps::close(couchstore_error_info_t* errinfo,
+                                           couch_file_handle h) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    const auto flushed = flush(errinfo, *bf);
+    // Give the memory back; the file may stay around closed for a while
+    std::vector<char>().swap(bf->buffer);
+    const auto errCode = wrapped_ops.close(errinfo, bf->handle);
+    return flushed != COUCHSTORE_SUCCESS ? flushed : errCode;
+}
+
+couchstore_error_t BufferedWriteOps::set_periodic_sync(couch_file_handle h,
+                                                       uint64_t period_bytes) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    return wrapped_ops.set_periodic_sync(bf->handle, period_bytes);
+}
+
+couchstore_error_t BufferedWriteOps::flush(couchstore_error_info_t* errinfo,
+                                           BufferedFile& bf) {
+    if (bf.buffer.empty()) {
+        return COUCHSTORE_SUCCESS;
+    }
+    const ssize_t written = wrapped_ops.pwrite(
+            errinfo, bf.handle, bf.buffer.data(), bf.buffer.size(), bf.offset);
+    // Whatever the outcome, the data is no longer ours to write
+    const size_t size = bf.buffer.size();
+    bf.buffer.clear();
+    if (written < 0) {
+        return couchstore_error_t(written);
+    }
+    if (size_t(written) != size) {
+        return COUCHSTORE_ERROR_WRITE;
+    }
+    return COUCHSTORE_SUCCESS;
+}
+
+ssize_t BufferedWriteOps::pread(couchstore_error_info_t* errinfo,
+                                couch_file_handle h,
+                                void* buf,
+                                size_t nbytes,
+                                cs_off_t offset) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    // A read of anything still in the buffer has to see it, so it is
+    // written out first
+    if (!bf->buffer.empty() &&
+        offset < bf->offset + cs_off_t(bf->buffer.size()) &&
+        offset + cs_off_t(nbytes) > bf->offset) {
+        const auto errCode = flush(errinfo, *bf);
+        if (errCode != COUCHSTORE_SUCCESS) {
+            return errCode;
+        }
+    }
+    return wrapped_ops.pread(errinfo, bf->handle, buf, nbytes, offset);
+}
+
+ssize_t BufferedWriteOps::pwrite(couchstore_error_info_t* errinfo,
+                                 couch_file_handle h,
+                                 const void* buf,
+                                 size_t nbytes,
+                                 cs_off_t offset) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    if (!bf->buffer.empty() &&
+        offset != bf->offset + cs_off_t(bf->buffer.size())) {
+        const auto errCode = flush(errinfo, *bf);
+        if (errCode != COUCHSTORE_SUCCESS) {
+            return errCode;
+        }
+    }
+
+    if (bf->buffer.empty()) {
+        if (nbytes >= bufferSize) {
+            // Nothing to gain from copying it
+            return wrapped_ops.pwrite(errinfo, bf->handle, buf, nbytes, offset);
+        }
+        bf->buffer.reserve(bufferSize);
+        bf->offset = offset;
+    }
+
+    const char* data = static_cast<const char*>(buf);
+    size_t remaining = nbytes;
+    while (remaining > 0) {
+        // The buffer is written out when it reaches the next multiple of
+        // its size in the file (so at most bufferSize bytes at a time)
+        const cs_off_t end = (bf->offset / bufferSize + 1) * bufferSize;
+        const cs_off_t current = bf->offset + bf->buffer.size();
+        const size_t chunk = std::min(remaining, size_t(end - current));
+        bf->buffer.insert(bf->buffer.end(), data, data + chunk);
+        data += chunk;
+        remaining -= chunk;
+
+        if (current + cs_off_t(chunk) == end) {
+            const auto errCode = flush(errinfo, *bf);
+            if (errCode != COUCHSTORE_SUCCESS) {
+                return errCode;
+            }
+            bf->offset = end;
+        }
+    }
+    return nbytes;
+}
+
+cs_off_t BufferedWriteOps::goto_eof(couchstore_error_info_t* errinfo,
+                                    couch_file_handle h) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    const auto errCode = flush(errinfo, *bf);
+    if (errCode != COUCHSTORE_SUCCESS) {
+        return errCode;
+    }
+    return wrapped_ops.goto_eof(errinfo, bf->handle);
+}
+
+couchstore_error_t BufferedWriteOps::sync(couchstore_error_info_t* errinfo,
+                                          couch_file_handle h) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    const auto errCode = flush(errinfo, *bf);
+    if (errCode != COUCHSTORE_SUCCESS) {
+        return errCode;
+    }
+    return wrapped_ops.sync(errinfo, bf->handle);
+}
+
+couchstore_error_t BufferedWriteOps::advise(couchstore_error_info_t* errinfo,
+                                            couch_file_handle h,
+                                            cs_off_t offs,
+                                            cs_off_t len,
+                                            couchstore_file_advice_t adv) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    return wrapped_ops.advise(errinfo, bf->handle, offs, len, adv);
+}
+
+FHStats* BufferedWriteOps::get_stats(couch_file_handle h) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    return wrapped_ops.get_stats(bf->handle);
+}
+
+void BufferedWriteOps::destructor(couch_file_handle h) {
+    BufferedFile* bf = reinterpret_cast<BufferedFile*>(h);
+    wrapped_ops.destructor(bf->handle);
+    delete bf;
+}
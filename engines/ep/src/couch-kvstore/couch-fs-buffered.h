@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <libcouchstore/couch_db.h>
+
+/**
+ * FileOpsInterface implementation which coalesces the writes of couchstore
+ * into buffers of a fixed size before passing them on to the wrapped ops.
+ *
+ * Couchstore appends the documents and the B-tree nodes of a commit to the
+ * end of the file in many small (and contiguous) writes. They are copied
+ * into a buffer instead, which is written out whenever it ends at a
+ * multiple of its size in the file (so that, after the first one, the
+ * writes are of whole aligned buffers), and before a sync, a close or a
+ * read or write of anything else than what directly follows it.
+ *
+ * The buffer of a file is only allocated once it is written to, and is
+ * released when the file is closed.
+ */
+class BufferedWriteOps : public FileOpsInterface {
+public:
+    /**
+     * @param ops the file ops to wrap
+     * @param bufferSize the size of the write buffer of each file
+     */
+    BufferedWriteOps(FileOpsInterface& ops, size_t bufferSize)
+        : wrapped_ops(ops), bufferSize(bufferSize) {
+    }
+
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override;
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle,
+                            const char* path,
+                            int oflag) override;
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override;
+    couchstore_error_t set_periodic_sync(couch_file_handle handle,
+                                         uint64_t period_bytes) override;
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle,
+                  void* buf,
+                  size_t nbytes,
+                  cs_off_t offset) override;
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle,
+                   const void* buf,
+                   size_t nbytes,
+                   cs_off_t offset) override;
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override;
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override;
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override;
+    FHStats* get_stats(couch_file_handle handle) override;
+    void destructor(couch_file_handle handle) override;
+
+protected:
+    struct BufferedFile {
+        /// Handle of the wrapped ops
+        couch_file_handle handle;
+        /// The data written but not passed on yet
+        std::vector<char> buffer;
+        /// The offset in the file of the start of the buffer
+        cs_off_t offset;
+    };
+
+    /// Write the buffer out (if not empty)
+    couchstore_error_t flush(couchstore_error_info_t* errinfo,
+                             BufferedFile& bf);
+
+    FileOpsInterface& wrapped_ops;
+    const size_t bufferSize;
+};
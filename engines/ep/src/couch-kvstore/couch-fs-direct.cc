@@ -0,0 +1,305 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "couch-kvstore/couch-fs-direct.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+const size_t CouchBlockCache::blockSize;
+
+CouchBlockCache::CouchBlockCache(size_t maxBytes)
+    : maxBlocks(maxBytes / blockSize) {
+}
+
+uint64_t CouchBlockCache::getFileId(const std::string& path, uint64_t inode) {
+    std::lock_guard<std::mutex> lh(mutex);
+    auto it = files.find(path);
+    if (it == files.end()) {
+        it = files.emplace(path, FileInfo{inode, nextFileId++}).first;
+    } else if (it->second.inode != inode) {
+        // A new file at the same path; the blocks of the old one age out
+        it->second = FileInfo{inode, nextFileId++};
+    }
+    return it->second.id;
+}
+
+bool CouchBlockCache::lookup(uint64_t fileId,
+                             cs_off_t offset,
+                             char* dest,
+                             size_t from,
+                             size_t len) {
+    std::lock_guard<std::mutex> lh(mutex);
+    auto it = index.find(Key{fileId, offset});
+    if (it == index.end()) {
+        ++misses;
+        return false;
+    }
+    ++hits;
+    lru.splice(lru.begin(), lru, it->second);
+    std::memcpy(dest, it->second->data.get() + from, len);
+    return true;
+}
+
+void CouchBlockCache::offer(uint64_t fileId,
+                            cs_off_t offset,
+                            const char* block) {
+    if (maxBlocks == 0) {
+        return;
+    }
+    const Key key{fileId, offset};
+    std::lock_guard<std::mutex> lh(mutex);
+    if (index.count(key) != 0) {
+        return;
+    }
+
+    if (recent.erase(key) == 0) {
+        // First read: just remember it
+        if (recentOrder.size() >= maxBlocks) {
+            recent.erase(recentOrder.front());
+            recentOrder.pop_front();
+        }
+        recent.insert(key);
+        recentOrder.push_back(key);
+        return;
+    }
+    // (Its entry in recentOrder is dropped when it reaches the front)
+
+    std::unique_ptr<char[]> data;
+    if (lru.size() >= maxBlocks) {
+        // Recycle the buffer of the least recently used block
+        auto& victim = lru.back();
+        index.erase(victim.key);
+        data = std::move(victim.data);
+        lru.pop_back();
+        ++evictions;
+    } else {
+        data.reset(new char[blockSize]);
+    }
+    std::memcpy(data.get(), block, blockSize);
+    lru.push_front(Block{key, std::move(data)});
+    index.emplace(key, lru.begin());
+}
+
+size_t CouchBlockCache::getNumBlocks() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    return lru.size();
+}
+
+couch_file_handle DirectOps::constructor(couchstore_error_info_t* errinfo) {
+    DirectFile* df = new DirectFile{wrapped_ops.constructor(errinfo),
+                                    wrapped_ops.constructor(errinfo),
+                                    false,
+                                    false,
+                                    0,
+                                    nullptr,
+                                    0};
+    return reinterpret_cast<couch_file_handle>(df);
+}
+
+couchstore_error_t DirectOps::open(couchstore_error_info_t* errinfo,
+                                   couch_file_handle* h,
+                                   const char* path,
+                                   int flags) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(*h);
+    auto errCode = wrapped_ops.open(errinfo, &df->handle, path, flags);
+    if (errCode != COUCHSTORE_SUCCESS) {
+        return errCode;
+    }
+
+    // Not all the file systems support O_DIRECT (e.g. tmpfs), in which case
+    // the reads go through the page cache (and the block cache) after all.
+    df->direct = false;
+#ifdef O_DIRECT
+    if (directIO) {
+        df->direct = wrapped_ops.open(errinfo,
+                                      &df->readHandle,
+                                      path,
+                                      O_RDONLY | O_DIRECT) ==
+                     COUCHSTORE_SUCCESS;
+    }
+#endif
+    df->readHandleOpen =
+            df->direct || wrapped_ops.open(errinfo,
+                                           &df->readHandle,
+                                           path,
+                                           O_RDONLY) == COUCHSTORE_SUCCESS;
+    if (!df->readHandleOpen) {
+        wrapped_ops.close(errinfo, df->handle);
+        return COUCHSTORE_ERROR_OPEN_FILE;
+    }
+
+    if (cache) {
+        struct stat st;
+        const uint64_t inode = ::stat(path, &st) == 0 ? uint64_t(st.st_ino) : 0;
+        df->fileId = cache->getFileId(path, inode);
+    }
+    return COUCHSTORE_SUCCESS;
+}
+
+couchstore_error_t DirectOps::close(couchstore_error_info_t* errinfo,
+                                    couch_file_handle h) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    if (df->readHandleOpen) {
+        wrapped_ops.close(errinfo, df->readHandle);
+        df->readHandleOpen = false;
+    }
+    return wrapped_ops.close(errinfo, df->handle);
+}
+
+couchstore_error_t DirectOps::set_periodic_sync(couch_file_handle h,
+                                                uint64_t period_bytes) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    return wrapped_ops.set_periodic_sync(df->handle, period_bytes);
+}
+
+char* DirectOps::getBuffer(DirectFile& df, size_t size) {
+    if (df.bufferSize < size) {
+        void* ptr = nullptr;
+#ifdef O_DIRECT
+        if (posix_memalign(&ptr, CouchBlockCache::blockSize, size) != 0) {
+            ptr = nullptr;
+        }
+#else
+        ptr = malloc(size);
+#endif
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        df.buffer.reset(static_cast<char*>(ptr));
+        df.bufferSize = size;
+    }
+    return df.buffer.get();
+}
+
+bool DirectOps::readCached(DirectFile& df,
+                           char* buf,
+                           size_t sz,
+                           cs_off_t off) {
+    const cs_off_t end = off + cs_off_t(sz);
+    for (cs_off_t pos = off; pos < end;) {
+        const cs_off_t block = pos - pos % CouchBlockCache::blockSize;
+        const size_t from = size_t(pos - block);
+        const size_t len = size_t(
+                std::min(end, block + cs_off_t(CouchBlockCache::blockSize)) -
+                pos);
+        if (!cache->lookup(df.fileId, block, buf + (pos - off), from, len)) {
+            return false;
+        }
+        pos += len;
+    }
+    return true;
+}
+
+ssize_t DirectOps::pread(couchstore_error_info_t* errinfo,
+                         couch_file_handle h,
+                         void* buf,
+                         size_t sz,
+                         cs_off_t off) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    if (!df->direct && !cache) {
+        return wrapped_ops.pread(errinfo, df->readHandle, buf, sz, off);
+    }
+    if (cache && readCached(*df, static_cast<char*>(buf), sz, off)) {
+        return sz;
+    }
+
+    // Read the whole blocks covering the range
+    const cs_off_t bs = CouchBlockCache::blockSize;
+    const cs_off_t start = off - off % bs;
+    const cs_off_t end = ((off + cs_off_t(sz) + bs - 1) / bs) * bs;
+    char* blocks = getBuffer(*df, size_t(end - start));
+    const ssize_t got = wrapped_ops.pread(
+            errinfo, df->readHandle, blocks, size_t(end - start), start);
+    if (got < 0) {
+        return got;
+    }
+
+    if (cache) {
+        // Only a complete block is immutable; the last one of the file may
+        // still grow
+        for (cs_off_t pos = 0; pos + bs <= got; pos += bs) {
+            cache->offer(df->fileId, start + pos, blocks + pos);
+        }
+    }
+
+    const ssize_t avail = got - ssize_t(off - start);
+    if (avail <= 0) {
+        return 0;
+    }
+    const size_t n = std::min(sz, size_t(avail));
+    std::memcpy(buf, blocks + (off - start), n);
+    return n;
+}
+
+ssize_t DirectOps::pwrite(couchstore_error_info_t* errinfo,
+                          couch_file_handle h,
+                          const void* buf,
+                          size_t sz,
+                          cs_off_t off) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    return wrapped_ops.pwrite(errinfo, df->handle, buf, sz, off);
+}
+
+cs_off_t DirectOps::goto_eof(couchstore_error_info_t* errinfo,
+                             couch_file_handle h) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    return wrapped_ops.goto_eof(errinfo, df->handle);
+}
+
+couchstore_error_t DirectOps::sync(couchstore_error_info_t* errinfo,
+                                   couch_file_handle h) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    const auto errCode = wrapped_ops.sync(errinfo, df->handle);
+    if (errCode == COUCHSTORE_SUCCESS && df->direct) {
+        // The pages written are clean now; don't keep them cached (a zero
+        // length applies to the whole file)
+        couchstore_error_info_t adviseErr;
+        wrapped_ops.advise(
+                &adviseErr, df->handle, 0, 0, COUCHSTORE_FILE_ADVICE_DONTNEED);
+    }
+    return errCode;
+}
+
+couchstore_error_t DirectOps::advise(couchstore_error_info_t* errinfo,
+                                     couch_file_handle h,
+                                     cs_off_t offs,
+                                     cs_off_t len,
+                                     couchstore_file_advice_t adv) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    return wrapped_ops.advise(errinfo, df->readHandle, offs, len, adv);
+}
+
+FileOpsInterface::FHStats* DirectOps::get_stats(couch_file_handle h) {
+    // The reads are issued on readHandle
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    return wrapped_ops.get_stats(df->readHandle);
+}
+
+void DirectOps::destructor(couch_file_handle h) {
+    DirectFile* df = reinterpret_cast<DirectFile*>(h);
+    wrapped_ops.destructor(df->readHandle);
+    wrapped_ops.destructor(df->handle);
+    delete df;
+}
@@ -0,0 +1,216 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <libcouchstore/couch_db.h>
+
+/**
+ * A bounded LRU cache of the blocks of couchstore files.
+ *
+ * Couchstore files are append-only, so a block which was read in full never
+ * changes (until its file is removed). The cache doesn't know which blocks
+ * hold B-tree nodes and which hold document bodies; instead it only admits a
+ * block on its second read within the recent past, so that the nodes which
+ * every lookup walks through stay cached while the bodies read once by a
+ * background fetch or a backfill don't evict them.
+ *
+ * Thread-safe.
+ */
+class CouchBlockCache {
+public:
+    /// The size of the blocks cached (and of the alignment of direct I/O)
+    static const size_t blockSize = 4096;
+
+    /// @param maxBytes the maximum size of the blocks cached
+    explicit CouchBlockCache(size_t maxBytes);
+
+    /**
+     * @return the identifier of the blocks of a file in the cache. The
+     *         blocks of a file which was removed and recreated (i.e. whose
+     *         inode changed) aren't returned for its new incarnation.
+     */
+    uint64_t getFileId(const std::string& path, uint64_t inode);
+
+    /**
+     * Copy the part [from, from + len) of a block into dest, if it is cached
+     * @param offset the offset of the block in its file
+     */
+    bool lookup(uint64_t fileId,
+                cs_off_t offset,
+                char* dest,
+                size_t from,
+                size_t len);
+
+    /**
+     * Offer a (complete) block just read from disk to the cache; it is only
+     * admitted if it was offered recently already.
+     */
+    void offer(uint64_t fileId, cs_off_t offset, const char* block);
+
+    size_t getNumBlocks() const;
+
+    size_t getMaxBlocks() const {
+        return maxBlocks;
+    }
+
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> evictions{0};
+
+private:
+    struct Key {
+        uint64_t fileId;
+        cs_off_t offset;
+
+        bool operator==(const Key& other) const {
+            return fileId == other.fileId && offset == other.offset;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<uint64_t>()(key.fileId * 0x9e3779b97f4a7c15ull ^
+                                         uint64_t(key.offset));
+        }
+    };
+
+    struct Block {
+        Key key;
+        std::unique_ptr<char[]> data;
+    };
+
+    const size_t maxBlocks;
+
+    mutable std::mutex mutex;
+
+    /// The cached blocks, most recently used first
+    std::list<Block> lru;
+    std::unordered_map<Key, std::list<Block>::iterator, KeyHash> index;
+
+    /// The blocks offered once recently (bounded to maxBlocks entries)
+    std::unordered_set<Key, KeyHash> recent;
+    std::deque<Key> recentOrder;
+
+    struct FileInfo {
+        uint64_t inode;
+        uint64_t id;
+    };
+    std::unordered_map<std::string, FileInfo> files;
+    uint64_t nextFileId = 0;
+};
+
+/**
+ * FileOpsInterface implementation which reads the couchstore files without
+ * the OS page cache (O_DIRECT) and/or through a CouchBlockCache.
+ *
+ * The file is opened twice through the wrapped ops: once as asked, for all
+ * of the operations but the reads, and once read-only and (if enabled and
+ * supported by the platform and the file system) O_DIRECT for the reads,
+ * which are then issued in whole aligned blocks. The pages written through
+ * the first handle are dropped from the page cache once synced.
+ */
+class DirectOps : public FileOpsInterface {
+public:
+    /**
+     * @param ops the file ops to wrap
+     * @param directIO true to read the files with O_DIRECT
+     * @param cache the block cache to read through, or nullptr
+     */
+    DirectOps(FileOpsInterface& ops,
+              bool directIO,
+              std::shared_ptr<CouchBlockCache> cache)
+        : wrapped_ops(ops), directIO(directIO), cache(std::move(cache)) {
+    }
+
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override;
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle,
+                            const char* path,
+                            int oflag) override;
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override;
+    couchstore_error_t set_periodic_sync(couch_file_handle handle,
+                                         uint64_t period_bytes) override;
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle,
+                  void* buf,
+                  size_t nbytes,
+                  cs_off_t offset) override;
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle,
+                   const void* buf,
+                   size_t nbytes,
+                   cs_off_t offset) override;
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override;
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override;
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override;
+    FHStats* get_stats(couch_file_handle handle) override;
+    void destructor(couch_file_handle handle) override;
+
+protected:
+    struct FreeDeleter {
+        void operator()(char* ptr) {
+            free(ptr);
+        }
+    };
+
+    struct DirectFile {
+        /// Handle of the wrapped ops for everything but the reads
+        couch_file_handle handle;
+        /// Handle of the wrapped ops for the reads
+        couch_file_handle readHandle;
+        /// True if readHandle is open (O_DIRECT or not)
+        bool readHandleOpen;
+        /// True if readHandle was opened O_DIRECT
+        bool direct;
+        /// The blocks of the file in the cache
+        uint64_t fileId;
+
+        /// Buffer for the aligned reads (a read is issued by one thread)
+        std::unique_ptr<char, FreeDeleter> buffer;
+        size_t bufferSize;
+    };
+
+    /// Copy the part of a read covered by the cache; false if not all of it
+    bool readCached(DirectFile& df, char* buf, size_t nbytes, cs_off_t offset);
+
+    /// @return a buffer (aligned for O_DIRECT) of at least size bytes
+    char* getBuffer(DirectFile& df, size_t size);
+
+    FileOpsInterface& wrapped_ops;
+    const bool directIO;
+    const std::shared_ptr<CouchBlockCache> cache;
+};
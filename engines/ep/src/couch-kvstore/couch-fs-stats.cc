@@ -35,7 +35,10 @@ StatsOps::StatFile::StatFile(FileOpsInterface* _orig_ops,
       orig_handle(_orig_handle),
       last_offs(_last_offs),
       read_count_since_open(0),
-      write_count_since_open(0) {
+      write_count_since_open(0),
+      readahead_window(0),
+      readahead_start(0),
+      readahead_end(0) {
 }
 
 size_t StatsOps::StatFile::getReadCount() {
@@ -61,6 +64,9 @@ couchstore_error_t StatsOps::open(couchstore_error_info_t* errinfo,
     StatFile* sf = reinterpret_cast<StatFile*>(*h);
     sf->read_count_since_open = 0;
     sf->write_count_since_open = 0;
+    sf->readahead_window = 0;
+    sf->readahead_start = 0;
+    sf->readahead_end = 0;
     return sf->orig_ops->open(errinfo, &sf->orig_handle, path, flags);
 }
 
@@ -97,6 +103,9 @@ ssize_t StatsOps::pread(couchstore_error_info_t* errinfo,
         stats.readSeekHisto.add(std::abs(off - sf->last_offs));
     }
     sf->last_offs = off;
+    if (sf->readahead_window > 0) {
+        readAhead(*sf, off, sz);
+    }
     BlockTimer bt(&stats.readTimeHisto);
     ssize_t result = sf->orig_ops->pread(errinfo, sf->orig_handle, buf,
                                          sz, off);
@@ -146,6 +155,66 @@ couchstore_error_t StatsOps::advise(couchstore_error_info_t* errinfo,
     return sf->orig_ops->advise(errinfo, sf->orig_handle, offs, len, adv);
 }
 
+couchstore_error_t StatsOps::adviseFile(couchstore_error_info_t* errinfo,
+                                        FHStats* fileStats,
+                                        cs_off_t offs,
+                                        cs_off_t len,
+                                        couchstore_file_advice_t adv) {
+    // get_stats() hands out the StatFile itself
+    StatFile* sf = static_cast<StatFile*>(fileStats);
+    return sf->orig_ops->advise(errinfo, sf->orig_handle, offs, len, adv);
+}
+
+couchstore_error_t StatsOps::setSequentialReadahead(
+        couchstore_error_info_t* errinfo,
+        FHStats* fileStats,
+        cs_off_t window) {
+    StatFile* sf = static_cast<StatFile*>(fileStats);
+    // A zero length applies to the whole file
+    const auto errCode = sf->orig_ops->advise(
+            errinfo, sf->orig_handle, 0, 0, COUCHSTORE_FILE_ADVICE_SEQUENTIAL);
+    if (errCode == COUCHSTORE_SUCCESS) {
+        sf->readahead_window = window;
+        sf->readahead_start = 0;
+        sf->readahead_end = 0;
+    }
+    return errCode;
+}
+
+void StatsOps::readAhead(StatFile& sf, cs_off_t off, size_t sz) {
+    const cs_off_t end = off + cs_off_t(sz);
+    cs_off_t from;
+    if (off >= sf.readahead_start && end <= sf.readahead_end) {
+        ++stats.readaheadHits;
+        // Extend the range once half of the window ahead was consumed, so
+        // the OS reads the next blocks while we process these.
+        if (sf.readahead_end - end > sf.readahead_window / 2) {
+            return;
+        }
+        from = sf.readahead_end;
+    } else {
+        // A seek out of the range (e.g. to a B-tree node): read ahead of it
+        ++stats.readaheadMisses;
+        sf.readahead_start = off;
+        from = off;
+    }
+
+    const cs_off_t to = end + sf.readahead_window;
+    // Readahead is only a hint; a failure to give it mustn't fail the read
+    couchstore_error_info_t errinfo;
+    if (sf.orig_ops->advise(&errinfo,
+                            sf.orig_handle,
+                            from,
+                            to - from,
+                            COUCHSTORE_FILE_ADVICE_WILLNEED) ==
+        COUCHSTORE_SUCCESS) {
+        stats.readaheadBytes += to - from;
+        sf.readahead_end = to;
+    } else {
+        sf.readahead_window = 0;
+    }
+}
+
 FileOpsInterface::FHStats* StatsOps::get_stats(couch_file_handle h) {
     // StatFile implements FHStats interface directly.
     StatFile* sf = reinterpret_cast<StatFile*>(h);
@@ -69,6 +69,32 @@ public:
     FHStats* get_stats(couch_file_handle handle) override;
     void destructor(couch_file_handle handle) override;
 
+    /**
+     * Give advice about a range of a file opened through a StatsOps, e.g. so
+     * the OS reads it ahead.
+     *
+     * @param fileStats the FHStats of the file (couchstore_get_db_filestats)
+     */
+    static couchstore_error_t adviseFile(couchstore_error_info_t* errinfo,
+                                         FHStats* fileStats,
+                                         cs_off_t offset,
+                                         cs_off_t len,
+                                         couchstore_file_advice_t advice);
+
+    /**
+     * Tell the OS that a file opened through a StatsOps will be read
+     * (roughly) sequentially, and keep advising it to read ahead the given
+     * number of bytes beyond each read issued on the file, until it is
+     * closed. The readahead effectiveness is recorded in the FileStats.
+     *
+     * @param fileStats the FHStats of the file (couchstore_get_db_filestats)
+     * @param window the number of bytes to keep reading ahead
+     */
+    static couchstore_error_t setSequentialReadahead(
+            couchstore_error_info_t* errinfo,
+            FHStats* fileStats,
+            cs_off_t window);
+
 protected:
     FileStats& stats;
     FileOpsInterface& wrapped_ops;
@@ -89,5 +115,14 @@ protected:
         size_t read_count_since_open;
         /// Number of write() calls against this file since it was last opened.
         size_t write_count_since_open;
+
+        /// Bytes to read ahead of each read; 0 if readahead isn't enabled.
+        cs_off_t readahead_window;
+        /// The range of the file last advised to be read ahead.
+        cs_off_t readahead_start;
+        cs_off_t readahead_end;
     };
+
+    /// Advise the OS to read ahead of a read of a file (as needed).
+    void readAhead(StatFile& sf, cs_off_t offset, size_t nbytes);
 };
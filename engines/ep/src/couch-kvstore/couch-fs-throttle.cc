@@ -0,0 +1,85 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "couch-kvstore/couch-fs-throttle.h"
+
+couch_file_handle ThrottledOps::constructor(couchstore_error_info_t* errinfo) {
+    return wrapped_ops.constructor(errinfo);
+}
+
+couchstore_error_t ThrottledOps::open(couchstore_error_info_t* errinfo,
+                                      couch_file_handle* h,
+                                      const char* path,
+                                      int flags) {
+    return wrapped_ops.open(errinfo, h, path, flags);
+}
+
+couchstore_error_t ThrottledOps::close(couchstore_error_info_t* errinfo,
+                                       couch_file_handle h) {
+    return wrapped_ops.close(errinfo, h);
+}
+
+couchstore_error_t ThrottledOps::set_periodic_sync(couch_file_handle h,
+                                                   uint64_t period_bytes) {
+    return wrapped_ops.set_periodic_sync(h, period_bytes);
+}
+
+ssize_t ThrottledOps::pread(couchstore_error_info_t* errinfo,
+                            couch_file_handle h,
+                            void* buf,
+                            size_t sz,
+                            cs_off_t off) {
+    return wrapped_ops.pread(errinfo, h, buf, sz, off);
+}
+
+ssize_t ThrottledOps::pwrite(couchstore_error_info_t* errinfo,
+                             couch_file_handle h,
+                             const void* buf,
+                             size_t sz,
+                             cs_off_t off) {
+    size_t bytes = sz;
+    writeCallback.callback(bytes);
+    return wrapped_ops.pwrite(errinfo, h, buf, sz, off);
+}
+
+cs_off_t ThrottledOps::goto_eof(couchstore_error_info_t* errinfo,
+                                couch_file_handle h) {
+    return wrapped_ops.goto_eof(errinfo, h);
+}
+
+couchstore_error_t ThrottledOps::sync(couchstore_error_info_t* errinfo,
+                                      couch_file_handle h) {
+    return wrapped_ops.sync(errinfo, h);
+}
+
+couchstore_error_t ThrottledOps::advise(couchstore_error_info_t* errinfo,
+                                        couch_file_handle h,
+                                        cs_off_t offs,
+                                        cs_off_t len,
+                                        couchstore_file_advice_t adv) {
+    return wrapped_ops.advise(errinfo, h, offs, len, adv);
+}
+
+FileOpsInterface::FHStats* ThrottledOps::get_stats(couch_file_handle h) {
+    return wrapped_ops.get_stats(h);
+}
+
+void ThrottledOps::destructor(couch_file_handle h) {
+    wrapped_ops.destructor(h);
+}
@@ -187,12 +187,57 @@ static_assert(sizeof(MetaDataV1) == 2,
 static_assert(sizeof(MetaDataV2) == 1,
               "MetaDataV2 is not the expected size.");
 
+    class MetaDataV3 {
+    public:
+        MetaDataV3() : dictionaryId(0) {
+        }
+
+        void initialise(const char* raw) {
+            std::memcpy(&dictionaryId, raw, sizeof(dictionaryId));
+            dictionaryId = ntohl(dictionaryId);
+        }
+
+        /*
+         * When V3 is persisted, the dictionaryId is in network byte order.
+         */
+        void prepareForPersistence() {
+            dictionaryId = htonl(dictionaryId);
+        }
+
+        uint32_t getDictionaryId() const {
+            return dictionaryId;
+        }
+
+        void setDictionaryId(uint32_t id) {
+            dictionaryId = id;
+        }
+
+        void copyToBuf(char* raw) const {
+            const uint32_t idNBO = htonl(dictionaryId);
+            std::memcpy(raw, &idNBO, sizeof(idNBO));
+        }
+
+    private:
+        /*
+         * V3 is a 4 byte extension storing the identifier of the
+         * ValueDictionary the value is encoded with. It follows a (zero) V2
+         * byte, so that the V0..V3 holders are persisted as is.
+         */
+#pragma pack(1)
+        uint32_t dictionaryId;
+#pragma pack()
+    };
+
+static_assert(sizeof(MetaDataV3) == 4,
+              "MetaDataV3 is not the expected size.");
+
 public:
 
     enum class Version {
         V0, // Cas/Exptime/Flags
         V1, // Flex code and datatype
-        V2  // Conflict Resolution Mode - not stored, but can be read
+        V2, // Conflict Resolution Mode - not stored, but can be read
+        V3  // Value dictionary identifier (after a zero V2)
         /*
          * !!MetaData Warning!!
          * Sherlock began storing the V2 MetaData.
@@ -212,10 +257,11 @@ public:
     MetaData(const sized_buf& in)
         : initVersion(Version::V0) {
 
-        // Expect metadata to be V0, V1 or V2.
+        // Expect metadata to be V0, V1, V2 or V3.
         // V2 part is ignored, but valid to find in storage.
-        if (in.size < getMetaDataSize(Version::V0)
-            || in.size > getMetaDataSize(Version::V2)) {
+        if ((in.size < getMetaDataSize(Version::V0) ||
+             in.size > getMetaDataSize(Version::V2)) &&
+            in.size != getMetaDataSize(Version::V3)) {
             throw std::invalid_argument("MetaData::MetaData in.size \"" +
                                         std::to_string(in.size) +
                                         "\" is out of range.");
@@ -233,6 +279,11 @@ public:
         }
 
         // Not initialising V2 from 'in' as V2 is ignored.
+
+        if (in.size == getMetaDataSize(Version::V3)) {
+            allMeta.v3.initialise(in.buf + getMetaDataSize(Version::V2));
+            initVersion = Version::V3;
+        }
     }
 
     /*
@@ -240,7 +291,8 @@ public:
      * to a pre-allocated sized_buf ready for passing to couchstore.
      */
     void copyToBuf(sized_buf& out) const {
-        if (out.size != getMetaDataSize(Version::V1)) {
+        if (out.size != getMetaDataSize(Version::V1) &&
+            out.size != getMetaDataSize(Version::V3)) {
             throw std::invalid_argument("MetaData::copyToBuf out.size \"" +
                                         std::to_string(out.size) +
                                         "\" incorrect size.");
@@ -248,6 +300,10 @@ public:
         // Copy the V0/V1 meta data holders to the output buffer
         allMeta.v0.copyToBuf(out.buf);
         allMeta.v1.copyToBuf(out.buf + sizeof(MetaDataV0));
+        if (out.size == getMetaDataSize(Version::V3)) {
+            out.buf[getMetaDataSize(Version::V1)] = 0; // V2 (ignored)
+            allMeta.v3.copyToBuf(out.buf + getMetaDataSize(Version::V2));
+        }
     }
 
     /*
@@ -257,6 +313,7 @@ public:
      */
     char* prepareAndGetForPersistence() {
         allMeta.v0.prepareForPersistence();
+        allMeta.v3.prepareForPersistence();
         return reinterpret_cast<char*>(&allMeta);
     }
 
@@ -308,6 +365,18 @@ public:
         return allMeta.v1.getDataType();
     }
 
+    /*
+     * The identifier of the ValueDictionary the value is encoded with, or 0
+     * if it isn't (only persisted with the V3 metadata).
+     */
+    void setDictionaryId(uint32_t id) {
+        allMeta.v3.setDictionaryId(id);
+    }
+
+    uint32_t getDictionaryId() const {
+        return allMeta.v3.getDictionaryId();
+    }
+
     Version getVersionInitialisedFrom() const {
         return initVersion;
     }
@@ -323,6 +392,11 @@ public:
                 return sizeof(MetaDataV0) +
                        sizeof(MetaDataV1) +
                        sizeof(MetaDataV2);
+            case Version::V3:
+                return sizeof(MetaDataV0) +
+                       sizeof(MetaDataV1) +
+                       sizeof(MetaDataV2) +
+                       sizeof(MetaDataV3);
         }
 
         return sizeof(MetaDataV0) + sizeof(MetaDataV1) + sizeof(MetaDataV2);
@@ -335,6 +409,7 @@ protected:
         MetaDataV0 v0;
         MetaDataV1 v1;
         MetaDataV2 v2;
+        MetaDataV3 v3;
 #pragma pack()
     } allMeta;
     Version initVersion;
@@ -55,10 +55,42 @@
 #include <kvstore.h>
 #include <platform/compress.h>
 
+/// The local document holding the ValueDictionary of a vbucket file
+static const char valueDictionaryDocId[] = "_local/vdict";
+
+/// The context of the couchstore_changes_since callback of a scan
+struct DbDumpContext {
+    CouchKVStore& store;
+    ScanContext* scanContext;
+};
+
 extern "C" {
     static int recordDbDumpC(Db *db, DocInfo *docinfo, void *ctx)
     {
-        return CouchKVStore::recordDbDump(db, docinfo, ctx);
+        auto* dumpCtx = static_cast<DbDumpContext*>(ctx);
+        return dumpCtx->store.recordDbDump(db, docinfo, dumpCtx->scanContext);
+    }
+
+    static int recordDbDumpByKeyC(Db *db, DocInfo *docinfo, void *ctx)
+    {
+        auto* dumpCtx = static_cast<DbDumpContext*>(ctx);
+        auto* sctx = dumpCtx->scanContext;
+        // The by-id tree has every seqno, and the scan resumes with the key
+        // the previous run handed last
+        if (docinfo->db_seq < sctx->startSeqno ||
+            docinfo->db_seq > sctx->maxSeqno ||
+            (!sctx->lastReadKey.empty() &&
+             sctx->lastReadKey.compare(0,
+                                       std::string::npos,
+                                       docinfo->id.buf,
+                                       docinfo->id.size) == 0)) {
+            return COUCHSTORE_SUCCESS;
+        }
+        int ret = dumpCtx->store.recordDbDump(db, docinfo, sctx);
+        if (ret == COUCHSTORE_SUCCESS) {
+            sctx->lastReadKey.assign(docinfo->id.buf, docinfo->id.size);
+        }
+        return ret;
     }
 }
 
@@ -160,6 +192,29 @@ static DocKey makeDocKey(const sized_buf buf, bool restoreNamespace) {
     }
 }
 
+/**
+ * A copy of the DocInfo of a bgfetch whose body is read after the lookup of
+ * all of the keys of the batch.
+ */
+struct DeferredDocInfo {
+    DeferredDocInfo(const DocInfo& docinfo, vb_bgfetch_item_ctx_t& ctx)
+        : info(docinfo),
+          id(docinfo.id.buf, docinfo.id.size),
+          revMeta(docinfo.rev_meta.buf, docinfo.rev_meta.size),
+          fetch(ctx) {
+        info.id = {const_cast<char*>(id.data()), id.size()};
+        info.rev_meta = {const_cast<char*>(revMeta.data()), revMeta.size()};
+    }
+
+    DocInfo info;
+    std::string id;
+    std::string revMeta;
+    vb_bgfetch_item_ctx_t& fetch;
+};
+
+// The size of the couchstore file blocks, each of which starts with a prefix
+static const size_t couchBlockSize = 4096;
+
 struct GetMultiCbCtx {
     GetMultiCbCtx(CouchKVStore &c, uint16_t v, vb_bgfetch_queue_t &f) :
         cks(c), vbId(v), fetches(f) {}
@@ -167,6 +222,10 @@ struct GetMultiCbCtx {
     CouchKVStore &cks;
     uint16_t vbId;
     vb_bgfetch_queue_t &fetches;
+
+    /// If set, the fetches which need a body are deferred (to be read ahead)
+    bool deferBodies = false;
+    std::vector<std::unique_ptr<DeferredDocInfo>> deferred;
 };
 
 struct StatResponseCtx {
@@ -219,11 +278,14 @@ couchstore_content_meta_flags CouchRequest::getContentMeta(const Item& it) {
     return rval;
 }
 
+const size_t CouchRequest::minDictionaryValue;
+
 CouchRequest::CouchRequest(const Item& it,
                            uint64_t rev,
                            MutationRequestCallback& cb,
                            bool del,
-                           bool persistDocNamespace)
+                           bool persistDocNamespace,
+                           const ValueDictionary* dictionary)
     : IORequest(it.getVBucketId(), cb, del, it.getKey()),
       value(it.getValue()),
       fileRevNum(rev) {
@@ -243,6 +305,22 @@ CouchRequest::CouchRequest(const Item& it,
         dbDoc.data.buf = NULL;
         dbDoc.data.size = 0;
     }
+
+    // The documents with xattrs aren't encoded, so that compaction (which
+    // parses them) doesn't need the dictionary
+    if (dictionary && !del && it.getNBytes() >= minDictionaryValue &&
+        mcbp::datatype::is_json(it.getDataType()) &&
+        !mcbp::datatype::is_xattr(it.getDataType())) {
+        if (dictionary->encode({value->getData(), it.getNBytes()},
+                               encodedValue)) {
+            dbDoc.data.buf = const_cast<char*>(encodedValue.data());
+            dbDoc.data.size = encodedValue.size();
+            meta.setDictionaryId(dictionary->getId());
+        } else {
+            encodedValue.clear();
+        }
+    }
+
     meta.setCas(it.getCas());
     meta.setFlags(it.getFlags());
     if (del) {
@@ -256,7 +334,9 @@ CouchRequest::CouchRequest(const Item& it,
     dbDocInfo.db_seq = it.getBySeqno();
 
     // Now allocate space to hold the meta and get it ready for storage
-    dbDocInfo.rev_meta.size = MetaData::getMetaDataSize(MetaData::Version::V1);
+    dbDocInfo.rev_meta.size = MetaData::getMetaDataSize(
+            isDictionaryEncoded() ? MetaData::Version::V3
+                                  : MetaData::Version::V1);
     dbDocInfo.rev_meta.buf = meta.prepareAndGetForPersistence();
 
     dbDocInfo.rev_seq = it.getRevSeqno();
@@ -268,7 +348,9 @@ CouchRequest::CouchRequest(const Item& it,
         dbDocInfo.deleted = 0;
     }
     dbDocInfo.id = dbDoc.id;
-    dbDocInfo.content_meta = getContentMeta(it);
+    // An encoded value doesn't compress any further
+    dbDocInfo.content_meta = isDictionaryEncoded() ? COUCH_DOC_NON_JSON_MODE
+                                                   : getContentMeta(it);
 }
 
 CouchKVStore::CouchKVStore(KVStoreConfig& config)
@@ -279,7 +361,8 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config,
                            FileOpsInterface& ops,
                            bool readOnly,
                            std::vector<std::atomic<uint64_t>>& dbFileRevMap,
-                           size_t fileRevMapSize)
+                           size_t fileRevMapSize,
+                           std::shared_ptr<CouchBlockCache> cache)
     : KVStore(config, readOnly),
       dbname(config.getDBName()),
       dbFileRevMap(dbFileRevMap),
@@ -287,11 +370,25 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config,
       intransaction(false),
       scanCounter(0),
       logger(config.getLogger()),
-      base_ops(ops) {
+      base_ops(ops),
+      blockCache(std::move(cache)),
+      dictionaryIdGenerator(true) {
     createDataDir(dbname);
     statCollectingFileOps = getCouchstoreStatsOps(st.fsStats, base_ops);
     statCollectingFileOpsCompaction = getCouchstoreStatsOps(
         st.fsStatsCompaction, base_ops);
+    if (configuration.isDirectIO() || blockCache) {
+        // Above the stats ops, so that they count the reads from disk
+        directFileOps = std::make_unique<DirectOps>(
+                *statCollectingFileOps, configuration.isDirectIO(), blockCache);
+    }
+    if (configuration.getWriteBufferSize() != 0) {
+        // Above the direct ops, so that the reads see what is buffered and
+        // the stats count the coalesced writes
+        bufferedFileOps = std::make_unique<BufferedWriteOps>(
+                directFileOps ? *directFileOps : *statCollectingFileOps,
+                configuration.getWriteBufferSize());
+    }
 
     // init db file map with default revision number, 1
     numDbFiles = configuration.getMaxVBuckets();
@@ -303,6 +400,7 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config,
     cachedFileSize.assign(numDbFiles, Couchbase::RelaxedAtomic<uint64_t>(0));
     cachedSpaceUsed.assign(numDbFiles, Couchbase::RelaxedAtomic<uint64_t>(0));
     cachedVBStates.resize(numDbFiles);
+    valueDictionaries.resize(numDbFiles);
 
     initialize();
 }
@@ -312,7 +410,11 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config, FileOpsInterface& ops)
                    ops,
                    false /*readonly*/,
                    fileRevMap,
-                   config.getMaxVBuckets()) {
+                   config.getMaxVBuckets(),
+                   config.getBlockCacheSize() > 0
+                           ? std::make_shared<CouchBlockCache>(
+                                     config.getBlockCacheSize())
+                           : nullptr) {
 }
 
 /**
@@ -321,16 +423,18 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config, FileOpsInterface& ops)
 std::unique_ptr<CouchKVStore> CouchKVStore::makeReadOnlyStore() {
     // Not using make_unique due to the private constructor we're calling
     return std::unique_ptr<CouchKVStore>(
-            new CouchKVStore(configuration, fileRevMap));
+            new CouchKVStore(configuration, fileRevMap, blockCache));
 }
 
 CouchKVStore::CouchKVStore(KVStoreConfig& config,
-                           std::vector<std::atomic<uint64_t>>& dbFileRevMap)
+                           std::vector<std::atomic<uint64_t>>& dbFileRevMap,
+                           std::shared_ptr<CouchBlockCache> cache)
     : CouchKVStore(config,
                    *couchstore_get_default_file_ops(),
                    true /*readonly*/,
                    dbFileRevMap,
-                   0) {
+                   0,
+                   std::move(cache)) {
 }
 
 void CouchKVStore::initialize() {
@@ -393,6 +497,7 @@ void CouchKVStore::reset(uint16_t vbucketId) {
         // KVBucket::vb_mutexes is used in this case.
         unlinkCouchFile(vbucketId, dbFileRevMap[vbucketId]);
         incrementRevision(vbucketId);
+        resetValueDictionary(vbucketId);
 
         setVBucketState(
                 vbucketId, *state, VBStatePersist::VBSTATE_PERSIST_WITH_COMMIT);
@@ -418,12 +523,19 @@ void CouchKVStore::set(const Item &itm, Callback<mutation_result> &cb) {
 
     // each req will be de-allocated after commit
     requestcb.setCb = &cb;
+    auto dictionary = getWriteDictionary(itm, fileRev);
     CouchRequest* req =
             new CouchRequest(itm,
                              fileRev,
                              requestcb,
                              deleteItem,
-                             configuration.shouldPersistDocNamespace());
+                             configuration.shouldPersistDocNamespace(),
+                             dictionary.get());
+    if (req->isDictionaryEncoded()) {
+        ++st.io_dictionary_encoded_docs;
+        st.io_dictionary_saved_bytes +=
+                itm.getNBytes() - req->getDbDocInfo()->size;
+    }
     pendingReqsQ.push_back(req);
 }
 
@@ -541,9 +653,13 @@ void CouchKVStore::getMulti(uint16_t vb, vb_bgfetch_queue_t &itms) {
     }
 
     GetMultiCbCtx ctx(*this, vb, itms);
+    ctx.deferBodies = configuration.isBgFetchReadahead() && itms.size() > 1;
 
     errCode = couchstore_docinfos_by_id(db, ids.data(), itms.size(),
                                         0, getMultiCbC, &ctx);
+    if (!ctx.deferred.empty()) {
+        readDeferredDocs(db, ctx);
+    }
     if (errCode != COUCHSTORE_SUCCESS) {
         st.numGetFailure += numItems;
         logger.log(EXTENSION_LOG_WARNING, "CouchKVStore::getMulti: "
@@ -903,6 +1019,14 @@ bool CouchKVStore::compactDBInternal(compaction_ctx* hook_ctx,
     uint64_t                   new_rev = fileRev + 1;
     hook_ctx->config = &configuration;
 
+    // Let the caller pace the writes of the compaction
+    std::unique_ptr<ThrottledOps> throttledOps;
+    if (hook_ctx->writeCallback) {
+        throttledOps = std::make_unique<ThrottledOps>(
+                *def_iops, *hook_ctx->writeCallback);
+        def_iops = throttledOps.get();
+    }
+
     TRACE_EVENT1("CouchKVStore", "compactDB", "vbid", vbid);
 
     // Open the source VBucket database file ...
@@ -1136,7 +1260,10 @@ StorageProperties CouchKVStore::getStorageProperties() {
                          StorageProperties::EfficientVBDeletion::Yes,
                          StorageProperties::PersistedDeletion::Yes,
                          StorageProperties::EfficientGet::Yes,
-                         StorageProperties::ConcurrentWriteCompact::No);
+                         StorageProperties::ConcurrentWriteCompact::No,
+                         // Each vbucket is a couchstore file of its own,
+                         // committed (and fsync'd) on its own
+                         StorageProperties::GroupCommit::No);
     return rv;
 }
 
@@ -1173,6 +1300,12 @@ bool CouchKVStore::getStat(const char* name, size_t& value)  {
     } else if (strcmp("io_bg_fetch_read_count", name) == 0) {
         value = st.getMultiFsReadCount;
         return true;
+    } else if (blockCache && strcmp("Block_cache_hits", name) == 0) {
+        value = blockCache->hits;
+        return true;
+    } else if (blockCache && strcmp("Block_cache_misses", name) == 0) {
+        value = blockCache->misses;
+        return true;
     }
 
     return false;
@@ -1255,6 +1388,23 @@ ScanContext* CouchKVStore::initScanContext(std::shared_ptr<Callback<GetValue> >
         return NULL;
     }
 
+    // The documents of a vbucket are mostly laid out in the file in seqno
+    // order, so a scan by seqno reads the file (roughly) sequentially.
+    const auto readahead = configuration.getBackfillReadahead();
+    auto* fileStats = couchstore_get_db_filestats(db);
+    if (readahead > 0 && fileStats != nullptr) {
+        couchstore_error_info_t errinfo;
+        errorCode = StatsOps::setSequentialReadahead(
+                &errinfo, fileStats, cs_off_t(readahead));
+        if (errorCode != COUCHSTORE_SUCCESS) {
+            logger.log(EXTENSION_LOG_INFO,
+                       "CouchKVStore::initScanContext: Failed to enable "
+                       "readahead, vb:%" PRIu16 " error:%s",
+                       vbid,
+                       couchstore_strerror(errorCode));
+        }
+    }
+
     size_t scanId = scanCounter++;
 
     {
@@ -1294,7 +1444,9 @@ scan_error_t CouchKVStore::scan(ScanContext* ctx) {
         return scan_failed;
     }
 
-    if (ctx->lastReadSeqno == ctx->maxSeqno) {
+    // A scan by key reads the seqnos in any order, and is only called
+    // again if it didn't finish
+    if (!ctx->byKey && ctx->lastReadSeqno == ctx->maxSeqno) {
         return scan_success;
     }
 
@@ -1321,12 +1473,24 @@ scan_error_t CouchKVStore::scan(ScanContext* ctx) {
         start = ctx->lastReadSeqno + 1;
     }
 
+    DbDumpContext dumpCtx{*this, ctx};
     couchstore_error_t errorCode;
-    errorCode = couchstore_changes_since(db,
-                                         start,
-                                         getDocFilter(ctx->docFilter),
-                                         recordDbDumpC,
-                                         static_cast<void*>(ctx));
+    if (ctx->byKey) {
+        const std::string& from =
+                ctx->lastReadKey.empty() ? ctx->startKey : ctx->lastReadKey;
+        sized_buf startKey{const_cast<char*>(from.data()), from.size()};
+        errorCode = couchstore_all_docs(db,
+                                        startKey.size ? &startKey : nullptr,
+                                        getDocFilter(ctx->docFilter),
+                                        recordDbDumpByKeyC,
+                                        static_cast<void*>(&dumpCtx));
+    } else {
+        errorCode = couchstore_changes_since(db,
+                                             start,
+                                             getDocFilter(ctx->docFilter),
+                                             recordDbDumpC,
+                                             static_cast<void*>(&dumpCtx));
+    }
 
     TRACE_EVENT_END1(
             "CouchKVStore", "scan", "lastReadSeqno", ctx->lastReadSeqno);
@@ -1336,8 +1500,10 @@ scan_error_t CouchKVStore::scan(ScanContext* ctx) {
             return scan_again;
         } else {
             logger.log(EXTENSION_LOG_WARNING,
-                       "CouchKVStore::scan couchstore_changes_since "
-                       "error:%s [%s]", couchstore_strerror(errorCode),
+                       "CouchKVStore::scan couchstore_%s "
+                       "error:%s [%s]",
+                       ctx->byKey ? "all_docs" : "changes_since",
+                       couchstore_strerror(errorCode),
                        couchkvstore_strerrno(db, errorCode).c_str());
             remVBucketFromDbFileMap(ctx->vbid);
             return scan_failed;
@@ -1452,7 +1618,13 @@ couchstore_error_t CouchKVStore::openDB(uint16_t vbucketId,
     std::string dbFileName = getDBFileName(dbname, vbucketId, fileRev);
 
     if(ops == nullptr) {
-        ops = statCollectingFileOps.get();
+        if (bufferedFileOps) {
+            ops = bufferedFileOps.get();
+        } else if (directFileOps) {
+            ops = directFileOps.get();
+        } else {
+            ops = statCollectingFileOps.get();
+        }
     }
 
     couchstore_error_t errorCode = COUCHSTORE_SUCCESS;
@@ -1591,6 +1763,7 @@ couchstore_error_t CouchKVStore::fetchDoc(Db* db,
         Doc *doc = nullptr;
         size_t valuelen = 0;
         void* valuePtr = nullptr;
+        std::string decoded;
         protocol_binary_datatype_t datatype = PROTOCOL_BINARY_RAW_BYTES;
         errCode = couchstore_open_doc_with_docinfo(db, docinfo, &doc,
                                                    DECOMPRESS_DOC_BODIES);
@@ -1609,6 +1782,19 @@ couchstore_error_t CouchKVStore::fetchDoc(Db* db,
             valuelen = doc->data.size;
             valuePtr = doc->data.buf;
 
+            if (valuelen && metadata->getDictionaryId() != 0) {
+                if (!decodeValue(*db,
+                                 vbId,
+                                 metadata->getDictionaryId(),
+                                 doc->data,
+                                 decoded)) {
+                    couchstore_free_document(doc);
+                    return COUCHSTORE_ERROR_CORRUPT;
+                }
+                valuelen = decoded.size();
+                valuePtr = const_cast<char*>(decoded.data());
+            }
+
             if (metadata->getVersionInitialisedFrom() == MetaData::Version::V0) {
                 // This is a super old version of a couchstore file.
                 // Try to determine if the document is JSON or raw bytes
@@ -1656,14 +1842,13 @@ couchstore_error_t CouchKVStore::fetchDoc(Db* db,
     return COUCHSTORE_SUCCESS;
 }
 
-int CouchKVStore::recordDbDump(Db *db, DocInfo *docinfo, void *ctx) {
-
-    ScanContext* sctx = static_cast<ScanContext*>(ctx);
+int CouchKVStore::recordDbDump(Db* db, DocInfo* docinfo, ScanContext* sctx) {
     std::shared_ptr<Callback<GetValue> > cb = sctx->callback;
     std::shared_ptr<Callback<CacheLookup> > cl = sctx->lookup;
 
     Doc *doc = nullptr;
     sized_buf value{nullptr, 0};
+    std::string decoded;
     uint64_t byseqno = docinfo->db_seq;
     uint16_t vbucketId = sctx->vbid;
 
@@ -1677,6 +1862,11 @@ int CouchKVStore::recordDbDump(Db *db, DocInfo *docinfo, void *ctx) {
     // Collections: TODO: Permanently restore to stored namespace
     DocKey docKey = makeDocKey(
             docinfo->id, sctx->config.shouldPersistDocNamespace());
+    if (sctx->keyFilter && !sctx->keyFilter(docKey)) {
+        sctx->lastReadSeqno = byseqno;
+        return COUCHSTORE_SUCCESS;
+    }
+
     CacheLookup lookup(docKey, byseqno, vbucketId);
     cl->callback(lookup);
     if (cl->getStatus() == ENGINE_KEY_EEXISTS) {
@@ -1706,7 +1896,24 @@ int CouchKVStore::recordDbDump(Db *db, DocInfo *docinfo, void *ctx) {
 
         if (errCode == COUCHSTORE_SUCCESS) {
             value = doc->data;
-            if (doc->data.size) {
+            if (doc->data.size && metadata->getDictionaryId() != 0) {
+                // Stored uncompressed; the value returned is decoded
+                if (!decodeValue(*db,
+                                 vbucketId,
+                                 metadata->getDictionaryId(),
+                                 doc->data,
+                                 decoded)) {
+                    sctx->logger->log(EXTENSION_LOG_WARNING,
+                                      "CouchKVStore::recordDbDump: "
+                                      "failed to decode the value, "
+                                      "vb:%" PRIu16 ", seqno:%" PRIu64,
+                                      vbucketId,
+                                      docinfo->db_seq);
+                    couchstore_free_document(doc);
+                    return COUCHSTORE_SUCCESS;
+                }
+                value = {const_cast<char*>(decoded.data()), decoded.size()};
+            } else if (doc->data.size) {
                 if ((openOptions & DECOMPRESS_DOC_BODIES) == 0) {
                     // We always store the document bodies compressed on disk,
                     // but now the client _wanted_ to fetch the document
@@ -1954,6 +2161,22 @@ couchstore_error_t CouchKVStore::saveDocs(uint16_t vbid,
             saveCollectionsManifest(*db.getDb(), *collectionsManifest);
         }
 
+        // A newly trained dictionary is committed with the first documents
+        // encoded with it
+        std::shared_ptr<const ValueDictionary> unsavedDictionary;
+        {
+            std::lock_guard<std::mutex> lh(valueDictionaryMutex);
+            if (valueDictionaries[vbid].unsaved) {
+                unsavedDictionary = valueDictionaries[vbid].dictionary;
+            }
+        }
+        if (unsavedDictionary) {
+            errCode = saveValueDictionary(*db.getDb(), *unsavedDictionary);
+            if (errCode != COUCHSTORE_SUCCESS) {
+                return errCode;
+            }
+        }
+
         hrtime_t cs_begin = gethrtime();
         errCode = couchstore_commit(db.getDb());
         st.commitHisto.add((gethrtime() - cs_begin) / 1000);
@@ -1966,6 +2189,14 @@ couchstore_error_t CouchKVStore::saveDocs(uint16_t vbid,
             return errCode;
         }
 
+        if (unsavedDictionary) {
+            std::lock_guard<std::mutex> lh(valueDictionaryMutex);
+            auto& entry = valueDictionaries[vbid];
+            if (entry.dictionary == unsavedDictionary) {
+                entry.unsaved = false;
+            }
+        }
+
         st.batchSize.add(docs.size());
 
         // retrieve storage system stats for file fragmentation computation
@@ -2072,6 +2303,10 @@ ENGINE_ERROR_CODE CouchKVStore::readVBState(Db *db, uint16_t vbId) {
     if (errCode == COUCHSTORE_SUCCESS) {
         highSeqno = info.last_sequence;
         purgeSeqno = info.purge_seq;
+        cachedDocCount[vbId] = info.doc_count;
+        cachedDeleteCount[vbId] = info.deleted_count;
+        cachedFileSize[vbId] = info.file_size;
+        cachedSpaceUsed[vbId] = info.space_used;
     } else {
         logger.log(EXTENSION_LOG_WARNING,
                    "CouchKVStore::readVBState: couchstore_db_info error:%s"
@@ -2291,6 +2526,174 @@ std::string CouchKVStore::readCollectionsManifest(Db& db) {
     return {lDoc.getLocalDoc()->json.buf, lDoc.getLocalDoc()->json.size};
 }
 
+std::shared_ptr<const ValueDictionary> CouchKVStore::getWriteDictionary(
+        const Item& itm, uint64_t fileRev) {
+    if (!configuration.isValueDictionary() ||
+        itm.getNBytes() < CouchRequest::minDictionaryValue ||
+        !mcbp::datatype::is_json(itm.getDataType()) ||
+        mcbp::datatype::is_xattr(itm.getDataType())) {
+        return nullptr;
+    }
+
+    const uint16_t vbid = itm.getVBucketId();
+    bool checked;
+    {
+        std::lock_guard<std::mutex> lh(valueDictionaryMutex);
+        auto& entry = valueDictionaries[vbid];
+        checked = entry.checked;
+        if (checked) {
+            if (entry.dictionary || entry.untrainable) {
+                return entry.dictionary;
+            }
+            entry.samples.emplace_back(itm.getData(), itm.getNBytes());
+            if (entry.samples.size() < ValueDictionary::trainingSamples) {
+                return nullptr;
+            }
+
+            auto data = ValueDictionary::train(entry.samples);
+            std::vector<std::string>().swap(entry.samples);
+            if (data.empty()) {
+                entry.untrainable = true;
+                return nullptr;
+            }
+            uint32_t id;
+            do {
+                id = uint32_t(dictionaryIdGenerator.next());
+            } while (id == 0);
+            entry.dictionary = std::make_shared<const ValueDictionary>(
+                    id, std::move(data));
+            entry.unsaved = true;
+            return entry.dictionary;
+        }
+    }
+
+    // The first write to the vbucket since the store was created: keep using
+    // the dictionary its file has, if any (read outside of the lock)
+    std::shared_ptr<const ValueDictionary> dictionary;
+    if (access(getDBFileName(dbname, vbid, fileRev).c_str(), F_OK) == 0) {
+        DbHolder db(this);
+        if (openDB(vbid,
+                   fileRev,
+                   db.getDbAddress(),
+                   COUCHSTORE_OPEN_FLAG_RDONLY) == COUCHSTORE_SUCCESS) {
+            dictionary = readValueDictionary(*db.getDb());
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lh(valueDictionaryMutex);
+        auto& entry = valueDictionaries[vbid];
+        if (!entry.checked) {
+            entry.checked = true;
+            entry.dictionary = dictionary;
+        }
+    }
+    return getWriteDictionary(itm, fileRev);
+}
+
+void CouchKVStore::resetValueDictionary(uint16_t vbid) {
+    std::lock_guard<std::mutex> lh(valueDictionaryMutex);
+    valueDictionaries[vbid] = VBucketValueDictionary();
+}
+
+couchstore_error_t CouchKVStore::saveValueDictionary(
+        Db& db, const ValueDictionary& dictionary) {
+    LocalDoc lDoc;
+    lDoc.id.buf = const_cast<char*>(valueDictionaryDocId);
+    lDoc.id.size = sizeof(valueDictionaryDocId) - 1;
+
+    const uint32_t idNBO = htonl(dictionary.getId());
+    std::string content(reinterpret_cast<const char*>(&idNBO), sizeof(idNBO));
+    content.append(dictionary.getData());
+
+    lDoc.json.buf = const_cast<char*>(content.data());
+    lDoc.json.size = content.size();
+    lDoc.deleted = 0;
+
+    couchstore_error_t errCode = couchstore_save_local_document(&db, &lDoc);
+    if (errCode != COUCHSTORE_SUCCESS) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::saveValueDictionary "
+                   "couchstore_save_local_document "
+                   "error:%s [%s]",
+                   couchstore_strerror(errCode),
+                   couchkvstore_strerrno(&db, errCode).c_str());
+    }
+    return errCode;
+}
+
+std::shared_ptr<const ValueDictionary> CouchKVStore::readValueDictionary(
+        Db& db) {
+    LocalDocHolder lDoc;
+    auto errCode = couchstore_open_local_document(&db,
+                                                  valueDictionaryDocId,
+                                                  sizeof(valueDictionaryDocId) -
+                                                          1,
+                                                  lDoc.getLocalDocAddress());
+    if (errCode != COUCHSTORE_SUCCESS) {
+        if (errCode != COUCHSTORE_ERROR_DOC_NOT_FOUND) {
+            logger.log(EXTENSION_LOG_WARNING,
+                       "CouchKVStore::readValueDictionary: "
+                       "couchstore_open_local_document error:%s",
+                       couchstore_strerror(errCode));
+        }
+        return nullptr;
+    }
+
+    const sized_buf& content = lDoc.getLocalDoc()->json;
+    uint32_t id = 0;
+    if (content.size >= sizeof(id)) {
+        std::memcpy(&id, content.buf, sizeof(id));
+        id = ntohl(id);
+    }
+    if (id == 0 || content.size - sizeof(id) > ValueDictionary::maxSize) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::readValueDictionary: invalid dictionary "
+                   "of size %" PRIu64,
+                   uint64_t(content.size));
+        return nullptr;
+    }
+    return std::make_shared<const ValueDictionary>(
+            id,
+            std::string(content.buf + sizeof(id), content.size - sizeof(id)));
+}
+
+bool CouchKVStore::decodeValue(Db& db,
+                               uint16_t vbid,
+                               uint32_t dictionaryId,
+                               sized_buf encoded,
+                               std::string& value) {
+    std::shared_ptr<const ValueDictionary> dictionary;
+    {
+        std::lock_guard<std::mutex> lh(valueDictionaryMutex);
+        auto& entry = valueDictionaries[vbid];
+        if (entry.dictionary && entry.dictionary->getId() == dictionaryId) {
+            dictionary = entry.dictionary;
+        }
+    }
+
+    if (!dictionary) {
+        dictionary = readValueDictionary(db);
+        if (!dictionary || dictionary->getId() != dictionaryId) {
+            logger.log(EXTENSION_LOG_WARNING,
+                       "CouchKVStore::decodeValue: no dictionary %" PRIu32
+                       " for vb:%" PRIu16,
+                       dictionaryId,
+                       vbid);
+            return false;
+        }
+        std::lock_guard<std::mutex> lh(valueDictionaryMutex);
+        auto& entry = valueDictionaries[vbid];
+        if (!entry.dictionary) {
+            // It is the dictionary of the file, as saved
+            entry.dictionary = dictionary;
+            entry.checked = true;
+            std::vector<std::string>().swap(entry.samples);
+        }
+    }
+
+    return dictionary->decode({encoded.buf, encoded.size}, value);
+}
+
 int CouchKVStore::getMultiCb(Db *db, DocInfo *docinfo, void *ctx) {
     if (docinfo == nullptr) {
         throw std::invalid_argument("CouchKVStore::getMultiCb: docinfo "
@@ -2320,18 +2723,66 @@ int CouchKVStore::getMultiCb(Db *db, DocInfo *docinfo, void *ctx) {
     }
 
     vb_bgfetch_item_ctx_t& bg_itm_ctx = (*qitr).second;
+    if (cbCtx->deferBodies && bg_itm_ctx.isMetaOnly == GetMetaOnly::No &&
+        docinfo->size > 0) {
+        cbCtx->deferred.push_back(
+                std::make_unique<DeferredDocInfo>(*docinfo, bg_itm_ctx));
+        return 0;
+    }
+
+    cbCtx->cks.getMultiDoc(db, docinfo, cbCtx->vbId, bg_itm_ctx);
+    return 0;
+}
+
+void CouchKVStore::readDeferredDocs(Db* db, GetMultiCbCtx& ctx) {
+    // Read the bodies in file order...
+    std::sort(ctx.deferred.begin(),
+              ctx.deferred.end(),
+              [](const std::unique_ptr<DeferredDocInfo>& a,
+                 const std::unique_ptr<DeferredDocInfo>& b) {
+                  return a->info.bp < b->info.bp;
+              });
+
+    // ...after asking the OS to read all of them ahead, so the reads are
+    // queued to the device concurrently instead of one at a time. The
+    // range covers the chunk header and the block prefixes of the body.
+    auto* fileStats = couchstore_get_db_filestats(db);
+    if (fileStats != nullptr) {
+        for (const auto& deferred : ctx.deferred) {
+            const auto& info = deferred->info;
+            const cs_off_t len =
+                    cs_off_t(info.size + info.size / couchBlockSize + 16);
+            couchstore_error_info_t errinfo;
+            StatsOps::adviseFile(&errinfo,
+                                 fileStats,
+                                 cs_off_t(info.bp),
+                                 len,
+                                 COUCHSTORE_FILE_ADVICE_WILLNEED);
+        }
+        st.io_bgfetch_readahead_docs += ctx.deferred.size();
+    }
+
+    for (auto& deferred : ctx.deferred) {
+        getMultiDoc(db, &deferred->info, ctx.vbId, deferred->fetch);
+    }
+}
+
+void CouchKVStore::getMultiDoc(Db* db,
+                               DocInfo* docinfo,
+                               uint16_t vbId,
+                               vb_bgfetch_item_ctx_t& bg_itm_ctx) {
     GetMetaOnly meta_only = bg_itm_ctx.isMetaOnly;
 
     GetValue returnVal;
-    couchstore_error_t errCode = cbCtx->cks.fetchDoc(db, docinfo, returnVal,
-                                                     cbCtx->vbId, meta_only);
+    couchstore_error_t errCode =
+            fetchDoc(db, docinfo, returnVal, vbId, meta_only);
     if (errCode != COUCHSTORE_SUCCESS && (meta_only == GetMetaOnly::No)) {
         st.numGetFailure++;
     }
 
     bg_itm_ctx.value = std::move(returnVal);
 
-    returnVal.setStatus(cbCtx->cks.couchErr2EngineErr(errCode));
+    returnVal.setStatus(couchErr2EngineErr(errCode));
 
     bool return_val_ownership_transferred = false;
     for (auto& fetch : bg_itm_ctx.bgfetched_list) {
@@ -2349,14 +2800,12 @@ int CouchKVStore::getMultiCb(Db *db, DocInfo *docinfo, void *ctx) {
         }
     }
     if (!return_val_ownership_transferred) {
-        cbCtx->cks.logger.log(EXTENSION_LOG_WARNING,
-                              "CouchKVStore::getMultiCb called with zero"
-                              "items in bgfetched_list, vb:%" PRIu16
-                              ", seqno:%" PRIu64,
-                              cbCtx->vbId, docinfo->rev_seq);
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::getMultiDoc called with zero"
+                   "items in bgfetched_list, vb:%" PRIu16
+                   ", seqno:%" PRIu64,
+                   vbId, docinfo->rev_seq);
     }
-
-    return 0;
 }
 
 
@@ -2439,6 +2888,11 @@ size_t CouchKVStore::getNumPersistedDeletes(uint16_t vbid) {
 
 DBFileInfo CouchKVStore::getDbFileInfo(uint16_t vbid) {
 
+    if (!isReadOnly()) {
+        // Kept up to date by the commits and compactions
+        return DBFileInfo{cachedFileSize.at(vbid).load(),
+                          cachedSpaceUsed.at(vbid).load()};
+    }
     DbInfo info = getDbInfo(vbid);
     return DBFileInfo{info.file_size, info.space_used};
 }
@@ -2490,6 +2944,149 @@ size_t CouchKVStore::getItemCount(uint16_t vbid) {
     return getDbInfo(vbid).doc_count;
 }
 
+bool CouchKVStore::bulkLoad(uint16_t vbid,
+                            vbucket_state& vbstate,
+                            const BulkLoadSource& source) {
+    if (isReadOnly()) {
+        throw std::logic_error("CouchKVStore::bulkLoad: Not valid on a "
+                               "read-only object.");
+    }
+
+    const uint64_t fileRev = dbFileRevMap[vbid];
+    const uint64_t newRev = fileRev + 1;
+    const std::string dbFile = getDBFileName(dbname, vbid, fileRev);
+    const std::string loadFile = dbFile + ".compact";
+    const std::string newFile = getDBFileName(dbname, vbid, newRev);
+
+    couchstore_open_flags flags = COUCHSTORE_OPEN_FLAG_CREATE;
+    if (!configuration.getBuffered()) {
+        flags |= COUCHSTORE_OPEN_FLAG_UNBUFFERED;
+    }
+    const auto periodicSyncBytes = configuration.getPeriodicSyncBytes();
+    if (periodicSyncBytes != 0) {
+        flags |= couchstore_encode_periodic_sync_flags(periodicSyncBytes);
+    }
+
+    hrtime_t start = gethrtime();
+    DbHolder db(this);
+    couchstore_error_t errCode = couchstore_open_db_ex(
+            loadFile.c_str(), flags, statCollectingFileOps.get(),
+            db.getDbAddress());
+    if (errCode != COUCHSTORE_SUCCESS) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::bulkLoad: couchstore_open_db_ex error:%s, "
+                   "name:%s",
+                   couchstore_strerror(errCode),
+                   loadFile.c_str());
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Item>> run;
+    size_t numItems = 0;
+    int64_t lastSeqno = 0;
+    while (errCode == COUCHSTORE_SUCCESS && source(run)) {
+        MutationRequestCallback requestcb;
+        requestcb.setCb = nullptr;
+        std::vector<std::unique_ptr<CouchRequest>> reqs;
+        std::vector<Doc*> docs;
+        std::vector<DocInfo*> docinfos;
+        reqs.reserve(run.size());
+        docs.reserve(run.size());
+        docinfos.reserve(run.size());
+        for (const auto& item : run) {
+            if (item->getBySeqno() <= lastSeqno) {
+                throw std::invalid_argument(
+                        "CouchKVStore::bulkLoad: seqno " +
+                        std::to_string(item->getBySeqno()) +
+                        " isn't above the previous one (" +
+                        std::to_string(lastSeqno) + ")");
+            }
+            lastSeqno = item->getBySeqno();
+            vbstate.maxCas = std::max(vbstate.maxCas, item->getCas());
+
+            reqs.emplace_back(std::make_unique<CouchRequest>(
+                    *item,
+                    newRev,
+                    requestcb,
+                    false /*del*/,
+                    configuration.shouldPersistDocNamespace()));
+            docs.push_back(static_cast<Doc*>(reqs.back()->getDbDoc()));
+            docinfos.push_back(reqs.back()->getDbDocInfo());
+            st.io_write_bytes += item->getKey().size() + item->getNBytes();
+        }
+
+        if (!docs.empty()) {
+            errCode = couchstore_save_documents(
+                    db.getDb(),
+                    docs.data(),
+                    docinfos.data(),
+                    unsigned(docs.size()),
+                    COMPRESS_DOC_BODIES | COUCHSTORE_SEQUENCE_AS_IS);
+            st.io_num_write += docs.size();
+            numItems += docs.size();
+        }
+        run.clear();
+    }
+
+    if (errCode == COUCHSTORE_SUCCESS) {
+        vbstate.highSeqno = lastSeqno;
+        vbstate.lastSnapStart = lastSeqno;
+        vbstate.lastSnapEnd = lastSeqno;
+        errCode = saveVBState(db.getDb(), vbstate);
+    }
+    if (errCode == COUCHSTORE_SUCCESS) {
+        errCode = couchstore_commit(db.getDb());
+    }
+    DbInfo info;
+    if (errCode == COUCHSTORE_SUCCESS) {
+        errCode = couchstore_db_info(db.getDb(), &info);
+    }
+    if (errCode != COUCHSTORE_SUCCESS) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::bulkLoad: error:%s [%s], vb:%" PRIu16
+                   ", items:%" PRIu64,
+                   couchstore_strerror(errCode),
+                   couchkvstore_strerrno(db.getDb(), errCode).c_str(),
+                   vbid,
+                   uint64_t(numItems));
+        closeDatabaseHandle(db.releaseDb());
+        removeCompactFile(loadFile);
+        return false;
+    }
+    closeDatabaseHandle(db.releaseDb());
+
+    if (rename(loadFile.c_str(), newFile.c_str()) != 0) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::bulkLoad: rename error:%s, old:%s, new:%s",
+                   cb_strerror().c_str(),
+                   loadFile.c_str(),
+                   newFile.c_str());
+        removeCompactFile(loadFile);
+        return false;
+    }
+
+    // Switch the vbucket to the new file
+    updateDbFileMap(vbid, newRev);
+    cachedVBStates[vbid] = std::make_unique<vbucket_state>(vbstate);
+    cachedDocCount[vbid] = info.doc_count;
+    cachedDeleteCount[vbid] = info.deleted_count;
+    cachedFileSize[vbid] = info.file_size;
+    cachedSpaceUsed[vbid] = info.space_used;
+    resetValueDictionary(vbid);
+    if (access(dbFile.c_str(), F_OK) == 0) {
+        unlinkCouchFile(vbid, fileRev);
+    }
+
+    logger.log(EXTENSION_LOG_NOTICE,
+               "CouchKVStore::bulkLoad: loaded %" PRIu64 " items into vb:%"
+               PRIu16 " (%s) in %" PRIu64 " ms",
+               uint64_t(numItems),
+               vbid,
+               newFile.c_str(),
+               uint64_t((gethrtime() - start) / 1000000));
+    return true;
+}
+
 RollbackResult CouchKVStore::rollback(uint16_t vbid, uint64_t rollbackSeqno,
                                       std::shared_ptr<RollbackCB> cb) {
     DbHolder db(this);
@@ -2580,9 +3177,12 @@ RollbackResult CouchKVStore::rollback(uint16_t vbid, uint64_t rollbackSeqno,
         return RollbackResult(false, 0, 0, 0);
     }
 
-    if ((totSeqCount / 2) <= rollbackSeqCount) {
-        //doresetVbucket flag set or rollback is greater than 50%,
-        //reset the vbucket and send the entire snapshot
+    // Undoing the rollback key by key costs a read for every key in the
+    // rolled back range; past the configured fraction of the vbucket
+    // (50% by default) reset the vbucket and send the entire snapshot
+    // instead.
+    const auto resetRatio = configuration.getRollbackResetRatio();
+    if (uint64_t(totSeqCount * resetRatio) <= rollbackSeqCount) {
         return RollbackResult(false, 0, 0, 0);
     }
 
@@ -2609,6 +3209,9 @@ RollbackResult CouchKVStore::rollback(uint16_t vbid, uint64_t rollbackSeqno,
         return RollbackResult(false, 0, 0, 0);
     }
 
+    // The header rewound to may predate the dictionary of the file
+    resetValueDictionary(vbid);
+
     vbucket_state* vb_state = getVBucketState(vbid);
     return RollbackResult(true, vb_state->highSeqno,
                           vb_state->lastSnapStart, vb_state->lastSnapEnd);
@@ -2619,6 +3222,10 @@ int populateAllKeys(Db *db, DocInfo *docinfo, void *ctx) {
     // Collections: TODO: Restore to stored namespace
     DocKey key = makeDocKey(docinfo->id, false /*restore namespace*/);
     (allKeysCtx->cb)->callback(key);
+    if (allKeysCtx->cb->getStatus() != ENGINE_SUCCESS) {
+        // The callback doesn't want any more keys
+        return COUCHSTORE_ERROR_CANCEL;
+    }
     if (--(allKeysCtx->count) <= 0) {
         //Only when count met is less than the actual number of entries
         return COUCHSTORE_ERROR_CANCEL;
@@ -2789,6 +3396,7 @@ uint64_t CouchKVStore::prepareToDelete(uint16_t vbid) {
     cachedDeleteCount[vbid] = 0;
     cachedFileSize[vbid] = 0;
     cachedSpaceUsed[vbid] = 0;
+    resetValueDictionary(vbid);
     return dbFileRevMap[vbid];
 }
 
@@ -22,20 +22,26 @@
 
 #include "atomicqueue.h"
 #include "configuration.h"
+#include "couch-kvstore/couch-fs-buffered.h"
+#include "couch-kvstore/couch-fs-direct.h"
 #include "couch-kvstore/couch-fs-stats.h"
+#include "couch-kvstore/couch-fs-throttle.h"
 #include "couch-kvstore/couch-kvstore-metadata.h"
 #include "item.h"
 #include "kvstore.h"
 #include "kvstore_priv.h"
 #include "libcouchstore/couch_db.h"
 #include "logger.h"
+#include "value_dictionary.h"
 
 #include <platform/histogram.h>
+#include <platform/random.h>
 #include <platform/strerror.h>
 #include <relaxed_atomic.h>
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -58,12 +64,18 @@ public:
      * @param cb persistence callback
      * @param del flag indicating if it is an item deletion or not
      * @param persistDocNamespace true if we should store the key's namespace
+     * @param dictionary the dictionary to encode the value with, if that
+     *        makes it smaller (can be nullptr)
      */
     CouchRequest(const Item& it,
                  uint64_t rev,
                  MutationRequestCallback& cb,
                  bool del,
-                 bool persistDocNamespace);
+                 bool persistDocNamespace,
+                 const ValueDictionary* dictionary = nullptr);
+
+    /// The smallest value encoded with a ValueDictionary
+    static const size_t minDictionaryValue = 16;
 
     virtual ~CouchRequest() {}
 
@@ -136,11 +148,21 @@ public:
         return key;
     }
 
+    /**
+     * @return true if the value is persisted encoded with a ValueDictionary
+     */
+    bool isDictionaryEncoded() const {
+        return !encodedValue.empty();
+    }
+
 protected:
     static couchstore_content_meta_flags getContentMeta(const Item& it);
 
     value_t value;
 
+    /// The value encoded with a ValueDictionary, if it is
+    std::string encodedValue;
+
     MetaData meta;
     uint64_t fileRevNum;
     Doc dbDoc;
@@ -150,6 +172,8 @@ protected:
 /**
  * KVStore with couchstore as the underlying storage system
  */
+struct GetMultiCbCtx;
+
 class CouchKVStore : public KVStore
 {
 public:
@@ -403,6 +427,16 @@ public:
     RollbackResult rollback(uint16_t vbid, uint64_t rollbackSeqno,
                             std::shared_ptr<RollbackCB> cb) override;
 
+    /**
+     * Bulk load the vbucket: the runs are written to a side file (named as
+     * a compaction in progress, so that an interrupted load is removed by
+     * the next start), which is renamed to the next revision of the vbucket
+     * file once committed.
+     */
+    bool bulkLoad(uint16_t vbid,
+                  vbucket_state& vbstate,
+                  const BulkLoadSource& source) override;
+
     /**
      * Perform pending tasks after persisting dirty items
      */
@@ -410,9 +444,21 @@ public:
 
     bool getStat(const char* name, size_t& value) override;
 
-    static int recordDbDump(Db *db, DocInfo *docinfo, void *ctx);
+    int recordDbDump(Db* db, DocInfo* docinfo, ScanContext* sctx);
     static int recordDbStat(Db *db, DocInfo *docinfo, void *ctx);
     static int getMultiCb(Db *db, DocInfo *docinfo, void *ctx);
+
+    /// Fetch the document of a bgfetch, given its DocInfo
+    void getMultiDoc(Db* db,
+                     DocInfo* docinfo,
+                     uint16_t vbId,
+                     vb_bgfetch_item_ctx_t& bg_itm_ctx);
+
+    /**
+     * Read the bodies of the bgfetches deferred by getMultiCb: ask the OS to
+     * read all of them ahead, then read them in file order.
+     */
+    void readDeferredDocs(Db* db, GetMultiCbCtx& ctx);
     ENGINE_ERROR_CODE readVBState(Db *db, uint16_t vbId);
 
     couchstore_error_t fetchDoc(Db* db,
@@ -550,6 +596,50 @@ protected:
      */
     std::string readCollectionsManifest(Db& db);
 
+    /**
+     * Get the dictionary to encode a value written to its vbucket with.
+     *
+     * The first time for a vbucket, the dictionary of its file (if any) is
+     * read; when it has none, the values written are collected until a
+     * dictionary can be trained from them, which is saved with the next
+     * commit (see saveDocs).
+     *
+     * @return the dictionary, or nullptr if the value isn't to be encoded
+     */
+    std::shared_ptr<const ValueDictionary> getWriteDictionary(
+            const Item& itm, uint64_t fileRev);
+
+    /// Forget the dictionary of a vbucket, whose file changes
+    void resetValueDictionary(uint16_t vbid);
+
+    /**
+     * Save a ValueDictionary to the _local/vdict document: its identifier
+     * (in network byte order) followed by its content.
+     */
+    couchstore_error_t saveValueDictionary(Db& db,
+                                           const ValueDictionary& dictionary);
+
+    /**
+     * Read the ValueDictionary from the _local/vdict document.
+     *
+     * @return the dictionary or nullptr if the file has none
+     */
+    std::shared_ptr<const ValueDictionary> readValueDictionary(Db& db);
+
+    /**
+     * Decode a value read from a vbucket file, encoded with its
+     * ValueDictionary.
+     *
+     * @param dictionaryId the identifier of the dictionary, from the metadata
+     * @return false if the file has no such dictionary or the value is
+     *         corrupt
+     */
+    bool decodeValue(Db& db,
+                     uint16_t vbid,
+                     uint32_t dictionaryId,
+                     sized_buf encoded,
+                     std::string& value);
+
     void setDocsCommitted(uint16_t docs);
     void closeDatabaseHandle(Db *db);
 
@@ -615,6 +705,20 @@ protected:
      */
     std::unique_ptr<FileOpsInterface> statCollectingFileOpsCompaction;
 
+    /**
+     * FileOpsInterface implementation for couchstore which reads without the
+     * page cache and/or through blockCache (wrapping statCollectingFileOps),
+     * or nullptr if neither is enabled. Not used for compaction.
+     */
+    std::unique_ptr<FileOpsInterface> directFileOps;
+
+    /**
+     * FileOpsInterface implementation for couchstore which coalesces the
+     * writes (wrapping directFileOps, or statCollectingFileOps), or nullptr
+     * if not enabled. Not used for compaction.
+     */
+    std::unique_ptr<FileOpsInterface> bufferedFileOps;
+
     /* deleted docs in each file, indexed by vBucket. RelaxedAtomic
        to allow stats access witout lock */
     std::vector<Couchbase::RelaxedAtomic<size_t>> cachedDeleteCount;
@@ -634,6 +738,30 @@ protected:
      */
     FileOpsInterface& base_ops;
 
+    /**
+     * The cache of the blocks read from the files, shared by the RW store
+     * and its RO sibling; nullptr if disabled.
+     */
+    std::shared_ptr<CouchBlockCache> blockCache;
+
+    struct VBucketValueDictionary {
+        /// The dictionary of the file, nullptr if none (yet)
+        std::shared_ptr<const ValueDictionary> dictionary;
+        /// True once the dictionary of the file was looked for
+        bool checked = false;
+        /// True if the dictionary was trained but not saved to the file yet
+        bool unsaved = false;
+        /// True if the samples had nothing in common to train from
+        bool untrainable = false;
+        /// The values to train the dictionary from
+        std::vector<std::string> samples;
+    };
+
+    /// The value dictionaries, indexed by vBucket
+    std::vector<VBucketValueDictionary> valueDictionaries;
+    std::mutex valueDictionaryMutex;
+    Couchbase::RandomGenerator dictionaryIdGenerator;
+
 private:
     /**
      * Construct the store, this constructor does the object initialisation and
@@ -649,12 +777,14 @@ private:
      *        read-only constructor is called, it doesn't need to resize the map
      *        as it will use a reference to the RW store's map, so 0 would be
      *        passed.
+     * @param cache the block cache to read through, or nullptr
      */
     CouchKVStore(KVStoreConfig& config,
                  FileOpsInterface& ops,
                  bool readOnly,
                  std::vector<std::atomic<uint64_t>>& dbFileRevMap,
-                 size_t fileRevMapSize);
+                 size_t fileRevMapSize,
+                 std::shared_ptr<CouchBlockCache> cache);
 
     /**
      * Construct a read-only store - private as should be called via
@@ -663,9 +793,11 @@ private:
      * @param config configuration data for the store
      * @param dbFileRevMap a reference to the map (which should be data owned by
      *        the RW store).
+     * @param cache the block cache of the RW store
      */
     CouchKVStore(KVStoreConfig& config,
-                 std::vector<std::atomic<uint64_t>>& dbFileRevMap);
+                 std::vector<std::atomic<uint64_t>>& dbFileRevMap,
+                 std::shared_ptr<CouchBlockCache> cache);
 
     class DbHolder {
     public:
@@ -24,6 +24,7 @@
 #include "dcp/producer.h"
 #include "ep_engine.h"
 #include "ep_time.h"
+#include "trace.h"
 
 #include <phosphor/phosphor.h>
 
@@ -109,6 +110,12 @@ BackfillManager::BackfillManager(EventuallyPersistentEngine& e)
     buffer.full = false;
 }
 
+void BackfillManager::setScanBufferLimits(size_t maxBytes, size_t maxItems) {
+    LockHolder lh(lock);
+    scanBuffer.maxBytes = maxBytes;
+    scanBuffer.maxItems = maxItems;
+}
+
 void BackfillManager::addStats(connection_t conn, ADD_STAT add_stat,
                                const void *c) {
     LockHolder lh(lock);
@@ -118,6 +125,8 @@ void BackfillManager::addStats(connection_t conn, ADD_STAT add_stat,
     conn->addStat("backfill_num_active", activeBackfills.size(), add_stat, c);
     conn->addStat("backfill_num_snoozing", snoozingBackfills.size(), add_stat, c);
     conn->addStat("backfill_num_pending", pendingBackfills.size(), add_stat, c);
+    conn->addStat("backfill_scan_max_bytes", scanBuffer.maxBytes, add_stat, c);
+    conn->addStat("backfill_scan_max_items", scanBuffer.maxItems, add_stat, c);
 }
 
 BackfillManager::~BackfillManager() {
@@ -145,7 +154,12 @@ BackfillManager::~BackfillManager() {
         UniqueDCPBackfillPtr backfill = std::move(pendingBackfills.front());
         pendingBackfills.pop_front();
         backfill->cancel();
+        engine.getDcpConnMap().decrNumPendingBackfills();
     }
+
+    // Whatever the backfills read and the streams didn't send is dropped
+    // with them
+    engine.getDcpConnMap().backfillBytesSent(buffer.bytesRead);
 }
 
 void BackfillManager::schedule(VBucket& vb,
@@ -153,9 +167,23 @@ void BackfillManager::schedule(VBucket& vb,
                                uint64_t start,
                                uint64_t end) {
     LockHolder lh(lock);
+    // Streams of other connections for the vbucket may be about to backfill
+    // it too, in which case the stream joins them
+    if (engine.getDcpConnMap().attachToBackfill(
+                vb.getId(), stream, start, end)) {
+        LOG(EXTENSION_LOG_NOTICE,
+            "Backfill for %s vb:%d attached to the one of another stream",
+            stream->getName().c_str(),
+            vb.getId());
+        return;
+    }
+
     UniqueDCPBackfillPtr backfill =
             vb.createDCPBackfill(engine, stream, start, end);
-    if (engine.getDcpConnMap().canAddBackfillToActiveQ()) {
+    if (backfill->isSharable()) {
+        backfill->shareThrough(engine.getDcpConnMap());
+    }
+    if (engine.getDcpConnMap().admitNewBackfill()) {
         activeBackfills.push_back(std::move(backfill));
     } else {
         LOG(EXTENSION_LOG_NOTICE, "Backfill for %s vb:%d is pending",
@@ -197,6 +225,14 @@ bool BackfillManager::bytesCheckAndRead(size_t bytes) {
         return false;
     }
 
+    // The buffer shared with the backfills of all the other connections
+    if (!engine.getDcpConnMap().backfillBytesCheckAndRead(bytes,
+                                                          getTaskId())) {
+        scanBuffer.bytesRead -= bytes;
+        buffer.bytesRead -= bytes;
+        return false;
+    }
+
     scanBuffer.itemsRead++;
 
     return true;
@@ -210,6 +246,7 @@ void BackfillManager::bytesForceRead(size_t bytes) {
     ++scanBuffer.itemsRead;
     scanBuffer.bytesRead += bytes;
     buffer.bytesRead += bytes;
+    engine.getDcpConnMap().backfillBytesForceRead(bytes);
 
     if (buffer.bytesRead > buffer.maxBytes) {
         /* Setting this flag prevents running other backfills and hence prevents
@@ -228,6 +265,7 @@ void BackfillManager::bytesSent(size_t bytes) {
                 "buffer.bytesRead (which is" + std::to_string(buffer.bytesRead) + ")");
     }
     buffer.bytesRead -= bytes;
+    engine.getDcpConnMap().backfillBytesSent(bytes);
 
     if (buffer.full) {
         /* We can have buffer.bytesRead > buffer.maxBytes */
@@ -253,6 +291,12 @@ void BackfillManager::bytesSent(size_t bytes) {
     }
 }
 
+void BackfillManager::resetScanBuffer() {
+    LockHolder lh(lock);
+    scanBuffer.bytesRead = 0;
+    scanBuffer.itemsRead = 0;
+}
+
 backfill_status_t BackfillManager::backfill() {
     std::unique_lock<std::mutex> lh(lock);
 
@@ -274,6 +318,12 @@ backfill_status_t BackfillManager::backfill() {
         return backfill_snooze;
     }
 
+    // Snooze until the streams of all the connections send enough of what
+    // their backfills read
+    if (engine.getDcpConnMap().isBackfillBufferFull(getTaskId())) {
+        return backfill_snooze;
+    }
+
     if (buffer.full) {
         // If the buffer is full check to make sure we don't have any backfills
         // that no longer have active streams and remove them. This prevents an
@@ -305,8 +355,14 @@ backfill_status_t BackfillManager::backfill() {
 
     lh.unlock();
     backfill_status_t status = backfill->run();
+    backfill->resetAttachedScanBuffers();
     lh.lock();
 
+    MEMCACHED_EP_BACKFILL_RUN(backfill->getVBucketId(),
+                              int(status),
+                              uint64_t(scanBuffer.bytesRead),
+                              uint64_t(scanBuffer.itemsRead));
+
     scanBuffer.bytesRead = 0;
     scanBuffer.itemsRead = 0;
 
@@ -339,12 +395,14 @@ backfill_status_t BackfillManager::backfill() {
 }
 
 void BackfillManager::moveToActiveQueue() {
-    // Order in below AND is important
-    while (!pendingBackfills.empty() &&
-           engine.getDcpConnMap().canAddBackfillToActiveQ()) {
+    // Order in below AND is important. Only one pending backfill is moved
+    // per run, for the connections waiting for a slot to get their turn.
+    if (!pendingBackfills.empty() &&
+        engine.getDcpConnMap().canAddBackfillToActiveQ()) {
         activeBackfills.splice(activeBackfills.end(),
                                pendingBackfills,
                                pendingBackfills.begin());
+        engine.getDcpConnMap().decrNumPendingBackfills();
     }
 
     while (!snoozingBackfills.empty()) {
@@ -363,6 +421,10 @@ void BackfillManager::moveToActiveQueue() {
     }
 }
 
+size_t BackfillManager::getTaskId() const {
+    return managerTask ? managerTask->getId() : 0;
+}
+
 void BackfillManager::wakeUpTask() {
     LockHolder lh(lock);
     if (managerTask) {
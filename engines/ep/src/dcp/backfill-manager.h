@@ -86,6 +86,18 @@ public:
 
     void bytesSent(size_t bytes);
 
+    /**
+     * Resets the scan buffer, for the streams of the connection attached to
+     * the backfills of other connections (which the manager doesn't run)
+     */
+    void resetScanBuffer();
+
+    /**
+     * Set the limits of the scan buffer, i.e. how much a backfill reads
+     * each time the manager task runs it
+     */
+    void setScanBufferLimits(size_t maxBytes, size_t maxItems);
+
     // Called by the managerTask to acutally perform backfilling & manage
     // backfills between the different queues.
     backfill_status_t backfill();
@@ -105,6 +117,9 @@ private:
 
     void moveToActiveQueue();
 
+    //! The id of the manager task (to be woken by), 0 if there is none
+    size_t getTaskId() const;
+
     std::mutex lock;
     std::list<UniqueDCPBackfillPtr> activeBackfills;
     std::list<std::pair<rel_time_t, UniqueDCPBackfillPtr> > snoozingBackfills;
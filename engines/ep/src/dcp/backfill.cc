@@ -0,0 +1,181 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "dcp/backfill.h"
+#include "collections/vbucket_filter.h"
+#include "dcp/dcpconnmap.h"
+
+DCPBackfill::DCPBackfill(const active_stream_t& s,
+                         uint64_t startSeqno,
+                         uint64_t endSeqno)
+    : stream(s),
+      startSeqno(startSeqno),
+      endSeqno(endSeqno),
+      byKey(s->isBackfillByKey()),
+      targets({{s, startSeqno, 0}}),
+      keyOnly(s->isKeyOnly()),
+      compressionEnabled(s->isCompressionEnabled()),
+      started(false),
+      snapshotMarked(false),
+      attachedPaused(false),
+      registry(nullptr) {
+}
+
+DCPBackfill::~DCPBackfill() {
+    if (registry) {
+        registry->unregisterBackfill(*this);
+    }
+}
+
+bool DCPBackfill::isStreamDead() const {
+    for (const auto& target : targets) {
+        if (target.stream->isActive()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DCPBackfill::shareThrough(DcpConnMap& connMap) {
+    registry = &connMap;
+    connMap.registerBackfill(*this);
+}
+
+bool DCPBackfill::attach(const active_stream_t& s,
+                         uint64_t start,
+                         uint64_t end) {
+    std::lock_guard<std::mutex> lh(attachMutex);
+    if (started || start < startSeqno || s->isKeyOnly() != keyOnly ||
+        s->isCompressionEnabled() != compressionEnabled || byKey ||
+        s->isBackfillByKey()) {
+        return false;
+    }
+    targets.push_back({s, start, 0});
+    endSeqno = std::max(endSeqno, end);
+    return true;
+}
+
+void DCPBackfill::resetAttachedScanBuffers() {
+    for (size_t ii = 1; ii < targets.size(); ++ii) {
+        targets[ii].stream->resetBackfillScanBuffer();
+    }
+}
+
+void DCPBackfill::markStarted() {
+    {
+        std::lock_guard<std::mutex> lh(attachMutex);
+        if (started) {
+            return;
+        }
+        started = true;
+    }
+    if (targets.size() > 1) {
+        stream->getLogger().log(EXTENSION_LOG_NOTICE,
+                                "(vb %d) Backfill (%" PRIu64 " to %" PRIu64
+                                ") shared by %" PRIu64 " streams",
+                                getVBucketId(),
+                                startSeqno,
+                                endSeqno,
+                                uint64_t(targets.size()));
+    }
+    if (registry) {
+        registry->unregisterBackfill(*this);
+        registry = nullptr;
+    }
+}
+
+bool DCPBackfill::backfillReceived(std::unique_ptr<Item> itm,
+                                   backfill_source_t backfillSource) {
+    const uint64_t seqno = itm->getBySeqno();
+    bool received = true;
+    for (size_t ii = 0; ii < targets.size(); ++ii) {
+        auto& target = targets[ii];
+        // The backfill by key only has the one stream, which never took
+        // an item read again after a pause
+        if (seqno < target.startSeqno ||
+            (!byKey && seqno <= target.lastSeqno)) {
+            continue;
+        }
+        // The last stream takes the item itself, the others a copy of it
+        std::unique_ptr<Item> copy = (ii + 1 == targets.size())
+                                             ? std::move(itm)
+                                             : std::make_unique<Item>(*itm);
+        if (target.stream->backfillReceived(
+                    std::move(copy), backfillSource, /*force*/ false)) {
+            target.lastSeqno = seqno;
+        } else {
+            received = false;
+            if (ii > 0) {
+                attachedPaused = true;
+            }
+        }
+    }
+    return received;
+}
+
+std::function<bool(const DocKey&)> DCPBackfill::makeKeyFilter() {
+    auto filters = std::make_shared<
+            std::vector<std::unique_ptr<Collections::VB::Filter>>>();
+    for (auto& target : targets) {
+        auto filter = target.stream->copyFilter();
+        if (filter->isPassthrough()) {
+            return {};
+        }
+        filters->push_back(std::move(filter));
+    }
+
+    return [filters](const DocKey& key) {
+        // The system events are for the streams to filter
+        if (key.getDocNamespace() == DocNamespace::System) {
+            return true;
+        }
+        for (const auto& filter : *filters) {
+            if (filter->allow(key)) {
+                return true;
+            }
+        }
+        return false;
+    };
+}
+
+void DCPBackfill::markDiskSnapshot(uint64_t snapEndSeqno, size_t numItems) {
+    snapshotMarked = true;
+    for (auto& target : targets) {
+        target.stream->incrBackfillRemaining(numItems);
+        target.stream->markDiskSnapshot(target.startSeqno, snapEndSeqno);
+    }
+}
+
+void DCPBackfill::completeBackfill(bool cancelled) {
+    stream->completeBackfill();
+    for (size_t ii = 1; ii < targets.size(); ++ii) {
+        auto& attached = targets[ii].stream;
+        if (cancelled && attached->isActive()) {
+            attached->sharedBackfillCancelled(snapshotMarked);
+        } else {
+            attached->completeBackfill();
+        }
+    }
+}
+
+bool DCPBackfill::pausedByAttachedStream() {
+    bool paused = attachedPaused;
+    attachedPaused = false;
+    return paused;
+}
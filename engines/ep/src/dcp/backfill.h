@@ -21,6 +21,11 @@
 
 #include "dcp/stream.h"
 
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class DcpConnMap;
 class ScanContext;
 
 /**
@@ -36,12 +41,9 @@ class DCPBackfill {
 public:
     DCPBackfill(const active_stream_t& s,
                 uint64_t startSeqno,
-                uint64_t endSeqno)
-        : stream(s), startSeqno(startSeqno), endSeqno(endSeqno) {
-    }
+                uint64_t endSeqno);
 
-    virtual ~DCPBackfill() {
-    }
+    virtual ~DCPBackfill();
 
     /**
      * Run the DCP backfill and return the status of the run
@@ -60,20 +62,102 @@ public:
     }
 
     /**
-     * Indicates if the DCP stream associated with the backfill is dead
+     * Indicates if the DCP streams associated with the backfill are all
+     * dead
      *
-     * @return true if stream is in dead state; else false
+     * @return true if the streams are in dead state; else false
      */
-    bool isStreamDead() const {
-        return !stream->isActive();
-    }
+    bool isStreamDead() const;
 
     /**
      * Cancels the backfill
      */
     virtual void cancel() = 0;
 
+    /**
+     * Indicates if the streams of other connections can attach to the
+     * backfill, for it to read the items for them too
+     */
+    virtual bool isSharable() const {
+        return false;
+    }
+
+    /**
+     * Lets the streams of the other connections attach to the backfill
+     * through the connection map, until it starts.
+     */
+    void shareThrough(DcpConnMap& connMap);
+
+    /**
+     * Attaches the stream of another connection to the backfill, which
+     * then reads the items for it too. Only possible before the backfill
+     * starts, and if it starts at or before the stream needs it to, with
+     * the same value filter. Backfills by key are never shared, as the
+     * items handed to a stream are tracked by seqno.
+     *
+     * @param s the stream (of the vbucket of the backfill)
+     * @param start the first seqno the stream needs
+     * @param end the last seqno the stream needs
+     * @return true if the stream is attached
+     */
+    bool attach(const active_stream_t& s, uint64_t start, uint64_t end);
+
+    /**
+     * Resets the scan buffers of the connections of the attached streams,
+     * to be called at the end of each run (the manager of the backfill only
+     * resets its own).
+     */
+    void resetAttachedScanBuffers();
+
+    /**
+     * Hands a backfilled item to all the streams which need it
+     *
+     * @return false if any of the streams couldn't take it, in which case
+     *         the backfill pauses and reads the item again on its next run
+     *         (for the streams which didn't take it)
+     */
+    bool backfillReceived(std::unique_ptr<Item> itm,
+                          backfill_source_t backfillSource);
+
 protected:
+    /**
+     * Marks the backfill started, after which no stream can attach to it
+     */
+    void markStarted();
+
+    /**
+     * Builds a filter of the keys at least one of the streams wants, from
+     * copies of their collections filters. To be called once the backfill
+     * is started (no more streams can attach).
+     *
+     * @return the filter, empty if one of the streams wants every key
+     */
+    std::function<bool(const DocKey&)> makeKeyFilter();
+
+    /**
+     * Informs all the streams of the snapshot and the number of items
+     * backfilled: see ActiveStream::markDiskSnapshot.
+     */
+    void markDiskSnapshot(uint64_t snapEndSeqno, size_t numItems);
+
+    /**
+     * Informs all the streams of the completion of the backfill. If it is
+     * cancelled, the attached streams still active schedule a backfill of
+     * their own if the snapshot wasn't marked yet, or end otherwise (as they
+     * miss items of it).
+     *
+     * @param cancelled indicates if the backfill finished fully or was
+     *                  cancelled in between
+     */
+    void completeBackfill(bool cancelled);
+
+    /**
+     * Indicates, and resets, if the last pause of the backfill was due to
+     * an attached stream, whose connection doesn't run the backfill (hence
+     * isn't woken up once the stream can take items again).
+     */
+    bool pausedByAttachedStream();
+
     /**
      * Ptr to the associated Active DCP stream. Backfill can be run for only
      * an active DCP stream
@@ -89,6 +173,36 @@ protected:
      * End seqno of the backfill
      */
     uint64_t endSeqno;
+
+    /**
+     * Whether the items may be read in the order of their keys (see
+     * DCP_ADD_STREAM_FLAG_BACKFILL_BY_KEY)
+     */
+    const bool byKey;
+
+private:
+    struct Target {
+        active_stream_t stream;
+        //! The first seqno the stream needs
+        uint64_t startSeqno;
+        //! The last seqno the stream took, not to hand it again after a pause
+        uint64_t lastSeqno;
+    };
+
+    //! The (first) stream the backfill is for, then the attached streams.
+    //! Only modified before the backfill starts, under attachMutex.
+    std::vector<Target> targets;
+
+    const bool keyOnly;
+    const bool compressionEnabled;
+
+    std::mutex attachMutex;
+    bool started;
+    bool snapshotMarked;
+    bool attachedPaused;
+
+    //! The connection map the backfill is registered with, if sharable
+    DcpConnMap* registry;
 };
 
 using UniqueDCPBackfillPtr = std::unique_ptr<DCPBackfill>;
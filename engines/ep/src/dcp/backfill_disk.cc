@@ -36,8 +36,10 @@ static std::string backfillStateToString(backfill_state_t state) {
     return "<invalid>:" + std::to_string(state);
 }
 
-CacheCallback::CacheCallback(EventuallyPersistentEngine& e, active_stream_t& s)
-    : engine_(e), stream_(s) {
+CacheCallback::CacheCallback(EventuallyPersistentEngine& e,
+                             active_stream_t& s,
+                             DCPBackfill* backfill)
+    : engine_(e), stream_(s), backfill_(backfill) {
     if (stream_.get() == nullptr) {
         throw std::invalid_argument("CacheCallback(): stream is NULL");
     }
@@ -68,9 +70,14 @@ void CacheCallback::callback(CacheLookup& lookup) {
                                           VBucket::GetKeyOnly::No);
     if (gv.getStatus() == ENGINE_SUCCESS) {
         if (gv.item->getBySeqno() == lookup.getBySeqno()) {
-            if (stream_->backfillReceived(std::move(gv.item),
-                                          BACKFILL_FROM_MEMORY,
-                                          /*force */false)) {
+            bool received =
+                    backfill_ ? backfill_->backfillReceived(
+                                        std::move(gv.item),
+                                        BACKFILL_FROM_MEMORY)
+                              : stream_->backfillReceived(std::move(gv.item),
+                                                          BACKFILL_FROM_MEMORY,
+                                                          /*force */ false);
+            if (received) {
                 setStatus(ENGINE_KEY_EEXISTS);
                 return;
             }
@@ -81,7 +88,8 @@ void CacheCallback::callback(CacheLookup& lookup) {
     setStatus(ENGINE_SUCCESS);
 }
 
-DiskCallback::DiskCallback(active_stream_t& s) : stream_(s) {
+DiskCallback::DiskCallback(active_stream_t& s, DCPBackfill* backfill)
+    : stream_(s), backfill_(backfill) {
     if (stream_.get() == nullptr) {
         throw std::invalid_argument("DiskCallback(): stream is NULL");
     }
@@ -98,9 +106,12 @@ void DiskCallback::callback(GetValue& val) {
         throw std::invalid_argument("DiskCallback::callback: val is NULL");
     }
 
-    if (!stream_->backfillReceived(std::move(val.item),
-                                   BACKFILL_FROM_DISK,
-                                   /*force*/ false)) {
+    bool received = backfill_ ? backfill_->backfillReceived(
+                                        std::move(val.item), BACKFILL_FROM_DISK)
+                              : stream_->backfillReceived(std::move(val.item),
+                                                          BACKFILL_FROM_DISK,
+                                                          /*force*/ false);
+    if (!received) {
         setStatus(ENGINE_ENOMEM); // Pause the backfill
     } else {
         setStatus(ENGINE_SUCCESS);
@@ -159,6 +170,9 @@ backfill_status_t DCPBackfillDisk::create() {
         return backfill_snooze;
     }
 
+    // No other stream can attach from now on, as the range is decided
+    markStarted();
+
     KVStore* kvstore = engine.getKVBucket()->getROUnderlying(vbid);
     ValueFilter valFilter = ValueFilter::VALUES_DECOMPRESSED;
     if (stream->isKeyOnly()) {
@@ -169,15 +183,18 @@ backfill_status_t DCPBackfillDisk::create() {
         }
     }
 
-    std::shared_ptr<Callback<GetValue> > cb(new DiskCallback(stream));
+    std::shared_ptr<Callback<GetValue> > cb(new DiskCallback(stream, this));
     std::shared_ptr<Callback<CacheLookup> > cl(
-            new CacheCallback(engine, stream));
+            new CacheCallback(engine, stream, this));
     scanCtx = kvstore->initScanContext(
             cb, cl, vbid, startSeqno, DocumentFilter::ALL_ITEMS, valFilter);
 
     if (scanCtx) {
-        stream->incrBackfillRemaining(scanCtx->documentCount);
-        stream->markDiskSnapshot(startSeqno, scanCtx->maxSeqno);
+        // Skip the documents of collections none of the streams wants
+        // before the scan reads their values
+        scanCtx->keyFilter = makeKeyFilter();
+        scanCtx->byKey = byKey;
+        markDiskSnapshot(scanCtx->maxSeqno, scanCtx->documentCount);
         transitionState(backfill_state_scanning);
     } else {
         transitionState(backfill_state_done);
@@ -189,7 +206,7 @@ backfill_status_t DCPBackfillDisk::create() {
 backfill_status_t DCPBackfillDisk::scan() {
     uint16_t vbid = stream->getVBucket();
 
-    if (!(stream->isActive())) {
+    if (isStreamDead()) {
         return complete(true);
     }
 
@@ -197,7 +214,9 @@ backfill_status_t DCPBackfillDisk::scan() {
     scan_error_t error = kvstore->scan(scanCtx);
 
     if (error == scan_again) {
-        return backfill_success;
+        // The connection of an attached stream doesn't wake this one once
+        // the stream can take items again
+        return pausedByAttachedStream() ? backfill_snooze : backfill_success;
     }
 
     transitionState(backfill_state_completing);
@@ -210,7 +229,8 @@ backfill_status_t DCPBackfillDisk::complete(bool cancelled) {
     KVStore* kvstore = engine.getKVBucket()->getROUnderlying(vbid);
     kvstore->destroyScanContext(scanCtx);
 
-    stream->completeBackfill();
+    markStarted();
+    completeBackfill(cancelled);
 
     EXTENSION_LOG_LEVEL severity =
             cancelled ? EXTENSION_LOG_NOTICE : EXTENSION_LOG_INFO;
@@ -36,24 +36,36 @@ enum backfill_state_t {
 /* Callback to get the items that are found to be in the cache */
 class CacheCallback : public Callback<CacheLookup> {
 public:
-    CacheCallback(EventuallyPersistentEngine& e, active_stream_t& s);
+    /**
+     * @param backfill if set, the items go to all the streams the backfill
+     *        is for (rather than just to s)
+     */
+    CacheCallback(EventuallyPersistentEngine& e,
+                  active_stream_t& s,
+                  DCPBackfill* backfill = nullptr);
 
     void callback(CacheLookup& lookup);
 
 private:
     EventuallyPersistentEngine& engine_;
     active_stream_t stream_;
+    DCPBackfill* backfill_;
 };
 
 /* Callback to get the items that are found to be in the disk */
 class DiskCallback : public Callback<GetValue> {
 public:
-    DiskCallback(active_stream_t& s);
+    /**
+     * @param backfill if set, the items go to all the streams the backfill
+     *        is for (rather than just to s)
+     */
+    DiskCallback(active_stream_t& s, DCPBackfill* backfill = nullptr);
 
     void callback(GetValue& val);
 
 private:
     active_stream_t stream_;
+    DCPBackfill* backfill_;
 };
 
 /**
@@ -74,6 +86,10 @@ public:
 
     void cancel() override;
 
+    bool isSharable() const override {
+        return true;
+    }
+
 private:
     /**
      * Creates a scan context with the KV Store to read items in the sequential
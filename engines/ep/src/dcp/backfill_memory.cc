@@ -149,7 +149,9 @@ void DCPBackfillMemoryBuffered::cancel() {
 backfill_status_t DCPBackfillMemoryBuffered::create() {
     /* Create range read cursor */
     try {
-        auto rangeItrOptional = evb->makeRangeIterator(true /*isBackfill*/);
+        auto rangeItrOptional =
+                evb->makeRangeIterator(true /*isBackfill*/,
+                                       static_cast<seqno_t>(startSeqno));
         if (rangeItrOptional) {
             rangeItr = std::move(*rangeItrOptional);
         } else {
@@ -749,6 +749,7 @@ bool DcpConsumer::handleResponse(protocol_binary_response_header* resp) {
         return true;
     } else if (opcode == PROTOCOL_BINARY_CMD_DCP_BUFFER_ACKNOWLEDGEMENT ||
                opcode == PROTOCOL_BINARY_CMD_DCP_CONTROL) {
+        flowControl.handleFlowCtlResponse(opaque);
         return true;
     }
 
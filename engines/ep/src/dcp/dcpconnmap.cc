@@ -18,10 +18,12 @@
 #include "config.h"
 
 #include "configuration.h"
+#include "dcp/backfill.h"
 #include "dcp/consumer.h"
 #include "dcp/producer.h"
 #include "dcpconnmap.h"
 #include "ep_engine.h"
+#include "executorpool.h"
 
 const uint32_t DcpConnMap::dbFileMem = 10 * 1024;
 const uint16_t DcpConnMap::numBackfillsThreshold = 4096;
@@ -42,6 +44,9 @@ DcpConnMap::DcpConnMap(EventuallyPersistentEngine &e)
     : ConnMap(e),
       aggrDcpConsumerBufferSize(0) {
     backfills.numActiveSnoozing = 0;
+    backfills.numPending = 0;
+    backfills.bytesRead = 0;
+    backfills.full = false;
     updateMaxActiveSnoozingBackfills(engine.getEpStats().getMaxDataSize());
     minCompressionRatioForProducer.store(
                     engine.getConfiguration().getDcpMinCompressionRatio());
@@ -53,12 +58,14 @@ DcpConnMap::DcpConnMap(EventuallyPersistentEngine &e)
     engine.getConfiguration().
         addValueChangedListener("dcp_consumer_process_buffered_messages_batch_size",
                                 new DcpConfigChangeListener(*this));
+    engine.getConfiguration().addValueChangedListener(
+            "dcp_producer_step_batch_size", new DcpConfigChangeListener(*this));
 }
 
 DcpConsumer *DcpConnMap::newConsumer(const void* cookie,
                                      const std::string &name)
 {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
 
     std::string conn_name("eq_dcpq:");
     conn_name.append(name);
@@ -113,7 +120,7 @@ ENGINE_ERROR_CODE DcpConnMap::addPassiveStream(ConnHandler& conn,
                                                uint16_t vbucket,
                                                uint32_t flags)
 {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     /* Check if a stream (passive) for the vbucket is already present */
     if (isPassiveStreamConnected_UNLOCKED(vbucket)) {
         LOG(EXTENSION_LOG_WARNING, "%s (vb %d) Failing to add passive stream, "
@@ -129,7 +136,7 @@ DcpProducer* DcpConnMap::newProducer(const void* cookie,
                                      const std::string& name,
                                      uint32_t flags,
                                      cb::const_byte_buffer jsonExtra) {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
 
     std::string conn_name("eq_dcpq:");
     conn_name.append(name);
@@ -181,7 +188,7 @@ void DcpConnMap::shutdownAllConnections() {
     // cycle between connLock, worker thread lock and releaseLock.
     CookieToConnectionMap mapCopy;
     {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         mapCopy = map_;
     }
 
@@ -191,7 +198,7 @@ void DcpConnMap::shutdownAllConnections() {
 
 void DcpConnMap::vbucketStateChanged(uint16_t vbucket, vbucket_state_t state,
                                      bool closeInboundStreams) {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     std::map<const void*, connection_t>::iterator itr = map_.begin();
     for (; itr != map_.end(); ++itr) {
         DcpProducer* producer = dynamic_cast<DcpProducer*> (itr->second.get());
@@ -205,7 +212,7 @@ void DcpConnMap::vbucketStateChanged(uint16_t vbucket, vbucket_state_t state,
 }
 
 void DcpConnMap::closeStreamsDueToRollback(uint16_t vbucket) {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     for (auto& pair : map_) {
         DcpProducer* producer = dynamic_cast<DcpProducer*>(pair.second.get());
         if (producer) {
@@ -216,12 +223,8 @@ void DcpConnMap::closeStreamsDueToRollback(uint16_t vbucket) {
 
 bool DcpConnMap::handleSlowStream(uint16_t vbid,
                                   const std::string &name) {
-    size_t lock_num = vbid % vbConnLockNum;
-    std::lock_guard<SpinLock> lh(vbConnLocks[lock_num]);
-    std::list<connection_t> &vb_conns = vbConns[vbid];
-
-    std::list<connection_t>::iterator itr = vb_conns.begin();
-    for (; itr != vb_conns.end(); ++itr) {
+    const auto vb_conns = getVBConns(vbid);
+    for (auto itr = vb_conns->begin(); itr != vb_conns->end(); ++itr) {
         DcpProducer* producer = static_cast<DcpProducer*> ((*itr).get());
         if (producer && producer->handleSlowStream(vbid, name)) {
             return true;
@@ -267,7 +270,7 @@ void DcpConnMap::disconnect(const void *cookie) {
     // data structure (under connsLock).
     connection_t conn;
     {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         std::map<const void*, connection_t>::iterator itr(map_.find(cookie));
         if (itr != map_.end()) {
             conn = itr->second;
@@ -300,7 +303,7 @@ void DcpConnMap::disconnect(const void *cookie) {
     // Finished disconnecting the stream; add it to the
     // deadConnections list.
     if (conn) {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         deadConnections.push_back(conn);
     }
 }
@@ -309,7 +312,7 @@ void DcpConnMap::manageConnections() {
     std::list<connection_t> release;
     std::list<connection_t> toNotify;
     {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         while (!deadConnections.empty()) {
             connection_t conn = deadConnections.front();
             release.push_back(conn);
@@ -358,33 +361,22 @@ void DcpConnMap::removeVBConnections(connection_t &conn) {
 
     DcpProducer *prod = static_cast<DcpProducer*>(tp);
     for (const auto vbid : prod->getVBVector()) {
-        size_t lock_num = vbid % vbConnLockNum;
-        std::lock_guard<SpinLock> lh(vbConnLocks[lock_num]);
-        std::list<connection_t> &vb_conns = vbConns[vbid];
-        std::list<connection_t>::iterator itr = vb_conns.begin();
-        for (; itr != vb_conns.end(); ++itr) {
-            if (conn->getCookie() == (*itr)->getCookie()) {
-                vb_conns.erase(itr);
-                break;
-            }
-        }
+        removeVBConnByVBId(conn, vbid);
     }
 }
 
 void DcpConnMap::notifyVBConnections(uint16_t vbid, uint64_t bySeqno) {
-    size_t lock_num = vbid % vbConnLockNum;
-    std::lock_guard<SpinLock> lh(vbConnLocks[lock_num]);
-
-    std::list<connection_t> &conns = vbConns[vbid];
-    std::list<connection_t>::iterator it = conns.begin();
-    for (; it != conns.end(); ++it) {
-        DcpProducer *conn = static_cast<DcpProducer*>((*it).get());
+    // Called for every mutation, so only loads the current list of the
+    // vbucket (which addVBConnByVBId / removeVBConnByVBId replace)
+    const auto conns = getVBConns(vbid);
+    for (const auto& it : *conns) {
+        DcpProducer *conn = static_cast<DcpProducer*>(it.get());
         conn->notifySeqnoAvailable(vbid, bySeqno);
     }
 }
 
 void DcpConnMap::notifyBackfillManagerTasks() {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     std::map<const void*, connection_t>::iterator itr = map_.begin();
     for (; itr != map_.end(); ++itr) {
         DcpProducer* producer = dynamic_cast<DcpProducer*> (itr->second.get());
@@ -404,6 +396,28 @@ bool DcpConnMap::canAddBackfillToActiveQ()
     return false;
 }
 
+bool DcpConnMap::admitNewBackfill() {
+    std::lock_guard<std::mutex> lh(backfills.mutex);
+    if (backfills.numPending == 0 &&
+        backfills.numActiveSnoozing < backfills.maxActiveSnoozing) {
+        ++backfills.numActiveSnoozing;
+        return true;
+    }
+    ++backfills.numPending;
+    return false;
+}
+
+void DcpConnMap::decrNumPendingBackfills() {
+    {
+        std::lock_guard<std::mutex> lh(backfills.mutex);
+        if (backfills.numPending > 0) {
+            --backfills.numPending;
+            return;
+        }
+    }
+    LOG(EXTENSION_LOG_WARNING, "PendingBackfills already zero!!!");
+}
+
 void DcpConnMap::decrNumActiveSnoozingBackfills()
 {
     {
@@ -422,9 +436,14 @@ void DcpConnMap::updateMaxActiveSnoozingBackfills(size_t maxDataSize)
                          static_cast<double>(numBackfillsMemThreshold)/100;
     size_t max = maxDataSize * numBackfillsMemThresholdPercent / dbFileMem;
 
+    auto& config = engine.getConfiguration();
+    size_t maxBytes =
+            maxDataSize * config.getDcpBackfillAggrMemThreshold() / 100;
+
     uint16_t newMaxActive;
     {
         std::lock_guard<std::mutex> lh(backfills.mutex);
+        backfills.maxBytes = maxBytes;
         /* We must have atleast one active/snoozing backfill */
         backfills.maxActiveSnoozing =
                 std::max(static_cast<size_t>(1),
@@ -435,8 +454,92 @@ void DcpConnMap::updateMaxActiveSnoozingBackfills(size_t maxDataSize)
         newMaxActive);
 }
 
+bool DcpConnMap::backfillBytesCheckAndRead(size_t bytes, size_t taskId) {
+    std::lock_guard<std::mutex> lh(backfills.mutex);
+    // Always allow a read into an empty buffer, so that an item bigger than
+    // the whole buffer is still backfilled
+    if (backfills.bytesRead == 0 ||
+        backfills.bytesRead + bytes <= backfills.maxBytes) {
+        backfills.bytesRead += bytes;
+        return true;
+    }
+    backfills.full = true;
+    backfills.waitingTasks.push_back(taskId);
+    return false;
+}
+
+void DcpConnMap::backfillBytesForceRead(size_t bytes) {
+    std::lock_guard<std::mutex> lh(backfills.mutex);
+    backfills.bytesRead += bytes;
+    if (backfills.bytesRead > backfills.maxBytes) {
+        backfills.full = true;
+    }
+}
+
+void DcpConnMap::backfillBytesSent(size_t bytes) {
+    std::vector<size_t> toWake;
+    {
+        std::lock_guard<std::mutex> lh(backfills.mutex);
+        backfills.bytesRead -= std::min(bytes, backfills.bytesRead);
+        if (!backfills.full ||
+            backfills.bytesRead > (backfills.maxBytes * 3 / 4)) {
+            return;
+        }
+        backfills.full = false;
+        toWake.swap(backfills.waitingTasks);
+    }
+
+    // A task may have completed or been cancelled since, in which case the
+    // wake up is a no-op
+    for (auto taskId : toWake) {
+        ExecutorPool::get()->wake(taskId);
+    }
+}
+
+bool DcpConnMap::isBackfillBufferFull(size_t taskId) {
+    std::lock_guard<std::mutex> lh(backfills.mutex);
+    if (backfills.full) {
+        backfills.waitingTasks.push_back(taskId);
+    }
+    return backfills.full;
+}
+
+void DcpConnMap::registerBackfill(DCPBackfill& backfill) {
+    std::lock_guard<std::mutex> lh(sharableBackfills.mutex);
+    sharableBackfills.byVBucket[backfill.getVBucketId()].push_back(&backfill);
+}
+
+void DcpConnMap::unregisterBackfill(DCPBackfill& backfill) {
+    std::lock_guard<std::mutex> lh(sharableBackfills.mutex);
+    auto it = sharableBackfills.byVBucket.find(backfill.getVBucketId());
+    if (it == sharableBackfills.byVBucket.end()) {
+        return;
+    }
+    it->second.remove(&backfill);
+    if (it->second.empty()) {
+        sharableBackfills.byVBucket.erase(it);
+    }
+}
+
+bool DcpConnMap::attachToBackfill(uint16_t vbid,
+                                  const active_stream_t& stream,
+                                  uint64_t start,
+                                  uint64_t end) {
+    std::lock_guard<std::mutex> lh(sharableBackfills.mutex);
+    auto it = sharableBackfills.byVBucket.find(vbid);
+    if (it == sharableBackfills.byVBucket.end()) {
+        return false;
+    }
+    for (auto* backfill : it->second) {
+        if (backfill->attach(stream, start, end)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void DcpConnMap::addStats(ADD_STAT add_stat, const void *c) {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     add_casted_stat("ep_dcp_dead_conn_count", deadConnections.size(), add_stat,
                     c);
 }
@@ -458,6 +561,8 @@ void DcpConnMap::DcpConfigChangeListener::sizeValueChanged(const std::string &ke
         myConnMap.consumerYieldConfigChanged(value);
     } else if (key == "dcp_consumer_process_buffered_messages_batch_size") {
         myConnMap.consumerBatchSizeConfigChanged(value);
+    } else if (key == "dcp_producer_step_batch_size") {
+        myConnMap.producerStepBatchSizeConfigChanged(value);
     }
 }
 
@@ -465,7 +570,7 @@ void DcpConnMap::DcpConfigChangeListener::sizeValueChanged(const std::string &ke
  * Find all DcpConsumers and set the yield threshold
  */
 void DcpConnMap::consumerYieldConfigChanged(size_t newValue) {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     for (const auto cookieToConn : map_) {
         DcpConsumer* dcpConsumer = dynamic_cast<DcpConsumer*>(
                 cookieToConn.second.get());
@@ -479,7 +584,7 @@ void DcpConnMap::consumerYieldConfigChanged(size_t newValue) {
  * Find all DcpConsumers and set the processor batchsize
  */
 void DcpConnMap::consumerBatchSizeConfigChanged(size_t newValue) {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     for (const auto cookieToConn : map_) {
         DcpConsumer* dcpConsumer = dynamic_cast<DcpConsumer*>(
                 cookieToConn.second.get());
@@ -489,8 +594,22 @@ void DcpConnMap::consumerBatchSizeConfigChanged(size_t newValue) {
     }
 }
 
+/*
+ * Find all DcpProducers and set the step batchsize
+ */
+void DcpConnMap::producerStepBatchSizeConfigChanged(size_t newValue) {
+    ConnsLockHolder lh(connsLock);
+    for (const auto cookieToConn : map_) {
+        DcpProducer* dcpProducer = dynamic_cast<DcpProducer*>(
+                cookieToConn.second.get());
+        if (dcpProducer) {
+            dcpProducer->setStepBatchSize(newValue);
+        }
+    }
+}
+
 connection_t DcpConnMap::findByName(const std::string& name) {
-    LockHolder lh(connsLock);
+    ConnsLockHolder lh(connsLock);
     for (const auto cookieToConn : map_) {
         // If the connection is NOT about to be disconnected
         // and the names match
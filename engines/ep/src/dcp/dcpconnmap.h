@@ -26,7 +26,10 @@
 #include <atomic>
 #include <list>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+class DCPBackfill;
 class DcpProducer;
 class DcpConsumer;
 
@@ -85,7 +88,7 @@ public:
     void shutdownAllConnections();
 
     bool isDeadConnectionsEmpty() {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         return deadConnections.empty();
     }
 
@@ -102,10 +105,71 @@ public:
 
     bool canAddBackfillToActiveQ();
 
+    /**
+     * Admits a newly scheduled backfill to the active queue of its manager,
+     * unless the maximum of running backfills is reached or other backfills
+     * are already waiting for a slot (to be admitted before it), in which
+     * case it is counted as pending.
+     *
+     * @return true if the backfill can run
+     */
+    bool admitNewBackfill();
+
     void decrNumActiveSnoozingBackfills();
 
+    void decrNumPendingBackfills();
+
     void updateMaxActiveSnoozingBackfills(size_t maxDataSize);
 
+    /**
+     * Checks if the read size fits into the buffer shared by the backfills
+     * of all the producers, and reads only if it does. Otherwise the buffer
+     * is marked full, and the task is woken once enough of it is sent.
+     *
+     * @param bytes read size
+     * @param taskId the backfill manager task reading
+     *
+     * @return true upon read success
+     */
+    bool backfillBytesCheckAndRead(size_t bytes, size_t taskId);
+
+    /**
+     * Reads into the shared backfill buffer irrespective of its usage.
+     */
+    void backfillBytesForceRead(size_t bytes);
+
+    /**
+     * Releases bytes of the shared backfill buffer, waking the backfill
+     * manager tasks waiting for it once enough of it is cleared.
+     */
+    void backfillBytesSent(size_t bytes);
+
+    /**
+     * Checks if the shared backfill buffer is full, in which case the task
+     * is woken once enough of it is sent.
+     */
+    bool isBackfillBufferFull(size_t taskId);
+
+    /**
+     * Registers a backfill which hasn't started yet, for the streams of the
+     * other connections backfilling the same vbucket to attach to it.
+     */
+    void registerBackfill(DCPBackfill& backfill);
+
+    void unregisterBackfill(DCPBackfill& backfill);
+
+    /**
+     * Attaches a stream to a registered backfill of its vbucket which can
+     * read the items it needs.
+     *
+     * @return true if the stream is attached, i.e. needs no backfill of its
+     *         own
+     */
+    bool attachToBackfill(uint16_t vbid,
+                          const active_stream_t& stream,
+                          uint64_t start,
+                          uint64_t end);
+
     uint16_t getNumActiveSnoozingBackfills () {
         std::lock_guard<std::mutex> lh(backfills.mutex);
         return backfills.numActiveSnoozing;
@@ -116,6 +180,21 @@ public:
         return backfills.maxActiveSnoozing;
     }
 
+    size_t getNumPendingBackfills() {
+        std::lock_guard<std::mutex> lh(backfills.mutex);
+        return backfills.numPending;
+    }
+
+    size_t getBackfillBytesRead() {
+        std::lock_guard<std::mutex> lh(backfills.mutex);
+        return backfills.bytesRead;
+    }
+
+    size_t getMaxBackfillBytes() {
+        std::lock_guard<std::mutex> lh(backfills.mutex);
+        return backfills.maxBytes;
+    }
+
     ENGINE_ERROR_CODE addPassiveStream(ConnHandler& conn, uint32_t opaque,
                                        uint16_t vbucket, uint32_t flags);
 
@@ -133,7 +212,7 @@ public:
     connection_t findByName(const std::string &name);
 
     bool isConnections() {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         return !map_.empty();
     }
 
@@ -142,7 +221,7 @@ public:
      */
     template <typename Fun>
     void each(Fun f) {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         for (auto& c : map_) {
             f(c.second);
         }
@@ -165,6 +244,11 @@ protected:
      */
     void consumerBatchSizeConfigChanged(size_t newValue);
 
+    /*
+     * Change the number of messages a DcpProducer sends per step
+     */
+    void producerStepBatchSizeConfigChanged(size_t newValue);
+
     bool isPassiveStreamConnected_UNLOCKED(uint16_t vbucket);
 
     /*
@@ -180,13 +264,28 @@ protected:
     /* Db file memory */
     static const uint32_t dbFileMem;
 
-    // Current and maximum number of backfills which are snoozing.
+    // Current and maximum number of backfills which are snoozing, the
+    // number of them waiting to run, and the buffer all of them share (the
+    // bytes read and not yet sent).
     struct {
         std::mutex mutex;
         uint16_t numActiveSnoozing;
         uint16_t maxActiveSnoozing;
+        size_t numPending;
+        size_t bytesRead;
+        size_t maxBytes;
+        bool full;
+        //! The backfill manager tasks to wake once the buffer isn't full
+        std::vector<size_t> waitingTasks;
     } backfills;
 
+    // The backfills which haven't started yet, per vbucket, for the streams
+    // of other connections to share.
+    struct {
+        std::mutex mutex;
+        std::unordered_map<uint16_t, std::list<DCPBackfill*>> byVBucket;
+    } sharableBackfills;
+
     /* Max num of backfills we want to have irrespective of memory */
     static const uint16_t numBackfillsThreshold;
     /* Max percentage of memory we want backfills to occupy */
@@ -34,11 +34,20 @@ size_t DcpFlowControlManager::newConsumerConn(DcpConsumer *) {
 
 void DcpFlowControlManager::handleDisconnect(DcpConsumer *) {}
 
+void DcpFlowControlManager::handleDrainSample(DcpConsumer*,
+                                              double,
+                                              std::chrono::microseconds) {
+}
+
 bool DcpFlowControlManager::isEnabled() const
 {
     return false;
 }
 
+bool DcpFlowControlManager::probesAckRtt() const {
+    return false;
+}
+
 void DcpFlowControlManager::setBufSizeWithinBounds(DcpConsumer *consumerConn,
                                                    size_t &bufSize)
 {
@@ -215,3 +224,101 @@ void DcpFlowControlManagerAggressive::resizeBuffers_UNLOCKED(size_t bufferSize)
         iter.second->setFlowControlBufSize(bufferSize);
     }
 }
+
+const size_t DcpFlowControlManagerAdaptive::bdpHeadroom;
+
+DcpFlowControlManagerAdaptive::DcpFlowControlManagerAdaptive(
+        EventuallyPersistentEngine& engine)
+    : DcpFlowControlManager(engine), aggrBufferSize(0) {
+}
+
+DcpFlowControlManagerAdaptive::~DcpFlowControlManagerAdaptive() {}
+
+size_t DcpFlowControlManagerAdaptive::newConsumerConn(
+        DcpConsumer* consumerConn) {
+    if (consumerConn == nullptr) {
+        throw std::invalid_argument(
+                "DcpFlowControlManagerAdaptive::newConsumerConn: resp is "
+                "NULL");
+    }
+    /* Start at the min size, until the connection is measured */
+    const size_t bufferSize = engine_.getConfiguration().getDcpConnBufferSize();
+
+    std::lock_guard<std::mutex> lh(dcpConsumersMapMutex);
+    auto& entry = dcpConsumersMap[consumerConn->getCookie()];
+    aggrBufferSize += bufferSize - entry.second;
+    entry = {consumerConn, bufferSize};
+    LOG(EXTENSION_LOG_INFO, "%s Conn flow control buffer is %zu",
+        consumerConn->logHeader(), bufferSize);
+    return bufferSize;
+}
+
+void DcpFlowControlManagerAdaptive::handleDisconnect(
+        DcpConsumer* consumerConn) {
+    std::lock_guard<std::mutex> lh(dcpConsumersMapMutex);
+    auto iter = dcpConsumersMap.find(consumerConn->getCookie());
+    if (iter != dcpConsumersMap.end() && iter->second.first == consumerConn) {
+        aggrBufferSize -= iter->second.second;
+        dcpConsumersMap.erase(iter);
+    }
+}
+
+void DcpFlowControlManagerAdaptive::handleDrainSample(
+        DcpConsumer* consumerConn,
+        double drainRate,
+        std::chrono::microseconds ackRtt) {
+    if (ackRtt.count() == 0) {
+        /* Not measured yet */
+        return;
+    }
+    Configuration& config = engine_.getConfiguration();
+    const size_t minSize = config.getDcpConnBufferSize();
+    const size_t maxSize = config.getDcpConnBufferSizeMax();
+    const double bdp = drainRate * ackRtt.count() / 1000000;
+    size_t bufferSize = std::min(
+            maxSize, std::max(minSize, size_t(bdp * bdpHeadroom)));
+
+    std::lock_guard<std::mutex> lh(dcpConsumersMapMutex);
+    auto iter = dcpConsumersMap.find(consumerConn->getCookie());
+    if (iter == dcpConsumersMap.end() || iter->second.first != consumerConn) {
+        return;
+    }
+    const size_t current = iter->second.second;
+
+    /* Only grow within what is left of the aggregate threshold */
+    const size_t aggrLimit = config.getDcpConnBufferSizeAggrMemThreshold() *
+                             engine_.getEpStats().getMaxDataSize() / 100;
+    const size_t others = aggrBufferSize - current;
+    if (bufferSize > current && others + bufferSize > aggrLimit) {
+        bufferSize = std::max(current,
+                              aggrLimit > others ? aggrLimit - others : 0);
+    }
+
+    /* Ignore the changes of less than 1/8 (each change is a control message
+       to the producer), unless down to the min size */
+    const size_t delta = bufferSize > current ? bufferSize - current
+                                              : current - bufferSize;
+    if (delta == 0 || (delta < current / 8 && bufferSize != minSize)) {
+        return;
+    }
+    aggrBufferSize += bufferSize;
+    aggrBufferSize -= current;
+    iter->second.second = bufferSize;
+    LOG(EXTENSION_LOG_INFO, "%s Conn flow control buffer is %zu (drain rate "
+        "%.0f bytes/s, ack rtt %" PRId64 " us)", consumerConn->logHeader(),
+        bufferSize, drainRate, int64_t(ackRtt.count()));
+    consumerConn->setFlowControlBufSize(bufferSize);
+}
+
+bool DcpFlowControlManagerAdaptive::isEnabled() const {
+    return true;
+}
+
+bool DcpFlowControlManagerAdaptive::probesAckRtt() const {
+    return true;
+}
+
+size_t DcpFlowControlManagerAdaptive::getAggrBufferSize() {
+    std::lock_guard<std::mutex> lh(dcpConsumersMapMutex);
+    return aggrBufferSize;
+}
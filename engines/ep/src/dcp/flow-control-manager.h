@@ -19,6 +19,7 @@
 #define SRC_DCP_FLOW_CONTROL_MANAGER_H_ 1
 
 #include <atomic>
+#include <chrono>
 #include <mutex>
 
 #include "memcached/types.h"
@@ -47,9 +48,19 @@ public:
     /* To be called when a consumer connection is deleted */
     virtual void handleDisconnect(DcpConsumer *);
 
+    /* To be called when the drain rate (bytes/s) or the buffer ack
+       round-trip time of a consumer connection is measured again */
+    virtual void handleDrainSample(DcpConsumer*,
+                                   double drainRate,
+                                   std::chrono::microseconds ackRtt);
+
     /* Will indicate if flow control is enabled */
     virtual bool isEnabled(void) const;
 
+    /* Will indicate if the connections should keep measuring their
+       round-trip time to the producer */
+    virtual bool probesAckRtt() const;
+
 protected:
     void setBufSizeWithinBounds(DcpConsumer *consumerConn, size_t &bufSize);
 
@@ -129,4 +140,47 @@ private:
     /* Fraction of memQuota for all dcp consumer connection buffers */
     std::atomic<double> dcpConnBufferSizeAggrFrac;
 };
+
+/**
+ * In this policy the flow control buffer size of each connection is sized
+ * from how fast the connection is drained over the round-trip time of its
+ * flow control messages, i.e. its bandwidth-delay product: the bytes a
+ * producer can send before hearing of the room made for them. The
+ * window is twice that product, within the min (10 MB) and max (50 MB) conn
+ * buffer sizes. A connection starts at the min size; the windows only grow
+ * while their total stays within the aggregate threshold (10% of bucket
+ * memory), and the window of an idle connection shrinks back to the min.
+ */
+class DcpFlowControlManagerAdaptive : public DcpFlowControlManager {
+public:
+    DcpFlowControlManagerAdaptive(EventuallyPersistentEngine& engine);
+
+    ~DcpFlowControlManagerAdaptive();
+
+    size_t newConsumerConn(DcpConsumer* consumerConn);
+
+    void handleDisconnect(DcpConsumer* consumerConn);
+
+    void handleDrainSample(DcpConsumer* consumerConn,
+                           double drainRate,
+                           std::chrono::microseconds ackRtt);
+
+    bool isEnabled(void) const;
+
+    bool probesAckRtt() const;
+
+    /* Total flow control buffer size of all the connections */
+    size_t getAggrBufferSize();
+
+private:
+    /* The window, relative to the bandwidth-delay product */
+    static const size_t bdpHeadroom = 2;
+
+    /* Mutex to ensure dcpConsumersMap is thread safe */
+    std::mutex dcpConsumersMapMutex;
+    /* All DCP Consumers with flow control buffer, with their buffer size */
+    std::map<const void*, std::pair<DcpConsumer*, size_t>> dcpConsumersMap;
+    /* Total of the buffer sizes in dcpConsumersMap */
+    size_t aggrBufferSize;
+};
 #endif  /* SRC_DCP_FLOW_CONTROL_MANAGER_H_ */
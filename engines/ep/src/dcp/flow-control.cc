@@ -25,6 +25,13 @@
 #include "ep_time.h"
 #include "objectregistry.h"
 
+const size_t FlowControl::windowHistorySize;
+
+/* How long without buffer acks, or without an rtt sample, before the drain
+   rate or the rtt is sampled again */
+static const std::chrono::seconds drainSampleInterval(5);
+static const std::chrono::seconds rttProbeInterval(10);
+
 FlowControl::FlowControl(EventuallyPersistentEngine &engine,
                          DcpConsumer* consumer) :
     consumerConn(consumer),
@@ -32,12 +39,18 @@ FlowControl::FlowControl(EventuallyPersistentEngine &engine,
     pendingControl(true),
     lastBufferAck(ep_current_time()),
     ackedBytes(0),
-    freedBytes(0)
+    freedBytes(0),
+    drainRate(0),
+    lastDrainSample(ProcessClock::now()),
+    ackRtt(0),
+    rttProbeInFlight(false),
+    rttProbeOpaque(0)
 {
     enabled = engine.getDcpFlowControlManager().isEnabled();
     if (enabled) {
         bufferSize =
                     engine.getDcpFlowControlManager().newConsumerConn(consumer);
+        recordBufSize_UNLOCKED(bufferSize);
     }
 }
 
@@ -56,8 +69,9 @@ ENGINE_ERROR_CODE FlowControl::handleFlowCtl(
         if (pendingControl) {
             pendingControl = false;
             std::string buf_size(std::to_string(bufferSize));
-            lh.unlock();
             uint64_t opaque = consumerConn->incrOpaqueCounter();
+            startRttProbe_UNLOCKED(uint32_t(opaque), ProcessClock::now());
+            lh.unlock();
             const std::string &controlMsgKey = consumerConn->getControlMsgKey();
             EventuallyPersistentEngine *epe =
                                     ObjectRegistry::onSwitchThread(NULL, true);
@@ -71,30 +85,21 @@ ENGINE_ERROR_CODE FlowControl::handleFlowCtl(
         } else if (isBufferSufficientlyDrained_UNLOCKED(ackable_bytes)) {
             lh.unlock();
             /* Send a buffer ack when at least 20% of the buffer is drained */
-            uint64_t opaque = consumerConn->incrOpaqueCounter();
-            EventuallyPersistentEngine *epe =
-                                    ObjectRegistry::onSwitchThread(NULL, true);
-            ret = producers->buffer_acknowledgement(consumerConn->getCookie(),
-                                                    opaque, 0, ackable_bytes);
-            ObjectRegistry::onSwitchThread(epe);
-            lastBufferAck = ep_current_time();
-            ackedBytes.fetch_add(ackable_bytes);
-            freedBytes.fetch_sub(ackable_bytes);
-            return (ret == ENGINE_SUCCESS) ? ENGINE_WANT_MORE : ret;
+            return sendBufferAck(producers, ackable_bytes);
         } else if (ackable_bytes > 0 &&
                    (ep_current_time() - lastBufferAck) > 5) {
             lh.unlock();
             /* Ack at least every 5 seconds */
-            uint64_t opaque = consumerConn->incrOpaqueCounter();
-            EventuallyPersistentEngine *epe =
-                                    ObjectRegistry::onSwitchThread(NULL, true);
-            ret = producers->buffer_acknowledgement(consumerConn->getCookie(),
-                                                    opaque, 0, ackable_bytes);
-            ObjectRegistry::onSwitchThread(epe);
-            lastBufferAck = ep_current_time();
-            ackedBytes.fetch_add(ackable_bytes);
-            freedBytes.fetch_sub(ackable_bytes);
-            return (ret == ENGINE_SUCCESS) ? ENGINE_WANT_MORE : ret;
+            return sendBufferAck(producers, ackable_bytes);
+        } else if (ackable_bytes == 0) {
+            /* Nothing drained: sample the idle time into the drain rate */
+            const auto now = ProcessClock::now();
+            if (now - lastDrainSample < drainSampleInterval) {
+                return ENGINE_FAILED;
+            }
+            sampleDrainRate_UNLOCKED(0, now);
+            lh.unlock();
+            notifyDrainSample();
         } else {
             lh.unlock();
         }
@@ -102,6 +107,97 @@ ENGINE_ERROR_CODE FlowControl::handleFlowCtl(
     return ENGINE_FAILED;
 }
 
+ENGINE_ERROR_CODE FlowControl::sendBufferAck(
+        struct dcp_message_producers* producers, uint32_t ackable_bytes) {
+    uint64_t opaque = consumerConn->incrOpaqueCounter();
+    EventuallyPersistentEngine* epe =
+            ObjectRegistry::onSwitchThread(NULL, true);
+    ENGINE_ERROR_CODE ret = producers->buffer_acknowledgement(
+            consumerConn->getCookie(), opaque, 0, ackable_bytes);
+    ObjectRegistry::onSwitchThread(epe);
+    lastBufferAck = ep_current_time();
+    ackedBytes.fetch_add(ackable_bytes);
+    freedBytes.fetch_sub(ackable_bytes);
+
+    const auto now = ProcessClock::now();
+    bool notify;
+    {
+        std::lock_guard<SpinLock> lh(bufferSizeLock);
+        sampleDrainRate_UNLOCKED(ackable_bytes, now);
+        /* The producer doesn't answer a buffer ack that succeeds, so the rtt
+           is measured by sending the buffer size again once in a while */
+        if (!rttProbeInFlight && now - lastRttSample > rttProbeInterval &&
+            engine_.getDcpFlowControlManager().probesAckRtt()) {
+            pendingControl = true;
+        }
+        notify = !pendingControl;
+    }
+    if (notify) {
+        notifyDrainSample();
+    }
+    return (ret == ENGINE_SUCCESS) ? ENGINE_WANT_MORE : ret;
+}
+
+void FlowControl::startRttProbe_UNLOCKED(uint32_t opaque,
+                                         ProcessClock::time_point now) {
+    if (!rttProbeInFlight) {
+        rttProbeInFlight = true;
+        rttProbeOpaque = opaque;
+        rttProbeSent = now;
+    }
+}
+
+void FlowControl::handleFlowCtlResponse(uint32_t opaque) {
+    {
+        std::lock_guard<SpinLock> lh(bufferSizeLock);
+        if (!rttProbeInFlight || opaque != rttProbeOpaque) {
+            return;
+        }
+        rttProbeInFlight = false;
+        lastRttSample = ProcessClock::now();
+        const auto sample =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        lastRttSample - rttProbeSent);
+        /* Smoothed as TCP does, with a gain of 1/8 */
+        ackRtt = (ackRtt.count() == 0) ? sample : (ackRtt * 7 + sample) / 8;
+    }
+    notifyDrainSample();
+}
+
+void FlowControl::sampleDrainRate_UNLOCKED(uint64_t bytes,
+                                           ProcessClock::time_point now) {
+    const double elapsed =
+            std::chrono::duration<double>(now - lastDrainSample).count();
+    if (elapsed <= 0) {
+        return;
+    }
+    lastDrainSample = now;
+    const double sample = bytes / elapsed;
+    drainRate = (drainRate == 0) ? sample : (drainRate * 3 + sample) / 4;
+}
+
+void FlowControl::notifyDrainSample() {
+    double rate;
+    std::chrono::microseconds rtt;
+    {
+        std::lock_guard<SpinLock> lh(bufferSizeLock);
+        rate = drainRate;
+        rtt = ackRtt;
+    }
+    engine_.getDcpFlowControlManager().handleDrainSample(
+            consumerConn, rate, rtt);
+}
+
+double FlowControl::getDrainRate() {
+    std::lock_guard<SpinLock> lh(bufferSizeLock);
+    return drainRate;
+}
+
+std::chrono::microseconds FlowControl::getAckRtt() {
+    std::lock_guard<SpinLock> lh(bufferSizeLock);
+    return ackRtt;
+}
+
 void FlowControl::incrFreedBytes(uint32_t bytes)
 {
     freedBytes.fetch_add(bytes);
@@ -119,9 +215,17 @@ void FlowControl::setFlowControlBufSize(uint32_t newSize)
     if (newSize != bufferSize) {
         bufferSize = newSize;
         pendingControl = true;
+        recordBufSize_UNLOCKED(newSize);
     }
 }
 
+void FlowControl::recordBufSize_UNLOCKED(uint32_t newSize) {
+    if (windowHistory.size() == windowHistorySize) {
+        windowHistory.pop_front();
+    }
+    windowHistory.emplace_back(ep_current_time(), newSize);
+}
+
 bool FlowControl::isBufferSufficientlyDrained() {
     std::lock_guard<SpinLock> lh(bufferSizeLock);
     return isBufferSufficientlyDrained_UNLOCKED(freedBytes.load());
@@ -136,4 +240,23 @@ void FlowControl::addStats(ADD_STAT add_stat, const void *c)
     consumerConn->addStat("total_acked_bytes", ackedBytes, add_stat, c);
     consumerConn->addStat("max_buffer_bytes", bufferSize, add_stat, c);
     consumerConn->addStat("unacked_bytes", freedBytes, add_stat, c);
+
+    uint64_t rate;
+    std::chrono::microseconds rtt;
+    std::string history;
+    {
+        std::lock_guard<SpinLock> lh(bufferSizeLock);
+        rate = uint64_t(drainRate);
+        rtt = ackRtt;
+        for (const auto& entry : windowHistory) {
+            if (!history.empty()) {
+                history += ",";
+            }
+            history += std::to_string(entry.second) + "@" +
+                       std::to_string(entry.first);
+        }
+    }
+    consumerConn->addStat("drain_rate", rate, add_stat, c);
+    consumerConn->addStat("ack_rtt_us", rtt.count(), add_stat, c);
+    consumerConn->addStat("max_buffer_bytes_history", history, add_stat, c);
 }
@@ -23,8 +23,12 @@
 #include "atomic.h"
 #include "memcached/engine.h"
 
+#include <platform/processclock.h>
 #include <relaxed_atomic.h>
 
+#include <chrono>
+#include <deque>
+
 class DcpConsumer;
 class EventuallyPersistentEngine;
 
@@ -51,13 +55,42 @@ public:
 
     bool isBufferSufficientlyDrained();
 
+    /* To be called on the response of the producer to a flow control
+       message of this connection */
+    void handleFlowCtlResponse(uint32_t opaque);
+
+    /* The rate (bytes/s) the buffer is drained at, averaged over the acks */
+    double getDrainRate();
+
+    /* The smoothed round-trip time to the producer (0 until measured) */
+    std::chrono::microseconds getAckRtt();
+
     void addStats(ADD_STAT add_stat, const void *c);
 
+    /* The number of buffer size changes kept for the stats */
+    static const size_t windowHistorySize = 10;
+
 private:
     void setBufSizeWithinBounds(size_t &bufSize);
 
     bool isBufferSufficientlyDrained_UNLOCKED(uint32_t ackable_bytes);
 
+    ENGINE_ERROR_CODE sendBufferAck(struct dcp_message_producers* producers,
+                                    uint32_t ackable_bytes);
+
+    /* Measure the rtt with the message of the given opaque, if not already
+       measuring it */
+    void startRttProbe_UNLOCKED(uint32_t opaque, ProcessClock::time_point now);
+
+    /* Fold the bytes drained since the last sample into the drain rate */
+    void sampleDrainRate_UNLOCKED(uint64_t bytes,
+                                  ProcessClock::time_point now);
+
+    /* Hand the current measurements to the flow control manager */
+    void notifyDrainSample();
+
+    void recordBufSize_UNLOCKED(uint32_t newSize);
+
     /* Associated consumer connection handler */
     DcpConsumer* consumerConn;
 
@@ -85,6 +118,27 @@ private:
 
     /* Bytes processed from the flow control buffer */
     std::atomic<uint64_t> freedBytes;
+
+    /* The following are guarded by bufferSizeLock */
+
+    /* Drain rate (bytes/s), as an exponentially weighted moving average */
+    double drainRate;
+
+    /* When the drain rate was last sampled */
+    ProcessClock::time_point lastDrainSample;
+
+    /* Smoothed round-trip time of the flow control messages, and when it
+       was last sampled */
+    std::chrono::microseconds ackRtt;
+    ProcessClock::time_point lastRttSample;
+
+    /* Opaque and send time of the message the rtt is measured with */
+    bool rttProbeInFlight;
+    uint32_t rttProbeOpaque;
+    ProcessClock::time_point rttProbeSent;
+
+    /* The last changes of the buffer size, with the time they were made at */
+    std::deque<std::pair<rel_time_t, uint32_t>> windowHistory;
 };
 
 #endif  /* SRC_DCP_FLOW_CONTROL_H_ */
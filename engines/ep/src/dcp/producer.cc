@@ -29,6 +29,7 @@
 #include "failover-table.h"
 
 #include <memcached/server_api.h>
+#include <algorithm>
 #include <vector>
 
 const std::chrono::seconds DcpProducer::defaultDcpNoopTxInterval(20);
@@ -142,6 +143,10 @@ DcpProducer::DcpProducer(EventuallyPersistentEngine& e,
       log(*this),
       itemsSent(0),
       totalBytesSent(0),
+      stepBatchSize(e.getConfiguration().getDcpProducerStepBatchSize()),
+      hibernateTime(rel_time_t(
+              e.getConfiguration().getDcpStreamHibernateTime())),
+      lastHibernateCheck(ep_current_time()),
       includeValue(((flags & DCP_OPEN_NO_VALUE) != 0) ?
               IncludeValue::No : IncludeValue::Yes),
       includeXattrs(((flags & DCP_OPEN_INCLUDE_XATTRS) != 0) ?
@@ -192,6 +197,8 @@ DcpProducer::DcpProducer(EventuallyPersistentEngine& e,
 
     enableExtMetaData = false;
     enableValueCompression = false;
+    snapshotCoalesceBytes = 0;
+    snapshotCoalesceMs = 0;
 
     // Cursor dropping is disabled for replication connections by default,
     // but will be enabled through a control message to support backward
@@ -509,23 +516,58 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
         return ret;
     }
 
-    std::unique_ptr<DcpResponse> resp;
-    if (rejectResp) {
-        resp = std::move(rejectResp);
-    } else {
-        resp = getNextItem();
-        if (!resp) {
-            return ENGINE_SUCCESS;
+    // Hand up to a batch of responses to the connection, so that they are
+    // all sent at once. Stop early when flow control or the ready queue
+    // have nothing more to send, or the connection's buffer is full.
+    const size_t batchSize = stepBatchSize;
+    size_t sent = 0;
+    ret = ENGINE_SUCCESS;
+    while (sent < batchSize) {
+        std::unique_ptr<DcpResponse> resp;
+        if (rejectResp) {
+            resp = std::move(rejectResp);
+        } else {
+            resp = getNextItem();
+            if (!resp) {
+                break;
+            }
+        }
+
+        ret = sendResponse(producers, std::move(resp));
+        if (ret != ENGINE_SUCCESS) {
+            break;
+        }
+        ++sent;
+    }
+
+    if (sent == 0) {
+        if (ret == ENGINE_SUCCESS) {
+            maybeHibernateStreams();
         }
+        return ret;
     }
+    // What couldn't be sent is stashed for the next step, once the
+    // responses already handed to the connection are on the wire
+    if (ret == ENGINE_SUCCESS || ret == ENGINE_E2BIG ||
+        ret == ENGINE_ENOMEM) {
+        return ENGINE_WANT_MORE;
+    }
+    return ret;
+}
 
+ENGINE_ERROR_CODE DcpProducer::sendResponse(
+        struct dcp_message_producers* producers,
+        std::unique_ptr<DcpResponse> resp) {
+    ENGINE_ERROR_CODE ret;
     Item* itmCpy = nullptr;
     auto* mutationResponse =
             dynamic_cast<MutationProducerResponse*>(resp.get());
     if (mutationResponse) {
         try {
             itmCpy = mutationResponse->getItemCopy();
-            itmCpy->pruneValueAndOrXattrs(includeValue, includeXattrs);
+            if (!mutationResponse->isValuePrepared()) {
+                itmCpy->pruneValueAndOrXattrs(includeValue, includeXattrs);
+            }
         } catch (const std::bad_alloc&) {
             rejectResp = std::move(resp);
             LOG(EXTENSION_LOG_WARNING,
@@ -537,10 +579,12 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
             return ENGINE_ENOMEM;
         }
 
-        if (enableValueCompression) {
+        if (enableValueCompression && !mutationResponse->isValuePrepared()) {
             /**
              * If value compression is enabled, the producer will need
-             * to snappy-compress the document before transmitting.
+             * to snappy-compress the document before transmitting (unless
+             * the stream already did, see
+             * ActiveStream::makeCompressedResponse).
              * Compression will obviously be done only if the datatype
              * indicates that the value isn't compressed already.
              */
@@ -575,7 +619,8 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
         {
             if (itmCpy == nullptr) {
                 throw std::logic_error(
-                    "DcpProducer::step(Mutation): itmCpy must be != nullptr");
+                    "DcpProducer::sendResponse(Mutation): itmCpy must be != "
+                    "nullptr");
             }
             std::pair<const char*, uint16_t> meta{nullptr, 0};
             if (mutationResponse->getExtMetaData()) {
@@ -599,7 +644,8 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
         {
             if (itmCpy == nullptr) {
                 throw std::logic_error(
-                    "DcpProducer::step(Deletion): itmCpy must be != nullptr");
+                    "DcpProducer::sendResponse(Deletion): itmCpy must be != "
+                    "nullptr");
             }
             std::pair<const char*, uint16_t> meta{nullptr, 0};
             if (mutationResponse->getExtMetaData()) {
@@ -674,7 +720,7 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
     }
 
     lastSendTime = ep_current_time();
-    return (ret == ENGINE_SUCCESS) ? ENGINE_WANT_MORE : ret;
+    return ret;
 }
 
 ENGINE_ERROR_CODE DcpProducer::bufferAcknowledgement(uint32_t opaque,
@@ -733,6 +779,18 @@ ENGINE_ERROR_CODE DcpProducer::control(uint32_t opaque, const void* key,
             supportsCursorDropping = false;
         }
         return ENGINE_SUCCESS;
+    } else if (strncmp(param, "snapshot_coalesce_bytes", nkey) == 0) {
+        uint32_t bytes;
+        if (parseUint32(valueStr.c_str(), &bytes)) {
+            snapshotCoalesceBytes = bytes;
+            return ENGINE_SUCCESS;
+        }
+    } else if (strncmp(param, "snapshot_coalesce_ms", nkey) == 0) {
+        uint32_t ms;
+        if (parseUint32(valueStr.c_str(), &ms)) {
+            snapshotCoalesceMs = ms;
+            return ENGINE_SUCCESS;
+        }
     } else if (strncmp(param, "set_noop_interval", nkey) == 0) {
         uint32_t noopInterval;
         if (parseUint32(valueStr.c_str(), &noopInterval)) {
@@ -758,17 +816,21 @@ ENGINE_ERROR_CODE DcpProducer::control(uint32_t opaque, const void* key,
             }
         }
     } else if(strncmp(param, "set_priority", nkey) == 0) {
+        Configuration& config = engine_.getConfiguration();
         if (valueStr == "high") {
             engine_.setDCPPriority(getCookie(), CONN_PRIORITY_HIGH);
             priority.assign("high");
+            applyPriorityWeight(config.getDcpPriorityWeightHigh());
             return ENGINE_SUCCESS;
         } else if (valueStr == "medium") {
             engine_.setDCPPriority(getCookie(), CONN_PRIORITY_MED);
             priority.assign("medium");
+            applyPriorityWeight(config.getDcpPriorityWeightMedium());
             return ENGINE_SUCCESS;
         } else if (valueStr == "low") {
             engine_.setDCPPriority(getCookie(), CONN_PRIORITY_LOW);
             priority.assign("low");
+            applyPriorityWeight(config.getDcpPriorityWeightLow());
             return ENGINE_SUCCESS;
         }
     }
@@ -883,6 +945,10 @@ void DcpProducer::recordBackfillManagerBytesSent(size_t bytes) {
     backfillMgr->bytesSent(bytes);
 }
 
+void DcpProducer::resetBackfillManagerScanBuffer() {
+    backfillMgr->resetScanBuffer();
+}
+
 void DcpProducer::scheduleBackfillManager(VBucket& vb,
                                           const active_stream_t& s,
                                           uint64_t start,
@@ -909,6 +975,8 @@ void DcpProducer::addStats(ADD_STAT add_stat, const void *c) {
     addStat("cursor_dropping",
             supportsCursorDropping ? "ELIGIBLE" : "NOT_ELIGIBLE",
             add_stat, c);
+    addStat("snapshot_coalesce_bytes", snapshotCoalesceBytes, add_stat, c);
+    addStat("snapshot_coalesce_ms", snapshotCoalesceMs, add_stat, c);
 
     // Possible that the producer has had its streams closed and hence doesn't
     // have a backfill manager anymore.
@@ -930,9 +998,15 @@ void DcpProducer::addStats(ADD_STAT add_stat, const void *c) {
             valid_streams.push_back(element.second);
         }
     );
+    size_t hibernating = 0;
     for (const auto& stream : valid_streams) {
         stream->addStats(add_stat, c);
+        if (stream->isTypeActive() &&
+            static_cast<ActiveStream*>(stream.get())->isHibernating()) {
+            hibernating++;
+        }
     }
+    addStat("num_hibernating_streams", hibernating, add_stat, c);
 }
 
 void DcpProducer::addTakeoverStats(ADD_STAT add_stat, const void* c,
@@ -1186,6 +1260,27 @@ ENGINE_ERROR_CODE DcpProducer::maybeSendNoop(
     return ENGINE_FAILED;
 }
 
+void DcpProducer::maybeHibernateStreams() {
+    const auto now = ep_current_time();
+    if (hibernateTime == 0 || (now - lastHibernateCheck) < hibernateTime) {
+        return;
+    }
+    lastHibernateCheck = now;
+
+    // As addStats, don't hold the streams map locked while taking the
+    // streamMutex of each stream
+    std::vector<StreamsMap::mapped_type> activeStreams;
+    streams.for_each([&activeStreams](const StreamsMap::value_type& iter) {
+        if (iter.second->isTypeActive()) {
+            activeStreams.push_back(iter.second);
+        }
+    });
+    for (const auto& stream : activeStreams) {
+        static_cast<ActiveStream*>(stream.get())
+                ->maybeHibernate(now, hibernateTime);
+    }
+}
+
 void DcpProducer::clearQueues() {
     streams.for_each(
         [](StreamsMap::value_type& iter) {
@@ -1229,6 +1324,23 @@ bool DcpProducer::bufferLogInsert(size_t bytes) {
     return log.insert(bytes);
 }
 
+void DcpProducer::applyPriorityWeight(size_t weight) {
+    Configuration& config = engine_.getConfiguration();
+    const size_t mediumWeight = config.getDcpPriorityWeightMedium();
+    auto scale = [weight, mediumWeight](size_t limit) {
+        return std::max(size_t(1), limit * weight / mediumWeight);
+    };
+
+    if (checkpointCreatorTask) {
+        static_cast<ActiveStreamCheckpointProcessorTask*>(
+                checkpointCreatorTask.get())
+                ->setIterationsBeforeYield(scale(
+                        config.getDcpProducerSnapshotMarkerYieldLimit()));
+    }
+    backfillMgr->setScanBufferLimits(scale(config.getDcpScanByteLimit()),
+                                     scale(config.getDcpScanItemLimit()));
+}
+
 void DcpProducer::createCheckpointProcessorTask() {
     checkpointCreatorTask =
             std::make_shared<ActiveStreamCheckpointProcessorTask>(engine_);
@@ -90,6 +90,11 @@ public:
 
     void aggregateQueueStats(ConnCounter& aggregator) override;
 
+    /// @return the priority class of the connection (high, medium or low)
+    std::string getPriority() const {
+        return priority;
+    }
+
     void setDisconnect() override;
 
     void notifySeqnoAvailable(uint16_t vbucket, uint64_t seqno);
@@ -131,6 +136,7 @@ public:
     void notifyBackfillManager();
     bool recordBackfillManagerBytesRead(size_t bytes, bool force);
     void recordBackfillManagerBytesSent(size_t bytes);
+    void resetBackfillManagerScanBuffer();
     void scheduleBackfillManager(VBucket& vb,
                                  const active_stream_t& s,
                                  uint64_t start,
@@ -144,6 +150,29 @@ public:
         return enableValueCompression;
     }
 
+    /**
+     * The maximum bytes of the snapshot the contiguous in-memory checkpoints
+     * of a stream are merged into (0 if they aren't merged)
+     */
+    size_t getSnapshotCoalesceBytes() const {
+        return snapshotCoalesceBytes;
+    }
+
+    /**
+     * How long a stream lets the checkpoints build up before reading them,
+     * so that they make one snapshot (0 to read them as soon as available)
+     */
+    std::chrono::milliseconds getSnapshotCoalesceWait() const {
+        return std::chrono::milliseconds(snapshotCoalesceMs.load());
+    }
+
+    /**
+     * Set the maximum number of responses a call to step() sends
+     */
+    void setStepBatchSize(size_t newValue) {
+        stepBatchSize = newValue;
+    }
+
     void notifyPaused(bool schedule);
 
     class BufferLog {
@@ -262,6 +291,13 @@ protected:
      */
     ENGINE_ERROR_CODE maybeSendNoop(struct dcp_message_producers* producers);
 
+    /**
+     * Put the active streams which have been idle for hibernateTime into
+     * hibernation (see ActiveStream::maybeHibernate). Called by step()
+     * when there is nothing to send, at most once every hibernateTime.
+     */
+    void maybeHibernateStreams();
+
     /**
      * Create the ActiveStreamCheckpointProcessorTask and assign to
      * checkpointCreatorTask
@@ -286,9 +322,26 @@ protected:
 
     std::unique_ptr<DcpResponse> getNextItem();
 
+    /**
+     * Send a response through the connection's producers, stashing it in
+     * rejectResp for a retry if the connection can't take it.
+     *
+     * @return ENGINE_SUCCESS if sent, else the error of the producer (e.g.
+     *         ENGINE_E2BIG if the connection's buffer is full)
+     */
+    ENGINE_ERROR_CODE sendResponse(struct dcp_message_producers* producers,
+                                   std::unique_ptr<DcpResponse> resp);
+
     size_t getItemsRemaining();
     stream_t findStreamByVbid(uint16_t vbid);
 
+    /**
+     * Scale the share of the checkpoint processor and backfill tasks the
+     * producer gets to the weight of its priority class, relative to the
+     * medium class (whose share is the configured one).
+     */
+    void applyPriorityWeight(size_t weight);
+
     std::string priority;
 
     // stash response for retry if E2BIG was hit
@@ -299,6 +352,8 @@ protected:
     Couchbase::RelaxedAtomic<bool> enableExtMetaData;
     Couchbase::RelaxedAtomic<bool> enableValueCompression;
     Couchbase::RelaxedAtomic<bool> supportsCursorDropping;
+    Couchbase::RelaxedAtomic<size_t> snapshotCoalesceBytes;
+    Couchbase::RelaxedAtomic<uint32_t> snapshotCoalesceMs;
 
     Couchbase::RelaxedAtomic<rel_time_t> lastSendTime;
     BufferLog log;
@@ -318,6 +373,14 @@ protected:
     std::atomic<size_t> itemsSent;
     std::atomic<size_t> totalBytesSent;
 
+    // The maximum number of responses a call to step() sends
+    std::atomic<size_t> stepBatchSize;
+
+    // How long an active stream has to be idle for to hibernate (0 if
+    // never), and when the streams were last checked for it
+    const rel_time_t hibernateTime;
+    rel_time_t lastHibernateCheck;
+
     ExTask checkpointCreatorTask;
     static const std::chrono::seconds defaultDcpNoopTxInterval;
 
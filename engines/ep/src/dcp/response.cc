@@ -70,8 +70,11 @@ uint32_t MutationResponse::getMessageSize() const {
     uint32_t body = item_->getKey().size();
     uint32_t sz = 0;
 
-    // If the item has xattributes then calculate the size of the xattributes
-    if (mcbp::datatype::is_xattr(item_->getDataType())) {
+    // If the item has xattributes (and they aren't sent along with all the
+    // value anyway) then calculate the size of the xattributes
+    if (mcbp::datatype::is_xattr(item_->getDataType()) &&
+        (includeXattributes == IncludeXattrs::No ||
+         includeValue == IncludeValue::No)) {
         auto root = reinterpret_cast<const char*>(item_->getData());
         const cb::const_char_buffer buffer{root,
                                            item_->getValue()->valueSize()};
@@ -378,7 +378,12 @@ public:
         return item_;
     }
 
-    /// @return pointer to copy of the item.
+    /**
+     * @return pointer to copy of the item. The copy shares the refcounted
+     *         value Blob rather than copying it: the connection sends the
+     *         value straight from it, and releases the copy (hence its
+     *         reference) once the message is written.
+     */
     Item* getItemCopy() {
         return new Item(*item_);
     }
@@ -453,8 +458,21 @@ public:
         return collectionLen;
     }
 
+    /**
+     * Mark the item as already pruned and compressed for the connection,
+     * so that the producer sends it as is.
+     */
+    void setValuePrepared() {
+        valuePrepared = true;
+    }
+
+    bool isValuePrepared() const {
+        return valuePrepared;
+    }
+
 private:
     uint8_t collectionLen;
+    bool valuePrepared = false;
 };
 
 /**
@@ -266,6 +266,9 @@ ActiveStream::ActiveStream(EventuallyPersistentEngine* e,
       producer(p),
       lastSentSnapEndSeqno(0),
       chkptItemsExtractionInProgress(false),
+      lastActivityTime(ep_current_time()),
+      hibernating(false),
+      hibernations(0),
       includeValue(includeVal),
       includeXattributes(includeXattrs),
       filter(std::move(filter)) {
@@ -302,6 +305,8 @@ ActiveStream::ActiveStream(EventuallyPersistentEngine* e,
 
     takeoverStart = 0;
     takeoverSendMaxTime = engine->getConfiguration().getDcpTakeoverMaxTime();
+    takeoverPauseBacklog =
+            engine->getConfiguration().getDcpTakeoverPauseBacklog();
 
     if (start_seqno_ >= end_seqno_) {
         /* streamMutex lock needs to be acquired because endStream
@@ -357,10 +362,33 @@ std::unique_ptr<DcpResponse> ActiveStream::next(
             break;
     }
 
+    if (response) {
+        lastActivityTime.store(ep_current_time());
+        hibernating.store(false);
+    }
     itemsReady.store(response ? true : false);
     return response;
 }
 
+bool ActiveStream::maybeHibernate(rel_time_t now, rel_time_t idleTime) {
+    if (hibernating.load() || itemsReady.load() ||
+        (now - lastActivityTime.load()) < idleTime) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lh(streamMutex);
+    // Only a stream waiting for new mutations in memory is idle; one which
+    // is backfilling or taking over is still going to send something
+    if (!isInMemory() || pendingBackfill || chkptItemsExtractionInProgress ||
+        itemsReady || !readyQ.empty()) {
+        return false;
+    }
+    readyQ.release();
+    hibernating.store(true);
+    hibernations++;
+    return true;
+}
+
 void ActiveStream::registerCursor(CheckpointManager& chkptmgr,
                                   uint64_t lastProcessedSeqno) {
     try {
@@ -469,10 +497,11 @@ bool ActiveStream::backfillReceived(std::unique_ptr<Item> itm,
     }
 
     if (itm->shouldReplicate()) {
+        // Built before taking the lock, as it may compress the value
+        queued_item qi(std::move(itm));
+        std::unique_ptr<DcpResponse> resp(makeResponseFromItem(qi));
         std::unique_lock<std::mutex> lh(streamMutex);
         if (isBackfilling()) {
-            queued_item qi(std::move(itm));
-            std::unique_ptr<DcpResponse> resp(makeResponseFromItem(qi));
             if (!producer->recordBackfillManagerBytesRead(
                         resp->getApproximateSize(), force)) {
                 // Deleting resp may also delete itm (which is owned by resp)
@@ -482,7 +511,12 @@ bool ActiveStream::backfillReceived(std::unique_ptr<Item> itm,
 
             bufferedBackfill.bytes.fetch_add(resp->getApproximateSize());
             bufferedBackfill.items++;
-            lastReadSeqno.store(uint64_t(*resp->getBySeqno()));
+            // A backfill by key reads the seqnos in any order, and the
+            // stream carries on from the highest one once it's done
+            const uint64_t seqno = *resp->getBySeqno();
+            if (seqno > lastReadSeqno.load()) {
+                lastReadSeqno.store(seqno);
+            }
 
             pushToReadyQ(std::move(resp));
 
@@ -573,6 +607,13 @@ void ActiveStream::setVBucketStateAckRecieved() {
                                                         false /* notify_dcp */,
                                                         epVbSetLh,
                                                         &vbStateLh);
+                // Now that it is dead the writes are refused anyway
+                if (takeoverWritesPaused) {
+                    vbucket->setTakeoverBackedUpState(false);
+                    takeoverWritesPaused = false;
+                } else {
+                    takeoverUnavailableStart = gethrtime();
+                }
 
                 producer->getLogger().log(EXTENSION_LOG_NOTICE,
                         "(vb %" PRIu16 ") Vbucket marked as dead, last sent "
@@ -581,10 +622,16 @@ void ActiveStream::setVBucketStateAckRecieved() {
                         lastSentSeqno.load(),
                         vbucket->getHighSeqno());
             } else {
+                const auto unavailable =
+                        (gethrtime() - takeoverUnavailableStart) / 1000;
+                engine->getEpStats().dcpTakeoverUnavailableHisto.add(
+                        unavailable);
                 producer->getLogger().log(EXTENSION_LOG_NOTICE,
                         "(vb %" PRIu16 ") Receive ack for set vbucket state to "
-                        "active message",
-                        vb_);
+                        "active message, vbucket was unavailable for "
+                        "%" PRIu64 " us",
+                        vb_,
+                        uint64_t(unavailable));
                 endStream(END_STREAM_OK);
             }
         } else {
@@ -681,6 +728,25 @@ std::unique_ptr<DcpResponse> ActiveStream::takeoverSendPhase() {
         vb->setTakeoverBackedUpState(true);
     }
 
+    // Once we're close to done pause the writes to the vbucket, so that
+    // the backlog stops growing and is sent in one go. The writes stay
+    // paused until the vbucket is marked as dead, which leaves nothing
+    // to send while it is.
+    if (vb && takeoverPauseBacklog != 0 && !takeoverWritesPaused &&
+        takeoverState == vbucket_state_pending &&
+        getItemsRemaining() <= takeoverPauseBacklog) {
+        vb->setTakeoverBackedUpState(true);
+        takeoverWritesPaused = true;
+        takeoverUnavailableStart = gethrtime();
+        producer->getLogger().log(EXTENSION_LOG_NOTICE,
+                                  "(vb %" PRIu16 ") Pausing the writes for "
+                                  "the takeover, last sent seqno: %" PRIu64
+                                  ", high seqno: %" PRIu64,
+                                  vb_,
+                                  lastSentSeqno.load(),
+                                  vb->getHighSeqno());
+    }
+
     if (!readyQ.empty()) {
         return nextQueuedItem();
     } else {
@@ -694,7 +760,9 @@ std::unique_ptr<DcpResponse> ActiveStream::takeoverSendPhase() {
     }
 
     if (vb) {
-        vb->setTakeoverBackedUpState(false);
+        if (!takeoverWritesPaused) {
+            vb->setTakeoverBackedUpState(false);
+        }
         takeoverStart = 0;
     }
 
@@ -725,6 +793,33 @@ std::unique_ptr<DcpResponse> ActiveStream::deadPhase() {
     return resp;
 }
 
+void ActiveStream::sharedBackfillCancelled(bool snapshotMarked) {
+    if (snapshotMarked) {
+        producer->getLogger().log(EXTENSION_LOG_WARNING,
+                                  "(vb %" PRIu16 ") Ending the stream as the "
+                                  "backfill it shares was cancelled",
+                                  vb_);
+        setDead(END_STREAM_BACKFILL_FAIL);
+        return;
+    }
+
+    LockHolder lh(streamMutex);
+    isBackfillTaskRunning.store(false);
+    if (isBackfilling()) {
+        scheduleBackfill_UNLOCKED(false);
+    }
+}
+
+void ActiveStream::resetBackfillScanBuffer() {
+    producer->resetBackfillManagerScanBuffer();
+}
+
+std::unique_ptr<Collections::VB::Filter> ActiveStream::copyFilter() {
+    // The filter is only modified under the streamMutex
+    std::lock_guard<std::mutex> lh(streamMutex);
+    return std::make_unique<Collections::VB::Filter>(*filter);
+}
+
 bool ActiveStream::isCompressionEnabled() {
     return producer->isValueCompressionEnabled();
 }
@@ -765,6 +860,13 @@ void ActiveStream::addStats(ADD_STAT add_stat, const void *c) {
                          name_.c_str(), vb_);
         add_casted_stat(buffer, itemsReady.load() ? "true" : "false", add_stat,
                         c);
+        checked_snprintf(buffer, bsize, "%s:stream_%d_hibernating",
+                         name_.c_str(), vb_);
+        add_casted_stat(buffer, hibernating.load() ? "true" : "false",
+                        add_stat, c);
+        checked_snprintf(buffer, bsize, "%s:stream_%d_hibernations",
+                         name_.c_str(), vb_);
+        add_casted_stat(buffer, hibernations.load(), add_stat, c);
         checked_snprintf(buffer, bsize, "%s:stream_%d_backfill_buffer_bytes",
                          name_.c_str(), vb_);
         add_casted_stat(buffer, bufferedBackfill.bytes, add_stat, c);
@@ -778,6 +880,10 @@ void ActiveStream::addStats(ADD_STAT add_stat, const void *c) {
             add_casted_stat(buffer, ep_current_time() - takeoverStart, add_stat,
                             c);
         }
+        checked_snprintf(buffer, bsize,
+                         "%s:stream_%d_takeover_writes_paused",
+                         name_.c_str(), vb_);
+        add_casted_stat(buffer, takeoverWritesPaused.load(), add_stat, c);
     } catch (std::exception& error) {
         LOG(EXTENSION_LOG_WARNING,
             "ActiveStream::addStats: Failed to build stats: %s", error.what());
@@ -889,12 +995,24 @@ bool ActiveStreamCheckpointProcessorTask::run() {
     notified.store(false);
 
     size_t iterations = 0;
+    // The streams waiting for more checkpoints to coalesce, and the time
+    // until the first of them is done waiting
+    std::vector<stream_t> waiting;
+    std::chrono::milliseconds minDelay(0);
     do {
         stream_t nextStream = queuePop();
         ActiveStream* stream = static_cast<ActiveStream*>(nextStream.get());
 
         if (stream) {
-            stream->nextCheckpointItemTask();
+            const auto delay = stream->getSnapshotCoalesceDelay();
+            if (delay.count() > 0) {
+                if (waiting.empty() || delay < minDelay) {
+                    minDelay = delay;
+                }
+                waiting.push_back(nextStream);
+            } else {
+                stream->nextCheckpointItemTask();
+            }
         } else {
             break;
         }
@@ -904,10 +1022,16 @@ bool ActiveStreamCheckpointProcessorTask::run() {
 
     // Now check if we were re-notified or there are still checkpoints
     bool expected = true;
-    if (notified.compare_exchange_strong(expected, false)
-        || !queueEmpty()) {
+    const bool more = notified.compare_exchange_strong(expected, false) ||
+                      !queueEmpty();
+    for (const auto& stream : waiting) {
+        pushUnique(stream);
+    }
+    if (more) {
         // wakeUp, essentially yielding and allowing other tasks a go
         wakeUp();
+    } else if (!waiting.empty()) {
+        snooze(minDelay.count() / 1000.0);
     }
 
     return true;
@@ -968,6 +1092,9 @@ std::unique_ptr<DcpResponse> ActiveStream::makeResponseFromItem(
         queued_item& item) {
     if (item->getOperation() != queue_op::system_event) {
         auto cKey = Collections::DocKey::make(item->getKey(), currentSeparator);
+        if (isCompressionEnabled()) {
+            return makeCompressedResponse(item, cKey.getCollectionLen());
+        }
         return std::make_unique<MutationProducerResponse>(
                 item,
                 opaque_,
@@ -979,6 +1106,44 @@ std::unique_ptr<DcpResponse> ActiveStream::makeResponseFromItem(
     }
 }
 
+std::unique_ptr<DcpResponse> ActiveStream::makeCompressedResponse(
+        queued_item& item, uint8_t collectionLen) {
+    auto copy = std::make_unique<Item>(*item);
+    const auto datatype = copy->getDataType();
+    const bool pruned = includeValue == IncludeValue::No ||
+                        includeXattributes == IncludeXattrs::No;
+    // The xattrs can only be pruned from the uncompressed value
+    if (pruned && mcbp::datatype::is_xattr(datatype) &&
+        mcbp::datatype::is_snappy(datatype) && !copy->decompressValue()) {
+        producer->getLogger().log(EXTENSION_LOG_WARNING,
+                                  "(vb %" PRIu16 ") Failed to snappy "
+                                  "uncompress a value to prune, seqno:%" PRId64,
+                                  vb_,
+                                  copy->getBySeqno());
+    }
+    copy->pruneValueAndOrXattrs(includeValue, includeXattributes);
+    if (copy->getNBytes() > 0 &&
+        !copy->compressValue(
+                engine->getDcpConnMap().getMinCompressionRatio())) {
+        producer->getLogger().log(EXTENSION_LOG_WARNING,
+                                  "(vb %" PRIu16 ") Failed to snappy "
+                                  "compress an uncompressed value, "
+                                  "seqno:%" PRId64,
+                                  vb_,
+                                  copy->getBySeqno());
+    }
+
+    // All of what the copy holds is to be sent
+    auto resp = std::make_unique<MutationProducerResponse>(
+            queued_item(std::move(copy)),
+            opaque_,
+            IncludeValue::Yes,
+            IncludeXattrs::Yes,
+            collectionLen);
+    resp->setValuePrepared();
+    return std::move(resp);
+}
+
 void ActiveStream::processItems(std::vector<queued_item>& items) {
     if (!items.empty()) {
         bool mark = false;
@@ -986,6 +1151,11 @@ void ActiveStream::processItems(std::vector<queued_item>& items) {
             mark = true;
         }
 
+        /* When coalescing, mutations holds the items of one checkpoint at a
+           time, which are then merged into the snapshot of the ones before */
+        const size_t coalesceBytes = producer->getSnapshotCoalesceBytes();
+        CoalescedSnapshot coalesced;
+
         std::deque<std::unique_ptr<DcpResponse>> mutations;
         for (auto& qi : items) {
             if (SystemEventReplicate::process(*qi) == ProcessStatus::Continue) {
@@ -993,10 +1163,13 @@ void ActiveStream::processItems(std::vector<queued_item>& items) {
                 lastReadSeqnoUnSnapshotted = qi->getBySeqno();
                 mutations.push_back(makeResponseFromItem(qi));
             } else if (qi->getOperation() == queue_op::checkpoint_start) {
-                /* if there are already other mutations, then they belong to the
-                   previous checkpoint and hence we must create a snapshot and
-                   put them onto readyQ */
-                if (!mutations.empty()) {
+                if (coalesceBytes) {
+                    coalesceCheckpoint(
+                            coalesced, mutations, mark, coalesceBytes);
+                } else if (!mutations.empty()) {
+                    /* if there are already other mutations, then they belong
+                       to the previous checkpoint and hence we must create a
+                       snapshot and put them onto readyQ */
                     snapshot(mutations, mark);
                     /* clear out all the mutations since they are already put
                        onto the readyQ */
@@ -1007,6 +1180,12 @@ void ActiveStream::processItems(std::vector<queued_item>& items) {
             }
         }
 
+        if (coalesceBytes) {
+            coalesceCheckpoint(coalesced, mutations, mark, coalesceBytes);
+            mutations.swap(coalesced.items);
+            mark = coalesced.mark;
+        }
+
         if (mutations.empty()) {
             // If we only got checkpoint start or ends check to see if there are
             // any more snapshots before pausing the stream.
@@ -1021,6 +1200,71 @@ void ActiveStream::processItems(std::vector<queued_item>& items) {
     producer->notifyStreamReady(vb_);
 }
 
+void ActiveStream::coalesceCheckpoint(
+        CoalescedSnapshot& snap,
+        std::deque<std::unique_ptr<DcpResponse>>& checkpoint,
+        bool mark,
+        size_t maxBytes) {
+    if (checkpoint.empty()) {
+        return;
+    }
+
+    auto getKey = [](DcpResponse& resp) -> const StoredDocKey* {
+        switch (resp.getEvent()) {
+        case DcpResponse::Event::Mutation:
+        case DcpResponse::Event::Deletion:
+        case DcpResponse::Event::Expiration:
+            return &static_cast<MutationResponse&>(resp).getItem()->getKey();
+        default:
+            return nullptr;
+        }
+    };
+
+    size_t bytes = 0;
+    bool duplicate = false;
+    for (auto& resp : checkpoint) {
+        bytes += resp->getMessageSize();
+        auto* key = getKey(*resp);
+        duplicate = duplicate || (key && snap.keys.count(*key) > 0);
+    }
+
+    // A snapshot has each key once, as the consumer expects
+    if (!snap.items.empty() && (duplicate || snap.bytes + bytes > maxBytes)) {
+        snapshot(snap.items, snap.mark);
+        snap = CoalescedSnapshot();
+    }
+
+    snap.mark = snap.mark || mark;
+    snap.bytes += bytes;
+    for (auto& resp : checkpoint) {
+        if (auto* key = getKey(*resp)) {
+            snap.keys.insert(*key);
+        }
+        snap.items.push_back(std::move(resp));
+    }
+    checkpoint.clear();
+}
+
+std::chrono::milliseconds ActiveStream::getSnapshotCoalesceDelay() {
+    const auto wait = producer->getSnapshotCoalesceWait();
+    if (wait.count() == 0 || !isInMemory()) {
+        coalesceWaitStart = ProcessClock::time_point();
+        return std::chrono::milliseconds(0);
+    }
+
+    const auto now = ProcessClock::now();
+    if (coalesceWaitStart == ProcessClock::time_point()) {
+        coalesceWaitStart = now;
+    }
+    const auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - coalesceWaitStart);
+    if (waited >= wait) {
+        coalesceWaitStart = ProcessClock::time_point();
+        return std::chrono::milliseconds(0);
+    }
+    return wait - waited;
+}
+
 void ActiveStream::snapshot(std::deque<std::unique_ptr<DcpResponse>>& items,
                             bool mark) {
     if (items.empty()) {
@@ -1102,6 +1346,10 @@ uint32_t ActiveStream::setDead(end_stream_status_t status) {
 
 void ActiveStream::notifySeqnoAvailable(uint64_t seqno) {
     if (isActive()) {
+        // Wake up from hibernation (if hibernating); the readyQ allocates
+        // its storage again once there is something to queue
+        hibernating.store(false);
+        lastActivityTime.store(ep_current_time());
         bool inverse = false;
         if (itemsReady.compare_exchange_strong(inverse, true)) {
             producer->notifyStreamReady(vb_);
@@ -1466,6 +1714,12 @@ void ActiveStream::transitionState(StreamState newState) {
                 VBucketPtr vb = engine->getVBucket(vb_);
                 if (vb) {
                     vb->checkpointManager->removeCursor(name_);
+                    // Don't leave the vbucket refusing writes if the
+                    // takeover didn't complete
+                    if (takeoverWritesPaused) {
+                        vb->setTakeoverBackedUpState(false);
+                        takeoverWritesPaused = false;
+                    }
                 }
                 break;
             }
@@ -1990,7 +2244,7 @@ process_items_error_t PassiveStream::processBufferedMessages(uint32_t& processed
     uint32_t total_bytes_processed = 0;
     bool failed = false, noMem = false;
 
-    while (count < batchSize && !buffer.messages.empty()) {
+    while (count < batchSize && buffer.front(lh) != nullptr) {
         ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
         /* If the stream is in dead state we should not process any remaining
            items in the buffer, we should rather clear them */
@@ -2000,6 +2254,45 @@ process_items_error_t PassiveStream::processBufferedMessages(uint32_t& processed
             return all_processed;
         }
 
+        // Consecutive mutations are set into the vbucket together
+        if (buffer.front(lh)->getEvent() == DcpResponse::Event::Mutation) {
+            std::vector<std::unique_ptr<DcpResponse>> mutations;
+            do {
+                mutations.push_back(buffer.pop_front(lh));
+            } while (count + mutations.size() < batchSize &&
+                     buffer.front(lh) != nullptr &&
+                     buffer.front(lh)->getEvent() ==
+                             DcpResponse::Event::Mutation);
+            lh.unlock();
+
+            size_t numProcessed;
+            uint32_t bytesProcessed;
+            ENGINE_ERROR_CODE ret = processMutationBatch(
+                    mutations, numProcessed, bytesProcessed);
+            total_bytes_processed += bytesProcessed;
+            count += numProcessed;
+            if (ret == ENGINE_TMPFAIL || ret == ENGINE_ENOMEM) {
+                failed = true;
+                noMem = ret == ENGINE_ENOMEM;
+            }
+
+            lh.lock();
+            if (numProcessed < mutations.size()) {
+                if (isActive()) {
+                    // Stash the mutations not processed back at the front
+                    while (mutations.size() > numProcessed) {
+                        buffer.push_front(std::move(mutations.back()), lh);
+                        mutations.pop_back();
+                    }
+                    break;
+                }
+                // As for a single message, the mutations of a dead stream
+                // are dropped
+                count += mutations.size() - numProcessed;
+            }
+            continue;
+        }
+
         std::unique_ptr<DcpResponse> response = buffer.pop_front(lh);
 
         // Release bufMutex whilst we attempt to process the message
@@ -2093,33 +2386,11 @@ ENGINE_ERROR_CODE PassiveStream::processMutation(MutationResponse* mutation) {
         return ENGINE_NOT_MY_VBUCKET;
     }
 
-    if (uint64_t(*mutation->getBySeqno()) < cur_snapshot_start.load() ||
-        uint64_t(*mutation->getBySeqno()) > cur_snapshot_end.load()) {
-        consumer->getLogger().log(EXTENSION_LOG_WARNING,
-            "(vb %d) Erroneous mutation [sequence "
-            "number does not fall in the expected snapshot range : "
-            "{snapshot_start (%" PRIu64 ") <= seq_no (%" PRIu64 ") <= "
-            "snapshot_end (%" PRIu64 ")]; Dropping the mutation!",
-            vb_, cur_snapshot_start.load(),
-            *mutation->getBySeqno(), cur_snapshot_end.load());
-        return ENGINE_ERANGE;
-    }
-
-    // MB-17517: Check for the incoming item's CAS validity. We /shouldn't/
-    // receive anything without a valid CAS, however given that versions without
-    // this check may send us "bad" CAS values, we should regenerate them (which
-    // is better than rejecting the data entirely).
-    if (!Item::isValidCas(mutation->getItem()->getCas())) {
-        LOG(EXTENSION_LOG_WARNING,
-            "%s Invalid CAS (0x%" PRIx64 ") received for mutation {vb:%" PRIu16
-            ", seqno:%" PRId64 "}. Regenerating new CAS",
-            consumer->logHeader(),
-            mutation->getItem()->getCas(), vb_,
-            mutation->getItem()->getBySeqno());
-        mutation->getItem()->setCas();
+    ENGINE_ERROR_CODE ret = checkMutation(*mutation);
+    if (ret != ENGINE_SUCCESS) {
+        return ret;
     }
 
-    ENGINE_ERROR_CODE ret;
     if (vb->isBackfillPhase()) {
         ret = engine->getKVBucket()->addBackfillItem(
                 *mutation->getItem(),
@@ -2157,6 +2428,126 @@ ENGINE_ERROR_CODE PassiveStream::processMutation(MutationResponse* mutation) {
     return ret;
 }
 
+ENGINE_ERROR_CODE PassiveStream::checkMutation(MutationResponse& mutation) {
+    if (uint64_t(*mutation.getBySeqno()) < cur_snapshot_start.load() ||
+        uint64_t(*mutation.getBySeqno()) > cur_snapshot_end.load()) {
+        consumer->getLogger().log(EXTENSION_LOG_WARNING,
+            "(vb %d) Erroneous mutation [sequence "
+            "number does not fall in the expected snapshot range : "
+            "{snapshot_start (%" PRIu64 ") <= seq_no (%" PRIu64 ") <= "
+            "snapshot_end (%" PRIu64 ")]; Dropping the mutation!",
+            vb_, cur_snapshot_start.load(),
+            *mutation.getBySeqno(), cur_snapshot_end.load());
+        return ENGINE_ERANGE;
+    }
+
+    // MB-17517: Check for the incoming item's CAS validity. We /shouldn't/
+    // receive anything without a valid CAS, however given that versions without
+    // this check may send us "bad" CAS values, we should regenerate them (which
+    // is better than rejecting the data entirely).
+    if (!Item::isValidCas(mutation.getItem()->getCas())) {
+        LOG(EXTENSION_LOG_WARNING,
+            "%s Invalid CAS (0x%" PRIx64 ") received for mutation {vb:%" PRIu16
+            ", seqno:%" PRId64 "}. Regenerating new CAS",
+            consumer->logHeader(),
+            mutation.getItem()->getCas(), vb_,
+            mutation.getItem()->getBySeqno());
+        mutation.getItem()->setCas();
+    }
+
+
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE PassiveStream::processMutationBatch(
+        std::vector<std::unique_ptr<DcpResponse>>& mutations,
+        size_t& numProcessed,
+        uint32_t& bytesProcessed) {
+    numProcessed = 0;
+    bytesProcessed = 0;
+
+    VBucketPtr vb = engine->getVBucket(vb_);
+    if (!vb) {
+        // Dropped, as for a single mutation
+        for (const auto& mutation : mutations) {
+            bytesProcessed += mutation->getMessageSize();
+        }
+        numProcessed = mutations.size();
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    while (numProcessed < mutations.size()) {
+        auto* first = static_cast<MutationResponse*>(
+                mutations[numProcessed].get());
+        ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+        // The backfill items of a vbucket are not queued into checkpoints,
+        // hence set one at a time
+        if (vb->isBackfillPhase()) {
+            ret = processMutation(first);
+            if (ret == ENGINE_TMPFAIL || ret == ENGINE_ENOMEM) {
+                return ret;
+            }
+            if (ret != ENGINE_ERANGE) {
+                bytesProcessed += first->getMessageSize();
+            }
+            ++numProcessed;
+            continue;
+        }
+
+        std::vector<Item*> items;
+        for (size_t ii = numProcessed; ii < mutations.size(); ++ii) {
+            auto& mutation = static_cast<MutationResponse&>(*mutations[ii]);
+            if (checkMutation(mutation) != ENGINE_SUCCESS) {
+                break;
+            }
+            items.push_back(mutation.getItem().get());
+        }
+        if (items.empty()) {
+            // Out of the snapshot range, and dropped
+            ++numProcessed;
+            continue;
+        }
+
+        size_t numSet;
+        std::tie(numSet, ret) = engine->getKVBucket()->setWithMetaBatch(
+                vb_,
+                items,
+                consumer->getCookie(),
+                {vbucket_state_active,
+                 vbucket_state_replica,
+                 vbucket_state_pending});
+        for (size_t ii = 0; ii < numSet; ++ii) {
+            bytesProcessed += mutations[numProcessed++]->getMessageSize();
+        }
+        if (numSet > 0) {
+            handleSnapshotEnd(vb, items[numSet - 1]->getBySeqno());
+        }
+
+        if (ret != ENGINE_SUCCESS) {
+            auto* failed = static_cast<MutationResponse*>(
+                    mutations[numProcessed].get());
+            consumer->getLogger().log(
+                    EXTENSION_LOG_WARNING,
+                    "vb:%" PRIu16
+                    " Got error '%s' while trying to process "
+                    "mutation with seqno:%" PRId64,
+                    vb_,
+                    cb::to_string(cb::to_engine_errc(ret)).c_str(),
+                    failed->getItem()->getBySeqno());
+            if (ret == ENGINE_TMPFAIL || ret == ENGINE_ENOMEM) {
+                return ret;
+            }
+            // As for a single mutation, a mutation which fails for good is
+            // dropped
+            bytesProcessed += failed->getMessageSize();
+            ++numProcessed;
+        }
+    }
+
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE PassiveStream::processDeletion(MutationResponse* deletion) {
     VBucketPtr vb = engine->getVBucket(vb_);
     if (!vb) {
@@ -2401,13 +2792,8 @@ void PassiveStream::addStats(ADD_STAT add_stat, const void *c) {
     try {
         const int bsize = 1024;
         char buf[bsize];
-        size_t bufferItems = 0;
-        size_t bufferBytes = 0;
-        {
-            std::lock_guard<std::mutex> lg(buffer.bufMutex);
-            bufferItems = buffer.messages.size();
-            bufferBytes = buffer.bytes;
-        }
+        const size_t bufferItems = buffer.size();
+        const size_t bufferBytes = buffer.getBytes();
         checked_snprintf(buf, bsize, "%s:stream_%d_buffer_items", name_.c_str(),
                          vb_);
         add_casted_stat(buf, bufferItems, add_stat, c);
@@ -2455,10 +2841,78 @@ std::unique_ptr<DcpResponse> PassiveStream::next() {
 }
 
 uint32_t PassiveStream::clearBuffer_UNLOCKED() {
-    uint32_t unackedBytes = buffer.bytes;
-    buffer.messages.clear();
-    buffer.bytes = 0;
-    return unackedBytes;
+    return buffer.clear();
+}
+
+void PassiveStream::Buffer::push(std::unique_ptr<DcpResponse> message) {
+    // Account for the message before the consumer may see it
+    bytes.fetch_add(message->getMessageSize());
+    count.fetch_add(1);
+
+    // Only the consumer clears overflowing, so once it's set we can't
+    // get back into the ring without looking at it under the lock
+    if (!overflowing.load() && ring.push(std::move(message))) {
+        return;
+    }
+    std::lock_guard<std::mutex> lg(overflowMutex);
+    overflow.push_back(std::move(message));
+    overflowing.store(true);
+}
+
+bool PassiveStream::Buffer::fill() {
+    if (!pending.empty()) {
+        return true;
+    }
+
+    // Look at overflowing first: once it is set, the producer has pushed
+    // the last messages into the ring it will until the overflow (which
+    // has all of the messages after those) has been drained - so if the
+    // ring is empty after that, the next message is in the overflow.
+    const bool overflowed = overflowing.load();
+    std::unique_ptr<DcpResponse> message;
+    if (ring.pop(message)) {
+        pending.push_back(std::move(message));
+        return true;
+    }
+    if (!overflowed) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lg(overflowMutex);
+    pending.swap(overflow);
+    overflowing.store(false);
+    return !pending.empty();
+}
+
+DcpResponse* PassiveStream::Buffer::front(std::unique_lock<std::mutex>& lh) {
+    return fill() ? pending.front().get() : nullptr;
+}
+
+std::unique_ptr<DcpResponse> PassiveStream::Buffer::pop_front(
+        std::unique_lock<std::mutex>& lh) {
+    fill();
+    std::unique_ptr<DcpResponse> rval(std::move(pending.front()));
+    pending.pop_front();
+    bytes.fetch_sub(rval->getMessageSize());
+    count.fetch_sub(1);
+    return rval;
+}
+
+void PassiveStream::Buffer::push_front(std::unique_ptr<DcpResponse> message,
+                                       std::unique_lock<std::mutex>& lh) {
+    bytes.fetch_add(message->getMessageSize());
+    count.fetch_add(1);
+    pending.push_front(std::move(message));
+}
+
+uint32_t PassiveStream::Buffer::clear() {
+    uint32_t cleared = 0;
+    while (fill()) {
+        cleared += pending.front()->getMessageSize();
+        pending.pop_front();
+        count.fetch_sub(1);
+    }
+    bytes.fetch_sub(cleared);
+    return cleared;
 }
 
 bool PassiveStream::transitionState(StreamState newState) {
@@ -25,11 +25,15 @@
 #include "dcp/dcp-types.h"
 #include "dcp/producer.h"
 #include "response.h"
+#include "spsc_ring.h"
 #include "vbucket.h"
 
 #include <atomic>
 #include <climits>
+#include <deque>
+#include <mutex>
 #include <queue>
+#include <unordered_set>
 
 class EventuallyPersistentEngine;
 class MutationResponse;
@@ -189,13 +193,63 @@ protected:
     std::atomic<bool> itemsReady;
     std::mutex streamMutex;
 
+    /**
+     * A FIFO queue of DcpResponses, which only allocates its storage when
+     * the first response is pushed (an empty std::deque already holds its
+     * map and a block of elements), so that the storage of the queue of an
+     * idle stream can be given back with release().
+     */
+    class ReadyQueue {
+    public:
+        bool empty() const {
+            return !queue || queue->empty();
+        }
+
+        size_t size() const {
+            return queue ? queue->size() : 0;
+        }
+
+        std::unique_ptr<DcpResponse>& front() {
+            return queue->front();
+        }
+
+        void push(std::unique_ptr<DcpResponse> resp) {
+            if (!queue) {
+                queue = std::make_unique<
+                        std::deque<std::unique_ptr<DcpResponse>>>();
+            }
+            queue->push_back(std::move(resp));
+        }
+
+        void pop() {
+            queue->pop_front();
+        }
+
+        /// @return true if the storage of the (empty) queue was freed
+        bool release() {
+            if (!queue || !queue->empty()) {
+                return false;
+            }
+            queue.reset();
+            return true;
+        }
+
+        /// @return true if the queue currently has storage allocated
+        bool isAllocated() const {
+            return queue != nullptr;
+        }
+
+    private:
+        std::unique_ptr<std::deque<std::unique_ptr<DcpResponse>>> queue;
+    };
+
     /**
      * Ordered queue of DcpResponses to be sent on the stream.
      * Elements are added to this queue by reading from disk/memory etc, and
      * are removed when sending over the network to our peer.
      * The readyQ owns the elements in it.
      */
-    std::queue<std::unique_ptr<DcpResponse>> readyQ;
+    ReadyQueue readyQ;
 
     // Number of items in the readyQ that are not meta items. Used for
     // calculating getItemsRemaining(). Atomic so it can be safely read by
@@ -249,6 +303,24 @@ public:
 
     void notifySeqnoAvailable(uint64_t seqno);
 
+    /**
+     * Put the stream into hibernation if it is streaming from memory and
+     * has had nothing to send for at least idleTime: the storage of its
+     * (empty) readyQ is freed, and allocated again when the stream has
+     * something to send after its next notifySeqnoAvailable().
+     *
+     * The checkpoint cursor is kept: it is cheap compared to the readyQ,
+     * and dropping it would make the stream backfill from disk when it
+     * wakes up (cursor dropping already does that for memory pressure).
+     *
+     * @return true if the stream went into hibernation
+     */
+    bool maybeHibernate(rel_time_t now, rel_time_t idleTime);
+
+    bool isHibernating() const {
+        return hibernating;
+    }
+
     void snapshotMarkerAckReceived();
 
     void setVBucketStateAckRecieved();
@@ -265,6 +337,27 @@ public:
 
     void completeBackfill();
 
+    /**
+     * Handles the cancellation of the backfill (of another connection) the
+     * stream is attached to: the stream schedules one of its own if it
+     * got none of the items yet, otherwise it ends, as it misses some.
+     *
+     * @param snapshotMarked if the disk snapshot was sent to the stream
+     */
+    void sharedBackfillCancelled(bool snapshotMarked);
+
+    /**
+     * Resets the scan buffer of the backfill manager of the connection, for
+     * a stream attached to the backfill of another one.
+     */
+    void resetBackfillScanBuffer();
+
+    /**
+     * @returns a copy of the stream's collections filter as it is now, for
+     *          a backfill to skip the keys of the other collections
+     */
+    std::unique_ptr<Collections::VB::Filter> copyFilter();
+
     bool isCompressionEnabled();
 
     void addStats(ADD_STAT add_stat, const void *c);
@@ -285,6 +378,15 @@ public:
     // Runs on ActiveStreamCheckpointProcessorTask
     void nextCheckpointItemTask();
 
+    /**
+     * How long to wait before reading the checkpoints of the stream, for
+     * more of them to build up and be merged into one snapshot (0 to read
+     * them now). The wait starts at the first call after a read.
+     *
+     * Runs on ActiveStreamCheckpointProcessorTask
+     */
+    std::chrono::milliseconds getSnapshotCoalesceDelay();
+
     /**
      * Function to handle a slow stream that is supposedly hogging memory in
      * checkpoint mgr. Currently we handle the slow stream by switching from
@@ -301,6 +403,12 @@ public:
                (includeXattributes == IncludeXattrs::No);
     }
 
+    /// @return true if the items of the disk snapshot may be sent in the
+    /// order of their keys rather than of their seqnos
+    bool isBackfillByKey() const {
+        return (flags_ & DCP_ADD_STREAM_FLAG_BACKFILL_BY_KEY) != 0;
+    }
+
     /// @returns a copy of the current collections separator.
     std::string getCurrentSeparator() const {
         return currentSeparator;
@@ -324,6 +432,15 @@ protected:
      */
     std::unique_ptr<DcpResponse> makeResponseFromItem(queued_item& item);
 
+    /**
+     * @return a MutationResponse for a connection with value compression,
+     *         whose item is a copy of the given one already pruned and
+     *         compressed, so that the thread building the response does
+     *         that work rather than the front-end thread sending it.
+     */
+    std::unique_ptr<DcpResponse> makeCompressedResponse(
+            queued_item& item, uint8_t collectionLen);
+
     /* The transitionState function is protected (as opposed to private) for
      * testing purposes.
      */
@@ -402,6 +519,31 @@ private:
     void snapshot(std::deque<std::unique_ptr<DcpResponse>>& snapshot,
                   bool mark);
 
+    /// A snapshot being built from contiguous in-memory checkpoints
+    struct CoalescedSnapshot {
+        std::deque<std::unique_ptr<DcpResponse>> items;
+        bool mark = false;
+        size_t bytes = 0;
+        std::unordered_set<StoredDocKey> keys;
+    };
+
+    /**
+     * Merge the items of a checkpoint into the snapshot of the checkpoints
+     * before it. If that would take the snapshot beyond maxBytes, or the
+     * checkpoint has a key the snapshot already has, the snapshot is put
+     * onto the readyQ and the checkpoint starts the next one instead.
+     *
+     * @param snap the snapshot being built
+     * @param checkpoint the items of the checkpoint, moved into snap
+     * @param mark if the checkpoint is the start of a new checkpoint
+     * @param maxBytes the size snapshots are merged up to
+     */
+    void coalesceCheckpoint(
+            CoalescedSnapshot& snap,
+            std::deque<std::unique_ptr<DcpResponse>>& checkpoint,
+            bool mark,
+            size_t maxBytes);
+
     void endStream(end_stream_status_t reason);
 
     /* reschedule = FALSE ==> First backfill on the stream
@@ -469,6 +611,17 @@ private:
     std::atomic<rel_time_t> takeoverStart;
     size_t takeoverSendMaxTime;
 
+    //! The number of items left to send at which the front end writes are
+    //! paused (dcp_takeover_pause_backlog)
+    size_t takeoverPauseBacklog;
+
+    //! Did we pause the front end writes to the vbucket for the takeover?
+    std::atomic<bool> takeoverWritesPaused{false};
+
+    //! When the vbucket became unavailable for writes because of the
+    //! takeover (the writes were paused or it was marked as dead)
+    hrtime_t takeoverUnavailableStart = 0;
+
     //! Last snapshot end seqno sent to the DCP client
     std::atomic<uint64_t> lastSentSnapEndSeqno;
 
@@ -477,6 +630,19 @@ private:
        items are added to the readyQ */
     std::atomic<bool> chkptItemsExtractionInProgress;
 
+    //! When the stream last had something to send
+    std::atomic<rel_time_t> lastActivityTime;
+
+    //! Whether the stream is hibernating (see maybeHibernate)
+    std::atomic<bool> hibernating;
+
+    //! The number of times the stream went into hibernation
+    std::atomic<size_t> hibernations;
+
+    /* When the checkpoint processor task started waiting for checkpoints to
+       build up to read them (epoch if not waiting) */
+    ProcessClock::time_point coalesceWaitStart;
+
     // Whether the responses sent using this stream should contain the value
     IncludeValue includeValue;
     // Whether the responses sent using the stream should contain the xattrs
@@ -528,6 +694,17 @@ public:
         return queue.size();
     }
 
+    /**
+     * Set the number of streams a run processes before yielding
+     */
+    void setIterationsBeforeYield(size_t iterations) {
+        iterationsBeforeYield = iterations;
+    }
+
+    size_t getIterationsBeforeYield() const {
+        return iterationsBeforeYield;
+    }
+
 private:
 
     stream_t queuePop() {
@@ -564,7 +741,7 @@ private:
     std::set<uint16_t> queuedVbuckets;
 
     std::atomic<bool> notified;
-    size_t iterationsBeforeYield;
+    std::atomic<size_t> iterationsBeforeYield;
 };
 
 class NotifierStream : public Stream {
@@ -655,6 +832,34 @@ protected:
 
     ENGINE_ERROR_CODE processMutation(MutationResponse* mutation);
 
+    /**
+     * Process consecutive buffered mutations as processMutation would one
+     * at a time, but setting them into the vbucket together (outside of
+     * the backfill phase of the vbucket).
+     *
+     * @param mutations the mutations
+     * @param[out] numProcessed the number of mutations processed (i.e. set,
+     *             or dropped as they failed for good), the others are to
+     *             be processed again
+     * @param[out] bytesProcessed the size of the mutations processed, but
+     *             for those out of the snapshot range
+     * @return ENGINE_SUCCESS, the (temporary) failure of the first mutation
+     *         not processed, or ENGINE_NOT_MY_VBUCKET if the vbucket is
+     *         gone (all the mutations being dropped then)
+     */
+    ENGINE_ERROR_CODE processMutationBatch(
+            std::vector<std::unique_ptr<DcpResponse>>& mutations,
+            size_t& numProcessed,
+            uint32_t& bytesProcessed);
+
+    /**
+     * Checks that a mutation falls in the current snapshot and regenerates
+     * its CAS if it isn't valid.
+     *
+     * @return ENGINE_ERANGE if the mutation is to be dropped
+     */
+    ENGINE_ERROR_CODE checkMutation(MutationResponse& mutation);
+
     ENGINE_ERROR_CODE processDeletion(MutationResponse* deletion);
 
     /**
@@ -720,44 +925,92 @@ protected:
     std::atomic<Snapshot> cur_snapshot_type;
     bool cur_snapshot_ack;
 
-    struct Buffer {
-        Buffer() : bytes(0) {}
+    /**
+     * The messages buffered for the processor task to apply.
+     *
+     * The front-end thread receiving the messages from the connection is
+     * the only producer, and pushes them into a lock-free ring (or, when
+     * the ring is full, an overflow queue which takes over until the
+     * consumer has drained it) - so it never waits for the consumer. The
+     * consumer side (the processor task, or setDead() clearing the buffer)
+     * must hold bufMutex, and keeps the messages it pops from the ring (or
+     * puts back) in front of them in a queue of its own.
+     */
+    class Buffer {
+    public:
+        /// The number of slots in the ring
+        static const size_t ringCapacity = 512;
+
+        Buffer() : ring(ringCapacity) {
+        }
 
         bool empty() const {
-            LockHolder lh(bufMutex);
-            return messages.empty();
+            return count.load() == 0;
         }
 
-        void push(std::unique_ptr<DcpResponse> message) {
-            std::lock_guard<std::mutex> lg(bufMutex);
-            bytes += message->getMessageSize();
-            messages.push_back(std::move(message));
+        size_t size() const {
+            return count.load();
         }
 
-        /*
+        size_t getBytes() const {
+            return bytes.load();
+        }
+
+        /// Buffer the message (producer only)
+        void push(std::unique_ptr<DcpResponse> message);
+
+        /**
+         * Get the oldest message, leaving it in the buffer.
          * Caller must of locked bufMutex and pass as lh (not asserted)
+         *
+         * @return the message, or nullptr if the buffer is empty
          */
-        std::unique_ptr<DcpResponse> pop_front(std::unique_lock<std::mutex>& lh) {
-            std::unique_ptr<DcpResponse> rval(std::move(messages.front()));
-            messages.pop_front();
-            bytes -= rval->getMessageSize();
-            return rval;
-        }
+        DcpResponse* front(std::unique_lock<std::mutex>& lh);
+
+        /*
+         * Caller must of locked bufMutex and pass as lh (not asserted), and
+         * the buffer must not be empty (front() didn't return nullptr)
+         */
+        std::unique_ptr<DcpResponse> pop_front(
+                std::unique_lock<std::mutex>& lh);
 
         /*
          * Caller must of locked bufMutex and pass as lh (not asserted)
          */
         void push_front(std::unique_ptr<DcpResponse> message,
-                        std::unique_lock<std::mutex>& lh) {
-            bytes += message->getMessageSize();
-            messages.push_front(std::move(message));
-        }
+                        std::unique_lock<std::mutex>& lh);
+
+        /*
+         * Drop all of the messages. Caller must hold bufMutex (or be the
+         * only user of the buffer left).
+         *
+         * @return the bytes of the messages dropped
+         */
+        uint32_t clear();
 
-        size_t bytes;
         /* Lock ordering w.r.t to streamMutex:
            First acquire bufMutex and then streamMutex */
         mutable std::mutex bufMutex;
-        std::deque<std::unique_ptr<DcpResponse> > messages;
+
+    private:
+        /// Make sure that the oldest message (if any) is in front
+        bool fill();
+
+        SpscRing<std::unique_ptr<DcpResponse>> ring;
+
+        /// The messages pushed once the ring was full, which all go here
+        /// (to keep them in order) while overflowing is set
+        std::mutex overflowMutex;
+        std::deque<std::unique_ptr<DcpResponse>> overflow;
+        std::atomic<bool> overflowing{false};
+
+        /// The oldest messages, taken out of the ring (or the overflow) by
+        /// the consumer (guarded by bufMutex)
+        std::deque<std::unique_ptr<DcpResponse>> pending;
+
+        /// The number and size of all of the messages buffered
+        std::atomic<size_t> count{0};
+        std::atomic<size_t> bytes{0};
     } buffer;
 };
 
@@ -40,7 +40,11 @@ bool DefragmenterTask::run(void) {
         if (!prAdapter) {
             prAdapter = std::make_unique<PauseResumeVBAdapter>(
                     std::make_unique<DefragmentVisitor>(
-                            getAgeThreshold(), getMaxValueSize(alloc_hooks)));
+                            getAgeThreshold(),
+                            getMaxValueSize(alloc_hooks),
+                            alloc_hooks,
+                            engine->getConfiguration()
+                                    .isDefragmenterStoredValueEnabled()));
             epstore_position = engine->getKVBucket()->startPosition();
         }
 
@@ -66,26 +70,34 @@ bool DefragmenterTask::run(void) {
         // Prepare the underlying visitor.
         auto& visitor = getDefragVisitor();
         const auto start = ProcessClock::now();
-        const auto deadline = start + getChunkDuration();
-        visitor.setDeadline(deadline);
+        prAdapter->getBudget().startRun(getChunkDuration());
         visitor.clearStats();
 
         // Do it - set off the visitor.
         epstore_position = engine->getKVBucket()->pauseResumeVisit(
                 *prAdapter, epstore_position);
         const auto end = ProcessClock::now();
+        stats.visitorRuns[static_cast<size_t>(getTypeId())].record(
+                prAdapter->getBudget().endRun());
 
         // Defrag complete. Restore thread caching.
         alloc_hooks->enable_thread_cache(old_tcache);
 
         // Update stats
         stats.defragNumMoved.fetch_add(visitor.getDefragCount());
+        stats.defragStoredValueNumMoved.fetch_add(
+                visitor.getStoredValueDefragCount());
         stats.defragNumVisited.fetch_add(visitor.getVisitedCount());
 
         // Release any free memory we now have in the allocator back to the OS.
         // TODO: Benchmark this - is it necessary? How much of a slowdown does it
         // add? How much memory does it return?
-        alloc_hooks->release_free_memory();
+        // A bucket with an arena of its own only needs to purge that one.
+        if (engine->getArena() != 0) {
+            alloc_hooks->purge_arena(engine->getArena());
+        } else {
+            alloc_hooks->release_free_memory();
+        }
 
         // Check if the visitor completed a full pass.
         bool completed = (epstore_position ==
@@ -105,7 +117,9 @@ bool DefragmenterTask::run(void) {
                                                                       start);
         ss << " Took " << duration.count() << " us."
            << " moved " << visitor.getDefragCount() << "/"
-           << visitor.getVisitedCount() << " visited documents."
+           << visitor.getVisitedCount() << " visited documents"
+           << " (and " << visitor.getStoredValueDefragCount()
+           << " StoredValues)."
            << " mem_used=" << stats.getTotalMemoryUsed()
            << ", mapped_bytes=" << getMappedBytes() << ". Sleeping for "
            << getSleepTime() << " seconds.";
@@ -137,7 +151,7 @@ cb::const_char_buffer DefragmenterTask::getDescription() {
 std::chrono::microseconds DefragmenterTask::maxExpectedDuration() {
     // Defragmenter processes items in chunks, with each chunk constrained
     // by a ChunkDuration runtime, so we expect to only take that long.
-    // However, the ProgressTracker used estimates the time remaining, so
+    // However, the VisitorBudget used estimates the time remaining, so
     // apply some headroom to that figure so we don't get inundated with
     // spurious "slow tasks" which only just exceed the limit.
     return getChunkDuration() * 10;
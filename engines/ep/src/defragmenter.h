@@ -88,6 +88,14 @@ class PauseResumeVBAdapter;
  * 2. Document size - Skip documents which are larger than the largest
  *    size class, or are zero-sized.
  *
+ * 3. Page utilization - if the allocator can tell how many of the regions
+ *    of the page an object is on are in use, only move objects on pages
+ *    which are less utilized than the average page of their size class.
+ *    This also lets us move the StoredValues (and their keys), which are
+ *    otherwise allocated once and never move; the hash table replaces
+ *    them with a copy under the hash bucket lock (see
+ *    VBucket::relocateStoredValue).
+ *
  * An additional policy consideration is how to locate
  * candidate documents. In a large instance, the simple act of
  * visiting each element in the HashTable is a expensive operation -
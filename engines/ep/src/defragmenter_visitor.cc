@@ -17,26 +17,46 @@
 
 #include "defragmenter_visitor.h"
 
+#include "vbucket.h"
+
+#include <memcached/allocator_hooks.h>
+
 // DegragmentVisitor implementation ///////////////////////////////////////////
 
 DefragmentVisitor::DefragmentVisitor(uint8_t age_threshold_,
-                                     size_t max_size_class)
+                                     size_t max_size_class,
+                                     ALLOCATOR_HOOKS_API* alloc_hooks_,
+                                     bool relocate_stored_values_)
     : max_size_class(max_size_class),
       age_threshold(age_threshold_),
+      alloc_hooks(alloc_hooks_),
+      relocate_stored_values(relocate_stored_values_),
+      currentVb(nullptr),
       defrag_count(0),
+      sv_defrag_count(0),
       visited_count(0) {
 }
 
 DefragmentVisitor::~DefragmentVisitor() {
 }
 
-void DefragmentVisitor::setDeadline(ProcessClock::time_point deadline) {
-    progressTracker.setDeadline(deadline);
-}
-
 bool DefragmentVisitor::visit(const HashTable::HashBucketLock& lh,
                               StoredValue& v) {
-    const size_t value_len = v.valuelen();
+    StoredValue* sv = &v;
+
+    // We hold the lock of the hash bucket, so nobody else may refer to the
+    // StoredValue; it's always safe to move (as far as the hash table is
+    // concerned; the VBucket may still refuse).
+    if (relocate_stored_values && currentVb != nullptr &&
+        getPageUtilization(sv) == PageUtilization::Sparse) {
+        StoredValue* moved = currentVb->relocateStoredValue(lh, *sv);
+        if (moved != nullptr) {
+            sv = moved;
+            sv_defrag_count++;
+        }
+    }
+
+    const size_t value_len = sv->valuelen();
 
     // value must be at least non-zero (also covers Items with null Blobs)
     // and no larger than the biggest size class the allocator
@@ -48,23 +68,51 @@ bool DefragmentVisitor::visit(const HashTable::HashBucketLock& lh,
         // It may be possible to add a reference to the blob without holding
         // any locks, therefore the check is somewhat of an estimate which
         // should be good enough.
-        if (v.getValue()->getAge() >= age_threshold &&
-            v.getValue().refCount() < 2) {
-            v.reallocate();
+        if (sv->getValue()->getAge() >= age_threshold &&
+            sv->getValue().refCount() < 2 &&
+            getPageUtilization(sv->getValue().get()) !=
+                    PageUtilization::Dense) {
+            sv->reallocate();
             defrag_count++;
         } else {
-            v.getValue()->incrementAge();
+            sv->getValue()->incrementAge();
         }
     }
     visited_count++;
 
-    // See if we have done enough work for this chunk. If so
-    // stop visiting (for now).
-    return progressTracker.shouldContinueVisiting(visited_count);
+    // Whoever drives the visit pauses it once the chunk is done (see
+    // VisitorBudget).
+    return true;
+}
+
+void DefragmentVisitor::setCurrentVBucket(VBucket& vb) {
+    currentVb = &vb;
+}
+
+DefragmentVisitor::PageUtilization DefragmentVisitor::getPageUtilization(
+        const void* ptr) const {
+    allocator_utilization util;
+    if (alloc_hooks == nullptr ||
+        alloc_hooks->get_allocation_utilization == nullptr ||
+        !alloc_hooks->get_allocation_utilization(ptr, &util)) {
+        return PageUtilization::Unknown;
+    }
+
+    // Moving an object off a full page can't free it, and moving it off a
+    // page which is more utilized than the average page is likely to
+    // leave it on a less utilized one (or to fill a hole in a page which
+    // is in use anyway).
+    if (util.page_used < util.page_regions &&
+        util.page_used * util.class_regions <
+                util.class_used * util.page_regions) {
+        return PageUtilization::Sparse;
+    }
+    return PageUtilization::Dense;
 }
 
 void DefragmentVisitor::clearStats() {
     defrag_count = 0;
+    sv_defrag_count = 0;
     visited_count = 0;
 }
 
@@ -72,6 +120,10 @@ size_t DefragmentVisitor::getDefragCount() const {
     return defrag_count;
 }
 
+size_t DefragmentVisitor::getStoredValueDefragCount() const {
+    return sv_defrag_count;
+}
+
 size_t DefragmentVisitor::getVisitedCount() const {
     return visited_count;
 }
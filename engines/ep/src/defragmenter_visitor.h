@@ -20,35 +20,60 @@
 #include "config.h"
 
 #include "hash_table.h"
-#include "progress_tracker.h"
+#include "utility.h"
 #include "vb_visitors.h"
 
 /**
  * Defragmentation visitor - visit all objects in a VBucket, and defragment
  * any which have reached the specified age.
+ *
+ * If the allocator can tell how utilized the page of an allocation is (see
+ * ALLOCATOR_HOOKS_API::get_allocation_utilization), we only move objects
+ * which are on a page which is less utilized than the average page of
+ * their size class. The StoredValues themselves (and their keys) are then
+ * moved too; as they don't have an age, they are only moved if we know
+ * their page is sparsely used.
  */
 class DefragmentVisitor : public VBucketAwareHTVisitor {
 public:
-    DefragmentVisitor(uint8_t age_threshold_, size_t max_size_class);
+    /**
+     * @param age_threshold_ how old a blob must be to be moved
+     * @param max_size_class size of the largest size class of the allocator
+     * @param alloc_hooks_ the allocator hooks used to get the utilization of
+     *        pages (nullptr to not use the utilization)
+     * @param relocate_stored_values_ move StoredValues on sparse pages
+     */
+    DefragmentVisitor(uint8_t age_threshold_,
+                      size_t max_size_class,
+                      ALLOCATOR_HOOKS_API* alloc_hooks_ = nullptr,
+                      bool relocate_stored_values_ = false);
 
     ~DefragmentVisitor();
 
-    // Set the deadline at which point the visitor will pause visiting.
-    void setDeadline(ProcessClock::time_point deadline_);
-
     // Implementation of HashTableVisitor interface:
     virtual bool visit(const HashTable::HashBucketLock& lh, StoredValue& v);
 
+    void setCurrentVBucket(VBucket& vb) override;
+
     // Resets any held stats to zero.
     void clearStats();
 
     // Returns the number of documents that have been defragmented.
     size_t getDefragCount() const;
 
+    // Returns the number of StoredValues that have been moved.
+    size_t getStoredValueDefragCount() const;
+
     // Returns the number of documents that have been visited.
     size_t getVisitedCount() const;
 
 private:
+    /// How utilized the page of an allocation is, relative to the average
+    /// page of its size class
+    enum class PageUtilization { Unknown, Sparse, Dense };
+
+    PageUtilization getPageUtilization(const void* ptr) const;
+
     /* Configuration parameters */
 
     // Size of the largest size class from the allocator.
@@ -57,14 +82,23 @@ private:
     // How old a blob must be to consider it for defragmentation.
     const uint8_t age_threshold;
 
+    // The allocator hooks used to get the utilization of pages (may be
+    // nullptr).
+    ALLOCATOR_HOOKS_API* const alloc_hooks;
+
+    // Should StoredValues on sparse pages be moved?
+    const bool relocate_stored_values;
+
     /* Runtime state */
 
-    // Estimates how far we have got, and when we should pause.
-    ProgressTracker progressTracker;
+    // The VBucket we are visiting.
+    VBucket* currentVb;
 
     /* Statistics */
     // Count of how many documents have been defrag'd.
     size_t defrag_count;
+    // Count of how many StoredValues have been moved.
+    size_t sv_defrag_count;
     // How many documents have been visited.
     size_t visited_count;
 };
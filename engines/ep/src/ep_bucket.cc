@@ -23,9 +23,15 @@
 #include "ep_vb.h"
 #include "failover-table.h"
 #include "flusher.h"
+#include "hlc.h"
+#include "item_compressor.h"
 #include "replicationthrottle.h"
 #include "tasks.h"
 
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
 /**
  * Callback class used by EpStore, for adding relevant keys
  * to bloomfilter during compaction.
@@ -98,7 +104,7 @@ bool BloomFilterCallback::initTempFilter(uint16_t vbucketId) {
     size_t initial_estimation = config.getBfilterKeyCount();
     size_t estimated_count;
     size_t num_deletes =
-            store.getROUnderlying(vbucketId)->getNumPersistedDeletes(vbucketId);
+            store.getRWUnderlying(vbucketId)->getNumPersistedDeletes(vbucketId);
     item_eviction_policy_t eviction_policy = store.getItemEvictionPolicy();
     if (eviction_policy == VALUE_ONLY) {
         /**
@@ -143,7 +149,9 @@ bool BloomFilterCallback::initTempFilter(uint16_t vbucketId) {
         estimated_count = initial_estimation;
     }
 
-    vb->initTempFilter(estimated_count, config.getBfilterFpProb());
+    vb->initTempFilter(estimated_count,
+                       config.getBfilterFpProb(),
+                       BloomFilter::parseLayout(config.getBfilterLayout()));
 
     return true;
 }
@@ -163,6 +171,74 @@ private:
     KVBucket& epstore;
 };
 
+/**
+ * Callback class used by EPBucket, for pacing the writes of a compaction.
+ */
+class CompactionWriteCallback : public Callback<size_t&> {
+public:
+    CompactionWriteCallback(EPBucket& bucket) : bucket(bucket) {
+    }
+
+    void callback(size_t& bytes) {
+        bucket.throttleCompactionWrite(bytes);
+    }
+
+private:
+    EPBucket& bucket;
+};
+
+/**
+ * A listener class to update the compaction throttle at runtime.
+ */
+class CompactionThrottleChangeListener : public ValueChangedListener {
+public:
+    CompactionThrottleChangeListener(CompactionThrottle& throttle)
+        : throttle(throttle) {
+    }
+
+    void sizeValueChanged(const std::string& key, size_t value) override {
+        if (key.compare("compaction_max_write_rate") == 0) {
+            throttle.setMaxWriteRate(value);
+        }
+    }
+
+private:
+    CompactionThrottle& throttle;
+};
+
+const std::chrono::microseconds CompactionThrottle::maxWait(
+        std::chrono::seconds(1));
+
+/// How long a compaction write backs off for while the disk queue is full
+static const std::chrono::milliseconds compactionBackoff(10);
+
+std::chrono::microseconds CompactionThrottle::acquire(
+        size_t bytes, ProcessClock::time_point now) {
+    const double rate = double(maxWriteRate.load());
+    if (rate == 0) {
+        return std::chrono::microseconds(0);
+    }
+
+    std::lock_guard<std::mutex> lh(mutex);
+    if (lastRefill == ProcessClock::time_point()) {
+        // Start with a full bucket
+        tokens = rate;
+    } else if (now > lastRefill) {
+        const auto elapsed = std::chrono::duration_cast<
+                std::chrono::duration<double>>(now - lastRefill);
+        tokens = std::min(rate, tokens + rate * elapsed.count());
+    }
+    lastRefill = std::max(lastRefill, now);
+
+    tokens -= double(bytes);
+    if (tokens >= 0) {
+        return std::chrono::microseconds(0);
+    }
+    const auto wait = std::chrono::microseconds(
+            uint64_t(std::ceil(-tokens / rate * 1000000)));
+    return std::min(wait, maxWait);
+}
+
 EPBucket::EPBucket(EventuallyPersistentEngine& theEngine)
     : KVBucket(theEngine) {
     const std::string& policy =
@@ -174,6 +250,12 @@ EPBucket::EPBucket(EventuallyPersistentEngine& theEngine)
     }
     replicationThrottle = std::make_unique<ReplicationThrottle>(
             engine.getConfiguration(), stats);
+
+    Configuration& config = engine.getConfiguration();
+    compactionThrottle.setMaxWriteRate(config.getCompactionMaxWriteRate());
+    config.addValueChangedListener(
+            "compaction_max_write_rate",
+            new CompactionThrottleChangeListener(compactionThrottle));
 }
 
 bool EPBucket::initialize() {
@@ -181,6 +263,11 @@ bool EPBucket::initialize() {
 
     enableItemPager();
 
+    // Only here, as the values of an Ephemeral bucket may be read without
+    // the hash bucket lock (see ItemCompressorTask)
+    ExecutorPool::get()->schedule(
+            std::make_shared<ItemCompressorTask>(&engine, stats));
+
     if (!startBgFetcher()) {
         LOG(EXTENSION_LOG_FATAL,
            "EPBucket::initialize: Failed to create and start bgFetchers");
@@ -195,6 +282,29 @@ void EPBucket::deinitialize() {
     stopFlusher();
     stopBgFetcher();
 
+    // Now the flusher is stopped the persisted seqnos of the vbuckets are
+    // final, so the filters (and hash tables) we save stay valid until the
+    // next warmup
+    Configuration& config = getEPEngine().getConfiguration();
+    if (config.isBfilterEnabled() && config.isBfilterPersist() &&
+        !stats.forceShutdown) {
+        for (auto vbid : vbMap.getBuckets()) {
+            VBucketPtr vb = getVBucket(vbid);
+            if (vb) {
+                vb->saveFilter(config.getDbname());
+            }
+        }
+    }
+    if (config.isHtSnapshot() && getItemEvictionPolicy() == VALUE_ONLY &&
+        !stats.forceShutdown) {
+        for (auto vbid : vbMap.getBuckets()) {
+            VBucketPtr vb = getVBucket(vbid);
+            if (vb) {
+                static_cast<EPVBucket&>(*vb).saveHashTable(config.getDbname());
+            }
+        }
+    }
+
     KVBucket::deinitialize();
 }
 
@@ -315,9 +425,28 @@ ENGINE_ERROR_CODE EPBucket::scheduleCompaction(uint16_t vbid,
     /* Update the compaction ctx with the previous purge seqno */
     c.max_purged_seq[vbid] = vb->getPurgeSeqno();
 
+    /* The most fragmented files are compacted first (see
+     * updateCompactionTasks) */
+    double fragmentation = 0;
+    try {
+        const DBFileInfo info =
+                getROUnderlying(vbid)->getDbFileInfo(c.db_file_id);
+        if (info.fileSize > 0 && info.spaceUsed < info.fileSize) {
+            fragmentation = double(info.fileSize - info.spaceUsed) /
+                            double(info.fileSize);
+        }
+    } catch (const std::exception& e) {
+        LOG(EXTENSION_LOG_WARNING,
+            "EPBucket::scheduleCompaction: failed to get the file info of "
+            "db %" PRIu16 ": %s",
+            c.db_file_id,
+            e.what());
+    }
+
     LockHolder lh(compactionLock);
     ExTask task = std::make_shared<CompactTask>(*this, c, cookie);
-    compactionTasks.push_back(std::make_pair(c.db_file_id, task));
+    compactionTasks.push_back(
+            CompTaskEntry{c.db_file_id, task, fragmentation});
     if (compactionTasks.size() > 1) {
         if ((stats.diskQueueSize > compactionWriteQueueCap &&
              compactionTasks.size() > (vbMap.getNumShards() / 2)) ||
@@ -352,6 +481,9 @@ void EPBucket::compactInternal(compaction_ctx* ctx) {
     ExpiredItemsCBPtr expiry(new ExpiredItemsCallback(*this));
     ctx->expiryCallback = expiry;
 
+    CompactionWriteCBPtr write(new CompactionWriteCallback(*this));
+    ctx->writeCallback = write;
+
     KVShard* shard = vbMap.getShardByVbId(ctx->db_file_id);
     KVStore* store = shard->getRWUnderlying();
     bool result = store->compactDB(ctx);
@@ -372,6 +504,9 @@ void EPBucket::compactInternal(compaction_ctx* ctx) {
 
         if (config.isBfilterEnabled() && result) {
             vb->swapFilter();
+            if (config.isBfilterPersist()) {
+                vb->saveFilter(config.getDbname());
+            }
         } else {
             vb->clearFilter();
         }
@@ -424,23 +559,39 @@ bool EPBucket::doCompact(compaction_ctx* ctx, const void* cookie) {
 
 void EPBucket::updateCompactionTasks(DBFileId db_file_id) {
     LockHolder lh(compactionLock);
-    bool erased = false, woke = false;
+    // Remove the completed task, and wake the snoozed task of the most
+    // fragmented file
+    std::list<CompTaskEntry>::iterator next = compactionTasks.end();
     std::list<CompTaskEntry>::iterator it = compactionTasks.begin();
     while (it != compactionTasks.end()) {
-        if ((*it).first == db_file_id) {
+        if (it->dbFileId == db_file_id) {
             it = compactionTasks.erase(it);
-            erased = true;
         } else {
-            ExTask& task = (*it).second;
-            if (task->getState() == TASK_SNOOZED) {
-                ExecutorPool::get()->wake(task->getId());
-                woke = true;
+            if (it->task->getState() == TASK_SNOOZED &&
+                (next == compactionTasks.end() ||
+                 it->fragmentation > next->fragmentation)) {
+                next = it;
             }
             ++it;
         }
-        if (erased && woke) {
-            break;
-        }
+    }
+    if (next != compactionTasks.end()) {
+        ExecutorPool::get()->wake(next->task->getId());
+    }
+}
+
+void EPBucket::throttleCompactionWrite(size_t bytes) {
+    auto wait = compactionThrottle.acquire(bytes, ProcessClock::now());
+    if (compactionThrottle.getMaxWriteRate() != 0 &&
+        stats.diskQueueSize > compactionWriteQueueCap) {
+        // Leave the disk to the flushers while they are behind
+        ++stats.compactionThrottleBackoffs;
+        wait += compactionBackoff;
+    }
+    if (wait.count() > 0) {
+        ++stats.compactionThrottleWaits;
+        stats.compactionThrottleWaitTime.fetch_add(wait.count());
+        std::this_thread::sleep_for(wait);
     }
 }
 
@@ -453,6 +604,101 @@ std::pair<uint64_t, bool> EPBucket::getLastPersistedCheckpointId(uint16_t vb) {
     }
 }
 
+ENGINE_ERROR_CODE EPBucket::bulkLoadVBucket(uint16_t vbid,
+                                           vbucket_state_t to,
+                                           const BulkLoadSource& source) {
+    if (vbid >= vbMap.getSize()) {
+        return ENGINE_ERANGE;
+    }
+    // Nothing is loaded into the hash table, which value eviction requires
+    if (eviction_policy != FULL_EVICTION) {
+        return ENGINE_ENOTSUP;
+    }
+
+    // Held throughout, so that the vbucket isn't created under the load
+    std::lock_guard<std::mutex> vbset(vbsetMutex);
+    if (vbMap.getBucket(vbid)) {
+        return ENGINE_KEY_EEXISTS;
+    }
+
+    KVStore* rwUnderlying = getRWUnderlying(vbid);
+    rwUnderlying->incrementRevision(vbid);
+
+    auto table =
+            std::make_unique<FailoverTable>(engine.getMaxFailoverEntries());
+    vbucket_state vbstate(to,
+                          0,
+                          0,
+                          0,
+                          0,
+                          0,
+                          0,
+                          0,
+                          HlcCasSeqnoUninitialised,
+                          false,
+                          table->toJSON());
+
+    Configuration& config = engine.getConfiguration();
+    HLC hlc(0,
+            HlcCasSeqnoUninitialised,
+            std::chrono::microseconds(config.getHlcDriftAheadThresholdUs()),
+            std::chrono::microseconds(config.getHlcDriftBehindThresholdUs()));
+    int64_t seqno = 0;
+    auto sequenced = [&](std::vector<std::unique_ptr<Item>>& items) {
+        const size_t first = items.size();
+        if (!source(items)) {
+            return false;
+        }
+        for (size_t ii = first; ii < items.size(); ++ii) {
+            Item& item = *items[ii];
+            item.setVBucketId(vbid);
+            item.setBySeqno(++seqno);
+            item.setRevSeqno(1);
+            if (item.getCas() == 0) {
+                item.setCas(hlc.nextHLC());
+            }
+            if (mcbp::datatype::is_xattr(item.getDataType())) {
+                vbstate.mightContainXattrs = true;
+            }
+        }
+        return true;
+    };
+    if (!rwUnderlying->bulkLoad(vbid, vbstate, sequenced)) {
+        return ENGINE_FAILED;
+    }
+
+    KVShard* shard = vbMap.getShardByVbId(vbid);
+    VBucketPtr vb = makeVBucket(vbid,
+                                to,
+                                shard,
+                                std::move(table),
+                                std::make_unique<NotifyNewSeqnoCB>(*this),
+                                to,
+                                vbstate.highSeqno,
+                                vbstate.lastSnapStart,
+                                vbstate.lastSnapEnd,
+                                0,
+                                vbstate.maxCas,
+                                vbstate.hlcCasEpochSeqno,
+                                vbstate.mightContainXattrs,
+                                "");
+    if (to == vbucket_state_active) {
+        collectionsManager->update(*vb);
+    }
+    // The first checkpoint for active vbucket should start with id 2.
+    vb->checkpointManager->setOpenCheckpointId(
+            to == vbucket_state_active ? 2 : 0);
+    vb->setPersistenceSeqno(vbstate.highSeqno);
+    vb->ht.setNumTotalItems(rwUnderlying->getItemCount(vbid));
+    // No bloom filter: an empty one would hide the keys just loaded, until
+    // compaction rebuilds it
+
+    if (vbMap.addBucket(vb) == ENGINE_ERANGE) {
+        return ENGINE_ERANGE;
+    }
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE EPBucket::getFileStats(const void* cookie,
                                          ADD_STAT add_stat) {
     const auto numShards = vbMap.getNumShards();
@@ -19,6 +19,54 @@
 
 #include "kv_bucket.h"
 
+#include <platform/processclock.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+/**
+ * Paces the writes of the compactions of a bucket to a maximum rate, with a
+ * token bucket shared by all of them: compactions of several shards may run
+ * in parallel, but together they don't write faster than the budget. A
+ * burst of up to one second worth of writes is allowed; past that, a write
+ * must wait for the tokens it borrowed to be refilled.
+ *
+ * Thread-safe.
+ */
+class CompactionThrottle {
+public:
+    /// @param rate the maximum write rate in bytes/s, 0 for no limit
+    void setMaxWriteRate(size_t rate) {
+        maxWriteRate = rate;
+    }
+
+    size_t getMaxWriteRate() const {
+        return maxWriteRate;
+    }
+
+    /**
+     * Take the tokens for a write
+     *
+     * @param bytes the size of the write
+     * @param now the current time
+     * @return how long the writer should wait before issuing the write
+     */
+    std::chrono::microseconds acquire(size_t bytes,
+                                      ProcessClock::time_point now);
+
+    /// The longest a single write is made to wait (the debt carries over)
+    static const std::chrono::microseconds maxWait;
+
+private:
+    std::atomic<size_t> maxWriteRate{0};
+
+    std::mutex mutex;
+    /// The bytes which may be written without waiting; negative when in debt
+    double tokens = 0;
+    ProcessClock::time_point lastRefill;
+};
+
 /**
  * Eventually Persistent Bucket
  *
@@ -73,9 +121,40 @@ public:
      */
     bool doCompact(compaction_ctx* ctx, const void* cookie);
 
+    CompactionThrottle& getCompactionThrottle() {
+        return compactionThrottle;
+    }
+
+    /**
+     * Delay a write of a compaction as needed to stay within
+     * compaction_max_write_rate, and to back off while the disk write queue
+     * is over compaction_write_queue_cap
+     */
+    void throttleCompactionWrite(size_t bytes);
+
     std::pair<uint64_t, bool> getLastPersistedCheckpointId(
             uint16_t vb) override;
 
+    /**
+     * Create a vbucket from a bulk load of items, written straight to its
+     * file (see KVStore::bulkLoad) rather than through the hash table, the
+     * checkpoints and the flusher.
+     *
+     * The items are given seqnos 1..n in the order of the source, a revision
+     * seqno of 1 and (unless they have one) a CAS; their keys must be unique.
+     * Once loaded, the vbucket is created in the given state with the seqno
+     * of the last item as its high seqno (so DCP resumes from there), and
+     * nothing resident: only full eviction buckets support bulk loads.
+     *
+     * @return ENGINE_SUCCESS, ENGINE_KEY_EEXISTS if the vbucket exists,
+     *         ENGINE_ENOTSUP if the bucket isn't full eviction,
+     *         ENGINE_ERANGE for an invalid vbucket or ENGINE_FAILED if the
+     *         load failed (or the store doesn't support bulk loads)
+     */
+    ENGINE_ERROR_CODE bulkLoadVBucket(uint16_t vbid,
+                                      vbucket_state_t to,
+                                      const BulkLoadSource& source);
+
     ENGINE_ERROR_CODE getFileStats(const void* cookie,
                                    ADD_STAT add_stat) override;
 
@@ -113,7 +192,8 @@ public:
     void rollbackUnpersistedItems(VBucket& vb, int64_t rollbackSeqno) override;
 
     size_t getNumPersistedDeletes(uint16_t vbid) override {
-        return getROUnderlying(vbid)->getNumPersistedDeletes(vbid);
+        // The read-write store keeps the count up to date
+        return getRWUnderlying(vbid)->getNumPersistedDeletes(vbid);
     }
 
     void notifyNewSeqno(const uint16_t vbid,
@@ -138,4 +218,6 @@ protected:
      *                   case of forestdb
      */
     void updateCompactionTasks(DBFileId db_file_id);
+
+    CompactionThrottle compactionThrottle;
 };
@@ -30,9 +30,11 @@
 #include "ep_bucket.h"
 #include "ep_vb.h"
 #include "ephemeral_bucket.h"
+#include "ephemeral_vb.h"
 #include "failover-table.h"
 #include "flusher.h"
 #include "htresizer.h"
+#include "instrumented_mutex.h"
 #include "logger.h"
 #include "memory_tracker.h"
 #include "replicationthrottle.h"
@@ -62,7 +64,9 @@
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <mutex>
+#include <set>
 #include <stdarg.h>
 #include <string>
 #include <vector>
@@ -271,6 +275,13 @@ static cb::EngineErrorItemPair EvpGet(ENGINE_HANDLE* handle,
     return cb::makeEngineErrorItemPair(cb::engine_errc(ret), itm, handle);
 }
 
+static void EvpGetMulti(ENGINE_HANDLE* handle,
+                        const void* cookie,
+                        const std::vector<cb::MultiGetKey>& keys,
+                        std::vector<cb::EngineErrorItemPair>& results) {
+    acquireEngine(handle)->getMulti(cookie, keys, results);
+}
+
 static cb::EngineErrorItemPair EvpGetIf(ENGINE_HANDLE* handle,
                                         const void* cookie,
                                         const DocKey& key,
@@ -349,6 +360,58 @@ static cb::EngineErrorCasPair EvpStoreIf(ENGINE_HANDLE* handle,
     return engine->store_if(cookie, item, cas, operation, predicate);
 }
 
+static ENGINE_ERROR_CODE EvpWaitForPersistence(ENGINE_HANDLE* handle,
+                                              const void* cookie,
+                                              uint16_t vbucket,
+                                              uint64_t seqno) {
+    return acquireEngine(handle)->waitForPersistence(cookie, vbucket, seqno);
+}
+
+static ENGINE_ERROR_CODE EvpArithmetic(ENGINE_HANDLE* handle,
+                                       const void* cookie,
+                                       const DocKey& key,
+                                       uint16_t vbucket,
+                                       bool increment,
+                                       uint64_t delta,
+                                       uint64_t cas,
+                                       uint64_t* result,
+                                       uint64_t* new_cas,
+                                       mutation_descr_t* mut_info) {
+    return acquireEngine(handle)->arithmetic(cookie,
+                                             key,
+                                             vbucket,
+                                             increment,
+                                             delta,
+                                             cas,
+                                             *result,
+                                             *new_cas,
+                                             *mut_info);
+}
+
+static ENGINE_ERROR_CODE EvpAppendPrepend(ENGINE_HANDLE* handle,
+                                          const void* cookie,
+                                          const DocKey& key,
+                                          uint16_t vbucket,
+                                          bool append,
+                                          cb::const_char_buffer value,
+                                          uint64_t cas,
+                                          uint64_t* new_cas,
+                                          mutation_descr_t* mut_info) {
+    return acquireEngine(handle)->appendPrepend(
+            cookie, key, vbucket, append, value, cas, *new_cas, *mut_info);
+}
+
+static ENGINE_ERROR_CODE EvpGetSeqnoRange(ENGINE_HANDLE* handle,
+                                          const void* cookie,
+                                          uint16_t vbucket,
+                                          uint64_t start,
+                                          uint64_t end,
+                                          size_t max_bytes,
+                                          cb::SeqnoRangeBatch& batch) {
+    return acquireEngine(handle)->getSeqnoRange(
+            cookie, vbucket, start, end, max_bytes, batch);
+}
+
 static ENGINE_ERROR_CODE EvpFlush(ENGINE_HANDLE* handle,
                                   const void* cookie) {
     return acquireEngine(handle)->flush(cookie);
@@ -406,6 +469,10 @@ protocol_binary_response_status EventuallyPersistentEngine::setCheckpointParam(
             validate(v, size_t(MIN_CHECKPOINT_ITEMS),
                      size_t(MAX_CHECKPOINT_ITEMS));
             getConfiguration().setChkMaxItems(v);
+        } else if (strcmp(keyz, "chk_max_size") == 0) {
+            getConfiguration().setChkMaxSize(std::stoull(valz));
+        } else if (strcmp(keyz, "checkpoint_memory_ratio") == 0) {
+            getConfiguration().setCheckpointMemoryRatio(std::stof(valz));
         } else if (strcmp(keyz, "chk_period") == 0) {
             size_t v = std::stoull(valz);
             validate(v, size_t(MIN_CHECKPOINT_PERIOD),
@@ -422,6 +489,8 @@ protocol_binary_response_status EventuallyPersistentEngine::setCheckpointParam(
             getConfiguration().setKeepClosedChks(cb_stob(valz));
         } else if (strcmp(keyz, "enable_chk_merge") == 0) {
             getConfiguration().setEnableChkMerge(cb_stob(valz));
+        } else if (strcmp(keyz, "chk_expel_enabled") == 0) {
+            getConfiguration().setChkExpelEnabled(cb_stob(valz));
         } else {
             msg = "Unknown config param";
             rv = PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
@@ -462,8 +531,21 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
     try {
         if (strcmp(keyz, "bg_fetch_delay") == 0) {
             getConfiguration().setBgFetchDelay(std::stoull(valz));
+        } else if (strcmp(keyz, "bgfetcher_coalesce_window") == 0) {
+            getConfiguration().setBgfetcherCoalesceWindow(std::stoull(valz));
+        } else if (strcmp(keyz, "executor_share_weight") == 0) {
+            getConfiguration().setExecutorShareWeight(std::stoull(valz));
         } else if (strcmp(keyz, "flushall_enabled") == 0) {
             getConfiguration().setFlushallEnabled(cb_stob(valz));
+        } else if (strcmp(keyz, "flush_mode") == 0) {
+            getConfiguration().setFlushMode(valz);
+        } else if (strcmp(keyz, "flusher_max_batch_delay") == 0) {
+            getConfiguration().setFlusherMaxBatchDelay(std::stoull(valz));
+        } else if (strcmp(keyz, "hlc_clock") == 0) {
+            getConfiguration().setHlcClock(valz);
+        } else if (strcmp(keyz, "vbucket_latency_sample_interval") == 0) {
+            getConfiguration().setVbucketLatencySampleInterval(
+                    std::stoull(valz));
         } else if (strcmp(keyz, "max_size") == 0) {
             size_t vsize = std::stoull(valz);
 
@@ -507,6 +589,9 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
             getConfiguration().setExpPagerEnabled(cb_stob(valz));
         } else if (strcmp(keyz, "exp_pager_stime") == 0) {
             getConfiguration().setExpPagerStime(std::stoull(valz));
+        } else if (strcmp(keyz, "exp_pager_full_sweep_interval") == 0) {
+            getConfiguration().setExpPagerFullSweepInterval(
+                    std::stoull(valz));
         } else if (strcmp(keyz, "exp_pager_initial_run_time") == 0) {
             getConfiguration().setExpPagerInitialRunTime(std::stoll(valz));
         } else if (strcmp(keyz, "access_scanner_enabled") == 0) {
@@ -560,10 +645,28 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
             getConfiguration().setDefragmenterAgeThreshold(std::stoull(valz));
         } else if (strcmp(keyz, "defragmenter_chunk_duration") == 0) {
             getConfiguration().setDefragmenterChunkDuration(std::stoull(valz));
+        } else if (strcmp(keyz, "vbucket_deletion_chunk_duration") == 0) {
+            getConfiguration().setVbucketDeletionChunkDuration(
+                    std::stoull(valz));
+        } else if (strcmp(keyz, "visitor_chunk_duration") == 0) {
+            getConfiguration().setVisitorChunkDuration(std::stoull(valz));
         } else if (strcmp(keyz, "defragmenter_run") == 0) {
             runDefragmenterTask();
+        } else if (strcmp(keyz, "item_compressor_enabled") == 0) {
+            getConfiguration().setItemCompressorEnabled(cb_stob(valz));
+        } else if (strcmp(keyz, "item_compressor_interval") == 0) {
+            getConfiguration().setItemCompressorInterval(std::stoull(valz));
+        } else if (strcmp(keyz, "item_compressor_chunk_duration") == 0) {
+            getConfiguration().setItemCompressorChunkDuration(
+                    std::stoull(valz));
+        } else if (strcmp(keyz, "item_compressor_min_ratio") == 0) {
+            getConfiguration().setItemCompressorMinRatio(std::stof(valz));
+        } else if (strcmp(keyz, "rollback_reset_ratio") == 0) {
+            getConfiguration().setRollbackResetRatio(std::stof(valz));
         } else if (strcmp(keyz, "compaction_write_queue_cap") == 0) {
             getConfiguration().setCompactionWriteQueueCap(std::stoull(valz));
+        } else if (strcmp(keyz, "compaction_max_write_rate") == 0) {
+            getConfiguration().setCompactionMaxWriteRate(std::stoull(valz));
         } else if (strcmp(keyz, "dcp_min_compression_ratio") == 0) {
             getConfiguration().setDcpMinCompressionRatio(std::stof(valz));
         } else if (strcmp(keyz, "dcp_noop_mandatory_for_v5_features") == 0) {
@@ -585,13 +688,26 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
             getConfiguration().requirementsMetOrThrow("ephemeral_metadata_purge_interval");
             getConfiguration().setEphemeralMetadataPurgeInterval(
                     std::stoull(valz));
+        } else if (strcmp(keyz, "ephemeral_metadata_purge_stale_target") ==
+                   0) {
+            getConfiguration().requirementsMetOrThrow(
+                    "ephemeral_metadata_purge_stale_target");
+            getConfiguration().setEphemeralMetadataPurgeStaleTarget(
+                    std::stoull(valz));
         } else if (strcmp(keyz, "mem_merge_count_threshold") == 0) {
             getConfiguration().setMemMergeCountThreshold(std::stoul(valz));
         } else if (strcmp(keyz, "mem_merge_bytes_threshold") == 0) {
             getConfiguration().setMemMergeBytesThreshold(std::stoul(valz));
+        } else if (strcmp(keyz, "lock_stats_sample_rate") == 0) {
+            getConfiguration().setLockStatsSampleRate(std::stoul(valz));
         } else if (strcmp(keyz, "fsync_after_every_n_bytes_written") == 0) {
             getConfiguration().setFsyncAfterEveryNBytesWritten(
                     std::stoull(valz));
+        } else if (strcmp(keyz, "couchstore_bgfetch_readahead") == 0) {
+            getConfiguration().setCouchstoreBgfetchReadahead(cb_stob(valz));
+        } else if (strcmp(keyz, "couchstore_backfill_readahead") == 0) {
+            getConfiguration().setCouchstoreBackfillReadahead(
+                    std::stoull(valz));
         } else if (strcmp(keyz, "xattr_enabled") == 0) {
             getConfiguration().setXattrEnabled(cb_stob(valz));
         } else {
@@ -645,6 +761,11 @@ protocol_binary_response_status EventuallyPersistentEngine::setDcpParam(
             validate(v, size_t(1), std::numeric_limits<size_t>::max());
             getConfiguration().setDcpConsumerProcessBufferedMessagesBatchSize(
                     v);
+        } else if (strcmp(keyz, "dcp_producer_step_batch_size") == 0) {
+            size_t v = atoi(valz);
+            checkNumeric(valz);
+            validate(v, size_t(1), std::numeric_limits<size_t>::max());
+            getConfiguration().setDcpProducerStepBatchSize(v);
         } else {
             msg = "Unknown config param";
             rv = PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
@@ -713,7 +834,7 @@ static protocol_binary_response_status evictKey(
     auto rv = e->evictKey(DocKey(keyPtr, keylen, docNamespace), vbucket, msg);
     if (rv == PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET ||
         rv == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT) {
-        if (e->isDegradedMode()) {
+        if (e->isDegradedMode(vbucket)) {
             return PROTOCOL_BINARY_RESPONSE_ETMPFAIL;
         }
     }
@@ -938,10 +1059,33 @@ static ENGINE_ERROR_CODE getReplicaCmd(EventuallyPersistentEngine* e,
     protocol_binary_request_no_extras* req =
         (protocol_binary_request_no_extras*)request;
     int keylen = ntohs(req->message.header.request.keylen);
+    uint8_t extlen = req->message.header.request.extlen;
     uint16_t vbucket = ntohs(req->message.header.request.vbucket);
     ENGINE_ERROR_CODE error_code;
-    DocKey key(reinterpret_cast<const uint8_t*>(request) + sizeof(*request),
-               keylen, docNamespace);
+    DocKey key(reinterpret_cast<const uint8_t*>(request) + sizeof(*request) +
+                       extlen,
+               keylen,
+               docNamespace);
+
+    if (extlen == sizeof(uint64_t)) {
+        // The client only wants the document if the replica has caught up
+        // with the given seqno
+        auto* grreq =
+                reinterpret_cast<protocol_binary_request_get_replica*>(request);
+        const uint64_t minSeqno = ntohll(grreq->message.body.min_seqno);
+        VBucketPtr vb = e->getVBucket(vbucket);
+        if (vb && vb->getState() == vbucket_state_replica &&
+            uint64_t(vb->getHighSeqno()) < minSeqno) {
+            ++(e->getEpStats().numReplicaReadsBehind);
+            *msg = "Replica has not reached the requested seqno";
+            *res = PROTOCOL_BINARY_RESPONSE_ETMPFAIL;
+            return ENGINE_SUCCESS;
+        }
+    } else if (extlen != 0) {
+        *msg = "Invalid extras";
+        *res = PROTOCOL_BINARY_RESPONSE_EINVAL;
+        return ENGINE_SUCCESS;
+    }
 
     GetValue rv(kvb->getReplica(key, vbucket, cookie));
 
@@ -1207,6 +1351,15 @@ static ENGINE_ERROR_CODE processUnknownCommand(
                              (request), response,
                              docNamespace);
     }
+    case PROTOCOL_BINARY_CMD_RANGE_SCAN: {
+        return h->rangeScan(
+                cookie,
+                reinterpret_cast<protocol_binary_request_range_scan*>(request),
+                response,
+                docNamespace);
+    }
+    case PROTOCOL_BINARY_CMD_WITH_META_BATCH:
+        return h->withMetaBatch(cookie, request, response, docNamespace);
         // MB-21143: Remove adjusted time/drift API, but return NOT_SUPPORTED
     case PROTOCOL_BINARY_CMD_GET_ADJUSTED_TIME:
     case PROTOCOL_BINARY_CMD_SET_DRIFT_COUNTER_STATE: {
@@ -1600,7 +1753,7 @@ ENGINE_ERROR_CODE create_instance(uint64_t interface,
     Logger::setLoggerAPI(api->log);
 
     MemoryTracker::getInstance(*api->alloc_hooks);
-    ObjectRegistry::initialize(api->alloc_hooks->get_allocation_size);
+    ObjectRegistry::initialize(*api->alloc_hooks);
 
     std::atomic<size_t>* inital_tracking = new std::atomic<size_t>();
 
@@ -1653,6 +1806,13 @@ static cb::EngineErrorMetadataPair EvpGetMeta(ENGINE_HANDLE* handle,
     return acquireEngine(handle)->getMeta(cookie, key, vbucket);
 }
 
+static void EvpGetMetaMulti(ENGINE_HANDLE* handle,
+                            const void* cookie,
+                            const std::vector<cb::MultiGetKey>& keys,
+                            std::vector<cb::EngineErrorMetadataPair>& results) {
+    acquireEngine(handle)->getMetaMulti(cookie, keys, results);
+}
+
 static bool EvpSetItemInfo(ENGINE_HANDLE* handle, const void* cookie,
                            item* itm, const item_info* itm_info) {
     Item* it = reinterpret_cast<Item*>(itm);
@@ -1702,10 +1862,12 @@ EventuallyPersistentEngine::EventuallyPersistentEngine(
     ENGINE_HANDLE_V1::remove = EvpItemDelete;
     ENGINE_HANDLE_V1::release = EvpItemRelease;
     ENGINE_HANDLE_V1::get = EvpGet;
+    ENGINE_HANDLE_V1::get_multi = EvpGetMulti;
     ENGINE_HANDLE_V1::get_if = EvpGetIf;
     ENGINE_HANDLE_V1::get_and_touch = EvpGetAndTouch;
     ENGINE_HANDLE_V1::get_locked = EvpGetLocked;
     ENGINE_HANDLE_V1::get_meta = EvpGetMeta;
+    ENGINE_HANDLE_V1::get_meta_multi = EvpGetMetaMulti;
     ENGINE_HANDLE_V1::unlock = EvpUnlock;
     ENGINE_HANDLE_V1::get_stats = EvpGetStats;
     ENGINE_HANDLE_V1::reset_stats = EvpResetStats;
@@ -1738,6 +1900,10 @@ EventuallyPersistentEngine::EventuallyPersistentEngine(
     ENGINE_HANDLE_V1::set_log_level = EvpSetLogLevel;
     ENGINE_HANDLE_V1::collections.set_manifest = EvpCollectionsSetManifest;
     ENGINE_HANDLE_V1::isXattrEnabled = EvpIsXattrEnabled;
+    ENGINE_HANDLE_V1::wait_for_persistence = EvpWaitForPersistence;
+    ENGINE_HANDLE_V1::arithmetic = EvpArithmetic;
+    ENGINE_HANDLE_V1::append_prepend = EvpAppendPrepend;
+    ENGINE_HANDLE_V1::get_seqno_range = EvpGetSeqnoRange;
 
     serverApi = getServerApiFunc();
     memset(&info, 0, sizeof(info));
@@ -1810,6 +1976,8 @@ public:
             engine.stats.mem_merge_count_threshold = value;
         } else if (key.compare("mem_merge_bytes_threshold") == 0) {
             engine.stats.mem_merge_bytes_threshold = value;
+        } else if (key.compare("lock_stats_sample_rate") == 0) {
+            LockStats::sampleRate.store(uint32_t(value));
         }
     }
 
@@ -1844,6 +2012,18 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::initialize(const char* config) {
 
     maxFailoverEntries = configuration.getMaxFailoverEntries();
 
+    if (configuration.isBucketArenaEnabled()) {
+        arena = ObjectRegistry::acquireArena();
+        if (arena == 0) {
+            LOG(EXTENSION_LOG_WARNING,
+                "EPEngine::initialize: the allocator doesn't support arenas, "
+                "the bucket allocates from the default arena");
+        } else {
+            // Allocate from now on (including this thread) from the arena
+            ObjectRegistry::onSwitchThread(this);
+        }
+    }
+
     // Start updating the variables from the config!
     VBucket::setMutationMemoryThreshold(
             configuration.getMutationMemThreshold());
@@ -1874,6 +2054,15 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::initialize(const char* config) {
             "mem_merge_bytes_threshold",
             new EpEngineValueChangeListener(*this));
 
+    // The lock stats are process wide: the last bucket to set the rate
+    // wins
+    if (configuration.getLockStatsSampleRate() != 0) {
+        LockStats::sampleRate.store(
+                uint32_t(configuration.getLockStatsSampleRate()));
+    }
+    configuration.addValueChangedListener(
+            "lock_stats_sample_rate", new EpEngineValueChangeListener(*this));
+
     maxItemSize = configuration.getMaxItemSize();
     configuration.addValueChangedListener("max_item_size",
                                        new EpEngineValueChangeListener(*this));
@@ -1914,6 +2103,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::initialize(const char* config) {
         dcpFlowControlManager_ = new DcpFlowControlManagerDynamic(*this);
     } else if (!flowCtlPolicy.compare("aggressive")) {
         dcpFlowControlManager_ = new DcpFlowControlManagerAggressive(*this);
+    } else if (!flowCtlPolicy.compare("adaptive")) {
+        dcpFlowControlManager_ = new DcpFlowControlManagerAdaptive(*this);
     } else {
         /* Flow control is not enabled */
         dcpFlowControlManager_ = new DcpFlowControlManager(*this);
@@ -1987,15 +2178,9 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::itemAllocate(
 
     time_t expiretime = (exptime == 0) ? 0 : ep_abs_time(ep_reltime(exptime));
 
-    *itm = new Item(key,
-                    flags,
-                    expiretime,
-                    nullptr,
-                    nbytes,
-                    datatype,
-                    0 /*cas*/,
-                    -1 /*seq*/,
-                    vbucket);
+    // The front end fills the value in, so allocate the Item with it
+    *itm = Item::makeWithValue(
+            key, flags, expiretime, nbytes, datatype, vbucket);
     if (*itm == NULL) {
         return memoryCondition();
     } else {
@@ -2005,7 +2190,100 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::itemAllocate(
 }
 
 void EventuallyPersistentEngine::itemRelease(const void* cookie, item* itm) {
-    delete reinterpret_cast<Item*>(itm);
+    Item::release(reinterpret_cast<Item*>(itm));
+}
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::waitForPersistence(
+        const void* cookie, uint16_t vbucket, uint64_t seqno) {
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    if (seqno <= vb->getPersistenceSeqno()) {
+        return ENGINE_SUCCESS;
+    }
+
+    // The same wait as SEQNO_PERSISTENCE does, which gives up (with
+    // ENGINE_TMPFAIL) after the checkpoint flush timeout
+    switch (vb->checkAddHighPriorityVBEntry(
+            seqno, cookie, HighPriorityVBNotify::Seqno)) {
+    case HighPriorityVBReqStatus::RequestScheduled:
+        getKVBucket()->wakeUpFlusher();
+        return ENGINE_EWOULDBLOCK;
+    case HighPriorityVBReqStatus::NotSupported:
+        return ENGINE_ENOTSUP;
+    case HighPriorityVBReqStatus::RequestNotScheduled:
+        break;
+    }
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::arithmetic(
+        const void* cookie,
+        const DocKey& key,
+        uint16_t vbucket,
+        bool increment,
+        uint64_t delta,
+        uint64_t cas,
+        uint64_t& result,
+        uint64_t& newCas,
+        mutation_descr_t& mutInfo) {
+    if (isDegradedMode(vbucket)) {
+        // Let the frontend fail it the way it fails any other store
+        return ENGINE_ENOTSUP;
+    }
+
+    BlockTimer timer(&stats.storeCmdHisto);
+    auto status = kvBucket->arithmetic(key,
+                                       vbucket,
+                                       increment,
+                                       delta,
+                                       cas,
+                                       cookie,
+                                       result,
+                                       newCas,
+                                       mutInfo);
+    switch (status) {
+    case ENGINE_SUCCESS:
+        ++stats.numOpsStore;
+        break;
+    case ENGINE_ENOMEM:
+        status = memoryCondition();
+        break;
+    default:
+        break;
+    }
+    return status;
+}
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::appendPrepend(
+        const void* cookie,
+        const DocKey& key,
+        uint16_t vbucket,
+        bool append,
+        cb::const_char_buffer value,
+        uint64_t cas,
+        uint64_t& newCas,
+        mutation_descr_t& mutInfo) {
+    if (isDegradedMode(vbucket)) {
+        return ENGINE_ENOTSUP;
+    }
+
+    BlockTimer timer(&stats.storeCmdHisto);
+    auto status = kvBucket->appendPrepend(
+            key, vbucket, append, value, cas, cookie, newCas, mutInfo);
+    switch (status) {
+    case ENGINE_SUCCESS:
+        ++stats.numOpsStore;
+        break;
+    case ENGINE_ENOMEM:
+        status = memoryCondition();
+        break;
+    default:
+        break;
+    }
+    return status;
 }
 
 ENGINE_ERROR_CODE EventuallyPersistentEngine::flush(const void *cookie){
@@ -2017,6 +2295,17 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::flush(const void *cookie){
         return ENGINE_TMPFAIL;
     }
 
+    if (configuration.getFlushMode() == "swap") {
+        // Replace every vbucket with an empty one (and a new file revision)
+        // right away; the old ones are freed by the vbucket deletion tasks.
+        if (kvBucket->isDeleteAllScheduled()) {
+            return ENGINE_TMPFAIL;
+        }
+        kvBucket->resetAllVBuckets();
+        LOG(EXTENSION_LOG_NOTICE, "Completed bucket flush by vbucket swap");
+        return ENGINE_SUCCESS;
+    }
+
     /*
      * Supporting only a SYNC operation for bucket flush
      */
@@ -2065,7 +2354,7 @@ cb::EngineErrorItemPair EventuallyPersistentEngine::get_and_touch(const void* co
                 cb::engine_errc::success, gv.item.release(), handle);
     }
 
-    if (isDegradedMode()) {
+    if (isDegradedMode(vbucket)) {
         // Remap all some of the error codes
         switch (rv) {
         case ENGINE_KEY_EEXISTS:
@@ -2085,6 +2374,51 @@ cb::EngineErrorItemPair EventuallyPersistentEngine::get_and_touch(const void* co
     return cb::makeEngineErrorItemPair(cb::engine_errc(rv));
 }
 
+void EventuallyPersistentEngine::getMulti(
+        const void* cookie,
+        const std::vector<cb::MultiGetKey>& keys,
+        std::vector<cb::EngineErrorItemPair>& results) {
+    const auto options = static_cast<get_options_t>(QUEUE_BG_FETCH |
+                                                    HONOR_STATES |
+                                                    TRACK_REFERENCE |
+                                                    DELETE_TEMP |
+                                                    HIDE_LOCKED_CAS |
+                                                    TRACK_STATISTICS);
+    auto* handle = reinterpret_cast<ENGINE_HANDLE*>(this);
+
+    // Group the keys per vbucket (and remember where they came from) so
+    // that we only have to look up each vbucket once. Any misses get
+    // queued in the pending bg fetches for the vbucket, so the BgFetcher
+    // will read all of them in one batch.
+    std::map<uint16_t, std::vector<size_t>> vbuckets;
+    for (size_t ii = 0; ii < keys.size(); ++ii) {
+        vbuckets[keys[ii].vbucket].push_back(ii);
+    }
+
+    std::vector<DocKey> batch;
+    for (const auto& vb : vbuckets) {
+        batch.clear();
+        for (auto index : vb.second) {
+            batch.push_back(keys[index].key);
+        }
+
+        auto values = kvBucket->getMulti(batch, vb.first, cookie, options);
+        for (size_t ii = 0; ii < values.size(); ++ii) {
+            auto& gv = values[ii];
+            ENGINE_ERROR_CODE ret = gv.getStatus();
+            if (ret == ENGINE_SUCCESS) {
+                ++stats.numOpsGet;
+            } else if ((ret == ENGINE_KEY_ENOENT ||
+                        ret == ENGINE_NOT_MY_VBUCKET) &&
+                       isDegradedMode(vb.first)) {
+                ret = ENGINE_TMPFAIL;
+            }
+            results[vb.second[ii]] = cb::makeEngineErrorItemPair(
+                    cb::engine_errc(ret), gv.item.release(), handle);
+        }
+    }
+}
+
 cb::EngineErrorItemPair EventuallyPersistentEngine::get_if(const void* cookie,
                                                        const DocKey& key,
                                                        uint16_t vbucket,
@@ -2124,7 +2458,7 @@ cb::EngineErrorItemPair EventuallyPersistentEngine::get_if(const void* cookie,
 
         case ENGINE_KEY_ENOENT: // FALLTHROUGH
         case ENGINE_NOT_MY_VBUCKET: // FALLTHROUGH
-            if (isDegradedMode()) {
+            if (isDegradedMode(vbucket)) {
                 status = ENGINE_TMPFAIL;
             }
             // FALLTHROUGH
@@ -2215,14 +2549,14 @@ cb::EngineErrorCasPair EventuallyPersistentEngine::store_if(
         }
     // FALLTHROUGH
     case OPERATION_SET:
-        if (isDegradedMode()) {
+        if (isDegradedMode(item.getVBucketId())) {
             return {cb::engine_errc::temporary_failure, cas};
         }
         status = kvBucket->set(item, cookie, predicate);
         break;
 
     case OPERATION_ADD:
-        if (isDegradedMode()) {
+        if (isDegradedMode(item.getVBucketId())) {
             return {cb::engine_errc::temporary_failure, cas};
         }
 
@@ -2250,7 +2584,7 @@ cb::EngineErrorCasPair EventuallyPersistentEngine::store_if(
         break;
     case ENGINE_NOT_STORED:
     case ENGINE_NOT_MY_VBUCKET:
-        if (isDegradedMode()) {
+        if (isDegradedMode(item.getVBucketId())) {
             return {cb::engine_errc::temporary_failure, cas};
         }
         break;
@@ -2348,6 +2682,10 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
     if (flusher) {
         add_casted_stat("ep_commit_num", epstats.flusherCommits,
                         add_stat, cookie);
+        add_casted_stat("ep_commit_group_num", epstats.flusherGroupCommits,
+                        add_stat, cookie);
+        add_casted_stat("ep_commit_group_vbuckets",
+                        epstats.flusherGroupCommitVBuckets, add_stat, cookie);
         add_casted_stat("ep_commit_time",
                         epstats.commit_time, add_stat, cookie);
         add_casted_stat("ep_commit_time_total",
@@ -2377,6 +2715,10 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                     epstats.vbucketDeletions, add_stat, cookie);
     add_casted_stat("ep_vbucket_del_fail",
                     epstats.vbucketDeletionFail, add_stat, cookie);
+    add_casted_stat("ep_vbucket_del_items_freed",
+                    epstats.vbucketDelItemsFreed, add_stat, cookie);
+    add_casted_stat("ep_vbucket_del_mem_pending",
+                    epstats.vbucketDelMemPending, add_stat, cookie);
     add_casted_stat("ep_flush_duration_total",
                     epstats.cumulativeFlushTime, add_stat, cookie);
 
@@ -2387,7 +2729,7 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
     add_casted_stat("ep_persist_vbstate_total",
                     epstats.totalPersistVBState, add_stat, cookie);
 
-    size_t memUsed =  stats.getTotalMemoryUsed();
+    size_t memUsed = stats.getPreciseTotalMemoryUsed();
     add_casted_stat("mem_used", memUsed, add_stat, cookie);
     add_casted_stat("ep_mem_low_wat_percent", stats.mem_low_wat_percent,
                     add_stat, cookie);
@@ -2422,6 +2764,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                     add_stat, cookie);
     add_casted_stat("ep_bg_meta_fetched", epstats.bg_meta_fetched,
                     add_stat, cookie);
+    add_casted_stat("ep_bg_fetched_in_place", epstats.bgFetchedInPlace,
+                    add_stat, cookie);
     add_casted_stat("ep_bg_remaining_items", epstats.numRemainingBgItems,
                     add_stat, cookie);
     add_casted_stat("ep_bg_remaining_jobs", epstats.numRemainingBgJobs,
@@ -2430,11 +2774,32 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                     add_stat, cookie);
     add_casted_stat("ep_num_pager_runs", epstats.pagerRuns,
                     add_stat, cookie);
+    add_casted_stat("ep_num_pager_predictive_runs",
+                    epstats.pagerPredictiveRuns,
+                    add_stat, cookie);
+    add_casted_stat("ep_mem_growth_rate", epstats.memGrowthRate,
+                    add_stat, cookie);
     add_casted_stat("ep_num_expiry_pager_runs", epstats.expiryPagerRuns,
                     add_stat, cookie);
+    add_casted_stat("ep_pager_last_visited", epstats.pagerLastVisited,
+                    add_stat, cookie);
+    add_casted_stat("ep_pager_last_ejected", epstats.pagerLastEjected,
+                    add_stat, cookie);
+    add_casted_stat("ep_pager_last_ejected_bytes",
+                    epstats.pagerLastEjectedBytes,
+                    add_stat, cookie);
+    add_casted_stat("ep_pager_last_bytes_per_eject",
+                    epstats.pagerLastEjected == 0
+                            ? 0
+                            : epstats.pagerLastEjectedBytes /
+                                      epstats.pagerLastEjected,
+                    add_stat, cookie);
     add_casted_stat("ep_items_rm_from_checkpoints",
                     epstats.itemsRemovedFromCheckpoints,
                     add_stat, cookie);
+    add_casted_stat("ep_items_expelled_from_checkpoints",
+                    epstats.itemsExpelledFromCheckpoints,
+                    add_stat, cookie);
     add_casted_stat("ep_num_value_ejects", epstats.numValueEjects,
                     add_stat, cookie);
     add_casted_stat("ep_num_eject_failures", epstats.numFailedEjects,
@@ -2453,6 +2818,15 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
 
     add_casted_stat("ep_pending_compactions", epstats.pendingCompactions,
                     add_stat, cookie);
+    add_casted_stat("ep_compaction_throttle_waits",
+                    epstats.compactionThrottleWaits,
+                    add_stat, cookie);
+    add_casted_stat("ep_compaction_throttle_wait_time",
+                    epstats.compactionThrottleWaitTime,
+                    add_stat, cookie);
+    add_casted_stat("ep_compaction_throttle_backoffs",
+                    epstats.compactionThrottleBackoffs,
+                    add_stat, cookie);
     add_casted_stat("ep_rollback_count", epstats.rollbackCount,
                     add_stat, cookie);
 
@@ -2508,6 +2882,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                     add_stat, cookie);
     add_casted_stat("ep_access_scanner_num_items", epstats.alogNumItems,
                     add_stat, cookie);
+    add_casted_stat("ep_access_scanner_reused_vbuckets",
+                    epstats.alogReusedVBuckets, add_stat, cookie);
 
     if (kvBucket->isAccessScannerEnabled() && epstats.alogTime.load() != 0)
     {
@@ -2566,6 +2942,10 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
 
     add_casted_stat("ep_num_ops_get_meta", epstats.numOpsGetMeta,
                     add_stat, cookie);
+    add_casted_stat("ep_num_replica_reads_behind",
+                    epstats.numReplicaReadsBehind,
+                    add_stat,
+                    cookie);
     add_casted_stat("ep_num_ops_set_meta", epstats.numOpsSetMeta,
                     add_stat, cookie);
     add_casted_stat("ep_num_ops_del_meta", epstats.numOpsDelMeta,
@@ -2588,6 +2968,18 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                     add_stat, cookie);
     add_casted_stat("ep_defragmenter_num_moved", epstats.defragNumMoved,
                     add_stat, cookie);
+    add_casted_stat("ep_defragmenter_sv_num_moved",
+                    epstats.defragStoredValueNumMoved,
+                    add_stat, cookie);
+    add_casted_stat("ep_item_compressor_num_visited",
+                    epstats.compressorNumVisited,
+                    add_stat, cookie);
+    add_casted_stat("ep_item_compressor_num_compressed",
+                    epstats.compressorNumCompressed,
+                    add_stat, cookie);
+    add_casted_stat("ep_item_compressor_num_inflated",
+                    epstats.compressorNumInflated,
+                    add_stat, cookie);
 
     add_casted_stat("ep_cursor_dropping_lower_threshold",
                     epstats.cursorDroppingLThreshold, add_stat, cookie);
@@ -2595,6 +2987,13 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                     epstats.cursorDroppingUThreshold, add_stat, cookie);
     add_casted_stat("ep_cursors_dropped",
                     epstats.cursorsDropped, add_stat, cookie);
+    add_casted_stat("ep_checkpoint_memory",
+                    epstats.checkpointMemory, add_stat, cookie);
+    add_casted_stat("ep_checkpoint_memory_quota",
+                    static_cast<size_t>(
+                            epstats.getMaxDataSize() *
+                            getCheckpointConfig().getCheckpointMemoryRatio()),
+                    add_stat, cookie);
 
 
     // Note: These are also reported per-shard in 'kvstore' stats, however
@@ -2638,7 +3037,7 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                 cookie);
     }
 
-    // Specific to ForestDB:
+    // Specific to ForestDB, or couchstore_block_cache_size:
     if (kvBucket->getKVStoreStat("Block_cache_hits", value,
                                  KVBucketIface::KVSOption::RW)) {
         add_casted_stat("ep_block_cache_hits", value, add_stat, cookie);
@@ -2653,11 +3052,36 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
 
 ENGINE_ERROR_CODE EventuallyPersistentEngine::doMemoryStats(const void *cookie,
                                                            ADD_STAT add_stat) {
-    add_casted_stat("bytes", stats.getTotalMemoryUsed(), add_stat, cookie);
-    add_casted_stat("mem_used", stats.getTotalMemoryUsed(), add_stat, cookie);
+    size_t memUsed = stats.getPreciseTotalMemoryUsed();
+    add_casted_stat("bytes", memUsed, add_stat, cookie);
+    add_casted_stat("mem_used", memUsed, add_stat, cookie);
+    add_casted_stat("mem_used_estimate", stats.getTotalMemoryUsed(),
+                    add_stat, cookie);
+
+    allocator_arena_stats arenaStats;
+    if (arena != 0 &&
+        serverApi->alloc_hooks->get_arena_stats(arena, &arenaStats)) {
+        add_casted_stat("ep_arena", arena, add_stat, cookie);
+        add_casted_stat("ep_arena_allocated", arenaStats.allocated_size,
+                        add_stat, cookie);
+        add_casted_stat("ep_arena_active", arenaStats.active_size,
+                        add_stat, cookie);
+        add_casted_stat("ep_arena_dirty", arenaStats.dirty_size,
+                        add_stat, cookie);
+        add_casted_stat("ep_arena_resident", arenaStats.resident_size,
+                        add_stat, cookie);
+    }
     add_casted_stat("ep_kv_size", stats.currentSize, add_stat, cookie);
     add_casted_stat("ep_value_size", stats.totalValueSize, add_stat, cookie);
     add_casted_stat("ep_overhead", stats.memOverhead, add_stat, cookie);
+    add_casted_stat("ep_rocksdb_block_cache_memory",
+                    stats.rocksdbBlockCacheMemory,
+                    add_stat,
+                    cookie);
+    add_casted_stat("ep_rocksdb_memtable_memory",
+                    stats.rocksdbMemTableMemory,
+                    add_stat,
+                    cookie);
     add_casted_stat("ep_max_size", stats.getMaxDataSize(), add_stat, cookie);
     add_casted_stat("ep_mem_low_wat", stats.mem_low_wat, add_stat, cookie);
     add_casted_stat("ep_mem_low_wat_percent", stats.mem_low_wat_percent,
@@ -2801,6 +3225,9 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doHashStats(const void *cookie,
                 add_casted_stat(buf, vb->ht.getSize(), add_stat, cookie);
                 checked_snprintf(buf, sizeof(buf), "vb_%d:locks", vbid);
                 add_casted_stat(buf, vb->ht.getNumLocks(), add_stat, cookie);
+                checked_snprintf(buf, sizeof(buf), "vb_%d:lock_waits", vbid);
+                add_casted_stat(
+                        buf, vb->ht.getNumLockWaits(), add_stat, cookie);
                 checked_snprintf(buf, sizeof(buf), "vb_%d:min_depth", vbid);
                 add_casted_stat(buf,
                                 depthVisitor.min == -1 ? 0 : depthVisitor.min,
@@ -2963,12 +3390,18 @@ struct ConnStatBuilder {
         if (tp) {
             ++aggregator.totalProducers;
             tp->aggregateQueueStats(aggregator);
+
+            ConnCounter& byPriority = priorityAggregators[tp->getPriority()];
+            ++byPriority.totalProducers;
+            tp->aggregateQueueStats(byPriority);
         }
     }
 
     const void *cookie;
     ADD_STAT    add_stat;
     ConnCounter& aggregator;
+    //! The producer stats aggregated per priority class
+    std::map<std::string, ConnCounter> priorityAggregators;
 };
 
 struct ConnAggStatBuilder {
@@ -3126,6 +3559,25 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doDcpStats(const void *cookie,
                     dcpConnMap_->getNumActiveSnoozingBackfills(), add_stat, cookie);
     add_casted_stat("ep_dcp_max_running_backfills",
                     dcpConnMap_->getMaxActiveSnoozingBackfills(), add_stat, cookie);
+    add_casted_stat("ep_dcp_num_pending_backfills",
+                    dcpConnMap_->getNumPendingBackfills(), add_stat, cookie);
+    add_casted_stat("ep_dcp_backfill_bytes_read",
+                    dcpConnMap_->getBackfillBytesRead(), add_stat, cookie);
+    add_casted_stat("ep_dcp_max_backfill_bytes",
+                    dcpConnMap_->getMaxBackfillBytes(), add_stat, cookie);
+
+    for (const auto& priority : {"high", "medium", "low"}) {
+        const ConnCounter& counter = dcpVisitor.priorityAggregators[priority];
+        const std::string prefix = std::string("ep_dcp_") + priority + "_";
+        add_casted_stat((prefix + "producer_count").c_str(),
+                        counter.totalProducers, add_stat, cookie);
+        add_casted_stat((prefix + "items_sent").c_str(),
+                        counter.conn_queueDrain, add_stat, cookie);
+        add_casted_stat((prefix + "items_remaining").c_str(),
+                        counter.conn_queueRemaining, add_stat, cookie);
+        add_casted_stat((prefix + "total_bytes").c_str(),
+                        counter.conn_totalBytes, add_stat, cookie);
+    }
 
     dcpConnMap_->addStats(add_stat, cookie);
     return ENGINE_SUCCESS;
@@ -3151,7 +3603,7 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doKeyStats(const void *cookie,
     } else if (validate) {
         rv = kvBucket->statsVKey(key, vbid, cookie);
         if (rv == ENGINE_NOT_MY_VBUCKET || rv == ENGINE_KEY_ENOENT) {
-            if (isDegradedMode()) {
+            if (isDegradedMode(vbid)) {
                 return ENGINE_TMPFAIL;
             }
         }
@@ -3240,6 +3692,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doTimingStats(const void *cookie,
     add_casted_stat("expiry_pager", stats.expiryPagerHisto, add_stat, cookie);
 
     add_casted_stat("storage_age", stats.dirtyAgeHisto, add_stat, cookie);
+    add_casted_stat("persistence_latency", stats.persistenceLatencyHisto,
+                    add_stat, cookie);
 
     // Regular commands
     add_casted_stat("get_cmd", stats.getCmdHisto, add_stat, cookie);
@@ -3267,6 +3721,10 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doTimingStats(const void *cookie,
                     add_stat, cookie);
     add_casted_stat("bg_batch_size", stats.getMultiBatchSizeHisto, add_stat,
                     cookie);
+    add_casted_stat("bg_pass_size", stats.bgFetchPassSizeHisto, add_stat,
+                    cookie);
+    add_casted_stat("bg_coalesce_wait", stats.bgFetchCoalesceHisto, add_stat,
+                    cookie);
 
     // Checkpoint cursor stats
     add_casted_stat("persistence_cursor_get_all_items",
@@ -3275,6 +3733,9 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doTimingStats(const void *cookie,
     add_casted_stat("dcp_cursors_get_all_items",
                     stats.dcpCursorsGetItemsHisto,
                     add_stat, cookie);
+    add_casted_stat("dcp_takeover_unavailable",
+                    stats.dcpTakeoverUnavailableHisto,
+                    add_stat, cookie);
 
     return ENGINE_SUCCESS;
 }
@@ -3305,6 +3766,114 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doRunTimeStats(const void
     return ENGINE_SUCCESS;
 }
 
+/**
+ * Add the histogram as the JSON of the command timings (which mctimings
+ * reads), unless it is empty and skipEmpty.
+ */
+static void addTaskTimingStat(const std::string& key,
+                              const LatencyHistogram& histogram,
+                              bool skipEmpty,
+                              ADD_STAT add_stat,
+                              const void* cookie) {
+    if (skipEmpty && histogram.getCount() == 0) {
+        return;
+    }
+    auto json = histogram.to_json();
+    char* ptr = cJSON_PrintUnformatted(json.get());
+    const std::string value(ptr);
+    cJSON_Free(ptr);
+    add_casted_stat(key.c_str(), value.c_str(), add_stat, cookie);
+}
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::doTaskTimingsStats(
+        const void* cookie,
+        ADD_STAT add_stat,
+        const std::string& taskStat) {
+    for (TaskId id : GlobalTask::allTaskIds) {
+        const std::string name = GlobalTask::getTaskName(id);
+        const std::string wait = name + ":wait";
+        const std::string run = name + ":run";
+        if (taskStat.empty() || taskStat == wait) {
+            LatencyHistogram histogram;
+            stats.taskTimings.getWaitTimes(id, histogram);
+            addTaskTimingStat(wait, histogram, taskStat.empty(), add_stat,
+                              cookie);
+            if (!taskStat.empty()) {
+                return ENGINE_SUCCESS;
+            }
+        }
+        if (taskStat.empty() || taskStat == run) {
+            LatencyHistogram histogram;
+            stats.taskTimings.getRunTimes(id, histogram);
+            addTaskTimingStat(run, histogram, taskStat.empty(), add_stat,
+                              cookie);
+            if (!taskStat.empty()) {
+                return ENGINE_SUCCESS;
+            }
+        }
+    }
+
+    return taskStat.empty() ? ENGINE_SUCCESS : ENGINE_KEY_ENOENT;
+}
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::doVisitorStats(
+        const void* cookie, ADD_STAT add_stat) {
+    for (TaskId id : GlobalTask::allTaskIds) {
+        const auto& runs = stats.visitorRuns[static_cast<size_t>(id)];
+        if (runs.runs == 0) {
+            continue;
+        }
+        const std::string name = GlobalTask::getTaskName(id);
+        add_casted_stat((name + ":runs").c_str(), runs.runs, add_stat, cookie);
+        add_casted_stat((name + ":overruns").c_str(),
+                        runs.overruns,
+                        add_stat,
+                        cookie);
+        add_casted_stat((name + ":overrun_time").c_str(),
+                        runs.overrunTime,
+                        add_stat,
+                        cookie);
+        add_casted_stat((name + ":max_overrun").c_str(),
+                        runs.maxOverrun,
+                        add_stat,
+                        cookie);
+    }
+
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::doLockStats(const void* cookie,
+                                                         ADD_STAT add_stat) {
+    add_casted_stat("sample_rate",
+                    LockStats::sampleRate.load(),
+                    add_stat,
+                    cookie);
+    for (size_t ii = 0; ii < LockStats::numLocks; ++ii) {
+        LockStats& lock = *LockStats::all[ii];
+        if (lock.sampled == 0) {
+            continue;
+        }
+        const std::string name(lock.name);
+        add_casted_stat((name + ":sampled").c_str(),
+                        lock.sampled,
+                        add_stat,
+                        cookie);
+        add_casted_stat((name + ":contended").c_str(),
+                        lock.contended,
+                        add_stat,
+                        cookie);
+        add_casted_stat((name + ":wait").c_str(),
+                        lock.waitHisto,
+                        add_stat,
+                        cookie);
+        add_casted_stat((name + ":hold").c_str(),
+                        lock.holdHisto,
+                        add_stat,
+                        cookie);
+    }
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE EventuallyPersistentEngine::doDispatcherStats(const void
                                                                 *cookie,
                                                                 ADD_STAT
@@ -3461,6 +4030,59 @@ bool EventuallyPersistentEngine::fetchLookupResult(const void* cookie,
     }
 }
 
+void EventuallyPersistentEngine::parkGet(const void* cookie,
+                                         const DocKey& key,
+                                         uint16_t vbucket) {
+    ParkedGet parked{StoredDocKey(key), vbucket, {}};
+    LockHolder lh(parkedGetsMutex);
+    auto it = parkedGets.find(cookie);
+    if (it == parkedGets.end()) {
+        parkedGets.emplace(cookie, std::move(parked));
+        ++numParkedGets;
+    } else {
+        // A get of the cookie which never came back for its result
+        it->second = std::move(parked);
+    }
+}
+
+bool EventuallyPersistentEngine::takeParkedGet(const void* cookie,
+                                               const DocKey& key,
+                                               uint16_t vbucket,
+                                               std::unique_ptr<Item>& itm) {
+    if (numParkedGets.load() == 0) {
+        return false;
+    }
+    LockHolder lh(parkedGetsMutex);
+    auto it = parkedGets.find(cookie);
+    if (it == parkedGets.end()) {
+        return false;
+    }
+    const bool completed = it->second.item &&
+                           it->second.key == StoredDocKey(key) &&
+                           it->second.vbucket == vbucket;
+    if (completed) {
+        itm = std::move(it->second.item);
+    }
+    parkedGets.erase(it);
+    --numParkedGets;
+    return completed;
+}
+
+void EventuallyPersistentEngine::completeParkedGet(const void* cookie,
+                                                   const DocKey& key,
+                                                   uint16_t vbucket,
+                                                   std::unique_ptr<Item> item) {
+    if (!item || numParkedGets.load() == 0) {
+        return;
+    }
+    LockHolder lh(parkedGetsMutex);
+    auto it = parkedGets.find(cookie);
+    if (it != parkedGets.end() && it->second.key == StoredDocKey(key) &&
+        it->second.vbucket == vbucket) {
+        it->second.item = std::move(item);
+    }
+}
+
 ENGINE_ERROR_CODE EventuallyPersistentEngine::doSeqnoStats(const void *cookie,
                                                           ADD_STAT add_stat,
                                                           const char* stat_key,
@@ -3495,12 +4117,51 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doSeqnoStats(const void *cookie,
     return ENGINE_SUCCESS;
 }
 
+ENGINE_ERROR_CODE EventuallyPersistentEngine::doVBucketLatencyStats(
+        const void* cookie, ADD_STAT add_stat, const char* stat_key, int nkey) {
+    auto addStats = [this, cookie, add_stat](const VBucketPtr& vb) {
+        vb->opStats.addStats(
+                "vb_" + std::to_string(vb->getId()), add_stat, cookie);
+    };
+
+    if (nkey > 16) {
+        std::string value(stat_key + 16, nkey - 16);
+
+        try {
+            checkNumeric(value.c_str());
+        } catch (std::runtime_error&) {
+            return ENGINE_EINVAL;
+        }
+
+        VBucketPtr vb = getVBucket(uint16_t(atoi(value.c_str())));
+        if (!vb || vb->getState() == vbucket_state_dead) {
+            return ENGINE_NOT_MY_VBUCKET;
+        }
+        addStats(vb);
+        return ENGINE_SUCCESS;
+    }
+
+    for (auto vbid : kvBucket->getVBuckets().getBuckets()) {
+        VBucketPtr vb = getVBucket(vbid);
+        if (vb) {
+            addStats(vb);
+        }
+    }
+    return ENGINE_SUCCESS;
+}
+
 void EventuallyPersistentEngine::addLookupAllKeys(const void *cookie,
                                                   ENGINE_ERROR_CODE err) {
     LockHolder lh(lookupMutex);
     allKeysLookups[cookie] = err;
 }
 
+void EventuallyPersistentEngine::addSeqnoRangeResult(const void* cookie,
+                                                     SeqnoRangeResult result) {
+    LockHolder lh(lookupMutex);
+    seqnoRangeLookups[cookie] = std::move(result);
+}
+
 void EventuallyPersistentEngine::runDefragmenterTask(void) {
     kvBucket->runDefragmenterTask();
 }
@@ -3541,6 +4202,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::getStats(const void* cookie,
         rv = doVBucketStats(cookie, add_stat, stat_key, nkey, false, true);
     } else if (cb_isPrefix(statKey, "vbucket-seqno")) {
         rv = doSeqnoStats(cookie, add_stat, stat_key, nkey);
+    } else if (cb_isPrefix(statKey, "vbucket-latency")) {
+        rv = doVBucketLatencyStats(cookie, add_stat, stat_key, nkey);
     } else if (statKey == "prev-vbucket") {
         rv = doVBucketStats(cookie, add_stat, stat_key, nkey, true, false);
     } else if (cb_isPrefix(statKey, "checkpoint")) {
@@ -3555,6 +4218,14 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::getStats(const void* cookie,
         rv = doSchedulerStats(cookie, add_stat);
     } else if (statKey == "runtimes") {
         rv = doRunTimeStats(cookie, add_stat);
+    } else if (statKey == "tasktimings") {
+        rv = doTaskTimingsStats(cookie, add_stat, {});
+    } else if (nkey > 12 && cb_isPrefix(statKey, "tasktimings ")) {
+        rv = doTaskTimingsStats(cookie, add_stat, statKey.substr(12));
+    } else if (statKey == "visitors") {
+        rv = doVisitorStats(cookie, add_stat);
+    } else if (statKey == "locks") {
+        rv = doLockStats(cookie, add_stat);
     } else if (statKey == "memory") {
         rv = doMemoryStats(cookie, add_stat);
     } else if (statKey == "uuid") {
@@ -3650,8 +4321,10 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::getStats(const void* cookie,
         }
     } else if (statKey == "collections" &&
                configuration.isCollectionsPrototypeEnabled()) {
-        // @todo MB-24546 For development, just log everything.
+        // @todo MB-24546 For development, also log everything.
         kvBucket->getCollectionsManager().logAll(*kvBucket.get());
+        kvBucket->getCollectionsManager().addStats(
+                *kvBucket.get(), cookie, add_stat);
         rv = ENGINE_SUCCESS;
     }
 
@@ -4067,7 +4740,7 @@ cb::EngineErrorMetadataPair EventuallyPersistentEngine::getMeta(
     if (ret == ENGINE_SUCCESS) {
         metadata = to_item_info(itemMeta, datatype, deleted);
     } else if (ret == ENGINE_KEY_ENOENT || ret == ENGINE_NOT_MY_VBUCKET) {
-        if (isDegradedMode()) {
+        if (isDegradedMode(vbucket)) {
             ret = ENGINE_TMPFAIL;
         }
     }
@@ -4075,8 +4748,39 @@ cb::EngineErrorMetadataPair EventuallyPersistentEngine::getMeta(
     return std::make_pair(cb::engine_errc(ret), metadata);
 }
 
-protocol_binary_response_status
-EventuallyPersistentEngine::decodeWithMetaOptions(
+void EventuallyPersistentEngine::getMetaMulti(
+        const void* cookie,
+        const std::vector<cb::MultiGetKey>& keys,
+        std::vector<cb::EngineErrorMetadataPair>& results) {
+    // Group the keys per vbucket. The metadata of the resident keys is
+    // read straight from the hash table, and the misses queue their
+    // (metadata only) bg fetches together so that the BgFetcher reads
+    // all of them from disk in one batch.
+    std::map<uint16_t, std::vector<size_t>> vbuckets;
+    for (size_t ii = 0; ii < keys.size(); ++ii) {
+        vbuckets[keys[ii].vbucket].push_back(ii);
+    }
+
+    std::vector<DocKey> batch;
+    for (const auto& vb : vbuckets) {
+        batch.clear();
+        for (auto index : vb.second) {
+            batch.push_back(keys[index].key);
+        }
+
+        auto values = kvBucket->getMetaDataMulti(batch, vb.first, cookie);
+        for (size_t ii = 0; ii < values.size(); ++ii) {
+            auto& ret = values[ii];
+            if ((ret.first == cb::engine_errc::no_such_key ||
+                 ret.first == cb::engine_errc::not_my_vbucket) &&
+                isDegradedMode(vb.first)) {
+                ret.first = cb::engine_errc::temporary_failure;
+            }
+            results[vb.second[ii]] = ret;
+        }
+    }
+}
+
         protocol_binary_request_delete_with_meta* request,
         GenerateCas& generateCas,
         CheckConflicts& checkConflicts,
@@ -4084,31 +4788,41 @@ EventuallyPersistentEngine::decodeWithMetaOptions(
         int& keyOffset) {
     uint8_t extlen = request->message.header.request.extlen;
     keyOffset = 0;
-    bool forceFlag = false;
+    uint32_t options = 0;
     if (extlen == 28 || extlen == 30) {
-        uint32_t options;
         memcpy(&options, request->bytes + sizeof(request->bytes),
                sizeof(options));
         options = ntohl(options);
         keyOffset = 4; // 4 bytes for options
+    }
 
-        if (options & SKIP_CONFLICT_RESOLUTION_FLAG) {
-            checkConflicts = CheckConflicts::No;
-        }
-
-        if (options & FORCE_ACCEPT_WITH_META_OPS) {
-            forceFlag = true;
-        }
+    return decodeWithMetaOptions(
+            options, generateCas, checkConflicts, permittedVBStates);
+}
 
-        if (options & REGENERATE_CAS) {
-            generateCas = GenerateCas::Yes;
-        }
+protocol_binary_response_status
+EventuallyPersistentEngine::decodeWithMetaOptions(
+        uint32_t options,
+        GenerateCas& generateCas,
+        CheckConflicts& checkConflicts,
+        PermittedVBStates& permittedVBStates) {
+    bool forceFlag = false;
+    if (options & SKIP_CONFLICT_RESOLUTION_FLAG) {
+        checkConflicts = CheckConflicts::No;
+    }
 
-        if (options & FORCE_WITH_META_OP) {
-            permittedVBStates.set(vbucket_state_replica);
-            permittedVBStates.set(vbucket_state_pending);
-            checkConflicts = CheckConflicts::No;
-        }
+    if (options & FORCE_ACCEPT_WITH_META_OPS) {
+        forceFlag = true;
+    }
+
+    if (options & REGENERATE_CAS) {
+        generateCas = GenerateCas::Yes;
+    }
+
+    if (options & FORCE_WITH_META_OP) {
+        permittedVBStates.set(vbucket_state_replica);
+        permittedVBStates.set(vbucket_state_pending);
+        checkConflicts = CheckConflicts::No;
     }
 
     // Validate options
@@ -4117,12 +4831,12 @@ EventuallyPersistentEngine::decodeWithMetaOptions(
                   checkConflicts == CheckConflicts::Yes;
 
     // 2) If bucket is LWW and forceFlag is not set and GenerateCas::No
-    bool check2 = configuration.getConflictResolutionType() == "lww" &&
-                  !forceFlag && generateCas == GenerateCas::No;
+    // (the strings aren't cached by the configuration, so only read it once)
+    const bool lww = configuration.getConflictResolutionType() == "lww";
+    bool check2 = lww && !forceFlag && generateCas == GenerateCas::No;
 
     // 3) If bucket is not LWW then forceFlag must be false.
-    bool check3 =
-            configuration.getConflictResolutionType() != "lww" && forceFlag;
+    bool check3 = !lww && forceFlag;
 
     // So if either check1/2/3 is true, return EINVAL
     if (check1 || check2 || check3) {
@@ -4549,6 +5263,185 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::deleteWithMeta(
                                     false /*isReplication*/);
 }
 
+/**
+ * The progress of a WITH_META_BATCH which had to wait for the metadata of
+ * one of its documents to be fetched from disk. It is kept as the engine
+ * specific data of the cookie until the command is executed again.
+ */
+struct WithMetaBatchProgress {
+    /// The offset (into the value of the request) of the next document
+    size_t offset = 0;
+    /// The results of the documents applied so far
+    std::vector<WithMetaBatchResult> results;
+};
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::withMetaBatch(
+        const void* cookie,
+        protocol_binary_request_header* request,
+        ADD_RESPONSE response,
+        DocNamespace docNamespace) {
+    std::unique_ptr<WithMetaBatchProgress> progress(
+            static_cast<WithMetaBatchProgress*>(getEngineSpecific(cookie)));
+    storeEngineSpecific(cookie, nullptr);
+
+    const auto& header = request->request;
+    const uint8_t extlen = header.extlen;
+    if ((extlen != 0 && extlen != sizeof(uint32_t)) || header.keylen != 0) {
+        return sendErrorResponse(
+                response, PROTOCOL_BINARY_RESPONSE_EINVAL, 0, cookie);
+    }
+
+    if (isDegradedMode()) {
+        return sendErrorResponse(
+                response, PROTOCOL_BINARY_RESPONSE_ETMPFAIL, 0, cookie);
+    }
+
+    uint32_t options = 0;
+    if (extlen != 0) {
+        memcpy(&options, request->bytes + sizeof(request->bytes),
+               sizeof(options));
+        options = ntohl(options);
+    }
+    CheckConflicts checkConflicts = CheckConflicts::Yes;
+    PermittedVBStates permittedVBStates{vbucket_state_active};
+    GenerateCas generateCas = GenerateCas::No;
+    const auto error = decodeWithMetaOptions(
+            options, generateCas, checkConflicts, permittedVBStates);
+    if (error != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        return sendErrorResponse(response, error, 0, cookie);
+    }
+
+    const uint16_t vbucket = ntohs(header.vbucket);
+    const uint8_t* value = request->bytes + sizeof(request->bytes) + extlen;
+    const size_t vallen = ntohl(header.bodylen) - extlen;
+
+    if (!progress) {
+        if (!getVBucket(vbucket)) {
+            return sendNotMyVBucketResponse(response, cookie, 0);
+        }
+
+        // Check the framing of all the documents first, so that we don't
+        // apply half of a malformed batch
+        size_t count = 0;
+        for (size_t offset = 0; offset < vallen; ++count) {
+            WithMetaBatchEntry entry;
+            if (vallen - offset < sizeof(entry)) {
+                return sendErrorResponse(
+                        response, PROTOCOL_BINARY_RESPONSE_EINVAL, 0, cookie);
+            }
+            memcpy(&entry, value + offset, sizeof(entry));
+            const size_t length = sizeof(entry) + ntohs(entry.keylen) +
+                                  ntohl(entry.valuelen) + ntohs(entry.nmeta);
+            if (entry.keylen == 0 ||
+                entry.op > uint8_t(WithMetaBatchOp::Delete) ||
+                vallen - offset < length) {
+                return sendErrorResponse(
+                        response, PROTOCOL_BINARY_RESPONSE_EINVAL, 0, cookie);
+            }
+            offset += length;
+        }
+        progress = std::make_unique<WithMetaBatchProgress>();
+        progress->results.reserve(count);
+    }
+
+    while (progress->offset < vallen) {
+        WithMetaBatchEntry entry;
+        memcpy(&entry, value + progress->offset, sizeof(entry));
+        const uint16_t keylen = ntohs(entry.keylen);
+        const uint32_t valuelen = ntohl(entry.valuelen);
+        const uint16_t nmeta = ntohs(entry.nmeta);
+        const uint8_t* keyPtr = value + progress->offset + sizeof(entry);
+        const uint8_t* valuePtr = keyPtr + keylen;
+        cb::const_byte_buffer emd;
+        if (nmeta > 0) {
+            emd = cb::const_byte_buffer{valuePtr + valuelen, nmeta};
+        }
+
+        const DocKey key(keyPtr, keylen, docNamespace);
+        const ItemMetaData itemMeta{ntohll(entry.cas),
+                                    ntohll(entry.seqno),
+                                    entry.flags,
+                                    time_t(ntohl(entry.expiration))};
+        const auto op = WithMetaBatchOp(entry.op);
+        uint64_t cas = 0;
+        uint64_t bySeqno = 0;
+        ENGINE_ERROR_CODE ret;
+        try {
+            if (valuelen > maxItemSize) {
+                ret = ENGINE_E2BIG;
+            } else if (op == WithMetaBatchOp::Delete && valuelen == 0) {
+                ret = deleteWithMeta(vbucket,
+                                     key,
+                                     itemMeta,
+                                     cas,
+                                     &bySeqno,
+                                     cookie,
+                                     permittedVBStates,
+                                     checkConflicts,
+                                     GenerateBySeqno::Yes,
+                                     generateCas,
+                                     emd);
+            } else {
+                ret = setWithMeta(vbucket,
+                                  key,
+                                  {valuePtr, valuelen},
+                                  itemMeta,
+                                  op == WithMetaBatchOp::Delete,
+                                  entry.datatype,
+                                  cas,
+                                  &bySeqno,
+                                  cookie,
+                                  permittedVBStates,
+                                  checkConflicts,
+                                  op != WithMetaBatchOp::Add /*allowExisting*/,
+                                  GenerateBySeqno::Yes,
+                                  generateCas,
+                                  emd);
+            }
+        } catch (const std::bad_alloc&) {
+            ret = ENGINE_ENOMEM;
+        }
+
+        if (ret == ENGINE_EWOULDBLOCK) {
+            // The metadata of the document is being fetched; carry on
+            // from (and retry) this document when we're notified
+            ++stats.numOpsGetMetaOnSetWithMeta;
+            storeEngineSpecific(cookie, progress.release());
+            return ENGINE_EWOULDBLOCK;
+        }
+
+        if (ret == ENGINE_SUCCESS) {
+            if (op == WithMetaBatchOp::Delete) {
+                ++stats.numOpsDelMeta;
+            } else {
+                ++stats.numOpsSetMeta;
+            }
+        } else if (ret == ENGINE_ENOMEM) {
+            ret = memoryCondition();
+        }
+
+        WithMetaBatchResult result;
+        result.status =
+                htons(serverApi->cookie->engine_error2mcbp(cookie, ret));
+        result.cas = htonll(ret == ENGINE_SUCCESS ? cas : 0);
+        progress->results.push_back(result);
+        progress->offset += sizeof(entry) + keylen + valuelen + nmeta;
+    }
+
+    return sendResponse(response,
+                        nullptr,
+                        0,
+                        nullptr,
+                        0,
+                        progress->results.data(),
+                        uint32_t(progress->results.size() *
+                                 sizeof(WithMetaBatchResult)),
+                        PROTOCOL_BINARY_RAW_BYTES,
+                        PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                        0,
+                        cookie);
+}
+
 ENGINE_ERROR_CODE
 EventuallyPersistentEngine::handleTrafficControlCmd(const void *cookie,
                                        protocol_binary_request_header *request,
@@ -4558,7 +5451,7 @@ EventuallyPersistentEngine::handleTrafficControlCmd(const void *cookie,
 
     switch (request->request.opcode) {
     case PROTOCOL_BINARY_CMD_ENABLE_TRAFFIC:
-        if (kvBucket->isWarmingUp()) {
+        if (kvBucket->isWarmingUpActiveVBuckets()) {
             // engine is still warming up, do not turn on data traffic yet
             status = PROTOCOL_BINARY_RESPONSE_ETMPFAIL;
             setErrorContext(cookie, "Persistent engine is still warming up!");
@@ -4775,14 +5668,24 @@ EventuallyPersistentEngine::returnMeta(const void* cookie,
  *
  * This initially allocated buffersize is doubled whenever the length
  * of the buffer holding all the keys, crosses the buffersize.
+ *
+ * If maxBytes is set the keys stop (with the status set to ENGINE_E2BIG
+ * so that the scan stops) before the buffer would exceed it, and the key
+ * it stopped at is kept as the one the next request should start at.
  */
 class AllKeysCallback : public Callback<const DocKey&> {
 public:
-    AllKeysCallback() {
+    explicit AllKeysCallback(size_t maxBytes_ = 0) : maxBytes(maxBytes_) {
         buffer.reserve((avgKeySize + sizeof(uint16_t)) * expNumKeys);
     }
 
     void callback(const DocKey& key) {
+        if (maxBytes != 0 && !buffer.empty() &&
+            buffer.size() + key.size() + sizeof(uint16_t) > maxBytes) {
+            continuation.assign(key.data(), key.data() + key.size());
+            setStatus(ENGINE_E2BIG);
+            return;
+        }
         if (buffer.size() + key.size() + sizeof(uint16_t) >
             buffer.size()) {
             // Reserve the 2x space for the copy-to buffer.
@@ -4799,8 +5702,16 @@ public:
     char* getAllKeysPtr() { return buffer.data(); }
     uint64_t getAllKeysLen() { return buffer.size(); }
 
+    /// The key the next request should start at (empty if the scan
+    /// wasn't cut short by maxBytes)
+    const std::vector<char>& getContinuation() const {
+        return continuation;
+    }
+
 private:
+    const size_t maxBytes;
     std::vector<char> buffer;
+    std::vector<char> continuation;
 
     static const int avgKeySize = 32;
     static const int expNumKeys = 1000;
@@ -4818,7 +5729,8 @@ public:
                      ADD_RESPONSE resp,
                      const DocKey start_key_,
                      uint16_t vbucket,
-                     uint32_t count_)
+                     uint32_t count_,
+                     uint32_t maxBytes_)
         : GlobalTask(e, TaskId::FetchAllKeysTask, 0, false),
           engine(e),
           cookie(c),
@@ -4827,7 +5739,8 @@ public:
           response(resp),
           start_key(start_key_),
           vbid(vbucket),
-          count(count_) {
+          count(count_),
+          maxBytes(maxBytes_) {
     }
 
     cb::const_char_buffer getDescription() {
@@ -4852,13 +5765,16 @@ public:
                                PROTOCOL_BINARY_RESPONSE_SUCCESS, 0,
                                cookie);
         } else {
-            auto cb = std::make_shared<AllKeysCallback>();
+            auto cb = std::make_shared<AllKeysCallback>(maxBytes);
             err = engine->getKVBucket()->getROUnderlying(vbid)->getAllKeys(
                                                     vbid, start_key, count, cb);
             if (err == ENGINE_SUCCESS) {
-                err =  sendResponse(response, NULL, 0, NULL, 0,
-                                    ((AllKeysCallback*)cb.get())->getAllKeysPtr(),
-                                    ((AllKeysCallback*)cb.get())->getAllKeysLen(),
+                // The key to continue from (if any) goes in the extras
+                const auto& next = cb->getContinuation();
+                err =  sendResponse(response, NULL, 0,
+                                    next.data(), uint8_t(next.size()),
+                                    cb->getAllKeysPtr(),
+                                    cb->getAllKeysLen(),
                                     PROTOCOL_BINARY_RAW_BYTES,
                                     PROTOCOL_BINARY_RESPONSE_SUCCESS, 0,
                                     cookie);
@@ -4877,6 +5793,7 @@ private:
     StoredDocKey start_key;
     uint16_t vbid;
     uint32_t count;
+    uint32_t maxBytes;
 };
 
 ENGINE_ERROR_CODE
@@ -4909,19 +5826,24 @@ EventuallyPersistentEngine::getAllKeys(const void* cookie,
     if (vb->getState() != vbucket_state_active) {
         return ENGINE_NOT_MY_VBUCKET;
     }
-    //key: key, ext: no. of keys to fetch, sorting-order
+    //key: key, ext: no. of keys to fetch (and max size of the response)
     uint16_t keylen = ntohs(request->message.header.request.keylen);
     uint8_t extlen = request->message.header.request.extlen;
 
     uint32_t count = 1000;
+    uint32_t maxBytes = 0;
 
     if (extlen > 0) {
-        if (extlen != sizeof(uint32_t)) {
+        if (extlen != sizeof(uint32_t) && extlen != 2 * sizeof(uint32_t)) {
             return ENGINE_EINVAL;
         }
-        memcpy(&count, request->bytes + sizeof(request->bytes),
-               sizeof(uint32_t));
+        const uint8_t* extras = request->bytes + sizeof(request->bytes);
+        memcpy(&count, extras, sizeof(uint32_t));
         count = ntohl(count);
+        if (extlen == 2 * sizeof(uint32_t)) {
+            memcpy(&maxBytes, extras + sizeof(uint32_t), sizeof(uint32_t));
+            maxBytes = ntohl(maxBytes);
+        }
     }
 
     if (keylen == 0) {
@@ -4932,7 +5854,707 @@ EventuallyPersistentEngine::getAllKeys(const void* cookie,
     DocKey start_key(keyPtr, keylen, docNamespace);
 
     ExTask task = std::make_shared<FetchAllKeysTask>(
-            this, cookie, response, start_key, vbucket, count);
+            this, cookie, response, start_key, vbucket, count, maxBytes);
+    ExecutorPool::get()->schedule(task);
+    return ENGINE_EWOULDBLOCK;
+}
+
+/**
+ * The range of keys of a RANGE_SCAN request
+ */
+struct KeyRange {
+    std::string start;
+    //! The key the range ends before (the range has no end if empty)
+    std::string end;
+    //! If set, the range is the keys starting with start (end is empty)
+    bool prefix;
+
+    /// @return true if the key is after the end of the range
+    bool isPast(const std::string& key) const {
+        if (prefix) {
+            return key.compare(0, start.size(), start) > 0;
+        }
+        return !end.empty() && key >= end;
+    }
+
+    bool contains(const std::string& key) const {
+        return key >= start && !isPast(key);
+    }
+};
+
+static std::string keyToString(const DocKey& key) {
+    return std::string(reinterpret_cast<const char*>(key.data()), key.size());
+}
+
+/**
+ * The documents of a RANGE_SCAN response: the ones of the by-id index of
+ * the file of the vbucket, merged with the ones of its HashTable which
+ * aren't persisted yet, in the order of their keys.
+ */
+class RangeScan {
+public:
+    RangeScan(VBucket& vb,
+              KeyRange range,
+              DocNamespace ns,
+              uint32_t count,
+              uint32_t maxBytes)
+        : vb(vb),
+          range(std::move(range)),
+          ns(ns),
+          count(count),
+          maxBytes(maxBytes) {
+    }
+
+    /**
+     * Collects the keys of the range whose documents aren't persisted yet,
+     * which the scan of the file may not see
+     */
+    void collectDirtyKeys() {
+        if (vb.dirtyQueueSize == 0) {
+            return;
+        }
+
+        class DirtyKeysVisitor : public HashTableVisitor {
+        public:
+            explicit DirtyKeysVisitor(RangeScan& scan) : scan(scan) {
+            }
+
+            bool visit(const HashTable::HashBucketLock&,
+                       StoredValue& v) override {
+                if (v.isDirty() && !v.isDeleted() && !v.isTempItem() &&
+                    v.getKey().getDocNamespace() == scan.ns) {
+                    auto key = keyToString(v.getKey());
+                    if (scan.range.contains(key)) {
+                        scan.dirty.insert(std::move(key));
+                    }
+                }
+                return true;
+            }
+
+        private:
+            RangeScan& scan;
+        } visitor(*this);
+        vb.ht.visit(visitor);
+    }
+
+    /**
+     * Looks up a document read from the file (before reading its value) in
+     * the HashTable, which may have a newer version of it, or a copy of it
+     *
+     * @return ENGINE_SUCCESS to read the document from the file,
+     *         ENGINE_KEY_EEXISTS to skip it and ENGINE_ENOMEM to stop the
+     *         scan (see CouchKVStore::recordDbDump)
+     */
+    ENGINE_ERROR_CODE lookup(CacheLookup& lookup) {
+        const auto key = keyToString(lookup.getKey());
+        if (!addDirtyBefore(&key) || range.isPast(key)) {
+            return ENGINE_ENOMEM;
+        }
+        dirty.erase(key);
+
+        std::unique_ptr<Item> item;
+        {
+            auto hbl = vb.ht.getLockedBucket(lookup.getKey());
+            StoredValue* v = vb.ht.unlocked_find(lookup.getKey(),
+                                                 hbl.getBucketNum(),
+                                                 WantsDeleted::Yes,
+                                                 TrackReference::No);
+            if (!v || v->isTempItem() || !v->isResident()) {
+                return ENGINE_SUCCESS;
+            }
+            if (v->isDeleted()) {
+                return ENGINE_KEY_EEXISTS;
+            }
+            item = v->toItem(v->isLocked(ep_current_time()), vb.getId());
+        }
+        return add(*item) ? ENGINE_KEY_EEXISTS : ENGINE_ENOMEM;
+    }
+
+    /// @return false if the response is full (to stop the scan)
+    bool addFromDisk(Item& item) {
+        return item.isDeleted() || add(item);
+    }
+
+    /// Adds the documents not persisted yet after the last one of the file
+    void finish() {
+        addDirtyBefore(nullptr);
+    }
+
+    const std::string& getBody() const {
+        return body;
+    }
+
+    /// The key the next request should start at (empty if the response
+    /// has the whole range)
+    const std::string& getContinuation() const {
+        return continuation;
+    }
+
+private:
+    /**
+     * Adds the documents not persisted yet whose keys are before the given
+     * one (all of them if null)
+     *
+     * @return false if the response is full
+     */
+    bool addDirtyBefore(const std::string* key) {
+        while (!dirty.empty() && (key == nullptr || *dirty.begin() < *key)) {
+            const StoredDocKey docKey(*dirty.begin(), ns);
+            dirty.erase(dirty.begin());
+
+            std::unique_ptr<Item> item;
+            {
+                auto hbl = vb.ht.getLockedBucket(docKey);
+                StoredValue* v = vb.ht.unlocked_find(docKey,
+                                                     hbl.getBucketNum(),
+                                                     WantsDeleted::No,
+                                                     TrackReference::No);
+                // It may have been deleted (or persisted and evicted)
+                // since it was collected
+                if (!v || v->isTempItem() || !v->isResident()) {
+                    continue;
+                }
+                item = v->toItem(v->isLocked(ep_current_time()), vb.getId());
+            }
+            if (!add(*item)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @return false (recording its key to continue from) if the document
+    ///         doesn't fit in the response
+    bool add(Item& item) {
+        if (item.isExpired(ep_real_time()) || !item.decompressValue()) {
+            return true;
+        }
+        item.pruneValueAndOrXattrs(IncludeValue::Yes, IncludeXattrs::No);
+
+        const auto& key = item.getKey();
+        const size_t size = sizeof(uint16_t) + 2 * sizeof(uint32_t) +
+                            sizeof(uint64_t) + sizeof(uint8_t) + key.size() +
+                            item.getNBytes();
+        if (numDocs == count ||
+            (maxBytes != 0 && numDocs != 0 && body.size() + size > maxBytes)) {
+            continuation = keyToString(key);
+            return false;
+        }
+
+        const uint16_t keylen = htons(uint16_t(key.size()));
+        const uint32_t flags = item.getFlags();
+        const uint32_t valuelen = htonl(uint32_t(item.getNBytes()));
+        const uint64_t cas = htonll(item.getCas());
+        const uint8_t datatype = item.getDataType();
+        body.append(reinterpret_cast<const char*>(&keylen), sizeof(keylen));
+        body.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+        body.append(reinterpret_cast<const char*>(&valuelen),
+                    sizeof(valuelen));
+        body.append(reinterpret_cast<const char*>(&cas), sizeof(cas));
+        body.append(reinterpret_cast<const char*>(&datatype),
+                    sizeof(datatype));
+        body.append(reinterpret_cast<const char*>(key.data()), key.size());
+        body.append(item.getData(), item.getNBytes());
+        ++numDocs;
+        return true;
+    }
+
+    VBucket& vb;
+    const KeyRange range;
+    const DocNamespace ns;
+    const uint32_t count;
+    const uint32_t maxBytes;
+
+    //! The keys of the documents not persisted yet, not added yet
+    std::set<std::string> dirty;
+
+    std::string body;
+    uint32_t numDocs = 0;
+    std::string continuation;
+};
+
+class RangeScanDiskCallback : public Callback<GetValue> {
+public:
+    explicit RangeScanDiskCallback(RangeScan& scan) : scan(scan) {
+    }
+
+    void callback(GetValue& val) {
+        setStatus(scan.addFromDisk(*val.item) ? ENGINE_SUCCESS
+                                              : ENGINE_ENOMEM);
+    }
+
+private:
+    RangeScan& scan;
+};
+
+class RangeScanCacheCallback : public Callback<CacheLookup> {
+public:
+    explicit RangeScanCacheCallback(RangeScan& scan) : scan(scan) {
+    }
+
+    void callback(CacheLookup& lookup) {
+        setStatus(scan.lookup(lookup));
+    }
+
+private:
+    RangeScan& scan;
+};
+
+/*
+ * Task that scans a range of keys and returns response, runs in
+ * background.
+ */
+class RangeScanTask : public GlobalTask {
+public:
+    RangeScanTask(EventuallyPersistentEngine* e,
+                  const void* c,
+                  ADD_RESPONSE resp,
+                  uint16_t vbucket,
+                  KeyRange range_,
+                  DocNamespace ns_,
+                  uint32_t count_,
+                  uint32_t maxBytes_)
+        : GlobalTask(e, TaskId::RangeScanTask, 0, false),
+          engine(e),
+          cookie(c),
+          description("Running a range scan on vbucket: " +
+                      std::to_string(vbucket)),
+          response(resp),
+          vbid(vbucket),
+          range(std::move(range_)),
+          ns(ns_),
+          count(count_),
+          maxBytes(maxBytes_) {
+    }
+
+    cb::const_char_buffer getDescription() {
+        return description;
+    }
+
+    std::chrono::microseconds maxExpectedDuration() {
+        // As for FetchAllKeysTask, a function of how many documents are
+        // fetched
+        return std::chrono::milliseconds(100);
+    }
+
+    bool run() {
+        TRACE_EVENT0("ep-engine/task", "RangeScanTask");
+        ENGINE_ERROR_CODE err = scan();
+        engine->addLookupAllKeys(cookie, err);
+        engine->notifyIOComplete(cookie, err);
+        return false;
+    }
+
+private:
+    ENGINE_ERROR_CODE scan() {
+        VBucketPtr vb = engine->getVBucket(vbid);
+        if (!vb) {
+            return ENGINE_NOT_MY_VBUCKET;
+        }
+
+        RangeScan scan(*vb, range, ns, count, maxBytes);
+        scan.collectDirtyKeys();
+        // There isn't any file to scan during the vbucket file creation
+        if (!vb->isBucketCreation()) {
+            KVStore* kvstore = engine->getKVBucket()->getROUnderlying(vbid);
+            auto cb = std::make_shared<RangeScanDiskCallback>(scan);
+            auto cl = std::make_shared<RangeScanCacheCallback>(scan);
+            ScanContext* ctx =
+                    kvstore->initScanContext(cb,
+                                             cl,
+                                             vbid,
+                                             0,
+                                             DocumentFilter::NO_DELETES,
+                                             ValueFilter::VALUES_DECOMPRESSED);
+            if (!ctx) {
+                return ENGINE_TMPFAIL;
+            }
+            ctx->byKey = true;
+            ctx->startKey = range.start;
+            // scan_again means the scan was stopped (by the end of the
+            // range, or a full response)
+            const scan_error_t error = kvstore->scan(ctx);
+            kvstore->destroyScanContext(ctx);
+            if (error == scan_failed) {
+                return ENGINE_FAILED;
+            }
+        }
+        if (scan.getContinuation().empty()) {
+            scan.finish();
+        }
+
+        const auto& next = scan.getContinuation();
+        const auto& body = scan.getBody();
+        return sendResponse(response,
+                            NULL,
+                            0,
+                            next.data(),
+                            uint8_t(next.size()),
+                            body.data(),
+                            uint32_t(body.size()),
+                            PROTOCOL_BINARY_RAW_BYTES,
+                            PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                            0,
+                            cookie);
+    }
+
+    EventuallyPersistentEngine* engine;
+    const void* cookie;
+    const std::string description;
+    ADD_RESPONSE response;
+    uint16_t vbid;
+    const KeyRange range;
+    const DocNamespace ns;
+    uint32_t count;
+    uint32_t maxBytes;
+};
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::rangeScan(
+        const void* cookie,
+        protocol_binary_request_range_scan* request,
+        ADD_RESPONSE response,
+        DocNamespace docNamespace) {
+    // Only the couchstore files can be scanned by key
+    if (!getKVBucket()->isGetAllKeysSupported() ||
+        configuration.getBackend() != "couchdb") {
+        return ENGINE_ENOTSUP;
+    }
+
+    {
+        LockHolder lh(lookupMutex);
+        auto it = allKeysLookups.find(cookie);
+        if (it != allKeysLookups.end()) {
+            ENGINE_ERROR_CODE err = it->second;
+            allKeysLookups.erase(it);
+            return err;
+        }
+    }
+
+    const auto& header = request->message.header.request;
+    uint16_t vbucket = ntohs(header.vbucket);
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    ReaderLockHolder rlh(vb->getStateLock());
+    if (vb->getState() != vbucket_state_active) {
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    // key: start key, extras: count, max size and flags, value: end key
+    if (header.extlen != sizeof(request->message.body)) {
+        return ENGINE_EINVAL;
+    }
+    const uint16_t keylen = ntohs(header.keylen);
+    const uint32_t bodylen = ntohl(header.bodylen);
+    uint32_t count = ntohl(request->message.body.count);
+    const uint32_t maxBytes = ntohl(request->message.body.max_bytes);
+    const uint32_t flags = ntohl(request->message.body.flags);
+    if ((flags & ~RANGE_SCAN_FLAG_PREFIX) != 0) {
+        return ENGINE_EINVAL;
+    }
+    if (count == 0) {
+        count = 1000;
+    }
+
+    const auto* keyPtr = reinterpret_cast<const char*>(
+            request->bytes + sizeof(request->bytes));
+    const size_t endlen = bodylen - header.extlen - keylen;
+    KeyRange range{std::string(keyPtr, keylen),
+                   std::string(keyPtr + keylen, endlen),
+                   (flags & RANGE_SCAN_FLAG_PREFIX) != 0};
+    if (range.prefix && !range.end.empty()) {
+        return ENGINE_EINVAL;
+    }
+
+    ExTask task = std::make_shared<RangeScanTask>(this,
+                                                  cookie,
+                                                  response,
+                                                  vbucket,
+                                                  std::move(range),
+                                                  docNamespace,
+                                                  count,
+                                                  maxBytes);
+    ExecutorPool::get()->schedule(task);
+    return ENGINE_EWOULDBLOCK;
+}
+
+/**
+ * The batch of the documents of a vbucket read for a get_seqno_range, up to
+ * the end of the range or the size of the batch.
+ */
+class SeqnoRangeRead {
+public:
+    SeqnoRangeRead(EventuallyPersistentEngine& engine,
+                   VBucket& vb,
+                   uint64_t start,
+                   uint64_t end,
+                   size_t maxBytes)
+        : engine(engine), vb(vb), end(end), maxBytes(maxBytes) {
+        result.next = start;
+    }
+
+    /// @return false (so that the read stops) if the item doesn't belong
+    ///         in the batch
+    bool add(std::unique_ptr<Item> item) {
+        const uint64_t seqno = item->getBySeqno();
+        if (seqno > end) {
+            complete = true;
+            return false;
+        }
+        const size_t size = item->size();
+        if (maxBytes != 0 && !result.items.empty() &&
+            bytes + size > maxBytes) {
+            return false;
+        }
+        bytes += size;
+        result.items.push_back(std::move(item));
+        result.next = seqno + 1;
+        return true;
+    }
+
+    /// As the backfills do (see CacheCallback), take the documents which
+    /// are resident from memory instead of reading their bodies
+    ENGINE_ERROR_CODE lookup(CacheLookup& lookup) {
+        if (uint64_t(lookup.getBySeqno()) > end) {
+            complete = true;
+            return ENGINE_ENOMEM;
+        }
+        GetValue gv = vb.getInternal(lookup.getKey(),
+                                     nullptr,
+                                     engine,
+                                     0,
+                                     /*options*/ NONE,
+                                     /*diskFlushAll*/ false,
+                                     VBucket::GetKeyOnly::No);
+        if (gv.getStatus() == ENGINE_SUCCESS &&
+            gv.item->getBySeqno() == lookup.getBySeqno()) {
+            return add(std::move(gv.item)) ? ENGINE_KEY_EEXISTS
+                                           : ENGINE_ENOMEM;
+        }
+        return ENGINE_SUCCESS;
+    }
+
+    /// Everything up to the seqno given was read (and no more was there)
+    void readUpTo(uint64_t seqno) {
+        if (seqno >= end) {
+            complete = true;
+        } else {
+            result.next = std::max(result.next, seqno + 1);
+        }
+    }
+
+    SeqnoRangeResult finish() {
+        if (complete) {
+            result.next = end + 1;
+        }
+        return std::move(result);
+    }
+
+private:
+    EventuallyPersistentEngine& engine;
+    VBucket& vb;
+    const uint64_t end;
+    const size_t maxBytes;
+    SeqnoRangeResult result;
+    size_t bytes = 0;
+    //! Set once the end of the range was reached
+    bool complete = false;
+};
+
+class SeqnoRangeDiskCallback : public Callback<GetValue> {
+public:
+    explicit SeqnoRangeDiskCallback(SeqnoRangeRead& read) : read(read) {
+    }
+
+    void callback(GetValue& val) {
+        setStatus(read.add(std::move(val.item)) ? ENGINE_SUCCESS
+                                                : ENGINE_ENOMEM);
+    }
+
+private:
+    SeqnoRangeRead& read;
+};
+
+class SeqnoRangeCacheCallback : public Callback<CacheLookup> {
+public:
+    explicit SeqnoRangeCacheCallback(SeqnoRangeRead& read) : read(read) {
+    }
+
+    void callback(CacheLookup& lookup) {
+        setStatus(read.lookup(lookup));
+    }
+
+private:
+    SeqnoRangeRead& read;
+};
+
+/*
+ * Task that reads a batch of the documents of a vbucket in seqno order for
+ * a get_seqno_range, runs in background.
+ */
+class SeqnoRangeTask : public GlobalTask {
+public:
+    SeqnoRangeTask(EventuallyPersistentEngine* e,
+                   const void* c,
+                   uint16_t vbucket,
+                   uint64_t start_,
+                   uint64_t end_,
+                   size_t maxBytes_)
+        : GlobalTask(e, TaskId::SeqnoRangeTask, 0, false),
+          engine(e),
+          cookie(c),
+          description("Reading a seqno range of vbucket: " +
+                      std::to_string(vbucket)),
+          vbid(vbucket),
+          start(start_),
+          end(end_),
+          maxBytes(maxBytes_) {
+    }
+
+    cb::const_char_buffer getDescription() {
+        return description;
+    }
+
+    std::chrono::microseconds maxExpectedDuration() {
+        // As for FetchAllKeysTask, a function of how many documents are
+        // read
+        return std::chrono::milliseconds(100);
+    }
+
+    bool run() {
+        TRACE_EVENT0("ep-engine/task", "SeqnoRangeTask");
+        SeqnoRangeResult result;
+        result.status = read(result);
+        const auto status = result.status;
+        engine->addSeqnoRangeResult(cookie, std::move(result));
+        engine->notifyIOComplete(cookie, status);
+        return false;
+    }
+
+private:
+    ENGINE_ERROR_CODE read(SeqnoRangeResult& result) {
+        VBucketPtr vb = engine->getVBucket(vbid);
+        if (!vb) {
+            return ENGINE_NOT_MY_VBUCKET;
+        }
+
+        SeqnoRangeRead rangeRead(*engine, *vb, start, end, maxBytes);
+        auto* evb = dynamic_cast<EphemeralVBucket*>(vb.get());
+        if (evb) {
+            // The whole range is copied from the sequence list (as by an
+            // in-memory backfill); only what fits is kept
+            const uint64_t first = std::max(start, uint64_t(1));
+            if (first <= uint64_t(vb->getHighSeqno())) {
+                ENGINE_ERROR_CODE status;
+                std::vector<UniqueItemPtr> items;
+                seqno_t readEnd;
+                std::tie(status, items, readEnd) =
+                        evb->inMemoryBackfill(first, end);
+                if (status != ENGINE_SUCCESS) {
+                    return status;
+                }
+                bool full = false;
+                for (auto& item : items) {
+                    if (!rangeRead.add(std::move(item))) {
+                        full = true;
+                        break;
+                    }
+                }
+                if (!full) {
+                    rangeRead.readUpTo(readEnd);
+                }
+            }
+        } else if (!vb->isBucketCreation()) {
+            // Only what is persisted can be read; the rest comes in a
+            // later batch
+            KVStore* kvstore = engine->getKVBucket()->getROUnderlying(vbid);
+            auto cb = std::make_shared<SeqnoRangeDiskCallback>(rangeRead);
+            auto cl = std::make_shared<SeqnoRangeCacheCallback>(rangeRead);
+            ScanContext* ctx =
+                    kvstore->initScanContext(cb,
+                                             cl,
+                                             vbid,
+                                             start,
+                                             DocumentFilter::ALL_ITEMS,
+                                             ValueFilter::VALUES_DECOMPRESSED);
+            if (!ctx) {
+                return ENGINE_TMPFAIL;
+            }
+            // scan_again means the read was stopped (by the end of the
+            // range, or a full batch)
+            const scan_error_t error = kvstore->scan(ctx);
+            const uint64_t maxSeqno = ctx->maxSeqno;
+            kvstore->destroyScanContext(ctx);
+            if (error == scan_failed) {
+                return ENGINE_FAILED;
+            }
+            if (error == scan_success) {
+                rangeRead.readUpTo(maxSeqno);
+            }
+        }
+        result = rangeRead.finish();
+        return ENGINE_SUCCESS;
+    }
+
+    EventuallyPersistentEngine* engine;
+    const void* cookie;
+    const std::string description;
+    const uint16_t vbid;
+    const uint64_t start;
+    const uint64_t end;
+    const size_t maxBytes;
+};
+
+ENGINE_ERROR_CODE EventuallyPersistentEngine::getSeqnoRange(
+        const void* cookie,
+        uint16_t vbucket,
+        uint64_t start,
+        uint64_t end,
+        size_t maxBytes,
+        cb::SeqnoRangeBatch& batch) {
+    SeqnoRangeResult result;
+    bool found = false;
+    {
+        LockHolder lh(lookupMutex);
+        auto it = seqnoRangeLookups.find(cookie);
+        if (it != seqnoRangeLookups.end()) {
+            result = std::move(it->second);
+            seqnoRangeLookups.erase(it);
+            found = true;
+        }
+    }
+    if (found) {
+        if (result.status == ENGINE_SUCCESS) {
+            auto* handle = reinterpret_cast<ENGINE_HANDLE*>(this);
+            batch.items.clear();
+            batch.items.reserve(result.items.size());
+            for (auto& item : result.items) {
+                batch.items.emplace_back(item.release(),
+                                         cb::ItemDeleter{handle});
+            }
+            batch.next = result.next;
+        }
+        return result.status;
+    }
+
+    if (start > end) {
+        return ENGINE_EINVAL;
+    }
+
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    ReaderLockHolder rlh(vb->getStateLock());
+    if (vb->getState() != vbucket_state_active) {
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    ExTask task = std::make_shared<SeqnoRangeTask>(
+            this, cookie, vbucket, start, end, maxBytes);
     ExecutorPool::get()->schedule(task);
     return ENGINE_EWOULDBLOCK;
 }
@@ -5033,6 +6655,17 @@ ConnHandler* EventuallyPersistentEngine::getConnHandler(const void *cookie) {
 
 void EventuallyPersistentEngine::handleDisconnect(const void *cookie) {
     dcpConnMap_->disconnect(cookie);
+    {
+        // A batch read for a connection which didn't come back for it
+        LockHolder lh(lookupMutex);
+        seqnoRangeLookups.erase(cookie);
+    }
+    if (numParkedGets.load() != 0) {
+        LockHolder lh(parkedGetsMutex);
+        if (parkedGets.erase(cookie) != 0) {
+            --numParkedGets;
+        }
+    }
     /**
      * Decrement session_cas's counter, if the connection closes
      * before a control command (that returned ENGINE_EWOULDBLOCK
@@ -5080,14 +6713,16 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::getAllVBucketSequenceNumbers(
     }
 
     std::vector<uint8_t> payload;
-    auto vbuckets = kvBucket->getVBuckets().getBuckets();
+    // Published by the vbuckets as they change (see VBucketSeqnoSlot), so
+    // that polling neither looks up nor locks any of them
+    const auto& slots = kvBucket->getVBuckets().getSeqnoSlots();
 
-    /* Reserve a buffer that's big enough to hold all of them (we might
+    /* Allocate a buffer that's big enough to hold all of them (we might
      * not use all of them. Each entry in the array occupies 10 bytes
      * (two bytes vbucket id followed by 8 bytes sequence number)
      */
     try {
-        payload.reserve(vbuckets.size() * (sizeof(uint16_t) + sizeof(uint64_t)));
+        payload.resize(slots.size() * (sizeof(uint16_t) + sizeof(uint64_t)));
     } catch (std::bad_alloc) {
         return sendResponse(response, 0, 0, 0, 0, 0, 0,
                             PROTOCOL_BINARY_RAW_BYTES,
@@ -5095,36 +6730,36 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::getAllVBucketSequenceNumbers(
                             cookie);
     }
 
-    for (auto id : vbuckets) {
-        VBucketPtr vb = getVBucket(id);
-        if (vb) {
-            auto state = vb->getState();
-            bool getSeqnoForThisVb = false;
-            if (reqState) {
-                getSeqnoForThisVb = (reqState == state);
+    size_t offset = 0;
+    for (size_t id = 0; id < slots.size(); ++id) {
+        const auto& slot = *slots[id];
+        auto state = static_cast<vbucket_state_t>(slot.state.load());
+        if (state == 0) {
+            continue;
+        }
+        bool getSeqnoForThisVb = false;
+        if (reqState) {
+            getSeqnoForThisVb = (reqState == state);
+        } else {
+            getSeqnoForThisVb = (state == vbucket_state_active) ||
+                                (state == vbucket_state_replica) ||
+                                (state == vbucket_state_pending);
+        }
+        if (getSeqnoForThisVb) {
+            uint16_t vbid = htons(static_cast<uint16_t>(id));
+            uint64_t highSeqno;
+            if (state == vbucket_state_active) {
+                highSeqno = htonll(slot.highSeqno.load());
             } else {
-                getSeqnoForThisVb = (state == vbucket_state_active) ||
-                                    (state == vbucket_state_replica) ||
-                                    (state == vbucket_state_pending);
-            }
-            if (getSeqnoForThisVb) {
-                uint16_t vbid = htons(static_cast<uint16_t>(id));
-                uint64_t highSeqno;
-                if (vb->getState() == vbucket_state_active) {
-                    highSeqno = htonll(vb->getHighSeqno());
-                } else {
-                    snapshot_info_t info =
-                            vb->checkpointManager->getSnapshotInfo();
-                    highSeqno = htonll(info.range.end);
-                }
-                auto offset = payload.size();
-                payload.resize(offset + sizeof(vbid) + sizeof(highSeqno));
-                memcpy(payload.data() + offset, &vbid, sizeof(vbid));
-                memcpy(payload.data() + offset + sizeof(vbid), &highSeqno,
-                       sizeof(highSeqno));
+                highSeqno = htonll(slot.snapshotEnd.load());
             }
+            memcpy(payload.data() + offset, &vbid, sizeof(vbid));
+            memcpy(payload.data() + offset + sizeof(vbid), &highSeqno,
+                   sizeof(highSeqno));
+            offset += sizeof(vbid) + sizeof(highSeqno);
         }
     }
+    payload.resize(offset);
 
     return sendResponse(response,
                         0, 0, /* key */
@@ -5278,6 +6913,7 @@ EventuallyPersistentEngine::~EventuallyPersistentEngine() {
     LOG(EXTENSION_LOG_NOTICE, "~EPEngine: Deleted dcpConnMap_.");
     delete dcpFlowControlManager_;
     delete checkpointConfig;
+    ObjectRegistry::releaseArena(arena);
 }
 
 const std::string& EpEngineTaskable::getName() const {
@@ -5300,6 +6936,10 @@ WorkLoadPolicy&  EpEngineTaskable::getWorkLoadPolicy(void) {
     return myEngine->getWorkLoadPolicy();
 }
 
+size_t EpEngineTaskable::getWorkloadShare() const {
+    return myEngine->getConfiguration().getExecutorShareWeight();
+}
+
 void EpEngineTaskable::logQTime(TaskId id,
                                 const ProcessClock::duration enqTime) {
     myEngine->getKVBucket()->logQTime(id, enqTime);
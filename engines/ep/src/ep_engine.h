@@ -59,6 +59,16 @@ typedef void (*NOTIFY_IO_COMPLETE_T)(const void *cookie,
 // Forward decl
 class EventuallyPersistentEngine;
 
+/**
+ * The outcome of the read of a seqno range by a SeqnoRangeTask (see
+ * ENGINE_HANDLE_V1::get_seqno_range), kept until its connection calls again
+ */
+struct SeqnoRangeResult {
+    ENGINE_ERROR_CODE status = ENGINE_SUCCESS;
+    std::vector<std::unique_ptr<Item>> items;
+    uint64_t next = 0;
+};
+
 /**
     To allow Engines to run tasks.
 **/
@@ -78,6 +88,8 @@ public:
 
     WorkLoadPolicy& getWorkLoadPolicy(void);
 
+    size_t getWorkloadShare() const;
+
     void logQTime(TaskId id, const ProcessClock::duration enqTime);
 
     void logRunTime(TaskId id, const ProcessClock::duration runTime);
@@ -134,7 +146,7 @@ public:
                                                      mut_info);
 
         if (ret == ENGINE_KEY_ENOENT || ret == ENGINE_NOT_MY_VBUCKET) {
-            if (isDegradedMode()) {
+            if (isDegradedMode(vbucket)) {
                 return ENGINE_TMPFAIL;
             }
         } else if (ret == ENGINE_SUCCESS) {
@@ -152,6 +164,17 @@ public:
                           get_options_t options)
     {
         BlockTimer timer(&stats.getCmdHisto);
+        std::unique_ptr<Item> parked;
+        if (takeParkedGet(cookie, key, vbucket, parked)) {
+            // The background fetch this get blocked on completed it
+            *itm = parked.release();
+            ++stats.bgFetchedInPlace;
+            if (options & TRACK_STATISTICS) {
+                ++stats.numOpsGet;
+            }
+            return ENGINE_SUCCESS;
+        }
+
         GetValue gv(kvBucket->get(key, vbucket, cookie, options));
         ENGINE_ERROR_CODE ret = gv.getStatus();
 
@@ -161,14 +184,39 @@ public:
                 ++stats.numOpsGet;
             }
         } else if (ret == ENGINE_KEY_ENOENT || ret == ENGINE_NOT_MY_VBUCKET) {
-            if (isDegradedMode()) {
+            if (isDegradedMode(vbucket)) {
                 return ENGINE_TMPFAIL;
             }
+        } else if (ret == ENGINE_EWOULDBLOCK && (options & QUEUE_BG_FETCH)) {
+            parkGet(cookie, key, vbucket);
         }
 
         return ret;
     }
 
+    /**
+     * Complete in place the get the cookie blocked on a background fetch
+     * of the key with (if it did): the next get() of the cookie for the
+     * key returns the item as is, rather than looking the key up again.
+     * Must be called before the cookie is notified.
+     *
+     * @param item the fetched item as the get would have returned it, or
+     *        null if the get has to look the key up again
+     */
+    void completeParkedGet(const void* cookie,
+                           const DocKey& key,
+                           uint16_t vbucket,
+                           std::unique_ptr<Item> item);
+
+    /**
+     * Fetch multiple items (see ENGINE_HANDLE_V1::get_multi). The keys
+     * are grouped by vbucket so that every vbucket is only looked up
+     * once.
+     */
+    void getMulti(const void* cookie,
+                  const std::vector<cb::MultiGetKey>& keys,
+                  std::vector<cb::EngineErrorItemPair>& results);
+
     /**
      * Fetch an item only if the specified filter predicate returns true.
      *
@@ -235,6 +283,52 @@ public:
                                     ENGINE_STORE_OPERATION operation,
                                     cb::StoreIfPredicate predicate);
 
+    /**
+     * Wait for the mutation with the given seqno to be persisted (see
+     * ENGINE_HANDLE_V1::wait_for_persistence)
+     */
+    ENGINE_ERROR_CODE waitForPersistence(const void* cookie,
+                                         uint16_t vbucket,
+                                         uint64_t seqno);
+
+    /**
+     * Increment or decrement a counter within the engine (see
+     * ENGINE_HANDLE_V1::arithmetic)
+     */
+    ENGINE_ERROR_CODE arithmetic(const void* cookie,
+                                 const DocKey& key,
+                                 uint16_t vbucket,
+                                 bool increment,
+                                 uint64_t delta,
+                                 uint64_t cas,
+                                 uint64_t& result,
+                                 uint64_t& newCas,
+                                 mutation_descr_t& mutInfo);
+
+    /**
+     * Append or prepend data to a document within the engine (see
+     * ENGINE_HANDLE_V1::append_prepend)
+     */
+    ENGINE_ERROR_CODE appendPrepend(const void* cookie,
+                                    const DocKey& key,
+                                    uint16_t vbucket,
+                                    bool append,
+                                    cb::const_char_buffer value,
+                                    uint64_t cas,
+                                    uint64_t& newCas,
+                                    mutation_descr_t& mutInfo);
+
+    /**
+     * Read a batch of the documents of a vbucket in seqno order (see
+     * ENGINE_HANDLE_V1::get_seqno_range), on a reader task
+     */
+    ENGINE_ERROR_CODE getSeqnoRange(const void* cookie,
+                                    uint16_t vbucket,
+                                    uint64_t start,
+                                    uint64_t end,
+                                    size_t maxBytes,
+                                    cb::SeqnoRangeBatch& batch);
+
     ENGINE_ERROR_CODE flush(const void *cookie);
 
     ENGINE_ERROR_CODE dcpOpen(const void* cookie,
@@ -253,6 +347,15 @@ public:
                                         const DocKey& key,
                                         uint16_t vbucket);
 
+    /**
+     * Fetch the metadata of multiple items (see
+     * ENGINE_HANDLE_V1::get_meta_multi). As with getMulti the keys are
+     * grouped by vbucket.
+     */
+    void getMetaMulti(const void* cookie,
+                      const std::vector<cb::MultiGetKey>& keys,
+                      std::vector<cb::EngineErrorMetadataPair>& results);
+
     ENGINE_ERROR_CODE setWithMeta(const void* cookie,
                                  protocol_binary_request_set_with_meta *request,
                                  ADD_RESPONSE response,
@@ -273,6 +376,16 @@ public:
                                 ADD_RESPONSE response,
                                 DocNamespace docNamespace);
 
+    ENGINE_ERROR_CODE rangeScan(const void* cookie,
+                                protocol_binary_request_range_scan* request,
+                                ADD_RESPONSE response,
+                                DocNamespace docNamespace);
+
+    ENGINE_ERROR_CODE withMetaBatch(const void* cookie,
+                                    protocol_binary_request_header* request,
+                                    ADD_RESPONSE response,
+                                    DocNamespace docNamespace);
+
     void setDCPPriority(const void* cookie, CONN_PRIORITY priority) {
         EventuallyPersistentEngine *epe = ObjectRegistry::onSwitchThread(NULL, true);
         serverApi->cookie->set_priority(cookie, priority);
@@ -498,6 +611,14 @@ public:
         return configuration;
     }
 
+    /**
+     * @return the allocator arena of the bucket, or 0 (the default arena)
+     *         if it doesn't have one of its own (see bucket_arena_enabled)
+     */
+    unsigned getArena() const {
+        return arena;
+    }
+
     ENGINE_ERROR_CODE deregisterTapClient(const void* cookie,
                                           protocol_binary_request_header *request,
                                           ADD_RESPONSE response);
@@ -538,6 +659,15 @@ public:
         return kvBucket->isWarmingUp() || !trafficEnabled.load();
     }
 
+    /**
+     * @return true if the ops on a vbucket are rejected: unlike
+     *         isDegradedMode(), false before warmup is complete once the
+     *         vbucket is available (see warmup_active_first).
+     */
+    bool isDegradedMode(uint16_t vbucket) const {
+        return kvBucket->isVBucketWarmingUp(vbucket) || !trafficEnabled.load();
+    }
+
     WorkLoadPolicy &getWorkLoadPolicy(void) {
         return *workload;
     }
@@ -552,6 +682,8 @@ public:
 
     void addLookupAllKeys(const void *cookie, ENGINE_ERROR_CODE err);
 
+    void addSeqnoRangeResult(const void* cookie, SeqnoRangeResult result);
+
     /*
      * Explicitly trigger the defragmenter task. Provided to facilitate
      * testing.
@@ -682,6 +814,17 @@ protected:
     ENGINE_ERROR_CODE doTimingStats(const void *cookie, ADD_STAT add_stat);
     ENGINE_ERROR_CODE doSchedulerStats(const void *cookie, ADD_STAT add_stat);
     ENGINE_ERROR_CODE doRunTimeStats(const void *cookie, ADD_STAT add_stat);
+    /**
+     * The wait and run time histograms of the task types as JSON; only
+     * those with samples, or just the "<task name>:<wait|run>" taskStat
+     */
+    ENGINE_ERROR_CODE doTaskTimingsStats(const void* cookie,
+                                         ADD_STAT add_stat,
+                                         const std::string& taskStat);
+    /// The runs of the time budgeted visitors, per task type which had any
+    ENGINE_ERROR_CODE doVisitorStats(const void* cookie, ADD_STAT add_stat);
+    /// The (sampled) contention of the instrumented locks
+    ENGINE_ERROR_CODE doLockStats(const void* cookie, ADD_STAT add_stat);
     ENGINE_ERROR_CODE doDispatcherStats(const void *cookie, ADD_STAT add_stat);
     ENGINE_ERROR_CODE doTasksStats(const void* cookie, ADD_STAT add_stat);
     ENGINE_ERROR_CODE doKeyStats(const void *cookie, ADD_STAT add_stat,
@@ -700,11 +843,28 @@ protected:
                                    const char* stat_key, int nkey);
     void addSeqnoVbStats(const void *cookie, ADD_STAT add_stat,
                                   const VBucketPtr &vb);
+    ENGINE_ERROR_CODE doVBucketLatencyStats(const void* cookie,
+                                            ADD_STAT add_stat,
+                                            const char* stat_key,
+                                            int nkey);
 
     void addLookupResult(const void* cookie, std::unique_ptr<Item> result);
 
     bool fetchLookupResult(const void* cookie, std::unique_ptr<Item>& itm);
 
+    /// Record that the get of the cookie for the key waits for a bgfetch
+    void parkGet(const void* cookie, const DocKey& key, uint16_t vbucket);
+
+    /**
+     * Take (and forget) the get of the cookie parked for the key.
+     *
+     * @return true if the get was completed in place, with the item in itm
+     */
+    bool takeParkedGet(const void* cookie,
+                       const DocKey& key,
+                       uint16_t vbucket,
+                       std::unique_ptr<Item>& itm);
+
     // Initialize all required callbacks of this engine with the underlying
     // server.
     void initializeEngineCallbacks();
@@ -729,6 +889,16 @@ protected:
             PermittedVBStates& permittedVBStates,
             int& keyOffset);
 
+    /**
+     * Decode and validate the options (the host byte order options field
+     * of a with_meta request, 0 if it has none)
+     */
+    protocol_binary_response_status decodeWithMetaOptions(
+            uint32_t options,
+            GenerateCas& generateCas,
+            CheckConflicts& checkConflicts,
+            PermittedVBStates& permittedVBStates);
+
     /**
      * Sends NOT_SUPPORTED response, using the specified response callback
      * to the specified connection via it's cookie.
@@ -870,7 +1040,20 @@ protected:
 
     std::map<const void*, std::unique_ptr<Item>> lookups;
     std::unordered_map<const void*, ENGINE_ERROR_CODE> allKeysLookups;
+    std::unordered_map<const void*, SeqnoRangeResult> seqnoRangeLookups;
     std::mutex lookupMutex;
+
+    // The gets which blocked on a background fetch (by cookie), and the
+    // item the fetch completed them with once it has. numParkedGets lets
+    // the common case of none skip the mutex.
+    struct ParkedGet {
+        StoredDocKey key;
+        uint16_t vbucket;
+        std::unique_ptr<Item> item;
+    };
+    std::unordered_map<const void*, ParkedGet> parkedGets;
+    std::mutex parkedGetsMutex;
+    std::atomic<size_t> numParkedGets{0};
     GET_SERVER_API getServerApiFunc;
     union {
         engine_info info;
@@ -886,6 +1069,8 @@ protected:
     size_t getlDefaultTimeout;
     size_t getlMaxTimeout;
     size_t maxFailoverEntries;
+    //! The allocator arena of the bucket (0 if none)
+    unsigned arena = 0;
     EPStats stats;
     Configuration configuration;
     std::atomic<bool> trafficEnabled;
@@ -19,6 +19,7 @@
 
 #include "bgfetcher.h"
 #include "checkpoint.h"
+#include "checksum.h"
 #include "ep_engine.h"
 #include "executorpool.h"
 #include "failover-table.h"
@@ -28,6 +29,17 @@
 #include "vbucket_bgfetch_item.h"
 #include "vbucketdeletiontask.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
 EPVBucket::EPVBucket(id_type i,
                      vbucket_state_t newState,
                      EPStats& st,
@@ -56,7 +68,8 @@ EPVBucket::EPVBucket(id_type i,
               lastSnapEnd,
               std::move(table),
               flusherCb,
-              std::make_unique<StoredValueFactory>(st),
+              std::make_unique<StoredValueFactory>(
+                      st, config.getHtInlineValueMaxSize()),
               std::move(newSeqnoCb),
               config,
               evictionPolicy,
@@ -85,7 +98,8 @@ EPVBucket::~EPVBucket() {
 ENGINE_ERROR_CODE EPVBucket::completeBGFetchForSingleItem(
         const DocKey& key,
         const VBucketBGFetchItem& fetched_item,
-        const ProcessClock::time_point startTime) {
+        const ProcessClock::time_point startTime,
+        std::unique_ptr<Item>& completedItem) {
     ENGINE_ERROR_CODE status = fetched_item.value->getStatus();
     Item* fetchedValue = fetched_item.value->item.get();
     { // locking scope
@@ -174,6 +188,12 @@ ENGINE_ERROR_CODE EPVBucket::completeBGFetchForSingleItem(
                     status = ENGINE_TMPFAIL;
                 }
             }
+
+            if (status == ENGINE_SUCCESS && v && v->isResident() &&
+                !v->isDeleted() && !v->isTempItem() &&
+                !v->isLocked(ep_current_time())) {
+                completedItem = v->toItem(false, getId());
+            }
         }
     } // locked scope ends
 
@@ -586,8 +606,9 @@ void EPVBucket::scheduleDeferredDeletion(EventuallyPersistentEngine& engine) {
 }
 
 MutationStatus EPVBucket::insertFromWarmup(Item& itm,
-                                         bool eject,
-                                         bool keyMetaDataOnly) {
+                                           bool eject,
+                                           bool keyMetaDataOnly,
+                                           bool addNew) {
     if (!hasMemoryForStoredValue(stats, itm, false)) {
         return MutationStatus::NoMem;
     }
@@ -599,6 +620,10 @@ MutationStatus EPVBucket::insertFromWarmup(Item& itm,
                                       TrackReference::No);
 
     if (v == NULL) {
+        if (!addNew) {
+            // Same as a value changed in memory
+            return MutationStatus::InvalidCas;
+        }
         v = ht.unlocked_addNewStoredValue(hbl, itm);
         if (keyMetaDataOnly) {
             v->markNotResident();
@@ -617,10 +642,12 @@ MutationStatus EPVBucket::insertFromWarmup(Item& itm,
         // Verify that the CAS isn't changed
         if (v->getCas() != itm.getCas()) {
             if (v->getCas() == 0) {
+                const time_t oldExptime = v->getExptime();
                 v->setCas(itm.getCas());
                 v->setFlags(itm.getFlags());
                 v->setExptime(itm.getExptime());
                 v->setRevSeqno(itm.getRevSeqno());
+                ht.noteExpiryChange(*v, oldExptime);
             } else {
                 return MutationStatus::InvalidCas;
             }
@@ -636,3 +663,355 @@ MutationStatus EPVBucket::insertFromWarmup(Item& itm,
 
     return MutationStatus::NotFound;
 }
+
+namespace {
+/// The header of a hash table snapshot file (followed by the records)
+struct HashTableSnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t uuid;
+    uint64_t seqno;
+    uint64_t numItems;
+    /// The size of all of the records
+    uint64_t length;
+    /// computeChecksum() of the records
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+const uint32_t htSnapshotMagic = 0x48545348; // "HTSH"
+const uint32_t htSnapshotVersion = 1;
+
+/**
+ * An item of a hash table snapshot; followed by its key and, if resident,
+ * its value, padded to a multiple of 8 bytes.
+ */
+struct HashTableSnapshotRecord {
+    uint64_t cas;
+    int64_t bySeqno;
+    uint64_t revSeqno;
+    uint32_t exptime;
+    uint32_t flags;
+    uint32_t valueLen;
+    uint16_t keyLen;
+    uint8_t docNamespace;
+    uint8_t datatype;
+    uint8_t resident;
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(HashTableSnapshotHeader) % 8 == 0 &&
+                      sizeof(HashTableSnapshotRecord) % 8 == 0,
+              "The records of a hash table snapshot must stay aligned");
+
+size_t getSnapshotPadding(size_t len) {
+    return (8 - len % 8) % 8;
+}
+
+std::string getHashTableSnapshotFileName(const std::string& dbname,
+                                         uint16_t vbid) {
+    return dbname + "/" + std::to_string(vbid) + ".htsnapshot";
+}
+
+/// Writes the alive items of a hash table as snapshot records
+class SnapshotWriter : public HashTableVisitor {
+public:
+    SnapshotWriter(FILE* fp) : fp(fp) {
+    }
+
+    bool visit(const HashTable::HashBucketLock& lh, StoredValue& v) override {
+        if (failed || v.isDeleted() || v.isTempItem()) {
+            return !failed;
+        }
+        if (v.isDirty()) {
+            // The snapshot must match the disk
+            dirty = true;
+            failed = true;
+            return false;
+        }
+
+        HashTableSnapshotRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.cas = v.getCas();
+        record.bySeqno = v.getBySeqno();
+        record.revSeqno = v.getRevSeqno();
+        record.exptime = static_cast<uint32_t>(v.getExptime());
+        record.flags = v.getFlags();
+        record.keyLen = static_cast<uint16_t>(v.getKey().size());
+        record.docNamespace =
+                static_cast<uint8_t>(v.getKey().getDocNamespace());
+        record.datatype = v.getDatatype();
+        const char* value = nullptr;
+        if (v.isResident()) {
+            record.resident = 1;
+            if (v.getValue()) {
+                value = v.getValue()->getData();
+                record.valueLen =
+                        static_cast<uint32_t>(v.getValue()->valueSize());
+            }
+        }
+
+        static const uint8_t padding[8] = {};
+        const size_t len = record.keyLen + record.valueLen;
+        failed = !(write(&record, sizeof(record)) &&
+                   write(v.getKey().data(), record.keyLen) &&
+                   write(value, record.valueLen) &&
+                   write(padding, getSnapshotPadding(len)));
+        ++numItems;
+        return !failed;
+    }
+
+    bool failed = false;
+    /// True if an item wasn't persisted
+    bool dirty = false;
+    uint64_t numItems = 0;
+    uint64_t length = 0;
+    uint32_t checksum = 0;
+
+private:
+    bool write(const void* buf, size_t len) {
+        if (len == 0) {
+            return true;
+        }
+        if (fwrite(buf, len, 1, fp) != 1) {
+            return false;
+        }
+        checksum = computeChecksum(
+                static_cast<const uint8_t*>(buf), len, checksum);
+        length += len;
+        return true;
+    }
+
+    FILE* fp;
+};
+
+/// A file mapped read-only (or, on Windows, read) into memory
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& fname) {
+#ifdef WIN32
+        FILE* fp = fopen(fname.c_str(), "rb");
+        if (fp == nullptr) {
+            return;
+        }
+        char buffer[8192];
+        size_t nr;
+        while ((nr = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+            contents.append(buffer, nr);
+        }
+        if (!ferror(fp)) {
+            addr = contents.data();
+            len = contents.size();
+        }
+        fclose(fp);
+#else
+        const int fd = open(fname.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* ptr = mmap(
+                    nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                addr = ptr;
+                len = size_t(st.st_size);
+#ifdef MADV_SEQUENTIAL
+                (void)madvise(ptr, len, MADV_SEQUENTIAL);
+#endif
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef WIN32
+        if (addr != nullptr) {
+            munmap(addr, len);
+        }
+#endif
+    }
+
+    const uint8_t* data() const {
+        return static_cast<const uint8_t*>(addr);
+    }
+
+    size_t size() const {
+        return len;
+    }
+
+private:
+#ifdef WIN32
+    std::string contents;
+    const void* addr = nullptr;
+#else
+    void* addr = nullptr;
+#endif
+    size_t len = 0;
+};
+} // anonymous namespace
+
+bool EPVBucket::saveHashTable(const std::string& dbname) {
+    // The flusher is stopped; the persisted seqno can't move under us
+    HashTableSnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = htSnapshotMagic;
+    header.version = htSnapshotVersion;
+    header.uuid = failovers ? failovers->getLatestUUID() : 0;
+    header.seqno = getPersistenceSeqno();
+
+    const std::string fname = getHashTableSnapshotFileName(dbname, getId());
+    const std::string next_fname = fname + ".new";
+    FILE* fp = fopen(next_fname.c_str(), "wb");
+    if (fp == nullptr) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Failed to create \"%s\": %s",
+            getId(),
+            next_fname.c_str(),
+            strerror(errno));
+        return false;
+    }
+
+    SnapshotWriter writer(fp);
+    bool rv = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (rv) {
+        ht.visit(writer);
+        rv = !writer.failed;
+    }
+    if (rv) {
+        header.numItems = writer.numItems;
+        header.length = writer.length;
+        header.checksum = writer.checksum;
+        rv = fseek(fp, 0, SEEK_SET) == 0 &&
+             fwrite(&header, sizeof(header), 1, fp) == 1;
+    }
+    if (fclose(fp) != 0) {
+        rv = false;
+    }
+    if (!rv || rename(next_fname.c_str(), fname.c_str()) != 0) {
+        if (writer.dirty) {
+            LOG(EXTENSION_LOG_NOTICE,
+                "(vb %" PRIu16 ") Not saving the hash table as not all of "
+                "its items are persisted",
+                getId());
+        } else {
+            LOG(EXTENSION_LOG_WARNING,
+                "(vb %" PRIu16 ") Failed to write the hash table to \"%s\": "
+                "%s",
+                getId(),
+                fname.c_str(),
+                strerror(errno));
+        }
+        remove(next_fname.c_str());
+        return false;
+    }
+    LOG(EXTENSION_LOG_NOTICE,
+        "(vb %" PRIu16 ") Saved the hash table (%" PRIu64 " items) to \"%s\"",
+        getId(),
+        writer.numItems,
+        fname.c_str());
+    return true;
+}
+
+bool EPVBucket::loadHashTable(const std::string& dbname, uint64_t highSeqno) {
+    const std::string fname = getHashTableSnapshotFileName(dbname, getId());
+    MappedFile file(fname);
+    if (file.data() == nullptr) {
+        return false;
+    }
+    // Once warmed up, the vbucket moves on from the disk state the snapshot
+    // is of; never look at it again
+    remove(fname.c_str());
+
+    const auto* header =
+            reinterpret_cast<const HashTableSnapshotHeader*>(file.data());
+    if (file.size() < sizeof(*header) || header->magic != htSnapshotMagic ||
+        header->version != htSnapshotVersion ||
+        header->length != file.size() - sizeof(*header)) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Ignoring invalid hash table snapshot \"%s\"",
+            getId(),
+            fname.c_str());
+        return false;
+    }
+
+    const uint64_t uuid = failovers ? failovers->getLatestUUID() : 0;
+    if (header->uuid != uuid || header->seqno != highSeqno) {
+        LOG(EXTENSION_LOG_NOTICE,
+            "(vb %" PRIu16 ") Ignoring stale hash table snapshot \"%s\"",
+            getId(),
+            fname.c_str());
+        return false;
+    }
+
+    const uint8_t* records = file.data() + sizeof(*header);
+    const size_t length = size_t(header->length);
+    if (computeChecksum(records, length) != header->checksum) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Ignoring corrupt hash table snapshot \"%s\"",
+            getId(),
+            fname.c_str());
+        return false;
+    }
+
+    // Check the framing of all of the records before inserting any
+    uint64_t numItems = 0;
+    for (size_t pos = 0; pos < length; ++numItems) {
+        if (length - pos < sizeof(HashTableSnapshotRecord)) {
+            break;
+        }
+        const auto* record =
+                reinterpret_cast<const HashTableSnapshotRecord*>(records + pos);
+        const size_t len = size_t(record->keyLen) + record->valueLen;
+        pos += sizeof(*record) + len + getSnapshotPadding(len);
+        if (pos > length) {
+            break;
+        }
+    }
+    if (numItems != header->numItems) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Ignoring invalid hash table snapshot \"%s\"",
+            getId(),
+            fname.c_str());
+        return false;
+    }
+
+    for (size_t pos = 0; pos < length;) {
+        const auto* record =
+                reinterpret_cast<const HashTableSnapshotRecord*>(records + pos);
+        const uint8_t* key = records + pos + sizeof(*record);
+        const size_t len = size_t(record->keyLen) + record->valueLen;
+        pos += sizeof(*record) + len + getSnapshotPadding(len);
+
+        Item itm(DocKey(key,
+                        record->keyLen,
+                        static_cast<DocNamespace>(record->docNamespace)),
+                 record->flags,
+                 record->exptime,
+                 record->resident ? key + record->keyLen : nullptr,
+                 record->valueLen,
+                 record->datatype,
+                 record->cas,
+                 record->bySeqno,
+                 getId(),
+                 record->revSeqno);
+        if (insertFromWarmup(itm, false, !record->resident, true) ==
+            MutationStatus::NoMem) {
+            LOG(EXTENSION_LOG_WARNING,
+                "(vb %" PRIu16 ") Out of memory loading the hash table "
+                "snapshot \"%s\"",
+                getId(),
+                fname.c_str());
+            return false;
+        }
+    }
+
+    LOG(EXTENSION_LOG_NOTICE,
+        "(vb %" PRIu16 ") Loaded the hash table (%" PRIu64
+        " items) from \"%s\"",
+        getId(),
+        numItems,
+        fname.c_str());
+    return true;
+}
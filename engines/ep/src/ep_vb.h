@@ -52,7 +52,8 @@ public:
     ENGINE_ERROR_CODE completeBGFetchForSingleItem(
             const DocKey& key,
             const VBucketBGFetchItem& fetched_item,
-            const ProcessClock::time_point startTime) override;
+            const ProcessClock::time_point startTime,
+            std::unique_ptr<Item>& completedItem) override;
 
     vb_bgfetch_queue_t getBGFetchItems() override;
 
@@ -144,12 +145,42 @@ public:
      * @param eject true if we should eject the value immediately
      * @param keyMetaDataOnly is this just the key and meta-data or a complete
      *                        item
+     * @param addNew false to only restore the value of a key already in the
+     *               hash table
      *
      * @return the result of the operation
      */
     MutationStatus insertFromWarmup(Item& itm,
                                     bool eject,
-                                    bool keyMetaDataOnly);
+                                    bool keyMetaDataOnly,
+                                    bool addNew);
+
+    /**
+     * Write the hash table (the keys, metadata and resident values of the
+     * alive items) to <dbname>/<vbid>.htsnapshot, for warmup to load
+     * rather than reading the documents from disk. It is only written if
+     * all of the items are persisted. As for saveFilter(), the file records
+     * the failover UUID and persisted seqno of the vbucket; it is only valid
+     * for the disk state with the same ones.
+     *
+     * The file is a header followed by a record per item, each aligned on 8
+     * bytes, so that it can be used in place once mapped.
+     *
+     * @return true if the snapshot was written
+     */
+    bool saveHashTable(const std::string& dbname);
+
+    /**
+     * Load the hash table written by saveHashTable() if it was written for
+     * the current failover UUID and the given (persisted) high seqno, and
+     * remove the file. The items are only inserted once the whole file was
+     * checked.
+     *
+     * @return true if all of the items of the snapshot were loaded. If only
+     *         some of them were (out of memory), loading the vbucket from
+     *         disk brings in the rest.
+     */
+    bool loadHashTable(const std::string& dbname, uint64_t highSeqno);
 
 protected:
     /**
@@ -30,11 +30,6 @@ EphemeralVBucket::HTTombstonePurger::HTTombstonePurger(rel_time_t purgeAge)
     : now(ep_current_time()), purgeAge(purgeAge), numPurgedItems(0) {
 }
 
-void EphemeralVBucket::HTTombstonePurger::setDeadline(
-        ProcessClock::time_point deadline) {
-    progressTracker.setDeadline(deadline);
-}
-
 void EphemeralVBucket::HTTombstonePurger::setCurrentVBucket(VBucket& vb) {
     vbucket = &dynamic_cast<EphemeralVBucket&>(vb);
 }
@@ -59,9 +54,9 @@ bool EphemeralVBucket::HTTombstonePurger::visit(
     }
     ++numVisitedItems;
 
-    // See if we have done enough work for this chunk. If so
-    // stop visiting (for now).
-    return progressTracker.shouldContinueVisiting(numVisitedItems);
+    // Whoever drives the visit pauses it once the chunk is done (see
+    // VisitorBudget).
+    return true;
 }
 
 void EphemeralVBucket::HTTombstonePurger::clearStats() {
@@ -77,7 +72,8 @@ EphTombstoneHTCleaner::EphTombstoneHTCleaner(EventuallyPersistentEngine* e,
                  false),
       bucket(bucket),
       bucketPosition(bucket.endPosition()),
-      staleItemDeleterTask(std::make_shared<EphTombstoneStaleItemDeleter>(e)) {
+      staleItemDeleterTask(
+              std::make_shared<EphTombstoneStaleItemDeleter>(e, bucket)) {
     ExecutorPool::get()->schedule(staleItemDeleterTask);
 }
 
@@ -99,13 +95,16 @@ bool EphTombstoneHTCleaner::run() {
 
     // Prepare the underlying visitor.
     auto& visitor = getPurgerVisitor();
-    visitor.setDeadline(ProcessClock::now() + getChunkDuration());
+    prAdapter->getBudget().startRun(getChunkDuration());
     visitor.clearStats();
 
     // (re)start visiting.
     auto start = ProcessClock::now();
     bucketPosition = bucket.pauseResumeVisit(*prAdapter, bucketPosition);
     auto end = ProcessClock::now();
+    engine->getEpStats()
+            .visitorRuns[static_cast<size_t>(getTypeId())]
+            .record(prAdapter->getBudget().endRun());
 
     // Check if the visitor completed a full pass.
     bool completed = (bucketPosition == bucket.endPosition());
@@ -114,6 +113,10 @@ bool EphTombstoneHTCleaner::run() {
             std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 
     if (!completed) {
+        // Get the stale items deleted as we go if they build up.
+        if (staleItemDeleterTask->isOverTarget()) {
+            staleItemDeleterTask->wakeUp();
+        }
         // Schedule to run again asap - note this still yields to the scheduler
         // if there are any higher priority tasks which want to run.
         return true;
@@ -143,7 +146,7 @@ cb::const_char_buffer EphTombstoneHTCleaner::getDescription() {
 std::chrono::microseconds EphTombstoneHTCleaner::maxExpectedDuration() {
     // Tombstone HT cleaner processes items in chunks, with each chunk
     // constrained by a ChunkDuration runtime, so we expect to only take that
-    // long. However, the ProgressTracker used estimates the time remaining, so
+    // long. However, the VisitorBudget used estimates the time remaining, so
     // apply some headroom to that figure so we don't get inundated with
     // spurious "slow tasks" which only just exceed the limit.
     return getChunkDuration() * 10;
@@ -168,57 +171,74 @@ EphTombstoneHTCleaner::getPurgerVisitor() {
             prAdapter->getHTVisitor());
 }
 
-/**
- * Ephemeral VBucket Sequence stale item deleter
- *
- * Visitor which is responsible for scanning sequence list for stale items
- * and deleting them.
- */
-class EphemeralVBucket::StaleItemDeleter : public VBucketVisitor {
-public:
-    StaleItemDeleter() {
-    }
-
-    void visitBucket(VBucketPtr& vb) override {
-        auto* vbucket = dynamic_cast<EphemeralVBucket*>(vb.get());
-        if (!vbucket) {
-            throw std::invalid_argument(
-                    "StaleItemDeleter::visitBucket: Called with a "
-                    "non-Ephemeral bucket");
-        }
-        numItemsDeleted += vbucket->purgeStaleItems();
-    }
-
-    size_t getNumItemsDeleted() const {
-        return numItemsDeleted;
-    }
-
-protected:
-    /// Count of how many items have been deleted for all visited vBuckets.
-    size_t numItemsDeleted = 0;
-};
+namespace {
+/// Below the target, the stale item deleter sleeps for this many chunk
+/// durations between its chunks.
+const int chunkSpacing = 4;
+} // anonymous namespace
 
 EphTombstoneStaleItemDeleter::EphTombstoneStaleItemDeleter(
-        EventuallyPersistentEngine* e)
-    : GlobalTask(e, TaskId::EphTombstoneStaleItemDeleter, INT_MAX, false) {
+        EventuallyPersistentEngine* e, EphemeralBucket& bucket)
+    : GlobalTask(e, TaskId::EphTombstoneStaleItemDeleter, INT_MAX, false),
+      bucket(bucket) {
 }
 
 bool EphTombstoneStaleItemDeleter::run() {
-    LOG(EXTENSION_LOG_INFO, "%s starting", getDescription().data());
+    if (!inPass) {
+        LOG(EXTENSION_LOG_INFO, "%s starting", getDescription().data());
+        inPass = true;
+        vbid = 0;
+        purgeRun.resumeSeqno = 0;
+        passStart = ProcessClock::now();
+        numItemsDeleted = 0;
+    }
 
-    // Create a StaleItemDeleter, and run across all VBuckets.
-    auto start = ProcessClock::now();
-    EphemeralVBucket::StaleItemDeleter deleter;
-    engine->getKVBucket()->visit(deleter);
-    auto end = ProcessClock::now();
+    // Delete from the vBuckets in turn, resuming where the previous chunk
+    // paused, until the chunk's budget is spent.
+    VisitorBudget budget;
+    budget.startRun(getChunkDuration());
+    purgeRun.shouldPause = [&budget]() { return !budget.visitItem(); };
+    const auto numVBuckets = bucket.getVBuckets().getSize();
+    while (vbid < numVBuckets) {
+        auto vb = bucket.getVBucket(vbid);
+        if (vb) {
+            numItemsDeleted += dynamic_cast<EphemeralVBucket&>(*vb)
+                                       .purgeStaleItems(&purgeRun);
+        } else {
+            purgeRun.resumeSeqno = 0;
+        }
+        if (purgeRun.resumeSeqno == 0) {
+            // Done with this vBucket
+            ++vbid;
+        }
+        if (budget.isSpent()) {
+            break;
+        }
+    }
+    purgeRun.shouldPause = nullptr;
+    engine->getEpStats()
+            .visitorRuns[static_cast<size_t>(getTypeId())]
+            .record(budget.endRun());
+
+    if (vbid < numVBuckets) {
+        // Paused. Keep going straight away if the stale items use too much
+        // memory, otherwise leave the thread to the other tasks for a while.
+        if (!isOverTarget()) {
+            snooze(std::chrono::duration<double>(getChunkDuration() *
+                                                 chunkSpacing)
+                           .count());
+        }
+        return true;
+    }
 
-    auto duration_ms =
-            std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    inPass = false;
+    auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            ProcessClock::now() - passStart);
 
     LOG(EXTENSION_LOG_INFO,
         "%s completed. Deleted %" PRIu64 " items. Took %" PRIu64 "ms.",
         getDescription().data(),
-        uint64_t(deleter.getNumItemsDeleted()),
+        uint64_t(numItemsDeleted),
         uint64_t(duration_ms.count()));
 
     // Sleep forever - rely on the HTCleaner task to wake us.
@@ -231,10 +251,29 @@ cb::const_char_buffer EphTombstoneStaleItemDeleter::getDescription() {
 }
 
 std::chrono::microseconds EphTombstoneStaleItemDeleter::maxExpectedDuration() {
-    // This currently needs to iterate the entire sequenceList for a VBucket;
-    // which can take multiple seconds - see MB-25920.
-    // Ideally this should be reduced, but in the interim set the maximum
-    // duration to a relatively generous limit of 10s (so as not to fill the
-    // logs with warnings).
-    return std::chrono::seconds(10);
+    // Like the HT cleaner, each run is a chunk bounded by ChunkDuration
+    // (give or take the VisitorBudget's estimate of the time left).
+    return getChunkDuration() * 10;
+}
+
+bool EphTombstoneStaleItemDeleter::isOverTarget() const {
+    size_t staleBytes = 0;
+    const auto numVBuckets = bucket.getVBuckets().getSize();
+    for (uint16_t id = 0; id < numVBuckets; ++id) {
+        auto vb = bucket.getVBucket(id);
+        if (vb) {
+            staleBytes +=
+                    dynamic_cast<EphemeralVBucket&>(*vb).getStaleItemBytes();
+        }
+    }
+    const auto target =
+            engine->getEpStats().getMaxDataSize() / 100 *
+            engine->getConfiguration().getEphemeralMetadataPurgeStaleTarget();
+    return staleBytes > target;
+}
+
+std::chrono::milliseconds EphTombstoneStaleItemDeleter::getChunkDuration()
+        const {
+    return std::chrono::milliseconds(
+            engine->getConfiguration().getEphemeralMetadataPurgeChunkDuration());
 }
@@ -54,6 +54,14 @@
  *    looking for stale OSVs. For such items unlink from the SequenceList and
  *    delete the OSV.
  *
+ * Both tasks work in chunks of ephemeral_metadata_purge_chunk_duration, each
+ * resuming where the previous one paused (a HashTable position, or a
+ * vBucket and seqno), so that neither holds a NonIO thread for long. The
+ * stale item deleter paces itself against the memory the stale items use:
+ * above ephemeral_metadata_purge_stale_target percent of the quota it runs
+ * its chunks back to back (and the HT cleaner wakes it to keep up with the
+ * items it marks stale); below it the chunks are spaced out.
+ *
  * Note that items can also become stale if they have been replaced with a newer
  * revision - this occurs when an item needs to be modified but the existing
  * revision is being read by a rangeRead and hence we cannot simply update the
@@ -67,7 +75,7 @@
 
 #include "ephemeral_vb.h"
 #include "kv_bucket_iface.h"
-#include "progress_tracker.h"
+#include "seqlist.h"
 #include "vb_visitors.h"
 
 class EphemeralBucket;
@@ -87,9 +95,6 @@ class EphemeralVBucket::HTTombstonePurger : public VBucketAwareHTVisitor {
 public:
     HTTombstonePurger(rel_time_t purgeAge);
 
-    // Set the deadline at which point the visitor will pause visiting.
-    void setDeadline(ProcessClock::time_point deadline);
-
     void setCurrentVBucket(VBucket& vb) override;
 
     bool visit(const HashTable::HashBucketLock& lh, StoredValue& v) override;
@@ -118,9 +123,6 @@ protected:
     ///    now - delete_time.
     const rel_time_t purgeAge;
 
-    /// Estimates how far we have got, and when we should pause.
-    ProgressTracker progressTracker;
-
     /// Count of how many items have been visited.
     size_t numVisitedItems;
 
@@ -181,11 +183,35 @@ private:
  */
 class EphTombstoneStaleItemDeleter : public GlobalTask {
 public:
-    EphTombstoneStaleItemDeleter(EventuallyPersistentEngine* e);
+    EphTombstoneStaleItemDeleter(EventuallyPersistentEngine* e,
+                                 EphemeralBucket& bucket);
 
     bool run() override;
 
     cb::const_char_buffer getDescription() override;
 
     std::chrono::microseconds maxExpectedDuration() override;
+
+    /// Do the stale items use more memory than the target?
+    bool isOverTarget() const;
+
+private:
+    /// How long should each chunk of deleting run for?
+    std::chrono::milliseconds getChunkDuration() const;
+
+    /// The bucket we are associated with.
+    EphemeralBucket& bucket;
+
+    /// Is a pass across the vBuckets in progress?
+    bool inPass = false;
+
+    /// The vBucket the pass has got to.
+    uint16_t vbid = 0;
+
+    /// Where in the SequenceList of vbid the pass has got to.
+    SequenceList::PurgeRun purgeRun;
+
+    /// When the pass started, and the items it deleted so far.
+    ProcessClock::time_point passStart;
+    size_t numItemsDeleted = 0;
 };
@@ -99,6 +99,17 @@ bool EphemeralVBucket::pageOut(const HashTable::HashBucketLock& lh,
         // metadata purge internal.
         return false;
     }
+    {
+        // Deleting an item a range read (backfill) is on leaves its old
+        // revision in the seqList as a stale item until the read is done;
+        // that uses more memory for now, not less. Leave it to a later pass
+        // (a mass delete would otherwise create a stale item for each item
+        // of the backfills in progress).
+        std::lock_guard<std::mutex> listWriteLg(seqList->getListWriteLock());
+        if (seqList->isInReadRange(listWriteLg, *v->toOrderedStoredValue())) {
+            return false;
+        }
+    }
     VBQueueItemCtx queueCtx(GenerateBySeqno::Yes,
                             GenerateCas::Yes,
                             TrackCasDrift::No,
@@ -117,6 +128,27 @@ bool EphemeralVBucket::pageOut(const HashTable::HashBucketLock& lh,
     return true;
 }
 
+StoredValue* EphemeralVBucket::relocateStoredValue(
+        const HashTable::HashBucketLock& lh, StoredValue& v) {
+    if (v.isTempItem()) {
+        // Temp items aren't in the sequence list
+        return VBucket::relocateStoredValue(lh, v);
+    }
+
+    std::lock_guard<std::mutex> listWriteLg(seqList->getListWriteLock());
+    if (!seqList->isRelinkable(listWriteLg, *v.toOrderedStoredValue())) {
+        return nullptr;
+    }
+
+    StoredValue* newSv;
+    StoredValue::UniquePtr oldSv;
+    std::tie(newSv, oldSv) = ht.unlocked_relocate(lh, v);
+    seqList->relinkListElem(listWriteLg,
+                            *oldSv->toOrderedStoredValue(),
+                            *newSv->toOrderedStoredValue());
+    return newSv;
+}
+
 bool EphemeralVBucket::areDeletedItemsAlwaysResident() const {
     // Ephemeral buckets do keep all deleted items resident in memory.
     // (We have nowhere else to store them, given there is no disk).
@@ -180,7 +212,8 @@ void EphemeralVBucket::dump() const {
 ENGINE_ERROR_CODE EphemeralVBucket::completeBGFetchForSingleItem(
         const DocKey& key,
         const VBucketBGFetchItem& fetched_item,
-        const ProcessClock::time_point startTime) {
+        const ProcessClock::time_point startTime,
+        std::unique_ptr<Item>& completedItem) {
     /* [EPHE TODO]: Just return error code and make all the callers handle it */
     throw std::logic_error(
             "EphemeralVBucket::completeBGFetchForSingleItem() "
@@ -275,8 +308,8 @@ EphemeralVBucket::inMemoryBackfill(uint64_t start, uint64_t end) {
 }
 
 boost::optional<SequenceList::RangeIterator>
-EphemeralVBucket::makeRangeIterator(bool isBackfill) {
-    return seqList->makeRangeIterator(isBackfill);
+EphemeralVBucket::makeRangeIterator(bool isBackfill, seqno_t startSeqno) {
+    return seqList->makeRangeIterator(isBackfill, startSeqno);
 }
 
 /* Vb level backfill queue is for items in a huge snapshot (disk backfill
@@ -304,7 +337,7 @@ void EphemeralVBucket::queueBackfillItem(
     stats.memOverhead->fetch_add(sizeof(queued_item));
 }
 
-size_t EphemeralVBucket::purgeStaleItems() {
+size_t EphemeralVBucket::purgeStaleItems(SequenceList::PurgeRun* run) {
     // Iterate over the sequence list and delete any stale items. But we do
     // not want to delete the last element in the vbucket, hence we pass
     // 'seqList->getHighSeqno() - 1'.
@@ -314,10 +347,13 @@ size_t EphemeralVBucket::purgeStaleItems() {
     //       deleted
     if (seqList->getHighSeqno() < 2) {
         /* not enough items to purge */
+        if (run) {
+            run->resumeSeqno = 0;
+        }
         return 0;
     }
     auto seqListPurged = seqList->purgeTombstones(
-            static_cast<seqno_t>(seqList->getHighSeqno()) - 1);
+            static_cast<seqno_t>(seqList->getHighSeqno()) - 1, run);
 
     // Update stats and return.
     seqListPurgeCount += seqListPurged;
@@ -29,7 +29,6 @@ public:
     class CountVisitor;
     class HTTombstonePurger;
     class HTCleaner;
-    class StaleItemDeleter;
 
     EphemeralVBucket(id_type i,
                      vbucket_state_t newState,
@@ -52,7 +51,8 @@ public:
     ENGINE_ERROR_CODE completeBGFetchForSingleItem(
             const DocKey& key,
             const VBucketBGFetchItem& fetched_item,
-            const ProcessClock::time_point startTime) override;
+            const ProcessClock::time_point startTime,
+            std::unique_ptr<Item>& completedItem) override;
 
     void resetStats() override;
 
@@ -96,6 +96,9 @@ public:
 
     bool pageOut(const HashTable::HashBucketLock& lh, StoredValue*& v) override;
 
+    StoredValue* relocateStoredValue(const HashTable::HashBucketLock& lh,
+                                     StoredValue& v) override;
+
     bool areDeletedItemsAlwaysResident() const override;
 
     void addStats(bool details, ADD_STAT add_stat, const void* c) override;
@@ -135,12 +138,14 @@ public:
      * the SequenceList, new range iterator will not be allowed
      *
      * @param isBackfill indicates if the iterator is for backfill (for debug)
+     * @param startSeqno the iterator may skip the items below it (it starts
+     *                   at or before it)
      *
      * @return range iterator object when possible
      *         null when not possible
      */
     boost::optional<SequenceList::RangeIterator> makeRangeIterator(
-            bool isBackfill);
+            bool isBackfill, seqno_t startSeqno = 0);
 
     void dump() const override;
 
@@ -160,9 +165,17 @@ public:
                            const GenerateBySeqno generateBySeqno) override;
 
     /** Purge any stale items in this VBucket's sequenceList.
+     * @param run If given, bounds the purge to a part of the list (see
+     *            SequenceList::PurgeRun)
      * @return Number of items purged.
      */
-    size_t purgeStaleItems();
+    size_t purgeStaleItems(SequenceList::PurgeRun* run = nullptr);
+
+    /// @return the memory used by the stale items of the sequenceList
+    size_t getStaleItemBytes() const {
+        return seqList->getStaleValueBytes() +
+               seqList->getStaleMetadataBytes();
+    }
 
     void setupDeferredDeletion(const void* cookie) override;
 
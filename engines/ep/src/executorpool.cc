@@ -47,6 +47,9 @@ static const size_t EP_MAX_WRITER_THREADS = 8;
 static const size_t EP_MAX_AUXIO_THREADS  = 8;
 static const size_t EP_MAX_NONIO_THREADS  = 8;
 
+// Several buckets drive the auto tuning, each every second
+static const auto AUTO_TUNE_MIN_INTERVAL = std::chrono::milliseconds(500);
+
 size_t ExecutorPool::getNumNonIO(void) {
     // 1. compute: 30% of total threads
     size_t count = maxGlobalThreads * 0.3;
@@ -138,7 +141,16 @@ ExecutorPool *ExecutorPool::get(void) {
                                    config.getNumReaderThreads(),
                                    config.getNumWriterThreads(),
                                    config.getNumAuxioThreads(),
-                                   config.getNumNonioThreads());
+                                   config.getNumNonioThreads(),
+                                   config.isExecutorWorkStealing(),
+                                   config.isExecutorTimerWheel(),
+                                   config.isExecutorFairShare(),
+                                   config.getExecutorReservedThreads());
+            tmp->setNumaAffinity(config.isExecutorNumaAffinity());
+            if (config.isExecutorAutoTune()) {
+                tmp->setAutoTune(config.getExecutorAutoTuneMinThreads(),
+                                 config.getExecutorAutoTuneMaxThreads());
+            }
             ObjectRegistry::onSwitchThread(epe);
             instance.store(tmp);
         }
@@ -157,11 +169,18 @@ void ExecutorPool::shutdown(void) {
 
 ExecutorPool::ExecutorPool(size_t maxThreads, size_t nTaskSets,
                            size_t maxReaders, size_t maxWriters,
-                           size_t maxAuxIO,   size_t maxNonIO) :
+                           size_t maxAuxIO,   size_t maxNonIO,
+                           bool workStealing, bool timerWheel,
+                           bool fairShare, size_t reservedThreads) :
                   numTaskSets(nTaskSets), totReadyTasks(0),
                   isHiPrioQset(false), isLowPrioQset(false), numBuckets(0),
-                  numSleepers(0), curWorkers(nTaskSets), numWorkers(nTaskSets),
-                  numReadyTasks(nTaskSets) {
+                  numSleepers(0), workStealing(workStealing),
+                  timerWheel(timerWheel), fairShare(fairShare),
+                  reservedThreads(workStealing ? 0 : reservedThreads),
+                  criticalLanes(nTaskSets),
+                  curWorkers(nTaskSets), numWorkers(nTaskSets),
+                  numReadyTasks(nTaskSets), numReadyCritical(nTaskSets),
+                  runTimes(nTaskSets), cpuTimes(nTaskSets) {
     size_t numCPU = Couchbase::get_available_cpu_count();
     size_t numThreads = (size_t)((numCPU * 3)/4);
     numThreads = (numThreads < EP_MIN_NUM_THREADS) ?
@@ -170,6 +189,12 @@ ExecutorPool::ExecutorPool(size_t maxThreads, size_t nTaskSets,
     for (size_t i = 0; i < nTaskSets; i++) {
         curWorkers[i] = 0;
         numReadyTasks[i] = 0;
+        numReadyCritical[i] = 0;
+        criticalLanes[i] =
+                this->reservedThreads > 0 &&
+                GlobalTask::hasLatencyCriticalTasks(task_type_t(i));
+        runTimes[i] = 0;
+        cpuTimes[i] = 0;
     }
     numWorkers[WRITER_TASK_IDX] = maxWriters;
     numWorkers[READER_TASK_IDX] = maxReaders;
@@ -480,8 +505,15 @@ void ExecutorPool::_registerTaskable(Taskable& taskable) {
         if (!(*whichQset)) {
             taskQ->reserve(numTaskSets);
             for (size_t i = 0; i < numTaskSets; ++i) {
-                taskQ->push_back(
-                        new TaskQueue(this, (task_type_t)i, queueName));
+                const auto type = static_cast<task_type_t>(i);
+                taskQ->push_back(new TaskQueue(
+                        this,
+                        type,
+                        queueName,
+                        workStealing ? _getNumThreads(type) : 0,
+                        timerWheel,
+                        fairShare,
+                        _hasCriticalLane(type)));
             }
             *whichQset = true;
         }
@@ -536,6 +568,16 @@ ssize_t ExecutorPool::_adjustWorkers(task_type_t type, size_t desiredNumItems) {
                         this,
                         type,
                         typeName + "_worker_" + std::to_string(tidx)));
+                threadQ.back()->setLane(tidx);
+                // The first thread of a type always runs any task
+                threadQ.back()->setReserved(_hasCriticalLane(type) &&
+                                            tidx >= 1 &&
+                                            tidx <= reservedThreads);
+                if (numaAffinity) {
+                    // Spread each type of thread over the nodes so that
+                    // every node gets readers, writers etc.
+                    threadQ.back()->setNumaNode(int(tidx));
+                }
                 threadQ.back()->start();
             }
         } else if (numItems > desiredNumItems) {
@@ -595,16 +637,29 @@ void ExecutorPool::adjustWorkers(task_type_t type, size_t newCount) {
     ObjectRegistry::onSwitchThread(epe);
 }
 
-bool ExecutorPool::_startWorkers(void) {
-    size_t numReaders = getNumReaders();
-    size_t numWriters = getNumWriters();
-    size_t numAuxIO = getNumAuxIO();
-    size_t numNonIO = getNumNonIO();
-
-    if (!numWorkers[WRITER_TASK_IDX]) {
+size_t ExecutorPool::_getNumThreads(task_type_t type) {
+    switch (type) {
+    case READER_TASK_IDX:
+        return getNumReaders();
+    case WRITER_TASK_IDX:
         // MB-12279: Limit writers to 4 for faster bgfetches in DGM by default
-        numWriters = 4;
+        return numWorkers[WRITER_TASK_IDX] ? getNumWriters() : 4;
+    case AUXIO_TASK_IDX:
+        return getNumAuxIO();
+    case NONIO_TASK_IDX:
+        return getNumNonIO();
+    default:
+        throw std::invalid_argument(
+                "ExecutorPool::_getNumThreads: invalid task type " +
+                std::to_string(type));
     }
+}
+
+bool ExecutorPool::_startWorkers(void) {
+    size_t numReaders = _getNumThreads(READER_TASK_IDX);
+    size_t numWriters = _getNumThreads(WRITER_TASK_IDX);
+    size_t numAuxIO = _getNumThreads(AUXIO_TASK_IDX);
+    size_t numNonIO = _getNumThreads(NONIO_TASK_IDX);
 
     _adjustWorkers(READER_TASK_IDX, numReaders);
     _adjustWorkers(WRITER_TASK_IDX, numWriters);
@@ -672,6 +727,11 @@ void ExecutorPool::_unregisterTaskable(Taskable& taskable, bool force) {
 
     LockHolder lh(tMutex);
     taskOwners.erase(&taskable);
+    for (auto* taskQ : {&hpTaskQ, &lpTaskQ}) {
+        for (auto* q : *taskQ) {
+            q->forgetTaskable(taskable.getGID());
+        }
+    }
     if (!(--numBuckets)) {
         if (taskLocator.size()) {
             throw std::logic_error("ExecutorPool::_unregisterTaskable: "
@@ -722,6 +782,35 @@ void ExecutorPool::unregisterTaskable(Taskable& taskable, bool force) {
     _unregisterTaskable(taskable, force);
 }
 
+static void addCriticalStats(TaskQueue* q,
+                             const void* cookie,
+                             ADD_STAT add_stat) {
+    // Times in us
+    char statname[80] = {0};
+    const auto stats = q->getCriticalStats();
+    const std::string prefix = "ep_workload:" + q->getName();
+    checked_snprintf(statname, sizeof(statname), "%s:CriticalQsize",
+                     prefix.c_str());
+    add_casted_stat(statname, q->getCriticalQueueSize(), add_stat, cookie);
+    checked_snprintf(statname, sizeof(statname), "%s:CriticalRuns",
+                     prefix.c_str());
+    add_casted_stat(statname, stats.runs, add_stat, cookie);
+    checked_snprintf(statname, sizeof(statname), "%s:CriticalQtime",
+                     prefix.c_str());
+    add_casted_stat(statname,
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                            stats.qtime)
+                            .count(),
+                    add_stat, cookie);
+    checked_snprintf(statname, sizeof(statname), "%s:CriticalMaxQtime",
+                     prefix.c_str());
+    add_casted_stat(statname,
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                            stats.maxQtime)
+                            .count(),
+                    add_stat, cookie);
+}
+
 void ExecutorPool::doTaskQStat(EventuallyPersistentEngine *engine,
                                const void *cookie, ADD_STAT add_stat) {
     if (engine->getEpStats().isShutdown) {
@@ -752,6 +841,9 @@ void ExecutorPool::doTaskQStat(EventuallyPersistentEngine *engine,
                                      hpTaskQ[i]->getName().c_str());
                     add_casted_stat(statname, pendingQsize, add_stat, cookie);
                 }
+                if (hpTaskQ[i]->hasCriticalLane()) {
+                    addCriticalStats(hpTaskQ[i], cookie, add_stat);
+                }
             }
         }
         if (isLowPrioQset) {
@@ -775,6 +867,9 @@ void ExecutorPool::doTaskQStat(EventuallyPersistentEngine *engine,
                                      lpTaskQ[i]->getName().c_str());
                     add_casted_stat(statname, pendingQsize, add_stat, cookie);
                 }
+                if (lpTaskQ[i]->hasCriticalLane()) {
+                    addCriticalStats(lpTaskQ[i], cookie, add_stat);
+                }
             }
         }
     } catch (std::exception& error) {
@@ -819,6 +914,90 @@ static void showJobLog(const char *logname, const char *prefix,
     }
 }
 
+static void addShareStats(TaskQueue* q,
+                          const void* cookie,
+                          ADD_STAT add_stat) {
+    char statname[80] = {0};
+    for (const auto& share : q->getShareStats()) {
+        try {
+            const std::string prefix = q->getName() + ":" + share.name;
+            checked_snprintf(statname, sizeof(statname), "%s:weight",
+                             prefix.c_str());
+            add_casted_stat(statname, share.weight, add_stat, cookie);
+            checked_snprintf(statname, sizeof(statname), "%s:runs",
+                             prefix.c_str());
+            add_casted_stat(statname, share.runs, add_stat, cookie);
+            checked_snprintf(statname, sizeof(statname), "%s:runtime",
+                             prefix.c_str());
+            add_casted_stat(statname,
+                            std::chrono::duration_cast<
+                                    std::chrono::microseconds>(share.runtime)
+                                    .count(),
+                            add_stat, cookie);
+            checked_snprintf(statname, sizeof(statname), "%s:qtime",
+                             prefix.c_str());
+            add_casted_stat(statname,
+                            std::chrono::duration_cast<
+                                    std::chrono::microseconds>(share.qtime)
+                                    .count(),
+                            add_stat, cookie);
+            checked_snprintf(statname, sizeof(statname), "%s:max_qtime",
+                             prefix.c_str());
+            add_casted_stat(statname,
+                            std::chrono::duration_cast<
+                                    std::chrono::microseconds>(share.maxQtime)
+                                    .count(),
+                            add_stat, cookie);
+        } catch (std::exception& error) {
+            LOG(EXTENSION_LOG_WARNING,
+                "addShareStats: Failed to build stats: %s", error.what());
+        }
+    }
+}
+
+static void addTunerStats(const std::string& type,
+                          size_t threads,
+                          const ThreadTuner& tuner,
+                          const void* cookie,
+                          ADD_STAT add_stat) {
+    char statname[80] = {0};
+    try {
+        const auto& stats = tuner.getStats();
+        const std::string prefix = "auto_tune:" + type;
+        checked_snprintf(statname, sizeof(statname), "%s:threads",
+                         prefix.c_str());
+        add_casted_stat(statname, threads, add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:min_threads",
+                         prefix.c_str());
+        add_casted_stat(statname, tuner.getMinThreads(), add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:max_threads",
+                         prefix.c_str());
+        add_casted_stat(statname, tuner.getMaxThreads(), add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:ready_tasks",
+                         prefix.c_str());
+        add_casted_stat(statname, stats.readyTasks, add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:busy_pct",
+                         prefix.c_str());
+        add_casted_stat(statname, stats.busy, add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:io_wait_pct",
+                         prefix.c_str());
+        add_casted_stat(statname, stats.ioWait, add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:grows",
+                         prefix.c_str());
+        add_casted_stat(statname, stats.grows, add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:shrinks",
+                         prefix.c_str());
+        add_casted_stat(statname, stats.shrinks, add_stat, cookie);
+        checked_snprintf(statname, sizeof(statname), "%s:last_decision",
+                         prefix.c_str());
+        add_casted_stat(statname, to_string(stats.lastDecision).c_str(),
+                        add_stat, cookie);
+    } catch (std::exception& error) {
+        LOG(EXTENSION_LOG_WARNING,
+            "addTunerStats: Failed to build stats: %s", error.what());
+    }
+}
+
 static void addWorkerStats(const char *prefix, ExecutorThread *t,
                            const void *cookie, ADD_STAT add_stat) {
     char statname[80] = {0};
@@ -871,6 +1050,24 @@ void ExecutorPool::doWorkerStat(EventuallyPersistentEngine *engine,
         showJobLog("slow", threadQ[tidx]->getName().c_str(),
                    threadQ[tidx]->getSlowLog(), cookie, add_stat);
     }
+    if (fairShare) {
+        // Per taskable queue time and runtime, in us
+        for (auto* taskQ : {&hpTaskQ, &lpTaskQ}) {
+            for (auto* q : *taskQ) {
+                addShareStats(q, cookie, add_stat);
+            }
+        }
+    }
+    if (autoTuning) {
+        std::lock_guard<std::mutex> tlh(tuneMutex);
+        for (const auto& entry : tuners) {
+            addTunerStats(to_string(entry.first),
+                          numWorkers[entry.first],
+                          entry.second,
+                          cookie,
+                          add_stat);
+        }
+    }
     ObjectRegistry::onSwitchThread(epe);
 }
 
@@ -960,6 +1157,72 @@ void ExecutorPool::doTasksStat(EventuallyPersistentEngine* engine,
     ObjectRegistry::onSwitchThread(epe);
 }
 
+void ExecutorPool::setAutoTune(size_t minThreads, size_t maxThreads) {
+    std::lock_guard<std::mutex> lh(tuneMutex);
+    const size_t numCpus = Couchbase::get_available_cpu_count();
+    tuners.clear();
+    for (auto type : {READER_TASK_IDX, WRITER_TASK_IDX, AUXIO_TASK_IDX}) {
+        tuners.emplace(type,
+                       ThreadTuner(minThreads,
+                                   maxThreads ? maxThreads : maxGlobalThreads,
+                                   numCpus));
+    }
+    lastTune = ProcessClock::now();
+    autoTuning = true;
+}
+
+void ExecutorPool::addRunTime(task_type_t type,
+                              ProcessClock::duration runtime,
+                              std::chrono::nanoseconds cpuTime) {
+    runTimes[type].fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(runtime)
+                    .count(),
+            std::memory_order_relaxed);
+    cpuTimes[type].fetch_add(cpuTime.count(), std::memory_order_relaxed);
+}
+
+void ExecutorPool::_autoTune(ProcessClock::time_point now) {
+    std::vector<std::pair<task_type_t, size_t>> changes;
+    {
+        std::lock_guard<std::mutex> lh(tuneMutex);
+        const auto interval = now - lastTune;
+        if (interval < AUTO_TUNE_MIN_INTERVAL) {
+            return;
+        }
+        lastTune = now;
+
+        for (auto& entry : tuners) {
+            const auto type = entry.first;
+            ThreadTuner::Sample sample;
+            sample.threads = numWorkers[type];
+            // The ready queues of each type of all the TaskQueues
+            sample.readyTasks = numReadyTasks[type];
+            sample.interval = interval;
+            sample.runtime = std::chrono::nanoseconds(runTimes[type].load());
+            sample.cpuTime = std::chrono::nanoseconds(cpuTimes[type].load());
+            const size_t wanted = entry.second.tune(sample);
+            if (wanted != sample.threads) {
+                changes.emplace_back(type, wanted);
+            }
+        }
+    }
+
+    // Outside of tuneMutex, which doWorkerStat takes under tMutex
+    for (const auto& change : changes) {
+        _adjustWorkers(change.first, change.second);
+    }
+}
+
+void ExecutorPool::autoTune() {
+    if (!autoTuning) {
+        return;
+    }
+    EventuallyPersistentEngine* epe =
+            ObjectRegistry::onSwitchThread(NULL, true);
+    _autoTune(ProcessClock::now());
+    ObjectRegistry::onSwitchThread(epe);
+}
+
 void ExecutorPool::_stopAndJoinThreads() {
 
     // Ask all threads to stop (but don't wait)
@@ -62,6 +62,52 @@
  * ExecutorPool::snooze(size_t taskId, double toSleep)
  *   The pool's snooze method will locate the task matching taskId and adjust
  *   its wakeTime to account for the toSleep value.
+ *
+ * === Work stealing ===
+ *
+ * A pool created with workStealing splits each TaskQueue into one lane per
+ * thread of its type, each lane with its own lock, ready queue and future
+ * queue. New tasks are spread round robin over the lanes; a thread runs the
+ * tasks of its own lane, rescheduling them back into it, and only when that
+ * has none ready steals the most urgent ready task of the other lanes (which
+ * then belongs to its lane). Task priority is thus strict within a lane and
+ * what an idle thread picks first across lanes.
+ *
+ * A pool created with timerWheel keeps the tasks waiting for their wakeTime
+ * in TimerWheels rather than FutureQueues (see timer_wheel.h).
+ *
+ * === Fair share ===
+ *
+ * A pool created with fairShare shares the threads of each task type between
+ * the taskables (buckets) in proportion to their getWorkloadShare(). A ready
+ * task only runs before the tasks of other taskables if its taskable has not
+ * used more of the runtime of the queue, divided by its share, than the
+ * least served of them; priority order holds within a taskable. Every busy
+ * taskable thus gets at least its share of the threads, whatever the others
+ * have ready (not with work stealing, whose lanes are each ordered on their
+ * own). The queue time and runtime of each taskable are in the worker stats.
+ *
+ * === Critical lanes ===
+ *
+ * A pool created with reservedThreads gives the TaskQueues of the task types
+ * with latency critical tasks (those front end requests wait for, see
+ * GlobalTask::isLatencyCritical) a critical lane: their ready critical tasks
+ * run before any other ready task of the queue, whatever its priority, and
+ * the tasks coming due are made ready at every fetch rather than once the
+ * ready queue is drained. Up to reservedThreads threads of each such type
+ * (never its first one) only run critical tasks, so a long running task
+ * can't hold up a background fetch by taking all the threads. Not with work
+ * stealing. The queue time of the critical tasks is in the workload stats.
+ *
+ * === Auto tuning ===
+ *
+ * Once setAutoTune() enabled it, each autoTune() call (made every second by
+ * the ExecutorTunerTask of the buckets) moves the number of READER, WRITER
+ * and AUXIO threads by at most one, within the given bounds, as the
+ * ThreadTuner of the type picks from its ready tasks, how busy its threads
+ * were and how much of their runtime was off the CPU (see thread_tuner.h).
+ * The NONIO threads, which run the tuning, are left alone. The decisions are
+ * in the worker stats.
  */
 #ifndef SRC_EXECUTORPOOL_H_
 #define SRC_EXECUTORPOOL_H_ 1
@@ -71,8 +117,11 @@
 #include "syncobject.h"
 #include "task_type.h"
 #include "taskable.h"
+#include "thread_tuner.h"
 
+#include <chrono>
 #include <map>
+#include <mutex>
 #include <set>
 
 // Forward decl
@@ -95,8 +144,18 @@ public:
 
     void doneWork(task_type_t taskType);
 
-    bool trySleep(task_type_t task_type) {
-        if (!numReadyTasks[task_type]) {
+    void addCriticalWork(task_type_t qType) {
+        ++numReadyCritical[qType];
+    }
+
+    void lessCriticalWork(task_type_t qType) {
+        --numReadyCritical[qType];
+    }
+
+    /// @param reserved if the thread only runs latency critical tasks
+    bool trySleep(task_type_t task_type, bool reserved = false) {
+        const auto& ready = reserved ? numReadyCritical : numReadyTasks;
+        if (!ready[task_type]) {
             numSleepers++;
             return true;
         }
@@ -197,6 +256,36 @@ public:
 
     size_t getNumSleepers(void) { return numSleepers; }
 
+    /**
+     * Should the threads be bound to NUMA nodes? Only affects threads
+     * created after the call.
+     */
+    void setNumaAffinity(bool enable) {
+        numaAffinity = enable;
+    }
+
+    /**
+     * Let autoTune() change the number of READER, WRITER and AUXIO threads
+     * between minThreads and maxThreads (0 for the max threads of the pool)
+     */
+    void setAutoTune(size_t minThreads, size_t maxThreads);
+
+    bool isAutoTuning() const {
+        return autoTuning;
+    }
+
+    /**
+     * Adjust the number of threads of the tuned task types to what they
+     * did since the last call, if it was at least half a second ago (each
+     * bucket calls it).
+     */
+    void autoTune();
+
+    /// Account a run of a task of the type (auto tuning only)
+    void addRunTime(task_type_t type,
+                    ProcessClock::duration runtime,
+                    std::chrono::nanoseconds cpuTime);
+
     size_t schedule(ExTask task);
 
     static ExecutorPool *get(void);
@@ -205,8 +294,16 @@ public:
 
 protected:
 
-    ExecutorPool(size_t t, size_t nTaskSets, size_t r, size_t w, size_t a,
-                 size_t n);
+    ExecutorPool(size_t t,
+                 size_t nTaskSets,
+                 size_t r,
+                 size_t w,
+                 size_t a,
+                 size_t n,
+                 bool workStealing = false,
+                 bool timerWheel = false,
+                 bool fairShare = false,
+                 size_t reservedThreads = 0);
     virtual ~ExecutorPool(void);
 
     TaskQueue* _nextTask(ExecutorThread &t, uint8_t tick);
@@ -214,6 +311,14 @@ protected:
     bool _wake(size_t taskId);
     virtual bool _startWorkers(void);
 
+    /// The number of threads to start for the given task type
+    size_t _getNumThreads(task_type_t type);
+
+    /// Does the TaskQueue of the type have a critical lane?
+    bool _hasCriticalLane(task_type_t type) const {
+        return criticalLanes[type];
+    }
+
     /**
      * Change the number of worked threads.
      *
@@ -230,6 +335,7 @@ protected:
     bool _stopTaskGroup(task_gid_t taskGID, task_type_t qidx, bool force);
     TaskQueue* _getTaskQueue(const Taskable& t, task_type_t qidx);
     void _stopAndJoinThreads();
+    void _autoTune(ProcessClock::time_point now);
 
     size_t numTaskSets; // safe to read lock-less not altered after creation
     size_t maxGlobalThreads;
@@ -255,9 +361,25 @@ protected:
     SyncObject tMutex; // to serialize taskLocator, threadQ, numBuckets access
 
     std::atomic<uint16_t> numSleepers; // total number of sleeping threads
+    bool numaAffinity = false; // bind the threads to NUMA nodes
+    const bool workStealing; // per thread lanes in the TaskQueues
+    const bool timerWheel; // TimerWheels for the tasks waiting in TaskQueues
+    const bool fairShare; // share the threads between the taskables
+    const size_t reservedThreads; // for the critical tasks, per task type
+    std::vector<bool> criticalLanes; // by task set, if its queues have one
     std::vector<std::atomic<uint16_t>> curWorkers; // track # of active workers per TaskSet
     std::vector<std::atomic<uint16_t>> numWorkers; // and limit it to the value set here
     std::vector<std::atomic<size_t>> numReadyTasks; // number of ready tasks per task set
+    std::vector<std::atomic<size_t>> numReadyCritical; // and critical ones
+
+    // Auto tuning only: by task set, the wall clock and CPU time (ns) of
+    // the runs of its tasks
+    std::vector<std::atomic<uint64_t>> runTimes;
+    std::vector<std::atomic<uint64_t>> cpuTimes;
+    std::atomic<bool> autoTuning{false};
+    std::mutex tuneMutex; // Protects tuners and lastTune
+    std::map<task_type_t, ThreadTuner> tuners;
+    ProcessClock::time_point lastTune;
 
     // Set of all known task owners
     std::set<void *> taskOwners;
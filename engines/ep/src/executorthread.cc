@@ -27,8 +27,36 @@
 #include "taskqueue.h"
 #include "ep_engine.h"
 
+#include <memcached/numa.h>
 #include <platform/timeutils.h>
 
+#ifndef WIN32
+#include <time.h>
+#endif
+
+/// The CPU time used by the calling thread so far
+static std::chrono::nanoseconds getThreadCpuTime() {
+#ifdef WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return std::chrono::nanoseconds(0);
+    }
+    auto toNs = [](const FILETIME& time) {
+        // In 100ns units
+        return ((uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime) *
+               100;
+    };
+    return std::chrono::nanoseconds(toNs(kernel) + toNs(user));
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    return std::chrono::seconds(ts.tv_sec) +
+           std::chrono::nanoseconds(ts.tv_nsec);
+#endif
+}
+
 extern "C" {
     static void launch_executor_thread(void *arg) {
         ExecutorThread *executor = (ExecutorThread*) arg;
@@ -73,6 +101,18 @@ void ExecutorThread::stop(bool wait) {
 void ExecutorThread::run() {
     LOG(EXTENSION_LOG_DEBUG, "Thread %s running..", getName().c_str());
 
+    if (numaNode >= 0) {
+        if (cb::numa::bindCurrentThreadToNode(numaNode)) {
+            LOG(EXTENSION_LOG_INFO, "Thread %s bound to NUMA node %" PRIu64,
+                getName().c_str(),
+                uint64_t(numaNode % cb::numa::getNumNodes()));
+        } else {
+            LOG(EXTENSION_LOG_WARNING,
+                "Thread %s: failed to bind to a NUMA node",
+                getName().c_str());
+        }
+    }
+
     for (uint8_t tick = 1;; tick++) {
         resetCurrentTask();
 
@@ -117,6 +157,12 @@ void ExecutorThread::run() {
                 curTaskDescr.data(),
                 uint64_t(currentTask->getId()));
 
+            // The auto tuning of the pool wants to know how much of the
+            // runtime was spent off the CPU (e.g. waiting for the disk)
+            const bool autoTuning = manager->isAutoTuning();
+            const auto cpuStart = autoTuning ? getThreadCpuTime()
+                                             : std::chrono::nanoseconds(0);
+
             // Now Run the Task ....
             currentTask->setState(TASK_RUNNING, TASK_SNOOZED);
             bool again = currentTask->run();
@@ -127,6 +173,10 @@ void ExecutorThread::run() {
             currentTask->getTaskable().logRunTime(currentTask->getTypeId(),
                                                   runtime);
             currentTask->updateRuntime(runtime);
+            if (autoTuning) {
+                manager->addRunTime(
+                        taskType, runtime, getThreadCpuTime() - cpuStart);
+            }
 
             // Check if exceeded expected duration; and if so log.
             // Note: This is done before we call onSwitchThread(NULL)
@@ -168,6 +168,35 @@ public:
         now.setTimePoint(ProcessClock::now());
     }
 
+    /**
+     * Bind the thread to the given NUMA node when it starts running
+     * (must be called before start())
+     */
+    void setNumaNode(int node) {
+        numaNode = node;
+    }
+
+    /**
+     * Set the lane of the TaskQueues the thread takes its tasks from first
+     * when they steal work (must be called before start())
+     */
+    void setLane(size_t idx) {
+        lane = idx;
+    }
+
+    /**
+     * Reserve the thread for the latency critical tasks of its type: it
+     * only takes the tasks of the critical lanes of the TaskQueues (must be
+     * called before start())
+     */
+    void setReserved(bool value) {
+        reserved = value;
+    }
+
+    bool isReserved() const {
+        return reserved;
+    }
+
 protected:
 
     cb_thread_t thread;
@@ -176,6 +205,15 @@ protected:
     const std::string name;
     std::atomic<executor_state_t> state;
 
+    // The NUMA node to bind the thread to (-1 to let it float)
+    int numaNode = -1;
+
+    // The lane of the work stealing TaskQueues owned by the thread
+    size_t lane = 0;
+
+    // Only runs latency critical tasks
+    bool reserved = false;
+
     // record of current time
     AtomicProcessTime now;
     // record of the earliest time the task can be woken-up
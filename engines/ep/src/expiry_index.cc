@@ -0,0 +1,89 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "expiry_index.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const size_t ExpiryIndex::DefaultGranularity;
+
+ExpiryIndex::ExpiryIndex(size_t granularity)
+    : granularity(std::max(size_t(1), granularity)), entries(0) {
+}
+
+void ExpiryIndex::add(uint32_t hash, time_t exptime) {
+    if (exptime == 0) {
+        throw std::invalid_argument(
+                "ExpiryIndex::add: the item doesn't expire");
+    }
+
+    std::lock_guard<std::mutex> lh(mutex);
+    auto& slot = slots[getSlot(exptime)];
+    // Repeated updates of the same key tend to land back to back
+    if (!slot.empty() && slot.back() == hash) {
+        return;
+    }
+    slot.push_back(hash);
+    ++entries;
+}
+
+std::vector<uint32_t> ExpiryIndex::takeDue(time_t now) {
+    std::vector<uint32_t> due;
+    {
+        std::lock_guard<std::mutex> lh(mutex);
+        // The items expire once now is past their expiry time, so all of
+        // the slots before the current one are due, and some of the
+        // items in the current slot may be
+        const auto current = getSlot(now);
+        auto it = slots.begin();
+        for (; it != slots.end() && it->first < current; ++it) {
+            due.insert(due.end(), it->second.begin(), it->second.end());
+        }
+        entries -= due.size();
+        slots.erase(slots.begin(), it);
+
+        if (it != slots.end() && it->first == current) {
+            due.insert(due.end(), it->second.begin(), it->second.end());
+        }
+    }
+
+    std::sort(due.begin(), due.end());
+    due.erase(std::unique(due.begin(), due.end()), due.end());
+    return due;
+}
+
+void ExpiryIndex::clear() {
+    std::lock_guard<std::mutex> lh(mutex);
+    slots.clear();
+    entries = 0;
+}
+
+size_t ExpiryIndex::size() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    return entries;
+}
+
+size_t ExpiryIndex::memorySize() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    // Roughly; the map nodes and the (unused) capacity of the vectors
+    // aren't exact
+    return sizeof(ExpiryIndex) +
+           slots.size() * (sizeof(time_t) + sizeof(std::vector<uint32_t>) +
+                           4 * sizeof(void*)) +
+           entries * sizeof(uint32_t);
+}
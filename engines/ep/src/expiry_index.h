@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * An index of when the items of a vbucket expire (a TTL index), so that
+ * the ExpiredItemPager only needs to look at the items which are due
+ * rather than visit every item in the hash table.
+ *
+ * The index is a time wheel of slots of `granularity` seconds, each
+ * holding the hashes of the keys expiring in that period. A slot stays in
+ * the index until all of its period has passed; until then the keys of
+ * the current slot are handed out (but kept) every time.
+ *
+ * Entries are never removed when an item is deleted or its expiry time
+ * is changed (a new entry is added for the new time); the stale entry is
+ * simply dropped when its slot falls due and the hash table doesn't have
+ * an expired item for the key.
+ *
+ * All methods are thread safe.
+ */
+class ExpiryIndex {
+public:
+    /// The default length (in seconds) of the period of each slot
+    static const size_t DefaultGranularity = 10;
+
+    explicit ExpiryIndex(size_t granularity = DefaultGranularity);
+
+    /**
+     * Add the key with the given hash, expiring at the given time
+     * (which must not be 0)
+     */
+    void add(uint32_t hash, time_t exptime);
+
+    /**
+     * Do the two expiry times fall in the same slot (so that an item
+     * already in the index for the first doesn't need a new entry for
+     * the second)?
+     */
+    bool isSameSlot(time_t a, time_t b) const {
+        return getSlot(a) == getSlot(b);
+    }
+
+    /**
+     * Take the hashes of the keys which may have expired as of the given
+     * time out of the index (sorted, and without duplicates). The keys of
+     * the slot the time is in are returned as well, but stay in the index.
+     */
+    std::vector<uint32_t> takeDue(time_t now);
+
+    void clear();
+
+    /// Get the number of entries in the index
+    size_t size() const;
+
+    size_t memorySize() const;
+
+    size_t getGranularity() const {
+        return granularity;
+    }
+
+private:
+    time_t getSlot(time_t exptime) const {
+        return exptime / time_t(granularity);
+    }
+
+    const size_t granularity;
+
+    mutable std::mutex mutex;
+    // The hashes expiring in each slot, by the number of the slot
+    std::map<time_t, std::vector<uint32_t>> slots;
+    size_t entries;
+};
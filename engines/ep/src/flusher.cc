@@ -18,13 +18,44 @@
 #include "flusher.h"
 
 #include "common.h"
+#include "statwriter.h"
 #include "tasks.h"
 #include <platform/timeutils.h>
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <sstream>
 
+const std::chrono::microseconds FlushBatchController::commitCostPerItem(100);
+const size_t FlushBatchController::maxTargetBatchSize;
+
+void FlushBatchController::recordCommit(std::chrono::microseconds duration) {
+    // Exponentially weighted moving average, with a weight of 1/8 for the
+    // latest commit
+    uint64_t latency = commitLatency;
+    latency = (latency == 0) ? duration.count()
+                             : (latency * 7 + duration.count()) / 8;
+    commitLatency = latency;
+
+    const uint64_t batch = latency / commitCostPerItem.count();
+    targetBatchSize = std::max(
+            size_t(1), size_t(std::min(batch, uint64_t(maxTargetBatchSize))));
+}
+
+void FlushBatchController::addStats(const std::string& prefix,
+                                    ADD_STAT add_stat,
+                                    const void* cookie) const {
+    add_prefixed_stat(prefix.c_str(), "flusher_commit_latency",
+                      commitLatency.load(), add_stat, cookie);
+    add_prefixed_stat(prefix.c_str(), "flusher_target_batch_size",
+                      targetBatchSize.load(), add_stat, cookie);
+    add_prefixed_stat(prefix.c_str(), "flusher_deferrals",
+                      numDeferrals.load(), add_stat, cookie);
+    add_prefixed_stat(prefix.c_str(), "flusher_deferred_vbuckets",
+                      numDeferredVBuckets.load(), add_stat, cookie);
+}
+
 
 bool Flusher::stop(bool isForceShutdown) {
     forceShutdownReceived = isForceShutdown;
@@ -216,6 +247,13 @@ bool Flusher::step(GlobalTask *task) {
 }
 
 void Flusher::completeFlush() {
+    // Flush the deferred vbuckets too; nothing is deferred once stopping
+    for (const auto& deferred : deferredVbs) {
+        lpVbs.push(deferred.first);
+    }
+    deferredVbs.clear();
+    batchController.setNumDeferredVBuckets(0);
+
     while(!canSnooze()) {
         flushVB();
     }
@@ -227,7 +265,65 @@ double Flusher::computeMinSleepTime() {
         return 0;
     }
     minSleepTime *= 2;
-    return std::min(minSleepTime, DEFAULT_MAX_SLEEP_TIME);
+    double tosleep = std::min(minSleepTime, DEFAULT_MAX_SLEEP_TIME);
+
+    // Wake up in time to flush the deferred vbuckets
+    const auto maxDelay = store->getFlusherMaxBatchDelay();
+    const auto now = ProcessClock::now();
+    for (const auto& deferred : deferredVbs) {
+        const std::chrono::duration<double> due =
+                deferred.second + maxDelay - now;
+        tosleep = std::min(tosleep, std::max(due.count(), 0.0));
+    }
+    return tosleep;
+}
+
+bool Flusher::deferFlush(uint16_t vbid) {
+    auto it = deferredVbs.find(vbid);
+    const auto maxDelay = store->getFlusherMaxBatchDelay();
+    if (maxDelay.count() > 0 && _state == State::Running) {
+        VBucketPtr vb = store->getVBucket(vbid);
+        const auto now = ProcessClock::now();
+        const auto deferredFor = (it == deferredVbs.end())
+                                         ? ProcessClock::duration::zero()
+                                         : now - it->second;
+        if (vb &&
+            batchController.shouldDefer(
+                    vb->dirtyQueueSize.load(), deferredFor, maxDelay)) {
+            if (it == deferredVbs.end()) {
+                deferredVbs.emplace(vbid, now);
+                batchController.recordDeferral(deferredVbs.size());
+            }
+            return true;
+        }
+    }
+
+    if (it != deferredVbs.end()) {
+        deferredVbs.erase(it);
+        batchController.setNumDeferredVBuckets(deferredVbs.size());
+    }
+    return false;
+}
+
+void Flusher::queueDueDeferredVBuckets() {
+    const auto maxDelay = store->getFlusherMaxBatchDelay();
+    const auto now = ProcessClock::now();
+    for (const auto& deferred : deferredVbs) {
+        if (deferred.second + maxDelay <= now) {
+            // deferFlush() lets it be flushed now
+            lpVbs.push(deferred.first);
+        }
+    }
+}
+
+void Flusher::updateBatchController() {
+    auto& kvstoreStats = shard->getRWUnderlying()->getKVStoreStat();
+    const size_t numCommits = kvstoreStats.numCommits;
+    if (numCommits != lastNumCommits) {
+        lastNumCommits = numCommits;
+        batchController.recordCommit(
+                std::chrono::microseconds(kvstoreStats.lastCommitTime.load()));
+    }
 }
 
 void Flusher::flushVB(void) {
@@ -248,6 +344,9 @@ void Flusher::flushVB(void) {
                 lpVbs.push(vbid);
             }
         }
+        if (lpVbs.empty()) {
+            queueDueDeferredVBuckets();
+        }
     }
 
     if (!doHighPriority && shard->highPriorityCount.load() > 0) {
@@ -272,15 +371,57 @@ void Flusher::flushVB(void) {
         hpVbs.pop();
         if (store->flushVBucket(vbid) == RETRY_FLUSH_VBUCKET) {
             hpVbs.push(vbid);
+        } else if (deferredVbs.erase(vbid)) {
+            batchController.setNumDeferredVBuckets(deferredVbs.size());
         }
+        updateBatchController();
+    } else if (store->getStorageProperties().hasGroupCommit()) {
+        flushLowPriorityGroup();
     } else {
         if (doHighPriority && --numHighPriority == 0) {
             doHighPriority = false;
         }
         uint16_t vbid = lpVbs.front();
         lpVbs.pop();
+        if (deferFlush(vbid)) {
+            return;
+        }
         if (store->flushVBucket(vbid) == RETRY_FLUSH_VBUCKET) {
             lpVbs.push(vbid);
         }
+        updateBatchController();
+    }
+}
+
+void Flusher::flushLowPriorityGroup() {
+    // Flush the vbuckets queued so far into one group commit. The ones
+    // which must be retried are only queued again once the group is
+    // committed, as they may be locked by the group until then.
+    FlushGroup group;
+    std::vector<uint16_t> retry;
+    for (size_t remaining = lpVbs.size(); remaining > 0; --remaining) {
+        if (!group.empty() && store->isDeleteAllScheduled()) {
+            // Commit what is staged before the deletion of all the data
+            break;
+        }
+        if (doHighPriority && --numHighPriority == 0) {
+            doHighPriority = false;
+        }
+        uint16_t vbid = lpVbs.front();
+        lpVbs.pop();
+        if (deferFlush(vbid)) {
+            continue;
+        }
+        if (store->flushVBucket(vbid, &group) == RETRY_FLUSH_VBUCKET) {
+            retry.push_back(vbid);
+        }
+    }
+
+    for (auto vbid : store->commitFlushGroup(group)) {
+        retry.push_back(vbid);
+    }
+    for (auto vbid : retry) {
+        lpVbs.push(vbid);
     }
+    updateBatchController();
 }
@@ -20,15 +20,20 @@
 
 #include "config.h"
 
+#include <chrono>
 #include <list>
 #include <map>
 #include <queue>
 #include <string>
+#include <unordered_map>
 
 #include "kv_bucket.h"
 #include "executorthread.h"
 #include "utility.h"
 
+#include <platform/processclock.h>
+#include <relaxed_atomic.h>
+
 #define NO_VBUCKETS_INSTANTIATED 0xFFFF
 #define RETRY_FLUSH_VBUCKET (-1)
 
@@ -37,6 +42,64 @@ const double DEFAULT_MAX_SLEEP_TIME = 10.0;
 
 class KVShard;
 
+/**
+ * Sizes the flush batches of a Flusher from the latency of the commits of
+ * its KVStore. The slower the commits, the more dirty items a vbucket must
+ * have before it is flushed without delay, so that the cost of a commit is
+ * shared by enough items; the Flusher defers (for a bounded time) the flush
+ * of a vbucket with fewer dirty items.
+ */
+class FlushBatchController {
+public:
+    /// Record a commit of the KVStore which took the given time
+    void recordCommit(std::chrono::microseconds duration);
+
+    /// The number of dirty items for which a vbucket is flushed right away
+    size_t getTargetBatchSize() const {
+        return targetBatchSize;
+    }
+
+    /**
+     * @param dirtyItems the number of items of a vbucket waiting to be
+     *                   persisted
+     * @param deferredFor how long the flush of the vbucket has been deferred
+     * @param maxDelay the maximum time a flush may be deferred
+     * @return true if the flush of the vbucket should be deferred
+     */
+    bool shouldDefer(size_t dirtyItems,
+                     ProcessClock::duration deferredFor,
+                     std::chrono::milliseconds maxDelay) const {
+        return dirtyItems > 0 && dirtyItems < targetBatchSize &&
+               deferredFor < maxDelay;
+    }
+
+    /// Record that the flush of a vbucket was deferred
+    void recordDeferral(size_t deferredVBuckets) {
+        ++numDeferrals;
+        numDeferredVBuckets = deferredVBuckets;
+    }
+
+    void setNumDeferredVBuckets(size_t deferredVBuckets) {
+        numDeferredVBuckets = deferredVBuckets;
+    }
+
+    void addStats(const std::string& prefix,
+                  ADD_STAT add_stat,
+                  const void* cookie) const;
+
+private:
+    /// The commit cost per item to aim for, by batching enough items
+    static const std::chrono::microseconds commitCostPerItem;
+
+    static const size_t maxTargetBatchSize = 10000;
+
+    /// Moving average of the commit latency, in us
+    Couchbase::RelaxedAtomic<uint64_t> commitLatency{0};
+    Couchbase::RelaxedAtomic<size_t> targetBatchSize{1};
+    Couchbase::RelaxedAtomic<size_t> numDeferrals{0};
+    Couchbase::RelaxedAtomic<size_t> numDeferredVBuckets{0};
+};
+
 /**
  * Manage persistence of data for an EPBucket.
  */
@@ -84,6 +147,10 @@ public:
     }
     void setTaskId(size_t newId) { taskId = newId; }
 
+    const FlushBatchController& getBatchController() const {
+        return batchController;
+    }
+
 private:
     enum class State {
         Initializing,
@@ -97,6 +164,10 @@ private:
     bool transitionState(State to);
     bool validTransition(State to) const;
     void flushVB();
+    void flushLowPriorityGroup();
+    bool deferFlush(uint16_t vbid);
+    void queueDueDeferredVBuckets();
+    void updateBatchController();
     void completeFlush();
     void initialize();
     void schedule_UNLOCKED();
@@ -124,6 +195,12 @@ private:
     size_t numHighPriority;
     std::atomic<bool> pendingMutation;
 
+    FlushBatchController batchController;
+    // The vbuckets whose flush is deferred, and since when
+    std::unordered_map<uint16_t, ProcessClock::time_point> deferredVbs;
+    // KVStoreStats::numCommits when the batchController was last updated
+    size_t lastNumCommits = 0;
+
     KVShard *shard;
 
     DISALLOW_COPY_AND_ASSIGN(Flusher);
@@ -986,7 +986,8 @@ StorageProperties ForestKVStore::getStorageProperties(void) {
                          StorageProperties::EfficientVBDeletion::Yes,
                          StorageProperties::PersistedDeletion::Yes,
                          StorageProperties::EfficientGet::Yes,
-                         StorageProperties::ConcurrentWriteCompact::Yes);
+                         StorageProperties::ConcurrentWriteCompact::Yes,
+                         StorageProperties::GroupCommit::No);
     return rv;
 }
 
@@ -1275,7 +1276,8 @@ ForestKVStore::getAllKeys(uint16_t vbid,
         // Collection: Currently only create the key in the DefaultCollection
         cb->callback(DocKey(key, keylen, DocNamespace::DefaultCollection));
 
-        if (fdb_iterator_next(fdb_iter) != FDB_RESULT_SUCCESS) {
+        if (cb->getStatus() != ENGINE_SUCCESS ||
+            fdb_iterator_next(fdb_iter) != FDB_RESULT_SUCCESS) {
             break;
         }
     }
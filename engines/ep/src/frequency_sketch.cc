@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "frequency_sketch.h"
+
+#include <algorithm>
+
+const uint8_t FrequencySketch::MaxFrequency;
+
+static size_t roundUpWidth(size_t width) {
+    size_t rv = 16;
+    while (rv < width) {
+        rv <<= 1;
+    }
+    return rv;
+}
+
+FrequencySketch::FrequencySketch(size_t w)
+    : width(roundUpWidth(w)),
+      sampleSize(10 * width),
+      table(Depth * width / CountersPerWord),
+      additions(0) {
+    for (auto& word : table) {
+        word.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t FrequencySketch::getIndex(uint32_t hash, int row) const {
+    static const uint64_t seeds[Depth] = {0xc3a5c85c97cb3127ULL,
+                                          0xb492b66fbe98f273ULL,
+                                          0x9ae16a3b2f90404fULL,
+                                          0xcbf29ce484222325ULL};
+    // Spread the bits of the hash (murmur3 finalizer) before deriving the
+    // index for each row from it
+    uint32_t h = hash;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    const uint64_t x = (uint64_t(h) + seeds[row]) * seeds[row];
+    return size_t(x >> 32) & (width - 1);
+}
+
+bool FrequencySketch::incrementAt(int row, size_t index) {
+    auto& word = table[row * (width / CountersPerWord) + index / CountersPerWord];
+    const int shift = int(index % CountersPerWord) * 4;
+    const uint64_t one = uint64_t(1) << shift;
+    uint64_t current = word.load(std::memory_order_relaxed);
+    while (((current >> shift) & 0xf) < MaxFrequency) {
+        if (word.compare_exchange_weak(
+                    current, current + one, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrequencySketch::increment(uint32_t hash) {
+    bool added = false;
+    for (int row = 0; row < Depth; ++row) {
+        added |= incrementAt(row, getIndex(hash, row));
+    }
+
+    if (added &&
+        additions.fetch_add(1, std::memory_order_relaxed) + 1 == sampleSize) {
+        // Only the thread which reached the sample size ages the counters
+        age();
+    }
+}
+
+uint8_t FrequencySketch::estimate(uint32_t hash) const {
+    uint8_t rv = MaxFrequency;
+    for (int row = 0; row < Depth; ++row) {
+        const size_t index = getIndex(hash, row);
+        const uint64_t word =
+                table[row * (width / CountersPerWord) +
+                      index / CountersPerWord]
+                        .load(std::memory_order_relaxed);
+        const int shift = int(index % CountersPerWord) * 4;
+        rv = std::min(rv, uint8_t((word >> shift) & 0xf));
+    }
+    return rv;
+}
+
+void FrequencySketch::age() {
+    for (auto& word : table) {
+        uint64_t current = word.load(std::memory_order_relaxed);
+        while (!word.compare_exchange_weak(
+                current,
+                (current >> 1) & 0x7777777777777777ULL,
+                std::memory_order_relaxed)) {
+        }
+    }
+    // Increments made while we aged the counters are lost in the noise
+    additions.store(sampleSize / 2, std::memory_order_relaxed);
+}
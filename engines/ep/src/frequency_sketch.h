@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A count-min sketch of the (recent) access frequency of the keys of a
+ * vbucket, as used by TinyLFU.
+ *
+ * The sketch has 4 rows of 4-bit saturating counters; an access increments
+ * one counter (picked by a different hash of the key) in each row, and the
+ * estimate for a key is the smallest of its counters. Once the number of
+ * accesses counted reaches the sample size (10 times the width) all of the
+ * counters are halved, so the sketch only reflects the recent history.
+ *
+ * Unlike the frequency counter of a StoredValue, the sketch remembers keys
+ * which aren't in memory (or were deleted and recreated) - so the ItemPager
+ * doesn't treat a hot item fetched back from disk as cold.
+ *
+ * All methods are thread safe (and lock-free).
+ */
+class FrequencySketch {
+public:
+    /// The value at which the counters saturate
+    static const uint8_t MaxFrequency = 15;
+
+    /**
+     * @param width the number of counters in each row (rounded up to a power
+     *        of two, and at least 16)
+     */
+    explicit FrequencySketch(size_t width);
+
+    /**
+     * Count an access to the key with the given hash.
+     */
+    void increment(uint32_t hash);
+
+    /**
+     * Get the estimated number of (recent) accesses to the key with the
+     * given hash, up to MaxFrequency.
+     */
+    uint8_t estimate(uint32_t hash) const;
+
+    size_t getWidth() const {
+        return width;
+    }
+
+    /// The number of accesses counted between halving the counters
+    size_t getSampleSize() const {
+        return sampleSize;
+    }
+
+    size_t memorySize() const {
+        return sizeof(FrequencySketch) + table.size() * sizeof(uint64_t);
+    }
+
+private:
+    static const int Depth = 4;
+    static const int CountersPerWord = 16;
+
+    /// Get the index (in the row) of the counter for the given hash
+    size_t getIndex(uint32_t hash, int row) const;
+
+    /// Increment the counter at index in row, unless saturated
+    bool incrementAt(int row, size_t index);
+
+    /// Halve all of the counters
+    void age();
+
+    const size_t width;
+    const size_t sampleSize;
+
+    /// Depth rows of width / CountersPerWord words
+    std::vector<std::atomic<uint64_t>> table;
+
+    /// The number of accesses counted since we last halved the counters
+    std::atomic<size_t> additions;
+};
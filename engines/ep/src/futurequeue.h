@@ -33,32 +33,65 @@
 
 #include "globaltask.h"
 
+/**
+ * Interface of the queues of tasks ordered by wakeTime a TaskQueue can keep
+ * its waiting tasks in (FutureQueue or TimerWheel).
+ */
+class FutureQueueBase {
+public:
+    virtual ~FutureQueueBase() {
+    }
+
+    virtual void push(ExTask task) = 0;
+
+    virtual void pop() = 0;
+
+    virtual ExTask top() = 0;
+
+    virtual size_t size() = 0;
+
+    virtual bool empty() = 0;
+
+    /*
+     * Update the wakeTime of task and keep the ordering.
+     * @returns true if 'task' is in the queue.
+     */
+    virtual bool updateWaketime(const ExTask& task,
+                                ProcessClock::time_point newTime) = 0;
+
+    /*
+     * snooze the task (by altering its wakeTime) and keep the ordering.
+     * @returns true if 'task' is in the queue.
+     */
+    virtual bool snooze(const ExTask& task, const double secs) = 0;
+};
+
 template <class C = std::deque<ExTask>,
           class Compare = CompareByDueDate>
-class FutureQueue {
+class FutureQueue : public FutureQueueBase {
 public:
 
-    void push(ExTask task) {
+    void push(ExTask task) override {
         std::lock_guard<std::mutex> lock(queueMutex);
         queue.push(task);
     }
 
-    void pop() {
+    void pop() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         queue.pop();
     }
 
-    ExTask top() {
+    ExTask top() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         return queue.top();
     }
 
-    size_t size() {
+    size_t size() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         return queue.size();
     }
 
-    bool empty() {
+    bool empty() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         return queue.empty();
     }
@@ -68,7 +101,8 @@ public:
      * maintained.
      * @returns true if 'task' is in the FutureQueue.
      */
-    bool updateWaketime(const ExTask& task, ProcessClock::time_point newTime) {
+    bool updateWaketime(const ExTask& task,
+                        ProcessClock::time_point newTime) override {
         std::lock_guard<std::mutex> lock(queueMutex);
         task->updateWaketime(newTime);
         // After modifiying the task's wakeTime, rebuild the heap
@@ -80,7 +114,7 @@ public:
      * heap property is maintained.
      * @returns true if 'task' is in the FutureQueue.
      */
-    bool snooze(const ExTask& task, const double secs) {
+    bool snooze(const ExTask& task, const double secs) override {
         std::lock_guard<std::mutex> lock(queueMutex);
         task->snooze(secs);
         // After modifiying the task's wakeTime, rebuild the heap
@@ -17,6 +17,8 @@
 
 #include <limits.h>
 
+#include <algorithm>
+
 #include "globaltask.h"
 #include "ep_engine.h"
 
@@ -141,6 +143,25 @@ task_type_t GlobalTask::getTaskType(TaskId id) {
                            std::to_string(static_cast<int>(id)));
 }
 
+bool GlobalTask::isLatencyCritical(TaskId id) {
+    switch (id) {
+    case TaskId::MultiBGFetcherTask:
+    case TaskId::SingleBGFetcherTask:
+    case TaskId::PendingOpsNotification:
+    case TaskId::NotifyHighPriorityReqTask:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool GlobalTask::hasLatencyCriticalTasks(task_type_t type) {
+    return std::any_of(
+            allTaskIds.begin(), allTaskIds.end(), [type](TaskId id) {
+                return getTaskType(id) == type && isLatencyCritical(id);
+            });
+}
+
 std::array<TaskId, static_cast<int>(TaskId::TASK_COUNT)> GlobalTask::allTaskIds = {{
 #define TASK(name, type, prio) TaskId::name,
 #include "tasks.def.h"
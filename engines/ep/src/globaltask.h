@@ -57,6 +57,7 @@ class GlobalTask {
     friend class CompareByPriority;
     friend class ExecutorPool;
     friend class ExecutorThread;
+    friend class TaskQueue;
 public:
 
     GlobalTask(Taskable& t,
@@ -238,6 +239,18 @@ public:
      */
     static task_type_t getTaskType(TaskId id);
 
+    /*
+     * Is TaskId id one of the tasks which front end requests wait for
+     * (background fetches, notifications of blocked connections)? These
+     * run in the critical lane of their TaskQueue.
+     */
+    static bool isLatencyCritical(TaskId id);
+
+    /*
+     * Are any of the tasks of the given type latency critical?
+     */
+    static bool hasLatencyCriticalTasks(task_type_t type);
+
     /*
      * A vector of all TaskId generated from tasks.def.h
      */
@@ -270,6 +283,9 @@ protected:
 
 private:
     atomic_time_point waketime; // used for priority_queue
+
+    // The lane of its TaskQueue the task is in (work stealing mode)
+    std::atomic<size_t> queueLane{0};
 };
 
 typedef std::shared_ptr<GlobalTask> ExTask;
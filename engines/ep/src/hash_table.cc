@@ -20,9 +20,12 @@
 #include "item.h"
 #include "stats.h"
 #include "stored_value_factories.h"
+#include "vb_visitors.h"
 
 #include <phosphor/phosphor.h>
+#include <platform/compress.h>
 
+#include <algorithm>
 #include <cstring>
 
 static const ssize_t prime_size_table[] = {
@@ -32,6 +35,17 @@ static const ssize_t prime_size_table[] = {
     1610612741, -1
 };
 
+static size_t nextPowerOfTwo(size_t n) {
+    size_t ret = 1;
+    while (ret < n) {
+        ret *= 2;
+    }
+    return ret;
+}
+
+static size_t previousPowerOfTwo(size_t n) {
+    return (n == 0) ? 0 : nextPowerOfTwo(n / 2 + 1);
+}
 
 std::ostream& operator<<(std::ostream& os, const HashTable::Position& pos) {
     os << "{lock:" << pos.lock << " bucket:" << pos.hash_bucket << "/" << pos.ht_size << "}";
@@ -41,19 +55,32 @@ std::ostream& operator<<(std::ostream& os, const HashTable::Position& pos) {
 HashTable::HashTable(EPStats& st,
                      std::unique_ptr<AbstractStoredValueFactory> svFactory,
                      size_t initialSize,
-                     size_t locks)
+                     size_t locks,
+                     BucketLayout layout,
+                     size_t maxLocks,
+                     bool hugePages)
     : maxDeletedRevSeqno(0),
       numTotalItems(0),
       numNonResidentItems(0),
       numDeletedItems(0),
       datatypeCounts(),
       numEjects(0),
+      numResidentSetChanges(0),
       memSize(0),
       cacheSize(0),
       metaDataMemory(0),
       initialSize(initialSize),
       size(initialSize),
-      mutexes(locks),
+      hugePages(hugePages),
+      hugePageBytes(0),
+      values(getBucketAllocator()),
+      layout(layout),
+      oldSize(0),
+      initialLocks(nextPowerOfTwo(std::max(locks, size_t(1)))),
+      maxLocks(std::max(initialLocks, previousPowerOfTwo(maxLocks))),
+      bucketsPerLock(std::max(initialSize / initialLocks, size_t(1))),
+      numLocks(initialLocks),
+      numLockWaits(0),
       stats(st),
       valFact(std::move(svFactory)),
       visitors(0),
@@ -61,9 +88,214 @@ HashTable::HashTable(EPStats& st,
       numResizes(0),
       numTempItems(0) {
     values.resize(size);
+    if (layout == BucketLayout::Tagged) {
+        tagTable = TagTable(size);
+    }
+    lockLevels[0].reset(new SharedMutex[initialLocks]);
     activeState = true;
 }
 
+HashTable::AllLocksHolder::AllLocksHolder(HashTable& ht)
+    : ht(ht), held(ht.numLocks) {
+    for (size_t i = 0; i < held; ++i) {
+        ht.getLock(i).lock();
+    }
+}
+
+HashTable::AllLocksHolder::~AllLocksHolder() {
+    for (size_t i = 0; i < held; ++i) {
+        ht.getLock(i).unlock();
+    }
+}
+
+void HashTable::AllLocksHolder::grow(size_t n) {
+    while (held < n) {
+        // The new level is as large as all the existing ones, and is
+        // locked before anyone may see it
+        size_t level = 1;
+        while ((ht.initialLocks << (level - 1)) < held) {
+            ++level;
+        }
+        ht.lockLevels[level].reset(new SharedMutex[held]);
+        for (size_t i = 0; i < held; ++i) {
+            ht.lockLevels[level][i].lock();
+        }
+        held *= 2;
+        ht.numLocks.store(held);
+    }
+}
+
+size_t HashTable::getNumLocksForSize(size_t newSize) const {
+    size_t n = initialLocks;
+    while (n < maxLocks && newSize / n > bucketsPerLock) {
+        n *= 2;
+    }
+    return n;
+}
+
+HashTable::BucketLayout HashTable::parseBucketLayout(const std::string& name) {
+    if (name == "chained") {
+        return BucketLayout::Chained;
+    }
+    if (name == "tagged") {
+        return BucketLayout::Tagged;
+    }
+    throw std::invalid_argument(
+            "HashTable::parseBucketLayout: unknown layout: " + name);
+}
+
+void HashTable::enableFrequencyTracking(size_t sketchWidth) {
+    frequencySketch = std::make_unique<FrequencySketch>(sketchWidth);
+}
+
+void HashTable::enableExpiryIndex(size_t granularity) {
+    expiryIndex = std::make_unique<ExpiryIndex>(granularity);
+}
+
+void HashTable::noteExpiryChange(const StoredValue& v, time_t oldExptime) {
+    const time_t exptime = v.getExptime();
+    if (!expiryIndex || exptime == 0 || v.isDeleted() || v.isTempItem()) {
+        return;
+    }
+    // An item which had an expiry time in the same slot is already in it
+    if (oldExptime != 0 && expiryIndex->isSameSlot(oldExptime, exptime)) {
+        return;
+    }
+    expiryIndex->add(v.getKey().hash(), exptime);
+}
+
+size_t HashTable::visitExpiring(HashTableVisitor& visitor, time_t now) {
+    if (!expiryIndex || !isActive()) {
+        return 0;
+    }
+
+    const auto due = expiryIndex->takeDue(now);
+    for (const auto hash : due) {
+        if (!isActive()) {
+            break;
+        }
+        auto hbl = getLockedBucketForHash(hash);
+        StoredValue* v = values[hbl.getBucketNum()].get();
+        while (v) {
+            StoredValue* tmp = v->getNext().get();
+            // The other keys in the chain have entries of their own
+            if (v->getKey().hash() == hash) {
+                visitor.visit(hbl, *v);
+            }
+            v = tmp;
+        }
+    }
+    return due.size();
+}
+
+uint8_t HashTable::getFrequency(const StoredValue& v) const {
+    if (!frequencySketch) {
+        return v.getFreqCounterValue();
+    }
+    return std::max(v.getFreqCounterValue(),
+                    frequencySketch->estimate(v.getKey().hash()));
+}
+
+bool HashTable::trackSharedReference(const StoredValue& v) {
+    if (v.getNRUValue() != MIN_NRU_VALUE) {
+        return false;
+    }
+    if (frequencySketch) {
+        if (v.getFreqCounterValue() != StoredValue::MaxFreqCounterValue) {
+            return false;
+        }
+        // The sketch is safe to update concurrently
+        frequencySketch->increment(v.getKey().hash());
+    }
+    return true;
+}
+
+uint64_t HashTable::TagBucket::match(uint8_t tag) const {
+    // Compare all of the tags at once (SIMD within a register)
+    uint64_t word = 0;
+    for (int i = 0; i < Entries; ++i) {
+        word |= uint64_t(tags[i]) << (8 * i);
+    }
+
+    const uint64_t low7 = 0x7f7f7f7f7f7f7f7full;
+    const uint64_t x = word ^ (0x0101010101010101ull * tag);
+    // The high bit of a byte is set if (and only if) the byte of x is 0
+    return ~(((x & low7) + low7) | x | low7);
+}
+
+void HashTable::TagBucket::insert(uint8_t tag, StoredValue* sv) {
+    if (count == Overflow) {
+        return;
+    }
+    if (count == Entries) {
+        count = Overflow;
+        return;
+    }
+    tags[count] = tag;
+    values[count] = sv;
+    ++count;
+}
+
+bool HashTable::TagBucket::erase(const StoredValue* sv) {
+    for (uint8_t i = 0; i < count && count != Overflow; ++i) {
+        if (values[i] == sv) {
+            --count;
+            tags[i] = tags[count];
+            values[i] = values[count];
+            tags[count] = 0;
+            values[count] = nullptr;
+            return true;
+        }
+    }
+    return false;
+}
+
+HashTable::TagTable::TagTable(size_t size)
+    : memory(new char[(size + 1) * sizeof(TagBucket)]), size(size) {
+    // Align the buckets to the cache lines
+    const auto align = uintptr_t(sizeof(TagBucket));
+    const auto addr = reinterpret_cast<uintptr_t>(memory.get());
+    buckets = reinterpret_cast<TagBucket*>((addr + align - 1) & ~(align - 1));
+    clear();
+}
+
+void HashTable::TagTable::clear() {
+    if (size != 0) {
+        memset(buckets, 0, size * sizeof(TagBucket));
+    }
+}
+
+void HashTable::unlocked_addTag(int bucket_num,
+                                StoredValue* sv,
+                                uint32_t hash) {
+    if (layout == BucketLayout::Tagged) {
+        tagTable[bucket_num].insert(getTag(hash), sv);
+    }
+}
+
+void HashTable::unlocked_removeTag(int bucket_num, const StoredValue* sv) {
+    if (layout != BucketLayout::Tagged) {
+        return;
+    }
+    auto& tb = tagTable[bucket_num];
+    if (tb.count == TagBucket::Overflow) {
+        // The chain may be short enough to be indexed again
+        unlocked_rebuildTags(bucket_num);
+    } else {
+        tb.erase(sv);
+    }
+}
+
+void HashTable::unlocked_rebuildTags(int bucket_num) {
+    auto& tb = tagTable[bucket_num];
+    memset(&tb, 0, sizeof(tb));
+    for (StoredValue* v = values[bucket_num].get();
+         v && tb.count != TagBucket::Overflow;
+         v = v->getNext().get()) {
+        tb.insert(getTag(v->getKey().hash()), v);
+    }
+}
+
 HashTable::~HashTable() {
     // Use unlocked clear for the destructor, avoids lock inversions on VBucket
     // delete
@@ -93,7 +325,7 @@ void HashTable::clear(bool deactivate) {
                     "non-active object");
         }
     }
-    MultiLockHolder mlh(mutexes);
+    AllLocksHolder alh(*this);
     clear_UNLOCKED(deactivate);
 }
 
@@ -113,7 +345,19 @@ void HashTable::clear_UNLOCKED(bool deactivate) {
             values[i] = std::move(v->getNext());
         }
     }
+    for (auto& chain : oldValues) {
+        while (chain) {
+            auto v = std::move(chain);
+            clearedMemSize += v->size();
+            clearedValSize += v->valuelen();
+            chain = std::move(v->getNext());
+        }
+    }
 
+    tagTable.clear();
+    if (expiryIndex) {
+        expiryIndex->clear();
+    }
     stats.currentSize.fetch_sub(clearedMemSize - clearedValSize);
 
     datatypeCounts.fill(0);
@@ -121,10 +365,48 @@ void HashTable::clear_UNLOCKED(bool deactivate) {
     numItems.store(0);
     numTempItems.store(0);
     numNonResidentItems.store(0);
+    ++numResidentSetChanges;
     memSize.store(0);
     cacheSize.store(0);
 }
 
+bool HashTable::clearWithinBudget(VisitorBudget& budget, size_t& position) {
+    setActiveState(false);
+    size_t clearedMemSize = 0;
+    size_t clearedValSize = 0;
+    // A spent budget frees nothing
+    bool spent = budget.isSpent();
+    while (position < size && !spent) {
+        auto& chain = values[position];
+        while (chain) {
+            if (!budget.visitItem()) {
+                spent = true;
+                break;
+            }
+            auto v = std::move(chain);
+            clearedMemSize += v->size();
+            clearedValSize += v->valuelen();
+            chain = std::move(v->getNext());
+        }
+        if (!spent) {
+            ++position;
+        }
+    }
+
+    // Keep the memory stats up to date as we go (the counts of items are
+    // only reset once all of them are freed)
+    stats.currentSize.fetch_sub(clearedMemSize - clearedValSize);
+    memSize.fetch_sub(std::min(clearedMemSize, memSize.load()));
+    cacheSize.fetch_sub(std::min(clearedMemSize, cacheSize.load()));
+
+    if (position < size) {
+        return false;
+    }
+    // The rest (the chains of a resize in progress, the indexes) all at once
+    clear_UNLOCKED(true);
+    return true;
+}
+
 static size_t distance(size_t a, size_t b) {
     return std::max(a, b) - std::min(a, b);
 }
@@ -181,6 +463,8 @@ void HashTable::resize(size_t newSize) {
         return;
     }
 
+    std::lock_guard<std::mutex> guard(resizeMutex);
+
     // Don't resize to the same size, either.
     if (newSize == size) {
         return;
@@ -189,43 +473,174 @@ void HashTable::resize(size_t newSize) {
     TRACE_EVENT2(
             "HashTable", "resize", "size", size.load(), "newSize", newSize);
 
-    MultiLockHolder mlh(mutexes);
-    if (visitors.load() > 0) {
-        // Do not allow a resize while any visitors are actually
-        // processing.  The next attempt will have to pick it up.  New
-        // visitors cannot start doing meaningful work (we own all
-        // locks at this point).
-        return;
+    // Get a place for the new items before we lock the table.
+    table_type newValues(newSize, getBucketAllocator());
+    TagTable newTags;
+    if (layout == BucketLayout::Tagged) {
+        newTags = TagTable(newSize);
     }
 
-    // Get a place for the new items.
-    table_type newValues(newSize);
+    {
+        AllLocksHolder alh(*this);
+        if (visitors.load() > 0) {
+            // Do not allow a resize while any visitors are actually
+            // processing.  The next attempt will have to pick it up.  New
+            // visitors cannot start doing meaningful work (we own all
+            // locks at this point).
+            return;
+        }
+
+        stats.memOverhead->fetch_sub(memorySize());
+        ++numResizes;
+
+        // Swap in the new table so all the hashy stuff works. The existing
+        // records stay in oldValues until they're moved over.
+        oldValues = std::move(values);
+        oldSize.store(size);
+        values = std::move(newValues);
+        size.store(newSize);
+        // The records are indexed again as they're moved to the new table
+        std::swap(tagTable, newTags);
+        // Keep about as many buckets per lock as we started with. The
+        // locks never go away, so a smaller table keeps the ones it had.
+        alh.grow(getNumLocksForSize(newSize));
+
+        stats.memOverhead->fetch_add(memorySize());
+    }
 
+    // Move the existing records into the new space, holding the locks
+    // for a single old hash bucket at a time.
+    for (size_t i = 0; i < oldSize && isActive(); i++) {
+        migrateOldBucket(i);
+    }
+
+    // Release the (now empty) old table once we've let go of the locks
+    table_type drained;
+    AllLocksHolder alh(*this);
     stats.memOverhead->fetch_sub(memorySize());
-    ++numResizes;
+    drained = std::move(oldValues);
+    oldSize.store(0);
+    stats.memOverhead->fetch_add(memorySize());
+}
 
-    // Set the new size so all the hashy stuff works.
-    size_t oldSize = size;
-    size.store(newSize);
+bool HashTable::unlocked_migrateForHash(HashBucketLock& hbl, int h) {
+    const size_t own = mutexForBucket(hbl.getBucketNum());
+    const size_t oldBucket = getOldBucketForHash(h);
+    const size_t other = mutexForBucket(oldBucket);
 
-    // Move existing records into the new space.
-    for (size_t i = 0; i < oldSize; i++) {
-        while (values[i]) {
-            // unlink the front element from the hash chain at values[i].
-            auto v = std::move(values[i]);
-            values[i] = std::move(v->getNext());
+    if (other == own) {
+        unlocked_migrateOldBucket(oldBucket, own, own);
+        return true;
+    }
+
+    if (other > own) {
+        std::lock_guard<SharedMutex> guard(getLock(other));
+        unlocked_migrateOldBucket(oldBucket, own, other);
+        return true;
+    }
 
-            // And re-link it into the correct place in newValues.
-            int newBucket = getBucketForHash(v->getKey().hash());
-            v->setNext(std::move(newValues[newBucket]));
-            newValues[newBucket] = std::move(v);
+    std::unique_lock<SharedMutex> lh(getLock(other), std::try_to_lock);
+    if (!lh) {
+        // Acquire the locks in order
+        const size_t currentSize = size;
+        const size_t currentOldSize = oldSize;
+        hbl.getHTLock().unlock();
+        lh.lock();
+        hbl.getHTLock().lock();
+        if (oldSize == 0) {
+            // The resize completed while we waited
+            return size == currentSize;
+        }
+        if (size != currentSize || oldSize != currentOldSize) {
+            return false;
         }
     }
 
-    // Finally assign the new table to values.
-    values = std::move(newValues);
+    unlocked_migrateOldBucket(oldBucket, own, other);
+    return true;
+}
 
-    stats.memOverhead->fetch_add(memorySize());
+void HashTable::unlocked_migrateOldBucket(size_t oldBucket,
+                                          size_t lockA,
+                                          size_t lockB) {
+    StoredValue::UniquePtr* curr = &oldValues[oldBucket];
+    while (*curr) {
+        const uint32_t hash = curr->get()->getKey().hash();
+        const int newBucket = getBucketForHash(hash);
+        const size_t lock = mutexForBucket(newBucket);
+        if (lock == lockA || lock == lockB) {
+            // unlink the element from the old hash chain, and re-link it
+            // into the correct place in values.
+            auto v = std::move(*curr);
+            *curr = std::move(v->getNext());
+            v->setNext(std::move(values[newBucket]));
+            values[newBucket] = std::move(v);
+            unlocked_addTag(newBucket, values[newBucket].get(), hash);
+        } else {
+            curr = &curr->get()->getNext();
+        }
+    }
+}
+
+void HashTable::migrateOldBucket(size_t oldBucket) {
+    const size_t own = mutexForBucket(oldBucket);
+    while (true) {
+        std::unique_lock<SharedMutex> lh(getLock(own));
+        unlocked_migrateOldBucket(oldBucket, own, own);
+
+        // The rest belong to hash buckets guarded by other locks. Nothing is
+        // ever added to the old table, so we make progress for every lock
+        // we acquire.
+        const auto& chain = oldValues[oldBucket];
+        if (!chain) {
+            return;
+        }
+
+        const size_t other =
+                mutexForBucket(getBucketForHash(chain->getKey().hash()));
+        if (other > own) {
+            std::lock_guard<SharedMutex> guard(getLock(other));
+            unlocked_migrateOldBucket(oldBucket, own, other);
+        } else {
+            lh.unlock();
+            std::lock_guard<SharedMutex> guard(getLock(other));
+            lh.lock();
+            unlocked_migrateOldBucket(oldBucket, other, own);
+        }
+    }
+}
+
+void HashTable::waitForResize(std::unique_lock<SharedMutex>& lh) {
+    while (oldSize != 0) {
+        lh.unlock();
+        {
+            // The resizer holds the mutex until it's done
+            std::lock_guard<std::mutex> guard(resizeMutex);
+        }
+        lh.lock();
+    }
+}
+
+HashTable::SharedHashBucketLock HashTable::getSharedLockedBucket(
+        const DocKey& key) {
+    if (!isActive()) {
+        throw std::logic_error(
+                "HashTable::getSharedLockedBucket: Cannot call on a "
+                "non-active object");
+    }
+    const int h = key.hash();
+    while (oldSize == 0) {
+        int bucket = getBucketForHash(h);
+        const size_t lock = mutexForBucket(bucket);
+        SharedHashBucketLock rv(bucket, getLock(lock));
+        // size, oldSize and numLocks only change while holding all of the
+        // locks
+        if (bucket == getBucketForHash(h) && lock == mutexForBucket(bucket) &&
+            oldSize == 0) {
+            return rv;
+        }
+    }
+    return SharedHashBucketLock();
 }
 
 StoredValue* HashTable::find(const DocKey& key,
@@ -270,7 +685,7 @@ MutationStatus HashTable::set(Item& val) {
 }
 
 MutationStatus HashTable::unlocked_updateStoredValue(
-        const std::unique_lock<std::mutex>& htLock,
+        const std::unique_lock<SharedMutex>& htLock,
         StoredValue& v,
         const Item& itm) {
     if (!htLock) {
@@ -287,6 +702,9 @@ MutationStatus HashTable::unlocked_updateStoredValue(
 
     MutationStatus status =
             v.isDirty() ? MutationStatus::WasDirty : MutationStatus::WasClean;
+    if (!v.isResident() || v.isDeleted() != itm.isDeleted()) {
+        ++numResidentSetChanges;
+    }
     if (!v.isResident() && !v.isDeleted() && !v.isTempItem()) {
         decrNumNonResidentItems();
     }
@@ -314,7 +732,10 @@ MutationStatus HashTable::unlocked_updateStoredValue(
     }
 
     /* setValue() will mark v as undeleted if required */
+    const time_t oldExptime =
+            (v.isDeleted() || v.isTempItem()) ? 0 : v.getExptime();
     setValue(itm, v);
+    noteExpiryChange(v, oldExptime);
 
     return status;
 }
@@ -337,6 +758,7 @@ StoredValue* HashTable::unlocked_addNewStoredValue(const HashBucketLock& hbl,
     auto v = (*valFact)(itm, std::move(values[hbl.getBucketNum()]));
     increaseMetaDataSize(stats, v->metaDataSize());
     increaseCacheSize(v->size());
+    ++numResidentSetChanges;
 
     if (v->isTempItem()) {
         ++numTempItems;
@@ -350,6 +772,10 @@ StoredValue* HashTable::unlocked_addNewStoredValue(const HashBucketLock& hbl,
         ++datatypeCounts[v->getDatatype()];
     }
     values[hbl.getBucketNum()] = std::move(v);
+    unlocked_addTag(hbl.getBucketNum(),
+                    values[hbl.getBucketNum()].get(),
+                    itm.getKey().hash());
+    noteExpiryChange(*values[hbl.getBucketNum()], 0);
 
     return values[hbl.getBucketNum()].get();
 }
@@ -390,17 +816,59 @@ HashTable::unlocked_replaceByCopy(const HashBucketLock& hbl,
         ++datatypeCounts[newSv->getDatatype()];
     }
     values[hbl.getBucketNum()] = std::move(newSv);
+    unlocked_addTag(hbl.getBucketNum(),
+                    values[hbl.getBucketNum()].get(),
+                    vToCopy.getKey().hash());
 
     return {values[hbl.getBucketNum()].get(), std::move(releasedSv)};
 }
 
-void HashTable::unlocked_softDelete(const std::unique_lock<std::mutex>& htLock,
+std::pair<StoredValue*, StoredValue::UniquePtr> HashTable::unlocked_relocate(
+        const HashBucketLock& hbl, StoredValue& v) {
+    if (!hbl.getHTLock()) {
+        throw std::invalid_argument(
+                "HashTable::unlocked_relocate: htLock not held");
+    }
+
+    if (!isActive()) {
+        throw std::logic_error(
+                "HashTable::unlocked_relocate: Cannot call on a "
+                "non-active HT object");
+    }
+
+    // Find the link to the StoredValue
+    StoredValue::UniquePtr* link = &values[hbl.getBucketNum()];
+    while (*link && link->get() != &v) {
+        link = &(*link)->getNext();
+    }
+    if (!*link) {
+        throw std::logic_error(
+                "HashTable::unlocked_relocate: StoredValue not found in "
+                "its hash bucket");
+    }
+
+    // The copy takes over the rest of the chain. The sizes and counts of
+    // the table don't change.
+    auto newSv = valFact->copyStoredValue(v, std::move(v.getNext()));
+    auto released = std::move(*link);
+    *link = std::move(newSv);
+
+    // The tags refer to the StoredValues by address
+    if (layout == BucketLayout::Tagged) {
+        unlocked_rebuildTags(hbl.getBucketNum());
+    }
+
+    return {link->get(), std::move(released)};
+}
+
+void HashTable::unlocked_softDelete(const std::unique_lock<SharedMutex>& htLock,
                                     StoredValue& v,
                                     bool onlyMarkDeleted) {
     const bool alreadyDeleted = v.isDeleted();
     if (!v.isResident() && !v.isDeleted() && !v.isTempItem()) {
         decrNumNonResidentItems();
     }
+    ++numResidentSetChanges;
 
     if (!alreadyDeleted) {
         --datatypeCounts[v.getDatatype()];
@@ -428,16 +896,48 @@ StoredValue* HashTable::unlocked_find(const DocKey& key,
                                       int bucket_num,
                                       WantsDeleted wantsDeleted,
                                       TrackReference trackReference) {
+    StoredValue* v = (layout == BucketLayout::Tagged)
+                             ? unlocked_findTagged(key, bucket_num)
+                             : unlocked_findInChain(key, bucket_num);
+    if (v) {
+        if (trackReference == TrackReference::Yes && !v->isDeleted()) {
+            v->referenced();
+            if (frequencySketch) {
+                v->incrFreqCounterValue();
+                frequencySketch->increment(key.hash());
+            }
+        }
+        if (wantsDeleted == WantsDeleted::Yes || !v->isDeleted()) {
+            return v;
+        }
+    }
+    return NULL;
+}
+
+StoredValue* HashTable::unlocked_findInChain(const DocKey& key,
+                                             int bucket_num) {
     for (StoredValue* v = values[bucket_num].get(); v; v = v->getNext().get()) {
         if (v->hasKey(key)) {
-            if (trackReference == TrackReference::Yes && !v->isDeleted()) {
-                v->referenced();
-            }
-            if (wantsDeleted == WantsDeleted::Yes || !v->isDeleted()) {
-                return v;
-            } else {
-                return NULL;
-            }
+            return v;
+        }
+    }
+    return NULL;
+}
+
+StoredValue* HashTable::unlocked_findTagged(const DocKey& key,
+                                            int bucket_num) {
+    const auto& tb = tagTable[bucket_num];
+    if (tb.count == TagBucket::Overflow) {
+        return unlocked_findInChain(key, bucket_num);
+    }
+
+    const uint64_t matches = tb.match(getTag(key.hash()));
+    if (matches == 0) {
+        return NULL;
+    }
+    for (int i = 0; i < tb.count; ++i) {
+        if (((matches >> (8 * i)) & 0x80) && tb.values[i]->hasKey(key)) {
+            return tb.values[i];
         }
     }
     return NULL;
@@ -473,6 +973,8 @@ StoredValue::UniquePtr HashTable::unlocked_release(
                 "HashTable::unlocked_release: StoredValue to be released "
                 "not found in HashTable; possibly HashTable leak");
     }
+    unlocked_removeTag(hbl.getBucketNum(), released.get());
+    ++numResidentSetChanges;
 
     // Update statistics now the item has been removed.
     reduceCacheSize(released->size());
@@ -503,16 +1005,18 @@ void HashTable::visit(HashTableVisitor &visitor) {
     // Acquire one (any) of the mutexes before incrementing {visitors}, this
     // prevents any race between this visitor and the HashTable resizer.
     // See comments in pauseResumeVisit() for further details.
-    std::unique_lock<std::mutex> lh(mutexes[0]);
+    std::unique_lock<SharedMutex> lh(getLock(0));
+    waitForResize(lh);
     VisitorTracker vt(&visitors);
     lh.unlock();
 
     size_t visited = 0;
-    for (int l = 0; isActive() && l < static_cast<int>(mutexes.size()); l++) {
-        for (int i = l; i < static_cast<int>(size); i+= mutexes.size()) {
+    const int locks = static_cast<int>(numLocks);
+    for (int l = 0; isActive() && l < locks; l++) {
+        for (int i = l; i < static_cast<int>(size); i += locks) {
             // (re)acquire mutex on each HashBucket, to minimise any impact
             // on front-end threads.
-            HashBucketLock lh(i, mutexes[l]);
+            HashBucketLock lh(i, lockStripe(l));
 
             StoredValue* v = values[i].get();
             if (v) {
@@ -542,11 +1046,15 @@ void HashTable::visitDepth(HashTableDepthVisitor &visitor) {
         return;
     }
     size_t visited = 0;
+    std::unique_lock<SharedMutex> guard(getLock(0));
+    waitForResize(guard);
     VisitorTracker vt(&visitors);
+    guard.unlock();
 
-    for (int l = 0; l < static_cast<int>(mutexes.size()); l++) {
-        LockHolder lh(mutexes[l]);
-        for (int i = l; i < static_cast<int>(size); i+= mutexes.size()) {
+    const int locks = static_cast<int>(numLocks);
+    for (int l = 0; l < locks; l++) {
+        std::lock_guard<SharedMutex> lh(getLock(l));
+        for (int i = l; i < static_cast<int>(size); i += locks) {
             size_t depth = 0;
             StoredValue* p = values[i].get();
             if (p) {
@@ -593,15 +1101,19 @@ HashTable::Position HashTable::pauseResumeVisit(HashTableVisitor& visitor,
     // inside the inner for() loop. To prevent this race, we explicitly acquire
     // (any) mutex, increment {visitors} and then release the mutex. This
     //avoids the race as if visitors >0 then Resizer will not attempt to resize.
-    std::unique_lock<std::mutex> lh(mutexes[0]);
+    // If a resize is already in progress we wait for it to complete, as we
+    // wouldn't see the records which haven't been moved to the new table.
+    std::unique_lock<SharedMutex> lh(getLock(0));
+    waitForResize(lh);
     VisitorTracker vt(&visitors);
     lh.unlock();
 
     // Start from the requested lock number if in range.
-    size_t lock = (start_pos.lock < mutexes.size()) ? start_pos.lock : 0;
+    const size_t locks = numLocks;
+    size_t lock = (start_pos.lock < locks) ? start_pos.lock : 0;
     size_t hash_bucket = 0;
 
-    for (; isActive() && !paused && lock < mutexes.size(); lock++) {
+    for (; isActive() && !paused && lock < locks; lock++) {
 
         // If the bucket position is *this* lock, then start from the
         // recorded bucket (as long as we haven't resized).
@@ -615,8 +1127,8 @@ HashTable::Position HashTable::pauseResumeVisit(HashTableVisitor& visitor,
         // Iterate across all values in the hash buckets owned by this lock.
         // Note: we don't record how far into the bucket linked-list we
         // pause at; so any restart will begin from the next bucket.
-        for (; !paused && hash_bucket < size; hash_bucket += mutexes.size()) {
-            HashBucketLock lh(hash_bucket, mutexes[lock]);
+        for (; !paused && hash_bucket < size; hash_bucket += locks) {
+            HashBucketLock lh(hash_bucket, lockStripe(lock));
 
             StoredValue* v = values[hash_bucket].get();
             while (!paused && v) {
@@ -643,7 +1155,7 @@ HashTable::Position HashTable::pauseResumeVisit(HashTableVisitor& visitor,
 }
 
 HashTable::Position HashTable::endPosition() const  {
-    return HashTable::Position(size, mutexes.size(), size);
+    return HashTable::Position(size, numLocks, size);
 }
 
 bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
@@ -655,10 +1167,14 @@ bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
     if (policy == VALUE_ONLY) {
         if (vptr->eligibleForEviction(policy)) {
             reduceCacheSize(vptr->valuelen());
+            // Ejecting a value compressed in memory restores its datatype
+            --datatypeCounts[vptr->getDatatype()];
             vptr->ejectValue();
+            ++datatypeCounts[vptr->getDatatype()];
             ++stats.numValueEjects;
             ++numNonResidentItems;
             ++numEjects;
+            ++numResidentSetChanges;
             return true;
         } else {
             ++stats.numFailedEjects;
@@ -674,6 +1190,7 @@ bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
             auto removed = hashChainRemoveFirst(
                     values[bucket_num],
                     [vptr](const StoredValue* v) { return v == vptr; });
+            unlocked_removeTag(bucket_num, removed.get());
 
             if (removed->isResident()) {
                 ++stats.numValueEjects;
@@ -685,6 +1202,7 @@ bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
             decrNumItems(); // Decrement because the item is fully evicted.
             --datatypeCounts[vptr->getDatatype()];
             ++numEjects;
+            ++numResidentSetChanges;
             updateMaxDeletedRevSeqno(vptr->getRevSeqno());
 
             return true;
@@ -707,7 +1225,7 @@ std::unique_ptr<Item> HashTable::getRandomKeyFromSlot(int slot) {
 }
 
 bool HashTable::unlocked_restoreValue(
-        const std::unique_lock<std::mutex>& htLock,
+        const std::unique_lock<SharedMutex>& htLock,
         const Item& itm,
         StoredValue& v) {
     if (!htLock || !isActive() || v.isResident()) {
@@ -726,12 +1244,76 @@ bool HashTable::unlocked_restoreValue(
     }
 
     v.restoreValue(itm);
+    ++numResidentSetChanges;
 
     increaseCacheSize(v.getValue()->valueSize());
     return true;
 }
 
-void HashTable::unlocked_restoreMeta(const std::unique_lock<std::mutex>& htLock,
+bool HashTable::unlocked_compressValue(
+        const std::unique_lock<SharedMutex>& htLock,
+        StoredValue& v,
+        float minCompressionRatio) {
+    if (!htLock || !isActive() || !v.isResident() || v.isDeleted() ||
+        v.isTempItem() || !v.getValue() || v.hasInlineValue()) {
+        return false;
+    }
+
+    const protocol_binary_datatype_t datatype = v.getDatatype();
+    if (mcbp::datatype::is_snappy(datatype) ||
+        mcbp::datatype::is_xattr(datatype)) {
+        return false;
+    }
+
+    // Held by a checkpoint (or an operation in flight); the original would
+    // stay around anyway
+    if (v.getValue().refCount() > 1) {
+        return false;
+    }
+
+    cb::compression::Buffer deflated;
+    if (!cb::compression::deflate(cb::compression::Algorithm::Snappy,
+                                  v.getValue()->getData(),
+                                  v.valuelen(),
+                                  deflated) ||
+        deflated.len > minCompressionRatio * v.valuelen()) {
+        return false;
+    }
+
+    replaceValueEncoding(
+            v,
+            value_t(Blob::New(deflated.data.get(), deflated.len)),
+            protocol_binary_datatype_t(datatype |
+                                       PROTOCOL_BINARY_DATATYPE_SNAPPY),
+            true);
+    return true;
+}
+
+bool HashTable::unlocked_inflateValue(
+        const std::unique_lock<SharedMutex>& htLock, StoredValue& v) {
+    if (!htLock || !isActive() || !v.isResident() ||
+        !v.isCompressedInMemory() || !v.getValue()) {
+        return false;
+    }
+
+    cb::compression::Buffer inflated;
+    if (!cb::compression::inflate(cb::compression::Algorithm::Snappy,
+                                  v.getValue()->getData(),
+                                  v.valuelen(),
+                                  inflated)) {
+        return false;
+    }
+
+    replaceValueEncoding(
+            v,
+            value_t(Blob::New(inflated.data.get(), inflated.len)),
+            protocol_binary_datatype_t(v.getDatatype() &
+                                       ~PROTOCOL_BINARY_DATATYPE_SNAPPY),
+            false);
+    return true;
+}
+
+void HashTable::unlocked_restoreMeta(const std::unique_lock<SharedMutex>& htLock,
                                      const Item& itm,
                                      StoredValue& v) {
     if (!htLock) {
@@ -753,6 +1335,18 @@ void HashTable::unlocked_restoreMeta(const std::unique_lock<std::mutex>& htLock,
         ++numNonResidentItems;
         ++datatypeCounts[v.getDatatype()];
     }
+    noteExpiryChange(v, 0);
+}
+
+void HashTable::replaceValueEncoding(StoredValue& v,
+                                     const value_t& value,
+                                     protocol_binary_datatype_t datatype,
+                                     bool compressed) {
+    --datatypeCounts[v.getDatatype()];
+    ++datatypeCounts[datatype];
+    reduceCacheSize(v.size());
+    v.replaceEncoding(value, datatype, compressed);
+    increaseCacheSize(v.size());
 }
 
 void HashTable::increaseCacheSize(size_t by) {
@@ -796,5 +1390,11 @@ std::ostream& operator<<(std::ostream& os, const HashTable& ht) {
             }
         }
     }
+    for (const auto& chain : ht.oldValues) {
+        for (StoredValue* sv = chain.get(); sv != nullptr;
+             sv = sv->getNext().get()) {
+            os << "    (resizing) " << *sv << std::endl;
+        }
+    }
     return os;
 }
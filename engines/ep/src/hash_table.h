@@ -18,16 +18,24 @@
 #pragma once
 
 #include "config.h"
+#include "expiry_index.h"
+#include "frequency_sketch.h"
+#include "instrumented_mutex.h"
+#include "locks.h"
 #include "storeddockey.h"
 #include "stored-value.h"
 
+#include <memcached/hugepages.h>
 #include <platform/histogram.h>
 #include <platform/non_negative_counter.h>
 
+#include <array>
+
 class AbstractStoredValueFactory;
 class HashTableStatVisitor;
 class HashTableVisitor;
 class HashTableDepthVisitor;
+class VisitorBudget;
 
 /**
  * Mutation types as returned by store commands.
@@ -69,9 +77,9 @@ enum class TempAddStatus : uint8_t {
  * StoredDocKeys to StoredValue.
  *
  * It supports a limited degree of concurrent access - the underlying
- * HashTable buckets are guarded by N ht_locks; where N is typically of the
- * order of the number of CPUs. Essentially ht bucket B is guarded by
- * mutex B mod N.
+ * HashTable buckets are guarded by N locks; where N starts at ht_locks
+ * (rounded up to a power of two) and doubles as the table grows, up to
+ * ht_max_locks. Essentially ht bucket B is guarded by mutex B mod N.
  *
  * StoredValue objects can have their value (Blob object) ejected, making the
  * value non-resident. Such StoredValues are still in the HashTable, and their
@@ -91,10 +99,45 @@ enum class TempAddStatus : uint8_t {
  * period of time - until the deletion is recorded on disk by the Flusher, at
  * which point they are removed from the HashTable by PersistenceCallback (we
  * don't want to unnecessarily spend memory on items which have been deleted).
+ *
+ * The HashTable is resized incrementally so that front-end operations aren't
+ * blocked while the StoredValues are rehashed: a resize swaps in the new
+ * bucket array (holding all locks only for the swap), and keeps the old one
+ * around until all StoredValues have been moved over. The resizer moves the
+ * StoredValues one old hash bucket at a time (holding the lock of the old
+ * bucket and the lock of the destination), and a front-end operation moves
+ * the StoredValues for its key the first time it locks the key's bucket (see
+ * getLockedBucketForHash). Once a HashBucketLock is held the key is always
+ * found in the new bucket array, so the rest of the HashTable doesn't need
+ * to know about the old one.
+ *
+ * The locks of the hash buckets are reader/writer locks. Anything which may
+ * modify a hash bucket (or the StoredValues in it) takes exclusive access
+ * via a HashBucketLock, while lookups which only read the StoredValue they
+ * find may take shared access via a SharedHashBucketLock (see
+ * getSharedLockedBucket) so that readers of the same (hot) keys don't
+ * serialise on each other.
+ *
+ * With BucketLayout::Tagged every hash bucket also has a cache line sized
+ * index holding a 1-byte tag (derived from the hash of the key) and a
+ * pointer for each StoredValue in the chain. A lookup compares the tags of
+ * the bucket in one go and only looks at the StoredValues whose tag match,
+ * instead of chasing (and comparing the key of) every StoredValue in the
+ * chain.
  */
 class HashTable {
 public:
 
+    /**
+     * The layout of the hash buckets
+     */
+    enum class BucketLayout : uint8_t {
+        /// The buckets only hold the head of the chain of StoredValues
+        Chained,
+        /// The buckets also have an index of tags (see TagBucket)
+        Tagged
+    };
+
     /**
      * Represents a position within the hashtable.
      *
@@ -145,10 +188,14 @@ public:
         HashBucketLock()
             : bucketNum(-1) {}
 
-        HashBucketLock(int bucketNum, std::mutex& mutex)
+        HashBucketLock(int bucketNum, SharedMutex& mutex)
             : bucketNum(bucketNum), htLock(mutex) {
         }
 
+        HashBucketLock(int bucketNum, std::unique_lock<SharedMutex>&& lock)
+            : bucketNum(bucketNum), htLock(std::move(lock)) {
+        }
+
         HashBucketLock(HashBucketLock&& other)
             : bucketNum(other.bucketNum), htLock(std::move(other.htLock)) {
         }
@@ -159,17 +206,61 @@ public:
             return bucketNum;
         }
 
-        const std::unique_lock<std::mutex>& getHTLock() const {
+        const std::unique_lock<SharedMutex>& getHTLock() const {
             return htLock;
         }
 
-        std::unique_lock<std::mutex>& getHTLock() {
+        std::unique_lock<SharedMutex>& getHTLock() {
             return htLock;
         }
 
     private:
         int bucketNum;
-        std::unique_lock<std::mutex> htLock;
+        std::unique_lock<SharedMutex> htLock;
+    };
+
+    /**
+     * Represents a hash bucket locked for shared access. The holder may
+     * look up (and read) the StoredValues in the bucket, but must not modify
+     * them (nor the bucket); anything else needs a HashBucketLock.
+     *
+     * A default constructed SharedHashBucketLock doesn't hold any lock.
+     */
+    class SharedHashBucketLock {
+    public:
+        SharedHashBucketLock() : bucketNum(-1), mutex(nullptr) {
+        }
+
+        SharedHashBucketLock(int bucketNum, SharedMutex& mutex)
+            : bucketNum(bucketNum), mutex(&mutex) {
+            mutex.lock_shared();
+        }
+
+        SharedHashBucketLock(SharedHashBucketLock&& other)
+            : bucketNum(other.bucketNum), mutex(other.mutex) {
+            other.mutex = nullptr;
+        }
+
+        SharedHashBucketLock(const SharedHashBucketLock& other) = delete;
+
+        ~SharedHashBucketLock() {
+            if (mutex) {
+                mutex->unlock_shared();
+            }
+        }
+
+        int getBucketNum() const {
+            return bucketNum;
+        }
+
+        /// @return true if the lock is held
+        explicit operator bool() const {
+            return mutex != nullptr;
+        }
+
+    private:
+        int bucketNum;
+        SharedMutex* mutex;
     };
 
     /**
@@ -178,19 +269,32 @@ public:
      * @param st the global stats reference
      * @param svFactory Factory to use for constructing stored values
      * @param initialSize the number of hash table buckets to initially create.
-     * @param locks the number of locks in the hash table
+     * @param locks the initial number of locks in the hash table (rounded
+     *              up to a power of two)
+     * @param layout the layout of the hash buckets
+     * @param maxLocks the number of locks the hash table may grow to as it
+     *                 is resized (rounded down to a power of two, and 0 to
+     *                 keep the initial number)
+     * @param hugePages true if the arrays of hash buckets should be backed
+     *                  by transparent huge pages (when they're big enough)
      */
     HashTable(EPStats& st,
               std::unique_ptr<AbstractStoredValueFactory> svFactory,
               size_t initialSize,
-              size_t locks);
+              size_t locks,
+              BucketLayout layout = BucketLayout::Chained,
+              size_t maxLocks = 0,
+              bool hugePages = false);
 
     ~HashTable();
 
     size_t memorySize() {
         return sizeof(HashTable)
-            + (size * sizeof(StoredValue*))
-            + (mutexes.size() * sizeof(std::mutex));
+            + ((size + oldSize) * sizeof(StoredValue*))
+            + tagTable.memorySize()
+            + (numLocks * sizeof(SharedMutex))
+            + (frequencySketch ? frequencySketch->memorySize() : 0)
+            + (expiryIndex ? expiryIndex->memorySize() : 0);
     }
 
     /**
@@ -201,7 +305,103 @@ public:
     /**
      * Get the number of locks in this hash table.
      */
-    size_t getNumLocks(void) { return mutexes.size(); }
+    size_t getNumLocks(void) { return numLocks; }
+
+    /**
+     * Get the number of times a hash bucket lock had to be waited for
+     * (as another thread held it).
+     */
+    size_t getNumLockWaits() const {
+        return numLockWaits;
+    }
+
+    BucketLayout getBucketLayout() const {
+        return layout;
+    }
+
+    /**
+     * Track the access frequency of the items (for the frequency based
+     * eviction) in addition to the NRU value: every referenced access
+     * increments the frequency counter of the StoredValue, and is counted
+     * in a FrequencySketch (which remembers the keys after their
+     * StoredValues are gone).
+     *
+     * Must be called before the hash table is used.
+     *
+     * @param sketchWidth the number of counters in each row of the sketch
+     */
+    void enableFrequencyTracking(size_t sketchWidth = 2048);
+
+    bool isFrequencyTracking() const {
+        return frequencySketch != nullptr;
+    }
+
+    /**
+     * Get the access frequency of the given item; the larger of its own
+     * counter and the estimate of the sketch.
+     */
+    uint8_t getFrequency(const StoredValue& v) const;
+
+    /**
+     * Track a reference to the given item made while holding shared access
+     * to its hash bucket, which doesn't allow us to modify the item.
+     *
+     * @return false if tracking the reference requires modifying the item
+     *         (its NRU value or frequency counter); the caller should retry
+     *         with exclusive access to the bucket
+     */
+    bool trackSharedReference(const StoredValue& v);
+
+    /**
+     * Keep a TTL index of the items (see ExpiryIndex), so that the expired
+     * items may be found without visiting all of the hash table. The items
+     * are added to it as they are stored (or their expiry time is changed
+     * through noteExpiryChange).
+     *
+     * Must be called before the hash table is used.
+     *
+     * @param granularity the length (in seconds) of each slot of the index
+     */
+    void enableExpiryIndex(
+            size_t granularity = ExpiryIndex::DefaultGranularity);
+
+    bool hasExpiryIndex() const {
+        return expiryIndex != nullptr;
+    }
+
+    /// Get the number of entries in the TTL index (0 if there is none)
+    size_t getExpiryIndexSize() const {
+        return expiryIndex ? expiryIndex->size() : 0;
+    }
+
+    /**
+     * Update the TTL index after changing the expiry time of the given
+     * item other than through the methods of the hash table (such as by
+     * touch). The hash bucket of the item must be locked.
+     *
+     * @param v the item (with its new expiry time)
+     * @param oldExptime the expiry time the item had before
+     */
+    void noteExpiryChange(const StoredValue& v, time_t oldExptime);
+
+    /**
+     * Visit the items which may have expired as of the given time (the
+     * items of the keys which are due in the TTL index, see
+     * ExpiryIndex::takeDue).
+     *
+     * The visitor may also be handed items which haven't expired (such as
+     * items which had their expiry time changed).
+     *
+     * @return the number of keys visited
+     */
+    size_t visitExpiring(HashTableVisitor& visitor, time_t now);
+
+    /**
+     * Get the layout with the given name ("chained" or "tagged")
+     *
+     * @throws std::invalid_argument for unknown layouts
+     */
+    static BucketLayout parseBucketLayout(const std::string& name);
 
     /**
      * Get the number of in-memory non-resident and resident items within
@@ -264,6 +464,16 @@ public:
      */
     size_t getNumEjects(void) { return numEjects; }
 
+    /**
+     * Get the number of changes to the set of resident items of this hash
+     * table (items added, removed, ejected or restored). The AccessScanner
+     * compares it across runs to find the vbuckets whose resident set didn't
+     * change.
+     */
+    size_t getNumResidentSetChanges() const {
+        return numResidentSetChanges;
+    }
+
     /**
      * Get the total item memory size in this hash table.
      */
@@ -276,11 +486,32 @@ public:
      */
     void clear(bool deactivate = false);
 
+    /**
+     * Free the items of a hash table nobody else uses any more (as its
+     * VBucket is being deleted) until the budget of the run is spent, so
+     * that freeing a large hash table doesn't hold a thread for long.
+     * Deactivates the hash table; takes no locks.
+     *
+     * @param budget counts each freed item
+     * @param position [in,out] the hash bucket to continue from (0 for the
+     *        first run)
+     * @return true once all the items are freed
+     */
+    bool clearWithinBudget(VisitorBudget& budget, size_t& position);
+
     /**
      * Get the number of times this hash table has been resized.
      */
     size_t getNumResizes() { return numResizes; }
 
+    /**
+     * Get the number of bytes of the arrays of hash buckets which are
+     * advised to be backed by huge pages
+     */
+    size_t getHugePageBytes() const {
+        return hugePageBytes;
+    }
+
     /**
      * Get the number of temp. items within this hash table.
      */
@@ -294,7 +525,9 @@ public:
     void resize();
 
     /**
-     * Resize to the specified size.
+     * Resize to the specified size. The StoredValues are moved over to the
+     * new bucket array a hash bucket at a time (see the class description),
+     * so front-end operations may run while we're resizing.
      */
     void resize(size_t to);
 
@@ -348,7 +581,7 @@ public:
      * @return Result indicating the status of the operation
      */
     MutationStatus unlocked_updateStoredValue(
-            const std::unique_lock<std::mutex>& htLock,
+            const std::unique_lock<SharedMutex>& htLock,
             StoredValue& v,
             const Item& itm);
 
@@ -383,6 +616,22 @@ public:
      */
     std::pair<StoredValue*, StoredValue::UniquePtr> unlocked_replaceByCopy(
             const HashBucketLock& hbl, const StoredValue& vToCopy);
+
+    /**
+     * Move a StoredValue to a new allocation (for the defragmenter): replace
+     * it with a copy at the same position of the hash bucket chain, and
+     * release the ownership of the original (which the caller should
+     * free, once nothing refers to it).
+     * Assumes that HT bucket lock is grabbed.
+     *
+     * @param hbl Hash table bucket lock that must be held.
+     * @param v StoredValue to be moved.
+     *
+     * @return Ptr of the copy of the StoredValue (owned by the hash table).
+     *         UniquePtr to the original StoredValue.
+     */
+    std::pair<StoredValue*, StoredValue::UniquePtr> unlocked_relocate(
+            const HashBucketLock& hbl, StoredValue& v);
     /**
      * Logically (soft) delete the item in ht
      * Assumes that HT bucket lock is grabbed.
@@ -393,7 +642,7 @@ public:
      * @param onlyMarkDeleted indicates if we must reset the StoredValue or
      *                        just mark deleted
      */
-    void unlocked_softDelete(const std::unique_lock<std::mutex>& htLock,
+    void unlocked_softDelete(const std::unique_lock<SharedMutex>& htLock,
                              StoredValue& v,
                              bool onlyMarkDeleted);
 
@@ -419,12 +668,13 @@ public:
      * @return HashBucektLock which contains a lock and the hash bucket number
      */
     inline HashBucketLock getLockedBucket(int bucket) {
-        return HashBucketLock(bucket, mutexes[mutexForBucket(bucket)]);
+        return HashBucketLock(bucket, lockStripe(mutexForBucket(bucket)));
     }
 
     /**
      * Get a lock holder holding a lock for the bucket for the given
-     * hash.
+     * hash. If a resize is in progress, the StoredValues for the hash are
+     * moved over from the old bucket array before we return.
      *
      * @param h the input hash
      * @return HashBucketLock which contains a lock and the hash bucket number
@@ -436,8 +686,13 @@ public:
                         "Cannot call on a non-active object");
             }
             int bucket = getBucketForHash(h);
-            HashBucketLock rv(bucket, mutexes[mutexForBucket(bucket)]);
-            if (bucket == getBucketForHash(h)) {
+            const size_t lock = mutexForBucket(bucket);
+            HashBucketLock rv(bucket, lockStripe(lock));
+            // The size and number of locks only change while holding all of
+            // the locks
+            if (bucket == getBucketForHash(h) &&
+                lock == mutexForBucket(bucket) &&
+                (oldSize == 0 || unlocked_migrateForHash(rv, h))) {
                 return rv;
             }
         }
@@ -458,6 +713,21 @@ public:
         return getLockedBucketForHash(key.hash());
     }
 
+    /**
+     * Get a lock holder holding shared access to the bucket for the hash
+     * of the given key.
+     *
+     * While a resize is in progress the StoredValues for the key may still
+     * be in the old bucket array, and moving them requires exclusive
+     * access. We don't lock anything in that case, and the caller should
+     * use getLockedBucket instead.
+     *
+     * @param key the key
+     * @return SharedHashBucketLock which contains the lock and the hash
+     *         bucket number (or holds no lock if a resize is in progress)
+     */
+    SharedHashBucketLock getSharedLockedBucket(const DocKey& key);
+
     /**
      * Delete a key from the cache without trying to lock the cache first
      * (Please note that you <b>MUST</b> acquire the mutex before calling
@@ -566,10 +836,43 @@ public:
      *
      * @return true if restored; else false
      */
-    bool unlocked_restoreValue(const std::unique_lock<std::mutex>& htLock,
+    bool unlocked_restoreValue(const std::unique_lock<SharedMutex>& htLock,
                                const Item& itm,
                                StoredValue& v);
 
+    /**
+     * Compress the value of the item in place (for the ItemCompressor),
+     * to keep more documents resident in the same memory. Only done for a
+     * resident document whose value isn't already compressed, has no
+     * XATTRs (which the engine reads from the value), isn't embedded in
+     * the StoredValue and isn't referenced by anyone else (as its memory
+     * wouldn't be freed). The value is marked as compressed by the engine
+     * (see StoredValue::isCompressedInMemory) so it can be inflated again.
+     * Assumes that HT bucket lock is grabbed.
+     *
+     * @param htLock Hash table lock that must be held
+     * @param v the StoredValue to compress
+     * @param minCompressionRatio the largest size of the compressed value
+     *        relative to the original for which it's worth keeping it
+     *
+     * @return true if the value was compressed
+     */
+    bool unlocked_compressValue(const std::unique_lock<SharedMutex>& htLock,
+                                StoredValue& v,
+                                float minCompressionRatio);
+
+    /**
+     * Inflate the value of the item if unlocked_compressValue compressed
+     * it. Assumes that HT bucket lock is grabbed.
+     *
+     * @param htLock Hash table lock that must be held
+     * @param v the StoredValue to inflate
+     *
+     * @return true if the value was inflated
+     */
+    bool unlocked_inflateValue(const std::unique_lock<SharedMutex>& htLock,
+                               StoredValue& v);
+
     /**
      * Restore the metadata of of a temporary item upon completion of a
      * background fetch.
@@ -579,7 +882,7 @@ public:
      * @param itm the Item whose metadata is being restored
      * @param v corresponding StoredValue
      */
-    void unlocked_restoreMeta(const std::unique_lock<std::mutex>& htLock,
+    void unlocked_restoreMeta(const std::unique_lock<SharedMutex>& htLock,
                               const Item& itm,
                               StoredValue& v);
 
@@ -618,6 +921,8 @@ public:
             datatypeCounts;
 
     std::atomic<size_t>       numEjects;
+    //! Number of changes to the set of resident items.
+    std::atomic<size_t>       numResidentSetChanges;
     //! Memory consumed by items in this hashtable.
     std::atomic<size_t>       memSize;
     //! Cache size.
@@ -627,7 +932,89 @@ public:
 
 private:
     // The container for actually holding the StoredValues.
-    using table_type = std::vector<StoredValue::UniquePtr>;
+    using table_type =
+            std::vector<StoredValue::UniquePtr,
+                        cb::hugepages::Allocator<StoredValue::UniquePtr>>;
+
+    /**
+     * The index of a hash bucket for BucketLayout::Tagged; it fills a cache
+     * line and has a tag and a pointer for each of the StoredValues in the
+     * chain. Chains longer than Entries are marked as Overflow and must be
+     * walked.
+     */
+    struct TagBucket {
+        static const uint8_t Entries = 7;
+        static const uint8_t Overflow = 0xff;
+
+        /**
+         * Compare the tag with all of the tags in the bucket (in one go).
+         *
+         * @return the high bit of byte N is set if entry N has the tag
+         */
+        uint64_t match(uint8_t tag) const;
+
+        void insert(uint8_t tag, StoredValue* sv);
+
+        /// @return false if the StoredValue wasn't in the index
+        bool erase(const StoredValue* sv);
+
+        // The tags are never 0, so unused entries never match
+        uint8_t tags[Entries];
+        uint8_t count;
+        StoredValue* values[Entries];
+    };
+
+    static_assert(sizeof(TagBucket) == 64,
+                  "HashTable::TagBucket should fill a cache line");
+
+    /**
+     * A cache line aligned array of TagBuckets (which is empty for the
+     * chained layout)
+     */
+    class TagTable {
+    public:
+        TagTable() = default;
+        explicit TagTable(size_t size);
+
+        TagBucket& operator[](size_t bucket) {
+            return buckets[bucket];
+        }
+
+        void clear();
+
+        size_t memorySize() const {
+            return (size == 0) ? 0 : (size + 1) * sizeof(TagBucket);
+        }
+
+    private:
+        std::unique_ptr<char[]> memory;
+        TagBucket* buckets = nullptr;
+        size_t size = 0;
+    };
+
+    /// Get the tag used in the TagBuckets for the given hash
+    static uint8_t getTag(uint32_t hash) {
+        return uint8_t(0x80 | ((hash * 2654435761u) >> 25));
+    }
+
+    /// Index the StoredValue at the head of the chain in the bucket
+    void unlocked_addTag(int bucket_num, StoredValue* sv, uint32_t hash);
+
+    /// Remove the StoredValue (which was unlinked from the bucket) from
+    /// its index
+    void unlocked_removeTag(int bucket_num, const StoredValue* sv);
+
+    /// Build the index of the bucket from its chain
+    void unlocked_rebuildTags(int bucket_num);
+
+    /// Get the allocator for a new array of hash buckets
+    table_type::allocator_type getBucketAllocator() {
+        return table_type::allocator_type(hugePages ? &hugePageBytes
+                                                    : nullptr);
+    }
+
+    StoredValue* unlocked_findInChain(const DocKey& key, int bucket_num);
+    StoredValue* unlocked_findTagged(const DocKey& key, int bucket_num);
 
     friend class StoredValue;
     friend std::ostream& operator<<(std::ostream& os, const HashTable& ht);
@@ -641,8 +1028,35 @@ private:
     // The size of the hash table (number of buckets) - i.e. number of elements
     // in `values`
     std::atomic<size_t> size;
+    // Should the bucket arrays be backed by huge pages, and how many bytes
+    // of them are
+    const bool hugePages;
+    std::atomic<size_t> hugePageBytes;
     table_type values;
-    std::vector<std::mutex> mutexes;
+    const BucketLayout layout;
+    // The tags for the buckets in values (for BucketLayout::Tagged)
+    TagTable tagTable;
+    // The bucket array we're moving the StoredValues out of while a resize
+    // is in progress, and its size (0 when we're not resizing). They're only
+    // modified while holding resizeMutex and all of the mutexes.
+    std::atomic<size_t> oldSize;
+    table_type oldValues;
+    // The locks guarding the hash buckets, allocated in levels which are
+    // only freed with the table (so a lock never moves): level 0 holds the
+    // initial locks, and each further level as many as all of the levels
+    // before it. numLocks (a power of two) only grows, while holding all of
+    // the locks.
+    static const size_t maxLockLevels = 32;
+    std::array<std::unique_ptr<SharedMutex[]>, maxLockLevels> lockLevels;
+    const size_t initialLocks;
+    const size_t maxLocks;
+    // The number of buckets per lock the table had to begin with, which it
+    // keeps (within maxLocks) as it grows
+    const size_t bucketsPerLock;
+    std::atomic<size_t> numLocks;
+    std::atomic<size_t> numLockWaits;
+    // Serializes the resizes (and is held for the duration of a resize)
+    std::mutex resizeMutex;
     EPStats&             stats;
     std::unique_ptr<AbstractStoredValueFactory> valFact;
     std::atomic<size_t>       visitors;
@@ -650,19 +1064,124 @@ private:
     std::atomic<size_t>       numResizes;
     std::atomic<size_t>       numTempItems;
     bool                 activeState;
+    // Only set when tracking the access frequency of the items
+    std::unique_ptr<FrequencySketch> frequencySketch;
+    // Only set when keeping a TTL index of the items
+    std::unique_ptr<ExpiryIndex> expiryIndex;
 
     int getBucketForHash(int h) {
         return abs(h % static_cast<int>(size));
     }
 
+    int getOldBucketForHash(int h) {
+        return abs(h % static_cast<int>(oldSize));
+    }
+
+    /**
+     * Move the StoredValues for the given hash over from the old bucket array
+     * while a resize is in progress. The lock of the old hash bucket must be
+     * acquired before the lock of the new one if it's a lower numbered lock,
+     * and in that case we have to let go of the lock in hbl while waiting.
+     *
+     * @param hbl the lock of the hash bucket (in the new array) for h
+     * @param h the hash
+     * @return false if the table was resized while we didn't hold the lock
+     *         (and hbl isn't the right bucket anymore)
+     */
+    bool unlocked_migrateForHash(HashBucketLock& hbl, int h);
+
+    /**
+     * Move the StoredValues in the given old hash bucket whose new hash
+     * bucket is guarded by either of the given locks (which must be held,
+     * together with the lock of the old bucket).
+     */
+    void unlocked_migrateOldBucket(size_t oldBucket,
+                                   size_t lockA,
+                                   size_t lockB);
+
+    /**
+     * Move all of the StoredValues in the given old hash bucket over to the
+     * new bucket array, acquiring the locks as needed. Must be called
+     * with resizeMutex held.
+     */
+    void migrateOldBucket(size_t oldBucket);
+
+    /**
+     * The visitors can't see the StoredValues left in the old bucket array,
+     * so wait until any resize in progress is complete. Called with the
+     * lock used to register a visitor held.
+     */
+    void waitForResize(std::unique_lock<SharedMutex>& lh);
+
     inline size_t mutexForBucket(size_t bucket_num) {
         if (!isActive()) {
             throw std::logic_error("HashTable::mutexForBucket: Cannot call on a "
                     "non-active object");
         }
-        return bucket_num % mutexes.size();
+        return bucket_num & (numLocks - 1);
+    }
+
+    /// Get the given lock (which must be < numLocks)
+    SharedMutex& getLock(size_t lock) {
+        if (lock < initialLocks) {
+            return lockLevels[0][lock];
+        }
+        // Level n (> 0) holds the locks [initialLocks << (n - 1),
+        // initialLocks << n)
+        size_t level = 1;
+        size_t start = initialLocks;
+        while (lock >= start * 2) {
+            start *= 2;
+            ++level;
+        }
+        return lockLevels[level][lock - start];
     }
 
+    /**
+     * Acquire the given lock, counting the times we have to wait for it
+     * (and timing a sample of the waits in LockStats::hashTable, as the
+     * stripes aren't InstrumentedMutexes)
+     */
+    std::unique_lock<SharedMutex> lockStripe(size_t lock) {
+        std::unique_lock<SharedMutex> lh(getLock(lock), std::try_to_lock);
+        const bool sampled = LockStats::shouldSample();
+        if (!lh) {
+            ++numLockWaits;
+            const hrtime_t start = sampled ? gethrtime() : 0;
+            lh.lock();
+            if (sampled) {
+                LockStats::hashTable.recordWait(gethrtime() - start);
+            }
+        } else if (sampled) {
+            LockStats::hashTable.recordWait(0);
+        }
+        return lh;
+    }
+
+    /// Get the number of locks the table should have for the given size
+    size_t getNumLocksForSize(size_t newSize) const;
+
+    /**
+     * Holds all of the locks of the table (like a MultiLockHolder), and
+     * lets the resizer add more locks while it holds them.
+     */
+    class AllLocksHolder {
+    public:
+        explicit AllLocksHolder(HashTable& ht);
+
+        ~AllLocksHolder();
+
+        /// Double the number of locks of the table until it has n (with
+        /// the new locks held as well)
+        void grow(size_t n);
+
+    private:
+        HashTable& ht;
+        size_t held;
+
+        DISALLOW_COPY_AND_ASSIGN(AllLocksHolder);
+    };
+
     std::unique_ptr<Item> getRandomKeyFromSlot(int slot);
 
     /** Searches for the first element in the specified hashChain which matches
@@ -703,6 +1222,15 @@ private:
 
     void clear_UNLOCKED(bool deactivate);
 
+    /**
+     * Replace the value of the item with another encoding of it, keeping
+     * the memory and datatype stats up to date.
+     */
+    void replaceValueEncoding(StoredValue& v,
+                              const value_t& value,
+                              protocol_binary_datatype_t datatype,
+                              bool compressed);
+
     /**
      * Increase the size of the cache
      */
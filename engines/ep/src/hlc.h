@@ -18,6 +18,7 @@
 #pragma once
 
 #include <chrono>
+#include <time.h>
 
 #include "atomic.h"
 
@@ -78,7 +79,9 @@ public:
         // b) dropping 16-bits (done by nowHLC)
         // c) comparing it with the last known time (max_cas)
         // d) returning either now or max_cas + 1
-        uint64_t timeNow = getMasked48(getTime());
+        uint64_t timeNow = getMasked48(
+                coarseClock.load(std::memory_order_relaxed) ? getCoarseTime()
+                                                            : getTime());
         uint64_t l = maxHLC.load();
 
         if (timeNow > l) {
@@ -115,6 +118,16 @@ public:
         setMaxHLC(hlc);
     }
 
+    /*
+     * Generate the HLC from a coarse clock, which is cheaper to read but
+     * only advances every few milliseconds. The HLC stays monotonic (if
+     * the time didn't advance the logical clock ticks instead), and the
+     * drift tracking always uses the precise clock.
+     */
+    void setCoarseClock(bool value) {
+        coarseClock.store(value, std::memory_order_relaxed);
+    }
+
     void setMaxHLC(uint64_t hlc) {
         atomic_setIfBigger(maxHLC, hlc);
     }
@@ -182,6 +195,20 @@ private:
         return std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
     }
 
+    /*
+     * Returns the system time as kept by the kernel at the last timer tick
+     * (where available), which doesn't have to read the hardware clock
+     */
+    static int64_t getCoarseTime() {
+#ifdef CLOCK_REALTIME_COARSE
+        struct timespec ts;
+        if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+            return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+#endif
+        return getTime();
+    }
+
     /*
      * maxHLC tracks the current highest time, either our own or a peer who
      * has a larger clock value. nextHLC and setMax* methods change this and can
@@ -202,6 +229,9 @@ private:
     std::atomic<uint64_t> driftAheadThreshold;
     std::atomic<uint64_t> driftBehindThreshold;
 
+    /// Set if nextHLC should use the coarse clock
+    std::atomic<bool> coarseClock{false};
+
     /**
      * Documents with a seqno >= epochSeqno have a HLC generated CAS.
      */
@@ -0,0 +1,29 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "instrumented_mutex.h"
+
+std::atomic<uint32_t> LockStats::sampleRate{0};
+
+LockStats LockStats::hashTable("hash_table");
+LockStats LockStats::checkpointQueue("checkpoint_queue");
+LockStats LockStats::dcpConns("dcp_conns");
+LockStats LockStats::vbMap("vbucket_map");
+
+LockStats* const LockStats::all[] = {
+        &hashTable, &checkpointQueue, &dcpConns, &vbMap};
+const size_t LockStats::numLocks = sizeof(all) / sizeof(all[0]);
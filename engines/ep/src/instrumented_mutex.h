@@ -0,0 +1,236 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <platform/histogram.h>
+#include <platform/platform.h>
+#include <platform/rwlock.h>
+#include <relaxed_atomic.h>
+
+#include "utility.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * The contention stats of a class of locks (such as the queueLocks of all
+ * the CheckpointManagers), reported by "stats locks".
+ *
+ * Only one in sampleRate acquisitions (per thread) is timed, so that the
+ * instrumented locks cost no more than a thread_local counter when they
+ * aren't sampled; the sampling is off (sampleRate 0) unless it is enabled
+ * with the lock_stats_sample_rate configuration parameter. The locks of
+ * all the buckets of the process share the stats.
+ */
+class LockStats {
+public:
+    explicit LockStats(const char* name) : name(name) {
+    }
+
+    /// @return true if the calling thread should time this acquisition
+    static bool shouldSample() {
+        const uint32_t rate = sampleRate.load(std::memory_order_relaxed);
+        if (rate == 0) {
+            return false;
+        }
+        static thread_local uint32_t acquisitions = 0;
+        if (++acquisitions < rate) {
+            return false;
+        }
+        acquisitions = 0;
+        return true;
+    }
+
+    /// Record how long (in nanoseconds) a sampled acquisition waited for
+    /// the lock
+    void recordWait(hrtime_t waited) {
+        ++sampled;
+        // Taking a free lock (and reading the clock) takes well under a
+        // microsecond
+        if (waited >= 1000) {
+            ++contended;
+        }
+        waitHisto.add(waited / 1000);
+    }
+
+    /// Record how long (in nanoseconds) a sampled acquisition held the lock
+    void recordHold(hrtime_t held) {
+        holdHisto.add(held / 1000);
+    }
+
+    void reset() {
+        sampled.reset();
+        contended.reset();
+        waitHisto.reset();
+        holdHisto.reset();
+    }
+
+    /// The name the stats are reported under
+    const char* const name;
+
+    /// The sampled acquisitions, and how many of them had to wait
+    Couchbase::RelaxedAtomic<uint64_t> sampled;
+    Couchbase::RelaxedAtomic<uint64_t> contended;
+
+    /// The (microseconds) waits for and holds of the sampled acquisitions
+    Histogram<hrtime_t> waitHisto;
+    Histogram<hrtime_t> holdHisto;
+
+    /// Time one in sampleRate acquisitions (none if 0)
+    static std::atomic<uint32_t> sampleRate;
+
+    /// The stats of the instrumented locks
+    static LockStats hashTable;
+    static LockStats checkpointQueue;
+    static LockStats dcpConns;
+    static LockStats vbMap;
+
+    /// All of the above, for reporting them
+    static LockStats* const all[];
+    static const size_t numLocks;
+};
+
+/**
+ * How an InstrumentedMutex takes its mutex (std::mutex, SharedMutex and
+ * the like), and the shared side of it if it has one. try_lock is only
+ * needed by the users of InstrumentedMutex::try_lock.
+ */
+template <typename Mutex>
+struct LockOps {
+    static void lock(Mutex& m) {
+        m.lock();
+    }
+    static bool try_lock(Mutex& m) {
+        return m.try_lock();
+    }
+    static void unlock(Mutex& m) {
+        m.unlock();
+    }
+    static void lock_shared(Mutex& m) {
+        m.lock_shared();
+    }
+    static void unlock_shared(Mutex& m) {
+        m.unlock_shared();
+    }
+};
+
+/// A cb::RWLock's sides are its WriterLock and ReaderLock
+template <>
+struct LockOps<cb::RWLock> {
+    static void lock(cb::RWLock& m) {
+        m.writer().lock();
+    }
+    static void unlock(cb::RWLock& m) {
+        m.writer().unlock();
+    }
+    static void lock_shared(cb::RWLock& m) {
+        m.reader().lock();
+    }
+    static void unlock_shared(cb::RWLock& m) {
+        m.reader().unlock();
+    }
+};
+
+/**
+ * A mutex which records (a sample of) how long its acquisitions wait for,
+ * and hold, it in a LockStats.
+ *
+ * It meets the Lockable requirements (so it may be used with std::lock_guard
+ * and std::unique_lock), and the shared side of the mutex is available
+ * through lock_shared() / unlock_shared() (see SharedLockHolder); only the
+ * waits of the shared acquisitions are recorded, as they overlap.
+ */
+template <typename Mutex>
+class InstrumentedMutex {
+public:
+    explicit InstrumentedMutex(LockStats& stats) : stats(stats) {
+    }
+
+    void lock() {
+        if (!LockStats::shouldSample()) {
+            LockOps<Mutex>::lock(mutex);
+            return;
+        }
+        const hrtime_t start = gethrtime();
+        LockOps<Mutex>::lock(mutex);
+        lockedAt = gethrtime();
+        stats.recordWait(lockedAt - start);
+    }
+
+    bool try_lock() {
+        return LockOps<Mutex>::try_lock(mutex);
+    }
+
+    void unlock() {
+        // Only the holder of the lock reads and writes lockedAt
+        const hrtime_t locked = lockedAt;
+        lockedAt = 0;
+        LockOps<Mutex>::unlock(mutex);
+        if (locked != 0) {
+            stats.recordHold(gethrtime() - locked);
+        }
+    }
+
+    void lock_shared() {
+        if (!LockStats::shouldSample()) {
+            LockOps<Mutex>::lock_shared(mutex);
+            return;
+        }
+        const hrtime_t start = gethrtime();
+        LockOps<Mutex>::lock_shared(mutex);
+        stats.recordWait(gethrtime() - start);
+    }
+
+    void unlock_shared() {
+        LockOps<Mutex>::unlock_shared(mutex);
+    }
+
+private:
+    Mutex mutex;
+    LockStats& stats;
+
+    /// When a sampled exclusive acquisition got the lock (0 if the current
+    /// one isn't sampled)
+    hrtime_t lockedAt = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(InstrumentedMutex);
+};
+
+/**
+ * RAII shared access to a mutex with a shared side (the counterpart of
+ * std::lock_guard for the exclusive side).
+ */
+template <typename Mutex>
+class SharedLockHolder {
+public:
+    explicit SharedLockHolder(Mutex& m) : mutex(m) {
+        mutex.lock_shared();
+    }
+
+    ~SharedLockHolder() {
+        mutex.unlock_shared();
+    }
+
+private:
+    Mutex& mutex;
+
+    DISALLOW_COPY_AND_ASSIGN(SharedLockHolder);
+};
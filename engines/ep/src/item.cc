@@ -110,6 +110,7 @@ Item::Item(const Item& other)
       value(other.value),
       key(other.key),
       bySeqno(other.bySeqno.load()),
+      enqueueTime(other.enqueueTime),
       queuedTime(other.queuedTime),
       vbucketId(other.vbucketId),
       op(other.op),
@@ -122,6 +123,40 @@ Item::~Item() {
     ObjectRegistry::onDeleteItem(this);
 }
 
+Item* Item::makeWithValue(const DocKey& k,
+                          const uint32_t fl,
+                          const time_t exp,
+                          const size_t nb,
+                          protocol_binary_datatype_t dtype,
+                          uint16_t vbid) {
+    const size_t align = alignof(Item);
+    const size_t offset =
+            (Blob::getAllocationSize(nb) + align - 1) & ~(align - 1);
+    void* allocation = ::operator new(offset + sizeof(Item));
+    Blob* blob = Blob::NewHolding(allocation, nb);
+    Item* item;
+    try {
+        item = new (static_cast<char*>(allocation) + offset)
+                Item(k, fl, exp, value_t(blob), dtype, 0, -1, vbid);
+    } catch (...) {
+        Blob::releaseHolder(blob);
+        throw;
+    }
+    item->holderOffset = static_cast<uint32_t>(offset);
+    return item;
+}
+
+void Item::release(Item* item) {
+    if (item->holderOffset == 0) {
+        delete item;
+        return;
+    }
+    Blob* holder = reinterpret_cast<Blob*>(reinterpret_cast<char*>(item) -
+                                           item->holderOffset);
+    item->~Item();
+    Blob::releaseHolder(holder);
+}
+
 std::string to_string(queue_op op) {
     switch(op) {
         case queue_op::set: return "set";
@@ -182,6 +182,26 @@ public:
 
     ~Item();
 
+    /**
+     * Create an Item for a new value of nb bytes, which the caller fills
+     * in (through getData()), together with the Blob of the value in a
+     * single allocation (the Blob first, followed by the Item). This is
+     * how the items the front end stores are allocated (see itemAllocate).
+     *
+     * The value may be shared as any other (the allocation is only freed
+     * once both the Item and the Blob are gone), but the Item must be
+     * destroyed with release() rather than deleted.
+     */
+    static Item* makeWithValue(const DocKey& k,
+                               const uint32_t fl,
+                               const time_t exp,
+                               const size_t nb,
+                               protocol_binary_datatype_t dtype,
+                               uint16_t vbid);
+
+    /// Destroy an Item made with makeWithValue() (or new)
+    static void release(Item* item);
+
     /* Snappy compress value and update datatype */
     bool compressValue(float minCompressionRatio = 1.0);
 
@@ -310,6 +330,18 @@ public:
 
     uint32_t getQueuedTime(void) const { return queuedTime; }
 
+    /**
+     * The (gethrtime) time at which the item was queued into a checkpoint
+     * for persistence, or 0 if it wasn't.
+     */
+    hrtime_t getEnqueueTime() const {
+        return enqueueTime;
+    }
+
+    void setEnqueueTime(hrtime_t time) {
+        enqueueTime = time;
+    }
+
     queue_op getOperation(void) const {
         return op;
     }
@@ -422,6 +454,10 @@ private:
         setValue(data);
     }
 
+    //! The offset of the Item from the start of the Blob it was allocated
+    //  with (see makeWithValue), or 0 if it was allocated on its own.
+    //  (Declared first to fill the room left after the RCValue.)
+    uint32_t holderOffset = 0;
     ItemMetaData metaData;
     value_t value;
     StoredDocKey key;
@@ -431,6 +467,7 @@ private:
     // checkpoints when updating a the open checkpointID - see
     // CheckpointManager::setOpenCheckpointId_UNLOCKED
     std::atomic<int64_t> bySeqno;
+    hrtime_t enqueueTime = 0;
     uint32_t queuedTime;
     uint16_t vbucketId;
     queue_op op;
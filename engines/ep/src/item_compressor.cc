@@ -0,0 +1,108 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "item_compressor.h"
+
+#include <phosphor/phosphor.h>
+
+#include "ep_engine.h"
+#include "item_compressor_visitor.h"
+
+ItemCompressorTask::ItemCompressorTask(EventuallyPersistentEngine* e,
+                                       EPStats& stats_)
+    : GlobalTask(e, TaskId::ItemCompressorTask, 0, false),
+      stats(stats_),
+      epstore_position(engine->getKVBucket()->startPosition()) {
+}
+
+bool ItemCompressorTask::run() {
+    TRACE_EVENT0("ep-engine/task", "ItemCompressorTask");
+    if (engine->getConfiguration().isItemCompressorEnabled()) {
+        // Resume from where the previous run paused, or start a new pass.
+        if (!prAdapter) {
+            prAdapter = std::make_unique<PauseResumeVBAdapter>(
+                    std::make_unique<ItemCompressorVisitor>(
+                            engine->getConfiguration()
+                                    .getItemCompressorMinRatio()));
+            epstore_position = engine->getKVBucket()->startPosition();
+        }
+
+        auto& visitor = getCompressorVisitor();
+        const auto start = ProcessClock::now();
+        prAdapter->getBudget().startRun(getChunkDuration());
+        visitor.clearStats();
+
+        epstore_position = engine->getKVBucket()->pauseResumeVisit(
+                *prAdapter, epstore_position);
+        const auto end = ProcessClock::now();
+        stats.visitorRuns[static_cast<size_t>(getTypeId())].record(
+                prAdapter->getBudget().endRun());
+
+        stats.compressorNumVisited.fetch_add(visitor.getVisitedCount());
+        stats.compressorNumCompressed.fetch_add(visitor.getCompressedCount());
+        stats.compressorNumInflated.fetch_add(visitor.getInflatedCount());
+
+        const bool completed =
+                (epstore_position == engine->getKVBucket()->endPosition());
+
+        LOG(EXTENSION_LOG_INFO,
+            "%s for bucket '%s' %s. Took %" PRIu64 " us, compressed %" PRIu64
+            " and inflated %" PRIu64 " of %" PRIu64
+            " visited documents. mem_used=%" PRIu64,
+            to_string(getDescription()).c_str(),
+            engine->getName().c_str(),
+            completed ? "finished" : "paused",
+            uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                             end - start)
+                             .count()),
+            uint64_t(visitor.getCompressedCount()),
+            uint64_t(visitor.getInflatedCount()),
+            uint64_t(visitor.getVisitedCount()),
+            uint64_t(stats.getTotalMemoryUsed()));
+
+        // Start over on the next run once the pass is done.
+        if (completed) {
+            prAdapter.reset();
+        }
+    }
+
+    snooze(getSleepTime());
+    return !engine->getEpStats().isShutdown;
+}
+
+cb::const_char_buffer ItemCompressorTask::getDescription() {
+    return "Item compressor";
+}
+
+std::chrono::microseconds ItemCompressorTask::maxExpectedDuration() {
+    // As the defragmenter: each run is bounded by the chunk duration, with
+    // some headroom for the estimate of the VisitorBudget.
+    return getChunkDuration() * 10;
+}
+
+size_t ItemCompressorTask::getSleepTime() const {
+    return engine->getConfiguration().getItemCompressorInterval();
+}
+
+std::chrono::milliseconds ItemCompressorTask::getChunkDuration() const {
+    return std::chrono::milliseconds(
+            engine->getConfiguration().getItemCompressorChunkDuration());
+}
+
+ItemCompressorVisitor& ItemCompressorTask::getCompressorVisitor() {
+    return dynamic_cast<ItemCompressorVisitor&>(prAdapter->getHTVisitor());
+}
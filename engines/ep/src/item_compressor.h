@@ -0,0 +1,78 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "globaltask.h"
+#include "kv_bucket_iface.h"
+
+class EPStats;
+class ItemCompressorVisitor;
+class PauseResumeVBAdapter;
+
+/**
+ * Task compressing the values of the items in memory which aren't hot
+ * (item_compressor_enabled), so more of them stay resident in the same
+ * bucket quota.
+ *
+ * The values are compressed in place with Snappy, and the datatype of the
+ * item gets the snappy bit; the frontend inflates them for the clients
+ * which didn't enable datatype snappy, and DCP for the consumers which
+ * didn't. A value compressed this way is inflated again by a later pass
+ * once the item is hot (see ItemCompressorVisitor), and its datatype is
+ * restored when it's evicted, as the copy on disk isn't compressed.
+ *
+ * As the defragmenter, the task limits the duration of each run (chunk),
+ * pauses, and starts the next chunk from where it left off.
+ *
+ * Only persistent buckets run it: the sequence list of an Ephemeral bucket
+ * reads the values of the items without the hash bucket lock.
+ */
+class ItemCompressorTask : public GlobalTask {
+public:
+    ItemCompressorTask(EventuallyPersistentEngine* e, EPStats& stats_);
+
+    bool run() override;
+
+    cb::const_char_buffer getDescription() override;
+
+    std::chrono::microseconds maxExpectedDuration() override;
+
+private:
+    /// Duration (in seconds) the task should sleep for between runs.
+    size_t getSleepTime() const;
+
+    // Upper limit on how long each chunk can run for, before being paused.
+    std::chrono::milliseconds getChunkDuration() const;
+
+    /// Returns the underlying ItemCompressorVisitor instance.
+    ItemCompressorVisitor& getCompressorVisitor();
+
+    EPStats& stats;
+
+    // Opaque marker indicating how far through the epStore we have visited.
+    KVBucketIface::Position epstore_position;
+
+    /**
+     * Visitor adapter which supports pausing & resuming (records how far
+     * though a VBucket is has got). unique_ptr as we re-create it for each
+     * complete pass.
+     */
+    std::unique_ptr<PauseResumeVBAdapter> prAdapter;
+};
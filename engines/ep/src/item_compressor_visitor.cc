@@ -0,0 +1,63 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "item_compressor_visitor.h"
+
+#include "item.h"
+#include "vbucket.h"
+
+ItemCompressorVisitor::ItemCompressorVisitor(float minCompressionRatio)
+    : minCompressionRatio(minCompressionRatio) {
+}
+
+bool ItemCompressorVisitor::visit(const HashTable::HashBucketLock& lh,
+                                  StoredValue& v) {
+    visited_count++;
+    if (currentHt == nullptr) {
+        return true;
+    }
+
+    if (isHot(v)) {
+        if (currentHt->unlocked_inflateValue(lh.getHTLock(), v)) {
+            inflated_count++;
+        }
+    } else if (currentHt->unlocked_compressValue(
+                       lh.getHTLock(), v, minCompressionRatio)) {
+        compressed_count++;
+    }
+
+    // Whoever drives the visit pauses it once the chunk is done (see
+    // VisitorBudget).
+    return true;
+}
+
+void ItemCompressorVisitor::setCurrentVBucket(VBucket& vb) {
+    currentHt = &vb.ht;
+}
+
+bool ItemCompressorVisitor::isHot(const StoredValue& v) const {
+    if (currentHt->isFrequencyTracking()) {
+        return currentHt->getFrequency(v) > 0;
+    }
+    return v.getNRUValue() < INITIAL_NRU_VALUE;
+}
+
+void ItemCompressorVisitor::clearStats() {
+    compressed_count = 0;
+    inflated_count = 0;
+    visited_count = 0;
+}
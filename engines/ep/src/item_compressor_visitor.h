@@ -0,0 +1,77 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "hash_table.h"
+#include "vb_visitors.h"
+
+/**
+ * Compression visitor - visit all objects in a VBucket, compress the
+ * values of the ones which aren't hot, and inflate the ones it compressed
+ * before which are hot again.
+ *
+ * An item isn't hot if it wasn't referenced since it was stored (or since
+ * the item pager last aged it), or, for a HashTable tracking the access
+ * frequency, if it has no recorded accesses.
+ */
+class ItemCompressorVisitor : public VBucketAwareHTVisitor {
+public:
+    /**
+     * @param minCompressionRatio the largest size of a compressed value
+     *        relative to the original for which it's worth keeping it
+     */
+    explicit ItemCompressorVisitor(float minCompressionRatio);
+
+    // Implementation of HashTableVisitor interface:
+    bool visit(const HashTable::HashBucketLock& lh, StoredValue& v) override;
+
+    void setCurrentVBucket(VBucket& vb) override;
+
+    // Resets any held stats to zero.
+    void clearStats();
+
+    // Returns the number of documents that have been compressed.
+    size_t getCompressedCount() const {
+        return compressed_count;
+    }
+
+    // Returns the number of documents that have been inflated again.
+    size_t getInflatedCount() const {
+        return inflated_count;
+    }
+
+    // Returns the number of documents that have been visited.
+    size_t getVisitedCount() const {
+        return visited_count;
+    }
+
+private:
+    bool isHot(const StoredValue& v) const;
+
+    const float minCompressionRatio;
+
+    // The HashTable of the VBucket we are visiting.
+    HashTable* currentHt = nullptr;
+
+    /* Statistics */
+    size_t compressed_count = 0;
+    size_t inflated_count = 0;
+    size_t visited_count = 0;
+};
@@ -22,15 +22,21 @@
 #include "dcp/dcpconnmap.h"
 #include "ep_engine.h"
 #include "ep_time.h"
+#include "executorpool.h"
 #include "item.h"
 #include "kv_bucket_iface.h"
+#include "trace.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
 #include <list>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <phosphor/phosphor.h>
 #include <platform/make_unique.h>
@@ -43,6 +49,26 @@ enum pager_type_t {
     EXPIRY_PAGER
 };
 
+/**
+ * The state shared by the PagingVisitors of one pager run (which may visit
+ * the vbuckets concurrently). The last visitor to complete finishes the run.
+ */
+struct PagerRunState {
+    explicit PagerRunState(size_t visitors)
+        : remaining(visitors),
+          visited(0),
+          ejected(0),
+          ejectedBytes(0),
+          completePhase(true) {
+    }
+
+    std::atomic<size_t> remaining;
+    std::atomic<size_t> visited;
+    std::atomic<size_t> ejected;
+    std::atomic<size_t> ejectedBytes;
+    std::atomic<bool> completePhase;
+};
+
 /**
  * As part of the ItemPager, visit all of the objects in memory and
  * eject some within a constrained probability
@@ -63,19 +89,36 @@ public:
      *              visits
      * @param bias active vbuckets eviction probability bias multiplier (0-1)
      * @param phase pointer to an item_pager_phase to be set
+     * @param sampledEviction pick the eviction threshold of each vbucket from
+     *        a sample of its items, and only visit it until enough items are
+     *        evicted
+     * @param run the state shared with the other visitors of the same run
+     *        (if there are any)
      */
     PagingVisitor(KVBucketIface& s, EPStats &st, double pcnt,
                   std::shared_ptr<std::atomic<bool>> &sfin, pager_type_t caller,
                   bool pause, double bias,
-                  std::atomic<item_pager_phase>* phase) :
+                  std::atomic<item_pager_phase>* phase,
+                  bool sampledEviction = false,
+                  std::shared_ptr<PagerRunState> run = nullptr) :
         store(s), stats(st), percent(pcnt),
         activeBias(bias), ejected(0),
         startTime(ep_real_time()), stateFinalizer(sfin), owner(caller),
         canPause(pause), completePhase(true),
         wasHighMemoryUsage(s.isMemoryUsageTooHigh()),
-        taskStart(gethrtime()), pager_phase(phase) {}
+        taskStart(gethrtime()), pager_phase(phase),
+        freqHistogram(), freqVisited(0), sampled(sampledEviction),
+        sampling(false), sampleHistogram(), sampleCount(0),
+        threshold{0, 0}, toEject(0),
+        visited(0), totalEjected(0), totalEjectedBytes(0),
+        runState(run ? std::move(run) : std::make_shared<PagerRunState>(1)) {}
 
     bool visit(const HashTable::HashBucketLock& lh, StoredValue& v) override {
+        ++visited;
+        if (sampling) {
+            return sampleItem(v);
+        }
+
         // Delete expired items for an active vbucket.
         bool isExpired = (currentBucket->getState() == vbucket_state_active) &&
                          v.isExpired(startTime) && !v.isDeleted();
@@ -90,6 +133,15 @@ public:
             return true;
         }
 
+        if (sampled) {
+            return visitSampled(lh, v);
+        }
+
+        if (currentBucket->ht.isFrequencyTracking()) {
+            visitByFrequency(lh, v);
+            return true;
+        }
+
         // always evict unreferenced items, or randomly evict referenced item
         double r = *pager_phase == PAGING_UNREFERENCED ?
             1 :
@@ -109,6 +161,13 @@ public:
     void visitBucket(VBucketPtr &vb) override {
         update();
 
+        // Resuming the visit of a vbucket which ran out of the budget of
+        // the previous run; the rest was done when the visit started
+        if (isBucketPaused(vb->getId())) {
+            visitHashTable(*vb, *this);
+            return;
+        }
+
         bool newCheckpointCreated = false;
         size_t removed = vb->checkpointManager->removeClosedUnrefCheckpoints(
                 *vb, newCheckpointCreated);
@@ -124,7 +183,14 @@ public:
         if (percent <= 0 || !pager_phase) {
             if (vBucketFilter(vb->getId())) {
                 currentBucket = vb;
-                vb->ht.visit(*this);
+                if (!useTtlIndex || !vb->ht.hasExpiryIndex()) {
+                    visitHashTable(*vb, *this);
+                } else if (vb->getState() == vbucket_state_active) {
+                    // Only the items due in the TTL index may have expired
+                    // (and only active vbuckets expire items; the others
+                    // keep their index until they're made active)
+                    vb->ht.visitExpiring(*this, startTime);
+                }
             }
             return;
         }
@@ -145,7 +211,11 @@ public:
             adjustPercent(p, vb->getState());
             if (vBucketFilter(vb->getId())) {
                 currentBucket = vb;
-                vb->ht.visit(*this);
+                if (sampled) {
+                    visitBucketSampled(*vb);
+                } else {
+                    visitHashTable(*vb, *this);
+                }
             }
 
         } else { // stop eviction whenever memory usage is below low watermark
@@ -177,9 +247,23 @@ public:
     void complete() override {
         update();
 
+        runState->visited += visited;
+        runState->ejected += totalEjected;
+        runState->ejectedBytes += totalEjectedBytes;
+        if (!completePhase) {
+            runState->completePhase = false;
+        }
+        if (--runState->remaining != 0) {
+            // The other visitors of the run are still going
+            return;
+        }
+
         hrtime_t elapsed_time = (gethrtime() - taskStart) / 1000;
         if (owner == ITEM_PAGER) {
             stats.itemPagerHisto.add(elapsed_time);
+            stats.pagerLastVisited.store(runState->visited);
+            stats.pagerLastEjected.store(runState->ejected);
+            stats.pagerLastEjectedBytes.store(runState->ejectedBytes);
         } else if (owner == EXPIRY_PAGER) {
             stats.expiryPagerHisto.add(elapsed_time);
         }
@@ -187,7 +271,7 @@ public:
         bool inverse = false;
         (*stateFinalizer).compare_exchange_strong(inverse, true);
 
-        if (pager_phase && completePhase) {
+        if (pager_phase && runState->completePhase) {
             if (*pager_phase == PAGING_UNREFERENCED) {
                 *pager_phase = PAGING_RANDOM;
             } else {
@@ -207,7 +291,186 @@ public:
      */
     size_t numEjected() { return ejected; }
 
+    /**
+     * Let the expiry pager only visit the items which are due in the TTL
+     * index of each vbucket which has one, rather than all of them.
+     */
+    void setUseTtlIndex(bool use) {
+        useTtlIndex = use;
+    }
+
+    /**
+     * Make the large values colder, so that (in the sampled and lfu modes)
+     * a few large cold values are evicted rather than many small ones
+     * freeing the same memory, as GreedyDual-Size does.
+     *
+     * @param weight the hotness an item loses each time its value doubles
+     *        in size past unit (0 to only go by the hotness)
+     * @param unit the size (in bytes) of the values which lose nothing
+     */
+    void setSizeWeight(double weight, size_t unit) {
+        sizeWeight = weight;
+        sizeUnit = std::max(unit, size_t(1));
+    }
+
 private:
+    /// The number of items we look at before evicting by frequency
+    static const size_t FreqLearningItems = 100;
+
+    /// The number of items we sample to pick the threshold of a vbucket
+    static const size_t SampleSize = 1000;
+
+    /// The number of items at each hotness (NRU or access frequency)
+    using HotnessHistogram =
+            std::array<size_t, FrequencySketch::MaxFrequency + 1>;
+
+    /**
+     * The hotness at or below which we evict items; items at exactly the
+     * threshold are only evicted with the given probability, so (many) ties
+     * don't make us evict more than we should.
+     */
+    struct EvictionThreshold {
+        uint8_t hotness;
+        double tieProbability;
+    };
+
+    /**
+     * Get the threshold which evicts percent of the count items in the
+     * histogram.
+     */
+    static EvictionThreshold getThreshold(const HotnessHistogram& histogram,
+                                          size_t count,
+                                          double percent) {
+        const double target = percent * count;
+        size_t below = 0;
+        for (uint8_t h = 0; h < histogram.size(); ++h) {
+            if (below + histogram[h] >= target) {
+                return {h,
+                        histogram[h] == 0 ? 0 : (target - below) /
+                                                        histogram[h]};
+            }
+            below += histogram[h];
+        }
+        return {uint8_t(histogram.size() - 1), 1};
+    }
+
+    static bool shouldEvict(uint8_t hotness,
+                            const EvictionThreshold& threshold) {
+        if (hotness != threshold.hotness) {
+            return hotness < threshold.hotness;
+        }
+        const double r =
+                static_cast<double>(std::rand()) / static_cast<double>(RAND_MAX);
+        return r < threshold.tieProbability;
+    }
+
+    /**
+     * Get how hot the given item is; its access frequency if the vbucket
+     * tracks it, otherwise how recently it was referenced (by its NRU),
+     * less the weight of the size of its value (see setSizeWeight).
+     */
+    uint8_t getHotness(const StoredValue& v) const {
+        const int hotness = currentBucket->ht.isFrequencyTracking()
+                                    ? currentBucket->ht.getFrequency(v)
+                                    : MAX_NRU_VALUE - v.getNRUValue();
+        if (sizeWeight == 0 || v.valuelen() <= sizeUnit) {
+            return uint8_t(hotness);
+        }
+        const double penalty =
+                sizeWeight * std::log2(double(v.valuelen()) / sizeUnit);
+        return uint8_t(std::max(0, hotness - int(std::lround(penalty))));
+    }
+
+    /**
+     * Age the item, so it has to keep being accessed to stay resident.
+     */
+    void ageItem(StoredValue& v) {
+        if (!currentBucket->ht.isFrequencyTracking()) {
+            v.incrNRUValue();
+        } else if (v.getFreqCounterValue() > 0) {
+            v.setFreqCounterValue(v.getFreqCounterValue() - 1);
+        }
+    }
+
+    /**
+     * Evict the least frequently accessed items (for a HashTable tracking
+     * the access frequency). We keep a histogram of the frequencies of the
+     * items visited so far, and evict an item if less than percent of the
+     * items seen are accessed less frequently.
+     */
+    void visitByFrequency(const HashTable::HashBucketLock& lh,
+                          StoredValue& v) {
+        if (!isEvictionCandidate(v)) {
+            // Tombstones (many, after an Ephemeral bucket auto deleted a
+            // lot) are cold but can't be evicted; counting them would make
+            // us evict fewer of the items which can.
+            return;
+        }
+        const uint8_t freq = getHotness(v);
+        ++freqHistogram[freq];
+        ++freqVisited;
+        ageItem(v);
+
+        if (freqVisited > FreqLearningItems &&
+            shouldEvict(freq,
+                        getThreshold(freqHistogram, freqVisited, percent))) {
+            doEviction(lh, &v);
+        }
+    }
+
+    /**
+     * Visit the given vbucket in sampled mode: build the histogram of the
+     * hotness of the items from where we stopped the previous time, pick
+     * the threshold which evicts percent of them, and then visit them
+     * (again) until we've evicted percent of the resident items of the
+     * vbucket. The next pass continues where this one stopped.
+     */
+    void visitBucketSampled(VBucket& vb) {
+        sampleHistogram.fill(0);
+        sampleCount = 0;
+        sampling = true;
+        HashTable::Position start = vb.pagerPosition;
+        vb.ht.pauseResumeVisit(*this, start);
+        sampling = false;
+
+        const size_t resident =
+                vb.getNumItems() - std::min(vb.getNumItems(),
+                                            vb.getNumNonResidentItems());
+        toEject = static_cast<size_t>(percent * resident);
+        if (sampleCount == 0 || toEject == 0) {
+            return;
+        }
+
+        threshold = getThreshold(sampleHistogram, sampleCount, percent);
+        start = vb.pagerPosition;
+        const auto end = vb.ht.pauseResumeVisit(*this, start);
+        vb.pagerPosition =
+                (end == vb.ht.endPosition()) ? HashTable::Position() : end;
+    }
+
+    /// Could the item be evicted (and so count towards the threshold)?
+    static bool isEvictionCandidate(const StoredValue& v) {
+        return !v.isDeleted() && !v.isTempItem() && v.isResident();
+    }
+
+    /// Count the hotness of an item (which may be evicted) in the sample
+    bool sampleItem(const StoredValue& v) {
+        if (isEvictionCandidate(v)) {
+            ++sampleHistogram[getHotness(v)];
+            ++sampleCount;
+        }
+        return sampleCount < SampleSize;
+    }
+
+    bool visitSampled(const HashTable::HashBucketLock& lh, StoredValue& v) {
+        const uint8_t hotness = getHotness(v);
+        ageItem(v);
+        if (shouldEvict(hotness, threshold)) {
+            doEviction(lh, &v);
+        }
+        return ejected < toEject;
+    }
+
     void adjustPercent(double prob, vbucket_state_t state) {
         if (state == vbucket_state_replica ||
             state == vbucket_state_dead)
@@ -224,9 +487,17 @@ private:
     void doEviction(const HashTable::HashBucketLock& lh, StoredValue* v) {
         item_eviction_policy_t policy = store.getItemEvictionPolicy();
         StoredDocKey key(v->getKey());
-
-        if (currentBucket->pageOut(lh, v)) {
+        const size_t valueBytes = v->valuelen();
+
+        const bool evicted = currentBucket->pageOut(lh, v);
+        MEMCACHED_EP_ITEM_EVICT(currentBucket->getId(),
+                                reinterpret_cast<const char*>(key.data()),
+                                int(key.size()),
+                                evicted ? 1 : 0);
+        if (evicted) {
             ++ejected;
+            ++totalEjected;
+            totalEjectedBytes += valueBytes;
 
             /**
              * For FULL EVICTION MODE, add all items that are being
@@ -254,8 +525,45 @@ private:
     hrtime_t taskStart;
     std::atomic<item_pager_phase>* pager_phase;
     VBucketPtr currentBucket;
+    // The number of items visited at each access frequency
+    HotnessHistogram freqHistogram;
+    size_t freqVisited;
+    // For the sampled eviction; whether we're sampling the current vbucket,
+    // the histogram of the sample, and the threshold and number of items to
+    // evict picked from it
+    const bool sampled;
+    bool sampling;
+    HotnessHistogram sampleHistogram;
+    size_t sampleCount;
+    EvictionThreshold threshold;
+    size_t toEject;
+    // The number of items visited and ejected over the whole run
+    size_t visited;
+    size_t totalEjected;
+    // The bytes of the values ejected over the whole run
+    size_t totalEjectedBytes;
+    std::shared_ptr<PagerRunState> runState;
+    bool useTtlIndex = false;
+    double sizeWeight = 0;
+    size_t sizeUnit = 1;
 };
 
+/// Get how long each run of the tasks of the PagingVisitors may take
+static std::chrono::microseconds getVisitorChunkDuration(
+        Configuration& config) {
+    return std::chrono::milliseconds(config.getVisitorChunkDuration());
+}
+
+/**
+ * Get the number of PagingVisitors to run concurrently: as configured, but
+ * leaving at least half of the NONIO threads to the other tasks.
+ */
+static size_t getPagerConcurrency(Configuration& config) {
+    const size_t limit =
+            std::max(size_t(1), ExecutorPool::get()->getNumNonIO() / 2);
+    return std::max(size_t(1), std::min(config.getPagerConcurrency(), limit));
+}
+
 ItemPager::ItemPager(EventuallyPersistentEngine *e, EPStats &st) :
     GlobalTask(e, TaskId::ItemPager, 10, false),
     engine(e),
@@ -264,10 +572,27 @@ ItemPager::ItemPager(EventuallyPersistentEngine *e, EPStats &st) :
     phase(PAGING_UNREFERENCED),
     doEvict(false) { }
 
+constexpr double MemoryGrowthEstimator::Alpha;
+
+void MemoryGrowthEstimator::sample(size_t memUsed,
+                                   ProcessClock::time_point now) {
+    if (haveSample && now > last) {
+        const double elapsed =
+                std::chrono::duration<double>(now - last).count();
+        const double current =
+                (static_cast<double>(memUsed) - lastMemUsed) / elapsed;
+        rate = Alpha * current + (1 - Alpha) * rate;
+    }
+    haveSample = true;
+    last = now;
+    lastMemUsed = memUsed;
+}
+
 bool ItemPager::run(void) {
     TRACE_EVENT0("ep-engine/task", "ItemPager");
     KVBucketIface* kvBucket = engine->getKVBucket();
-    double current = static_cast<double>(stats.getTotalMemoryUsed());
+    const size_t memUsed = stats.getTotalMemoryUsed();
+    double current = static_cast<double>(memUsed);
     double upper = static_cast<double>(stats.mem_high_wat);
     double lower = static_cast<double>(stats.mem_low_wat);
     double sleepTime = 5;
@@ -276,16 +601,37 @@ bool ItemPager::run(void) {
         doEvict = false;
     }
 
+    // In the predictive mode we sample the memory used every second, and
+    // start as soon as we're above the low watermark if we'd otherwise
+    // reach the high watermark within the lookahead.
+    const size_t lookahead =
+            engine->getConfiguration().getPagerGrowthLookahead();
+    double projected = current;
+    if (lookahead > 0) {
+        growth.sample(memUsed, ProcessClock::now());
+        stats.memGrowthRate.store(static_cast<size_t>(growth.getRate()));
+        projected = growth.project(memUsed, lookahead);
+        sleepTime = 1;
+    }
+    const bool predicted =
+            current <= upper && current > lower && projected > upper;
+
     bool inverse = true;
-    if (((current > upper) || doEvict) &&
+    if (((current > upper) || predicted || doEvict) &&
         (*available).compare_exchange_strong(inverse, false)) {
         if (kvBucket->getItemEvictionPolicy() == VALUE_ONLY) {
             doEvict = true;
         }
 
         ++stats.pagerRuns;
+        if (predicted) {
+            ++stats.pagerPredictiveRuns;
+        }
 
-        double toKill = (current - static_cast<double>(lower)) / current;
+        // Evict enough to still be at the low watermark once the memory
+        // we expect to be allocated over the lookahead is (without a
+        // lookahead projected is the memory used now)
+        double toKill = std::min(1.0, (projected - lower) / current);
 
         std::stringstream ss;
         ss << "Using " << stats.getTotalMemoryUsed()
@@ -297,19 +643,31 @@ bool ItemPager::run(void) {
         size_t activeEvictPerc = cfg.getPagerActiveVbPcnt();
         double bias = static_cast<double>(activeEvictPerc) / 50;
 
-        auto pv = std::make_unique<PagingVisitor>(*kvBucket,
-                                                  stats,
-                                                  toKill,
-                                                  available,
-                                                  ITEM_PAGER,
-                                                  false,
-                                                  bias,
-                                                  &phase);
+        const size_t concurrency = getPagerConcurrency(cfg);
+        auto runState = std::make_shared<PagerRunState>(concurrency);
+        std::vector<std::unique_ptr<VBucketVisitor>> visitors;
+        for (size_t ii = 0; ii < concurrency; ++ii) {
+            auto pv = std::make_unique<PagingVisitor>(
+                    *kvBucket,
+                    stats,
+                    toKill,
+                    available,
+                    ITEM_PAGER,
+                    false,
+                    bias,
+                    &phase,
+                    cfg.isPagerSampledEviction(),
+                    runState);
+            pv->setRunBudget(getVisitorChunkDuration(cfg));
+            pv->setSizeWeight(cfg.getPagerSizeWeight(),
+                              cfg.getPagerSizeUnit());
+            visitors.push_back(std::move(pv));
+        }
 
         // p99.99 is ~50ms
         const auto maxExpectedDuration = std::chrono::milliseconds(50);
 
-        kvBucket->visit(std::move(pv),
+        kvBucket->visit(std::move(visitors),
                         "Item pager",
                         TaskId::ItemPagerVisitor,
                         /*sleepTime*/ 0,
@@ -328,7 +686,8 @@ ExpiredItemPager::ExpiredItemPager(EventuallyPersistentEngine *e,
     engine(e),
     stats(st),
     sleepTime(static_cast<double>(stime)),
-    available(new std::atomic<bool>(true)) {
+    available(new std::atomic<bool>(true)),
+    runs(0) {
 
     double initialSleep = sleepTime;
     if (taskTime != -1) {
@@ -371,20 +730,36 @@ bool ExpiredItemPager::run(void) {
     if ((*available).compare_exchange_strong(inverse, false)) {
         ++stats.expiryPagerRuns;
 
-        auto pv = std::make_unique<PagingVisitor>(*kvBucket,
-                                                  stats,
-                                                  -1,
-                                                  available,
-                                                  EXPIRY_PAGER,
-                                                  true,
-                                                  1,
-                                                  nullptr);
+        Configuration& cfg = engine->getConfiguration();
+        // Every so many runs we visit everything anyway, to purge the
+        // temporary items and expired items which aren't in the indexes
+        const size_t interval = cfg.getExpPagerFullSweepInterval();
+        const bool fullSweep = interval == 0 || runs % interval == 0;
+        ++runs;
+        const size_t concurrency = getPagerConcurrency(cfg);
+        auto runState = std::make_shared<PagerRunState>(concurrency);
+        std::vector<std::unique_ptr<VBucketVisitor>> visitors;
+        for (size_t ii = 0; ii < concurrency; ++ii) {
+            auto pv = std::make_unique<PagingVisitor>(*kvBucket,
+                                                      stats,
+                                                      -1,
+                                                      available,
+                                                      EXPIRY_PAGER,
+                                                      true,
+                                                      1,
+                                                      nullptr,
+                                                      false,
+                                                      runState);
+            pv->setUseTtlIndex(!fullSweep);
+            pv->setRunBudget(getVisitorChunkDuration(cfg));
+            visitors.push_back(std::move(pv));
+        }
 
         // p99.99 is ~50ms (same as ItemPager).
         const auto maxExpectedDuration = std::chrono::milliseconds(50);
 
         // track spawned tasks for shutdown..
-        kvBucket->visit(std::move(pv),
+        kvBucket->visit(std::move(visitors),
                         "Expired item remover",
                         TaskId::ExpiredItemPagerVisitor,
                         10,
@@ -22,6 +22,8 @@
 
 #include "globaltask.h"
 
+#include <platform/processclock.h>
+
 typedef std::pair<int64_t, int64_t> row_range_t;
 
 // Forward declaration.
@@ -36,6 +38,43 @@ enum item_pager_phase {
     PAGING_RANDOM
 };
 
+/**
+ * Estimates how fast the memory used by the bucket grows from the samples
+ * the ItemPager takes each time it runs, so that the pager may start to
+ * evict items before a burst of writes takes the bucket past the high
+ * watermark (see pager_growth_lookahead).
+ */
+class MemoryGrowthEstimator {
+public:
+    /**
+     * Record the memory used at the given time. The rate is a moving
+     * average of the growth between the samples, so a single sample
+     * doesn't make it jump.
+     */
+    void sample(size_t memUsed, ProcessClock::time_point now);
+
+    /// @return the rate (bytes per second) the memory used grows at; 0 if
+    ///         it doesn't grow
+    double getRate() const {
+        return rate > 0 ? rate : 0;
+    }
+
+    /// @return the memory we'd use after the given number of seconds if it
+    ///         keeps growing at the current rate
+    double project(size_t memUsed, size_t seconds) const {
+        return static_cast<double>(memUsed) + getRate() * seconds;
+    }
+
+    /// The weight of the latest sample in the moving average
+    static constexpr double Alpha = 0.5;
+
+private:
+    ProcessClock::time_point last;
+    size_t lastMemUsed = 0;
+    bool haveSample = false;
+    double rate = 0;
+};
+
 /**
  * Dispatcher job responsible for periodically pushing data out of
  * memory.
@@ -81,6 +120,8 @@ private:
     // objects running on different threads.
     std::atomic<item_pager_phase> phase;
     bool                            doEvict;
+    // The growth of the memory used (with pager_growth_lookahead)
+    MemoryGrowthEstimator growth;
 };
 
 /**
@@ -123,6 +164,9 @@ private:
     EPStats                        &stats;
     double                          sleepTime;
     std::shared_ptr<std::atomic<bool>>   available;
+    // The number of runs so far (to tell which runs should visit every
+    // item rather than just those due in the TTL indexes)
+    size_t                          runs;
 };
 
 #endif  // SRC_ITEM_PAGER_H_
@@ -54,12 +54,17 @@
 #include "replicationthrottle.h"
 #include "statwriter.h"
 #include "tasks.h"
+#include "trace.h"
 #include "vb_count_visitor.h"
 #include "vbucket.h"
 #include "vbucket_bgfetch_item.h"
 #include "vbucketdeletiontask.h"
 #include "warmup.h"
 
+#ifdef EP_USE_ROCKSDB
+#include "rocksdb-kvstore/rocksdb-kvstore.h"
+#endif
+
 class StatsValueChangeListener : public ValueChangedListener {
 public:
     StatsValueChangeListener(EPStats& st, KVBucket& str)
@@ -79,6 +84,11 @@ public:
             stats.mem_low_wat.store(low_wat);
             stats.mem_high_wat.store(high_wat);
             store.setCursorDroppingLowerUpperThresholds(value);
+#ifdef EP_USE_ROCKSDB
+            if (store.getRocksDBMemoryBudget()) {
+                store.getRocksDBMemoryBudget()->setQuota(value);
+            }
+#endif
         } else if (key.compare("mem_low_wat") == 0) {
             stats.mem_low_wat.store(value);
             stats.mem_low_wat_percent.store(
@@ -121,6 +131,10 @@ public:
             store.setBGFetchDelay(static_cast<uint32_t>(value));
         } else if (key.compare("compaction_write_queue_cap") == 0) {
             store.setCompactionWriteQueueCap(value);
+        } else if (key.compare("flusher_max_batch_delay") == 0) {
+            store.setFlusherMaxBatchDelay(std::chrono::milliseconds(value));
+        } else if (key.compare("bgfetcher_coalesce_window") == 0) {
+            store.setBgFetcherCoalesceWindow(std::chrono::microseconds(value));
         } else if (key.compare("exp_pager_stime") == 0) {
             store.setExpiryPagerSleeptime(value);
         } else if (key.compare("alog_sleep_time") == 0) {
@@ -137,6 +151,8 @@ public:
             store.setCompactionExpMemThreshold(value);
         } else if (key.compare("replication_throttle_cap_pcnt") == 0) {
             store.getEPEngine().getReplicationThrottle().setCapPercent(value);
+        } else if (key.compare("vbucket_latency_sample_interval") == 0) {
+            VBucketOpStats::setSampleInterval(value);
         } else {
             LOG(EXTENSION_LOG_WARNING,
                 "Failed to change value for unknown variable, %s\n",
@@ -219,9 +235,23 @@ private:
     const std::string description;
 };
 
+/// The memory shared by the RocksDB shards of a bucket, if it uses RocksDB
+static std::shared_ptr<RocksDBMemoryBudget> makeRocksDBMemoryBudget(
+        EventuallyPersistentEngine& engine) {
+#ifdef EP_USE_ROCKSDB
+    auto& config = engine.getConfiguration();
+    if (config.getBackend() == "rocksdb") {
+        return std::make_shared<RocksDBMemoryBudget>(config,
+                                                     engine.getEpStats());
+    }
+#endif
+    return nullptr;
+}
+
 KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
     : engine(theEngine),
       stats(engine.getEpStats()),
+      rocksDBMemoryBudget(makeRocksDBMemoryBudget(theEngine)),
       vbMap(theEngine.getConfiguration(), *this),
       defragmenterTask(NULL),
       vb_mutexes(engine.getConfiguration().getMaxVbuckets()),
@@ -246,6 +276,8 @@ KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
     const size_t size = GlobalTask::allTaskIds.size();
     stats.schedulingHisto.resize(size);
     stats.taskRuntimeHisto.resize(size);
+    // (Not resized, as the atomics can't be moved)
+    stats.visitorRuns = std::vector<EPStats::VisitorRuns>(size);
 
     for (size_t i = 0; i < GlobalTask::allTaskIds.size(); i++) {
         stats.schedulingHisto[i].reset();
@@ -329,6 +361,21 @@ KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
     config.addValueChangedListener("compaction_write_queue_cap",
                                    new EPStoreValueChangeListener(*this));
 
+    setFlusherMaxBatchDelay(
+            std::chrono::milliseconds(config.getFlusherMaxBatchDelay()));
+    config.addValueChangedListener("flusher_max_batch_delay",
+                                   new EPStoreValueChangeListener(*this));
+
+    VBucketOpStats::setSampleInterval(
+            config.getVbucketLatencySampleInterval());
+    config.addValueChangedListener("vbucket_latency_sample_interval",
+                                   new EPStoreValueChangeListener(*this));
+
+    setBgFetcherCoalesceWindow(
+            std::chrono::microseconds(config.getBgfetcherCoalesceWindow()));
+    config.addValueChangedListener("bgfetcher_coalesce_window",
+                                   new EPStoreValueChangeListener(*this));
+
     config.addValueChangedListener("dcp_min_compression_ratio",
                                    new EPStoreValueChangeListener(*this));
 
@@ -368,6 +415,11 @@ bool KVBucket::initialize() {
             std::make_shared<WorkLoadMonitor>(&engine, false);
     ExecutorPool::get()->schedule(workloadMonitorTask);
 
+    if (ExecutorPool::get()->isAutoTuning()) {
+        ExTask tunerTask = std::make_shared<ExecutorTunerTask>(&engine);
+        ExecutorPool::get()->schedule(tunerTask);
+    }
+
 #if HAVE_JEMALLOC
     /* Only create the defragmenter task if we have an underlying memory
      * allocator which can facilitate defragmenting memory.
@@ -535,6 +587,7 @@ void KVBucket::logQTime(TaskId taskType, const ProcessClock::duration enqTime) {
             std::chrono::duration_cast<std::chrono::microseconds>(enqTime)
                     .count();
     stats.schedulingHisto[static_cast<int>(taskType)].add(ns_count);
+    stats.taskTimings.logWaitTime(taskType, enqTime);
 }
 
 void KVBucket::logRunTime(TaskId taskType,
@@ -543,6 +596,7 @@ void KVBucket::logRunTime(TaskId taskType,
             std::chrono::duration_cast<std::chrono::microseconds>(runTime)
                     .count();
     stats.taskRuntimeHisto[static_cast<int>(taskType)].add(ns_count);
+    stats.taskTimings.logRunTime(taskType, runTime);
 }
 
 ENGINE_ERROR_CODE KVBucket::set(Item& itm,
@@ -579,7 +633,92 @@ ENGINE_ERROR_CODE KVBucket::set(Item& itm,
             return ENGINE_UNKNOWN_COLLECTION;
         } // now hold collections read access for the duration of the set
 
-        return vb->set(itm, cookie, engine, bgFetchDelay, predicate);
+        VBucketOpStats::Timer timer(vb->opStats, VBucketOpStats::Op::Store);
+        auto rv = vb->set(itm, cookie, engine, bgFetchDelay, predicate);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countSet(itm.getKey());
+        }
+        return rv;
+    }
+}
+
+ENGINE_ERROR_CODE KVBucket::arithmetic(const DocKey& key,
+                                       uint16_t vbucket,
+                                       bool increment,
+                                       uint64_t delta,
+                                       uint64_t cas,
+                                       const void* cookie,
+                                       uint64_t& result,
+                                       uint64_t& newCas,
+                                       mutation_descr_t& mutInfo) {
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        ++stats.numNotMyVBuckets;
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    // Obtain read-lock on VB state to ensure VB state changes are interlocked
+    // with this update. Leave the vbuckets which aren't plain active ones to
+    // the get and store of the frontend.
+    ReaderLockHolder rlh(vb->getStateLock());
+    if (vb->getState() != vbucket_state_active || vb->isTakeoverBackedUp()) {
+        return ENGINE_ENOTSUP;
+    }
+
+    { // collections read-lock scope
+        auto collectionsRHandle = vb->lockCollections();
+        if (!collectionsRHandle.doesKeyContainValidCollection(key)) {
+            return ENGINE_UNKNOWN_COLLECTION;
+        }
+
+        auto rv = vb->arithmetic(key,
+                                 increment,
+                                 delta,
+                                 cas,
+                                 cookie,
+                                 engine,
+                                 result,
+                                 newCas,
+                                 mutInfo);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countSet(key);
+        }
+        return rv;
+    }
+}
+
+ENGINE_ERROR_CODE KVBucket::appendPrepend(const DocKey& key,
+                                          uint16_t vbucket,
+                                          bool append,
+                                          cb::const_char_buffer value,
+                                          uint64_t cas,
+                                          const void* cookie,
+                                          uint64_t& newCas,
+                                          mutation_descr_t& mutInfo) {
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        ++stats.numNotMyVBuckets;
+        return ENGINE_NOT_MY_VBUCKET;
+    }
+
+    // As for arithmetic, only plain active vbuckets are handled here
+    ReaderLockHolder rlh(vb->getStateLock());
+    if (vb->getState() != vbucket_state_active || vb->isTakeoverBackedUp()) {
+        return ENGINE_ENOTSUP;
+    }
+
+    { // collections read-lock scope
+        auto collectionsRHandle = vb->lockCollections();
+        if (!collectionsRHandle.doesKeyContainValidCollection(key)) {
+            return ENGINE_UNKNOWN_COLLECTION;
+        }
+
+        auto rv = vb->appendPrepend(
+                key, append, value, cas, cookie, engine, newCas, mutInfo);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countSet(key);
+        }
+        return rv;
     }
 }
 
@@ -619,7 +758,12 @@ ENGINE_ERROR_CODE KVBucket::add(Item &itm, const void *cookie)
             return ENGINE_UNKNOWN_COLLECTION;
         } // now hold collections read access for the duration of the set
 
-        return vb->add(itm, cookie, engine, bgFetchDelay);
+        VBucketOpStats::Timer timer(vb->opStats, VBucketOpStats::Op::Store);
+        auto rv = vb->add(itm, cookie, engine, bgFetchDelay);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countSet(itm.getKey());
+        }
+        return rv;
     }
 }
 
@@ -651,7 +795,12 @@ ENGINE_ERROR_CODE KVBucket::replace(Item& itm,
             return ENGINE_UNKNOWN_COLLECTION;
         } // now hold collections read access for the duration of the set
 
-        return vb->replace(itm, cookie, engine, bgFetchDelay, predicate);
+        VBucketOpStats::Timer timer(vb->opStats, VBucketOpStats::Op::Store);
+        auto rv = vb->replace(itm, cookie, engine, bgFetchDelay, predicate);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countSet(itm.getKey());
+        }
+        return rv;
     }
 }
 
@@ -786,8 +935,10 @@ ENGINE_ERROR_CODE KVBucket::setVBucketState_UNLOCKED(
         if (config.isBfilterEnabled()) {
             // Initialize bloom filters upon vbucket creation during
             // bucket creation and rebalance
-            newvb->createFilter(config.getBfilterKeyCount(),
-                                config.getBfilterFpProb());
+            newvb->createFilter(
+                    config.getBfilterKeyCount(),
+                    config.getBfilterFpProb(),
+                    BloomFilter::parseLayout(config.getBfilterLayout()));
         }
 
         // The first checkpoint for active vbucket should start with id 2.
@@ -898,6 +1049,18 @@ bool KVBucket::resetVBucket(uint16_t vbid) {
     return resetVBucket_UNLOCKED(lockedVB, vbsetLock);
 }
 
+void KVBucket::resetAllVBuckets() {
+    std::unique_lock<std::mutex> vbsetLock(vbsetMutex);
+    for (auto vbid : vbMap.getBuckets()) {
+        auto lockedVB = getLockedVBucket(vbid);
+        if (!lockedVB || lockedVB->isBucketCreation() ||
+            lockedVB->isDeletionDeferred()) {
+            continue;
+        }
+        resetVBucket_UNLOCKED(lockedVB, vbsetLock);
+    }
+}
+
 bool KVBucket::resetVBucket_UNLOCKED(LockedVBucketPtr& vb,
                                      std::unique_lock<std::mutex>& vbset) {
     bool rv(false);
@@ -1031,6 +1194,8 @@ void KVBucket::appendAggregatedVBucketStats(VBucketCountVisitor& active,
     DO_STAT("vb_active_meta_data_memory", active.getMetaDataMemory());
     DO_STAT("vb_active_meta_data_disk", active.getMetaDataDisk());
     DO_STAT("vb_active_ht_memory", active.getHashtableMemory());
+    DO_STAT("vb_active_ht_hugepage_bytes",
+            active.getHashtableHugePageBytes());
     DO_STAT("vb_active_itm_memory", active.getItemMemory());
     DO_STAT("vb_active_ops_create", active.getOpsCreate());
     DO_STAT("vb_active_ops_update", active.getOpsUpdate());
@@ -1056,6 +1221,8 @@ void KVBucket::appendAggregatedVBucketStats(VBucketCountVisitor& active,
     DO_STAT("vb_replica_meta_data_memory", replica.getMetaDataMemory());
     DO_STAT("vb_replica_meta_data_disk", replica.getMetaDataDisk());
     DO_STAT("vb_replica_ht_memory", replica.getHashtableMemory());
+    DO_STAT("vb_replica_ht_hugepage_bytes",
+            replica.getHashtableHugePageBytes());
     DO_STAT("vb_replica_itm_memory", replica.getItemMemory());
     DO_STAT("vb_replica_ops_create", replica.getOpsCreate());
     DO_STAT("vb_replica_ops_update", replica.getOpsUpdate());
@@ -1081,6 +1248,8 @@ void KVBucket::appendAggregatedVBucketStats(VBucketCountVisitor& active,
     DO_STAT("vb_pending_meta_data_memory", pending.getMetaDataMemory());
     DO_STAT("vb_pending_meta_data_disk", pending.getMetaDataDisk());
     DO_STAT("vb_pending_ht_memory", pending.getHashtableMemory());
+    DO_STAT("vb_pending_ht_hugepage_bytes",
+            pending.getHashtableHugePageBytes());
     DO_STAT("vb_pending_itm_memory", pending.getItemMemory());
     DO_STAT("vb_pending_ops_create", pending.getOpsCreate());
     DO_STAT("vb_pending_ops_update", pending.getOpsUpdate());
@@ -1190,8 +1359,11 @@ void KVBucket::completeBGFetch(const DocKey& key,
         VBucketPtr vb = getVBucket(vbucket);
         if (vb) {
             VBucketBGFetchItem item{&gcb, cookie, init, isMeta};
-            ENGINE_ERROR_CODE status =
-                    vb->completeBGFetchForSingleItem(key, item, startTime);
+            std::unique_ptr<Item> completed;
+            ENGINE_ERROR_CODE status = vb->completeBGFetchForSingleItem(
+                    key, item, startTime, completed);
+            engine.completeParkedGet(
+                    item.cookie, key, vbucket, std::move(completed));
             engine.notifyIOComplete(item.cookie, status);
         } else {
             LOG(EXTENSION_LOG_INFO, "vb:%" PRIu16 " file was deleted in the "
@@ -1212,8 +1384,11 @@ void KVBucket::completeBGFetchMulti(uint16_t vbId,
         for (const auto& item : fetchedItems) {
             auto& key = item.first;
             auto* fetched_item = item.second;
+            std::unique_ptr<Item> completed;
             ENGINE_ERROR_CODE status = vb->completeBGFetchForSingleItem(
-                    key, *fetched_item, startTime);
+                    key, *fetched_item, startTime, completed);
+            engine.completeParkedGet(
+                    fetched_item->cookie, key, vbId, std::move(completed));
             engine.notifyIOComplete(fetched_item->cookie, status);
         }
         LOG(EXTENSION_LOG_DEBUG,
@@ -1272,14 +1447,87 @@ GetValue KVBucket::getInternal(const DocKey& key,
             return GetValue(NULL, ENGINE_UNKNOWN_COLLECTION);
         }
 
-        return vb->getInternal(key,
-                               cookie,
-                               engine,
-                               bgFetchDelay,
-                               options,
-                               diskDeleteAll,
-                               VBucket::GetKeyOnly::No);
+        VBucketOpStats::Timer timer(vb->opStats, VBucketOpStats::Op::Get);
+        auto gv = vb->getInternal(key,
+                                  cookie,
+                                  engine,
+                                  bgFetchDelay,
+                                  options,
+                                  diskDeleteAll,
+                                  VBucket::GetKeyOnly::No);
+        if (gv.getStatus() == ENGINE_SUCCESS) {
+            collectionsRHandle.countGet(key);
+        }
+        return gv;
+    }
+}
+
+std::vector<GetValue> KVBucket::getMulti(const std::vector<DocKey>& keys,
+                                         uint16_t vbucket,
+                                         const void* cookie,
+                                         get_options_t options) {
+    std::vector<GetValue> ret;
+    ret.reserve(keys.size());
+
+    auto notMyVBucket = [this, &keys, &ret]() {
+        stats.numNotMyVBuckets += keys.size();
+        for (size_t ii = 0; ii < keys.size(); ++ii) {
+            ret.emplace_back(nullptr, ENGINE_NOT_MY_VBUCKET);
+        }
+    };
+
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        notMyVBucket();
+        return ret;
+    }
+
+    ReaderLockHolder rlh(vb->getStateLock());
+    if (options & HONOR_STATES) {
+        vbucket_state_t vbState = vb->getState();
+        if (vbState == vbucket_state_dead ||
+            vbState == vbucket_state_replica) {
+            notMyVBucket();
+            return ret;
+        } else if (vbState == vbucket_state_pending) {
+            // Every key is notified separately when the vbucket changes
+            // state (just like if they were requested one by one)
+            for (size_t ii = 0; ii < keys.size(); ++ii) {
+                if (vb->addPendingOp(cookie)) {
+                    ret.emplace_back(nullptr, ENGINE_EWOULDBLOCK);
+                } else {
+                    break;
+                }
+            }
+            if (ret.size() == keys.size()) {
+                return ret;
+            }
+            // The vbucket changed state while we were adding the pending
+            // ops; look up the rest of the keys
+        }
+    }
+
+    auto collectionsRHandle = vb->lockCollections();
+    while (ret.size() < keys.size()) {
+        const auto& key = keys[ret.size()];
+        if (!collectionsRHandle.doesKeyContainValidCollection(key)) {
+            ret.emplace_back(nullptr, ENGINE_UNKNOWN_COLLECTION);
+        } else {
+            VBucketOpStats::Timer timer(vb->opStats, VBucketOpStats::Op::Get);
+            ret.emplace_back(vb->getInternal(key,
+                                             cookie,
+                                             engine,
+                                             bgFetchDelay,
+                                             options,
+                                             diskDeleteAll,
+                                             VBucket::GetKeyOnly::No));
+            if (ret.back().getStatus() == ENGINE_SUCCESS) {
+                collectionsRHandle.countGet(key);
+            }
+        }
     }
+
+    return ret;
 }
 
 GetValue KVBucket::getRandomKey() {
@@ -1352,6 +1600,49 @@ ENGINE_ERROR_CODE KVBucket::getMetaData(const DocKey& key,
     }
 }
 
+std::vector<cb::EngineErrorMetadataPair> KVBucket::getMetaDataMulti(
+        const std::vector<DocKey>& keys,
+        uint16_t vbucket,
+        const void* cookie) {
+    std::vector<cb::EngineErrorMetadataPair> ret(
+            keys.size(),
+            std::make_pair(cb::engine_errc::not_my_vbucket, item_info()));
+
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        stats.numNotMyVBuckets += keys.size();
+        return ret;
+    }
+
+    ReaderLockHolder rlh(vb->getStateLock());
+    if (vb->getState() == vbucket_state_dead ||
+        vb->getState() == vbucket_state_replica) {
+        stats.numNotMyVBuckets += keys.size();
+        return ret;
+    }
+
+    auto collectionsRHandle = vb->lockCollections();
+    for (size_t ii = 0; ii < keys.size(); ++ii) {
+        const auto& key = keys[ii];
+        if (!collectionsRHandle.doesKeyContainValidCollection(key)) {
+            ret[ii].first = cb::engine_errc::unknown_collection;
+            continue;
+        }
+
+        ItemMetaData metadata;
+        uint32_t deleted;
+        uint8_t datatype;
+        const auto status = vb->getMetaData(
+                key, cookie, engine, bgFetchDelay, metadata, deleted, datatype);
+        ret[ii].first = cb::engine_errc(status);
+        if (status == ENGINE_SUCCESS) {
+            ret[ii].second = to_item_info(metadata, datatype, deleted);
+        }
+    }
+
+    return ret;
+}
+
 ENGINE_ERROR_CODE KVBucket::setWithMeta(Item& itm,
                                         uint64_t cas,
                                         uint64_t* seqno,
@@ -1396,18 +1687,52 @@ ENGINE_ERROR_CODE KVBucket::setWithMeta(Item& itm,
             return ENGINE_UNKNOWN_COLLECTION;
         }
 
-        return vb->setWithMeta(itm,
-                               cas,
-                               seqno,
-                               cookie,
-                               engine,
-                               bgFetchDelay,
-                               checkConflicts,
-                               allowExisting,
-                               genBySeqno,
-                               genCas,
-                               isReplication);
+        auto rv = vb->setWithMeta(itm,
+                                  cas,
+                                  seqno,
+                                  cookie,
+                                  engine,
+                                  bgFetchDelay,
+                                  checkConflicts,
+                                  allowExisting,
+                                  genBySeqno,
+                                  genCas,
+                                  isReplication);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countSet(itm.getKey());
+        }
+        return rv;
+    }
+}
+
+std::pair<size_t, ENGINE_ERROR_CODE> KVBucket::setWithMetaBatch(
+        uint16_t vbucket,
+        const std::vector<Item*>& items,
+        const void* cookie,
+        PermittedVBStates permittedVBStates) {
+    VBucketPtr vb = getVBucket(vbucket);
+    if (!vb) {
+        ++stats.numNotMyVBuckets;
+        return {0, ENGINE_NOT_MY_VBUCKET};
+    }
+
+    ReaderLockHolder rlh(vb->getStateLock());
+    if (!permittedVBStates.test(vb->getState())) {
+        if (vb->getState() == vbucket_state_pending) {
+            if (vb->addPendingOp(cookie)) {
+                return {0, ENGINE_EWOULDBLOCK};
+            }
+        } else {
+            ++stats.numNotMyVBuckets;
+            return {0, ENGINE_NOT_MY_VBUCKET};
+        }
+    } else if (vb->isTakeoverBackedUp()) {
+        LOG(EXTENSION_LOG_DEBUG, "(vb %u) Returned TMPFAIL to a setWithMeta "
+            "batch, becuase takeover is lagging", vb->getId());
+        return {0, ENGINE_TMPFAIL};
     }
+
+    return vb->setWithMetaBatch(items, cookie, engine, bgFetchDelay);
 }
 
 GetValue KVBucket::getAndUpdateTtl(const DocKey& key, uint16_t vbucket,
@@ -1438,7 +1763,12 @@ GetValue KVBucket::getAndUpdateTtl(const DocKey& key, uint16_t vbucket,
             return GetValue(NULL, ENGINE_UNKNOWN_COLLECTION);
         }
 
-        return vb->getAndUpdateTtl(key, cookie, engine, bgFetchDelay, exptime);
+        auto gv = vb->getAndUpdateTtl(
+                key, cookie, engine, bgFetchDelay, exptime);
+        if (gv.getStatus() == ENGINE_SUCCESS) {
+            collectionsRHandle.countGet(key);
+        }
+        return gv;
     }
 }
 
@@ -1457,8 +1787,12 @@ GetValue KVBucket::getLocked(const DocKey& key, uint16_t vbucket,
             return GetValue(NULL, ENGINE_UNKNOWN_COLLECTION);
         }
 
-        return vb->getLocked(
+        auto gv = vb->getLocked(
                 key, currentTime, lockTimeout, cookie, engine, bgFetchDelay);
+        if (gv.getStatus() == ENGINE_SUCCESS) {
+            collectionsRHandle.countGet(key);
+        }
+        return gv;
     }
 }
 
@@ -1548,6 +1882,9 @@ std::string KVBucket::validateKey(const DocKey& key, uint16_t vbucket,
             return "item_deleted";
         }
 
+        // Compare the value as it is on disk
+        vb->ht.unlocked_inflateValue(hbl.getHTLock(), *v);
+
         if (diskItem.getFlags() != v->getFlags()) {
             return "flags_mismatch";
         } else if (v->isResident() && memcmp(diskItem.getData(),
@@ -1591,8 +1928,13 @@ ENGINE_ERROR_CODE KVBucket::deleteItem(const DocKey& key,
             return ENGINE_UNKNOWN_COLLECTION;
         }
 
-        return vb->deleteItem(
+        VBucketOpStats::Timer timer(vb->opStats, VBucketOpStats::Op::Delete);
+        auto rv = vb->deleteItem(
                 key, cas, cookie, engine, bgFetchDelay, itemMeta, mutInfo);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countDelete(key);
+        }
+        return rv;
     }
 }
 
@@ -1646,19 +1988,23 @@ ENGINE_ERROR_CODE KVBucket::deleteWithMeta(const DocKey& key,
             return ENGINE_UNKNOWN_COLLECTION;
         }
 
-        return vb->deleteWithMeta(key,
-                                  cas,
-                                  seqno,
-                                  cookie,
-                                  engine,
-                                  bgFetchDelay,
-                                  checkConflicts,
-                                  itemMeta,
-                                  backfill,
-                                  genBySeqno,
-                                  generateCas,
-                                  bySeqno,
-                                  isReplication);
+        auto rv = vb->deleteWithMeta(key,
+                                     cas,
+                                     seqno,
+                                     cookie,
+                                     engine,
+                                     bgFetchDelay,
+                                     checkConflicts,
+                                     itemMeta,
+                                     backfill,
+                                     genBySeqno,
+                                     generateCas,
+                                     bySeqno,
+                                     isReplication);
+        if (rv == ENGINE_SUCCESS) {
+            collectionsRHandle.countDelete(key);
+        }
+        return rv;
     }
 }
 
@@ -1701,6 +2047,7 @@ public:
     // This callback is invoked for set only.
     void callback(mutation_result &value) {
         if (value.first == 1) {
+            countFlushed(value.second ? 1 : 0);
             auto hbl = vbucket->ht.getLockedBucket(queuedItem->getKey());
             StoredValue* v = vbucket->fetchValidValue(hbl,
                                                       queuedItem->getKey(),
@@ -1781,6 +2128,7 @@ public:
         if (value >= 0) {
             // We have successfully removed an item from the disk, we
             // may now remove it from the hash table.
+            countFlushed(value > 0 ? -1 : 0);
             vbucket->deletedOnDiskCbk(*queuedItem, (value > 0));
         } else {
             LOG(EXTENSION_LOG_WARNING,
@@ -1794,8 +2142,43 @@ public:
         return vbucket;
     }
 
+    /**
+     * Record how long the item took to be persisted, now that the commit
+     * made it durable.
+     * @param now the (gethrtime) time of the end of the commit
+     */
+    void persisted(hrtime_t now) {
+        const hrtime_t enqueued = queuedItem->getEnqueueTime();
+        if (rejected || enqueued == 0 || now < enqueued) {
+            // Not queued through a checkpoint (e.g. a backfill item), or to
+            // be flushed again
+            return;
+        }
+        const hrtime_t latency = (now - enqueued) / 1000;
+        stats.persistenceLatencyHisto.add(latency);
+        vbucket->persistenceLatencyHisto.add(latency);
+    }
+
 private:
 
+    /**
+     * Count the item and the change to the number of documents on disk in
+     * the stats of its collection. Takes the collections read lock, so must
+     * be called before any hash table lock (the front end takes them in
+     * that order).
+     */
+    void countFlushed(int64_t diskItemsDelta) {
+        auto collectionsRHandle = vbucket->lockCollections();
+        auto* collectionStats =
+                collectionsRHandle.getStatsForKey(queuedItem->getKey());
+        if (collectionStats) {
+            collectionStats->diskItems.fetch_add(diskItemsDelta,
+                                                 std::memory_order_relaxed);
+            collectionStats->flushedBytes.fetch_add(
+                    queuedItem->size(), std::memory_order_relaxed);
+        }
+    }
+
     void redirty() {
         if (vbucket->isDeletionDeferred()) {
             // updating the member stats for the vbucket is not really necessary
@@ -1806,6 +2189,7 @@ private:
             return;
         }
         ++stats.flushFailed;
+        rejected = true;
         vbucket->markDirty(queuedItem->getKey());
         vbucket->rejectQueue.push(queuedItem);
         ++vbucket->opsReject;
@@ -1815,6 +2199,8 @@ private:
     VBucketPtr vbucket;
     EPStats& stats;
     uint64_t cas;
+    // True if the item failed to persist and was queued to be flushed again
+    bool rejected = false;
     DISALLOW_COPY_AND_ASSIGN(PersistenceCallback);
 };
 
@@ -1858,6 +2244,10 @@ void KVBucket::flushOneDeleteAll() {
 }
 
 int KVBucket::flushVBucket(uint16_t vbid) {
+    return flushVBucket(vbid, nullptr);
+}
+
+int KVBucket::flushVBucket(uint16_t vbid, FlushGroup* group) {
     KVShard *shard = vbMap.getShardByVbId(vbid);
     if (diskDeleteAll && !deleteAllTaskCtx.delay) {
         if (shard->getId() == EP_PRIMARY_SHARD) {
@@ -1876,6 +2266,7 @@ int KVBucket::flushVBucket(uint16_t vbid) {
         return RETRY_FLUSH_VBUCKET; // to avoid blocking flusher
     }
     if (vb) {
+        MEMCACHED_EP_FLUSH_START(vbid);
         std::vector<queued_item> items;
         KVStore *rwUnderlying = getRWUnderlying(vbid);
 
@@ -1887,93 +2278,108 @@ int KVBucket::flushVBucket(uint16_t vbid) {
         // Append any 'backfill' items (mutations added by a DCP stream).
         vb->getBackfillItems(items);
 
-        // Append all items outstanding for the persistence cursor.
-        snapshot_range_t range;
-        hrtime_t _begin_ = gethrtime();
-        range = vb->checkpointManager->getAllItemsForCursor(
-                CheckpointManager::pCursorName, items);
-        stats.persistenceCursorGetItemsHisto.add((gethrtime() - _begin_) / 1000);
-
-        if (!items.empty()) {
-            while (!rwUnderlying->begin()) {
-                ++stats.beginFailed;
-                LOG(EXTENSION_LOG_WARNING, "Failed to start a transaction!!! "
-                    "Retry in 1 sec ...");
-                sleep(1);
+        Item *prev = NULL;
+        auto vbstate = vb->getVBucketState();
+        uint64_t maxSeqno = 0;
+
+        bool mustCheckpointVBState = false;
+        bool inTransaction = false;
+        std::list<PersistenceCallback*>& pcbs = rwUnderlying->getPersistenceCbList();
+
+        SystemEventFlush sef;
+
+        // Flush one item; superseded is true if a newer item for the same
+        // key is flushed too, in which case this one needn't go to disk.
+        auto flushItem = [&](const queued_item& item, bool superseded) {
+            if (!inTransaction) {
+                while (!rwUnderlying->begin()) {
+                    ++stats.beginFailed;
+                    LOG(EXTENSION_LOG_WARNING, "Failed to start a transaction!!! "
+                        "Retry in 1 sec ...");
+                    sleep(1);
+                }
+                inTransaction = true;
             }
-            rwUnderlying->optimizeWrites(items);
-
-            Item *prev = NULL;
-            auto vbstate = vb->getVBucketState();
-            uint64_t maxSeqno = 0;
-            range.start = std::max(range.start, vbstate.lastSnapStart);
 
-            bool mustCheckpointVBState = false;
-            std::list<PersistenceCallback*>& pcbs = rwUnderlying->getPersistenceCbList();
+            if (!item->shouldPersist()) {
+                return;
+            }
 
-            SystemEventFlush sef;
+            // Pass the Item through the SystemEventFlush which may filter
+            // the item away (return Skip).
+            if (sef.process(item) == ProcessStatus::Skip) {
+                // The item has no further flushing actions i.e. we've
+                // absorbed it in the process function.
+                // Update stats and carry-on
+                --stats.diskQueueSize;
+                vb->doStatsForFlushing(*item, item->size());
+                return;
+            }
 
-            for (const auto& item : items) {
+            if (item->getOperation() == queue_op::set_vbucket_state) {
+                // No actual item explicitly persisted to (this op exists
+                // to ensure a commit occurs with the current vbstate);
+                // flag that we must trigger a snapshot even if there are
+                // no 'real' items in the checkpoint.
+                mustCheckpointVBState = true;
 
-                if (!item->shouldPersist()) {
-                    continue;
+                // Update queuing stats how this item has logically been
+                // processed.
+                --stats.diskQueueSize;
+                vb->doStatsForFlushing(*item, item->size());
+
+            } else if (!superseded) {
+                prev = item.get();
+                ++items_flushed;
+                PersistenceCallback* cb =
+                        flushOneDelOrSet(item, vb.getVB());
+                if (cb) {
+                    pcbs.push_back(cb);
                 }
 
-                // Pass the Item through the SystemEventFlush which may filter
-                // the item away (return Skip).
-                if (sef.process(item) == ProcessStatus::Skip) {
-                    // The item has no further flushing actions i.e. we've
-                    // absorbed it in the process function.
-                    // Update stats and carry-on
-                    --stats.diskQueueSize;
-                    vb->doStatsForFlushing(*item, item->size());
-                    continue;
+                maxSeqno = std::max(maxSeqno, (uint64_t)item->getBySeqno());
+                vbstate.maxCas = std::max(vbstate.maxCas, item->getCas());
+                if (item->isDeleted()) {
+                    vbstate.maxDeletedSeqno =
+                            std::max(vbstate.maxDeletedSeqno,
+                                     item->getRevSeqno());
                 }
+                ++stats.flusher_todo;
 
-                if (item->getOperation() == queue_op::set_vbucket_state) {
-                    // No actual item explicitly persisted to (this op exists
-                    // to ensure a commit occurs with the current vbstate);
-                    // flag that we must trigger a snapshot even if there are
-                    // no 'real' items in the checkpoint.
-                    mustCheckpointVBState = true;
-
-                    // Update queuing stats how this item has logically been
-                    // processed.
-                    --stats.diskQueueSize;
-                    vb->doStatsForFlushing(*item, item->size());
-
-                } else if (!prev || prev->getKey() != item->getKey()) {
-                    prev = item.get();
-                    ++items_flushed;
-                    PersistenceCallback* cb =
-                            flushOneDelOrSet(item, vb.getVB());
-                    if (cb) {
-                        pcbs.push_back(cb);
-                    }
-
-                    maxSeqno = std::max(maxSeqno, (uint64_t)item->getBySeqno());
-                    vbstate.maxCas = std::max(vbstate.maxCas, item->getCas());
-                    if (item->isDeleted()) {
-                        vbstate.maxDeletedSeqno =
-                                std::max(vbstate.maxDeletedSeqno,
-                                         item->getRevSeqno());
-                    }
-                    ++stats.flusher_todo;
+            } else {
+                // A newer item for the same key is flushed - don't need
+                // to flush this one to disk.
+                --stats.diskQueueSize;
+                vb->doStatsForFlushing(*item, item->size());
+            }
+        };
 
-                } else {
-                    // Item is the same key as the previous[1] one - don't need
-                    // to flush to disk.
-                    // [1] Previous here really means 'next' - optimizeWrites()
-                    //     above has actually re-ordered items such that items
-                    //     with the same key are ordered from high->low seqno.
-                    //     This means we only write the highest (i.e. newest)
-                    //     item for a given key, and discard any duplicate,
-                    //     older items.
-                    --stats.diskQueueSize;
-                    vb->doStatsForFlushing(*item, item->size());
-                }
+        snapshot_range_t range;
+        hrtime_t _begin_ = gethrtime();
+        if (items.empty()) {
+            // The common case: only the items outstanding for the
+            // persistence cursor are to be flushed, so write them straight
+            // from the checkpoints instead of copying and sorting them; the
+            // checkpoint indexes tell which ones are superseded.
+            range = vb->checkpointManager->visitItemsForCursor(
+                    CheckpointManager::pCursorName, flushItem);
+        } else {
+            // Append all items outstanding for the persistence cursor.
+            range = vb->checkpointManager->getAllItemsForCursor(
+                    CheckpointManager::pCursorName, items);
+            rwUnderlying->optimizeWrites(items);
+            for (const auto& item : items) {
+                // optimizeWrites() has re-ordered the items such that items
+                // with the same key are ordered from high->low seqno, so an
+                // item with the same key as the previously flushed one is
+                // older than it.
+                flushItem(item, prev && prev->getKey() == item->getKey());
             }
+        }
+        stats.persistenceCursorGetItemsHisto.add((gethrtime() - _begin_) / 1000);
 
+        if (inTransaction) {
+            range.start = std::max(range.start, vbstate.lastSnapStart);
 
             {
                 ReaderLockHolder rlh(vb->getStateLock());
@@ -2020,6 +2426,17 @@ int KVBucket::flushVBucket(uint16_t vbid) {
                 }
             }
 
+            // In a group commit leave the commit (and the rest of the flush)
+            // to commitFlushGroup(), keeping the vbucket locked until then.
+            // A flush writing the collections manifest commits on its own,
+            // as the manifest is passed to the commit.
+            if (group && items_flushed > 0 &&
+                !sef.getCollectionsManifestItem()) {
+                group->pending.push_back(
+                        {std::move(vb), range, items_flushed, flush_start});
+                return items_flushed;
+            }
+
             /* Perform an explicit commit to disk if the commit
              * interval reaches zero and if there is a non-zero number
              * of items to flush.
@@ -2033,53 +2450,103 @@ int KVBucket::flushVBucket(uint16_t vbid) {
                     LOG(EXTENSION_LOG_INFO, "VBucket %" PRIu16 " created", vbid);
                 }
             }
+        }
 
-            hrtime_t flush_end = gethrtime();
-            uint64_t trans_time = (flush_end - flush_start) / 1000000;
-
-            lastTransTimePerItem.store((items_flushed == 0) ? 0 :
-                                       static_cast<double>(trans_time) /
-                                       static_cast<double>(items_flushed));
-            stats.cumulativeFlushTime.fetch_add(trans_time);
-            stats.flusher_todo.store(0);
-            stats.totalPersistVBState++;
-
-            if (vb->rejectQueue.empty()) {
-                vb->setPersistedSnapshot(range.start, range.end);
-                uint64_t highSeqno = rwUnderlying->getLastPersistedSeqno(vbid);
-                if (highSeqno > 0 &&
-                    highSeqno != vb->getPersistenceSeqno()) {
-                    vb->setPersistenceSeqno(highSeqno);
-                }
+        return completeFlushVBucket(
+                *vb, *rwUnderlying, inTransaction, range, items_flushed,
+                flush_start);
+    }
+
+    return items_flushed;
+}
+
+int KVBucket::completeFlushVBucket(VBucket& vb,
+                                   KVStore& rwUnderlying,
+                                   bool inTransaction,
+                                   const snapshot_range_t& range,
+                                   int items_flushed,
+                                   hrtime_t flush_start) {
+    const uint16_t vbid = vb.getId();
+    if (inTransaction) {
+        hrtime_t flush_end = gethrtime();
+        uint64_t trans_time = (flush_end - flush_start) / 1000000;
+        MEMCACHED_EP_FLUSH_DONE(
+                vbid, items_flushed, uint64_t(flush_end - flush_start) / 1000);
+
+        lastTransTimePerItem.store((items_flushed == 0) ? 0 :
+                                   static_cast<double>(trans_time) /
+                                   static_cast<double>(items_flushed));
+        stats.cumulativeFlushTime.fetch_add(trans_time);
+        stats.flusher_todo.store(0);
+        stats.totalPersistVBState++;
+
+        if (vb.rejectQueue.empty()) {
+            vb.setPersistedSnapshot(range.start, range.end);
+            uint64_t highSeqno = rwUnderlying.getLastPersistedSeqno(vbid);
+            if (highSeqno > 0 &&
+                highSeqno != vb.getPersistenceSeqno()) {
+                vb.setPersistenceSeqno(highSeqno);
             }
         }
+    }
 
-        rwUnderlying->pendingTasks();
+    rwUnderlying.pendingTasks();
 
-        if (vb->checkpointManager->getNumCheckpoints() > 1) {
-            wakeUpCheckpointRemover();
-        }
+    if (vb.checkpointManager->getNumCheckpoints() > 1) {
+        wakeUpCheckpointRemover();
+    }
 
-        if (vb->rejectQueue.empty()) {
-            vb->checkpointManager->itemsPersisted();
-            uint64_t seqno = vb->getPersistenceSeqno();
-            uint64_t chkid =
-                    vb->checkpointManager->getPersistenceCursorPreChkId();
-            vb->notifyHighPriorityRequests(
-                    engine, seqno, HighPriorityVBNotify::Seqno);
-            vb->notifyHighPriorityRequests(
-                    engine, chkid, HighPriorityVBNotify::ChkPersistence);
-            if (chkid > 0 && chkid != vb->getPersistenceCheckpointId()) {
-                vb->setPersistenceCheckpointId(chkid);
-            }
-        } else {
-            return RETRY_FLUSH_VBUCKET;
+    if (vb.rejectQueue.empty()) {
+        vb.checkpointManager->itemsPersisted();
+        uint64_t seqno = vb.getPersistenceSeqno();
+        uint64_t chkid =
+                vb.checkpointManager->getPersistenceCursorPreChkId();
+        vb.notifyHighPriorityRequests(
+                engine, seqno, HighPriorityVBNotify::Seqno);
+        vb.notifyHighPriorityRequests(
+                engine, chkid, HighPriorityVBNotify::ChkPersistence);
+        if (chkid > 0 && chkid != vb.getPersistenceCheckpointId()) {
+            vb.setPersistenceCheckpointId(chkid);
         }
+    } else {
+        return RETRY_FLUSH_VBUCKET;
     }
 
     return items_flushed;
 }
 
+std::vector<uint16_t> KVBucket::commitFlushGroup(FlushGroup& group) {
+    std::vector<uint16_t> retry;
+    if (group.pending.empty()) {
+        return retry;
+    }
+
+    // All the vbuckets of a group belong to the same shard, hence they share
+    // the KVStore transaction.
+    KVStore* rwUnderlying =
+            getRWUnderlying(group.pending.front().vb->getId());
+    commit(*rwUnderlying, nullptr);
+    ++stats.flusherGroupCommits;
+    stats.flusherGroupCommitVBuckets.fetch_add(group.pending.size());
+
+    for (auto& flushed : group.pending) {
+        VBucket& vb = *flushed.vb;
+        if (vb.setBucketCreation(false)) {
+            LOG(EXTENSION_LOG_INFO, "VBucket %" PRIu16 " created", vb.getId());
+        }
+        if (completeFlushVBucket(vb,
+                                 *rwUnderlying,
+                                 true,
+                                 flushed.range,
+                                 flushed.itemsFlushed,
+                                 flushed.flushStart) == RETRY_FLUSH_VBUCKET) {
+            retry.push_back(vb.getId());
+        }
+    }
+    group.pending.clear();
+    return retry;
+}
+
 void KVBucket::commit(KVStore& kvstore, const Item* collectionsManifest) {
     std::list<PersistenceCallback*>& pcbs = kvstore.getPersistenceCbList();
     BlockTimer timer(&stats.diskCommitHisto, "disk_commit", stats.timingLog);
@@ -2092,6 +2559,11 @@ void KVBucket::commit(KVStore& kvstore, const Item* collectionsManifest) {
         sleep(1);
     }
 
+    const hrtime_t durable = gethrtime();
+    for (auto* pcb : pcbs) {
+        pcb->persisted(durable);
+    }
+
     //Update the total items in the case of full eviction
     if (getItemEvictionPolicy() == FULL_EVICTION) {
         std::unordered_set<uint16_t> vbSet;
@@ -2115,6 +2587,9 @@ void KVBucket::commit(KVStore& kvstore, const Item* collectionsManifest) {
 
     ++stats.flusherCommits;
     hrtime_t commit_end = gethrtime();
+    auto& kvstoreStats = kvstore.getKVStoreStat();
+    kvstoreStats.lastCommitTime = (commit_end - commit_start) / 1000;
+    ++kvstoreStats.numCommits;
     uint64_t commit_time = (commit_end - commit_start) / 1000000;
     stats.commit_time.store(commit_time);
     stats.cumulativeCommitTime.fetch_add(commit_time);
@@ -2253,6 +2728,14 @@ bool KVBucket::isWarmingUp() {
     return warmupTask && !warmupTask->isComplete();
 }
 
+bool KVBucket::isVBucketWarmingUp(uint16_t vbid) {
+    return warmupTask && !warmupTask->isVBucketAvailable(vbid);
+}
+
+bool KVBucket::isWarmingUpActiveVBuckets() {
+    return warmupTask && !warmupTask->areActiveVBucketsAvailable();
+}
+
 bool KVBucket::shouldSetVBStateBlock(const void* cookie) {
     if (warmupTask) {
         return warmupTask->shouldSetVBStateBlock(cookie);
@@ -2470,6 +2953,32 @@ size_t KVBucket::visit(std::unique_ptr<VBucketVisitor> visitor,
     return ExecutorPool::get()->schedule(task);
 }
 
+void KVBucket::visit(std::vector<std::unique_ptr<VBucketVisitor>> visitors,
+                     const char* lbl,
+                     TaskId id,
+                     double sleepTime,
+                     std::chrono::microseconds maxExpectedDuration) {
+    if (visitors.empty()) {
+        return;
+    }
+
+    std::vector<uint16_t> vbs;
+    const VBucketFilter& vbFilter = visitors.front()->getVBucketFilter();
+    for (auto vbid : vbMap.getBuckets()) {
+        if (vbFilter(vbid)) {
+            vbs.push_back(vbid);
+        }
+    }
+    auto queue = std::make_shared<VBCBAdaptor::VBucketQueue>(std::move(vbs));
+
+    for (auto& visitor : visitors) {
+        auto task = std::make_shared<VBCBAdaptor>(
+                this, id, std::move(visitor), queue, lbl, sleepTime);
+        task->setMaxExpectedDuration(maxExpectedDuration);
+        ExecutorPool::get()->schedule(task);
+    }
+}
+
 KVBucket::Position KVBucket::pauseResumeVisit(PauseResumeVBVisitor& visitor,
                                               Position& start_pos) {
     uint16_t vbid = start_pos.vbucket_id;
@@ -2502,7 +3011,19 @@ VBCBAdaptor::VBCBAdaptor(KVBucket* s,
                          const char* l,
                          double sleep,
                          bool shutdown)
+    : VBCBAdaptor(s, id, std::move(v), nullptr, l, sleep, shutdown) {
+}
+
+VBCBAdaptor::VBCBAdaptor(KVBucket* s,
+                         TaskId id,
+                         std::unique_ptr<VBucketVisitor> v,
+                         std::shared_ptr<VBucketQueue> queue,
+                         const char* l,
+                         double sleep,
+                         bool shutdown)
     : GlobalTask(&s->getEPEngine(), id, 0, shutdown),
+      vbQueue(std::move(queue)),
+      pending(false),
       store(s),
       visitor(std::move(v)),
       label(l),
@@ -2510,17 +3031,23 @@ VBCBAdaptor::VBCBAdaptor(KVBucket* s,
       maxDuration(std::chrono::seconds::max()),
       currentvb(0) {
     updateDescription();
-    const VBucketFilter& vbFilter = visitor->getVBucketFilter();
-    for (auto vbid : store->getVBuckets().getBuckets()) {
-        if (vbFilter(vbid)) {
-            vbList.push(vbid);
+    if (!vbQueue) {
+        std::vector<uint16_t> vbs;
+        const VBucketFilter& vbFilter = visitor->getVBucketFilter();
+        for (auto vbid : store->getVBuckets().getBuckets()) {
+            if (vbFilter(vbid)) {
+                vbs.push_back(vbid);
+            }
         }
+        vbQueue = std::make_shared<VBucketQueue>(std::move(vbs));
     }
 }
 
 bool VBCBAdaptor::run(void) {
-    if (!vbList.empty()) {
-        currentvb.store(vbList.front());
+    uint16_t vbid = currentvb.load();
+    if (pending || vbQueue->pop(vbid)) {
+        pending = true;
+        currentvb.store(vbid);
         updateDescription();
         VBucketPtr vb = store->getVBucket(currentvb);
         if (vb) {
@@ -2528,18 +3055,35 @@ bool VBCBAdaptor::run(void) {
                 snooze(sleepTime);
                 return true;
             }
+            // A visitor with a run budget yields once it is spent part way
+            // through the vbucket, and resumes it on the next run.
+            visitor->getBudget().startRun(visitor->getRunBudget());
             visitor->visitBucket(vb);
+            endBudgetedRun();
+            if (visitor->isBucketPaused(vbid)) {
+                return true;
+            }
         }
-        vbList.pop();
+        pending = false;
     }
 
-    bool isdone = vbList.empty();
+    bool isdone = vbQueue->empty();
     if (isdone) {
         visitor->complete();
     }
     return !isdone;
 }
 
+void VBCBAdaptor::endBudgetedRun() {
+    auto& budget = visitor->getBudget();
+    if (budget.isLimited()) {
+        store->getEPEngine()
+                .getEpStats()
+                .visitorRuns[static_cast<size_t>(getTypeId())]
+                .record(budget.endRun());
+    }
+}
+
 void VBCBAdaptor::updateDescription() {
     std::unique_lock<std::mutex> lock(description.mutex);
     description.text =
@@ -2557,7 +3101,9 @@ void KVBucket::resetUnderlyingStats(void)
     for (size_t i = 0; i < GlobalTask::allTaskIds.size(); i++) {
         stats.schedulingHisto[i].reset();
         stats.taskRuntimeHisto[i].reset();
+        stats.visitorRuns[i].reset();
     }
+    stats.taskTimings.reset();
 }
 
 void KVBucket::addKVStoreStats(ADD_STAT add_stat, const void* cookie) {
@@ -2575,6 +3121,16 @@ void KVBucket::addKVStoreStats(ADD_STAT add_stat, const void* cookie) {
         for (auto* store : underlyingSet) {
             store->addStats(add_stat, cookie);
         }
+
+        // The decisions of the flusher's batch controller, alongside the
+        // stats of the KVStore it flushes to
+        auto* flusher = vbMap.shards[i]->getFlusher();
+        if (flusher) {
+            flusher->getBatchController().addStats(
+                    "rw_" + std::to_string(vbMap.shards[i]->getId()),
+                    add_stat,
+                    cookie);
+        }
     }
 }
 
@@ -40,6 +40,43 @@ class Manager;
  */
 class VBCBAdaptor : public GlobalTask {
 public:
+    /**
+     * The vbuckets left to visit, which may be shared by a group of
+     * VBCBAdaptors visiting them concurrently.
+     */
+    class VBucketQueue {
+    public:
+        explicit VBucketQueue(std::vector<uint16_t> vbs)
+            : vbuckets(std::move(vbs)), next(0) {
+        }
+
+        /**
+         * Take the next vbucket to visit.
+         *
+         * @return false if there are no vbuckets left
+         */
+        bool pop(uint16_t& vbid) {
+            const size_t index = next.fetch_add(1);
+            if (index >= vbuckets.size()) {
+                return false;
+            }
+            vbid = vbuckets[index];
+            return true;
+        }
+
+        bool empty() const {
+            return next.load() >= vbuckets.size();
+        }
+
+    private:
+        const std::vector<uint16_t> vbuckets;
+        std::atomic<size_t> next;
+    };
+
+    /**
+     * Create a task visiting the vbuckets accepted by the filter of the
+     * visitor.
+     */
     VBCBAdaptor(KVBucket* s,
                 TaskId id,
                 std::unique_ptr<VBucketVisitor> v,
@@ -47,6 +84,18 @@ public:
                 double sleep = 0,
                 bool shutdown = false);
 
+    /**
+     * Create a task visiting the vbuckets taken from the given queue
+     * (concurrently with the other tasks taking vbuckets from it).
+     */
+    VBCBAdaptor(KVBucket* s,
+                TaskId id,
+                std::unique_ptr<VBucketVisitor> v,
+                std::shared_ptr<VBucketQueue> queue,
+                const char* l,
+                double sleep = 0,
+                bool shutdown = false);
+
     cb::const_char_buffer getDescription() {
         std::unique_lock<std::mutex> lock(description.mutex);
         return description.text;
@@ -64,7 +113,10 @@ public:
     bool run(void);
 
 private:
-    std::queue<uint16_t>        vbList;
+    std::shared_ptr<VBucketQueue> vbQueue;
+    // The vbucket we took from vbQueue but haven't visited yet (because
+    // the visitor asked us to pause)
+    bool                        pending;
     KVBucket  *store;
     std::unique_ptr<VBucketVisitor> visitor;
     const char                 *label;
@@ -80,13 +132,53 @@ private:
     /// re-calculate the description (when the currentVB changes).
     void updateDescription();
 
+    /// End the run of a visitor with a run budget, recording its stats.
+    void endBudgetedRun();
+
     DISALLOW_COPY_AND_ASSIGN(VBCBAdaptor);
 };
 
+/**
+ * A group commit of the flusher of a shard. The vbuckets flushed into it
+ * stage their items in the transaction of the shard's KVStore without
+ * committing it, and they stay locked until KVBucket::commitFlushGroup()
+ * commits all of them at once.
+ */
+class FlushGroup {
+public:
+    bool empty() const {
+        return pending.empty();
+    }
+
+    size_t size() const {
+        return pending.size();
+    }
+
+private:
+    friend class KVBucket;
+
+    /// A vbucket whose items are staged but not committed yet
+    struct PendingFlush {
+        LockedVBucketPtr vb;
+        snapshot_range_t range;
+        int itemsFlushed;
+        hrtime_t flushStart;
+    };
+
+    std::vector<PendingFlush> pending;
+};
+
 const uint16_t EP_PRIMARY_SHARD = 0;
 class KVShard;
-
-typedef std::pair<uint16_t, ExTask> CompTaskEntry;
+class RocksDBMemoryBudget;
+
+/// A scheduled compaction task
+struct CompTaskEntry {
+    uint16_t dbFileId;
+    ExTask task;
+    /// The fraction of the file which isn't live data when scheduled
+    double fragmentation;
+};
 
 
 /**
@@ -146,6 +238,35 @@ public:
      */
     ENGINE_ERROR_CODE add(Item &item, const void *cookie);
 
+    /**
+     * Increment or decrement a counter in the store.
+     * @return ENGINE_ENOTSUP if the counter has to be updated with get and
+     *         store instead, otherwise the result of the operation
+     */
+    ENGINE_ERROR_CODE arithmetic(const DocKey& key,
+                                 uint16_t vbucket,
+                                 bool increment,
+                                 uint64_t delta,
+                                 uint64_t cas,
+                                 const void* cookie,
+                                 uint64_t& result,
+                                 uint64_t& newCas,
+                                 mutation_descr_t& mutInfo);
+
+    /**
+     * Append or prepend data to a document in the store.
+     * @return ENGINE_ENOTSUP if the document has to be updated with get and
+     *         store instead, otherwise the result of the operation
+     */
+    ENGINE_ERROR_CODE appendPrepend(const DocKey& key,
+                                    uint16_t vbucket,
+                                    bool append,
+                                    cb::const_char_buffer value,
+                                    uint64_t cas,
+                                    const void* cookie,
+                                    uint64_t& newCas,
+                                    mutation_descr_t& mutInfo);
+
     /**
      * Replace an item in the store.
      * @param item the item to replace. On success, this will have its seqno
@@ -186,6 +307,11 @@ public:
                            options);
     }
 
+    std::vector<GetValue> getMulti(const std::vector<DocKey>& keys,
+                                   uint16_t vbucket,
+                                   const void* cookie,
+                                   get_options_t options);
+
     GetValue getRandomKey(void);
 
     /**
@@ -228,6 +354,11 @@ public:
                                   uint32_t& deleted,
                                   uint8_t& datatype);
 
+    std::vector<cb::EngineErrorMetadataPair> getMetaDataMulti(
+            const std::vector<DocKey>& keys,
+            uint16_t vbucket,
+            const void* cookie);
+
     ENGINE_ERROR_CODE setWithMeta(
             Item& item,
             uint64_t cas,
@@ -241,6 +372,12 @@ public:
             ExtendedMetaData* emd = NULL,
             bool isReplication = false);
 
+    std::pair<size_t, ENGINE_ERROR_CODE> setWithMetaBatch(
+            uint16_t vbucket,
+            const std::vector<Item*>& items,
+            const void* cookie,
+            PermittedVBStates permittedVBStates);
+
     /**
      * Retrieve a value, but update its TTL first
      *
@@ -474,6 +611,12 @@ public:
      */
     bool resetVBucket(uint16_t vbid);
 
+    /**
+     * Reset all the vbuckets (see resetVBucket) while holding the vbset
+     * lock, so that no vbucket is created or deleted half way through.
+     */
+    void resetAllVBuckets();
+
     /**
      * Run a vBucket visitor, visiting all items. Synchronous.
      */
@@ -490,6 +633,12 @@ public:
                  double sleepTime,
                  std::chrono::microseconds maxExpectedDuration);
 
+    void visit(std::vector<std::unique_ptr<VBucketVisitor>> visitors,
+               const char* lbl,
+               TaskId id,
+               double sleepTime,
+               std::chrono::microseconds maxExpectedDuration) override;
+
     Position pauseResumeVisit(PauseResumeVBVisitor& visitor,
                               Position& start_pos);
 
@@ -584,6 +733,14 @@ public:
         return vbMap;
     }
 
+    /**
+     * The block cache and memtables shared by the RocksDB shards of the
+     * bucket, or nullptr if it doesn't use RocksDB.
+     */
+    const std::shared_ptr<RocksDBMemoryBudget>& getRocksDBMemoryBudget() {
+        return rocksDBMemoryBudget;
+    }
+
     EventuallyPersistentEngine& getEPEngine() {
         return engine;
     }
@@ -655,6 +812,10 @@ public:
 
     bool isWarmingUp();
 
+    bool isVBucketWarmingUp(uint16_t vbid);
+
+    bool isWarmingUpActiveVBuckets();
+
     /**
      * Method checks with Warmup if a setVBState should block.
      * On returning true, Warmup will have saved the cookie ready for
@@ -680,6 +841,26 @@ public:
      */
     int flushVBucket(uint16_t vbid);
 
+    /**
+     * Flushes all items waiting for persistence in a given vbucket, as part
+     * of a group commit if group is non-null: if the vbucket has items to
+     * write they are staged in the KVStore transaction, and the flush is
+     * completed by commitFlushGroup().
+     *
+     * @param vbid The id of the vbucket to flush
+     * @param group The group commit to join, or nullptr to commit now
+     * @return The number of items flushed
+     */
+    int flushVBucket(uint16_t vbid, FlushGroup* group);
+
+    /**
+     * Commit the items staged by the vbuckets of a group commit, and
+     * complete their flush.
+     *
+     * @return The vbuckets which must be flushed again
+     */
+    std::vector<uint16_t> commitFlushGroup(FlushGroup& group);
+
     void commit(KVStore& kvstore, const Item* collectionsManifest);
 
     void addKVStoreStats(ADD_STAT add_stat, const void* cookie);
@@ -745,6 +926,30 @@ public:
         compactionWriteQueueCap = to;
     }
 
+    /**
+     * The maximum time the flushers may defer the flush of a vbucket with
+     * few dirty items (see FlushBatchController).
+     */
+    std::chrono::milliseconds getFlusherMaxBatchDelay() const {
+        return std::chrono::milliseconds(flusherMaxBatchDelay.load());
+    }
+
+    void setFlusherMaxBatchDelay(std::chrono::milliseconds to) {
+        flusherMaxBatchDelay = to.count();
+    }
+
+    /**
+     * The maximum time the background fetchers may wait after the first
+     * miss queued to them, to fetch more misses in the same pass.
+     */
+    std::chrono::microseconds getBgFetcherCoalesceWindow() const {
+        return std::chrono::microseconds(bgFetcherCoalesceWindow.load());
+    }
+
+    void setBgFetcherCoalesceWindow(std::chrono::microseconds to) {
+        bgFetcherCoalesceWindow = to.count();
+    }
+
     void setCompactionExpMemThreshold(size_t to) {
         compactionExpMemThreshold = static_cast<double>(to) / 100.0;
     }
@@ -831,6 +1036,20 @@ protected:
     PersistenceCallback* flushOneDelOrSet(const queued_item &qi,
                                           VBucketPtr &vb);
 
+    /**
+     * The end of the flush of a vbucket, once its items are committed:
+     * record that they are persisted and notify whoever waits for them.
+     *
+     * @return items_flushed, or RETRY_FLUSH_VBUCKET if some items were
+     *         rejected and must be flushed again
+     */
+    int completeFlushVBucket(VBucket& vb,
+                             KVStore& rwUnderlying,
+                             bool inTransaction,
+                             const snapshot_range_t& range,
+                             int items_flushed,
+                             hrtime_t flush_start);
+
     /**
      * Get metadata and value for a given key
      *
@@ -881,6 +1100,8 @@ protected:
     EventuallyPersistentEngine     &engine;
     EPStats                        &stats;
     std::unique_ptr<Warmup> warmupTask;
+    // Before vbMap, as the shards it creates share it
+    std::shared_ptr<RocksDBMemoryBudget> rocksDBMemoryBudget;
     VBucketMap                      vbMap;
     ExTask itemPagerTask;
     ExTask                          chkTask;
@@ -889,6 +1110,10 @@ protected:
 
     size_t                          compactionWriteQueueCap;
     float                           compactionExpMemThreshold;
+    // In milliseconds
+    std::atomic<size_t> flusherMaxBatchDelay;
+    // In microseconds
+    std::atomic<size_t> bgFetcherCoalesceWindow;
 
     /* Vector of mutexes for each vbucket
      * Used by flush operations: flushVB, deleteVB, compactVB, snapshotVB */
@@ -108,6 +108,37 @@ public:
      */
     virtual ENGINE_ERROR_CODE add(Item &item, const void *cookie) = 0;
 
+    /**
+     * Increment or decrement a counter in the store (see
+     * ENGINE_HANDLE_V1::arithmetic).
+     * @return ENGINE_ENOTSUP if the counter has to be updated with get and
+     *         store instead, otherwise the result of the operation
+     */
+    virtual ENGINE_ERROR_CODE arithmetic(const DocKey& key,
+                                         uint16_t vbucket,
+                                         bool increment,
+                                         uint64_t delta,
+                                         uint64_t cas,
+                                         const void* cookie,
+                                         uint64_t& result,
+                                         uint64_t& newCas,
+                                         mutation_descr_t& mutInfo) = 0;
+
+    /**
+     * Append or prepend data to a document in the store (see
+     * ENGINE_HANDLE_V1::append_prepend).
+     * @return ENGINE_ENOTSUP if the document has to be updated with get and
+     *         store instead, otherwise the result of the operation
+     */
+    virtual ENGINE_ERROR_CODE appendPrepend(const DocKey& key,
+                                            uint16_t vbucket,
+                                            bool append,
+                                            cb::const_char_buffer value,
+                                            uint64_t cas,
+                                            const void* cookie,
+                                            uint64_t& newCas,
+                                            mutation_descr_t& mutInfo) = 0;
+
     /**
      * Replace an item in the store.
      * @param item the item to replace
@@ -144,6 +175,22 @@ public:
     virtual GetValue get(const DocKey& key, uint16_t vbucket,
                          const void *cookie, get_options_t options) = 0;
 
+    /**
+     * Retrieve the values for multiple keys in the same vbucket. The
+     * vbucket (and its state) is only looked up once for all of the keys.
+     *
+     * @param keys    the keys to fetch
+     * @param vbucket the vbucket from which to retrieve the keys
+     * @param cookie  the connection cookie
+     * @param options options specified for retrieval
+     *
+     * @return a GetValue for each of the keys (in the same order)
+     */
+    virtual std::vector<GetValue> getMulti(const std::vector<DocKey>& keys,
+                                           uint16_t vbucket,
+                                           const void* cookie,
+                                           get_options_t options) = 0;
+
     virtual GetValue getRandomKey(void) = 0;
 
     /**
@@ -183,6 +230,22 @@ public:
                                           uint32_t& deleted,
                                           uint8_t& datatype) = 0;
 
+    /**
+     * Retrieve the meta data for multiple keys in the same vbucket. The
+     * vbucket (and its state) is only looked up once for all of the keys.
+     *
+     * @param keys the keys to get the meta data for
+     * @param vbucket the vbucket from which to retrieve the keys
+     * @param cookie the connection cookie
+     *
+     * @return the status and meta data of each of the keys (in the same
+     *         order)
+     */
+    virtual std::vector<cb::EngineErrorMetadataPair> getMetaDataMulti(
+            const std::vector<DocKey>& keys,
+            uint16_t vbucket,
+            const void* cookie) = 0;
+
     /**
      * Set an item in the store.
      * @param item the item to set
@@ -213,6 +276,24 @@ public:
             ExtendedMetaData* emd = NULL,
             bool isReplication = false) = 0;
 
+    /**
+     * Set a batch of items replicated to a vbucket, in seqno order: see
+     * VBucket::setWithMetaBatch.
+     *
+     * @param vbucket the vbucket of the items
+     * @param items the items to set, stopping at the first which fails
+     * @param cookie the cookie representing the consumer
+     * @param permittedVBStates set of VB states that the target VB can be in
+     *
+     * @return the number of items set, and the result of the one which
+     *         failed (ENGINE_SUCCESS if none did)
+     */
+    virtual std::pair<size_t, ENGINE_ERROR_CODE> setWithMetaBatch(
+            uint16_t vbucket,
+            const std::vector<Item*>& items,
+            const void* cookie,
+            PermittedVBStates permittedVBStates) = 0;
+
     /**
      * Retrieve a value, but update its TTL first
      *
@@ -470,6 +551,12 @@ public:
      */
     virtual bool resetVBucket(uint16_t vbid) = 0;
 
+    /**
+     * Reset all the vbuckets, leaving the memory and the files of the old
+     * ones to be freed in the background.
+     */
+    virtual void resetAllVBuckets() = 0;
+
     /**
      * Run a vBucket visitor, visiting all items. Synchronous.
      */
@@ -486,6 +573,23 @@ public:
                          double sleepTime,
                          std::chrono::microseconds maxExpectedDuration) = 0;
 
+    /**
+     * Run a group of vbucket visitors concurrently, one task each. The
+     * vbuckets (accepted by the filter of the first visitor; they should
+     * all have the same filter) are shared between the tasks: each task
+     * takes the next vbucket left when it's done with its current one, so
+     * a task stuck on a big vbucket doesn't hold the others up. The
+     * complete() method of each visitor is called once its task runs out
+     * of vbuckets.
+     *
+     * Note that this is asynchronous.
+     */
+    virtual void visit(std::vector<std::unique_ptr<VBucketVisitor>> visitors,
+                       const char* lbl,
+                       TaskId id,
+                       double sleepTime,
+                       std::chrono::microseconds maxExpectedDuration) = 0;
+
     /**
      * Visit the items in this epStore, starting the iteration from the
      * given startPosition and allowing the visit to be paused at any point.
@@ -634,6 +738,15 @@ public:
 
     virtual bool isWarmingUp() = 0;
 
+    /**
+     * @return true if the vbucket doesn't take traffic yet, because warmup
+     *         hasn't loaded its keys and metadata (see warmup_active_first)
+     */
+    virtual bool isVBucketWarmingUp(uint16_t vbid) = 0;
+
+    /// @return true if warmup didn't make all of the active vbuckets available
+    virtual bool isWarmingUpActiveVBuckets() = 0;
+
     virtual bool maybeEnableTraffic(void) = 0;
 
     /**
@@ -40,6 +40,7 @@ KVShard::KVShard(uint16_t id, KVBucket& kvBucket)
     }
 #ifdef EP_USE_ROCKSDB
     else if (backend == "rocksdb") {
+        kvConfig.setRocksDBMemoryBudget(kvBucket.getRocksDBMemoryBudget());
         auto stores = KVStoreFactory::create(kvConfig);
         rwStore = std::move(stores.rw);
     }
@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include "instrumented_mutex.h"
 #include "kvstore_config.h"
 #include "utility.h"
 #include "vbucket.h"
@@ -112,6 +113,8 @@ private:
      */
     class VBMapElement {
     public:
+        using VBMutex = InstrumentedMutex<std::mutex>;
+
         /**
          * Access for const/non-const VBMapElement (using enable_if to hide
          * const methods for non-const users and vice-versa)
@@ -123,7 +126,7 @@ private:
         template <class T>
         class Access {
         public:
-            Access(std::mutex& m, T e) : lock(m), element(e) {
+            Access(VBMutex& m, T e) : lock(m), element(e) {
             }
 
             /**
@@ -171,7 +174,7 @@ private:
             }
 
         private:
-            std::unique_lock<std::mutex> lock;
+            std::unique_lock<VBMutex> lock;
             T& element;
         };
 
@@ -184,7 +187,7 @@ private:
         }
 
     private:
-        mutable std::mutex mutex;
+        mutable VBMutex mutex{LockStats::vbMap};
         VBucketPtr vbPtr;
     };
 
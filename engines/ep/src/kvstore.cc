@@ -72,6 +72,9 @@ void FileStats::reset() {
     writeCountHisto.reset();
     totalBytesRead = 0;
     totalBytesWritten = 0;
+    readaheadHits = 0;
+    readaheadMisses = 0;
+    readaheadBytes = 0;
 }
 
 KVStoreRWRO KVStoreFactory::create(KVStoreConfig& config) {
@@ -250,6 +253,16 @@ void KVStore::addStats(ADD_STAT add_stat, const void *c) {
         addStat(prefix, "failure_del",   st.numDelFailure,   add_stat, c);
         addStat(prefix, "failure_vbset", st.numVbSetFailure, add_stat, c);
         addStat(prefix, "lastCommDocs",  st.docsCommitted,   add_stat, c);
+        addStat(prefix,
+                "io_dictionary_encoded_docs",
+                st.io_dictionary_encoded_docs,
+                add_stat,
+                c);
+        addStat(prefix,
+                "io_dictionary_saved_bytes",
+                st.io_dictionary_saved_bytes,
+                add_stat,
+                c);
     }
 
     addStat(prefix,
@@ -257,6 +270,11 @@ void KVStore::addStats(ADD_STAT add_stat, const void *c) {
             st.io_bg_fetch_docs_read,
             add_stat,
             c);
+    addStat(prefix,
+            "io_bg_fetch_readahead_docs",
+            st.io_bgfetch_readahead_docs,
+            add_stat,
+            c);
     addStat(prefix, "io_num_write", st.io_num_write, add_stat, c);
     addStat(prefix,
             "io_bg_fetch_doc_bytes",
@@ -277,6 +295,18 @@ void KVStore::addStats(ADD_STAT add_stat, const void *c) {
             st.fsStatsCompaction.totalBytesRead, add_stat, c);
     addStat(prefix, "io_compaction_write_bytes",
             st.fsStatsCompaction.totalBytesWritten, add_stat, c);
+
+    addStat(prefix, "io_readahead_hits", st.fsStats.readaheadHits, add_stat, c);
+    addStat(prefix,
+            "io_readahead_misses",
+            st.fsStats.readaheadMisses,
+            add_stat,
+            c);
+    addStat(prefix,
+            "io_readahead_bytes",
+            st.fsStats.readaheadBytes,
+            add_stat,
+            c);
 }
 
 void KVStore::addTimingStats(ADD_STAT add_stat, const void *c) {
@@ -30,8 +30,10 @@
 #include <relaxed_atomic.h>
 #include <atomic>
 #include <cstring>
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -56,6 +58,8 @@ typedef uint16_t DBFileId;
 
 typedef std::shared_ptr<Callback<uint16_t&, const DocKey&, bool&> > BloomFilterCBPtr;
 typedef std::shared_ptr<Callback<Item&, time_t&> > ExpiredItemsCBPtr;
+/// Called with the size of each write of a compaction, before it is issued
+typedef std::shared_ptr<Callback<size_t&> > CompactionWriteCBPtr;
 
 typedef struct {
     uint64_t purge_before_ts;
@@ -68,6 +72,7 @@ typedef struct {
     uint32_t curr_time;
     BloomFilterCBPtr bloomFilterCallback;
     ExpiredItemsCBPtr expiryCallback;
+    CompactionWriteCBPtr writeCallback;
 } compaction_ctx;
 
 /**
@@ -154,6 +159,13 @@ enum class ValueFilter {
     VALUES_DECOMPRESSED
 };
 
+/**
+ * Decides from its key if a scan hands a document to the callbacks; the
+ * scan skips the others before reading their value (or looking them up in
+ * the cache).
+ */
+using DocKeyFilter = std::function<bool(const DocKey&)>;
+
 enum class VBStatePersist {
     VBSTATE_CACHE_UPDATE_ONLY,       //Update only cached state in-memory
     VBSTATE_PERSIST_WITHOUT_COMMIT,  //Persist without committing to disk
@@ -185,6 +197,21 @@ public:
     const ValueFilter valFilter;
     const uint64_t documentCount;
 
+    // An empty filter (the default) hands every document, it may be set
+    // before the first call to scan
+    DocKeyFilter keyFilter;
+
+    // Hand the documents in the order of their keys (which is closer to
+    // their layout on disk after churn) rather than of their seqnos. The
+    // KVStores which can't scan by key ignore it. May be set before the
+    // first call to scan.
+    bool byKey = false;
+    // The key a scan by key starts at (the first key if empty). May be set
+    // before the first call to scan.
+    std::string startKey;
+    // The key of the last document a scan by key handed, to resume from
+    std::string lastReadKey;
+
     Logger* logger;
     const KVStoreConfig& config;
 };
@@ -218,6 +245,14 @@ struct FileStats {
     // Total bytes written to disk.
     std::atomic<size_t> totalBytesWritten{0};
 
+    // Reads of a file with readahead enabled (see
+    // StatsOps::setSequentialReadahead) which were / weren't in the range
+    // already advised to be read ahead.
+    std::atomic<size_t> readaheadHits{0};
+    std::atomic<size_t> readaheadMisses{0};
+    // Total bytes advised to be read ahead.
+    std::atomic<size_t> readaheadBytes{0};
+
     void reset();
 };
 
@@ -232,6 +267,8 @@ public:
      */
     KVStoreStats() :
       docsCommitted(0),
+      numCommits(0),
+      lastCommitTime(0),
       numOpen(0),
       numClose(0),
       numLoadedVb(0),
@@ -243,7 +280,10 @@ public:
       io_bg_fetch_docs_read(0),
       io_num_write(0),
       io_bgfetch_doc_bytes(0),
+      io_bgfetch_readahead_docs(0),
       io_write_bytes(0),
+      io_dictionary_encoded_docs(0),
+      io_dictionary_saved_bytes(0),
       readSizeHisto(ExponentialGenerator<size_t>(1, 2), 25),
       writeSizeHisto(ExponentialGenerator<size_t>(1, 2), 25),
       getMultiFsReadCount(0),
@@ -255,6 +295,8 @@ public:
 
     void reset() {
         docsCommitted = 0;
+        numCommits = 0;
+        lastCommitTime = 0;
         numOpen = 0;
         numClose = 0;
         numLoadedVb = 0;
@@ -263,6 +305,9 @@ public:
         numDelFailure = 0;
         numOpenFailure = 0;
         numVbSetFailure = 0;
+        io_bgfetch_readahead_docs = 0;
+        io_dictionary_encoded_docs = 0;
+        io_dictionary_saved_bytes = 0;
 
         readTimeHisto.reset();
         readSizeHisto.reset();
@@ -282,6 +327,10 @@ public:
 
     // the number of docs committed
     Couchbase::RelaxedAtomic<size_t> docsCommitted;
+    // the number of transactions committed by the flusher
+    Couchbase::RelaxedAtomic<size_t> numCommits;
+    // how long (in us) the last of those commits took
+    Couchbase::RelaxedAtomic<hrtime_t> lastCommitTime;
     // the number of open() calls
     Couchbase::RelaxedAtomic<size_t> numOpen;
     // the number of close() calls
@@ -305,8 +354,14 @@ public:
     Couchbase::RelaxedAtomic<size_t> io_num_write;
     //! Document bytes (key+meta+value) read for background fetch operations.
     Couchbase::RelaxedAtomic<size_t> io_bgfetch_doc_bytes;
+    //! Documents whose body was read ahead for background fetch operations
+    Couchbase::RelaxedAtomic<size_t> io_bgfetch_readahead_docs;
     //! Number of bytes written (key + value + application rev metadata)
     Couchbase::RelaxedAtomic<size_t> io_write_bytes;
+    //! Documents written with their value encoded with a value dictionary
+    Couchbase::RelaxedAtomic<size_t> io_dictionary_encoded_docs;
+    //! Bytes of value those documents saved by the encoding
+    Couchbase::RelaxedAtomic<size_t> io_dictionary_saved_bytes;
 
     /* for flush and vb delete, no error handling in KVStore, such
      * failure should be tracked in MC-engine  */
@@ -358,6 +413,14 @@ public:
 struct vbucket_state;
 typedef std::map<uint16_t, vbucket_state> vbucket_map_t;
 
+/**
+ * The source of the items of a bulk load (see KVStore::bulkLoad): appends
+ * the next run of items to the vector and returns true, or returns false
+ * once there are no more.
+ */
+using BulkLoadSource =
+        std::function<bool(std::vector<std::unique_ptr<Item>>&)>;
+
 /**
  * Properties of the storage layer.
  *
@@ -394,11 +457,17 @@ public:
         No
     };
 
+    enum class GroupCommit {
+        Yes,
+        No
+    };
+
     StorageProperties(EfficientVBDump evb, EfficientVBDeletion evd, PersistedDeletion pd,
-                      EfficientGet eget, ConcurrentWriteCompact cwc)
+                      EfficientGet eget, ConcurrentWriteCompact cwc,
+                      GroupCommit gc)
         : efficientVBDump(evb), efficientVBDeletion(evd),
           persistedDeletions(pd), efficientGet(eget),
-          concWriteCompact(cwc) {}
+          concWriteCompact(cwc), groupCommit(gc) {}
 
     /* True if we can efficiently dump a single vbucket */
     bool hasEfficientVBDump() const {
@@ -426,12 +495,20 @@ public:
         return (concWriteCompact == ConcurrentWriteCompact::Yes);
     }
 
+    /* True if the writes to several vbuckets can be staged in one
+     * transaction (between begin() and commit()), which commits them
+     * all at once */
+    bool hasGroupCommit() const {
+        return (groupCommit == GroupCommit::Yes);
+    }
+
 private:
     EfficientVBDump efficientVBDump;
     EfficientVBDeletion efficientVBDeletion;
     PersistedDeletion persistedDeletions;
     EfficientGet efficientGet;
     ConcurrentWriteCompact concWriteCompact;
+    GroupCommit groupCommit;
 };
 
 /**
@@ -606,7 +683,9 @@ public:
     virtual vbucket_state *getVBucketState(uint16_t vbid) = 0;
 
     /**
-     * Get the number of deleted items that are persisted to a vbucket file
+     * Get the number of deleted items that are persisted to a vbucket file.
+     * The read-write store keeps it up to date as it commits (and compacts),
+     * so it doesn't read the file.
      *
      * @param vbid The vbucket if of the file to get the number of deletes for.
      * @returns the number of deletes which are persisted
@@ -637,6 +716,8 @@ public:
 
     /**
      * This method will return the total number of items in the vbucket
+     * (as of the last commit, which the read-write store keeps it up to
+     * date with, so that it is a memory read)
      *
      * vbid - vbucket id
      */
@@ -645,6 +726,26 @@ public:
     virtual RollbackResult rollback(uint16_t vbid, uint64_t rollbackseqno,
                                     std::shared_ptr<RollbackCB> cb) = 0;
 
+    /**
+     * Write the items of a bulk load to a new file of a vbucket, then switch
+     * the vbucket to it (removing its current file) in one step.
+     *
+     * The items carry their seqnos (ascending) and are written as they come,
+     * without looking up the previous versions of their keys: the keys must
+     * be unique across the load. They are committed once, at the end, with
+     * the vbucket state given, whose highSeqno, snapshot range and maxCas
+     * are set from the items.
+     *
+     * @return true if the vbucket was switched to the new file; false if the
+     *         store doesn't support bulk loads or the load failed (in which
+     *         case the current file is left as it was)
+     */
+    virtual bool bulkLoad(uint16_t vbid,
+                          vbucket_state& vbstate,
+                          const BulkLoadSource& source) {
+        return false;
+    }
+
     /**
      * This method is called before persisting a batch of data if you'd like to
      * do stuff to them that might improve performance at the IO layer.
@@ -675,6 +776,11 @@ public:
         return st;
     }
 
+    /**
+     * Hand (up to count of) the keys of the vbucket, starting at start_key,
+     * to the callback in order. The scan stops early if the callback sets
+     * its status to anything but ENGINE_SUCCESS.
+     */
     virtual ENGINE_ERROR_CODE getAllKeys(uint16_t vbid,
                             const DocKey start_key, uint32_t count,
                             std::shared_ptr<Callback<const DocKey&>> cb) = 0;
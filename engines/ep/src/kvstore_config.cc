@@ -26,6 +26,20 @@ public:
     void sizeValueChanged(const std::string& key, size_t value) override {
         if (key == "fsync_after_every_n_bytes_written") {
             config.setPeriodicSyncBytes(value);
+        } else if (key == "couchstore_backfill_readahead") {
+            config.setBackfillReadahead(value);
+        }
+    }
+
+    void booleanValueChanged(const std::string& key, bool value) override {
+        if (key == "couchstore_bgfetch_readahead") {
+            config.setBgFetchReadahead(value);
+        }
+    }
+
+    void floatValueChanged(const std::string& key, float value) override {
+        if (key == "rollback_reset_ratio") {
+            config.setRollbackResetRatio(value);
         }
     }
 
@@ -45,6 +59,20 @@ KVStoreConfig::KVStoreConfig(Configuration& config, uint16_t shardid)
     setPeriodicSyncBytes(config.getFsyncAfterEveryNBytesWritten());
     config.addValueChangedListener("fsync_after_every_n_bytes_written",
                                    new ConfigChangeListener(*this));
+    setBgFetchReadahead(config.isCouchstoreBgfetchReadahead());
+    config.addValueChangedListener("couchstore_bgfetch_readahead",
+                                   new ConfigChangeListener(*this));
+    setBackfillReadahead(config.getCouchstoreBackfillReadahead());
+    setDirectIO(config.isCouchstoreDirectIo());
+    setBlockCacheSize(config.getCouchstoreBlockCacheSize() /
+                      config.getMaxNumShards());
+    setValueDictionary(config.isCouchstoreValueDictionary());
+    setWriteBufferSize(config.getCouchstoreWriteBufferSize());
+    setRollbackResetRatio(config.getRollbackResetRatio());
+    config.addValueChangedListener("rollback_reset_ratio",
+                                   new ConfigChangeListener(*this));
+    config.addValueChangedListener("couchstore_backfill_readahead",
+                                   new ConfigChangeListener(*this));
 }
 
 KVStoreConfig::KVStoreConfig(uint16_t _maxVBuckets,
@@ -63,6 +91,13 @@ KVStoreConfig::KVStoreConfig(uint16_t _maxVBuckets,
       logger(&global_logger),
       buffered(true),
       persistDocNamespace(_persistDocNamespace),
+      bgFetchReadahead(false),
+      backfillReadahead(0),
+      directIO(false),
+      blockCacheSize(0),
+      valueDictionary(false),
+      writeBufferSize(0),
+      rollbackResetRatio(0.5),
       rocksDBOptions(rocksDBOptions_),
       rocksDBCFOptions(rocksDBCFOptions_) {
     // We pass RocksDB Options (through `configuration.json` and the
@@ -22,9 +22,11 @@
 #include "configuration.h"
 #include "logger.h"
 
+#include <memory>
 #include <string>
 
 class Logger;
+class RocksDBMemoryBudget;
 
 class KVStoreConfig {
 public:
@@ -102,6 +104,104 @@ public:
         persistDocNamespace = value;
     }
 
+    /**
+     * Indicates whether the couchstore getMulti() reads the document bodies
+     * of a batch ahead (concurrently) before reading them.
+     *
+     * Only recognised by CouchKVStore
+     */
+    bool isBgFetchReadahead() const {
+        return bgFetchReadahead;
+    }
+
+    void setBgFetchReadahead(bool value) {
+        bgFetchReadahead = value;
+    }
+
+    /**
+     * The number of bytes a scan advises the OS to read ahead of its reads
+     * (0 if it doesn't).
+     *
+     * Only recognised by CouchKVStore
+     */
+    size_t getBackfillReadahead() const {
+        return backfillReadahead;
+    }
+
+    void setBackfillReadahead(size_t bytes) {
+        backfillReadahead = bytes;
+    }
+
+    /**
+     * Indicates whether the files are read without the OS page cache.
+     *
+     * Only recognised by CouchKVStore
+     */
+    bool isDirectIO() const {
+        return directIO;
+    }
+
+    void setDirectIO(bool value) {
+        directIO = value;
+    }
+
+    /**
+     * The maximum size of the cache of the blocks read from the files (0 if
+     * there is no cache).
+     *
+     * Only recognised by CouchKVStore
+     */
+    size_t getBlockCacheSize() const {
+        return blockCacheSize;
+    }
+
+    void setBlockCacheSize(size_t bytes) {
+        blockCacheSize = bytes;
+    }
+
+    /**
+     * Indicates whether the JSON values are stored encoded with a dictionary
+     * trained per vbucket file.
+     *
+     * Only recognised by CouchKVStore
+     */
+    bool isValueDictionary() const {
+        return valueDictionary;
+    }
+
+    void setValueDictionary(bool value) {
+        valueDictionary = value;
+    }
+
+    /**
+     * The size of the buffer the contiguous writes to a file are coalesced
+     * into (0 if they are passed straight on).
+     *
+     * Only recognised by CouchKVStore
+     */
+    size_t getWriteBufferSize() const {
+        return writeBufferSize;
+    }
+
+    void setWriteBufferSize(size_t bytes) {
+        writeBufferSize = bytes;
+    }
+
+    /**
+     * The fraction of the items of a vbucket a rollback may undo in place.
+     * If more items than that were written after the rollback point, the
+     * rollback fails so that the vbucket is reset instead.
+     *
+     * Only recognised by CouchKVStore
+     */
+    float getRollbackResetRatio() const {
+        return rollbackResetRatio;
+    }
+
+    void setRollbackResetRatio(float value) {
+        rollbackResetRatio = value;
+    }
+
     uint64_t getPeriodicSyncBytes() const {
         return periodicSyncBytes;
     }
@@ -124,6 +224,20 @@ public:
         return rocksDBCFOptions;
     }
 
+    /**
+     * The block cache and memtable budget shared by the RocksDB shards of
+     * the bucket; nullptr to give each instance its own.
+     *
+     * Only recognised by RocksDBKVStore
+     */
+    const std::shared_ptr<RocksDBMemoryBudget>& getRocksDBMemoryBudget() const {
+        return rocksDBMemoryBudget;
+    }
+
+    void setRocksDBMemoryBudget(std::shared_ptr<RocksDBMemoryBudget> budget) {
+        rocksDBMemoryBudget = std::move(budget);
+    }
+
 private:
     class ConfigChangeListener;
 
@@ -142,10 +256,34 @@ private:
      */
     uint64_t periodicSyncBytes;
 
+    /// Read the bodies of a bgfetch batch ahead; see isBgFetchReadahead()
+    bool bgFetchReadahead;
+
+    /// The readahead of a scan; see getBackfillReadahead()
+    size_t backfillReadahead;
+
+    /// Read the files with O_DIRECT; see isDirectIO()
+    bool directIO;
+
+    /// The size of the block cache of the shard; see getBlockCacheSize()
+    size_t blockCacheSize;
+
+    /// Encode the values with a dictionary; see isValueDictionary()
+    bool valueDictionary;
+
+    /// The size of the write buffer of a file; see getWriteBufferSize()
+    size_t writeBufferSize;
+
+    /// When to reset instead of rolling back; see getRollbackResetRatio()
+    float rollbackResetRatio;
+
     // RocksDB Database level options. Semicolon-separated `<option>=<value>`
     // pairs.
     std::string rocksDBOptions;
     // RocksDB Column Family level options. Semicolon-separated
     // `<option>=<value>` pairs.
     std::string rocksDBCFOptions;
+
+    /// The memory shared by the RocksDB shards; see getRocksDBMemoryBudget()
+    std::shared_ptr<RocksDBMemoryBudget> rocksDBMemoryBudget;
 };
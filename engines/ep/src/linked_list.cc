@@ -19,8 +19,11 @@
 
 #include "stats.h"
 
+#include <algorithm>
 #include <mutex>
 
+const seqno_t BasicLinkedList::seqnoIndexInterval;
+
 BasicLinkedList::BasicLinkedList(uint16_t vbucketId, EPStats& st)
     : SequenceList(),
       readRange(0, 0),
@@ -51,6 +54,7 @@ BasicLinkedList::~BasicLinkedList() {
     /* Erase all the list elements (does not destroy elements, just removes
        them from the list) */
     seqList.clear();
+    seqnoIndex.clear();
 }
 
 void BasicLinkedList::appendToList(std::lock_guard<std::mutex>& seqLock,
@@ -74,6 +78,7 @@ SequenceList::UpdateStatus BasicLinkedList::updateListElem(
 
     /* Since there is no other reads or writes happenning in this range, we can
        move the item to the end of the list */
+    removeFromSeqnoIndex(writeLock, v);
     auto it = seqList.iterator_to(v);
     seqList.erase(it);
     seqList.push_back(v);
@@ -93,10 +98,11 @@ BasicLinkedList::rangeRead(seqno_t start, seqno_t end) {
         return std::make_tuple(ENGINE_ERANGE, std::vector<UniqueItemPtr>(), 0);
     }
 
-    /* Allows only 1 rangeRead for now */
-    std::lock_guard<std::mutex> lckGd(rangeReadLock);
-
+    /* Allocated here, as it can't be under rangeLock */
+    std::list<SeqRange> node{SeqRange(0, 0)};
+    ReadRangeHandle handle;
     {
+        std::lock_guard<std::mutex> lckGd(rangeReadLock);
         std::lock_guard<std::mutex> listWriteLg(getListWriteLock());
         std::lock_guard<SpinLock> lh(rangeLock);
         if (start > highSeqno) {
@@ -115,7 +121,8 @@ BasicLinkedList::rangeRead(seqno_t start, seqno_t end) {
         /* Mark the initial read range */
         end = std::min(end, static_cast<seqno_t>(highSeqno));
         end = std::max(end, static_cast<seqno_t>(highestDedupedSeqno));
-        readRange = SeqRange(1, end);
+        node.front() = SeqRange(1, end);
+        handle = addReadRange(lh, node);
     }
 
     /* Read items in the range */
@@ -132,9 +139,9 @@ BasicLinkedList::rangeRead(seqno_t start, seqno_t end) {
 
         {
             std::lock_guard<SpinLock> lh(rangeLock);
-            readRange.setBegin(currSeqno); /* [EPHE TODO]: should we
-                                                     update the min every time ?
-                                                   */
+            setReadRangeBegin(lh, handle, currSeqno); /* [EPHE TODO]: should
+                                                         we update the min
+                                                         every time ? */
         }
 
         if (currSeqno < start) {
@@ -169,15 +176,17 @@ BasicLinkedList::rangeRead(seqno_t start, seqno_t end) {
                 "item with seqno %" PRIi64 "before streaming it",
                 vbid,
                 currSeqno);
+            std::lock_guard<SpinLock> lh(rangeLock);
+            removeReadRange(lh, handle);
             return std::make_tuple(
                     ENGINE_ENOMEM, std::vector<UniqueItemPtr>(), 0);
         }
     }
 
-    /* Done with range read, reset the range */
+    /* Done with range read, remove its range */
     {
         std::lock_guard<SpinLock> lh(rangeLock);
-        readRange.reset();
+        removeReadRange(lh, handle);
     }
 
     /* Return all the range read items */
@@ -194,6 +203,17 @@ void BasicLinkedList::updateHighSeqno(std::lock_guard<std::mutex>& listWriteLg,
                                     " which is < 1");
     }
     highSeqno = v.getBySeqno();
+
+    /* Index the element if it is the first of its interval of seqnos (the
+       index is ordered like the list, as the seqnos only grow at its end) */
+    if (v.seqno_hook.is_linked() &&
+        (seqnoIndex.empty() ||
+         v.getBySeqno() / seqnoIndexInterval >
+                 seqnoIndex.rbegin()->first / seqnoIndexInterval)) {
+        seqnoIndex.emplace_hint(seqnoIndex.end(),
+                                v.getBySeqno(),
+                                const_cast<OrderedStoredValue*>(&v));
+    }
 }
 void BasicLinkedList::updateHighestDedupedSeqno(
         std::lock_guard<std::mutex>& listWriteLg, const OrderedStoredValue& v) {
@@ -224,7 +244,42 @@ void BasicLinkedList::markItemStale(std::lock_guard<std::mutex>& listWriteLg,
     v->toOrderedStoredValue()->markStale(listWriteLg, newSv);
 }
 
-size_t BasicLinkedList::purgeTombstones(seqno_t purgeUpToSeqno) {
+bool BasicLinkedList::isInReadRange(std::lock_guard<std::mutex>& listWriteLg,
+                                    const OrderedStoredValue& v) {
+    // Setting the range requires the write lock, so it can't grow until we
+    // release it.
+    std::lock_guard<SpinLock> lh(rangeLock);
+    return readRange.fallsInRange(v.getBySeqno());
+}
+
+bool BasicLinkedList::isRelinkable(std::lock_guard<std::mutex>& listWriteLg,
+                                   const OrderedStoredValue& v) {
+    // A stale OSV refers to its replacement by address, and we don't know
+    // which element it is
+    if (numStaleItems != 0) {
+        return false;
+    }
+
+    // Readers (and purgeTombstones) access the elements of the read range
+    // without the write lock.
+    return !isInReadRange(listWriteLg, v);
+}
+
+void BasicLinkedList::relinkListElem(std::lock_guard<std::mutex>& listWriteLg,
+                                     OrderedStoredValue& v,
+                                     OrderedStoredValue& copy) {
+    auto it = seqList.iterator_to(v);
+    seqList.insert(it, copy);
+    seqList.erase(it);
+
+    auto indexIt = seqnoIndex.find(v.getBySeqno());
+    if (indexIt != seqnoIndex.end() && indexIt->second == &v) {
+        indexIt->second = &copy;
+    }
+}
+
+size_t BasicLinkedList::purgeTombstones(seqno_t purgeUpToSeqno,
+                                        PurgeRun* run) {
     // Purge items marked as stale from the seqList.
     //
     // Strategy - we try to ensure that this function does not block
@@ -245,15 +300,28 @@ size_t BasicLinkedList::purgeTombstones(seqno_t purgeUpToSeqno) {
     // release the lock between each element so front-end operations can
     // have the opportunity to acquire it.
     //
-    // Attempt to acquire the readRangeLock, to block anyone else concurrently
-    // reading from the list while we remove elements from it.
+    // A run which returns without pausing, for whatever reason, is done.
+    seqno_t resumeSeqno = 0;
+    if (run) {
+        std::swap(resumeSeqno, run->resumeSeqno);
+    }
+
+    // Attempt to acquire the readRangeLock, to block anyone else from
+    // starting to read from the list while we remove elements from it.
     std::unique_lock<std::mutex> rrGuard(rangeReadLock, std::try_to_lock);
     if (!rrGuard) {
         // If we cannot acquire the lock then another thread is
-        // running a range read. Given these are typically long-running,
-        // return without blocking.
+        // starting a range read; return without blocking.
         return 0;
     }
+    {
+        std::lock_guard<SpinLock> rangeGuard(rangeLock);
+        if (!readRanges.empty()) {
+            // Other threads are running range reads. Given these are
+            // typically long-running, return without blocking.
+            return 0;
+        }
+    }
 
     // Determine the start and end iterators.
     OrderedLL::iterator startIt;
@@ -264,14 +332,23 @@ size_t BasicLinkedList::purgeTombstones(seqno_t purgeUpToSeqno) {
             return 0;
         }
 
-        // Determine the start
+        // Determine the start: resume at the last element of the seqno
+        // index at or before resumeSeqno (if any), so that the items the
+        // earlier runs visited aren't walked again.
         startIt = seqList.begin();
+        auto indexIt = seqnoIndex.upper_bound(resumeSeqno);
+        if (indexIt != seqnoIndex.begin()) {
+            --indexIt;
+            if (indexIt->first > startIt->getBySeqno()) {
+                startIt = seqList.iterator_to(*indexIt->second);
+            }
+        }
         if (startIt->getBySeqno() > purgeUpToSeqno) {
             /* Nothing to purge */
             return 0;
         }
 
-        // Update readRange
+        // Update readRange (there are no range reads to merge it with)
         std::lock_guard<SpinLock> rangeGuard(rangeLock);
         readRange = SeqRange(startIt->getBySeqno(), purgeUpToSeqno);
     }
@@ -284,6 +361,10 @@ size_t BasicLinkedList::purgeTombstones(seqno_t purgeUpToSeqno) {
         if (it->getBySeqno() > purgeUpToSeqno) {
             break;
         }
+        if (run && it != startIt && run->shouldPause()) {
+            run->resumeSeqno = it->getBySeqno();
+            break;
+        }
 
         {
             std::lock_guard<std::mutex> writeGuard(getListWriteLock());
@@ -303,7 +384,7 @@ size_t BasicLinkedList::purgeTombstones(seqno_t purgeUpToSeqno) {
     // Complete; reset the readRange.
     {
         std::lock_guard<SpinLock> lh(rangeLock);
-        readRange.reset();
+        mergeReadRanges(lh);
     }
     return purgedCount;
 }
@@ -366,8 +447,8 @@ std::mutex& BasicLinkedList::getListWriteLock() const {
 }
 
 boost::optional<SequenceList::RangeIterator> BasicLinkedList::makeRangeIterator(
-        bool isBackfill) {
-    auto pRangeItr = RangeIteratorLL::create(*this, isBackfill);
+        bool isBackfill, seqno_t startSeqno) {
+    auto pRangeItr = RangeIteratorLL::create(*this, isBackfill, startSeqno);
     return pRangeItr ? RangeIterator(std::move(pRangeItr))
                      : boost::optional<SequenceList::RangeIterator>{};
 }
@@ -395,6 +476,7 @@ OrderedLL::iterator BasicLinkedList::purgeListElem(OrderedLL::iterator it) {
     StoredValue::UniquePtr purged(&*it);
     {
         std::lock_guard<std::mutex> lckGd(getListWriteLock());
+        removeFromSeqnoIndex(lckGd, *purged->toOrderedStoredValue());
         it = seqList.erase(it);
     }
 
@@ -416,24 +498,76 @@ OrderedLL::iterator BasicLinkedList::purgeListElem(OrderedLL::iterator it) {
     return it;
 }
 
+BasicLinkedList::ReadRangeHandle BasicLinkedList::addReadRange(
+        std::lock_guard<SpinLock>& rangeGuard, std::list<SeqRange>& node) {
+    auto handle = node.begin();
+    readRanges.splice(readRanges.end(), node);
+    mergeReadRanges(rangeGuard);
+    return handle;
+}
+
+void BasicLinkedList::setReadRangeBegin(std::lock_guard<SpinLock>& rangeGuard,
+                                        ReadRangeHandle handle,
+                                        seqno_t begin) {
+    handle->setBegin(begin);
+    mergeReadRanges(rangeGuard);
+}
+
+void BasicLinkedList::removeReadRange(std::lock_guard<SpinLock>& rangeGuard,
+                                      ReadRangeHandle handle) {
+    readRanges.erase(handle);
+    mergeReadRanges(rangeGuard);
+}
+
+void BasicLinkedList::mergeReadRanges(std::lock_guard<SpinLock>& rangeGuard) {
+    if (readRanges.empty()) {
+        readRange.reset();
+        return;
+    }
+    seqno_t begin = readRanges.front().getBegin();
+    seqno_t end = readRanges.front().getEnd();
+    for (const auto& range : readRanges) {
+        begin = std::min(begin, range.getBegin());
+        end = std::max(end, range.getEnd());
+    }
+    readRange = SeqRange(begin, end);
+}
+
+void BasicLinkedList::removeFromSeqnoIndex(
+        std::lock_guard<std::mutex>& listWriteLg, const OrderedStoredValue& v) {
+    auto it = seqnoIndex.find(v.getBySeqno());
+    if (it != seqnoIndex.end() && it->second == &v) {
+        seqnoIndex.erase(it);
+    }
+}
+
 std::unique_ptr<BasicLinkedList::RangeIteratorLL>
-BasicLinkedList::RangeIteratorLL::create(BasicLinkedList& ll, bool isBackfill) {
+BasicLinkedList::RangeIteratorLL::create(BasicLinkedList& ll,
+                                         bool isBackfill,
+                                         seqno_t startSeqno) {
     /* Note: cannot use std::make_unique because the constructor of
        RangeIteratorLL is private */
     std::unique_ptr<BasicLinkedList::RangeIteratorLL> pRangeItr(
-            new BasicLinkedList::RangeIteratorLL(ll, isBackfill));
+            new BasicLinkedList::RangeIteratorLL(ll, isBackfill, startSeqno));
     return pRangeItr->tryLater() ? nullptr : std::move(pRangeItr);
 }
 
 BasicLinkedList::RangeIteratorLL::RangeIteratorLL(BasicLinkedList& ll,
-                                                  bool isBackfill)
+                                                  bool isBackfill,
+                                                  seqno_t startSeqno)
     : list(ll),
-      /* Try to get range read lock, do not block */
-      readLockHolder(list.rangeReadLock, std::try_to_lock),
+      registered(false),
       itrRange(0, 0),
       numRemaining(0),
       earlySnapShotEndSeqno(0),
       isBackfill(isBackfill) {
+    /* Allocated here, as it can't be under rangeLock */
+    std::list<SeqRange> node{SeqRange(0, 0)};
+
+    /* Try to get range read lock (only held by purgeTombstones() for long),
+       do not block */
+    std::unique_lock<std::mutex> readLockHolder(list.rangeReadLock,
+                                                std::try_to_lock);
     if (!readLockHolder) {
         /* no blocking */
         return;
@@ -442,9 +576,8 @@ BasicLinkedList::RangeIteratorLL::RangeIteratorLL(BasicLinkedList& ll,
     std::lock_guard<std::mutex> listWriteLg(list.getListWriteLock());
     std::lock_guard<SpinLock> lh(list.rangeLock);
     if (list.highSeqno < 1) {
-        /* No need of holding a lock for the snapshot as there are no items;
-           Also iterator range is at default (0, 0) */
-        readLockHolder.unlock();
+        /* No need of registering a range for the snapshot as there are no
+           items; Also iterator range is at default (0, 0) */
         return;
     }
 
@@ -454,14 +587,32 @@ BasicLinkedList::RangeIteratorLL::RangeIteratorLL(BasicLinkedList& ll,
     /* Number of items that can be iterated over */
     numRemaining = list.seqList.size();
 
+    /* Skip the items below startSeqno we can: start at the last element of
+       the seqno index at or before it. It stays in its place in the list
+       from here on, as it is in the read range */
+    auto indexIt = list.seqnoIndex.upper_bound(startSeqno);
+    if (indexIt != list.seqnoIndex.begin()) {
+        --indexIt;
+        if (indexIt->first > currIt->getBySeqno()) {
+            currIt = list.seqList.iterator_to(*indexIt->second);
+            /* The items left are at most one per seqno */
+            numRemaining = std::min(
+                    numRemaining,
+                    uint64_t(list.seqList.back().getBySeqno() -
+                             currIt->getBySeqno() + 1));
+        }
+    }
+
     /* The minimum seqno in the iterator that must be read to get a consistent
        read snapshot */
     earlySnapShotEndSeqno = list.highestDedupedSeqno;
 
     /* Mark the snapshot range on linked list. The range that can be read by the
        iterator is inclusive of the start and the end. */
-    list.readRange =
+    node.front() =
             SeqRange(currIt->getBySeqno(), list.seqList.back().getBySeqno());
+    readRangeHandle = list.addReadRange(lh, node);
+    registered = true;
 
     /* Keep the range in the iterator obj. We store the range end seqno as one
        higher than the end seqno that can be read by this iterator.
@@ -485,16 +636,14 @@ BasicLinkedList::RangeIteratorLL::RangeIteratorLL(BasicLinkedList& ll,
 
 BasicLinkedList::RangeIteratorLL::~RangeIteratorLL() {
     std::lock_guard<SpinLock> lh(list.rangeLock);
-    if (readLockHolder.owns_lock()) {
-        /* we must reset the list readRange only if the list iterator still owns
-           the read lock on the list */
-        list.readRange.reset();
+    if (registered) {
+        /* we must remove the read range only if the iterator has not already
+           removed it at the end of the iteration */
+        list.removeReadRange(lh, readRangeHandle);
         EXTENSION_LOG_LEVEL severity =
                 isBackfill ? EXTENSION_LOG_NOTICE : EXTENSION_LOG_INFO;
         LOG(severity, "vb:%" PRIu16 " Releasing the range iterator", list.vbid);
     }
-    /* As readLockHolder goes out of scope here, it will automatically release
-       the snapshot read lock on the linked list */
 }
 
 OrderedStoredValue& BasicLinkedList::RangeIteratorLL::operator*() const {
@@ -535,14 +684,14 @@ void BasicLinkedList::RangeIteratorLL::incrOperatorHelper() {
        the last element indicates the end of the iteration */
     if (curr() == itrRange.getEnd() - 1) {
         std::lock_guard<SpinLock> lh(list.rangeLock);
-        /* We reset the range and release the readRange lock here so that any
-           iterator client that does not delete the iterator obj will not end up
-           holding the list readRange lock forever */
-        list.readRange.reset();
+        /* We remove the read range here so that any iterator client that does
+           not delete the iterator obj will not end up holding back the list
+           (de-duplication and purging) forever */
+        list.removeReadRange(lh, readRangeHandle);
+        registered = false;
         EXTENSION_LOG_LEVEL severity =
                 isBackfill ? EXTENSION_LOG_NOTICE : EXTENSION_LOG_INFO;
         LOG(severity, "vb:%" PRIu16 " Releasing the range iterator", list.vbid);
-        readLockHolder.unlock();
 
         /* Update the begin to end() so the client can see that the iteration
            has ended */
@@ -556,7 +705,7 @@ void BasicLinkedList::RangeIteratorLL::incrOperatorHelper() {
            linked list. This helps reduce the stale items in the list during
            heavy update load from the front end */
         std::lock_guard<SpinLock> lh(list.rangeLock);
-        list.readRange.setBegin(currIt->getBySeqno());
+        list.setReadRangeBegin(lh, readRangeHandle, currIt->getBySeqno());
     }
 
     /* Also update the current range stored in the iterator obj */
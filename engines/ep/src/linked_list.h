@@ -33,6 +33,9 @@
 #include <platform/non_negative_counter.h>
 #include <relaxed_atomic.h>
 
+#include <list>
+#include <map>
+
 /* This option will configure "list" to use the member hook */
 using MemberHookOption =
         boost::intrusive::member_hook<OrderedStoredValue,
@@ -144,10 +147,25 @@ private:
  * ================================
  * 'writeLock' and 'rangeLock' are held for short durations, typically for
  * single list element writes and reads.
- * 'rangeReadLock' is held for longer duration on the list (for entire range).
+ * 'rangeReadLock' is held by the range reads only while they register their
+ * read range, and by purgeTombstones() for its entire range.
+ *
+ * Concurrent Range Reads:
+ * ======================
+ * Any number of range reads (rangeRead() and RangeIteratorLLs, e.g. several
+ * DCP backfills) may iterate the list at the same time. Each registers its
+ * own read range, and 'readRange' (the range in which items must not be
+ * moved) is the merge of them. purgeTombstones() only runs while there are
+ * no range reads, as it removes elements they could be iterating over.
  */
 class BasicLinkedList : public SequenceList {
 public:
+    /**
+     * The interval of the seqnos in the seqno index: the first element of
+     * each interval of seqnos is in it
+     */
+    static const seqno_t seqnoIndexInterval = 256;
+
     BasicLinkedList(uint16_t vbucketId, EPStats& st);
 
     ~BasicLinkedList();
@@ -174,7 +192,18 @@ public:
                        StoredValue::UniquePtr ownedSv,
                        StoredValue* newSv) override;
 
-    size_t purgeTombstones(seqno_t purgeUpToSeqno) override;
+    bool isInReadRange(std::lock_guard<std::mutex>& listWriteLg,
+                       const OrderedStoredValue& v) override;
+
+    bool isRelinkable(std::lock_guard<std::mutex>& listWriteLg,
+                      const OrderedStoredValue& v) override;
+
+    void relinkListElem(std::lock_guard<std::mutex>& listWriteLg,
+                        OrderedStoredValue& v,
+                        OrderedStoredValue& copy) override;
+
+    size_t purgeTombstones(seqno_t purgeUpToSeqno,
+                           PurgeRun* run = nullptr) override;
 
     void updateNumDeletedItems(bool oldDeleted, bool newDeleted) override;
 
@@ -201,7 +230,7 @@ public:
     std::mutex& getListWriteLock() const override;
 
     boost::optional<SequenceList::RangeIterator> makeRangeIterator(
-            bool isBackfill) override;
+            bool isBackfill, seqno_t startSeqno = 0) override;
 
     void dump() const override;
 
@@ -220,9 +249,15 @@ protected:
      * Used to mark of the range where point-in-time snapshot is happening.
      * To get a valid point-in-time snapshot and for correct list iteration we
      * must not de-duplicate an item in the list in this range.
+     * With range reads in-flight it is the merge of their readRanges.
      */
     SeqRange readRange;
 
+    /**
+     * The read ranges of the range reads in-flight. Guarded by rangeLock.
+     */
+    std::list<SeqRange> readRanges;
+
     /**
      * Lock that protects readRange.
      * We use spinlock here since the lock is held only for very small time
@@ -231,17 +266,10 @@ protected:
     mutable SpinLock rangeLock;
 
     /**
-     * Lock that serializes range reads on the 'seqList' - i.e. serializes
-     * the addition / removal of range reads from the set in-flight.
-     * We need to serialize range reads because, range reads set a list level
-     * range in which items are read. If we have multiple range reads then we
-     * must handle the races in the updation of the range to have most inclusive
-     * range.
-     * For now we use this lock to allow only one range read at a time.
-     *
-     * It is also additionally used in purgeTombstones() to prevent the
-     * creation of any new rangeReads while purge is in-progress - see
-     * detailed comments there.
+     * Lock that serializes the addition of range reads to the set in-flight
+     * with purgeTombstones(), which holds it to prevent the creation of any
+     * new rangeReads while purge is in-progress - see detailed comments
+     * there.
      */
     std::mutex rangeReadLock;
 
@@ -253,9 +281,48 @@ protected:
        list */
     Couchbase::RelaxedAtomic<size_t> staleMetaDataSize;
 
+    /**
+     * A sparse index of the list, from the seqno of the first element of
+     * each seqnoIndexInterval to the element, so that range iterators can
+     * start at their start seqno rather than walk the list from its head.
+     * An element leaves the index when it leaves its place in the list
+     * (it is moved to the end, relinked or purged).
+     * Guarded by writeLock.
+     */
+    std::map<seqno_t, OrderedStoredValue*> seqnoIndex;
+
 private:
     OrderedLL::iterator purgeListElem(OrderedLL::iterator it);
 
+    using ReadRangeHandle = std::list<SeqRange>::iterator;
+
+    /**
+     * Adds a range read to the set in-flight, and merges its range into
+     * readRange.
+     *
+     * @param node a list holding the read range, which is moved into
+     *             readRanges (so that it is allocated outside of rangeLock)
+     * @return the handle of the range read
+     */
+    ReadRangeHandle addReadRange(std::lock_guard<SpinLock>& rangeGuard,
+                                 std::list<SeqRange>& node);
+
+    /// Moves the begin of a range read, as it is done with the items before
+    void setReadRangeBegin(std::lock_guard<SpinLock>& rangeGuard,
+                           ReadRangeHandle handle,
+                           seqno_t begin);
+
+    /// Removes a range read from the set in-flight
+    void removeReadRange(std::lock_guard<SpinLock>& rangeGuard,
+                         ReadRangeHandle handle);
+
+    /// Sets readRange to the merge of the ranges of the range reads
+    void mergeReadRanges(std::lock_guard<SpinLock>& rangeGuard);
+
+    /// Removes the element from the seqno index (if it is in it)
+    void removeFromSeqnoIndex(std::lock_guard<std::mutex>& listWriteLg,
+                              const OrderedStoredValue& v);
+
     /**
      * We need to keep track of the highest seqno separately because there is a
      * small window wherein the last element of the list (though in correct
@@ -311,20 +378,24 @@ private:
     class RangeIteratorLL : public SequenceList::RangeIteratorImpl {
     public:
         /**
-         * Method to create instances of RangeIteratorLL. We only
-         * allow one RangeIteratorLL object to exist at any one time,
-         * hence creation can fail and that's why object creation is via a
+         * Method to create instances of RangeIteratorLL. Several may exist
+         * at any one time, but not while purgeTombstones() runs, hence
+         * creation can fail and that's why object creation is via a
          * public method and not constructor.
          *
          * @param ll ref to the linkedlist on which the iterator is created
          * @param isBackfill indicates if the iterator is for backfill (for
          *                   debug)
+         * @param startSeqno the items below it may be skipped: the iterator
+         *                   starts at the element of the seqno index at or
+         *                   before it
          *
-         * @return Non-null pointer on success, or null if a RangeIteratorLL
-         *         already exists.
+         * @return Non-null pointer on success, or null if tombstones are
+         *         being purged.
          */
         static std::unique_ptr<RangeIteratorLL> create(BasicLinkedList& ll,
-                                                       bool isBackfill);
+                                                       bool isBackfill,
+                                                       seqno_t startSeqno);
 
         ~RangeIteratorLL();
 
@@ -358,7 +429,9 @@ private:
     private:
         /* We have a private constructor because we want to create the iterator
            optionally, that is, only when it is possible to get a read lock */
-        RangeIteratorLL(BasicLinkedList& ll, bool isBackfill);
+        RangeIteratorLL(BasicLinkedList& ll,
+                        bool isBackfill,
+                        seqno_t startSeqno);
 
         /**
          * Indicates if the client should try creating the iterator at a later
@@ -368,8 +441,8 @@ private:
          *         false: iterator created successfully
          */
         bool tryLater() const {
-            /* could not lock and the list has items */
-            return (!readLockHolder && (list.getHighSeqno() > 0));
+            /* could not register and the list has items */
+            return (!registered && (list.getHighSeqno() > 0));
         }
 
         /**
@@ -394,8 +467,12 @@ private:
         /* The current list element pointed by the iterator */
         OrderedLL::iterator currIt;
 
-        /* Lock holder which allows having only one iterator at a time */
-        std::unique_lock<std::mutex> readLockHolder;
+        /* Whether the iterator has its read range in the list's set of
+           range reads (from creation until the end of the iteration) */
+        bool registered;
+
+        /* The handle of the read range of the iterator in the list */
+        ReadRangeHandle readRangeHandle;
 
         /* Current range of the iterator */
         SeqRange itrRange;
@@ -20,17 +20,171 @@
 
 #include "config.h"
 
+#include <array>
+#include <atomic>
 #include <functional>
 #include <mutex>
+#include <platform/cacheline_padded.h>
 #include <platform/rwlock.h>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
 
 #include "utility.h"
 
 using LockHolder = std::lock_guard<std::mutex>;
 
+/**
+ * A reader/writer lock for short critical sections where most of the users
+ * only read (such as the hash buckets of a HashTable).
+ *
+ * It meets the Lockable requirements, so the exclusive side may be used with
+ * std::unique_lock and std::lock_guard like a std::mutex.
+ *
+ * Taking (and releasing) shared access is a single atomic operation on the
+ * lock word, so readers don't serialise on each other. Writers are
+ * serialised by a std::mutex, block new readers as soon as they arrive and
+ * then wait for the current readers to leave. Readers which find a writer
+ * waiting (or holding the lock) sleep on the std::mutex.
+ */
+class SharedMutex {
+public:
+    SharedMutex() : state(0) {
+    }
+
+    void lock() {
+        writerMutex.lock();
+        state.fetch_or(Writer, std::memory_order_acquire);
+        while (state.load(std::memory_order_acquire) != Writer) {
+            std::this_thread::yield();
+        }
+    }
+
+    bool try_lock() {
+        if (!writerMutex.try_lock()) {
+            return false;
+        }
+        uint32_t expected = 0;
+        if (state.compare_exchange_strong(expected,
+                                          Writer,
+                                          std::memory_order_acquire)) {
+            return true;
+        }
+        writerMutex.unlock();
+        return false;
+    }
+
+    void unlock() {
+        state.fetch_and(~Writer, std::memory_order_release);
+        writerMutex.unlock();
+    }
+
+    void lock_shared() {
+        while (!try_lock_shared()) {
+            // Wait for the writer to release the lock
+            std::lock_guard<std::mutex> guard(writerMutex);
+        }
+    }
+
+    bool try_lock_shared() {
+        auto current = state.load(std::memory_order_relaxed);
+        while ((current & Writer) == 0) {
+            if (state.compare_exchange_weak(current,
+                                            current + 1,
+                                            std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void unlock_shared() {
+        state.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    /// Set while a writer holds (or waits for) the lock
+    static const uint32_t Writer = 0x80000000;
+
+    /// The Writer bit and the number of readers holding the lock
+    std::atomic<uint32_t> state;
+
+    /// Serialises the writers
+    std::mutex writerMutex;
+
+    DISALLOW_COPY_AND_ASSIGN(SharedMutex);
+};
+
+/**
+ * A reader/writer lock for state which the operations of all the front end
+ * threads read, and which is rarely changed (such as the collections
+ * manifest of a VBucket).
+ *
+ * Even a SharedMutex makes the readers write its lock word, whose cache
+ * line then moves between the cores on every operation. This spreads the
+ * readers over Shards SharedMutexes (each on its own cache line), a thread
+ * always using the same one, so the cores mostly write their own. Writers
+ * take all of the shards, in order, so they cost Shards times as much.
+ *
+ * The exclusive side meets the Lockable requirements; shared access is
+ * taken with a ReaderHolder, which remembers the shard it locked.
+ */
+class ShardedSharedMutex {
+public:
+    static const size_t Shards = 16;
+
+    /// RAII shared access, through the calling thread's shard
+    class ReaderHolder {
+    public:
+        explicit ReaderHolder(ShardedSharedMutex& m)
+            : shard(&m.getReaderShard()) {
+            shard->lock_shared();
+        }
+
+        ReaderHolder(ReaderHolder&& other) : shard(other.shard) {
+            other.shard = nullptr;
+        }
+
+        ReaderHolder(const ReaderHolder& other) = delete;
+
+        ~ReaderHolder() {
+            if (shard) {
+                shard->unlock_shared();
+            }
+        }
+
+    private:
+        SharedMutex* shard;
+    };
+
+    ShardedSharedMutex() = default;
+
+    void lock() {
+        for (auto& shard : shards) {
+            shard->lock();
+        }
+    }
+
+    void unlock() {
+        for (auto& shard : shards) {
+            shard->unlock();
+        }
+    }
+
+private:
+    /// @return the shard the calling thread takes shared access through
+    SharedMutex& getReaderShard() {
+        static std::atomic<size_t> nextShard{0};
+        thread_local const size_t shard = nextShard++ % Shards;
+        return *shards[shard];
+    }
+
+    std::array<cb::CachelinePadded<SharedMutex>, Shards> shards;
+
+    DISALLOW_COPY_AND_ASSIGN(ShardedSharedMutex);
+};
+
 /**
  * RAII lock holder over multiple locks.
  */
@@ -42,7 +196,7 @@ public:
      *
      * @param m reference to a vector of locks
      */
-    MultiLockHolder(std::vector<std::mutex>& m)
+    MultiLockHolder(std::vector<SharedMutex>& m)
         : mutexes(m) {
         lock();
     }
@@ -70,7 +224,7 @@ private:
         }
     }
 
-    std::vector<std::mutex>& mutexes;
+    std::vector<SharedMutex>& mutexes;
 
     DISALLOW_COPY_AND_ASSIGN(MultiLockHolder);
 };
@@ -28,6 +28,7 @@
 extern "C" {
 #include "crc32.h"
 }
+#include "checksum.h"
 #include "ep_engine.h"
 #include "mutation_log.h"
 
@@ -257,7 +258,7 @@ MutationLog::MutationLog(const std::string &path,
     : paddingHisto(GrowingWidthGenerator<uint32_t>(0, 8, 1.5), 32),
     logPath(path),
     blockSize(bs),
-    blockPos(HEADER_RESERVED),
+    blockPos(getBlockHeaderSize(MutationLogVersion::Current)),
     file(INVALID_FILE_VALUE),
     disabled(false),
     entries(0),
@@ -398,10 +399,11 @@ void MutationLog::readInitialBlock() {
 
     headerBlock.set(buf);
 
-    // Check the version is one we can handle, V1 and V2.
+    // Check the version is one we can handle, V1 to V3.
     switch (headerBlock.version()) {
     case MutationLogVersion::V1:
     case MutationLogVersion::V2:
+    case MutationLogVersion::V3:
         break;
     default: {
         std::stringstream ss;
@@ -471,6 +473,8 @@ bool MutationLog::prepareWrites() {
             }
         }
         logSize = static_cast<size_t>(seek_result);
+        // The blocks appended are in the format of the existing file
+        blockPos = getBlockHeaderSize(headerBlock.version());
     }
     return true;
 }
@@ -532,6 +536,11 @@ void MutationLog::open(bool _readOnly) {
         throw ReadException(ss.str());
     }
 
+#if !defined(WIN32) && defined(POSIX_FADV_SEQUENTIAL)
+    // The log is only ever read from start to end, block by block
+    (void)posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
     int64_t size;
     try {
          size = getFileSize(file);
@@ -655,7 +664,8 @@ bool MutationLog::replaceWith(MutationLog &mlog) {
 }
 
 bool MutationLog::flush() {
-    if (isEnabled() && blockPos > HEADER_RESERVED) {
+    const size_t headerSize = getBlockHeaderSize(headerBlock.version());
+    if (isEnabled() && blockPos > headerSize) {
         if (!isOpen()) {
             throw std::logic_error("MutationLog::flush: "
                                    "Not valid on a closed log");
@@ -670,15 +680,24 @@ bool MutationLog::flush() {
         }
 
         entries = htons(entries);
-        memcpy(blockBuffer.get() + 2, &entries, sizeof(entries));
+        if (headerSize == HEADER_RESERVED_V3) {
+            // 4 byte crc32c, 2 byte item count and 2 bytes of padding
+            memcpy(blockBuffer.get() + 4, &entries, sizeof(entries));
+            memset(blockBuffer.get() + 6, 0, 2);
+            uint32_t crc(htonl(
+                    computeChecksum(blockBuffer.get() + 4, blockSize - 4)));
+            memcpy(blockBuffer.get(), &crc, sizeof(crc));
+        } else {
+            memcpy(blockBuffer.get() + 2, &entries, sizeof(entries));
 
-        uint32_t crc32(crc32buf(blockBuffer.get() + 2, blockSize - 2));
-        uint16_t crc16(htons(crc32 & 0xffff));
-        memcpy(blockBuffer.get(), &crc16, sizeof(crc16));
+            uint32_t crc32(crc32buf(blockBuffer.get() + 2, blockSize - 2));
+            uint16_t crc16(htons(crc32 & 0xffff));
+            memcpy(blockBuffer.get(), &crc16, sizeof(crc16));
+        }
 
         if (writeFully(file, blockBuffer.get(), blockSize)) {
             logSize.fetch_add(blockSize);
-            blockPos = HEADER_RESERVED;
+            blockPos = headerSize;
             entries = 0;
         } else {
             /* write to the mutation log failed. Disable the log */
@@ -772,7 +791,8 @@ void MutationLog::iterator::prepItem() {
                 MutationLogEntryV1::newEntry(p, bufferBytesRemaining())->len();
         break;
     }
-    case MutationLogVersion::V2: {
+    case MutationLogVersion::V2:
+    case MutationLogVersion::V3: {
         copyLen =
                 MutationLogEntryV2::newEntry(p, bufferBytesRemaining())->len();
         break;
@@ -788,7 +808,8 @@ size_t MutationLog::iterator::getCurrentEntryLen() const {
         return MutationLogEntryV1::newEntry(entryBuf.begin(), entryBuf.size())
                 ->len();
     }
-    case MutationLogVersion::V2: {
+    case MutationLogVersion::V2:
+    case MutationLogVersion::V3: {
         return MutationLogEntryV2::newEntry(entryBuf.begin(), entryBuf.size())
                 ->len();
     }
@@ -847,10 +868,11 @@ MutationLog::MutationLogEntryHolder MutationLog::iterator::upgradeEntry()
         break;
     }
     */
-    case MutationLogVersion::Current: {
+    case MutationLogVersion::V2:
+    case MutationLogVersion::V3: {
         throw std::invalid_argument(
                 "MutationLog::iterator::upgradeEntry cannot"
-                " upgrade if version == current");
+                " upgrade if the entries are current");
     }
     }
 
@@ -876,6 +898,10 @@ MutationLog::MutationLogEntryHolder MutationLog::iterator::upgradeEntry()
 
         // fall through
     }
+    case MutationLogVersion::V3: {
+        // V3 only changed the block checksum; the entries are V2
+        break;
+    }
     /* If V3 exists then add a case (which is hit by V2 falling through)
     case MutationLogVersion::V3: {
         // Upgrade V2 to V3
@@ -896,8 +922,9 @@ MutationLog::MutationLogEntryHolder MutationLog::iterator::upgradeEntry()
 }
 
 MutationLog::MutationLogEntryHolder MutationLog::iterator::operator*() {
-    // If the file version is down-level return an upgraded entry
-    if (log->headerBlock.version() != MutationLogVersion::Current) {
+    // If the file version is down-level return an upgraded entry (V2 and V3
+    // share the current entry format)
+    if (log->headerBlock.version() == MutationLogVersion::V1) {
         return upgradeEntry();
     } else {
         return {entryBuf.data(), false /*not allocated*/};
@@ -926,25 +953,40 @@ void MutationLog::iterator::nextBlock() {
     }
     offset += bytesread;
 
-    // block starts with 2 byte crc and 2 byte item count
-    uint32_t crc32(crc32buf(buf.data() + sizeof(uint16_t), buf.size() - sizeof(uint16_t)));
-    uint16_t computed_crc16(crc32 & 0xffff);
-    uint16_t retrieved_crc16;
-    memcpy(&retrieved_crc16, buf.data(), sizeof(retrieved_crc16));
-    retrieved_crc16 = ntohs(retrieved_crc16);
-    if (computed_crc16 != retrieved_crc16) {
-        throw CRCReadException();
+    const size_t headerSize = getBlockHeaderSize(log->headerBlock.version());
+    size_t countOffset;
+    if (headerSize == HEADER_RESERVED_V3) {
+        // block starts with 4 byte crc32c, 2 byte item count and 2 byte pad
+        countOffset = sizeof(uint32_t);
+        uint32_t computed_crc(computeChecksum(buf.data() + countOffset,
+                                              buf.size() - countOffset));
+        uint32_t retrieved_crc;
+        memcpy(&retrieved_crc, buf.data(), sizeof(retrieved_crc));
+        if (computed_crc != ntohl(retrieved_crc)) {
+            throw CRCReadException();
+        }
+    } else {
+        // block starts with 2 byte crc and 2 byte item count
+        countOffset = sizeof(uint16_t);
+        uint32_t crc32(crc32buf(buf.data() + sizeof(uint16_t),
+                                buf.size() - sizeof(uint16_t)));
+        uint16_t computed_crc16(crc32 & 0xffff);
+        uint16_t retrieved_crc16;
+        memcpy(&retrieved_crc16, buf.data(), sizeof(retrieved_crc16));
+        retrieved_crc16 = ntohs(retrieved_crc16);
+        if (computed_crc16 != retrieved_crc16) {
+            throw CRCReadException();
+        }
     }
 
-    std::copy_n(buf.data() + sizeof(uint16_t),
+    std::copy_n(buf.data() + countOffset,
                 sizeof(uint16_t),
                 reinterpret_cast<uint8_t*>(&items));
 
     items = ntohs(items);
 
-    // adjust p so it skips the 2 byte crc and 2 byte item count and points to
-    // the first item.
-    p = buf.begin() + sizeof(uint16_t) + sizeof(uint16_t);
+    // adjust p so it skips the block header and points to the first item.
+    p = buf.begin() + headerSize;
 
     prepItem();
 }
@@ -1011,7 +1053,9 @@ MutationLog::iterator MutationLogHarvester::loadBatch(
         switch (le->type()) {
         case MutationLogType::New:
             if (vbid_set.find(le->vbucket()) != vbid_set.end()) {
-                committed[le->vbucket()].emplace(le->key());
+                // The AccessScanner logs the keys of a vbucket in order
+                auto& keys = committed[le->vbucket()];
+                keys.emplace_hint(keys.end(), le->key());
                 count++;
             }
             break;
@@ -72,8 +72,23 @@ const int MUTATION_LOG_COMPACTOR_FREQ(3600);
 
 const size_t MIN_LOG_HEADER_SIZE(4096);
 const size_t HEADER_RESERVED(4);
+const size_t HEADER_RESERVED_V3(8);
 
-enum class MutationLogVersion { V1 = 1, V2 = 2, Current = V2 };
+/**
+ * V3 has the same entries as V2; its blocks start with a (hardware
+ * accelerated) CRC32C of the whole block instead of the lower 16 bits of a
+ * CRC32.
+ */
+enum class MutationLogVersion { V1 = 1, V2 = 2, V3 = 3, Current = V3 };
+
+/**
+ * @return the size of the header of each block (the checksum and the entry
+ *         count) of a log of the given version
+ */
+inline size_t getBlockHeaderSize(MutationLogVersion version) {
+    return version < MutationLogVersion::V3 ? HEADER_RESERVED
+                                            : HEADER_RESERVED_V3;
+}
 
 const size_t LOG_ENTRY_BUF_SIZE(512);
 
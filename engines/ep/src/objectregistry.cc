@@ -22,11 +22,19 @@
 #include "ep_engine.h"
 #include "item.h"
 #include "stored-value.h"
-#include "threadlocal.h"
+
+#include <mutex>
+#include <vector>
 
 #if 1
-static ThreadLocal<EventuallyPersistentEngine*> *th;
-static ThreadLocal<std::atomic<size_t>*> *initial_track;
+/*
+ * The engine the calling thread runs on behalf of, read by every tracked
+ * allocation and free: a thread_local is resolved by the compiler (at
+ * worst through the __tls_get_addr fast path in a shared object), rather
+ * than by a call to pthread_getspecific / TlsGetValue as a ThreadLocal is.
+ */
+static thread_local EventuallyPersistentEngine* th = nullptr;
+static thread_local std::atomic<size_t>* initial_track = nullptr;
 
 extern "C" {
     static size_t defaultGetAllocSize(const void *) {
@@ -36,26 +44,14 @@ extern "C" {
 
 static get_allocation_size getAllocSize = defaultGetAllocSize;
 
+static ALLOCATOR_HOOKS_API* hooksApi = nullptr;
 
+/// The arena the calling thread allocates from
+static thread_local unsigned threadArena = 0;
 
-/**
- * Object registry link hook for getting the registry thread local
- * installed.
- */
-class installer {
-public:
-   installer() {
-      if (th == NULL) {
-         th = new ThreadLocal<EventuallyPersistentEngine*>();
-         initial_track = new ThreadLocal<std::atomic<size_t>*>();
-      }
-   }
-
-   ~installer() {
-       delete initial_track;
-       delete th;
-   }
-} install;
+/// The arenas of the deleted buckets, for reuse
+static std::mutex freeArenasMutex;
+static std::vector<unsigned> freeArenas;
 
 static bool verifyEngine(EventuallyPersistentEngine *engine)
 {
@@ -69,17 +65,19 @@ static bool verifyEngine(EventuallyPersistentEngine *engine)
    return true;
 }
 
-void ObjectRegistry::initialize(get_allocation_size func) {
-    getAllocSize = func;
+void ObjectRegistry::initialize(ALLOCATOR_HOOKS_API& hooks) {
+    getAllocSize = hooks.get_allocation_size;
+    hooksApi = &hooks;
 }
 
 void ObjectRegistry::reset() {
     getAllocSize = defaultGetAllocSize;
+    hooksApi = nullptr;
 }
 
 void ObjectRegistry::onCreateBlob(const Blob *blob)
 {
-   EventuallyPersistentEngine *engine = th->get();
+   EventuallyPersistentEngine *engine = th;
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
        size_t size = getAllocSize(blob);
@@ -96,7 +94,7 @@ void ObjectRegistry::onCreateBlob(const Blob *blob)
 
 void ObjectRegistry::onDeleteBlob(const Blob *blob)
 {
-   EventuallyPersistentEngine *engine = th->get();
+   EventuallyPersistentEngine *engine = th;
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
        size_t size = getAllocSize(blob);
@@ -113,7 +111,7 @@ void ObjectRegistry::onDeleteBlob(const Blob *blob)
 
 void ObjectRegistry::onCreateStoredValue(const StoredValue *sv)
 {
-   EventuallyPersistentEngine *engine = th->get();
+   EventuallyPersistentEngine *engine = th;
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
        size_t size = getAllocSize(sv);
@@ -129,7 +127,7 @@ void ObjectRegistry::onCreateStoredValue(const StoredValue *sv)
 
 void ObjectRegistry::onDeleteStoredValue(const StoredValue *sv)
 {
-   EventuallyPersistentEngine *engine = th->get();
+   EventuallyPersistentEngine *engine = th;
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
        size_t size = getAllocSize(sv);
@@ -146,7 +144,7 @@ void ObjectRegistry::onDeleteStoredValue(const StoredValue *sv)
 
 void ObjectRegistry::onCreateItem(const Item *pItem)
 {
-   EventuallyPersistentEngine *engine = th->get();
+   EventuallyPersistentEngine *engine = th;
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
        stats.memOverhead->fetch_add(pItem->size() - pItem->getValMemSize());
@@ -156,7 +154,7 @@ void ObjectRegistry::onCreateItem(const Item *pItem)
 
 void ObjectRegistry::onDeleteItem(const Item *pItem)
 {
-   EventuallyPersistentEngine *engine = th->get();
+   EventuallyPersistentEngine *engine = th;
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
        stats.memOverhead->fetch_sub(pItem->size() - pItem->getValMemSize());
@@ -165,7 +163,7 @@ void ObjectRegistry::onDeleteItem(const Item *pItem)
 }
 
 EventuallyPersistentEngine *ObjectRegistry::getCurrentEngine() {
-    return th->get();
+    return th;
 }
 
 EventuallyPersistentEngine *ObjectRegistry::onSwitchThread(
@@ -174,21 +172,56 @@ EventuallyPersistentEngine *ObjectRegistry::onSwitchThread(
     EventuallyPersistentEngine *old_engine = NULL;
 
     if (want_old_thread_local) {
-        old_engine = th->get();
+        old_engine = th;
     }
 
-    th->set(engine);
+    th = engine;
+
+    // Only the engines given an arena by acquireArena() (through the
+    // hooks) have one, so the hooks are set if the arenas differ
+    const unsigned arena = engine ? engine->getArena() : 0;
+    if (arena != threadArena && hooksApi->set_thread_arena(arena)) {
+        threadArena = arena;
+    }
     return old_engine;
 }
 
+unsigned ObjectRegistry::acquireArena() {
+    {
+        std::lock_guard<std::mutex> lh(freeArenasMutex);
+        if (!freeArenas.empty()) {
+            const unsigned arena = freeArenas.back();
+            freeArenas.pop_back();
+            return arena;
+        }
+    }
+
+    unsigned arena = 0;
+    if (hooksApi == nullptr || hooksApi->create_arena == nullptr ||
+        !hooksApi->create_arena(&arena)) {
+        return 0;
+    }
+    return arena;
+}
+
+void ObjectRegistry::releaseArena(unsigned arena) {
+    if (arena == 0) {
+        return;
+    }
+    // Give back what the bucket left behind before the arena is reused
+    hooksApi->purge_arena(arena);
+    std::lock_guard<std::mutex> lh(freeArenasMutex);
+    freeArenas.push_back(arena);
+}
+
 void ObjectRegistry::setStats(std::atomic<size_t>* init_track) {
-    initial_track->set(init_track);
+    initial_track = init_track;
 }
 
 bool ObjectRegistry::memoryAllocated(size_t mem) {
-    EventuallyPersistentEngine *engine = th->get();
-    if (initial_track->get()) {
-        initial_track->get()->fetch_add(mem);
+    EventuallyPersistentEngine *engine = th;
+    if (initial_track) {
+        initial_track->fetch_add(mem);
     }
     if (!engine) {
         return false;
@@ -199,9 +232,9 @@ bool ObjectRegistry::memoryAllocated(size_t mem) {
 }
 
 bool ObjectRegistry::memoryDeallocated(size_t mem) {
-    EventuallyPersistentEngine *engine = th->get();
-    if (initial_track->get()) {
-        initial_track->get()->fetch_sub(mem);
+    EventuallyPersistentEngine *engine = th;
+    if (initial_track) {
+        initial_track->fetch_sub(mem);
     }
     if (!engine) {
         return false;
@@ -212,12 +245,12 @@ bool ObjectRegistry::memoryDeallocated(size_t mem) {
 }
 
 SystemAllocationGuard::SystemAllocationGuard() {
-    engine = th->get();
-    th->set(nullptr);
+    engine = th;
+    th = nullptr;
 }
 
 SystemAllocationGuard::~SystemAllocationGuard() {
-    th->set(engine);
+    th = engine;
 }
 
 #endif
@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <memcached/allocator_hooks.h>
+
 #include <atomic>
 
 class EventuallyPersistentEngine;
@@ -34,7 +36,7 @@ class StoredValue;
 
 class ObjectRegistry {
 public:
-    static void initialize(get_allocation_size func);
+    static void initialize(ALLOCATOR_HOOKS_API& hooks);
 
     /**
      * Resets the ObjectRegistry back to initial state (before initialize()
@@ -54,9 +56,25 @@ public:
 
     static EventuallyPersistentEngine *getCurrentEngine();
 
+    /**
+     * Sets the engine the calling thread works for, switching the thread
+     * to the allocator arena of the engine (or the default arena when
+     * leaving it) if the engine has one of its own.
+     */
     static EventuallyPersistentEngine *onSwitchThread(EventuallyPersistentEngine *engine,
                                                       bool want_old_thread_local = false);
 
+    /**
+     * Acquires an allocator arena for a bucket, reusing one a deleted
+     * bucket released if any (arenas can't be destroyed).
+     * @return the arena, or 0 (the default arena) if the allocator doesn't
+     *         support arenas
+     */
+    static unsigned acquireArena();
+
+    /// Releases the arena of a bucket being deleted, for reuse
+    static void releaseArena(unsigned arena);
+
     static void setStats(std::atomic<size_t>* init_track);
     static bool memoryAllocated(size_t mem);
     static bool memoryDeallocated(size_t mem);
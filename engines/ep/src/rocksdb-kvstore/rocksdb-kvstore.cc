@@ -19,26 +19,94 @@
 
 #include "rocksdb-kvstore.h"
 
+#include "configuration.h"
+#include "ep_time.h"
 #include "kvstore_config.h"
 #include "kvstore_priv.h"
+#include "stats.h"
 
 #include <rocksdb/convenience.h>
+#include <rocksdb/table.h>
 
 #include <string.h>
 #include <algorithm>
 #include <limits>
+#include <tuple>
+#include <unordered_map>
 
 #include "vbucket.h"
 
 static const size_t DEFAULT_VAL_SIZE(64 * 1024);
 
+// The size of the header of a document value, before the value itself (see
+// mkValSlice)
+static const size_t VAL_HEADER_SIZE(sizeof(ItemMetaData) + sizeof(uint8_t) +
+                                    sizeof(int64_t) + sizeof(uint8_t) +
+                                    sizeof(uint32_t));
+
+static bool matches_prefix(rocksdb::Slice s, size_t len, const char* p) {
+    return s.size() >= len && std::memcmp(p, s.data(), len) == 0;
+}
+
+RocksDBMemoryBudget::RocksDBMemoryBudget(Configuration& config, EPStats& st)
+    : stats(st), blockCacheRatio(config.getRocksdbBlockCacheRatio()) {
+    const size_t quota = config.getMaxSize();
+    if (blockCacheRatio > 0) {
+        blockCache = rocksdb::NewLRUCache(size_t(quota * blockCacheRatio));
+    }
+    const float memtablesRatio = config.getRocksdbMemtablesRatio();
+    if (memtablesRatio > 0) {
+        writeBufferManager = std::make_shared<rocksdb::WriteBufferManager>(
+                size_t(quota * memtablesRatio));
+    }
+}
+
+void RocksDBMemoryBudget::setQuota(size_t quota) {
+    if (blockCache) {
+        blockCache->SetCapacity(size_t(quota * blockCacheRatio));
+    }
+}
+
+void RocksDBMemoryBudget::updateStats() {
+    if (blockCache) {
+        stats.rocksdbBlockCacheMemory.store(blockCache->GetUsage());
+    }
+    if (writeBufferManager) {
+        stats.rocksdbMemTableMemory.store(writeBufferManager->memory_usage());
+    }
+}
+
+RocksRequest::RocksRequest(const Item& item,
+                           MutationRequestCallback& cb,
+                           bool del)
+    : IORequest(item.getVBucketId(), cb, del, item.getKey()),
+      item(item) {
+    dataSize = item.getNBytes();
+}
+
 RocksDBKVStore::RocksDBKVStore(KVStoreConfig& config)
     : KVStore(config),
       valBuffer(NULL),
       valSize(0),
+      inTransaction(false),
+      compactionFilter(*this,
+                       ObjectRegistry::getCurrentEngine(),
+                       RocksDBCompactionFilter::Family::Documents),
+      seqnoCompactionFilter(*this,
+                            ObjectRegistry::getCurrentEngine(),
+                            RocksDBCompactionFilter::Family::Seqnos),
+      metaCompactionFilter(*this,
+                           ObjectRegistry::getCurrentEngine(),
+                           RocksDBCompactionFilter::Family::Metadata),
+      compactionCtx(nullptr),
+      purgedSeqnos(config.getMaxVBuckets()),
+      cachedDeleteCount(config.getMaxVBuckets()),
       scanCounter(0),
-      logger(config.getLogger()) {
+      logger(config.getLogger()),
+      memoryBudget(config.getRocksDBMemoryBudget()) {
     cachedVBStates.resize(configuration.getMaxVBuckets());
+    cachedDocCount.assign(configuration.getMaxVBuckets(),
+                          Couchbase::RelaxedAtomic<size_t>(0));
 
     writeOptions.sync = true;
 
@@ -100,11 +168,41 @@ void RocksDBKVStore::open() {
     defaultCFOptions = rocksdb::ColumnFamilyOptions(rdbOptions);
     seqnoCFOptions = rocksdb::ColumnFamilyOptions(rdbOptions);
     localCFOptions = rocksdb::ColumnFamilyOptions(rdbOptions);
+    metaCFOptions = rocksdb::ColumnFamilyOptions(rdbOptions);
 
     rdbOptions.create_if_missing = true;
     rdbOptions.create_missing_column_families = true;
 
+    // Account for the block cache and the memtables at the bucket level,
+    // so that they don't grow with the number of shards
+    if (memoryBudget && memoryBudget->getWriteBufferManager()) {
+        rdbOptions.write_buffer_manager =
+                memoryBudget->getWriteBufferManager();
+    }
+    if (memoryBudget && memoryBudget->getBlockCache()) {
+        // Keep the rest of the table options from RocksDBCFOptions
+        rocksdb::BlockBasedTableOptions tableOptions;
+        if (rdbOptions.table_factory &&
+            std::string(rdbOptions.table_factory->Name()) ==
+                    "BlockBasedTable") {
+            tableOptions = *static_cast<rocksdb::BlockBasedTableOptions*>(
+                    rdbOptions.table_factory->GetOptions());
+        }
+        tableOptions.block_cache = memoryBudget->getBlockCache();
+        std::shared_ptr<rocksdb::TableFactory> tableFactory(
+                rocksdb::NewBlockBasedTableFactory(tableOptions));
+        for (auto* cfOptions : {&defaultCFOptions,
+                                &seqnoCFOptions,
+                                &localCFOptions,
+                                &metaCFOptions}) {
+            cfOptions->table_factory = tableFactory;
+        }
+    }
+
     seqnoCFOptions.comparator = &vbidSeqnoComparator;
+    defaultCFOptions.compaction_filter = &compactionFilter;
+    seqnoCFOptions.compaction_filter = &seqnoCompactionFilter;
+    metaCFOptions.compaction_filter = &metaCompactionFilter;
 
     /* Use a listener to set the appropriate engine in the
      * flusher threads RocksDB creates. We need the flusher threads to
@@ -126,7 +224,9 @@ void RocksDBKVStore::open() {
 
             rocksdb::ColumnFamilyDescriptor("vbid_seqno_to_key",
                                             seqnoCFOptions),
-            rocksdb::ColumnFamilyDescriptor("_local", localCFOptions)};
+            rocksdb::ColumnFamilyDescriptor("_local", localCFOptions),
+            rocksdb::ColumnFamilyDescriptor("vbid_key_to_meta",
+                                            metaCFOptions)};
 
     std::vector<rocksdb::ColumnFamilyHandle*> handles;
 
@@ -145,45 +245,184 @@ void RocksDBKVStore::open() {
     defaultFamilyHandle.reset(handles[0]);
     seqnoFamilyHandle.reset(handles[1]);
     localFamilyHandle.reset(handles[2]);
+    metaFamilyHandle.reset(handles[3]);
 
     // Attempt to read persisted vb states
     std::unique_ptr<rocksdb::Iterator> it(
             db->NewIterator(rocksdb::ReadOptions(), localFamilyHandle.get()));
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+    const std::string prefix = getVbstatePrefix();
+    for (it->Seek(prefix);
+         it->Valid() &&
+         matches_prefix(it->key(), prefix.size(), prefix.data());
+         it->Next()) {
         uint16_t vb = std::stoi(it->key().ToString().substr(
-                getVbstatePrefix().length(), std::string::npos));
+                prefix.length(), std::string::npos));
         readVBState(vb);
+        readDocCounts(vb);
     }
 }
 
 void RocksDBKVStore::close() {
-    batch.reset();
+    pendingReqs.clear();
+    inTransaction = false;
     defaultFamilyHandle.reset();
     seqnoFamilyHandle.reset();
     localFamilyHandle.reset();
+    metaFamilyHandle.reset();
     db.reset();
 }
 
 bool RocksDBKVStore::begin() {
-    if (!batch) {
-        batch = std::make_unique<rocksdb::WriteBatch>();
-    }
-    return bool(batch);
+    inTransaction = true;
+    return inTransaction;
 }
 
 bool RocksDBKVStore::commit(const Item* collectionsManifest) {
     std::lock_guard<std::mutex> lg(writeLock);
-    if (batch) {
-        rocksdb::Status s = db->Write(writeOptions, batch.get());
+    if (inTransaction) {
+        rocksdb::WriteBatch writeBatch;
+        std::vector<bool> existing;
+        std::unordered_map<uint16_t, DocCounts> counts;
+        writeRequests(writeBatch, existing, counts);
+        rocksdb::Status s = db->Write(writeOptions, &writeBatch);
         if (s.ok()) {
-            batch.reset();
+            for (const auto& vbCounts : counts) {
+                cachedDocCount[vbCounts.first] = vbCounts.second.items;
+                cachedDeleteCount[vbCounts.first] = vbCounts.second.deletes;
+            }
+            commitCallback(existing);
+            pendingReqs.clear();
+            inTransaction = false;
+            if (memoryBudget) {
+                memoryBudget->updateStats();
+            }
+        } else {
+            logger.log(EXTENSION_LOG_WARNING,
+                       "RocksDBKVStore::commit: Write error:%s",
+                       s.ToString().c_str());
+        }
+    }
+    return !inTransaction;
+}
+
+void RocksDBKVStore::writeRequests(
+        rocksdb::WriteBatch& writeBatch,
+        std::vector<bool>& existing,
+        std::unordered_map<uint16_t, DocCounts>& counts) {
+    std::vector<std::string> keys;
+    keys.reserve(pendingReqs.size());
+    for (const auto& req : pendingReqs) {
+        keys.push_back(mkKeyStr(req->getVBucketId(), req->getKey()));
+    }
+
+    // Look up the revisions of the documents currently in the DB, to
+    // replace their seqno entries (and to tell inserts from updates).
+    std::vector<rocksdb::Slice> keySlices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    auto statuses = getMetaEntries(rocksdb::ReadOptions(), keySlices, values);
+
+    // The seqno and deleted state of each key as of the previous request of
+    // the transaction for the key, if any
+    std::unordered_map<std::string, std::pair<int64_t, bool>> written;
+
+    existing.assign(pendingReqs.size(), false);
+    for (size_t ii = 0; ii < pendingReqs.size(); ++ii) {
+        const auto& item = pendingReqs[ii]->getItem();
+        const uint16_t vbid = item.getVBucketId();
+        const auto& key = keys[ii];
+
+        bool found = false;
+        int64_t oldSeqno = 0;
+        bool oldDeleted = false;
+        auto it = written.find(key);
+        if (it != written.end()) {
+            found = true;
+            std::tie(oldSeqno, oldDeleted) = it->second;
+        } else if (statuses[ii].ok()) {
+            found = true;
+            auto old = grokValSlice(
+                    vbid, item.getKey(), values[ii], GetMetaOnly::Yes);
+            oldSeqno = old->getBySeqno();
+            oldDeleted = old->isDeleted();
+        }
+        existing[ii] = found && !oldDeleted;
+
+        auto vbCounts = counts.find(vbid);
+        if (vbCounts == counts.end()) {
+            DocCounts current;
+            current.items = cachedDocCount[vbid];
+            current.deletes = cachedDeleteCount[vbid];
+            vbCounts = counts.emplace(vbid, current).first;
+        }
+        auto& count = vbCounts->second;
+        if (found) {
+            size_t& old = oldDeleted ? count.deletes : count.items;
+            old = old > 0 ? old - 1 : 0;
+        }
+        ++(item.isDeleted() ? count.deletes : count.items);
+
+        if (found && oldSeqno != item.getBySeqno()) {
+            writeBatch.Delete(seqnoFamilyHandle.get(),
+                              mkSeqnoStr(vbid, oldSeqno));
+        }
+
+        // The seqno entry is the key (without its vbid) followed by the
+        // document, as stored in the default Column Family.
+        auto v = mkValSlice(item);
+        const uint16_t keyLen = uint16_t(key.size() - sizeof(uint16_t));
+        rocksdb::Slice seqnoValParts[] = {
+                rocksdb::Slice(reinterpret_cast<const char*>(&keyLen),
+                               sizeof(keyLen)),
+                rocksdb::Slice(key.data() + sizeof(uint16_t), keyLen),
+                v};
+        auto seq = mkSeqnoStr(vbid, item.getBySeqno());
+        rocksdb::Slice seqSlice(seq);
+        rocksdb::Slice keySlice(key);
+
+        rocksdb::Status s1 = writeBatch.Put(keySlice, v);
+        rocksdb::Status s2 =
+                writeBatch.Put(seqnoFamilyHandle.get(),
+                               rocksdb::SliceParts(&seqSlice, 1),
+                               rocksdb::SliceParts(seqnoValParts, 3));
+        rocksdb::Status s3 = writeBatch.Put(
+                metaFamilyHandle.get(), keySlice, mkMetaStr(v));
+        cb_assert(s1.ok());
+        cb_assert(s2.ok());
+        cb_assert(s3.ok());
+
+        written[key] = std::make_pair(item.getBySeqno(), item.isDeleted());
+    }
+
+    for (const auto& vbCounts : counts) {
+        saveDocCounts(writeBatch, vbCounts.first, vbCounts.second);
+    }
+}
+
+void RocksDBKVStore::commitCallback(const std::vector<bool>& existing) {
+    for (size_t ii = 0; ii < pendingReqs.size(); ++ii) {
+        auto& req = *pendingReqs[ii];
+        const size_t keySize = req.getKey().size();
+        const size_t dataSize = req.getItem().getNBytes();
+        ++st.io_num_write;
+        st.io_write_bytes += (keySize + dataSize);
+
+        if (req.isDelete()) {
+            // Whether the deletion is for an existing item
+            int rv = existing[ii] ? 1 : 0;
+            st.delTimeHisto.add(req.getDelta() / 1000);
+            req.getDelCallback()->callback(rv);
+        } else {
+            st.writeTimeHisto.add(req.getDelta() / 1000);
+            st.writeSizeHisto.add(dataSize + keySize);
+            mutation_result p(MUTATION_SUCCESS, !existing[ii]);
+            req.getSetCallback()->callback(p);
         }
     }
-    return !batch;
 }
 
 void RocksDBKVStore::rollback() {
-    batch.reset();
+    pendingReqs.clear();
+    inTransaction = false;
 }
 
 void RocksDBKVStore::adjustValBuffer(const size_t to) {
@@ -212,27 +451,15 @@ std::vector<vbucket_state*> RocksDBKVStore::listPersistedVbuckets() {
 }
 
 void RocksDBKVStore::set(const Item& itm, Callback<mutation_result>& cb) {
-    storeItem(itm);
-
-    // TODO RDB: This callback should not really be called until
-    // after the batch is committed.
-    std::pair<int, bool> p(1, true);
-    cb.callback(p);
-}
-
-void RocksDBKVStore::storeItem(const Item& itm) {
-    // TODO RDB: Consider using SliceParts to avoid copying if
-    // possible.
-    uint16_t vbid = itm.getVBucketId();
-    auto k = mkKeyStr(vbid, itm.getKey());
-    auto v = mkValSlice(itm);
-    auto seq = mkSeqnoStr(vbid, itm.getBySeqno());
-
-    // TODO RDB: check status.
-    rocksdb::Status s1 = batch->Put(k, v);
-    rocksdb::Status s2 = batch->Put(seqnoFamilyHandle.get(), seq, k);
-    cb_assert(s1.ok());
-    cb_assert(s2.ok());
+    if (!inTransaction) {
+        throw std::invalid_argument(
+                "RocksDBKVStore::set: inTransaction must be true to perform a "
+                "set operation.");
+    }
+    MutationRequestCallback requestcb;
+    requestcb.setCb = &cb;
+    pendingReqs.push_back(
+            std::make_unique<RocksRequest>(itm, requestcb, false));
 }
 
 GetValue RocksDBKVStore::get(const DocKey& key, uint16_t vb, bool fetchDelete) {
@@ -247,34 +474,114 @@ GetValue RocksDBKVStore::getWithHeader(void* dbHandle,
     std::string k(mkKeyStr(vb, key));
     std::string value;
 
-    // TODO RDB: use a PinnableSlice to avoid some memcpy
-    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), k, &value);
+    rocksdb::Status s;
+    if (getMetaOnly == GetMetaOnly::Yes) {
+        std::vector<std::string> values;
+        s = getMetaEntries(rocksdb::ReadOptions(), {k}, values).front();
+        value = std::move(values.front());
+    } else {
+        // TODO RDB: use a PinnableSlice to avoid some memcpy
+        s = db->Get(rocksdb::ReadOptions(), k, &value);
+    }
     if (!s.ok()) {
         return GetValue{NULL, ENGINE_KEY_ENOENT};
     }
     return makeGetValue(vb, key, value, getMetaOnly);
 }
 
+std::vector<rocksdb::Status> RocksDBKVStore::getMetaEntries(
+        const rocksdb::ReadOptions& options,
+        const std::vector<rocksdb::Slice>& keys,
+        std::vector<std::string>& values) {
+    std::vector<rocksdb::ColumnFamilyHandle*> families(keys.size(),
+                                                       metaFamilyHandle.get());
+    auto statuses = db->MultiGet(options, families, keys, &values);
+
+    std::vector<size_t> missing;
+    for (size_t ii = 0; ii < statuses.size(); ++ii) {
+        if (statuses[ii].IsNotFound()) {
+            missing.push_back(ii);
+        }
+    }
+    if (missing.empty()) {
+        return statuses;
+    }
+
+    std::vector<rocksdb::Slice> docKeys;
+    docKeys.reserve(missing.size());
+    for (auto ii : missing) {
+        docKeys.push_back(keys[ii]);
+    }
+    std::vector<std::string> docs;
+    auto docStatuses = db->MultiGet(options, docKeys, &docs);
+    for (size_t jj = 0; jj < missing.size(); ++jj) {
+        statuses[missing[jj]] = docStatuses[jj];
+        values[missing[jj]] = std::move(docs[jj]);
+    }
+    return statuses;
+}
+
 void RocksDBKVStore::getMulti(uint16_t vb, vb_bgfetch_queue_t& itms) {
-    // TODO RDB: RocksDB supports a multi get which we should use here.
+    if (itms.empty()) {
+        return;
+    }
+
+    // Look the keys up in (at most) two MultiGets, one for the documents
+    // and one for the metadata of the meta-only fetches, in key order (so
+    // the reads walk each SST file forwards), against one snapshot, so that
+    // all of the items fetched by a batch are read from the same point in
+    // time.
+    using Fetch = std::pair<std::string, vb_bgfetch_queue_t::value_type*>;
+    std::vector<Fetch> docFetches;
+    std::vector<Fetch> metaFetches;
     for (auto& it : itms) {
-        auto& key = it.first;
-        std::string vbAndKey(mkKeyStr(vb, it.first));
-        std::string value;
-        rocksdb::Status s = db->Get(rocksdb::ReadOptions(), vbAndKey, &value);
-        if (s.ok()) {
-            it.second.value =
-                    makeGetValue(vb, key, value, it.second.isMetaOnly);
-            GetValue* rv = &it.second.value;
-            for (auto& fetch : it.second.bgfetched_list) {
-                fetch->value = rv;
+        auto& fetches = it.second.isMetaOnly == GetMetaOnly::Yes ? metaFetches
+                                                                 : docFetches;
+        fetches.emplace_back(mkKeyStr(vb, it.first), &it);
+    }
+
+    rocksdb::ReadOptions options;
+    options.snapshot = db->GetSnapshot();
+    for (auto* fetches : {&docFetches, &metaFetches}) {
+        if (fetches->empty()) {
+            continue;
+        }
+        std::sort(fetches->begin(),
+                  fetches->end(),
+                  [](const Fetch& a, const Fetch& b) {
+                      return a.first < b.first;
+                  });
+
+        std::vector<rocksdb::Slice> keys;
+        keys.reserve(fetches->size());
+        for (const auto& fetch : *fetches) {
+            keys.emplace_back(fetch.first);
+        }
+
+        std::vector<std::string> values;
+        auto statuses = fetches == &metaFetches
+                                ? getMetaEntries(options, keys, values)
+                                : db->MultiGet(options, keys, &values);
+
+        for (size_t ii = 0; ii < fetches->size(); ++ii) {
+            auto& key = (*fetches)[ii].second->first;
+            auto& ctx = (*fetches)[ii].second->second;
+            if (statuses[ii].ok()) {
+                ctx.value = makeGetValue(vb, key, values[ii], ctx.isMetaOnly);
+            } else {
+                ctx.value.setStatus(ENGINE_KEY_ENOENT);
             }
-        } else {
-            for (auto& fetch : it.second.bgfetched_list) {
-                fetch->value->setStatus(ENGINE_KEY_ENOENT);
+            for (auto& fetch : ctx.bgfetched_list) {
+                fetch->value = &ctx.value;
             }
         }
     }
+    db->ReleaseSnapshot(options.snapshot);
+
+    // The reads (may have) filled the block cache
+    if (memoryBudget) {
+        memoryBudget->updateStats();
+    }
 }
 
 void RocksDBKVStore::reset(uint16_t vbucketId) {
@@ -284,16 +591,15 @@ void RocksDBKVStore::reset(uint16_t vbucketId) {
 }
 
 void RocksDBKVStore::del(const Item& itm, Callback<int>& cb) {
-    // TODO RDB: Deleted items remain as tombstones, but are not yet
-    // expired - they will accumuate forever.
-    storeItem(itm);
-
-    int rv(1);
-    cb.callback(rv);
-}
-
-static bool matches_prefix(rocksdb::Slice s, size_t len, const char* p) {
-    return s.size() >= len && std::memcmp(p, s.data(), len) == 0;
+    if (!inTransaction) {
+        throw std::invalid_argument(
+                "RocksDBKVStore::del: inTransaction must be true to perform a "
+                "delete operation.");
+    }
+    // Deleted items remain as tombstones until compactDB purges them.
+    MutationRequestCallback requestcb;
+    requestcb.delCb = &cb;
+    pendingReqs.push_back(std::make_unique<RocksRequest>(itm, requestcb, true));
 }
 
 void RocksDBKVStore::delVBucket(uint16_t vb, uint64_t vb_version) {
@@ -303,12 +609,14 @@ void RocksDBKVStore::delVBucket(uint16_t vb, uint64_t vb_version) {
     const char* prefix(reinterpret_cast<const char*>(&vb));
     std::string start(prefix, sizeof(vb));
 
-    // We must delete both all the documents for the VB,
-    // and all the vbid:seqno=>vbid:key mappings
+    // We must delete all the documents for the VB, all the
+    // vbid:seqno=>vbid:key mappings and all the metadata of the documents
     std::vector<rocksdb::ColumnFamilyHandle*> CFHandles{
-            defaultFamilyHandle.get(), seqnoFamilyHandle.get()};
+            defaultFamilyHandle.get(),
+            seqnoFamilyHandle.get(),
+            metaFamilyHandle.get()};
 
-    // makes use of the fact that keys in both CFs are vbid prefixed
+    // makes use of the fact that keys in all those CFs are vbid prefixed
     // if we move to a db per vb this will just be dropping the whole DB.
     for (auto* handle : CFHandles) {
         std::unique_ptr<rocksdb::Iterator> it(
@@ -320,8 +628,12 @@ void RocksDBKVStore::delVBucket(uint16_t vb, uint64_t vb_version) {
             delBatch.Delete(handle, it->key());
         }
     }
+    delBatch.Delete(localFamilyHandle.get(),
+                    getDocCountPrefix() + std::to_string(vb));
     rocksdb::Status s = db->Write(writeOptions, &delBatch);
     cb_assert(s.ok());
+    cachedDocCount[vb] = 0;
+    cachedDeleteCount[vb] = 0;
 }
 
 bool RocksDBKVStore::snapshotVBucket(uint16_t vbucketId,
@@ -365,6 +677,156 @@ void RocksDBKVStore::destroyInvalidVBuckets(bool) {
     // TODO RDB:  implement
 }
 
+bool RocksDBKVStore::compactDB(compaction_ctx* ctx) {
+    std::lock_guard<std::mutex> lg(compactionLock);
+    const uint16_t vbid = ctx->db_file_id;
+
+    // The documents of the vbucket are the keys prefixed by its id; the end
+    // of the range is the (bytewise) successor of the prefix.
+    std::string start(reinterpret_cast<const char*>(&vbid), sizeof(vbid));
+    std::string end(start);
+    while (!end.empty() && uint8_t(end.back()) == 0xff) {
+        end.pop_back();
+    }
+    if (!end.empty()) {
+        end.back()++;
+    }
+    rocksdb::Slice startSlice(start);
+    rocksdb::Slice endSlice(end);
+
+    rocksdb::CompactRangeOptions options;
+    options.bottommost_level_compaction =
+            rocksdb::BottommostLevelCompaction::kForce;
+
+    // The seqno entries of the vbucket
+    std::string seqnoStart = mkSeqnoStr(vbid, 0);
+    std::string seqnoEnd =
+            mkSeqnoStr(vbid, std::numeric_limits<int64_t>::max());
+    rocksdb::Slice seqnoStartSlice(seqnoStart);
+    rocksdb::Slice seqnoEndSlice(seqnoEnd);
+
+    compactionCtx.store(ctx);
+    auto s = db->CompactRange(options,
+                              defaultFamilyHandle.get(),
+                              &startSlice,
+                              end.empty() ? nullptr : &endSlice);
+    if (s.ok()) {
+        s = db->CompactRange(options,
+                             seqnoFamilyHandle.get(),
+                             &seqnoStartSlice,
+                             &seqnoEndSlice);
+    }
+    if (s.ok()) {
+        s = db->CompactRange(options,
+                             metaFamilyHandle.get(),
+                             &startSlice,
+                             end.empty() ? nullptr : &endSlice);
+    }
+    compactionCtx.store(nullptr);
+
+    ctx->max_purged_seq[vbid] = purgedSeqnos[vbid].load();
+    if (s.ok()) {
+        recountDocuments(vbid);
+    }
+
+    if (!s.ok()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::compactDB: CompactRange error:%s, "
+                   "vb:%" PRIu16,
+                   s.ToString().c_str(),
+                   vbid);
+        return false;
+    }
+    return true;
+}
+
+bool RocksDBKVStore::filterCompactedItem(
+        const rocksdb::Slice& key,
+        const rocksdb::Slice& entry,
+        RocksDBCompactionFilter::Family family) {
+    rocksdb::Slice value(entry);
+    if (family == RocksDBCompactionFilter::Family::Seqnos) {
+        // Skip the key of the document
+        uint16_t keyLen;
+        if (value.size() < sizeof(keyLen)) {
+            return false;
+        }
+        std::memcpy(&keyLen, value.data(), sizeof(keyLen));
+        if (value.size() < sizeof(keyLen) + keyLen) {
+            return false;
+        }
+        value.remove_prefix(sizeof(keyLen) + keyLen);
+    }
+    if (key.size() <= sizeof(uint16_t) ||
+        value.size() < sizeof(ItemMetaData) + sizeof(uint8_t) +
+                               sizeof(int64_t)) {
+        return false;
+    }
+
+    uint16_t vbid;
+    std::memcpy(&vbid, key.data(), sizeof(vbid));
+
+    // Background compactions keep everything; the purge settings come from
+    // the explicit compaction of the vbucket.
+    compaction_ctx* ctx = compactionCtx.load();
+    if (!ctx || ctx->db_file_id != vbid) {
+        return false;
+    }
+
+    ItemMetaData meta;
+    const char* src = value.data();
+    std::memcpy(&meta, src, sizeof(meta));
+    src += sizeof(meta);
+    uint8_t deleted;
+    std::memcpy(&deleted, src, sizeof(deleted));
+    src += sizeof(deleted);
+    int64_t bySeqno;
+    std::memcpy(&bySeqno, src, sizeof(bySeqno));
+
+    const time_t now = ep_real_time();
+    if (deleted) {
+        // The exptime of a tombstone is the time of its deletion
+        if (ctx->drop_deletes ||
+            (uint64_t(meta.exptime) < ctx->purge_before_ts &&
+             (!ctx->purge_before_seq ||
+              uint64_t(bySeqno) <= ctx->purge_before_seq))) {
+            updatePurgedSeqno(vbid, bySeqno);
+            return true;
+        }
+    } else if (family == RocksDBCompactionFilter::Family::Documents &&
+               ctx->expiryCallback && meta.exptime && meta.exptime < now) {
+        DocKey docKey(reinterpret_cast<const uint8_t*>(key.data() +
+                                                       sizeof(uint16_t)),
+                      key.size() - sizeof(uint16_t),
+                      DocNamespace::DefaultCollection);
+        auto item = grokValSlice(vbid, docKey, value, GetMetaOnly::No);
+        time_t startTime = now;
+        ctx->expiryCallback->callback(*item, startTime);
+    }
+    return false;
+}
+
+void RocksDBKVStore::updatePurgedSeqno(uint16_t vbid, int64_t seqno) {
+    auto& purged = purgedSeqnos[vbid];
+    uint64_t current = purged.load();
+    while (current < uint64_t(seqno) &&
+           !purged.compare_exchange_weak(current, uint64_t(seqno))) {
+    }
+}
+
+bool RocksDBCompactionFilter::Filter(int level,
+                                     const rocksdb::Slice& key,
+                                     const rocksdb::Slice& existing_value,
+                                     std::string* new_value,
+                                     bool* value_changed) const {
+    // Compactions run in RocksDB's threads; the expiry callback allocates
+    // on behalf of the bucket.
+    auto* previous = ObjectRegistry::onSwitchThread(engine, true);
+    const bool remove = store.filterCompactedItem(key, existing_value, family);
+    ObjectRegistry::onSwitchThread(previous);
+    return remove;
+}
+
 size_t RocksDBKVStore::getNumShards() {
     return configuration.getMaxShards();
 }
@@ -373,11 +835,12 @@ StorageProperties RocksDBKVStore::getStorageProperties(void) {
     StorageProperties rv(StorageProperties::EfficientVBDump::Yes,
                          StorageProperties::EfficientVBDeletion::Yes,
                          StorageProperties::PersistedDeletion::No,
-                         // TODO RDB: Not strictly true, multiGet
-                         // does not yet use the underlying multi get
-                         // of RocksDB
+                         // getMulti() uses the MultiGet of RocksDB
                          StorageProperties::EfficientGet::Yes,
-                         StorageProperties::ConcurrentWriteCompact::Yes);
+                         StorageProperties::ConcurrentWriteCompact::Yes,
+                         // All the vbuckets of the shard share the DB, and
+                         // the WriteBatch of the transaction
+                         StorageProperties::GroupCommit::Yes);
     return rv;
 }
 
@@ -464,6 +927,15 @@ rocksdb::Slice RocksDBKVStore::mkValSlice(const Item& item) {
     return rocksdb::Slice(valBuffer, dest - valBuffer);
 }
 
+std::string RocksDBKVStore::mkMetaStr(const rocksdb::Slice& val) {
+    std::string meta(val.data(), VAL_HEADER_SIZE);
+    const uint32_t valueLen = 0;
+    std::memcpy(&meta[VAL_HEADER_SIZE - sizeof(valueLen)],
+                &valueLen,
+                sizeof(valueLen));
+    return meta;
+}
+
 std::unique_ptr<Item> RocksDBKVStore::grokValSlice(uint16_t vb,
                                                    const DocKey& key,
                                                    const rocksdb::Slice& s,
@@ -583,6 +1055,8 @@ void RocksDBKVStore::readVBState(uint16_t vbid) {
                 getJSONObjString(cJSON_GetObjectItem(jsonObj, "max_cas"));
         const std::string hlcCasEpoch =
                 getJSONObjString(cJSON_GetObjectItem(jsonObj, "hlc_epoch"));
+        const std::string purgeSeqnoValue =
+                getJSONObjString(cJSON_GetObjectItem(jsonObj, "purge_seqno"));
         mightContainXattrs = getJSONObjBool(
                 cJSON_GetObjectItem(jsonObj, "might_contain_xattrs"));
 
@@ -624,6 +1098,10 @@ void RocksDBKVStore::readVBState(uint16_t vbid) {
                 hlcCasEpochSeqno = std::stoull(hlcCasEpoch);
             }
 
+            if (!purgeSeqnoValue.empty()) {
+                purgeSeqno = std::stoull(purgeSeqnoValue);
+            }
+
             if (failover_json) {
                 char* json = cJSON_PrintUnformatted(failover_json);
                 failovers.assign(json);
@@ -633,6 +1111,7 @@ void RocksDBKVStore::readVBState(uint16_t vbid) {
         cJSON_Delete(jsonObj);
     }
 
+    updatePurgedSeqno(vbid, purgeSeqno);
     cachedVBStates[vbid] = std::make_unique<vbucket_state>(state,
                                                            checkpointId,
                                                            maxDeletedSeqno,
@@ -659,7 +1138,10 @@ bool RocksDBKVStore::saveVBState(const vbucket_state& vbState, uint16_t vbid) {
     jsonState << ",\"snap_start\": \"" << vbState.lastSnapStart << "\""
               << ",\"snap_end\": \"" << vbState.lastSnapEnd << "\""
               << ",\"max_cas\": \"" << vbState.maxCas << "\""
-              << ",\"hlc_epoch\": \"" << vbState.hlcCasEpochSeqno << "\"";
+              << ",\"hlc_epoch\": \"" << vbState.hlcCasEpochSeqno << "\""
+              << ",\"purge_seqno\": \""
+              << std::max(vbState.purgeSeqno, purgedSeqnos[vbid].load())
+              << "\"";
 
     if (vbState.mightContainXattrs) {
         jsonState << ",\"might_contain_xattrs\": true";
@@ -678,6 +1160,115 @@ bool RocksDBKVStore::saveVBState(const vbucket_state& vbState, uint16_t vbid) {
     return s.ok();
 }
 
+void RocksDBKVStore::readDocCounts(uint16_t vbid) {
+    std::string json;
+    rocksdb::Status s = db->Get(rocksdb::ReadOptions(),
+                                localFamilyHandle.get(),
+                                getDocCountPrefix() + std::to_string(vbid),
+                                &json);
+    if (s.ok()) {
+        cJSON* jsonObj = cJSON_Parse(json.c_str());
+        const std::string items = getJSONObjString(
+                cJSON_GetObjectItem(jsonObj, "item_count"));
+        const std::string deletes = getJSONObjString(
+                cJSON_GetObjectItem(jsonObj, "delete_count"));
+        cJSON_Delete(jsonObj);
+        if (!items.empty() && !deletes.empty()) {
+            cachedDocCount[vbid] = std::stoull(items);
+            cachedDeleteCount[vbid] = std::stoull(deletes);
+            return;
+        }
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::readDocCounts: Invalid document counts "
+                   "for vb:%" PRIu16 ", json:%s",
+                   vbid,
+                   json.c_str());
+    } else if (!s.IsNotFound()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::readDocCounts: error getting the "
+                   "document counts error:%s, vb:%" PRIu16,
+                   s.ToString().c_str(),
+                   vbid);
+    }
+
+    // Written before the counts were persisted; the next commit to the
+    // vbucket persists them
+    const auto counts = countDocuments(vbid, nullptr);
+    cachedDocCount[vbid] = counts.items;
+    cachedDeleteCount[vbid] = counts.deletes;
+}
+
+void RocksDBKVStore::saveDocCounts(rocksdb::WriteBatch& writeBatch,
+                                   uint16_t vbid,
+                                   const DocCounts& counts) {
+    std::stringstream json;
+    json << "{\"item_count\": \"" << counts.items << "\""
+         << ",\"delete_count\": \"" << counts.deletes << "\"}";
+    rocksdb::Status s =
+            writeBatch.Put(localFamilyHandle.get(),
+                           getDocCountPrefix() + std::to_string(vbid),
+                           json.str());
+    cb_assert(s.ok());
+}
+
+RocksDBKVStore::DocCounts RocksDBKVStore::countDocuments(
+        uint16_t vbid, const rocksdb::Snapshot* snapshot) {
+    rocksdb::ReadOptions options;
+    options.snapshot = snapshot;
+    // A one-off scan, which mustn't push the hot blocks out of the cache
+    options.fill_cache = false;
+    std::unique_ptr<rocksdb::Iterator> it(
+            db->NewIterator(options, defaultFamilyHandle.get()));
+
+    const char* prefix(reinterpret_cast<const char*>(&vbid));
+    DocCounts counts;
+    for (it->Seek(rocksdb::Slice(prefix, sizeof(vbid)));
+         it->Valid() && matches_prefix(it->key(), sizeof(vbid), prefix);
+         it->Next()) {
+        // The deleted flag follows the ItemMetaData (see mkValSlice)
+        const rocksdb::Slice value = it->value();
+        if (value.size() > sizeof(ItemMetaData) &&
+            value.data()[sizeof(ItemMetaData)]) {
+            ++counts.deletes;
+        } else {
+            ++counts.items;
+        }
+    }
+    return counts;
+}
+
+void RocksDBKVStore::recountDocuments(uint16_t vbid) {
+    const rocksdb::Snapshot* snapshot;
+    DocCounts before;
+    {
+        std::lock_guard<std::mutex> lg(writeLock);
+        snapshot = db->GetSnapshot();
+        before.items = cachedDocCount[vbid];
+        before.deletes = cachedDeleteCount[vbid];
+    }
+    const auto counted = countDocuments(vbid, snapshot);
+    db->ReleaseSnapshot(snapshot);
+
+    // Apply what was committed since the snapshot to what it holds
+    std::lock_guard<std::mutex> lg(writeLock);
+    DocCounts counts;
+    counts.items = cachedDocCount[vbid] - before.items + counted.items;
+    counts.deletes = cachedDeleteCount[vbid] - before.deletes + counted.deletes;
+
+    rocksdb::WriteBatch writeBatch;
+    saveDocCounts(writeBatch, vbid, counts);
+    rocksdb::Status s = db->Write(writeOptions, &writeBatch);
+    if (!s.ok()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::recountDocuments: Write error:%s, "
+                   "vb:%" PRIu16,
+                   s.ToString().c_str(),
+                   vbid);
+    }
+    cachedDocCount[vbid] = counts.items;
+    cachedDeleteCount[vbid] = counts.deletes;
+}
+
 int64_t RocksDBKVStore::readHighSeqnoFromDisk(uint16_t vbid) {
     std::unique_ptr<rocksdb::Iterator> it(
             db->NewIterator(rocksdb::ReadOptions(), seqnoFamilyHandle.get()));
@@ -705,6 +1296,10 @@ std::string RocksDBKVStore::getVbstatePrefix() {
     return "vbstate.";
 }
 
+std::string RocksDBKVStore::getDocCountPrefix() {
+    return "doccount.";
+}
+
 ScanContext* RocksDBKVStore::initScanContext(
         std::shared_ptr<Callback<GetValue> > cb,
         std::shared_ptr<Callback<CacheLookup> > cl,
@@ -772,39 +1367,31 @@ scan_error_t RocksDBKVStore::scan(ScanContext* ctx) {
         rocksdb::Slice seqnoSlice = it->key();
         grokSeqnoSlice(seqnoSlice, &vb, &seqno);
 
-        rocksdb::Slice keySlice = it->value();
+        // The value is the key of the document, followed by the document
+        rocksdb::Slice entry = it->value();
+        uint16_t keyLen;
+        std::memcpy(&keyLen, entry.data(), sizeof(keyLen));
+        entry.remove_prefix(sizeof(keyLen));
 
-        std::string valueStr;
-        rocksdb::Status s = db->Get(snapshotOpts, keySlice, &valueStr);
+        // TODO RDB: Deal with collections
+        DocKey key(reinterpret_cast<const uint8_t*>(entry.data()),
+                   keyLen,
+                   DocNamespace::DefaultCollection);
+        entry.remove_prefix(keyLen);
 
-        if (!s.ok()) {
-            // TODO RDB: Old seqnos are never removed from the db!
-            // If the item does not exist (s.isNotFound())
-            // the seqno => key mapping could be removed; not even
-            // a tombstone remains of that item.
+        if (ctx->keyFilter && !ctx->keyFilter(key)) {
+            ctx->lastReadSeqno = seqno;
             continue;
         }
 
-        rocksdb::Slice valSlice(valueStr);
-
-        // TODO RDB: Deal with collections
-        DocKey key(reinterpret_cast<const uint8_t*>(keySlice.data() +
-                                                    sizeof(uint16_t)),
-                   keySlice.size() - sizeof(uint16_t),
-                   DocNamespace::DefaultCollection);
-
         std::unique_ptr<Item> itm =
-                grokValSlice(ctx->vbid, key, valSlice, isMetaOnly);
+                grokValSlice(ctx->vbid, key, entry, isMetaOnly);
 
-        if (itm->getBySeqno() > seqno) {
-            // TODO RDB: Old seqnos are never removed from the db!
-            // If the item has a newer seqno now, the stale
-            // seqno => key mapping could be removed
-            continue;
-        } else if (itm->getBySeqno() < seqno) {
+        if (itm->getBySeqno() != seqno) {
             throw std::logic_error(
-                    "RocksDBKVStore::scan: index has a higher seqno"
-                    "than the document in a snapshot!");
+                    "RocksDBKVStore::scan: seqno index entry " +
+                    std::to_string(seqno) + " has a document with seqno " +
+                    std::to_string(itm->getBySeqno()));
         }
 
         bool includeDeletes =
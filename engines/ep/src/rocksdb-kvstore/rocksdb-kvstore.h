@@ -25,17 +25,65 @@
 
 #include <platform/dirutils.h>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include <kvstore.h>
 
+#include <rocksdb/cache.h>
+#include <rocksdb/compaction_filter.h>
 #include <rocksdb/db.h>
 #include <rocksdb/listener.h>
+#include <rocksdb/write_buffer_manager.h>
+#include <atomic>
 #include <string>
 
 #include "../objectregistry.h"
+#include "kvstore_priv.h"
 #include "vbucket_bgfetch_item.h"
 
+class Configuration;
+class EPStats;
+
+/**
+ * The block cache and the memtables of the RocksDB instances (one per
+ * shard) of a bucket, shared by all of them so that the memory they use is
+ * bounded by a fraction of the bucket quota (rocksdb_block_cache_ratio and
+ * rocksdb_memtables_ratio of max_size) instead of growing with the number
+ * of shards. The memory they use is reported in EPStats.
+ */
+class RocksDBMemoryBudget {
+public:
+    RocksDBMemoryBudget(Configuration& config, EPStats& stats);
+
+    /**
+     * Resize the block cache for a new bucket quota. The memtables keep the
+     * budget they were created with, as a WriteBufferManager can't be
+     * resized.
+     */
+    void setQuota(size_t quota);
+
+    /// Copy the memory used by the block cache and memtables to EPStats
+    void updateStats();
+
+    /// The shared block cache, nullptr if the shards have their own
+    const std::shared_ptr<rocksdb::Cache>& getBlockCache() const {
+        return blockCache;
+    }
+
+    /// The shared memtable budget, nullptr if the shards have none
+    const std::shared_ptr<rocksdb::WriteBufferManager>& getWriteBufferManager()
+            const {
+        return writeBufferManager;
+    }
+
+private:
+    EPStats& stats;
+    const float blockCacheRatio;
+    std::shared_ptr<rocksdb::Cache> blockCache;
+    std::shared_ptr<rocksdb::WriteBufferManager> writeBufferManager;
+};
+
 // Used to set the correct engine in the ObjectRegistry thread local
 // in RocksDB's flusher threads.
 class FlushStartListener : public rocksdb::EventListener {
@@ -97,6 +145,65 @@ public:
     }
 };
 
+class RocksDBKVStore;
+
+/**
+ * Compaction filter of the document, seqno and metadata Column Families: it
+ * purges the old tombstones and asks the engine to expire the expired
+ * documents as RocksDB compacts them. See
+ * RocksDBKVStore::filterCompactedItem.
+ */
+class RocksDBCompactionFilter : public rocksdb::CompactionFilter {
+public:
+    /// The Column Family filtered
+    enum class Family {
+        /// The documents, by key
+        Documents,
+        /// The documents (after their key), by seqno
+        Seqnos,
+        /// The metadata of the documents, by key
+        Metadata
+    };
+
+    RocksDBCompactionFilter(RocksDBKVStore& store,
+                            EventuallyPersistentEngine* epe,
+                            Family family)
+        : store(store), engine(epe), family(family) {
+    }
+
+    bool Filter(int level,
+                const rocksdb::Slice& key,
+                const rocksdb::Slice& existing_value,
+                std::string* new_value,
+                bool* value_changed) const override;
+
+    const char* Name() const override {
+        return "RocksDBCompactionFilter";
+    }
+
+private:
+    RocksDBKVStore& store;
+    EventuallyPersistentEngine* engine;
+    const Family family;
+};
+
+/**
+ * A mutation or deletion of a RocksDBKVStore transaction. The documents are
+ * written to the WriteBatch at commit, and the callback invoked once the
+ * batch is durable.
+ */
+class RocksRequest : public IORequest {
+public:
+    RocksRequest(const Item& item, MutationRequestCallback& cb, bool del);
+
+    const Item& getItem() const {
+        return item;
+    }
+
+private:
+    Item item;
+};
+
 /**
  * A persistence store based on rocksdb.
  */
@@ -192,16 +299,16 @@ public:
         return 1024;
     }
 
-    bool compactDB(compaction_ctx*) override {
-        // Explicit compaction is not needed.
-        // Compaction is continuously occurring in separate threads
-        // under RocksDB's control
-        return true;
-    }
+    /**
+     * Compaction is continuously occurring in separate threads under
+     * RocksDB's control. An explicit compaction forces all of the documents
+     * of the vbucket through the compaction filter, with the purge and
+     * expiry settings of the request.
+     */
+    bool compactDB(compaction_ctx* ctx) override;
 
-    uint16_t getDBFileId(const protocol_binary_request_compact_db&) override {
-        // Not needed if there is no explicit compaction
-        return 0;
+    uint16_t getDBFileId(const protocol_binary_request_compact_db& req) override {
+        return ntohs(req.message.header.request.vbucket);
     }
 
     vbucket_state* getVBucketState(uint16_t vbucketId) override {
@@ -209,8 +316,7 @@ public:
     }
 
     size_t getNumPersistedDeletes(uint16_t vbid) override {
-        // TODO vmx 2016-10-29: implement
-        return 0;
+        return cachedDeleteCount[vbid];
     }
 
     DBFileInfo getDbFileInfo(uint16_t vbid) override {
@@ -226,8 +332,7 @@ public:
     }
 
     size_t getItemCount(uint16_t vbid) override {
-        // TODO vmx 2016-10-29: implement
-        return 0;
+        return cachedDocCount[vbid];
     }
 
     RollbackResult rollback(uint16_t vbid,
@@ -291,6 +396,8 @@ public:
     }
 
 private:
+    friend class RocksDBCompactionFilter;
+
     /**
      * Direct access to the DB.
      */
@@ -300,6 +407,8 @@ private:
     std::unique_ptr<rocksdb::ColumnFamilyHandle> defaultFamilyHandle;
     std::unique_ptr<rocksdb::ColumnFamilyHandle> seqnoFamilyHandle;
     std::unique_ptr<rocksdb::ColumnFamilyHandle> localFamilyHandle;
+    // The metadata of the documents, by key: what a meta-only fetch reads
+    std::unique_ptr<rocksdb::ColumnFamilyHandle> metaFamilyHandle;
 
     char* valBuffer;
     size_t valSize;
@@ -308,6 +417,7 @@ private:
     rocksdb::ColumnFamilyOptions defaultCFOptions;
     rocksdb::ColumnFamilyOptions seqnoCFOptions;
     rocksdb::ColumnFamilyOptions localCFOptions;
+    rocksdb::ColumnFamilyOptions metaCFOptions;
 
     void open();
 
@@ -323,6 +433,26 @@ private:
     void adjustValBuffer(const size_t);
 
     rocksdb::Slice mkValSlice(const Item& item);
+
+    /**
+     * @return the entry of the metadata Column Family for a document value
+     *         written by mkValSlice: its header, with a value length of 0
+     */
+    std::string mkMetaStr(const rocksdb::Slice& val);
+
+    /**
+     * Look up the metadata of documents of the default Column Family,
+     * falling back to their document for any document written before the
+     * metadata Column Family was added.
+     *
+     * @param keys the keys (as made by mkKeyStr) to look up
+     * @param values set to the metadata entry or the document of each key
+     * @return the status of the lookup of each key
+     */
+    std::vector<rocksdb::Status> getMetaEntries(
+            const rocksdb::ReadOptions& options,
+            const std::vector<rocksdb::Slice>& keys,
+            std::vector<std::string>& values);
     rocksdb::SliceParts mkValSliceParts(const Item& item);
     std::unique_ptr<Item> grokValSlice(uint16_t vb,
                                        const DocKey& key,
@@ -334,17 +464,99 @@ private:
                           const std::string& value,
                           GetMetaOnly getMetaOnly = GetMetaOnly::No);
 
-    void storeItem(const Item& item);
-
     void readVBState(uint16_t vbid);
 
+    /// The number of documents and of tombstones of a vbucket in the DB
+    struct DocCounts {
+        size_t items = 0;
+        size_t deletes = 0;
+    };
+
+    /**
+     * Load the document counts of a vbucket, which commit() persists with
+     * the documents. A DB written without them has its documents counted.
+     */
+    void readDocCounts(uint16_t vbid);
+
+    /// Add the document counts of the vbucket to a WriteBatch
+    void saveDocCounts(rocksdb::WriteBatch& writeBatch,
+                       uint16_t vbid,
+                       const DocCounts& counts);
+
+    /// Count the documents of the vbucket (in the given snapshot, if any)
+    DocCounts countDocuments(uint16_t vbid, const rocksdb::Snapshot* snapshot);
+
+    /**
+     * Recount the documents of a vbucket once the compaction has purged its
+     * tombstones, as the compaction filter runs before the outcome of the
+     * compaction is visible (and the flusher may be writing the same keys
+     * meanwhile).
+     */
+    void recountDocuments(uint16_t vbid);
+
     bool saveVBState(const vbucket_state& vbState, uint16_t vbid);
 
     int64_t readHighSeqnoFromDisk(uint16_t vbid);
 
+    /**
+     * Decide what a compaction does with a document.
+     *
+     * Only the explicit compaction of a vbucket (compactDB) filters its
+     * documents, so that the engine learns the seqnos purged; the
+     * background compactions keep everything.
+     *
+     * A tombstone is purged if it is older than the purge time (and seqno)
+     * of the compaction, or if the compaction drops all of the deletes.
+     *
+     * An expired document is kept, but handed to the expiry callback of the
+     * explicit compaction in progress, as the couchstore compactor does; the
+     * engine then persists a tombstone for it, which is purged later.
+     *
+     * @param family the Column Family of the entry; in the seqno one the
+     *               document follows the key in the value, and only the
+     *               entries of the document one are expired
+     * @return true if the document must be dropped
+     */
+    bool filterCompactedItem(const rocksdb::Slice& key,
+                             const rocksdb::Slice& entry,
+                             RocksDBCompactionFilter::Family family);
+
+    /**
+     * Write the documents of the transaction to a WriteBatch.
+     *
+     * Each document is written to the default Column Family (by key) and,
+     * with its key, to the seqno Column Family, from which the entry of the
+     * previous revision of the document is removed. Hence a by-seqno scan
+     * reads each live revision once, in a single pass over the seqno Column
+     * Family. Its metadata is also written to the metadata Column Family,
+     * so that a meta-only fetch (and the lookup of the previous revision
+     * here) doesn't read the value.
+     *
+     * @param writeBatch the batch to write to
+     * The document counts of each vbucket written to are updated in the
+     * batch too, so that they are always those of the documents on disk.
+     *
+     * @param existing set to whether each document of the transaction
+     *                 existed (and was not deleted) in the DB
+     * @param counts set to the document counts of each vbucket written to,
+     *               once the batch is written
+     */
+    void writeRequests(rocksdb::WriteBatch& writeBatch,
+                       std::vector<bool>& existing,
+                       std::unordered_map<uint16_t, DocCounts>& counts);
+
+    /// Invoke the callbacks of the requests of a committed transaction
+    void commitCallback(const std::vector<bool>& existing);
+
+    /// Raise the highest seqno purged from the vbucket to the given one
+    void updatePurgedSeqno(uint16_t vbid, int64_t seqno);
+
     std::string getVbstatePrefix();
 
-    std::unique_ptr<rocksdb::WriteBatch> batch;
+    std::string getDocCountPrefix();
+
+    bool inTransaction;
+    std::vector<std::unique_ptr<RocksRequest>> pendingReqs;
     rocksdb::WriteOptions writeOptions;
 
     // RocksDB does *not* need additional synchronisation around
@@ -352,6 +564,23 @@ private:
     // commit, potentially losing data.
     std::mutex writeLock;
 
+    RocksDBCompactionFilter compactionFilter;
+    RocksDBCompactionFilter seqnoCompactionFilter;
+    RocksDBCompactionFilter metaCompactionFilter;
+
+    // Serialises the explicit compactions, which share compactionCtx
+    std::mutex compactionLock;
+
+    // The context of the explicit compaction in progress, if any
+    std::atomic<compaction_ctx*> compactionCtx;
+
+    // The highest seqno of the tombstones purged from each vbucket
+    std::vector<std::atomic<uint64_t>> purgedSeqnos;
+
+    // The tombstones of each vbucket (the documents are in cachedDocCount),
+    // only changed with the writeLock held
+    std::vector<Couchbase::RelaxedAtomic<size_t>> cachedDeleteCount;
+
     std::atomic<size_t> scanCounter; // atomic counter for generating scan id
 
     struct SnapshotDeleter {
@@ -367,4 +596,7 @@ private:
     std::map<size_t, SnapshotPtr> scanSnapshots;
 
     Logger& logger;
+
+    /// The block cache and memtables shared with the other shards (if any)
+    std::shared_ptr<RocksDBMemoryBudget> memoryBudget;
 };
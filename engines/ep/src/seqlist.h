@@ -25,6 +25,7 @@
 
 #pragma once
 
+#include <functional>
 #include <mutex>
 #include <vector>
 
@@ -133,6 +134,22 @@ public:
      */
     enum class UpdateStatus { Success, Append };
 
+    /**
+     * Bounds a purgeTombstones() call to a part of the list, so that a purge
+     * of a long list can be spread over several calls.
+     */
+    struct PurgeRun {
+        // Called for each item visited after the first; the call pauses
+        // (returns) when it returns true
+        std::function<bool()> shouldPause;
+
+        // In: the seqno to start at (the items below it were visited by the
+        // earlier calls), 0 for the start of the list. Out: the seqno to
+        // resume at if the call paused, otherwise 0 (it got to the end of
+        // its range, or couldn't purge at all)
+        seqno_t resumeSeqno = 0;
+    };
+
     /**
      * RangeIterator for a SequenceList objects.
      *
@@ -156,8 +173,9 @@ public:
      * Note: (a) Do not hold the iterator for long, as it will result in stale
      *           items in list and hence increased memory usage.
      *       (b) Make sure to delete the iterator after using it.
-     *       (c) For now, we allow on one RangeIterator. Try to create more
-     *           iterators will result in the create call(s) being blocked.
+     *       (c) Several RangeIterators may exist at a time, but creating
+     *           one can fail (e.g. while tombstones are purged); try again
+     *           later then.
      */
     class RangeIterator {
     public:
@@ -320,6 +338,42 @@ public:
                                StoredValue::UniquePtr ownedSv,
                                StoredValue* replacement) = 0;
 
+    /**
+     * Check if the OrderedStoredValue is in the range of a range read (or
+     * of a purge), in which case updating it can't move it to the end of
+     * the list, but has to leave it there as a stale item (see
+     * updateListElem).
+     *
+     * @param listWriteLg Write lock of the sequenceList from getListWriteLock()
+     * @param v OrderedStoredValue to be updated
+     */
+    virtual bool isInReadRange(std::lock_guard<std::mutex>& listWriteLg,
+                               const OrderedStoredValue& v) = 0;
+
+    /**
+     * Check if the OrderedStoredValue may be replaced by a copy (see
+     * relinkListElem). It must not be in the range of a range read (or of
+     * a purge), and no stale OSV may refer to it as its replacement.
+     *
+     * @param listWriteLg Write lock of the sequenceList from getListWriteLock()
+     * @param v OrderedStoredValue to be replaced
+     */
+    virtual bool isRelinkable(std::lock_guard<std::mutex>& listWriteLg,
+                              const OrderedStoredValue& v) = 0;
+
+    /**
+     * Replace an OrderedStoredValue by a copy of it, at the same position
+     * in the list (for the defragmenter). The caller must have checked
+     * isRelinkable() while holding the same write lock.
+     *
+     * @param listWriteLg Write lock of the sequenceList from getListWriteLock()
+     * @param v OrderedStoredValue to be unlinked from the list
+     * @param copy Copy of v to be linked in its place
+     */
+    virtual void relinkListElem(std::lock_guard<std::mutex>& listWriteLg,
+                                OrderedStoredValue& v,
+                                OrderedStoredValue& copy) = 0;
+
     /**
      * Remove from sequence list and delete all OSVs which are purgable.
      * OSVs which can be purged are items which are outside the ReadRange and
@@ -327,11 +381,14 @@ public:
      *
      * @param purgeUpToSeqno Indicates the max seqno (inclusive) that could be
      *                       purged
+     * @param run If given, where to start and when to pause (see PurgeRun);
+     *            otherwise the whole list is visited
      *
      * @return The number of items purged from the sequence list (and hence
      *         deleted).
      */
-    virtual size_t purgeTombstones(seqno_t purgeUpToSeqno) = 0;
+    virtual size_t purgeTombstones(seqno_t purgeUpToSeqno,
+                                   PurgeRun* run = nullptr) = 0;
 
     /**
      * Updates the number of deleted items in the sequence list whenever
@@ -411,12 +468,14 @@ public:
      * the SequenceList, new range iterator will not be allowed
      *
      * @param isBackfill indicates if the iterator is for backfill (for debug)
+     * @param startSeqno the iterator may skip the items below it (it starts
+     *                   at or before it)
      *
      * @return range iterator object when possible
      *         null when not possible
      */
     virtual boost::optional<SequenceList::RangeIterator> makeRangeIterator(
-            bool isBackfill) = 0;
+            bool isBackfill, seqno_t startSeqno = 0) = 0;
 
     /**
      * Debug - prints a representation of the list to stderr.
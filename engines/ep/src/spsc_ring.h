@@ -0,0 +1,114 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <platform/cacheline_padded.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+ * A bounded, lock-free queue for a single producer and a single consumer
+ * thread (the consumer may change, as long as the changes are ordered -
+ * for instance by holding a mutex while consuming).
+ *
+ * The indexes of the two sides live in their own cache lines, along with
+ * the copy each side keeps of the other side's index, so that in the
+ * common case a push or a pop only touches the cache line of the slot and
+ * the one of its own side.
+ */
+template <class T>
+class SpscRing {
+public:
+    /**
+     * @param capacity the number of elements the ring holds (rounded up to
+     *        a power of two)
+     */
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.reset(new T[size]);
+        mask = size - 1;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    /**
+     * Push an element (producer only).
+     *
+     * @return false if the ring is full; the element is left untouched
+     */
+    bool push(T&& element) {
+        const size_t tail = producer->tail.load(std::memory_order_relaxed);
+        if (tail - producer->head == capacity()) {
+            producer->head = consumer->head.load(std::memory_order_acquire);
+            if (tail - producer->head == capacity()) {
+                return false;
+            }
+        }
+        slots[tail & mask] = std::move(element);
+        producer->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Pop the oldest element (consumer only).
+     *
+     * @return false if the ring is empty
+     */
+    bool pop(T& element) {
+        const size_t head = consumer->head.load(std::memory_order_relaxed);
+        if (head == consumer->tail) {
+            consumer->tail = producer->tail.load(std::memory_order_acquire);
+            if (head == consumer->tail) {
+                return false;
+            }
+        }
+        element = std::move(slots[head & mask]);
+        slots[head & mask] = T();
+        consumer->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Producer {
+        /// The next slot to push to
+        std::atomic<size_t> tail{0};
+        /// The head the last time the producer looked
+        size_t head = 0;
+    };
+
+    struct Consumer {
+        /// The next slot to pop from
+        std::atomic<size_t> head{0};
+        /// The tail the last time the consumer looked
+        size_t tail = 0;
+    };
+
+    std::unique_ptr<T[]> slots;
+    size_t mask;
+    cb::CachelinePadded<Producer> producer;
+    cb::CachelinePadded<Consumer> consumer;
+};
@@ -17,54 +17,50 @@
 
 #include "stats.h"
 
-void EPStats::memAllocated(size_t sz) {
-    if (isShutdown) {
-        return;
-    }
+#include "atomic.h"
 
-    if (localMemCounter.get() == nullptr) {
-        // this HAS to be a non-bucket allocation
-        // or else the callbacks would try to call this
-        // function again & it would become an infinite loop
-        SystemAllocationGuard system_alloc_guard;
-        localMemCounter.set(new TLMemCounter());
-    }
-
-    if (0 == sz) {
+void EPStats::memAllocated(size_t sz) {
+    if (isShutdown || 0 == sz) {
         return;
     }
-
-    localMemCounter.get()->used += sz;
-    mergeMemCounter();
+    updateMemShard(sz);
 }
 
 void EPStats::memDeallocated(size_t sz) {
-    if (isShutdown) {
+    if (isShutdown || 0 == sz) {
         return;
     }
+    updateMemShard(-static_cast<long long>(sz));
+}
 
-    if (localMemCounter.get() == nullptr) {
-        // this HAS to be a non-bucket allocation
-        // or else the callbacks would try to call this
-        // function again & it would become an infinite loop
-        SystemAllocationGuard system_alloc_guard;
-        localMemCounter.set(new TLMemCounter());
+EPStats::MemShard& EPStats::getMemShard() {
+    auto* shard = localMemShard.get();
+    if (shard == nullptr) {
+        shard = &memShards[nextMemShard++ % memShards.size()];
+        localMemShard.set(shard);
     }
+    return **shard;
+}
 
-    if (0 == sz) {
-        return;
+void EPStats::updateMemShard(long long sz) {
+    auto& shard = getMemShard();
+    const auto used = shard.used.fetch_add(sz, std::memory_order_relaxed) + sz;
+    const auto count = shard.count.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (count % mem_merge_count_threshold == 0 ||
+        std::abs(used) > (long long)mem_merge_bytes_threshold) {
+        // Another thread of the shard may fold it at the same time, the
+        // exchange makes sure every byte is folded exactly once
+        totalMemory->fetch_add(
+                shard.used.exchange(0, std::memory_order_relaxed));
     }
-
-    localMemCounter.get()->used -= sz;
-    mergeMemCounter();
 }
 
-void EPStats::mergeMemCounter(bool force) {
-    auto& counter = *(localMemCounter.get());
-    counter.count++;
-    if (force || counter.count % mem_merge_count_threshold == 0 ||
-        std::abs(counter.used) > (long)mem_merge_bytes_threshold) {
-        totalMemory->fetch_add(counter.used);
-        counter.used = 0;
+void EPStats::VisitorRuns::record(std::chrono::microseconds overrun) {
+    ++runs;
+    if (overrun.count() > 0) {
+        const auto us = uint64_t(overrun.count());
+        ++overruns;
+        overrunTime.fetch_add(us);
+        atomic_setIfBigger(maxOverrun, us);
     }
-}
\ No newline at end of file
+}
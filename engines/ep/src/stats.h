@@ -22,6 +22,7 @@
 
 #include <memcached/engine.h>
 
+#include <array>
 #include <map>
 
 #include <platform/cacheline_padded.h>
@@ -32,6 +33,7 @@
 #include <atomic>
 #include "memory_tracker.h"
 #include "objectregistry.h"
+#include "task_timings.h"
 #include "threadlocal.h"
 #include "utility.h"
 
@@ -58,6 +60,26 @@ public:
     // ordering (no ordeing or synchronization).
     using Counter = Couchbase::RelaxedAtomic<size_t>;
 
+    /// The runs of the time budgeted visitors of a task type (see
+    /// VisitorBudget), and how far past their budget they went.
+    struct VisitorRuns {
+        /// Record a run which took the given time past its budget.
+        void record(std::chrono::microseconds overrun);
+
+        void reset() {
+            runs.store(0);
+            overruns.store(0);
+            overrunTime.store(0);
+            maxOverrun.store(0);
+        }
+
+        std::atomic<uint64_t> runs{0};
+        std::atomic<uint64_t> overruns{0};
+        // The total and the largest time (us) past the budget
+        std::atomic<uint64_t> overrunTime{0};
+        std::atomic<uint64_t> maxOverrun{0};
+    };
+
     EPStats() :
         warmedUpKeys(0),
         warmedUpValues(0),
@@ -70,6 +92,8 @@ public:
         vbBackfillQueueSize(0),
         flusher_todo(0),
         flusherCommits(0),
+        flusherGroupCommits(0),
+        flusherGroupCommitVBuckets(0),
         cumulativeFlushTime(0),
         cumulativeCommitTime(0),
         tooYoung(0),
@@ -89,6 +113,8 @@ public:
         commit_time(0),
         vbucketDeletions(0),
         vbucketDeletionFail(0),
+        vbucketDelItemsFreed(0),
+        vbucketDelMemPending(0),
         mem_low_wat(0),
         mem_low_wat_percent(0),
         mem_high_wat(0),
@@ -97,8 +123,15 @@ public:
         cursorDroppingUThreshold(0),
         cursorsDropped(0),
         pagerRuns(0),
+        pagerPredictiveRuns(0),
+        memGrowthRate(0),
         expiryPagerRuns(0),
+        pagerLastVisited(0),
+        pagerLastEjected(0),
+        pagerLastEjectedBytes(0),
         itemsRemovedFromCheckpoints(0),
+        itemsExpelledFromCheckpoints(0),
+        checkpointMemory(0),
         numValueEjects(0),
         numFailedEjects(0),
         numNotMyVBuckets(0),
@@ -110,6 +143,8 @@ public:
         totalStoredValSize(0),
         storedValOverhead(0),
         memOverhead(0),
+        rocksdbBlockCacheMemory(0),
+        rocksdbMemTableMemory(0),
         numItem(0),
         totalMemory(0),
         memoryTrackerEnabled(false),
@@ -121,8 +156,12 @@ public:
         pendingOpsMax(0),
         pendingOpsMaxDuration(0),
         pendingCompactions(0),
+        compactionThrottleWaits(0),
+        compactionThrottleWaitTime(0),
+        compactionThrottleBackoffs(0),
         bg_fetched(0),
         bg_meta_fetched(0),
+        bgFetchedInPlace(0),
         numRemainingBgItems(0),
         numRemainingBgJobs(0),
         bgNumOperations(0),
@@ -139,6 +178,7 @@ public:
         numOpsStore(0),
         numOpsDelete(0),
         numOpsGet(0),
+        numReplicaReadsBehind(0),
         numOpsGetMeta(0),
         numOpsSetMeta(0),
         numOpsDelMeta(0),
@@ -151,6 +191,7 @@ public:
         alogRuns(0),
         accessScannerSkips(0),
         alogNumItems(0),
+        alogReusedVBuckets(0),
         alogTime(0),
         alogRuntime(0),
         expPagerTime(0),
@@ -158,21 +199,18 @@ public:
         rollbackCount(0),
         defragNumVisited(0),
         defragNumMoved(0),
+        defragStoredValueNumMoved(0),
+        compressorNumVisited(0),
+        compressorNumCompressed(0),
+        compressorNumInflated(0),
         dirtyAgeHisto(GrowingWidthGenerator<hrtime_t>(0, ONE_SECOND, 1.4), 25),
+        persistenceLatencyHisto(ExponentialGenerator<hrtime_t>(1, 2), 30),
         diskCommitHisto(GrowingWidthGenerator<hrtime_t>(0, ONE_SECOND, 1.4), 25),
         mlogCompactorHisto(GrowingWidthGenerator<hrtime_t>(0, ONE_SECOND, 1.4), 25),
         timingLog(NULL),
         mem_merge_count_threshold(1),
         mem_merge_bytes_threshold(0),
-        localMemCounter([](void* ptr) -> void {
-                if (ptr != nullptr) {
-                    // This HAS to be a non-bucket deallocation
-                    // or else the callbacks could try to update counters
-                    // that no longer exist
-                    SystemAllocationGuard system_alloc_guard;
-                    delete (TLMemCounter*)ptr;
-                }
-            }),
+        nextMemShard(0),
         maxDataSize(DEFAULT_MAX_DATA_SIZE) {}
 
     ~EPStats() {
@@ -189,12 +227,42 @@ public:
         }
     }
 
+    /**
+     * The memory used by the bucket, as cheap to read as a single atomic.
+     *
+     * With the memory tracker this is the total the shards were folded
+     * into, which is off by about getMemoryErrorMargin() at most (the quota
+     * checks and the pager can rely on that).
+     */
     size_t getTotalMemoryUsed() {
         if (memoryTrackerEnabled.load()) {
             auto val = totalMemory->load();
             return val >= 0 ? val : 0;
         }
-        return currentSize.load() + memOverhead->load();
+        return currentSize.load() + memOverhead->load() +
+               rocksdbBlockCacheMemory.load() + rocksdbMemTableMemory.load();
+    }
+
+    /**
+     * The memory used by the bucket, including what the memory tracker
+     * didn't fold yet. Reads all of the shards, so meant for the stats
+     * rather than the front end paths.
+     */
+    size_t getPreciseTotalMemoryUsed() {
+        if (memoryTrackerEnabled.load()) {
+            auto val = totalMemory->load();
+            for (auto& shard : memShards) {
+                val += shard->used.load(std::memory_order_relaxed);
+            }
+            return val >= 0 ? val : 0;
+        }
+        return currentSize.load() + memOverhead->load() +
+               rocksdbBlockCacheMemory.load() + rocksdbMemTableMemory.load();
+    }
+
+    /// @return how far getTotalMemoryUsed() may be from the precise total
+    size_t getMemoryErrorMargin() const {
+        return memShards.size() * mem_merge_bytes_threshold;
     }
 
     // account for allocated mem
@@ -203,12 +271,6 @@ public:
     // account for deallocated mem
     void memDeallocated(size_t sz);
 
-    // merge accumulated local memory to the bucket variable
-    // the boolean force, if set to true, will skip checking
-    // threshold constraints and merge the local counters
-    // immediately
-    void mergeMemCounter(bool force = false);
-
     //! Number of keys warmed up during key-only loading.
     Counter warmedUpKeys;
     //! Number of key-values warmed up during data loading.
@@ -235,6 +297,10 @@ public:
     Counter flusher_todo;
     //! Number of transaction commits.
     Counter flusherCommits;
+    //! Number of transaction commits shared by a group of vbuckets.
+    Counter flusherGroupCommits;
+    //! Number of vbuckets committed by group commits.
+    Counter flusherGroupCommitVBuckets;
     //! Total time spent flushing.
     Counter cumulativeFlushTime;
     //! Total time spent committing.
@@ -281,6 +347,10 @@ public:
     Counter vbucketDeletions;
     //! Number of times we failed to delete a vbucket.
     Counter vbucketDeletionFail;
+    //! Number of items freed by the tasks deleting vbuckets.
+    Counter vbucketDelItemsFreed;
+    //! Memory of the items of the deleted vbuckets not freed yet.
+    std::atomic<size_t> vbucketDelMemPending;
 
     //! Beyond this point are config items
     //! Pager low water mark.
@@ -299,10 +369,26 @@ public:
 
     //! Number of times we needed to kick in the pager
     Counter pagerRuns;
+    //! Number of pager runs started below the high watermark because
+    //! of how fast the memory used grows (pager_growth_lookahead)
+    Counter pagerPredictiveRuns;
+    //! The rate (bytes/s) the memory used grew at, as estimated by the
+    //! item pager (only with pager_growth_lookahead)
+    std::atomic<size_t> memGrowthRate;
     //! Number of times the expiry pager runs for purging expired items
     Counter expiryPagerRuns;
+    //! Number of items the last (completed) item pager run visited
+    Counter pagerLastVisited;
+    //! Number of items the last (completed) item pager run ejected
+    Counter pagerLastEjected;
+    //! Bytes of the values the last (completed) item pager run ejected
+    Counter pagerLastEjectedBytes;
     //! Number of items removed from closed unreferenced checkpoints.
     Counter itemsRemovedFromCheckpoints;
+    //! Number of items expelled from checkpoints still referenced by cursors.
+    Counter itemsExpelledFromCheckpoints;
+    //! Memory used by all of the checkpoints (their items and overhead).
+    Counter checkpointMemory;
     //! Number of times a value is ejected
     Counter numValueEjects;
     //! Number of times a value could not be ejected
@@ -325,6 +411,12 @@ public:
     Counter storedValOverhead;
     //! Amount of memory used to track items and what-not.
     cb::CachelinePadded<Counter> memOverhead;
+    //! Memory used by the block cache and the memtables shared by the
+    //! RocksDB shards (see RocksDBMemoryBudget). Only counted in the
+    //! total memory used without the memory tracker, as otherwise most of
+    //! it was allocated by the engine's threads and is already tracked.
+    Counter rocksdbBlockCacheMemory;
+    Counter rocksdbMemTableMemory;
     //! Total number of Item objects
     cb::CachelinePadded<Counter> numItem;
     //! The total amount of memory used by this bucket (From memory tracking)
@@ -354,11 +446,19 @@ public:
 
     //! Number of pending vbucket compaction requests
     Counter pendingCompactions;
+    //! Number of times a compaction write was delayed
+    Counter compactionThrottleWaits;
+    //! Total time compaction writes were delayed for (us)
+    Counter compactionThrottleWaitTime;
+    //! Number of compaction writes delayed for the disk write queue size
+    Counter compactionThrottleBackoffs;
 
     //! Number of times background fetches occurred.
     Counter bg_fetched;
     //! Number of times meta background fetches occurred.
     Counter bg_meta_fetched;
+    //! Number of gets completed in place by their background fetch
+    Counter bgFetchedInPlace;
     //! Number of remaining bg fetch items
     Counter numRemainingBgItems;
     //! Number of remaining bg fetch jobs.
@@ -418,6 +518,9 @@ public:
     Counter numOpsDelete;
     //! The number of basic get operations
     Counter numOpsGet;
+    //! The number of replica reads refused as the replica was behind the
+    //! seqno the client asked for
+    Counter numReplicaReadsBehind;
 
     //! The number of get with meta operations
     Counter  numOpsGetMeta;
@@ -444,6 +547,9 @@ public:
     Counter accessScannerSkips;
     //! The number of items that last access scanner task swept to log
     Counter alogNumItems;
+    //! The number of vbuckets whose keys the last access scanner task copied
+    //! from the previous access log
+    Counter alogReusedVBuckets;
     //! The next access scanner task schedule time (GMT)
     std::atomic<hrtime_t> alogTime;
     //! The number of seconds that the last access scanner task took
@@ -466,9 +572,33 @@ public:
      */
     Counter defragNumMoved;
 
+    /** The number of StoredValues that have been moved (defragmented) by
+     * the defragmenter task.
+     */
+    Counter defragStoredValueNumMoved;
+
+    /** The number of items that have been visited by the item compressor
+     * task.
+     */
+    Counter compressorNumVisited;
+
+    /** The number of values that have been compressed in memory by the
+     * item compressor task.
+     */
+    Counter compressorNumCompressed;
+
+    /** The number of values the item compressor task compressed and
+     * inflated again as their item became hot.
+     */
+    Counter compressorNumInflated;
+
     //! Histogram of queue processing dirty age.
     Histogram<hrtime_t> dirtyAgeHisto;
 
+    //! Histogram of the time (us) from queueing an item into a checkpoint to
+    //! it being durable on disk.
+    Histogram<hrtime_t> persistenceLatencyHisto;
+
     //! Histogram of item allocation sizes.
     Histogram<size_t> itemAllocSizeHisto;
 
@@ -477,6 +607,14 @@ public:
      */
     Histogram<size_t> getMultiBatchSizeHisto;
 
+    //! Histogram of the number of items fetched by a pass of a background
+    //! fetcher over the pending vbuckets of its shard.
+    Histogram<size_t> bgFetchPassSizeHisto;
+
+    //! Histogram of the time (us) from the first miss queued to a background
+    //! fetcher to the pass fetching it.
+    Histogram<hrtime_t> bgFetchCoalesceHisto;
+
     //
     // Command timers
     //
@@ -539,10 +677,20 @@ public:
     // ! Histograms of various task run times, one per Task.
     std::vector<ProcessDurationHistogram> taskRuntimeHisto;
 
+    //! Finer histograms of the task wait and run times, for the percentiles
+    TaskTimings taskTimings;
+
+    //! The runs of the time budgeted visitors, one per Task.
+    std::vector<VisitorRuns> visitorRuns;
+
     //! Checkpoint Cursor histograms
     Histogram<hrtime_t> persistenceCursorGetItemsHisto;
     Histogram<hrtime_t> dcpCursorsGetItemsHisto;
 
+    //! Histogram of how long the vbuckets taken over were unavailable for
+    //! the front end writes
+    Histogram<hrtime_t> dcpTakeoverUnavailableHisto;
+
     //! Reset all stats to reasonable values.
     void reset() {
         tooYoung.store(0);
@@ -553,11 +701,17 @@ public:
         commit_time.store(0);
         cursorsDropped.store(0);
         pagerRuns.store(0);
+        pagerPredictiveRuns.store(0);
         itemsRemovedFromCheckpoints.store(0);
+        itemsExpelledFromCheckpoints.store(0);
         numValueEjects.store(0);
         numFailedEjects.store(0);
         numNotMyVBuckets.store(0);
         bg_fetched.store(0);
+        bgFetchedInPlace.store(0);
+        compactionThrottleWaits.store(0);
+        compactionThrottleWaitTime.store(0);
+        compactionThrottleBackoffs.store(0);
         bgNumOperations.store(0);
         bgWait.store(0);
         bgLoad.store(0);
@@ -578,7 +732,8 @@ public:
         alogRuns.store(0);
         accessScannerSkips.store(0),
         defragNumVisited.store(0),
-        defragNumMoved.store(0);
+        defragNumMoved.store(0),
+        defragStoredValueNumMoved.store(0);
 
         pendingOpsHisto.reset();
         bgWaitHisto.reset();
@@ -604,31 +759,60 @@ public:
         diskCommitHisto.reset();
         itemAllocSizeHisto.reset();
         getMultiBatchSizeHisto.reset();
+        bgFetchPassSizeHisto.reset();
+        bgFetchCoalesceHisto.reset();
         dirtyAgeHisto.reset();
+        persistenceLatencyHisto.reset();
         mlogCompactorHisto.reset();
         getMultiHisto.reset();
         persistenceCursorGetItemsHisto.reset();
         dcpCursorsGetItemsHisto.reset();
+        dcpTakeoverUnavailableHisto.reset();
     }
 
     // Used by stats logging infrastructure.
     std::ostream *timingLog;
 
-    //! These 2 thresholds define when the thread local
-    //  mem counters are merged to the bucket counter
+    //! These 2 thresholds define when the mem counter shards
+    //  are merged to the bucket counter
     size_t mem_merge_count_threshold;
     size_t mem_merge_bytes_threshold;
 
-private:
-    struct TLMemCounter {
-        // accumulated mem
-        long long used = 0;
+    //! Number of shards of the memory tracker
+    static const size_t MemShards = 32;
 
-        // no.of times mem accounting has happened
-        size_t count = 0;
+private:
+    /**
+     * The memory tracker accounts the (de)allocations of a thread in one
+     * of MemShards counters (each on its own cache line) instead of
+     * totalMemory, whose cache line would otherwise move between the cores
+     * on every allocation. A shard is folded into totalMemory once it
+     * holds more than mem_merge_bytes_threshold (or after
+     * mem_merge_count_threshold updates), which bounds the error of
+     * totalMemory. Nothing is lost when a thread exits, and the error
+     * doesn't grow with the number of threads.
+     */
+    struct MemShard {
+        //! Memory accounted since the shard was last folded
+        std::atomic<long long> used{0};
+        //! No. of times mem accounting has happened
+        std::atomic<size_t> count{0};
     };
 
-    ThreadLocalPtr<TLMemCounter> localMemCounter;
+    /// @return the shard the calling thread accounts its memory in
+    MemShard& getMemShard();
+
+    /// Account sz bytes in the calling thread's shard
+    void updateMemShard(long long sz);
+
+    std::array<cb::CachelinePadded<MemShard>, MemShards> memShards;
+
+    //! The shards are given out to the threads round-robin
+    std::atomic<size_t> nextMemShard;
+
+    //! The shard of each thread (a plain pthread key, as thread_local
+    //  could allocate from within the allocation hooks)
+    ThreadLocalPtr<cb::CachelinePadded<MemShard>> localMemShard;
 
     //! Max allowable memory size.
     std::atomic<size_t> maxDataSize;
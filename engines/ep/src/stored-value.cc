@@ -30,11 +30,15 @@ const int64_t StoredValue::state_deleted_key = -3;
 const int64_t StoredValue::state_non_existent_key = -4;
 const int64_t StoredValue::state_temp_init = -5;
 const int64_t StoredValue::state_collection_open = -6;
+const size_t StoredValue::InlineValueUnit;
+const size_t StoredValue::MaxInlineValueCapacity;
+const uint8_t StoredValue::MaxFreqCounterValue;
 
 StoredValue::StoredValue(const Item& itm,
                          UniquePtr n,
                          EPStats& stats,
-                         bool isOrdered)
+                         bool isOrdered,
+                         uint8_t inlineCapacity)
     : value(itm.getValue()),
       chain_next_or_replacement(std::move(n)),
       cas(itm.getCas()),
@@ -49,11 +53,21 @@ StoredValue::StoredValue(const Item& itm,
       isOrdered(isOrdered),
       nru(itm.getNRUValue()),
       resident(!isTempItem()),
-      stale(false) {
+      compressedInMemory(false),
+      stale(false),
+      inlineValueUnits(inlineCapacity / InlineValueUnit),
+      freqCounter(0) {
     // Placement-new the key which lives in memory directly after this
     // object.
     new (key()) SerialisedDocKey(itm.getKey());
 
+    if (inlineValueUnits != 0) {
+        // The embedded Blob always exists (empty until we have a value
+        // which fits)
+        Blob::NewEmbedded(inlineValue(), nullptr, 0);
+        assignValue(itm.getValue());
+    }
+
     if (isTempInitialItem()) {
         markClean();
     } else {
@@ -89,12 +103,23 @@ StoredValue::StoredValue(const StoredValue& other,
       isOrdered(other.isOrdered),
       nru(other.nru),
       resident(other.resident),
-      stale(false) {
+      compressedInMemory(other.compressedInMemory),
+      stale(false),
+      inlineValueUnits(other.inlineValueUnits),
+      freqCounter(other.freqCounter) {
     // Placement-new the key which lives in memory directly after this
     // object.
     StoredDocKey sKey(other.getKey());
     new (key()) SerialisedDocKey(sKey);
 
+    if (inlineValueUnits != 0) {
+        // We can't share the other's embedded Blob (it goes away with the
+        // other), so copy the value into our own
+        Blob::NewEmbedded(inlineValue(), nullptr, 0);
+        value.reset();
+        assignValue(other.value);
+    }
+
     ObjectRegistry::onCreateStoredValue(this);
 }
 
@@ -107,6 +132,11 @@ void StoredValue::setValue(const Item& itm) {
 }
 
 void StoredValue::ejectValue() {
+    if (compressedInMemory) {
+        // The copy on disk (which we fetch back) isn't compressed
+        datatype &= ~PROTOCOL_BINARY_DATATYPE_SNAPPY;
+        compressedInMemory = false;
+    }
     markNotResident();
 }
 
@@ -149,8 +179,9 @@ void StoredValue::restoreValue(const Item& itm) {
     }
     datatype = itm.getDataType();
     deleted = itm.isDeleted();
-    value = itm.getValue();
+    assignValue(itm.getValue());
     resident = true;
+    compressedInMemory = false;
 }
 
 void StoredValue::restoreMeta(const Item& itm) {
@@ -185,12 +216,25 @@ size_t StoredValue::getRequiredStorage(const Item& item) {
            SerialisedDocKey::getObjectSize(item.getKey().size());
 }
 
+size_t StoredValue::getRequiredStorage(const Item& item,
+                                       uint8_t inlineCapacity) {
+    if (inlineCapacity == 0) {
+        return getRequiredStorage(item);
+    }
+    return getInlineValueOffset(
+                   SerialisedDocKey::getObjectSize(item.getKey().size())) +
+           Blob::getAllocationSize(inlineCapacity);
+}
+
 std::unique_ptr<Item> StoredValue::toItem(bool lck, uint16_t vbucket) const {
+    // The Item may outlive us, so it can't share the embedded Blob
     auto itm =
             std::make_unique<Item>(getKey(),
                                    getFlags(),
                                    getExptime(),
-                                   value,
+                                   hasInlineValue()
+                                           ? value_t(Blob::Copy(*value))
+                                           : value,
                                    datatype,
                                    lck ? static_cast<uint64_t>(-1) : getCas(),
                                    bySeqno,
@@ -228,12 +272,24 @@ std::unique_ptr<Item> StoredValue::toItemKeyOnly(uint16_t vbucket) const {
 }
 
 void StoredValue::reallocate() {
+    if (hasInlineValue()) {
+        // Part of our own allocation
+        return;
+    }
     // Allocate a new Blob for this stored value; copy the existing Blob to
     // the new one and free the old.
     value_t new_val(Blob::Copy(*value));
     value.reset(new_val);
 }
 
+void StoredValue::replaceEncoding(const value_t& newValue,
+                                  protocol_binary_datatype_t newDatatype,
+                                  bool compressed) {
+    assignValue(newValue);
+    datatype = newDatatype;
+    compressedInMemory = compressed;
+}
+
 void StoredValue::Deleter::operator()(StoredValue* val) {
     if (val->isOrdered) {
         delete static_cast<OrderedStoredValue*>(val);
@@ -277,6 +333,7 @@ bool StoredValue::deleteImpl() {
 
     resetValue();
     setDatatype(PROTOCOL_BINARY_RAW_BYTES);
+    compressedInMemory = false;
 
     deleted = true;
     markDirty();
@@ -296,6 +353,7 @@ void StoredValue::setValueImpl(const Item& itm) {
     revSeqno = itm.getRevSeqno();
 
     nru = itm.getNRUValue();
+    compressedInMemory = false;
 
     if (isTempInitialItem()) {
         markClean();
@@ -307,8 +365,27 @@ void StoredValue::setValueImpl(const Item& itm) {
         resident = false;
     } else {
         resident = true;
-        value = itm.getValue();
+        assignValue(itm.getValue());
+    }
+}
+
+void StoredValue::assignValue(const value_t& newValue) {
+    if (inlineValueUnits != 0 && newValue &&
+        newValue->valueSize() <= getInlineValueCapacity()) {
+        Blob* blob = inlineValue();
+        if (newValue.get() == blob) {
+            return;
+        }
+        value.reset();
+        // The previous content may still be referenced while the hash
+        // bucket lock is held (see handlePreExpiry)
+        if (blob->isUnreferencedEmbedded()) {
+            value.reset(Blob::NewEmbedded(
+                    blob, newValue->getData(), newValue->valueSize()));
+            return;
+        }
     }
+    value = newValue;
 }
 
 /**
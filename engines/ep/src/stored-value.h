@@ -26,6 +26,8 @@
 
 #include <boost/intrusive/list.hpp>
 
+#include <algorithm>
+
 class Item;
 class OrderedStoredValue;
 
@@ -73,6 +75,17 @@ class OrderedStoredValue;
  *   length  {   | ...               |
  *               +-------------------+
  *
+ * Small values may also be embedded in the StoredValue (see
+ * StoredValueFactory): a Blob is then allocated directly after the key, in
+ * the same allocation, and the value points at it. This saves the separate
+ * allocation (and its fixed overhead) for the value of buckets with tiny
+ * values (for example counters). The StoredValue knows how big the embedded
+ * Blob may be (inlineValueUnits), so later values which fit are copied
+ * into it; larger values, and values which are still referenced elsewhere
+ * when the next one arrives, are held in a separate Blob as usual. The
+ * embedded Blob must never be shared outside the hash bucket lock, so
+ * toItem() copies it.
+ *
  * OrderedStoredValue is a "subclass" of StoredValue, which is used by
  * Ephemeral buckets as it supports maintaining a seqno ordering of items in
  * memory (for Persistent buckets this ordering is maintained on-disk).
@@ -127,6 +140,15 @@ public:
     // Owning pointer type for StoredValue objects.
     using UniquePtr = std::unique_ptr<StoredValue, Deleter>;
 
+    /// The size of an embedded value is a multiple of this
+    static const size_t InlineValueUnit = 8;
+
+    /// The largest value which may be embedded
+    static const size_t MaxInlineValueCapacity = 15 * InlineValueUnit;
+
+    /// The value at which the frequency counter saturates
+    static const uint8_t MaxFreqCounterValue = 15;
+
     uint8_t getNRUValue() const;
 
     void setNRUValue(uint8_t nru_val);
@@ -135,6 +157,26 @@ public:
 
     void referenced();
 
+    /**
+     * Get the (saturating) count of references to this item.
+     */
+    uint8_t getFreqCounterValue() const {
+        return freqCounter;
+    }
+
+    void setFreqCounterValue(uint8_t value) {
+        freqCounter = std::min(value, MaxFreqCounterValue);
+    }
+
+    /**
+     * Count a reference to this item (saturating at MaxFreqCounterValue).
+     */
+    void incrFreqCounterValue() {
+        if (freqCounter < MaxFreqCounterValue) {
+            ++freqCounter;
+        }
+    }
+
     /**
      * Mark this item as needing to be persisted.
      */
@@ -420,7 +462,7 @@ public:
     }
 
     size_t metaDataSize() const {
-        return getObjectSize();
+        return getObjectSize() - getInlineValueStorage();
     }
 
     /**
@@ -564,16 +606,45 @@ public:
 
     /**
      * Return the size in byte of this object; both the fixed fields and the
-     * variable-length key. Doesn't include value size (allocated externally).
+     * variable-length key (and the storage for an embedded value). Doesn't
+     * include value size if it's allocated externally.
      */
     inline size_t getObjectSize() const;
 
+    /**
+     * True if the value is held in the Blob embedded in this object.
+     */
+    bool hasInlineValue() const {
+        return inlineValueUnits != 0 && value.get() == inlineValue();
+    }
+
     /**
      * Reallocates the dynamic members of StoredValue. Used as part of
      * defragmentation.
      */
     void reallocate();
 
+    /**
+     * Replace the value with another encoding of the same document (see
+     * HashTable::unlocked_compressValue), keeping everything else.
+     *
+     * @param newValue the value in its new encoding
+     * @param newDatatype the datatype of newValue
+     * @param compressed true if newValue was compressed by the engine
+     *        rather than stored compressed by the client
+     */
+    void replaceEncoding(const value_t& newValue,
+                         protocol_binary_datatype_t newDatatype,
+                         bool compressed);
+
+    /**
+     * True if the value was compressed by the engine (the ItemCompressor)
+     * rather than stored compressed by the client.
+     */
+    bool isCompressedInMemory() const {
+        return compressedInMemory;
+    }
+
     /**
      * Returns pointer to the subclass OrderedStoredValue if it the object is
      * of the type, if not throws a bad_cast.
@@ -595,6 +666,12 @@ public:
     /// Return how many bytes are need to store Item as a StoredValue
     static size_t getRequiredStorage(const Item& item);
 
+    /**
+     * Return how many bytes are needed to store Item as a StoredValue with
+     * room for an embedded value of up to inlineCapacity bytes.
+     */
+    static size_t getRequiredStorage(const Item& item, uint8_t inlineCapacity);
+
 protected:
     /**
      * Constructor - protected as allocation needs to be done via
@@ -607,11 +684,15 @@ protected:
      *           which the new item is being inserted).
      * @param stats EPStats to update for this new StoredValue
      * @param isOrdered Are we constructing an OrderedStoredValue?
+     * @param inlineCapacity the size of the value which may be embedded
+     *        after the key (a multiple of InlineValueUnit up to
+     *        MaxInlineValueCapacity, 0 for none; StoredValue only)
      */
     StoredValue(const Item& itm,
                 UniquePtr n,
                 EPStats& stats,
-                bool isOrdered);
+                bool isOrdered,
+                uint8_t inlineCapacity = 0);
 
     // Destructor. protected, as needs to be carefully deleted (via
     // StoredValue::Destructor) depending on the value of isOrdered flag.
@@ -640,6 +721,50 @@ protected:
      */
     inline SerialisedDocKey* key();
 
+    /**
+     * Get the address of the Blob embedded after the key. Only valid if
+     * inlineValueUnits is non-zero.
+     */
+    Blob* inlineValue() const {
+        return reinterpret_cast<Blob*>(
+                reinterpret_cast<char*>(const_cast<StoredValue*>(this)) +
+                getInlineValueOffset(getKey().getObjectSize()));
+    }
+
+    /**
+     * Get the offset of the embedded Blob for a key of the given size.
+     */
+    static size_t getInlineValueOffset(size_t keyObjectSize) {
+        const size_t align = alignof(Blob);
+        return (sizeof(StoredValue) + keyObjectSize + align - 1) & ~(align - 1);
+    }
+
+    /**
+     * Get the number of bytes used by the embedded Blob (including the
+     * padding after the key).
+     */
+    size_t getInlineValueStorage() const {
+        if (inlineValueUnits == 0) {
+            return 0;
+        }
+        return getInlineValueOffset(getKey().getObjectSize()) -
+               sizeof(StoredValue) - getKey().getObjectSize() +
+               Blob::getAllocationSize(getInlineValueCapacity());
+    }
+
+    /**
+     * Get the size of the value which fits in the embedded Blob.
+     */
+    size_t getInlineValueCapacity() const {
+        return size_t(inlineValueUnits) * InlineValueUnit;
+    }
+
+    /**
+     * Set the value of this item, copying it into the embedded Blob if it
+     * fits and nobody else refers to the current content of the Blob.
+     */
+    void assignValue(const value_t& newValue);
+
     /**
      * Logically mark this SV as deleted.
      * Implementation for StoredValue instances (dispatched to by del() based
@@ -679,7 +804,7 @@ protected:
     const bool isOrdered : 1; //!< Is this an instance of OrderedStoredValue?
     uint8_t            nru       :  2; //!< True if referenced since last sweep
     bool               resident :  1;
-    bool unused : 1; // Unused bits in first byte of bitfields.
+    bool compressedInMemory : 1; //!< Compressed by the ItemCompressor
 
     // Indicates if a newer instance of the item is added. Logically part of
     // OSV, but is physically located in SV as there are spare bytes here.
@@ -694,6 +819,16 @@ protected:
     // Note (2): Only 1 bit of this is currently used; rest is "spare".
     std::atomic<bool> stale;
 
+    /// The size of the value which fits in the embedded Blob in units of
+    /// InlineValueUnit bytes (0 if there is no embedded Blob). Only set when
+    /// the object is created.
+    const uint8_t inlineValueUnits : 4;
+
+    /// Saturating count of the references to this item, for the frequency
+    /// based eviction (see HashTable::isFrequencyTracking). Aged by the
+    /// ItemPager.
+    uint8_t freqCounter : 4;
+
     friend std::ostream& operator<<(std::ostream& os, const StoredValue& sv);
 };
 
@@ -840,5 +975,5 @@ size_t StoredValue::getObjectSize() const {
     if (isOrdered) {
         return sizeof(OrderedStoredValue) + getKey().getObjectSize();
     }
-    return sizeof(*this) + getKey().getObjectSize();
+    return sizeof(*this) + getKey().getObjectSize() + getInlineValueStorage();
 }
@@ -22,7 +22,10 @@
  */
 
 #include <memory>
+#include <stdexcept>
+#include <string>
 
+#include "item.h"
 #include "stored-value.h"
 
 /**
@@ -58,12 +61,29 @@ public:
 
 /**
  * Creator of StoredValue instances.
+ *
+ * If maxInlineValueSize is non-zero, values of up to that many bytes are
+ * embedded in the StoredValue instead of being held in a separate Blob (see
+ * StoredValue). The room for the value is rounded up to a multiple of
+ * StoredValue::InlineValueUnit bytes, so a slightly larger value (the next
+ * value of a counter) still fits.
  */
 class StoredValueFactory : public AbstractStoredValueFactory {
 public:
     using value_type = StoredValue;
 
-    StoredValueFactory(EPStats& s) : stats(&s) {
+    /// The largest value which may be embedded in a StoredValue
+    static const size_t MaxInlineValueSize =
+            StoredValue::MaxInlineValueCapacity;
+
+    StoredValueFactory(EPStats& s, size_t maxInlineValueSize = 0)
+        : stats(&s), maxInlineValueSize(maxInlineValueSize) {
+        if (maxInlineValueSize > MaxInlineValueSize) {
+            throw std::invalid_argument(
+                    "StoredValueFactory: maxInlineValueSize (which is " +
+                    std::to_string(maxInlineValueSize) +
+                    ") must not exceed " + std::to_string(MaxInlineValueSize));
+        }
     }
 
     /**
@@ -71,23 +91,45 @@ public:
      */
     StoredValue::UniquePtr operator()(const Item& itm,
                                       StoredValue::UniquePtr next) override {
+        const uint8_t inlineCapacity = getInlineCapacity(itm);
+
         // Allocate a buffer to store the StoredValue and any trailing bytes
         // that maybe required.
         return StoredValue::UniquePtr(
-                new (::operator new(StoredValue::getRequiredStorage(itm)))
+                new (::operator new(StoredValue::getRequiredStorage(
+                        itm, inlineCapacity)))
                         StoredValue(itm,
                                     std::move(next),
                                     *stats,
-                                    /*isOrdered*/ false));
+                                    /*isOrdered*/ false,
+                                    inlineCapacity));
     }
 
+    /**
+     * Create a copy of the StoredValue (with room for the same embedded
+     * value) from the given one.
+     */
     StoredValue::UniquePtr copyStoredValue(const StoredValue& other,
                                            StoredValue::UniquePtr next) override {
-        throw std::logic_error("Copy of StoredValue is not supported");
+        return StoredValue::UniquePtr(
+                new (::operator new(other.getObjectSize()))
+                        StoredValue(other, std::move(next), *stats));
     }
 
 private:
+    /// @return the size of the value to embed in a StoredValue for itm
+    uint8_t getInlineCapacity(const Item& itm) const {
+        const auto& value = itm.getValue();
+        if (!value || value->valueSize() == 0 ||
+            value->valueSize() > maxInlineValueSize) {
+            return 0;
+        }
+        const size_t unit = StoredValue::InlineValueUnit;
+        return uint8_t((value->valueSize() + unit - 1) & ~(unit - 1));
+    }
+
     EPStats* stats;
+    const size_t maxInlineValueSize;
 };
 
 /**
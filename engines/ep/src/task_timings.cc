@@ -0,0 +1,113 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "task_timings.h"
+
+#include "globaltask.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+
+const size_t TaskTimings::numShards;
+
+static const size_t numTasks = static_cast<size_t>(TaskId::TASK_COUNT);
+
+static size_t getShard() {
+    // The ids of threads are often aligned addresses: mix the bits before
+    // taking the shard (Fibonacci hashing)
+    const uint64_t hash =
+            std::hash<std::thread::id>()(std::this_thread::get_id());
+    return size_t((hash * 0x9E3779B97F4A7C15ull) >> 32) %
+           TaskTimings::numShards;
+}
+
+static int64_t toNs(ProcessClock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+            .count();
+}
+
+TaskTimings::TaskTimings() : histograms(numShards * numTasks) {
+    for (auto& ptr : histograms) {
+        ptr.store(nullptr);
+    }
+}
+
+TaskTimings::~TaskTimings() {
+    for (auto& ptr : histograms) {
+        delete ptr.load();
+    }
+}
+
+TaskTimings::Histograms& TaskTimings::getHistograms(TaskId id) {
+    auto& slot = histograms[getShard() * numTasks + static_cast<size_t>(id)];
+    auto* ptr = slot.load(std::memory_order_acquire);
+    if (ptr == nullptr) {
+        std::unique_ptr<Histograms> created(new Histograms);
+        if (slot.compare_exchange_strong(ptr, created.get())) {
+            ptr = created.release();
+        }
+        // else another thread of the shard created them, now in ptr
+    }
+    return *ptr;
+}
+
+void TaskTimings::logWaitTime(TaskId id, ProcessClock::duration waitTime) {
+    const auto ns = std::max(int64_t(0), toNs(waitTime));
+    getHistograms(id).wait.add(hrtime_t(ns));
+}
+
+void TaskTimings::logRunTime(TaskId id, ProcessClock::duration runTime) {
+    const auto ns = std::max(int64_t(0), toNs(runTime));
+    getHistograms(id).run.add(hrtime_t(ns));
+}
+
+void TaskTimings::getWaitTimes(TaskId id, LatencyHistogram& histogram) const {
+    for (size_t shard = 0; shard < numShards; ++shard) {
+        const auto* ptr =
+                histograms[shard * numTasks + static_cast<size_t>(id)].load(
+                        std::memory_order_acquire);
+        if (ptr != nullptr) {
+            histogram += ptr->wait;
+        }
+    }
+}
+
+void TaskTimings::getRunTimes(TaskId id, LatencyHistogram& histogram) const {
+    for (size_t shard = 0; shard < numShards; ++shard) {
+        const auto* ptr =
+                histograms[shard * numTasks + static_cast<size_t>(id)].load(
+                        std::memory_order_acquire);
+        if (ptr != nullptr) {
+            histogram += ptr->run;
+        }
+    }
+}
+
+void TaskTimings::reset() {
+    // Reset rather than free, as the threads may be recording into them
+    for (auto& slot : histograms) {
+        auto* ptr = slot.load(std::memory_order_acquire);
+        if (ptr != nullptr) {
+            ptr->wait.reset();
+            ptr->run.reset();
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <daemon/latency_histogram.h>
+#include <platform/processclock.h>
+
+#include <atomic>
+#include <vector>
+
+enum class TaskId : int;
+
+/**
+ * Per task type (TASK() of tasks.def.h) histograms of how long the tasks
+ * wait to run once ready (from their wakeTime to the start of the run) and
+ * of how long they run for, in the log-linear LatencyHistogram of the
+ * command timings so they give the tail percentiles.
+ *
+ * The executor threads record into one of numShards shards, picked from
+ * their thread id, so that the threads running the same task type mostly
+ * don't update the same counters. The histograms of a shard are only
+ * allocated when first recorded into; reads merge the shards.
+ */
+class TaskTimings {
+public:
+    static const size_t numShards = 4;
+
+    TaskTimings();
+
+    ~TaskTimings();
+
+    TaskTimings(const TaskTimings&) = delete;
+
+    void logWaitTime(TaskId id, ProcessClock::duration waitTime);
+
+    void logRunTime(TaskId id, ProcessClock::duration runTime);
+
+    /// Add the wait times of the task type to the histogram
+    void getWaitTimes(TaskId id, LatencyHistogram& histogram) const;
+
+    /// Add the run times of the task type to the histogram
+    void getRunTimes(TaskId id, LatencyHistogram& histogram) const;
+
+    void reset();
+
+private:
+    struct Histograms {
+        LatencyHistogram wait;
+        LatencyHistogram run;
+    };
+
+    /// The histograms of the task type in the shard of the calling thread
+    Histograms& getHistograms(TaskId id);
+
+    // By shard, then by task type (allocated on first use)
+    std::vector<std::atomic<Histograms*>> histograms;
+};
@@ -63,6 +63,12 @@ public:
     */
     virtual WorkLoadPolicy& getWorkLoadPolicy() = 0;
 
+    /*
+        Return the share of the worker threads the taskable gets, relative
+        to the other taskables, when the pool shares them fairly (>= 1).
+    */
+    virtual size_t getWorkloadShare() const = 0;
+
     /*
         Called with the time spent queued
     */
@@ -19,13 +19,42 @@
 #include "taskqueue.h"
 #include "executorpool.h"
 #include "executorthread.h"
+#include "timer_wheel.h"
 
+#include <algorithm>
 #include <cmath>
 
-TaskQueue::TaskQueue(ExecutorPool *m, task_type_t t, const char *nm) :
-    name(nm), queueType(t), manager(m), sleepers(0)
-{
-    // EMPTY
+// How much more usage (runtime / weight) than the least served taskable
+// with ready tasks a taskable may have before its tasks are held back, so
+// that the priority order holds for short tasks (fair share mode)
+static const auto fairShareSlack = std::chrono::milliseconds(1);
+
+static std::unique_ptr<FutureQueueBase> makeFutureQueue(bool timerWheel) {
+    if (timerWheel) {
+        return std::unique_ptr<FutureQueueBase>(new TimerWheel());
+    }
+    return std::unique_ptr<FutureQueueBase>(new FutureQueue<>());
+}
+
+TaskQueue::TaskQueue(ExecutorPool* m,
+                     task_type_t t,
+                     const char* nm,
+                     size_t numLanes,
+                     bool timerWheel,
+                     bool fairShare,
+                     bool criticalLane)
+    : name(nm),
+      queueType(t),
+      manager(m),
+      sleepers(0),
+      futureQueue(makeFutureQueue(timerWheel)),
+      criticalLane(criticalLane && numLanes == 0),
+      fairShare(fairShare && numLanes == 0),
+      nextLane(0) {
+    for (size_t i = 0; i < numLanes; ++i) {
+        lanes.emplace_back(new Lane);
+        lanes.back()->futureQueue = makeFutureQueue(timerWheel);
+    }
 }
 
 TaskQueue::~TaskQueue() {
@@ -37,13 +66,28 @@ const std::string TaskQueue::getName() const {
 }
 
 size_t TaskQueue::getReadyQueueSize() {
+    if (!lanes.empty()) {
+        size_t size = 0;
+        for (auto& lane : lanes) {
+            std::lock_guard<std::mutex> lh(lane->mutex);
+            size += lane->readyQueue.size();
+        }
+        return size;
+    }
     LockHolder lh(mutex);
-    return readyQueue.size();
+    return readyQueue.size() + criticalQueue.size();
 }
 
 size_t TaskQueue::getFutureQueueSize() {
+    if (!lanes.empty()) {
+        size_t size = 0;
+        for (auto& lane : lanes) {
+            size += lane->futureQueue->size();
+        }
+        return size;
+    }
     LockHolder lh(mutex);
-    return futureQueue.size();
+    return futureQueue->size();
 }
 
 size_t TaskQueue::getPendingQueueSize() {
@@ -51,13 +95,156 @@ size_t TaskQueue::getPendingQueueSize() {
     return pendingQueue.size();
 }
 
+size_t TaskQueue::getCriticalQueueSize() {
+    LockHolder lh(mutex);
+    return criticalQueue.size();
+}
+
+TaskQueue::CriticalStats TaskQueue::getCriticalStats() {
+    LockHolder lh(mutex);
+    return criticalStats;
+}
+
+std::vector<TaskQueue::ShareStats> TaskQueue::getShareStats() {
+    LockHolder lh(mutex);
+    std::vector<ShareStats> stats;
+    for (const auto& it : shares) {
+        const Share& share = it.second;
+        stats.push_back({share.name,
+                         share.weight,
+                         share.runs,
+                         share.runtime,
+                         share.qtime,
+                         share.maxQtime});
+    }
+    return stats;
+}
+
+void TaskQueue::forgetTaskable(task_gid_t gid) {
+    LockHolder lh(mutex);
+    auto it = shares.find(gid);
+    // Dead tasks of the taskable may still be waiting to be popped
+    if (it != shares.end() && it->second.numReady == 0) {
+        shares.erase(it);
+    }
+}
+
 ExTask TaskQueue::_popReadyTask(void) {
-    ExTask t = readyQueue.top();
-    readyQueue.pop();
+    ExTask t;
+    if (!criticalQueue.empty()) {
+        t = _popCriticalTask();
+    } else if (fairShare) {
+        t = _popFairTask();
+    } else {
+        t = readyQueue.top();
+        readyQueue.pop();
+    }
     manager->lessWork(queueType);
     return t;
 }
 
+ExTask TaskQueue::_popCriticalTask() {
+    ExTask task = criticalQueue.top();
+    criticalQueue.pop();
+    manager->lessCriticalWork(queueType);
+
+    ++criticalStats.runs;
+    const auto now = ProcessClock::now();
+    if (now > task->getWaketime()) {
+        const auto qtime = now - task->getWaketime();
+        criticalStats.qtime += qtime;
+        criticalStats.maxQtime = std::max(criticalStats.maxQtime, qtime);
+    }
+    return task;
+}
+
+void TaskQueue::_pushReadyTask(ExTask task) {
+    if (criticalLane && GlobalTask::isLatencyCritical(task->getTypeId())) {
+        // Not accounted to the share of the taskable: critical tasks are
+        // short, and the requests waiting for them shouldn't wait for the
+        // other tasks of their bucket to get their share
+        criticalQueue.push(task);
+        manager->addCriticalWork(queueType);
+        return;
+    }
+    if (fairShare) {
+        Share& share = _shareOf(task);
+        if (share.numReady == 0) {
+            // A taskable idle until now doesn't get to run ahead of the
+            // others for the time it didn't use
+            const Share* least = nullptr;
+            for (const auto& it : shares) {
+                const Share& other = it.second;
+                if (other.numReady &&
+                    (!least || other.usage < least->usage)) {
+                    least = &other;
+                }
+            }
+            if (least) {
+                share.usage = std::max(share.usage, least->usage);
+            }
+            share.weight =
+                    std::max(size_t(1), task->getTaskable().getWorkloadShare());
+        }
+        ++share.numReady;
+    }
+    readyQueue.push(task);
+}
+
+ExTask TaskQueue::_popFairTask() {
+    ExTask task = readyQueue.top();
+    readyQueue.pop();
+    if (!task->isdead()) {
+        const Share* least = nullptr;
+        for (const auto& it : shares) {
+            const Share& share = it.second;
+            if (share.numReady && (!least || share.usage < least->usage)) {
+                least = &share;
+            }
+        }
+        // Take the first task, in priority order, of a taskable not over
+        // its share. There is one: that of the least served taskable.
+        std::vector<ExTask> heldBack;
+        while (!task->isdead() &&
+               _shareOf(task).usage > least->usage + fairShareSlack) {
+            if (readyQueue.empty()) {
+                throw std::logic_error(
+                        "TaskQueue::_popFairTask: no ready task of " +
+                        least->name + " in " + getName());
+            }
+            heldBack.push_back(task);
+            task = readyQueue.top();
+            readyQueue.pop();
+        }
+        for (auto& t : heldBack) {
+            readyQueue.push(t);
+        }
+    }
+
+    // The runtime of a task is charged as it is dispatched next (when its
+    // previous run is known)
+    Share& share = _shareOf(task);
+    --share.numReady;
+    ++share.runs;
+    share.runtime += task->getPrevRuntime();
+    share.usage += task->getPrevRuntime() / int64_t(share.weight);
+    const auto now = ProcessClock::now();
+    if (now > task->getWaketime()) {
+        const auto qtime = now - task->getWaketime();
+        share.qtime += qtime;
+        share.maxQtime = std::max(share.maxQtime, qtime);
+    }
+    return task;
+}
+
+TaskQueue::Share& TaskQueue::_shareOf(const ExTask& task) {
+    Share& share = shares[task->getTaskable().getGID()];
+    if (share.name.empty()) {
+        share.name = task->getTaskable().getName();
+    }
+    return share;
+}
+
 void TaskQueue::doWake(size_t &numToWake) {
     LockHolder lh(mutex);
     _doWake_UNLOCKED(numToWake);
@@ -65,7 +252,9 @@ void TaskQueue::doWake(size_t &numToWake) {
 
 void TaskQueue::_doWake_UNLOCKED(size_t &numToWake) {
     if (sleepers && numToWake)  {
-        if (numToWake < sleepers) {
+        // With a critical lane the sleeper woken might be a reserved thread
+        // which leaves other tasks than the critical ones: wake them all
+        if (numToWake < sleepers && !criticalLane) {
             for (; numToWake; --numToWake) {
                 mutex.notify_one(); // cond_signal 1
             }
@@ -79,7 +268,8 @@ void TaskQueue::_doWake_UNLOCKED(size_t &numToWake) {
 bool TaskQueue::_doSleep(ExecutorThread &t,
                          std::unique_lock<std::mutex>& lock) {
     t.updateCurrentTime();
-    if (t.getCurTime() < t.getWaketime() && manager->trySleep(queueType)) {
+    if (t.getCurTime() < t.getWaketime() &&
+        manager->trySleep(queueType, t.isReserved())) {
         // Atomically switch from running to sleeping; iff we were previously
         // running.
         executor_state_t expected_state = EXECUTOR_RUNNING;
@@ -88,6 +278,15 @@ bool TaskQueue::_doSleep(ExecutorThread &t,
             return false;
         }
         sleepers++;
+        if (!lanes.empty()) {
+            // The next task this thread runs may be in any lane. It counts
+            // as a sleeper by now, so whatever is scheduled after the scan
+            // wakes it up.
+            const auto earliest = _earliestLaneWaketime();
+            if (earliest < t.getWaketime()) {
+                t.setWaketime(earliest);
+            }
+        }
         // zzz....
         const auto snooze = t.getWaketime() - t.getCurTime();
 
@@ -114,6 +313,10 @@ bool TaskQueue::_doSleep(ExecutorThread &t,
 }
 
 bool TaskQueue::_fetchNextTask(ExecutorThread &t, bool toSleep) {
+    if (!lanes.empty()) {
+        return _fetchNextLaneTask(t, toSleep);
+    }
+
     bool ret = false;
     std::unique_lock<std::mutex> lh(mutex);
 
@@ -121,18 +324,28 @@ bool TaskQueue::_fetchNextTask(ExecutorThread &t, bool toSleep) {
         return ret; // shutting down
     }
 
+    const size_t readyBefore = readyQueue.size() + criticalQueue.size();
     size_t numToWake = _moveReadyTasks(t.getCurTime());
 
-    if (!futureQueue.empty() && t.taskType == queueType &&
-        futureQueue.top()->getWaketime() < t.getWaketime()) {
+    if (!futureQueue->empty() && t.taskType == queueType &&
+        futureQueue->top()->getWaketime() < t.getWaketime()) {
         // record earliest waketime
-        t.setWaketime(futureQueue.top()->getWaketime());
+        t.setWaketime(futureQueue->top()->getWaketime());
     }
 
     if (!readyQueue.empty() && readyQueue.top()->isdead()) {
         t.setCurrentTask(_popReadyTask()); // clean out dead tasks first
         ret = true;
-    } else if (!readyQueue.empty() || !pendingQueue.empty()) {
+    } else if (t.isReserved()) {
+        // Only the critical tasks, the others are left to the other threads
+        if (!criticalQueue.empty()) {
+            t.setCurrentTask(_popReadyTask());
+            ret = true;
+        } else if (readyQueue.size() > readyBefore) {
+            ++numToWake; // this thread didn't take one of those made ready
+        }
+    } else if (!readyQueue.empty() || !criticalQueue.empty() ||
+               !pendingQueue.empty()) {
         // we must consider any pending tasks too. To ensure prioritized run
         // order, the function below will push any pending task back into the
         // readyQueue (sorted by priority)
@@ -150,6 +363,142 @@ bool TaskQueue::_fetchNextTask(ExecutorThread &t, bool toSleep) {
     return ret;
 }
 
+bool TaskQueue::_fetchNextLaneTask(ExecutorThread& t, bool toSleep) {
+    if (toSleep) {
+        std::unique_lock<std::mutex> lh(mutex);
+        if (!_doSleep(t, lh)) {
+            return false; // shutting down
+        }
+    }
+
+    const size_t own = t.lane % lanes.size();
+    Lane& lane = *lanes[own];
+    size_t numToWake;
+    ExTask task;
+    {
+        std::lock_guard<std::mutex> lh(lane.mutex);
+        numToWake = _moveReadyLaneTasks(lane, t.getCurTime());
+
+        if (!lane.futureQueue->empty() && t.taskType == queueType &&
+            lane.futureQueue->top()->getWaketime() < t.getWaketime()) {
+            // record earliest waketime
+            t.setWaketime(lane.futureQueue->top()->getWaketime());
+        }
+
+        if (!lane.readyQueue.empty()) {
+            task = lane.readyQueue.top();
+            lane.readyQueue.pop();
+        }
+    }
+    if (!task) {
+        task = _stealLaneTask(t, own, numToWake);
+    }
+
+    if (task) {
+        manager->lessWork(queueType);
+        t.setCurrentTask(task);
+        // Current thread takes one task, so wake up one less thread
+        numToWake = numToWake ? numToWake - 1 : 0;
+    }
+    _wakeSleepers(numToWake);
+    return bool(task);
+}
+
+size_t TaskQueue::_moveReadyLaneTasks(Lane& lane,
+                                      const ProcessClock::time_point tv) {
+    if (!lane.readyQueue.empty()) {
+        return 0;
+    }
+
+    size_t numReady = 0;
+    while (!lane.futureQueue->empty()) {
+        ExTask tid = lane.futureQueue->top();
+        if (tid->getWaketime() > tv) {
+            break;
+        }
+        lane.futureQueue->pop();
+        lane.readyQueue.push(tid);
+        numReady++;
+    }
+
+    manager->addWork(numReady, queueType);
+    return numReady;
+}
+
+ExTask TaskQueue::_stealLaneTask(ExecutorThread& t,
+                                 size_t own,
+                                 size_t& moved) {
+    // Take the most urgent ready task of the other lanes. A lane whose lock
+    // is held is skipped: its owner is fetching from it.
+    Lane* victim = nullptr;
+    ExTask best;
+    for (size_t i = 1; i < lanes.size(); ++i) {
+        Lane& lane = *lanes[(own + i) % lanes.size()];
+        std::unique_lock<std::mutex> lh(lane.mutex, std::try_to_lock);
+        if (!lh.owns_lock()) {
+            continue;
+        }
+        moved += _moveReadyLaneTasks(lane, t.getCurTime());
+        if (lane.readyQueue.empty()) {
+            continue;
+        }
+        ExTask top = lane.readyQueue.top();
+        if (!best || CompareByPriority()(best, top)) {
+            best = top;
+            victim = &lane;
+        }
+    }
+    if (!victim) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lh(victim->mutex);
+    if (victim->readyQueue.empty()) {
+        return nullptr; // beaten to it
+    }
+    ExTask task = victim->readyQueue.top();
+    victim->readyQueue.pop();
+    // The task moves to the lane of the thread running it, which is where it
+    // is rescheduled into
+    task->queueLane = own;
+    return task;
+}
+
+ProcessClock::time_point TaskQueue::_earliestLaneWaketime() {
+    auto earliest = ProcessClock::time_point::max();
+    for (auto& lane : lanes) {
+        std::lock_guard<std::mutex> lh(lane->mutex);
+        if (!lane->readyQueue.empty()) {
+            return ProcessClock::now();
+        }
+        if (!lane->futureQueue->empty()) {
+            earliest = std::min(earliest,
+                                lane->futureQueue->top()->getWaketime());
+        }
+    }
+    return earliest;
+}
+
+std::unique_lock<std::mutex> TaskQueue::_lockLaneOf(const ExTask& task) {
+    // The lane of a task only changes under the lock of the lane it leaves
+    while (true) {
+        const size_t idx = task->queueLane;
+        std::unique_lock<std::mutex> lh(lanes[idx]->mutex);
+        if (task->queueLane == idx) {
+            return lh;
+        }
+    }
+}
+
+void TaskQueue::_wakeSleepers(size_t& numToWake) {
+    // Sleepers are counted before they look at the lanes, so if there are
+    // none a thread about to sleep still sees the work being woken for.
+    if (numToWake && sleepers) {
+        LockHolder lh(mutex);
+        _doWake_UNLOCKED(numToWake);
+    }
+}
+
 bool TaskQueue::fetchNextTask(ExecutorThread &thread, bool toSleep) {
     EventuallyPersistentEngine *epe = ObjectRegistry::onSwitchThread(NULL, true);
     bool rv = _fetchNextTask(thread, toSleep);
@@ -158,16 +507,18 @@ bool TaskQueue::fetchNextTask(ExecutorThread &thread, bool toSleep) {
 }
 
 size_t TaskQueue::_moveReadyTasks(const ProcessClock::time_point tv) {
-    if (!readyQueue.empty()) {
+    // With a critical lane a critical task coming due mustn't wait for the
+    // ready tasks to be drained
+    if (!readyQueue.empty() && !criticalLane) {
         return 0;
     }
 
     size_t numReady = 0;
-    while (!futureQueue.empty()) {
-        ExTask tid = futureQueue.top();
+    while (!futureQueue->empty()) {
+        ExTask tid = futureQueue->top();
         if (tid->getWaketime() <= tv) {
-            futureQueue.pop();
-            readyQueue.push(tid);
+            futureQueue->pop();
+            _pushReadyTask(tid);
             numReady++;
         } else {
             break;
@@ -183,17 +534,24 @@ size_t TaskQueue::_moveReadyTasks(const ProcessClock::time_point tv) {
 void TaskQueue::_checkPendingQueue(void) {
     if (!pendingQueue.empty()) {
         ExTask runnableTask = pendingQueue.front();
-        readyQueue.push(runnableTask);
+        _pushReadyTask(runnableTask);
         manager->addWork(1, queueType);
         pendingQueue.pop_front();
     }
 }
 
 ProcessClock::time_point TaskQueue::_reschedule(ExTask &task) {
+    if (!lanes.empty()) {
+        auto lh = _lockLaneOf(task);
+        auto& laneQueue = *lanes[task->queueLane]->futureQueue;
+        laneQueue.push(task);
+        return laneQueue.top()->getWaketime();
+    }
+
     LockHolder lh(mutex);
 
-    futureQueue.push(task);
-    return futureQueue.top()->getWaketime();
+    futureQueue->push(task);
+    return futureQueue->top()->getWaketime();
 }
 
 ProcessClock::time_point TaskQueue::reschedule(ExTask &task) {
@@ -207,21 +565,31 @@ void TaskQueue::_schedule(ExTask &task) {
     TaskQueue* sleepQ;
     size_t numToWake = 1;
 
-    {
+    LOG(EXTENSION_LOG_DEBUG,
+        "%s: Schedule a task \"%.*s\" id %" PRIu64,
+        name.c_str(),
+        int(task->getDescription().size()),
+        task->getDescription().data(),
+        uint64_t(task->getId()));
+
+    if (!lanes.empty()) {
+        task->setState(TASK_RUNNING, TASK_DEAD);
+        const size_t idx = nextLane++ % lanes.size();
+        {
+            std::lock_guard<std::mutex> lh(lanes[idx]->mutex);
+            task->queueLane = idx;
+            lanes[idx]->futureQueue->push(task);
+        }
+        sleepQ = manager->getSleepQ(queueType);
+        _wakeSleepers(numToWake);
+    } else {
         LockHolder lh(mutex);
 
         // If we are rescheduling a previously cancelled task, we should reset
         // the task state to the initial value of running.
         task->setState(TASK_RUNNING, TASK_DEAD);
 
-        futureQueue.push(task);
-
-        LOG(EXTENSION_LOG_DEBUG,
-            "%s: Schedule a task \"%.*s\" id %" PRIu64,
-            name.c_str(),
-            int(task->getDescription().size()),
-            task->getDescription().data(),
-            uint64_t(task->getId()));
+        futureQueue->push(task);
 
         sleepQ = manager->getSleepQ(queueType);
         _doWake_UNLOCKED(numToWake);
@@ -242,14 +610,23 @@ void TaskQueue::_wake(ExTask &task) {
     TaskQueue* sleepQ;
     // One task is being made ready regardless of the queue it's in.
     size_t readyCount = 1;
-    {
+    LOG(EXTENSION_LOG_DEBUG,
+        "%s: Wake a task \"%.*s\" id %" PRIu64,
+        name.c_str(),
+        int(task->getDescription().size()),
+        task->getDescription().data(),
+        uint64_t(task->getId()));
+
+    if (!lanes.empty()) {
+        {
+            auto lh = _lockLaneOf(task);
+            lanes[task->queueLane]->futureQueue->updateWaketime(task, now);
+            task->setState(TASK_RUNNING, TASK_SNOOZED);
+        }
+        sleepQ = manager->getSleepQ(queueType);
+        _wakeSleepers(readyCount);
+    } else {
         LockHolder lh(mutex);
-        LOG(EXTENSION_LOG_DEBUG,
-            "%s: Wake a task \"%.*s\" id %" PRIu64,
-            name.c_str(),
-            int(task->getDescription().size()),
-            task->getDescription().data(),
-            uint64_t(task->getId()));
 
         std::queue<ExTask> notReady;
         // Wake thread-count-serialized tasks too
@@ -264,7 +641,7 @@ void TaskQueue::_wake(ExTask &task) {
             }
         }
 
-        futureQueue.updateWaketime(task, now);
+        futureQueue->updateWaketime(task, now);
         task->setState(TASK_RUNNING, TASK_SNOOZED);
 
         while (!notReady.empty()) {
@@ -274,7 +651,7 @@ void TaskQueue::_wake(ExTask &task) {
             }
 
             // MB-18453: Only push to the futureQueue
-            futureQueue.push(tid);
+            futureQueue->push(tid);
             notReady.pop();
         }
 
@@ -286,6 +663,15 @@ void TaskQueue::_wake(ExTask &task) {
     }
 }
 
+void TaskQueue::snooze(ExTask& task, const double secs) {
+    if (lanes.empty()) {
+        futureQueue->snooze(task, secs);
+        return;
+    }
+    auto lh = _lockLaneOf(task);
+    lanes[task->queueLane]->futureQueue->snooze(task, secs);
+}
+
 void TaskQueue::wake(ExTask &task) {
     EventuallyPersistentEngine *epe = ObjectRegistry::onSwitchThread(NULL, true);
     _wake(task);
@@ -22,11 +22,17 @@
 #include "futurequeue.h"
 #include "syncobject.h"
 #include "task_type.h"
+#include "taskable.h"
 
 #include <platform/processclock.h>
 
+#include <atomic>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <unordered_map>
+#include <vector>
 
 class ExecutorPool;
 class ExecutorThread;
@@ -34,7 +40,27 @@ class ExecutorThread;
 class TaskQueue {
     friend class ExecutorPool;
 public:
-    TaskQueue(ExecutorPool *m, task_type_t t, const char *nm);
+    /**
+     * @param numLanes if non-zero the ready and future queues are split into
+     *        that many lanes (one per worker thread) so that the threads only
+     *        contend with each other when stealing work; zero keeps a single
+     *        set of queues for all the threads.
+     * @param timerWheel if the tasks waiting for their wakeTime are kept in
+     *        a TimerWheel rather than a FutureQueue.
+     * @param fairShare if the ready tasks of a taskable that got more than
+     *        its share of the runtime wait for those of the others (not
+     *        with lanes, which are each ordered on their own).
+     * @param criticalLane if the ready latency critical tasks run before
+     *        all the others, and are all that the reserved threads run (not
+     *        with lanes).
+     */
+    TaskQueue(ExecutorPool* m,
+              task_type_t t,
+              const char* nm,
+              size_t numLanes = 0,
+              bool timerWheel = false,
+              bool fairShare = false,
+              bool criticalLane = false);
     ~TaskQueue();
 
     void schedule(ExTask &task);
@@ -61,11 +87,73 @@ public:
 
     size_t getPendingQueueSize();
 
-    void snooze(ExTask& task, const double secs) {
-        futureQueue.snooze(task, secs);
+    size_t getCriticalQueueSize();
+
+    bool hasCriticalLane() const {
+        return criticalLane;
+    }
+
+    size_t getNumLanes() const {
+        return lanes.size();
     }
 
+    void snooze(ExTask& task, const double secs);
+
+    /// How a taskable used the queue (fair share mode)
+    struct ShareStats {
+        std::string name;
+        size_t weight;
+        uint64_t runs;
+        ProcessClock::duration runtime;
+        ProcessClock::duration qtime;
+        ProcessClock::duration maxQtime;
+    };
+
+    std::vector<ShareStats> getShareStats();
+
+    /// How the latency critical tasks waited to run (critical lane only)
+    struct CriticalStats {
+        uint64_t runs = 0;
+        ProcessClock::duration qtime{0};
+        ProcessClock::duration maxQtime{0};
+    };
+
+    CriticalStats getCriticalStats();
+
+    /// Drop the share of an unregistered taskable
+    void forgetTaskable(task_gid_t gid);
+
 private:
+    /**
+     * The queues of one worker thread (work stealing mode). A thread pops
+     * from its own lane and only looks at the other lanes when its own has
+     * no ready task, taking the most urgent one they have.
+     */
+    struct Lane {
+        // Protects readyQueue and the moves from futureQueue to readyQueue
+        std::mutex mutex;
+        std::priority_queue<ExTask, std::deque<ExTask>, CompareByPriority>
+                readyQueue;
+        std::unique_ptr<FutureQueueBase> futureQueue;
+    };
+
+    /**
+     * The share of a taskable of the queue (fair share mode). Its runtime
+     * divided by its weight is the usage compared with the others'.
+     */
+    struct Share {
+        std::string name;
+        size_t weight = 1;
+        ProcessClock::duration usage{0};
+        // The ready tasks of the taskable in readyQueue
+        size_t numReady = 0;
+        uint64_t runs = 0;
+        ProcessClock::duration runtime{0};
+        ProcessClock::duration qtime{0};
+        ProcessClock::duration maxQtime{0};
+    };
+
+
     void _schedule(ExTask &task);
     ProcessClock::time_point _reschedule(ExTask &task);
     void _checkPendingQueue(void);
@@ -75,21 +163,49 @@ private:
     void _doWake_UNLOCKED(size_t &numToWake);
     size_t _moveReadyTasks(const ProcessClock::time_point tv);
     ExTask _popReadyTask(void);
+    ExTask _popCriticalTask();
+    void _pushReadyTask(ExTask task);
+    ExTask _popFairTask();
+    Share& _shareOf(const ExTask& task);
+
+    bool _fetchNextLaneTask(ExecutorThread& thread, bool toSleep);
+    size_t _moveReadyLaneTasks(Lane& lane, ProcessClock::time_point tv);
+    ExTask _stealLaneTask(ExecutorThread& thread, size_t own, size_t& moved);
+    ProcessClock::time_point _earliestLaneWaketime();
+    std::unique_lock<std::mutex> _lockLaneOf(const ExTask& task);
+    void _wakeSleepers(size_t& numToWake);
 
     SyncObject mutex;
     const std::string name;
     task_type_t queueType;
     ExecutorPool *manager;
-    size_t sleepers; // number of threads sleeping in this taskQueue
+    // number of threads sleeping in this taskQueue
+    std::atomic<size_t> sleepers;
 
     // sorted by task priority.
     std::priority_queue<ExTask, std::deque<ExTask>,
                         CompareByPriority> readyQueue;
 
     // sorted by waketime.
-    FutureQueue<> futureQueue;
+    std::unique_ptr<FutureQueueBase> futureQueue;
 
     std::list<ExTask> pendingQueue;
+
+    // Critical lane only: the ready latency critical tasks, which go
+    // before those of readyQueue (under mutex)
+    const bool criticalLane;
+    std::priority_queue<ExTask, std::deque<ExTask>, CompareByPriority>
+            criticalQueue;
+    CriticalStats criticalStats;
+
+    // Fair share mode only, by the GID of the taskables (under mutex)
+    const bool fairShare;
+    std::unordered_map<task_gid_t, Share> shares;
+
+    // Work stealing mode only (the queues above are then unused)
+    std::vector<std::unique_ptr<Lane>> lanes;
+    // The lane the next task scheduled is pushed into (round robin)
+    std::atomic<size_t> nextLane;
 };
 
 #endif  // SRC_TASKQUEUE_H_
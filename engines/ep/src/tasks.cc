@@ -19,6 +19,7 @@
 #include "bgfetcher.h"
 #include "ep_bucket.h"
 #include "ep_engine.h"
+#include "executorpool.h"
 #include "flusher.h"
 #include "kvstore.h"
 #include "tasks.h"
@@ -30,6 +31,7 @@
 #include <phosphor/phosphor.h>
 
 static const double WORKLOAD_MONITOR_FREQ(5.0);
+static const double EXECUTOR_TUNER_FREQ(1.0);
 
 bool FlusherTask::run() {
     TRACE_EVENT0("ep-engine/task", "FlusherTask");
@@ -160,3 +162,13 @@ bool WorkLoadMonitor::run() {
     }
     return true;
 }
+
+ExecutorTunerTask::ExecutorTunerTask(EventuallyPersistentEngine* e)
+    : GlobalTask(e, TaskId::ExecutorTunerTask, EXECUTOR_TUNER_FREQ, false) {
+}
+
+bool ExecutorTunerTask::run() {
+    ExecutorPool::get()->autoTune();
+    snooze(EXECUTOR_TUNER_FREQ);
+    return !engine->getEpStats().isShutdown;
+}
@@ -30,6 +30,8 @@
 // Read IO tasks
 TASK(MultiBGFetcherTask, READER_TASK_IDX, 0)
 TASK(FetchAllKeysTask, READER_TASK_IDX, 0)
+TASK(RangeScanTask, READER_TASK_IDX, 0)
+TASK(SeqnoRangeTask, READER_TASK_IDX, 0)
 TASK(Warmup, READER_TASK_IDX, 0)
 TASK(WarmupInitialize, READER_TASK_IDX, 0)
 TASK(WarmupCreateVBuckets, READER_TASK_IDX, 0)
@@ -73,9 +75,11 @@ TASK(ExpiredItemPager, NONIO_TASK_IDX, 7)
 TASK(ItemPagerVisitor, NONIO_TASK_IDX, 7)
 TASK(ExpiredItemPagerVisitor, NONIO_TASK_IDX, 7)
 TASK(DefragmenterTask, NONIO_TASK_IDX, 7)
+TASK(ItemCompressorTask, NONIO_TASK_IDX, 7)
 TASK(EphTombstoneHTCleaner, NONIO_TASK_IDX, 7)
 TASK(EphTombstoneStaleItemDeleter, NONIO_TASK_IDX, 7)
 TASK(ConnManager, NONIO_TASK_IDX, 8)
 TASK(WorkLoadMonitor, NONIO_TASK_IDX, 10)
+TASK(ExecutorTunerTask, NONIO_TASK_IDX, 10)
 TASK(HashtableResizerTask, NONIO_TASK_IDX, 211)
 TASK(HashtableResizerVisitorTask, NONIO_TASK_IDX, 7)
@@ -302,3 +302,23 @@ private:
     size_t prevNumMutations;
     size_t prevNumGets;
 };
+
+/**
+ * A task that drives the auto tuning of the thread counts of the
+ * ExecutorPool (shared by the buckets, which each run one).
+ */
+class ExecutorTunerTask : public GlobalTask {
+public:
+    ExecutorTunerTask(EventuallyPersistentEngine* e);
+
+    bool run();
+
+    std::chrono::microseconds maxExpectedDuration() {
+        // Only reads a few counters, unless it starts or stops a thread
+        return std::chrono::milliseconds(10);
+    }
+
+    cb::const_char_buffer getDescription() {
+        return "Tuning the number of executor threads";
+    }
+};
@@ -0,0 +1,109 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "thread_tuner.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const int ThreadTuner::growAfter;
+const int ThreadTuner::shrinkAfter;
+constexpr double ThreadTuner::busyHigh;
+constexpr double ThreadTuner::busyLow;
+constexpr double ThreadTuner::ioWaitHigh;
+
+ThreadTuner::ThreadTuner(size_t minThreads, size_t maxThreads, size_t numCpus)
+    : minThreads(std::max(size_t(1), minThreads)),
+      maxThreads(std::max(this->minThreads, maxThreads)),
+      numCpus(numCpus) {
+}
+
+size_t ThreadTuner::tune(const Sample& sample) {
+    const auto runtime = sample.runtime - prevRuntime;
+    const auto cpuTime = sample.cpuTime - prevCpuTime;
+    prevRuntime = sample.runtime;
+    prevCpuTime = sample.cpuTime;
+
+    // The runs of long tasks are only counted when they end, so an
+    // interval may see more runtime than the threads had
+    double busy = 0;
+    if (sample.threads > 0 && sample.interval.count() > 0) {
+        busy = double(runtime.count()) /
+               (double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               sample.interval)
+                               .count()) *
+                sample.threads);
+        busy = std::min(busy, 1.0);
+    }
+    double ioWait = 0;
+    if (runtime.count() > 0) {
+        ioWait = 1.0 - double(cpuTime.count()) / double(runtime.count());
+        ioWait = std::min(std::max(ioWait, 0.0), 1.0);
+    }
+
+    stats.busy = uint64_t(busy * 100);
+    stats.ioWait = uint64_t(ioWait * 100);
+    stats.readyTasks = sample.readyTasks;
+
+    const bool backlog = sample.readyTasks > sample.threads;
+    const bool wantMore = backlog && busy >= busyHigh &&
+                          (ioWait >= ioWaitHigh || sample.threads < numCpus);
+    const bool wantFewer = sample.readyTasks == 0 && busy <= busyLow;
+
+    growStreak = wantMore ? growStreak + 1 : 0;
+    shrinkStreak = wantFewer ? shrinkStreak + 1 : 0;
+
+    size_t wanted = sample.threads;
+    if (growStreak >= growAfter && sample.threads < maxThreads) {
+        wanted = sample.threads + 1;
+    } else if (shrinkStreak >= shrinkAfter && sample.threads > minThreads) {
+        wanted = sample.threads - 1;
+    }
+    // Keep within the bounds whatever set the current count
+    wanted = std::min(std::max(wanted, minThreads), maxThreads);
+
+    if (wanted > sample.threads) {
+        stats.lastDecision = Decision::Grow;
+        ++stats.grows;
+    } else if (wanted < sample.threads) {
+        stats.lastDecision = Decision::Shrink;
+        ++stats.shrinks;
+    } else {
+        stats.lastDecision = Decision::Hold;
+    }
+    if (wanted != sample.threads) {
+        growStreak = 0;
+        shrinkStreak = 0;
+    }
+    return wanted;
+}
+
+std::string to_string(ThreadTuner::Decision decision) {
+    switch (decision) {
+    case ThreadTuner::Decision::Hold:
+        return "hold";
+    case ThreadTuner::Decision::Grow:
+        return "grow";
+    case ThreadTuner::Decision::Shrink:
+        return "shrink";
+    }
+    throw std::invalid_argument("to_string(ThreadTuner::Decision): invalid "
+                                "decision " +
+                                std::to_string(int(decision)));
+}
@@ -0,0 +1,117 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <platform/processclock.h>
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Picks how many threads a task type of the ExecutorPool should have, from
+ * what its threads did since the last call (auto tuning mode):
+ *
+ * - it grows by one thread when more tasks are ready than there are threads
+ *   while the threads are busy, as long as either they spend a good part of
+ *   their runtime off the CPU (waiting for I/O, so more of them give more
+ *   I/O in flight) or there are CPUs to spare;
+ * - it shrinks by one thread when nothing is ready and the threads are
+ *   mostly idle.
+ *
+ * Either has to be seen on several calls in a row (more to shrink than to
+ * grow) before the count changes, and the streaks start over after a
+ * change, so that a burst doesn't make the count flap.
+ */
+class ThreadTuner {
+public:
+    // Consecutive calls needing more (fewer) threads before growing
+    // (shrinking)
+    static const int growAfter = 3;
+    static const int shrinkAfter = 10;
+
+    // The fraction of their time the threads run tasks above which they
+    // are busy, and below which they are idle
+    static constexpr double busyHigh = 0.75;
+    static constexpr double busyLow = 0.25;
+
+    // The fraction of the runtime off the CPU above which the tasks wait
+    // for I/O
+    static constexpr double ioWaitHigh = 0.25;
+
+    enum class Decision { Hold, Grow, Shrink };
+
+    /// What the threads of the task type did since the last call
+    struct Sample {
+        // The current number of threads
+        size_t threads;
+        // The tasks ready to run now
+        size_t readyTasks;
+        // The time since the last call
+        ProcessClock::duration interval;
+        // The total (ever) wall clock time and CPU time of the runs
+        std::chrono::nanoseconds runtime;
+        std::chrono::nanoseconds cpuTime;
+    };
+
+    struct Stats {
+        // Percentages over the last interval
+        uint64_t busy = 0;
+        uint64_t ioWait = 0;
+        size_t readyTasks = 0;
+        uint64_t grows = 0;
+        uint64_t shrinks = 0;
+        Decision lastDecision = Decision::Hold;
+    };
+
+    /**
+     * @param minThreads the fewest threads to shrink to
+     * @param maxThreads the most threads to grow to
+     * @param numCpus the CPUs available for the threads
+     */
+    ThreadTuner(size_t minThreads, size_t maxThreads, size_t numCpus);
+
+    /// @return the number of threads the task type should have
+    size_t tune(const Sample& sample);
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+    size_t getMinThreads() const {
+        return minThreads;
+    }
+
+    size_t getMaxThreads() const {
+        return maxThreads;
+    }
+
+private:
+    const size_t minThreads;
+    const size_t maxThreads;
+    const size_t numCpus;
+
+    std::chrono::nanoseconds prevRuntime{0};
+    std::chrono::nanoseconds prevCpuTime{0};
+    int growStreak = 0;
+    int shrinkStreak = 0;
+    Stats stats;
+};
+
+std::string to_string(ThreadTuner::Decision decision);
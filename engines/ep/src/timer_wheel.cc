@@ -0,0 +1,283 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <vector>
+
+const size_t TimerWheel::slotBits;
+const size_t TimerWheel::numSlots;
+const size_t TimerWheel::numLevels;
+const int64_t TimerWheel::tickNs;
+const size_t TimerWheel::dueLevel;
+const size_t TimerWheel::overflowLevel;
+
+static const size_t slotMask = TimerWheel::numSlots - 1;
+
+TimerWheel::TimerWheel(ProcessClock::time_point start)
+    : now(toTick(toNs(start))), numTasks(0), nextSeq(0) {
+    occupied.fill(0);
+    levelSize.fill(0);
+}
+
+int64_t TimerWheel::toNs(ProcessClock::time_point tp) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   tp.time_since_epoch())
+            .count();
+}
+
+int64_t TimerWheel::toTick(int64_t ns) {
+    // Rounded down, also before the epoch
+    return ns >= 0 ? ns / tickNs : -((-(ns + 1)) / tickNs) - 1;
+}
+
+void TimerWheel::push(ExTask task) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    const int64_t waketime = toNs(task->getWaketime());
+    place({std::move(task), waketime, nextSeq++});
+}
+
+void TimerWheel::pop() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    Position pos;
+    if (!findTop(pos)) {
+        return;
+    }
+    Entry entry = take(pos);
+    erasePosition(entry.task->getId(), entry.seq);
+    // Nothing is due before the task popped
+    advance(toTick(entry.waketime));
+}
+
+ExTask TimerWheel::top() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    Position pos;
+    if (!findTop(pos)) {
+        return ExTask();
+    }
+    return pos.level == dueLevel ? pos.dueIt->second.task : pos.it->task;
+}
+
+size_t TimerWheel::size() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return numTasks;
+}
+
+bool TimerWheel::empty() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return numTasks == 0;
+}
+
+bool TimerWheel::updateWaketime(const ExTask& task,
+                                ProcessClock::time_point newTime) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    task->updateWaketime(newTime);
+
+    auto range = positions.equal_range(task->getId());
+    if (range.first == range.second) {
+        return false;
+    }
+    std::vector<Entry> entries;
+    for (auto it = range.first; it != range.second; ++it) {
+        entries.push_back(take(it->second));
+    }
+    positions.erase(range.first, range.second);
+    const int64_t waketime = toNs(newTime);
+    for (auto& entry : entries) {
+        entry.waketime = waketime;
+        place(std::move(entry));
+    }
+    return true;
+}
+
+bool TimerWheel::snooze(const ExTask& task, const double secs) {
+    task->snooze(secs);
+    return updateWaketime(task, task->getWaketime());
+}
+
+void TimerWheel::place(Entry entry) {
+    Position pos;
+    pos.seq = entry.seq;
+    const size_t taskId = entry.task->getId();
+    const int64_t tick = toTick(entry.waketime);
+
+    if (tick <= now) {
+        pos.level = dueLevel;
+        pos.dueIt = due.emplace(entry.waketime, std::move(entry));
+    } else {
+        const int64_t delta = tick - now;
+        size_t level = 0;
+        while (level < numLevels &&
+               delta >= (int64_t(1) << (slotBits * (level + 1)))) {
+            ++level;
+        }
+        if (level == numLevels) {
+            pos.level = overflowLevel;
+            pos.it = overflow.insert(overflow.end(), std::move(entry));
+        } else {
+            pos.level = level;
+            pos.slot = size_t(tick >> (slotBits * level)) & slotMask;
+            Slot& slot = wheel[level][pos.slot];
+            pos.it = slot.insert(slot.end(), std::move(entry));
+            occupied[level] |= uint64_t(1) << pos.slot;
+            ++levelSize[level];
+        }
+    }
+    positions.emplace(taskId, pos);
+    ++numTasks;
+}
+
+TimerWheel::Entry TimerWheel::take(const Position& pos) {
+    Entry entry;
+    if (pos.level == dueLevel) {
+        entry = std::move(pos.dueIt->second);
+        due.erase(pos.dueIt);
+    } else if (pos.level == overflowLevel) {
+        entry = std::move(*pos.it);
+        overflow.erase(pos.it);
+    } else {
+        Slot& slot = wheel[pos.level][pos.slot];
+        entry = std::move(*pos.it);
+        slot.erase(pos.it);
+        if (slot.empty()) {
+            occupied[pos.level] &= ~(uint64_t(1) << pos.slot);
+        }
+        --levelSize[pos.level];
+    }
+    --numTasks;
+    return entry;
+}
+
+void TimerWheel::erasePosition(size_t taskId, uint64_t seq) {
+    auto range = positions.equal_range(taskId);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.seq == seq) {
+            positions.erase(it);
+            return;
+        }
+    }
+}
+
+size_t TimerWheel::firstOccupied(size_t level, size_t from) const {
+    for (size_t i = 0; i < numSlots; ++i) {
+        const size_t idx = (from + i) & slotMask;
+        if (occupied[level] & (uint64_t(1) << idx)) {
+            return idx;
+        }
+    }
+    return numSlots;
+}
+
+bool TimerWheel::findTop(Position& pos) {
+    bool found = false;
+    int64_t earliest = 0;
+
+    if (!due.empty()) {
+        pos.level = dueLevel;
+        pos.dueIt = due.begin();
+        pos.seq = pos.dueIt->second.seq;
+        earliest = pos.dueIt->first;
+        found = true;
+    }
+
+    auto consider = [&](Slot& slot, size_t level, size_t idx) {
+        for (auto it = slot.begin(); it != slot.end(); ++it) {
+            if (!found || it->waketime < earliest) {
+                pos.level = level;
+                pos.slot = idx;
+                pos.it = it;
+                pos.seq = it->seq;
+                earliest = it->waketime;
+                found = true;
+            }
+        }
+    };
+
+    // The slots of a level after the current one are in wakeTime order
+    // (the current one, last, only holds the tasks a whole turn ahead)
+    for (size_t level = 0; level < numLevels; ++level) {
+        if (!occupied[level]) {
+            continue;
+        }
+        const size_t from =
+                size_t((now >> (slotBits * level)) + 1) & slotMask;
+        const size_t idx = firstOccupied(level, from);
+        consider(wheel[level][idx], level, idx);
+    }
+    consider(overflow, overflowLevel, 0);
+    return found;
+}
+
+void TimerWheel::cascade(Slot& slot) {
+    Slot entries;
+    entries.swap(slot);
+    numTasks -= entries.size();
+    for (auto& entry : entries) {
+        erasePosition(entry.task->getId(), entry.seq);
+        place(std::move(entry));
+    }
+}
+
+void TimerWheel::advance(int64_t tick) {
+    while (now < tick) {
+        size_t lowest = 0;
+        while (lowest < numLevels && levelSize[lowest] == 0) {
+            ++lowest;
+        }
+
+        // Step to the next time something needs cascading or is due: the
+        // next slot boundary of the lowest level in use above 0, or if level
+        // 0 is in use its next occupied slot if sooner. With the wheel
+        // empty, straight to the tick.
+        int64_t next = tick;
+        if (lowest < numLevels) {
+            const size_t shift = slotBits * std::max(lowest, size_t(1));
+            next = ((now >> shift) + 1) << shift;
+            if (lowest == 0) {
+                const size_t from = size_t(now + 1) & slotMask;
+                const size_t idx = firstOccupied(0, from);
+                next = std::min(next,
+                                now + 1 + int64_t((idx - from) & slotMask));
+            }
+            next = std::min(next, tick);
+        }
+        const int64_t prev = now;
+        now = next;
+
+        // Highest level first, as a cascade may fill the levels below
+        if ((prev >> (slotBits * (numLevels - 1))) !=
+            (now >> (slotBits * (numLevels - 1)))) {
+            cascade(overflow);
+        }
+        for (size_t level = numLevels - 1; level > 0; --level) {
+            const size_t shift = slotBits * level;
+            if ((prev >> shift) != (now >> shift)) {
+                const size_t idx = size_t(now >> shift) & slotMask;
+                levelSize[level] -= wheel[level][idx].size();
+                occupied[level] &= ~(uint64_t(1) << idx);
+                cascade(wheel[level][idx]);
+            }
+        }
+        const size_t idx = size_t(now) & slotMask;
+        levelSize[0] -= wheel[0][idx].size();
+        occupied[0] &= ~(uint64_t(1) << idx);
+        cascade(wheel[0][idx]);
+    }
+}
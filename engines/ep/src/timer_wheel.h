@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * The TimerWheel is a FutureQueue whose push, snooze and updateWaketime do
+ * not depend on how many tasks are queued (FutureQueue re-heapifies the
+ * whole queue on every snooze).
+ *
+ * It is a hierarchical timer wheel of numLevels levels of numSlots slots.
+ * A slot of level 0 is one tick (1ms) wide, a slot of level L numSlots^L
+ * ticks. A task goes into the lowest level whose span covers how far past
+ * the time of the wheel it is due, or into an overflow list if beyond the
+ * last level. As the time of the wheel moves forward (to the wakeTime of
+ * the task popped) the slots it reaches are cascaded into the lower levels,
+ * and those of level 0 into the tasks due, which are ordered by wakeTime.
+ *
+ * As a slot holds many wakeTimes, top() looks for the earliest task in the
+ * first occupied slot of every level (found from a bitmap of the occupied
+ * slots) and in the tasks due.
+ */
+
+#pragma once
+
+#include "futurequeue.h"
+
+#include <array>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+class TimerWheel : public FutureQueueBase {
+public:
+    static const size_t slotBits = 6;
+    static const size_t numSlots = size_t(1) << slotBits;
+    static const size_t numLevels = 4;
+
+    /// The width of a slot of level 0
+    static const int64_t tickNs = 1000000;
+
+    /**
+     * @param start the time of the wheel; tasks due before go straight into
+     *        the tasks due.
+     */
+    explicit TimerWheel(ProcessClock::time_point start = ProcessClock::now());
+
+    void push(ExTask task) override;
+
+    void pop() override;
+
+    ExTask top() override;
+
+    size_t size() override;
+
+    bool empty() override;
+
+    bool updateWaketime(const ExTask& task,
+                        ProcessClock::time_point newTime) override;
+
+    bool snooze(const ExTask& task, const double secs) override;
+
+private:
+    struct Entry {
+        ExTask task;
+        // The wakeTime the task was queued with, in ns
+        int64_t waketime;
+        // Tells apart the copies of a task pushed more than once
+        uint64_t seq;
+    };
+
+    using Slot = std::list<Entry>;
+    using DueTasks = std::multimap<int64_t, Entry>;
+
+    // The levels of an Entry outside of the wheel
+    static const size_t dueLevel = numLevels;
+    static const size_t overflowLevel = numLevels + 1;
+
+    struct Position {
+        size_t level;
+        size_t slot;
+        Slot::iterator it; // unless due
+        DueTasks::iterator dueIt; // if due
+        uint64_t seq;
+    };
+
+    static int64_t toNs(ProcessClock::time_point tp);
+
+    static int64_t toTick(int64_t ns);
+
+    /// Queue the entry according to its wakeTime
+    void place(Entry entry);
+
+    /// Take the entry out of its slot (its position is left to the caller)
+    Entry take(const Position& pos);
+
+    void erasePosition(size_t taskId, uint64_t seq);
+
+    /// Find the entry with the earliest wakeTime
+    bool findTop(Position& pos);
+
+    /// Move the time of the wheel forward to the given tick
+    void advance(int64_t tick);
+
+    /// Queue again the entries of the slot (as the time of the wheel moved)
+    void cascade(Slot& slot);
+
+    /// The first occupied slot of the level from the given slot
+    size_t firstOccupied(size_t level, size_t from) const;
+
+    std::mutex queueMutex;
+
+    // The time of the wheel, in ticks
+    int64_t now;
+
+    std::array<std::array<Slot, numSlots>, numLevels> wheel;
+    // Per level, bit N is set if slot N is not empty
+    std::array<uint64_t, numLevels> occupied;
+    std::array<size_t, numLevels> levelSize;
+
+    DueTasks due;
+    Slot overflow;
+
+    // The positions of the entries, by task id
+    std::unordered_multimap<size_t, Position> positions;
+
+    size_t numTasks;
+    uint64_t nextSeq;
+};
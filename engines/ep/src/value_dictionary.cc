@@ -0,0 +1,250 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "value_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+const size_t ValueDictionary::trainingSamples;
+const size_t ValueDictionary::maxSize;
+const size_t ValueDictionary::minCopy;
+const size_t ValueDictionary::hashBits;
+
+/// The longest quoted string a dictionary is trained with
+static const size_t maxTrainedString = 64;
+
+static void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+static bool readVarint(const char*& pos, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+        const uint8_t byte = uint8_t(*pos++);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ValueDictionary::ValueDictionary(uint32_t id, std::string data)
+    : id(id), data(std::move(data)), index(size_t(1) << hashBits, -1) {
+    if (id == 0) {
+        throw std::invalid_argument("ValueDictionary: id must be non-zero");
+    }
+    if (this->data.size() > maxSize) {
+        throw std::invalid_argument("ValueDictionary: data too large (" +
+                                    std::to_string(this->data.size()) + ")");
+    }
+    for (size_t pos = 0; pos + minCopy <= this->data.size(); ++pos) {
+        index[hash(this->data.data() + pos)] = int32_t(pos);
+    }
+}
+
+size_t ValueDictionary::hash(const char* p) {
+    uint32_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return (word * 2654435761u) >> (32 - hashBits);
+}
+
+std::string ValueDictionary::train(const std::vector<std::string>& samples) {
+    // The number of samples each quoted string appears in
+    std::map<std::string, size_t> counts;
+    for (const auto& sample : samples) {
+        std::set<std::string> seen;
+        for (size_t pos = sample.find('"'); pos != std::string::npos;) {
+            size_t end = pos + 1;
+            while (end < sample.size() && sample[end] != '"') {
+                end += sample[end] == '\\' ? 2 : 1;
+            }
+            if (end >= sample.size()) {
+                break;
+            }
+            ++end;
+            if (end < sample.size() && sample[end] == ':') {
+                ++end;
+            }
+            const size_t len = end - pos;
+            if (len >= 3 && len <= maxTrainedString) {
+                seen.insert(sample.substr(pos, len));
+            }
+            pos = sample.find('"', end);
+        }
+        for (const auto& str : seen) {
+            ++counts[str];
+        }
+    }
+
+    std::vector<std::pair<size_t, const std::string*>> scored;
+    for (const auto& entry : counts) {
+        if (entry.second >= 2) {
+            scored.emplace_back(entry.second * entry.first.size(),
+                                &entry.first);
+        }
+    }
+    std::stable_sort(scored.begin(),
+                     scored.end(),
+                     [](const std::pair<size_t, const std::string*>& a,
+                        const std::pair<size_t, const std::string*>& b) {
+                         return a.first > b.first;
+                     });
+
+    std::vector<const std::string*> chosen;
+    size_t size = 0;
+    for (const auto& entry : scored) {
+        if (size + entry.second->size() > maxSize) {
+            continue;
+        }
+        chosen.push_back(entry.second);
+        size += entry.second->size();
+    }
+
+    // The best last, so that the copies from them are the shortest to encode
+    std::string result;
+    result.reserve(size);
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        result.append(**it);
+    }
+    return result;
+}
+
+bool ValueDictionary::encode(cb::const_char_buffer value,
+                             std::string& out) const {
+    out.clear();
+    appendVarint(out, value.size());
+
+    const char* const src = value.data();
+    const size_t size = value.size();
+    const size_t dictSize = data.size();
+    // Per hash, the last position in the value (+1, so that 0 is none)
+    std::vector<uint32_t> local(size_t(1) << hashBits, 0);
+
+    size_t literal = 0;
+    auto flushLiteral = [&](size_t upTo) {
+        if (upTo > literal) {
+            appendVarint(out, uint64_t(upTo - literal) << 1);
+            out.append(src + literal, upTo - literal);
+        }
+    };
+
+    size_t pos = 0;
+    while (pos + minCopy <= size) {
+        const size_t h = hash(src + pos);
+        size_t bestLen = 0;
+        size_t bestDistance = 0;
+
+        if (local[h] != 0) {
+            const size_t from = local[h] - 1;
+            size_t len = 0;
+            while (pos + len < size && src[from + len] == src[pos + len]) {
+                ++len;
+            }
+            bestLen = len;
+            bestDistance = pos - from;
+        }
+        if (index[h] >= 0) {
+            const size_t from = size_t(index[h]);
+            size_t len = 0;
+            while (from + len < dictSize && pos + len < size &&
+                   data[from + len] == src[pos + len]) {
+                ++len;
+            }
+            if (len > bestLen) {
+                bestLen = len;
+                bestDistance = dictSize - from + pos;
+            }
+        }
+        local[h] = uint32_t(pos + 1);
+
+        if (bestLen < minCopy) {
+            ++pos;
+            continue;
+        }
+
+        flushLiteral(pos);
+        appendVarint(out, (uint64_t(bestLen - minCopy) << 1) | 1);
+        appendVarint(out, bestDistance);
+        for (size_t i = pos + 1; i < pos + bestLen && i + minCopy <= size;
+             ++i) {
+            local[hash(src + i)] = uint32_t(i + 1);
+        }
+        pos += bestLen;
+        literal = pos;
+        if (out.size() >= size) {
+            return false;
+        }
+    }
+    flushLiteral(size);
+    return out.size() < size;
+}
+
+bool ValueDictionary::decode(cb::const_char_buffer encoded,
+                             std::string& out) const {
+    out.clear();
+    const char* pos = encoded.data();
+    const char* const end = pos + encoded.size();
+    uint64_t size;
+    if (!readVarint(pos, end, size)) {
+        return false;
+    }
+    // A copy may expand a lot, but not beyond the limits of the ops
+    out.reserve(std::min(size, uint64_t(encoded.size()) * 64));
+
+    const size_t dictSize = data.size();
+    while (pos < end) {
+        uint64_t op;
+        if (!readVarint(pos, end, op)) {
+            return false;
+        }
+        const uint64_t len = (op >> 1) + ((op & 1) ? minCopy : 0);
+        if (len > size - out.size()) {
+            return false;
+        }
+        if ((op & 1) == 0) {
+            if (len > uint64_t(end - pos)) {
+                return false;
+            }
+            out.append(pos, size_t(len));
+            pos += len;
+            continue;
+        }
+
+        uint64_t distance;
+        if (!readVarint(pos, end, distance) || distance == 0 ||
+            distance > dictSize + out.size()) {
+            return false;
+        }
+        // Position in the dictionary followed by the output; byte by byte as
+        // a copy may overlap what it produces
+        size_t from = size_t(dictSize + out.size() - distance);
+        for (uint64_t i = 0; i < len; ++i, ++from) {
+            out.push_back(from < dictSize ? data[from]
+                                          : out[from - dictSize]);
+        }
+    }
+    return out.size() == size;
+}
@@ -0,0 +1,110 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <platform/sized_buffer.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A dictionary of the strings the values of a vbucket have in common (e.g.
+ * the field names of its JSON documents), with which a value is stored as
+ * LZ77 copies from the dictionary or from the value itself, and literals.
+ *
+ * Unlike the per-document Snappy compression, a copy can refer to the
+ * dictionary, so that a small document compresses even if each of its field
+ * names appears only once in it.
+ *
+ * The encoding of a value is the varint of its length followed by the
+ * sequence of:
+ * - literals: the varint (length << 1), then the bytes;
+ * - copies: the varint ((length - minCopy) << 1 | 1), then the varint of the
+ *   distance back to the data copied in the dictionary followed by the
+ *   value decoded so far.
+ *
+ * Immutable once built, hence thread-safe.
+ */
+class ValueDictionary {
+public:
+    /// The number of values a dictionary is trained from
+    static const size_t trainingSamples = 64;
+
+    /// The maximum size of a dictionary
+    static const size_t maxSize = 4096;
+
+    /// The shortest copy encoded
+    static const size_t minCopy = 4;
+
+    /**
+     * @param id the (non-zero) identifier the values encoded with the
+     *           dictionary refer to it with
+     * @param data the content of the dictionary
+     */
+    ValueDictionary(uint32_t id, std::string data);
+
+    /**
+     * Build the content of a dictionary from sample values: the quoted
+     * strings (such as JSON field names) repeated the most across the
+     * samples, weighted by their length, the most common last (i.e. closest
+     * to the values).
+     *
+     * @return the content, empty if the samples have nothing in common
+     */
+    static std::string train(const std::vector<std::string>& samples);
+
+    uint32_t getId() const {
+        return id;
+    }
+
+    const std::string& getData() const {
+        return data;
+    }
+
+    /**
+     * Encode a value with the dictionary
+     *
+     * @param value the value
+     * @param out set to the encoding
+     * @return false if the encoding isn't smaller than the value
+     */
+    bool encode(cb::const_char_buffer value, std::string& out) const;
+
+    /**
+     * Decode a value encoded with the dictionary
+     *
+     * @param encoded the encoding
+     * @param out set to the value
+     * @return false if the encoding is corrupt
+     */
+    bool decode(cb::const_char_buffer encoded, std::string& out) const;
+
+private:
+    static const size_t hashBits = 12;
+
+    static size_t hash(const char* p);
+
+    const uint32_t id;
+    const std::string data;
+
+    /// Per hash of minCopy bytes, the last position of them in data (or -1)
+    std::vector<int32_t> index;
+};
@@ -31,6 +31,7 @@ void VBucketCountVisitor::visitBucket(VBucketPtr& vb) {
 
     if (desired_state != vbucket_state_dead) {
         htMemory += vb->ht.memorySize();
+        htHugePageBytes += vb->ht.getHugePageBytes();
         htItemMemory += vb->ht.getItemMemory();
         htCacheSize += vb->ht.cacheSize;
         numEjects += vb->ht.getNumEjects();
@@ -40,6 +40,7 @@ public:
           nonResident(0),
           numVbucket(0),
           htMemory(0),
+          htHugePageBytes(0),
           htItemMemory(0),
           htCacheSize(0),
           numEjects(0),
@@ -113,6 +114,10 @@ public:
         return htMemory;
     }
 
+    size_t getHashtableHugePageBytes() {
+        return htHugePageBytes;
+    }
+
     size_t getItemMemory() {
         return htItemMemory;
     }
@@ -189,6 +194,7 @@ private:
     size_t nonResident;
     size_t numVbucket;
     size_t htMemory;
+    size_t htHugePageBytes;
     size_t htItemMemory;
     size_t htCacheSize;
     size_t numEjects;
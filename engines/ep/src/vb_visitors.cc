@@ -19,6 +19,87 @@
 
 #include "vbucket.h"
 
+#include <algorithm>
+
+constexpr std::chrono::microseconds VisitorBudget::unlimited;
+
+void VisitorBudget::startRun(std::chrono::microseconds runBudget) {
+    budget = runBudget;
+    start = ProcessClock::now();
+    deadline = isLimited() ? start + budget : ProcessClock::time_point::max();
+    progressTracker.setDeadline(deadline);
+    visited = 0;
+    spent = false;
+}
+
+bool VisitorBudget::visitItem() {
+    if (!spent && !progressTracker.shouldContinueVisiting(++visited)) {
+        spent = true;
+    }
+    return !spent;
+}
+
+bool VisitorBudget::isSpent() {
+    if (!spent && isLimited()) {
+        spent = ProcessClock::now() >= deadline;
+    }
+    return spent;
+}
+
+std::chrono::microseconds VisitorBudget::endRun() {
+    if (!isLimited()) {
+        return std::chrono::microseconds(0);
+    }
+    const auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+            ProcessClock::now() - start);
+    return std::max(took - budget, std::chrono::microseconds(0));
+}
+
+namespace {
+/// Counts the items the wrapped visitor visits against the budget
+class BudgetedVisitor : public HashTableVisitor {
+public:
+    BudgetedVisitor(HashTableVisitor& visitor, VisitorBudget& budget)
+        : visitor(visitor), budget(budget) {
+    }
+
+    bool visit(const HashTable::HashBucketLock& lh, StoredValue& v) override {
+        const bool more = visitor.visit(lh, v);
+        return budget.visitItem() && more;
+    }
+
+private:
+    HashTableVisitor& visitor;
+    VisitorBudget& budget;
+};
+} // anonymous namespace
+
+HashTable::Position visitWithinBudget(HashTable& ht,
+                                      HashTableVisitor& visitor,
+                                      VisitorBudget& budget,
+                                      HashTable::Position start) {
+    if (budget.isSpent()) {
+        return start;
+    }
+    BudgetedVisitor budgeted(visitor, budget);
+    return ht.pauseResumeVisit(budgeted, start);
+}
+
+bool VBucketVisitor::visitHashTable(VBucket& vb, HashTableVisitor& visitor) {
+    if (positionVb != vb.getId()) {
+        htPosition = HashTable::Position();
+        positionVb = vb.getId();
+    }
+    htPosition = visitWithinBudget(vb.ht, visitor, budget, htPosition);
+
+    const bool done = (htPosition == vb.ht.endPosition());
+    if (done) {
+        htPosition = HashTable::Position();
+    }
+    bucketPaused = !done && budget.isSpent();
+    return done;
+}
+
 PauseResumeVBAdapter::PauseResumeVBAdapter(
         std::unique_ptr<VBucketAwareHTVisitor> htVisitor)
     : htVisitor(std::move(htVisitor)) {
@@ -33,7 +114,7 @@ bool PauseResumeVBAdapter::visit(VBucket& vb) {
     }
 
     htVisitor->setCurrentVBucket(vb);
-    hashtable_position = vb.ht.pauseResumeVisit(*htVisitor, ht_start);
+    hashtable_position = visitWithinBudget(vb.ht, *htVisitor, budget, ht_start);
 
     if (hashtable_position != vb.ht.endPosition()) {
         // We didn't get to the end of this VBucket. Record the vbucket_id
@@ -20,13 +20,81 @@
 #include "config.h"
 
 #include "hash_table.h"
+#include "progress_tracker.h"
 #include "vb_filter.h"
 
+#include <chrono>
+
 class HashTableVisitor;
 class VBucket;
 
 using VBucketPtr = std::shared_ptr<VBucket>;
 
+/**
+ * The time budget of one run of a task visiting items: once spent, the
+ * visit stops where it is so that the task gives its thread back to the
+ * TaskQueue, and resumes from there on its next run.
+ *
+ * Uses a ProgressTracker, so the clock is only read every so often
+ * rather than for every visited item.
+ */
+class VisitorBudget {
+public:
+    /// The budget which is never spent
+    static constexpr std::chrono::microseconds unlimited =
+            std::chrono::microseconds::max();
+
+    /// Start a run which may take up to the given time.
+    void startRun(std::chrono::microseconds runBudget);
+
+    /**
+     * Count an item visited by the run.
+     *
+     * @return false if the budget is spent, and the visit should pause
+     */
+    bool visitItem();
+
+    /// @return true if the budget of the run is spent (reads the clock)
+    bool isSpent();
+
+    /// @return true if the run has a budget to spend (isn't unlimited)
+    bool isLimited() const {
+        return budget != unlimited;
+    }
+
+    /**
+     * End the run.
+     *
+     * @return how long the run took past its budget (zero if it didn't)
+     */
+    std::chrono::microseconds endRun();
+
+    /// @return the number of items visited by the run
+    size_t getVisitedCount() const {
+        return visited;
+    }
+
+private:
+    ProgressTracker progressTracker;
+    std::chrono::microseconds budget = unlimited;
+    ProcessClock::time_point start;
+    ProcessClock::time_point deadline = ProcessClock::time_point::max();
+    size_t visited = 0;
+    bool spent = false;
+};
+
+/**
+ * Visit the HashTable from the given position until either the visitor
+ * stops or the budget of the run is spent (a spent budget visits nothing).
+ *
+ * @return the position to resume the visit from; HashTable::endPosition()
+ *         once all the items were visited
+ */
+HashTable::Position visitWithinBudget(HashTable& ht,
+                                      HashTableVisitor& visitor,
+                                      VisitorBudget& budget,
+                                      HashTable::Position start);
+
 /**
  * vbucket-aware hashtable visitor.
  */
@@ -63,8 +131,55 @@ public:
         return false;
     }
 
+    /**
+     * Set how long each run of the task visiting the vbuckets (see
+     * VBCBAdaptor) may take: once spent, the visit of the vbucket pauses
+     * (if using visitHashTable()) to be resumed by the next run.
+     * Unlimited by default, where each run visits one whole vbucket.
+     */
+    void setRunBudget(std::chrono::microseconds budget) {
+        runBudget = budget;
+    }
+
+    std::chrono::microseconds getRunBudget() const {
+        return runBudget;
+    }
+
+    /// The budget of the current run
+    VisitorBudget& getBudget() {
+        return budget;
+    }
+
+    /**
+     * @return true if the visit of the given vbucket paused as the budget
+     *         of the run was spent; visitBucket() is then called again for
+     *         it on the next run, to resume it
+     */
+    bool isBucketPaused(uint16_t vbid) const {
+        return bucketPaused && positionVb == vbid;
+    }
+
 protected:
+    /**
+     * Visit the HashTable of the vbucket within the budget of the run:
+     * from its start, or from where the previous call for it stopped if
+     * the visit paused (see isBucketPaused()) or the visitor stopped it.
+     *
+     * @return true if the visit got to the end of the HashTable
+     */
+    bool visitHashTable(VBucket& vb, HashTableVisitor& visitor);
+
     VBucketFilter vBucketFilter;
+
+private:
+    std::chrono::microseconds runBudget = VisitorBudget::unlimited;
+    VisitorBudget budget;
+
+    // Where the last visitHashTable() stopped before the end, in which
+    // vbucket, and whether it was because the budget was spent
+    HashTable::Position htPosition;
+    uint16_t positionVb = 0;
+    bool bucketPaused = false;
 };
 
 /**
@@ -116,8 +231,8 @@ public:
 
     /**
      * Visit a VBucket within an epStore. Records the place where the visit
-     * stops (when the wrapped htVisitor returns false), for later resuming
-     * from *approximately* the same place.
+     * stops (when the budget is spent, or the wrapped htVisitor returns
+     * false), for later resuming from *approximately* the same place.
      */
     bool visit(VBucket& vb) override;
 
@@ -131,10 +246,18 @@ public:
         return *htVisitor;
     }
 
+    /// The budget of the current run (unlimited unless started).
+    VisitorBudget& getBudget() {
+        return budget;
+    }
+
 private:
     // The HashTable visitor to apply to each VBucket's HashTable.
     std::unique_ptr<VBucketAwareHTVisitor> htVisitor;
 
+    // The visit pauses once the budget of the run is spent.
+    VisitorBudget budget;
+
     // When resuming, which vbucket should we start from?
     uint16_t resume_vbucket_id = 0;
 
@@ -20,6 +20,7 @@
 #include "atomic.h"
 #include "bgfetcher.h"
 #include "checkpoint.h"
+#include "checksum.h"
 #include "conflict_resolution.h"
 #include "ep_engine.h"
 #include "ep_time.h"
@@ -31,10 +32,16 @@
 #include "stored_value_factories.h"
 #include "vbucket.h"
 #include "vbucketdeletiontask.h"
+#include "vbucketmap.h"
 
+#include <memcached/util.h>
 #include <xattr/blob.h>
 #include <xattr/utils.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <functional>
 #include <list>
 #include <set>
@@ -151,7 +158,13 @@ VBucket::VBucket(id_type i,
                  int64_t hlcEpochSeqno,
                  bool mightContainXattrs,
                  const std::string& collectionsManifest)
-    : ht(st, std::move(valFact), config.getHtSize(), config.getHtLocks()),
+    : ht(st,
+         std::move(valFact),
+         config.getHtSize(),
+         config.getHtLocks(),
+         HashTable::parseBucketLayout(config.getHtBucketLayout()),
+         config.getHtMaxLocks(),
+         config.isHtHugepages()),
       checkpointManager(std::make_unique<CheckpointManager>(st,
                                                             i,
                                                             chkConfig,
@@ -170,6 +183,7 @@ VBucket::VBucket(id_type i,
       dirtyQueueDrain(0),
       dirtyQueueAge(0),
       dirtyQueuePendingWrites(0),
+      persistenceLatencyHisto(ExponentialGenerator<hrtime_t>(1, 2), 30),
       metaDataDisk(0),
       numExpiredItems(0),
       eviction(evictionPolicy),
@@ -179,6 +193,7 @@ VBucket::VBucket(id_type i,
       id(i),
       state(newState),
       initialState(initState),
+      seqnoSlot(nullptr),
       purge_seqno(purgeSeqno),
       takeover_backed_up(false),
       persisted_snapshot_start(lastSnapStart),
@@ -196,12 +211,22 @@ VBucket::VBucket(id_type i,
       newSeqnoCb(std::move(newSeqnoCb)),
       manifest(collectionsManifest),
       mayContainXattrs(mightContainXattrs) {
+    hlc.setCoarseClock(config.getHlcClock() == "coarse");
+
     if (config.getConflictResolutionType().compare("lww") == 0) {
         conflictResolver.reset(new LastWriteWinsResolution());
     } else {
         conflictResolver.reset(new RevisionSeqnoResolution());
     }
 
+    if (config.getPagerEvictionAlgorithm() == "lfu") {
+        ht.enableFrequencyTracking();
+    }
+
+    if (config.isExpPagerTtlIndex()) {
+        ht.enableExpiryIndex();
+    }
+
     backfill.isBackfillPhase = false;
     pendingOpsStart = 0;
     stats.memOverhead->fetch_add(sizeof(VBucket)
@@ -333,6 +358,18 @@ void VBucket::setState_UNLOCKED(vbucket_state_t to,
         VBucket::toString(to));
 
     state = to;
+    if (seqnoSlot) {
+        seqnoSlot->state.store(uint8_t(to));
+    }
+}
+
+void VBucket::setSeqnoSlot(VBucketSeqnoSlot* slot) {
+    WriterLockHolder wlh(stateLock);
+    seqnoSlot = slot;
+    if (slot) {
+        slot->state.store(uint8_t(state.load()));
+    }
+    checkpointManager->setSeqnoSlot(slot);
 }
 
 vbucket_state VBucket::getVBucketState() const {
@@ -391,6 +428,8 @@ void VBucket::resetStats() {
     dirtyQueueAge.store(0);
     dirtyQueuePendingWrites.store(0);
     dirtyQueueDrain.store(0);
+    persistenceLatencyHisto.reset();
+    opStats.reset();
 
     hlc.resetStats();
 }
@@ -415,7 +454,7 @@ void VBucket::addStat(const char *nm, const T &val, ADD_STAT add_stat,
     }
 }
 
-void VBucket::handlePreExpiry(const std::unique_lock<std::mutex>& hbl,
+void VBucket::handlePreExpiry(const std::unique_lock<SharedMutex>& hbl,
                               StoredValue& v) {
     value_t value = v.getValue();
     if (value) {
@@ -516,7 +555,9 @@ bool VBucket::isResidentRatioUnderThreshold(float threshold) {
     }
 }
 
-void VBucket::createFilter(size_t key_count, double probability) {
+void VBucket::createFilter(size_t key_count,
+                           double probability,
+                           BloomFilter::Layout layout) {
     // Create the actual bloom filter upon vbucket creation during
     // scenarios:
     //      - Bucket creation
@@ -524,20 +565,22 @@ void VBucket::createFilter(size_t key_count, double probability) {
     LockHolder lh(bfMutex);
     if (bFilter == nullptr && tempFilter == nullptr) {
         bFilter = std::make_unique<BloomFilter>(key_count, probability,
-                                        BFILTER_ENABLED);
+                                        BFILTER_ENABLED, layout);
     } else {
         LOG(EXTENSION_LOG_WARNING, "(vb %" PRIu16 ") Bloom filter / Temp filter"
             " already exist!", id);
     }
 }
 
-void VBucket::initTempFilter(size_t key_count, double probability) {
+void VBucket::initTempFilter(size_t key_count,
+                             double probability,
+                             BloomFilter::Layout layout) {
     // Create a temp bloom filter with status as COMPACTING,
     // if the main filter is found to exist, set its state to
     // COMPACTING as well.
     LockHolder lh(bfMutex);
     tempFilter = std::make_unique<BloomFilter>(key_count, probability,
-                                     BFILTER_COMPACTING);
+                                     BFILTER_COMPACTING, layout);
     if (bFilter) {
         bFilter->setStatus(BFILTER_COMPACTING);
     }
@@ -659,6 +702,163 @@ size_t VBucket::getNumOfKeysInFilter() {
     }
 }
 
+StoredValue* VBucket::relocateStoredValue(const HashTable::HashBucketLock& lh,
+                                          StoredValue& v) {
+    // Nothing outside the hash table refers to the StoredValues
+    return ht.unlocked_relocate(lh, v).first;
+}
+
+namespace {
+/// Adds the keys of the hash table to a bloom filter
+class FilterKeysVisitor : public HashTableVisitor {
+public:
+    FilterKeysVisitor(BloomFilter& filter) : filter(filter) {
+    }
+
+    bool visit(const HashTable::HashBucketLock& lh, StoredValue& v) override {
+        filter.addKey(v.getKey());
+        return true;
+    }
+
+private:
+    BloomFilter& filter;
+};
+
+/// The header of a saved bloom filter file (followed by the filter)
+struct SavedFilterHeader {
+    uint64_t uuid;
+    uint64_t seqno;
+    /// computeChecksum() of the filter
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+std::string getFilterFileName(const std::string& dbname, uint16_t vbid) {
+    return dbname + "/" + std::to_string(vbid) + ".bloomfilter";
+}
+} // anonymous namespace
+
+bool VBucket::saveFilter(const std::string& dbname) {
+    // Read the seqno before the keys of the hash table; any item we miss
+    // (as it was created after we visited its hash bucket) is persisted
+    // with a higher seqno, which makes the file fail the check in
+    // loadFilter().
+    SavedFilterHeader header;
+    header.uuid = failovers ? failovers->getLatestUUID() : 0;
+    header.seqno = getPersistenceSeqno();
+
+    std::unique_ptr<BloomFilter> snapshot;
+    {
+        LockHolder lh(bfMutex);
+        if (!bFilter || bFilter->getStatus() != BFILTER_ENABLED) {
+            return false;
+        }
+        snapshot = std::make_unique<BloomFilter>(*bFilter);
+    }
+
+    FilterKeysVisitor visitor(*snapshot);
+    ht.visit(visitor);
+
+    {
+        // Pick up the keys evicted while we visited the hash table
+        LockHolder lh(bfMutex);
+        if (!bFilter || !snapshot->merge(*bFilter)) {
+            return false;
+        }
+    }
+
+    const std::string data = snapshot->serialize();
+    header.checksum = computeChecksum(
+            reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    header.reserved = 0;
+    const std::string fname = getFilterFileName(dbname, id);
+    const std::string next_fname = fname + ".new";
+    FILE* fp = fopen(next_fname.c_str(), "wb");
+    if (fp == nullptr) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Failed to create \"%s\": %s",
+            id,
+            next_fname.c_str(),
+            strerror(errno));
+        return false;
+    }
+
+    bool rv = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(data.data(), data.size(), 1, fp) == 1;
+    if (fclose(fp) != 0) {
+        rv = false;
+    }
+    if (!rv || rename(next_fname.c_str(), fname.c_str()) != 0) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Failed to write the bloom filter to \"%s\": %s",
+            id,
+            fname.c_str(),
+            strerror(errno));
+        remove(next_fname.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool VBucket::loadFilter(const std::string& dbname, uint64_t highSeqno) {
+    const std::string fname = getFilterFileName(dbname, id);
+    FILE* fp = fopen(fname.c_str(), "rb");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    SavedFilterHeader header;
+    std::string data;
+    bool rv = fread(&header, sizeof(header), 1, fp) == 1;
+    char buffer[8192];
+    size_t nr;
+    while (rv && (nr = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        data.append(buffer, nr);
+    }
+    rv = rv && !ferror(fp);
+    fclose(fp);
+
+    const uint64_t uuid = failovers ? failovers->getLatestUUID() : 0;
+    if (!rv || header.uuid != uuid || header.seqno != highSeqno) {
+        // Items were persisted after the filter was written (or it belongs
+        // to an older incarnation of the vbucket), so it could be missing
+        // some of the keys on disk.
+        LOG(EXTENSION_LOG_NOTICE,
+            "(vb %" PRIu16 ") Ignoring stale bloom filter \"%s\"",
+            id,
+            fname.c_str());
+        return false;
+    }
+
+    if (computeChecksum(reinterpret_cast<const uint8_t*>(data.data()),
+                        data.size()) != header.checksum) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Ignoring corrupt bloom filter \"%s\"",
+            id,
+            fname.c_str());
+        return false;
+    }
+
+    std::unique_ptr<BloomFilter> filter;
+    try {
+        filter = BloomFilter::deserialize(data, BFILTER_ENABLED);
+    } catch (const std::invalid_argument& e) {
+        LOG(EXTENSION_LOG_WARNING,
+            "(vb %" PRIu16 ") Ignoring invalid bloom filter \"%s\": %s",
+            id,
+            fname.c_str(),
+            e.what());
+        return false;
+    }
+
+    LockHolder lh(bfMutex);
+    if (bFilter || tempFilter) {
+        return false;
+    }
+    bFilter = std::move(filter);
+    return true;
+}
+
 VBNotifyCtx VBucket::queueDirty(
         StoredValue& v,
         const GenerateBySeqno generateBySeqno,
@@ -889,6 +1089,199 @@ ENGINE_ERROR_CODE VBucket::set(Item& itm,
     return ret;
 }
 
+ENGINE_ERROR_CODE VBucket::arithmetic(const DocKey& key,
+                                      bool increment,
+                                      uint64_t delta,
+                                      uint64_t cas,
+                                      const void* cookie,
+                                      EventuallyPersistentEngine& engine,
+                                      uint64_t& result,
+                                      uint64_t& newCas,
+                                      mutation_descr_t& mutInfo) {
+    auto hbl = ht.getLockedBucket(key);
+    StoredValue* v = ht.unlocked_find(key,
+                                      hbl.getBucketNum(),
+                                      WantsDeleted::No,
+                                      TrackReference::Yes);
+
+    // Anything but a plain counter in memory is left to the get and store
+    // of the frontend (which creates missing counters, preserves the
+    // XATTRs and fetches evicted values)
+    if (v == nullptr || v->isTempItem() || !v->isResident() ||
+        v->isExpired(ep_real_time()) || v->isLocked(ep_current_time()) ||
+        mcbp::datatype::is_xattr(v->getDatatype()) ||
+        mcbp::datatype::is_snappy(v->getDatatype())) {
+        return ENGINE_ENOTSUP;
+    }
+
+    if (cas != 0 && cas != v->getCas()) {
+        return ENGINE_KEY_EEXISTS;
+    }
+
+    const std::string payload(v->getValue()->getData(), v->valuelen());
+    uint64_t value;
+    if (!safe_strtoull(payload.c_str(), &value)) {
+        return ENGINE_DELTA_BADVAL;
+    }
+
+    if (increment) {
+        value += delta;
+    } else {
+        value = (value < delta) ? 0 : value - delta;
+    }
+    const std::string newValue = std::to_string(value);
+
+    // The new value goes in a new Item (rather than being written over
+    // the old one) as the checkpoints may share the Blob of the old one
+    Item itm(key,
+             v->getFlags(),
+             v->getExptime(),
+             newValue.data(),
+             newValue.size(),
+             PROTOCOL_BINARY_RAW_BYTES,
+             v->getCas(),
+             -1,
+             getId());
+
+    PreLinkDocumentContext preLinkDocumentContext(engine, cookie, &itm);
+    VBQueueItemCtx queueItmCtx(GenerateBySeqno::Yes,
+                               GenerateCas::Yes,
+                               TrackCasDrift::No,
+                               /*isBackfillItem*/ false,
+                               &preLinkDocumentContext);
+
+    MutationStatus status;
+    boost::optional<VBNotifyCtx> notifyCtx;
+    std::tie(status, notifyCtx) = processSet(hbl,
+                                             v,
+                                             itm,
+                                             itm.getCas(),
+                                             /*allowExisting*/ true,
+                                             /*hashMetaData*/ false,
+                                             queueItmCtx,
+                                             cb::StoreIfStatus::Continue,
+                                             /*maybeKeyExists*/ true);
+
+    switch (status) {
+    case MutationStatus::NoMem:
+        return ENGINE_ENOMEM;
+    case MutationStatus::InvalidCas:
+        return ENGINE_KEY_EEXISTS;
+    case MutationStatus::IsLocked:
+        return ENGINE_LOCKED;
+    case MutationStatus::NotFound:
+    case MutationStatus::NeedBgFetch:
+        // Can't happen as we checked the item is resident (under the same
+        // lock), but let the frontend handle it if it does
+        return ENGINE_ENOTSUP;
+    case MutationStatus::WasDirty:
+    case MutationStatus::WasClean:
+        break;
+    }
+
+    notifyNewSeqno(*notifyCtx);
+    result = value;
+    newCas = v->getCas();
+    mutInfo.seqno = v->getBySeqno();
+    mutInfo.vbucket_uuid = failovers->getLatestUUID();
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE VBucket::appendPrepend(const DocKey& key,
+                                         bool append,
+                                         cb::const_char_buffer value,
+                                         uint64_t cas,
+                                         const void* cookie,
+                                         EventuallyPersistentEngine& engine,
+                                         uint64_t& newCas,
+                                         mutation_descr_t& mutInfo) {
+    auto hbl = ht.getLockedBucket(key);
+    StoredValue* v = ht.unlocked_find(key,
+                                      hbl.getBucketNum(),
+                                      WantsDeleted::No,
+                                      TrackReference::Yes);
+
+    // Same as for arithmetic: anything but a plain document in memory is
+    // left to the get and store of the frontend
+    if (v == nullptr || v->isTempItem() || !v->isResident() ||
+        v->isExpired(ep_real_time()) || v->isLocked(ep_current_time()) ||
+        mcbp::datatype::is_xattr(v->getDatatype()) ||
+        mcbp::datatype::is_snappy(v->getDatatype())) {
+        return ENGINE_ENOTSUP;
+    }
+
+    if (cas != 0 && cas != v->getCas()) {
+        return ENGINE_KEY_EEXISTS;
+    }
+
+    const size_t oldSize = v->valuelen();
+    if (oldSize + value.len > engine.getConfiguration().getMaxItemSize()) {
+        return ENGINE_E2BIG;
+    }
+
+    // Build the new value straight from the old one (the only copy of it
+    // the operation makes). It can't be grown in place as the checkpoints
+    // share the Blob of the old value.
+    value_t blob(Blob::New(oldSize + value.len));
+    char* data = const_cast<char*>(blob->getData());
+    char* oldPart = append ? data : data + value.len;
+    char* newPart = append ? data + oldSize : data;
+    if (oldSize != 0) {
+        std::memcpy(oldPart, v->getValue()->getData(), oldSize);
+    }
+    std::memcpy(newPart, value.buf, value.len);
+
+    // Like the frontend does, the new revision is raw bytes without expiry
+    Item itm(key,
+             v->getFlags(),
+             0,
+             blob,
+             PROTOCOL_BINARY_RAW_BYTES,
+             v->getCas(),
+             -1,
+             getId());
+
+    PreLinkDocumentContext preLinkDocumentContext(engine, cookie, &itm);
+    VBQueueItemCtx queueItmCtx(GenerateBySeqno::Yes,
+                               GenerateCas::Yes,
+                               TrackCasDrift::No,
+                               /*isBackfillItem*/ false,
+                               &preLinkDocumentContext);
+
+    MutationStatus status;
+    boost::optional<VBNotifyCtx> notifyCtx;
+    std::tie(status, notifyCtx) = processSet(hbl,
+                                             v,
+                                             itm,
+                                             itm.getCas(),
+                                             /*allowExisting*/ true,
+                                             /*hashMetaData*/ false,
+                                             queueItmCtx,
+                                             cb::StoreIfStatus::Continue,
+                                             /*maybeKeyExists*/ true);
+
+    switch (status) {
+    case MutationStatus::NoMem:
+        return ENGINE_ENOMEM;
+    case MutationStatus::InvalidCas:
+        return ENGINE_KEY_EEXISTS;
+    case MutationStatus::IsLocked:
+        return ENGINE_LOCKED;
+    case MutationStatus::NotFound:
+    case MutationStatus::NeedBgFetch:
+        return ENGINE_ENOTSUP;
+    case MutationStatus::WasDirty:
+    case MutationStatus::WasClean:
+        break;
+    }
+
+    notifyNewSeqno(*notifyCtx);
+    newCas = v->getCas();
+    mutInfo.seqno = v->getBySeqno();
+    mutInfo.vbucket_uuid = failovers->getLatestUUID();
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE VBucket::replace(Item& itm,
                                    const void* cookie,
                                    EventuallyPersistentEngine& engine,
@@ -1053,7 +1446,8 @@ ENGINE_ERROR_CODE VBucket::setWithMeta(Item& itm,
                                        bool allowExisting,
                                        GenerateBySeqno genBySeqno,
                                        GenerateCas genCas,
-                                       bool isReplication) {
+                                       bool isReplication,
+                                       VBNotifyCtx* deferredNotify) {
     auto hbl = ht.getLockedBucket(itm.getKey());
     StoredValue* v = ht.unlocked_find(itm.getKey(),
                                       hbl.getBucketNum(),
@@ -1140,7 +1534,15 @@ ENGINE_ERROR_CODE VBucket::setWithMeta(Item& itm,
         // we unlock ht lock here because we want to avoid potential lock
         // inversions arising from notifyNewSeqno() call
         hbl.getHTLock().unlock();
-        notifyNewSeqno(*notifyCtx);
+        if (deferredNotify) {
+            if (notifyCtx->bySeqno > deferredNotify->bySeqno) {
+                deferredNotify->bySeqno = notifyCtx->bySeqno;
+            }
+            deferredNotify->notifyReplication |= notifyCtx->notifyReplication;
+            deferredNotify->notifyFlusher |= notifyCtx->notifyFlusher;
+        } else {
+            notifyNewSeqno(*notifyCtx);
+        }
     } break;
     case MutationStatus::NotFound:
         ret = ENGINE_KEY_ENOENT;
@@ -1165,6 +1567,50 @@ ENGINE_ERROR_CODE VBucket::setWithMeta(Item& itm,
     return ret;
 }
 
+std::pair<size_t, ENGINE_ERROR_CODE> VBucket::setWithMetaBatch(
+        const std::vector<Item*>& items,
+        const void* cookie,
+        EventuallyPersistentEngine& engine,
+        int bgFetchDelay) {
+    VBNotifyCtx notifyCtx;
+    size_t numSet = 0;
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    {
+        auto collectionsRHandle = lockCollections();
+        for (auto* itm : items) {
+            if (!Item::isValidCas(itm->getCas())) {
+                ret = ENGINE_KEY_EEXISTS;
+            } else if (!collectionsRHandle.doesKeyContainValidCollection(
+                               itm->getKey())) {
+                ret = ENGINE_UNKNOWN_COLLECTION;
+            } else {
+                ret = setWithMeta(*itm,
+                                  0,
+                                  nullptr,
+                                  cookie,
+                                  engine,
+                                  bgFetchDelay,
+                                  CheckConflicts::No,
+                                  /*allowExisting*/ true,
+                                  GenerateBySeqno::No,
+                                  GenerateCas::No,
+                                  /*isReplication*/ true,
+                                  &notifyCtx);
+            }
+            if (ret != ENGINE_SUCCESS) {
+                break;
+            }
+            collectionsRHandle.countSet(itm->getKey());
+            ++numSet;
+        }
+    }
+
+    if (numSet > 0) {
+        notifyNewSeqno(notifyCtx);
+    }
+    return {numSet, ret};
+}
+
 ENGINE_ERROR_CODE VBucket::deleteItem(const DocKey& key,
                                       uint64_t& cas,
                                       const void* cookie,
@@ -1569,6 +2015,13 @@ std::pair<MutationStatus, GetValue> VBucket::processGetAndUpdateTtl(
             return {MutationStatus::NotFound, GetValue()};
         }
 
+        // The whole document is fetched even for a TOUCH (which doesn't
+        // return the value): the new expiry is persisted by writing the
+        // document again, as neither couchstore (which appends the body
+        // with the new metadata) nor RocksDB (which keeps a copy of the
+        // document in the seqno Column Family) can update the metadata of
+        // a stored document on its own. Queueing the document without its
+        // value would lose the value on the next flush.
         if (!v->isResident()) {
             return {MutationStatus::NeedBgFetch, GetValue()};
         }
@@ -1581,9 +2034,11 @@ std::pair<MutationStatus, GetValue> VBucket::processGetAndUpdateTtl(
         const bool exptime_mutated = exptime != v->getExptime();
         auto bySeqNo = v->getBySeqno();
         if (exptime_mutated) {
+            const time_t oldExptime = v->getExptime();
             v->markDirty();
             v->setExptime(exptime);
             v->setRevSeqno(v->getRevSeqno() + 1);
+            ht.noteExpiryChange(*v, oldExptime);
         }
 
         GetValue rv(v->toItem(v->isLocked(ep_current_time()), getId()),
@@ -1651,6 +2106,36 @@ GetValue VBucket::getAndUpdateTtl(const DocKey& key,
     return gv;
 }
 
+bool VBucket::isReadableShared(const StoredValue& v,
+                               TrackReference trackReference) {
+    if (v.isTempItem() || v.isDeleted() || v.isExpired(ep_real_time())) {
+        return false;
+    }
+    // Once the item is referenced as often as the NRU (and frequency
+    // counter) tracks, the read doesn't change it
+    return trackReference == TrackReference::No ||
+           ht.trackSharedReference(v);
+}
+
+GetValue VBucket::getInternalResident(const StoredValue& v,
+                                      get_options_t options,
+                                      GetKeyOnly getKeyOnly) {
+    // Should we hide (return -1) for the items' CAS?
+    const bool hideCas =
+            (options & HIDE_LOCKED_CAS) && v.isLocked(ep_current_time());
+    std::unique_ptr<Item> item;
+    if (getKeyOnly == GetKeyOnly::Yes) {
+        item = v.toItemKeyOnly(getId());
+    } else {
+        item = v.toItem(hideCas, getId());
+    }
+    return GetValue(std::move(item),
+                    ENGINE_SUCCESS,
+                    v.getBySeqno(),
+                    !v.isResident(),
+                    v.getNRUValue());
+}
+
 GetValue VBucket::getInternal(const DocKey& key,
                               const void* cookie,
                               EventuallyPersistentEngine& engine,
@@ -1664,6 +2149,34 @@ GetValue VBucket::getInternal(const DocKey& key,
     const bool metadataOnly = (options & ALLOW_META_ONLY);
     const bool getDeletedValue = (options & GET_DELETED_VALUE);
     const bool bgFetchRequired = (options & QUEUE_BG_FETCH);
+
+    // Most gets find a live (or no) item which we only need to copy out,
+    // and may do so with shared access to the hash bucket. Everything else
+    // (expiring the item, temp items and background fetches, or recording
+    // the reference in the NRU) needs the exclusive lock.
+    {
+        auto shbl = ht.getSharedLockedBucket(key);
+        if (shbl) {
+            const StoredValue* v = ht.unlocked_find(key,
+                                                    shbl.getBucketNum(),
+                                                    WantsDeleted::Yes,
+                                                    TrackReference::No);
+            if (v == nullptr) {
+                if (!getDeletedValue &&
+                    (eviction == VALUE_ONLY || diskFlushAll)) {
+                    return GetValue();
+                }
+            } else if (v->isDeleted()) {
+                if (!getDeletedValue) {
+                    return GetValue();
+                }
+            } else if ((v->isResident() || metadataOnly) &&
+                       isReadableShared(*v, trackReference)) {
+                return getInternalResident(*v, options, getKeyOnly);
+            }
+        }
+    }
+
     auto hbl = ht.getLockedBucket(key);
     StoredValue* v = fetchValidValue(
             hbl, key, WantsDeleted::Yes, trackReference, QueueExpired::Yes);
@@ -1705,20 +2218,7 @@ GetValue VBucket::getInternal(const DocKey& key,
                     key, cookie, engine, bgFetchDelay, queueBgFetch, *v);
         }
 
-        // Should we hide (return -1) for the items' CAS?
-        const bool hideCas =
-                (options & HIDE_LOCKED_CAS) && v->isLocked(ep_current_time());
-        std::unique_ptr<Item> item;
-        if (getKeyOnly == GetKeyOnly::Yes) {
-            item = v->toItemKeyOnly(getId());
-        } else {
-            item = v->toItem(hideCas, getId());
-        }
-        return GetValue(std::move(item),
-                        ENGINE_SUCCESS,
-                        v->getBySeqno(),
-                        !v->isResident(),
-                        v->getNRUValue());
+        return getInternalResident(*v, options, getKeyOnly);
     } else {
         if (!getDeletedValue && (eviction == VALUE_ONLY || diskFlushAll)) {
             return GetValue();
@@ -1739,6 +2239,37 @@ GetValue VBucket::getInternal(const DocKey& key,
     }
 }
 
+ENGINE_ERROR_CODE VBucket::getMetaDataFromSV(const StoredValue& v,
+                                             ItemMetaData& metadata,
+                                             uint32_t& deleted,
+                                             uint8_t& datatype) {
+    if (v.isTempNonExistentItem()) {
+        metadata.cas = v.getCas();
+        return ENGINE_KEY_ENOENT;
+    }
+
+    if (v.isTempDeletedItem() || v.isDeleted() ||
+        v.isExpired(ep_real_time())) {
+        deleted |= GET_META_ITEM_DELETED_FLAG;
+    }
+
+    if (v.isLocked(ep_current_time())) {
+        metadata.cas = static_cast<uint64_t>(-1);
+    } else {
+        metadata.cas = v.getCas();
+    }
+    metadata.flags = v.getFlags();
+    metadata.exptime = v.getExptime();
+    metadata.revSeqno = v.getRevSeqno();
+    datatype = v.getDatatype();
+    if (v.isCompressedInMemory()) {
+        // Not how the document was stored (or is on disk)
+        datatype &= ~PROTOCOL_BINARY_DATATYPE_SNAPPY;
+    }
+
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE VBucket::getMetaData(const DocKey& key,
                                        const void* cookie,
                                        EventuallyPersistentEngine& engine,
@@ -1747,6 +2278,23 @@ ENGINE_ERROR_CODE VBucket::getMetaData(const DocKey& key,
                                        uint32_t& deleted,
                                        uint8_t& datatype) {
     deleted = 0;
+
+    // Reading the metadata of an item we have doesn't modify anything, so
+    // only a miss (which may add a temp item) needs the exclusive lock
+    {
+        auto shbl = ht.getSharedLockedBucket(key);
+        if (shbl) {
+            const StoredValue* v = ht.unlocked_find(key,
+                                                    shbl.getBucketNum(),
+                                                    WantsDeleted::Yes,
+                                                    TrackReference::No);
+            if (v && !v->isTempInitialItem()) {
+                stats.numOpsGetMeta++;
+                return getMetaDataFromSV(*v, metadata, deleted, datatype);
+            }
+        }
+    }
+
     auto hbl = ht.getLockedBucket(key);
     StoredValue* v = ht.unlocked_find(
             key, hbl.getBucketNum(), WantsDeleted::Yes, TrackReference::No);
@@ -1757,26 +2305,8 @@ ENGINE_ERROR_CODE VBucket::getMetaData(const DocKey& key,
             // Need bg meta fetch.
             bgFetch(key, cookie, engine, bgFetchDelay, true);
             return ENGINE_EWOULDBLOCK;
-        } else if (v->isTempNonExistentItem()) {
-            metadata.cas = v->getCas();
-            return ENGINE_KEY_ENOENT;
         } else {
-            if (v->isTempDeletedItem() || v->isDeleted() ||
-                v->isExpired(ep_real_time())) {
-                deleted |= GET_META_ITEM_DELETED_FLAG;
-            }
-
-            if (v->isLocked(ep_current_time())) {
-                metadata.cas = static_cast<uint64_t>(-1);
-            } else {
-                metadata.cas = v->getCas();
-            }
-            metadata.flags = v->getFlags();
-            metadata.exptime = v->getExptime();
-            metadata.revSeqno = v->getRevSeqno();
-            datatype = v->getDatatype();
-
-            return ENGINE_SUCCESS;
+            return getMetaDataFromSV(*v, metadata, deleted, datatype);
         }
     } else {
         // The key wasn't found. However, this may be because it was previously
@@ -1798,12 +2328,42 @@ ENGINE_ERROR_CODE VBucket::getMetaData(const DocKey& key,
     }
 }
 
+void VBucket::getKeyStatsFromSV(const StoredValue& v,
+                                struct key_stats& kstats) {
+    kstats.logically_deleted = v.isDeleted();
+    kstats.dirty = v.isDirty();
+    kstats.exptime = v.getExptime();
+    kstats.flags = v.getFlags();
+    kstats.cas = v.getCas();
+    kstats.vb_state = getState();
+    kstats.resident = v.isResident();
+}
+
 ENGINE_ERROR_CODE VBucket::getKeyStats(const DocKey& key,
                                        const void* cookie,
                                        EventuallyPersistentEngine& engine,
                                        int bgFetchDelay,
                                        struct key_stats& kstats,
                                        WantsDeleted wantsDeleted) {
+    // As with getInternal, a live item only needs shared access
+    {
+        auto shbl = ht.getSharedLockedBucket(key);
+        if (shbl) {
+            const StoredValue* v = ht.unlocked_find(key,
+                                                    shbl.getBucketNum(),
+                                                    WantsDeleted::Yes,
+                                                    TrackReference::No);
+            if (v == nullptr) {
+                if (eviction == VALUE_ONLY) {
+                    return ENGINE_KEY_ENOENT;
+                }
+            } else if (isReadableShared(*v, TrackReference::Yes)) {
+                getKeyStatsFromSV(*v, kstats);
+                return ENGINE_SUCCESS;
+            }
+        }
+    }
+
     auto hbl = ht.getLockedBucket(key);
     StoredValue* v = fetchValidValue(hbl,
                                      key,
@@ -1825,14 +2385,7 @@ ENGINE_ERROR_CODE VBucket::getKeyStats(const DocKey& key,
             bgFetch(key, cookie, engine, bgFetchDelay, true);
             return ENGINE_EWOULDBLOCK;
         }
-        kstats.logically_deleted = v->isDeleted();
-        kstats.dirty = v->isDirty();
-        kstats.exptime = v->getExptime();
-        kstats.flags = v->getFlags();
-        kstats.cas = v->getCas();
-        kstats.vb_state = getState();
-        kstats.resident = v->isResident();
-
+        getKeyStatsFromSV(*v, kstats);
         return ENGINE_SUCCESS;
     } else {
         if (eviction == VALUE_ONLY) {
@@ -2007,6 +2560,7 @@ void VBucket::_addStats(bool details, ADD_STAT add_stat, const void* c) {
         addStat("ht_item_memory", ht.getItemMemory(), add_stat, c);
         addStat("ht_cache_size", ht.cacheSize.load(), add_stat, c);
         addStat("ht_size", ht.getSize(), add_stat, c);
+        addStat("ht_hugepage_bytes", ht.getHugePageBytes(), add_stat, c);
         addStat("num_ejects", ht.getNumEjects(), add_stat, c);
         addStat("ops_create", opsCreate.load(), add_stat, c);
         addStat("ops_update", opsUpdate.load(), add_stat, c);
@@ -2019,6 +2573,8 @@ void VBucket::_addStats(bool details, ADD_STAT add_stat, const void* c) {
         addStat("queue_drain", dirtyQueueDrain.load(), add_stat, c);
         addStat("queue_age", getQueueAge(), add_stat, c);
         addStat("pending_writes", dirtyQueuePendingWrites.load(), add_stat, c);
+        add_prefixed_stat(statPrefix, "persistence_latency",
+                          persistenceLatencyHisto, add_stat, c);
 
         addStat("high_seqno", getHighSeqno(), add_stat, c);
         addStat("uuid", failovers->getLatestUUID(), add_stat, c);
@@ -2459,12 +3015,26 @@ void VBucket::updateRevSeqNoOfNewStoredValue(StoredValue& v) {
     v.setRevSeqno(seqno);
 }
 
+/// Orders the min-heaps of high priority requests by the id waited for
+static bool laterHighPriorityVBEntry(const HighPriorityVBEntry& a,
+                                     const HighPriorityVBEntry& b) {
+    return a.id > b.id;
+}
+
 void VBucket::addHighPriorityVBEntry(uint64_t seqnoOrChkId,
                                      const void* cookie,
                                      HighPriorityVBNotify reqType) {
     std::unique_lock<std::mutex> lh(hpVBReqsMutex);
-    hpVBReqs.push_back(HighPriorityVBEntry(cookie, seqnoOrChkId, reqType));
-    numHpVBReqs.store(hpVBReqs.size());
+    HighPriorityVBEntry entry(cookie, seqnoOrChkId, reqType);
+    entry.serial = ++hpVBReqsSerial;
+
+    const auto index = getHighPriorityIndex(reqType);
+    auto& heap = hpVBReqs[index];
+    heap.push_back(entry);
+    std::push_heap(heap.begin(), heap.end(), laterHighPriorityVBEntry);
+    hpVBReqsByAge[index].push_back(entry);
+    hpVBReqsWaiting[cookie] = entry.serial;
+    numHpVBReqs.store(hpVBReqsWaiting.size());
 
     LOG(EXTENSION_LOG_NOTICE,
         "Added high priority async request %s "
@@ -2477,60 +3047,88 @@ void VBucket::addHighPriorityVBEntry(uint64_t seqnoOrChkId,
         cookie);
 }
 
+void VBucket::compactHighPriorityVBEntries(size_t index) {
+    auto& heap = hpVBReqs[index];
+    if (heap.size() <= 2 * hpVBReqsWaiting.size() + 16) {
+        return;
+    }
+    heap.erase(std::remove_if(heap.begin(),
+                              heap.end(),
+                              [this](const HighPriorityVBEntry& entry) {
+                                  return !isHighPriorityVBEntryWaiting(entry);
+                              }),
+               heap.end());
+    std::make_heap(heap.begin(), heap.end(), laterHighPriorityVBEntry);
+}
+
 std::map<const void*, ENGINE_ERROR_CODE> VBucket::getHighPriorityNotifications(
         EventuallyPersistentEngine& engine,
         uint64_t idNum,
         HighPriorityVBNotify notifyType) {
     std::unique_lock<std::mutex> lh(hpVBReqsMutex);
     std::map<const void*, ENGINE_ERROR_CODE> toNotify;
-
-    auto entry = hpVBReqs.begin();
-
-    while (entry != hpVBReqs.end()) {
-        if (notifyType != entry->reqType) {
-            ++entry;
+    const std::string logStr(to_string(notifyType));
+    const auto index = getHighPriorityIndex(notifyType);
+
+    // The requests satisfied by idNum are at the top of the heap
+    auto& heap = hpVBReqs[index];
+    while (!heap.empty() && heap.front().id <= idNum) {
+        std::pop_heap(heap.begin(), heap.end(), laterHighPriorityVBEntry);
+        const auto entry = heap.back();
+        heap.pop_back();
+        if (!isHighPriorityVBEntryWaiting(entry)) {
+            continue;
+        }
+        hpVBReqsWaiting.erase(entry.cookie);
+
+        hrtime_t wall_time(gethrtime() - entry.start);
+        toNotify[entry.cookie] = ENGINE_SUCCESS;
+        stats.chkPersistenceHisto.add(wall_time / 1000);
+        adjustCheckpointFlushTimeout(wall_time / 1000000000);
+        LOG(EXTENSION_LOG_NOTICE,
+            "Notified the completion of %s "
+            "for vbucket %" PRIu16 ", Check for: %" PRIu64
+            ", "
+            "Persisted upto: %" PRIu64 ", cookie %p",
+            logStr.c_str(),
+            getId(),
+            entry.id,
+            idNum,
+            entry.cookie);
+    }
+
+    // The requests which timed out are the oldest ones
+    auto& byAge = hpVBReqsByAge[index];
+    while (!byAge.empty()) {
+        const auto& entry = byAge.front();
+        if (!isHighPriorityVBEntryWaiting(entry)) {
+            byAge.pop_front();
             continue;
         }
 
-        std::string logStr(to_string(notifyType));
-
-        hrtime_t wall_time(gethrtime() - entry->start);
-        size_t spent = wall_time / 1000000000;
-        if (entry->id <= idNum) {
-            toNotify[entry->cookie] = ENGINE_SUCCESS;
-            stats.chkPersistenceHisto.add(wall_time / 1000);
-            adjustCheckpointFlushTimeout(wall_time / 1000000000);
-            LOG(EXTENSION_LOG_NOTICE,
-                "Notified the completion of %s "
-                "for vbucket %" PRIu16 ", Check for: %" PRIu64
-                ", "
-                "Persisted upto: %" PRIu64 ", cookie %p",
-                logStr.c_str(),
-                getId(),
-                entry->id,
-                idNum,
-                entry->cookie);
-            entry = hpVBReqs.erase(entry);
-        } else if (spent > getCheckpointFlushTimeout()) {
-            adjustCheckpointFlushTimeout(spent);
-            engine.storeEngineSpecific(entry->cookie, NULL);
-            toNotify[entry->cookie] = ENGINE_TMPFAIL;
-            LOG(EXTENSION_LOG_WARNING,
-                "Notified the timeout on %s "
-                "for vbucket %" PRIu16 ", Check for: %" PRIu64
-                ", "
-                "Persisted upto: %" PRIu64 ", cookie %p",
-                logStr.c_str(),
-                getId(),
-                entry->id,
-                idNum,
-                entry->cookie);
-            entry = hpVBReqs.erase(entry);
-        } else {
-            ++entry;
+        size_t spent = (gethrtime() - entry.start) / 1000000000;
+        if (spent <= getCheckpointFlushTimeout()) {
+            break;
         }
-    }
-    numHpVBReqs.store(hpVBReqs.size());
+        adjustCheckpointFlushTimeout(spent);
+        engine.storeEngineSpecific(entry.cookie, NULL);
+        toNotify[entry.cookie] = ENGINE_TMPFAIL;
+        LOG(EXTENSION_LOG_WARNING,
+            "Notified the timeout on %s "
+            "for vbucket %" PRIu16 ", Check for: %" PRIu64
+            ", "
+            "Persisted upto: %" PRIu64 ", cookie %p",
+            logStr.c_str(),
+            getId(),
+            entry.id,
+            idNum,
+            entry.cookie);
+        hpVBReqsWaiting.erase(entry.cookie);
+        byAge.pop_front();
+    }
+
+    compactHighPriorityVBEntries(index);
+    numHpVBReqs.store(hpVBReqsWaiting.size());
     return toNotify;
 }
 
@@ -2540,11 +3138,16 @@ std::map<const void*, ENGINE_ERROR_CODE> VBucket::tmpFailAndGetAllHpNotifies(
 
     LockHolder lh(hpVBReqsMutex);
 
-    for (auto& entry : hpVBReqs) {
-        toNotify[entry.cookie] = ENGINE_TMPFAIL;
-        engine.storeEngineSpecific(entry.cookie, NULL);
+    for (auto& entry : hpVBReqsWaiting) {
+        toNotify[entry.first] = ENGINE_TMPFAIL;
+        engine.storeEngineSpecific(entry.first, NULL);
+    }
+    hpVBReqsWaiting.clear();
+    for (size_t ii = 0; ii < hpVBReqs.size(); ++ii) {
+        hpVBReqs[ii].clear();
+        hpVBReqsByAge[ii].clear();
     }
-    hpVBReqs.clear();
+    numHpVBReqs.store(0);
 
     return toNotify;
 }
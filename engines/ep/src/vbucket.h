@@ -28,12 +28,17 @@
 #include "item_pager.h"
 #include "kvstore.h"
 #include "monotonic.h"
+#include "vbucket_op_stats.h"
 
 #include <memcached/engine.h>
 #include <platform/non_negative_counter.h>
 #include <relaxed_atomic.h>
+#include <array>
 #include <atomic>
+#include <deque>
 #include <queue>
+#include <unordered_map>
+#include <vector>
 
 class EPStats;
 class CheckpointManager;
@@ -45,6 +50,7 @@ class EventuallyPersistentEngine;
 class DCPBackfill;
 class RollbackResult;
 class VBucketBGFetchItem;
+struct VBucketSeqnoSlot;
 
 /**
  * The following will be used to identify
@@ -104,6 +110,9 @@ struct HighPriorityVBEntry {
 
     /* for stats (histogram) */
     hrtime_t start;
+
+    /* tells the request apart from later requests of the same cookie */
+    uint64_t serial = 0;
 };
 
 typedef std::unique_ptr<Callback<const uint16_t, const VBNotifyCtx&>>
@@ -207,6 +216,10 @@ public:
         hlc.setDriftBehindThreshold(threshold);
     }
 
+    void setHLCCoarseClock(bool value) {
+        hlc.setCoarseClock(value);
+    }
+
     /**
      * @returns a seqno, documents with a seqno >= the returned value have a HLC
      * generated CAS. Can return HlcCasSeqnoUninitialised if warmup has not
@@ -336,6 +349,12 @@ public:
      */
     void setState_UNLOCKED(vbucket_state_t to, WriterLockHolder& vbStateLock);
 
+    /**
+     * Publish the state and the seqnos of the vbucket to the given slot of
+     * the VBucketMap from now on, or stop if it is null.
+     */
+    void setSeqnoSlot(VBucketSeqnoSlot* slot);
+
     cb::RWLock& getStateLock() {return stateLock;}
 
     vbucket_state_t getInitialState(void) { return initialState; }
@@ -348,7 +367,7 @@ public:
      *
      * @param v the stored value
      */
-    void handlePreExpiry(const std::unique_lock<std::mutex>& hbl,
+    void handlePreExpiry(const std::unique_lock<SharedMutex>& hbl,
                          StoredValue& v);
 
     bool addPendingOp(const void *cookie);
@@ -495,8 +514,14 @@ public:
     /**
      * BloomFilter operations for vbucket
      */
-    void createFilter(size_t key_count, double probability);
-    void initTempFilter(size_t key_count, double probability);
+    void createFilter(
+            size_t key_count,
+            double probability,
+            BloomFilter::Layout layout = BloomFilter::Layout::Standard);
+    void initTempFilter(
+            size_t key_count,
+            double probability,
+            BloomFilter::Layout layout = BloomFilter::Layout::Standard);
     void addToFilter(const DocKey& key);
     virtual bool maybeKeyExistsInFilter(const DocKey& key);
     bool isTempFilterAvailable();
@@ -508,6 +533,26 @@ public:
     size_t getFilterSize();
     size_t getNumOfKeysInFilter();
 
+    /**
+     * Write the bloom filter to <dbname>/<vbid>.bloomfilter, so warmup may
+     * load it rather than starting without a filter. As the filter doesn't
+     * hold the keys which are resident, they are added to the saved copy.
+     * The file records the failover UUID and persisted seqno of the
+     * vbucket; it is only valid for the disk state with the same ones.
+     *
+     * @return true if the filter was written
+     */
+    bool saveFilter(const std::string& dbname);
+
+    /**
+     * Load the bloom filter written by saveFilter(), if it was written for
+     * the current failover UUID and the given (persisted) high seqno. The
+     * vbucket must not have a filter yet.
+     *
+     * @return true if the filter was loaded
+     */
+    bool loadFilter(const std::string& dbname, uint64_t highSeqno);
+
     uint64_t nextHLCCas() {
         return hlc.nextHLC();
     }
@@ -640,6 +685,10 @@ public:
 
     HashTable         ht;
 
+    /// Where the next sampled pass of the item pager over ht starts (see
+    /// pager_sampled_eviction). Only used by the (single) item pager.
+    HashTable::Position pagerPosition;
+
     /// Manager of this vBucket's checkpoints. unique_ptr for pimpl.
     std::unique_ptr<CheckpointManager> checkpointManager;
 
@@ -675,13 +724,17 @@ public:
      * @param key The key of the item
      * @param fetched_item The item which has been fetched.
      * @param startTime The time processing of the batch of items started.
+     * @param[out] completedItem set to the item a get would now return, if
+     *             the fetch restored a live, unlocked value (so that the
+     *             get waiting for the fetch can be completed in place)
      *
      * @return ENGINE_ERROR_CODE status notified to be to the front end
      */
     virtual ENGINE_ERROR_CODE completeBGFetchForSingleItem(
             const DocKey& key,
             const VBucketBGFetchItem& fetched_item,
-            const ProcessClock::time_point startTime) = 0;
+            const ProcessClock::time_point startTime,
+            std::unique_ptr<Item>& completedItem) = 0;
 
     /**
      * Retrieve an item from the disk for vkey stats
@@ -741,6 +794,61 @@ public:
                           int bgFetchDelay,
                           cb::StoreIfPredicate predicate);
 
+    /**
+     * Increment or decrement a counter in the vbucket, under a single
+     * hash bucket lock (see ENGINE_HANDLE_V1::arithmetic).
+     *
+     * @param key the key of the counter
+     * @param increment true to add delta, false to subtract it (stopping
+     *                  at 0)
+     * @param delta the value to add or subtract
+     * @param cas the cas the counter must have (or 0 for any)
+     * @param cookie the connection cookie
+     * @param engine Reference to ep engine
+     * @param result set to the new value of the counter on success
+     * @param newCas set to the new cas of the counter on success
+     * @param mutInfo set to the seqno and vbucket uuid on success
+     *
+     * @return ENGINE_ENOTSUP if the counter isn't a resident document
+     *         without XATTRs (which the frontend has to handle with get
+     *         and store), otherwise the status of the operation
+     */
+    ENGINE_ERROR_CODE arithmetic(const DocKey& key,
+                                 bool increment,
+                                 uint64_t delta,
+                                 uint64_t cas,
+                                 const void* cookie,
+                                 EventuallyPersistentEngine& engine,
+                                 uint64_t& result,
+                                 uint64_t& newCas,
+                                 mutation_descr_t& mutInfo);
+
+    /**
+     * Append or prepend data to a document in the vbucket, under a single
+     * hash bucket lock (see ENGINE_HANDLE_V1::append_prepend).
+     *
+     * @param key the key of the document
+     * @param append true to append the data, false to prepend it
+     * @param value the data to add
+     * @param cas the cas the document must have (or 0 for any)
+     * @param cookie the connection cookie
+     * @param engine Reference to ep engine
+     * @param newCas set to the new cas of the document on success
+     * @param mutInfo set to the seqno and vbucket uuid on success
+     *
+     * @return ENGINE_ENOTSUP if the document isn't a resident one without
+     *         XATTRs (which the frontend has to handle with get and store),
+     *         otherwise the status of the operation
+     */
+    ENGINE_ERROR_CODE appendPrepend(const DocKey& key,
+                                    bool append,
+                                    cb::const_char_buffer value,
+                                    uint64_t cas,
+                                    const void* cookie,
+                                    EventuallyPersistentEngine& engine,
+                                    uint64_t& newCas,
+                                    mutation_descr_t& mutInfo);
+
     /**
      * Replace (overwrite existing) an item in the vbucket.
      *
@@ -789,6 +897,9 @@ public:
      * @param genCas
      * @param isReplication set to true if we are to use replication
      *                      throttle threshold
+     * @param deferredNotify if set, the notification of the new seqno is
+     *                       merged into it (for the caller to notify once
+     *                       for several items) rather than made
      *
      * @return the result of the store operation
      */
@@ -802,7 +913,29 @@ public:
                                   bool allowExisting,
                                   GenerateBySeqno genBySeqno,
                                   GenerateCas genCas,
-                                  bool isReplication);
+                                  bool isReplication,
+                                  VBNotifyCtx* deferredNotify = nullptr);
+
+    /**
+     * Set a batch of replicated items (from DCP, in seqno order), as
+     * setWithMeta would one at a time (without conflict resolution, with
+     * the seqnos and CAS of the items), but checking their collections
+     * under one lock of the manifest and notifying the new seqnos once for
+     * all of them.
+     *
+     * @param items the items to set, stopping at the first which fails
+     * @param cookie the cookie representing the consumer
+     * @param engine Reference to ep engine
+     * @param bgFetchDelay
+     *
+     * @return the number of items set, and the result of the one which
+     *         failed (ENGINE_SUCCESS if none did)
+     */
+    std::pair<size_t, ENGINE_ERROR_CODE> setWithMetaBatch(
+            const std::vector<Item*>& items,
+            const void* cookie,
+            EventuallyPersistentEngine& engine,
+            int bgFetchDelay);
 
     /**
      * Delete an item in the vbucket
@@ -908,6 +1041,18 @@ public:
     virtual bool pageOut(const HashTable::HashBucketLock& lh,
                          StoredValue*& v) = 0;
 
+    /**
+     * Move the StoredValue to a new allocation, so the memory it was in may
+     * be reused (see DefragmentVisitor).
+     *
+     * @param lh Bucket lock associated with the StoredValue.
+     * @param v the StoredValue to move; it is freed if it was moved
+     *
+     * @return the new StoredValue, or nullptr if v can't be moved now
+     */
+    virtual StoredValue* relocateStoredValue(
+            const HashTable::HashBucketLock& lh, StoredValue& v);
+
     /**
      * Add an item in the store
      *
@@ -1141,10 +1286,15 @@ public:
     std::atomic<size_t>  dirtyQueueDrain;
     std::atomic<uint64_t> dirtyQueueAge;
     std::atomic<size_t>  dirtyQueuePendingWrites;
+    //! The time (us) from queueing an item to it being durable on disk
+    Histogram<hrtime_t> persistenceLatencyHisto;
     std::atomic<size_t>  metaDataDisk;
 
     std::atomic<size_t>  numExpiredItems;
 
+    //! The front end operations and their (sampled) latencies
+    VBucketOpStats opStats;
+
     /**
      * A custom delete function for deleting VBucket objects. Any thread could
      * be the last thread to release a VBucketPtr and deleting a VB will
@@ -1403,13 +1553,58 @@ protected:
     /* last seqno that is persisted on the disk */
     std::atomic<uint64_t> persistenceSeqno;
 
-    /* holds all high priority async requests to the vbucket */
-    std::list<HighPriorityVBEntry> hpVBReqs;
+    /**
+     * Get the index of the requests of the given type in hpVBReqs and
+     * hpVBReqsByAge.
+     */
+    static size_t getHighPriorityIndex(HighPriorityVBNotify reqType) {
+        return reqType == HighPriorityVBNotify::Seqno ? 0 : 1;
+    }
+
+    /**
+     * Is the given request still waiting (rather than notified already)?
+     * hpVBReqsMutex must be held.
+     */
+    bool isHighPriorityVBEntryWaiting(const HighPriorityVBEntry& entry) const {
+        auto it = hpVBReqsWaiting.find(entry.cookie);
+        return it != hpVBReqsWaiting.end() && it->second == entry.serial;
+    }
+
+    /**
+     * Drop the requests which were notified from the min-heap of the given
+     * type once they make up most of it, so that requests which timed out
+     * waiting for a seqno which never came don't pile up.
+     * hpVBReqsMutex must be held.
+     */
+    void compactHighPriorityVBEntries(size_t index);
+
+    /**
+     * Holds all high priority async requests to the vbucket; for each type
+     * of request a min-heap of the seqno (or checkpoint id) they wait for,
+     * so that a notification only looks at the requests it satisfies.
+     */
+    std::array<std::vector<HighPriorityVBEntry>, 2> hpVBReqs;
+
+    /**
+     * The high priority requests of each type in the order they were
+     * added (the oldest first), to find the ones which timed out.
+     */
+    std::array<std::deque<HighPriorityVBEntry>, 2> hpVBReqsByAge;
+
+    /**
+     * The serial of the request each waiting cookie made. The requests
+     * notified are left in hpVBReqs and hpVBReqsByAge, and dropped when
+     * they turn up there.
+     */
+    std::unordered_map<const void*, uint64_t> hpVBReqsWaiting;
+
+    /* the serial of the last high priority request added */
+    uint64_t hpVBReqsSerial = 0;
 
     /* synchronizes access to hpVBReqs */
     std::mutex hpVBReqsMutex;
 
-    /* size of list hpVBReqs (to avoid MB-9434) */
+    /* number of requests waiting (to avoid MB-9434) */
     Couchbase::RelaxedAtomic<size_t> numHpVBReqs;
 
     /**
@@ -1430,6 +1625,49 @@ private:
 
     void decrDirtyQueuePendingWrites(size_t decrementBy);
 
+    /**
+     * Check if a read may be served from the given StoredValue while only
+     * holding shared access to its hash bucket; i.e. the StoredValue is
+     * live (not temp, deleted or expired) and the read doesn't need to
+     * update its NRU value (or frequency counter).
+     *
+     * This records the reference if the read may go ahead (see
+     * HashTable::trackSharedReference), so it must be the last check.
+     *
+     * @param v the StoredValue found for the key
+     * @param trackReference whether the read should record the reference
+     */
+    bool isReadableShared(const StoredValue& v, TrackReference trackReference);
+
+    /**
+     * Build the result of getInternal for a StoredValue which doesn't need
+     * to be fetched from disk.
+     *
+     * @param v the StoredValue found for the key
+     * @param options the options of the get
+     * @param getKeyOnly if GetKeyOnly::Yes only the key is returned
+     */
+    GetValue getInternalResident(const StoredValue& v,
+                                 get_options_t options,
+                                 GetKeyOnly getKeyOnly);
+
+    /**
+     * Fill in the result of getMetaData for a StoredValue which doesn't
+     * need a background fetch of its metadata.
+     *
+     * @return ENGINE_KEY_ENOENT for a temp non-existent item,
+     *         ENGINE_SUCCESS otherwise
+     */
+    ENGINE_ERROR_CODE getMetaDataFromSV(const StoredValue& v,
+                                        ItemMetaData& metadata,
+                                        uint32_t& deleted,
+                                        uint8_t& datatype);
+
+    /**
+     * Fill in the result of getKeyStats for the given StoredValue
+     */
+    void getKeyStatsFromSV(const StoredValue& v, struct key_stats& kstats);
+
     /**
      * Updates an existing StoredValue in in-memory data structures like HT.
      * Assumes that HT bucket lock is grabbed.
@@ -1628,6 +1866,8 @@ private:
     std::atomic<vbucket_state_t>    state;
     cb::RWLock                      stateLock;
     vbucket_state_t                 initialState;
+    // Where the state is published to, guarded by the stateLock
+    VBucketSeqnoSlot*               seqnoSlot;
     std::mutex                           pendingOpLock;
     std::vector<const void*>        pendingOps;
     hrtime_t                        pendingOpsStart;
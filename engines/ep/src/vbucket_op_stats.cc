@@ -0,0 +1,135 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "vbucket_op_stats.h"
+
+#include "statwriter.h"
+
+#include <algorithm>
+
+std::atomic<size_t> VBucketOpStats::sampleInterval{64};
+
+static const char* opNames[VBucketOpStats::NumOps] = {"get", "store", "del"};
+
+void VBucketOpStats::recordLatency(Op op, ProcessClock::duration duration) {
+    const auto usec =
+            std::chrono::duration_cast<std::chrono::microseconds>(duration);
+    auto& counters = getShard()->latency[size_t(op)];
+    counters.sampled.fetch_add(1, std::memory_order_relaxed);
+    counters.totalUsec.fetch_add(uint64_t(usec.count()),
+                                 std::memory_order_relaxed);
+    counters.buckets[getBucket(usec)].fetch_add(1, std::memory_order_relaxed);
+
+    const auto value = uint64_t(usec.count());
+    auto max = counters.maxUsec.load(std::memory_order_relaxed);
+    while (value > max && !counters.maxUsec.compare_exchange_weak(
+                                  max, value, std::memory_order_relaxed)) {
+    }
+}
+
+size_t VBucketOpStats::getBucket(std::chrono::microseconds latency) {
+    uint64_t value = uint64_t(latency.count());
+    size_t bucket = 0;
+    while (value != 0 && bucket < NumBuckets - 1) {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+uint64_t VBucketOpStats::getOps(Op op) const {
+    uint64_t ret = 0;
+    for (const auto& shard : shards) {
+        ret += shard->ops[size_t(op)].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+uint64_t VBucketOpStats::getSampled(Op op) const {
+    uint64_t ret = 0;
+    for (const auto& shard : shards) {
+        ret += shard->latency[size_t(op)].sampled.load(
+                std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+void VBucketOpStats::addStats(const std::string& prefix,
+                              ADD_STAT add_stat,
+                              const void* c) const {
+    for (size_t op = 0; op < NumOps; ++op) {
+        uint64_t sampled = 0;
+        uint64_t total = 0;
+        uint64_t max = 0;
+        std::array<uint64_t, NumBuckets> buckets{};
+        for (const auto& shard : shards) {
+            const auto& counters = shard->latency[op];
+            sampled += counters.sampled.load(std::memory_order_relaxed);
+            total += counters.totalUsec.load(std::memory_order_relaxed);
+            max = std::max(max,
+                           counters.maxUsec.load(std::memory_order_relaxed));
+            for (size_t ii = 0; ii < NumBuckets; ++ii) {
+                buckets[ii] +=
+                        counters.buckets[ii].load(std::memory_order_relaxed);
+            }
+        }
+
+        // The upper bound (in us) of the bucket holding the percentile
+        auto percentile = [&buckets, sampled](double pct) -> uint64_t {
+            const auto wanted = uint64_t(sampled * pct / 100.0);
+            uint64_t seen = 0;
+            for (size_t ii = 0; ii < NumBuckets; ++ii) {
+                seen += buckets[ii];
+                if (seen > wanted) {
+                    return uint64_t(1) << ii;
+                }
+            }
+            return uint64_t(1) << (NumBuckets - 1);
+        };
+
+        const std::string name = prefix + ":" + opNames[op];
+        add_casted_stat((name + "_ops").c_str(),
+                        getOps(Op(op)), add_stat, c);
+        add_casted_stat((name + "_sampled").c_str(), sampled, add_stat, c);
+        if (sampled == 0) {
+            continue;
+        }
+        add_casted_stat((name + "_mean_us").c_str(),
+                        total / sampled, add_stat, c);
+        add_casted_stat((name + "_p50_us").c_str(),
+                        percentile(50), add_stat, c);
+        add_casted_stat((name + "_p99_us").c_str(),
+                        percentile(99), add_stat, c);
+        add_casted_stat((name + "_max_us").c_str(), max, add_stat, c);
+    }
+}
+
+void VBucketOpStats::reset() {
+    for (auto& shard : shards) {
+        for (auto& ops : shard->ops) {
+            ops.store(0, std::memory_order_relaxed);
+        }
+        for (auto& counters : shard->latency) {
+            counters.sampled.store(0, std::memory_order_relaxed);
+            counters.totalUsec.store(0, std::memory_order_relaxed);
+            counters.maxUsec.store(0, std::memory_order_relaxed);
+            for (auto& bucket : counters.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
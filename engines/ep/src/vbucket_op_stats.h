@@ -0,0 +1,143 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <memcached/engine_common.h>
+#include <platform/cacheline_padded.h>
+#include <platform/processclock.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Per vbucket counters and (sampled) latency summaries of the front end
+ * operations, to find the vbuckets which are hot or slow (the timings of
+ * the bucket average them away). See "stats vbucket-latency".
+ *
+ * The counters are split over a few cache line padded shards (a thread
+ * always updates the same shard) to avoid the front end threads fighting
+ * over the cache lines of a hot vbucket. Only one in every
+ * getSampleInterval() operations (of a thread) is timed, and its latency
+ * is recorded in a power of two histogram (in microseconds).
+ */
+class VBucketOpStats {
+public:
+    enum class Op : uint8_t { Get, Store, Delete };
+    static const size_t NumOps = 3;
+    static const size_t NumShards = 4;
+    /// Bucket 0 holds latencies below 1us, bucket i the ones in
+    /// [2^(i-1), 2^i) us and the last bucket everything above
+    static const size_t NumBuckets = 20;
+
+    /**
+     * Times (if it is sampled) and counts an operation for the lifetime
+     * of the object
+     */
+    class Timer {
+    public:
+        Timer(VBucketOpStats& stats, Op op) : stats(stats), op(op) {
+            if (stats.begin(op)) {
+                start = ProcessClock::now();
+            }
+        }
+
+        ~Timer() {
+            if (start != ProcessClock::time_point()) {
+                stats.recordLatency(op, ProcessClock::now() - start);
+            }
+        }
+
+    private:
+        VBucketOpStats& stats;
+        const Op op;
+        ProcessClock::time_point start;
+    };
+
+    /**
+     * Count an operation
+     *
+     * @return true if the latency of the operation should be sampled
+     */
+    bool begin(Op op) {
+        getShard()->ops[size_t(op)].fetch_add(1, std::memory_order_relaxed);
+        const auto interval = sampleInterval.load(std::memory_order_relaxed);
+        if (interval == 0) {
+            return false;
+        }
+        static thread_local size_t counter;
+        return (++counter % interval) == 0;
+    }
+
+    void recordLatency(Op op, ProcessClock::duration duration);
+
+    void addStats(const std::string& prefix,
+                  ADD_STAT add_stat,
+                  const void* c) const;
+
+    void reset();
+
+    /// Get the number of operations counted
+    uint64_t getOps(Op op) const;
+
+    /// Get the number of operations whose latency was sampled
+    uint64_t getSampled(Op op) const;
+
+    /**
+     * Set how often the latency is sampled (every N'th operation of a
+     * thread); 0 turns the sampling off
+     */
+    static void setSampleInterval(size_t interval) {
+        sampleInterval.store(interval, std::memory_order_relaxed);
+    }
+
+    static size_t getSampleInterval() {
+        return sampleInterval.load(std::memory_order_relaxed);
+    }
+
+    /// Get the histogram bucket for the given latency
+    static size_t getBucket(std::chrono::microseconds latency);
+
+private:
+    struct OpCounters {
+        std::atomic<uint64_t> sampled{0};
+        std::atomic<uint64_t> totalUsec{0};
+        std::atomic<uint64_t> maxUsec{0};
+        std::array<std::atomic<uint32_t>, NumBuckets> buckets{};
+    };
+
+    struct Shard {
+        std::array<std::atomic<uint64_t>, NumOps> ops{};
+        std::array<OpCounters, NumOps> latency;
+    };
+
+    cb::CachelinePadded<Shard>& getShard() {
+        static std::atomic<size_t> nextShard{0};
+        static thread_local size_t index =
+                nextShard.fetch_add(1, std::memory_order_relaxed) % NumShards;
+        return shards[index];
+    }
+
+    std::array<cb::CachelinePadded<Shard>, NumShards> shards;
+
+    static std::atomic<size_t> sampleInterval;
+};
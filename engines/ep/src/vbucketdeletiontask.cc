@@ -24,6 +24,8 @@
 #include <phosphor/phosphor.h>
 #include <platform/processclock.h>
 
+#include <algorithm>
+
 VBucketMemoryDeletionTask::VBucketMemoryDeletionTask(
         EventuallyPersistentEngine& eng, VBucket* vb, TaskId tid)
     : GlobalTask(&eng, tid, 0.0, true), vbucket(vb) {
@@ -72,8 +74,48 @@ VBucketMemoryAndDiskDeletionTask::VBucketMemoryAndDiskDeletionTask(
                                 static_cast<VBucket*>(vb),
                                 TaskId::VBucketMemoryAndDiskDeletionTask),
       shard(shard),
-      vbDeleteRevision(vb->getDeferredDeletionFileRevision()) {
+      vbDeleteRevision(vb->getDeferredDeletionFileRevision()),
+      memPending(vb->ht.getItemMemory()) {
     description += " and disk";
+    engine->getEpStats().vbucketDelMemPending.fetch_add(memPending);
+}
+
+VBucketMemoryAndDiskDeletionTask::~VBucketMemoryAndDiskDeletionTask() {
+    // Not run to completion (shutdown); the VBucket frees the rest
+    engine->getEpStats().vbucketDelMemPending.fetch_sub(memPending);
+}
+
+std::chrono::microseconds
+VBucketMemoryAndDiskDeletionTask::maxExpectedDuration() {
+    // Each run freeing items is bounded by the chunk duration (with some
+    // headroom for the estimate of the VisitorBudget); the last one also
+    // removes the file, which VBucketMemoryDeletionTask allows for.
+    return std::max(
+            VBucketMemoryDeletionTask::maxExpectedDuration(),
+            std::chrono::microseconds(std::chrono::milliseconds(
+                    engine->getConfiguration()
+                            .getVbucketDeletionChunkDuration() *
+                    10)));
+}
+
+bool VBucketMemoryAndDiskDeletionTask::releaseItems() {
+    auto& stats = engine->getEpStats();
+    const size_t memBefore = vbucket->ht.getItemMemory();
+
+    budget.startRun(std::chrono::milliseconds(
+            engine->getConfiguration().getVbucketDeletionChunkDuration()));
+    const bool done = vbucket->ht.clearWithinBudget(budget, htPosition);
+    stats.visitorRuns[static_cast<size_t>(getTypeId())].record(
+            budget.endRun());
+
+    const size_t freed =
+            std::min(memPending, memBefore - vbucket->ht.getItemMemory());
+    memPending -= freed;
+    stats.vbucketDelMemPending.fetch_sub(freed);
+    // The item the budget ran out at isn't freed
+    stats.vbucketDelItemsFreed.fetch_add(budget.getVisitedCount() -
+                                         (done ? 0 : 1));
+    return done;
 }
 
 bool VBucketMemoryAndDiskDeletionTask::run() {
@@ -81,7 +123,18 @@ bool VBucketMemoryAndDiskDeletionTask::run() {
                  "VBucketMemoryAndDiskDeletionTask",
                  "vb",
                  vbucket->getId());
-    notifyAllPendingConnsFailed(false);
+    if (!notifiedPendingConns) {
+        notifyAllPendingConnsFailed(false);
+        notifiedPendingConns = true;
+    }
+
+    if (!releaseItems()) {
+        // Give the thread back, and carry on from there as soon as possible
+        snooze(0);
+        return true;
+    }
+    engine->getEpStats().vbucketDelMemPending.fetch_sub(memPending);
+    memPending = 0;
 
     auto start = ProcessClock::now();
     shard.getRWUnderlying()->delVBucket(vbucket->getId(), vbDeleteRevision);
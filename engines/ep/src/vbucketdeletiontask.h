@@ -18,6 +18,7 @@
 #pragma once
 
 #include "globaltask.h"
+#include "vb_visitors.h"
 #include "vbucket.h"
 
 class EPVBucket;
@@ -69,6 +70,13 @@ protected:
  * responsible for clearing all the VBucket's pending operations and for
  * clearing the VBucket's hash table and removing the disk file.
  *
+ * The hash table is freed over as many runs as needed, each taking up to
+ * vbucket_deletion_chunk_duration, so that dropping a vbucket with millions
+ * of items (e.g. when rebalancing it out) doesn't hold the thread (and the
+ * allocator) for seconds. The disk file is removed once it's all freed.
+ * (The hash table of an Ephemeral vbucket can't be freed before its
+ * sequence list, which ~EphemeralVBucket destroys first.)
+ *
  * This task is designed to be invoked only when the EPVBucket has no owners.
  */
 class VBucketMemoryAndDiskDeletionTask : public VBucketMemoryDeletionTask {
@@ -86,9 +94,29 @@ public:
                                      KVShard& shard,
                                      EPVBucket* vbucket);
 
+    ~VBucketMemoryAndDiskDeletionTask();
+
+    std::chrono::microseconds maxExpectedDuration();
+
     bool run();
 
 protected:
+    /**
+     * Free the next chunk of the items of the vbucket.
+     *
+     * @return true once all of them are freed
+     */
+    bool releaseItems();
+
     KVShard& shard;
     uint64_t vbDeleteRevision;
+
+    // The budget of each run freeing items, and how far they got
+    VisitorBudget budget;
+    size_t htPosition = 0;
+
+    // Memory of the items not freed yet (see EPStats::vbucketDelMemPending)
+    size_t memPending;
+
+    bool notifiedPendingConns = false;
 };
@@ -19,6 +19,7 @@
 
 #include <platform/make_unique.h>
 
+#include <cstring>
 #include <vector>
 
 #include "kv_bucket_iface.h"
@@ -26,7 +27,7 @@
 #include "vbucketmap.h"
 
 VBucketMap::VBucketMap(Configuration& config, KVBucket& store)
-    : size(config.getMaxVbuckets()) {
+    : seqnoSlots(config.getMaxVbuckets()), size(config.getMaxVbuckets()) {
     WorkLoadPolicy &workload = store.getEPEngine().getWorkLoadPolicy();
     for (size_t shardId = 0; shardId < workload.getNumShards(); shardId++) {
         shards.push_back(std::make_unique<KVShard>(shardId, store));
@@ -36,6 +37,8 @@ VBucketMap::VBucketMap(Configuration& config, KVBucket& store)
                                     new VBucketConfigChangeListener(*this));
     config.addValueChangedListener("hlc_drift_behind_threshold_us",
                                     new VBucketConfigChangeListener(*this));
+    config.addValueChangedListener("hlc_clock",
+                                   new VBucketConfigChangeListener(*this));
 }
 
 VBucketPtr VBucketMap::getBucket(id_type id) const {
@@ -49,6 +52,11 @@ VBucketPtr VBucketMap::getBucket(id_type id) const {
 
 ENGINE_ERROR_CODE VBucketMap::addBucket(VBucketPtr vb) {
     if (vb->getId() < size) {
+        auto previous = getBucket(vb->getId());
+        if (previous && previous != vb) {
+            previous->setSeqnoSlot(nullptr);
+        }
+        vb->setSeqnoSlot(&*seqnoSlots[vb->getId()]);
         getShardByVbId(vb->getId())->setBucket(vb);
         LOG(EXTENSION_LOG_INFO,
             "Mapped new vbucket %d in state %s",
@@ -66,6 +74,13 @@ ENGINE_ERROR_CODE VBucketMap::addBucket(VBucketPtr vb) {
 void VBucketMap::dropVBucketAndSetupDeferredDeletion(id_type id,
                                                      const void* cookie) {
     if (id < size) {
+        {
+            auto vb = getBucket(id);
+            if (vb) {
+                vb->setSeqnoSlot(nullptr);
+            }
+        }
+        seqnoSlots[id]->state.store(0);
         getShardByVbId(id)->dropVBucketAndSetupDeferredDeletion(id, cookie);
     }
 }
@@ -147,6 +162,15 @@ void VBucketMap::setHLCDriftBehindThreshold(std::chrono::microseconds threshold)
     }
 }
 
+void VBucketMap::setHLCCoarseClock(bool value) {
+    for (id_type id = 0; id < size; id++) {
+        auto vb = getBucket(id);
+        if (vb) {
+            vb->setHLCCoarseClock(value);
+        }
+    }
+}
+
 void VBucketMap::VBucketConfigChangeListener::sizeValueChanged(const std::string &key,
                                                    size_t value) {
     if (key == "hlc_drift_ahead_threshold_us") {
@@ -155,3 +179,10 @@ void VBucketMap::VBucketConfigChangeListener::sizeValueChanged(const std::string
         map.setHLCDriftBehindThreshold(std::chrono::microseconds(value));
     }
 }
+
+void VBucketMap::VBucketConfigChangeListener::stringValueChanged(
+        const std::string& key, const char* value) {
+    if (key == "hlc_clock") {
+        map.setHLCCoarseClock(strcmp(value, "coarse") == 0);
+    }
+}
@@ -20,6 +20,9 @@
 
 #include "config.h"
 
+#include <platform/cacheline_padded.h>
+#include <relaxed_atomic.h>
+
 #include <vector>
 
 
@@ -28,6 +31,20 @@
 
 class VBucket;
 
+/**
+ * What GET_ALL_VB_SEQNOS reports for a vbucket: its state, and its high
+ * seqno (if active) or the end of its current snapshot (see
+ * CheckpointManager::getSnapshotInfo). The vbucket and its
+ * CheckpointManager publish them as they change, so that the command
+ * reads them without looking up (or locking) any vbucket.
+ */
+struct VBucketSeqnoSlot {
+    /// The state of the vbucket, 0 if there is none
+    Couchbase::RelaxedAtomic<uint8_t> state{0};
+    Couchbase::RelaxedAtomic<int64_t> highSeqno{0};
+    Couchbase::RelaxedAtomic<uint64_t> snapshotEnd{0};
+};
+
 /**
  * A map of known vbuckets.
  */
@@ -44,6 +61,8 @@ friend class Warmup;
             : map(vbucketMap) {}
 
         void sizeValueChanged(const std::string &key, size_t value) override;
+        void stringValueChanged(const std::string& key,
+                                const char* value) override;
 
     private:
         VBucketMap& map;
@@ -54,6 +73,9 @@ public:
     // This class uses the same id_type as VBucket
     typedef VBucket::id_type id_type;
 
+    // Padded, as the slots of different vbuckets are written concurrently
+    using SeqnoSlots = std::vector<cb::CachelinePadded<VBucketSeqnoSlot>>;
+
     VBucketMap(Configuration& config, KVBucket& store);
 
     /**
@@ -88,9 +110,18 @@ public:
     size_t getNumShards() const;
     void setHLCDriftAheadThreshold(std::chrono::microseconds threshold);
     void setHLCDriftBehindThreshold(std::chrono::microseconds threshold);
+    void setHLCCoarseClock(bool value);
+
+    /// The seqno slots of all of the vbuckets, indexed by vbucket id
+    const SeqnoSlots& getSeqnoSlots() const {
+        return seqnoSlots;
+    }
 
 private:
 
+    // Before the shards, as it must outlive their vbuckets
+    SeqnoSlots seqnoSlots;
+
     std::vector<std::unique_ptr<KVShard>> shards;
 
     const id_type size;
@@ -17,6 +17,7 @@
 
 #include "warmup.h"
 
+#include "blob.h"
 #include "checkpoint.h"
 #include "common.h"
 #include "connmap.h"
@@ -154,7 +155,7 @@ public:
         : GlobalTask(&st.getEPEngine(), TaskId::WarmupKeyDump, 0, false),
           _shardId(sh),
           _warmup(w),
-          _description("Warmup - key dump: shard " + std::to_string(_shardId)) {
+          _description("Warmup - key dump: " + w->getLoadTaskName(sh)) {
         _warmup->addToTaskSet(uid);
     }
 
@@ -256,8 +257,8 @@ public:
         : GlobalTask(&st.getEPEngine(), TaskId::WarmupLoadingKVPairs, 0, false),
           _shardId(sh),
           _warmup(w),
-          _description("Warmup - loading KV Pairs: shard " +
-                       std::to_string(_shardId)) {
+          _description("Warmup - loading KV Pairs: " +
+                       w->getLoadTaskName(sh)) {
         _warmup->addToTaskSet(uid);
     }
 
@@ -293,8 +294,7 @@ public:
         GlobalTask(&st.getEPEngine(), TaskId::WarmupLoadingData, 0, false),
         _shardId(sh),
         _warmup(w),
-        _description("Warmup - loading data: shard " +
-                     std::to_string(_shardId)) {
+        _description("Warmup - loading data: " + w->getLoadTaskName(sh)) {
         _warmup->addToTaskSet(uid);
     }
 
@@ -359,6 +359,13 @@ static bool batchWarmupCallback(uint16_t vbId,
 {
     WarmupCookie *c = static_cast<WarmupCookie *>(arg);
 
+    if (!c->epstore->getWarmup()->hasValueBudget(vbId)) {
+        // The vbucket has loaded its part of the values; carry on with the
+        // others
+        c->skipped += fetches.size();
+        return true;
+    }
+
     if (!c->epstore->maybeEnableTraffic()) {
         vb_bgfetch_queue_t items2fetch;
         for (auto& key : fetches) {
@@ -417,6 +424,11 @@ static bool warmupCallback(void *arg, uint16_t vb, const DocKey& key)
 {
     WarmupCookie *cookie = static_cast<WarmupCookie*>(arg);
 
+    if (!cookie->epstore->getWarmup()->hasValueBudget(vb)) {
+        cookie->skipped++;
+        return true;
+    }
+
     if (!cookie->epstore->maybeEnableTraffic()) {
         GetValue cb = cookie->epstore->getROUnderlying(vb)->get(key, vb);
 
@@ -555,7 +567,14 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
             setStatus(ENGINE_NOT_MY_VBUCKET);
             return;
         }
+        if (!val.isPartial() &&
+            !epstore.getWarmup()->hasValueBudget(vb->getId())) {
+            // The vbucket has loaded its part of the values
+            setStatus(ENGINE_ENOMEM);
+            return;
+        }
         bool succeeded(false);
+        bool loaded(false);
         int retry = 2;
         do {
             if (i->getCas() == static_cast<uint64_t>(-1)) {
@@ -572,8 +591,13 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
                 return;
             }
 
-            const auto res =
-                    epVb->insertFromWarmup(*i, shouldEject(), val.isPartial());
+            // Once a vbucket takes traffic, a key missing from its hash
+            // table was deleted since its key dump; don't bring it back
+            const bool addNew =
+                    val.isPartial() ||
+                    !epstore.getWarmup()->hasLoadedMetadata(vb->getId());
+            const auto res = epVb->insertFromWarmup(
+                    *i, shouldEject(), val.isPartial(), addNew);
             switch (res) {
             case MutationStatus::NoMem:
                 if (retry == 2) {
@@ -602,6 +626,7 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
                 break;
             case MutationStatus::NotFound:
                 succeeded = true;
+                loaded = true;
                 break;
             default:
                 throw std::logic_error(
@@ -611,6 +636,11 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
             }
         } while (!succeeded && retry-- > 0);
 
+        if (loaded && !val.isPartial()) {
+            epstore.getWarmup()->chargeValue(
+                    vb->getId(), Blob::getAllocationSize(i->getNBytes()));
+        }
+
         if (maybeEnableTraffic) {
             stopLoading = epstore.maybeEnableTraffic();
         }
@@ -701,9 +731,19 @@ void LoadStorageKVPairCallback::purge() {
     hasPurged = true;
 }
 
+LoadValueCallback::LoadValueCallback(KVBucket& ep, int _warmupState)
+    : vbuckets(ep.vbMap), epstore(ep), warmupState(_warmupState) {
+}
+
 void LoadValueCallback::callback(CacheLookup &lookup)
 {
     if (warmupState == WarmupState::LoadingData) {
+        if (!epstore.getWarmup()->hasValueBudget(lookup.getVBucketId())) {
+            // Don't read the value; the scan of the vbucket is cancelled
+            setStatus(ENGINE_ENOMEM);
+            return;
+        }
+
         VBucketPtr vb = vbuckets.getBucket(lookup.getVBucketId());
         if (!vb) {
             return;
@@ -736,10 +776,26 @@ Warmup::Warmup(KVBucket& st, Configuration& config_)
       startTime(0),
       metadata(0),
       warmup(0),
+      stateTime(WarmupState::Done + 1),
+      stateStart(0),
       shardVbStates(store.vbMap.getNumShards()),
       threadtask_count(0),
       shardKeyDumpStatus(store.vbMap.getNumShards()),
       shardVbIds(store.vbMap.getNumShards()),
+      numLoadTasks(config_.getWarmupLoadTasks()),
+      loadStopped(false),
+      activeFirst(config_.isWarmupActiveFirst()),
+      vbMetadataLoaded(store.vbMap.getSize()),
+      pendingActiveKeyDumps(0),
+      activeMetadataLoaded(false),
+      htSnapshot(config_.isHtSnapshot()),
+      vbLoadedFromSnapshot(store.vbMap.getSize()),
+      snapshotVBuckets(0),
+      residentRatioTarget(config_.getWarmupResidentRatioTarget()),
+      vbValueBudget(store.vbMap.getSize()),
+      vbByteBudget(store.vbMap.getSize()),
+      valuesPlanned(false),
+      plannedValues(0),
       estimateTime(0),
       estimatedItemCount(std::numeric_limits<size_t>::max()),
       cleanShutdown(true),
@@ -800,6 +856,7 @@ void Warmup::scheduleInitialize()
 void Warmup::initialize()
 {
     startTime.store(gethrtime());
+    stateStart.store(startTime.load());
 
     std::map<std::string, std::string> session_stats;
     store.getOneROUnderlying()->getPersistedStats(session_stats);
@@ -864,6 +921,13 @@ void Warmup::createVBuckets(uint16_t shardId) {
                                       ->getCollectionsManifest(vbid)
                             : "" /*no collections manifest*/);
 
+            // Check the saved filter against the failover UUID before we
+            // (maybe) add a new failover entry below
+            if (config.isBfilterEnabled() && config.isBfilterPersist()) {
+                vb->loadFilter(config.getDbname(),
+                               static_cast<uint64_t>(vbs.highSeqno));
+            }
+
             if(vbs.state == vbucket_state_active && !cleanShutdown) {
                 if (static_cast<uint64_t>(vbs.highSeqno) == vbs.lastSnapEnd) {
                     vb->failovers->createEntry(vbs.lastSnapEnd);
@@ -960,8 +1024,11 @@ void Warmup::estimateDatabaseItemCount(uint16_t shardId)
 
 void Warmup::scheduleKeyDump()
 {
-    threadtask_count = 0;
-    for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
+    if (activeFirst && pendingActiveKeyDumps == 0) {
+        activeMetadataLoaded = true;
+    }
+    prepareLoadingPhase();
+    for (size_t i = 0; i < getNumLoadTasks(); i++) {
         ExTask task = std::make_shared<WarmupKeyDump>(store, i, this);
         ExecutorPool::get()->schedule(task);
     }
@@ -970,12 +1037,19 @@ void Warmup::scheduleKeyDump()
 
 void Warmup::keyDumpforShard(uint16_t shardId)
 {
-    KVStore* kvstore = store.getROUnderlyingByShard(shardId);
     auto cb = std::make_shared<LoadStorageKVPairCallback>(
             store, false, state.getState());
     auto cl = std::make_shared<NoLookupCallback>();
 
-    for (const auto vbid : shardVbIds[shardId]) {
+    size_t pos = 0;
+    uint16_t vbid;
+    while (nextVBucket(shardId, pos, vbid)) {
+        if (loadHashTableSnapshot(vbid)) {
+            setMetadataLoaded(vbid);
+            continue;
+        }
+
+        KVStore* kvstore = store.getROUnderlying(vbid);
         ScanContext* ctx = kvstore->initScanContext(cb, cl, vbid, 0,
                                                     DocumentFilter::NO_DELETES,
                                                     ValueFilter::KEYS_ONLY);
@@ -984,14 +1058,25 @@ void Warmup::keyDumpforShard(uint16_t shardId)
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
                 // skip loading remaining VBuckets as memory limit was reached
+                stopLoadingPhase();
                 break;
             }
+            if (errorCode == scan_success) {
+                setMetadataLoaded(vbid);
+            }
         }
     }
 
-    shardKeyDumpStatus[shardId] = true;
+    if (numLoadTasks == 0) {
+        shardKeyDumpStatus[shardId] = true;
+    } else {
+        // The tasks aren't bound to a shard
+        for (auto& status : shardKeyDumpStatus) {
+            status = true;
+        }
+    }
 
-    if (++threadtask_count == store.vbMap.getNumShards()) {
+    if (++threadtask_count == getNumLoadTasks()) {
         bool success = false;
         for (size_t i = 0; i < store.vbMap.getNumShards(); i++) {
             if (shardKeyDumpStatus[i]) {
@@ -1038,6 +1123,8 @@ void Warmup::checkForAccessLog()
             accesslogs++;
         }
     }
+    planValueLoading();
+
     if (accesslogs == store.vbMap.shards.size()) {
         transition(WarmupState::LoadingAccessLog);
     } else {
@@ -1126,7 +1213,9 @@ size_t Warmup::doWarmup(MutationLog &lf, const std::map<uint16_t,
     MutationLogHarvester harvester(lf, &store.getEPEngine());
     std::map<uint16_t, vbucket_state>::const_iterator it;
     for (it = vbmap.begin(); it != vbmap.end(); ++it) {
-        harvester.setVBucket(it->first);
+        if (!vbLoadedFromSnapshot[it->first]) {
+            harvester.setVBucket(it->first);
+        }
     }
 
     // To constrain the number of elements from the access log we have to keep
@@ -1174,8 +1263,8 @@ void Warmup::scheduleLoadingKVPairs()
     // keys have been warmed up at this point.
     setEstimatedWarmupCount(estimatedItemCount);
 
-    threadtask_count = 0;
-    for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
+    prepareLoadingPhase();
+    for (size_t i = 0; i < getNumLoadTasks(); i++) {
         ExTask task = std::make_shared<WarmupLoadingKVPairs>(store, i, this);
         ExecutorPool::get()->schedule(task);
     }
@@ -1191,13 +1280,15 @@ void Warmup::loadKVPairsforShard(uint16_t shardId)
         maybe_enable_traffic = true;
     }
 
-    KVStore* kvstore = store.getROUnderlyingByShard(shardId);
     auto cb = std::make_shared<LoadStorageKVPairCallback>(
             store, maybe_enable_traffic, state.getState());
     auto cl =
-            std::make_shared<LoadValueCallback>(store.vbMap, state.getState());
+            std::make_shared<LoadValueCallback>(store, state.getState());
 
-    for (const auto vbid : shardVbIds[shardId]) {
+    size_t pos = 0;
+    uint16_t vbid;
+    while (nextVBucket(shardId, pos, vbid)) {
+        KVStore* kvstore = store.getROUnderlying(vbid);
         ScanContext* ctx = kvstore->initScanContext(cb, cl, vbid, 0,
                                                     DocumentFilter::NO_DELETES,
                                                     ValueFilter::VALUES_DECOMPRESSED);
@@ -1206,11 +1297,12 @@ void Warmup::loadKVPairsforShard(uint16_t shardId)
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
                 // skip loading remaining VBuckets as memory limit was reached
+                stopLoadingPhase();
                 break;
             }
         }
     }
-    if (++threadtask_count == store.vbMap.getNumShards()) {
+    if (++threadtask_count == getNumLoadTasks()) {
         transition(WarmupState::Done);
     }
 }
@@ -1220,8 +1312,8 @@ void Warmup::scheduleLoadingData()
     size_t estimatedCount = store.getEPEngine().getEpStats().warmedUpKeys;
     setEstimatedWarmupCount(estimatedCount);
 
-    threadtask_count = 0;
-    for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
+    prepareLoadingPhase();
+    for (size_t i = 0; i < getNumLoadTasks(); i++) {
         ExTask task = std::make_shared<WarmupLoadingData>(store, i, this);
         ExecutorPool::get()->schedule(task);
     }
@@ -1231,13 +1323,15 @@ void Warmup::loadDataforShard(uint16_t shardId)
 {
     scan_error_t errorCode = scan_success;
 
-    KVStore* kvstore = store.getROUnderlyingByShard(shardId);
     auto cb = std::make_shared<LoadStorageKVPairCallback>(
             store, true, state.getState());
     auto cl =
-            std::make_shared<LoadValueCallback>(store.vbMap, state.getState());
+            std::make_shared<LoadValueCallback>(store, state.getState());
 
-    for (const auto vbid : shardVbIds[shardId]) {
+    size_t pos = 0;
+    uint16_t vbid;
+    while (nextVBucket(shardId, pos, vbid)) {
+        KVStore* kvstore = store.getROUnderlying(vbid);
         ScanContext* ctx = kvstore->initScanContext(cb, cl, vbid, 0,
                                                     DocumentFilter::NO_DELETES,
                                                     ValueFilter::VALUES_DECOMPRESSED);
@@ -1245,17 +1339,200 @@ void Warmup::loadDataforShard(uint16_t shardId)
             errorCode = kvstore->scan(ctx);
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
+                if (!isComplete() && !hasValueBudget(vbid)) {
+                    // Only this vbucket has loaded its part of the values
+                    continue;
+                }
                 // skip loading remaining VBuckets as memory limit was reached
+                stopLoadingPhase();
                 break;
             }
         }
     }
 
-    if (++threadtask_count == store.vbMap.getNumShards()) {
+    if (++threadtask_count == getNumLoadTasks()) {
         transition(WarmupState::Done);
     }
 }
 
+size_t Warmup::getNumLoadTasks() const {
+    return numLoadTasks == 0 ? store.vbMap.getNumShards() : numLoadTasks;
+}
+
+std::string Warmup::getLoadTaskName(uint16_t taskId) const {
+    return (numLoadTasks == 0 ? "shard " : "task ") + std::to_string(taskId);
+}
+
+void Warmup::prepareLoadingPhase() {
+    threadtask_count = 0;
+    loadStopped = false;
+    if (numLoadTasks == 0) {
+        return;
+    }
+
+    // Interleave the shards, so that the first vbuckets taken are spread
+    // over the shards, each in the order of its shardVbIds
+    LockHolder lh(loadQueueMutex);
+    loadQueue.clear();
+    for (size_t pos = 0;; ++pos) {
+        bool more = false;
+        for (const auto& vbids : shardVbIds) {
+            if (pos < vbids.size()) {
+                loadQueue.push_back(vbids[pos]);
+                more = true;
+            }
+        }
+        if (!more) {
+            break;
+        }
+    }
+}
+
+bool Warmup::nextVBucket(uint16_t taskId, size_t& pos, uint16_t& vbid) {
+    // The vbuckets loaded from a snapshot are complete already
+    do {
+        if (numLoadTasks == 0) {
+            // The vbuckets of the task's shard, in turn
+            if (pos >= shardVbIds[taskId].size()) {
+                return false;
+            }
+            vbid = shardVbIds[taskId][pos++];
+            continue;
+        }
+
+        if (loadStopped) {
+            return false;
+        }
+        LockHolder lh(loadQueueMutex);
+        if (loadQueue.empty()) {
+            return false;
+        }
+        vbid = loadQueue.front();
+        loadQueue.pop_front();
+    } while (vbLoadedFromSnapshot[vbid]);
+    return true;
+}
+
+void Warmup::stopLoadingPhase() {
+    loadStopped = true;
+}
+
+void Warmup::setMetadataLoaded(uint16_t vbid) {
+    if (!activeFirst || vbid >= vbMetadataLoaded.size()) {
+        return;
+    }
+    vbMetadataLoaded[vbid] = true;
+
+    const auto& vbStates = shardVbStates[vbid % store.vbMap.getNumShards()];
+    auto it = vbStates.find(vbid);
+    if (it != vbStates.end() && it->second.state == vbucket_state_active &&
+        --pendingActiveKeyDumps == 0) {
+        activeMetadataLoaded = true;
+        LOG(EXTENSION_LOG_NOTICE,
+            "Warmup: the metadata of all of the active vbuckets is loaded "
+            "in %s, the traffic can be enabled",
+            cb::time2text(std::chrono::nanoseconds(gethrtime() - startTime))
+                    .c_str());
+    }
+}
+
+bool Warmup::loadHashTableSnapshot(uint16_t vbid) {
+    if (!htSnapshot) {
+        return false;
+    }
+    VBucketPtr vb = store.getVBucket(vbid);
+    EPVBucket* epVb = dynamic_cast<EPVBucket*>(vb.get());
+    if (!epVb ||
+        !epVb->loadHashTable(config.getDbname(), vb->getPersistenceSeqno())) {
+        return false;
+    }
+
+    // (The hash table holds the items of the snapshot only)
+    EPStats& stats = store.getEPEngine().getEpStats();
+    const size_t numItems = vb->ht.getNumItems();
+    stats.warmedUpKeys.fetch_add(numItems);
+    stats.warmedUpValues.fetch_add(numItems -
+                                   vb->ht.getNumInMemoryNonResItems());
+    vbLoadedFromSnapshot[vbid] = true;
+    ++snapshotVBuckets;
+    return true;
+}
+
+void Warmup::planValueLoading() {
+    if (residentRatioTarget == 0 ||
+        store.getItemEvictionPolicy() != VALUE_ONLY) {
+        return;
+    }
+
+    // The values wanted per vbucket, from the number of items persisted
+    // (all of whose metadata is in the hash table by now)
+    std::vector<size_t> wanted(vbValueBudget.size());
+    size_t totalWanted = 0;
+    for (const auto& vbids : shardVbIds) {
+        for (const auto vbid : vbids) {
+            VBucketPtr vb = store.getVBucket(vbid);
+            if (!vb || vbid >= wanted.size() || vbLoadedFromSnapshot[vbid]) {
+                continue;
+            }
+            const size_t numItems = vb->ht.getNumItems();
+            const size_t resident =
+                    numItems - vb->ht.getNumInMemoryNonResItems();
+            const size_t target = numItems * residentRatioTarget / 100;
+            if (target > resident) {
+                wanted[vbid] = target - resident;
+                totalWanted += wanted[vbid];
+            }
+        }
+    }
+
+    // The memory all of them may take, split in proportion
+    EPStats& stats = store.getEPEngine().getEpStats();
+    const size_t memUsed = stats.getTotalMemoryUsed();
+    const size_t lowWat = stats.mem_low_wat.load();
+    const size_t headroom = lowWat > memUsed ? lowWat - memUsed : 0;
+    for (size_t vbid = 0; vbid < wanted.size(); ++vbid) {
+        vbValueBudget[vbid] = wanted[vbid];
+        vbByteBudget[vbid] =
+                totalWanted == 0
+                        ? 0
+                        : size_t(double(headroom) * wanted[vbid] /
+                                 totalWanted);
+    }
+    plannedValues = totalWanted;
+    valuesPlanned = true;
+
+    LOG(EXTENSION_LOG_NOTICE,
+        "Warmup: planning to load %" PRIu64 " values (resident ratio "
+        "target %" PRIu64 "%%) within %" PRIu64 " bytes",
+        uint64_t(totalWanted),
+        uint64_t(residentRatioTarget),
+        uint64_t(headroom));
+}
+
+bool Warmup::hasValueBudget(uint16_t vbid) const {
+    if (!valuesPlanned) {
+        return true;
+    }
+    return vbid < vbValueBudget.size() && vbValueBudget[vbid].load() > 0 &&
+           vbByteBudget[vbid].load() > 0;
+}
+
+/// Subtract n from counter, stopping at 0
+static void saturatingSubtract(std::atomic<size_t>& counter, size_t n) {
+    size_t current = counter.load();
+    while (!counter.compare_exchange_weak(current,
+                                          current > n ? current - n : 0)) {
+    }
+}
+
+void Warmup::chargeValue(uint16_t vbid, size_t bytes) {
+    if (!valuesPlanned || vbid >= vbValueBudget.size()) {
+        return;
+    }
+    saturatingSubtract(vbValueBudget[vbid], 1);
+    saturatingSubtract(vbByteBudget[vbid], bytes);
+}
+
 void Warmup::scheduleCompletion() {
     ExTask task = std::make_shared<WarmupCompletion>(store, this);
     ExecutorPool::get()->schedule(task);
@@ -1309,6 +1586,8 @@ void Warmup::step() {
 void Warmup::transition(int to, bool force) {
     int old = state.getState();
     if (old != WarmupState::Done) {
+        const hrtime_t now = gethrtime();
+        stateTime[old].fetch_add(now - stateStart.exchange(now));
         state.transition(to, force);
         step();
     }
@@ -1348,6 +1627,20 @@ void Warmup::addStats(ADD_STAT add_stat, const void *c) const
             add_stat,
             c);
     addStat("min_item_threshold", stats.warmupNumReadCap * 100.0, add_stat, c);
+    if (activeFirst) {
+        addStat("active_available",
+                areActiveVBucketsAvailable() ? "true" : "false",
+                add_stat,
+                c);
+    }
+
+    if (htSnapshot) {
+        addStat("snapshot_vbuckets", snapshotVBuckets.load(), add_stat, c);
+    }
+
+    if (valuesPlanned) {
+        addStat("planned_values", plannedValues.load(), add_stat, c);
+    }
 
     hrtime_t md_time = metadata.load();
     if (md_time > 0) {
@@ -1374,6 +1667,22 @@ void Warmup::addStats(ADD_STAT add_stat, const void *c) const
         addStat("access_log", "corrupt", add_stat, c);
     }
 
+    // The names of the states in the stats (indexed by the state)
+    static const char* stateStatNames[] = {"initialize_time",
+                                           "create_vbuckets_time",
+                                           "estimate_item_count_time",
+                                           "key_dump_time",
+                                           "check_access_log_time",
+                                           "loading_access_log_time",
+                                           "loading_kv_pairs_time",
+                                           "loading_data_time"};
+    for (int st = WarmupState::Initialize; st < WarmupState::Done; ++st) {
+        const hrtime_t st_time = stateTime[st].load();
+        if (st_time > 0) {
+            addStat(stateStatNames[st], st_time / 1000, add_stat, c);
+        }
+    }
+
     size_t warmupCount = estimatedWarmupCount.load();
     if (warmupCount == std::numeric_limits<size_t>::max()) {
         addStat("estimated_value_count", "unknown", add_stat, c);
@@ -1430,6 +1739,15 @@ void Warmup::populateShardVbStates()
             }
         }
 
+        pendingActiveKeyDumps += activeVBs.size();
+        if (activeFirst) {
+            shardVbIds[i].insert(
+                    shardVbIds[i].end(), activeVBs.begin(), activeVBs.end());
+            shardVbIds[i].insert(
+                    shardVbIds[i].end(), replicaVBs.begin(), replicaVBs.end());
+            continue;
+        }
+
         // Push one active VB to the front.
         // When the ratio of RAM to VBucket is poor (big vbuckets) this will
         // ensure we at least bring active data in before replicas eat RAM.
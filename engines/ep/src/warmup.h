@@ -25,6 +25,7 @@
 #include <atomic>
 #include <deque>
 #include <map>
+#include <mutex>
 #include <ostream>
 #include <string>
 #include <unordered_set>
@@ -102,13 +103,13 @@ private:
 
 class LoadValueCallback : public Callback<CacheLookup> {
 public:
-    LoadValueCallback(VBucketMap& vbMap, int _warmupState) :
-        vbuckets(vbMap), warmupState(_warmupState) { }
+    LoadValueCallback(KVBucket& ep, int _warmupState);
 
     void callback(CacheLookup &lookup);
 
 private:
     VBucketMap &vbuckets;
+    KVBucket&   epstore;
     int         warmupState;
 };
 
@@ -166,6 +167,45 @@ public:
      */
     void processCreateVBucketsComplete();
 
+    /**
+     * @return true if the vbucket takes traffic: warmup is complete, or (with
+     *         warmup_active_first) the key dump of the vbucket is done, i.e.
+     *         all of its keys and metadata are in the hash table and the
+     *         values not loaded yet are fetched from disk.
+     */
+    bool isVBucketAvailable(uint16_t vbid) const {
+        return isComplete() || hasLoadedMetadata(vbid);
+    }
+
+    /**
+     * @return true if the traffic can be enabled: warmup is complete, or
+     *         (with warmup_active_first) all of the active vbuckets are
+     *         available while the rest is loaded in the background.
+     */
+    bool areActiveVBucketsAvailable() const {
+        return isComplete() || activeMetadataLoaded.load();
+    }
+
+    /// @return true if the vbucket is available before warmup is complete
+    bool hasLoadedMetadata(uint16_t vbid) const {
+        return vbid < vbMetadataLoaded.size() && vbMetadataLoaded[vbid].load();
+    }
+
+    /**
+     * @return true if values may still be loaded into the vbucket: there is
+     *         no plan (warmup_resident_ratio_target), or the vbucket's part
+     *         of it isn't used up yet.
+     */
+    bool hasValueBudget(uint16_t vbid) const;
+
+    /// Account a value of the given (allocation) size loaded into a vbucket
+    void chargeValue(uint16_t vbid, size_t bytes);
+
+    /// @return the number of vbuckets loaded from a hash table snapshot
+    size_t getNumSnapshotVBuckets() const {
+        return snapshotVBuckets.load();
+    }
+
     bool setOOMFailure() {
         bool inverse = false;
         return warmupOOMFailure.compare_exchange_strong(inverse, true);
@@ -183,6 +223,9 @@ public:
     void loadDataforShard(uint16_t shardId);
     void done();
 
+    /// The name of a task of the key dump and data loading phases
+    std::string getLoadTaskName(uint16_t taskId) const;
+
 private:
     template <typename T>
     void addStat(const char *nm, const T &val, ADD_STAT add_stat, const void *c) const;
@@ -204,6 +247,48 @@ private:
     void scheduleLoadingData();
     void scheduleCompletion();
 
+    /**
+     * The number of tasks the key dump and data loading phases are split
+     * in: one per shard, each loading the vbuckets of its shard in turn, or
+     * warmup_load_tasks, each loading the next vbucket not taken yet by any
+     * task, so that the loading is spread over all of the reader threads.
+     */
+    size_t getNumLoadTasks() const;
+
+    /// Reset the state shared by the tasks of a key dump or loading phase
+    void prepareLoadingPhase();
+
+    /**
+     * @param taskId the task (shard) loading
+     * @param pos the position of the task in the vbuckets of its shard
+     * @param vbid set to the next vbucket for the task to load
+     * @return false if the task is done
+     */
+    bool nextVBucket(uint16_t taskId, size_t& pos, uint16_t& vbid);
+
+    /// Stop all of the tasks of the phase (the memory limit was reached)
+    void stopLoadingPhase();
+
+    /// Make a vbucket available once its key dump is done (active first)
+    void setMetadataLoaded(uint16_t vbid);
+
+    /**
+     * Load a vbucket from the snapshot of its hash table written by the
+     * last (clean) shutdown, if there is a valid one (ht_snapshot). The
+     * loading phases then skip the vbucket.
+     *
+     * @return true if the vbucket is loaded
+     */
+    bool loadHashTableSnapshot(uint16_t vbid);
+
+    /**
+     * Once the metadata is loaded (value eviction), work out how many values
+     * of each vbucket to load to reach warmup_resident_ratio_target, within
+     * the memory left below the low watermark. The hottest keys (the access
+     * log) are loaded first; a vbucket stops loading once its part is used.
+     */
+    void planValueLoading();
+
     void transition(int to, bool force=false);
 
     WarmupState state;
@@ -219,6 +304,11 @@ private:
     std::atomic<hrtime_t> metadata;
     std::atomic<hrtime_t> warmup;
 
+    /// The time (ns) spent in each state (indexed by the state), and when
+    /// the current state was entered
+    std::vector<std::atomic<hrtime_t>> stateTime;
+    std::atomic<hrtime_t> stateStart;
+
     std::vector<std::map<uint16_t, vbucket_state>> shardVbStates;
     std::atomic<size_t> threadtask_count;
     std::vector<std::atomic<bool>> shardKeyDumpStatus;
@@ -227,6 +317,36 @@ private:
     /// contains all vBucket IDs which are present for the given shard.
     std::vector<std::vector<uint16_t>> shardVbIds;
 
+    /// warmup_load_tasks (0 for one task per shard)
+    const size_t numLoadTasks;
+    /// The vbuckets not yet taken by a task of the phase (warmup_load_tasks)
+    std::mutex loadQueueMutex;
+    std::deque<uint16_t> loadQueue;
+    std::atomic<bool> loadStopped;
+
+    /// warmup_active_first
+    const bool activeFirst;
+    /// Per vbucket: true once it is available (see isVBucketAvailable())
+    std::vector<std::atomic<bool>> vbMetadataLoaded;
+    /// The number of active vbuckets whose key dump isn't done yet
+    std::atomic<size_t> pendingActiveKeyDumps;
+    std::atomic<bool> activeMetadataLoaded;
+
+    /// ht_snapshot
+    const bool htSnapshot;
+    /// Per vbucket: true if it was loaded from its hash table snapshot
+    std::vector<std::atomic<bool>> vbLoadedFromSnapshot;
+    std::atomic<size_t> snapshotVBuckets;
+
+    /// warmup_resident_ratio_target (0 if disabled)
+    const size_t residentRatioTarget;
+    /// Per vbucket: the number and the size of the values left to load
+    std::vector<std::atomic<size_t>> vbValueBudget;
+    std::vector<std::atomic<size_t>> vbByteBudget;
+    /// true once planValueLoading() set the budgets
+    std::atomic<bool> valuesPlanned;
+    std::atomic<size_t> plannedValues;
+
     std::atomic<hrtime_t> estimateTime;
     std::atomic<size_t> estimatedItemCount;
     bool cleanShutdown;
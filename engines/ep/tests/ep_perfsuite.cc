@@ -31,6 +31,8 @@
 
 #include "config.h"
 
+#include <cJSON_utils.h>
+#include <daemon/latency_histogram.h>
 #include <memcached/engine.h>
 #include <memcached/engine_testapp.h>
 
@@ -39,6 +41,7 @@
 #include <condition_variable>
 #include <fstream>
 #include <iterator>
+#include <memory>
 #include <mutex>
 #include <numeric>
 #include <random>
@@ -101,16 +104,18 @@ inline BackgroundWork operator & (BackgroundWork lhs, BackgroundWork rhs) {
             std::underlying_type<BackgroundWork>::type(rhs));
 }
 
-template<typename T>
 struct Stats {
     std::string name;
+    uint64_t count;
     double mean;
     double median;
     double stddev;
     double pct5;
     double pct95;
     double pct99;
-    std::vector<T>* values;
+    double pct999;
+    double max;
+    const LatencyHistogram* histogram;
 };
 
 static const int iterations_for_fast_stats = 100;
@@ -154,6 +159,9 @@ std::unordered_map<std::string, StatProperties> stat_tests = {
         make_stat_pair("dispatcher", {"dispatcher", StatRuntime::Slow, {}}),
         make_stat_pair("scheduler", {"scheduler", StatRuntime::Fast, {}}),
         make_stat_pair("runtimes", {"runtimes", StatRuntime::Fast, {}}),
+        make_stat_pair("tasktimings",
+                       {"tasktimings", StatRuntime::Fast, {}}),
+        make_stat_pair("visitors", {"visitors", StatRuntime::Fast, {}}),
         make_stat_pair("memory", {"memory", StatRuntime::Fast, {}}),
         make_stat_pair("uuid", {"uuid", StatRuntime::Fast, {}}),
         // We add a document with the key __sentinel__ to vbucket 0 at the
@@ -178,11 +186,10 @@ static void fillLineWith(const char c, int spaces) {
 }
 
 // Render the specified value stats, in human-readable text format.
-template<typename T>
-void renderToText(const std::string& name,
-                  const std::string& description,
-                  const std::vector<Stats<T> >& value_stats,
-                  const std::string& unit) {
+static void renderToText(const std::string& name,
+                         const std::string& description,
+                         const std::vector<Stats>& value_stats,
+                         const std::string& unit) {
 
     printf("%s", description.c_str());
     fillLineWith('=', 88 - description.length());
@@ -190,39 +197,43 @@ void renderToText(const std::string& name,
     // From these find the start and end for the spark graphs which covers the
     // a "reasonable sample" of each value set. We define that as from the 5th
     // to the 95th percentile, so we ensure *all* sets have that range covered.
-    T spark_start = std::numeric_limits<T>::max();
-    T spark_end = 0;
+    double spark_start = std::numeric_limits<double>::max();
+    double spark_end = 0;
     for (const auto& stats : value_stats) {
         spark_start = (stats.pct5 < spark_start) ? stats.pct5 : spark_start;
         spark_end = (stats.pct95 > spark_end) ? stats.pct95 : spark_end;
     }
 
-    printf("\n\n                                Percentile           \n");
-    printf("  %-22s Median     95th     99th  Std Dev  Histogram of samples\n\n", "");
+    printf("\n\n                                    Percentile           \n");
+    printf("  %-22s Median     95th     99th   99.9th  Std Dev  "
+           "Histogram of samples\n\n", "");
     // Finally, print out each set.
     for (const auto& stats : value_stats) {
         if (stats.median/1e6 < 1) {
-            printf("%-22s %8.03f %8.03f %8.03f %8.03f  ",
+            printf("%-22s %8.03f %8.03f %8.03f %8.03f %8.03f  ",
                     stats.name.c_str(), stats.median/1e3, stats.pct95/1e3,
-                    stats.pct99/1e3, stats.stddev/1e3);
+                    stats.pct99/1e3, stats.pct999/1e3, stats.stddev/1e3);
         } else {
-            printf("%-15s (x1e3) %8.03f %8.03f %8.03f %8.03f  ",
+            printf("%-15s (x1e3) %8.03f %8.03f %8.03f %8.03f %8.03f  ",
                     stats.name.c_str(), stats.median/1e6, stats.pct95/1e6,
-                    stats.pct99/1e6, stats.stddev/1e6);
+                    stats.pct99/1e6, stats.pct999/1e6, stats.stddev/1e6);
         }
 
         // Calculate and render Sparkline (requires UTF-8 terminal).
         const int nbins = 32;
-        int prev_distance = 0;
+        uint64_t prev_count = 0;
         std::vector<size_t> histogram;
         for (unsigned int bin = 0; bin < nbins; bin++) {
-            const T max_for_bin = (spark_end / nbins) * bin;
-            auto it = std::lower_bound(stats.values->begin(),
-                                       stats.values->end(),
-                                       max_for_bin);
-            const int distance = std::distance(stats.values->begin(), it);
-            histogram.push_back(distance - prev_distance);
-            prev_distance = distance;
+            const auto max_for_bin = hrtime_t((spark_end / nbins) * bin);
+            uint64_t count = 0;
+            for (size_t ii = 0; ii < LatencyHistogram::NumBuckets &&
+                                LatencyHistogram::getUpperBound(ii) <
+                                        max_for_bin;
+                 ++ii) {
+                count += stats.histogram->getBucket(ii);
+            }
+            histogram.push_back(count - prev_count);
+            prev_count = count;
         }
 
         const auto minmax = std::minmax_element(histogram.begin(), histogram.end());
@@ -236,14 +247,14 @@ void renderToText(const std::string& name,
         }
         putchar('\n');
     }
-    printf("%58s  %-14d %s %14d\n\n", "",
+    printf("%67s  %-14d %s %14d\n\n", "",
            int(spark_start/1e3), unit.c_str(), int(spark_end/1e3));
 }
 
-template<typename T>
-void renderToXML(const std::string& name, const std::string& description,
-                 const std::vector<Stats<T> >& value_stats,
-                 const std::string& unit) {
+static void renderToXML(const std::string& name,
+                        const std::string& description,
+                        const std::vector<Stats>& value_stats,
+                        const std::string& unit) {
     std::string test_name = testHarness.output_file_prefix;
     test_name += name;
     std::ofstream file(test_name + ".xml");
@@ -263,45 +274,173 @@ void renderToXML(const std::string& name, const std::string& description,
         << "    <testcase name=\"" << name << "." << stats.name
         << ".pct95\" time=\"" << stats.pct95/1e3 << "\" classname=\"ep-perfsuite\"/>\n"
         << "    <testcase name=\"" << name << "." << stats.name
-        << ".pct99\" time=\"" << stats.pct99/1e3 << "\" classname=\"ep-perfsuite\"/>\n";
+        << ".pct99\" time=\"" << stats.pct99/1e3 << "\" classname=\"ep-perfsuite\"/>\n"
+        << "    <testcase name=\"" << name << "." << stats.name
+        << ".pct999\" time=\"" << stats.pct999/1e3 << "\" classname=\"ep-perfsuite\"/>\n";
     }
     file << "  </testsuite>\n";
     file << "</testsuites>\n";
 }
 
-// Given a vector of values (each a vector<T>) calculate metrics on them
-// and print in the format specified by {testharness.output_format}.
-template<typename T>
-void output_result(const std::string& name,
-                   const std::string& description,
-                   std::vector<std::pair<std::string, std::vector<T>* >> values,
-                   std::string unit) {
+/**
+ * Get the JSON representation of the results of a test, which is also
+ * the format of the baselines the results are compared against (see
+ * compareToBaseline). The values are in the given unit.
+ */
+static unique_cJSON_ptr resultsToJSON(const std::string& name,
+                                      const std::string& description,
+                                      const std::vector<Stats>& value_stats,
+                                      const std::string& unit) {
+    unique_cJSON_ptr root(cJSON_CreateObject());
+    cJSON_AddStringToObject(root.get(), "name", name.c_str());
+    cJSON_AddStringToObject(root.get(), "description", description.c_str());
+    cJSON_AddStringToObject(root.get(), "unit", unit.c_str());
+
+    cJSON* results = cJSON_CreateObject();
+    for (const auto& stats : value_stats) {
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddNumberToObject(obj, "count", double(stats.count));
+        cJSON_AddNumberToObject(obj, "mean", stats.mean / 1e3);
+        cJSON_AddNumberToObject(obj, "stddev", stats.stddev / 1e3);
+        cJSON_AddNumberToObject(obj, "median", stats.median / 1e3);
+        cJSON_AddNumberToObject(obj, "p95", stats.pct95 / 1e3);
+        cJSON_AddNumberToObject(obj, "p99", stats.pct99 / 1e3);
+        cJSON_AddNumberToObject(obj, "p99.9", stats.pct999 / 1e3);
+        cJSON_AddNumberToObject(obj, "max", stats.max / 1e3);
+        cJSON_AddItemToObject(results, stats.name.c_str(), obj);
+    }
+    cJSON_AddItemToObject(root.get(), "results", results);
+    return root;
+}
+
+static void renderToJSON(const std::string& name,
+                         const std::string& description,
+                         const std::vector<Stats>& value_stats,
+                         const std::string& unit) {
+    std::string test_name = testHarness.output_file_prefix;
+    test_name += name;
+    std::ofstream file(test_name + ".json");
+
+    auto json = resultsToJSON(name, description, value_stats, unit);
+    char* ptr = cJSON_Print(json.get());
+    file << ptr << "\n";
+    cJSON_Free(ptr);
+}
+
+/**
+ * Compare the p99.9 of the results with the ones of the baseline of the
+ * test (<baseline_dir>/<name>.json, in the format written by
+ * renderToJSON) if there is one. The baseline may have a "tolerance"
+ * (the percentage a value may regress by, 10% by default).
+ *
+ * @return false if any of the values regressed by more than the tolerance
+ */
+static bool compareToBaseline(const std::string& name,
+                              const std::vector<Stats>& value_stats) {
+    if (testHarness.baseline_dir == nullptr) {
+        return true;
+    }
+
+    const std::string path =
+            std::string(testHarness.baseline_dir) + "/" + name + ".json";
+    std::ifstream file(path);
+    if (!file) {
+        printf("No baseline for %s (%s), not comparing the results\n",
+               name.c_str(), path.c_str());
+        return true;
+    }
+    const std::string content((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    unique_cJSON_ptr baseline(cJSON_Parse(content.c_str()));
+    cJSON* results = baseline ? cJSON_GetObjectItem(baseline.get(), "results")
+                              : nullptr;
+    if (results == nullptr) {
+        fprintf(stderr, "Invalid baseline %s\n", path.c_str());
+        return false;
+    }
+
+    double tolerance = 10;
+    cJSON* obj = cJSON_GetObjectItem(baseline.get(), "tolerance");
+    if (obj != nullptr && obj->type == cJSON_Number) {
+        tolerance = obj->valuedouble;
+    }
+
+    bool ret = true;
+    for (const auto& stats : value_stats) {
+        cJSON* entry = cJSON_GetObjectItem(results, stats.name.c_str());
+        cJSON* expected =
+                entry ? cJSON_GetObjectItem(entry, "p99.9") : nullptr;
+        if (expected == nullptr || expected->type != cJSON_Number) {
+            continue;
+        }
+        const double limit = expected->valuedouble * (1 + tolerance / 100);
+        const double actual = stats.pct999 / 1e3;
+        if (actual > limit) {
+            fprintf(stderr,
+                    "%s.%s: p99.9 of %.03f regressed from the baseline of "
+                    "%.03f (tolerance %.0f%%)\n",
+                    name.c_str(),
+                    stats.name.c_str(),
+                    actual,
+                    expected->valuedouble,
+                    tolerance);
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+/**
+ * Calculate metrics on the given histograms, print them in the format
+ * specified by {testharness.output_format} and compare them with the
+ * baseline of the test.
+ *
+ * @return false if the results regressed from the baseline
+ */
+static bool output_result(
+        const std::string& name,
+        const std::string& description,
+        const std::vector<std::pair<std::string, const LatencyHistogram*>>&
+                values,
+        const std::string& unit) {
     // First, calculate mean, median, standard deviation and percentiles of
     // each set of values, both for printing and to derive what the range of
-    // the graphs should be.
+    // the graphs should be. The histograms only know which bucket a value
+    // is in, so the mean and standard deviation use the middle of them.
     std::string new_name = name;
     std::replace(new_name.begin(), new_name.end(), ' ', '_');
-    std::vector<Stats<T>> value_stats;
+    std::vector<Stats> value_stats;
     for (const auto &t : values) {
-        Stats<T> stats;
+        const LatencyHistogram& histogram = *t.second;
+        Stats stats;
         stats.name = t.first;
-        stats.values = t.second;
-        std::vector <T> &vec = *t.second;
+        stats.histogram = &histogram;
+        stats.count = histogram.getCount();
 
         // Calculate latency percentiles
-        std::sort(vec.begin(), vec.end());
-        stats.median = vec[(vec.size() * 50) / 100];
-        stats.pct5 = vec[(vec.size() * 5) / 100];
-        stats.pct95 = vec[(vec.size() * 95) / 100];
-        stats.pct99 = vec[(vec.size() * 99) / 100];
-
-        const double sum = std::accumulate(vec.begin(), vec.end(), 0.0);
-        stats.mean = sum / vec.size();
+        stats.median = histogram.getPercentile(50);
+        stats.pct5 = histogram.getPercentile(5);
+        stats.pct95 = histogram.getPercentile(95);
+        stats.pct99 = histogram.getPercentile(99);
+        stats.pct999 = histogram.getPercentile(99.9);
+        stats.max = histogram.getPercentile(100);
+
+        double sum = 0.0;
+        for (size_t ii = 0; ii < LatencyHistogram::NumBuckets; ++ii) {
+            sum += histogram.getBucket(ii) *
+                   (double(LatencyHistogram::getLowerBound(ii)) +
+                    LatencyHistogram::getUpperBound(ii)) / 2;
+        }
+        stats.mean = stats.count ? sum / stats.count : 0.0;
         double accum = 0.0;
-        std::for_each (vec.begin(), vec.end(),[&](const double d) {
-            accum += (d - stats.mean) * (d - stats.mean);
-        });
-        stats.stddev = sqrt(accum / (vec.size() - 1));
+        for (size_t ii = 0; ii < LatencyHistogram::NumBuckets; ++ii) {
+            const double d = (double(LatencyHistogram::getLowerBound(ii)) +
+                              LatencyHistogram::getUpperBound(ii)) / 2;
+            accum += histogram.getBucket(ii) * (d - stats.mean) *
+                     (d - stats.mean);
+        }
+        stats.stddev =
+                stats.count > 1 ? sqrt(accum / (stats.count - 1)) : 0.0;
 
         value_stats.push_back(stats);
     }
@@ -315,8 +454,35 @@ void output_result(const std::string& name,
     case OutputFormat::XML:
         renderToXML(new_name, description, value_stats, unit);
         break;
+
+    case OutputFormat::JSON:
+        renderToJSON(new_name, description, value_stats, unit);
+        break;
+    }
+
+    return compareToBaseline(new_name, value_stats);
+}
+
+// As above, for the values (each a vector<T>) of the tests which need
+// every sample (e.g. to match the send and receive times of the items).
+template<typename T>
+static bool output_result(
+        const std::string& name,
+        const std::string& description,
+        std::vector<std::pair<std::string, std::vector<T>*>> values,
+        std::string unit) {
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+    std::vector<std::pair<std::string, const LatencyHistogram*>> all;
+    for (const auto& t : values) {
+        histograms.emplace_back(new LatencyHistogram);
+        for (const auto& value : *t.second) {
+            histograms.back()->add(hrtime_t(value));
+        }
+        all.emplace_back(t.first, histograms.back().get());
     }
+    return output_result(name, description, all, unit);
 }
+
 /* Add a sentinel document (one with a the key SENTINEL_KEY).
  * This can be used by DCP streams to reliably detect the end of
  * a run (sequence numbers are only supported by DCP, and
@@ -350,10 +516,10 @@ static void perf_latency_core(ENGINE_HANDLE *h,
                               ENGINE_HANDLE_V1 *h1,
                               int key_prefix,
                               int num_docs,
-                              std::vector<hrtime_t> &add_timings,
-                              std::vector<hrtime_t> &get_timings,
-                              std::vector<hrtime_t> &replace_timings,
-                              std::vector<hrtime_t> &delete_timings) {
+                              LatencyHistogram& add_timings,
+                              LatencyHistogram& get_timings,
+                              LatencyHistogram& replace_timings,
+                              LatencyHistogram& delete_timings) {
 
     const void *cookie = testHarness.create_cookie();
     const std::string data(100, 'x');
@@ -373,7 +539,7 @@ static void perf_latency_core(ENGINE_HANDLE *h,
                              /*vBucket*/0, 0, 0).first,
                 "Failed to add a value");
         const hrtime_t end = gethrtime();
-        add_timings.push_back(end - start);
+        add_timings.add(end - start);
     }
 
     // Get
@@ -382,7 +548,7 @@ static void perf_latency_core(ENGINE_HANDLE *h,
         auto ret = get(h, h1, cookie, key, 0);
         checkeq(cb::engine_errc::success, ret.first, "Failed to get a value");
         const hrtime_t end = gethrtime();
-        get_timings.push_back(end - start);
+        get_timings.add(end - start);
     }
 
     // Update (Replace)
@@ -394,7 +560,7 @@ static void perf_latency_core(ENGINE_HANDLE *h,
                              /*vBucket*/0, 0, 0).first,
                 "Failed to replace a value");
         const hrtime_t end = gethrtime();
-        replace_timings.push_back(end - start);
+        replace_timings.add(end - start);
     }
 
     // Delete
@@ -404,7 +570,7 @@ static void perf_latency_core(ENGINE_HANDLE *h,
                 del(h, h1, key.c_str(), 0, 0, cookie),
                 "Failed to delete a value");
         const hrtime_t end = gethrtime();
-        delete_timings.push_back(end - start);
+        delete_timings.add(end - start);
     }
 
     testHarness.destroy_cookie(cookie);
@@ -417,12 +583,8 @@ static enum test_result perf_latency(ENGINE_HANDLE *h,
     // Only timing front-end performance, not considering persistence.
     stop_persistence(h, h1);
 
-    std::vector<hrtime_t> add_timings, get_timings,
-                          replace_timings, delete_timings;
-    add_timings.reserve(num_docs);
-    get_timings.reserve(num_docs);
-    replace_timings.reserve(num_docs);
-    delete_timings.reserve(num_docs);
+    LatencyHistogram add_timings, get_timings, replace_timings,
+            delete_timings;
 
     std::string description(std::string("Latency [") + title + "] - " +
                             std::to_string(num_docs) + " items (µs)");
@@ -433,13 +595,13 @@ static enum test_result perf_latency(ENGINE_HANDLE *h,
 
     add_sentinel_doc(h, h1, /*vbid*/0);
 
-    std::vector<std::pair<std::string, std::vector<hrtime_t>*> > all_timings;
-    all_timings.push_back(std::make_pair("Add", &add_timings));
-    all_timings.push_back(std::make_pair("Get", &get_timings));
-    all_timings.push_back(std::make_pair("Replace", &replace_timings));
-    all_timings.push_back(std::make_pair("Delete", &delete_timings));
-    output_result(title, description, all_timings, "µs");
-    return SUCCESS;
+    std::vector<std::pair<std::string, const LatencyHistogram*>> all_timings;
+    all_timings.emplace_back("Add", &add_timings);
+    all_timings.emplace_back("Get", &get_timings);
+    all_timings.emplace_back("Replace", &replace_timings);
+    all_timings.emplace_back("Delete", &delete_timings);
+    return output_result(title, description, all_timings, "µs") ? SUCCESS
+                                                                 : FAIL;
 }
 
 /* Benchmark the baseline latency (without any tasks running) of ep-engine.
@@ -466,28 +628,14 @@ static enum test_result perf_latency_expiry_pager(ENGINE_HANDLE *h,
 
 class ThreadArguments {
 public:
-    void reserve(int n) {
-        add_timings.reserve(n);
-        get_timings.reserve(n);
-        replace_timings.reserve(n);
-        delete_timings.reserve(n);
-    }
-
-    void clear() {
-        add_timings.clear();
-        get_timings.clear();
-        replace_timings.clear();
-        delete_timings.clear();
-    }
-
     ENGINE_HANDLE* h;
     ENGINE_HANDLE_V1* h1;
     int key_prefix;
     int num_docs;
-    std::vector<hrtime_t> add_timings;
-    std::vector<hrtime_t> get_timings;
-    std::vector<hrtime_t> replace_timings;
-    std::vector<hrtime_t> delete_timings;
+    LatencyHistogram add_timings;
+    LatencyHistogram get_timings;
+    LatencyHistogram replace_timings;
+    LatencyHistogram delete_timings;
 };
 
 extern "C" {
@@ -548,7 +696,6 @@ static enum test_result perf_latency_baseline_multi_thread_bucket(engine_test_t*
     for (int ii = 0; ii < n_threads; ii++) {
         thread_args[ii].h = buckets[bucket].h;
         thread_args[ii].h1 = buckets[bucket].h1;
-        thread_args[ii].reserve(num_docs);
         thread_args[ii].num_docs = num_docs;
         thread_args[ii].key_prefix = ii;
         if ((++bucket) == n_buckets) {
@@ -574,34 +721,23 @@ static enum test_result perf_latency_baseline_multi_thread_bucket(engine_test_t*
     }
 
     // For the results, bring all the bucket timings into a single array
-    std::vector<std::pair<std::string, std::vector<hrtime_t>*> > all_timings;
-    std::vector<hrtime_t> add_timings, get_timings, replace_timings,
-                          delete_timings;
+    std::vector<std::pair<std::string, const LatencyHistogram*>> all_timings;
+    LatencyHistogram add_timings, get_timings, replace_timings,
+            delete_timings;
     for (int ii = 0; ii < n_threads; ii++) {
-        add_timings.insert(add_timings.end(),
-                           thread_args[ii].add_timings.begin(),
-                           thread_args[ii].add_timings.end());
-        get_timings.insert(get_timings.end(),
-                           thread_args[ii].get_timings.begin(),
-                           thread_args[ii].get_timings.end());
-        replace_timings.insert(replace_timings.end(),
-                               thread_args[ii].replace_timings.begin(),
-                               thread_args[ii].replace_timings.end());
-        delete_timings.insert(delete_timings.end(),
-                              thread_args[ii].delete_timings.begin(),
-                              thread_args[ii].delete_timings.end());
-        // done with these arrays now
-        thread_args[ii].clear();
+        add_timings += thread_args[ii].add_timings;
+        get_timings += thread_args[ii].get_timings;
+        replace_timings += thread_args[ii].replace_timings;
+        delete_timings += thread_args[ii].delete_timings;
     }
-    all_timings.push_back(std::make_pair("Add", &add_timings));
-    all_timings.push_back(std::make_pair("Get", &get_timings));
-    all_timings.push_back(std::make_pair("Replace", &replace_timings));
-    all_timings.push_back(std::make_pair("Delete", &delete_timings));
+    all_timings.emplace_back("Add", &add_timings);
+    all_timings.emplace_back("Get", &get_timings);
+    all_timings.emplace_back("Replace", &replace_timings);
+    all_timings.emplace_back("Delete", &delete_timings);
     std::stringstream title;
     title << n_buckets << "_buckets_" << n_threads << "_threads_baseline";
-    output_result(title.str(), "Timings", all_timings, "µs");
-
-    return SUCCESS;
+    return output_result(title.str(), "Timings", all_timings, "µs") ? SUCCESS
+                                                                     : FAIL;
 }
 
 static enum test_result perf_latency_baseline_multi_bucket_2(engine_test_t* test) {
@@ -1045,7 +1181,7 @@ static enum test_result perf_dcp_latency_and_bandwidth(ENGINE_HANDLE *h,
                          item_count);
     fillLineWith('=', 86-printed);
 
-    output_result(title, "Size", all_sizes, "KB");
+    bool ok = output_result(title, "Size", all_sizes, "KB");
 
     fillLineWith('=', 86);
 
@@ -1053,10 +1189,10 @@ static enum test_result perf_dcp_latency_and_bandwidth(ENGINE_HANDLE *h,
                      item_count);
     fillLineWith('=', 88-printed);
 
-    output_result(title, "Latency", all_timings, "µs");
+    ok = output_result(title, "Latency", all_timings, "µs") && ok;
     printf("\n\n");
 
-    return SUCCESS;
+    return ok ? SUCCESS : FAIL;
 }
 
 static enum test_result perf_dcp_latency_with_padded_json(ENGINE_HANDLE *h,
@@ -1252,8 +1388,8 @@ static enum test_result perf_stat_latency(ENGINE_HANDLE *h,
 
     std::string description(std::string("Latency [") + title + "] - " +
                             iterations + " items (µs)");
-    output_result(title, description, all_timings, "µs");
-    return SUCCESS;
+    return output_result(title, description, all_timings, "µs") ? SUCCESS
+                                                                 : FAIL;
 }
 
 /* Benchmark the baseline stats (without any tasks running) of ep-engine */
@@ -1306,6 +1442,128 @@ static enum test_result perf_slow_stat_latency_100vb_sets_and_dcp(
                                      BackgroundWork::Dcp), 100);
 }
 
+/*
+ * Benchmark warmup: load items over a number of vbuckets (and build an
+ * access log for them), then restart the bucket (cleanly or not) a few
+ * times, timing the warmup states and measuring the memory used once
+ * warmup is complete.
+ */
+static enum test_result perf_warmup(ENGINE_HANDLE* h,
+                                    ENGINE_HANDLE_V1* h1,
+                                    bool shutdownForce) {
+    if (!isWarmupEnabled(h, h1)) {
+        return SKIPPED;
+    }
+
+    const int num_vbuckets = 16;
+    const size_t num_items = ITERATIONS;
+    const int restarts = 5;
+
+    // Let the access scanner write an access log even though everything
+    // is resident, so that warmup has one to load
+    checkeq(ENGINE_SUCCESS,
+            h1->get_stats(h, NULL, NULL, 0, add_stats),
+            "Failed to get stats.");
+    std::string config(testHarness.get_current_testcase()->cfg);
+    if (!config.empty() && config.back() != ';') {
+        config += ';';
+    }
+    config += std::string("alog_path=") + vals["ep_dbname"] +
+              DIRECTORY_SEPARATOR_CHARACTER + "access.log" +
+              ";alog_resident_ratio_threshold=100";
+    testHarness.reload_engine(&h, &h1, testHarness.engine_path,
+                              config.c_str(), true, false);
+    check(test_setup(h, h1), "Failed to set up the bucket");
+
+    for (int vb = 1; vb < num_vbuckets; vb++) {
+        check(set_vbucket_state(h, h1, vb, vbucket_state_active),
+              "Failed set_vbucket_state for vbucket");
+    }
+
+    const void* cookie = testHarness.create_cookie();
+    const std::string data(100, 'x');
+    for (size_t ii = 0; ii < num_items; ii++) {
+        const auto key = "key" + std::to_string(ii);
+        checkeq(cb::engine_errc::success,
+                storeCasVb11(h, h1, cookie, OPERATION_SET, key.c_str(),
+                             data.c_str(), data.length(), 0, 0,
+                             uint16_t(ii % num_vbuckets), 0, 0).first,
+                "Failed to store a value");
+    }
+    testHarness.destroy_cookie(cookie);
+    wait_for_flusher_to_settle(h, h1);
+
+    const int num_shards =
+            get_int_stat(h, h1, "ep_workload:num_shards", "workload");
+    check(set_param(h, h1, protocol_binary_engine_param_flush,
+                    "access_scanner_run", "true"),
+          "Failed to trigger access scanner");
+    wait_for_stat_to_be(h, h1, "ep_num_access_scanner_runs", num_shards);
+
+    const std::string title =
+            std::string("Warmup_") + get_str_stat(h, h1, "ep_backend") + "_" +
+            get_str_stat(h, h1, "ep_item_eviction_policy") +
+            (shutdownForce ? "_unclean" : "_clean");
+
+    // The warmup stat of each of the timings (in µs), which we keep in ns
+    const std::vector<std::pair<std::string, std::string>> phases = {
+            {"Total", "ep_warmup_time"},
+            {"KeyDump", "ep_warmup_key_dump_time"},
+            {"LoadingAccessLog", "ep_warmup_loading_access_log_time"},
+            {"LoadingKVPairs", "ep_warmup_loading_kv_pairs_time"},
+            {"LoadingData", "ep_warmup_loading_data_time"}};
+    std::vector<std::vector<hrtime_t>> timings(phases.size());
+    std::vector<size_t> mem_used;
+
+    for (int ii = 0; ii < restarts; ii++) {
+        testHarness.reload_engine(&h, &h1, testHarness.engine_path,
+                                  config.c_str(), true, shutdownForce);
+        wait_for_warmup_complete(h, h1);
+
+        vals.clear();
+        checkeq(ENGINE_SUCCESS,
+                h1->get_stats(h, NULL, "warmup", 6, add_stats),
+                "Failed to get the warmup stats");
+        for (size_t phase = 0; phase < phases.size(); phase++) {
+            auto iter = vals.find(phases[phase].second);
+            if (iter != vals.end()) {
+                timings[phase].push_back(std::stoull(iter->second) * 1000);
+            }
+        }
+        mem_used.push_back(get_int_stat(h, h1, "mem_used"));
+        checkeq(int(num_items), get_int_stat(h, h1, "curr_items"),
+                "Warmup didn't load all of the items");
+    }
+
+    std::vector<std::pair<std::string, std::vector<hrtime_t>*>> all_timings;
+    for (size_t phase = 0; phase < phases.size(); phase++) {
+        if (!timings[phase].empty()) {
+            all_timings.emplace_back(phases[phase].first, &timings[phase]);
+        }
+    }
+    std::vector<std::pair<std::string, std::vector<size_t>*>> all_memory;
+    all_memory.emplace_back("mem_used", &mem_used);
+
+    std::string description("Warmup [" + title + "] - " +
+                            std::to_string(num_items) + " items, " +
+                            std::to_string(num_vbuckets) + " vbuckets (µs)");
+    bool ok = output_result(title, description, all_timings, "µs");
+    description = "Warmup [" + title + "] - memory (KB)";
+    ok = output_result(title + "_memory", description, all_memory, "KB") &&
+         ok;
+    return ok ? SUCCESS : FAIL;
+}
+
+static enum test_result perf_warmup_clean(ENGINE_HANDLE* h,
+                                          ENGINE_HANDLE_V1* h1) {
+    return perf_warmup(h, h1, false);
+}
+
+static enum test_result perf_warmup_unclean(ENGINE_HANDLE* h,
+                                            ENGINE_HANDLE_V1* h1) {
+    return perf_warmup(h, h1, true);
+}
+
 /*****************************************************************************
  * List of testcases
  *****************************************************************************/
@@ -1384,6 +1642,42 @@ BaseTestCase testsuite_testcases[] = {
                  perf_slow_stat_latency_100vb_sets_and_dcp, test_setup,
                  teardown, "backend=couchdb;ht_size=393209", prepare, cleanup),
 
+        TestCase("Warmup after clean shutdown", perf_warmup_clean,
+                 test_setup, teardown, "backend=couchdb;ht_size=393209",
+                 prepare_ep_bucket, cleanup),
+        TestCase("Warmup after unclean shutdown", perf_warmup_unclean,
+                 test_setup, teardown, "backend=couchdb;ht_size=393209",
+                 prepare_ep_bucket, cleanup),
+        TestCase("Warmup after clean shutdown (full eviction)",
+                 perf_warmup_clean, test_setup, teardown,
+                 "backend=couchdb;ht_size=393209;"
+                 "item_eviction_policy=full_eviction",
+                 prepare_ep_bucket, cleanup),
+        TestCase("Warmup after unclean shutdown (full eviction)",
+                 perf_warmup_unclean, test_setup, teardown,
+                 "backend=couchdb;ht_size=393209;"
+                 "item_eviction_policy=full_eviction",
+                 prepare_ep_bucket, cleanup),
+#ifdef EP_USE_ROCKSDB
+        TestCase("Warmup after clean shutdown (RocksDB)", perf_warmup_clean,
+                 test_setup, teardown, "backend=rocksdb;ht_size=393209",
+                 prepare_ep_bucket, cleanup),
+        TestCase("Warmup after unclean shutdown (RocksDB)",
+                 perf_warmup_unclean, test_setup, teardown,
+                 "backend=rocksdb;ht_size=393209",
+                 prepare_ep_bucket, cleanup),
+        TestCase("Warmup after clean shutdown (RocksDB, full eviction)",
+                 perf_warmup_clean, test_setup, teardown,
+                 "backend=rocksdb;ht_size=393209;"
+                 "item_eviction_policy=full_eviction",
+                 prepare_ep_bucket, cleanup),
+        TestCase("Warmup after unclean shutdown (RocksDB, full eviction)",
+                 perf_warmup_unclean, test_setup, teardown,
+                 "backend=rocksdb;ht_size=393209;"
+                 "item_eviction_policy=full_eviction",
+                 prepare_ep_bucket, cleanup),
+#endif
+
         TestCase(NULL, NULL, NULL, NULL,
                  "backend=couchdb", prepare, cleanup)
 };
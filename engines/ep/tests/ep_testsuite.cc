@@ -1306,6 +1306,44 @@ static enum test_result test_get_replica(ENGINE_HANDLE *h,
     return SUCCESS;
 }
 
+static enum test_result test_get_replica_min_seqno(ENGINE_HANDLE *h,
+                                                   ENGINE_HANDLE_V1 *h1) {
+    // Stores k0 (seqno 1) to vbucket 0 and makes it a replica
+    cb_free(prepare_get_replica(h, h1, vbucket_state_replica));
+
+    for (uint64_t seqno : {uint64_t(1), uint64_t(2)}) {
+        const uint64_t ext = htonll(seqno);
+        auto* pkt = createPacket(PROTOCOL_BINARY_CMD_GET_REPLICA,
+                                 0,
+                                 0,
+                                 reinterpret_cast<const char*>(&ext),
+                                 sizeof(ext),
+                                 "k0",
+                                 2);
+        checkeq(ENGINE_SUCCESS,
+                h1->unknown_command(
+                        h, NULL, pkt, add_response, testHarness.doc_namespace),
+                "Get Replica Failed");
+        cb_free(pkt);
+        if (seqno == 1) {
+            checkeq(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                    last_status.load(),
+                    "Expected the replica to have reached seqno 1");
+            checkeq(std::string("replicadata"),
+                    last_body,
+                    "Should have returned identical value");
+        } else {
+            checkeq(PROTOCOL_BINARY_RESPONSE_ETMPFAIL,
+                    last_status.load(),
+                    "Expected the replica to be behind seqno 2");
+        }
+    }
+    checkeq(1,
+            get_int_stat(h, h1, "ep_num_replica_reads_behind"),
+            "Expected one replica read to be refused");
+    return SUCCESS;
+}
+
 static enum test_result test_get_replica_non_resident(ENGINE_HANDLE *h,
                                                       ENGINE_HANDLE_V1 *h1) {
 
@@ -2223,6 +2261,9 @@ static enum test_result test_bg_meta_stats(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h
             "Missing key");
     checkeq(1, get_int_stat(h, h1, "ep_bg_fetched"), "Expected bg_fetched to be 1");
     checkeq(1, get_int_stat(h, h1, "ep_bg_meta_fetched"), "Expected bg_meta_fetched to be 1");
+    // The retry of the get took the item the fetch completed it with
+    checkeq(1, get_int_stat(h, h1, "ep_bg_fetched_in_place"),
+            "Expected the get to be completed in place");
 
     // store new key with some random metadata
     const size_t keylen = strlen("k3");
@@ -3612,6 +3653,171 @@ static enum test_result test_all_keys_api_during_bucket_creation(
     return SUCCESS;
 }
 
+/*
+ * Issue a RANGE_SCAN of [start, end) and return the documents of the
+ * response (which leaves the continuation key in last_ext)
+ */
+static std::vector<std::pair<std::string, std::string>> range_scan(
+        ENGINE_HANDLE* h,
+        ENGINE_HANDLE_V1* h1,
+        const std::string& start,
+        const std::string& end,
+        uint32_t count) {
+    uint32_t ext[3] = {htonl(count), 0, 0};
+    protocol_binary_request_header* pkt =
+            createPacket(PROTOCOL_BINARY_CMD_RANGE_SCAN,
+                         0,
+                         0,
+                         reinterpret_cast<char*>(ext),
+                         sizeof(ext),
+                         start.c_str(),
+                         start.size(),
+                         end.c_str(),
+                         end.size());
+    checkeq(ENGINE_SUCCESS,
+            h1->unknown_command(
+                    h, nullptr, pkt, add_response, testHarness.doc_namespace),
+            "Failed to range scan");
+    cb_free(pkt);
+    checkeq(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+            last_status.load(),
+            "Unexpected response status");
+
+    // keylen (2), flags (4), valuelen (4), cas (8), datatype (1), key, value
+    std::vector<std::pair<std::string, std::string>> docs;
+    size_t offset = 0;
+    while (offset < last_body.size()) {
+        uint16_t keylen;
+        uint32_t valuelen;
+        memcpy(&keylen, last_body.data() + offset, sizeof(keylen));
+        memcpy(&valuelen, last_body.data() + offset + 6, sizeof(valuelen));
+        offset += 19;
+        std::string key = last_body.substr(offset, ntohs(keylen));
+        offset += key.size();
+        docs.emplace_back(std::move(key),
+                          last_body.substr(offset, ntohl(valuelen)));
+        offset += docs.back().second.size();
+    }
+    return docs;
+}
+
+static enum test_result test_range_scan(ENGINE_HANDLE* h,
+                                        ENGINE_HANDLE_V1* h1) {
+    if (!isPersistentBucket(h, h1)) {
+        uint32_t ext[3] = {0, 0, 0};
+        protocol_binary_request_header* pkt =
+                createPacket(PROTOCOL_BINARY_CMD_RANGE_SCAN,
+                             0,
+                             0,
+                             reinterpret_cast<char*>(ext),
+                             sizeof(ext),
+                             "key_0",
+                             5);
+        checkeq(ENGINE_ENOTSUP,
+                h1->unknown_command(h,
+                                    nullptr,
+                                    pkt,
+                                    add_response,
+                                    testHarness.doc_namespace),
+                "Should return not supported");
+        cb_free(pkt);
+        return SUCCESS;
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        std::string key("key_0" + std::to_string(i));
+        checkeq(ENGINE_SUCCESS,
+                store(h, h1, NULL, OPERATION_SET, key.c_str(), "old", nullptr),
+                "Failed to store a value");
+    }
+    wait_for_flusher_to_settle(h, h1);
+
+    // The scan should see the documents which aren't persisted yet: an
+    // update, a deletion and a new key
+    stop_persistence(h, h1);
+    checkeq(ENGINE_SUCCESS,
+            store(h, h1, NULL, OPERATION_SET, "key_03", "new", nullptr),
+            "Failed to update a value");
+    checkeq(ENGINE_SUCCESS, del(h, h1, "key_05", 0, 0), "Failed to delete");
+    checkeq(ENGINE_SUCCESS,
+            store(h, h1, NULL, OPERATION_SET, "key_045", "new", nullptr),
+            "Failed to store a value");
+
+    using Docs = std::vector<std::pair<std::string, std::string>>;
+    check(Docs({{"key_02", "old"}, {"key_03", "new"}, {"key_04", "old"}}) ==
+                  range_scan(h, h1, "key_02", "key_08", 3),
+          "Unexpected documents in the first page");
+    checkeq(std::string("key_045"), last_ext, "Unexpected continuation key");
+
+    check(Docs({{"key_045", "new"}, {"key_06", "old"}, {"key_07", "old"}}) ==
+                  range_scan(h, h1, "key_045", "key_08", 3),
+          "Unexpected documents in the second page");
+    checkeq(std::string(), last_ext, "The range should be complete");
+
+    start_persistence(h, h1);
+    return SUCCESS;
+}
+
+static enum test_result test_get_seqno_range(ENGINE_HANDLE* h,
+                                             ENGINE_HANDLE_V1* h1) {
+    for (int i = 0; i < 10; ++i) {
+        std::string key("key_" + std::to_string(i));
+        checkeq(ENGINE_SUCCESS,
+                store(h, h1, NULL, OPERATION_SET, key.c_str(), "value",
+                      nullptr),
+                "Failed to store a value");
+    }
+    checkeq(ENGINE_SUCCESS, del(h, h1, "key_3", 0, 0), "Failed to delete");
+    // A persistent bucket only reads what is persisted
+    wait_for_flusher_to_settle(h, h1);
+
+    const void* cookie = testHarness.create_cookie();
+    const uint64_t end =
+            get_int_stat(h, h1, "vb_0:high_seqno", "vbucket-seqno");
+    cb::SeqnoRangeBatch batch;
+    checkeq(ENGINE_EINVAL,
+            h1->get_seqno_range(h, cookie, 0, end, 1, 0, batch),
+            "The start of the range should be before its end");
+    checkeq(ENGINE_NOT_MY_VBUCKET,
+            h1->get_seqno_range(h, cookie, 1, 1, end, 0, batch),
+            "vb 1 doesn't exist");
+
+    // A batch of a single document at a time (as it is over max_bytes)
+    std::vector<std::pair<std::string, bool>> docs;
+    uint64_t seqno = 0;
+    uint64_t start = 1;
+    while (start <= end) {
+        checkeq(ENGINE_SUCCESS,
+                h1->get_seqno_range(h, cookie, 0, start, end, 1, batch),
+                "Failed to read the range");
+        checkeq(size_t(1), batch.items.size(), "Expected one document");
+        item_info info;
+        check(h1->get_item_info(h, cookie, batch.items.front().get(), &info),
+              "Failed to get the item info");
+        check(info.seqno > seqno, "The documents should be in seqno order");
+        check(info.seqno < batch.next, "The next batch should follow it");
+        seqno = info.seqno;
+        docs.emplace_back(
+                std::string(static_cast<const char*>(info.key), info.nkey),
+                info.document_state == DocumentState::Deleted);
+        start = batch.next;
+    }
+    checkeq(size_t(10), docs.size(), "Expected every key once");
+    check(docs.back() == std::make_pair(std::string("key_3"), true),
+          "The deletion should come last");
+
+    // All of it in one batch, past which there is nothing to read yet
+    checkeq(ENGINE_SUCCESS,
+            h1->get_seqno_range(h, cookie, 0, 1, end + 10, 0, batch),
+            "Failed to read the range");
+    checkeq(size_t(10), batch.items.size(), "Expected all of the documents");
+    checkeq(end + 1, batch.next, "Should continue after the high seqno");
+
+    batch.items.clear();
+    testHarness.destroy_cookie(cookie);
+    return SUCCESS;
+}
+
 static enum test_result test_curr_items_add_set(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
     item *i = NULL;
 
@@ -6187,11 +6393,26 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
         },
         {"dcp",
             {
+                "ep_dcp_backfill_bytes_read",
                 "ep_dcp_count",
                 "ep_dcp_dead_conn_count",
+                "ep_dcp_high_items_remaining",
+                "ep_dcp_high_items_sent",
+                "ep_dcp_high_producer_count",
+                "ep_dcp_high_total_bytes",
                 "ep_dcp_items_remaining",
                 "ep_dcp_items_sent",
+                "ep_dcp_low_items_remaining",
+                "ep_dcp_low_items_sent",
+                "ep_dcp_low_producer_count",
+                "ep_dcp_low_total_bytes",
+                "ep_dcp_max_backfill_bytes",
                 "ep_dcp_max_running_backfills",
+                "ep_dcp_medium_items_remaining",
+                "ep_dcp_medium_items_sent",
+                "ep_dcp_medium_producer_count",
+                "ep_dcp_medium_total_bytes",
+                "ep_dcp_num_pending_backfills",
                 "ep_dcp_num_running_backfills",
                 "ep_dcp_producer_count",
                 "ep_dcp_queue_fill",
@@ -6294,6 +6515,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
         {"checkpoint",
             {
                 "vb_0:last_closed_checkpoint_id",
+                "vb_0:mem_overhead",
                 "vb_0:mem_usage",
                 "vb_0:num_checkpoint_items",
                 "vb_0:num_checkpoints",
@@ -6307,6 +6529,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
         {"checkpoint 0",
             {
                 "vb_0:last_closed_checkpoint_id",
+                "vb_0:mem_overhead",
                 "vb_0:mem_usage",
                 "vb_0:num_checkpoint_items",
                 "vb_0:num_checkpoints",
@@ -6344,22 +6567,33 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_bfilter_key_count",
                 "ep_bfilter_residency_threshold",
                 "ep_bg_fetch_delay",
+                "ep_bgfetcher_coalesce_window",
                 "ep_bucket_type",
                 "ep_cache_size",
+                "ep_checkpoint_memory_ratio",
+                "ep_chk_expel_enabled",
                 "ep_chk_max_items",
+                "ep_chk_max_size",
                 "ep_chk_period",
                 "ep_chk_remover_stime",
                 "ep_collections_prototype_enabled",
                 "ep_compaction_exp_mem_threshold",
+                "ep_compaction_max_write_rate",
                 "ep_compaction_write_queue_cap",
                 "ep_config_file",
                 "ep_conflict_resolution_type",
                 "ep_connection_manager_interval",
                 "ep_couch_bucket",
+                "ep_couchstore_backfill_readahead",
+                "ep_couchstore_bgfetch_readahead",
+                "ep_couchstore_block_cache_size",
+                "ep_couchstore_direct_io",
+                "ep_couchstore_value_dictionary",
                 "ep_cursor_dropping_lower_mark",
                 "ep_cursor_dropping_upper_mark",
                 "ep_data_traffic_enabled",
                 "ep_dbname",
+                "ep_dcp_backfill_aggr_mem_threshold",
                 "ep_dcp_backfill_byte_limit",
                 "ep_dcp_conn_buffer_size",
                 "ep_dcp_conn_buffer_size_aggr_mem_threshold",
@@ -6374,7 +6608,11 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_dcp_idle_timeout",
                 "ep_dcp_noop_mandatory_for_v5_features",
                 "ep_dcp_noop_tx_interval",
+                "ep_dcp_priority_weight_high",
+                "ep_dcp_priority_weight_low",
+                "ep_dcp_priority_weight_medium",
                 "ep_dcp_producer_snapshot_marker_yield_limit",
+                "ep_dcp_producer_step_batch_size",
                 "ep_dcp_consumer_process_buffered_messages_yield_limit",
                 "ep_dcp_consumer_process_buffered_messages_batch_size",
                 "ep_dcp_scan_byte_limit",
@@ -6386,11 +6624,21 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_defragmenter_enabled",
                 "ep_defragmenter_interval",
                 "ep_enable_chk_merge",
+                "ep_executor_auto_tune",
+                "ep_executor_auto_tune_max_threads",
+                "ep_executor_auto_tune_min_threads",
+                "ep_executor_fair_share",
+                "ep_executor_numa_affinity",
+                "ep_executor_reserved_threads",
+                "ep_executor_share_weight",
+                "ep_executor_timer_wheel",
+                "ep_executor_work_stealing",
                 "ep_exp_pager_enabled",
                 "ep_exp_pager_initial_run_time",
                 "ep_exp_pager_stime",
                 "ep_failpartialwarmup",
                 "ep_flushall_enabled",
+                "ep_flusher_max_batch_delay",
                 "ep_fsync_after_every_n_bytes_written",
                 "ep_getl_default_timeout",
                 "ep_getl_max_timeout",
@@ -6399,6 +6647,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_ht_locks",
                 "ep_ht_resize_interval",
                 "ep_ht_size",
+                "ep_ht_snapshot",
                 "ep_initfile",
                 "ep_item_num_based_new_chk",
                 "ep_keep_closed_chks",
@@ -6434,11 +6683,15 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_time_synchronization",
                 "ep_uuid",
                 "ep_vb0",
+                "ep_visitor_chunk_duration",
                 "ep_waitforwarmup",
                 "ep_warmup",
+                "ep_warmup_active_first",
                 "ep_warmup_batch_size",
+                "ep_warmup_load_tasks",
                 "ep_warmup_min_items_threshold",
                 "ep_warmup_min_memory_threshold",
+                "ep_warmup_resident_ratio_target",
                 "ep_xattr_enabled"
             }
         },
@@ -6489,6 +6742,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "curr_temp_items",
                 "ep_access_scanner_last_runtime",
                 "ep_access_scanner_num_items",
+                "ep_access_scanner_reused_vbuckets",
                 "ep_access_scanner_task_time",
                 "ep_active_ahead_exceptions",
                 "ep_active_behind_exceptions",
@@ -6511,26 +6765,39 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_bg_fetch_avg_read_amplification",
                 "ep_bg_fetch_delay",
                 "ep_bg_fetched",
+                "ep_bg_fetched_in_place",
                 "ep_bg_meta_fetched",
                 "ep_bg_remaining_items",
                 "ep_bg_remaining_jobs",
+                "ep_bgfetcher_coalesce_window",
                 "ep_blob_num",
                 "ep_blob_overhead",
                 "ep_bucket_priority",
                 "ep_bucket_type",
                 "ep_cache_size",
+                "ep_checkpoint_memory",
+                "ep_checkpoint_memory_quota",
+                "ep_checkpoint_memory_ratio",
+                "ep_chk_expel_enabled",
                 "ep_chk_max_items",
+                "ep_chk_max_size",
                 "ep_chk_period",
                 "ep_chk_persistence_remains",
                 "ep_chk_remover_stime",
                 "ep_clock_cas_drift_threshold_exceeded",
                 "ep_collections_prototype_enabled",
                 "ep_compaction_exp_mem_threshold",
+                "ep_compaction_max_write_rate",
                 "ep_compaction_write_queue_cap",
                 "ep_config_file",
                 "ep_conflict_resolution_type",
                 "ep_connection_manager_interval",
                 "ep_couch_bucket",
+                "ep_couchstore_backfill_readahead",
+                "ep_couchstore_bgfetch_readahead",
+                "ep_couchstore_block_cache_size",
+                "ep_couchstore_direct_io",
+                "ep_couchstore_value_dictionary",
                 "ep_cursor_dropping_lower_mark",
                 "ep_cursor_dropping_lower_threshold",
                 "ep_cursor_dropping_upper_mark",
@@ -6538,6 +6805,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_cursors_dropped",
                 "ep_data_traffic_enabled",
                 "ep_dbname",
+                "ep_dcp_backfill_aggr_mem_threshold",
                 "ep_dcp_backfill_byte_limit",
                 "ep_dcp_conn_buffer_size",
                 "ep_dcp_conn_buffer_size_aggr_mem_threshold",
@@ -6554,7 +6822,11 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_dcp_min_compression_ratio",
                 "ep_dcp_noop_mandatory_for_v5_features",
                 "ep_dcp_noop_tx_interval",
+                "ep_dcp_priority_weight_high",
+                "ep_dcp_priority_weight_low",
+                "ep_dcp_priority_weight_medium",
                 "ep_dcp_producer_snapshot_marker_yield_limit",
+                "ep_dcp_producer_step_batch_size",
                 "ep_dcp_scan_byte_limit",
                 "ep_dcp_scan_item_limit",
                 "ep_dcp_takeover_max_time",
@@ -6572,6 +6844,15 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_diskqueue_memory",
                 "ep_diskqueue_pending",
                 "ep_enable_chk_merge",
+                "ep_executor_auto_tune",
+                "ep_executor_auto_tune_max_threads",
+                "ep_executor_auto_tune_min_threads",
+                "ep_executor_fair_share",
+                "ep_executor_numa_affinity",
+                "ep_executor_reserved_threads",
+                "ep_executor_share_weight",
+                "ep_executor_timer_wheel",
+                "ep_executor_work_stealing",
                 "ep_exp_pager_enabled",
                 "ep_exp_pager_initial_run_time",
                 "ep_exp_pager_stime",
@@ -6583,6 +6864,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_flush_all",
                 "ep_flush_duration_total",
                 "ep_flushall_enabled",
+                "ep_flusher_max_batch_delay",
                 "ep_fsync_after_every_n_bytes_written",
                 "ep_getl_default_timeout",
                 "ep_getl_max_timeout",
@@ -6591,6 +6873,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_ht_locks",
                 "ep_ht_resize_interval",
                 "ep_ht_size",
+                "ep_ht_snapshot",
                 "ep_initfile",
                 "ep_io_bg_fetch_read_count",
                 "ep_io_compaction_read_bytes",
@@ -6599,6 +6882,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_io_total_write_bytes",
                 "ep_item_num",
                 "ep_item_num_based_new_chk",
+                "ep_items_expelled_from_checkpoints",
                 "ep_items_rm_from_checkpoints",
                 "ep_keep_closed_chks",
                 "ep_kv_size",
@@ -6696,11 +6980,15 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_vb_total",
                 "ep_vbucket_del",
                 "ep_vbucket_del_fail",
+                "ep_visitor_chunk_duration",
                 "ep_waitforwarmup",
                 "ep_warmup",
+                "ep_warmup_active_first",
                 "ep_warmup_batch_size",
+                "ep_warmup_load_tasks",
                 "ep_warmup_min_items_threshold",
                 "ep_warmup_min_memory_threshold",
+                "ep_warmup_resident_ratio_target",
                 "ep_workload_pattern",
                 "ep_xattr_enabled",
                 "mem_used",
@@ -6803,6 +7091,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                                                             "ep_flusher_todo"});
         eng_stats.insert(eng_stats.end(),
                          {"ep_commit_num",
+                          "ep_commit_group_num",
+                          "ep_commit_group_vbuckets",
                           "ep_commit_time",
                           "ep_commit_time_total",
                           "ep_item_begin_failed",
@@ -6817,6 +7107,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
         eng_stats.insert(eng_stats.end(),
                          {"ep_access_scanner_enabled",
                           "ep_alog_block_size",
+                          "ep_alog_incremental",
                           "ep_alog_max_stored_items",
                           "ep_alog_path",
                           "ep_alog_resident_ratio_threshold",
@@ -6849,6 +7140,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
         config_stats.insert(config_stats.end(),
                             {"ep_access_scanner_enabled",
                              "ep_alog_block_size",
+                             "ep_alog_incremental",
                              "ep_alog_max_stored_items",
                              "ep_alog_path",
                              "ep_alog_resident_ratio_threshold",
@@ -6864,6 +7156,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                           "ep_ephemeral_metadata_purge_age",
                           "ep_ephemeral_metadata_purge_chunk_duration",
                           "ep_ephemeral_metadata_purge_interval",
+                          "ep_ephemeral_metadata_purge_stale_target",
 
                           "vb_active_auto_delete_count",
                           "vb_active_ht_tombstone_purged_count",
@@ -6916,7 +7209,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                             {"ep_ephemeral_full_policy",
                              "ep_ephemeral_metadata_purge_age",
                              "ep_ephemeral_metadata_purge_chunk_duration",
-                             "ep_ephemeral_metadata_purge_interval"});
+                             "ep_ephemeral_metadata_purge_interval",
+                             "ep_ephemeral_metadata_purge_stale_target"});
     }
 
     // In addition to the exact stat keys above, we also use regex patterns
@@ -7049,6 +7343,7 @@ static enum test_result test_mb19687_variable(ENGINE_HANDLE* h,
                 "ep_tmp_oom_errors",
                 "ep_value_size",
                 "mem_used",
+                "mem_used_estimate",
             }
         },
 
@@ -7063,6 +7358,12 @@ static enum test_result test_mb19687_variable(ENGINE_HANDLE* h,
         {"runtimes",
             {}
         },
+        {"tasktimings",
+            {}
+        },
+        {"visitors",
+            {}
+        },
         {"kvtimings",
             {}
         },
@@ -7420,6 +7721,13 @@ BaseTestCase testsuite_testcases[] = {
                  test_setup, teardown, NULL, prepare, cleanup),
         TestCase("replica read: invalid key", test_get_replica_invalid_key,
                  test_setup, teardown, NULL, prepare, cleanup),
+        TestCase("replica read: min seqno",
+                 test_get_replica_min_seqno,
+                 test_setup,
+                 teardown,
+                 NULL,
+                 prepare,
+                 cleanup),
         TestCase("test getr with evicted key",
                  test_get_replica_non_resident,
                  test_setup,
@@ -7645,6 +7953,20 @@ BaseTestCase testsuite_testcases[] = {
                  nullptr,
                  prepare,
                  cleanup),
+        TestCase("test RANGE_SCAN api",
+                 test_range_scan,
+                 test_setup,
+                 teardown,
+                 nullptr,
+                 prepare_skip_broken_under_rocks,
+                 cleanup),
+        TestCase("test get_seqno_range",
+                 test_get_seqno_range,
+                 test_setup,
+                 teardown,
+                 nullptr,
+                 prepare,
+                 cleanup),
         TestCase("ep worker stats", test_worker_stats,
                  test_setup, teardown,
                  "max_num_workers=8;max_threads=8", prepare, cleanup),
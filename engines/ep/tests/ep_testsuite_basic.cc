@@ -2336,6 +2336,12 @@ BaseTestCase testsuite_testcases[] = {
                  "flushall_enabled=true;max_vbuckets=16;ht_size=7;ht_locks=3",
                  /* TODO Ephemeral: FLUSH currently not working*/prepare_skip_broken_under_ephemeral,
                  cleanup),
+        TestCase("flush multi vbuckets by swap", test_flush_multiv,
+                 test_setup, teardown,
+                 "flushall_enabled=true;flush_mode=swap;max_vbuckets=16;"
+                 "ht_size=7;ht_locks=3",
+                 prepare_skip_broken_under_ephemeral,
+                 cleanup),
         TestCase("flush_disabled",
                  test_flush_disabled,
                  test_setup,
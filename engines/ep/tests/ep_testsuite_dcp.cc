@@ -1406,6 +1406,34 @@ static enum test_result test_dcp_consumer_flow_control_dynamic(ENGINE_HANDLE *h,
     return SUCCESS;
 }
 
+static enum test_result test_dcp_consumer_flow_control_adaptive(
+                                                        ENGINE_HANDLE *h,
+                                                        ENGINE_HANDLE_V1 *h1) {
+    const auto *cookie1 = testHarness.create_cookie();
+    const std::string name("unittest");
+    const uint32_t opaque = 0;
+    const uint32_t seqno = 0;
+    const uint32_t flags = 0;
+    const auto flow_ctl_buf_min = 10485760;
+    checkeq(ENGINE_SUCCESS,
+            h1->dcp.open(h, cookie1, opaque, seqno, flags, name, {}),
+            "Failed dcp consumer open connection.");
+
+    /* A new connection starts at the min, until it is measured */
+    const auto stat_name("eq_dcpq:" + name + ":max_buffer_bytes");
+    checkeq(flow_ctl_buf_min,
+            get_int_stat(h, h1, stat_name.c_str(), "dcp"),
+            "Flow Control Buffer Size not equal to min");
+    const auto history_name("eq_dcpq:" + name + ":max_buffer_bytes_history");
+    const auto history = get_str_stat(h, h1, history_name.c_str(), "dcp");
+    checkeq(std::to_string(flow_ctl_buf_min),
+            history.substr(0, history.find('@')),
+            "Flow Control Buffer Size history not starting at min");
+    testHarness.destroy_cookie(cookie1);
+
+    return SUCCESS;
+}
+
 static enum test_result test_dcp_consumer_flow_control_aggressive(
                                                         ENGINE_HANDLE *h,
                                                         ENGINE_HANDLE_V1 *h1) {
@@ -5936,6 +5964,8 @@ static enum test_result test_set_dcp_param(ENGINE_HANDLE *h,
     func("dcp_consumer_process_buffered_messages_batch_size", 1000, true);
     func("dcp_consumer_process_buffered_messages_yield_limit", 0, false);
     func("dcp_consumer_process_buffered_messages_batch_size", 0, false);
+    func("dcp_producer_step_batch_size", 1000, true);
+    func("dcp_producer_step_batch_size", 0, false);
     return SUCCESS;
 }
 
@@ -5978,6 +6008,10 @@ BaseTestCase testsuite_testcases[] = {
                  test_dcp_consumer_flow_control_aggressive,
                  test_setup, teardown, "dcp_flow_control_policy=aggressive",
                  prepare, cleanup),
+        TestCase("test dcp consumer flow control adaptive",
+                 test_dcp_consumer_flow_control_adaptive,
+                 test_setup, teardown, "dcp_flow_control_policy=adaptive",
+                 prepare, cleanup),
         TestCase("test open producer", test_dcp_producer_open,
                  test_setup, teardown, nullptr, prepare, cleanup),
         TestCase("test open producer same cookie", test_dcp_producer_open_same_cookie,
@@ -1082,6 +1082,93 @@ static enum test_result test_set_with_meta_by_force(ENGINE_HANDLE *h,
     return SUCCESS;
 }
 
+static void add_with_meta_batch_entry(std::vector<char>& body,
+                                      WithMetaBatchOp op,
+                                      const std::string& key,
+                                      const std::string& value,
+                                      const ItemMetaData& meta) {
+    WithMetaBatchEntry entry;
+    entry.op = uint8_t(op);
+    entry.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    entry.keylen = htons(uint16_t(key.size()));
+    entry.flags = meta.flags;
+    entry.expiration = htonl(uint32_t(meta.exptime));
+    entry.seqno = htonll(meta.revSeqno);
+    entry.cas = htonll(meta.cas);
+    entry.nmeta = 0;
+    entry.valuelen = htonl(uint32_t(value.size()));
+    const char* ptr = reinterpret_cast<const char*>(&entry);
+    body.insert(body.end(), ptr, ptr + sizeof(entry));
+    body.insert(body.end(), key.begin(), key.end());
+    body.insert(body.end(), value.begin(), value.end());
+}
+
+static enum test_result test_with_meta_batch(ENGINE_HANDLE *h,
+                                             ENGINE_HANDLE_V1 *h1) {
+    checkeq(ENGINE_SUCCESS,
+            store(h, h1, NULL, OPERATION_SET, "existing", "value", nullptr),
+            "Failed set.");
+    wait_for_flusher_to_settle(h, h1);
+
+    const ItemMetaData setMeta(0xdeadbeef, 10, 0xdeadbeef, 0);
+    const ItemMetaData delMeta(0xcafef00d, 100, 0, 0);
+    std::vector<char> body;
+    add_with_meta_batch_entry(
+            body, WithMetaBatchOp::Set, "batch_a", "a", setMeta);
+    add_with_meta_batch_entry(
+            body, WithMetaBatchOp::Add, "existing", "b", setMeta);
+    add_with_meta_batch_entry(
+            body, WithMetaBatchOp::Delete, "existing", "", delMeta);
+
+    protocol_binary_request_header* pkt =
+            createPacket(PROTOCOL_BINARY_CMD_WITH_META_BATCH, 0, 0, nullptr,
+                         0, "", 0, body.data(), body.size());
+    checkeq(ENGINE_SUCCESS,
+            h1->unknown_command(h, nullptr, pkt, add_response,
+                                testHarness.doc_namespace),
+            "Expected the batch to be accepted");
+    cb_free(pkt);
+    checkeq(PROTOCOL_BINARY_RESPONSE_SUCCESS, last_status.load(),
+            "Expected success");
+    checkeq(3 * sizeof(WithMetaBatchResult), last_body.size(),
+            "Expected a result for every document");
+
+    WithMetaBatchResult results[3];
+    memcpy(results, last_body.data(), sizeof(results));
+    checkeq(uint16_t(PROTOCOL_BINARY_RESPONSE_SUCCESS),
+            ntohs(results[0].status), "Expected the set to succeed");
+    checkeq(uint64_t(0xdeadbeef), ntohll(results[0].cas),
+            "Expected the cas of the set to be the one requested");
+    checkeq(uint16_t(PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS),
+            ntohs(results[1].status), "Expected the add to fail");
+    checkeq(uint16_t(PROTOCOL_BINARY_RESPONSE_SUCCESS),
+            ntohs(results[2].status), "Expected the delete to succeed");
+
+    checkeq(1, get_int_stat(h, h1, "ep_num_ops_set_meta"),
+            "Expected one set_with_meta");
+    checkeq(1, get_int_stat(h, h1, "ep_num_ops_del_meta"),
+            "Expected one del_with_meta");
+
+    check_key_value(h, h1, "batch_a", "a", 1);
+    checkeq(ENGINE_KEY_ENOENT, verify_key(h, h1, "existing"),
+            "Expected the document to be deleted");
+
+    // A batch which isn't framed correctly is rejected as a whole
+    pkt = createPacket(PROTOCOL_BINARY_CMD_WITH_META_BATCH, 0, 0, nullptr, 0,
+                       "", 0, body.data(), body.size() - 1);
+    checkeq(ENGINE_SUCCESS,
+            h1->unknown_command(h, nullptr, pkt, add_response,
+                                testHarness.doc_namespace),
+            "Expected the batch to be rejected");
+    cb_free(pkt);
+    checkeq(PROTOCOL_BINARY_RESPONSE_EINVAL, last_status.load(),
+            "Expected a malformed batch to be rejected");
+    checkeq(1, get_int_stat(h, h1, "ep_num_ops_set_meta"),
+            "Expected nothing of the malformed batch to be applied");
+
+    return SUCCESS;
+}
+
 static enum test_result test_set_with_meta_deleted(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
     const char* key = "set_with_meta_key";
     size_t keylen = strlen(key);
@@ -2657,6 +2744,8 @@ BaseTestCase testsuite_testcases[] = {
                  cleanup),
         TestCase("set with meta by force", test_set_with_meta_by_force,
                  test_setup, teardown, NULL, prepare, cleanup),
+        TestCase("with meta batch", test_with_meta_batch, test_setup,
+                 teardown, NULL, prepare, cleanup),
         TestCase("set with meta deleted",
                  test_set_with_meta_deleted,
                  test_setup,
@@ -45,7 +45,7 @@ public:
     }
 
     void addConn(const void* cookie, connection_t conn) {
-        LockHolder lh(connsLock);
+        ConnsLockHolder lh(connsLock);
         map_[cookie] = conn;
     }
 };
@@ -70,7 +70,7 @@ public:
         return nextCheckpointItem();
     }
 
-    const std::queue<std::unique_ptr<DcpResponse>>& public_readyQ() {
+    const ReadyQueue& public_readyQ() {
         return readyQ;
     }
 
@@ -260,8 +260,7 @@ public:
     }
 
     size_t getNumBufferItems() const {
-        LockHolder lh(buffer.bufMutex);
-        return buffer.messages.size();
+        return buffer.size();
     }
 
     uint32_t responseMessageSize;
@@ -37,6 +37,10 @@ public:
     void setKVBucket(std::unique_ptr<KVBucket> store);
     void setDcpConnMap(std::unique_ptr<DcpConnMap> dcpConnMap);
 
+    void setArena(unsigned newArena) {
+        arena = newArena;
+    }
+
     /* Allow us to call normally protected methods */
 
     ENGINE_ERROR_CODE public_doDcpVbTakeoverStats(const void* cookie,
@@ -443,6 +443,56 @@ TEST_F(BasicLinkedListTest, UpdateDuringRangeRead) {
     EXPECT_EQ(expectedSeqno, basicLL->getAllSeqnoForVerification());
 }
 
+/* Relink an element (as the defragmenter does); the copy takes its place */
+TEST_F(BasicLinkedListTest, RelinkElem) {
+    const int numItems = 3;
+    const std::string keyPrefix("key");
+    addNewItemsToList(1, keyPrefix, numItems);
+
+    const auto key = makeStoredDocKey(keyPrefix + std::to_string(2));
+    auto hbl = ht.getLockedBucket(key);
+    StoredValue* sv = ht.unlocked_find(
+            key, hbl.getBucketNum(), WantsDeleted::No, TrackReference::No);
+    ASSERT_NE(nullptr, sv);
+
+    std::lock_guard<std::mutex> listWriteLg(basicLL->getListWriteLock());
+    ASSERT_TRUE(basicLL->isRelinkable(listWriteLg, *sv->toOrderedStoredValue()));
+    auto res = ht.unlocked_relocate(hbl, *sv);
+    EXPECT_NE(sv, res.first);
+    basicLL->relinkListElem(listWriteLg,
+                            *res.second->toOrderedStoredValue(),
+                            *res.first->toOrderedStoredValue());
+    res.second.reset();
+
+    std::vector<seqno_t> expectedSeqno = {1, 2, 3};
+    EXPECT_EQ(expectedSeqno, basicLL->getAllSeqnoForVerification());
+    EXPECT_EQ(numItems, basicLL->getNumItems());
+}
+
+/* Elements in a read range, or which stale elements may refer to, can't be
+   relinked */
+TEST_F(BasicLinkedListTest, RelinkElemNotAllowed) {
+    const int numItems = 3;
+    const std::string keyPrefix("key");
+    addNewItemsToList(1, keyPrefix, numItems);
+
+    auto* osv = ht.find(makeStoredDocKey(keyPrefix + std::to_string(3)),
+                        TrackReference::No,
+                        WantsDeleted::No)
+                        ->toOrderedStoredValue();
+
+    basicLL->registerFakeReadRange(2, numItems);
+    {
+        std::lock_guard<std::mutex> listWriteLg(basicLL->getListWriteLock());
+        EXPECT_FALSE(basicLL->isRelinkable(listWriteLg, *osv));
+    }
+    basicLL->resetReadRange();
+
+    addStaleItem("stale", numItems + 1);
+    std::lock_guard<std::mutex> listWriteLg(basicLL->getListWriteLock());
+    EXPECT_FALSE(basicLL->isRelinkable(listWriteLg, *osv));
+}
+
 TEST_F(BasicLinkedListTest, DeletedItem) {
     const std::string keyPrefix("key");
     const int numItems = 1;
@@ -733,7 +783,10 @@ TEST_F(BasicLinkedListTest, MultipleRangeIterator_MB24474) {
     EXPECT_EQ(expectedSeqno, actualSeqno);
 }
 
-TEST_F(BasicLinkedListTest, NonBlockingRangeIterators) {
+/* Several range iterators can read the list at the same time; the read range
+   of the list is the merge of theirs, and tombstones are not purged while
+   any of them reads */
+TEST_F(BasicLinkedListTest, ConcurrentRangeIterators) {
     const int numItems = 3;
     const std::string keyPrefix("key");
 
@@ -741,25 +794,132 @@ TEST_F(BasicLinkedListTest, NonBlockingRangeIterators) {
     std::vector<seqno_t> expectedSeqno =
             addNewItemsToList(1, keyPrefix, numItems);
 
+    auto itr1 = getRangeIterator();
+    ++itr1;
+    EXPECT_EQ(2, basicLL->getRangeReadBegin());
+
+    /* itr1 is already using the list, we can have another iterator */
+    auto itr2 = getRangeIterator();
+    EXPECT_EQ(1, basicLL->getRangeReadBegin());
+    EXPECT_EQ(numItems, basicLL->getRangeReadEnd());
+
+    /* Read all the items with itr2 */
+    std::vector<seqno_t> actualSeqno;
+    while (itr2.curr() != itr2.end()) {
+        actualSeqno.push_back((*itr2).getBySeqno());
+        ++itr2;
+    }
+    EXPECT_EQ(expectedSeqno, actualSeqno);
+
+    /* The range left is the one of itr1 */
+    EXPECT_EQ(2, basicLL->getRangeReadBegin());
+    EXPECT_EQ(numItems, basicLL->getRangeReadEnd());
+
+    /* No purging while itr1 reads */
+    addStaleItem("stale", numItems + 1);
+    EXPECT_EQ(0, basicLL->purgeTombstones(numItems + 1));
+
+    actualSeqno.clear();
+    while (itr1.curr() != itr1.end()) {
+        actualSeqno.push_back((*itr1).getBySeqno());
+        ++itr1;
+    }
+    EXPECT_EQ(std::vector<seqno_t>(expectedSeqno.begin() + 1,
+                                   expectedSeqno.end()),
+              actualSeqno);
+    EXPECT_EQ(0, basicLL->getRangeReadBegin());
+    EXPECT_EQ(0, basicLL->getRangeReadEnd());
+
+    EXPECT_EQ(1, basicLL->purgeTombstones(numItems + 1));
+}
+
+/* A range iterator with a start seqno starts at the element of the seqno
+   index at or before it, rather than at the head of the list */
+TEST_F(BasicLinkedListTest, RangeIteratorSeek) {
+    const seqno_t interval = BasicLinkedList::seqnoIndexInterval;
+    const int numItems = 3 * interval;
+    const std::string keyPrefix("key");
+    addNewItemsToList(1, keyPrefix, numItems);
+
     {
-        auto itr1 = getRangeIterator();
-        auto itr2 = basicLL->makeRangeIterator(true /*isBackfill*/);
-        /* itr1 is already using the list, we cannot have another iterator */
-        EXPECT_FALSE(itr2);
+        auto itrOptional = basicLL->makeRangeIterator(true /*isBackfill*/,
+                                                      2 * interval + 10);
+        ASSERT_TRUE(itrOptional);
+        auto& itr = *itrOptional;
+        EXPECT_EQ(2 * interval, itr.curr());
+        EXPECT_EQ(numItems, itr.back());
+        EXPECT_EQ(numItems - 2 * interval + 1, itr.count());
+        /* The items before it are not in the read range */
+        EXPECT_EQ(2 * interval, basicLL->getRangeReadBegin());
 
-        /* itr1 goes out of scope and releases the read lock on the list */
+        std::vector<seqno_t> actualSeqno;
+        while (itr.curr() != itr.end()) {
+            actualSeqno.push_back((*itr).getBySeqno());
+            ++itr;
+        }
+        EXPECT_EQ(numItems - 2 * interval + 1, actualSeqno.size());
+        EXPECT_EQ(2 * interval, actualSeqno.front());
     }
 
-    /* Iterator created now, should be able to read all items */
+    /* Moving the indexed element to the end of the list removes it from the
+       index; the iterator then starts at the element indexed before it */
+    updateItem(numItems, keyPrefix + std::to_string(2 * interval));
     auto itr = getRangeIterator();
-    std::vector<seqno_t> actualSeqno;
+    auto itrOptional =
+            basicLL->makeRangeIterator(true /*isBackfill*/, 2 * interval + 10);
+    ASSERT_TRUE(itrOptional);
+    EXPECT_EQ(interval, itrOptional->curr());
 
-    /* Read all the items with the iterator */
-    while (itr.curr() != itr.end()) {
-        actualSeqno.push_back((*itr).getBySeqno());
-        ++itr;
+    /* Without a start seqno we start at the head */
+    EXPECT_EQ(1, itr.curr());
+}
+
+/* A purge can pause, and resume near where it paused */
+TEST_F(BasicLinkedListTest, PurgePauseResume) {
+    const seqno_t interval = BasicLinkedList::seqnoIndexInterval;
+    const std::string keyPrefix("key");
+
+    /* Items [1, interval], stale items [interval + 1, 2 * interval] and items
+       [2 * interval + 1, 3 * interval] */
+    addNewItemsToList(1, keyPrefix, interval);
+    for (seqno_t i = interval + 1; i <= 2 * interval; ++i) {
+        addStaleItem("stale" + std::to_string(i), i);
     }
-    EXPECT_EQ(expectedSeqno, actualSeqno);
+    addNewItemsToList(2 * interval + 1, keyPrefix, interval);
+    const seqno_t numItems = 3 * interval;
+
+    /* Pause after visiting 10 of the stale items */
+    int visited = 0;
+    SequenceList::PurgeRun run;
+    run.shouldPause = [&visited, interval]() {
+        return ++visited > interval + 9;
+    };
+    EXPECT_EQ(10, basicLL->purgeTombstones(numItems, &run));
+    EXPECT_EQ(interval + 11, run.resumeSeqno);
+    EXPECT_EQ(interval - 10, basicLL->getNumStaleItems());
+
+    /* The rest of the purge starts at the element of the seqno index before
+       the resume seqno, not at the head */
+    visited = 0;
+    run.shouldPause = [&visited]() {
+        ++visited;
+        return false;
+    };
+    EXPECT_EQ(interval - 10, basicLL->purgeTombstones(numItems, &run));
+    EXPECT_EQ(0, run.resumeSeqno);
+    EXPECT_EQ(2 * interval - 10, visited);
+    EXPECT_EQ(0, basicLL->getNumStaleItems());
+    EXPECT_EQ(2 * interval, basicLL->getNumItems());
+}
+
+/* Range iterators can't be created while tombstones are purged */
+TEST_F(BasicLinkedListTest, NoRangeIteratorWhilePurging) {
+    const int numItems = 3;
+    const std::string keyPrefix("key");
+    addNewItemsToList(1, keyPrefix, numItems);
+
+    std::lock_guard<std::mutex> purgeGuard(basicLL->getRangeReadLock());
+    EXPECT_FALSE(basicLL->makeRangeIterator(true /*isBackfill*/));
 }
 
 TEST_F(BasicLinkedListTest, RangeReadStopsOnInvalidSeqno) {
@@ -14,6 +14,7 @@
  *   limitations under the License.
  */
 
+#include <stdexcept>
 #include <unordered_set>
 
 #include <gtest/gtest.h>
@@ -80,6 +81,122 @@ TEST_P(BloomFilterDocKeyTest, check_maybeKeyExist) {
     }
 }
 
+class BloomFilterLayoutTest
+        : public ::testing::TestWithParam<BloomFilter::Layout> {};
+
+// A key added to the filter is always found, and the false positive rate
+// is about what we asked for.
+TEST_P(BloomFilterLayoutTest, FalsePositiveRate) {
+    const size_t numKeys = 10000;
+    BloomFilter filter(numKeys, 0.01, BFILTER_ENABLED, GetParam());
+    EXPECT_EQ(GetParam(), filter.getLayout());
+
+    for (size_t i = 0; i < numKeys; i++) {
+        filter.addKey(makeStoredDocKey("key" + std::to_string(i)));
+    }
+    for (size_t i = 0; i < numKeys; i++) {
+        EXPECT_TRUE(
+                filter.maybeKeyExists(makeStoredDocKey("key" + std::to_string(i))));
+    }
+    EXPECT_LE(numKeys * 0.99, filter.getNumOfKeysInFilter());
+
+    size_t falsePositives = 0;
+    for (size_t i = 0; i < numKeys; i++) {
+        if (filter.maybeKeyExists(
+                    makeStoredDocKey("missing" + std::to_string(i)))) {
+            ++falsePositives;
+        }
+    }
+    EXPECT_GT(numKeys * 0.03, falsePositives);
+}
+
+TEST_P(BloomFilterLayoutTest, Disable) {
+    BloomFilter filter(100, 0.01, BFILTER_ENABLED, GetParam());
+    auto key = makeStoredDocKey("key");
+    filter.addKey(key);
+    EXPECT_NE(0, filter.getFilterSize());
+
+    filter.setStatus(BFILTER_DISABLED);
+    EXPECT_EQ(0, filter.getFilterSize());
+    EXPECT_EQ(0, filter.getNumOfKeysInFilter());
+    EXPECT_TRUE(filter.maybeKeyExists(makeStoredDocKey("missing")));
+}
+
+// A deserialized filter has the same geometry and keys as the original
+TEST_P(BloomFilterLayoutTest, Serialize) {
+    const size_t numKeys = 1000;
+    BloomFilter filter(numKeys, 0.01, BFILTER_ENABLED, GetParam());
+    for (size_t i = 0; i < numKeys; i++) {
+        filter.addKey(makeStoredDocKey("key" + std::to_string(i)));
+    }
+
+    auto copy = BloomFilter::deserialize(filter.serialize(), BFILTER_ENABLED);
+    ASSERT_TRUE(copy);
+    EXPECT_EQ(GetParam(), copy->getLayout());
+    EXPECT_EQ(filter.getFilterSize(), copy->getFilterSize());
+    EXPECT_EQ(filter.getNumOfKeysInFilter(), copy->getNumOfKeysInFilter());
+    for (size_t i = 0; i < numKeys; i++) {
+        auto key = makeStoredDocKey("key" + std::to_string(i));
+        EXPECT_TRUE(copy->maybeKeyExists(key));
+        key = makeStoredDocKey("missing" + std::to_string(i));
+        EXPECT_EQ(filter.maybeKeyExists(key), copy->maybeKeyExists(key));
+    }
+}
+
+TEST_P(BloomFilterLayoutTest, DeserializeInvalid) {
+    BloomFilter filter(100, 0.01, BFILTER_ENABLED, GetParam());
+    const auto data = filter.serialize();
+
+    EXPECT_THROW(BloomFilter::deserialize("", BFILTER_ENABLED),
+                 std::invalid_argument);
+    EXPECT_THROW(BloomFilter::deserialize(data.substr(0, data.size() - 1),
+                                          BFILTER_ENABLED),
+                 std::invalid_argument);
+    auto corrupt = data;
+    corrupt[0] ^= 0xff;
+    EXPECT_THROW(BloomFilter::deserialize(corrupt, BFILTER_ENABLED),
+                 std::invalid_argument);
+}
+
+// The copy and the merged filters have the keys of both filters
+TEST_P(BloomFilterLayoutTest, CopyAndMerge) {
+    BloomFilter filter(100, 0.01, BFILTER_ENABLED, GetParam());
+    filter.addKey(makeStoredDocKey("key1"));
+
+    BloomFilter copy(filter);
+    copy.addKey(makeStoredDocKey("key2"));
+    EXPECT_TRUE(copy.maybeKeyExists(makeStoredDocKey("key1")));
+    EXPECT_TRUE(copy.maybeKeyExists(makeStoredDocKey("key2")));
+
+    filter.addKey(makeStoredDocKey("key3"));
+    ASSERT_TRUE(copy.merge(filter));
+    EXPECT_TRUE(copy.maybeKeyExists(makeStoredDocKey("key3")));
+
+    // Filters of a different size can't be merged
+    BloomFilter other(10000, 0.01, BFILTER_ENABLED, GetParam());
+    EXPECT_FALSE(copy.merge(other));
+}
+
+INSTANTIATE_TEST_CASE_P(Layouts,
+                        BloomFilterLayoutTest,
+                        ::testing::Values(BloomFilter::Layout::Standard,
+                                          BloomFilter::Layout::Blocked), );
+
+TEST(BloomFilterTest, BlockedLayoutSize) {
+    // Whole 512 bit blocks
+    BloomFilter filter(1000, 0.01, BFILTER_ENABLED, BloomFilter::Layout::Blocked);
+    EXPECT_EQ(0, filter.getFilterSize() % 512);
+    EXPECT_LE(BloomFilter(1000, 0.01, BFILTER_ENABLED).getFilterSize(),
+              filter.getFilterSize());
+}
+
+TEST(BloomFilterTest, ParseLayout) {
+    EXPECT_EQ(BloomFilter::Layout::Standard,
+              BloomFilter::parseLayout("standard"));
+    EXPECT_EQ(BloomFilter::Layout::Blocked, BloomFilter::parseLayout("blocked"));
+    EXPECT_THROW(BloomFilter::parseLayout("sparse"), std::invalid_argument);
+}
+
 static std::vector<DocNamespace> allDocNamespaces = {{DocNamespace::DefaultCollection,
                                                       DocNamespace::Collections,
                                                       DocNamespace::System}};
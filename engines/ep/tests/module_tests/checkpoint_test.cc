@@ -30,6 +30,7 @@
 #include "tests/module_tests/test_helpers.h"
 #include "thread_gate.h"
 #include "ep_vb.h"
+#include "vbucketmap.h"
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -312,6 +313,57 @@ TYPED_TEST(CheckpointTest, basic_chk_test) {
     EXPECT_EQ(0, rc);
 }
 
+// Cursors are read in parallel (queueLock is only held in shared mode for
+// them) while items are queued; every cursor must still see each item once
+// and in order.
+TYPED_TEST(CheckpointTest, ConcurrentCursorReads) {
+    const int numItems = RUNNING_ON_VALGRIND ? NUM_ITEMS_VG : NUM_ITEMS;
+    const size_t numReaders =
+            RUNNING_ON_VALGRIND ? NUM_DCP_THREADS_VG : NUM_DCP_THREADS;
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < numReaders; ++i) {
+        names.push_back(DCP_CURSOR_PREFIX + std::to_string(i));
+        this->manager->registerCursorBySeqno(
+                names.back(), 1000, MustSendCheckpointEnd::NO);
+    }
+
+    ThreadGate gate{numReaders + 1};
+    std::vector<std::vector<int64_t>> seqnos(numReaders);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < numReaders; ++i) {
+        readers.emplace_back([this, &gate, &names, &seqnos, numItems, i]() {
+            gate.threadUp();
+            while (seqnos[i].empty() || seqnos[i].back() < 1000 + numItems) {
+                std::vector<queued_item> items;
+                this->manager->getAllItemsForCursor(names[i], items);
+                for (const auto& qi : items) {
+                    if (qi->getOperation() == queue_op::set) {
+                        seqnos[i].push_back(qi->getBySeqno());
+                    }
+                }
+                this->manager->hasNext(names[i]);
+                this->manager->getNumItemsForCursor(names[i]);
+            }
+        });
+    }
+
+    gate.threadUp();
+    for (int ii = 0; ii < numItems; ++ii) {
+        EXPECT_TRUE(this->queueNewItem("key" + std::to_string(ii)));
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    for (const auto& seen : seqnos) {
+        ASSERT_EQ(numItems, seen.size());
+        for (int ii = 0; ii < numItems; ++ii) {
+            EXPECT_EQ(1001 + ii, seen[ii]);
+        }
+    }
+}
+
 TYPED_TEST(CheckpointTest, reset_checkpoint_id) {
     int i;
     for (i = 0; i < 10; ++i) {
@@ -458,6 +510,55 @@ TYPED_TEST(CheckpointTest, OneOpenCkpt) {
 }
 
 // Test that enqueuing a single delete works.
+// Test that the seqno slot of a vbucket follows its state, high seqno and
+// snapshot info, until it is detached
+TYPED_TEST(CheckpointTest, SeqnoSlot) {
+    // The slot is the one of the vbucket's own CheckpointManager
+    auto& manager = *this->vbucket->checkpointManager;
+    VBucketSeqnoSlot slot;
+    this->vbucket->setSeqnoSlot(&slot);
+    EXPECT_EQ(vbucket_state_active, vbucket_state_t(slot.state.load()));
+    EXPECT_EQ(1000, slot.highSeqno.load());
+    EXPECT_EQ(manager.getSnapshotInfo().range.end, slot.snapshotEnd.load());
+
+    queued_item qi{new Item(makeStoredDocKey("key1"),
+                            this->vbucket->getId(),
+                            queue_op::set,
+                            /*revSeq*/ 0,
+                            /*bySeq*/ 0)};
+    ASSERT_TRUE(manager.queueDirty(*this->vbucket,
+                                   qi,
+                                   GenerateBySeqno::Yes,
+                                   GenerateCas::Yes,
+                                   /*preLinkDocCtx*/ nullptr));
+    EXPECT_EQ(1001, slot.highSeqno.load());
+    EXPECT_EQ(1001, slot.snapshotEnd.load());
+
+    // A replica reports the end of the snapshot being received
+    this->vbucket->setState(vbucket_state_replica);
+    EXPECT_EQ(vbucket_state_replica, vbucket_state_t(slot.state.load()));
+    manager.createSnapshot(1002, 1010);
+    EXPECT_EQ(manager.getSnapshotInfo().range.end, slot.snapshotEnd.load());
+    queued_item qi2{new Item(makeStoredDocKey("key2"),
+                             this->vbucket->getId(),
+                             queue_op::set,
+                             /*revSeq*/ 0,
+                             /*bySeq*/ 1002)};
+    ASSERT_TRUE(manager.queueDirty(*this->vbucket,
+                                   qi2,
+                                   GenerateBySeqno::No,
+                                   GenerateCas::No,
+                                   /*preLinkDocCtx*/ nullptr));
+    EXPECT_EQ(1002, slot.highSeqno.load());
+    EXPECT_EQ(1010, slot.snapshotEnd.load());
+
+    this->vbucket->setSeqnoSlot(nullptr);
+    manager.createSnapshot(1011, 1020);
+    this->vbucket->setState(vbucket_state_pending);
+    EXPECT_EQ(vbucket_state_replica, vbucket_state_t(slot.state.load()));
+    EXPECT_EQ(1010, slot.snapshotEnd.load());
+}
+
 TYPED_TEST(CheckpointTest, Delete) {
     // Enqueue a single delete.
     queued_item qi{new Item{makeStoredDocKey("key1"),
@@ -608,6 +709,108 @@ TYPED_TEST(CheckpointTest, ItemBasedCheckpointCreation) {
     EXPECT_EQ(1, this->manager->getNumOpenChkItems()); // 1x op_set
 }
 
+TYPED_TEST(CheckpointTest, SizeBasedCheckpointCreation) {
+    // Allow the items of a checkpoint to use the memory of (about) 5 items,
+    // way below the max number of items.
+    const size_t itemSize = Item(makeStoredDocKey("key0"),
+                                 this->vbucket->getId(),
+                                 queue_op::set,
+                                 /*revSeq*/ 0,
+                                 /*bySeq*/ 0)
+                                    .size();
+    this->checkpoint_config = CheckpointConfig(DEFAULT_CHECKPOINT_PERIOD,
+                                               MAX_CHECKPOINT_ITEMS,
+                                               /*numCheckpoints*/ 2,
+                                               /*itemBased*/ true,
+                                               /*keepClosed*/ false,
+                                               /*enableMerge*/ false,
+                                               /*persistenceEnabled*/ true,
+                                               /*maxSize*/ 5 * itemSize);
+    this->createManager();
+
+    unsigned int ii = 0;
+    for (; ii < 10 && this->manager->getNumCheckpoints() == 1; ++ii) {
+        EXPECT_TRUE(this->queueNewItem("key" + std::to_string(ii)));
+    }
+    EXPECT_EQ(2, this->manager->getNumCheckpoints());
+    EXPECT_GE(6, ii);
+    EXPECT_EQ(1, this->manager->getNumOpenChkItems());
+}
+
+TYPED_TEST(CheckpointTest, QueueDirtyBatch) {
+    std::vector<queued_item> items;
+    for (const auto& key : {"key0", "key1", "key2", "key1", "key3"}) {
+        items.emplace_back(new Item(makeStoredDocKey(key),
+                                    this->vbucket->getId(),
+                                    queue_op::set,
+                                    /*revSeq*/ 0,
+                                    /*bySeq*/ 0));
+    }
+
+    // The seqnos of the batch are contiguous, and the second key1 replaces
+    // the first one (which wasn't persisted yet)
+    EXPECT_EQ(4,
+              this->manager->queueDirty(*this->vbucket,
+                                        items,
+                                        GenerateBySeqno::Yes,
+                                        GenerateCas::Yes));
+    for (size_t ii = 0; ii < items.size(); ++ii) {
+        EXPECT_EQ(1001 + int64_t(ii), items[ii]->getBySeqno());
+        EXPECT_NE(0, items[ii]->getCas());
+        // Stamped for the persistence latency
+        EXPECT_NE(0, items[ii]->getEnqueueTime());
+    }
+    EXPECT_EQ(1005, this->manager->getHighSeqno());
+    EXPECT_EQ(4, this->manager->getNumOpenChkItems());
+
+    std::vector<queued_item> persisted;
+    this->manager->getAllItemsForCursor(CheckpointManager::pCursorName,
+                                        persisted);
+    std::vector<int64_t> seqnos;
+    for (const auto& qi : persisted) {
+        if (!qi->isCheckPointMetaItem()) {
+            seqnos.push_back(qi->getBySeqno());
+        }
+    }
+    EXPECT_EQ(std::vector<int64_t>({1001, 1003, 1004, 1005}), seqnos);
+
+    // An empty batch is a no-op
+    items.clear();
+    EXPECT_EQ(0,
+              this->manager->queueDirty(*this->vbucket,
+                                        items,
+                                        GenerateBySeqno::Yes,
+                                        GenerateCas::Yes));
+    EXPECT_EQ(1005, this->manager->getHighSeqno());
+}
+
+TYPED_TEST(CheckpointTest, MemUsageAccountsForDeduplication) {
+    const size_t initialBucketMem = this->global_stats.checkpointMemory;
+    const size_t initialMem = this->manager->getMemoryUsage();
+
+    ASSERT_TRUE(this->queueNewItem("key0"));
+    const size_t mem = this->manager->getMemoryUsage();
+    EXPECT_LT(initialMem, mem);
+    EXPECT_LE(initialBucketMem + (mem - initialMem),
+              this->global_stats.checkpointMemory);
+
+    // Replacing the item (whether or not the persistence cursor is past it)
+    // doesn't change the memory used
+    for (int ii = 0; ii < 10; ++ii) {
+        EXPECT_FALSE(this->queueNewItem("key0"));
+    }
+    EXPECT_EQ(mem, this->manager->getMemoryUsage());
+    std::vector<queued_item> items;
+    this->manager->getAllItemsForCursor(CheckpointManager::pCursorName, items);
+    EXPECT_TRUE(this->queueNewItem("key0"));
+    EXPECT_EQ(mem, this->manager->getMemoryUsage());
+
+    // The bucket-wide usage drops when the checkpoints go
+    const size_t bucketMem = this->global_stats.checkpointMemory;
+    this->manager.reset();
+    EXPECT_GT(bucketMem, this->global_stats.checkpointMemory);
+}
+
 // Test checkpoint and cursor accounting - when checkpoints are closed the
 // offset of cursors is updated as appropriate.
 TYPED_TEST(CheckpointTest, CursorOffsetOnCheckpointClose) {
@@ -774,6 +977,36 @@ TYPED_TEST(CheckpointTest, ItemsForCheckpointCursor) {
     EXPECT_EQ(2 * MIN_CHECKPOINT_ITEMS + 3, items.size());
 }
 
+// Test that visitItemsForCursor() visits the items in place, and flags the
+// ones whose key is queued again in a later checkpoint.
+TYPED_TEST(CheckpointTest, VisitItemsForCursorFlagsSupersededItems) {
+    // key1 and key2 in the first checkpoint, key2 and key3 in the second
+    EXPECT_TRUE(this->queueNewItem("key1"));
+    EXPECT_TRUE(this->queueNewItem("key2"));
+    this->manager->createNewCheckpoint();
+    EXPECT_TRUE(this->queueNewItem("key2"));
+    EXPECT_TRUE(this->queueNewItem("key3"));
+
+    std::vector<std::pair<std::string, bool>> visited;
+    auto range = this->manager->visitItemsForCursor(
+            CheckpointManager::pCursorName,
+            [&visited](const queued_item& qi, bool superseded) {
+                if (!qi->isCheckPointMetaItem()) {
+                    visited.emplace_back(qi->getKey().c_str(), superseded);
+                }
+            });
+
+    const std::vector<std::pair<std::string, bool>> expected = {
+            {"key1", false}, {"key2", true}, {"key2", false}, {"key3", false}};
+    EXPECT_EQ(expected, visited);
+    EXPECT_EQ(1004, range.end);
+
+    // The cursor has moved past all of the items
+    EXPECT_EQ(0,
+              this->manager->getNumItemsForCursor(
+                      CheckpointManager::pCursorName));
+}
+
 // Test the checkpoint cursor movement
 TYPED_TEST(CheckpointTest, CursorMovement) {
     /* We want to have items across 2 checkpoints. Size down the default number
@@ -1201,3 +1434,247 @@ TYPED_TEST(CheckpointTest,
     // Test - second item (duplicate key) should return false.
     EXPECT_FALSE(this->queueNewItem("key"));
 }
+
+// Check that de-duplicating a key many times (which compacts the checkpoint
+// queue) keeps the cursors and the checkpoint index consistent.
+TYPED_TEST(CheckpointTest, DeduplicateCompactsQueue) {
+    const std::string dcpCursor(DCP_CURSOR_PREFIX + std::to_string(0));
+    this->manager->registerCursorBySeqno(
+            dcpCursor, 1000, MustSendCheckpointEnd::NO);
+
+    for (int ii = 0; ii < 10; ++ii) {
+        ASSERT_TRUE(this->queueNewItem("key" + std::to_string(ii)));
+    }
+
+    // Let the persistence cursor read the first half of the keys
+    bool isLastMutationItem;
+    for (int ii = 0; ii < 7; ++ii) {
+        this->manager->nextItem(CheckpointManager::pCursorName,
+                                isLastMutationItem);
+    }
+
+    // Update the second half of the keys lots of times
+    for (int round = 0; round < 500; ++round) {
+        for (int ii = 5; ii < 10; ++ii) {
+            this->queueNewItem("key" + std::to_string(ii));
+        }
+    }
+
+    // The persistence cursor still has the second half to read, and the DCP
+    // cursor all of the keys
+    EXPECT_EQ(5,
+              this->manager->getNumItemsForCursor(
+                      CheckpointManager::pCursorName));
+    EXPECT_EQ(11, this->manager->getNumItemsForCursor(dcpCursor));
+
+    std::vector<queued_item> items;
+    this->manager->getAllItemsForCursor(CheckpointManager::pCursorName, items);
+    ASSERT_EQ(5, items.size());
+    for (int ii = 0; ii < 5; ++ii) {
+        EXPECT_EQ(makeStoredDocKey("key" + std::to_string(ii + 5)),
+                  items[ii]->getKey());
+    }
+    EXPECT_EQ(this->manager->getHighSeqno(), items.back()->getBySeqno());
+
+    // And the index must still find the latest versions
+    this->queueNewItem("key9");
+    EXPECT_EQ(1,
+              this->manager->getNumItemsForCursor(
+                      CheckpointManager::pCursorName));
+}
+
+TYPED_TEST(CheckpointTest, ExpelItemsProcessedByAllCursors) {
+    const std::string dcpCursor(DCP_CURSOR_PREFIX + std::to_string(0));
+    this->manager->registerCursorBySeqno(
+            dcpCursor, 1000, MustSendCheckpointEnd::NO);
+
+    for (int ii = 0; ii < 10; ++ii) {
+        ASSERT_TRUE(this->queueNewItem("key" + std::to_string(ii)));
+    }
+    this->manager->createNewCheckpoint();
+    ASSERT_EQ(2, this->manager->getNumCheckpoints());
+
+    // Nothing can be expelled until the checkpoint is persisted
+    EXPECT_EQ(0, this->manager->expelUnreferencedCheckpointItems());
+
+    std::vector<queued_item> items;
+    this->manager->getAllItemsForCursor(CheckpointManager::pCursorName, items);
+    this->manager->itemsPersisted();
+
+    // The DCP cursor reads checkpoint_start and seqnos 1001..1005
+    bool isLastMutationItem;
+    for (int ii = 0; ii < 6; ++ii) {
+        this->manager->nextItem(dcpCursor, isLastMutationItem);
+    }
+    const size_t remaining = this->manager->getNumItemsForCursor(dcpCursor);
+
+    // The items before the one the DCP cursor is on are expelled
+    EXPECT_LT(0, this->manager->expelUnreferencedCheckpointItems());
+    EXPECT_EQ(4, this->global_stats.itemsExpelledFromCheckpoints);
+    EXPECT_EQ(0, this->manager->expelUnreferencedCheckpointItems());
+
+    // The DCP cursor keeps its position
+    EXPECT_EQ(remaining, this->manager->getNumItemsForCursor(dcpCursor));
+    items.clear();
+    this->manager->getAllItemsForCursor(dcpCursor, items);
+    ASSERT_FALSE(items.empty());
+    EXPECT_EQ(1006, items.front()->getBySeqno());
+
+    // A new cursor can only start after the expelled items, the stream has
+    // to backfill them
+    CursorRegResult result = this->manager->registerCursorBySeqno(
+            "new-cursor", 1002, MustSendCheckpointEnd::NO);
+    EXPECT_EQ(1005, result.first);
+    EXPECT_FALSE(result.second);
+    items.clear();
+    this->manager->getAllItemsForCursor("new-cursor", items);
+    auto firstItem = std::find_if(
+            items.begin(), items.end(), [](const queued_item& qi) {
+                return !qi->isCheckPointMetaItem();
+            });
+    ASSERT_NE(items.end(), firstItem);
+    EXPECT_EQ(1005, (*firstItem)->getBySeqno());
+}
+
+static queued_item makeQueueItem(const std::string& key, int64_t seqno) {
+    return queued_item(new Item(makeStoredDocKey(key),
+                                0,
+                                queue_op::set,
+                                /*revSeq*/ 0,
+                                seqno));
+}
+
+static std::vector<int64_t> getSeqnos(const CheckpointQueue& queue) {
+    std::vector<int64_t> seqnos;
+    for (const auto& qi : queue) {
+        seqnos.push_back(qi->getBySeqno());
+    }
+    return seqnos;
+}
+
+TEST(CheckpointQueueTest, PositionsAreStable) {
+    CheckpointQueue queue;
+    const auto a = queue.push_back(makeQueueItem("a", 1));
+    const auto b = queue.push_back(makeQueueItem("b", 2));
+    const auto c = queue.push_back(makeQueueItem("c", 3));
+
+    queue.erase(b);
+    EXPECT_EQ(2, queue.size());
+    EXPECT_EQ(std::vector<int64_t>({1, 3}), getSeqnos(queue));
+    EXPECT_EQ(3, (*queue.iteratorAt(c))->getBySeqno());
+
+    // Items pushed to the front come before the existing ones, which keep
+    // their positions
+    const auto z = queue.push_front(makeQueueItem("z", 0));
+    EXPECT_LT(z, a);
+    EXPECT_EQ(std::vector<int64_t>({0, 1, 3}), getSeqnos(queue));
+    EXPECT_EQ(1, (*queue.iteratorAt(a))->getBySeqno());
+    EXPECT_EQ(3, (*queue.iteratorAt(c))->getBySeqno());
+
+    // Iterating backwards skips the removed item too
+    auto it = queue.end();
+    EXPECT_EQ(3, (*--it)->getBySeqno());
+    EXPECT_EQ(1, (*--it)->getBySeqno());
+    EXPECT_EQ(0, (*--it)->getBySeqno());
+    EXPECT_EQ(queue.begin(), it);
+    EXPECT_EQ(3, (*queue.rbegin())->getBySeqno());
+
+    EXPECT_THROW(queue.erase(b), std::invalid_argument);
+}
+
+TEST(CheckpointQueueTest, RemovedItemsAtTheEnds) {
+    CheckpointQueue queue;
+    const auto a = queue.push_back(makeQueueItem("a", 1));
+    const auto b = queue.push_back(makeQueueItem("b", 2));
+    queue.push_back(makeQueueItem("c", 3));
+
+    // Once c is gone, b is the back item and leaves no hole behind it
+    queue.erase(b);
+    queue.pop_back();
+    EXPECT_EQ(1, queue.size());
+    EXPECT_EQ(0, queue.getNumRemoved());
+    EXPECT_EQ(a, queue.backPosition());
+    EXPECT_EQ(1, queue.back()->getBySeqno());
+}
+
+TEST(CheckpointQueueTest, Compact) {
+    CheckpointQueue queue;
+    std::vector<CheckpointQueue::Position> positions;
+    const int numItems = 3000;
+    for (int ii = 0; ii < numItems; ++ii) {
+        positions.push_back(queue.push_back(makeQueueItem("key", ii)));
+    }
+
+    // Remove all but every third item (and the back item)
+    EXPECT_FALSE(queue.needsCompaction());
+    for (int ii = 0; ii < numItems - 1; ++ii) {
+        if (ii % 3 != 0) {
+            queue.erase(positions[ii]);
+        }
+    }
+    ASSERT_TRUE(queue.needsCompaction());
+
+    std::vector<int64_t> expected;
+    for (int ii = 0; ii < numItems; ++ii) {
+        if (ii % 3 == 0 || ii == numItems - 1) {
+            expected.push_back(ii);
+        }
+    }
+    EXPECT_EQ(expected, getSeqnos(queue));
+
+    queue.compact([&positions](CheckpointQueue::Position from,
+                               CheckpointQueue::Position to,
+                               const queued_item& qi) {
+        EXPECT_EQ(positions[qi->getBySeqno()], from);
+        EXPECT_LT(to, from);
+        positions[qi->getBySeqno()] = to;
+    });
+
+    EXPECT_EQ(0, queue.getNumRemoved());
+    EXPECT_FALSE(queue.needsCompaction());
+    EXPECT_EQ(expected, getSeqnos(queue));
+    for (auto seqno : expected) {
+        EXPECT_EQ(seqno, (*queue.iteratorAt(positions[seqno]))->getBySeqno());
+    }
+}
+
+TEST(CheckpointIndexTest, InsertFindErase) {
+    // Keep the keys alive; the index refers to them
+    std::vector<StoredDocKey> keys;
+    for (int ii = 0; ii < 1000; ++ii) {
+        keys.push_back(makeStoredDocKey("key" + std::to_string(ii)));
+    }
+
+    CheckpointIndex index;
+    EXPECT_EQ(nullptr, index.find(keys[0]));
+    for (int ii = 0; ii < 1000; ++ii) {
+        index.insert(keys[ii], {ii, ii * 2});
+    }
+    EXPECT_EQ(1000, index.size());
+
+    // Replacing an entry doesn't add one
+    index.insert(keys[1], {1, 3});
+    EXPECT_EQ(1000, index.size());
+    EXPECT_EQ(3, index.find(makeStoredDocKey("key1"))->mutation_id);
+
+    // The namespace is part of the key
+    EXPECT_EQ(nullptr,
+              index.find(DocKey("key1", DocNamespace::System)));
+
+    // Remove every other key; the rest must still be found
+    for (int ii = 0; ii < 1000; ii += 2) {
+        EXPECT_TRUE(index.erase(keys[ii]));
+    }
+    EXPECT_FALSE(index.erase(keys[0]));
+    EXPECT_EQ(500, index.size());
+    for (int ii = 0; ii < 1000; ++ii) {
+        const auto* entry = index.find(makeStoredDocKey("key" +
+                                                        std::to_string(ii)));
+        if (ii % 2 == 0) {
+            EXPECT_EQ(nullptr, entry);
+        } else {
+            ASSERT_NE(nullptr, entry);
+            EXPECT_EQ(ii, entry->position);
+        }
+    }
+}
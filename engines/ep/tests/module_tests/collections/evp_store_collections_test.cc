@@ -142,6 +142,75 @@ TEST_F(CollectionsTest, collections_basic) {
     EXPECT_EQ(ENGINE_UNKNOWN_COLLECTION, gv.getStatus());
 }
 
+// The front end ops and the flushed items are counted by collection
+TEST_F(CollectionsTest, stats) {
+    VBucketPtr vb = store->getVBucket(vbid);
+    vb->updateFromManifest({R"({"separator":"::",
+                 "collections":[{"name":"$default", "uid":"0"},
+                                {"name":"meat", "uid":"1"}]})"});
+    store_item(vbid, {"key", DocNamespace::DefaultCollection}, "value");
+    store_item(vbid, {"meat::beef", DocNamespace::Collections}, "value");
+    store_item(vbid, {"meat::beef", DocNamespace::Collections}, "value2");
+    store_item(vbid,
+               {"fruit::apple", DocNamespace::Collections},
+               "value",
+               0,
+               {cb::engine_errc::unknown_collection});
+
+    // The meat create event, key and one (de-duplicated) beef
+    flush_vbucket_to_disk(vbid, 3);
+
+    get_options_t options = static_cast<get_options_t>(
+            QUEUE_BG_FETCH | HONOR_STATES | TRACK_REFERENCE | DELETE_TEMP |
+            HIDE_LOCKED_CAS | TRACK_STATISTICS);
+    GetValue gv = store->get(
+            {"meat::beef", DocNamespace::Collections}, vbid, cookie, options);
+    ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+    gv = store->get({"meat::sausage", DocNamespace::Collections},
+                    vbid,
+                    cookie,
+                    options);
+    EXPECT_EQ(ENGINE_KEY_ENOENT, gv.getStatus());
+
+    auto getTotals = [&vb](const DocKey& key) {
+        auto rh = vb->lockCollections();
+        auto* stats = rh.getStatsForKey(key);
+        EXPECT_NE(nullptr, stats);
+        return stats ? stats->getTotals()
+                     : Collections::VB::ManifestEntry::Stats::Totals{};
+    };
+    const DocKey beef{"meat::beef", DocNamespace::Collections};
+    auto meat = getTotals(beef);
+    EXPECT_EQ(2u, meat.sets);
+    EXPECT_EQ(1u, meat.gets);
+    EXPECT_EQ(0u, meat.deletes);
+    EXPECT_EQ(1, meat.diskItems);
+    EXPECT_LT(0u, meat.flushedBytes);
+
+    auto dflt = getTotals({"key", DocNamespace::DefaultCollection});
+    EXPECT_EQ(1u, dflt.sets);
+    EXPECT_EQ(0u, dflt.gets);
+    EXPECT_EQ(1, dflt.diskItems);
+
+    EXPECT_EQ(nullptr,
+              vb->lockCollections().getStatsForKey(
+                      {"fruit::apple", DocNamespace::Collections}));
+
+    uint64_t cas = 0;
+    ASSERT_EQ(ENGINE_SUCCESS,
+              store->deleteItem(beef,
+                                cas,
+                                vbid,
+                                /*cookie*/ cookie,
+                                /*itemMeta*/ nullptr,
+                                /*mutation_descr_t*/ nullptr));
+    flush_vbucket_to_disk(vbid, 1);
+
+    meat = getTotals(beef);
+    EXPECT_EQ(1u, meat.deletes);
+    EXPECT_EQ(0, meat.diskItems);
+}
+
 // Test demonstrates issue logged as MB_25344, when we delete a collection
 // and then happen to perform a mutation against a new rev of the collection
 // we may encounter the key which is pending deletion and then fail when we
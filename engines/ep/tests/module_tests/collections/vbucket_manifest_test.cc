@@ -36,52 +36,52 @@ public:
     }
 
     bool exists(Collections::Identifier identifier) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         return exists_UNLOCKED(identifier);
     }
 
     bool isOpen(Collections::Identifier identifier) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         expect_true(exists_UNLOCKED(identifier));
         auto itr = map.find(identifier.getName());
         return itr->second->isOpen();
     }
 
     bool isExclusiveOpen(Collections::Identifier identifier) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         expect_true(exists_UNLOCKED(identifier));
         auto itr = map.find(identifier.getName());
         return itr->second->isExclusiveOpen();
     }
 
     bool isDeleting(Collections::Identifier identifier) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         expect_true(exists_UNLOCKED(identifier));
         auto itr = map.find(identifier.getName());
         return itr->second->isDeleting();
     }
 
     bool isExclusiveDeleting(Collections::Identifier identifier) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         expect_true(exists_UNLOCKED(identifier));
         auto itr = map.find(identifier.getName());
         return itr->second->isExclusiveDeleting();
     }
 
     bool isOpenAndDeleting(Collections::Identifier identifier) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         expect_true(exists_UNLOCKED(identifier));
         auto itr = map.find(identifier.getName());
         return itr->second->isOpenAndDeleting();
     }
 
     size_t size() const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         return map.size();
     }
 
     bool compareEntry(const Collections::VB::ManifestEntry& entry) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         if (exists_UNLOCKED(entry.getIdentifier())) {
             auto itr = map.find(entry.getCollectionName());
             const auto& myEntry = *itr->second;
@@ -93,7 +93,7 @@ public:
     }
 
     bool operator==(const MockVBManifest& rhs) const {
-        std::lock_guard<cb::ReaderLock> readLock(rwlock.reader());
+        ShardedSharedMutex::ReaderHolder readLock(rwlock);
         if (rhs.size() != size()) {
             return false;
         }
@@ -360,4 +360,21 @@ TEST(ChangeListenerTest, ChangeListenerSSizeRegression) {
 
     // change parameters
     configuration.setParameter(key, (ssize_t)2);
-}
\ No newline at end of file
+}
+TEST(ConfigurationTest, GeneratedGettersFollowSetParameter) {
+    // The generated getters read a copy of the value, which must be kept
+    // in sync however the parameter is set
+    ConfigurationShim configuration;
+    EXPECT_EQ(47, configuration.getHtLocks());
+    EXPECT_EQ(47, configuration.getParameter<size_t>("ht_locks"));
+
+    configuration.setParameter("ht_locks", (size_t)5);
+    EXPECT_EQ(5, configuration.getHtLocks());
+
+    configuration.setMaxSize(100);
+    EXPECT_EQ(100, configuration.getParameter<size_t>("max_size"));
+
+    // Through the alias
+    configuration.setParameter("cache_size", (size_t)200);
+    EXPECT_EQ(200, configuration.getMaxSize());
+}
@@ -32,6 +32,7 @@
 #include "dcp/backfill_disk.h"
 #include "dcp/dcp-types.h"
 #include "dcp/dcpconnmap.h"
+#include "dcp/flow-control-manager.h"
 #include "dcp/producer.h"
 #include "dcp/stream.h"
 #include "ep_time.h"
@@ -328,6 +329,57 @@ TEST_P(StreamTest, test_verifyProducerStats) {
     destroy_dcp_stream();
 }
 
+/*
+ * Test that a producer sends up to a batch of messages per step, and keeps
+ * what the connection can't take for the next step
+ */
+TEST_P(StreamTest, ProducerStepBatch) {
+    VBucketPtr vb = engine->getKVBucket()->getVBucket(vbid);
+    setup_dcp_stream(0, IncludeValue::No, IncludeXattrs::No);
+    store_item(vbid, "key1", "value1");
+    store_item(vbid, "key2", "value2");
+    auto producers = get_dcp_producers(reinterpret_cast<ENGINE_HANDLE*>(engine),
+                                       reinterpret_cast<ENGINE_HANDLE_V1*>(engine));
+    uint64_t rollbackSeqno;
+    auto err = producer->streamRequest(/*flags*/0,
+                                       /*opaque*/0,
+                                       /*vbucket*/0,
+                                       /*start_seqno*/0,
+                                       /*end_seqno*/~0,
+                                       /*vb_uuid*/0,
+                                       /*snap_start*/0,
+                                       /*snap_end*/~0,
+                                       &rollbackSeqno,
+                                       StreamTest::fakeDcpAddFailoverLog);
+
+    EXPECT_EQ(ENGINE_SUCCESS, err);
+    producer->setStepBatchSize(10);
+    producer->notifySeqnoAvailable(vbid, vb->getHighSeqno());
+    EXPECT_EQ(ENGINE_SUCCESS, producer->step(producers.get()));
+    producer->getCheckpointSnapshotTask().run();
+
+    /* The connection can't take the mutations: the snapshot marker is sent
+     * and the first mutation kept for the next step.
+     */
+    auto mutation_callback = producers->mutation;
+    producers->mutation = mock_mutation_return_engine_e2big;
+    EXPECT_EQ(ENGINE_WANT_MORE, producer->step(producers.get()));
+    EXPECT_EQ(0, producer->getItemsSent());
+    EXPECT_GT(producer->getTotalBytesSent(), 0);
+
+    /* Still nothing sent, so the step reports it */
+    EXPECT_EQ(ENGINE_E2BIG, producer->step(producers.get()));
+    EXPECT_EQ(0, producer->getItemsSent());
+
+    /* Both mutations go in one step, then there is nothing more */
+    producers->mutation = mutation_callback;
+    EXPECT_EQ(ENGINE_WANT_MORE, producer->step(producers.get()));
+    EXPECT_EQ(2, producer->getItemsSent());
+    EXPECT_EQ(ENGINE_SUCCESS, producer->step(producers.get()));
+
+    destroy_dcp_stream();
+}
+
 /*
  * Test that when have a producer with IncludeValue set to Yes and IncludeXattrs
  * set to No an active stream created via a streamRequest returns false for
@@ -464,6 +516,43 @@ TEST_P(StreamTest, test_keyAndValueExcludingXattrsMessageSize) {
     destroy_dcp_stream();
 }
 
+/*
+ * Test that with value compression a stream builds its response from a
+ * compressed copy of the item, which the producer then sends as is.
+ */
+TEST_P(StreamTest, test_compressedResponse) {
+    const std::string valueData =
+            R"({"json":")" + std::string(1024, 'x') + R"("})";
+    queued_item qi(new Item(makeStoredDocKey("key"),
+                            /*flags*/0,
+                            /*exp*/0,
+                            valueData.c_str(),
+                            valueData.size(),
+                            PROTOCOL_BINARY_DATATYPE_JSON));
+
+    setup_dcp_stream(0, IncludeValue::Yes, IncludeXattrs::Yes);
+    const std::string key("enable_value_compression");
+    ASSERT_EQ(ENGINE_SUCCESS,
+              producer->control(0, key.c_str(), key.size(), "true", 4));
+    std::unique_ptr<DcpResponse> dcpResponse =
+            dynamic_cast<MockActiveStream*>(
+                    stream.get())->public_makeResponseFromItem(qi);
+
+    auto* mutation =
+            dynamic_cast<MutationProducerResponse*>(dcpResponse.get());
+    ASSERT_NE(nullptr, mutation);
+    EXPECT_TRUE(mutation->isValuePrepared());
+    EXPECT_TRUE(mcbp::datatype::is_snappy(mutation->getItem()->getDataType()));
+    EXPECT_LT(mutation->getMessageSize(),
+              MutationResponse::mutationBaseMsgBytes + qi->getKey().size() +
+                      valueData.size());
+
+    // The queued item itself is left as it was
+    EXPECT_EQ(PROTOCOL_BINARY_DATATYPE_JSON, qi->getDataType());
+    EXPECT_EQ(valueData.size(), qi->getNBytes());
+    destroy_dcp_stream();
+}
+
 /*
  * Test for a dcpResponse retrieved from a stream where IncludeValue is Yes and
  * IncludeXattrs are No, and the document does not have any xattrs.  So again
@@ -677,6 +766,113 @@ TEST_P(StreamTest, test_mb18625) {
     destroy_dcp_stream();
 }
 
+/* Check that an idle in-memory stream frees its readyQ when hibernating,
+   and streams the new mutations as before once notified of them */
+TEST_P(StreamTest, HibernateIdleStream) {
+    setup_dcp_stream();
+    MockActiveStream* mock_stream =
+            static_cast<MockActiveStream*>(stream.get());
+    mock_stream->transitionStateToBackfilling();
+    mock_stream->transitionStateToInMemory();
+
+    store_item(vbid, "key", "value");
+    mock_stream->nextCheckpointItemTask();
+    EXPECT_TRUE(mock_stream->public_readyQ().isAllocated());
+    while (mock_stream->next()) {
+    }
+    EXPECT_EQ(0, mock_stream->public_readyQ().size());
+
+    /* Not idle for long enough yet */
+    const rel_time_t idleTime = 60;
+    EXPECT_FALSE(mock_stream->maybeHibernate(ep_current_time(), idleTime));
+    EXPECT_TRUE(mock_stream->public_readyQ().isAllocated());
+
+    const rel_time_t later = ep_current_time() + idleTime;
+    EXPECT_TRUE(mock_stream->maybeHibernate(later, idleTime));
+    EXPECT_TRUE(mock_stream->isHibernating());
+    EXPECT_FALSE(mock_stream->public_readyQ().isAllocated());
+    EXPECT_FALSE(mock_stream->maybeHibernate(later, idleTime))
+            << "Stream should already be hibernating";
+
+    /* A new mutation wakes the stream up, and it is sent as usual */
+    store_item(vbid, "key", "value2");
+    mock_stream->notifySeqnoAvailable(vb0->getHighSeqno());
+    EXPECT_FALSE(mock_stream->isHibernating());
+    mock_stream->nextCheckpointItemTask();
+    EXPECT_TRUE(mock_stream->public_readyQ().isAllocated());
+
+    auto resp = mock_stream->next();
+    ASSERT_NE(nullptr, resp);
+    EXPECT_EQ(DcpResponse::Event::SnapshotMarker, resp->getEvent());
+    resp = mock_stream->next();
+    ASSERT_NE(nullptr, resp);
+    EXPECT_EQ(DcpResponse::Event::Mutation, resp->getEvent());
+    EXPECT_EQ(vb0->getHighSeqno(), *resp->getBySeqno());
+    destroy_dcp_stream();
+}
+
+/* Check that the contiguous in-memory checkpoints are merged into one
+   snapshot when the producer coalesces them, until a key repeats */
+TEST_P(StreamTest, SnapshotCoalescing) {
+    setup_dcp_stream();
+    auto control = [this](const std::string& key, const std::string& value) {
+        return producer->control(
+                0, key.c_str(), key.size(), value.c_str(), value.size());
+    };
+    ASSERT_EQ(ENGINE_SUCCESS, control("snapshot_coalesce_bytes", "1048576"));
+
+    auto& ckpt_mgr = *vb0->checkpointManager;
+    store_item(vbid, "key1", "value");
+    ckpt_mgr.createNewCheckpoint();
+    store_item(vbid, "key2", "value");
+    ckpt_mgr.createNewCheckpoint();
+    store_item(vbid, "key1", "value");
+
+    MockActiveStream* mock_stream =
+            static_cast<MockActiveStream*>(stream.get());
+    mock_stream->nextCheckpointItemTask();
+
+    /* The first two checkpoints make one snapshot */
+    auto resp = mock_stream->public_nextQueuedItem();
+    ASSERT_NE(nullptr, resp);
+    ASSERT_EQ(DcpResponse::Event::SnapshotMarker, resp->getEvent());
+    auto* marker = static_cast<SnapshotMarker*>(resp.get());
+    EXPECT_EQ(2, marker->getEndSeqno());
+    EXPECT_TRUE(marker->getFlags() & MARKER_FLAG_CHK);
+    for (int64_t seqno = 1; seqno <= 2; ++seqno) {
+        resp = mock_stream->public_nextQueuedItem();
+        ASSERT_NE(nullptr, resp);
+        EXPECT_EQ(DcpResponse::Event::Mutation, resp->getEvent());
+        EXPECT_EQ(seqno, *resp->getBySeqno());
+    }
+
+    /* The third one has key1 again, so it makes its own */
+    resp = mock_stream->public_nextQueuedItem();
+    ASSERT_NE(nullptr, resp);
+    ASSERT_EQ(DcpResponse::Event::SnapshotMarker, resp->getEvent());
+    marker = static_cast<SnapshotMarker*>(resp.get());
+    EXPECT_EQ(3, marker->getStartSeqno());
+    EXPECT_EQ(3, marker->getEndSeqno());
+    resp = mock_stream->public_nextQueuedItem();
+    ASSERT_NE(nullptr, resp);
+    EXPECT_EQ(3, *resp->getBySeqno());
+    EXPECT_EQ(nullptr, mock_stream->public_nextQueuedItem());
+
+    /* With a wait, the checkpoints are read once it has elapsed */
+    mock_stream->transitionStateToBackfilling();
+    mock_stream->transitionStateToInMemory();
+    EXPECT_EQ(0, mock_stream->getSnapshotCoalesceDelay().count());
+    ASSERT_EQ(ENGINE_SUCCESS, control("snapshot_coalesce_ms", "60000"));
+    const auto delay = mock_stream->getSnapshotCoalesceDelay();
+    EXPECT_GT(delay.count(), 0);
+    EXPECT_LE(delay, std::chrono::milliseconds(60000));
+    EXPECT_LE(mock_stream->getSnapshotCoalesceDelay(), delay);
+    ASSERT_EQ(ENGINE_SUCCESS, control("snapshot_coalesce_ms", "0"));
+    EXPECT_EQ(0, mock_stream->getSnapshotCoalesceDelay().count());
+
+    destroy_dcp_stream();
+}
+
 /* Stream items from a DCP backfill */
 TEST_P(StreamTest, BackfillOnly) {
     /* Add 3 items */
@@ -896,6 +1092,32 @@ TEST_P(StreamTest, CursorDroppingBasicNotAllowedStates) {
     destroy_dcp_stream();
 }
 
+// With dcp_takeover_pause_backlog the takeover stream pauses the writes to
+// the vbucket once it is close to done. They stay paused until the vbucket
+// is marked as dead, or are resumed if the stream goes away before that.
+TEST_P(StreamTest, TakeoverPausesWrites) {
+    engine->getConfiguration().setDcpTakeoverPauseBacklog(10);
+    setup_dcp_stream(DCP_ADD_STREAM_FLAG_TAKEOVER);
+    MockActiveStream* mock_stream =
+            dynamic_cast<MockActiveStream*>(stream.get());
+
+    mock_stream->transitionStateToBackfilling();
+    mock_stream->transitionStateToTakeoverSend();
+    EXPECT_FALSE(vb0->isTakeoverBackedUp());
+
+    // Nothing left to send; the writes are paused and the stream asks the
+    // consumer to take the vbucket to pending
+    auto resp = mock_stream->next();
+    ASSERT_TRUE(resp);
+    EXPECT_EQ(DcpResponse::Event::SetVbucket, resp->getEvent());
+    EXPECT_TRUE(mock_stream->isTakeoverWait());
+    EXPECT_TRUE(vb0->isTakeoverBackedUp());
+
+    mock_stream->transitionStateToTakeoverDead();
+    EXPECT_FALSE(vb0->isTakeoverBackedUp());
+    destroy_dcp_stream();
+}
+
 TEST_P(StreamTest, RollbackDueToPurge) {
     setup_dcp_stream(0, IncludeValue::No, IncludeXattrs::No);
 
@@ -1230,6 +1452,95 @@ TEST_P(ConnectionTest, test_maybesendnoop_buffer_full) {
     destroy_mock_cookie(cookie);
 }
 
+/*
+ * Test that the priority class of a producer scales its share of the
+ * checkpoint processor task by the class weight, relative to medium.
+ */
+TEST_P(ConnectionTest, test_priority_weight) {
+    const void* cookie = create_mock_cookie();
+    MockDcpProducer producer(*engine,
+                             cookie,
+                             "test_producer",
+                             /*flags*/ 0,
+                             {/*no json*/},
+                             /*startTask*/ true);
+
+    Configuration& config = engine->getConfiguration();
+    const size_t yieldLimit = config.getDcpProducerSnapshotMarkerYieldLimit();
+    auto& task = producer.getCheckpointSnapshotTask();
+    EXPECT_EQ(yieldLimit, task.getIterationsBeforeYield());
+
+    const std::string key("set_priority");
+    auto setPriority = [&producer, &key](const std::string& value) {
+        return producer.control(
+                0, key.c_str(), key.size(), value.c_str(), value.size());
+    };
+    ASSERT_EQ(ENGINE_SUCCESS, setPriority("high"));
+    EXPECT_EQ(yieldLimit * config.getDcpPriorityWeightHigh() /
+                      config.getDcpPriorityWeightMedium(),
+              task.getIterationsBeforeYield());
+
+    ASSERT_EQ(ENGINE_SUCCESS, setPriority("low"));
+    EXPECT_EQ(yieldLimit * config.getDcpPriorityWeightLow() /
+                      config.getDcpPriorityWeightMedium(),
+              task.getIterationsBeforeYield());
+
+    ASSERT_EQ(ENGINE_SUCCESS, setPriority("medium"));
+    EXPECT_EQ(yieldLimit, task.getIterationsBeforeYield());
+    EXPECT_EQ("medium", producer.getPriority());
+
+    destroy_mock_cookie(cookie);
+}
+
+/*
+ * Test that the backfills of all the connections share the buffer set by
+ * dcp_backfill_aggr_mem_threshold, and that new backfills wait behind the
+ * pending ones.
+ */
+TEST_P(ConnectionTest, test_backfill_aggr_buffer) {
+    MockDcpConnMap connMap(*engine);
+    connMap.initialize();
+    connMap.updateMaxActiveSnoozingBackfills(1000);
+    // 10% of the quota by default
+    const size_t maxBytes = connMap.getMaxBackfillBytes();
+    ASSERT_EQ(100u, maxBytes);
+
+    // An empty buffer takes any read
+    EXPECT_TRUE(connMap.backfillBytesCheckAndRead(maxBytes * 2, 0));
+    EXPECT_FALSE(connMap.backfillBytesCheckAndRead(1, 0));
+    EXPECT_TRUE(connMap.isBackfillBufferFull(0));
+    connMap.backfillBytesSent(maxBytes * 2);
+    EXPECT_FALSE(connMap.isBackfillBufferFull(0));
+    EXPECT_EQ(0u, connMap.getBackfillBytesRead());
+
+    EXPECT_TRUE(connMap.backfillBytesCheckAndRead(maxBytes, 0));
+    EXPECT_FALSE(connMap.backfillBytesCheckAndRead(1, 0));
+    // Not full anymore only once a quarter of it is cleared
+    connMap.backfillBytesSent(10);
+    EXPECT_TRUE(connMap.isBackfillBufferFull(0));
+    connMap.backfillBytesSent(15);
+    EXPECT_FALSE(connMap.isBackfillBufferFull(0));
+    connMap.backfillBytesForceRead(maxBytes);
+    EXPECT_TRUE(connMap.isBackfillBufferFull(0));
+    connMap.backfillBytesSent(connMap.getBackfillBytesRead());
+
+    // Fill up the running backfills, after which a new one is pending, and
+    // so is the next even once a slot is free, as the pending one goes first
+    const size_t maxActive = connMap.getMaxActiveSnoozingBackfills();
+    for (size_t i = 0; i < maxActive; ++i) {
+        EXPECT_TRUE(connMap.admitNewBackfill());
+    }
+    EXPECT_FALSE(connMap.admitNewBackfill());
+    EXPECT_EQ(1u, connMap.getNumPendingBackfills());
+    connMap.decrNumActiveSnoozingBackfills();
+    EXPECT_FALSE(connMap.admitNewBackfill());
+    EXPECT_EQ(2u, connMap.getNumPendingBackfills());
+    EXPECT_TRUE(connMap.canAddBackfillToActiveQ());
+    connMap.decrNumPendingBackfills();
+    connMap.decrNumPendingBackfills();
+    EXPECT_EQ(0u, connMap.getNumPendingBackfills());
+}
+
 TEST_P(ConnectionTest, test_maybesendnoop_send_noop) {
     const void* cookie = create_mock_cookie();
     // Create a Mock Dcp producer
@@ -2337,6 +2648,127 @@ TEST_P(ConnectionTest,
     processConsumerMutationsNearThreshold(false);
 }
 
+/* Test that the adaptive flow control policy sizes the buffer of a consumer
+   from its drain rate and rtt, within the bounds and the aggregate threshold */
+TEST_P(ConnectionTest, test_flow_control_adaptive_window) {
+    auto& config = engine->getConfiguration();
+    const size_t minSize = config.getDcpConnBufferSize();
+    const size_t maxSize = config.getDcpConnBufferSizeMax();
+    /* Have the aggregate threshold fit a max size and a min size */
+    engine->getEpStats().setMaxDataSize(
+            (maxSize + minSize) * 100 /
+            config.getDcpConnBufferSizeAggrMemThreshold());
+    const std::chrono::microseconds rtt(100000);
+
+    DcpFlowControlManagerAdaptive manager(*engine);
+    const void* cookie1 = create_mock_cookie();
+    const void* cookie2 = create_mock_cookie();
+    connection_t conn1 = new MockDcpConsumer(*engine, cookie1, "consumer1");
+    connection_t conn2 = new MockDcpConsumer(*engine, cookie2, "consumer2");
+    auto* consumer1 = dynamic_cast<MockDcpConsumer*>(conn1.get());
+    auto* consumer2 = dynamic_cast<MockDcpConsumer*>(conn2.get());
+
+    EXPECT_EQ(minSize, manager.newConsumerConn(consumer1));
+    EXPECT_EQ(minSize, manager.newConsumerConn(consumer2));
+
+    /* Not measured yet: the window stays as is */
+    manager.handleDrainSample(consumer1, minSize * 10, {});
+    EXPECT_EQ(2 * minSize, manager.getAggrBufferSize());
+
+    /* The window is twice the bandwidth-delay product */
+    manager.handleDrainSample(consumer1, minSize * 10, rtt);
+    EXPECT_EQ(2 * minSize, consumer1->getFlowControlBufSize());
+
+    /* A fast connection is only bounded by the max size */
+    manager.handleDrainSample(consumer1, maxSize * 100, rtt);
+    EXPECT_EQ(maxSize, consumer1->getFlowControlBufSize());
+    EXPECT_EQ(maxSize + minSize, manager.getAggrBufferSize());
+
+    /* No room left under the aggregate threshold for the other one */
+    const uint32_t size2 = consumer2->getFlowControlBufSize();
+    manager.handleDrainSample(consumer2, minSize * 10, rtt);
+    EXPECT_EQ(size2, consumer2->getFlowControlBufSize());
+    EXPECT_EQ(maxSize + minSize, manager.getAggrBufferSize());
+
+    /* Once idle, the first one shrinks back to the min, making room */
+    manager.handleDrainSample(consumer1, 0, rtt);
+    EXPECT_EQ(minSize, consumer1->getFlowControlBufSize());
+    manager.handleDrainSample(consumer2, minSize * 10, rtt);
+    EXPECT_EQ(2 * minSize, consumer2->getFlowControlBufSize());
+    EXPECT_EQ(3 * minSize, manager.getAggrBufferSize());
+
+    manager.handleDisconnect(consumer1);
+    manager.handleDisconnect(consumer2);
+    EXPECT_EQ(0, manager.getAggrBufferSize());
+
+    destroy_mock_cookie(cookie1);
+    destroy_mock_cookie(cookie2);
+}
+
+/* Test that the consecutive mutations buffered by a passive stream are all
+   set into the replica vbucket by the processor task */
+TEST_P(ConnectionTest, ProcessBufferedMutationBatch) {
+    const void* cookie = create_mock_cookie();
+    const uint32_t opaque = 1;
+    const uint64_t snapStart = 1, snapEnd = 5;
+
+    connection_t conn = new MockDcpConsumer(*engine, cookie, "test_consumer");
+    MockDcpConsumer* consumer = dynamic_cast<MockDcpConsumer*>(conn.get());
+
+    ASSERT_EQ(ENGINE_SUCCESS, set_vb_state(vbid, vbucket_state_replica));
+    ASSERT_EQ(ENGINE_SUCCESS,
+              consumer->addStream(/*opaque*/ 0,
+                                  vbid,
+                                  /*flags*/ 0));
+    MockPassiveStream* stream = static_cast<MockPassiveStream*>(
+            (consumer->getVbucketStream(vbid)).get());
+    ASSERT_TRUE(stream->isActive());
+
+    EXPECT_EQ(ENGINE_SUCCESS,
+              consumer->snapshotMarker(opaque,
+                                       vbid,
+                                       snapStart,
+                                       snapEnd,
+                                       /* in-memory snapshot */ 0x1));
+
+    /* Have the mutations buffered, as setting them temporarily fails */
+    auto vb = engine->getKVBucket()->getVBucket(vbid);
+    vb->setTakeoverBackedUpState(true);
+    for (uint64_t seqno = snapStart; seqno <= snapEnd; ++seqno) {
+        const std::string key = "key" + std::to_string(seqno);
+        const DocKey docKey{key, DocNamespace::DefaultCollection};
+        EXPECT_EQ(ENGINE_SUCCESS,
+                  consumer->mutation(opaque,
+                                     docKey,
+                                     {}, // value
+                                     0, // priv bytes
+                                     PROTOCOL_BINARY_RAW_BYTES,
+                                     0, // cas
+                                     vbid,
+                                     0, // flags
+                                     seqno,
+                                     0, // rev seqno
+                                     0, // exptime
+                                     0, // locktime
+                                     {}, // meta
+                                     0)); // nru
+    }
+    EXPECT_EQ(snapEnd, stream->getNumBufferItems());
+
+    /* Still failing: the mutations stay buffered */
+    EXPECT_EQ(cannot_process, consumer->processBufferedItems());
+    EXPECT_EQ(snapEnd, stream->getNumBufferItems());
+    EXPECT_EQ(0, vb->getHighSeqno());
+
+    vb->setTakeoverBackedUpState(false);
+    EXPECT_EQ(more_to_process, consumer->processBufferedItems());
+    EXPECT_EQ(0, stream->getNumBufferItems());
+    EXPECT_EQ(int64_t(snapEnd), vb->getHighSeqno());
+
+    EXPECT_EQ(ENGINE_SUCCESS, consumer->closeStream(opaque, vbid));
+    destroy_mock_cookie(cookie);
+}
+
 // Test cases which run in both Full and Value eviction
 INSTANTIATE_TEST_CASE_P(PersistentAndEphemeral,
                         StreamTest,
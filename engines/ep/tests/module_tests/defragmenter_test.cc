@@ -22,6 +22,7 @@
 #include "defragmenter.h"
 #include "defragmenter_visitor.h"
 #include "item.h"
+#include "tests/module_tests/test_helpers.h"
 #include "vbucket.h"
 
 #include <valgrind/valgrind.h>
@@ -349,6 +350,57 @@ TEST_P(DefragmenterTest, DISABLED_MaxDefragValueSize) {
                       get_mock_server_api()->alloc_hooks));
 }
 
+/// Reports every allocation to be on a page with a single region in use
+static bool sparse_allocation_utilization(const void*,
+                                          allocator_utilization* util) {
+    util->page_used = 1;
+    util->page_regions = 64;
+    util->class_used = 32;
+    util->class_regions = 64;
+    return true;
+}
+
+// With the page utilization available the defragmenter moves the
+// StoredValues too (and doesn't wait for them to reach the age threshold).
+TEST_P(DefragmenterTest, RelocateStoredValues) {
+    const size_t num_docs = 100;
+    setDocs(64, num_docs);
+
+    ALLOCATOR_HOOKS_API hooks = *get_mock_server_api()->alloc_hooks;
+    hooks.get_allocation_utilization = sparse_allocation_utilization;
+
+    std::vector<const StoredValue*> before;
+    for (size_t i = 0; i < num_docs; i++) {
+        before.push_back(vbucket->ht.find(
+                makeStoredDocKey(std::to_string(i)),
+                TrackReference::No,
+                WantsDeleted::No));
+    }
+
+    PauseResumeVBAdapter prAdapter(std::make_unique<DefragmentVisitor>(
+            /*age_threshold*/ 255,
+            /*max_size_class*/ 1024,
+            &hooks,
+            /*relocate_stored_values*/ true));
+    prAdapter.visit(*vbucket);
+
+    auto& visitor = dynamic_cast<DefragmentVisitor&>(prAdapter.getHTVisitor());
+    EXPECT_EQ(num_docs, visitor.getVisitedCount());
+    EXPECT_EQ(num_docs, visitor.getStoredValueDefragCount());
+    EXPECT_EQ(0, visitor.getDefragCount());
+
+    EXPECT_EQ(num_docs, vbucket->ht.getNumItems());
+    const std::string data(64, 'x');
+    for (size_t i = 0; i < num_docs; i++) {
+        auto* sv = vbucket->ht.find(makeStoredDocKey(std::to_string(i)),
+                                    TrackReference::No,
+                                    WantsDeleted::No);
+        ASSERT_NE(nullptr, sv);
+        EXPECT_NE(before[i], sv);
+        EXPECT_EQ(data, sv->getValue()->to_s());
+    }
+}
+
 INSTANTIATE_TEST_CASE_P(
         FullAndValueEviction,
         DefragmenterTest,
@@ -112,6 +112,29 @@ TEST_F(EphemeralVBucketTest, PageOutAfterDeleteWithValue) {
     EXPECT_FALSE(storedVal->getValue());
 }
 
+// Items a backfill is reading aren't paged out, as that would leave their
+// old revisions in the seqlist as stale items.
+TEST_F(EphemeralVBucketTest, NoPageOutDuringBackfill) {
+    const int numItems = 3;
+    auto keys = generateKeys(numItems);
+    setMany(keys, MutationStatus::WasClean);
+
+    mockEpheVB->registerFakeReadRange(1, 2);
+    for (int i = 0; i < numItems; ++i) {
+        auto lock_sv = lockAndFind(keys[i]);
+        EXPECT_EQ(i == numItems - 1,
+                  vbucket->pageOut(lock_sv.first, lock_sv.second));
+    }
+    EXPECT_EQ(0, mockEpheVB->public_getNumStaleItems());
+    EXPECT_EQ(numItems - 1, vbucket->getNumItems());
+
+    // Once the backfill is done they can be
+    mockEpheVB->resetReadRange();
+    auto lock_sv = lockAndFind(keys[0]);
+    EXPECT_TRUE(vbucket->pageOut(lock_sv.first, lock_sv.second));
+    EXPECT_EQ(0, mockEpheVB->public_getNumStaleItems());
+}
+
 // NRU: check the seqlist has correct statistics for a create, pageout,
 // and (re)create of the same key.
 TEST_F(EphemeralVBucketTest, CreatePageoutCreate) {
@@ -353,6 +353,46 @@ TEST_P(RollbackTest, RollbackOnActive) {
     EXPECT_EQ(TaskStatus::Abort, store->rollback(vbid, 0 /*rollbackReqSeqno*/));
 }
 
+/*
+ * With rollback_reset_ratio=1 a rollback of most of the vbucket is still
+ * undone in place instead of resetting the vbucket.
+ */
+TEST_P(RollbackTest, RollbackMostItemsInPlace) {
+    engine->getConfiguration().setRollbackResetRatio(1.0);
+
+    const int numItems = 10;
+    for (int i = 0; i < numItems; i++) {
+        store_item(vbid, makeStoredDocKey("key_" + std::to_string(i)), "gone");
+    }
+    ASSERT_EQ(numItems, store->flushVBucket(vbid));
+
+    store->setVBucketState(vbid, vbStateAtRollback, false);
+    ASSERT_EQ(TaskStatus::Complete, store->rollback(vbid, initial_seqno));
+    EXPECT_EQ(initial_seqno, store->getVBucket(vbid)->getHighSeqno());
+
+    // The items before the rollback point are still there...
+    for (int64_t i = 1; i <= initial_seqno; i++) {
+        auto result = getInternal(makeStoredDocKey("dummy" + std::to_string(i)),
+                                  vbid,
+                                  /*cookie*/ nullptr,
+                                  vbStateAtRollback,
+                                  {});
+        EXPECT_EQ(ENGINE_SUCCESS, result.getStatus())
+                << "A key stored before the rollback point was lost";
+    }
+
+    // ... and the ones after it are gone
+    for (int i = 0; i < numItems; i++) {
+        auto result = getInternal(makeStoredDocKey("key_" + std::to_string(i)),
+                                  vbid,
+                                  /*cookie*/ nullptr,
+                                  vbStateAtRollback,
+                                  {});
+        EXPECT_EQ(ENGINE_KEY_ENOENT, result.getStatus())
+                << "A key set after the rollback point was found";
+    }
+}
+
 class RollbackDcpTest : public SingleThreadedEPBucketTest,
                         public ::testing::WithParamInterface<
                                 std::tuple<std::string, std::string>> {
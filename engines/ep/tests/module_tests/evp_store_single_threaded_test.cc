@@ -25,6 +25,7 @@
 #include "checkpoint.h"
 #include "dcp/dcpconnmap.h"
 #include "ep_time.h"
+#include "ep_vb.h"
 #include "evp_store_test.h"
 #include "fakes/fake_executorpool.h"
 #include "programs/engine_testapp/mock_server.h"
@@ -37,6 +38,7 @@
 #include <xattr/blob.h>
 #include <xattr/utils.h>
 
+#include <algorithm>
 #include <thread>
 
 ProcessClock::time_point SingleThreadedKVBucketTest::runNextTask(
@@ -786,6 +788,32 @@ TEST_F(SingleThreadedEPBucketTest, test_mb22451) {
     producer->closeAllStreams();
 }
 
+// The task deleting a vbucket frees all of its items, and accounts for
+// them in the progress stats.
+TEST_F(SingleThreadedEPBucketTest, VBucketDeletionFreesItems) {
+    auto* task_executor = reinterpret_cast<SingleThreadedExecutorPool*>
+        (ExecutorPool::get());
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    const int numItems = 10;
+    for (int ii = 0; ii < numItems; ++ii) {
+        store_item(vbid, makeStoredDocKey("key_" + std::to_string(ii)),
+                   "value");
+    }
+    EXPECT_EQ(numItems, store->flushVBucket(vbid));
+
+    auto& stats = engine->getEpStats();
+    EXPECT_TRUE(store->resetVBucket(vbid));
+    EXPECT_NE(0, stats.vbucketDelMemPending.load());
+
+    auto& lpAuxioQ = *task_executor->getLpTaskQ()[AUXIO_TASK_IDX];
+    runNextTask(lpAuxioQ, "Removing (dead) vb:0 from memory and disk");
+    EXPECT_EQ(numItems, stats.vbucketDelItemsFreed);
+    EXPECT_EQ(0, stats.vbucketDelMemPending.load());
+
+    // Cleanup - run flusher.
+    store->flushVBucket(vbid);
+}
+
 /* Regression / reproducer test for MB-19815 - an exception is thrown
  * (and connection disconnected) if a couchstore file hasn't been re-created
  * yet when doDcpVbTakeoverStats() is called.
@@ -980,6 +1008,82 @@ TEST_F(SingleThreadedEPBucketTest, MB19892_BackfillNotDeleted) {
                       dummy_dcp_add_failover_cb));
 }
 
+/*
+ * Test that the disk backfill of the stream of another connection for the
+ * same vbucket attaches to the (not yet started) one of the first stream,
+ * and that the single scan hands the items to both streams.
+ */
+TEST_F(SingleThreadedEPBucketTest, BackfillSharedByStreams) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+
+    // One item on disk only, for the streams to backfill it
+    store_item(vbid, makeStoredDocKey("key"), "value");
+    auto vb = store->getVBuckets().getBucket(vbid);
+    auto& ckpt_mgr = *vb->checkpointManager;
+    ckpt_mgr.createNewCheckpoint();
+    EXPECT_EQ(1, store->flushVBucket(vbid));
+    bool new_ckpt_created;
+    EXPECT_EQ(1, ckpt_mgr.removeClosedUnrefCheckpoints(*vb, new_ckpt_created));
+
+    const void* cookie2 = create_mock_cookie();
+    std::vector<mock_dcp_producer_t> producers;
+    std::vector<stream_t> streams;
+    for (auto* c : {cookie, cookie2}) {
+        producers.push_back(new MockDcpProducer(
+                *engine,
+                c,
+                "test_producer" + std::to_string(producers.size()),
+                /*flags*/ 0,
+                {/*no json*/}));
+        streams.push_back(new MockActiveStream(
+                static_cast<EventuallyPersistentEngine*>(engine.get()),
+                producers.back(),
+                /*flags*/ 0,
+                /*opaque*/ 0,
+                *vb,
+                /*st_seqno*/ 0,
+                /*en_seqno*/ ~0,
+                /*vb_uuid*/ 0xabcd,
+                /*snap_start_seqno*/ 0,
+                /*snap_end_seqno*/ ~0,
+                IncludeValue::Yes,
+                IncludeXattrs::Yes));
+        auto* stream = static_cast<MockActiveStream*>(streams.back().get());
+        stream->transitionStateToBackfilling();
+        ASSERT_TRUE(stream->isBackfilling());
+    }
+
+    // The checkpoint processor tasks of both producers, and the backfill
+    // manager task of the first one only
+    auto& lpAuxioQ = *task_executor->getLpTaskQ()[AUXIO_TASK_IDX];
+    EXPECT_EQ(3, lpAuxioQ.getFutureQueueSize());
+
+    // backfill:create(), scan(), complete() and finished
+    for (int ii = 0; ii < 4; ++ii) {
+        runNextTask(lpAuxioQ, "Backfilling items for a DCP Connection");
+    }
+
+    for (auto& stream : streams) {
+        auto* mock_stream = static_cast<MockActiveStream*>(stream.get());
+        auto resp = mock_stream->next();
+        ASSERT_TRUE(resp);
+        EXPECT_EQ(DcpResponse::Event::SnapshotMarker, resp->getEvent());
+        resp = mock_stream->next();
+        ASSERT_TRUE(resp);
+        EXPECT_EQ(DcpResponse::Event::Mutation, resp->getEvent());
+        EXPECT_EQ(std::string("key"),
+                  dynamic_cast<MutationResponse*>(resp.get())
+                          ->getItem()
+                          ->getKey()
+                          .c_str());
+        EXPECT_EQ(1u, mock_stream->getLastReadSeqno());
+    }
+
+    streams.clear();
+    producers.clear();
+    destroy_mock_cookie(cookie2);
+}
+
 /*
  * Test that the DCP processor returns a 'yield' return code when
  * working on a large enough buffer size.
@@ -1563,6 +1667,121 @@ TEST_F(WarmupTest, mightContainXattrs) {
     EXPECT_TRUE(engine->getKVBucket()->getVBucket(vbid)->mightContainXattrs());
 }
 
+// With warmup_load_tasks, the loading tasks aren't bound to a shard; all of
+// the vbuckets must still be loaded.
+TEST_F(WarmupTest, LoadTasksShareTheVBuckets) {
+    const uint16_t vbid2 = vbid + 1;
+    for (const auto vb : {vbid, vbid2}) {
+        setVBucketStateAndRunPersistTask(vb, vbucket_state_active);
+        for (int ii = 0; ii < 5; ++ii) {
+            store_item(vb, makeStoredDocKey("key" + std::to_string(ii)), "v");
+        }
+        flush_vbucket_to_disk(vb, 5);
+    }
+
+    config_string += ";warmup_load_tasks=3";
+    resetEngineAndWarmup();
+
+    for (const auto vb : {vbid, vbid2}) {
+        for (int ii = 0; ii < 5; ++ii) {
+            auto gv = store->get(makeStoredDocKey("key" + std::to_string(ii)),
+                                 vb,
+                                 nullptr,
+                                 {});
+            EXPECT_EQ(ENGINE_SUCCESS, gv.getStatus());
+        }
+    }
+    EXPECT_EQ(10, engine->getEpStats().warmedUpValues);
+}
+
+// With warmup_active_first, an active vbucket takes traffic once its key dump
+// is done, while warmup goes on loading the values.
+TEST_F(WarmupTest, ActiveVBucketAvailableAfterKeyDump) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    for (int ii = 0; ii < 5; ++ii) {
+        store_item(vbid, makeStoredDocKey("key" + std::to_string(ii)), "v");
+    }
+    flush_vbucket_to_disk(vbid, 5);
+
+    config_string += ";warmup_active_first=true";
+    resetEngineAndEnableWarmup();
+
+    auto& readerQueue = *task_executor->getLpTaskQ()[READER_TASK_IDX];
+    while (store->isVBucketWarmingUp(vbid)) {
+        CheckedExecutor executor(task_executor, readerQueue);
+        executor.runCurrentTask();
+    }
+    EXPECT_TRUE(store->isWarmingUp());
+    EXPECT_FALSE(store->isWarmingUpActiveVBuckets());
+    EXPECT_EQ(0, engine->getEpStats().warmedUpValues);
+
+    // A write before the value is loaded isn't overwritten by it
+    store_item(vbid, makeStoredDocKey("key0"), "new");
+
+    while (store->isWarmingUp()) {
+        CheckedExecutor executor(task_executor, readerQueue);
+        executor.runCurrentTask();
+    }
+
+    auto gv = store->get(makeStoredDocKey("key0"), vbid, nullptr, {});
+    ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+    EXPECT_EQ("new", gv.item->getValue()->to_s());
+    EXPECT_EQ(4, engine->getEpStats().warmedUpValues);
+}
+
+// A vbucket is loaded from the snapshot of its hash table saved for the
+// persisted state, rather than from disk
+TEST_F(WarmupTest, LoadHashTableSnapshot) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    for (int ii = 0; ii < 5; ++ii) {
+        store_item(vbid, makeStoredDocKey("key" + std::to_string(ii)), "v");
+    }
+    flush_vbucket_to_disk(vbid, 5);
+
+    // A replica keeps its failover UUID over the warmup whichever way the
+    // engine is shut down
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_replica);
+    const std::string dbname = engine->getConfiguration().getDbname();
+    {
+        auto vb = store->getVBucket(vbid);
+        ASSERT_TRUE(static_cast<EPVBucket&>(*vb).saveHashTable(dbname));
+    }
+
+    config_string += ";ht_snapshot=true";
+    resetEngineAndWarmup();
+
+    EXPECT_EQ(1, store->getWarmup()->getNumSnapshotVBuckets());
+    auto vb = store->getVBucket(vbid);
+    ASSERT_TRUE(vb);
+    EXPECT_EQ(5, vb->ht.getNumItems());
+    EXPECT_EQ(0, vb->ht.getNumInMemoryNonResItems());
+    EXPECT_EQ(5, engine->getEpStats().warmedUpValues);
+
+    // The snapshot is only loaded once
+    EXPECT_FALSE(static_cast<EPVBucket&>(*vb).loadHashTable(
+            dbname, vb->getPersistenceSeqno()));
+}
+
+// Warmup loads the values of only as many items as the resident ratio
+// target asks for, rather than until the memory is full
+TEST_F(WarmupTest, ResidentRatioTarget) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    for (int ii = 0; ii < 10; ++ii) {
+        store_item(vbid, makeStoredDocKey("key" + std::to_string(ii)), "v");
+    }
+    flush_vbucket_to_disk(vbid, 10);
+
+    config_string += ";warmup_resident_ratio_target=50";
+    resetEngineAndWarmup();
+
+    auto vb = store->getVBucket(vbid);
+    ASSERT_TRUE(vb);
+    EXPECT_EQ(10, vb->ht.getNumItems());
+    EXPECT_EQ(5, vb->ht.getNumInMemoryNonResItems());
+    EXPECT_EQ(5, engine->getEpStats().warmedUpValues);
+    EXPECT_FALSE(store->getWarmup()->hasValueBudget(vbid));
+}
+
 TEST_F(WarmupTest, MB_25197) {
     setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
 
@@ -1705,3 +1924,52 @@ TEST_F(SingleThreadedEPBucketTest, mb25273) {
     EXPECT_EQ(3, gv.item->getCas());
     EXPECT_EQ(value.size(), gv.item->getValue()->valueSize());
 }
+
+// The visitors of a concurrent visit share the vbuckets between them; each
+// vbucket is visited (by one of them) once, and they all complete.
+TEST_F(SingleThreadedEPBucketTest, ConcurrentVisitorsShareVBuckets) {
+    const uint16_t numVBuckets = 4;
+    for (uint16_t vb = 0; vb < numVBuckets; ++vb) {
+        ASSERT_EQ(ENGINE_SUCCESS,
+                  store->setVBucketState(vb, vbucket_state_active, false));
+    }
+
+    class RecordingVisitor : public VBucketVisitor {
+    public:
+        RecordingVisitor(std::vector<uint16_t>& v, size_t& c)
+            : visited(v), completed(c) {
+        }
+
+        void visitBucket(VBucketPtr& vb) override {
+            visited.push_back(vb->getId());
+        }
+
+        void complete() override {
+            ++completed;
+        }
+
+    private:
+        std::vector<uint16_t>& visited;
+        size_t& completed;
+    };
+
+    std::vector<uint16_t> visited;
+    size_t completed = 0;
+    std::vector<std::unique_ptr<VBucketVisitor>> visitors;
+    visitors.push_back(std::make_unique<RecordingVisitor>(visited, completed));
+    visitors.push_back(std::make_unique<RecordingVisitor>(visited, completed));
+    store->visit(std::move(visitors),
+                 "Recording visitor",
+                 TaskId::ItemPagerVisitor,
+                 0,
+                 std::chrono::milliseconds(50));
+
+    auto& lpNonioQ = *task_executor->getLpTaskQ()[NONIO_TASK_IDX];
+    for (int ii = 0; ii < 10 && completed < 2; ++ii) {
+        runNextTask(lpNonioQ);
+    }
+    EXPECT_EQ(2, completed);
+
+    std::sort(visited.begin(), visited.end());
+    EXPECT_EQ(std::vector<uint16_t>({0, 1, 2, 3}), visited);
+}
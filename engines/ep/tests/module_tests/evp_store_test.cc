@@ -364,6 +364,46 @@ TEST_P(EPStoreEvictionTest, DeletedValue) {
     EXPECT_EQ("deleted value", result.item->getValue()->to_s());
 }
 
+// Test that with a coalescing window the BGFetcher defers its pass until
+// the window of the first miss has passed, then fetches in one pass.
+TEST_P(EPStoreEvictionTest, BgFetchCoalesceWindow) {
+    auto key = makeStoredDocKey("key");
+    store_item(vbid, key, "value");
+    flush_vbucket_to_disk(vbid);
+    evict_key(vbid, key);
+
+    engine->getConfiguration().setBgfetcherCoalesceWindow(100000);
+
+    auto do_get = [this, &key]() {
+        return store->get(key, vbid, cookie, QUEUE_BG_FETCH);
+    };
+    EXPECT_EQ(ENGINE_EWOULDBLOCK, do_get().getStatus());
+
+    auto& stats = engine->getEpStats();
+    auto vb = store->getVBucket(vbid);
+    auto* bgFetcher = vb->getShard()->getBgFetcher();
+    MockGlobalTask mockTask(engine->getTaskable(), TaskId::MultiBGFetcherTask);
+
+    // Within the window: nothing is fetched, and the task is due to run
+    // again at its end.
+    const auto beforeRun = ProcessClock::now();
+    EXPECT_TRUE(bgFetcher->run(&mockTask));
+    EXPECT_TRUE(vb->hasPendingBGFetchItems());
+    EXPECT_GT(mockTask.getWaketime(), beforeRun);
+    EXPECT_EQ(0, stats.bgFetchPassSizeHisto.total());
+
+    // Closing the window lets the next run fetch.
+    engine->getConfiguration().setBgfetcherCoalesceWindow(0);
+    EXPECT_TRUE(bgFetcher->run(&mockTask));
+    EXPECT_FALSE(vb->hasPendingBGFetchItems());
+    EXPECT_EQ(1, stats.bgFetchPassSizeHisto.total());
+    EXPECT_EQ(1, stats.bgFetchCoalesceHisto.total());
+
+    auto result = do_get();
+    ASSERT_EQ(ENGINE_SUCCESS, result.getStatus());
+    EXPECT_EQ("value", result.item->getValue()->to_s());
+}
+
 // Test to ensure all pendingBGfetches are deleted when the
 // VBucketMemoryDeletionTask is run
 TEST_P(EPStoreEvictionTest, MB_21976) {
@@ -802,6 +842,59 @@ TEST_P(EPStoreEvictionTest, memOverheadMemoryCondition) {
     }
 }
 
+// Test that a bulk load creates the vbucket with the items on disk only
+TEST_P(EPStoreEvictionTest, BulkLoadVBucket) {
+    const uint16_t loadVb = 1;
+    const int runs = 3;
+    const int runSize = 100;
+    int run = 0;
+    BulkLoadSource source = [&run](std::vector<std::unique_ptr<Item>>& items) {
+        if (run == runs) {
+            return false;
+        }
+        for (int ii = 0; ii < runSize; ++ii) {
+            const auto key = "key" + std::to_string(run * runSize + ii);
+            items.push_back(std::make_unique<Item>(
+                    makeStoredDocKey(key), 0, 0, "value", 5));
+        }
+        ++run;
+        return true;
+    };
+
+    auto& bucket = dynamic_cast<EPBucket&>(*store);
+    if (GetParam() == "value_only") {
+        EXPECT_EQ(ENGINE_ENOTSUP,
+                  bucket.bulkLoadVBucket(
+                          loadVb, vbucket_state_active, source));
+        return;
+    }
+
+    ASSERT_EQ(ENGINE_SUCCESS,
+              bucket.bulkLoadVBucket(loadVb, vbucket_state_active, source));
+    run = 0;
+    EXPECT_EQ(ENGINE_KEY_EEXISTS,
+              bucket.bulkLoadVBucket(loadVb, vbucket_state_active, source));
+
+    auto vb = store->getVBucket(loadVb);
+    ASSERT_TRUE(vb);
+    EXPECT_EQ(runs * runSize, vb->getHighSeqno());
+    EXPECT_EQ(size_t(runs * runSize), vb->getNumItems());
+    EXPECT_EQ(0u, vb->ht.getNumInMemoryItems());
+
+    auto key = makeStoredDocKey("key42");
+    GetValue gv = store->get(key, loadVb, cookie, QUEUE_BG_FETCH);
+    EXPECT_EQ(ENGINE_EWOULDBLOCK, gv.getStatus());
+
+    // The vbucket may not be on the shard of vbid, so run its own fetcher
+    MockGlobalTask mockTask(engine->getTaskable(),
+                            TaskId::MultiBGFetcherTask);
+    vb->getShard()->getBgFetcher()->run(&mockTask);
+    gv = store->get(key, loadVb, cookie, QUEUE_BG_FETCH);
+    ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+    EXPECT_EQ("value", gv.item->getValue()->to_s());
+    EXPECT_EQ(43, gv.item->getBySeqno());
+}
+
 class EPStoreEvictionBloomOnOffTest
         : public EPBucketTest,
           public ::testing::WithParamInterface<
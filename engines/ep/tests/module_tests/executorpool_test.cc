@@ -21,6 +21,7 @@
 
 #include "executorpool_test.h"
 #include "lambda_task.h"
+#include "taskqueue.h"
 
 MockTaskable::MockTaskable() : policy(HIGH_BUCKET_PRIORITY, 1) {
 }
@@ -30,7 +31,7 @@ const std::string& MockTaskable::getName() const {
 }
 
 task_gid_t MockTaskable::getGID() const {
-    return 0;
+    return reinterpret_cast<task_gid_t>(this);
 }
 
 bucket_priority_t MockTaskable::getWorkloadPriority() const {
@@ -44,6 +45,10 @@ WorkLoadPolicy& MockTaskable::getWorkLoadPolicy(void) {
     return policy;
 }
 
+size_t MockTaskable::getWorkloadShare() const {
+    return share;
+}
+
 void MockTaskable::logQTime(TaskId id, const ProcessClock::duration enqTime) {
 }
 
@@ -241,6 +246,190 @@ TEST_F(ExecutorPoolDynamicWorkerTest, reschedule_dead_task) {
     EXPECT_EQ(2, runCount);
 }
 
+/* With work stealing each TaskQueue has a lane per thread of its type, and
+ * a task queued behind a long running one is stolen by an idle thread: the
+ * two gated tasks below can only both finish if they run concurrently.
+ */
+TEST_F(ExecutorPoolTest, work_stealing) {
+    const size_t numWriters = 2;
+    TestExecutorPool pool(10, // MaxThreads
+                          NUM_TASK_GROUPS,
+                          1, // MaxNumReaders
+                          numWriters,
+                          1, // MaxNumAuxio
+                          1, // MaxNumNonio
+                          true); // workStealing
+
+    MockTaskable taskable;
+    pool.registerTaskable(taskable);
+    ASSERT_EQ(numWriters,
+              pool.getHpTaskQ()[WRITER_TASK_IDX]->getNumLanes());
+
+    // Spread round robin: the gated tasks go into the first lane
+    ThreadGate tg{2};
+    std::atomic<size_t> runs{0};
+    std::vector<ExTask> tasks;
+    tasks.push_back(makeTask(taskable, tg, 0));
+    tasks.push_back(std::make_shared<LambdaTask>(
+            taskable, TaskId::StatSnap, 0, true, [&runs]() -> bool {
+                ++runs;
+                return false;
+            }));
+    tasks.push_back(makeTask(taskable, tg, 2));
+    for (auto& task : tasks) {
+        pool.schedule(task);
+    }
+
+    tg.waitFor(std::chrono::seconds(10));
+    EXPECT_TRUE(tg.isComplete()) << "Timeout waiting for threads to run";
+
+    // And every task of many runs exactly once
+    const size_t numTasks = 1000;
+    for (size_t i = 0; i < numTasks; ++i) {
+        pool.schedule(std::make_shared<LambdaTask>(
+                taskable, TaskId::StatSnap, 0, true, [&runs]() -> bool {
+                    ++runs;
+                    return false;
+                }));
+    }
+    pool.waitForEmptyTaskLocator();
+    EXPECT_EQ(numTasks + 1, runs);
+
+    pool.unregisterTaskable(taskable, false);
+}
+
+/*
+ * ExecutorThread which is not started, to fetch tasks from a queue by hand
+ */
+class FetchingThread : public ExecutorThread {
+public:
+    FetchingThread(ExecutorPool* pool, task_type_t type)
+        : ExecutorThread(pool, type, "fetching_thread") {
+    }
+
+    ExTask fetch(TaskQueue& queue) {
+        updateCurrentTime();
+        if (!queue.fetchNextTask(*this, false)) {
+            return nullptr;
+        }
+        return currentTask;
+    }
+};
+
+/*
+ * The ready tasks of a taskable which got more than its share of the
+ * runtime of a fair share queue wait for those of the other taskables.
+ */
+TEST_F(ExecutorPoolTest, fair_share) {
+    TestExecutorPool pool(10, // MaxThreads
+                          NUM_TASK_GROUPS,
+                          1, // MaxNumReaders
+                          1, // MaxNumWriters
+                          1, // MaxNumAuxio
+                          1); // MaxNumNonio
+    MockTaskable owner;
+    pool.registerTaskable(owner);
+
+    MockTaskable heavy;
+    MockTaskable light;
+    light.setWorkloadShare(2);
+
+    for (bool fairShare : {false, true}) {
+        TaskQueue queue(&pool, WRITER_TASK_IDX, "FairShareQ_", 0, false,
+                        fairShare);
+        // All the tasks previously ran for 10ms; those of heavy come first
+        // in priority order (same priority, scheduled first)
+        const size_t numTasks = 6;
+        for (auto* taskable : {&heavy, &light}) {
+            for (size_t i = 0; i < numTasks; ++i) {
+                ExTask task = std::make_shared<LambdaTask>(
+                        *taskable, TaskId::StatSnap, 0, true, []() -> bool {
+                            return false;
+                        });
+                task->updateRuntime(std::chrono::milliseconds(10));
+                queue.schedule(task);
+            }
+        }
+
+        FetchingThread thread(&pool, WRITER_TASK_IDX);
+        size_t heavyRuns = 0;
+        for (size_t i = 0; i < 9; ++i) {
+            ExTask task = thread.fetch(queue);
+            ASSERT_TRUE(task);
+            if (&task->getTaskable() == &heavy) {
+                ++heavyRuns;
+            }
+        }
+        if (fairShare) {
+            // Light runs twice for each run of heavy
+            EXPECT_EQ(3u, heavyRuns);
+
+            const auto stats = queue.getShareStats();
+            ASSERT_EQ(2u, stats.size());
+            for (const auto& share : stats) {
+                const uint64_t runs = share.weight == 2 ? 6 : 3;
+                EXPECT_EQ(runs, share.runs);
+                EXPECT_EQ(runs * std::chrono::milliseconds(10), share.runtime);
+            }
+        } else {
+            EXPECT_EQ(numTasks, heavyRuns);
+            EXPECT_TRUE(queue.getShareStats().empty());
+        }
+
+        while (thread.fetch(queue)) {
+        }
+    }
+
+    pool.unregisterTaskable(owner, false);
+}
+
+/*
+ * The ready latency critical tasks of a queue with a critical lane run
+ * before the others, and are all that a reserved thread takes.
+ */
+TEST_F(ExecutorPoolTest, critical_lane) {
+    TestExecutorPool pool(10, // MaxThreads
+                          NUM_TASK_GROUPS,
+                          1, // MaxNumReaders
+                          1, // MaxNumWriters
+                          1, // MaxNumAuxio
+                          1); // MaxNumNonio
+    MockTaskable taskable;
+    pool.registerTaskable(taskable);
+
+    TaskQueue queue(&pool, READER_TASK_IDX, "CriticalQ_", 0, false, false,
+                    true);
+    ASSERT_TRUE(queue.hasCriticalLane());
+    auto makeReaderTask = [&taskable](TaskId id) -> ExTask {
+        return std::make_shared<LambdaTask>(
+                taskable, id, 0, true, []() -> bool { return false; });
+    };
+    // Same priority as the background fetch, and scheduled first
+    ExTask bulk = makeReaderTask(TaskId::FetchAllKeysTask);
+    ExTask critical = makeReaderTask(TaskId::MultiBGFetcherTask);
+    queue.schedule(bulk);
+    queue.schedule(critical);
+
+    FetchingThread reserved(&pool, READER_TASK_IDX);
+    reserved.setReserved(true);
+    EXPECT_EQ(critical, reserved.fetch(queue));
+    EXPECT_FALSE(reserved.fetch(queue));
+    EXPECT_EQ(1u, queue.getReadyQueueSize());
+
+    // A critical task coming due goes before the ready ones
+    ExTask next = makeReaderTask(TaskId::SingleBGFetcherTask);
+    queue.schedule(next);
+    FetchingThread thread(&pool, READER_TASK_IDX);
+    EXPECT_EQ(next, thread.fetch(queue));
+    EXPECT_EQ(bulk, thread.fetch(queue));
+    EXPECT_FALSE(thread.fetch(queue));
+
+    EXPECT_EQ(2u, queue.getCriticalStats().runs);
+    EXPECT_EQ(0u, queue.getCriticalQueueSize());
+
+    pool.unregisterTaskable(taskable, false);
+}
+
 /* Testing to ensure that repeatedly scheduling a task does not result in
  * multiple entries in the taskQueue - this could cause a deadlock in
  * _unregisterTaskable when the taskLocator is empty but duplicate tasks remain
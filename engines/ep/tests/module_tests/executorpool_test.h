@@ -43,6 +43,12 @@ public:
 
     WorkLoadPolicy& getWorkLoadPolicy(void);
 
+    size_t getWorkloadShare() const;
+
+    void setWorkloadShare(size_t s) {
+        share = s;
+    }
+
     void logQTime(TaskId id, const ProcessClock::duration enqTime);
 
     void logRunTime(TaskId id, const ProcessClock::duration runTime);
@@ -50,6 +56,7 @@ public:
 protected:
     std::string name;
     WorkLoadPolicy policy;
+    size_t share = 1;
 };
 
 class TestExecutorPool : public ExecutorPool {
@@ -59,13 +66,19 @@ public:
                      size_t maxReaders,
                      size_t maxWriters,
                      size_t maxAuxIO,
-                     size_t maxNonIO)
+                     size_t maxNonIO,
+                     bool workStealing = false)
         : ExecutorPool(maxThreads,
                        nTaskSets,
                        maxReaders,
                        maxWriters,
                        maxAuxIO,
-                       maxNonIO) {
+                       maxNonIO,
+                       workStealing) {
+    }
+
+    TaskQ& getHpTaskQ() {
+        return hpTaskQ;
     }
 
     size_t getNumBuckets() {
@@ -0,0 +1,84 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "expiry_index.h"
+
+#include <gtest/gtest.h>
+
+using Hashes = std::vector<uint32_t>;
+
+TEST(ExpiryIndexTest, Empty) {
+    ExpiryIndex index(10);
+    EXPECT_EQ(0, index.size());
+    EXPECT_TRUE(index.takeDue(1000).empty());
+    EXPECT_THROW(index.add(1, 0), std::invalid_argument);
+}
+
+TEST(ExpiryIndexTest, TakeDue) {
+    ExpiryIndex index(10);
+    index.add(3, 105);
+    index.add(1, 112);
+    index.add(2, 109);
+    index.add(4, 131);
+    EXPECT_EQ(4, index.size());
+
+    // Nothing has expired yet
+    EXPECT_TRUE(index.takeDue(100).empty());
+
+    // The slot we're in is handed out, but kept
+    EXPECT_EQ(Hashes({2, 3}), index.takeDue(106));
+    EXPECT_EQ(Hashes({2, 3}), index.takeDue(109));
+    EXPECT_EQ(4, index.size());
+
+    // Once its period has passed it is taken out
+    EXPECT_EQ(Hashes({1, 2, 3}), index.takeDue(113));
+    EXPECT_EQ(2, index.size());
+    EXPECT_EQ(Hashes({1}), index.takeDue(120));
+    EXPECT_EQ(1, index.size());
+
+    EXPECT_EQ(Hashes({4}), index.takeDue(1000));
+    EXPECT_EQ(0, index.size());
+}
+
+TEST(ExpiryIndexTest, Duplicates) {
+    ExpiryIndex index(10);
+    // Updates of the same key back to back are only added once
+    index.add(1, 101);
+    index.add(1, 102);
+    EXPECT_EQ(1, index.size());
+
+    // Otherwise they're only returned once
+    index.add(2, 103);
+    index.add(1, 104);
+    index.add(1, 115);
+    EXPECT_EQ(4, index.size());
+    EXPECT_EQ(Hashes({1, 2}), index.takeDue(200));
+    EXPECT_EQ(0, index.size());
+}
+
+TEST(ExpiryIndexTest, Clear) {
+    ExpiryIndex index(10);
+    const auto memory = index.memorySize();
+    index.add(1, 101);
+    index.add(2, 201);
+    EXPECT_LT(memory, index.memorySize());
+
+    index.clear();
+    EXPECT_EQ(0, index.size());
+    EXPECT_EQ(memory, index.memorySize());
+    EXPECT_TRUE(index.takeDue(1000).empty());
+}
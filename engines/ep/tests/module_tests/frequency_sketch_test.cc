@@ -0,0 +1,103 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "frequency_sketch.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+TEST(FrequencySketchTest, Width) {
+    EXPECT_EQ(16, FrequencySketch(0).getWidth());
+    EXPECT_EQ(1024, FrequencySketch(1000).getWidth());
+    EXPECT_EQ(1024, FrequencySketch(1024).getWidth());
+    EXPECT_EQ(10 * 1024, FrequencySketch(1024).getSampleSize());
+}
+
+TEST(FrequencySketchTest, Estimate) {
+    FrequencySketch sketch(1024);
+    EXPECT_EQ(0, sketch.estimate(1));
+
+    for (int ii = 0; ii < 5; ++ii) {
+        sketch.increment(1);
+    }
+    sketch.increment(2);
+    EXPECT_EQ(5, sketch.estimate(1));
+    EXPECT_EQ(1, sketch.estimate(2));
+}
+
+TEST(FrequencySketchTest, Saturates) {
+    FrequencySketch sketch(1024);
+    for (int ii = 0; ii < 100; ++ii) {
+        sketch.increment(1);
+    }
+    EXPECT_EQ(FrequencySketch::MaxFrequency, sketch.estimate(1));
+}
+
+// The estimate may overcount (a collision in every row), but never
+// undercounts
+TEST(FrequencySketchTest, NeverUndercounts) {
+    FrequencySketch sketch(64);
+    for (uint32_t hash = 0; hash < 200; ++hash) {
+        for (uint32_t ii = 0; ii < hash % 4; ++ii) {
+            sketch.increment(hash);
+        }
+    }
+    for (uint32_t hash = 0; hash < 200; ++hash) {
+        EXPECT_LE(hash % 4, sketch.estimate(hash)) << "hash:" << hash;
+    }
+}
+
+// Once we've counted the sample size the counters are halved
+TEST(FrequencySketchTest, Aging) {
+    FrequencySketch sketch(16);
+    for (int ii = 0; ii < 8; ++ii) {
+        sketch.increment(12345);
+    }
+
+    // Count other keys until the counters are aged (their collisions with
+    // our key may only increase its estimate until then)
+    uint8_t before = sketch.estimate(12345);
+    uint8_t after = before;
+    for (uint32_t hash = 0; hash < 10 * sketch.getSampleSize(); ++hash) {
+        sketch.increment(hash);
+        after = sketch.estimate(12345);
+        if (after < before) {
+            break;
+        }
+        before = after;
+    }
+    ASSERT_LE(8, before);
+    EXPECT_GE((before + 1) / 2, after);
+}
+
+TEST(FrequencySketchTest, ConcurrentIncrements) {
+    FrequencySketch sketch(1024);
+    std::vector<std::thread> threads;
+    for (int ii = 0; ii < 4; ++ii) {
+        threads.emplace_back([&sketch]() {
+            for (int jj = 0; jj < 3; ++jj) {
+                sketch.increment(42);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(12, sketch.estimate(42));
+}
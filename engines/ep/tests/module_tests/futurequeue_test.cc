@@ -19,46 +19,59 @@
 
 #include "futurequeue.h"
 #include "tests/module_tests/test_task.h"
+#include "timer_wheel.h"
 
-class FutureQueueTest : public ::testing::TestWithParam<std::string> {
+#include <algorithm>
+#include <random>
+#include <set>
+
+/*
+ * The tests every queue a TaskQueue can keep its future tasks in must pass.
+ */
+template <typename Queue>
+class FutureQueueTest : public ::testing::Test {
 public:
-    FutureQueue<> queue;
+    Queue queue;
 };
 
-TEST_F(FutureQueueTest, initAssumptions) {
-    EXPECT_EQ(0u, queue.size());
-    EXPECT_TRUE(queue.empty());
+using FutureQueueTypes = ::testing::Types<FutureQueue<>, TimerWheel>;
+
+TYPED_TEST_CASE(FutureQueueTest, FutureQueueTypes);
+
+TYPED_TEST(FutureQueueTest, initAssumptions) {
+    EXPECT_EQ(0u, this->queue.size());
+    EXPECT_TRUE(this->queue.empty());
 }
 
-TEST_F(FutureQueueTest, push1) {
+TYPED_TEST(FutureQueueTest, push1) {
     ExTask hpTask =
             std::make_shared<TestTask>(nullptr, TaskId::PendingOpsNotification);
 
-    queue.push(hpTask);
-    EXPECT_EQ(1u, queue.size());
-    EXPECT_FALSE(queue.empty());
+    this->queue.push(hpTask);
+    EXPECT_EQ(1u, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
 
-    EXPECT_EQ(TaskId::PendingOpsNotification, queue.top()->getTypeId());
+    EXPECT_EQ(TaskId::PendingOpsNotification, this->queue.top()->getTypeId());
 }
 
-TEST_F(FutureQueueTest, pushn) {
+TYPED_TEST(FutureQueueTest, pushn) {
     ExTask hpTask =
             std::make_shared<TestTask>(nullptr, TaskId::PendingOpsNotification);
 
     const size_t n = 10;
     for (size_t i = 0; i < n; i++) {
-        queue.push(hpTask);
+        this->queue.push(hpTask);
     }
-    EXPECT_EQ(n, queue.size());
-    EXPECT_FALSE(queue.empty());
-    EXPECT_EQ(TaskId::PendingOpsNotification, queue.top()->getTypeId());
+    EXPECT_EQ(n, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
+    EXPECT_EQ(TaskId::PendingOpsNotification, this->queue.top()->getTypeId());
 }
 
 /*
  * Push n TestTask objects, each with an id of their push order but with
  * a decreasing waketime, i.e. last element pushed has the smallest wakeTime.
  */
-TEST_F(FutureQueueTest, pushOrder) {
+TYPED_TEST(FutureQueueTest, pushOrder) {
     const int n = 10;
     for (int i = 0; i <= n; i++) {
         ExTask hpTask;
@@ -66,11 +79,11 @@ TEST_F(FutureQueueTest, pushOrder) {
                 nullptr, TaskId::PendingOpsNotification, i);
         const auto newtime = std::chrono::nanoseconds(n - i);
         hpTask->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(hpTask);
+        this->queue.push(hpTask);
     }
 
     // last task pushed must be the first one in the queue
-    EXPECT_EQ(n, static_cast<TestTask*>(queue.top().get())->order);
+    EXPECT_EQ(n, static_cast<TestTask*>(this->queue.top().get())->order);
 }
 
 /*
@@ -80,7 +93,7 @@ TEST_F(FutureQueueTest, pushOrder) {
  * Then use the queue updateWake time to move a task to the front
  *
  */
-TEST_F(FutureQueueTest, updateWaketime) {
+TYPED_TEST(FutureQueueTest, updateWaketime) {
     const int n = 10;
     ExTask middleTask;
     for (int i = 0; i <= n; i++) {
@@ -89,7 +102,7 @@ TEST_F(FutureQueueTest, updateWaketime) {
                 nullptr, TaskId::PendingOpsNotification, i);
         const auto newtime = std::chrono::nanoseconds((n * 2) - i);
         hpTask->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(hpTask);
+        this->queue.push(hpTask);
 
         if (i == n/2) {
             middleTask = hpTask;
@@ -99,17 +112,17 @@ TEST_F(FutureQueueTest, updateWaketime) {
     ASSERT_NE(nullptr, middleTask.get());
 
     // last task pushed must be the first one in the queue
-    EXPECT_EQ(n, static_cast<TestTask*>(queue.top().get())->order);
+    EXPECT_EQ(n, static_cast<TestTask*>(this->queue.top().get())->order);
     EXPECT_NE(static_cast<TestTask*>(middleTask.get())->order,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 
     // Now update the n/2 task's time and expect it to become the front task
-    EXPECT_TRUE(queue.updateWaketime(middleTask,
+    EXPECT_TRUE(this->queue.updateWaketime(middleTask,
                                      ProcessClock::time_point::min()));
 
     // Now the middleTask is queue.top
     EXPECT_EQ(static_cast<TestTask*>(middleTask.get())->order,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 }
 
 /*
@@ -119,7 +132,7 @@ TEST_F(FutureQueueTest, updateWaketime) {
  * Then use the snooze method to move a task from the front
  *
  */
-TEST_F(FutureQueueTest, snooze) {
+TYPED_TEST(FutureQueueTest, snooze) {
     const int n = 10;
 
     for (int i = 0; i <= n; i++) {
@@ -128,26 +141,26 @@ TEST_F(FutureQueueTest, snooze) {
                 nullptr, TaskId::PendingOpsNotification, i);
         const auto newtime = std::chrono::nanoseconds((n * 2) - i);
         hpTask->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(hpTask);
+        this->queue.push(hpTask);
     }
 
     // Now update the top task's time and expect it to become the last task
     // we can't see the back, so will pop/top all..
-    int top = static_cast<TestTask*>(queue.top().get())->order;
-    EXPECT_TRUE(queue.snooze(queue.top(), n*3));
+    int top = static_cast<TestTask*>(this->queue.top().get())->order;
+    EXPECT_TRUE(this->queue.snooze(this->queue.top(), n*3));
 
     // The top task is not the old top
     EXPECT_NE(top,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 
     ExTask lastTask;
-    while (!queue.empty()) {
+    while (!this->queue.empty()) {
         if (lastTask) {
             EXPECT_LT(lastTask->getWaketime(),
-                      queue.top()->getWaketime());
+                      this->queue.top()->getWaketime());
         }
-        lastTask = queue.top();
-        queue.pop();
+        lastTask = this->queue.top();
+        this->queue.pop();
     }
 
     EXPECT_EQ(top, static_cast<TestTask*>(lastTask.get())->order);
@@ -156,65 +169,196 @@ TEST_F(FutureQueueTest, snooze) {
 /*
  * snooze/wake a task not in the queue, the queue is also empty.
  */
-TEST_F(FutureQueueTest, taskNotInEmptyQueue) {
+TYPED_TEST(FutureQueueTest, taskNotInEmptyQueue) {
     ExTask task =
             std::make_shared<TestTask>(nullptr, TaskId::PendingOpsNotification);
 
     const auto wake = task->getWaketime();
-    queue.snooze(task, 5.0);
+    this->queue.snooze(task, 5.0);
     // snooze uses gethrtime so we'll only check that the tasks time changed.
     EXPECT_NE(wake, task->getWaketime());
 
-    EXPECT_EQ(0u, queue.size());
-    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0u, this->queue.size());
+    EXPECT_TRUE(this->queue.empty());
 
     const auto newtime = std::chrono::nanoseconds(5);
-    EXPECT_FALSE(queue.updateWaketime(task, ProcessClock::time_point(newtime)));
+    EXPECT_FALSE(this->queue.updateWaketime(task,
+                                            ProcessClock::time_point(newtime)));
     EXPECT_EQ(ProcessClock::time_point(std::chrono::nanoseconds(5)),
               task->getWaketime());
 
-    EXPECT_EQ(0u, queue.size());
-    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0u, this->queue.size());
+    EXPECT_TRUE(this->queue.empty());
 }
 
 /*
  * snooze/wake a task not in the queue
  */
-TEST_F(FutureQueueTest, taskNotInQueue) {
+TYPED_TEST(FutureQueueTest, taskNotInQueue) {
     const size_t nTasks = 5;
     for (size_t ii = 1; ii < nTasks; ii++) {
         ExTask t = std::make_shared<TestTask>(nullptr,
                                               TaskId::PendingOpsNotification);
         const auto newtime = std::chrono::nanoseconds(1+ii);
         t->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(t);
+        this->queue.push(t);
     }
     // Finally push a task with an obvious ID value of -1
     ExTask task = std::make_shared<TestTask>(
             nullptr, TaskId::PendingOpsNotification, -1);
     task->updateWaketime(ProcessClock::time_point::min());
-    queue.push(task);
+    this->queue.push(task);
 
     // Now operate with a new task not in the queue
     task = std::make_shared<TestTask>(nullptr, TaskId::PendingOpsNotification);
     const auto wake = task->getWaketime();
-    EXPECT_FALSE(queue.snooze(task, 5.0));
+    EXPECT_FALSE(this->queue.snooze(task, 5.0));
 
     // snooze uses gethrtime so we'll only check that the tasks time changed.
     EXPECT_NE(wake, task->getWaketime());
 
-    EXPECT_EQ(nTasks, queue.size());
-    EXPECT_FALSE(queue.empty());
+    EXPECT_EQ(nTasks, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
     EXPECT_EQ(-1,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 
     const auto newtime = std::chrono::nanoseconds(5);
-    EXPECT_FALSE(queue.updateWaketime(task, ProcessClock::time_point(newtime)));
+    EXPECT_FALSE(this->queue.updateWaketime(task,
+                                            ProcessClock::time_point(newtime)));
     EXPECT_EQ(ProcessClock::time_point(std::chrono::nanoseconds(5)),
               task->getWaketime());
 
-    EXPECT_EQ(nTasks, queue.size());
-    EXPECT_FALSE(queue.empty());
+    EXPECT_EQ(nTasks, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
     EXPECT_EQ(-1,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
+}
+
+class TimerWheelTest : public ::testing::Test {
+public:
+    TimerWheelTest() : start(ProcessClock::now()), wheel(start) {
+    }
+
+    ExTask makeTask(int order, ProcessClock::time_point waketime) {
+        ExTask task = std::make_shared<TestTask>(
+                nullptr, TaskId::PendingOpsNotification, order);
+        task->updateWaketime(waketime);
+        return task;
+    }
+
+    const ProcessClock::time_point start;
+    TimerWheel wheel;
+};
+
+/*
+ * Tasks due in every level of the wheel and beyond (in the overflow list)
+ * pop in wakeTime order, however they were pushed.
+ */
+TEST_F(TimerWheelTest, popAcrossLevels) {
+    using namespace std::chrono;
+    const std::vector<ProcessClock::time_point> waketimes = {
+            start - milliseconds(1),
+            start + milliseconds(5),
+            start + milliseconds(70),
+            start + seconds(5),
+            start + seconds(300),
+            start + hours(5),
+            ProcessClock::time_point::max()};
+
+    std::vector<ExTask> tasks;
+    for (size_t ii = 0; ii < waketimes.size(); ++ii) {
+        tasks.push_back(makeTask(ii, waketimes[ii]));
+    }
+    std::shuffle(tasks.begin(), tasks.end(), std::mt19937(1));
+    for (auto& task : tasks) {
+        wheel.push(task);
+    }
+    ASSERT_EQ(waketimes.size(), wheel.size());
+
+    for (size_t ii = 0; ii < waketimes.size(); ++ii) {
+        ASSERT_FALSE(wheel.empty());
+        EXPECT_EQ(int(ii), static_cast<TestTask*>(wheel.top().get())->order);
+        wheel.pop();
+    }
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_FALSE(wheel.top());
+}
+
+/*
+ * Moving a task from a high level of the wheel to the front and back again.
+ */
+TEST_F(TimerWheelTest, updateWaketimeAcrossLevels) {
+    using namespace std::chrono;
+    ExTask soon = makeTask(0, start + milliseconds(10));
+    ExTask later = makeTask(1, start + hours(1));
+    wheel.push(soon);
+    wheel.push(later);
+
+    EXPECT_TRUE(wheel.updateWaketime(later, start + milliseconds(1)));
+    EXPECT_EQ(later, wheel.top());
+
+    EXPECT_TRUE(wheel.updateWaketime(later, start + seconds(10)));
+    EXPECT_EQ(soon, wheel.top());
+    wheel.pop();
+    EXPECT_EQ(later, wheel.top());
+    wheel.pop();
+    EXPECT_TRUE(wheel.empty());
+}
+
+/*
+ * Interleave pushes, wakeTime updates and pops at random and check the wheel
+ * pops the same wakeTimes as a sorted set of them.
+ */
+TEST_F(TimerWheelTest, randomAgainstReference) {
+    std::mt19937 gen(42);
+    // From due already to a few levels up, in ms
+    std::uniform_int_distribution<int64_t> offset(-10, 20000000);
+    std::uniform_int_distribution<int> action(0, 3);
+
+    std::multiset<ProcessClock::time_point> reference;
+    std::vector<ExTask> queued;
+    ProcessClock::time_point lastPopped = ProcessClock::time_point::min();
+
+    for (int ii = 0; ii < 5000; ++ii) {
+        // Tasks are not pushed before the last one popped, as in a TaskQueue
+        const auto base = std::max(start, lastPopped);
+        switch (action(gen)) {
+        case 0:
+        case 1: {
+            auto waketime = base + std::chrono::milliseconds(offset(gen));
+            queued.push_back(makeTask(ii, waketime));
+            wheel.push(queued.back());
+            reference.insert(waketime);
+            break;
+        }
+        case 2:
+            if (!queued.empty()) {
+                auto& task = queued[gen() % queued.size()];
+                reference.erase(reference.find(task->getWaketime()));
+                auto waketime = base + std::chrono::milliseconds(offset(gen));
+                ASSERT_TRUE(wheel.updateWaketime(task, waketime));
+                reference.insert(waketime);
+            }
+            break;
+        case 3:
+            if (!reference.empty()) {
+                ExTask top = wheel.top();
+                ASSERT_TRUE(top);
+                ASSERT_EQ(*reference.begin(), top->getWaketime());
+                lastPopped = top->getWaketime();
+                wheel.pop();
+                reference.erase(reference.begin());
+                queued.erase(std::find(queued.begin(), queued.end(), top));
+            }
+            break;
+        }
+        ASSERT_EQ(reference.size(), wheel.size());
+    }
+
+    while (!reference.empty()) {
+        ASSERT_EQ(*reference.begin(), wheel.top()->getWaketime());
+        wheel.pop();
+        reference.erase(reference.begin());
+    }
+    EXPECT_TRUE(wheel.empty());
 }
@@ -24,6 +24,7 @@
 #include "stored_value_factories.h"
 #include "tests/module_tests/test_helpers.h"
 #include "threadtests.h"
+#include "vb_visitors.h"
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -32,6 +33,7 @@
 #include <algorithm>
 #include <limits>
 #include <signal.h>
+#include <thread>
 
 EPStats global_stats;
 
@@ -251,6 +253,61 @@ TEST_F(HashTableTest, Resize) {
     verifyFound(h, keys);
 }
 
+// The number of locks is a power of two, and grows (up to the maximum) as
+// the table is resized, but never shrinks
+TEST_F(HashTableTest, ResizeGrowsLocks) {
+    HashTable h(global_stats,
+                makeFactory(),
+                47,
+                3,
+                HashTable::BucketLayout::Chained,
+                /*maxLocks*/ 100);
+    EXPECT_EQ(4, h.getNumLocks());
+
+    auto keys = generateKeys(1000);
+    storeMany(h, keys);
+
+    h.resize(6143);
+    EXPECT_EQ(64, h.getNumLocks());
+    verifyFound(h, keys);
+
+    h.resize(769);
+    EXPECT_EQ(64, h.getNumLocks());
+    verifyFound(h, keys);
+
+    h.clear();
+    EXPECT_EQ(0, h.getNumItems());
+}
+
+// Only bucket arrays of whole huge pages are advised to be backed by them,
+// and the count follows the array as the table is resized
+TEST_F(HashTableTest, HugePages) {
+    HashTable h(global_stats,
+                makeFactory(),
+                47,
+                3,
+                HashTable::BucketLayout::Chained,
+                /*maxLocks*/ 0,
+                /*hugePages*/ true);
+    EXPECT_EQ(0, h.getHugePageBytes());
+
+    auto keys = generateKeys(1000);
+    storeMany(h, keys);
+
+    const size_t bigSize = 4 * cb::hugepages::pageSize / sizeof(void*);
+    h.resize(bigSize);
+    if (cb::hugepages::isTransparentSupported()) {
+        EXPECT_LE(2 * cb::hugepages::pageSize, h.getHugePageBytes());
+    } else {
+        EXPECT_EQ(0, h.getHugePageBytes());
+    }
+    verifyFound(h, keys);
+
+    h.resize(769);
+    EXPECT_EQ(0, h.getHugePageBytes());
+    verifyFound(h, keys);
+}
+
 class AccessGenerator : public Generator<bool> {
 public:
 
@@ -295,6 +352,99 @@ TEST_F(HashTableTest, ConcurrentAccessResize) {
     getCompletedThreads(4, &gen);
 }
 
+// The records are moved over to the new table incrementally while resizing,
+// so the front-end operations must find every record (in either table) the
+// whole time.
+TEST_F(HashTableTest, FindWhileResizing) {
+    HashTable h(global_stats, makeFactory(), 5, 3);
+
+    auto keys = generateKeys(5000);
+    storeMany(h, keys);
+
+    std::atomic<bool> done{false};
+    std::thread resizer([&h, &done]() {
+        for (int ii = 0; ii < 20; ++ii) {
+            h.resize(ii % 2 == 0 ? 24571 : 47);
+        }
+        done = true;
+    });
+
+    do {
+        verifyFound(h, keys);
+    } while (!done);
+    resizer.join();
+
+    EXPECT_EQ(20, h.getNumResizes());
+    EXPECT_EQ(47, h.getSize());
+    EXPECT_EQ(keys.size(), count(h));
+}
+
+TEST_F(HashTableTest, SharedLockedBucket) {
+    HashTable h(global_stats, makeFactory(), 5, 1);
+
+    auto keys = generateKeys(100);
+    storeMany(h, keys);
+
+    for (const auto& key : keys) {
+        // Readers don't exclude each other
+        auto first = h.getSharedLockedBucket(key);
+        auto second = h.getSharedLockedBucket(key);
+        ASSERT_TRUE(first);
+        ASSERT_TRUE(second);
+        EXPECT_EQ(first.getBucketNum(), second.getBucketNum());
+        EXPECT_NE(nullptr,
+                  h.unlocked_find(key,
+                                  first.getBucketNum(),
+                                  WantsDeleted::No,
+                                  TrackReference::No));
+    }
+
+    auto missing = makeStoredDocKey("missing");
+    auto shbl = h.getSharedLockedBucket(missing);
+    ASSERT_TRUE(shbl);
+    EXPECT_EQ(nullptr,
+              h.unlocked_find(missing,
+                              shbl.getBucketNum(),
+                              WantsDeleted::No,
+                              TrackReference::No));
+}
+
+// Readers with shared access must still be excluded by the writers
+TEST_F(HashTableTest, SharedFindWhileWriting) {
+    HashTable h(global_stats, makeFactory(), 47, 3);
+
+    auto keys = generateKeys(500);
+    storeMany(h, keys);
+    auto churn = generateKeys(1000, 500);
+
+    std::atomic<bool> done{false};
+    std::thread writer([&h, &churn, &done]() {
+        for (int ii = 0; ii < 20; ++ii) {
+            storeMany(h, churn);
+            for (const auto& key : churn) {
+                del(h, key);
+            }
+        }
+        done = true;
+    });
+
+    do {
+        for (const auto& key : keys) {
+            auto shbl = h.getSharedLockedBucket(key);
+            ASSERT_TRUE(shbl);
+            auto* v = h.unlocked_find(key,
+                                      shbl.getBucketNum(),
+                                      WantsDeleted::No,
+                                      TrackReference::No);
+            ASSERT_NE(nullptr, v);
+            EXPECT_TRUE(v->hasKey(key));
+        }
+    } while (!done);
+    writer.join();
+
+    EXPECT_EQ(keys.size(), count(h));
+}
+
 TEST_F(HashTableTest, AutoResize) {
     HashTable h(global_stats, makeFactory(), 5, 3);
 
@@ -310,6 +460,100 @@ TEST_F(HashTableTest, AutoResize) {
     verifyFound(h, keys);
 }
 
+TEST_F(HashTableTest, TaggedFind) {
+    HashTable h(global_stats,
+                makeFactory(),
+                5,
+                1,
+                HashTable::BucketLayout::Tagged);
+    EXPECT_EQ(HashTable::BucketLayout::Tagged, h.getBucketLayout());
+    testFind(h);
+}
+
+TEST_F(HashTableTest, TaggedResize) {
+    HashTable h(global_stats,
+                makeFactory(),
+                5,
+                3,
+                HashTable::BucketLayout::Tagged);
+
+    auto keys = generateKeys(1000);
+    storeMany(h, keys);
+    verifyFound(h, keys);
+
+    // Most chains are indexed after the resize
+    h.resize(6143);
+    verifyFound(h, keys);
+
+    h.resize(769);
+    verifyFound(h, keys);
+    EXPECT_EQ(keys.size(), count(h));
+}
+
+// Deleting from long (overflowed) chains must let the index catch up once
+// the chains are short again
+TEST_F(HashTableTest, TaggedDeletions) {
+    size_t initialSize = global_stats.currentSize.load();
+    HashTable h(global_stats,
+                makeFactory(),
+                5,
+                1,
+                HashTable::BucketLayout::Tagged);
+    const int nkeys = 1000;
+
+    auto keys = generateKeys(nkeys);
+    storeMany(h, keys);
+    EXPECT_EQ(nkeys, count(h));
+
+    for (size_t ii = 0; ii < keys.size(); ++ii) {
+        EXPECT_TRUE(del(h, keys[ii]));
+        if (ii % 97 == 0) {
+            // The remaining keys must still be found, and the deleted not
+            EXPECT_FALSE(h.find(keys[ii], TrackReference::No, WantsDeleted::Yes));
+            std::vector<StoredDocKey> remaining(keys.begin() + ii + 1,
+                                                keys.end());
+            verifyFound(h, remaining);
+        }
+    }
+
+    EXPECT_EQ(0, count(h));
+    EXPECT_EQ(initialSize, global_stats.currentSize.load());
+}
+
+TEST_F(HashTableTest, TaggedFindWhileResizing) {
+    HashTable h(global_stats,
+                makeFactory(),
+                5,
+                3,
+                HashTable::BucketLayout::Tagged);
+
+    auto keys = generateKeys(5000);
+    storeMany(h, keys);
+
+    std::atomic<bool> done{false};
+    std::thread resizer([&h, &done]() {
+        for (int ii = 0; ii < 10; ++ii) {
+            h.resize(ii % 2 == 0 ? 6143 : 769);
+        }
+        done = true;
+    });
+
+    do {
+        verifyFound(h, keys);
+    } while (!done);
+    resizer.join();
+
+    EXPECT_EQ(keys.size(), count(h));
+}
+
+TEST_F(HashTableTest, ParseBucketLayout) {
+    EXPECT_EQ(HashTable::BucketLayout::Chained,
+              HashTable::parseBucketLayout("chained"));
+    EXPECT_EQ(HashTable::BucketLayout::Tagged,
+              HashTable::parseBucketLayout("tagged"));
+    EXPECT_THROW(HashTable::parseBucketLayout("swiss"), std::invalid_argument);
+}
+
 TEST_F(HashTableTest, DepthCounting) {
     HashTable h(global_stats, makeFactory(), 5, 1);
     const int nkeys = 5000;
@@ -415,6 +659,74 @@ TEST_P(HashTableStatsTest, EjectFlush) {
     ht.clear();
 }
 
+// Check that compressing a value in memory reduces the size of the cache,
+// and that inflating or ejecting it restores the original datatype.
+TEST_P(HashTableStatsTest, CompressInflate) {
+    {
+        // Not referring to the value from elsewhere, so it may be compressed
+        Item local(key, 0, 0, std::string(itemSize, 'x').data(), itemSize);
+        EXPECT_EQ(MutationStatus::WasClean, ht.set(local));
+    }
+    const auto cacheSizeBefore = ht.cacheSize.load();
+    {
+        auto hbl = ht.getLockedBucket(key);
+        StoredValue* v = ht.unlocked_find(
+                key, hbl.getBucketNum(), WantsDeleted::No, TrackReference::No);
+        ASSERT_NE(nullptr, v);
+        ASSERT_TRUE(ht.unlocked_compressValue(hbl.getHTLock(), *v, 0.85));
+        EXPECT_TRUE(v->isCompressedInMemory());
+        EXPECT_TRUE(mcbp::datatype::is_snappy(v->getDatatype()));
+        EXPECT_LT(ht.cacheSize.load(), cacheSizeBefore);
+        EXPECT_EQ(1, ht.datatypeCounts[PROTOCOL_BINARY_DATATYPE_SNAPPY]);
+
+        // Already compressed
+        EXPECT_FALSE(ht.unlocked_compressValue(hbl.getHTLock(), *v, 0.85));
+
+        ASSERT_TRUE(ht.unlocked_inflateValue(hbl.getHTLock(), *v));
+        EXPECT_FALSE(v->isCompressedInMemory());
+        EXPECT_EQ(PROTOCOL_BINARY_RAW_BYTES, v->getDatatype());
+        EXPECT_EQ(std::string(itemSize, 'x'),
+                  std::string(v->getValue()->getData(), v->valuelen()));
+        EXPECT_EQ(cacheSizeBefore, ht.cacheSize.load());
+        EXPECT_EQ(0, ht.datatypeCounts[PROTOCOL_BINARY_DATATYPE_SNAPPY]);
+
+        // Ejecting a compressed value restores the datatype of the document
+        ASSERT_TRUE(ht.unlocked_compressValue(hbl.getHTLock(), *v, 0.85));
+        v->markClean();
+        EXPECT_TRUE(ht.unlocked_ejectItem(v, evictionPolicy));
+        if (evictionPolicy == VALUE_ONLY) {
+            EXPECT_EQ(PROTOCOL_BINARY_RAW_BYTES, v->getDatatype());
+            EXPECT_FALSE(v->isCompressedInMemory());
+        }
+        EXPECT_EQ(0, ht.datatypeCounts[PROTOCOL_BINARY_DATATYPE_SNAPPY]);
+    }
+
+    del(ht, key);
+}
+
+// Check that the resident set changes are counted, and only them
+TEST_P(HashTableStatsTest, ResidentSetChanges) {
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item));
+    auto changes = ht.getNumResidentSetChanges();
+    EXPECT_NE(0, changes);
+
+    // Updating (or reading) a resident item doesn't change the resident set
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item));
+    StoredValue* v(ht.find(key, TrackReference::Yes, WantsDeleted::No));
+    ASSERT_TRUE(v);
+    EXPECT_EQ(changes, ht.getNumResidentSetChanges());
+
+    v->markClean();
+    EXPECT_TRUE(ht.unlocked_ejectItem(v, evictionPolicy));
+    EXPECT_LT(changes, ht.getNumResidentSetChanges());
+    changes = ht.getNumResidentSetChanges();
+
+    // (Under full eviction the item is gone already)
+    if (del(ht, key)) {
+        EXPECT_LT(changes, ht.getNumResidentSetChanges());
+    }
+}
+
 INSTANTIATE_TEST_CASE_P(
         ValueAndFullEviction,
         HashTableStatsTest,
@@ -496,6 +808,110 @@ TEST_F(HashTableTest, NRUMinimum) {
     EXPECT_EQ(MIN_NRU_VALUE, v->getNRUValue());
 }
 
+// Check that referenced finds count the access frequency, once enabled
+TEST_F(HashTableTest, FrequencyTracking) {
+    HashTable ht(global_stats, makeFactory(), 5, 1);
+    StoredDocKey key = makeStoredDocKey("key");
+
+    Item item(key, 0, 0, "value", strlen("value"));
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item));
+
+    StoredValue* v(ht.find(key, TrackReference::Yes, WantsDeleted::No));
+    ASSERT_NE(nullptr, v);
+    EXPECT_FALSE(ht.isFrequencyTracking());
+    EXPECT_EQ(0, v->getFreqCounterValue());
+
+    const auto memory = ht.memorySize();
+    ht.enableFrequencyTracking();
+    EXPECT_TRUE(ht.isFrequencyTracking());
+    EXPECT_LT(memory, ht.memorySize());
+
+    for (int ii = 0; ii < 3; ++ii) {
+        ht.find(key, TrackReference::Yes, WantsDeleted::No);
+    }
+    ht.find(key, TrackReference::No, WantsDeleted::No);
+    EXPECT_EQ(3, v->getFreqCounterValue());
+    EXPECT_EQ(3, ht.getFrequency(*v));
+
+    // The sketch remembers the key when the StoredValue is gone
+    ASSERT_TRUE(del(ht, key));
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item));
+    v = ht.find(key, TrackReference::No, WantsDeleted::No);
+    ASSERT_NE(nullptr, v);
+    EXPECT_EQ(0, v->getFreqCounterValue());
+    EXPECT_EQ(3, ht.getFrequency(*v));
+}
+
+TEST_F(HashTableTest, ExpiryIndex) {
+    HashTable ht(global_stats, makeFactory(), 5, 1);
+    EXPECT_FALSE(ht.hasExpiryIndex());
+    const auto memory = ht.memorySize();
+    ht.enableExpiryIndex(10);
+    EXPECT_TRUE(ht.hasExpiryIndex());
+    EXPECT_LE(memory, ht.memorySize());
+
+    // Only the items which expire are indexed
+    auto key1 = makeStoredDocKey("key1");
+    auto key2 = makeStoredDocKey("key2");
+    auto key3 = makeStoredDocKey("key3");
+    Item item1(key1, 0, 1005, "value", strlen("value"));
+    Item item2(key2, 0, 2005, "value", strlen("value"));
+    Item item3(key3, 0, 0, "value", strlen("value"));
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item1));
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item2));
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item3));
+    EXPECT_EQ(2, ht.getExpiryIndexSize());
+
+    // Storing it again with the same expiry time doesn't add it again
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item1));
+    EXPECT_EQ(2, ht.getExpiryIndexSize());
+
+    // Only the items which are due are visited
+    Counter counter(false);
+    EXPECT_EQ(0, ht.visitExpiring(counter, 1000));
+    EXPECT_EQ(1, ht.visitExpiring(counter, 1010));
+    EXPECT_EQ(1, counter.count);
+    EXPECT_EQ(1, ht.getExpiryIndexSize());
+
+    // Changing the expiry time adds a new entry
+    {
+        auto hbl = ht.getLockedBucket(key2);
+        auto* v = ht.unlocked_find(
+                key2, hbl.getBucketNum(), WantsDeleted::No, TrackReference::No);
+        ASSERT_NE(nullptr, v);
+        v->setExptime(3005);
+        ht.noteExpiryChange(*v, 2005);
+    }
+    EXPECT_EQ(2, ht.getExpiryIndexSize());
+
+    ht.clear();
+    EXPECT_EQ(0, ht.getExpiryIndexSize());
+}
+
+// References under shared access may only proceed if they don't need to
+// modify the StoredValue
+TEST_F(HashTableTest, TrackSharedReference) {
+    HashTable ht(global_stats, makeFactory(), 5, 1);
+    ht.enableFrequencyTracking();
+    StoredDocKey key = makeStoredDocKey("key");
+
+    Item item(key, 0, 0, "value", strlen("value"));
+    item.setNRUValue(MIN_NRU_VALUE);
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item));
+
+    StoredValue* v(ht.find(key, TrackReference::No, WantsDeleted::No));
+    ASSERT_NE(nullptr, v);
+    EXPECT_FALSE(ht.trackSharedReference(*v));
+
+    v->setFreqCounterValue(StoredValue::MaxFreqCounterValue);
+    EXPECT_TRUE(ht.trackSharedReference(*v));
+    EXPECT_EQ(StoredValue::MaxFreqCounterValue, v->getFreqCounterValue());
+    EXPECT_EQ(StoredValue::MaxFreqCounterValue, ht.getFrequency(*v));
+
+    v->setNRUValue(INITIAL_NRU_VALUE);
+    EXPECT_FALSE(ht.trackSharedReference(*v));
+}
+
 /* Test release from HT (but not deletion) of an (HT) element */
 TEST_F(HashTableTest, ReleaseItem) {
     /* Setup with 2 hash buckets and 1 lock */
@@ -607,6 +1023,54 @@ TEST_F(HashTableTest, CopyItem) {
     EXPECT_EQ(statsCurrSizeBeforeCopy, global_stats.currentSize.load());
 }
 
+/* Test moving an element of the HT to a new allocation (for both kinds of
+   StoredValue) */
+TEST_F(HashTableTest, Relocate) {
+    for (bool isOrdered : {false, true}) {
+        /* 1 hash bucket so the items share the chain */
+        HashTable ht(global_stats, makeFactory(isOrdered), 1, 1);
+
+        const int numItems = 3;
+        auto keys = generateKeys(numItems);
+        storeMany(ht, keys);
+
+        auto hbl = ht.getLockedBucket(keys[1]);
+        StoredValue* sv = ht.unlocked_find(
+                keys[1], hbl.getBucketNum(), WantsDeleted::No,
+                TrackReference::No);
+        ASSERT_NE(nullptr, sv);
+
+        auto metaDataMemBefore = ht.metaDataMemory.load();
+        auto cacheSizeBefore = ht.cacheSize.load();
+        auto memSizeBefore = ht.memSize.load();
+
+        auto res = ht.unlocked_relocate(hbl, *sv);
+        EXPECT_EQ(sv, res.second.get());
+        EXPECT_NE(sv, res.first);
+        EXPECT_EQ(*sv, *res.first);
+        EXPECT_EQ(nullptr, res.second->getNext().get());
+        res.second.reset();
+
+        /* All of the items are still in the chain */
+        for (const auto& key : keys) {
+            EXPECT_NE(nullptr,
+                      ht.unlocked_find(key,
+                                       hbl.getBucketNum(),
+                                       WantsDeleted::No,
+                                       TrackReference::No));
+        }
+        EXPECT_EQ(res.first,
+                  ht.unlocked_find(keys[1],
+                                   hbl.getBucketNum(),
+                                   WantsDeleted::No,
+                                   TrackReference::No));
+        EXPECT_EQ(numItems, ht.getNumItems());
+        EXPECT_EQ(metaDataMemBefore, ht.metaDataMemory.load());
+        EXPECT_EQ(cacheSizeBefore, ht.cacheSize.load());
+        EXPECT_EQ(memSizeBefore, ht.memSize.load());
+    }
+}
+
 /* Test copying a deleted element in HT */
 TEST_F(HashTableTest, CopyDeletedItem) {
     /* Setup with 2 hash buckets and 1 lock. Note: Copying is allowed only on
@@ -728,3 +1192,88 @@ TEST_F(HashTableTest, PauseResumeHashBucket) {
     HashTable::Position start;
     ht.pauseResumeVisit(mockVisitor, start);
 }
+
+// A visit within an unlimited budget visits everything, and a spent budget
+// visits nothing.
+TEST_F(HashTableTest, VisitWithinBudget) {
+    HashTable ht(global_stats, makeFactory(), 5, 1);
+    auto keys = generateKeys(10);
+    storeMany(ht, keys);
+
+    VisitorBudget budget;
+    EXPECT_FALSE(budget.isLimited());
+    budget.startRun(VisitorBudget::unlimited);
+    Counter counter(true);
+    EXPECT_EQ(ht.endPosition(),
+              visitWithinBudget(ht, counter, budget, HashTable::Position()));
+    EXPECT_EQ(10u, counter.count);
+    EXPECT_EQ(10u, budget.getVisitedCount());
+    EXPECT_FALSE(budget.isSpent());
+    EXPECT_EQ(std::chrono::microseconds(0), budget.endRun());
+
+    budget.startRun(std::chrono::microseconds(0));
+    EXPECT_TRUE(budget.isLimited());
+    EXPECT_TRUE(budget.isSpent());
+    Counter none(true);
+    EXPECT_EQ(HashTable::Position(),
+              visitWithinBudget(ht, none, budget, HashTable::Position()));
+    EXPECT_EQ(0u, none.count);
+}
+
+// Clearing within a budget frees nothing once it's spent, and carries on
+// from where it stopped.
+TEST_F(HashTableTest, ClearWithinBudget) {
+    HashTable ht(global_stats, makeFactory(), 5, 1);
+    auto keys = generateKeys(10);
+    storeMany(ht, keys);
+    const size_t memBefore = ht.getItemMemory();
+    ASSERT_NE(0, memBefore);
+
+    VisitorBudget budget;
+    size_t position = 0;
+    budget.startRun(std::chrono::microseconds(0));
+    EXPECT_FALSE(ht.clearWithinBudget(budget, position));
+    EXPECT_EQ(0, position);
+    EXPECT_EQ(memBefore, ht.getItemMemory());
+
+    budget.startRun(VisitorBudget::unlimited);
+    EXPECT_TRUE(ht.clearWithinBudget(budget, position));
+    EXPECT_EQ(ht.getSize(), position);
+    EXPECT_EQ(10u, budget.getVisitedCount());
+    EXPECT_EQ(0, ht.getItemMemory());
+    EXPECT_EQ(0, ht.getNumItems());
+}
+
+// A visit pauses once its budget is spent, and resumes where it stopped.
+TEST_F(HashTableTest, VisitWithinBudgetPauses) {
+    HashTable ht(global_stats, makeFactory(), 1021, 1);
+    auto keys = generateKeys(1000);
+    storeMany(ht, keys);
+
+    class SlowVisitor : public HashTableVisitor {
+    public:
+        bool visit(const HashTable::HashBucketLock& lh,
+                   StoredValue& v) override {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            ++visited;
+            return true;
+        }
+        size_t visited = 0;
+    } visitor;
+
+    VisitorBudget budget;
+    budget.startRun(std::chrono::milliseconds(1));
+    auto position =
+            visitWithinBudget(ht, visitor, budget, HashTable::Position());
+    EXPECT_NE(ht.endPosition(), position);
+    EXPECT_TRUE(budget.isSpent());
+    EXPECT_LT(visitor.visited, keys.size());
+    EXPECT_GT(budget.endRun().count(), 0);
+
+    const size_t firstRun = visitor.visited;
+    budget.startRun(VisitorBudget::unlimited);
+    EXPECT_EQ(ht.endPosition(),
+              visitWithinBudget(ht, visitor, budget, position));
+    EXPECT_GT(visitor.visited, firstRun);
+    EXPECT_LE(visitor.visited, keys.size());
+}
@@ -24,6 +24,7 @@
 #include "checkpoint.h"
 #include "ep_time.h"
 #include "evp_store_single_threaded_test.h"
+#include "item_pager.h"
 #include "test_helpers.h"
 #include "tests/mock/mock_synchronous_ep_engine.h"
 
@@ -338,6 +339,164 @@ TEST_P(STItemPagerTest, ExpiredItemsDeletedFirst) {
     EXPECT_EQ(0, stats.expired_compactor);
 }
 
+/**
+ * Test fixture for the item pager in sampled mode (pager_sampled_eviction).
+ */
+class STSampledItemPagerTest : public STItemPagerTest {
+protected:
+    void SetUp() override {
+        config_string += "pager_sampled_eviction=true;";
+        STItemPagerTest::SetUp();
+    }
+};
+
+// The sampled pager evicts (about) the fraction of the items we need to
+// free, and records how many items it looked at to do so.
+TEST_P(STSampledItemPagerTest, ServerQuotaReached) {
+    size_t count = populateUntilTmpFail(vbid);
+    ASSERT_GE(count, 50) << "Too few documents stored";
+
+    runHighMemoryPager();
+
+    auto& stats = engine->getEpStats();
+    auto vb = engine->getVBucket(vbid);
+    const auto numResidentItems =
+            vb->getNumItems() - vb->getNumNonResidentItems();
+    EXPECT_LT(numResidentItems, count);
+    EXPECT_LT(0, stats.pagerLastEjected);
+    EXPECT_LE(stats.pagerLastEjected, stats.pagerLastVisited);
+}
+
+/**
+ * Test fixture for the sampled item pager weighing the value size
+ * (pager_size_weight).
+ */
+class STSizeWeightedItemPagerTest : public STItemPagerTest {
+protected:
+    void SetUp() override {
+        config_string +=
+                "pager_sampled_eviction=true;pager_size_weight=2;"
+                "pager_size_unit=256;";
+        STItemPagerTest::SetUp();
+    }
+};
+
+// With a size weight the larger values are less hot, so when the bucket
+// holds small and large values the pager frees more bytes per eviction
+// than the average value size.
+TEST_P(STSizeWeightedItemPagerTest, LargeValuesEvictedFirst) {
+    auto& stats = engine->getEpStats();
+    const std::string small(64, 's');
+    const std::string large(2048, 'l');
+    size_t count = 0;
+    size_t bytes = 0;
+    ENGINE_ERROR_CODE result = ENGINE_SUCCESS;
+    while (result == ENGINE_SUCCESS) {
+        const auto& value = (count % 4 == 0) ? large : small;
+        auto key = makeStoredDocKey("key_" + std::to_string(count));
+        auto item = make_item(vbid, key, value);
+        item.setNRUValue(MAX_NRU_VALUE);
+        result = storeItem(item);
+        if (result == ENGINE_SUCCESS) {
+            bytes += value.size();
+            ++count;
+        }
+    }
+    ASSERT_EQ(ENGINE_TMPFAIL, result);
+    ASSERT_GE(count, 50) << "Too few documents stored";
+
+    store->getVBucket(vbid)->checkpointManager->createNewCheckpoint();
+    if (std::get<0>(GetParam()) == "persistent") {
+        store->flushVBucket(vbid);
+    }
+
+    runHighMemoryPager();
+
+    ASSERT_LT(0, stats.pagerLastEjected);
+    EXPECT_LT(0, stats.pagerLastEjectedBytes);
+    EXPECT_GT(stats.pagerLastEjectedBytes / stats.pagerLastEjected,
+              bytes / count);
+}
+
+/**
+ * Test fixture for the item pager starting ahead of the high watermark
+ * when the memory used grows fast (pager_growth_lookahead).
+ */
+class STPredictiveItemPagerTest : public STItemPagerTest {
+protected:
+    void SetUp() override {
+        config_string += "pager_growth_lookahead=60;";
+        STItemPagerTest::SetUp();
+    }
+
+    /// Store items until the memory used reaches the given limit
+    void storeUntil(size_t limit) {
+        auto& stats = engine->getEpStats();
+        const std::string value(512, 'x');
+        while (stats.getTotalMemoryUsed() < limit) {
+            auto key = makeStoredDocKey("key_" + std::to_string(count++));
+            auto item = make_item(vbid, key, value);
+            item.setNRUValue(MAX_NRU_VALUE);
+            ASSERT_EQ(ENGINE_SUCCESS, storeItem(item));
+        }
+    }
+
+    size_t count = 0;
+};
+
+// With the memory growing fast the pager starts to evict above the low
+// watermark, without waiting for the high watermark to be reached.
+TEST_P(STPredictiveItemPagerTest, StartBelowHighWatermark) {
+    auto& stats = engine->getEpStats();
+    auto& lpNonioQ = *task_executor->getLpTaskQ()[NONIO_TASK_IDX];
+    const size_t lower = stats.mem_low_wat;
+    const size_t upper = stats.mem_high_wat;
+
+    // The first run only takes a sample of the memory used
+    storeUntil(lower + 1);
+    store->attemptToFreeMemory();
+    runNextTask(lpNonioQ, "Paging out items.");
+    EXPECT_EQ(0, stats.pagerRuns);
+    EXPECT_EQ(initialNonIoTasks, lpNonioQ.getFutureQueueSize());
+
+    // The memory grew since; at that rate we'd be past the high watermark
+    // (long) before the lookahead is over
+    storeUntil(lower + (upper - lower) / 4);
+    ASSERT_LT(stats.getTotalMemoryUsed(), upper);
+    store->getVBucket(vbid)->checkpointManager->createNewCheckpoint();
+    if (std::get<0>(GetParam()) == "persistent") {
+        store->flushVBucket(vbid);
+    }
+
+    store->attemptToFreeMemory();
+    runNextTask(lpNonioQ, "Paging out items.");
+    EXPECT_EQ(1, stats.pagerRuns);
+    EXPECT_EQ(1, stats.pagerPredictiveRuns);
+    EXPECT_LT(0, stats.memGrowthRate);
+    runNextTask(lpNonioQ, "Item pager on vb 0");
+    EXPECT_LT(0, stats.pagerLastEjected);
+}
+
+TEST(MemoryGrowthEstimatorTest, Rate) {
+    MemoryGrowthEstimator growth;
+    auto now = ProcessClock::now();
+    growth.sample(1000, now);
+    EXPECT_EQ(0, growth.getRate());
+    EXPECT_EQ(1000, growth.project(1000, 10));
+
+    // 1000 bytes/s, smoothed with the (initial) rate of 0
+    now += std::chrono::seconds(1);
+    growth.sample(2000, now);
+    EXPECT_DOUBLE_EQ(MemoryGrowthEstimator::Alpha * 1000, growth.getRate());
+    EXPECT_DOUBLE_EQ(2000 + 10 * growth.getRate(), growth.project(2000, 10));
+
+    // Shrinking memory doesn't make us predict less than what we use
+    now += std::chrono::seconds(1);
+    growth.sample(0, now);
+    EXPECT_EQ(0, growth.getRate());
+    EXPECT_EQ(500, growth.project(500, 10));
+}
+
 /**
  * Test fixture for Ephemeral-only item pager tests.
  */
@@ -784,4 +943,29 @@ INSTANTIATE_TEST_CASE_P(Persistent,
 
 INSTANTIATE_TEST_CASE_P(Ephemeral, STEphemeralItemPagerTest, ephConfigValues, );
 
+// Ephemeral fail_new_data buckets don't run the item pager
+INSTANTIATE_TEST_CASE_P(
+        EphemeralOrPersistent,
+        STSampledItemPagerTest,
+        ::testing::Values(std::make_tuple(std::string("ephemeral"),
+                                          std::string("auto_delete")),
+                          std::make_tuple(std::string("persistent"),
+                                          std::string{})), );
+
+INSTANTIATE_TEST_CASE_P(
+        EphemeralOrPersistent,
+        STPredictiveItemPagerTest,
+        ::testing::Values(std::make_tuple(std::string("ephemeral"),
+                                          std::string("auto_delete")),
+                          std::make_tuple(std::string("persistent"),
+                                          std::string{})), );
+
+INSTANTIATE_TEST_CASE_P(
+        EphemeralOrPersistent,
+        STSizeWeightedItemPagerTest,
+        ::testing::Values(std::make_tuple(std::string("ephemeral"),
+                                          std::string("auto_delete")),
+                          std::make_tuple(std::string("persistent"),
+                                          std::string{})), );
+
 #endif
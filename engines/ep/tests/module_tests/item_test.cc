@@ -26,6 +26,8 @@
 #include <memcached/protocol_binary.h>
 #include <platform/make_unique.h>
 
+#include <cstring>
+
 class ItemNoValuePruneTest : public ::testing::TestWithParam<
                              std::tuple<IncludeValue, IncludeXattrs>> {
 public:
@@ -118,6 +120,32 @@ TEST_F(ItemTest, getAndSetCachedDataType) {
               (PROTOCOL_BINARY_DATATYPE_JSON & item->getDataType()));
 }
 
+// An Item allocated with its value can be released while the value is
+// still referenced (and the other way around)
+TEST(ItemWithValueTest, valueOutlivesItem) {
+    auto* itm = Item::makeWithValue(
+            makeStoredDocKey("key"), 0, 0, 5, PROTOCOL_BINARY_RAW_BYTES, 0);
+    ASSERT_EQ(5u, itm->getNBytes());
+    std::memcpy(const_cast<char*>(itm->getData()), "value", 5);
+
+    value_t value = itm->getValue();
+    Item::release(itm);
+    EXPECT_EQ("value", value->to_s());
+}
+
+TEST(ItemWithValueTest, itemOutlivesValue) {
+    auto* itm = Item::makeWithValue(
+            makeStoredDocKey("key"), 0, 0, 5, PROTOCOL_BINARY_RAW_BYTES, 0);
+    std::memcpy(const_cast<char*>(itm->getData()), "value", 5);
+
+    // Replacing the value drops the Item's reference to the Blob it was
+    // allocated with, which must still hold the Item's memory
+    itm->setValue(Blob::New("other", 5));
+    EXPECT_EQ("other", itm->getValue()->to_s());
+    EXPECT_EQ("key", std::string(itm->getKey().c_str()));
+    Item::release(itm);
+}
+
 TEST_F(ItemPruneTest, testPruneNothing) {
     item->pruneValueAndOrXattrs(IncludeValue::Yes, IncludeXattrs::Yes);
 
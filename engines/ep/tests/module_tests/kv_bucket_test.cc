@@ -27,6 +27,7 @@
 #include "checkpoint_remover.h"
 #include "dcp/dcpconnmap.h"
 #include "dcp/flow-control-manager.h"
+#include "ep_bucket.h"
 #include "ep_engine.h"
 #include "ep_time.h"
 #include "flusher.h"
@@ -571,6 +572,146 @@ TEST_P(KVBucketParamTest, AddNMVB) {
     EXPECT_EQ(ENGINE_NOT_MY_VBUCKET, store->add(item, cookie));
 }
 
+// Arithmetic tests ///////////////////////////////////////////////////////////
+
+// Test the counter is updated in the hash table (and queued as a mutation)
+TEST_P(KVBucketParamTest, ArithmeticInMemory) {
+    auto key = makeStoredDocKey("counter");
+    auto stored = store_item(vbid, key, "10");
+
+    uint64_t result = 0;
+    uint64_t cas = 0;
+    mutation_descr_t mutInfo{};
+    EXPECT_EQ(ENGINE_SUCCESS,
+              store->arithmetic(
+                      key, vbid, true, 5, 0, cookie, result, cas, mutInfo));
+    EXPECT_EQ(15, result);
+    EXPECT_NE(stored.getCas(), cas);
+    EXPECT_EQ(stored.getBySeqno() + 1, int64_t(mutInfo.seqno));
+
+    // Decrement stops at zero
+    EXPECT_EQ(ENGINE_SUCCESS,
+              store->arithmetic(
+                      key, vbid, false, 20, cas, cookie, result, cas, mutInfo));
+    EXPECT_EQ(0, result);
+
+    auto gv = store->get(key, vbid, cookie, TRACK_REFERENCE);
+    ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+    EXPECT_EQ("0", gv.item->getValue()->to_s());
+    EXPECT_EQ(cas, gv.item->getCas());
+}
+
+// Test the cases the frontend has to handle with get and store
+TEST_P(KVBucketParamTest, ArithmeticFallsBack) {
+    uint64_t result = 0;
+    uint64_t cas = 0;
+    mutation_descr_t mutInfo{};
+    auto key = makeStoredDocKey("counter");
+    EXPECT_EQ(ENGINE_ENOTSUP,
+              store->arithmetic(
+                      key, vbid, true, 1, 0, cookie, result, cas, mutInfo));
+
+    store_item(vbid, key, "1");
+    store->setVBucketState(vbid, vbucket_state_pending, false);
+    EXPECT_EQ(ENGINE_ENOTSUP,
+              store->arithmetic(
+                      key, vbid, true, 1, 0, cookie, result, cas, mutInfo));
+}
+
+TEST_P(KVBucketParamTest, ArithmeticErrors) {
+    uint64_t result = 0;
+    uint64_t cas = 0;
+    mutation_descr_t mutInfo{};
+    auto key = makeStoredDocKey("counter");
+    auto stored = store_item(vbid, key, "counter");
+    EXPECT_EQ(ENGINE_DELTA_BADVAL,
+              store->arithmetic(
+                      key, vbid, true, 1, 0, cookie, result, cas, mutInfo));
+    EXPECT_EQ(ENGINE_KEY_EEXISTS,
+              store->arithmetic(key,
+                                vbid,
+                                true,
+                                1,
+                                stored.getCas() + 1,
+                                cookie,
+                                result,
+                                cas,
+                                mutInfo));
+    EXPECT_EQ(ENGINE_NOT_MY_VBUCKET,
+              store->arithmetic(
+                      key, vbid + 1, true, 1, 0, cookie, result, cas, mutInfo));
+}
+
+// Append / Prepend tests /////////////////////////////////////////////////////
+
+TEST_P(KVBucketParamTest, AppendPrependInMemory) {
+    auto key = makeStoredDocKey("key");
+    auto stored = store_item(vbid, key, "b");
+
+    uint64_t cas = 0;
+    mutation_descr_t mutInfo{};
+    EXPECT_EQ(ENGINE_SUCCESS,
+              store->appendPrepend(
+                      key, vbid, true, {"c", 1}, 0, cookie, cas, mutInfo));
+    EXPECT_NE(stored.getCas(), cas);
+    EXPECT_EQ(stored.getBySeqno() + 1, int64_t(mutInfo.seqno));
+    EXPECT_EQ(ENGINE_SUCCESS,
+              store->appendPrepend(
+                      key, vbid, false, {"a", 1}, cas, cookie, cas, mutInfo));
+
+    auto gv = store->get(key, vbid, cookie, TRACK_REFERENCE);
+    ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+    EXPECT_EQ("abc", gv.item->getValue()->to_s());
+    EXPECT_EQ(cas, gv.item->getCas());
+}
+
+// Test the cases the frontend has to handle with get and store
+TEST_P(KVBucketParamTest, AppendPrependFallsBack) {
+    uint64_t cas = 0;
+    mutation_descr_t mutInfo{};
+    auto key = makeStoredDocKey("key");
+    EXPECT_EQ(ENGINE_ENOTSUP,
+              store->appendPrepend(
+                      key, vbid, true, {"a", 1}, 0, cookie, cas, mutInfo));
+
+    store_item(vbid,
+               key,
+               createXattrValue("body"),
+               0,
+               {cb::engine_errc::success},
+               PROTOCOL_BINARY_DATATYPE_XATTR);
+    EXPECT_EQ(ENGINE_ENOTSUP,
+              store->appendPrepend(
+                      key, vbid, true, {"a", 1}, 0, cookie, cas, mutInfo));
+}
+
+TEST_P(KVBucketParamTest, AppendPrependErrors) {
+    uint64_t cas = 0;
+    mutation_descr_t mutInfo{};
+    auto key = makeStoredDocKey("key");
+    auto stored = store_item(vbid, key, "value");
+    EXPECT_EQ(ENGINE_KEY_EEXISTS,
+              store->appendPrepend(key,
+                                   vbid,
+                                   true,
+                                   {"a", 1},
+                                   stored.getCas() + 1,
+                                   cookie,
+                                   cas,
+                                   mutInfo));
+
+    const std::string big(engine->getConfiguration().getMaxItemSize(), 'x');
+    EXPECT_EQ(ENGINE_E2BIG,
+              store->appendPrepend(key,
+                                   vbid,
+                                   true,
+                                   {big.data(), big.size()},
+                                   0,
+                                   cookie,
+                                   cas,
+                                   mutInfo));
+}
+
 // SetWithMeta tests //////////////////////////////////////////////////////////
 
 // Test basic setWithMeta
@@ -682,6 +823,41 @@ TEST_P(KVBucketParamTest, mb22824) {
     EXPECT_EQ(itemMeta1.cas, itemMeta2.cas);
 }
 
+// Check that getMetaDataMulti returns the same meta data as getMetaData
+// for each of the keys
+TEST_P(KVBucketParamTest, GetMetaDataMulti) {
+    const auto key1 = makeStoredDocKey("key1");
+    const auto key2 = makeStoredDocKey("key2");
+    store_item(vbid, key1, "value1");
+    store_item(vbid, key2, "value2");
+
+    auto results = store->getMetaDataMulti({key2, key1}, vbid, cookie);
+    ASSERT_EQ(2u, results.size());
+    for (size_t ii = 0; ii < results.size(); ++ii) {
+        uint32_t deleted = 0;
+        ItemMetaData itemMeta;
+        uint8_t datatype = PROTOCOL_BINARY_RAW_BYTES;
+        ASSERT_EQ(ENGINE_SUCCESS,
+                  store->getMetaData(ii == 0 ? key2 : key1,
+                                     vbid,
+                                     cookie,
+                                     itemMeta,
+                                     deleted,
+                                     datatype));
+        EXPECT_EQ(cb::engine_errc::success, results[ii].first);
+        EXPECT_EQ(itemMeta.cas, results[ii].second.cas);
+        EXPECT_EQ(uint64_t(itemMeta.revSeqno), results[ii].second.seqno);
+        EXPECT_EQ(DocumentState::Alive, results[ii].second.document_state);
+    }
+
+    // All of the keys of a vbucket we don't own fail
+    store->setVBucketState(vbid, vbucket_state_replica, false);
+    results = store->getMetaDataMulti({key1, key2}, vbid, cookie);
+    ASSERT_EQ(2u, results.size());
+    EXPECT_EQ(cb::engine_errc::not_my_vbucket, results[0].first);
+    EXPECT_EQ(cb::engine_errc::not_my_vbucket, results[1].first);
+}
+
 /**
  *  Test that the first item updates the hlcSeqno, but not the second
  */
@@ -717,6 +893,48 @@ TEST_P(KVBucketParamTest, test_hlcEpochSeqno) {
     EXPECT_EQ(seqno, vb->getHLCEpochSeqno());
 }
 
+// The high priority requests are notified in the order of the seqno they
+// wait for, once it is reached
+TEST_P(KVBucketParamTest, HighPriorityNotifications) {
+    auto vb = store->getVBucket(vbid);
+    std::vector<const void*> cookies;
+    for (const uint64_t seqno : {10, 5, 20}) {
+        cookies.push_back(create_mock_cookie());
+        EXPECT_EQ(HighPriorityVBReqStatus::RequestScheduled,
+                  vb->checkAddHighPriorityVBEntry(
+                          seqno, cookies.back(), HighPriorityVBNotify::Seqno));
+    }
+    EXPECT_EQ(3, vb->getHighPriorityChkSize());
+
+    EXPECT_TRUE(vb->getHighPriorityNotifications(
+                          *engine, 4, HighPriorityVBNotify::Seqno)
+                        .empty());
+
+    auto toNotify = vb->getHighPriorityNotifications(
+            *engine, 10, HighPriorityVBNotify::Seqno);
+    EXPECT_EQ(2, toNotify.size());
+    EXPECT_EQ(ENGINE_SUCCESS, toNotify[cookies[0]]);
+    EXPECT_EQ(ENGINE_SUCCESS, toNotify[cookies[1]]);
+    EXPECT_EQ(1, vb->getHighPriorityChkSize());
+
+    // A notified cookie may wait again
+    EXPECT_EQ(HighPriorityVBReqStatus::RequestScheduled,
+              vb->checkAddHighPriorityVBEntry(
+                      30, cookies[0], HighPriorityVBNotify::Seqno));
+    toNotify = vb->getHighPriorityNotifications(
+            *engine, 25, HighPriorityVBNotify::Seqno);
+    EXPECT_EQ(1, toNotify.size());
+    EXPECT_EQ(ENGINE_SUCCESS, toNotify[cookies[2]]);
+    EXPECT_EQ(1, vb->getHighPriorityChkSize());
+
+    vb->notifyAllPendingConnsFailed(*engine);
+    EXPECT_EQ(0, vb->getHighPriorityChkSize());
+
+    for (auto* c : cookies) {
+        destroy_mock_cookie(c);
+    }
+}
+
 TEST_F(KVBucketTest, DataRaceInDoWorkerStat) {
     /* MB-23529: TSAN intermittently reports a data race.
      * This race appears to be caused by GGC's buggy string COW as seen
@@ -1088,4 +1306,58 @@ INSTANTIATE_TEST_CASE_P(EphemeralOrPersistent,
                             return info.param.substr(info.param.find('=') + 1);
                         });
 
+// The flusher waits for vbuckets to gather more dirty items when the
+// commits are slow, but never for longer than the maximum delay.
+TEST(FlushBatchControllerTest, TargetBatchSizeFollowsCommitLatency) {
+    using namespace std::chrono;
+    FlushBatchController controller;
+    const milliseconds maxDelay(100);
+    EXPECT_EQ(1, controller.getTargetBatchSize());
+    EXPECT_FALSE(controller.shouldDefer(1, seconds(0), maxDelay));
+
+    // 20ms commits: aim for 200 items per commit
+    controller.recordCommit(milliseconds(20));
+    EXPECT_EQ(200, controller.getTargetBatchSize());
+    EXPECT_TRUE(controller.shouldDefer(10, seconds(0), maxDelay));
+    EXPECT_FALSE(controller.shouldDefer(10, maxDelay, maxDelay));
+    EXPECT_FALSE(controller.shouldDefer(200, seconds(0), maxDelay));
+    EXPECT_FALSE(controller.shouldDefer(0, seconds(0), maxDelay));
+
+    // The target follows the moving average back down
+    for (int ii = 0; ii < 100; ++ii) {
+        controller.recordCommit(microseconds(100));
+    }
+    EXPECT_EQ(1, controller.getTargetBatchSize());
+}
+
+// The compactions may write a second worth of their budget at once; past
+// that they wait for the tokens they borrowed.
+TEST(CompactionThrottleTest, WritesWaitForTheirTokens) {
+    using namespace std::chrono;
+    CompactionThrottle throttle;
+    const auto start = ProcessClock::now();
+    EXPECT_EQ(microseconds(0), throttle.acquire(1000000, start));
+
+    throttle.setMaxWriteRate(1000);
+    EXPECT_EQ(microseconds(0), throttle.acquire(500, start));
+    EXPECT_EQ(microseconds(0), throttle.acquire(500, start));
+    EXPECT_EQ(milliseconds(500), throttle.acquire(500, start));
+
+    // The debt is repaid after half a second
+    EXPECT_EQ(microseconds(0),
+              throttle.acquire(0, start + milliseconds(500)));
+    EXPECT_EQ(seconds(1), throttle.acquire(1000, start + milliseconds(500)));
+
+    // A single wait is bounded, but the debt carries over
+    EXPECT_EQ(CompactionThrottle::maxWait,
+              throttle.acquire(5000, start + milliseconds(1500)));
+    EXPECT_EQ(CompactionThrottle::maxWait,
+              throttle.acquire(0, start + milliseconds(2500)));
+
+    // No limit
+    throttle.setMaxWriteRate(0);
+    EXPECT_EQ(microseconds(0),
+              throttle.acquire(1000000, start + milliseconds(2500)));
+}
+
 const char KVBucketTest::test_dbname[] = "ep_engine_ep_unit_tests_db";
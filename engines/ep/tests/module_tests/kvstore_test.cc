@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <platform/dirutils.h>
+#include <platform/make_unique.h>
 
 #include "callbacks.h"
 #include "couch-kvstore/couch-kvstore.h"
@@ -26,6 +27,7 @@
 #include "src/internal.h"
 #include "tests/module_tests/test_helpers.h"
 #include "tests/test_fileops.h"
+#include "value_dictionary.h"
 #include "vbucket_bgfetch_item.h"
 
 #include <gmock/gmock.h>
@@ -247,6 +249,562 @@ TEST_P(CouchAndForestTest, BasicTest) {
     checkGetValue(gv);
 }
 
+/* Test that a store which advertises group commit commits the writes to
+ * several vbuckets staged in one transaction */
+TEST_P(CouchAndForestTest, GroupCommit) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+    if (!kvstore->getStorageProperties().hasGroupCommit()) {
+        return;
+    }
+
+    // vbuckets 0 and 4 both belong to shard 0
+    vbucket_state state(
+            vbucket_state_active, 0, 0, 0, 0, 0, 0, 0, 0, false, "");
+    kvstore->snapshotVBucket(
+            4, state, VBStatePersist::VBSTATE_PERSIST_WITHOUT_COMMIT);
+
+    kvstore->begin();
+    StoredDocKey key = makeStoredDocKey("key");
+    Item item0(key, 0, 0, "value", 5);
+    Item item4(key, 0, 0, "value", 5);
+    item4.setVBucketId(4);
+    WriteCallback wc;
+    kvstore->set(item0, wc);
+    kvstore->set(item4, wc);
+
+    EXPECT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    GetValue gv0 = kvstore->get(key, 0);
+    checkGetValue(gv0);
+    GetValue gv4 = kvstore->get(key, 4);
+    checkGetValue(gv4);
+}
+
+/* Test that getMulti fetches each of the keys of a batch, and reports the
+ * ones which don't exist as not found */
+TEST_P(CouchAndForestTest, GetMulti) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    kvstore->begin();
+    WriteCallback wc;
+    for (int i = 0; i < 10; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  "value",
+                  5);
+        kvstore->set(item, wc);
+    }
+    EXPECT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    vb_bgfetch_queue_t itms;
+    for (int i = 9; i >= 0; i -= 2) {
+        vb_bgfetch_item_ctx_t ctx;
+        ctx.isMetaOnly = GetMetaOnly::No;
+        ctx.bgfetched_list.push_back(
+                std::make_unique<VBucketBGFetchItem>(nullptr, false));
+        itms[makeStoredDocKey("key" + std::to_string(i))] = std::move(ctx);
+    }
+    vb_bgfetch_item_ctx_t missing;
+    missing.isMetaOnly = GetMetaOnly::No;
+    missing.bgfetched_list.push_back(
+            std::make_unique<VBucketBGFetchItem>(nullptr, false));
+    itms[makeStoredDocKey("missing")] = std::move(missing);
+
+    kvstore->getMulti(0, itms);
+
+    for (auto& it : itms) {
+        auto& fetch = *it.second.bgfetched_list.front();
+        ASSERT_EQ(&it.second.value, fetch.value);
+        if (it.first == makeStoredDocKey("missing")) {
+            EXPECT_EQ(ENGINE_KEY_ENOENT, fetch.value->getStatus());
+        } else {
+            ASSERT_EQ(ENGINE_SUCCESS, fetch.value->getStatus());
+            checkGetValue(*fetch.value);
+            EXPECT_EQ(it.first, fetch.value->item->getKey());
+        }
+    }
+}
+
+/* Test that a meta-only getMulti returns the metadata of the documents (and
+ * tombstones), without their value */
+TEST_P(CouchAndForestTest, GetMultiMetaOnly) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    class DeleteCallback : public Callback<int> {
+    public:
+        void callback(int& result) {
+        }
+    } dc;
+
+    kvstore->begin();
+    WriteCallback wc;
+    Item live(makeStoredDocKey("live"), 0xcaffee, 0, "value", 5);
+    live.setBySeqno(1);
+    live.setCas(0x1234);
+    live.setRevSeqno(5);
+    kvstore->set(live, wc);
+    Item deleted(makeStoredDocKey("deleted"), 0, 0, "value", 5);
+    deleted.setBySeqno(2);
+    deleted.setCas(0x5678);
+    deleted.setRevSeqno(7);
+    deleted.setDeleted();
+    kvstore->del(deleted, dc);
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    vb_bgfetch_queue_t itms;
+    for (const auto* key : {"live", "deleted", "missing"}) {
+        vb_bgfetch_item_ctx_t ctx;
+        ctx.isMetaOnly = GetMetaOnly::Yes;
+        ctx.bgfetched_list.push_back(
+                std::make_unique<VBucketBGFetchItem>(nullptr, true));
+        itms[makeStoredDocKey(key)] = std::move(ctx);
+    }
+
+    kvstore->getMulti(0, itms);
+
+    auto& liveValue = itms[makeStoredDocKey("live")].value;
+    ASSERT_EQ(ENGINE_SUCCESS, liveValue.getStatus());
+    EXPECT_EQ(0x1234, liveValue.item->getCas());
+    EXPECT_EQ(5, liveValue.item->getRevSeqno());
+    EXPECT_EQ(0xcaffee, liveValue.item->getFlags());
+    EXPECT_FALSE(liveValue.item->isDeleted());
+
+    auto& deletedValue = itms[makeStoredDocKey("deleted")].value;
+    ASSERT_EQ(ENGINE_SUCCESS, deletedValue.getStatus());
+    EXPECT_EQ(0x5678, deletedValue.item->getCas());
+    EXPECT_EQ(7, deletedValue.item->getRevSeqno());
+    EXPECT_TRUE(deletedValue.item->isDeleted());
+
+    EXPECT_EQ(ENGINE_KEY_ENOENT,
+              itms[makeStoredDocKey("missing")].value.getStatus());
+}
+
+/* Test that getAllKeys stops the scan as soon as the callback sets its
+ * status (as the GET_KEYS callback does once its response is full) */
+TEST_P(CouchAndForestTest, GetAllKeysStopsOnCallbackStatus) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    kvstore->begin();
+    WriteCallback wc;
+    for (int i = 0; i < 10; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  "value",
+                  5);
+        kvstore->set(item, wc);
+    }
+    EXPECT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    struct StopAfterThree : public Callback<const DocKey&> {
+        void callback(const DocKey&) override {
+            if (++seen == 3) {
+                setStatus(ENGINE_E2BIG);
+            }
+        }
+        int seen = 0;
+    };
+    auto cb = std::make_shared<StopAfterThree>();
+    EXPECT_EQ(ENGINE_SUCCESS,
+              kvstore->getAllKeys(0, makeStoredDocKey(""), 10, cb));
+    EXPECT_EQ(3, cb->seen);
+}
+
+/* Test that a compaction which drops the deletes purges the tombstones (but
+ * not the live documents), and reports the highest seqno it purged */
+TEST_P(CouchAndForestTest, CompactDropsTombstones) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    class DeleteCallback : public Callback<int> {
+    public:
+        void callback(int& result) {
+        }
+    } dc;
+
+    kvstore->begin();
+    WriteCallback wc;
+    Item live(makeStoredDocKey("live"), 0, 0, "value", 5);
+    live.setBySeqno(1);
+    kvstore->set(live, wc);
+    Item deleted(makeStoredDocKey("deleted"), 0, 0, "value", 5);
+    deleted.setBySeqno(2);
+    deleted.setDeleted();
+    kvstore->del(deleted, dc);
+    // Couchstore never purges the document with the highest seqno
+    Item last(makeStoredDocKey("last"), 0, 0, "value", 5);
+    last.setBySeqno(3);
+    kvstore->set(last, wc);
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    compaction_ctx cctx;
+    cctx.purge_before_seq = 0;
+    cctx.purge_before_ts = 0;
+    cctx.curr_time = 0;
+    cctx.drop_deletes = 1;
+    cctx.db_file_id = 0;
+    EXPECT_TRUE(kvstore->compactDB(&cctx));
+
+    EXPECT_EQ(2, cctx.max_purged_seq[0]);
+    GetValue gv = kvstore->get(makeStoredDocKey("live"), 0);
+    checkGetValue(gv);
+    gv = kvstore->get(makeStoredDocKey("deleted"), 0, true /*fetchDelete*/);
+    EXPECT_EQ(ENGINE_KEY_ENOENT, gv.getStatus());
+}
+
+/* Test that the counts of the documents and the tombstones of a vbucket
+ * follow its commits and compactions, and are restored when it is opened */
+TEST_P(CouchAndForestTest, DocCounts) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    class DeleteCallback : public Callback<int> {
+    public:
+        void callback(int& result) {
+        }
+    } dc;
+    WriteCallback wc;
+
+    kvstore->begin();
+    Item live(makeStoredDocKey("live"), 0, 0, "value", 5);
+    live.setBySeqno(1);
+    kvstore->set(live, wc);
+    Item deleted(makeStoredDocKey("deleted"), 0, 0, "value", 5);
+    deleted.setBySeqno(2);
+    deleted.setDeleted();
+    kvstore->del(deleted, dc);
+    Item last(makeStoredDocKey("last"), 0, 0, "value", 5);
+    last.setBySeqno(3);
+    kvstore->set(last, wc);
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+    EXPECT_EQ(2, kvstore->getItemCount(0));
+    EXPECT_EQ(1, kvstore->getNumPersistedDeletes(0));
+
+    // Delete one of the documents, and update the other one (so that the
+    // document with the highest seqno isn't a tombstone)
+    kvstore->begin();
+    live.setBySeqno(4);
+    live.setDeleted();
+    kvstore->del(live, dc);
+    last.setBySeqno(5);
+    kvstore->set(last, wc);
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+    EXPECT_EQ(1, kvstore->getItemCount(0));
+    EXPECT_EQ(2, kvstore->getNumPersistedDeletes(0));
+
+    compaction_ctx cctx;
+    cctx.purge_before_seq = 0;
+    cctx.purge_before_ts = 0;
+    cctx.curr_time = 0;
+    cctx.drop_deletes = 1;
+    cctx.db_file_id = 0;
+    EXPECT_TRUE(kvstore->compactDB(&cctx));
+    EXPECT_EQ(1, kvstore->getItemCount(0));
+    EXPECT_EQ(0, kvstore->getNumPersistedDeletes(0));
+
+    kvstore.reset();
+    kvstore = std::move(KVStoreFactory::create(config).rw);
+    EXPECT_EQ(1, kvstore->getItemCount(0));
+    EXPECT_EQ(0, kvstore->getNumPersistedDeletes(0));
+}
+
+/* Test that the persistence callbacks of a transaction are only invoked by
+ * its commit, and tell inserts from updates */
+TEST_P(CouchAndForestTest, SetCallbacksAfterCommit) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    std::vector<mutation_result> results;
+    CustomCallback<mutation_result> cb(
+            [&results](mutation_result result) { results.push_back(result); });
+
+    Item item(makeStoredDocKey("key"), 0, 0, "value", 5);
+    item.setBySeqno(1);
+    kvstore->begin();
+    kvstore->set(item, cb);
+    EXPECT_TRUE(results.empty());
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+    ASSERT_EQ(1, results.size());
+    EXPECT_EQ(mutation_result(1, true), results[0]);
+
+    item.setBySeqno(2);
+    kvstore->begin();
+    kvstore->set(item, cb);
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+    ASSERT_EQ(2, results.size());
+    EXPECT_EQ(mutation_result(1, false), results[1]);
+}
+
+/* Test that a by-seqno scan only returns the latest revision of each
+ * document */
+TEST_P(CouchAndForestTest, ScanReturnsLatestRevisions) {
+    KVStoreConfig config(
+            1024, 4, data_dir, GetParam(), 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    WriteCallback wc;
+    kvstore->begin();
+    for (int i = 1; i <= 2; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  "value",
+                  5);
+        item.setBySeqno(i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    // Update key1, giving it seqno 3
+    kvstore->begin();
+    Item item(makeStoredDocKey("key1"), 0, 0, "value", 5);
+    item.setBySeqno(3);
+    kvstore->set(item, wc);
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    vbucket_state state(
+            vbucket_state_active, 0, 0, 3, 0, 0, 0, 0, 0, false, "");
+    kvstore->snapshotVBucket(
+            0, state, VBStatePersist::VBSTATE_PERSIST_WITHOUT_COMMIT);
+
+    std::vector<int64_t> seqnos;
+    auto cb = std::make_shared<CustomCallback<GetValue>>(
+            [&seqnos](GetValue gv) {
+                seqnos.push_back(gv.item->getBySeqno());
+            });
+    auto cl = std::make_shared<CustomCallback<CacheLookup>>();
+    auto* scanCtx = kvstore->initScanContext(cb,
+                                             cl,
+                                             0,
+                                             1,
+                                             DocumentFilter::ALL_ITEMS,
+                                             ValueFilter::VALUES_DECOMPRESSED);
+    ASSERT_NE(nullptr, scanCtx);
+    EXPECT_EQ(scan_success, kvstore->scan(scanCtx));
+    kvstore->destroyScanContext(scanCtx);
+
+    EXPECT_EQ(std::vector<int64_t>({2, 3}), seqnos);
+}
+
+/* Test that a scan with a key filter only hands (and looks up) the
+ * documents the filter allows, and still gets to the end */
+TEST_F(CouchKVStoreTest, ScanKeyFilter) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    WriteCallback wc;
+    kvstore->begin();
+    for (int i = 1; i <= 6; i++) {
+        Item item(makeStoredDocKey((i % 2 ? "keep" : "skip") +
+                                   std::to_string(i)),
+                  0,
+                  0,
+                  "value",
+                  5);
+        item.setBySeqno(i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    vbucket_state state(
+            vbucket_state_active, 0, 0, 6, 0, 0, 0, 0, 0, false, "");
+    kvstore->snapshotVBucket(
+            0, state, VBStatePersist::VBSTATE_PERSIST_WITHOUT_COMMIT);
+
+    std::vector<int64_t> seqnos;
+    auto cb = std::make_shared<CustomCallback<GetValue>>(
+            [&seqnos](GetValue gv) {
+                seqnos.push_back(gv.item->getBySeqno());
+            });
+    size_t lookups = 0;
+    auto cl = std::make_shared<CustomCallback<CacheLookup>>(
+            [&lookups](CacheLookup) { ++lookups; });
+    auto* scanCtx = kvstore->initScanContext(cb,
+                                             cl,
+                                             0,
+                                             1,
+                                             DocumentFilter::ALL_ITEMS,
+                                             ValueFilter::VALUES_DECOMPRESSED);
+    ASSERT_NE(nullptr, scanCtx);
+    scanCtx->keyFilter = [](const DocKey& key) {
+        return key.size() > 4 &&
+               std::memcmp(key.data(), "keep", 4) == 0;
+    };
+    EXPECT_EQ(scan_success, kvstore->scan(scanCtx));
+    EXPECT_EQ(6u, scanCtx->lastReadSeqno);
+    kvstore->destroyScanContext(scanCtx);
+
+    EXPECT_EQ(std::vector<int64_t>({1, 3, 5}), seqnos);
+    EXPECT_EQ(3u, lookups);
+}
+
+/* Test that a scan by key hands the documents of the range in the order of
+ * their keys, and resumes after the key it handed last when paused */
+TEST_F(CouchKVStoreTest, ScanByKey) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    // key5 gets seqno 1, key4 seqno 2 ... key1 seqno 5
+    WriteCallback wc;
+    kvstore->begin();
+    for (int i = 1; i <= 5; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(6 - i)),
+                  0,
+                  0,
+                  "value",
+                  5);
+        item.setBySeqno(i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    vbucket_state state(
+            vbucket_state_active, 0, 0, 5, 0, 0, 0, 0, 0, false, "");
+    kvstore->snapshotVBucket(
+            0, state, VBStatePersist::VBSTATE_PERSIST_WITHOUT_COMMIT);
+
+    // Takes the first two documents, then refuses the third once
+    struct PausingCallback : public Callback<GetValue> {
+        void callback(GetValue& gv) override {
+            if (seqnos.size() == 2 && !paused) {
+                paused = true;
+                setStatus(ENGINE_ENOMEM);
+                return;
+            }
+            setStatus(ENGINE_SUCCESS);
+            seqnos.push_back(gv.item->getBySeqno());
+        }
+        std::vector<int64_t> seqnos;
+        bool paused = false;
+    };
+    auto cb = std::make_shared<PausingCallback>();
+    auto cl = std::make_shared<CustomCallback<CacheLookup>>();
+    auto* scanCtx = kvstore->initScanContext(cb,
+                                             cl,
+                                             0,
+                                             2,
+                                             DocumentFilter::ALL_ITEMS,
+                                             ValueFilter::VALUES_DECOMPRESSED);
+    ASSERT_NE(nullptr, scanCtx);
+    scanCtx->byKey = true;
+    EXPECT_EQ(scan_again, kvstore->scan(scanCtx));
+    EXPECT_EQ(scan_success, kvstore->scan(scanCtx));
+    kvstore->destroyScanContext(scanCtx);
+
+    // key1 ... key4 (key5 is before the start of the range)
+    EXPECT_EQ(std::vector<int64_t>({5, 4, 3, 2}), cb->seqnos);
+}
+
+/* Test that getMulti with the readahead of the document bodies enabled
+ * fetches all of the documents of the batch */
+TEST_F(CouchKVStoreTest, GetMultiReadahead) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    config.setBgFetchReadahead(true);
+    auto kvstore = setup_kv_store(config);
+
+    kvstore->begin();
+    WriteCallback wc;
+    for (int i = 1; i <= 10; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    vb_bgfetch_queue_t itms;
+    for (int i = 1; i <= 10; i++) {
+        vb_bgfetch_item_ctx_t ctx;
+        // A meta-only fetch doesn't need its body
+        ctx.isMetaOnly = i == 1 ? GetMetaOnly::Yes : GetMetaOnly::No;
+        ctx.bgfetched_list.push_back(
+                std::make_unique<VBucketBGFetchItem>(nullptr, i == 1));
+        itms[makeStoredDocKey("key" + std::to_string(i))] = std::move(ctx);
+    }
+    kvstore->getMulti(0, itms);
+
+    for (auto& it : itms) {
+        auto& fetch = *it.second.bgfetched_list.front();
+        ASSERT_EQ(&it.second.value, fetch.value);
+        ASSERT_EQ(ENGINE_SUCCESS, fetch.value->getStatus());
+        EXPECT_EQ(it.first, fetch.value->item->getKey());
+        if (it.second.isMetaOnly == GetMetaOnly::No) {
+            checkGetValue(*fetch.value);
+        }
+    }
+    EXPECT_EQ(9, kvstore->getKVStoreStat().io_bgfetch_readahead_docs.load());
+}
+
+/* Test that a scan with readahead enabled returns all of the documents, and
+ * that its reads are (mostly) within the range advised to be read ahead */
+TEST_F(CouchKVStoreTest, ScanReadahead) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    config.setBackfillReadahead(1024 * 1024);
+    auto kvstore = setup_kv_store(config);
+
+    // Enough documents for the scan to read many blocks of the file
+    const int numDocs = 1000;
+    const std::string value(1024, 'x');
+    kvstore->begin();
+    WriteCallback wc;
+    for (int i = 1; i <= numDocs; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  value.data(),
+                  value.size(),
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    int numItems = 0;
+    auto cb = std::make_shared<CustomCallback<GetValue>>(
+            [&numItems](GetValue gv) {
+                ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+                EXPECT_EQ(++numItems, gv.item->getBySeqno());
+            });
+    auto cl = std::make_shared<CustomCallback<CacheLookup>>();
+    auto* scanCtx = kvstore->initScanContext(cb,
+                                             cl,
+                                             0,
+                                             1,
+                                             DocumentFilter::ALL_ITEMS,
+                                             ValueFilter::VALUES_DECOMPRESSED);
+    ASSERT_NE(nullptr, scanCtx);
+    EXPECT_EQ(scan_success, kvstore->scan(scanCtx));
+    kvstore->destroyScanContext(scanCtx);
+    EXPECT_EQ(numDocs, numItems);
+
+    const auto& fsStats = kvstore->getKVStoreStat().fsStats;
+    EXPECT_LT(0, fsStats.readaheadMisses.load());
+    EXPECT_LT(fsStats.readaheadMisses.load(), fsStats.readaheadHits.load());
+    EXPECT_LT(0, fsStats.readaheadBytes.load());
+}
+
 TEST_F(CouchKVStoreTest, CompressedTest) {
     KVStoreConfig config(
             1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
@@ -283,6 +841,221 @@ TEST_F(CouchKVStoreTest, CompressedTest) {
     kvstore->destroyScanContext(scanCtx);
 }
 
+/* Test that gets read through the block cache (and O_DIRECT, where the file
+ * system supports it) return the documents, and hit the cache once the
+ * blocks they need were read twice */
+TEST_F(CouchKVStoreTest, DirectIOBlockCache) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    config.setDirectIO(true);
+    config.setBlockCacheSize(1024 * 1024);
+    auto kvstore = setup_kv_store(config);
+
+    // Enough documents for the file to span many blocks
+    kvstore->begin();
+    WriteCallback wc;
+    const std::string value(1024, 'x');
+    for (int i = 1; i <= 100; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  value.data(),
+                  value.size(),
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    for (int ii = 0; ii < 3; ii++) {
+        for (int i = 1; i <= 100; i += 10) {
+            GetValue gv = kvstore->get(
+                    makeStoredDocKey("key" + std::to_string(i)), 0);
+            ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+            EXPECT_EQ(value, gv.item->getValue()->to_s());
+        }
+    }
+
+    size_t hits = 0;
+    ASSERT_TRUE(kvstore->getStat("Block_cache_hits", hits));
+    EXPECT_LT(0, hits);
+}
+
+/* Test that the writes of a commit are coalesced by the write buffer (with
+ * the buffering of couchstore itself disabled, which would otherwise issue
+ * a write per document), and that the documents can be read back */
+TEST_F(CouchKVStoreTest, WriteBuffer) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    config.setBuffered(false);
+    config.setWriteBufferSize(1024 * 1024);
+    auto kvstore = setup_kv_store(config);
+    auto& fsStats = kvstore->getKVStoreStat().fsStats;
+    fsStats.reset();
+
+    kvstore->begin();
+    WriteCallback wc;
+    const std::string value(100, 'x');
+    const int numItems = 100;
+    for (int i = 1; i <= numItems; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  value.data(),
+                  value.size(),
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+    EXPECT_LT(fsStats.writeSizeHisto.total(), size_t(numItems / 4));
+
+    for (int i = 1; i <= numItems; i += 10) {
+        GetValue gv =
+                kvstore->get(makeStoredDocKey("key" + std::to_string(i)), 0);
+        ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+        EXPECT_EQ(value, gv.item->getValue()->to_s());
+    }
+}
+
+TEST(CouchBlockCacheTest, AdmitsOnSecondRead) {
+    const size_t bs = CouchBlockCache::blockSize;
+    CouchBlockCache cache(2 * bs);
+    const auto file = cache.getFileId("file", 1);
+    EXPECT_EQ(file, cache.getFileId("file", 1));
+
+    std::vector<char> block(bs, 'a');
+    char byte = 0;
+    cache.offer(file, 0, block.data());
+    EXPECT_FALSE(cache.lookup(file, 0, &byte, 0, 1));
+    cache.offer(file, 0, block.data());
+    ASSERT_TRUE(cache.lookup(file, 0, &byte, bs - 1, 1));
+    EXPECT_EQ('a', byte);
+
+    // Two more blocks evict the least recently used one
+    block.assign(bs, 'b');
+    cache.offer(file, bs, block.data());
+    cache.offer(file, bs, block.data());
+    EXPECT_TRUE(cache.lookup(file, 0, &byte, 0, 1));
+    cache.offer(file, 2 * bs, block.data());
+    cache.offer(file, 2 * bs, block.data());
+    EXPECT_EQ(2, cache.getNumBlocks());
+    EXPECT_TRUE(cache.lookup(file, 0, &byte, 0, 1));
+    EXPECT_FALSE(cache.lookup(file, bs, &byte, 0, 1));
+    EXPECT_TRUE(cache.lookup(file, 2 * bs, &byte, 0, 1));
+    EXPECT_EQ('b', byte);
+    EXPECT_EQ(1, cache.evictions.load());
+
+    // A file recreated at the same path doesn't see the old blocks
+    const auto newFile = cache.getFileId("file", 2);
+    EXPECT_NE(file, newFile);
+    EXPECT_FALSE(cache.lookup(newFile, 0, &byte, 0, 1));
+}
+
+static std::string makeJsonValue(int i) {
+    return R"({"name":"user)" + std::to_string(i) +
+           R"(","email":"user@example.com","active":true,"visits":)" +
+           std::to_string(i * 7) + "}";
+}
+
+TEST(ValueDictionaryTest, EncodeDecode) {
+    std::vector<std::string> samples;
+    for (size_t i = 0; i < ValueDictionary::trainingSamples; i++) {
+        samples.push_back(makeJsonValue(i));
+    }
+    const ValueDictionary dictionary(1, ValueDictionary::train(samples));
+    EXPECT_NE(std::string::npos, dictionary.getData().find(R"("email":)"));
+
+    const std::string value = makeJsonValue(1000);
+    std::string encoded;
+    ASSERT_TRUE(dictionary.encode({value.data(), value.size()}, encoded));
+    EXPECT_LT(encoded.size(), value.size());
+
+    std::string decoded;
+    ASSERT_TRUE(dictionary.decode({encoded.data(), encoded.size()}, decoded));
+    EXPECT_EQ(value, decoded);
+
+    // Neither a truncated encoding nor one of another dictionary decode
+    EXPECT_FALSE(dictionary.decode({encoded.data(), encoded.size() - 1},
+                                   decoded));
+    const ValueDictionary other(2, "");
+    EXPECT_FALSE(other.decode({encoded.data(), encoded.size()}, decoded));
+
+    // A value with nothing in common isn't encoded
+    const std::string random = "q7Zp2xKv9LmB4nWc";
+    EXPECT_FALSE(dictionary.encode({random.data(), random.size()}, encoded));
+}
+
+/* Test that the JSON values written once a dictionary was trained are stored
+ * encoded with it, and read back (by a get, a scan and the RO store, which
+ * reads the dictionary from the file) as they were written */
+TEST_F(CouchKVStoreTest, ValueDictionary) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    config.setValueDictionary(true);
+    auto kvstores = KVStoreFactory::create(config);
+    initialize_kv_store(kvstores.rw.get());
+    auto& kvstore = kvstores.rw;
+
+    const int numDocs = 100;
+    kvstore->begin();
+    WriteCallback wc;
+    for (int i = 1; i <= numDocs; i++) {
+        const std::string value = makeJsonValue(i);
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  value.data(),
+                  value.size(),
+                  PROTOCOL_BINARY_DATATYPE_JSON,
+                  0,
+                  i);
+        kvstore->set(item, wc);
+    }
+    ASSERT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    const auto& st = kvstore->getKVStoreStat();
+    EXPECT_EQ(size_t(numDocs) - ValueDictionary::trainingSamples + 1,
+              st.io_dictionary_encoded_docs.load());
+    EXPECT_LT(0, st.io_dictionary_saved_bytes.load());
+
+    for (int i : {1, numDocs}) {
+        GetValue gv =
+                kvstore->get(makeStoredDocKey("key" + std::to_string(i)), 0);
+        ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+        EXPECT_EQ(makeJsonValue(i), gv.item->getValue()->to_s());
+        EXPECT_EQ(PROTOCOL_BINARY_DATATYPE_JSON, gv.item->getDataType());
+    }
+
+    GetValue gv = kvstores.ro->get(
+            makeStoredDocKey("key" + std::to_string(numDocs)), 0);
+    ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+    EXPECT_EQ(makeJsonValue(numDocs), gv.item->getValue()->to_s());
+
+    int numItems = 0;
+    auto cb = std::make_shared<CustomCallback<GetValue>>(
+            [&numItems](GetValue gv) {
+                ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+                EXPECT_EQ(makeJsonValue(++numItems),
+                          gv.item->getValue()->to_s());
+                EXPECT_EQ(PROTOCOL_BINARY_DATATYPE_JSON,
+                          gv.item->getDataType());
+            });
+    auto cl = std::make_shared<CustomCallback<CacheLookup>>();
+    auto* scanCtx = kvstore->initScanContext(cb,
+                                             cl,
+                                             0,
+                                             1,
+                                             DocumentFilter::ALL_ITEMS,
+                                             ValueFilter::VALUES_DECOMPRESSED);
+    ASSERT_NE(nullptr, scanCtx);
+    EXPECT_EQ(scan_success, kvstore->scan(scanCtx));
+    kvstore->destroyScanContext(scanCtx);
+    EXPECT_EQ(numDocs, numItems);
+}
+
 // Verify the stats returned from operations are accurate.
 TEST_F(CouchKVStoreTest, StatsTest) {
     KVStoreConfig config(
@@ -1656,6 +2429,8 @@ TEST_F(CouchKVStoreMetaData, basic) {
     EXPECT_EQ(16, MetaData::getMetaDataSize(MetaData::Version::V0));
     EXPECT_EQ(16 + 2, MetaData::getMetaDataSize(MetaData::Version::V1));
     EXPECT_EQ(16 + 2 + 1, MetaData::getMetaDataSize(MetaData::Version::V2));
+    EXPECT_EQ(16 + 2 + 1 + 4,
+              MetaData::getMetaDataSize(MetaData::Version::V3));
 }
 
 TEST_F(CouchKVStoreMetaData, overlay) {
@@ -32,6 +32,7 @@ extern "C" {
 #include "crc32.h"
 }
 
+#include "checksum.h"
 #include "mutation_log.h"
 #include "tests/module_tests/test_helpers.h"
 
@@ -646,3 +647,74 @@ TEST_F(MutationLogTest, upgrade) {
         }
     }
 }
+
+// The logs written since V3 checksum their blocks with a CRC32C; the V2 ones
+// (CRC16 blocks, same entries) must still load.
+TEST_F(MutationLogTest, ReadV2) {
+    {
+        MutationLog ml(tmp_log_filename.c_str());
+        ml.open();
+        EXPECT_EQ(MutationLogVersion::V3, ml.header().version());
+    }
+    remove(tmp_log_filename.c_str());
+
+    // Craft a V2 format file
+    LogHeaderBlock headerBlock(MutationLogVersion::V2);
+    headerBlock.set(MIN_LOG_HEADER_SIZE);
+    const auto* ptr = reinterpret_cast<uint8_t*>(&headerBlock);
+
+    std::vector<uint8_t> toWrite(ptr, ptr + sizeof(LogHeaderBlock));
+    toWrite.resize(MIN_LOG_HEADER_SIZE + HEADER_RESERVED);
+
+    const uint16_t items = 5;
+    const uint16_t swapped = htons(items);
+    std::copy_n(reinterpret_cast<const uint8_t*>(&swapped),
+                sizeof(uint16_t),
+                toWrite.begin() + MIN_LOG_HEADER_SIZE + 2);
+
+    const uint16_t vbid = 3;
+    for (int ii = 0; ii < items; ii++) {
+        const auto key = makeStoredDocKey("mykey" + std::to_string(ii));
+        std::vector<uint8_t> bytes(MutationLogEntryV2::len(key.size()));
+        (void)MutationLogEntryV2::newEntry(
+                bytes.data(), MutationLogType::New, vbid, key);
+        toWrite.insert(toWrite.end(), bytes.begin(), bytes.end());
+    }
+    toWrite.resize(MIN_LOG_HEADER_SIZE * 2);
+
+    uint32_t crc32(crc32buf(&toWrite[MIN_LOG_HEADER_SIZE + 2],
+                            MIN_LOG_HEADER_SIZE - 2));
+    uint16_t crc16(htons(crc32 & 0xffff));
+    std::copy_n(reinterpret_cast<uint8_t*>(&crc16),
+                sizeof(uint16_t),
+                toWrite.begin() + MIN_LOG_HEADER_SIZE);
+
+    {
+        std::ofstream logFile(tmp_log_filename,
+                              std::ios::out | std::ofstream::binary);
+        std::copy(toWrite.begin(),
+                  toWrite.end(),
+                  std::ostreambuf_iterator<char>(logFile));
+    }
+
+    MutationLog ml(tmp_log_filename.c_str());
+    ml.open();
+    EXPECT_EQ(MutationLogVersion::V2, ml.header().version());
+    MutationLogHarvester h(ml);
+    h.setVBucket(vbid);
+    EXPECT_EQ(ml.end(), h.loadBatch(ml.begin(), 0));
+
+    std::set<StoredDocKey> sets[vbid + 1];
+    h.apply(&sets, loaderFun);
+    EXPECT_EQ(items, sets[vbid].size());
+}
+
+TEST(ChecksumTest, Crc32c) {
+    const std::string data = "123456789";
+    const auto* buf = reinterpret_cast<const uint8_t*>(data.data());
+    EXPECT_EQ(0xe3069283, computeChecksum(buf, data.size()));
+
+    // In pieces
+    const uint32_t head = computeChecksum(buf, 4);
+    EXPECT_EQ(0xe3069283, computeChecksum(buf + 4, data.size() - 4, head));
+}
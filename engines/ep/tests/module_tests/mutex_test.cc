@@ -17,10 +17,13 @@
 
 #include "config.h"
 
+#include <atomic>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include "common.h"
+#include "instrumented_mutex.h"
 #include "locks.h"
 
 #include <gtest/gtest.h>
@@ -48,3 +51,143 @@ TEST(LockTimerTest, WriterLockHolder) {
         std::this_thread::sleep_for(std::chrono::milliseconds(2));
     }
 }
+
+TEST(SharedMutexTest, Readers) {
+    SharedMutex m;
+    m.lock_shared();
+    EXPECT_TRUE(m.try_lock_shared());
+    EXPECT_FALSE(m.try_lock());
+    m.unlock_shared();
+    EXPECT_FALSE(m.try_lock());
+    m.unlock_shared();
+    EXPECT_TRUE(m.try_lock());
+    m.unlock();
+}
+
+TEST(SharedMutexTest, Writer) {
+    SharedMutex m;
+    {
+        std::lock_guard<SharedMutex> guard(m);
+        EXPECT_FALSE(m.try_lock());
+        EXPECT_FALSE(m.try_lock_shared());
+    }
+    EXPECT_TRUE(m.try_lock_shared());
+    m.unlock_shared();
+}
+
+TEST(SharedMutexTest, ReadersAndWriters) {
+    SharedMutex m;
+    size_t a = 0;
+    size_t b = 0;
+    std::atomic<bool> torn{false};
+
+    std::vector<std::thread> readers;
+    for (int ii = 0; ii < 4; ++ii) {
+        readers.emplace_back([&m, &a, &b, &torn]() {
+            for (int jj = 0; jj < 10000; ++jj) {
+                m.lock_shared();
+                if (a != b) {
+                    torn = true;
+                }
+                m.unlock_shared();
+            }
+        });
+    }
+
+    for (int ii = 0; ii < 10000; ++ii) {
+        std::lock_guard<SharedMutex> guard(m);
+        ++a;
+        ++b;
+    }
+
+    for (auto& t : readers) {
+        t.join();
+    }
+    EXPECT_FALSE(torn);
+    EXPECT_EQ(10000, a);
+}
+
+TEST(ShardedSharedMutexTest, Readers) {
+    ShardedSharedMutex m;
+    {
+        ShardedSharedMutex::ReaderHolder first(m);
+        ShardedSharedMutex::ReaderHolder second(m);
+    }
+    std::lock_guard<ShardedSharedMutex> guard(m);
+}
+
+// Readers on any thread (so any shard) exclude the writer
+TEST(ShardedSharedMutexTest, ReadersAndWriters) {
+    ShardedSharedMutex m;
+    size_t a = 0;
+    size_t b = 0;
+    std::atomic<bool> torn{false};
+
+    std::vector<std::thread> readers;
+    for (size_t ii = 0; ii < ShardedSharedMutex::Shards + 2; ++ii) {
+        readers.emplace_back([&m, &a, &b, &torn]() {
+            for (int jj = 0; jj < 1000; ++jj) {
+                ShardedSharedMutex::ReaderHolder rlh(m);
+                if (a != b) {
+                    torn = true;
+                }
+            }
+        });
+    }
+
+    for (int ii = 0; ii < 1000; ++ii) {
+        std::lock_guard<ShardedSharedMutex> guard(m);
+        ++a;
+        ++b;
+    }
+
+    for (auto& t : readers) {
+        t.join();
+    }
+    EXPECT_FALSE(torn);
+    EXPECT_EQ(1000, a);
+}
+
+TEST(InstrumentedMutexTest, SampledAcquisitions) {
+    LockStats stats("test");
+    InstrumentedMutex<SharedMutex> m(stats);
+
+    LockStats::sampleRate = 0;
+    {
+        std::lock_guard<InstrumentedMutex<SharedMutex>> guard(m);
+    }
+    EXPECT_EQ(0, stats.sampled);
+
+    LockStats::sampleRate = 1;
+    {
+        std::lock_guard<InstrumentedMutex<SharedMutex>> guard(m);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    {
+        SharedLockHolder<InstrumentedMutex<SharedMutex>> rlh(m);
+    }
+    LockStats::sampleRate = 0;
+
+    EXPECT_EQ(2, stats.sampled);
+    EXPECT_EQ(2, stats.waitHisto.total());
+    // Only the exclusive acquisition records how long it held the lock
+    EXPECT_EQ(1, stats.holdHisto.total());
+}
+
+TEST(InstrumentedMutexTest, ContendedWait) {
+    LockStats stats("test");
+    InstrumentedMutex<std::mutex> m(stats);
+    std::unique_lock<InstrumentedMutex<std::mutex>> lh(m);
+
+    LockStats::sampleRate = 1;
+    std::thread waiter([&m]() {
+        std::lock_guard<InstrumentedMutex<std::mutex>> guard(m);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    lh.unlock();
+    waiter.join();
+    LockStats::sampleRate = 0;
+
+    EXPECT_EQ(1, stats.sampled);
+    EXPECT_EQ(1, stats.contended);
+}
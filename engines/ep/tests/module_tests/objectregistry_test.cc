@@ -62,3 +62,53 @@ TEST_F(ObjectRegistryTest, MemOverhead) {
     }
     EXPECT_EQ(0, *engine.getEpStats().memOverhead);
 }
+
+static unsigned numArenas;
+static unsigned testThreadArena;
+
+extern "C" {
+static size_t test_get_allocation_size(const void*) {
+    return 0;
+}
+
+static bool test_create_arena(unsigned* arena) {
+    *arena = ++numArenas;
+    return true;
+}
+
+static bool test_set_thread_arena(unsigned arena) {
+    testThreadArena = arena;
+    return true;
+}
+
+static void test_purge_arena(unsigned) {
+}
+}
+
+// Check that a thread allocates from the arena of the engine it works for
+// (and from the default arena outside of it), and that the arena of a
+// deleted bucket is reused.
+TEST_F(ObjectRegistryTest, Arena) {
+    ALLOCATOR_HOOKS_API hooks{};
+    hooks.get_allocation_size = test_get_allocation_size;
+    hooks.create_arena = test_create_arena;
+    hooks.set_thread_arena = test_set_thread_arena;
+    hooks.purge_arena = test_purge_arena;
+    ObjectRegistry::initialize(hooks);
+
+    const unsigned arena = ObjectRegistry::acquireArena();
+    ASSERT_NE(0u, arena);
+    engine.setArena(arena);
+
+    ObjectRegistry::onSwitchThread(&engine);
+    EXPECT_EQ(arena, testThreadArena);
+    ObjectRegistry::onSwitchThread(nullptr);
+    EXPECT_EQ(0u, testThreadArena);
+
+    engine.setArena(0);
+    ObjectRegistry::releaseArena(arena);
+    EXPECT_EQ(arena, ObjectRegistry::acquireArena());
+    EXPECT_EQ(arena + 1, ObjectRegistry::acquireArena());
+
+    ObjectRegistry::reset();
+}
@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "spsc_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+
+TEST(SpscRingTest, Capacity) {
+    SpscRing<int> ring(5);
+    EXPECT_EQ(8, ring.capacity());
+
+    for (int ii = 0; ii < 8; ++ii) {
+        int value = ii;
+        EXPECT_TRUE(ring.push(std::move(value)));
+    }
+    int value = 8;
+    EXPECT_FALSE(ring.push(std::move(value)));
+
+    // Popping makes room again, and the elements come out in order
+    EXPECT_TRUE(ring.pop(value));
+    EXPECT_EQ(0, value);
+    value = 8;
+    EXPECT_TRUE(ring.push(std::move(value)));
+    for (int ii = 1; ii <= 8; ++ii) {
+        EXPECT_TRUE(ring.pop(value));
+        EXPECT_EQ(ii, value);
+    }
+    EXPECT_FALSE(ring.pop(value));
+}
+
+// A failed push leaves the element with the caller
+TEST(SpscRingTest, FullKeepsElement) {
+    SpscRing<std::unique_ptr<int>> ring(1);
+    auto first = std::make_unique<int>(1);
+    EXPECT_TRUE(ring.push(std::move(first)));
+    auto second = std::make_unique<int>(2);
+    EXPECT_FALSE(ring.push(std::move(second)));
+    ASSERT_TRUE(second);
+    EXPECT_EQ(2, *second);
+
+    std::unique_ptr<int> popped;
+    EXPECT_TRUE(ring.pop(popped));
+    EXPECT_EQ(1, *popped);
+}
+
+TEST(SpscRingTest, Threads) {
+    const size_t count = 100000;
+    SpscRing<size_t> ring(64);
+
+    std::thread producer([&ring, count]() {
+        for (size_t ii = 0; ii < count; ++ii) {
+            size_t value = ii;
+            while (!ring.push(std::move(value))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    size_t expected = 0;
+    while (expected < count) {
+        size_t value;
+        if (ring.pop(value)) {
+            ASSERT_EQ(expected, value);
+            ++expected;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+}
@@ -29,6 +29,8 @@
 
 #include <gmock/gmock.h>
 
+#include <thread>
+
 void StatTest::SetUp() {
     SingleThreadedEPBucketTest::SetUp();
     store->setVBucketState(vbid, vbucket_state_active, false);
@@ -140,6 +142,49 @@ TEST_F(StatTest, vbucket_takeover_stats_stream_not_active) {
 }
 
 
+TEST_F(StatTest, visitor_stats) {
+    auto& runs = engine->getEpStats().visitorRuns[static_cast<size_t>(
+            TaskId::ItemPagerVisitor)];
+    runs.record(std::chrono::microseconds(0));
+    runs.record(std::chrono::microseconds(300));
+    runs.record(std::chrono::microseconds(100));
+
+    auto vals = get_stat("visitors");
+    EXPECT_EQ("3", vals["ItemPagerVisitor:runs"]);
+    EXPECT_EQ("2", vals["ItemPagerVisitor:overruns"]);
+    EXPECT_EQ("400", vals["ItemPagerVisitor:overrun_time"]);
+    EXPECT_EQ("300", vals["ItemPagerVisitor:max_overrun"]);
+    // Only the task types which ran are included
+    EXPECT_EQ(0u, vals.count("DefragmenterTask:runs"));
+}
+
+// The memory accounted by threads which exited (before their shard was
+// folded) must not be lost, and the estimate must stay within its margin
+TEST(EPStatsTest, memory_shards) {
+    EPStats stats;
+    stats.memoryTrackerEnabled.store(true);
+    stats.mem_merge_count_threshold = 1000000;
+    stats.mem_merge_bytes_threshold = 10000;
+
+    std::vector<std::thread> threads;
+    for (int ii = 0; ii < 64; ++ii) {
+        threads.emplace_back([&stats]() {
+            for (int jj = 0; jj < 100; ++jj) {
+                stats.memAllocated(300);
+                stats.memDeallocated(100);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(64u * 100 * 200, stats.getPreciseTotalMemoryUsed());
+    EXPECT_EQ(EPStats::MemShards * 10000, stats.getMemoryErrorMargin());
+    EXPECT_LE(stats.getPreciseTotalMemoryUsed() - stats.getTotalMemoryUsed(),
+              stats.getMemoryErrorMargin());
+}
+
 TEST_P(DatatypeStatTest, datatypesInitiallyZero) {
     // Check that the datatype stats initialise to 0
     auto vals = get_stat(nullptr);
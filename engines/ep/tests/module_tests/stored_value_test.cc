@@ -225,6 +225,21 @@ TYPED_TEST(ValueTest, deletedValueDatatypeIsBinary) {
             << "datatype should be RAW BYTES after deletion.";
 }
 
+TYPED_TEST(ValueTest, freqCounter) {
+    EXPECT_EQ(0, this->sv->getFreqCounterValue());
+    this->sv->incrFreqCounterValue();
+    EXPECT_EQ(1, this->sv->getFreqCounterValue());
+
+    // The counter saturates
+    this->sv->setFreqCounterValue(StoredValue::MaxFreqCounterValue);
+    this->sv->incrFreqCounterValue();
+    EXPECT_EQ(StoredValue::MaxFreqCounterValue,
+              this->sv->getFreqCounterValue());
+    this->sv->setFreqCounterValue(StoredValue::MaxFreqCounterValue + 1);
+    EXPECT_EQ(StoredValue::MaxFreqCounterValue,
+              this->sv->getFreqCounterValue());
+}
+
 /// Check that StoredValue / OrderedStoredValue don't unexpectedly change in
 /// size (we've carefully crafted them to be as efficient as possible).
 TEST(StoredValueTest, expectedSize) {
@@ -244,3 +259,133 @@ TEST(OrderedStoredValueTest, expectedSize) {
             << "Unexpected change in OrderedStoredValue storage size for item: "
             << item;
 }
+
+/**
+ * Test fixture for StoredValues with an embedded value (see
+ * StoredValueFactory::maxInlineValueSize).
+ */
+class InlineValueTest : public ::testing::Test {
+public:
+    InlineValueTest() : stats(), factory(stats, /*maxInlineValueSize*/ 16) {
+    }
+
+protected:
+    EPStats stats;
+    StoredValueFactory factory;
+};
+
+TEST_F(InlineValueTest, SmallValueIsEmbedded) {
+    auto item = make_item(0, makeStoredDocKey("key"), "value");
+    auto sv = factory(item, {});
+    EXPECT_TRUE(sv->hasInlineValue());
+    EXPECT_NE(item.getValue().get(), sv->getValue().get());
+    EXPECT_EQ("value", sv->getValue()->to_s());
+    EXPECT_EQ(5, sv->valuelen());
+
+    // Room for 8 bytes of value after the (5 byte) key
+    EXPECT_EQ(StoredValue::getRequiredStorage(item) + /*padding*/ 3 +
+                      Blob::getAllocationSize(8),
+              sv->getObjectSize());
+    EXPECT_EQ(StoredValue::getRequiredStorage(item), sv->metaDataSize());
+    EXPECT_EQ(sv->metaDataSize() + 5, sv->size());
+}
+
+// A copy (for the defragmenter) has its own embedded value
+TEST_F(InlineValueTest, CopyHasItsOwnValue) {
+    auto item = make_item(0, makeStoredDocKey("key"), "value");
+    auto sv = factory(item, {});
+    auto copy = factory.copyStoredValue(*sv, {});
+    EXPECT_TRUE(copy->hasInlineValue());
+    EXPECT_NE(sv->getValue().get(), copy->getValue().get());
+    EXPECT_EQ(sv->getObjectSize(), copy->getObjectSize());
+    EXPECT_EQ(*sv, *copy);
+
+    sv.reset();
+    EXPECT_EQ("value", copy->getValue()->to_s());
+}
+
+TEST_F(InlineValueTest, LargeValueIsNotEmbedded) {
+    auto item = make_item(
+            0, makeStoredDocKey("key"), std::string(17, 'v').c_str());
+    auto sv = factory(item, {});
+    EXPECT_FALSE(sv->hasInlineValue());
+    EXPECT_EQ(item.getValue().get(), sv->getValue().get());
+    EXPECT_EQ(StoredValue::getRequiredStorage(item), sv->getObjectSize());
+}
+
+TEST_F(InlineValueTest, ItemDoesNotShareTheEmbeddedValue) {
+    auto sv = factory(make_item(0, makeStoredDocKey("key"), "value"), {});
+    auto item = sv->toItem(false, 0);
+    EXPECT_NE(sv->getValue().get(), item->getValue().get());
+    EXPECT_EQ("value", item->getValue()->to_s());
+
+    // The item must stay valid once the StoredValue is gone
+    sv.reset();
+    EXPECT_EQ("value", item->getValue()->to_s());
+}
+
+TEST_F(InlineValueTest, SetValue) {
+    auto sv = factory(make_item(0, makeStoredDocKey("key"), "99"), {});
+    ASSERT_TRUE(sv->hasInlineValue());
+
+    // A new value which fits reuses the embedded Blob
+    sv->setValue(make_item(0, makeStoredDocKey("key"), "100"));
+    EXPECT_TRUE(sv->hasInlineValue());
+    EXPECT_EQ("100", sv->getValue()->to_s());
+
+    // A larger one doesn't
+    auto large = make_item(0, makeStoredDocKey("key"), "123456789");
+    sv->setValue(large);
+    EXPECT_FALSE(sv->hasInlineValue());
+    EXPECT_EQ(large.getValue().get(), sv->getValue().get());
+
+    // But we may go back to the embedded Blob
+    sv->setValue(make_item(0, makeStoredDocKey("key"), "1"));
+    EXPECT_TRUE(sv->hasInlineValue());
+    EXPECT_EQ("1", sv->getValue()->to_s());
+}
+
+TEST_F(InlineValueTest, SetValueWhileReferenced) {
+    auto sv = factory(make_item(0, makeStoredDocKey("key"), "old"), {});
+    ASSERT_TRUE(sv->hasInlineValue());
+
+    // Someone still looks at the old value (under the hash bucket lock), so
+    // we can't overwrite it
+    value_t old = sv->getValue();
+    auto item = make_item(0, makeStoredDocKey("key"), "new");
+    sv->setValue(item);
+    EXPECT_FALSE(sv->hasInlineValue());
+    EXPECT_EQ("old", old->to_s());
+    EXPECT_EQ("new", sv->getValue()->to_s());
+}
+
+TEST_F(InlineValueTest, EjectAndRestore) {
+    auto sv = factory(make_item(0, makeStoredDocKey("key"), "value"), {});
+    sv->ejectValue();
+    EXPECT_FALSE(sv->getValue());
+    EXPECT_FALSE(sv->hasInlineValue());
+
+    sv->restoreValue(make_item(0, makeStoredDocKey("key"), "value"));
+    EXPECT_TRUE(sv->isResident());
+    EXPECT_TRUE(sv->hasInlineValue());
+    EXPECT_EQ("value", sv->getValue()->to_s());
+}
+
+TEST_F(InlineValueTest, TempItemHasNoEmbeddedValue) {
+    Item itm(makeStoredDocKey("k"),
+             0,
+             0,
+             (const value_t) nullptr,
+             PROTOCOL_BINARY_RAW_BYTES,
+             0,
+             StoredValue::state_temp_init);
+    auto sv = factory(itm, {});
+    EXPECT_FALSE(sv->hasInlineValue());
+    EXPECT_EQ(StoredValue::getRequiredStorage(itm), sv->getObjectSize());
+}
+
+TEST_F(InlineValueTest, MaxInlineValueSize) {
+    EXPECT_THROW(StoredValueFactory(stats,
+                                    StoredValueFactory::MaxInlineValueSize + 1),
+                 std::invalid_argument);
+}
@@ -111,6 +111,32 @@ TEST_P(StoredDocKeyTestCombi, hash) {
     }
 }
 
+TEST_P(StoredDocKeyTest, hashVersions) {
+    StoredDocKey key("a_key_longer_than_one_word", GetParam());
+    DocKey docKey(key);
+    auto serialKey = SerialisedDocKey::make(key);
+
+    EXPECT_EQ(key.hash(DocKeyHashVersion::Current), key.hash());
+    for (auto version :
+         {DocKeyHashVersion::Djb2, DocKeyHashVersion::WordAtATime}) {
+        EXPECT_EQ(key.hash(version), docKey.hash(version));
+        EXPECT_EQ(key.hash(version), serialKey->hash(version));
+    }
+
+    // djb2 of the namespace and "k"
+    uint32_t djb2 = 5381;
+    djb2 = ((djb2 << 5) + djb2) ^ uint32_t(GetParam());
+    djb2 = ((djb2 << 5) + djb2) ^ uint32_t('k');
+    EXPECT_EQ(djb2,
+              StoredDocKey("k", GetParam()).hash(DocKeyHashVersion::Djb2));
+
+    // The last word is zero padded, which mustn't make keys which only
+    // differ by trailing zeros collide
+    const uint8_t raw[2] = {'k', 0};
+    EXPECT_NE(StoredDocKey(raw, 1, GetParam()).hash(),
+              StoredDocKey(raw, 2, GetParam()).hash());
+}
+
 TEST_P(StoredDocKeyTestCombi, equalityOperators) {
     StoredDocKey key1("key1", std::get<0>(GetParam()));
     StoredDocKey key2("key1", std::get<1>(GetParam()));
@@ -0,0 +1,120 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "globaltask.h"
+#include "task_timings.h"
+
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+TEST(TaskTimingsTest, empty) {
+    TaskTimings timings;
+    LatencyHistogram histogram;
+    timings.getWaitTimes(TaskId::MultiBGFetcherTask, histogram);
+    timings.getRunTimes(TaskId::MultiBGFetcherTask, histogram);
+    EXPECT_EQ(0u, histogram.getCount());
+}
+
+TEST(TaskTimingsTest, percentiles) {
+    TaskTimings timings;
+    for (int ii = 0; ii < 99; ++ii) {
+        timings.logWaitTime(TaskId::MultiBGFetcherTask, microseconds(1));
+    }
+    timings.logWaitTime(TaskId::MultiBGFetcherTask, milliseconds(10));
+    timings.logRunTime(TaskId::MultiBGFetcherTask, milliseconds(2));
+
+    LatencyHistogram wait;
+    timings.getWaitTimes(TaskId::MultiBGFetcherTask, wait);
+    EXPECT_EQ(100u, wait.getCount());
+    // The upper bounds of the buckets are within 1/SubBuckets of the value
+    EXPECT_LE(1000u, wait.getPercentile(50));
+    EXPECT_GE(1000u + 1000u / LatencyHistogram::SubBuckets,
+              wait.getPercentile(50));
+    EXPECT_LE(10000000u, wait.getPercentile(99.9));
+
+    LatencyHistogram run;
+    timings.getRunTimes(TaskId::MultiBGFetcherTask, run);
+    EXPECT_EQ(1u, run.getCount());
+    EXPECT_LE(2000000u, run.getPercentile(50));
+
+    // The other task types have nothing
+    LatencyHistogram other;
+    timings.getWaitTimes(TaskId::ItemPager, other);
+    timings.getRunTimes(TaskId::ItemPager, other);
+    EXPECT_EQ(0u, other.getCount());
+}
+
+// Negative durations (the clock going backwards) count as zero
+TEST(TaskTimingsTest, negative) {
+    TaskTimings timings;
+    timings.logWaitTime(TaskId::ItemPager, microseconds(-5));
+
+    LatencyHistogram wait;
+    timings.getWaitTimes(TaskId::ItemPager, wait);
+    EXPECT_EQ(1u, wait.getCount());
+    EXPECT_EQ(1u, wait.getBucket(0));
+}
+
+// The samples of all the threads, whatever their shard, are merged
+TEST(TaskTimingsTest, threads) {
+    TaskTimings timings;
+    const int numThreads = 8;
+    const int numSamples = 1000;
+
+    std::vector<std::thread> threads;
+    for (int ii = 0; ii < numThreads; ++ii) {
+        threads.emplace_back([&timings]() {
+            for (int jj = 0; jj < numSamples; ++jj) {
+                timings.logWaitTime(TaskId::MultiBGFetcherTask,
+                                    microseconds(jj));
+                timings.logRunTime(TaskId::MultiBGFetcherTask,
+                                   microseconds(jj));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    LatencyHistogram wait;
+    timings.getWaitTimes(TaskId::MultiBGFetcherTask, wait);
+    EXPECT_EQ(uint64_t(numThreads * numSamples), wait.getCount());
+    LatencyHistogram run;
+    timings.getRunTimes(TaskId::MultiBGFetcherTask, run);
+    EXPECT_EQ(uint64_t(numThreads * numSamples), run.getCount());
+}
+
+TEST(TaskTimingsTest, reset) {
+    TaskTimings timings;
+    timings.logWaitTime(TaskId::MultiBGFetcherTask, microseconds(10));
+    timings.logRunTime(TaskId::MultiBGFetcherTask, microseconds(10));
+    timings.reset();
+
+    LatencyHistogram histogram;
+    timings.getWaitTimes(TaskId::MultiBGFetcherTask, histogram);
+    timings.getRunTimes(TaskId::MultiBGFetcherTask, histogram);
+    EXPECT_EQ(0u, histogram.getCount());
+
+    // Still usable afterwards
+    timings.logRunTime(TaskId::MultiBGFetcherTask, microseconds(10));
+    timings.getRunTimes(TaskId::MultiBGFetcherTask, histogram);
+    EXPECT_EQ(1u, histogram.getCount());
+}
@@ -0,0 +1,116 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "thread_tuner.h"
+
+using namespace std::chrono;
+
+/**
+ * Feeds a ThreadTuner one second intervals in which the threads were busy
+ * and off the CPU for the given fractions of their time.
+ */
+class ThreadTunerTest : public ::testing::Test {
+protected:
+    size_t tune(size_t threads, size_t ready, double busy, double ioWait) {
+        const auto runtime = duration_cast<nanoseconds>(
+                seconds(1) * (busy * threads));
+        totalRuntime += runtime;
+        totalCpuTime += duration_cast<nanoseconds>(runtime * (1 - ioWait));
+        return tuner.tune(
+                {threads, ready, seconds(1), totalRuntime, totalCpuTime});
+    }
+
+    ThreadTuner tuner{2, 8, /*numCpus*/ 4};
+    nanoseconds totalRuntime{0};
+    nanoseconds totalCpuTime{0};
+};
+
+// A backlog of I/O bound tasks grows the threads, one at a time after
+// growAfter intervals, up to the max
+TEST_F(ThreadTunerTest, growsWhenWaitingForIO) {
+    size_t threads = 4;
+    for (int ii = 1; ii < ThreadTuner::growAfter; ++ii) {
+        EXPECT_EQ(4u, tune(threads, 20, 1.0, 0.8));
+        EXPECT_EQ(ThreadTuner::Decision::Hold,
+                  tuner.getStats().lastDecision);
+    }
+    threads = tune(threads, 20, 1.0, 0.8);
+    EXPECT_EQ(5u, threads);
+    EXPECT_EQ(ThreadTuner::Decision::Grow, tuner.getStats().lastDecision);
+    EXPECT_EQ(1u, tuner.getStats().grows);
+    EXPECT_EQ(100u, tuner.getStats().busy);
+    EXPECT_EQ(80u, tuner.getStats().ioWait);
+    EXPECT_EQ(20u, tuner.getStats().readyTasks);
+
+    for (int ii = 0; ii < 100; ++ii) {
+        threads = tune(threads, 20, 1.0, 0.8);
+    }
+    EXPECT_EQ(8u, threads);
+    EXPECT_EQ(4u, tuner.getStats().grows);
+}
+
+// CPU bound tasks don't get more threads than CPUs, whatever the backlog
+TEST_F(ThreadTunerTest, cpuBoundStopsAtCpus) {
+    size_t threads = 2;
+    for (int ii = 0; ii < 100; ++ii) {
+        threads = tune(threads, 20, 1.0, 0.0);
+    }
+    EXPECT_EQ(4u, threads);
+}
+
+// Idle threads shrink, slower than they grow, down to the min
+TEST_F(ThreadTunerTest, shrinksWhenIdle) {
+    size_t threads = 6;
+    for (int ii = 1; ii < ThreadTuner::shrinkAfter; ++ii) {
+        EXPECT_EQ(6u, tune(threads, 0, 0.1, 0.5));
+    }
+    threads = tune(threads, 0, 0.1, 0.5);
+    EXPECT_EQ(5u, threads);
+    EXPECT_EQ(ThreadTuner::Decision::Shrink, tuner.getStats().lastDecision);
+    EXPECT_EQ(1u, tuner.getStats().shrinks);
+
+    for (int ii = 0; ii < 100; ++ii) {
+        threads = tune(threads, 0, 0.0, 0.0);
+    }
+    EXPECT_EQ(2u, threads);
+}
+
+// Signals which flip between intervals (or in the band between idle and
+// busy) leave the count alone
+TEST_F(ThreadTunerTest, hysteresis) {
+    for (int ii = 0; ii < 100; ++ii) {
+        if (ii % ThreadTuner::growAfter == 0) {
+            EXPECT_EQ(4u, tune(4, 0, 0.1, 0.8));
+        } else {
+            EXPECT_EQ(4u, tune(4, 20, 1.0, 0.8));
+        }
+    }
+    for (int ii = 0; ii < 100; ++ii) {
+        EXPECT_EQ(4u, tune(4, 2, 0.5, 0.8));
+        EXPECT_EQ(4u, tune(4, 0, 0.5, 0.8));
+    }
+    EXPECT_EQ(0u, tuner.getStats().grows);
+    EXPECT_EQ(0u, tuner.getStats().shrinks);
+}
+
+// A count set out of the bounds is brought back within them
+TEST_F(ThreadTunerTest, bounds) {
+    EXPECT_EQ(8u, tune(12, 0, 0.5, 0.5));
+    EXPECT_EQ(2u, tune(1, 0, 0.5, 0.5));
+}
@@ -29,6 +29,9 @@
 #include "vbucket_bgfetch_item.h"
 
 #include <platform/cb_malloc.h>
+#include <platform/dirutils.h>
+
+#include <fstream>
 
 void VBucketTest::SetUp() {
     const auto eviction_policy = GetParam();
@@ -254,6 +257,57 @@ TEST_P(EPVBucketTest, GetBGFetchItemsPerformance) {
     auto items = this->vbucket->getBGFetchItems();
 }
 
+// The HLC generated from the coarse clock must still be strictly
+// increasing, and not fall behind a larger HLC we've seen
+TEST_P(VBucketTest, CoarseHLCIsMonotonic) {
+    this->vbucket->setHLCCoarseClock(true);
+    uint64_t last = this->vbucket->nextHLCCas();
+    for (int ii = 0; ii < 10000; ++ii) {
+        const auto next = this->vbucket->nextHLCCas();
+        ASSERT_GT(next, last);
+        last = next;
+    }
+
+    const uint64_t ahead = last + (uint64_t(1) << 32);
+    this->vbucket->setMaxCas(ahead);
+    EXPECT_GT(this->vbucket->nextHLCCas(), ahead);
+}
+
+TEST_P(VBucketTest, OpStats) {
+    EXPECT_EQ(0u, VBucketOpStats::getBucket(std::chrono::microseconds(0)));
+    EXPECT_EQ(1u, VBucketOpStats::getBucket(std::chrono::microseconds(1)));
+    EXPECT_EQ(3u, VBucketOpStats::getBucket(std::chrono::microseconds(4)));
+    EXPECT_EQ(VBucketOpStats::NumBuckets - 1,
+              VBucketOpStats::getBucket(std::chrono::seconds(100)));
+
+    const auto interval = VBucketOpStats::getSampleInterval();
+    VBucketOpStats::setSampleInterval(1);
+    auto& opStats = this->vbucket->opStats;
+    for (int ii = 0; ii < 10; ++ii) {
+        VBucketOpStats::Timer timer(opStats, VBucketOpStats::Op::Get);
+    }
+    {
+        VBucketOpStats::Timer timer(opStats, VBucketOpStats::Op::Store);
+    }
+    EXPECT_EQ(10u, opStats.getOps(VBucketOpStats::Op::Get));
+    EXPECT_EQ(10u, opStats.getSampled(VBucketOpStats::Op::Get));
+    EXPECT_EQ(1u, opStats.getOps(VBucketOpStats::Op::Store));
+    EXPECT_EQ(0u, opStats.getOps(VBucketOpStats::Op::Delete));
+
+    // With the sampling off the ops are still counted
+    VBucketOpStats::setSampleInterval(0);
+    {
+        VBucketOpStats::Timer timer(opStats, VBucketOpStats::Op::Delete);
+    }
+    EXPECT_EQ(1u, opStats.getOps(VBucketOpStats::Op::Delete));
+    EXPECT_EQ(0u, opStats.getSampled(VBucketOpStats::Op::Delete));
+    VBucketOpStats::setSampleInterval(interval);
+
+    opStats.reset();
+    EXPECT_EQ(0u, opStats.getOps(VBucketOpStats::Op::Get));
+    EXPECT_EQ(0u, opStats.getSampled(VBucketOpStats::Op::Get));
+}
+
 // Check the existence of bloom filter after performing a
 // swap of existing filter with a temporary filter.
 TEST_P(VBucketTest, SwapFilter) {
@@ -264,6 +318,54 @@ TEST_P(VBucketTest, SwapFilter) {
     EXPECT_NE("DOESN'T EXIST", this->vbucket->getFilterStatusString());
 }
 
+// The saved filter has the keys of the hash table (which aren't in the
+// filter), and is only loaded for the seqno it was saved for
+TEST_P(VBucketTest, SaveAndLoadFilter) {
+    const std::string dbname = "vbucket_test_bfilter";
+    cb::io::rmrf(dbname);
+    cb::io::mkdirp(dbname);
+
+    this->vbucket->createFilter(1000, 0.01);
+    auto keys = generateKeys(100);
+    addMany(keys, AddStatus::Success);
+    const auto evicted = makeStoredDocKey("evicted");
+    this->vbucket->addToFilter(evicted);
+    EXPECT_FALSE(this->vbucket->maybeKeyExistsInFilter(keys[0]));
+
+    ASSERT_TRUE(this->vbucket->saveFilter(dbname));
+    this->vbucket->clearFilter();
+
+    const uint64_t seqno = this->vbucket->getPersistenceSeqno();
+    EXPECT_FALSE(this->vbucket->loadFilter(dbname, seqno + 1));
+    EXPECT_EQ("DOESN'T EXIST", this->vbucket->getFilterStatusString());
+
+    ASSERT_TRUE(this->vbucket->loadFilter(dbname, seqno));
+    EXPECT_EQ("ENABLED", this->vbucket->getFilterStatusString());
+    EXPECT_TRUE(this->vbucket->maybeKeyExistsInFilter(evicted));
+    for (const auto& key : keys) {
+        EXPECT_TRUE(this->vbucket->maybeKeyExistsInFilter(key));
+    }
+
+    // We don't replace an existing filter
+    EXPECT_FALSE(this->vbucket->loadFilter(dbname, seqno));
+
+    // Nor load a corrupt one
+    this->vbucket->clearFilter();
+    {
+        std::fstream file(dbname + "/" +
+                                  std::to_string(this->vbucket->getId()) +
+                                  ".bloomfilter",
+                          std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(-1, std::ios::end);
+        const char last = file.get();
+        file.seekp(-1, std::ios::end);
+        file.put(~last);
+    }
+    EXPECT_FALSE(this->vbucket->loadFilter(dbname, seqno));
+    EXPECT_EQ("DOESN'T EXIST", this->vbucket->getFilterStatusString());
+    cb::io::rmrf(dbname);
+}
+
 TEST_P(VBucketTest, Add) {
     const auto eviction_policy = GetParam();
     if (eviction_policy != VALUE_ONLY) {
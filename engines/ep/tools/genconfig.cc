@@ -35,6 +35,7 @@
 using namespace std;
 
 stringstream prototypes;
+stringstream cachedValues;
 stringstream initialization;
 stringstream implementation;
 
@@ -441,10 +442,23 @@ static void generate(cJSON* o, cJSON* params) {
     string validator = getValidator(config_name, o);
     string requirements = getRequirements(config_name, o, params);
 
+    // The numeric and boolean parameters are read from a lock-free copy
+    // (kept up to date by setParameter), the strings from the attributes
+    const bool cached = type.compare("std::string") != 0;
+
     // Generate prototypes
-    prototypes << "    " << type
-               << " " << getGetterPrefix(type)
-               << cppname << "() const;" << endl;
+    if (cached) {
+        prototypes << "    " << type << " " << getGetterPrefix(type)
+                   << cppname << "() const {" << endl
+                   << "        return cached" << cppname << ".load();" << endl
+                   << "    }" << endl;
+        cachedValues << "    std::atomic<" << type << "> cached" << cppname
+                     << "{};" << endl;
+    } else {
+        prototypes << "    " << type
+                   << " " << getGetterPrefix(type)
+                   << cppname << "() const;" << endl;
+    }
     if  (!isReadOnly(o)) {
         prototypes << "    void set" << cppname << "(const " << type
                    << " &nval);" << endl;
@@ -457,6 +471,10 @@ static void generate(cJSON* o, cJSON* params) {
     } else {
         initialization << "(" << type << ")" << defaultVal << ");" << endl;
     }
+    if (cached) {
+        initialization << "    addCachedValue(\"" << config_name
+                       << "\", cached" << cppname << ");" << endl;
+    }
     if (!validator.empty()) {
         initialization << "    setValueValidator(\"" << config_name
                        << "\", " << validator << ");" << endl;
@@ -472,13 +490,15 @@ static void generate(cJSON* o, cJSON* params) {
         }
     }
 
-    // Generate the getter
-    implementation << type << " Configuration::" << getGetterPrefix(type)
-                   << cppname << "() const {" << endl
-                   << "    return "
-                   << "getParameter<" << datatypes[type] << ">(\""
-                   << config_name << "\");" << endl
-                   << "}" << endl;
+    if (!cached) {
+        // Generate the getter
+        implementation << type << " Configuration::" << getGetterPrefix(type)
+                       << cppname << "() const {" << endl
+                       << "    return "
+                       << "getParameter<" << datatypes[type] << ">(\""
+                       << config_name << "\");" << endl
+                       << "}" << endl;
+    }
 
     if  (!isReadOnly(o)) {
         // generate the setter
@@ -531,7 +551,12 @@ int main(int argc, char **argv) {
     for (int ii = 0; ii < num; ++ii) {
         generate(cJSON_GetArrayItem(params, ii), params);
     }
-    prototypes << "#endif  // SRC_GENERATED_CONFIGURATION_H_" << endl;
+    prototypes << endl
+               << "private:" << endl
+               << cachedValues.str()
+               << endl
+               << "public:" << endl
+               << "#endif  // SRC_GENERATED_CONFIGURATION_H_" << endl;
 
     ofstream headerfile("src/generated_configuration.h");
     headerfile << prototypes.str();
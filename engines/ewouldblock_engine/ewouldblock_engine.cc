@@ -242,7 +242,7 @@ public:
                 // The server expects that if EWOULDBLOCK is returned then the
                 // server should be notified in the future when the operation is
                 // ready - so add this op to the pending IO queue.
-                schedule_notification(iter->second.first);
+                schedule_notification(cookie);
             }
         }
 
@@ -983,6 +983,40 @@ private:
 
     static bool isXattrEnabled(ENGINE_HANDLE* handle);
 
+    static ENGINE_ERROR_CODE wait_for_persistence(ENGINE_HANDLE* handle,
+                                                  const void* cookie,
+                                                  uint16_t vbucket,
+                                                  uint64_t seqno);
+
+    static ENGINE_ERROR_CODE arithmetic(ENGINE_HANDLE* handle,
+                                        const void* cookie,
+                                        const DocKey& key,
+                                        uint16_t vbucket,
+                                        bool increment,
+                                        uint64_t delta,
+                                        uint64_t cas,
+                                        uint64_t* result,
+                                        uint64_t* new_cas,
+                                        mutation_descr_t* mut_info);
+
+    static ENGINE_ERROR_CODE append_prepend(ENGINE_HANDLE* handle,
+                                            const void* cookie,
+                                            const DocKey& key,
+                                            uint16_t vbucket,
+                                            bool append,
+                                            cb::const_char_buffer value,
+                                            uint64_t cas,
+                                            uint64_t* new_cas,
+                                            mutation_descr_t* mut_info);
+
+    static ENGINE_ERROR_CODE get_seqno_range(ENGINE_HANDLE* handle,
+                                             const void* cookie,
+                                             uint16_t vbucket,
+                                             uint64_t start,
+                                             uint64_t end,
+                                             size_t max_bytes,
+                                             cb::SeqnoRangeBatch& batch);
+
     // Base class for all fault injection modes.
     struct FaultInjectMode {
         FaultInjectMode(ENGINE_ERROR_CODE injected_error_)
@@ -1288,9 +1322,14 @@ EWB_Engine::EWB_Engine(GET_SERVER_API gsa_)
     ENGINE_HANDLE_V1::remove = remove;
     ENGINE_HANDLE_V1::release = release;
     ENGINE_HANDLE_V1::get = get;
+    // Let the core call get() for every key so that we may inject
+    // errors for each of them
+    ENGINE_HANDLE_V1::get_multi = nullptr;
     ENGINE_HANDLE_V1::get_if = get_if;
     ENGINE_HANDLE_V1::get_locked = get_locked;
     ENGINE_HANDLE_V1::get_meta = get_meta;
+    // As with get_multi, get_meta() is called for every key
+    ENGINE_HANDLE_V1::get_meta_multi = nullptr;
     ENGINE_HANDLE_V1::get_and_touch = get_and_touch;
     ENGINE_HANDLE_V1::unlock = unlock;
     ENGINE_HANDLE_V1::store = store;
@@ -1328,6 +1367,10 @@ EWB_Engine::EWB_Engine(GET_SERVER_API gsa_)
     ENGINE_HANDLE_V1::collections.set_manifest = collections_set_manifest;
 
     ENGINE_HANDLE_V1::isXattrEnabled = isXattrEnabled;
+    ENGINE_HANDLE_V1::wait_for_persistence = wait_for_persistence;
+    ENGINE_HANDLE_V1::arithmetic = arithmetic;
+    ENGINE_HANDLE_V1::append_prepend = append_prepend;
+    ENGINE_HANDLE_V1::get_seqno_range = get_seqno_range;
 
     std::memset(&info, 0, sizeof(info.buffer));
     info.eng_info.description = "EWOULDBLOCK Engine";
@@ -1753,6 +1796,100 @@ bool EWB_Engine::isXattrEnabled(ENGINE_HANDLE* handle) {
     }
 }
 
+ENGINE_ERROR_CODE EWB_Engine::wait_for_persistence(ENGINE_HANDLE* handle,
+                                                   const void* cookie,
+                                                   uint16_t vbucket,
+                                                   uint64_t seqno) {
+    EWB_Engine* ewb = to_engine(handle);
+    if (ewb->real_engine->wait_for_persistence == nullptr) {
+        return ENGINE_ENOTSUP;
+    }
+    return ewb->real_engine->wait_for_persistence(
+            ewb->real_handle, cookie, vbucket, seqno);
+}
+
+ENGINE_ERROR_CODE EWB_Engine::arithmetic(ENGINE_HANDLE* handle,
+                                         const void* cookie,
+                                         const DocKey& key,
+                                         uint16_t vbucket,
+                                         bool increment,
+                                         uint64_t delta,
+                                         uint64_t cas,
+                                         uint64_t* result,
+                                         uint64_t* new_cas,
+                                         mutation_descr_t* mut_info) {
+    EWB_Engine* ewb = to_engine(handle);
+    if (ewb->real_engine->arithmetic == nullptr) {
+        return ENGINE_ENOTSUP;
+    }
+    ENGINE_ERROR_CODE err = ENGINE_SUCCESS;
+    if (ewb->should_inject_error(Cmd::ARITHMETIC, cookie, err)) {
+        return err;
+    }
+    return ewb->real_engine->arithmetic(ewb->real_handle,
+                                        cookie,
+                                        key,
+                                        vbucket,
+                                        increment,
+                                        delta,
+                                        cas,
+                                        result,
+                                        new_cas,
+                                        mut_info);
+}
+
+ENGINE_ERROR_CODE EWB_Engine::append_prepend(ENGINE_HANDLE* handle,
+                                             const void* cookie,
+                                             const DocKey& key,
+                                             uint16_t vbucket,
+                                             bool append,
+                                             cb::const_char_buffer value,
+                                             uint64_t cas,
+                                             uint64_t* new_cas,
+                                             mutation_descr_t* mut_info) {
+    EWB_Engine* ewb = to_engine(handle);
+    if (ewb->real_engine->append_prepend == nullptr) {
+        return ENGINE_ENOTSUP;
+    }
+    ENGINE_ERROR_CODE err = ENGINE_SUCCESS;
+    if (ewb->should_inject_error(Cmd::CAS, cookie, err)) {
+        return err;
+    }
+    return ewb->real_engine->append_prepend(ewb->real_handle,
+                                            cookie,
+                                            key,
+                                            vbucket,
+                                            append,
+                                            value,
+                                            cas,
+                                            new_cas,
+                                            mut_info);
+}
+
+ENGINE_ERROR_CODE EWB_Engine::get_seqno_range(ENGINE_HANDLE* handle,
+                                              const void* cookie,
+                                              uint16_t vbucket,
+                                              uint64_t start,
+                                              uint64_t end,
+                                              size_t max_bytes,
+                                              cb::SeqnoRangeBatch& batch) {
+    EWB_Engine* ewb = to_engine(handle);
+    if (ewb->real_engine->get_seqno_range == nullptr) {
+        return ENGINE_ENOTSUP;
+    }
+    ENGINE_ERROR_CODE err = ENGINE_SUCCESS;
+    if (ewb->should_inject_error(Cmd::GET, cookie, err)) {
+        return err;
+    }
+    return ewb->real_engine->get_seqno_range(ewb->real_handle,
+                                             cookie,
+                                             vbucket,
+                                             start,
+                                             end,
+                                             max_bytes,
+                                             batch);
+}
+
 ENGINE_ERROR_CODE create_instance(uint64_t interface,
                                   GET_SERVER_API gsa,
                                   ENGINE_HANDLE **handle)
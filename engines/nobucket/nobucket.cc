@@ -43,6 +43,8 @@ public:
         ENGINE_HANDLE_V1::remove = item_delete;
         ENGINE_HANDLE_V1::release = item_release;
         ENGINE_HANDLE_V1::get = get;
+        ENGINE_HANDLE_V1::get_multi = nullptr;
+        ENGINE_HANDLE_V1::get_meta_multi = nullptr;
         ENGINE_HANDLE_V1::get_if = get_if;
         ENGINE_HANDLE_V1::get_and_touch = get_and_touch;
         ENGINE_HANDLE_V1::get_locked = get_locked;
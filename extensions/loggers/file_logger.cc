@@ -13,7 +13,10 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <time.h>
+#include <algorithm>
+#include <cinttypes>
 #include <iostream>
+#include <vector>
 
 #ifdef WIN32
 #include <io.h>
@@ -35,6 +38,7 @@
 
 #include "extensions/protocol_extension.h"
 #include "file_logger_utilities.h"
+#include "log_ring.h"
 
 /* Pointer to the server API */
 static SERVER_HANDLE_V1 *sapi;
@@ -57,48 +61,69 @@ static const EXTENSION_LOG_LEVEL stderr_output_level = EXTENSION_LOG_WARNING;
 static size_t cyclesz = 100 * 1024 * 1024;
 
 /*
- * We're using two buffers for logging. We'll be inserting data into one,
- * while we're working on writing the other one to disk. Given that the disk
- * is way slower than our CPU, we might end up in a situation that we'll be
- * blocking the frontend threads if you're logging too much.
+ * Each thread logs into a ring buffer of its own (see LogRing), so that
+ * logging never blocks the frontend threads: a message which doesn't fit
+ * in the ring is dropped (and counted) instead. Only the text of the
+ * message is formatted by the thread logging it; the logger thread
+ * formats the timestamp and severity of the messages it drains from the
+ * rings, and writes them to the file through the following buffer.
  */
 static struct logbuffer {
     /* Pointer to beginning of the datasegment of this buffer */
     char *data;
     /* The current offset of the buffer */
     size_t offset;
-} buffers[2];
-
-/* The index in the buffers where we're currently inserting more data */
-static int currbuffer = 0;
+} filebuffer;
 
 /* Are we running in a unit test (don't print warnings to stderr) */
 static bool unit_test = false;
 
-/* The size of the buffers (this may be tuned by the buffersize configuration
+/* The size of the buffer (this may be tuned by the buffersize configuration
  * parameter */
 static size_t buffersz = 2048 * 1024;
 
+/* The size of the ring of each thread (this may be tuned by the ringsize
+ * configuration parameter */
+static size_t ringsz = 256 * 1024;
+
 /* The sleeptime between each forced flush of the buffer */
 static size_t sleeptime = 60;
 
-/* To avoid race condition we're protecting our shared resources with a
- * single mutex. */
+/* The logger thread sleeps on the following condition variable (protected
+ * by the mutex) between the flushes. A thread notifies it when its ring
+ * is > 75% full.
+ */
 static cb_mutex_t mutex;
+static cb_cond_t cond;
+
+/* Where the messages of a ring should go */
+static const uint8_t to_file = 0x1;
+static const uint8_t to_stderr = 0x2;
 
-/* The thread performing the disk IO will be waiting for the input buffers
- * to be filled by sleeping on the following condition variable. The
- * frontend threads will notify the condition variable when the buffer is
- * > 75% full
+/* The rings of all the threads. The lock is only taken by a thread the
+ * first time it logs a message, and by the logger thread to find the
+ * rings to drain
  */
-static cb_cond_t cond;
+static std::mutex rings_mutex;
+static std::vector<std::shared_ptr<LogRing>> rings;
 
-/* In the "worst case scenarios" we're logging so much that the disk thread
- * can't keep up with the the frontend threads. In these rare situations
- * the frontend threads will block and wait for the flusher to free up log
- * space
+/* Bumped every time the logger is initialized, so that the threads
+ * register a new ring (memcached_logger_test initializes it for each
+ * test)
  */
-static cb_cond_t space_cond;
+static std::atomic<int> generation{0};
+
+/* The ring of the current thread */
+static thread_local struct ThreadRing {
+    ~ThreadRing() {
+        if (ring) {
+            ring->orphaned = true;
+        }
+    }
+
+    std::shared_ptr<LogRing> ring;
+    int generation = -1;
+} thread_ring;
 
 static char hostname[256];
 static pid_t pid;
@@ -109,6 +134,7 @@ std::mutex stderr_mutex;
 /* To avoid the logs beeing flooded by the same log messages we try to
  * de-duplicate the messages and instead print out:
  *   "message repeated xxx times"
+ * (only accessed by the logger thread)
  */
 static struct {
     /* The last message being added to the log */
@@ -125,29 +151,22 @@ static struct {
     time_t created;
 } lastlog;
 
+static void flush_buffer(void);
+
 static void do_add_log_entry(const char *msg, size_t size) {
-    /* wait until there is room in the current buffer */
-    while ((buffers[currbuffer].offset + size) >= buffersz) {
-        if (!unit_test) {
-            fprintf(stderr, "WARNING: waiting for log space to be available\n");
+    if ((filebuffer.offset + size) >= buffersz) {
+        flush_buffer();
+        if (size >= buffersz) {
+            // Doesn't fit anyway
+            return;
         }
-        cb_cond_wait(&space_cond, &mutex);
     }
 
-    /* We could have performed the memcpy outside the locked region,
-     * but then we would need to handle the situation where we're
-     * flipping the ownership of the buffer (otherwise we could be
-     * writing rubbish to the file) */
-    memcpy(buffers[currbuffer].data + buffers[currbuffer].offset,
-           msg, size);
-    buffers[currbuffer].offset += size;
-    if (buffers[currbuffer].offset > (buffersz * 0.75)) {
-        /* we're getting full.. time get the logger to start doing stuff! */
-        cb_cond_signal(&cond);
-    }
+    memcpy(filebuffer.data + filebuffer.offset, msg, size);
+    filebuffer.offset += size;
 }
 
-static void flush_last_log(bool timebased) {
+static void flush_last_log(void) {
     if (lastlog.count > 1) {
         ISOTime::ISO8601String timestamp;
         ISOTime::generatetimestamp(timestamp);
@@ -162,12 +181,6 @@ static void flush_last_log(bool timebased) {
             return;
         }
 
-        // Only try to flush if there is enough free space, otherwise
-        // we'll be causing a deadlock
-        if (timebased && ((buffers[currbuffer].offset + offset) >= buffersz)) {
-            return ;
-        }
-
         do_add_log_entry(buffer, offset);
         lastlog.buffer[0] = '\0';
         lastlog.count = 0;
@@ -178,24 +191,20 @@ static void flush_last_log(bool timebased) {
 
 static void add_log_entry(time_t now, const char *msg, int prefixlen, size_t size)
 {
-    cb_mutex_enter(&mutex);
-
     if (size < sizeof(lastlog.buffer)) {
         if (memcmp(lastlog.buffer + lastlog.offset, msg + prefixlen, size-prefixlen) == 0) {
             ++lastlog.count;
         } else {
-            flush_last_log(false);
+            flush_last_log();
             do_add_log_entry(msg, size);
             memcpy(lastlog.buffer, msg, size);
             lastlog.offset = prefixlen;
             lastlog.created = now;
         }
     } else {
-        flush_last_log(false);
+        flush_last_log();
         do_add_log_entry(msg, size);
     }
-
-    cb_mutex_exit(&mutex);
 }
 
 static const char *severity2string(EXTENSION_LOG_LEVEL sev) {
@@ -253,6 +262,34 @@ static int format_log_entry(char* buffer, size_t buf_len, time_t time,
     return prefix_len;
 }
 
+/* Add a message to the ring of the calling thread (which never blocks) */
+static void add_to_ring(const LogRing::Header& hdr, const char* msg) {
+    auto& ring = thread_ring.ring;
+    if (thread_ring.generation != generation.load()) {
+        if (ring) {
+            ring->orphaned = true;
+        }
+        try {
+            ring = std::make_shared<LogRing>(ringsz);
+        } catch (const std::bad_alloc&) {
+            ring.reset();
+            return;
+        }
+        thread_ring.generation = generation.load();
+        std::lock_guard<std::mutex> guard(rings_mutex);
+        rings.push_back(ring);
+    }
+
+    ring->push(hdr, msg);
+    if (ring->used() > (ring->getCapacity() * 0.75) &&
+        !ring->notified.exchange(true)) {
+        /* we're getting full.. time get the logger to start doing stuff! */
+        cb_mutex_enter(&mutex);
+        cb_cond_signal(&cond);
+        cb_mutex_exit(&mutex);
+    }
+}
+
 /* Takes the syslog compliant event and calls the native logging functionality */
 static void syslog_event_receiver(SyslogEvent *event) {
     uint8_t syslog_severity = event->prival & 7; /* Mask out all but 3 least-significant bits */
@@ -278,22 +315,36 @@ static void syslog_event_receiver(SyslogEvent *event) {
         fprintf(stderr, "ERROR: Unknown syslog_severity\n");
     }
 
-    char buffer[2048];
-    const int prefixlen = format_log_entry(buffer, sizeof(buffer),
-                                           event->time, event->time_secfrac,
-                                           severity, event->msg);
-
-    if (severity >= current_log_level || severity >= stderr_output_level) {
-        if (severity >= stderr_output_level) {
-            std::lock_guard<std::mutex> guard(stderr_mutex);
-            std::cerr << buffer;
-            std::cerr.flush();
-        }
-
-        if (severity >= current_log_level) {
-            add_log_entry(event->time, buffer, prefixlen, strlen(buffer));
-        }
+    uint8_t flags = 0;
+    if (severity >= current_log_level) {
+        flags |= to_file;
+    }
+    if (severity >= stderr_output_level) {
+        flags |= to_stderr;
+    }
+    if (flags == 0) {
+        return;
     }
+
+    if (severity == EXTENSION_LOG_FATAL) {
+        // We may be about to crash, so don't leave it to the logger thread
+        // to get it out to the babysitter
+        char buffer[2048];
+        format_log_entry(buffer, sizeof(buffer), event->time,
+                         event->time_secfrac, severity, event->msg);
+        std::lock_guard<std::mutex> guard(stderr_mutex);
+        std::cerr << buffer;
+        std::cerr.flush();
+        flags &= ~to_stderr;
+    }
+
+    LogRing::Header hdr{};
+    hdr.size = uint32_t(strlen(event->msg));
+    hdr.severity = uint8_t(severity);
+    hdr.flags = flags;
+    hdr.usec = event->time_secfrac;
+    hdr.sec = int64_t(event->time);
+    add_to_ring(hdr, event->msg);
 }
 
 
@@ -499,100 +550,178 @@ static size_t flush_pending_io(FILE *file, struct logbuffer *lb) {
     return ret;
 }
 
-static void flush_all_buffers_to_file(FILE *file) {
-    while (buffers[currbuffer].offset) {
-        int curr  = currbuffer;
-        currbuffer = (currbuffer == 0) ? 1 : 0;
-        flush_pending_io(file, buffers + curr);
-    }
-}
-
 static volatile int run = 1;
 static cb_thread_t tid;
 static FILE *fp;
 
+/* The name of the log files (everything before the nnn.txt) */
+static const char *logfile_name;
+
+/* The number of bytes written to the current log file */
+static size_t currsize;
+
+/* Write the buffer to the log file (rotating it if needed) */
+static void flush_buffer(void) {
+    /* In case we failed to open the log file last time (e.g. EMFILE),
+       re-attempt now. */
+    if (fp == NULL) {
+        fp = open_logfile(logfile_name);
+        if (fp != NULL) {
+            // Record that the log is back online.
+            struct timeval now;
+            cb_get_timeofday(&now);
+            char log_entry[1024];
+            format_log_entry(log_entry, sizeof(log_entry),
+                             now.tv_sec, now.tv_usec,
+                             EXTENSION_LOG_NOTICE,
+                             "Restarting file logging\n");
+
+            fwrite(log_entry, 1, strlen(log_entry), fp);
+            // Send to stderr for good measure.
+            std::lock_guard<std::mutex> guard(stderr_mutex);
+            std::cerr << log_entry;
+        }
+    }
+
+    currsize += flush_pending_io(fp, &filebuffer);
+    if (currsize > cyclesz) {
+        fp = rotate_logfile(fp, logfile_name);
+        currsize = 0;
+    }
+}
+
+struct PendingEntry {
+    LogRing::Header hdr;
+    std::string msg;
+};
+
+/* Drain the rings of all the threads, and add their messages to the buffer
+ * (in the order they were logged). If block is false we don't wait for
+ * the lock of the rings (we may be crashing).
+ */
+static void drain_rings(bool block) {
+    std::vector<std::shared_ptr<LogRing>> current;
+    {
+        std::unique_lock<std::mutex> guard(rings_mutex, std::defer_lock);
+        if (block) {
+            guard.lock();
+        } else if (!guard.try_lock()) {
+            return;
+        }
+
+        // Forget about the rings of the threads which went away, once
+        // they're drained (no-one adds to them anymore)
+        rings.erase(std::remove_if(rings.begin(), rings.end(),
+                                   [](const std::shared_ptr<LogRing>& ring) {
+                                       return ring->orphaned && ring->empty();
+                                   }),
+                    rings.end());
+        current = rings;
+    }
+
+    std::vector<PendingEntry> entries;
+    uint64_t dropped = 0;
+    for (auto& ring : current) {
+        ring->drain([&entries](const LogRing::Header& hdr, const char* msg) {
+            entries.push_back({hdr, std::string(msg, hdr.size)});
+        });
+        ring->notified = false;
+        dropped += ring->takeDropped();
+    }
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const PendingEntry& a, const PendingEntry& b) {
+                         return a.hdr.sec < b.hdr.sec ||
+                                (a.hdr.sec == b.hdr.sec &&
+                                 a.hdr.usec < b.hdr.usec);
+                     });
+
+    char log_entry[2048];
+    for (const auto& entry : entries) {
+        const auto severity = EXTENSION_LOG_LEVEL(entry.hdr.severity);
+        const int prefixlen = format_log_entry(log_entry, sizeof(log_entry),
+                                               time_t(entry.hdr.sec),
+                                               entry.hdr.usec, severity,
+                                               entry.msg.c_str());
+        if (entry.hdr.flags & to_stderr) {
+            std::lock_guard<std::mutex> guard(stderr_mutex);
+            std::cerr << log_entry;
+            std::cerr.flush();
+        }
+        if (entry.hdr.flags & to_file) {
+            add_log_entry(time_t(entry.hdr.sec), log_entry, prefixlen,
+                          strlen(log_entry));
+        }
+    }
+
+    if (dropped > 0) {
+        struct timeval now;
+        cb_get_timeofday(&now);
+        char msg[128];
+        snprintf(msg, sizeof(msg),
+                 "Dropped %" PRIu64 " log messages as the log buffers were "
+                 "full\n", dropped);
+        format_log_entry(log_entry, sizeof(log_entry), now.tv_sec,
+                         now.tv_usec, EXTENSION_LOG_WARNING, msg);
+        flush_last_log();
+        do_add_log_entry(log_entry, strlen(log_entry));
+        if (!unit_test) {
+            std::lock_guard<std::mutex> guard(stderr_mutex);
+            std::cerr << log_entry;
+        }
+    }
+}
+
 static void logger_thread_main(void* arg)
 {
-    size_t currsize = 0;
+    logfile_name = reinterpret_cast<const char*>(arg);
+    currsize = 0;
 
     struct timeval tp;
-    cb_get_timeofday(&tp);
-    time_t next = (time_t)tp.tv_sec;
 
     cb_mutex_enter(&mutex);
     while (run) {
-        cb_get_timeofday(&tp);
-
-        while ((time_t)tp.tv_sec >= next  ||
-               buffers[currbuffer].offset > (buffersz * 0.75)) {
-            int curr  = currbuffer;
-            next = (time_t)tp.tv_sec + 1;
-            currbuffer = (currbuffer == 0) ? 1 : 0;
-            /* Let people who is blocked for space continue */
-            cb_cond_broadcast(&space_cond);
-
-            /* Perform file IO without the lock */
-            cb_mutex_exit(&mutex);
-
-            /* In case we failed to open the log file last time (e.g. EMFILE),
-               re-attempt now. */
-            if (fp == NULL) {
-                fp = open_logfile(reinterpret_cast<const char*>(arg));
-                if (fp != NULL) {
-                    // Record that the log is back online.
-                    struct timeval now;
-                    cb_get_timeofday(&now);
-                    char log_entry[1024];
-                    format_log_entry(log_entry, sizeof(log_entry),
-                                     now.tv_sec, now.tv_usec,
-                                     EXTENSION_LOG_NOTICE,
-                                     "Restarting file logging\n");
-
-                    fwrite(log_entry, 1, strlen(log_entry), fp);
-                    // Send to stderr for good measure.
-                    std::lock_guard<std::mutex> guard(stderr_mutex);
-                    std::cerr << log_entry;
-                }
-            }
-
-            currsize += flush_pending_io(fp, buffers + curr);
-            if (currsize > cyclesz) {
-                fp = rotate_logfile(fp, reinterpret_cast<const char*>(arg));
-                currsize = 0;
-            }
-            cb_mutex_enter(&mutex);
-        }
+        /* Perform the formatting and file IO without the lock */
+        cb_mutex_exit(&mutex);
+        drain_rings(true);
+        flush_buffer();
 
         // Only run dedupe for ~5 seconds
+        cb_get_timeofday(&tp);
         if (lastlog.count > 0 && (lastlog.created + 4 < tp.tv_sec)) {
-            flush_last_log(true);
+            flush_last_log();
         }
+        cb_mutex_enter(&mutex);
 
-        cb_get_timeofday(&tp);
-        next = (time_t)tp.tv_sec + (time_t)sleeptime;
-
+        if (!run) {
+            break;
+        }
         if (unit_test) {
             cb_cond_timedwait(&cond, &mutex, 100);
         } else {
             cb_cond_timedwait(&cond, &mutex, (unsigned int)(1000 * sleeptime));
         }
     }
+    cb_mutex_exit(&mutex);
+
+    drain_rings(true);
+    flush_last_log();
 
     /* The log file might not be open, however we may have
      * an event in the buffer that needs flushing to a file.
      */
-    if (buffers[currbuffer].offset != 0 && !fp) {
-        fp = open_logfile(reinterpret_cast<const char*>(arg));
+    if (filebuffer.offset != 0 && !fp) {
+        fp = open_logfile(logfile_name);
     }
     if (fp) {
-        flush_all_buffers_to_file(fp);
+        flush_pending_io(fp, &filebuffer);
         close_logfile(fp);
+        fp = NULL;
     }
 
-    cb_mutex_exit(&mutex);
     cb_free(arg);
-    cb_free(buffers[0].data);
-    cb_free(buffers[1].data);
+    cb_free(filebuffer.data);
+    filebuffer.data = NULL;
 }
 
 static void exit_handler(void) {
@@ -629,7 +758,8 @@ static void logger_shutdown(bool force) {
         // Don't bother attempting to take any mutexes - other threads may
         // never run again. Just flush the buffers asap.
         if (fp) {
-            flush_all_buffers_to_file(fp);
+            drain_rings(false);
+            flush_pending_io(fp, &filebuffer);
             close_logfile(fp);
             fp = NULL;
         }
@@ -638,7 +768,6 @@ static void logger_shutdown(bool force) {
 
     int running;
     cb_mutex_enter(&mutex);
-    flush_last_log(false);
     running = run;
     run = 0;
     cb_cond_signal(&cond);
@@ -663,12 +792,16 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
     lastlog.count = 0;
     lastlog.offset = 0;
     lastlog.created = 0;
+    ++generation;
+    {
+        std::lock_guard<std::mutex> guard(rings_mutex);
+        rings.clear();
+    }
 
     char *fname = NULL;
 
     cb_mutex_initialize(&mutex);
     cb_cond_initialize(&cond);
-    cb_cond_initialize(&space_cond);
 
     descriptor.get_name = get_name;
     descriptor.log = logger_log_wrapper;
@@ -692,7 +825,7 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
     }
 
     if (config != NULL) {
-        struct config_item items[6];
+        struct config_item items[7];
         int ii = 0;
         memset(&items, 0, sizeof(items));
 
@@ -706,6 +839,11 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
         items[ii].value.dt_size = &buffersz;
         ++ii;
 
+        items[ii].key = "ringsize";
+        items[ii].datatype = DT_SIZE;
+        items[ii].value.dt_size = &ringsz;
+        ++ii;
+
         items[ii].key = "cyclesize";
         items[ii].datatype = DT_SIZE;
         items[ii].value.dt_size = &cyclesz;
@@ -723,7 +861,7 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
 
         items[ii].key = NULL;
         ++ii;
-        cb_assert(ii == 6);
+        cb_assert(ii == 7);
 
         if (sapi->core->parse_config(config, items, stderr) != ENGINE_SUCCESS) {
             return EXTENSION_FATAL;
@@ -739,21 +877,25 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
     }
 
     if (getenv("CB_MAXIMIZE_LOGGER_BUFFER_SIZE") != nullptr) {
-        buffersz = 8 * 1024 * 1024; // use two 8MB log buffers
+        buffersz = 8 * 1024 * 1024; // use an 8MB log buffer
+        ringsz = 1024 * 1024;
+    }
+
+    if (ringsz < LogRing::minimumCapacity) {
+        ringsz = LogRing::minimumCapacity;
     }
 
     if (fname == NULL) {
         fname = cb_strdup("memcached");
     }
 
-    buffers[0].data = reinterpret_cast<char*>(cb_malloc(buffersz));
-    buffers[1].data = reinterpret_cast<char*>(cb_malloc(buffersz));
+    filebuffer.data = reinterpret_cast<char*>(cb_malloc(buffersz));
+    filebuffer.offset = 0;
 
-    if (buffers[0].data == NULL || buffers[1].data == NULL || fname == NULL) {
+    if (filebuffer.data == NULL || fname == NULL) {
         std::cerr << "Failed to allocate memory for the logger" << std::endl;
         cb_free(fname);
-        cb_free(buffers[0].data);
-        cb_free(buffers[1].data);
+        cb_free(filebuffer.data);
         return EXTENSION_FATAL;
     }
 
@@ -764,8 +906,7 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
         std::cerr << "Failed to create the logger backend thread: "
                   << cb_strerror() << std::endl;
         cb_free(fname);
-        cb_free(buffers[0].data);
-        cb_free(buffers[1].data);
+        cb_free(filebuffer.data);
         return EXTENSION_FATAL;
     }
 
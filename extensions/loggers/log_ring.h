@@ -0,0 +1,175 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+/**
+ * A ring buffer of log entries with a single producer (the thread which
+ * owns it) and a single consumer (the thread of the file logger), which
+ * neither of them ever blocks on.
+ *
+ * The entries are stored back to back (each one is a Header followed by
+ * the message, padded to a multiple of 8 bytes). An entry is never split
+ * over the end of the ring; the producer skips to the beginning instead
+ * (marking the skipped part with a Header of size wrapMarker if it fits).
+ * An entry which doesn't fit in the free space is dropped and counted.
+ */
+class LogRing {
+public:
+    struct Header {
+        /// The size of the message following the header
+        uint32_t size;
+        /// The severity (EXTENSION_LOG_LEVEL) of the message
+        uint8_t severity;
+        /// Where the message should go (see the flags of file_logger.cc)
+        uint8_t flags;
+        uint16_t padding;
+        /// The microseconds part of the time the message was logged
+        uint32_t usec;
+        /// The time the message was logged
+        int64_t sec;
+    };
+
+    static const size_t minimumCapacity = 4096;
+
+    /**
+     * @param size the capacity of the ring (rounded down to a multiple
+     *             of 8 bytes)
+     * @throws std::invalid_argument if it is smaller than minimumCapacity
+     */
+    explicit LogRing(size_t size) : capacity(size & ~size_t(7)) {
+        if (capacity < minimumCapacity) {
+            throw std::invalid_argument("LogRing: the capacity must be at "
+                                        "least 4096 bytes");
+        }
+        data.reset(new char[capacity]);
+    }
+
+    /**
+     * Add an entry to the ring
+     *
+     * @return false if it was dropped as there isn't room for it
+     */
+    bool push(const Header& hdr, const char* msg) {
+        const size_t len = entrySize(hdr.size);
+        size_t h = head.load(std::memory_order_relaxed);
+        const size_t t = tail.load(std::memory_order_acquire);
+
+        size_t offset = h % capacity;
+        const size_t pad = (capacity - offset < len) ? capacity - offset : 0;
+        if (capacity - (h - t) < pad + len) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (pad != 0) {
+            if (pad >= sizeof(Header)) {
+                Header marker{};
+                marker.size = wrapMarker;
+                memcpy(data.get() + offset, &marker, sizeof(marker));
+            }
+            h += pad;
+            offset = 0;
+        }
+
+        Header entry = hdr;
+        memcpy(data.get() + offset, &entry, sizeof(entry));
+        memcpy(data.get() + offset + sizeof(entry), msg, hdr.size);
+        head.store(h + len, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Hand all the entries added so far to the callback (in the order
+     * they were added), and free up the space they used. The message
+     * handed to the callback is only valid during the call.
+     *
+     * Should only be called by the consumer.
+     */
+    template <typename Callback>
+    void drain(Callback callback) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        const size_t h = head.load(std::memory_order_acquire);
+        while (t != h) {
+            const size_t offset = t % capacity;
+            if (capacity - offset < sizeof(Header)) {
+                t += capacity - offset;
+                continue;
+            }
+            Header hdr;
+            memcpy(&hdr, data.get() + offset, sizeof(hdr));
+            if (hdr.size == wrapMarker) {
+                t += capacity - offset;
+                continue;
+            }
+            callback(hdr, data.get() + offset + sizeof(hdr));
+            t += entrySize(hdr.size);
+        }
+        tail.store(t, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) ==
+               tail.load(std::memory_order_acquire);
+    }
+
+    /// The bytes in use
+    size_t used() const {
+        return head.load(std::memory_order_acquire) -
+               tail.load(std::memory_order_acquire);
+    }
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    /// Get the number of entries dropped since the last call
+    uint64_t takeDropped() {
+        return dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    /// Set by the producer when it goes away, so that the consumer may
+    /// free the ring once it is drained
+    std::atomic<bool> orphaned{false};
+
+    /// Set by the producer when it asks the consumer to drain the ring
+    /// (and cleared by the consumer), to only do that once
+    std::atomic<bool> notified{false};
+
+private:
+    static const uint32_t wrapMarker = UINT32_MAX;
+
+    static size_t entrySize(size_t msglen) {
+        return (sizeof(Header) + msglen + 7) & ~size_t(7);
+    }
+
+    const size_t capacity;
+    std::unique_ptr<char[]> data;
+
+    /// The position (in bytes since the ring was created) the producer
+    /// adds the next entry at, and the one the consumer reads the next
+    /// entry from
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+
+    std::atomic<uint64_t> dropped{0};
+};
@@ -54,7 +54,30 @@ enum class Feature : uint16_t {
      * of commands (@todo this should "disable" select bucket as that won't
      * give the user deterministic behavior)
      */
-    UnorderedExecution = 0x0e
+    UnorderedExecution = 0x0e,
+    /**
+     * Ask the server to report the time it spent on each request in the
+     * framing extras of the response (see Magic::AltClientResponse)
+     */
+    Tracing = 0x0f,
+    /**
+     * Allow the mutations to carry a durability requirement in their
+     * extras (see cb::mcbp::DurabilityLevel), so that the server holds
+     * back the response until the requirement is met.
+     */
+    Durability = 0x10
+};
+
+/**
+ * The durability requirement a mutation may carry (as an extra byte
+ * following the flags and the expiry time) once the client enabled
+ * Feature::Durability.
+ */
+enum class DurabilityLevel : uint8_t {
+    /// Respond as soon as the mutation is stored in memory
+    None = 0,
+    /// Respond once the mutation is persisted on the active vbucket
+    PersistToActive = 1
 };
 
 } // namespace mcbp
@@ -33,7 +33,14 @@ enum class Magic : uint8_t {
     /// Request packet from server to client
     ServerRequest = 0x82,
     /// Response packet from client to server
-    ServerResponse = 0x83
+    ServerResponse = 0x83,
+    /**
+     * Response packet from server to client with framing extras. The
+     * 16 bit key length field is split into an 8 bit framing extras
+     * length followed by an 8 bit key length, and the framing extras
+     * are located right after the header (before the extras)
+     */
+    AltClientResponse = 0x18
 };
 
 /**
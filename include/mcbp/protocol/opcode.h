@@ -78,6 +78,9 @@ enum class ClientOpcode : uint8_t {
     /* Shutdown the server */
     Shutdown = 0x29,
 
+    /* Get multiple documents in one request */
+    GetMulti = 0x2a,
+
     /* These commands are used for range operations and exist within
      * this header for use in other projects.  Range operations are
      * not expected to be implemented in the memcached server itself.
@@ -239,6 +242,21 @@ enum class ClientOpcode : uint8_t {
      */
     CollectionsSetManifest = 0xb9,
 
+    /**
+     * Command to get the documents of a range of keys
+     */
+    RangeScan = 0xba,
+
+    /**
+     * Command to apply a batch of set/add/del_with_meta to a vbucket
+     */
+    WithMetaBatch = 0xbb,
+
+    /**
+     * Command to get the metadata of multiple documents in one request
+     */
+    GetMetaMulti = 0xbc,
+
     /**
      * Commands for GO-XDCR
      */
@@ -351,6 +369,20 @@ enum class ServerOpcode {
      *   value is the actual cluster map
      */
     ClustermapChangeNotification = 0x01,
+
+    /**
+     * The client may subscribe to the timings of some of the commands
+     * with ioctl_set of "timings.subscribe" (which requires duplex). The
+     * server will then send a TimingsNotification message per bucket
+     * every interval, with the histograms of the samples recorded since
+     * the previous message.
+     *
+     * The packet format is still volatile, but:
+     *   key is the bucket name ("/all/" for the aggregated timings)
+     *   value is a JSON object with the "interval" (in seconds) and the
+     *   "timings" of each opcode (in the same format as GET_CMD_TIMER)
+     */
+    TimingsNotification = 0x02,
 };
 
 } // namespace mcbp
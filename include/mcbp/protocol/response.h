@@ -47,7 +47,8 @@ struct Response {
     // the correct byteorder)
 
     void setMagic(Magic magic) {
-        if (magic == Magic::ClientResponse || magic == Magic::ServerResponse) {
+        if (magic == Magic::ClientResponse || magic == Magic::ServerResponse ||
+            magic == Magic::AltClientResponse) {
             Response::magic = uint8_t(magic);
         } else {
             throw std::invalid_argument(
@@ -66,7 +67,8 @@ struct Response {
     }
 
     ClientOpcode getClientOpcode() const {
-        if (getMagic() != Magic::ClientResponse) {
+        if (getMagic() != Magic::ClientResponse &&
+            getMagic() != Magic::AltClientResponse) {
             throw std::logic_error("getClientOpcode: magic != client response");
         }
         return ClientOpcode(opcode);
@@ -85,6 +87,9 @@ struct Response {
     }
 
     uint16_t getKeylen() const {
+        if (getMagic() == Magic::AltClientResponse) {
+            return reinterpret_cast<const uint8_t*>(&keylen)[1];
+        }
         return ntohs(keylen);
     }
 
@@ -92,6 +97,14 @@ struct Response {
         keylen = htons(value);
     }
 
+    /// The length of the framing extras (only used by AltClientResponse)
+    uint8_t getFramingExtraslen() const {
+        if (getMagic() == Magic::AltClientResponse) {
+            return reinterpret_cast<const uint8_t*>(&keylen)[0];
+        }
+        return 0;
+    }
+
     uint8_t getExtlen() const {
         return extlen;
     }
@@ -140,31 +153,41 @@ struct Response {
         cas = htonll(val);
     }
 
+    cb::const_byte_buffer getFramingExtras() const {
+        return {reinterpret_cast<const uint8_t*>(this) + sizeof(*this),
+                getFramingExtraslen()};
+    }
+
     cb::const_byte_buffer getKey() const {
-        return {reinterpret_cast<const uint8_t*>(this) + sizeof(*this) + extlen,
-                getKeylen()};
+        const auto buf = getExtdata();
+        return {buf.data() + buf.size(), getKeylen()};
     }
 
     cb::const_byte_buffer getExtdata() const {
-        return {reinterpret_cast<const uint8_t*>(this) + sizeof(*this), extlen};
+        const auto buf = getFramingExtras();
+        return {buf.data() + buf.size(), extlen};
     }
 
     cb::const_byte_buffer getValue() const {
         const auto buf = getKey();
-        return {buf.data() + buf.size(), getBodylen() - getKeylen() - extlen};
+        return {buf.data() + buf.size(),
+                getBodylen() - getFramingExtraslen() - getKeylen() - extlen};
     }
 
     /**
-     * Validate that the header is "sane" (correct magic, and extlen+keylen
-     * doesn't exceed the body size)
+     * Validate that the header is "sane" (correct magic, and framing
+     * extras+extlen+keylen doesn't exceed the body size)
      */
     bool validate() {
         auto m = Magic(magic);
-        if (m != Magic::ClientResponse && m != Magic::ServerResponse) {
+        if (m != Magic::ClientResponse && m != Magic::ServerResponse &&
+            m != Magic::AltClientResponse) {
             return false;
         }
 
-        return (size_t(extlen) + size_t(getKeylen()) <= size_t(getBodylen()));
+        return (size_t(getFramingExtraslen()) + size_t(extlen) +
+                        size_t(getKeylen()) <=
+                size_t(getBodylen()));
     }
 };
 
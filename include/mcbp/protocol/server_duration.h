@@ -0,0 +1,76 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/sized_buffer.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace cb {
+namespace mcbp {
+
+/**
+ * The framing extras of a response (see Magic::AltClientResponse) is a
+ * sequence of frame info objects. Each object starts with a byte where
+ * the upper 4 bits is the id of the object and the lower 4 bits is the
+ * length of the data following the byte.
+ */
+enum class ResponseFrameInfoId : uint8_t {
+    /// The time the server spent on the request (2 bytes, see below)
+    ServerDuration = 0x00
+};
+
+/// The size of the server duration frame info object (including the id)
+const size_t ServerDurationFrameSize = 3;
+
+/**
+ * Encode the time the server spent on a request to the 16 bit value sent
+ * to the client. The encoding trades precision for range: the error is
+ * below 5% from 100us and shrinks as the duration grows, and the value
+ * saturates at ~2 minutes.
+ */
+uint16_t encodeServerDuration(std::chrono::microseconds duration);
+
+/**
+ * Decode a value created by encodeServerDuration
+ */
+std::chrono::microseconds decodeServerDuration(uint16_t encoded);
+
+/**
+ * Write the server duration frame info object to the provided buffer
+ *
+ * @param dest where to write the object (ServerDurationFrameSize bytes)
+ * @param duration the time the server spent on the request
+ */
+void writeServerDurationFrame(uint8_t* dest,
+                              std::chrono::microseconds duration);
+
+/**
+ * Look up the server duration in the framing extras of a response
+ *
+ * @param framing the framing extras
+ * @param duration where to store the duration
+ * @return true if the framing extras contains the server duration
+ * @throws std::invalid_argument if the framing extras is corrupt
+ */
+bool findServerDuration(cb::const_byte_buffer framing,
+                        std::chrono::microseconds& duration);
+
+} // namespace mcbp
+} // namespace cb
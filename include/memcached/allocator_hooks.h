@@ -49,6 +49,35 @@ typedef struct allocator_stats {
 
 } allocator_stats;
 
+/* The utilization of the memory "page" (slab / run) holding an allocation,
+   and of all the pages of its size class. An allocation on a page which is
+   less utilized than the average page of its size may be moved (freed and
+   allocated again) to free up the page. */
+typedef struct allocator_utilization {
+    /* Regions (allocations) in use, and in total, on the allocation's page */
+    size_t page_used;
+    size_t page_regions;
+
+    /* Regions in use, and in total, on all the pages of the size class */
+    size_t class_used;
+    size_t class_regions;
+} allocator_utilization;
+
+/* The statistics of a single arena of the allocator (see create_arena) */
+typedef struct allocator_arena_stats {
+    /* Bytes of memory allocated from the arena by the application */
+    size_t allocated_size;
+
+    /* Bytes in the pages the arena has in use (allocated or fragmented) */
+    size_t active_size;
+
+    /* Bytes in the free pages of the arena not yet given back to the OS */
+    size_t dirty_size;
+
+    /* Bytes in resident pages mapped by the arena (including metadata) */
+    size_t resident_size;
+} allocator_arena_stats;
+
 /**
  * Engine allocator hooks for memory tracking.
  */
@@ -132,6 +161,57 @@ typedef struct engine_allocator_hooks_v1 {
      */
     bool (*get_allocator_property)(const char* name, size_t* value);
 
+    /**
+     * Gets the utilization of the page holding the given allocation.
+     * @param ptr an allocation of the allocator (which isn't a large
+     *            allocation with pages of its own)
+     * @param util destination for the utilization
+     * @return false if the allocator can't tell (or ptr is a large
+     *         allocation)
+     */
+    bool (*get_allocation_utilization)(const void* ptr,
+                                       allocator_utilization* util);
+
+    /**
+     * Creates a new arena. The memory of a thread which allocates from it
+     * (see set_thread_arena) is kept apart from the other arenas, and may
+     * be accounted and purged separately.
+     *
+     * Arenas can't be destroyed (memory of the arena may still be in use),
+     * so a caller done with an arena should keep it for reuse.
+     *
+     * @param arena destination for the id of the new arena
+     * @return false if the allocator doesn't support arenas
+     */
+    bool (*create_arena)(unsigned* arena);
+
+    /**
+     * Makes the calling thread allocate from the given arena, where 0 (the
+     * default) is the arena of the allocations of the core.
+     *
+     * Allocations freed to the thread cache may be reused by the thread
+     * after switching arenas, until the cache is flushed.
+     *
+     * @param arena the arena to allocate from
+     * @return whether the call was successful
+     */
+    bool (*set_thread_arena)(unsigned arena);
+
+    /**
+     * Gets the statistics of an arena.
+     * @param arena the arena
+     * @param stats destination for the statistics
+     * @return whether the call was successful
+     */
+    bool (*get_arena_stats)(unsigned arena, allocator_arena_stats* stats);
+
+    /**
+     * Releases the free memory of an arena to the OS (like
+     * release_free_memory, for a single arena).
+     * @param arena the arena
+     */
+    void (*purge_arena)(unsigned arena);
+
 } ALLOCATOR_HOOKS_API;
 
 #ifdef __cplusplus
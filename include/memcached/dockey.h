@@ -50,6 +50,24 @@ enum class DocNamespace : uint8_t {
     System = 2
 };
 
+/**
+ * The versions of the hash function of the DocKeys. The hash is only ever
+ * kept in memory (by the hash tables, checkpoint indexes, frequency
+ * sketches etc.) so Current may change from one release to the next; the
+ * older versions are kept to compare them against (see
+ * engines/ep/benchmarks/hash_table_bench.cc).
+ */
+enum class DocKeyHashVersion : uint8_t {
+    /// djb2, a byte at a time
+    Djb2 = 1,
+    /// Mixes the key 8 bytes at a time with 64 bit multiplies (in the
+    /// style of xxHash / wyhash), with a 64 bit finaliser so that all of
+    /// the bits of the key affect the low bits of the hash
+    WordAtATime = 2,
+
+    Current = WordAtATime
+};
+
 template <class T>
 struct DocKeyInterface {
     size_t size() const {
@@ -68,8 +86,24 @@ struct DocKeyInterface {
         return hash(size());
     }
 
+    /// Get the hash of the key with the given version of the function
+    uint32_t hash(DocKeyHashVersion version) const {
+        return hash(size(), version);
+    }
+
 protected:
-    uint32_t hash(size_t bytes) const {
+    /// Get the hash of the namespace and the first bytes of the key
+    uint32_t hash(
+            size_t bytes,
+            DocKeyHashVersion version = DocKeyHashVersion::Current) const {
+        if (version == DocKeyHashVersion::Djb2) {
+            return hashDjb2(bytes);
+        }
+        return hashWordAtATime(bytes);
+    }
+
+private:
+    uint32_t hashDjb2(size_t bytes) const {
         uint32_t h = 5381;
 
         h = ((h << 5) + h) ^ uint32_t(getDocNamespace());
@@ -80,6 +114,36 @@ protected:
 
         return h;
     }
+
+    uint32_t hashWordAtATime(size_t bytes) const {
+        const uint64_t prime1 = 0x9e3779b185ebca87ull;
+        const uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+        const uint8_t* ptr = data();
+
+        // The length is part of the seed, as the last word is zero padded
+        uint64_t h = (uint64_t(getDocNamespace()) << 56 | bytes) * prime1;
+        auto round = [&h, prime1, prime2](uint64_t word) {
+            h ^= word * prime2;
+            h = ((h << 31) | (h >> 33)) * prime1;
+        };
+
+        for (; bytes >= sizeof(uint64_t); bytes -= sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, ptr, sizeof(word));
+            round(word);
+            ptr += sizeof(word);
+        }
+        if (bytes > 0) {
+            uint64_t word = 0;
+            std::memcpy(&word, ptr, bytes);
+            round(word);
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        return uint32_t(h ^ (h >> 32));
+    }
 };
 
 /**
@@ -9,6 +9,7 @@
 #include <memory>
 #include <sys/types.h>
 #include <utility>
+#include <vector>
 
 #include <boost/optional/optional.hpp>
 
@@ -174,6 +175,16 @@ struct EngineErrorCasPair {
     engine_errc status;
     uint64_t cas;
 };
+
+/**
+ * A key to look up with ENGINE_HANDLE_V1::get_multi
+ */
+struct MultiGetKey {
+    DocKey key;
+    uint16_t vbucket;
+};
+
+struct SeqnoRangeBatch;
 }
 
 /**
@@ -335,6 +346,27 @@ typedef struct engine_interface_v1 {
                                    uint16_t vbucket,
                                    DocStateFilter documentStateFilter);
 
+    /**
+     * Retrieve multiple (alive) items in one call. This is an optional
+     * interface; if the engine sets it to nullptr the core calls get()
+     * for every key.
+     *
+     * The engine sets the result for every key. The engine must call
+     * notify_io_complete exactly once for every key it returns
+     * cb::engine_errc::would_block for (the core waits for all of them
+     * before it retries those keys).
+     *
+     * @param handle the engine handle
+     * @param cookie The cookie provided by the frontend
+     * @param keys the keys to look up (and their vbucket)
+     * @param results the result for each of the keys (the caller
+     *                provides one entry per key)
+     */
+    void (*get_multi)(ENGINE_HANDLE* handle,
+                      const void* cookie,
+                      const std::vector<cb::MultiGetKey>& keys,
+                      std::vector<cb::EngineErrorItemPair>& results);
+
     /**
      * Retrieve metadata for a given item.
      *
@@ -350,6 +382,25 @@ typedef struct engine_interface_v1 {
                                             const DocKey& key,
                                             uint16_t vbucket);
 
+    /**
+     * Retrieve the metadata for multiple items in one call. This is an
+     * optional interface; if the engine sets it to nullptr the core calls
+     * get_meta() for every key.
+     *
+     * As with get_multi the engine must call notify_io_complete exactly
+     * once for every key it returns cb::engine_errc::would_block for.
+     *
+     * @param handle the engine handle
+     * @param cookie The cookie provided by the frontend
+     * @param keys the keys to look up (and their vbucket)
+     * @param results the result for each of the keys (the caller
+     *                provides one entry per key)
+     */
+    void (*get_meta_multi)(ENGINE_HANDLE* handle,
+                           const void* cookie,
+                           const std::vector<cb::MultiGetKey>& keys,
+                           std::vector<cb::EngineErrorMetadataPair>& results);
+
     /**
      * Optionally retrieve an item. Only non-deleted items may be fetched
      * through this interface (Documents in deleted state may be evicted
@@ -601,6 +652,127 @@ typedef struct engine_interface_v1 {
      */
     bool (*isXattrEnabled)(ENGINE_HANDLE* handle);
 
+    /**
+     * Wait for a mutation to be persisted (used for the mutations
+     * carrying a durability requirement). Engines which don't persist
+     * anything leave this as nullptr.
+     *
+     * @param handle the engine handle
+     * @param cookie The cookie provided by the frontend
+     * @param vbucket the vbucket the mutation was stored in
+     * @param seqno the seqno the engine assigned the mutation
+     * @return ENGINE_SUCCESS if the mutation is already persisted, or
+     *         ENGINE_EWOULDBLOCK if the engine calls notify_io_complete
+     *         once it is (with ENGINE_SUCCESS) or the engine gave up
+     *         waiting for it (with ENGINE_TMPFAIL)
+     */
+    ENGINE_ERROR_CODE (*wait_for_persistence)(ENGINE_HANDLE* handle,
+                                              const void* cookie,
+                                              uint16_t vbucket,
+                                              uint64_t seqno);
+
+    /**
+     * Increment or decrement a counter document in a single operation
+     * within the engine (optional). Engines which don't provide it leave
+     * this as nullptr, and the frontend implements the arithmetic
+     * commands with get and store.
+     *
+     * @param handle the engine handle
+     * @param cookie The cookie provided by the frontend
+     * @param key the key of the counter
+     * @param vbucket the vbucket the counter lives in
+     * @param increment true to add delta to the counter, false to
+     *                  subtract it (stopping at 0)
+     * @param delta the value to add or subtract
+     * @param cas the cas the counter must have (or 0 for any)
+     * @param result where to store the new value of the counter
+     * @param new_cas where to store the new cas of the counter
+     * @param mut_info where to store the vbucket uuid and seqno of the
+     *                 mutation
+     * @return ENGINE_ENOTSUP if the engine can't do it for this document
+     *         (for instance if it doesn't exist or isn't in memory), in
+     *         which case the frontend should use get and store instead
+     */
+    ENGINE_ERROR_CODE (*arithmetic)(ENGINE_HANDLE* handle,
+                                    const void* cookie,
+                                    const DocKey& key,
+                                    uint16_t vbucket,
+                                    bool increment,
+                                    uint64_t delta,
+                                    uint64_t cas,
+                                    uint64_t* result,
+                                    uint64_t* new_cas,
+                                    mutation_descr_t* mut_info);
+
+    /**
+     * Append or prepend data to a document in a single operation within
+     * the engine (optional). Engines which don't provide it leave this as
+     * nullptr, and the frontend implements APPEND and PREPEND with get and
+     * store.
+     *
+     * @param handle the engine handle
+     * @param cookie The cookie provided by the frontend
+     * @param key the key of the document
+     * @param vbucket the vbucket the document lives in
+     * @param append true to append the data, false to prepend it
+     * @param value the (uncompressed) data to add to the document
+     * @param cas the cas the document must have (or 0 for any)
+     * @param new_cas where to store the new cas of the document
+     * @param mut_info where to store the vbucket uuid and seqno of the
+     *                 mutation
+     * @return ENGINE_ENOTSUP if the engine can't do it for this document
+     *         (for instance if it doesn't exist, has XATTRs or isn't in
+     *         memory), in which case the frontend should use get and store
+     *         instead
+     */
+    ENGINE_ERROR_CODE (*append_prepend)(ENGINE_HANDLE* handle,
+                                        const void* cookie,
+                                        const DocKey& key,
+                                        uint16_t vbucket,
+                                        bool append,
+                                        cb::const_char_buffer value,
+                                        uint64_t cas,
+                                        uint64_t* new_cas,
+                                        mutation_descr_t* mut_info);
+
+    /**
+     * Read the documents (and deletions) of a vbucket with a seqno in a
+     * range, in seqno order and in batches, for the consumers within the
+     * process which would otherwise have to stream them over DCP (such as
+     * a local index builder). This is an optional interface; engines which
+     * don't provide it leave it as nullptr.
+     *
+     * A batch holds the documents up to max_bytes in total (but at least
+     * one), and the seqno to read the next batch of the range from. The
+     * range is complete once that is past end. An engine may not be able
+     * to read all of the range yet (a persistent bucket only reads what
+     * is persisted), in which case the batch ends early, and is empty if
+     * nothing after start can be read yet.
+     *
+     * As the documents may have to be read from disk, the engine may
+     * return ENGINE_EWOULDBLOCK and call notify_io_complete once the batch
+     * is read. The caller then calls again (with the same arguments) to
+     * get it.
+     *
+     * @param handle the engine handle
+     * @param cookie The cookie provided by the frontend
+     * @param vbucket the vbucket to read
+     * @param start the first seqno of the range
+     * @param end the last seqno of the range
+     * @param max_bytes the size of the batch (0 for no limit)
+     * @param batch where to store the documents read and the next seqno
+     * @return ENGINE_SUCCESS with the batch read, ENGINE_NOT_MY_VBUCKET if
+     *         the vbucket isn't active here, or ENGINE_EINVAL if start is
+     *         after end
+     */
+    ENGINE_ERROR_CODE (*get_seqno_range)(ENGINE_HANDLE* handle,
+                                         const void* cookie,
+                                         uint16_t vbucket,
+                                         uint64_t start,
+                                         uint64_t end,
+                                         size_t max_bytes,
+                                         cb::SeqnoRangeBatch& batch);
+
 } ENGINE_HANDLE_V1;
 
 namespace cb {
@@ -650,6 +822,17 @@ inline EngineErrorItemPair makeEngineErrorItemPair(cb::engine_errc err,
                                                    ENGINE_HANDLE* handle) {
     return {err, unique_item_ptr{it, ItemDeleter{handle}}};
 }
+
+/**
+ * A batch of the documents of a vbucket read with
+ * ENGINE_HANDLE_V1::get_seqno_range
+ */
+struct SeqnoRangeBatch {
+    /// The documents (and deletions), in seqno order
+    std::vector<unique_item_ptr> items;
+    /// The seqno the next batch of the range is read from
+    uint64_t next = 0;
+};
 }
 
 /**
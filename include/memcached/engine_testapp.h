@@ -8,6 +8,7 @@
 enum class OutputFormat {
     Text,
     XML,
+    JSON,
 };
 
 enum test_result {
@@ -33,6 +34,9 @@ struct test_harness {
                          const char *, const char *, bool, bool);
     OutputFormat output_format;
     const char* output_file_prefix;
+    /// The directory with the baselines for the results of the
+    /// performance tests (or nullptr to not compare them)
+    const char* baseline_dir;
     const void *(*create_cookie)(void);
     void (*destroy_cookie)(const void *cookie);
     void (*set_ewouldblock_handling)(const void *cookie, bool enable);
@@ -0,0 +1,154 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/visibility.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+/**
+ * Support for backing large, long lived regions of memory by 2 MB huge
+ * pages, so that random accesses to them don't miss in the TLB all of the
+ * time.
+ *
+ * Two kinds of huge pages are used, where available (on Linux):
+ *
+ *   * Explicit huge pages (MAP_HUGETLB), which must have been reserved by
+ *     the administrator (vm.nr_hugepages). Only used by map().
+ *   * Transparent huge pages, which the kernel backs the memory advised
+ *     with MADV_HUGEPAGE by when it can (unless they're disabled).
+ *
+ * Everything falls back to regular pages when neither is available.
+ */
+namespace cb {
+namespace hugepages {
+
+/// The size of a huge page
+const size_t pageSize = 2 * 1024 * 1024;
+
+/// How a region returned by map() is backed
+enum class Backing { Regular, Transparent, Explicit };
+
+/// Round the size up to a whole number of huge pages
+MEMCACHED_PUBLIC_API
+size_t roundUp(size_t size);
+
+/**
+ * Get the number of bytes of the whole (aligned) huge pages within the
+ * region, which are the ones advise() asks huge pages for
+ */
+MEMCACHED_PUBLIC_API
+size_t alignedBytes(const void* ptr, size_t size);
+
+/**
+ * Are transparent huge pages available (and not disabled)?
+ */
+MEMCACHED_PUBLIC_API
+bool isTransparentSupported();
+
+/**
+ * Ask for the whole huge pages within the (already allocated) region to
+ * be backed by transparent huge pages. This is only a hint, and works
+ * best before the memory is first touched.
+ *
+ * @return the number of bytes advised (alignedBytes() if transparent
+ *         huge pages are supported, 0 otherwise)
+ */
+MEMCACHED_PUBLIC_API
+size_t advise(void* ptr, size_t size);
+
+/**
+ * Map a zero filled region of roundUp(size) bytes, backed by explicit huge
+ * pages if there are enough of them reserved, or aligned to (and advised
+ * to use) transparent huge pages otherwise.
+ *
+ * @param size the number of bytes needed
+ * @param backing set to how the region is backed
+ * @return the region (to be released with unmap()), or nullptr if it
+ *         couldn't be mapped (and the caller should use malloc instead)
+ */
+MEMCACHED_PUBLIC_API
+void* map(size_t size, Backing& backing);
+
+/// Release a region returned by map() (with the size asked for)
+MEMCACHED_PUBLIC_API
+void unmap(void* ptr, size_t size);
+
+/**
+ * An allocator for containers (such as the bucket array of a hash table),
+ * which advises the storage it allocates to be backed by transparent huge
+ * pages. The memory itself comes from std::allocator (so it is accounted
+ * for as usual), and only allocations of a few huge pages or more are
+ * actually backed by them.
+ *
+ * The number of bytes advised is kept in the counter given (the default
+ * constructed allocator doesn't advise anything).
+ */
+template <class T>
+class Allocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    Allocator() = default;
+
+    explicit Allocator(std::atomic<size_t>* advised) : advised(advised) {
+    }
+
+    template <class U>
+    Allocator(const Allocator<U>& other) : advised(other.advised) {
+    }
+
+    T* allocate(size_t n) {
+        T* ptr = std::allocator<T>().allocate(n);
+        if (advised != nullptr) {
+            advised->fetch_add(advise(ptr, n * sizeof(T)));
+        }
+        return ptr;
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        if (advised != nullptr && isTransparentSupported()) {
+            advised->fetch_sub(alignedBytes(ptr, n * sizeof(T)));
+        }
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <class U>
+    bool operator==(const Allocator<U>& other) const {
+        return advised == other.advised;
+    }
+
+    template <class U>
+    bool operator!=(const Allocator<U>& other) const {
+        return advised != other.advised;
+    }
+
+private:
+    template <class U>
+    friend class Allocator;
+
+    std::atomic<size_t>* advised = nullptr;
+};
+
+} // namespace hugepages
+} // namespace cb
@@ -0,0 +1,50 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/visibility.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A JSON validator used to detect the datatype of the documents stored
+ * by clients which don't know about datatypes (and the documents produced
+ * by subdoc). It accepts any JSON value (not only objects and arrays)
+ * encoded in UTF-8, like checkUTF8JSON() in JSON_checker, but scans the
+ * content of the strings (where most of the bytes in a document live)
+ * 16 bytes at a time with SSE2 on x86-64 and NEON on aarch64.
+ */
+namespace cb {
+namespace json {
+
+/**
+ * Check if the buffer contains a single valid JSON value (optionally
+ * surrounded by whitespace)
+ */
+MEMCACHED_PUBLIC_API
+bool isValidJson(const uint8_t* data, size_t size);
+
+/**
+ * Same as isValidJson, but always use the scalar string scanner (used
+ * by the tests and the benchmark to compare the implementations)
+ */
+MEMCACHED_PUBLIC_API
+bool isValidJsonScalar(const uint8_t* data, size_t size);
+
+} // namespace json
+} // namespace cb
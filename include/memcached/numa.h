@@ -0,0 +1,63 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/visibility.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Minimal support for placing threads on NUMA nodes, used by the front
+ * end worker threads and ep-engine's executor threads.
+ *
+ * The topology is read from sysfs on Linux. On other platforms (or if
+ * the topology isn't available) the machine is treated as a single
+ * node, and binding a thread is a no-op.
+ */
+namespace cb {
+namespace numa {
+
+/**
+ * Parse a list of CPUs in the format used by sysfs (and taskset), for
+ * instance "0-3,8,10-11"
+ *
+ * @throws std::invalid_argument if the list is malformed
+ */
+MEMCACHED_PUBLIC_API
+std::vector<int> parseCpuList(const std::string& list);
+
+/**
+ * Get the number of NUMA nodes (always at least 1)
+ */
+MEMCACHED_PUBLIC_API
+size_t getNumNodes();
+
+/**
+ * Restrict the calling thread to the CPUs of the given node. The node
+ * number wraps around, so callers may just pass a thread index to spread
+ * threads round robin over the nodes.
+ *
+ * @return true if the thread was bound, false if the platform doesn't
+ *         support it (or we failed to bind the thread)
+ */
+MEMCACHED_PUBLIC_API
+bool bindCurrentThreadToNode(size_t node);
+
+} // namespace numa
+} // namespace cb
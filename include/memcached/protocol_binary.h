@@ -237,6 +237,8 @@ const uint8_t PROTOCOL_BINARY_CMD_AUDIT_CONFIG_RELOAD =
         uint8_t(cb::mcbp::ClientOpcode::AuditConfigReload);
 const uint8_t PROTOCOL_BINARY_CMD_SHUTDOWN =
         uint8_t(cb::mcbp::ClientOpcode::Shutdown);
+const uint8_t PROTOCOL_BINARY_CMD_GET_MULTI =
+        uint8_t(cb::mcbp::ClientOpcode::GetMulti);
 const uint8_t PROTOCOL_BINARY_CMD_RGET = uint8_t(cb::mcbp::ClientOpcode::Rget);
 const uint8_t PROTOCOL_BINARY_CMD_RSET = uint8_t(cb::mcbp::ClientOpcode::Rset);
 const uint8_t PROTOCOL_BINARY_CMD_RSETQ =
@@ -391,6 +393,12 @@ const uint8_t PROTOCOL_BINARY_CMD_GET_KEYS =
         uint8_t(cb::mcbp::ClientOpcode::GetKeys);
 const uint8_t PROTOCOL_BINARY_CMD_COLLECTIONS_SET_MANIFEST =
         uint8_t(cb::mcbp::ClientOpcode::CollectionsSetManifest);
+const uint8_t PROTOCOL_BINARY_CMD_RANGE_SCAN =
+        uint8_t(cb::mcbp::ClientOpcode::RangeScan);
+const uint8_t PROTOCOL_BINARY_CMD_WITH_META_BATCH =
+        uint8_t(cb::mcbp::ClientOpcode::WithMetaBatch);
+const uint8_t PROTOCOL_BINARY_CMD_GET_META_MULTI =
+        uint8_t(cb::mcbp::ClientOpcode::GetMetaMulti);
 const uint8_t PROTOCOL_BINARY_CMD_SET_DRIFT_COUNTER_STATE =
         uint8_t(cb::mcbp::ClientOpcode::SetDriftCounterState);
 const uint8_t PROTOCOL_BINARY_CMD_GET_ADJUSTED_TIME =
@@ -538,6 +546,42 @@ typedef protocol_binary_response_get protocol_binary_response_getq;
 typedef protocol_binary_response_get protocol_binary_response_getk;
 typedef protocol_binary_response_get protocol_binary_response_getkq;
 
+/**
+ * Definition of the GET_MULTI command. The request has no extras and no
+ * key; the body is a sequence of keys, each prefixed by a KeyHeader
+ * (in network byte order):
+ *
+ *     vbucket    2 @0
+ *     keylen     2 @2
+ *     key   keylen @4
+ *
+ * The server sends a protocol_binary_response_getk for every document
+ * found, and a response with the key (and no value) for keys failing
+ * with a status other than KEY_ENOENT. Keys which don't exist are
+ * omitted (as with GETKQ). The responses are sent in the order of the
+ * keys in the request, and the request is terminated by a success
+ * response without key and body.
+ */
+typedef protocol_binary_request_no_extras protocol_binary_request_get_multi;
+
+namespace mcbp {
+namespace getmulti {
+
+#pragma pack(1)
+struct KeyHeader {
+    uint16_t vbucket;
+    uint16_t keylen;
+};
+#pragma pack()
+
+static_assert(sizeof(KeyHeader) == 4, "Incorrect compiler padding");
+
+/// The maximum number of keys in a single GET_MULTI request
+const size_t MaxKeys = 1024;
+
+} // namespace getmulti
+} // namespace mcbp
+
 /**
  * Definition of the packet used by the delete command
  * See section 4
@@ -1442,6 +1486,14 @@ typedef union {
  * error ENGINE_NOT_MY_VBUCKET
  */
 #define DCP_ADD_STREAM_ACTIVE_VB_ONLY 16
+/**
+ * Indicate the server that the items of the disk snapshot of a stream
+ * request may be sent in any order (the order of the keys on disk), for
+ * the consumers which don't need the seqno order, such as an initial index
+ * build. The disk snapshot still covers the whole range of seqnos it is
+ * marked with. Only for stream requests (not add stream).
+ */
+#define DCP_ADD_STREAM_FLAG_BACKFILL_BY_KEY 32
             uint32_t flags;
         } body;
     } message;
@@ -1911,6 +1963,51 @@ typedef union {
 typedef protocol_binary_request_set_with_meta
         protocol_binary_request_delete_with_meta;
 
+/**
+ * Message format for PROTOCOL_BINARY_CMD_WITH_META_BATCH
+ *
+ * Applies a number of set/add/del_with_meta to the vbucket of the request
+ * in one command. The optional extras hold the options (4 bytes, see
+ * FORCE_WITH_META_OP etc), which apply to all of the documents; the key is
+ * empty. The value is a sequence of documents, each of them a
+ * WithMetaBatchEntry followed by the key, the value and the extended
+ * metadata (nmeta bytes) of the document.
+ *
+ * The value of the response holds a WithMetaBatchResult for every
+ * document of the request (in the same order). The status of the response
+ * itself is only an error if the request as a whole failed (for instance
+ * if it is malformed, or the vbucket isn't there).
+ */
+enum class WithMetaBatchOp : uint8_t { Set = 0, Add = 1, Delete = 2 };
+
+#pragma pack(1)
+
+struct WithMetaBatchEntry {
+    /// The WithMetaBatchOp
+    uint8_t op;
+    uint8_t datatype;
+    uint16_t keylen;
+    uint32_t flags;
+    uint32_t expiration;
+    uint64_t seqno;
+    uint64_t cas;
+    uint16_t nmeta;
+    uint32_t valuelen;
+};
+
+struct WithMetaBatchResult {
+    /// The protocol_binary_response_status of the document
+    uint16_t status;
+    /// The CAS of the document if it was stored
+    uint64_t cas;
+};
+
+#pragma pack()
+
+static_assert(sizeof(WithMetaBatchEntry) == 34, "Incorrect compiler padding");
+static_assert(sizeof(WithMetaBatchResult) == 10,
+              "Incorrect compiler padding");
+
 /**
  * The message format for getLocked engine API
  */
@@ -1922,6 +2019,19 @@ typedef protocol_binary_request_gat protocol_binary_request_getl;
  */
 typedef protocol_binary_request_no_extras protocol_binary_request_get_meta;
 
+/**
+ * The CMD_GET_META_MULTI command has the same layout as GET_MULTI (the
+ * value is a sequence of keys, each prefixed by a mcbp::getmulti::KeyHeader).
+ *
+ * The server sends a response for every key, in the order of the keys in
+ * the request. It holds the key and either a GetMetaResponse (with the
+ * datatype) as the extras and the CAS of the document, or the status the
+ * lookup failed with (KEY_ENOENT included). The sequence is terminated by
+ * a success response without extras, key or value.
+ */
+typedef protocol_binary_request_no_extras
+        protocol_binary_request_get_meta_multi;
+
 /**
  * Structure holding getMeta command response fields
  */
@@ -2275,14 +2385,72 @@ typedef protocol_binary_response_no_extras
  *
  * The extras field may contain a 32 bit integer specifying the number
  * of keys to fetch. If no value specified 1000 keys is transmitted.
+ * It may be followed by a second 32 bit integer specifying the maximum
+ * size of the value of the response (0 means no limit).
  *
  * Key is mandatory and specifies the starting key
  *
  * Get keys is used to fetch a sequence of keys from the server starting
- * at the specified key.
+ * at the specified key. If the response stopped at the maximum size (before
+ * the number of keys or the end of the vbucket was reached), the extras
+ * field of the response holds the key the next request should start at.
  */
 typedef protocol_binary_request_no_extras protocol_binary_request_get_keys;
 
+/**
+ * Message format for PROTOCOL_BINARY_CMD_RANGE_SCAN
+ *
+ * The key specifies the first key of the range, and the value the key the
+ * range ends before (the range has no end if empty). With
+ * RANGE_SCAN_FLAG_PREFIX the range is the keys starting with the key
+ * instead (and the value must be empty).
+ *
+ * The extras specify the maximum number of documents of the response (0
+ * means the default of 1000) and the maximum size of its value (0 means no
+ * limit, at least one document is sent).
+ *
+ * The value of the response holds the documents of the range, in the order
+ * of their keys, each of them as: the key length (2 bytes), the flags (4
+ * bytes), the value length (4 bytes), the CAS (8 bytes), the datatype (1
+ * byte), the key and the value (without the extended attributes). The
+ * documents which aren't persisted yet are included. If the response
+ * stopped at one of the maximums before the end of the range, the extras
+ * field of the response holds the key the next request should start at.
+ */
+#define RANGE_SCAN_FLAG_PREFIX 1
+
+typedef union {
+    struct {
+        protocol_binary_request_header header;
+        struct {
+            uint32_t count;
+            uint32_t max_bytes;
+            uint32_t flags;
+        } body;
+    } message;
+    uint8_t bytes[sizeof(protocol_binary_request_header) + 12];
+} protocol_binary_request_range_scan;
+
+/**
+ * Message format for PROTOCOL_BINARY_CMD_GET_REPLICA
+ *
+ * The extras field may contain a 64 bit integer specifying the minimum
+ * seqno the replica vbucket must have received for the document to be
+ * returned (to read your own writes, or to bound how stale the document
+ * may be). If the replica is behind it, PROTOCOL_BINARY_RESPONSE_ETMPFAIL
+ * is returned, and the client should read from the active vbucket (or
+ * another replica) instead.
+ */
+typedef union {
+    struct {
+        protocol_binary_request_header header;
+        struct {
+            uint64_t min_seqno;
+        } body;
+    } message;
+    uint8_t bytes[sizeof(protocol_binary_request_header) + 8];
+} protocol_binary_request_get_replica;
+
 
 enum class TimeType : uint8_t {
     TimeOfDay,
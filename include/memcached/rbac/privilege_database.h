@@ -44,6 +44,11 @@ namespace rbac {
  */
 using PrivilegeMask = std::bitset<size_t(Privilege::Impersonate) + 1>;
 
+/**
+ * A bit per command (the 8 bit opcode of a MCBP command).
+ */
+using CommandMask = std::bitset<0x100>;
+
 /**
  * The UserEntry object is in an in-memory representation of the per-user
  * privileges.
@@ -148,6 +153,37 @@ public:
      */
     PrivilegeAccess check(Privilege privilege) const;
 
+    /**
+     * Is this context created from a different generation of the
+     * privilege database than the current one?
+     */
+    bool isStale() const;
+
+    /**
+     * Get the access decision cached for the command (the outcome of all
+     * of the privilege checks the command requires) in this context.
+     *
+     * The cache only lives as long as the context: it is empty in a new
+     * context, and it is cleared every time the privileges in the context
+     * change.
+     *
+     * @param command the opcode of the command
+     * @return Ok or Fail if a decision is cached for the command
+     *         Stale if no decision is cached, or the context is stale
+     */
+    PrivilegeAccess getCachedAccess(uint8_t command) const;
+
+    /**
+     * Cache the access decision for the command in this context.
+     *
+     * The caller must make sure that the decision was made by using
+     * this context, and that the context wasn't stale.
+     *
+     * @param command the opcode of the command
+     * @param access the decision (Stale is ignored)
+     */
+    void setCachedAccess(uint8_t command, PrivilegeAccess access);
+
     /**
      * Get the generation of the Privilege Database this context maps
      * to. If there is a mismatch with this number and the current number
@@ -193,6 +229,11 @@ protected:
 
     uint32_t generation;
     PrivilegeMask mask;
+
+    /// The commands with an access decision cached
+    CommandMask cachedCommands;
+    /// The commands the cached decision is "Ok" for
+    CommandMask allowedCommands;
 };
 
 /**
@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/sized_buffer.h>
+#include <xattr/visibility.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace cb {
+namespace xattr {
+
+/**
+ * The BlobIndex is the location of every key and value in an xattr blob,
+ * sorted by key. The blob is walked once to build the index, and all
+ * lookups after that are a binary search (rather than a walk through
+ * the blob like cb::xattr::Blob::get does).
+ *
+ * It is meant to be built once per document operation and shared by
+ * all the code in the operation which needs to look into the xattrs.
+ * The blob must be a valid xattr blob (see cb::xattr::validate), and
+ * must outlive the index (and not be modified) as the values returned
+ * point into it.
+ */
+class XATTR_PUBLIC_API BlobIndex {
+public:
+    /**
+     * Build the index for the given blob (replacing any previous index)
+     *
+     * @param blob the encoded xattrs (the 4 byte length followed by the
+     *             kv-pairs), or an empty buffer if there are none
+     */
+    void build(cb::const_byte_buffer blob);
+
+    /// Was build() last called for the given blob
+    bool is_index_of(cb::const_byte_buffer other) const {
+        return other.buf == blob.buf && other.len == blob.len;
+    }
+
+    /**
+     * Get the value for a given key located in the blob
+     *
+     * @param key The key to look up
+     * @return a buffer containing it's value. If not found the buffer length
+     *         is 0
+     */
+    cb::const_byte_buffer get(cb::const_byte_buffer key) const;
+
+    /**
+     * Get the size of the system xattr's located in the blob (the same as
+     * cb::xattr::Blob::get_system_size)
+     */
+    size_t get_system_size() const {
+        return system_size;
+    }
+
+    /// The number of xattrs in the blob
+    size_t size() const {
+        return entries.size();
+    }
+
+private:
+    struct Entry {
+        /// The offset of the key into the blob
+        uint32_t key;
+        uint32_t keylen;
+        /// The offset of the value into the blob
+        uint32_t value;
+        uint32_t valuelen;
+    };
+
+    cb::const_byte_buffer keyOf(const Entry& entry) const {
+        return {blob.buf + entry.key, entry.keylen};
+    }
+
+    cb::const_byte_buffer blob;
+    std::vector<Entry> entries;
+    size_t system_size = 0;
+};
+
+}
+}
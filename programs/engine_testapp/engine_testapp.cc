@@ -352,6 +352,31 @@ static ENGINE_ERROR_CODE mock_unlock(ENGINE_HANDLE* handle,
     return ret;
 }
 
+static ENGINE_ERROR_CODE mock_get_seqno_range(ENGINE_HANDLE* handle,
+                                              const void* cookie,
+                                              uint16_t vbucket,
+                                              uint64_t start,
+                                              uint64_t end,
+                                              size_t max_bytes,
+                                              cb::SeqnoRangeBatch& batch) {
+    struct mock_connstruct* c = get_or_create_mock_connstruct(cookie);
+    auto engine_fn =
+            std::bind(get_engine_v1_from_handle(handle)->get_seqno_range,
+                      get_engine_from_handle(handle),
+                      static_cast<const void*>(c),
+                      vbucket,
+                      start,
+                      end,
+                      max_bytes,
+                      std::ref(batch));
+
+    ENGINE_ERROR_CODE ret =
+            call_engine_and_handle_EWOULDBLOCK(handle, c, engine_fn);
+
+    check_and_destroy_mock_connstruct(c, cookie);
+    return ret;
+}
+
 
 static ENGINE_ERROR_CODE mock_get_stats(ENGINE_HANDLE* handle,
                                         const void* cookie,
@@ -749,6 +774,12 @@ static void usage(void) {
     printf("-v                           verbose output\n");
     printf("-X                           Use stderr logger instead of /dev/zero\n");
     printf("-n                           Regex specifying name(s) of test(s) to run\n");
+    printf("-f <text|xml|json>           Output format of the results of the\n");
+    printf("                             performance tests.\n");
+    printf("-B <dir>                     Compare the p99.9 of the results of the\n");
+    printf("                             performance tests with the baselines\n");
+    printf("                             (<test>.json, as written by -f json)\n");
+    printf("                             in the directory.\n");
 }
 
 static int report_test(const char *name,
@@ -867,10 +898,12 @@ static ENGINE_HANDLE_V1* create_bucket(bool initialize, const char* cfg) {
         mock_engine->me.remove = mock_remove;
         mock_engine->me.release = mock_release;
         mock_engine->me.get = mock_get;
+        mock_engine->me.get_multi = nullptr;
         mock_engine->me.get_if = mock_get_if;
         mock_engine->me.get_and_touch = mock_get_and_touch;
         mock_engine->me.get_locked = mock_get_locked;
         mock_engine->me.get_meta = mock_get_meta;
+        mock_engine->me.get_meta_multi = nullptr;
         mock_engine->me.unlock = mock_unlock;
         mock_engine->me.store = mock_store;
         mock_engine->me.flush = mock_flush;
@@ -900,6 +933,7 @@ static ENGINE_HANDLE_V1* create_bucket(bool initialize, const char* cfg) {
         mock_engine->me.collections.set_manifest =
                 mock_collections_set_manifest;
         mock_engine->me.isXattrEnabled = mock_isXattrEnabled;
+        mock_engine->me.get_seqno_range = mock_get_seqno_range;
 
         mock_engine->the_engine = (ENGINE_HANDLE_V1*)handle;
 
@@ -910,6 +944,9 @@ static ENGINE_HANDLE_V1* create_bucket(bool initialize, const char* cfg) {
         if (mock_engine->the_engine->unknown_command == NULL) {
             mock_engine->me.unknown_command = NULL;
         }
+        if (mock_engine->the_engine->get_seqno_range == nullptr) {
+            mock_engine->me.get_seqno_range = nullptr;
+        }
 
         if (initialize) {
             if(!init_engine_instance(handle, cfg, logger_descriptor)) {
@@ -1237,6 +1274,7 @@ int main(int argc, char **argv) {
     std::unique_ptr<std::regex> test_case_regex;
     engine_test_t *testcases = NULL;
     OutputFormat output_format(OutputFormat::Text);
+    const char* baseline_dir = nullptr;
     cb_dlhandle_t handle;
     char *errmsg = NULL;
     void *symbol = NULL;
@@ -1304,7 +1342,8 @@ int main(int argc, char **argv) {
                        "C:" /* Test case id */
                        "s" /* spinlock the program */
                        "X" /* Use stderr logger */
-                       "f:" /* output format. Valid values are: 'text' and 'xml' */
+                       "f:" /* output format. Valid values are: 'text', 'xml' and 'json' */
+                       "B:" /* Directory with the baselines of the results */
                        )) != -1) {
         switch (c) {
         case 'a':
@@ -1331,12 +1370,17 @@ int main(int argc, char **argv) {
                 output_format = OutputFormat::Text;
             } else if (std::string(optarg) == "xml") {
                 output_format = OutputFormat::XML;
+            } else if (std::string(optarg) == "json") {
+                output_format = OutputFormat::JSON;
             } else {
                 fprintf(stderr, "Invalid option for output format '%s'. Valid "
-                    "options are 'text' and 'xml'.\n", optarg);
+                    "options are 'text', 'xml' and 'json'.\n", optarg);
                 return 1;
             }
             break;
+        case 'B':
+            baseline_dir = optarg;
+            break;
         case 'h':
             usage();
             return 0;
@@ -1409,6 +1453,7 @@ int main(int argc, char **argv) {
     harness.engine_path = engine;
     harness.output_format = output_format;
     harness.output_file_prefix = "output.";
+    harness.baseline_dir = baseline_dir;
     harness.reload_engine = reload_engine;
     harness.create_cookie = create_mock_cookie;
     harness.destroy_cookie = destroy_mock_cookie;
@@ -462,6 +462,12 @@ SERVER_HANDLE_V1 *get_mock_server_api(void)
       hooks_api.release_free_memory = AllocHooks::release_free_memory;
       hooks_api.enable_thread_cache = AllocHooks::enable_thread_cache;
       hooks_api.get_allocator_property = AllocHooks::get_allocator_property;
+      hooks_api.get_allocation_utilization =
+              AllocHooks::get_allocation_utilization;
+      hooks_api.create_arena = AllocHooks::create_arena;
+      hooks_api.set_thread_arena = AllocHooks::set_thread_arena;
+      hooks_api.get_arena_stats = AllocHooks::get_arena_stats;
+      hooks_api.purge_arena = AllocHooks::purge_arena;
 
       document_api.pre_link = mock_pre_link_document;
       document_api.pre_expiry = document_pre_expiry;
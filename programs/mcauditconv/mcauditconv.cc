@@ -0,0 +1,222 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * mcauditconv renders a binary audit trail (see auditd/src/auditrecord.h)
+ * as the standard JSON audit trail: one JSON document per line, with
+ * the id, name and description of each event (from the event descriptors
+ * the audit daemon used, audit_events.json) and its timestamp.
+ */
+
+#include <cJSON_utils.h>
+#include <getopt.h>
+#include <memcached/isotime.h>
+#include <platform/platform.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "auditrecord.h"
+#include "eventdescriptor.h"
+
+using DescriptorMap = std::map<uint32_t, std::unique_ptr<EventDescriptor>>;
+
+void usage() {
+    using std::endl;
+    std::cerr << "usage: mcauditconv [options] file..." << endl
+              << "\t--descriptors filename  The audit_events.json to get the"
+              << endl
+              << "\t                        names of the events from" << endl
+              << "\t--output filename       Write the events to the named"
+              << endl
+              << "\t                        file (default stdout)" << endl
+              << endl;
+    exit(EXIT_FAILURE);
+}
+
+DescriptorMap load_descriptors(const std::string& filename) {
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        throw std::system_error(
+                errno, std::system_category(), "Can't open " + filename);
+    }
+    const std::string content((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+    unique_cJSON_ptr root(cJSON_Parse(content.c_str()));
+    if (!root) {
+        throw std::runtime_error("Failed to parse " + filename);
+    }
+
+    // {"version": 1, "modules": [{ ..., "events": [descriptor, ...] }]}
+    DescriptorMap ret;
+    auto* modules = cJSON_GetObjectItem(root.get(), "modules");
+    if (modules == nullptr || modules->type != cJSON_Array) {
+        throw std::runtime_error("No \"modules\" in " + filename);
+    }
+    for (auto* module = modules->child; module != nullptr;
+         module = module->next) {
+        auto* events = cJSON_GetObjectItem(module, "events");
+        if (events == nullptr || events->type != cJSON_Array) {
+            continue;
+        }
+        for (auto* event = events->child; event != nullptr;
+             event = event->next) {
+            std::unique_ptr<EventDescriptor> descr(new EventDescriptor(event));
+            const auto id = descr->getId();
+            ret[id] = std::move(descr);
+        }
+    }
+    return ret;
+}
+
+/**
+ * Render one event as JSON (the same way Event::process does)
+ *
+ * @return false if the payload isn't a valid JSON object
+ */
+bool render_event(FILE* output,
+                  const DescriptorMap& descriptors,
+                  const AuditRecordHeader& header,
+                  const std::string& payload) {
+    unique_cJSON_ptr json(cJSON_Parse(payload.c_str()));
+    if (!json || json->type != cJSON_Object) {
+        return false;
+    }
+
+    if (cJSON_GetObjectItem(json.get(), "timestamp") == nullptr) {
+        const uint64_t usec = ntohll(header.timestamp);
+        const auto timestamp = ISOTime::generatetimestamp(
+                time_t(usec / 1000000), uint32_t(usec % 1000000));
+        cJSON_AddStringToObject(json.get(), "timestamp", timestamp.c_str());
+    }
+    const uint32_t id = ntohl(header.id);
+    cJSON_AddNumberToObject(json.get(), "id", id);
+    auto descr = descriptors.find(id);
+    if (descr != descriptors.end()) {
+        cJSON_AddStringToObject(json.get(), "name",
+                                descr->second->getName().c_str());
+        cJSON_AddStringToObject(json.get(), "description",
+                                descr->second->getDescription().c_str());
+    }
+
+    fprintf(output, "%s\n", to_string(json, false).c_str());
+    return true;
+}
+
+void process_file(const std::string& filename,
+                  FILE* output,
+                  const DescriptorMap& descriptors) {
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (fp == nullptr) {
+        throw std::system_error(
+                errno, std::system_category(), "Can't open " + filename);
+    }
+
+    AuditFileHeader fileheader;
+    if (fread(&fileheader, sizeof(fileheader), 1, fp) != 1 ||
+        !fileheader.is_valid()) {
+        fclose(fp);
+        throw std::runtime_error(filename + " is not a binary audit trail");
+    }
+
+    size_t count = 0;
+    AuditRecordHeader header;
+    std::string payload;
+    while (fread(&header, sizeof(header), 1, fp) == 1) {
+        payload.resize(ntohl(header.length));
+        if (!payload.empty() &&
+            fread(&payload[0], payload.size(), 1, fp) != 1) {
+            // The daemon crashed while writing the record
+            std::cerr << filename << ": the last event is truncated"
+                      << std::endl;
+            break;
+        }
+        if (!render_event(output, descriptors, header, payload)) {
+            std::cerr << filename << ": event " << count << " (id "
+                      << ntohl(header.id) << ") is not valid JSON: "
+                      << payload << std::endl;
+        }
+        ++count;
+    }
+    fclose(fp);
+}
+
+int main(int argc, char** argv) {
+    struct option long_options[] = {
+            {"descriptors", required_argument, nullptr, 'd'},
+            {"output", required_argument, nullptr, 'o'},
+            {nullptr, 0, nullptr, 0}};
+
+    std::string descriptors;
+    std::string output;
+
+    int cmd;
+    while ((cmd = getopt_long(argc, argv, "d:o:", long_options, nullptr)) !=
+           EOF) {
+        switch (cmd) {
+        case 'd':
+            descriptors = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    if (optind == argc) {
+        usage();
+    }
+
+    try {
+        DescriptorMap descriptorMap;
+        if (!descriptors.empty()) {
+            descriptorMap = load_descriptors(descriptors);
+        }
+
+        FILE* ofs = stdout;
+        if (!output.empty()) {
+            ofs = fopen(output.c_str(), "w");
+            if (ofs == nullptr) {
+                throw std::system_error(errno,
+                                        std::system_category(),
+                                        "Failed to open " + output);
+            }
+        }
+
+        for (; optind < argc; ++optind) {
+            process_file(argv[optind], ofs, descriptorMap);
+        }
+
+        if (ofs != stdout) {
+            fclose(ofs);
+        }
+        return EXIT_SUCCESS;
+    } catch (std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+    }
+
+    return EXIT_FAILURE;
+}
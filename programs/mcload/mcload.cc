@@ -0,0 +1,773 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * mcload - drive a configurable GET/SET load to memcached and report the
+ *          throughput and the latency distribution.
+ *
+ * Every thread owns a number of connections. For each round it sends a
+ * batch of (pipeline depth) commands on each of its connections before
+ * it reads the responses, so a thread keeps
+ * (connections * depth) operations outstanding at the same time. The
+ * latency of an operation is the time from we sent the command until
+ * we received its response.
+ *
+ * The keys, values and op mix come from a seeded random generator so
+ * that a run may be repeated.
+ */
+
+#include "config.h"
+
+#include <daemon/latency_histogram.h>
+#include <getopt.h>
+#include <memcached/protocol_binary.h>
+#include <platform/platform.h>
+#include <programs/getpass.h>
+#include <programs/hostname_utils.h>
+#include <protocol/connection/client_connection.h>
+#include <protocol/connection/client_mcbp_commands.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+    std::string host{"localhost"};
+    std::string port{"11210"};
+    sa_family_t family = AF_UNSPEC;
+    bool secure = false;
+    std::string user;
+    std::string password;
+    std::string bucket;
+
+    size_t threads = 1;
+    size_t connections = 1;
+    size_t depth = 1;
+    std::chrono::seconds duration{10};
+    uint64_t keys = 100000;
+    std::string distribution{"uniform"};
+    size_t valueMin = 256;
+    size_t valueMax = 256;
+    unsigned int getRatio = 90;
+    uint16_t vbuckets = 0;
+    uint64_t seed = 0;
+    bool populate = false;
+    bool serverDuration = false;
+    std::string hgrm;
+};
+
+/**
+ * The KeyGenerator picks the index of the key to use for the next
+ * operation.
+ */
+class KeyGenerator {
+public:
+    virtual ~KeyGenerator() = default;
+    virtual uint64_t next(std::mt19937_64& rng) = 0;
+};
+
+/// Every key is equally likely
+class UniformKeyGenerator : public KeyGenerator {
+public:
+    explicit UniformKeyGenerator(uint64_t keys) : dist(0, keys - 1) {
+    }
+
+    uint64_t next(std::mt19937_64& rng) override {
+        return dist(rng);
+    }
+
+private:
+    std::uniform_int_distribution<uint64_t> dist;
+};
+
+/**
+ * Zipfian distribution (key 0 is the most popular) using the algorithm
+ * from "Quickly Generating Billion-Record Synthetic Databases" by Gray
+ * et al (the same as YCSB)
+ */
+class ZipfianKeyGenerator : public KeyGenerator {
+public:
+    ZipfianKeyGenerator(uint64_t keys, double theta)
+        : keys(keys), theta(theta), alpha(1.0 / (1.0 - theta)) {
+        if (theta <= 0 || theta >= 1) {
+            throw std::invalid_argument(
+                    "zipfian: theta must be in the range (0, 1)");
+        }
+        zetan = zeta(keys);
+        eta = (1 - std::pow(2.0 / keys, 1 - theta)) / (1 - zeta(2) / zetan);
+    }
+
+    uint64_t next(std::mt19937_64& rng) override {
+        const double u = std::uniform_real_distribution<double>()(rng);
+        const double uz = u * zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, theta)) {
+            return std::min(uint64_t(1), keys - 1);
+        }
+        const auto ret =
+                uint64_t(keys * std::pow(eta * u - eta + 1, alpha));
+        return std::min(ret, keys - 1);
+    }
+
+private:
+    double zeta(uint64_t n) const {
+        double sum = 0;
+        for (uint64_t ii = 1; ii <= n; ++ii) {
+            sum += 1.0 / std::pow(double(ii), theta);
+        }
+        return sum;
+    }
+
+    const uint64_t keys;
+    const double theta;
+    const double alpha;
+    double zetan;
+    double eta;
+};
+
+/**
+ * A fraction of the keys (the hot set) receive a fraction of the
+ * operations, and the rest of the operations go to the other keys
+ */
+class HotspotKeyGenerator : public KeyGenerator {
+public:
+    HotspotKeyGenerator(uint64_t keys, double keyFraction, double opFraction)
+        : hotKeys(std::max(uint64_t(1), uint64_t(keys * keyFraction))),
+          opFraction(opFraction),
+          hot(0, hotKeys - 1),
+          cold(std::min(hotKeys, keys - 1), keys - 1) {
+        if (keyFraction <= 0 || keyFraction > 1 || opFraction < 0 ||
+            opFraction > 1) {
+            throw std::invalid_argument(
+                    "hotspot: the fractions must be in the range (0, 1]");
+        }
+    }
+
+    uint64_t next(std::mt19937_64& rng) override {
+        if (std::uniform_real_distribution<double>()(rng) < opFraction) {
+            return hot(rng);
+        }
+        return cold(rng);
+    }
+
+private:
+    const uint64_t hotKeys;
+    const double opFraction;
+    std::uniform_int_distribution<uint64_t> hot;
+    std::uniform_int_distribution<uint64_t> cold;
+};
+
+/**
+ * Create the key generator from the specification: uniform,
+ * zipfian[:theta] or hotspot[:key_fraction[:op_fraction]]
+ */
+static std::unique_ptr<KeyGenerator> createKeyGenerator(
+        const std::string& spec, uint64_t keys) {
+    std::vector<std::string> fields;
+    std::string::size_type start = 0;
+    std::string::size_type pos;
+    while ((pos = spec.find(':', start)) != std::string::npos) {
+        fields.push_back(spec.substr(start, pos - start));
+        start = pos + 1;
+    }
+    fields.push_back(spec.substr(start));
+
+    if (fields[0] == "uniform" && fields.size() == 1) {
+        return std::unique_ptr<KeyGenerator>(new UniformKeyGenerator(keys));
+    }
+    if (fields[0] == "zipfian" && fields.size() <= 2) {
+        const double theta = fields.size() > 1 ? std::stod(fields[1]) : 0.99;
+        return std::unique_ptr<KeyGenerator>(
+                new ZipfianKeyGenerator(keys, theta));
+    }
+    if (fields[0] == "hotspot" && fields.size() <= 3) {
+        const double keyFraction =
+                fields.size() > 1 ? std::stod(fields[1]) : 0.2;
+        const double opFraction =
+                fields.size() > 2 ? std::stod(fields[2]) : 0.8;
+        return std::unique_ptr<KeyGenerator>(
+                new HotspotKeyGenerator(keys, keyFraction, opFraction));
+    }
+
+    throw std::invalid_argument("Unknown key distribution \"" + spec + "\"");
+}
+
+static std::string getKey(uint64_t index) {
+    std::string key = std::to_string(index);
+    return "mcload-" + std::string(key.size() < 10 ? 10 - key.size() : 0,
+                                   '0') + key;
+}
+
+static uint16_t getVBucket(const Config& config, uint64_t index) {
+    return config.vbuckets == 0 ? 0 : uint16_t(index % config.vbuckets);
+}
+
+static std::unique_ptr<MemcachedConnection> connect(const Config& config) {
+    in_port_t port;
+    sa_family_t family;
+    std::string host;
+    std::tie(host, port, family) =
+            cb::inet::parse_hostname(config.host, config.port);
+    if (config.family != AF_UNSPEC) {
+        family = config.family;
+    }
+
+    std::unique_ptr<MemcachedConnection> connection(
+            new MemcachedConnection(host, port, family, config.secure));
+    connection->connect();
+    connection->hello("mcload", MEMCACHED_VERSION, "load generator");
+    connection->setXerrorSupport(true);
+    if (config.serverDuration) {
+        connection->setTracingFeature(true);
+    }
+    if (!config.user.empty()) {
+        connection->authenticate(config.user, config.password,
+                                 connection->getSaslMechanisms());
+    }
+    if (!config.bucket.empty()) {
+        connection->selectBucket(config.bucket);
+    }
+    return connection;
+}
+
+/**
+ * The statistics for one type of operation
+ */
+struct OpStats {
+    OpStats()
+        : latency(new LatencyHistogram), server(new LatencyHistogram) {
+    }
+
+    void add(const OpStats& other) {
+        *latency += *other.latency;
+        *server += *other.server;
+        errors += other.errors;
+        misses += other.misses;
+    }
+
+    /// The latency seen by the client
+    std::unique_ptr<LatencyHistogram> latency;
+    /// The server duration reported by the server (if enabled)
+    std::unique_ptr<LatencyHistogram> server;
+    uint64_t errors = 0;
+    uint64_t misses = 0;
+};
+
+/**
+ * Used by the main thread to start all of the load threads at the same
+ * time once they're connected.
+ */
+class StartGate {
+public:
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return open; });
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> guard(mutex);
+        open = true;
+        cond.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool open = false;
+};
+
+class LoadThread {
+public:
+    LoadThread(const Config& config, size_t index)
+        : config(config),
+          index(index),
+          rng(config.seed + index),
+          keys(createKeyGenerator(config.distribution, config.keys)),
+          valueSize(config.valueMin, config.valueMax),
+          value(config.valueMax, 'x') {
+    }
+
+    void connectAll() {
+        for (size_t ii = 0; ii < config.connections; ++ii) {
+            connections.emplace_back(connect(config));
+        }
+    }
+
+    /**
+     * Store the keys assigned to this thread (every n'th key) so that the
+     * gets in the test finds the documents.
+     */
+    void populate() {
+        auto& connection = *connections.front();
+        uint64_t outstanding = 0;
+        for (uint64_t key = index; key < config.keys;
+             key += config.threads) {
+            sendSet(connection, key);
+            if (++outstanding == config.depth) {
+                drain(connection, outstanding);
+                outstanding = 0;
+            }
+        }
+        drain(connection, outstanding);
+    }
+
+    void run(StartGate& gate) {
+        std::vector<std::vector<Pending>> pending(connections.size());
+        for (auto& p : pending) {
+            p.resize(config.depth);
+        }
+
+        gate.wait();
+        const auto stop = Clock::now() + config.duration;
+        while (Clock::now() < stop) {
+            for (size_t ii = 0; ii < connections.size(); ++ii) {
+                for (auto& op : pending[ii]) {
+                    send(*connections[ii], op);
+                }
+            }
+            for (size_t ii = 0; ii < connections.size(); ++ii) {
+                for (auto& op : pending[ii]) {
+                    receive(*connections[ii], op);
+                }
+            }
+        }
+    }
+
+    OpStats gets;
+    OpStats sets;
+
+private:
+    struct Pending {
+        bool get;
+        Clock::time_point start;
+    };
+
+    void sendGet(MemcachedConnection& connection, uint64_t key) {
+        BinprotGetCommand cmd;
+        cmd.setKey(getKey(key));
+        cmd.setVBucket(getVBucket(config, key));
+        connection.sendCommand(cmd);
+    }
+
+    void sendSet(MemcachedConnection& connection, uint64_t key) {
+        BinprotMutationCommand cmd;
+        cmd.setMutationType(MutationType::Set);
+        cmd.setKey(getKey(key));
+        cmd.setVBucket(getVBucket(config, key));
+        cmd.addValueBuffer(
+                {reinterpret_cast<const uint8_t*>(value.data()),
+                 valueSize(rng)});
+        connection.sendCommand(cmd);
+    }
+
+    void send(MemcachedConnection& connection, Pending& op) {
+        const auto key = keys->next(rng);
+        op.get = std::uniform_int_distribution<unsigned int>(0, 99)(rng) <
+                 config.getRatio;
+        op.start = Clock::now();
+        if (op.get) {
+            sendGet(connection, key);
+        } else {
+            sendSet(connection, key);
+        }
+    }
+
+    void receive(MemcachedConnection& connection, const Pending& op) {
+        BinprotResponse response;
+        connection.recvResponse(response);
+        const auto now = Clock::now();
+
+        auto& stats = op.get ? gets : sets;
+        stats.latency->add(hrtime_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - op.start)
+                        .count()));
+        if (response.hasServerDuration()) {
+            stats.server->add(hrtime_t(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            response.getServerDuration())
+                            .count()));
+        }
+
+        if (response.getStatus() == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT) {
+            ++stats.misses;
+        } else if (!response.isSuccess()) {
+            ++stats.errors;
+        }
+    }
+
+    void drain(MemcachedConnection& connection, uint64_t count) {
+        for (uint64_t ii = 0; ii < count; ++ii) {
+            BinprotResponse response;
+            connection.recvResponse(response);
+            if (!response.isSuccess()) {
+                throw std::runtime_error(
+                        "Failed to populate " + getKey(index) + ": " +
+                        std::to_string(response.getStatus()));
+            }
+        }
+    }
+
+    const Config& config;
+    const size_t index;
+    std::mt19937_64 rng;
+    std::unique_ptr<KeyGenerator> keys;
+    std::uniform_int_distribution<size_t> valueSize;
+    const std::string value;
+    std::vector<std::unique_ptr<MemcachedConnection>> connections;
+};
+
+static double toMicros(hrtime_t ns) {
+    return double(ns) / 1000.0;
+}
+
+static void printHeader() {
+    std::cout << std::left << std::setw(10) << "Operation" << std::right
+              << std::setw(12) << "Count" << std::setw(12) << "Ops/s"
+              << std::setw(8) << "Errors";
+    for (const auto* p : {"p50", "p90", "p99", "p99.9", "p99.99", "max"}) {
+        std::cout << std::setw(10) << (std::string(p) + "us");
+    }
+    std::cout << std::endl;
+}
+
+static void printLine(const std::string& name,
+                      const LatencyHistogram& histogram,
+                      uint64_t errors,
+                      double seconds) {
+    const auto count = histogram.getCount();
+    std::cout << std::left << std::setw(10) << name << std::right
+              << std::setw(12) << count << std::setw(12) << std::fixed
+              << std::setprecision(0) << (count / seconds) << std::setw(8)
+              << errors << std::setprecision(1);
+    for (double p : {50.0, 90.0, 99.0, 99.9, 99.99, 100.0}) {
+        std::cout << std::setw(10) << toMicros(histogram.getPercentile(p));
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Write the histogram in the percentile distribution format used by
+ * HdrHistogram (which may be plotted with its tools). The values are
+ * in microseconds.
+ */
+static void writeHgrm(const std::string& file,
+                      const LatencyHistogram& histogram) {
+    std::ofstream out(file);
+    if (!out) {
+        throw std::runtime_error("Failed to open " + file);
+    }
+
+    const auto total = histogram.getCount();
+    out << std::setw(12) << "Value" << std::setw(15) << "Percentile"
+        << std::setw(11) << "TotalCount" << std::setw(17)
+        << "1/(1-Percentile)" << "\n\n";
+
+    uint64_t seen = 0;
+    double sum = 0;
+    hrtime_t max = 0;
+    out << std::fixed;
+    for (size_t ii = 0; ii < LatencyHistogram::NumBuckets; ++ii) {
+        const auto count = histogram.getBucket(ii);
+        if (count == 0) {
+            continue;
+        }
+        seen += count;
+        max = LatencyHistogram::getUpperBound(ii);
+        sum += double(count) * (LatencyHistogram::getLowerBound(ii) + max) /
+               2;
+
+        const double percentile = double(seen) / total;
+        out << std::setw(12) << std::setprecision(3) << toMicros(max)
+            << std::setw(15) << std::setprecision(12) << percentile
+            << std::setw(11) << seen;
+        if (seen < total) {
+            out << std::setw(17) << std::setprecision(2)
+                << 1.0 / (1.0 - percentile);
+        }
+        out << "\n";
+    }
+
+    out << std::setprecision(3) << "#[Mean    = "
+        << (total ? toMicros(hrtime_t(sum / total)) : 0.0)
+        << ", Max = " << toMicros(max) << "]\n"
+        << "#[Total count    = " << total << "]\n";
+}
+
+static void usage() {
+    std::cerr
+            << "Usage: mcload [options]\n"
+            << "\n"
+            << "  --host=host[:port]    The server to connect to "
+               "[localhost]\n"
+            << "  --port=port           The port to connect to [11210]\n"
+            << "  --ipv4 / --ipv6       Force IPv4 or IPv6\n"
+            << "  --ssl                 Connect over SSL\n"
+            << "  --user=name           Authenticate as the user\n"
+            << "  --password=pass       The password for the user (- to "
+               "prompt)\n"
+            << "  --bucket=name         The bucket to use\n"
+            << "  --threads=n           The number of threads [1]\n"
+            << "  --connections=n       The connections per thread [1]\n"
+            << "  --depth=n             The number of commands to pipeline "
+               "per connection [1]\n"
+            << "  --duration=seconds    How long to run the load [10]\n"
+            << "  --keys=n              The number of keys [100000]\n"
+            << "  --distribution=spec   The key distribution: uniform, "
+               "zipfian[:theta]\n"
+            << "                        or hotspot[:key_fraction[:op_"
+               "fraction]] [uniform]\n"
+            << "  --value-size=min[:max] The size of the values [256]\n"
+            << "  --get-ratio=percent   The percentage of gets (the rest "
+               "are sets) [90]\n"
+            << "  --vbuckets=n          Spread the keys over n vbuckets "
+               "[use vbucket 0]\n"
+            << "  --seed=n              Seed for the random generators [0]\n"
+            << "  --populate            Store all of the keys before the "
+               "test\n"
+            << "  --server-duration     Ask the server to report its "
+               "duration of the commands\n"
+            << "  --hgrm=prefix         Write the latency distributions to "
+               "prefix-<op>.hgrm\n";
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    struct option long_options[] = {
+            {"host", required_argument, nullptr, 'h'},
+            {"port", required_argument, nullptr, 'p'},
+            {"ipv4", no_argument, nullptr, '4'},
+            {"ipv6", no_argument, nullptr, '6'},
+            {"ssl", no_argument, nullptr, 's'},
+            {"user", required_argument, nullptr, 'u'},
+            {"password", required_argument, nullptr, 'P'},
+            {"bucket", required_argument, nullptr, 'b'},
+            {"threads", required_argument, nullptr, 't'},
+            {"connections", required_argument, nullptr, 'c'},
+            {"depth", required_argument, nullptr, 'q'},
+            {"duration", required_argument, nullptr, 'd'},
+            {"keys", required_argument, nullptr, 'k'},
+            {"distribution", required_argument, nullptr, 'D'},
+            {"value-size", required_argument, nullptr, 'v'},
+            {"get-ratio", required_argument, nullptr, 'r'},
+            {"vbuckets", required_argument, nullptr, 'V'},
+            {"seed", required_argument, nullptr, 'S'},
+            {"populate", no_argument, nullptr, 'L'},
+            {"server-duration", no_argument, nullptr, 'T'},
+            {"hgrm", required_argument, nullptr, 'o'},
+            {"help", no_argument, nullptr, '?'},
+            {nullptr, 0, nullptr, 0}};
+
+    Config config;
+
+    /* Initialize the socket subsystem */
+    cb_initialize_sockets();
+
+    try {
+        int cmd;
+        while ((cmd = getopt_long(argc,
+                                  argv,
+                                  "h:p:46su:P:b:t:c:q:d:k:D:v:r:V:S:LTo:?",
+                                  long_options,
+                                  nullptr)) != EOF) {
+            switch (cmd) {
+            case 'h':
+                config.host.assign(optarg);
+                break;
+            case 'p':
+                config.port.assign(optarg);
+                break;
+            case '4':
+                config.family = AF_INET;
+                break;
+            case '6':
+                config.family = AF_INET6;
+                break;
+            case 's':
+                config.secure = true;
+                break;
+            case 'u':
+                config.user.assign(optarg);
+                break;
+            case 'P':
+                config.password.assign(optarg);
+                break;
+            case 'b':
+                config.bucket.assign(optarg);
+                break;
+            case 't':
+                config.threads = std::stoul(optarg);
+                break;
+            case 'c':
+                config.connections = std::stoul(optarg);
+                break;
+            case 'q':
+                config.depth = std::stoul(optarg);
+                break;
+            case 'd':
+                config.duration = std::chrono::seconds(std::stoul(optarg));
+                break;
+            case 'k':
+                config.keys = std::stoull(optarg);
+                break;
+            case 'D':
+                config.distribution.assign(optarg);
+                break;
+            case 'v': {
+                const std::string spec(optarg);
+                const auto pos = spec.find(':');
+                config.valueMin = std::stoul(spec.substr(0, pos));
+                config.valueMax =
+                        pos == std::string::npos
+                                ? config.valueMin
+                                : std::stoul(spec.substr(pos + 1));
+            } break;
+            case 'r':
+                config.getRatio = std::stoul(optarg);
+                break;
+            case 'V':
+                config.vbuckets = uint16_t(std::stoul(optarg));
+                break;
+            case 'S':
+                config.seed = std::stoull(optarg);
+                break;
+            case 'L':
+                config.populate = true;
+                break;
+            case 'T':
+                config.serverDuration = true;
+                break;
+            case 'o':
+                config.hgrm.assign(optarg);
+                break;
+            default:
+                usage();
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid argument: " << e.what() << std::endl;
+        usage();
+    }
+
+    if (optind != argc || config.threads == 0 || config.connections == 0 ||
+        config.depth == 0 || config.keys == 0 || config.getRatio > 100 ||
+        config.valueMin > config.valueMax) {
+        usage();
+    }
+
+    if (config.password == "-") {
+        config.password.assign(getpass());
+    }
+
+    try {
+        std::vector<std::unique_ptr<LoadThread>> loaders;
+        for (size_t ii = 0; ii < config.threads; ++ii) {
+            loaders.emplace_back(new LoadThread(config, ii));
+            loaders.back()->connectAll();
+        }
+
+        if (config.populate) {
+            std::cout << "Storing " << config.keys << " keys..." << std::flush;
+            std::vector<std::thread> populators;
+            for (auto& loader : loaders) {
+                populators.emplace_back(&LoadThread::populate, loader.get());
+            }
+            for (auto& thread : populators) {
+                thread.join();
+            }
+            std::cout << " done" << std::endl;
+        }
+
+        StartGate gate;
+        std::vector<std::thread> threads;
+        std::atomic<bool> failed{false};
+        for (auto& loader : loaders) {
+            auto* l = loader.get();
+            threads.emplace_back([l, &gate, &failed]() {
+                try {
+                    l->run(gate);
+                } catch (const std::exception& e) {
+                    std::cerr << "Load thread failed: " << e.what()
+                              << std::endl;
+                    failed = true;
+                }
+            });
+        }
+
+        const auto start = Clock::now();
+        gate.release();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const auto seconds =
+                std::chrono::duration<double>(Clock::now() - start).count();
+
+        OpStats gets;
+        OpStats sets;
+        for (auto& loader : loaders) {
+            gets.add(loader->gets);
+            sets.add(loader->sets);
+        }
+
+        std::cout << "Ran " << config.threads * config.connections
+                  << " connections with " << config.depth
+                  << " outstanding commands each for " << std::fixed
+                  << std::setprecision(1) << seconds << "s (" << gets.misses
+                  << " get misses)" << std::endl;
+        printHeader();
+        printLine("get", *gets.latency, gets.errors, seconds);
+        printLine("set", *sets.latency, sets.errors, seconds);
+        if (config.serverDuration) {
+            printLine("get(srv)", *gets.server, gets.errors, seconds);
+            printLine("set(srv)", *sets.server, sets.errors, seconds);
+        }
+
+        if (!config.hgrm.empty()) {
+            writeHgrm(config.hgrm + "-get.hgrm", *gets.latency);
+            writeHgrm(config.hgrm + "-set.hgrm", *sets.latency);
+        }
+
+        if (failed) {
+            return EXIT_FAILURE;
+        }
+    } catch (const ConnectionError& ex) {
+        std::cerr << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    } catch (const std::runtime_error& ex) {
+        std::cerr << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
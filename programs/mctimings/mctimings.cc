@@ -28,6 +28,9 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 static uint32_t getValue(cJSON *root, const char *key) {
     cJSON *obj = cJSON_GetObjectItem(root, key);
@@ -109,6 +112,19 @@ public:
             dump("s ", 80, 0, wayout[4]);
         }
         std::cout << "Total: " << total << " operations" << std::endl;
+
+        if (!percentiles.empty()) {
+            std::cout << "Percentiles:";
+            dumpPercentiles();
+            std::cout << std::endl;
+        }
+    }
+
+    /// Print the percentiles reported by the server on the current line
+    void dumpPercentiles() const {
+        for (const auto& p : percentiles) {
+            std::cout << " p" << p.first << ": " << p.second / 1000.0 << "us";
+        }
     }
 
 private:
@@ -181,6 +197,15 @@ private:
             oldwayout = true;
         }
 
+        // Newer servers provide the percentiles (in ns) as it keeps the
+        // samples with a higher resolution than the histogram above
+        obj = cJSON_GetObjectItem(root, "percentiles");
+        if (obj != nullptr) {
+            for (auto* p = obj->child; p != nullptr; p = p->next) {
+                percentiles.emplace_back(p->string, p->valuedouble);
+            }
+        }
+
         // Calculate total and cumulative counts, and find the highest value.
         max = total = 0;
 
@@ -251,6 +276,9 @@ private:
     bool oldwayout;
 
     uint64_t total;
+
+    /// The percentile and the value (in ns) reported by the server
+    std::vector<std::pair<std::string, double>> percentiles;
 };
 
 std::string opcode2string(uint8_t opcode) {
@@ -349,8 +377,12 @@ static void request_stat_timings(MemcachedConnection& connection,
     // these responses (i.e. subdoc_execute) don't include a key,
     // so the statsMap adds them into the map with a counter to make sure
     // that you can fetch all of them. We only expect a single entry, which
-    // would be named "0"
+    // would be named "0" (or the name of the histogram of the stat group,
+    // e.g. "MultiBGFetcherTask:wait" for "tasktimings MultiBGFetcherTask:wait")
     auto iter = map.find("0");
+    if (iter == map.end() && map.size() == 1) {
+        iter = map.begin();
+    }
     if (iter == map.end()) {
         std::cerr << "Failed to fetch statistics for \"" << key << "\""
                   << std::endl;
@@ -378,14 +410,86 @@ static void request_stat_timings(MemcachedConnection& connection,
     }
 }
 
+/**
+ * Subscribe to the timings of the opcodes, and print the samples the
+ * server pushes every interval (until the connection is closed)
+ */
+static void follow_cmd_timings(MemcachedConnection& connection,
+                               const std::string& bucket,
+                               const std::vector<std::string>& opcodes,
+                               uint32_t interval,
+                               bool verbose) {
+    std::string key = "timings.subscribe?buckets=" + bucket + "&opcodes=";
+    for (const auto& opcode : opcodes) {
+        if (memcached_text_2_opcode(opcode.c_str()) ==
+            PROTOCOL_BINARY_CMD_INVALID) {
+            std::cerr << "Only command timings may be followed: " << opcode
+                      << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (key.back() != '=') {
+            key.push_back(',');
+        }
+        key.append(opcode);
+    }
+
+    connection.setDuplexSupport(true);
+    connection.ioctl_set(key, std::to_string(interval));
+
+    while (true) {
+        Frame frame;
+        connection.recvFrame(frame, false);
+        if (frame.getMagic() != cb::mcbp::Magic::ServerRequest) {
+            continue;
+        }
+        const auto* request = frame.getRequest();
+        if (request->getServerOpcode() !=
+            cb::mcbp::ServerOpcode::TimingsNotification) {
+            continue;
+        }
+
+        const auto value = request->getValue();
+        unique_cJSON_ptr json(cJSON_Parse(
+                std::string{reinterpret_cast<const char*>(value.data()),
+                            value.size()}
+                        .c_str()));
+        auto* obj = json ? cJSON_GetObjectItem(json.get(), "timings")
+                         : nullptr;
+        if (obj == nullptr) {
+            std::cerr << "Fatal error: invalid timings notification"
+                      << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        for (auto* entry = obj->child; entry != nullptr; entry = entry->next) {
+            Timings timings(entry);
+            if (verbose) {
+                timings.dumpHistogram(entry->string);
+            } else {
+                std::cout << entry->string << " " << timings.getTotal()
+                          << " operations";
+                timings.dumpPercentiles();
+                std::cout << std::endl;
+            }
+        }
+    }
+}
+
 void usage() {
     std::cerr << "Usage mctimings [-h host[:port]] [-p port] [-u user]"
               << " [-P pass] [-S passFromStdin] [-b bucket] [-s]"
-              << "-v [opcode / stat_name]*" << std::endl
+              << " [-f interval] -v [opcode / stat_name]*" << std::endl
+              << std::endl
+              << "    -f interval  Print the timings of the opcodes "
+              << "recorded in every interval" << std::endl
+              << "                 (in seconds) as the server pushes them"
+              << std::endl
               << std::endl
               << "Example:" << std::endl
-              << "    mctimings -h localhost:11210 -v GET SET"
-              << std::endl;
+              << "    mctimings -h localhost:11210 -v GET SET" << std::endl
+              << "    mctimings -b default -v \"tasktimings "
+              << "MultiBGFetcherTask:wait\"" << std::endl
+              << "    mctimings -b default -f 1 GET SET" << std::endl;
 }
 
 int main(int argc, char** argv) {
@@ -398,11 +502,12 @@ int main(int argc, char** argv) {
     sa_family_t family = AF_UNSPEC;
     bool verbose = false;
     bool secure = false;
+    uint32_t interval = 0;
 
     /* Initialize the socket subsystem */
     cb_initialize_sockets();
 
-    while ((cmd = getopt(argc, argv, "46h:p:u:b:P:Ssv")) != EOF) {
+    while ((cmd = getopt(argc, argv, "46h:p:u:b:P:Ssvf:")) != EOF) {
         switch (cmd) {
         case '6' :
             family = AF_INET6;
@@ -434,6 +539,13 @@ int main(int argc, char** argv) {
         case 'v' :
             verbose = true;
             break;
+        case 'f':
+            interval = uint32_t(std::strtoul(optarg, nullptr, 10));
+            if (interval == 0) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            break;
         default:
             usage();
             return EXIT_FAILURE;
@@ -474,7 +586,17 @@ int main(int argc, char** argv) {
             connection.selectBucket(bucket);
         }
 
-        if (optind == argc) {
+        if (interval != 0) {
+            if (optind == argc) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            follow_cmd_timings(connection,
+                               bucket,
+                               {argv + optind, argv + argc},
+                               interval,
+                               verbose);
+        } else if (optind == argc) {
             for (int ii = 0; ii < 256; ++ii) {
                 request_cmd_timings(connection, bucket, (uint8_t)ii, verbose,
                                     true);
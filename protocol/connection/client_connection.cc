@@ -439,7 +439,8 @@ void MemcachedConnection::recvFrame(Frame& frame,
     if (magic != cb::mcbp::Magic::ClientRequest &&
         magic != cb::mcbp::Magic::ClientResponse &&
         magic != cb::mcbp::Magic::ServerRequest &&
-        magic != cb::mcbp::Magic::ServerResponse) {
+        magic != cb::mcbp::Magic::ServerResponse &&
+        magic != cb::mcbp::Magic::AltClientResponse) {
         throw std::runtime_error("Invalid magic received: " +
                                  std::to_string(frame.payload.at(0)));
     }
@@ -615,8 +616,10 @@ void MemcachedConnection::createBucket(const std::string& name,
     }
 }
 
-void MemcachedConnection::deleteBucket(const std::string& name) {
-    BinprotGenericCommand command(PROTOCOL_BINARY_CMD_DELETE_BUCKET, name);
+void MemcachedConnection::deleteBucket(const std::string& name,
+                                       const std::string& config) {
+    BinprotGenericCommand command(
+            PROTOCOL_BINARY_CMD_DELETE_BUCKET, name, config);
     sendCommand(command);
     BinprotResponse response;
     recvResponse(response);
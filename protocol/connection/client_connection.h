@@ -311,8 +311,10 @@ public:
      * Delete the named bucket
      *
      * @param name the name of the bucket
+     * @param config the deletion options (e.g. "force=true;async=true")
      */
-    void deleteBucket(const std::string& name);
+    void deleteBucket(const std::string& name,
+                      const std::string& config = "");
 
     /**
      * Select the named bucket
@@ -672,6 +674,10 @@ public:
 
     void setUnorderedExecutionMode(ExecutionMode mode);
 
+    void setTracingFeature(bool enable) {
+        setFeature(cb::mcbp::Feature::Tracing, enable);
+    }
+
     /**
      * Get the error map from the server
      *
@@ -16,6 +16,7 @@
  */
 #include "client_mcbp_commands.h"
 #include <mcbp/mcbp.h>
+#include <mcbp/protocol/server_duration.h>
 #include <array>
 
 void BinprotCommand::encode(std::vector<uint8_t>& buf) const {
@@ -137,6 +138,35 @@ void BinprotSubdocCommand::encode(std::vector<uint8_t>& buf) const {
 
 void BinprotResponse::assign(std::vector<uint8_t>&& srcbuf) {
     payload = std::move(srcbuf);
+    serverDurationReceived = false;
+    if (getHeader().response.magic ==
+        uint8_t(cb::mcbp::Magic::AltClientResponse)) {
+        stripFramingExtras();
+    }
+}
+
+void BinprotResponse::stripFramingExtras() {
+    // The length fields are in host local byte order, and the (network
+    // order) framing extras length and key length bytes forms the upper
+    // and lower byte in the 16 bit keylen
+    auto& header = getHeader().response;
+    const size_t framing = header.keylen >> 8;
+    if (framing > header.bodylen) {
+        throw std::runtime_error(
+                "BinprotResponse::stripFramingExtras: framing extras exceeds "
+                "the body");
+    }
+
+    const auto* start = payload.data() + getHeaderLen();
+    serverDurationReceived = cb::mcbp::findServerDuration({start, framing},
+                                                          serverDuration);
+    payload.erase(payload.begin() + getHeaderLen(),
+                  payload.begin() + getHeaderLen() + framing);
+
+    auto& res = getHeader().response;
+    res.magic = PROTOCOL_BINARY_RES;
+    res.keylen = res.keylen & 0xff;
+    res.bodylen -= uint32_t(framing);
 }
 
 void BinprotSubdocResponse::assign(std::vector<uint8_t>&& srcbuf) {
@@ -192,6 +222,33 @@ void BinprotGetCommand::encode(std::vector<uint8_t>& buf) const {
     buf.insert(buf.end(), key.begin(), key.end());
 }
 
+/// Encode the keys of a GET_MULTI / GET_META_MULTI command
+static std::vector<uint8_t> encodeMultiKeys(
+        const std::vector<std::pair<std::string, uint16_t>>& keys) {
+    std::vector<uint8_t> body;
+    for (const auto& entry : keys) {
+        mcbp::getmulti::KeyHeader kh;
+        kh.vbucket = htons(entry.second);
+        kh.keylen = htons(uint16_t(entry.first.size()));
+        const auto* ptr = reinterpret_cast<const uint8_t*>(&kh);
+        body.insert(body.end(), ptr, ptr + sizeof(kh));
+        body.insert(body.end(), entry.first.begin(), entry.first.end());
+    }
+    return body;
+}
+
+void BinprotGetMultiCommand::encode(std::vector<uint8_t>& buf) const {
+    const auto body = encodeMultiKeys(keys);
+    writeHeader(buf, body.size(), 0);
+    buf.insert(buf.end(), body.begin(), body.end());
+}
+
+void BinprotGetMetaMultiCommand::encode(std::vector<uint8_t>& buf) const {
+    const auto body = encodeMultiKeys(keys);
+    writeHeader(buf, body.size(), 0);
+    buf.insert(buf.end(), body.begin(), body.end());
+}
+
 void BinprotGetAndLockCommand::encode(std::vector<uint8_t>& buf) const {
     writeHeader(buf, 0, sizeof(lock_timeout));
     protocol_binary_request_getl *req;
@@ -19,6 +19,8 @@
 #include <platform/sized_buffer.h>
 #include "client_connection.h"
 
+#include <chrono>
+
 /**
  * This is the base class used for binary protocol commands. You probably
  * want to use one of the subclasses. Do not subclass this class directly,
@@ -369,6 +371,19 @@ public:
                 payload.data());
     }
 
+    /**
+     * Did the server report the time it spent on the request (it does
+     * so once the client enables Feature::Tracing)
+     */
+    bool hasServerDuration() const {
+        return serverDurationReceived;
+    }
+
+    /// Get the time the server spent on the request
+    std::chrono::microseconds getServerDuration() const {
+        return serverDuration;
+    }
+
     /**
      * Populate this response from a response
      * @param srcbuf The buffer containing the response.
@@ -390,7 +405,17 @@ protected:
         return *reinterpret_cast<protocol_binary_response_header*>(
                 payload.data());
     }
+
+    /**
+     * Pick up the server duration from the framing extras of an
+     * alternative response, and strip the framing extras off so that
+     * the rest of the packet looks like a normal response
+     */
+    void stripFramingExtras();
+
     std::vector<uint8_t> payload;
+    bool serverDurationReceived = false;
+    std::chrono::microseconds serverDuration{0};
 };
 
 class BinprotSubdocCommand : public BinprotCommandT<BinprotSubdocCommand> {
@@ -821,6 +846,48 @@ public:
     void encode(std::vector<uint8_t>& buf) const override;
 };
 
+/**
+ * The GET_MULTI command. The server sends a BinprotGetResponse for each
+ * key (except the ones which don't exist) followed by a success response
+ * without a key.
+ */
+class BinprotGetMultiCommand
+    : public BinprotCommandT<BinprotGetMultiCommand,
+                             PROTOCOL_BINARY_CMD_GET_MULTI> {
+public:
+    void encode(std::vector<uint8_t>& buf) const override;
+
+    BinprotGetMultiCommand& addKey(const std::string& key,
+                                   uint16_t vbucket = 0) {
+        keys.emplace_back(key, vbucket);
+        return *this;
+    }
+
+protected:
+    std::vector<std::pair<std::string, uint16_t>> keys;
+};
+
+/**
+ * The GET_META_MULTI command. The server sends a response with the key
+ * for each of the keys (with the GetMetaResponse in the extras if it
+ * was found), followed by a success response without a key.
+ */
+class BinprotGetMetaMultiCommand
+    : public BinprotCommandT<BinprotGetMetaMultiCommand,
+                             PROTOCOL_BINARY_CMD_GET_META_MULTI> {
+public:
+    void encode(std::vector<uint8_t>& buf) const override;
+
+    BinprotGetMetaMultiCommand& addKey(const std::string& key,
+                                       uint16_t vbucket = 0) {
+        keys.emplace_back(key, vbucket);
+        return *this;
+    }
+
+protected:
+    std::vector<std::pair<std::string, uint16_t>> keys;
+};
+
 class BinprotGetAndLockCommand
     : public BinprotCommandT<BinprotGetAndLockCommand, PROTOCOL_BINARY_CMD_GET_LOCKED> {
 public:
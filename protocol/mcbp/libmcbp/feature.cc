@@ -49,6 +49,10 @@ std::string to_string(cb::mcbp::Feature feature) {
         return "Clustermap change notification";
     case cb::mcbp::Feature::UnorderedExecution:
         return "Unordered execution";
+    case cb::mcbp::Feature::Tracing:
+        return "Tracing";
+    case cb::mcbp::Feature::Durability:
+        return "Durability";
     }
 
     throw std::invalid_argument(
@@ -29,6 +29,8 @@ std::string to_string(cb::mcbp::Magic magic) {
         return "ServerRequest";
     case cb::mcbp::Magic::ServerResponse:
         return "ServerResponse";
+    case cb::mcbp::Magic::AltClientResponse:
+        return "AltClientResponse";
     }
 
     throw std::invalid_argument(
@@ -42,6 +44,7 @@ bool cb::mcbp::is_legal(cb::mcbp::Magic magic) {
     case Magic::ClientResponse:
     case Magic::ServerRequest:
     case Magic::ServerResponse:
+    case Magic::AltClientResponse:
         return true;
     }
 
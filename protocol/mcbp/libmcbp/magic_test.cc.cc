@@ -29,7 +29,8 @@ const std::map<cb::mcbp::Magic, std::string> blueprint = {
         {{cb::mcbp::Magic::ClientRequest, "ClientRequest"},
          {cb::mcbp::Magic::ClientResponse, "ClientResponse"},
          {cb::mcbp::Magic::ServerRequest, "ServerRequest"},
-         {cb::mcbp::Magic::ServerResponse, "ServerResponse"}}};
+         {cb::mcbp::Magic::ServerResponse, "ServerResponse"},
+         {cb::mcbp::Magic::AltClientResponse, "AltClientResponse"}}};
 
 TEST(Magic, to_string) {
     for (int ii = 0; ii < 0x100; ++ii) {
@@ -109,6 +109,8 @@ std::string to_string(cb::mcbp::ClientOpcode opcode) {
         return "AUDIT_CONFIG_RELOAD";
     case ClientOpcode::Shutdown:
         return "SHUTDOWN";
+    case ClientOpcode::GetMulti:
+        return "GET_MULTI";
     case ClientOpcode::Rget:
         return "RGET";
     case ClientOpcode::Rset:
@@ -271,6 +273,12 @@ std::string to_string(cb::mcbp::ClientOpcode opcode) {
         return "GET_KEYS";
     case ClientOpcode::CollectionsSetManifest:
         return "COLLECTIONS_SET_MANIFEST";
+    case ClientOpcode::RangeScan:
+        return "RANGE_SCAN";
+    case ClientOpcode::WithMetaBatch:
+        return "WITH_META_BATCH";
+    case ClientOpcode::GetMetaMulti:
+        return "GET_META_MULTI";
     case ClientOpcode::SetDriftCounterState:
         return "SET_DRIFT_COUNTER_STATE";
     case ClientOpcode::GetAdjustedTime:
@@ -341,6 +349,8 @@ std::string to_string(cb::mcbp::ServerOpcode opcode) {
     switch (opcode) {
     case ServerOpcode::ClustermapChangeNotification:
         return "ClustermapChangeNotification";
+    case ServerOpcode::TimingsNotification:
+        return "TimingsNotification";
     }
     throw std::invalid_argument(
             "to_string(cb::mcbp::ServerOpcode): Invalid opcode: " +
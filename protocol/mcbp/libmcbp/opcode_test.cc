@@ -70,6 +70,7 @@ const std::map<cb::mcbp::ClientOpcode, std::string> client_blueprint = {
          {ClientOpcode::AuditPut, "AUDIT_PUT"},
          {ClientOpcode::AuditConfigReload, "AUDIT_CONFIG_RELOAD"},
          {ClientOpcode::Shutdown, "SHUTDOWN"},
+         {ClientOpcode::GetMulti, "GET_MULTI"},
          {ClientOpcode::Rget, "RGET"},
          {ClientOpcode::Rset, "RSET"},
          {ClientOpcode::Rsetq, "RSETQ"},
@@ -151,6 +152,9 @@ const std::map<cb::mcbp::ClientOpcode, std::string> client_blueprint = {
          {ClientOpcode::SeqnoPersistence, "SEQNO_PERSISTENCE"},
          {ClientOpcode::GetKeys, "GET_KEYS"},
          {ClientOpcode::CollectionsSetManifest, "COLLECTIONS_SET_MANIFEST"},
+         {ClientOpcode::RangeScan, "RANGE_SCAN"},
+         {ClientOpcode::WithMetaBatch, "WITH_META_BATCH"},
+         {ClientOpcode::GetMetaMulti, "GET_META_MULTI"},
          {ClientOpcode::SetDriftCounterState, "SET_DRIFT_COUNTER_STATE"},
          {ClientOpcode::GetAdjustedTime, "GET_ADJUSTED_TIME"},
          {ClientOpcode::SubdocGet, "SUBDOC_GET"},
@@ -245,7 +249,8 @@ TEST(ClientOpcode_to_opcode, SpaceMayBeUsed) {
 
 const std::map<cb::mcbp::ServerOpcode, std::string> server_blueprint = {
         {{ServerOpcode::ClustermapChangeNotification,
-          "ClustermapChangeNotification"}}};
+          "ClustermapChangeNotification"},
+         {ServerOpcode::TimingsNotification, "TimingsNotification"}}};
 
 TEST(ServerOpcode, to_string) {
     for (int ii = 0; ii < 0x100; ++ii) {
@@ -0,0 +1,78 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <mcbp/protocol/server_duration.h>
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+uint16_t cb::mcbp::encodeServerDuration(std::chrono::microseconds duration) {
+    if (duration.count() <= 0) {
+        return 0;
+    }
+
+    const auto encoded = std::round(
+            std::pow(double(duration.count()) * 2, 1.0 / 1.74));
+    if (encoded > std::numeric_limits<uint16_t>::max()) {
+        return std::numeric_limits<uint16_t>::max();
+    }
+    return uint16_t(encoded);
+}
+
+std::chrono::microseconds cb::mcbp::decodeServerDuration(uint16_t encoded) {
+    return std::chrono::microseconds(
+            uint64_t(std::pow(double(encoded), 1.74) / 2));
+}
+
+void cb::mcbp::writeServerDurationFrame(uint8_t* dest,
+                                        std::chrono::microseconds duration) {
+    const auto encoded = encodeServerDuration(duration);
+    dest[0] = (uint8_t(ResponseFrameInfoId::ServerDuration) << 4) |
+              uint8_t(sizeof(encoded));
+    dest[1] = uint8_t(encoded >> 8);
+    dest[2] = uint8_t(encoded & 0xff);
+}
+
+bool cb::mcbp::findServerDuration(cb::const_byte_buffer framing,
+                                  std::chrono::microseconds& duration) {
+    size_t offset = 0;
+    while (offset < framing.size()) {
+        const auto id = ResponseFrameInfoId(framing[offset] >> 4);
+        const size_t size = framing[offset] & 0x0f;
+        ++offset;
+        if (offset + size > framing.size()) {
+            throw std::invalid_argument(
+                    "cb::mcbp::findServerDuration: frame info object exceeds "
+                    "the framing extras");
+        }
+
+        if (id == ResponseFrameInfoId::ServerDuration) {
+            if (size != sizeof(uint16_t)) {
+                throw std::invalid_argument(
+                        "cb::mcbp::findServerDuration: invalid server "
+                        "duration size: " +
+                        std::to_string(size));
+            }
+            duration = decodeServerDuration(
+                    uint16_t(framing[offset] << 8) | framing[offset + 1]);
+            return true;
+        }
+        offset += size;
+    }
+
+    return false;
+}
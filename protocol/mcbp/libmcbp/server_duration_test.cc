@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <mcbp/protocol/server_duration.h>
+
+#include <array>
+#include <stdexcept>
+
+using std::chrono::microseconds;
+
+TEST(ServerDuration, Zero) {
+    EXPECT_EQ(0, cb::mcbp::encodeServerDuration(microseconds(0)));
+    EXPECT_EQ(microseconds(0), cb::mcbp::decodeServerDuration(0));
+}
+
+TEST(ServerDuration, Precision) {
+    for (uint64_t us = 100; us < 100000000; us *= 3) {
+        const auto decoded = cb::mcbp::decodeServerDuration(
+                cb::mcbp::encodeServerDuration(microseconds(us)));
+        EXPECT_NEAR(double(us), double(decoded.count()), us * 0.05)
+                << "for " << us << "us";
+    }
+}
+
+TEST(ServerDuration, Saturate) {
+    EXPECT_EQ(std::numeric_limits<uint16_t>::max(),
+              cb::mcbp::encodeServerDuration(std::chrono::hours(1)));
+}
+
+TEST(ServerDuration, Frame) {
+    std::array<uint8_t, 1 + cb::mcbp::ServerDurationFrameSize> framing;
+    // Prefix the duration with an (unknown) empty frame info object
+    framing[0] = 0xf0;
+    cb::mcbp::writeServerDurationFrame(framing.data() + 1,
+                                       microseconds(1000));
+    EXPECT_EQ(0x02, framing[1]);
+
+    microseconds duration(0);
+    EXPECT_TRUE(cb::mcbp::findServerDuration({framing.data(), framing.size()},
+                                             duration));
+    EXPECT_NEAR(1000, duration.count(), 10);
+
+    EXPECT_FALSE(cb::mcbp::findServerDuration({framing.data(), 1}, duration));
+    EXPECT_THROW(cb::mcbp::findServerDuration({framing.data(), 3}, duration),
+                 std::invalid_argument);
+}
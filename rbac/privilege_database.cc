@@ -185,6 +185,32 @@ PrivilegeAccess PrivilegeContext::check(Privilege privilege) const {
     return PrivilegeAccess::Fail;
 }
 
+bool PrivilegeContext::isStale() const {
+    return generation != cb::rbac::generation;
+}
+
+PrivilegeAccess PrivilegeContext::getCachedAccess(uint8_t command) const {
+    if (!cachedCommands.test(command) || isStale()) {
+        return PrivilegeAccess::Stale;
+    }
+
+    if (allowedCommands.test(command)) {
+        return PrivilegeAccess::Ok;
+    }
+
+    return PrivilegeAccess::Fail;
+}
+
+void PrivilegeContext::setCachedAccess(uint8_t command,
+                                       PrivilegeAccess access) {
+    if (access == PrivilegeAccess::Stale) {
+        return;
+    }
+
+    cachedCommands.set(command);
+    allowedCommands.set(command, access == PrivilegeAccess::Ok);
+}
+
 std::string PrivilegeContext::to_string() const {
     if (mask.all()) {
         return "[all]";
@@ -209,6 +235,7 @@ std::string PrivilegeContext::to_string() const {
 bool PrivilegeContext::dropPrivilege(Privilege privilege) {
     if (mask[int(privilege)]) {
         mask[int(privilege)] = false;
+        cachedCommands.reset();
         return true;
     }
 
@@ -224,6 +251,7 @@ void PrivilegeContext::setBucketPrivileges() {
 }
 
 void PrivilegeContext::setBucketPrivilegeBits(bool value) {
+    cachedCommands.reset();
     mask[int(Privilege::Read)] = value;
     mask[int(Privilege::Insert)] = value;
     mask[int(Privilege::Upsert)] = value;
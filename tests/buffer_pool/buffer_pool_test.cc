@@ -0,0 +1,108 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/buffer_pool.h>
+#include <gtest/gtest.h>
+
+TEST(BufferPoolTest, AllocationSize) {
+    EXPECT_EQ(2048, BufferPool::getAllocationSize(1));
+    EXPECT_EQ(2048, BufferPool::getAllocationSize(2048));
+    EXPECT_EQ(8192, BufferPool::getAllocationSize(2049));
+    EXPECT_EQ(2 * 1024 * 1024, BufferPool::getAllocationSize(2 * 1024 * 1024));
+    // Bigger than the max size class
+    EXPECT_EQ(3 * 1024 * 1024, BufferPool::getAllocationSize(3 * 1024 * 1024));
+}
+
+TEST(BufferPoolTest, GetMiss) {
+    BufferPool pool;
+    EXPECT_FALSE(pool.get(100));
+    EXPECT_EQ(0, pool.getHits());
+    EXPECT_EQ(1, pool.getMisses());
+}
+
+TEST(BufferPoolTest, ReleaseAndGet) {
+    BufferPool pool;
+    pool.release(BufferPool::allocate(100), 0);
+    EXPECT_EQ(2048, pool.getSize());
+
+    auto buffer = pool.get(100);
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(2048, buffer->capacity());
+    EXPECT_EQ(0, pool.getSize());
+    EXPECT_EQ(1, pool.getHits());
+    EXPECT_EQ(0, pool.getMisses());
+}
+
+TEST(BufferPoolTest, SizeClasses) {
+    BufferPool pool;
+    pool.release(BufferPool::allocate(100), 0);
+
+    // The small buffer can't be used for a big packet
+    EXPECT_FALSE(pool.get(10000));
+
+    pool.release(BufferPool::allocate(10000), 0);
+    auto buffer = pool.get(10000);
+    ASSERT_TRUE(buffer);
+    EXPECT_LE(10000, buffer->capacity());
+
+    // And the small one is still there
+    buffer = pool.get(100);
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0, pool.getSize());
+}
+
+TEST(BufferPoolTest, NonEmptyBuffersAreNotPooled) {
+    BufferPool pool;
+    auto buffer = BufferPool::allocate(100);
+    buffer->produced(10);
+    pool.release(std::move(buffer), 0);
+    EXPECT_EQ(0, pool.getSize());
+}
+
+TEST(BufferPoolTest, HugeBuffersAreNotPooled) {
+    BufferPool pool(16 * 1024 * 1024);
+    pool.release(BufferPool::allocate(3 * 1024 * 1024), 0);
+    EXPECT_EQ(0, pool.getSize());
+}
+
+TEST(BufferPoolTest, MaxSize) {
+    BufferPool pool(4096);
+    pool.release(BufferPool::allocate(100), 0);
+    pool.release(BufferPool::allocate(100), 0);
+    pool.release(BufferPool::allocate(100), 0);
+    EXPECT_EQ(4096, pool.getSize());
+}
+
+TEST(BufferPoolTest, IdleBuffersAreTrimmed) {
+    BufferPool pool(BufferPool::DefaultMaxSize, 10);
+    pool.release(BufferPool::allocate(100), 0);
+    pool.release(BufferPool::allocate(100), 5);
+    pool.trim(10);
+    EXPECT_EQ(4096, pool.getSize());
+    pool.trim(11);
+    EXPECT_EQ(2048, pool.getSize());
+    pool.trim(16);
+    EXPECT_EQ(0, pool.getSize());
+}
+
+TEST(BufferPoolTest, Clear) {
+    BufferPool pool;
+    pool.release(BufferPool::allocate(100), 0);
+    pool.release(BufferPool::allocate(10000), 0);
+    pool.clear();
+    EXPECT_EQ(0, pool.getSize());
+    EXPECT_FALSE(pool.get(100));
+}
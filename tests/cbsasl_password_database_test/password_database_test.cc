@@ -249,6 +249,34 @@ TEST_F(UserTest, InvalidLabel) {
                  std::runtime_error);
 }
 
+// The dummy users keep the same salt (as the real users do), which isn't
+// the one of another unknown user
+TEST_F(UserTest, Dummy) {
+    auto u = cb::sasl::UserFactory::createDummy("unknown",
+                                                Mechanism::SCRAM_SHA512);
+    EXPECT_TRUE(u.isDummy());
+    const auto& md = u.getPassword(Mechanism::SCRAM_SHA512);
+    EXPECT_EQ(cb::crypto::SHA512_DIGEST_SIZE,
+              Couchbase::Base64::decode(md.getSalt()).size());
+    EXPECT_EQ(cb::crypto::SHA512_DIGEST_SIZE, md.getPassword().size());
+    EXPECT_THROW(u.getPassword(Mechanism::SCRAM_SHA1),
+                 std::invalid_argument);
+
+    auto again = cb::sasl::UserFactory::createDummy("unknown",
+                                                    Mechanism::SCRAM_SHA512);
+    EXPECT_EQ(md.getSalt(),
+              again.getPassword(Mechanism::SCRAM_SHA512).getSalt());
+
+    auto other = cb::sasl::UserFactory::createDummy("other",
+                                                    Mechanism::SCRAM_SHA512);
+    EXPECT_NE(md.getSalt(),
+              other.getPassword(Mechanism::SCRAM_SHA512).getSalt());
+
+    EXPECT_THROW(cb::sasl::UserFactory::createDummy("unknown",
+                                                    Mechanism::PLAIN),
+                 std::logic_error);
+}
+
 class PasswordDatabaseTest : public ::testing::Test {
 public:
     void SetUp() {
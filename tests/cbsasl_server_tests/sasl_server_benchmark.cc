@@ -0,0 +1,137 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmark the SCRAM authentications per second the server side of
+ * cbsasl handles. Each iteration runs the handshake of a client with a
+ * wrong password (the server-first-message, and the verification of the
+ * client proof) for either the known user of the password file or an
+ * unknown user (a new one each time, like a burst of guessed names).
+ * The two should cost about the same, so that the time taken doesn't
+ * tell whether a user exists (and unknown users don't cost more).
+ */
+
+#include "config.h"
+
+#include <benchmark/benchmark.h>
+#include <cbcrypto/cbcrypto.h>
+#include <cbsasl/cbsasl.h>
+#include <platform/base64.h>
+
+#include <array>
+#include <cstring>
+#include <string>
+
+static char envptr[1024]{"CBSASL_PWFILE=" SOURCE_ROOT
+    "/tests/cbsasl_server_tests/sasl_server_test.json"};
+
+static const char mechanisms[] = "SCRAM-SHA512 SCRAM-SHA256 SCRAM-SHA1";
+
+static int sasl_getopt_callback(void*, const char*,
+                                const char* option,
+                                const char** result,
+                                unsigned* len) {
+    if (option == nullptr || result == nullptr || len == nullptr) {
+        return CBSASL_BADPARAM;
+    }
+
+    if (strcmp(option, "sasl mechanisms") == 0) {
+        *result = mechanisms;
+        *len = unsigned(strlen(mechanisms));
+        return CBSASL_OK;
+    }
+
+    return CBSASL_FAIL;
+}
+
+struct Sha1 {
+    static constexpr const char* name = "SCRAM-SHA1";
+    static const int digestSize = cb::crypto::SHA1_DIGEST_SIZE;
+};
+
+struct Sha256 {
+    static constexpr const char* name = "SCRAM-SHA256";
+    static const int digestSize = cb::crypto::SHA256_DIGEST_SIZE;
+};
+
+struct Sha512 {
+    static constexpr const char* name = "SCRAM-SHA512";
+    static const int digestSize = cb::crypto::SHA512_DIGEST_SIZE;
+};
+
+template <typename Mech>
+void ScramAuthBenchmark(benchmark::State& state) {
+    putenv(envptr);
+    std::array<cbsasl_callback_t, 2> callbacks;
+    callbacks[0].id = CBSASL_CB_GETOPT;
+    callbacks[0].proc = (int (*)(void))sasl_getopt_callback;
+    callbacks[0].context = nullptr;
+    callbacks[1].id = CBSASL_CB_LIST_END;
+    callbacks[1].proc = nullptr;
+    callbacks[1].context = nullptr;
+    if (cbsasl_server_init(callbacks.data(), "sasl_server_benchmark") !=
+        CBSASL_OK) {
+        state.SkipWithError("cbsasl_server_init failed");
+        return;
+    }
+
+    const bool unknown = state.range(0) != 0;
+    const std::string clientNonce = "fyko+d2lbbFgONRv9qkxdawL";
+    const std::string proof =
+            Couchbase::Base64::encode(std::string(Mech::digestSize, 'x'));
+    uint64_t count = 0;
+
+    while (state.KeepRunning()) {
+        const std::string username =
+                unknown ? "unknown" + std::to_string(count++) : "mikewied";
+        const std::string clientFirst =
+                "n,,n=" + username + ",r=" + clientNonce;
+
+        cbsasl_conn_t* conn = nullptr;
+        cbsasl_server_new(nullptr, nullptr, nullptr, nullptr, nullptr,
+                          nullptr, 0, &conn);
+        const char* out = nullptr;
+        unsigned outlen = 0;
+        auto err = cbsasl_server_start(conn, Mech::name, clientFirst.data(),
+                                       unsigned(clientFirst.size()), &out,
+                                       &outlen);
+        if (err != CBSASL_CONTINUE) {
+            cbsasl_dispose(&conn);
+            state.SkipWithError("cbsasl_server_start failed");
+            break;
+        }
+
+        // The combined nonce is the first attribute of server-first-message
+        const std::string serverFirst(out, outlen);
+        const auto nonce = serverFirst.substr(2, serverFirst.find(',') - 2);
+        const std::string clientFinal = "c=biws,r=" + nonce + ",p=" + proof;
+        err = cbsasl_server_step(conn, clientFinal.data(),
+                                 unsigned(clientFinal.size()), &out, &outlen);
+        benchmark::DoNotOptimize(err);
+        cbsasl_dispose(&conn);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    cbsasl_server_term();
+}
+
+// Args: 0 for the known user, 1 for unknown users
+BENCHMARK_TEMPLATE(ScramAuthBenchmark, Sha1)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(ScramAuthBenchmark, Sha256)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(ScramAuthBenchmark, Sha512)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN()
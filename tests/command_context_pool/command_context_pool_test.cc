@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/command_context_pool.h>
+#include <daemon/protocol/mcbp/command_context.h>
+#include <gtest/gtest.h>
+
+#include <new>
+#include <vector>
+
+TEST(CommandContextPoolTest, ReuseMemory) {
+    CommandContextPool pool;
+    auto* ptr = pool.allocate(100);
+    EXPECT_EQ(1u, pool.getHeapAllocations());
+    pool.deallocate(ptr, 100);
+
+    // Any size in the same size class may reuse the memory
+    EXPECT_EQ(ptr, pool.allocate(128));
+    EXPECT_EQ(1u, pool.getHeapAllocations());
+
+    // But not sizes in other classes
+    auto* other = pool.allocate(129);
+    EXPECT_NE(ptr, other);
+    EXPECT_EQ(2u, pool.getHeapAllocations());
+
+    pool.deallocate(ptr, 128);
+    pool.deallocate(other, 129);
+}
+
+TEST(CommandContextPoolTest, SteadyState) {
+    CommandContextPool pool;
+    std::vector<void*> blocks(16);
+    for (int round = 0; round < 10; ++round) {
+        for (size_t ii = 0; ii < blocks.size(); ++ii) {
+            blocks[ii] = pool.allocate(64 * (1 + (ii % 4)));
+        }
+        for (size_t ii = 0; ii < blocks.size(); ++ii) {
+            pool.deallocate(blocks[ii], 64 * (1 + (ii % 4)));
+        }
+    }
+    EXPECT_EQ(blocks.size(), pool.getHeapAllocations());
+}
+
+TEST(CommandContextPoolTest, BigContexts) {
+    CommandContextPool pool;
+    const size_t size = CommandContextPool::MaxSize + 1;
+    for (int ii = 0; ii < 2; ++ii) {
+        pool.deallocate(pool.allocate(size), size);
+    }
+    EXPECT_EQ(2u, pool.getHeapAllocations());
+}
+
+TEST(CommandContextPoolTest, MaxFree) {
+    CommandContextPool pool;
+    std::vector<void*> blocks(CommandContextPool::MaxFree + 1);
+    for (auto& block : blocks) {
+        block = pool.allocate(64);
+    }
+    for (auto* block : blocks) {
+        pool.deallocate(block, 64);
+    }
+    for (auto& block : blocks) {
+        block = pool.allocate(64);
+    }
+    EXPECT_EQ(blocks.size() + 1, pool.getHeapAllocations());
+    for (auto* block : blocks) {
+        pool.deallocate(block, 64);
+    }
+}
+
+class TestContext : public CommandContext {
+public:
+    explicit TestContext(int& destroyed_) : destroyed(destroyed_) {
+    }
+
+    ~TestContext() override {
+        ++destroyed;
+    }
+
+    int& destroyed;
+};
+
+TEST(CommandContextPoolTest, Deleter) {
+    CommandContextPool pool;
+    int destroyed = 0;
+
+    auto* memory = pool.allocate(sizeof(TestContext));
+    auto* pooled = new (memory) TestContext(destroyed);
+    CommandContextDeleter deleter{&pool, memory, sizeof(TestContext)};
+    deleter(pooled);
+    EXPECT_EQ(1, destroyed);
+    EXPECT_EQ(memory, pool.allocate(sizeof(TestContext)));
+    pool.deallocate(memory, sizeof(TestContext));
+
+    // Contexts without a pool are deleted
+    CommandContextDeleter{}(new TestContext(destroyed));
+    EXPECT_EQ(2, destroyed);
+}
@@ -484,6 +484,54 @@ TEST_F(SettingsTest, RequireInit) {
     }
 }
 
+TEST_F(SettingsTest, ReuseportListeners) {
+    nonBooleanValuesShouldFail("reuseport_listeners");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddTrueToObject(obj.get(), "reuseport_listeners");
+    try {
+        Settings settings(obj);
+        EXPECT_TRUE(settings.isReuseportListeners());
+        EXPECT_TRUE(settings.has.reuseport_listeners);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddFalseToObject(obj.get(), "reuseport_listeners");
+    try {
+        Settings settings(obj);
+        EXPECT_FALSE(settings.isReuseportListeners());
+        EXPECT_TRUE(settings.has.reuseport_listeners);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, NumaAffinity) {
+    nonBooleanValuesShouldFail("numa_affinity");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddTrueToObject(obj.get(), "numa_affinity");
+    try {
+        Settings settings(obj);
+        EXPECT_TRUE(settings.isNumaAffinity());
+        EXPECT_TRUE(settings.has.numa_affinity);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddFalseToObject(obj.get(), "numa_affinity");
+    try {
+        Settings settings(obj);
+        EXPECT_FALSE(settings.isNumaAffinity());
+        EXPECT_TRUE(settings.has.numa_affinity);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
 TEST_F(SettingsTest, TopkeysEnabled) {
     nonBooleanValuesShouldFail("topkeys_enabled");
 
@@ -508,6 +556,48 @@ TEST_F(SettingsTest, TopkeysEnabled) {
     }
 }
 
+TEST_F(SettingsTest, ConnectionMigration) {
+    nonBooleanValuesShouldFail("connection_migration");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddTrueToObject(obj.get(), "connection_migration");
+    try {
+        Settings settings(obj);
+        EXPECT_TRUE(settings.isConnectionMigrationEnabled());
+        EXPECT_TRUE(settings.has.connection_migration);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddFalseToObject(obj.get(), "connection_migration");
+    try {
+        Settings settings(obj);
+        EXPECT_FALSE(settings.isConnectionMigrationEnabled());
+        EXPECT_TRUE(settings.has.connection_migration);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, TopkeysSampleRate) {
+    nonNumericValuesShouldFail("topkeys_sample_rate");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "topkeys_sample_rate", 0);
+    expectFail(obj);
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "topkeys_sample_rate", 16);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(16, settings.getTopkeysSampleRate());
+        EXPECT_TRUE(settings.has.topkeys_sample_rate);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
 TEST_F(SettingsTest, DefaultReqsPerEvent) {
     nonNumericValuesShouldFail("default_reqs_per_event");
 
@@ -596,6 +686,104 @@ TEST_F(SettingsTest, ConnectionIdleTime) {
     }
 }
 
+TEST_F(SettingsTest, PipelineBatchSize) {
+    nonNumericValuesShouldFail("pipeline_batch_size");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "pipeline_batch_size", 16384);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(16384, settings.getPipelineBatchSize());
+        EXPECT_TRUE(settings.has.pipeline_batch_size);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, SnappyResponseMinSize) {
+    nonNumericValuesShouldFail("snappy_response_min_size");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "snappy_response_min_size", 1024);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(1024, settings.getSnappyResponseMinSize());
+        EXPECT_TRUE(settings.has.snappy_response_min_size);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, EventBudget) {
+    nonNumericValuesShouldFail("event_time_budget");
+    nonNumericValuesShouldFail("event_byte_budget");
+
+    {
+        Settings settings;
+        EXPECT_FALSE(settings.isEventBudgetEnabled());
+    }
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "event_time_budget", 500);
+    cJSON_AddNumberToObject(obj.get(), "event_byte_budget", 65536);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(500, settings.getEventTimeBudget().count());
+        EXPECT_TRUE(settings.has.event_time_budget);
+        EXPECT_EQ(65536, settings.getEventByteBudget());
+        EXPECT_TRUE(settings.has.event_byte_budget);
+        EXPECT_TRUE(settings.isEventBudgetEnabled());
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, MaxSendQueueSize) {
+    nonNumericValuesShouldFail("max_send_queue_size");
+    nonNumericValuesShouldFail("max_thread_send_queue_size");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "max_send_queue_size", 1048576);
+    cJSON_AddNumberToObject(obj.get(), "max_thread_send_queue_size", 8388608);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(1048576, settings.getMaxSendQueueSize());
+        EXPECT_TRUE(settings.has.max_send_queue_size);
+        EXPECT_EQ(8388608, settings.getMaxThreadSendQueueSize());
+        EXPECT_TRUE(settings.has.max_thread_send_queue_size);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, SslSessionCacheSize) {
+    nonNumericValuesShouldFail("ssl_session_cache_size");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "ssl_session_cache_size", 100);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(100, settings.getSslSessionCacheSize());
+        EXPECT_TRUE(settings.has.ssl_session_cache_size);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, SslSessionLifetime) {
+    nonNumericValuesShouldFail("ssl_session_lifetime");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "ssl_session_lifetime", 600);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(600, settings.getSslSessionLifetime());
+        EXPECT_TRUE(settings.has.ssl_session_lifetime);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
 TEST_F(SettingsTest, BioDrainBufferSize) {
     nonNumericValuesShouldFail("bio_drain_buffer_sz");
 
@@ -1168,6 +1356,34 @@ TEST(SettingsUpdateTest, RequireInitIsNotDynamic) {
                  std::invalid_argument);
 }
 
+TEST(SettingsUpdateTest, ReuseportListenersIsNotDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    settings.setReuseportListeners(true);
+    updated.setReuseportListeners(settings.isReuseportListeners());
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // Changing it should fail
+    updated.setReuseportListeners(!settings.isReuseportListeners());
+    EXPECT_THROW(settings.updateSettings(updated, false),
+                 std::invalid_argument);
+}
+
+TEST(SettingsUpdateTest, NumaAffinityIsNotDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    settings.setNumaAffinity(true);
+    updated.setNumaAffinity(settings.isNumaAffinity());
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // Changing it should fail
+    updated.setNumaAffinity(!settings.isNumaAffinity());
+    EXPECT_THROW(settings.updateSettings(updated, false),
+                 std::invalid_argument);
+}
+
 TEST(SettingsUpdateTest, DefaultReqIsDynamic) {
     Settings updated;
     Settings settings;
@@ -1264,6 +1480,150 @@ TEST(SettingsUpdateTest, VerbosityIsDynamic) {
     EXPECT_EQ(updated.getVerbose(), settings.getVerbose());
 }
 
+TEST(SettingsUpdateTest, PipelineBatchSizeIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto old = settings.getPipelineBatchSize();
+    updated.setPipelineBatchSize(old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setPipelineBatchSize(old + 4096);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.getPipelineBatchSize());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getPipelineBatchSize(),
+              settings.getPipelineBatchSize());
+}
+
+TEST(SettingsUpdateTest, SnappyResponseMinSizeIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto old = settings.getSnappyResponseMinSize();
+    updated.setSnappyResponseMinSize(old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setSnappyResponseMinSize(old + 1024);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.getSnappyResponseMinSize());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getSnappyResponseMinSize(),
+              settings.getSnappyResponseMinSize());
+}
+
+TEST(SettingsUpdateTest, EventBudgetIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto oldTime = settings.getEventTimeBudget().count();
+    updated.setEventTimeBudget(oldTime);
+    auto oldBytes = settings.getEventByteBudget();
+    updated.setEventByteBudget(oldBytes);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setEventTimeBudget(oldTime + 100);
+    updated.setEventByteBudget(oldBytes + 4096);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(oldTime, settings.getEventTimeBudget().count());
+    EXPECT_EQ(oldBytes, settings.getEventByteBudget());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getEventTimeBudget(), settings.getEventTimeBudget());
+    EXPECT_EQ(updated.getEventByteBudget(), settings.getEventByteBudget());
+}
+
+TEST(SettingsUpdateTest, MaxSendQueueSizeIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto old = settings.getMaxSendQueueSize();
+    updated.setMaxSendQueueSize(old);
+    auto oldThread = settings.getMaxThreadSendQueueSize();
+    updated.setMaxThreadSendQueueSize(oldThread);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setMaxSendQueueSize(old + 1024);
+    updated.setMaxThreadSendQueueSize(oldThread + 4096);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.getMaxSendQueueSize());
+    EXPECT_EQ(oldThread, settings.getMaxThreadSendQueueSize());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getMaxSendQueueSize(), settings.getMaxSendQueueSize());
+    EXPECT_EQ(updated.getMaxThreadSendQueueSize(),
+              settings.getMaxThreadSendQueueSize());
+}
+
+TEST(SettingsUpdateTest, SslSessionCacheSizeIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto old = settings.getSslSessionCacheSize();
+    updated.setSslSessionCacheSize(old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setSslSessionCacheSize(old + 100);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.getSslSessionCacheSize());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getSslSessionCacheSize(),
+              settings.getSslSessionCacheSize());
+}
+
+TEST(SettingsUpdateTest, SslSessionLifetimeIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto old = settings.getSslSessionLifetime();
+    updated.setSslSessionLifetime(old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setSslSessionLifetime(old + 60);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.getSslSessionLifetime());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getSslSessionLifetime(),
+              settings.getSslSessionLifetime());
+}
+
+TEST(SettingsUpdateTest, TopkeysSampleRateIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto old = settings.getTopkeysSampleRate();
+    updated.setTopkeysSampleRate(old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setTopkeysSampleRate(old + 10);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.getTopkeysSampleRate());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getTopkeysSampleRate(),
+              settings.getTopkeysSampleRate());
+}
+
+TEST(SettingsUpdateTest, ConnectionMigrationIsDynamic) {
+    Settings updated;
+    Settings settings;
+    // setting it to the same value should work
+    auto old = settings.isConnectionMigrationEnabled();
+    updated.setConnectionMigrationEnabled(old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setConnectionMigrationEnabled(!old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.isConnectionMigrationEnabled());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(!old, settings.isConnectionMigrationEnabled());
+}
+
 TEST(SettingsUpdateTest, ConnectionIdleTimeIsDynamic) {
     Settings updated;
     Settings settings;
@@ -0,0 +1,94 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/connection_balancer.h>
+#include <gtest/gtest.h>
+
+using ConnectionLoad = ConnectionBalancer::ConnectionLoad;
+
+/**
+ * The tests don't need real connections; the balancer only uses the
+ * pointers to identify them
+ */
+static const Connection* conn(uintptr_t id) {
+    return reinterpret_cast<const Connection*>(id);
+}
+
+static const uint64_t period = 1000;
+
+TEST(ConnectionBalancerTest, SingleThread) {
+    ConnectionBalancer::Migration migration;
+    EXPECT_FALSE(ConnectionBalancer::findMigration(
+            {1000}, {{{conn(1), 500}, {conn(2), 500}}}, period, migration));
+}
+
+TEST(ConnectionBalancerTest, IdleThreads) {
+    // Nobody is busy for more than half of the period
+    ConnectionBalancer::Migration migration;
+    EXPECT_FALSE(ConnectionBalancer::findMigration(
+            {500, 0}, {{{conn(1), 250}, {conn(2), 250}}, {}}, period,
+            migration));
+}
+
+TEST(ConnectionBalancerTest, Balanced) {
+    // The gap between the threads is less than a quarter of the period
+    ConnectionBalancer::Migration migration;
+    EXPECT_FALSE(ConnectionBalancer::findMigration(
+            {900, 700},
+            {{{conn(1), 450}, {conn(2), 450}}, {{conn(3), 700}}},
+            period,
+            migration));
+}
+
+TEST(ConnectionBalancerTest, MoveToIdlestThread) {
+    ConnectionBalancer::Migration migration;
+    ASSERT_TRUE(ConnectionBalancer::findMigration(
+            {300, 900, 100},
+            {{{conn(1), 300}},
+             {{conn(2), 150}, {conn(3), 350}, {conn(4), 400}},
+             {{conn(5), 100}}},
+            period,
+            migration));
+    EXPECT_EQ(1u, migration.from);
+    EXPECT_EQ(2u, migration.to);
+    // The gap is 800; moving conn(4) leaves 500 on each thread
+    EXPECT_EQ(conn(4), migration.connection);
+}
+
+TEST(ConnectionBalancerTest, DontMoveTheHotSpot) {
+    // The single connection on the busy thread would just make the
+    // other thread busy
+    ConnectionBalancer::Migration migration;
+    EXPECT_FALSE(ConnectionBalancer::findMigration(
+            {1000, 0}, {{{conn(1), 1000}}, {}}, period, migration));
+
+    // But we may move the smaller one
+    ASSERT_TRUE(ConnectionBalancer::findMigration(
+            {1000, 0},
+            {{{conn(1), 800}, {conn(2), 200}}, {}},
+            period,
+            migration));
+    EXPECT_EQ(conn(2), migration.connection);
+}
+
+TEST(ConnectionBalancerTest, IgnoreIdleConnections) {
+    ConnectionBalancer::Migration migration;
+    EXPECT_FALSE(ConnectionBalancer::findMigration(
+            {1000, 0},
+            {{{conn(1), 1000}, {conn(2), 0}}, {}},
+            period,
+            migration));
+}
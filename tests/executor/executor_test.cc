@@ -136,6 +136,38 @@ TEST_F(ExecutorTest, RescheduleMissingLock) {
     EXPECT_TRUE(cmd->executionComplete);
 }
 
+class AuthTestTask : public BasicTestTask {
+public:
+    AuthTestTask() : BasicTestTask(1) {
+    }
+
+    TaskType getType() const override {
+        return TaskType::Auth;
+    }
+};
+
+// The task types given executors of their own run on them, and the others
+// share the default ones
+TEST(ExecutorPoolTest, DedicatedExecutors) {
+    ExecutorPool pool(2, {{TaskType::Auth, 3}, {TaskType::Admin, 0}});
+    EXPECT_EQ(2, pool.getNumExecutors(TaskType::Default));
+    EXPECT_EQ(3, pool.getNumExecutors(TaskType::Auth));
+    EXPECT_EQ(2, pool.getNumExecutors(TaskType::Admin));
+
+    for (int ii = 0; ii < 4; ++ii) {
+        auto* cmd = new AuthTestTask;
+        std::shared_ptr<Task> task(cmd);
+        std::unique_lock<std::mutex> lock(task->getMutex());
+        pool.schedule(task);
+        cmd->cond.wait(lock, [cmd] { return cmd->executionComplete.load(); });
+    }
+
+    EXPECT_EQ(4, pool.getStats(TaskType::Auth).runs);
+    EXPECT_EQ(0, pool.getStats(TaskType::Default).runs);
+    EXPECT_LE(pool.getStats(TaskType::Auth).maxRuntime,
+              pool.getStats(TaskType::Auth).runtime);
+}
+
 struct MockProcessClockSource : cb::ProcessClockSource {
     MOCK_METHOD0(now, ProcessClock::time_point());
 };
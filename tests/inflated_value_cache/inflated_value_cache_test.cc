@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/inflated_value_cache.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+static InflatedValueCache::Buffer makeBuffer(size_t size) {
+    auto ret = std::make_shared<cb::compression::Buffer>();
+    ret->data.reset(new char[size]);
+    memset(ret->data.get(), 'a', size);
+    ret->len = size;
+    return ret;
+}
+
+static const DocKey key("key", DocNamespace::DefaultCollection);
+
+TEST(InflatedValueCacheTest, LookupMiss) {
+    InflatedValueCache cache;
+    EXPECT_FALSE(cache.lookup(0, 0, key, 1));
+    EXPECT_EQ(0, cache.getHits());
+    EXPECT_EQ(1, cache.getMisses());
+}
+
+TEST(InflatedValueCacheTest, LookupHit) {
+    InflatedValueCache cache;
+    auto buffer = makeBuffer(100);
+    cache.insert(0, 0, key, 1, buffer);
+    EXPECT_EQ(100, cache.getSize());
+    EXPECT_EQ(buffer, cache.lookup(0, 0, key, 1));
+    EXPECT_EQ(1, cache.getHits());
+}
+
+TEST(InflatedValueCacheTest, DocumentIdentity) {
+    InflatedValueCache cache;
+    cache.insert(0, 0, key, 1, makeBuffer(100));
+    // A different CAS means a different version of the document
+    EXPECT_FALSE(cache.lookup(0, 0, key, 2));
+    EXPECT_FALSE(cache.lookup(1, 0, key, 1));
+    EXPECT_FALSE(cache.lookup(0, 1, key, 1));
+    EXPECT_FALSE(cache.lookup(0, 0, DocKey("key", DocNamespace::System), 1));
+    EXPECT_FALSE(cache.lookup(0, 0, DocKey("key2",
+                                           DocNamespace::DefaultCollection),
+                              1));
+    EXPECT_TRUE(cache.lookup(0, 0, key, 1));
+}
+
+TEST(InflatedValueCacheTest, LockedCasIsNotCached) {
+    InflatedValueCache cache;
+    cache.insert(0, 0, key, InflatedValueCache::LockedCas, makeBuffer(100));
+    EXPECT_EQ(0, cache.getSize());
+    EXPECT_FALSE(cache.lookup(0, 0, key, InflatedValueCache::LockedCas));
+}
+
+TEST(InflatedValueCacheTest, MaxItemSize) {
+    InflatedValueCache cache(1024, 100);
+    cache.insert(0, 0, key, 1, makeBuffer(101));
+    EXPECT_EQ(0, cache.getSize());
+    EXPECT_FALSE(cache.lookup(0, 0, key, 1));
+}
+
+TEST(InflatedValueCacheTest, EvictLeastRecentlyUsed) {
+    InflatedValueCache cache(300, 100);
+    cache.insert(0, 0, key, 1, makeBuffer(100));
+    cache.insert(0, 0, key, 2, makeBuffer(100));
+    cache.insert(0, 0, key, 3, makeBuffer(100));
+    EXPECT_EQ(300, cache.getSize());
+
+    // Touch the first one so that the second is the least recently used
+    EXPECT_TRUE(cache.lookup(0, 0, key, 1));
+    cache.insert(0, 0, key, 4, makeBuffer(100));
+    EXPECT_EQ(300, cache.getSize());
+    EXPECT_TRUE(cache.lookup(0, 0, key, 1));
+    EXPECT_FALSE(cache.lookup(0, 0, key, 2));
+    EXPECT_TRUE(cache.lookup(0, 0, key, 3));
+    EXPECT_TRUE(cache.lookup(0, 0, key, 4));
+}
+
+TEST(InflatedValueCacheTest, EvictedBufferStaysValid) {
+    InflatedValueCache cache(100, 100);
+    auto buffer = cache.lookup(0, 0, key, 1);
+    cache.insert(0, 0, key, 1, makeBuffer(100));
+    buffer = cache.lookup(0, 0, key, 1);
+    ASSERT_TRUE(buffer);
+    cache.insert(0, 0, key, 2, makeBuffer(100));
+    EXPECT_FALSE(cache.lookup(0, 0, key, 1));
+    EXPECT_EQ(100, buffer->len);
+    EXPECT_EQ('a', buffer->data.get()[99]);
+}
+
+TEST(InflatedValueCacheTest, Clear) {
+    InflatedValueCache cache;
+    cache.insert(0, 0, key, 1, makeBuffer(100));
+    cache.clear();
+    EXPECT_EQ(0, cache.getSize());
+    EXPECT_FALSE(cache.lookup(0, 0, key, 1));
+}
@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/io_vector_pool.h>
+#include <daemon/memcached.h>
+#include <gtest/gtest.h>
+
+TEST(IoVectorPoolTest, ReuseVectors) {
+    IoVectorPool pool;
+    std::vector<iovec> iov;
+    std::vector<msghdr> msglist;
+
+    pool.get(iov, msglist);
+    EXPECT_EQ(IOV_LIST_INITIAL, iov.size());
+    EXPECT_LE(MSG_LIST_INITIAL, msglist.capacity());
+    EXPECT_EQ(0, pool.getHits());
+    EXPECT_EQ(1, pool.getMisses());
+
+    const auto* data = iov.data();
+    msglist.emplace_back();
+    pool.release(iov, msglist);
+
+    // The connection is left without any memory
+    EXPECT_EQ(0, iov.capacity());
+    EXPECT_EQ(0, msglist.capacity());
+    EXPECT_LT(0, pool.getSize());
+
+    // And the next connection gets the same (but empty) lists
+    pool.get(iov, msglist);
+    EXPECT_EQ(data, iov.data());
+    EXPECT_TRUE(msglist.empty());
+    EXPECT_EQ(1, pool.getHits());
+    EXPECT_EQ(0, pool.getSize());
+}
+
+TEST(IoVectorPoolTest, KeepExisting) {
+    IoVectorPool pool;
+    std::vector<iovec> iov(IOV_LIST_INITIAL * 2);
+    std::vector<msghdr> msglist;
+    const auto* data = iov.data();
+
+    pool.get(iov, msglist);
+    EXPECT_EQ(data, iov.data());
+    EXPECT_EQ(0, pool.getHits());
+    EXPECT_EQ(0, pool.getMisses());
+}
+
+TEST(IoVectorPoolTest, ReleaseBigVectors) {
+    IoVectorPool pool;
+    std::vector<iovec> iov(IOV_LIST_HIGHWAT + 1);
+    std::vector<msghdr> msglist;
+
+    pool.release(iov, msglist);
+    EXPECT_TRUE(iov.empty());
+    EXPECT_EQ(0, pool.getSize());
+
+    // Nothing to hand out
+    pool.get(iov, msglist);
+    EXPECT_EQ(1, pool.getMisses());
+}
+
+TEST(IoVectorPoolTest, MaxFree) {
+    IoVectorPool pool;
+    std::vector<std::vector<iovec>> iovs(IoVectorPool::MaxFree + 1);
+    std::vector<msghdr> msglist;
+    for (auto& iov : iovs) {
+        pool.get(iov, msglist);
+        msglist = std::vector<msghdr>();
+    }
+
+    for (auto& iov : iovs) {
+        pool.release(iov, msglist);
+    }
+    EXPECT_EQ(IoVectorPool::MaxFree * IOV_LIST_INITIAL * sizeof(iovec),
+              pool.getSize());
+}
+
+TEST(IoVectorPoolTest, RecordBuffer) {
+    IoVectorPool pool;
+    auto& buffer = pool.getRecordBuffer(1024);
+    EXPECT_LE(1024, buffer.capacity());
+    EXPECT_EQ(buffer.capacity(), pool.getSize());
+    EXPECT_EQ(&buffer, &pool.getRecordBuffer(512));
+}
@@ -0,0 +1,149 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/latency_histogram.h>
+#include <daemon/timing_histogram.h>
+#include <gtest/gtest.h>
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+    for (hrtime_t ii = 0; ii < LatencyHistogram::SubBuckets; ++ii) {
+        const auto index = LatencyHistogram::getIndex(ii);
+        EXPECT_EQ(ii, LatencyHistogram::getLowerBound(index));
+        EXPECT_EQ(ii, LatencyHistogram::getUpperBound(index));
+    }
+}
+
+TEST(LatencyHistogramTest, BucketsCoverValues) {
+    size_t previous = 0;
+    for (hrtime_t value = 1; value < (hrtime_t(1) << 20); ++value) {
+        const auto index = LatencyHistogram::getIndex(value);
+        ASSERT_LT(index, LatencyHistogram::NumBuckets);
+        ASSERT_LE(LatencyHistogram::getLowerBound(index), value);
+        ASSERT_GE(LatencyHistogram::getUpperBound(index), value);
+        // The buckets are contiguous
+        ASSERT_TRUE(index == previous || index == previous + 1);
+        previous = index;
+    }
+}
+
+TEST(LatencyHistogramTest, RelativeError) {
+    for (hrtime_t value = 1000; value < (hrtime_t(1) << 39); value *= 3) {
+        const auto index = LatencyHistogram::getIndex(value);
+        const auto lower = LatencyHistogram::getLowerBound(index);
+        const auto upper = LatencyHistogram::getUpperBound(index);
+        EXPECT_LE(double(upper - lower) / double(lower),
+                  1.0 / LatencyHistogram::SubBuckets);
+    }
+}
+
+TEST(LatencyHistogramTest, HugeValuesUseTheLastBucket) {
+    EXPECT_EQ(LatencyHistogram::NumBuckets - 1,
+              LatencyHistogram::getIndex(~hrtime_t(0)));
+    EXPECT_EQ(LatencyHistogram::NumBuckets - 1,
+              LatencyHistogram::getIndex(
+                      (hrtime_t(1) << LatencyHistogram::MaxValueBits) - 1));
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(0, histogram.getPercentile(99.0));
+
+    // 9999 fast operations and a single slow one
+    for (int ii = 0; ii < 9999; ++ii) {
+        histogram.add(1000);
+    }
+    histogram.add(1000000);
+    EXPECT_EQ(10000, histogram.getCount());
+
+    const auto fast = LatencyHistogram::getUpperBound(
+            LatencyHistogram::getIndex(1000));
+    const auto slow = LatencyHistogram::getUpperBound(
+            LatencyHistogram::getIndex(1000000));
+    EXPECT_EQ(fast, histogram.getPercentile(50.0));
+    EXPECT_EQ(fast, histogram.getPercentile(99.99));
+    EXPECT_EQ(slow, histogram.getPercentile(100.0));
+}
+
+TEST(LatencyHistogramTest, Merge) {
+    LatencyHistogram a;
+    LatencyHistogram b;
+    a.add(10);
+    a.add(5000);
+    b.add(5000);
+
+    a += b;
+    EXPECT_EQ(3, a.getCount());
+    EXPECT_EQ(1, a.getBucket(LatencyHistogram::getIndex(10)));
+    EXPECT_EQ(2, a.getBucket(LatencyHistogram::getIndex(5000)));
+
+    a.reset();
+    EXPECT_EQ(0, a.getCount());
+    EXPECT_EQ(0, a.getBucket(LatencyHistogram::getIndex(5000)));
+}
+
+TEST(LatencyHistogramTest, Subtract) {
+    LatencyHistogram before;
+    LatencyHistogram after;
+    before.add(10);
+    after.add(10);
+    after.add(10);
+    after.add(5000);
+
+    after -= before;
+    EXPECT_EQ(2, after.getCount());
+    EXPECT_EQ(1, after.getBucket(LatencyHistogram::getIndex(10)));
+    EXPECT_EQ(1, after.getBucket(LatencyHistogram::getIndex(5000)));
+
+    // A bucket which was reset in between is kept as it is
+    before.add(5000);
+    before.add(5000);
+    after -= before;
+    EXPECT_EQ(1, after.getCount());
+    EXPECT_EQ(0, after.getBucket(LatencyHistogram::getIndex(10)));
+    EXPECT_EQ(1, after.getBucket(LatencyHistogram::getIndex(5000)));
+}
+
+TEST(LatencyHistogramTest, AddToTimingHistogram) {
+    LatencyHistogram histogram;
+    histogram.add(500);       // <= 1us
+    histogram.add(25000);     // 20-29us
+    histogram.add(3500000);   // 3ms
+    histogram.add(700000000); // 500-999ms
+
+    TimingHistogram legacy;
+    histogram.addTo(legacy);
+    EXPECT_EQ(4, legacy.get_total());
+    EXPECT_EQ(1, legacy.get_ns());
+    EXPECT_EQ(1, legacy.get_usec(2));
+    EXPECT_EQ(1, legacy.get_msec(3));
+    EXPECT_EQ(1, legacy.get_halfsec(1));
+}
+
+TEST(LatencyHistogramTest, ToJson) {
+    LatencyHistogram histogram;
+    histogram.add(500);
+    histogram.add(3500000);
+
+    auto json = histogram.to_json();
+    ASSERT_TRUE(json);
+    EXPECT_EQ(1, cJSON_GetObjectItem(json.get(), "ns")->valueint);
+    auto* percentiles = cJSON_GetObjectItem(json.get(), "percentiles");
+    ASSERT_NE(nullptr, percentiles);
+    EXPECT_EQ(double(histogram.getPercentile(50.0)),
+              cJSON_GetObjectItem(percentiles, "50")->valuedouble);
+    EXPECT_EQ(double(histogram.getPercentile(99.99)),
+              cJSON_GetObjectItem(percentiles, "99.99")->valuedouble);
+}
@@ -28,6 +28,7 @@
 #include <gtest/gtest.h>
 
 #include "extensions/loggers/file_logger_utilities.h"
+#include "extensions/loggers/log_ring.h"
 
 class LoggerTest : public ::testing::Test {
 protected:
@@ -38,13 +39,12 @@ protected:
             remove_files(files);
         }
 
-        /* Note: Ensure buffer is at least 4* larger than the expected message
-         * length, otherwise the writer will be blocked waiting for the flusher
-         * thread to timeout and write (as we haven't actually hit the 75%
-         * watermark which would normally trigger an immediate flush).
+        /* Note: Ensure the ring is large enough for all the messages
+         * logged by a test, otherwise the messages logged while the
+         * flusher is sleeping are dropped.
          */
         ret = memcached_extensions_initialize("unit_test=true;"
-                  "cyclesize=2048;buffersize=8192;"
+                  "cyclesize=2048;buffersize=8192;ringsize=2097152;"
                   "sleeptime=1;filename=logger_test", get_server_api);
         cb_assert(ret == EXTENSION_SUCCESS);
 
@@ -128,6 +128,45 @@ TEST_F(LoggerTest, Rotate) {
     remove_files(files);
 }
 
+/**
+ * Test that the messages which don't fit in the ring of a thread are
+ * dropped rather than blocking the thread, and that the number of
+ * messages dropped is recorded in the log.
+ */
+TEST_F(LoggerTest, DropWhenRingIsFull) {
+    logger->shutdown(false);
+    files = cb::io::findFilesWithPrefix("logger_test");
+    remove_files(files);
+    ret = memcached_extensions_initialize("unit_test=true;"
+              "cyclesize=1048576;buffersize=8192;ringsize=4096;"
+              "sleeptime=1;filename=logger_test", get_server_api);
+    ASSERT_EQ(EXTENSION_SUCCESS, ret);
+
+    for (auto ii = 0; ii < 1024; ++ii) {
+        logger->log(EXTENSION_LOG_DETAIL, NULL,
+                    "Hei hopp, dette er bare noe tull... Paa tide med %05u!!",
+                    ii);
+    }
+    logger->shutdown(false);
+
+    files = cb::io::findFilesWithPrefix("logger_test");
+    ASSERT_EQ(1, files.size());
+    FILE* fp = fopen(files[0].c_str(), "r");
+    ASSERT_NE(nullptr, fp);
+    char line[1024];
+    bool found = false;
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+        if (strstr(line, "WARNING Dropped ") != nullptr &&
+            strstr(line, " log messages as the log buffers were full") !=
+                    nullptr) {
+            found = true;
+        }
+    }
+    fclose(fp);
+    EXPECT_TRUE(found) << "The dropped messages weren't recorded";
+    remove_files(files);
+}
+
 static bool my_fgets(char *buffer, size_t buffsize, FILE *fp) {
     if (fgets(buffer, (int)buffsize, fp) != NULL) {
         char *end = strchr(buffer, '\n');
@@ -285,3 +324,69 @@ TEST_F(LoggerUtilitiesTest, TestInvalidSeparator) {
     createFile(1, "-", ".txt");
     EXPECT_EQ(0, find_first_logfile_id(prefix));
 }
+
+class LogRingTest : public ::testing::Test {
+protected:
+    LogRingTest() : ring(LogRing::minimumCapacity) {
+    }
+
+    bool push(const std::string& msg) {
+        LogRing::Header hdr{};
+        hdr.size = uint32_t(msg.size());
+        return ring.push(hdr, msg.data());
+    }
+
+    std::vector<std::string> drain() {
+        std::vector<std::string> ret;
+        ring.drain([&ret](const LogRing::Header& hdr, const char* msg) {
+            ret.emplace_back(msg, hdr.size);
+        });
+        return ret;
+    }
+
+    LogRing ring;
+};
+
+TEST_F(LogRingTest, TooSmall) {
+    EXPECT_THROW(LogRing(LogRing::minimumCapacity - 1),
+                 std::invalid_argument);
+}
+
+TEST_F(LogRingTest, PushDrain) {
+    EXPECT_TRUE(ring.empty());
+    EXPECT_TRUE(push("first"));
+    EXPECT_TRUE(push("second"));
+    EXPECT_FALSE(ring.empty());
+
+    const std::vector<std::string> expected{"first", "second"};
+    EXPECT_EQ(expected, drain());
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ(0, ring.takeDropped());
+}
+
+TEST_F(LogRingTest, DropWhenFull) {
+    const std::string msg(1000, 'x');
+    int pushed = 0;
+    while (push(msg)) {
+        ++pushed;
+    }
+    EXPECT_EQ(4, pushed);
+    EXPECT_FALSE(push(msg));
+    EXPECT_EQ(2, ring.takeDropped());
+    EXPECT_EQ(0, ring.takeDropped());
+
+    EXPECT_EQ(4, drain().size());
+    EXPECT_TRUE(push(msg));
+}
+
+TEST_F(LogRingTest, Wrap) {
+    // Push and drain messages of a size which doesn't divide the capacity,
+    // so that the entries wrap at different offsets each round
+    for (int ii = 0; ii < 100; ++ii) {
+        const std::string msg(700 + ii, char('a' + ii % 26));
+        ASSERT_TRUE(push(msg));
+        ASSERT_TRUE(push(msg));
+        const std::vector<std::string> expected{msg, msg};
+        ASSERT_EQ(expected, drain());
+    }
+}
@@ -394,6 +394,30 @@ TEST_F(SetReplaceValidatorTest, NoKey) {
               validate(PROTOCOL_BINARY_CMD_REPLACEQ));
 }
 
+TEST_F(SetReplaceValidatorTest, Durability) {
+    request.message.header.request.extlen = 9;
+    auto* extras = blob + sizeof(request.bytes);
+    extras[8] = uint8_t(cb::mcbp::DurabilityLevel::None);
+
+    // Only accepted once the client enabled the feature
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL,
+              validate(PROTOCOL_BINARY_CMD_SET));
+    connection.setDurabilitySupported(true);
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+              validate(PROTOCOL_BINARY_CMD_SET));
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+              validate(PROTOCOL_BINARY_CMD_REPLACEQ));
+
+    // The connection isn't associated with a bucket which persists
+    extras[8] = uint8_t(cb::mcbp::DurabilityLevel::PersistToActive);
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED,
+              validate(PROTOCOL_BINARY_CMD_SET));
+
+    extras[8] = 0xff;
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL,
+              validate(PROTOCOL_BINARY_CMD_SET));
+}
+
 // Test Append[q] and Prepend[q]
 class AppendPrependValidatorTest : public ValidatorTest {
     virtual void SetUp() override {
@@ -548,6 +572,92 @@ TEST_F(DeleteValidatorTest, InvalidDatatype) {
               validate(PROTOCOL_BINARY_CMD_DELETEQ));
 }
 
+class GetMultiValidatorTest : public ValidatorTest {
+    virtual void SetUp() override {
+        ValidatorTest::SetUp();
+        addKey("foo", 0);
+        addKey("bar", 1);
+    }
+
+protected:
+    void addKey(const std::string& key, uint16_t vbucket) {
+        mcbp::getmulti::KeyHeader kh;
+        kh.vbucket = htons(vbucket);
+        kh.keylen = htons(uint16_t(key.size()));
+        memcpy(blob + sizeof(request.bytes) + body, &kh, sizeof(kh));
+        body += sizeof(kh);
+        memcpy(blob + sizeof(request.bytes) + body, key.data(), key.size());
+        body += key.size();
+        request.message.header.request.bodylen = htonl(uint32_t(body));
+    }
+
+    int validate() {
+        return ValidatorTest::validate(PROTOCOL_BINARY_CMD_GET_MULTI,
+                                       static_cast<void*>(&request));
+    }
+
+    size_t body = 0;
+};
+
+TEST_F(GetMultiValidatorTest, CorrectMessage) {
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, validate());
+}
+
+TEST_F(GetMultiValidatorTest, InvalidMagic) {
+    request.message.header.request.magic = 0;
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, InvalidExtlen) {
+    request.message.header.request.extlen = 2;
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, InvalidKeylen) {
+    request.message.header.request.keylen = htons(3);
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, InvalidDatatype) {
+    request.message.header.request.datatype = PROTOCOL_BINARY_DATATYPE_JSON;
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, Cas) {
+    request.message.header.request.cas = 1;
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, NoKeys) {
+    request.message.header.request.bodylen = 0;
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, EmptyKey) {
+    addKey("", 0);
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, TruncatedKeyHeader) {
+    request.message.header.request.bodylen = htonl(uint32_t(body + 2));
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, TruncatedKey) {
+    request.message.header.request.bodylen = htonl(uint32_t(body - 1));
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL, validate());
+}
+
+TEST_F(GetMultiValidatorTest, GetMetaMulti) {
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+              ValidatorTest::validate(PROTOCOL_BINARY_CMD_GET_META_MULTI,
+                                      static_cast<void*>(&request)));
+    request.message.header.request.bodylen = htonl(uint32_t(body - 1));
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_EINVAL,
+              ValidatorTest::validate(PROTOCOL_BINARY_CMD_GET_META_MULTI,
+                                      static_cast<void*>(&request)));
+}
+
 // Test INCREMENT[q] and DECREMENT[q]
 class IncrementDecrementValidatorTest : public ValidatorTest {
     virtual void SetUp() override {
@@ -0,0 +1,81 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <gtest/gtest.h>
+
+#include <xattr/blob.h>
+#include <xattr/blob_index.h>
+
+#include "utilities/string_utilities.h"
+
+static cb::const_byte_buffer to_const(cb::byte_buffer buffer) {
+    return {buffer.buf, buffer.len};
+}
+
+TEST(XattrBlobIndex, Empty) {
+    cb::xattr::BlobIndex index;
+    index.build({nullptr, 0});
+    EXPECT_EQ(0, index.size());
+    EXPECT_EQ(0, index.get_system_size());
+    EXPECT_EQ(0, index.get(to_const_byte_buffer("_sync")).len);
+}
+
+TEST(XattrBlobIndex, Get) {
+    cb::xattr::Blob blob;
+    blob.set(to_const_byte_buffer("user"),
+             to_const_byte_buffer("{\"author\":\"bubba\"}"));
+    blob.set(to_const_byte_buffer("_sync"),
+             to_const_byte_buffer("{\"cas\":\"0xdeadbeefcafefeed\"}"));
+    blob.set(to_const_byte_buffer("meta"),
+             to_const_byte_buffer("{\"content-type\":\"text\"}"));
+    blob.set(to_const_byte_buffer("_sy"), to_const_byte_buffer("true"));
+
+    const auto buffer = to_const(blob.finalize());
+    cb::xattr::BlobIndex index;
+    index.build(buffer);
+    EXPECT_TRUE(index.is_index_of(buffer));
+    EXPECT_EQ(4, index.size());
+
+    for (const auto& key : {"user", "_sync", "meta", "_sy"}) {
+        EXPECT_EQ(to_string(blob.get(std::string(key))),
+                  to_string(index.get(to_const_byte_buffer(key))))
+                << key;
+    }
+
+    EXPECT_EQ(0, index.get(to_const_byte_buffer("_s")).len);
+    EXPECT_EQ(0, index.get(to_const_byte_buffer("_syncs")).len);
+    EXPECT_EQ(0, index.get(to_const_byte_buffer("zzz")).len);
+    EXPECT_EQ(0, index.get(to_const_byte_buffer("a")).len);
+}
+
+TEST(XattrBlobIndex, SystemSize) {
+    cb::xattr::Blob blob;
+    blob.set(to_const_byte_buffer("user"),
+             to_const_byte_buffer("{\"author\":\"bubba\"}"));
+    EXPECT_EQ(blob.get_system_size(), [&blob]() {
+        cb::xattr::BlobIndex index;
+        index.build(to_const(blob.finalize()));
+        return index.get_system_size();
+    }());
+
+    blob.set(to_const_byte_buffer("_sync"),
+             to_const_byte_buffer("{\"cas\":\"0xdeadbeefcafefeed\"}"));
+    blob.set(to_const_byte_buffer("_meta"), to_const_byte_buffer("1"));
+
+    cb::xattr::BlobIndex index;
+    index.build(to_const(blob.finalize()));
+    EXPECT_EQ(blob.get_system_size(), index.get_system_size());
+}
@@ -0,0 +1,70 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmark the privilege check performed for every command. Check and
+ * InsertOrUpsert run the privilege checks of a GET and an ADD (for a
+ * user without the Insert privilege) like the privilege chains do,
+ * Cached looks up the decision cached in the privilege context.
+ */
+
+#include <memcached/rbac.h>
+
+#include <benchmark/benchmark.h>
+
+using cb::rbac::Privilege;
+using cb::rbac::PrivilegeAccess;
+
+static cb::rbac::PrivilegeContext createContext() {
+    static cb::rbac::PrivilegeDatabase db(nullptr);
+    cb::rbac::PrivilegeMask mask{};
+    mask[int(Privilege::Read)] = true;
+    mask[int(Privilege::Upsert)] = true;
+    return cb::rbac::PrivilegeContext(db.generation, mask);
+}
+
+void Check(benchmark::State& state) {
+    auto context = createContext();
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(context.check(Privilege::Read));
+    }
+}
+
+void InsertOrUpsert(benchmark::State& state) {
+    auto context = createContext();
+    while (state.KeepRunning()) {
+        auto ret = context.check(Privilege::Insert);
+        if (ret != PrivilegeAccess::Ok) {
+            ret = context.check(Privilege::Upsert);
+        }
+        benchmark::DoNotOptimize(ret);
+    }
+}
+
+void Cached(benchmark::State& state) {
+    auto context = createContext();
+    context.setCachedAccess(0x02, PrivilegeAccess::Ok);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(context.getCachedAccess(0x02));
+    }
+}
+
+BENCHMARK(Check);
+BENCHMARK(InsertOrUpsert);
+BENCHMARK(Cached);
+
+BENCHMARK_MAIN()
@@ -88,3 +88,35 @@ TEST(PrivilegeDatabaseTest, GenerationCounter) {
     cb::rbac::PrivilegeDatabase db2(nullptr);
     EXPECT_GT(db2.generation, db1.generation);
 }
+
+TEST(PrivilegeContextTest, CachedAccess) {
+    using cb::rbac::PrivilegeAccess;
+    cb::rbac::PrivilegeDatabase db(nullptr);
+    cb::rbac::PrivilegeMask mask{};
+    mask[int(cb::rbac::Privilege::Read)] = true;
+    cb::rbac::PrivilegeContext context(db.generation, mask);
+
+    EXPECT_EQ(PrivilegeAccess::Stale, context.getCachedAccess(0));
+    context.setCachedAccess(0, PrivilegeAccess::Ok);
+    context.setCachedAccess(1, PrivilegeAccess::Fail);
+    context.setCachedAccess(2, PrivilegeAccess::Stale);
+    EXPECT_EQ(PrivilegeAccess::Ok, context.getCachedAccess(0));
+    EXPECT_EQ(PrivilegeAccess::Fail, context.getCachedAccess(1));
+    EXPECT_EQ(PrivilegeAccess::Stale, context.getCachedAccess(2));
+
+    // Changing the privileges in the context clears the cache
+    EXPECT_TRUE(context.dropPrivilege(cb::rbac::Privilege::Read));
+    EXPECT_EQ(PrivilegeAccess::Stale, context.getCachedAccess(0));
+    EXPECT_EQ(PrivilegeAccess::Stale, context.getCachedAccess(1));
+
+    context.setCachedAccess(0, PrivilegeAccess::Ok);
+    context.setBucketPrivileges();
+    EXPECT_EQ(PrivilegeAccess::Stale, context.getCachedAccess(0));
+
+    // And so does a new generation of the privilege database
+    context.setCachedAccess(0, PrivilegeAccess::Ok);
+    EXPECT_FALSE(context.isStale());
+    cb::rbac::PrivilegeDatabase db2(nullptr);
+    EXPECT_TRUE(context.isStale());
+    EXPECT_EQ(PrivilegeAccess::Stale, context.getCachedAccess(0));
+}
@@ -0,0 +1,134 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/subdocument_index.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+class SubdocumentIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        doc = R"({"name":"Joe", "age": 42,
+                  "address": {"street": "Main Street", "zip": "94040"},
+                  "tags": ["a", {"b": [1, 2.5e3]}, true, null],
+                  "empty": {}, "none": []})";
+        ASSERT_TRUE(index.build({doc.data(), doc.size()}));
+    }
+
+    SubdocumentIndex::Status lookup(const std::string& path) {
+        return index.lookup({path.data(), path.size()}, value);
+    }
+
+    /// Look up a path which must exist, and return its value
+    std::string get(const std::string& path) {
+        EXPECT_EQ(SubdocumentIndex::Status::Found, lookup(path)) << path;
+        return std::string(value.buf, value.len);
+    }
+
+    std::string doc;
+    SubdocumentIndex index;
+    cb::const_char_buffer value;
+};
+
+TEST_F(SubdocumentIndexTest, Found) {
+    EXPECT_EQ("\"Joe\"", get("name"));
+    EXPECT_EQ("42", get("age"));
+    EXPECT_EQ(R"({"street": "Main Street", "zip": "94040"})", get("address"));
+    EXPECT_EQ("\"94040\"", get("address.zip"));
+    EXPECT_EQ("\"a\"", get("tags[0]"));
+    EXPECT_EQ("[1, 2.5e3]", get("tags[1].b"));
+    EXPECT_EQ("2.5e3", get("tags[1].b[1]"));
+    EXPECT_EQ("2.5e3", get("tags[1].b[-1]"));
+    EXPECT_EQ("null", get("tags[-1]"));
+    EXPECT_EQ("{}", get("empty"));
+    EXPECT_EQ("[]", get("none"));
+}
+
+TEST_F(SubdocumentIndexTest, NotFound) {
+    EXPECT_EQ(SubdocumentIndex::Status::NotFound, lookup("missing"));
+    EXPECT_EQ(SubdocumentIndex::Status::NotFound, lookup("address.city"));
+    EXPECT_EQ(SubdocumentIndex::Status::NotFound, lookup("tags[4]"));
+    EXPECT_EQ(SubdocumentIndex::Status::NotFound, lookup("none[-1]"));
+    EXPECT_EQ(SubdocumentIndex::Status::NotFound, lookup("empty.a"));
+}
+
+TEST_F(SubdocumentIndexTest, Mismatch) {
+    EXPECT_EQ(SubdocumentIndex::Status::Mismatch, lookup("[0]"));
+    EXPECT_EQ(SubdocumentIndex::Status::Mismatch, lookup("name.first"));
+    EXPECT_EQ(SubdocumentIndex::Status::Mismatch, lookup("address[0]"));
+    EXPECT_EQ(SubdocumentIndex::Status::Mismatch, lookup("tags.a"));
+}
+
+TEST_F(SubdocumentIndexTest, Unsupported) {
+    // The paths we leave to subjson
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup(""));
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup("`name`"));
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup(".name"));
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup("address..zip"));
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup("tags[-2]"));
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup("tags[01]"));
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup("tags[0"));
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported, lookup("tags[0]a"));
+}
+
+TEST(SubdocumentIndexBuildTest, EscapedNames) {
+    const std::string doc = R"({"a\"b": 1, "c": "x\"}"})";
+    SubdocumentIndex index;
+    ASSERT_TRUE(index.build({doc.data(), doc.size()}));
+    cb::const_char_buffer value;
+    // We can't compare the names with escape sequences
+    EXPECT_EQ(SubdocumentIndex::Status::Unsupported,
+              index.lookup({"c", 1}, value));
+}
+
+TEST(SubdocumentIndexBuildTest, EscapedStrings) {
+    const std::string doc = R"({"a": "x\\", "b": "\"]}", "c": 3})";
+    SubdocumentIndex index;
+    ASSERT_TRUE(index.build({doc.data(), doc.size()}));
+    cb::const_char_buffer value;
+    EXPECT_EQ(SubdocumentIndex::Status::Found, index.lookup({"c", 1}, value));
+    EXPECT_EQ("3", std::string(value.buf, value.len));
+    EXPECT_EQ(SubdocumentIndex::Status::Found, index.lookup({"b", 1}, value));
+    EXPECT_EQ(R"("\"]}")", std::string(value.buf, value.len));
+}
+
+TEST(SubdocumentIndexBuildTest, RejectsDocuments) {
+    SubdocumentIndex index;
+    const std::string invalid = R"({"a": 1,})";
+    EXPECT_FALSE(index.build({invalid.data(), invalid.size()}));
+    EXPECT_FALSE(index.isIndexed());
+    EXPECT_TRUE(index.isIndexOf({invalid.data(), invalid.size()}));
+
+    const std::string deep = std::string(SubdocumentIndex::MaxDepth + 1, '[') +
+                             std::string(SubdocumentIndex::MaxDepth + 1, ']');
+    EXPECT_FALSE(index.build({deep.data(), deep.size()}));
+
+    const std::string ok = std::string(SubdocumentIndex::MaxDepth, '[') +
+                           std::string(SubdocumentIndex::MaxDepth, ']');
+    EXPECT_TRUE(index.build({ok.data(), ok.size()}));
+    EXPECT_TRUE(index.isIndexed());
+}
+
+TEST(SubdocumentIndexBuildTest, Scalar) {
+    const std::string doc = " 42 ";
+    SubdocumentIndex index;
+    ASSERT_TRUE(index.build({doc.data(), doc.size()}));
+    EXPECT_EQ(1u, index.size());
+    cb::const_char_buffer value;
+    EXPECT_EQ(SubdocumentIndex::Status::Mismatch,
+              index.lookup({"a", 1}, value));
+}
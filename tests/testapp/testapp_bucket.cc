@@ -199,6 +199,49 @@ TEST_P(BucketTest, MB19756TestDeleteWhileClientConnected) {
     watchdog.join();
 }
 
+// An async delete replies once the bucket is detached, and finishes
+// draining the connections and shutting it down in the background
+TEST_P(BucketTest, DeleteBucketAsync) {
+    auto& conn = getAdminConnection();
+    conn.createBucket("bucket", "", BucketType::Memcached);
+
+    auto second_conn = conn.clone();
+    second_conn->authenticate("@admin", "password", "PLAIN");
+    second_conn->selectBucket("bucket");
+
+    conn.deleteBucket("bucket", "async=true");
+
+    // The bucket may no longer be selected
+    auto third_conn = conn.clone();
+    third_conn->authenticate("@admin", "password", "PLAIN");
+    try {
+        third_conn->selectBucket("bucket");
+        FAIL() << "Selected a bucket being deleted";
+    } catch (ConnectionError&) {
+    }
+
+    auto buckets = conn.listBuckets();
+    EXPECT_EQ(buckets.end(),
+              std::find(buckets.begin(), buckets.end(), "bucket"));
+
+    // The name is taken until the deletion completes (which disconnects
+    // the second connection)
+    using std::chrono::steady_clock;
+    const auto timeout = steady_clock::now() + std::chrono::seconds(30);
+    bool created = false;
+    do {
+        try {
+            conn.createBucket("bucket", "", BucketType::Memcached);
+            created = true;
+        } catch (ConnectionError& error) {
+            ASSERT_TRUE(error.isAlreadyExists()) << error.getReason();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    } while (!created && steady_clock::now() < timeout);
+    ASSERT_TRUE(created) << "Async bucket deletion did not complete";
+    conn.deleteBucket("bucket");
+}
+
 // Regression test for MB-19981 - if a bucket delete is attempted while there
 // is connection in the conn_read_packet_body state.  And that connection is
 // currently blocked waiting for a response from the server; the connection will
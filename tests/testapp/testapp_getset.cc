@@ -214,6 +214,60 @@ TEST_P(GetSetTest, TestGetSuccess) {
     EXPECT_EQ(document.value, stored.value);
 }
 
+TEST_P(GetSetTest, TestServerDuration) {
+    MemcachedConnection& conn = getConnection();
+    conn.mutate(document, 0, MutationType::Set);
+
+    BinprotGetCommand cmd;
+    cmd.setKey(name);
+    BinprotGetResponse rsp;
+    conn.executeCommand(cmd, rsp);
+    ASSERT_TRUE(rsp.isSuccess());
+    EXPECT_FALSE(rsp.hasServerDuration());
+
+    conn.setTracingFeature(true);
+    conn.executeCommand(cmd, rsp);
+    conn.setTracingFeature(false);
+
+    // The framing extras is stripped off before the response is parsed
+    ASSERT_TRUE(rsp.isSuccess());
+    EXPECT_TRUE(rsp.hasServerDuration());
+    EXPECT_GT(std::chrono::seconds(10), rsp.getServerDuration());
+    EXPECT_EQ(document.value, rsp.getDataString());
+    EXPECT_EQ(document.info.flags, rsp.getDocumentFlags());
+}
+
+TEST_P(GetSetTest, TestGetMulti) {
+    MemcachedConnection& conn = getConnection();
+    conn.mutate(document, 0, MutationType::Set);
+    auto other = document;
+    other.info.id = name + "-other";
+    conn.mutate(other, 0, MutationType::Set);
+
+    BinprotGetMultiCommand cmd;
+    cmd.addKey(name).addKey(name + "-missing").addKey(other.info.id);
+    conn.sendCommand(cmd);
+
+    // The documents are returned in the order they were requested, and
+    // the missing key is skipped
+    for (const auto& expected : {document, other}) {
+        BinprotGetResponse rsp;
+        conn.recvResponse(rsp);
+        ASSERT_TRUE(rsp.isSuccess());
+        EXPECT_EQ(expected.info.id, rsp.getKeyString());
+        EXPECT_EQ(expected.value, rsp.getDataString());
+        EXPECT_EQ(expected.info.flags, rsp.getDocumentFlags());
+        EXPECT_NE(mcbp::cas::Wildcard, rsp.getCas());
+    }
+
+    // And the responses are terminated by an empty success response
+    BinprotGetResponse rsp;
+    conn.recvResponse(rsp);
+    ASSERT_TRUE(rsp.isSuccess());
+    EXPECT_TRUE(rsp.getKeyString().empty());
+    EXPECT_EQ(0u, rsp.getBodylen());
+}
+
 TEST_P(GetSetTest, TestAppend) {
     MemcachedConnection& conn = getConnection();
     document.info.datatype = cb::mcbp::Datatype::Raw;
@@ -707,6 +761,38 @@ TEST_P(GetSetTest, TestGetMeta) {
     EXPECT_EQ(PROTOCOL_BINARY_RAW_BYTES, meta.second.datatype);
 }
 
+TEST_P(GetSetTest, TestGetMetaMulti) {
+    MemcachedConnection& conn = getConnection();
+    const auto info = conn.mutate(document, 0, MutationType::Set);
+
+    BinprotGetMetaMultiCommand cmd;
+    cmd.addKey(name).addKey(name + "-missing");
+    conn.sendCommand(cmd);
+
+    // Every key gets a response (in the order they were requested)
+    BinprotResponse rsp;
+    conn.recvResponse(rsp);
+    ASSERT_TRUE(rsp.isSuccess());
+    EXPECT_EQ(name, rsp.getKeyString());
+    EXPECT_EQ(info.cas, rsp.getCas());
+    ASSERT_EQ(sizeof(GetMetaResponse), rsp.getExtlen());
+    GetMetaResponse meta;
+    memcpy(&meta, rsp.getPayload(), sizeof(meta));
+    EXPECT_EQ(0u, meta.deleted);
+    EXPECT_EQ(0u, meta.expiry);
+
+    conn.recvResponse(rsp);
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, rsp.getStatus());
+    EXPECT_EQ(name + "-missing", rsp.getKeyString());
+    EXPECT_EQ(0u, rsp.getExtlen());
+
+    // And the responses are terminated by an empty success response
+    conn.recvResponse(rsp);
+    ASSERT_TRUE(rsp.isSuccess());
+    EXPECT_TRUE(rsp.getKeyString().empty());
+    EXPECT_EQ(0u, rsp.getBodylen());
+}
+
 TEST_P(GetSetTest, TestGetMetaExpiry) {
     // Case `expiry` <= `num_seconds_in_a_month`
     // When we set `document.info.expiration` to a value less than the number
@@ -363,6 +363,25 @@ TEST_P(StatsTest, TestConnectionsInvalidNumber) {
     }
 }
 
+/**
+ * The vbucket-details group is generated by a background task, and the
+ * error from the engine (the default engine doesn't support the group)
+ * should be returned to the client
+ */
+TEST_P(StatsTest, TestBackgroundStatGroup) {
+    MemcachedConnection& conn = getConnection();
+    try {
+        conn.stats("vbucket-details");
+        FAIL() << "The default engine doesn't support vbucket-details";
+    } catch (ConnectionError& error) {
+        EXPECT_TRUE(error.isNotFound()) << error.what();
+    }
+
+    // The connection should still work after the task completed
+    auto stats = conn.stats("");
+    ASSERT_NE(nullptr, stats.get());
+}
+
 TEST_P(StatsTest, TestTopkeys) {
     MemcachedConnection& conn = getConnection();
 
@@ -442,6 +461,114 @@ TEST_P(StatsTest, TestResponseStats) {
               getResponseCount(PROTOCOL_BINARY_RESPONSE_SUCCESS));
 }
 
+TEST_P(StatsTest, TestSnapshot) {
+    MemcachedConnection& conn = getConnection();
+
+    auto getSnapshot = [&conn](const std::string& generation) {
+        auto stats = conn.stats("snapshot " + generation);
+        auto* snapshot = cJSON_GetObjectItem(stats.get(), "snapshot");
+        EXPECT_NE(nullptr, snapshot);
+        return unique_cJSON_ptr(cJSON_Parse(snapshot->valuestring));
+    };
+
+    // Without a (known) generation we get all of the stats
+    auto full = getSnapshot("0");
+    ASSERT_NE(nullptr, full.get());
+    EXPECT_EQ(cJSON_False, cJSON_GetObjectItem(full.get(), "delta")->type);
+    auto* stats = cJSON_GetObjectItem(full.get(), "stats");
+    ASSERT_NE(nullptr, stats);
+    EXPECT_NE(nullptr, cJSON_GetObjectItem(stats, "pid"));
+    const auto generation =
+            cJSON_GetObjectItem(full.get(), "generation")->valueint;
+    EXPECT_LT(0, generation);
+
+    // With it only what changed since, which doesn't include the pid
+    auto delta = getSnapshot(std::to_string(generation));
+    ASSERT_NE(nullptr, delta.get());
+    EXPECT_EQ(cJSON_True, cJSON_GetObjectItem(delta.get(), "delta")->type);
+    EXPECT_EQ(generation + 1,
+              cJSON_GetObjectItem(delta.get(), "generation")->valueint);
+    stats = cJSON_GetObjectItem(delta.get(), "stats");
+    ASSERT_NE(nullptr, stats);
+    EXPECT_EQ(nullptr, cJSON_GetObjectItem(stats, "pid"));
+    EXPECT_NE(nullptr, cJSON_GetObjectItem(delta.get(), "removed"));
+
+    // An old generation gets all of them again
+    full = getSnapshot(std::to_string(generation));
+    ASSERT_NE(nullptr, full.get());
+    EXPECT_EQ(cJSON_False, cJSON_GetObjectItem(full.get(), "delta")->type);
+
+    // The groups implemented by the core can't be snapshotted
+    try {
+        conn.stats("snapshot 0 settings");
+        FAIL() << "settings can't be snapshotted";
+    } catch (ConnectionError& error) {
+        EXPECT_TRUE(error.isInvalidArguments()) << error.getReason();
+    }
+}
+
+TEST_P(StatsTest, TimingsSubscription) {
+    auto& conn = getAdminConnection();
+    conn.selectBucket("default");
+
+    auto second = conn.clone();
+    second->authenticate("@admin", "password", "PLAIN");
+
+    // The timings may only be pushed to a duplex connection
+    const std::string key{"timings.subscribe?buckets=default&opcodes=GET"};
+    try {
+        second->ioctl_set(key, "1");
+        FAIL() << "It should not be possible to subscribe without duplex";
+    } catch (ConnectionError& error) {
+        EXPECT_TRUE(error.isNotSupported()) << error.getReason();
+    }
+
+    second->setDuplexSupport(true);
+    try {
+        second->ioctl_set(
+                "timings.subscribe?buckets=default&opcodes=NO_SUCH_OP", "1");
+        FAIL() << "It should not be possible to subscribe to unknown opcodes";
+    } catch (ConnectionError& error) {
+        EXPECT_TRUE(error.isInvalidArguments()) << error.getReason();
+    }
+    second->ioctl_set(key, "1");
+
+    Document doc;
+    doc.info.id = name;
+    doc.value = "value";
+    conn.mutate(doc, 0, MutationType::Set);
+    conn.get(name, 0);
+
+    // Only the samples recorded since the subscription was made are pushed
+    Frame frame;
+    second->recvFrame(frame, false);
+    ASSERT_EQ(cb::mcbp::Magic::ServerRequest, frame.getMagic());
+    const auto* request = frame.getRequest();
+    ASSERT_EQ(cb::mcbp::ServerOpcode::TimingsNotification,
+              request->getServerOpcode());
+
+    const auto bucket = request->getKey();
+    EXPECT_EQ("default",
+              std::string(reinterpret_cast<const char*>(bucket.data()),
+                          bucket.size()));
+
+    const auto value = request->getValue();
+    unique_cJSON_ptr json(cJSON_Parse(
+            std::string(reinterpret_cast<const char*>(value.data()),
+                        value.size())
+                    .c_str()));
+    ASSERT_NE(nullptr, json.get());
+    EXPECT_EQ(1, cJSON_GetObjectItem(json.get(), "interval")->valueint);
+    auto* timings = cJSON_GetObjectItem(json.get(), "timings");
+    ASSERT_NE(nullptr, timings);
+    auto* get = cJSON_GetObjectItem(timings, "GET");
+    ASSERT_NE(nullptr, get);
+    EXPECT_EQ(nullptr, cJSON_GetObjectItem(timings, "SET"));
+    auto* percentiles = cJSON_GetObjectItem(get, "percentiles");
+    ASSERT_NE(nullptr, percentiles);
+    EXPECT_LT(0, cJSON_GetObjectItem(percentiles, "50")->valuedouble);
+}
+
 TEST_P(StatsTest, TracingStatsIsPrivileged) {
     MemcachedConnection& conn = getConnection();
 
@@ -0,0 +1,105 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "testapp.h"
+#include "testapp_client_test.h"
+
+#include <algorithm>
+#include <set>
+
+class UnorderedExecutionTest : public TestappClientTest {
+public:
+    void SetUp() override {
+        TestappClientTest::SetUp();
+
+        document.info.cas = mcbp::cas::Wildcard;
+        document.info.datatype = cb::mcbp::Datatype::Raw;
+        document.info.flags = 0xcaffee;
+        const std::string content = "Hello world";
+        std::copy(content.begin(), content.end(),
+                  std::back_inserter(document.value));
+    }
+
+protected:
+    Document document;
+};
+
+INSTANTIATE_TEST_CASE_P(TransportProtocols,
+                        UnorderedExecutionTest,
+                        ::testing::Values(TransportProtocols::McbpPlain,
+                                          TransportProtocols::McbpSsl),
+                        ::testing::PrintToStringParamName());
+
+/**
+ * Verify that a GET blocking in the engine don't prevent the server from
+ * executing (and returning the result of) the following commands in the
+ * pipeline, and that we get the response for all of them.
+ */
+TEST_P(UnorderedExecutionTest, BlockedGetDontBlockPipeline) {
+    auto& conn = getConnection();
+    std::set<std::string> keys;
+    for (int ii = 0; ii < 4; ++ii) {
+        document.info.id = name + std::to_string(ii);
+        conn.mutate(document, 0, MutationType::Set);
+        keys.insert(document.info.id);
+    }
+
+    conn.setUnorderedExecutionMode(ExecutionMode::Unordered);
+
+    // Make the first GET return EWOULDBLOCK (the engine notifies the
+    // cookie once it is ready). That command gets parked while the
+    // server keeps on executing the rest of them.
+    conn.configureEwouldBlockEngine(EWBEngineMode::Next_N,
+                                    ENGINE_EWOULDBLOCK,
+                                    1);
+
+    for (const auto& key : keys) {
+        BinprotGetCommand cmd;
+        cmd.setOp(PROTOCOL_BINARY_CMD_GETK);
+        cmd.setKey(key);
+        conn.sendCommand(cmd);
+    }
+
+    std::set<std::string> received;
+    for (size_t ii = 0; ii < keys.size(); ++ii) {
+        BinprotResponse rsp;
+        conn.recvResponse(rsp);
+        ASSERT_TRUE(rsp.isSuccess())
+                << memcached_status_2_text(rsp.getStatus());
+        received.insert(rsp.getKeyString());
+    }
+    EXPECT_EQ(keys, received);
+
+    conn.disableEwouldBlockEngine();
+    conn.setUnorderedExecutionMode(ExecutionMode::Ordered);
+}
+
+/**
+ * It should not be possible to select a bucket in unordered execution
+ * mode as the parked commands would be executed in the new bucket.
+ */
+TEST_P(UnorderedExecutionTest, SelectBucketNotSupported) {
+    auto& conn = getAdminConnection();
+    conn.setUnorderedExecutionMode(ExecutionMode::Unordered);
+    try {
+        conn.selectBucket("default");
+        FAIL() << "Select bucket should fail in unordered execution mode";
+    } catch (const ConnectionError& error) {
+        EXPECT_TRUE(error.isNotSupported()) << error.what();
+    }
+    conn.setUnorderedExecutionMode(ExecutionMode::Ordered);
+    conn.selectBucket("default");
+}
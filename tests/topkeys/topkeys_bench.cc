@@ -16,6 +16,7 @@
  */
 #include "daemon/topkeys.h"
 
+#include <cJSON_utils.h>
 #include <gtest/gtest.h>
 #include <memory>
 
@@ -56,3 +57,55 @@ TEST_F(TopKeysTest, Basic) {
     topkeys->stats(&count, 0, dump_key);
     EXPECT_EQ(80, count);
 }
+
+TEST_F(TopKeysTest, MergeThreads) {
+    topkeys.reset(new TopKeys(10, 4));
+
+    // Let every thread access the same keys; each key should only be
+    // reported once with the accesses of all of the threads. Use few
+    // enough keys that none of them may be evicted from its shard.
+    std::vector<std::string> keys;
+    for (int ii = 0; ii < 10; ii++) {
+        keys.emplace_back("topkey_test_" + std::to_string(ii));
+    }
+    for (size_t thread = 0; thread < 4; ++thread) {
+        for (auto& key : keys) {
+            topkeys->updateKey(key.c_str(), key.size(), 0, thread);
+        }
+    }
+
+    unique_cJSON_ptr json(cJSON_CreateObject());
+    ASSERT_EQ(ENGINE_SUCCESS, topkeys->json_stats(json.get(), 0));
+    auto* array = cJSON_GetObjectItem(json.get(), "topkeys");
+    ASSERT_NE(nullptr, array);
+    size_t count = 0;
+    for (auto* child = array->child; child != nullptr; child = child->next) {
+        EXPECT_EQ(4, cJSON_GetObjectItem(child, "access_count")->valueint);
+        ++count;
+    }
+    EXPECT_EQ(keys.size(), count);
+}
+
+TEST_F(TopKeysTest, Sampled) {
+    settings.setTopkeysSampleRate(100);
+
+    const std::string key = "topkey_test";
+    for (int ii = 0; ii < 100000; ii++) {
+        topkeys->updateKey(key.c_str(), key.size(), 0);
+    }
+    settings.setTopkeysSampleRate(1);
+
+    unique_cJSON_ptr json(cJSON_CreateObject());
+    ASSERT_EQ(ENGINE_SUCCESS, topkeys->json_stats(json.get(), 0));
+    auto* array = cJSON_GetObjectItem(json.get(), "topkeys");
+    ASSERT_NE(nullptr, array);
+    ASSERT_NE(nullptr, array->child);
+
+    // Every sample counts as 100 accesses, so the estimate should be
+    // close to the real number of accesses
+    const auto estimate =
+            cJSON_GetObjectItem(array->child, "access_count")->valueint;
+    EXPECT_EQ(0, estimate % 100);
+    EXPECT_LT(90000, estimate);
+    EXPECT_GT(110000, estimate);
+}
@@ -0,0 +1,92 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/tracer.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using cb::tracing::ScopedSpan;
+using cb::tracing::TraceCode;
+using cb::tracing::Tracer;
+
+TEST(TracerTest, Empty) {
+    Tracer tracer;
+    EXPECT_TRUE(tracer.empty());
+    EXPECT_EQ("", tracer.to_string());
+    for (int ii = 0; ii < int(TraceCode::Count); ++ii) {
+        EXPECT_FALSE(tracer.isActive(TraceCode(ii)));
+        EXPECT_EQ(ProcessClock::duration::zero(),
+                  tracer.getDuration(TraceCode(ii)));
+    }
+}
+
+TEST(TracerTest, BeginEnd) {
+    Tracer tracer;
+    tracer.begin(TraceCode::Engine);
+    EXPECT_TRUE(tracer.isActive(TraceCode::Engine));
+    EXPECT_FALSE(tracer.empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    tracer.end(TraceCode::Engine);
+    EXPECT_FALSE(tracer.isActive(TraceCode::Engine));
+
+    const auto duration = tracer.getDuration(TraceCode::Engine);
+    EXPECT_LE(std::chrono::milliseconds(2), duration);
+
+    // Ending a span which isn't running doesn't change anything
+    tracer.end(TraceCode::Engine);
+    EXPECT_EQ(duration, tracer.getDuration(TraceCode::Engine));
+}
+
+TEST(TracerTest, Accumulate) {
+    Tracer tracer;
+    for (int ii = 0; ii < 2; ++ii) {
+        ScopedSpan span(tracer, TraceCode::Ewouldblock);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_FALSE(tracer.isActive(TraceCode::Ewouldblock));
+    EXPECT_LE(std::chrono::milliseconds(2),
+              tracer.getDuration(TraceCode::Ewouldblock));
+}
+
+TEST(TracerTest, ActiveDuration) {
+    Tracer tracer;
+    tracer.begin(TraceCode::Request);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_LE(std::chrono::milliseconds(1),
+              tracer.getDuration(TraceCode::Request));
+    EXPECT_TRUE(tracer.isActive(TraceCode::Request));
+}
+
+TEST(TracerTest, ToString) {
+    Tracer tracer;
+    { ScopedSpan span(tracer, TraceCode::Validate); }
+    { ScopedSpan span(tracer, TraceCode::SendQueue); }
+
+    const auto text = tracer.to_string();
+    EXPECT_EQ(0, text.find("validate="));
+    EXPECT_NE(std::string::npos, text.find(" send_queue="));
+    EXPECT_EQ(std::string::npos, text.find("engine"));
+}
+
+TEST(TracerTest, Clear) {
+    Tracer tracer;
+    tracer.begin(TraceCode::Request);
+    { ScopedSpan span(tracer, TraceCode::Rbac); }
+    tracer.clear();
+    EXPECT_TRUE(tracer.empty());
+    EXPECT_FALSE(tracer.isActive(TraceCode::Request));
+}
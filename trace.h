@@ -46,6 +46,20 @@
 #define MEMCACHED_CONN_DISPATCH_ENABLED() (0)
 #define MEMCACHED_CONN_RELEASE(arg0)
 #define MEMCACHED_CONN_RELEASE_ENABLED() (0)
+#define MEMCACHED_EP_BACKFILL_RUN(arg0, arg1, arg2, arg3)
+#define MEMCACHED_EP_BACKFILL_RUN_ENABLED() (0)
+#define MEMCACHED_EP_BGFETCH_DONE(arg0, arg1, arg2)
+#define MEMCACHED_EP_BGFETCH_DONE_ENABLED() (0)
+#define MEMCACHED_EP_BGFETCH_START(arg0, arg1)
+#define MEMCACHED_EP_BGFETCH_START_ENABLED() (0)
+#define MEMCACHED_EP_CHECKPOINT_CREATE(arg0, arg1, arg2, arg3)
+#define MEMCACHED_EP_CHECKPOINT_CREATE_ENABLED() (0)
+#define MEMCACHED_EP_FLUSH_DONE(arg0, arg1, arg2)
+#define MEMCACHED_EP_FLUSH_DONE_ENABLED() (0)
+#define MEMCACHED_EP_FLUSH_START(arg0)
+#define MEMCACHED_EP_FLUSH_START_ENABLED() (0)
+#define MEMCACHED_EP_ITEM_EVICT(arg0, arg1, arg2, arg3)
+#define MEMCACHED_EP_ITEM_EVICT_ENABLED() (0)
 #define MEMCACHED_ITEM_LINK(arg0, arg1, arg2)
 #define MEMCACHED_ITEM_LINK_ENABLED() (0)
 #define MEMCACHED_ITEM_REMOVE(arg0, arg1, arg2)
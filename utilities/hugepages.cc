@@ -0,0 +1,124 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+
+#include <memcached/hugepages.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace cb {
+namespace hugepages {
+
+size_t roundUp(size_t size) {
+    return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+size_t alignedBytes(const void* ptr, size_t size) {
+    const auto begin = roundUp(uintptr_t(ptr));
+    const auto end = (uintptr_t(ptr) + size) & ~(pageSize - 1);
+    return end > begin ? end - begin : 0;
+}
+
+bool isTransparentSupported() {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // The selected mode is in brackets, for instance
+    // "always [madvise] never"
+    static const bool supported = []() {
+        std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string modes;
+        if (!std::getline(file, modes)) {
+            return false;
+        }
+        return modes.find("[never]") == std::string::npos;
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+size_t advise(void* ptr, size_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const auto bytes = alignedBytes(ptr, size);
+    if (bytes == 0 || !isTransparentSupported()) {
+        return 0;
+    }
+    // It's only a hint; if the kernel refuses the memory is still usable
+    madvise(reinterpret_cast<void*>(roundUp(uintptr_t(ptr))),
+            bytes,
+            MADV_HUGEPAGE);
+    return bytes;
+#else
+    (void)ptr;
+    (void)size;
+    return 0;
+#endif
+}
+
+void* map(size_t size, Backing& backing) {
+    backing = Backing::Regular;
+#ifdef __linux__
+    size = roundUp(size);
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+    void* ptr = mmap(nullptr, size, prot, flags | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+        backing = Backing::Explicit;
+        return ptr;
+    }
+#endif
+
+    // Map an extra huge page, and trim the region down to the aligned
+    // huge pages so that all of it may be backed by transparent ones
+    auto* base = static_cast<char*>(
+            mmap(nullptr, size + pageSize, prot, flags, -1, 0));
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    auto* aligned = reinterpret_cast<char*>(roundUp(uintptr_t(base)));
+    if (aligned != base) {
+        munmap(base, aligned - base);
+    }
+    munmap(aligned + size, (base + pageSize) - aligned);
+    if (advise(aligned, size) != 0) {
+        backing = Backing::Transparent;
+    }
+    return aligned;
+#else
+    (void)size;
+    return nullptr;
+#endif
+}
+
+void unmap(void* ptr, size_t size) {
+#ifdef __linux__
+    munmap(ptr, roundUp(size));
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
+} // namespace hugepages
+} // namespace cb
@@ -0,0 +1,411 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+
+#include <memcached/json_validator.h>
+
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace cb {
+namespace json {
+
+namespace {
+
+/**
+ * Skip the characters in a string which don't need any special
+ * treatment (printable ASCII other than '"' and '\') 16 bytes at a time.
+ * Leaves ptr at the first special character, or at the last (partial)
+ * chunk of the buffer which the caller needs to scan byte by byte.
+ */
+inline void skipPlainChars(const uint8_t*& ptr, const uint8_t* end) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x20);
+    while (end - ptr >= 16) {
+        const __m128i chunk =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        // As signed chars both the control characters and the bytes
+        // of a multi-byte UTF-8 sequence are "less than" a space
+        const __m128i special =
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                          _mm_cmpeq_epi8(chunk, backslash)),
+                             _mm_cmplt_epi8(chunk, control));
+        const int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            ptr += __builtin_ctz(mask);
+            return;
+        }
+        ptr += 16;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const int8x16_t control = vdupq_n_s8(0x20);
+    while (end - ptr >= 16) {
+        const uint8x16_t chunk = vld1q_u8(ptr);
+        const uint8x16_t special = vorrq_u8(
+                vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+                vcltq_s8(vreinterpretq_s8_u8(chunk), control));
+        if (vmaxvq_u8(special) != 0) {
+            // Let the caller locate the character within the chunk
+            return;
+        }
+        ptr += 16;
+    }
+#else
+    (void)ptr;
+    (void)end;
+#endif
+}
+
+/**
+ * The stack of the containers we're in ('{' or '['). The first levels
+ * are kept inline so that we don't need to allocate memory for the
+ * documents we normally see.
+ */
+class Stack {
+public:
+    void push(uint8_t container) {
+        if (depth < InlineDepth) {
+            inlined[depth] = container;
+        } else {
+            overflow.push_back(char(container));
+        }
+        ++depth;
+    }
+
+    void pop() {
+        --depth;
+        if (depth >= InlineDepth) {
+            overflow.pop_back();
+        }
+    }
+
+    bool empty() const {
+        return depth == 0;
+    }
+
+    uint8_t top() const {
+        if (depth <= InlineDepth) {
+            return inlined[depth - 1];
+        }
+        return uint8_t(overflow.back());
+    }
+
+private:
+    static const size_t InlineDepth = 64;
+    uint8_t inlined[InlineDepth];
+    std::string overflow;
+    size_t depth = 0;
+};
+
+template <bool Vectorized>
+class Parser {
+public:
+    Parser(const uint8_t* data, size_t size) : ptr(data), end(data + size) {
+    }
+
+    bool parse() {
+        Stack stack;
+
+        for (;;) {
+            // Parse the next value
+            skipWhitespace();
+            if (ptr == end) {
+                return false;
+            }
+
+            switch (*ptr) {
+            case '{':
+                ++ptr;
+                skipWhitespace();
+                if (ptr < end && *ptr == '}') {
+                    ++ptr;
+                    break;
+                }
+                stack.push('{');
+                if (!member()) {
+                    return false;
+                }
+                continue;
+            case '[':
+                ++ptr;
+                skipWhitespace();
+                if (ptr < end && *ptr == ']') {
+                    ++ptr;
+                    break;
+                }
+                stack.push('[');
+                continue;
+            case '"':
+                if (!string()) {
+                    return false;
+                }
+                break;
+            case 't':
+                if (!literal("true", 4)) {
+                    return false;
+                }
+                break;
+            case 'f':
+                if (!literal("false", 5)) {
+                    return false;
+                }
+                break;
+            case 'n':
+                if (!literal("null", 4)) {
+                    return false;
+                }
+                break;
+            default:
+                if (!number()) {
+                    return false;
+                }
+            }
+
+            // We've got a complete value; close the containers it ends
+            // until we find the separator of the next value
+            bool more = false;
+            while (!more) {
+                skipWhitespace();
+                if (stack.empty()) {
+                    return ptr == end;
+                }
+                if (ptr == end) {
+                    return false;
+                }
+
+                const auto container = stack.top();
+                if (*ptr == ',') {
+                    ++ptr;
+                    if (container == '{' && !member()) {
+                        return false;
+                    }
+                    more = true;
+                } else if (*ptr == (container == '{' ? '}' : ']')) {
+                    ++ptr;
+                    stack.pop();
+                } else {
+                    return false;
+                }
+            }
+        }
+    }
+
+private:
+    void skipWhitespace() {
+        while (ptr < end &&
+               (*ptr == ' ' || *ptr == '\n' || *ptr == '\r' || *ptr == '\t')) {
+            ++ptr;
+        }
+    }
+
+    /// Parse the name of an object member and the following colon
+    bool member() {
+        skipWhitespace();
+        if (ptr == end || *ptr != '"' || !string()) {
+            return false;
+        }
+        skipWhitespace();
+        if (ptr == end || *ptr != ':') {
+            return false;
+        }
+        ++ptr;
+        return true;
+    }
+
+    bool string() {
+        ++ptr; // the opening quote
+        for (;;) {
+            if (Vectorized) {
+                skipPlainChars(ptr, end);
+            }
+            if (ptr == end) {
+                return false;
+            }
+
+            const uint8_t c = *ptr;
+            if (c == '"') {
+                ++ptr;
+                return true;
+            } else if (c == '\\') {
+                if (!escape()) {
+                    return false;
+                }
+            } else if (c < 0x20) {
+                return false;
+            } else if (c >= 0x80) {
+                if (!utf8()) {
+                    return false;
+                }
+            } else {
+                ++ptr;
+            }
+        }
+    }
+
+    bool escape() {
+        ++ptr; // the backslash
+        if (ptr == end) {
+            return false;
+        }
+
+        switch (*ptr) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            ++ptr;
+            return true;
+        case 'u':
+            ++ptr;
+            if (end - ptr < 4) {
+                return false;
+            }
+            for (int ii = 0; ii < 4; ++ii, ++ptr) {
+                const uint8_t c = *ptr;
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+                      (c >= 'A' && c <= 'F'))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /// Validate a multi-byte UTF-8 sequence (no overlong encodings,
+    /// surrogates or code points above U+10FFFF)
+    bool utf8() {
+        const uint8_t lead = *ptr;
+        ptrdiff_t continuation;
+        uint8_t low = 0x80;
+        uint8_t high = 0xbf;
+
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            continuation = 1;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            continuation = 2;
+            if (lead == 0xe0) {
+                low = 0xa0;
+            } else if (lead == 0xed) {
+                high = 0x9f;
+            }
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            continuation = 3;
+            if (lead == 0xf0) {
+                low = 0x90;
+            } else if (lead == 0xf4) {
+                high = 0x8f;
+            }
+        } else {
+            return false;
+        }
+
+        if (end - ptr <= continuation) {
+            return false;
+        }
+
+        // The second byte has the tighter range
+        if (ptr[1] < low || ptr[1] > high) {
+            return false;
+        }
+        for (ptrdiff_t ii = 2; ii <= continuation; ++ii) {
+            if ((ptr[ii] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        ptr += continuation + 1;
+        return true;
+    }
+
+    bool digits() {
+        const auto start = ptr;
+        while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+            ++ptr;
+        }
+        return ptr != start;
+    }
+
+    bool number() {
+        if (*ptr == '-') {
+            ++ptr;
+        }
+        if (ptr == end) {
+            return false;
+        }
+        if (*ptr == '0') {
+            ++ptr;
+        } else if (!digits()) {
+            return false;
+        }
+
+        if (ptr < end && *ptr == '.') {
+            ++ptr;
+            if (!digits()) {
+                return false;
+            }
+        }
+
+        if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+            ++ptr;
+            if (ptr < end && (*ptr == '+' || *ptr == '-')) {
+                ++ptr;
+            }
+            if (!digits()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool literal(const char* word, size_t len) {
+        if (size_t(end - ptr) < len || std::memcmp(ptr, word, len) != 0) {
+            return false;
+        }
+        ptr += len;
+        return true;
+    }
+
+    const uint8_t* ptr;
+    const uint8_t* const end;
+};
+
+} // anonymous namespace
+
+bool isValidJson(const uint8_t* data, size_t size) {
+    return Parser<true>(data, size).parse();
+}
+
+bool isValidJsonScalar(const uint8_t* data, size_t size) {
+    return Parser<false>(data, size).parse();
+}
+
+} // namespace json
+} // namespace cb
@@ -0,0 +1,144 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+
+#include <memcached/numa.h>
+
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace cb {
+namespace numa {
+
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> ret;
+    size_t pos = 0;
+
+    auto number = [&list, &pos]() -> int {
+        const auto start = pos;
+        int value = 0;
+        while (pos < list.size() && isdigit(list[pos])) {
+            value = value * 10 + (list[pos] - '0');
+            ++pos;
+        }
+        if (pos == start) {
+            throw std::invalid_argument("parseCpuList: invalid list \"" +
+                                        list + "\"");
+        }
+        return value;
+    };
+
+    // sysfs terminates the list with a newline
+    auto end = list.find_last_not_of("\n ");
+    if (end == std::string::npos) {
+        return ret;
+    }
+
+    while (pos <= end) {
+        const int first = number();
+        int last = first;
+        if (pos <= end && list[pos] == '-') {
+            ++pos;
+            last = number();
+            if (last < first) {
+                throw std::invalid_argument("parseCpuList: invalid range \"" +
+                                            list + "\"");
+            }
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            ret.push_back(cpu);
+        }
+        if (pos <= end) {
+            if (list[pos] != ',') {
+                throw std::invalid_argument("parseCpuList: invalid list \"" +
+                                            list + "\"");
+            }
+            ++pos;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Read the CPUs of each of the NUMA nodes. Nodes without CPUs (memory
+ * only nodes) are skipped as we can't run threads on them.
+ */
+static std::vector<std::vector<int>> readTopology() {
+    std::vector<std::vector<int>> ret;
+#ifdef __linux__
+    try {
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string nodes;
+        if (std::getline(online, nodes)) {
+            for (auto node : parseCpuList(nodes)) {
+                std::ifstream file("/sys/devices/system/node/node" +
+                                   std::to_string(node) + "/cpulist");
+                std::string cpus;
+                if (std::getline(file, cpus)) {
+                    auto list = parseCpuList(cpus);
+                    if (!list.empty()) {
+                        ret.emplace_back(std::move(list));
+                    }
+                }
+            }
+        }
+    } catch (const std::exception&) {
+        ret.clear();
+    }
+#endif
+    return ret;
+}
+
+static const std::vector<std::vector<int>>& getTopology() {
+    static const std::vector<std::vector<int>> topology = readTopology();
+    return topology;
+}
+
+size_t getNumNodes() {
+    const auto& topology = getTopology();
+    return topology.empty() ? 1 : topology.size();
+}
+
+bool bindCurrentThreadToNode(size_t node) {
+    const auto& topology = getTopology();
+    if (topology.empty()) {
+        return false;
+    }
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : topology[node % topology.size()]) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+} // namespace numa
+} // namespace cb
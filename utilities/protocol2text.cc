@@ -62,6 +62,7 @@ static const std::map<uint8_t, std::string> commandmap {
     {PROTOCOL_BINARY_CMD_CONFIG_VALIDATE,"CONFIG_VALIDATE"},
     {PROTOCOL_BINARY_CMD_CONFIG_RELOAD,"CONFIG_RELOAD"},
     {PROTOCOL_BINARY_CMD_SHUTDOWN,"SHUTDOWN"},
+    {PROTOCOL_BINARY_CMD_GET_MULTI,"GET_MULTI"},
     {PROTOCOL_BINARY_CMD_AUDIT_PUT,"AUDIT_PUT"},
     {PROTOCOL_BINARY_CMD_AUDIT_CONFIG_RELOAD,"AUDIT_CONFIG_RELOAD"},
     {PROTOCOL_BINARY_CMD_RGET,"RGET"},
@@ -141,6 +142,9 @@ static const std::map<uint8_t, std::string> commandmap {
     {PROTOCOL_BINARY_CMD_GET_RANDOM_KEY,"GET_RANDOM_KEY"},
     {PROTOCOL_BINARY_CMD_SEQNO_PERSISTENCE,"SEQNO_PERSISTENCE"},
     {PROTOCOL_BINARY_CMD_GET_KEYS,"GET_KEYS"},
+    {PROTOCOL_BINARY_CMD_RANGE_SCAN,"RANGE_SCAN"},
+    {PROTOCOL_BINARY_CMD_WITH_META_BATCH,"WITH_META_BATCH"},
+    {PROTOCOL_BINARY_CMD_GET_META_MULTI,"GET_META_MULTI"},
     {PROTOCOL_BINARY_CMD_GET_ADJUSTED_TIME,"GET_ADJUSTED_TIME"},
     {PROTOCOL_BINARY_CMD_SET_DRIFT_COUNTER_STATE,"SET_DRIFT_COUNTER_STATE"},
     {PROTOCOL_BINARY_CMD_SUBDOC_GET,"SUBDOC_GET"},
@@ -24,6 +24,9 @@
 
 #include <memcached/util.h>
 #include <memcached/config_parser.h>
+#include <memcached/hugepages.h>
+#include <memcached/json_validator.h>
+#include <memcached/numa.h>
 #include "string_utilities.h"
 
 #include <gtest/gtest.h>
@@ -475,3 +478,137 @@ TEST(ConfigParserTest, A) {
     EXPECT_EQ(0, fclose(error));
     remove(outfile);
 }
+
+TEST(NumaTest, parseCpuList) {
+    using cb::numa::parseCpuList;
+    EXPECT_EQ(std::vector<int>({0}), parseCpuList("0"));
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 8, 10, 11}),
+              parseCpuList("0-3,8,10-11"));
+    // sysfs terminates the list with a newline
+    EXPECT_EQ(std::vector<int>({4, 5}), parseCpuList("4-5\n"));
+    EXPECT_TRUE(parseCpuList("").empty());
+
+    EXPECT_THROW(parseCpuList("a"), std::invalid_argument);
+    EXPECT_THROW(parseCpuList("1-"), std::invalid_argument);
+    EXPECT_THROW(parseCpuList("3-1"), std::invalid_argument);
+    EXPECT_THROW(parseCpuList("1,,2"), std::invalid_argument);
+    EXPECT_THROW(parseCpuList("1;2"), std::invalid_argument);
+}
+
+TEST(NumaTest, getNumNodes) {
+    EXPECT_LE(1u, cb::numa::getNumNodes());
+}
+
+TEST(HugePagesTest, alignedBytes) {
+    using namespace cb::hugepages;
+    EXPECT_EQ(0u, roundUp(0));
+    EXPECT_EQ(pageSize, roundUp(1));
+    EXPECT_EQ(2 * pageSize, roundUp(pageSize + 1));
+
+    auto* aligned = reinterpret_cast<char*>(16 * pageSize);
+    EXPECT_EQ(2 * pageSize, alignedBytes(aligned, 2 * pageSize));
+    EXPECT_EQ(pageSize, alignedBytes(aligned + 1, 2 * pageSize));
+    EXPECT_EQ(0u, alignedBytes(aligned + 1, pageSize));
+    EXPECT_EQ(0u, alignedBytes(aligned, pageSize - 1));
+}
+
+TEST(HugePagesTest, map) {
+    using namespace cb::hugepages;
+    Backing backing;
+    auto* ptr = static_cast<char*>(map(pageSize + 1, backing));
+    if (ptr == nullptr) {
+        // Not supported on this platform
+        EXPECT_EQ(Backing::Regular, backing);
+        return;
+    }
+    EXPECT_EQ(0u, uintptr_t(ptr) % pageSize);
+    EXPECT_EQ(0, ptr[0]);
+    EXPECT_EQ(0, ptr[2 * pageSize - 1]);
+    ptr[2 * pageSize - 1] = 'x';
+    unmap(ptr, pageSize + 1);
+}
+
+static bool isValidJson(const std::string& doc) {
+    auto* ptr = reinterpret_cast<const uint8_t*>(doc.data());
+    const bool ret = cb::json::isValidJson(ptr, doc.size());
+    // The vectorized and the scalar scanner must agree
+    EXPECT_EQ(ret, cb::json::isValidJsonScalar(ptr, doc.size())) << doc;
+    return ret;
+}
+
+TEST(JsonValidatorTest, Values) {
+    EXPECT_TRUE(isValidJson("{}"));
+    EXPECT_TRUE(isValidJson(" [ ] "));
+    EXPECT_TRUE(isValidJson("\"string\""));
+    EXPECT_TRUE(isValidJson("-0.5e+10"));
+    EXPECT_TRUE(isValidJson("true"));
+    EXPECT_TRUE(isValidJson("false"));
+    EXPECT_TRUE(isValidJson("null"));
+    EXPECT_TRUE(isValidJson(
+            "{\"a\":1,\"b\":[1,2,{\"c\":null}],\"d\":\"\\u00e9\\n\\\"\"}"));
+
+    EXPECT_FALSE(isValidJson(""));
+    EXPECT_FALSE(isValidJson(" "));
+    EXPECT_FALSE(isValidJson("{"));
+    EXPECT_FALSE(isValidJson("[1,]"));
+    EXPECT_FALSE(isValidJson("[1 2]"));
+    EXPECT_FALSE(isValidJson("{\"a\"}"));
+    EXPECT_FALSE(isValidJson("{1:2}"));
+    EXPECT_FALSE(isValidJson("[}"));
+    EXPECT_FALSE(isValidJson("{} {}"));
+    EXPECT_FALSE(isValidJson("01"));
+    EXPECT_FALSE(isValidJson("1."));
+    EXPECT_FALSE(isValidJson("1e"));
+    EXPECT_FALSE(isValidJson("tru"));
+    EXPECT_FALSE(isValidJson("\"\\x\""));
+    EXPECT_FALSE(isValidJson("\"\\u12g4\""));
+    EXPECT_FALSE(isValidJson("binary data"));
+}
+
+TEST(JsonValidatorTest, Strings) {
+    // Make the strings long enough to be scanned in chunks, with the
+    // special characters at different offsets
+    for (size_t ii = 0; ii < 40; ++ii) {
+        const std::string prefix = "[\"" + std::string(ii, 'a');
+        const std::string suffix = std::string(40 - ii, 'b') + "\"]";
+        EXPECT_TRUE(isValidJson(prefix + suffix));
+        EXPECT_TRUE(isValidJson(prefix + "\\\"" + suffix));
+        EXPECT_TRUE(isValidJson(prefix + "\xc3\xa9" + suffix));
+        EXPECT_TRUE(isValidJson(prefix + "\xf0\x9f\x98\x80" + suffix));
+        EXPECT_FALSE(isValidJson(prefix + "\"" + suffix));
+        EXPECT_FALSE(isValidJson(prefix + "\x01" + suffix));
+        EXPECT_FALSE(isValidJson(prefix + "\xff" + suffix));
+        EXPECT_FALSE(isValidJson(prefix));
+    }
+}
+
+TEST(JsonValidatorTest, Utf8) {
+    EXPECT_TRUE(isValidJson("\"\xe2\x82\xac\""));
+    // Overlong encoding
+    EXPECT_FALSE(isValidJson("\"\xc0\xaf\""));
+    EXPECT_FALSE(isValidJson("\"\xe0\x80\xaf\""));
+    // Surrogate
+    EXPECT_FALSE(isValidJson("\"\xed\xa0\x80\""));
+    // Above U+10FFFF
+    EXPECT_FALSE(isValidJson("\"\xf4\x90\x80\x80\""));
+    // Truncated sequence
+    EXPECT_FALSE(isValidJson("\"\xe2\x82\""));
+}
+
+TEST(JsonValidatorTest, Nesting) {
+    // Deeper than the inline part of the stack
+    const size_t depth = 1000;
+    EXPECT_TRUE(isValidJson(std::string(depth, '[') + std::string(depth, ']')));
+    EXPECT_FALSE(
+            isValidJson(std::string(depth, '[') + std::string(depth - 1, ']')));
+
+    std::string doc;
+    for (size_t ii = 0; ii < 100; ++ii) {
+        doc += "{\"a\":[";
+    }
+    doc += "1";
+    for (size_t ii = 0; ii < 100; ++ii) {
+        doc += "]}";
+    }
+    EXPECT_TRUE(isValidJson(doc));
+}
@@ -0,0 +1,94 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+
+#include <xattr/blob_index.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace cb {
+namespace xattr {
+
+/// Compare two keys the way std::string would
+static bool less(cb::const_byte_buffer a, cb::const_byte_buffer b) {
+    const int ret = std::memcmp(a.buf, b.buf, std::min(a.len, b.len));
+    if (ret != 0) {
+        return ret < 0;
+    }
+    return a.len < b.len;
+}
+
+void BlobIndex::build(cb::const_byte_buffer xattrs) {
+    blob = xattrs;
+    entries.clear();
+    system_size = 0;
+    if (blob.len == 0) {
+        return;
+    }
+
+    // The global length field is counted as part of the system xattrs
+    system_size = 4;
+    size_t current = 4;
+    while (current + 4 <= blob.len) {
+        uint32_t size;
+        std::memcpy(&size, blob.buf + current, sizeof(size));
+        size = ntohl(size);
+
+        Entry entry;
+        entry.key = uint32_t(current + 4);
+        entry.keylen = uint32_t(
+                strlen(reinterpret_cast<const char*>(blob.buf + entry.key)));
+        entry.value = entry.key + entry.keylen + 1;
+        entry.valuelen = size - entry.keylen - 2;
+        entries.push_back(entry);
+
+        if (blob.buf[entry.key] == '_') {
+            system_size += size + 4;
+        }
+        current += 4 + size;
+    }
+
+    // The keys are stored in the order they were added, so we normally
+    // need to sort them (but there is no point if they already are)
+    const auto compare = [this](const Entry& a, const Entry& b) {
+        return less(keyOf(a), keyOf(b));
+    };
+    if (!std::is_sorted(entries.begin(), entries.end(), compare)) {
+        std::sort(entries.begin(), entries.end(), compare);
+    }
+}
+
+cb::const_byte_buffer BlobIndex::get(cb::const_byte_buffer key) const {
+    auto iter = std::lower_bound(
+            entries.begin(),
+            entries.end(),
+            key,
+            [this](const Entry& entry, cb::const_byte_buffer k) {
+                return less(keyOf(entry), k);
+            });
+    if (iter != entries.end() && iter->keylen == key.len &&
+        std::memcmp(blob.buf + iter->key, key.buf, key.len) == 0) {
+        return {blob.buf + iter->value, iter->valuelen};
+    }
+
+    // Not found!
+    return {nullptr, 0};
+}
+
+}
+}